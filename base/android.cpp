@@ -9,6 +9,12 @@
 #include "android.hpp"
 
 #if defined(__ANDROID__)
+#include <algorithm>
+#include <array>
+#include <ctime>
+
+#include <dlfcn.h>
+#include <android/choreographer.h>
 #include <android/configuration.h>
 
 int32_t vkx::android::screenDensity{ 0 };
@@ -22,4 +28,170 @@ void vkx::android::getDeviceConfig(AAssetManager* assetManager) {
     AConfiguration_delete(config);
 }
 
+namespace {
+
+// libandroid functions of API levels above the minimum
+using FrameCallback64 = void (*)(int64_t frameTimeNanos, void* data);
+using PostFrameCallback64 = void (*)(AChoreographer* choreographer, FrameCallback64 callback, void* data);
+using RefreshRateCallback = void (*)(int64_t vsyncPeriodNanos, void* data);
+using RefreshRateRegistration = void (*)(AChoreographer* choreographer, RefreshRateCallback callback, void* data);
+// AThermalManager is opaque, and its header is only usable from API level 30
+using AcquireThermalManager = void* (*)();
+using ReleaseThermalManager = void (*)(void* manager);
+using GetThermalStatus = int32_t (*)(void* manager);
+
+// Odd deltas, from vsyncs the loop was too busy to see, are left out by taking the shortest of the recent ones
+const size_t DELTA_COUNT = 16;
+
+struct FrameTiming {
+    void* library{ nullptr };
+    AChoreographer* choreographer{ nullptr };
+    PostFrameCallback64 postFrameCallback64{ nullptr };
+    RefreshRateRegistration registerRefreshRateCallback{ nullptr };
+    RefreshRateRegistration unregisterRefreshRateCallback{ nullptr };
+    void* thermalManager{ nullptr };
+    ReleaseThermalManager releaseThermalManager{ nullptr };
+    GetThermalStatus getThermalStatus{ nullptr };
+    bool running{ false };
+    // A frame callback is waiting to be called
+    bool posted{ false };
+
+    int64_t lastVsync{ 0 };
+    // From the refresh rate callback, which knows of changes before the deltas show them
+    int64_t reportedPeriod{ 0 };
+    std::array<int64_t, DELTA_COUNT> deltas{};
+    size_t deltaCount{ 0 };
+    // The vsync the previous waitForPresentSlot aimed for
+    int64_t presentSlot{ 0 };
+} timing;
+
+void postFrameCallback();
+
+void onVsync(int64_t frameTimeNanos) {
+    timing.posted = false;
+    if (timing.lastVsync && frameTimeNanos > timing.lastVsync) {
+        timing.deltas[timing.deltaCount % DELTA_COUNT] = frameTimeNanos - timing.lastVsync;
+        ++timing.deltaCount;
+    }
+    timing.lastVsync = frameTimeNanos;
+    if (timing.running) {
+        postFrameCallback();
+    }
+}
+
+void frameCallback64(int64_t frameTimeNanos, void*) {
+    onVsync(frameTimeNanos);
+}
+
+// The callback of API level 24, which takes a long, 32 bits on 32 bit ABIs
+void frameCallback(long frameTimeNanos, void*) {
+    onVsync(frameTimeNanos);
+}
+
+void refreshRateCallback(int64_t vsyncPeriodNanos, void*) {
+    timing.reportedPeriod = vsyncPeriodNanos;
+}
+
+void postFrameCallback() {
+    if (timing.posted) {
+        return;
+    }
+    timing.posted = true;
+    if (timing.postFrameCallback64) {
+        timing.postFrameCallback64(timing.choreographer, frameCallback64, nullptr);
+    } else {
+        AChoreographer_postFrameCallback(timing.choreographer, frameCallback, nullptr);
+    }
+}
+
+int64_t monotonicNow() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000ll + now.tv_nsec;
+}
+
+}  // namespace
+
+void vkx::android::startFrameTiming() {
+    if (timing.running) {
+        return;
+    }
+    if (!timing.library) {
+        timing.library = dlopen("libandroid.so", RTLD_NOW | RTLD_LOCAL);
+    }
+    if (timing.library) {
+        timing.postFrameCallback64 = (PostFrameCallback64)dlsym(timing.library, "AChoreographer_postFrameCallback64");
+        timing.registerRefreshRateCallback = (RefreshRateRegistration)dlsym(timing.library, "AChoreographer_registerRefreshRateCallback");
+        timing.unregisterRefreshRateCallback = (RefreshRateRegistration)dlsym(timing.library, "AChoreographer_unregisterRefreshRateCallback");
+        auto acquireThermalManager = (AcquireThermalManager)dlsym(timing.library, "AThermal_acquireManager");
+        timing.releaseThermalManager = (ReleaseThermalManager)dlsym(timing.library, "AThermal_releaseManager");
+        timing.getThermalStatus = (GetThermalStatus)dlsym(timing.library, "AThermal_getCurrentThermalStatus");
+        if (acquireThermalManager && timing.releaseThermalManager && timing.getThermalStatus) {
+            timing.thermalManager = acquireThermalManager();
+        }
+    }
+    timing.choreographer = AChoreographer_getInstance();
+    if (!timing.choreographer) {
+        return;
+    }
+    if (timing.registerRefreshRateCallback && timing.unregisterRefreshRateCallback) {
+        timing.registerRefreshRateCallback(timing.choreographer, refreshRateCallback, nullptr);
+    }
+    timing.lastVsync = 0;
+    timing.deltaCount = 0;
+    timing.presentSlot = 0;
+    timing.running = true;
+    postFrameCallback();
+}
+
+void vkx::android::stopFrameTiming() {
+    if (timing.choreographer && timing.registerRefreshRateCallback && timing.unregisterRefreshRateCallback) {
+        timing.unregisterRefreshRateCallback(timing.choreographer, refreshRateCallback, nullptr);
+    }
+    // A callback still posted finds running cleared and doesn't post another
+    timing.running = false;
+    if (timing.thermalManager) {
+        timing.releaseThermalManager(timing.thermalManager);
+        timing.thermalManager = nullptr;
+    }
+}
+
+int64_t vkx::android::vsyncPeriod() {
+    if (timing.reportedPeriod) {
+        return timing.reportedPeriod;
+    }
+    if (timing.deltaCount < 4) {
+        return 0;
+    }
+    const auto last = timing.deltas.begin() + std::min(timing.deltaCount, DELTA_COUNT);
+    return *std::min_element(timing.deltas.begin(), last);
+}
+
+int32_t vkx::android::thermalStatus() {
+    return timing.thermalManager ? timing.getThermalStatus(timing.thermalManager) : 0;
+}
+
+void vkx::android::waitForPresentSlot(uint32_t interval) {
+    const int64_t period = vsyncPeriod();
+    if (!period || !timing.lastVsync || interval < 2) {
+        timing.presentSlot = 0;
+        return;
+    }
+    const int64_t now = monotonicNow();
+    // The vsyncs are whole periods after the last one seen
+    int64_t slot = timing.presentSlot ? timing.presentSlot + period * interval : timing.lastVsync + period;
+    if (slot - period / 2 < now) {
+        // Running late, the next vsync there is still time for
+        const int64_t sinceLast = std::max<int64_t>(now - timing.lastVsync, 0);
+        slot = timing.lastVsync + (sinceLast / period + 1) * period;
+        if (slot - period / 2 < now) {
+            slot += period;
+        }
+    }
+    timing.presentSlot = slot;
+    const int64_t wake = slot - period / 2;
+    const timespec wakeTime{ (time_t)(wake / 1000000000ll), (long)(wake % 1000000000ll) };
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeTime, nullptr);
+}
+
 #endif
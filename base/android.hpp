@@ -25,6 +25,22 @@ extern int32_t screenDensity;
 extern android_app* androidApp;
 
 void getDeviceConfig(AAssetManager* assetManager);
+
+/*
+    Display refresh timing from the choreographer, and the thermal status, for vks::FramePacer.  The choreographer's
+    callbacks are dispatched by the looper of the thread that started them, so these are only called from the app's
+    main loop.  The functions newer than the minimum API level are looked up at runtime, and report nothing where
+    the platform doesn't have them.
+*/
+void startFrameTiming();
+void stopFrameTiming();
+// The refresh period in nanoseconds, 0 until the first few vsyncs were seen
+int64_t vsyncPeriod();
+// AThermal_getCurrentThermalStatus, from API level 30, otherwise ATHERMAL_STATUS_NONE
+int32_t thermalStatus();
+// Block until half a refresh before the vsync `interval` refreshes after the one the previous call waited for, so
+// a present right after lands on it.  Paces presents where VK_GOOGLE_display_timing isn't available.
+void waitForPresentSlot(uint32_t interval);
 }}  // namespace vkx::android
 
 #endif
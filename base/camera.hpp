@@ -14,6 +14,23 @@ class Camera {
 private:
     float fov;
     float znear, zfar;
+    glm::vec2 jitter{ 0.0f };
+    float aspect{ 1.0f };
+    uint32_t preRotation{ 0 };
+
+    void updatePerspective(float aspect) {
+        this->aspect = aspect;
+        // Targets rendered a quarter turn off the display are as tall as the view is wide
+        const bool swapsAxes = preRotation == 90 || preRotation == 270;
+        matrices.unjitteredPerspective = glm::perspective(glm::radians(fov), swapsAxes ? 1.0f / aspect : aspect, znear, zfar);
+        if (preRotation) {
+            matrices.unjitteredPerspective = glm::rotate(glm::mat4(1.0f), glm::radians((float)preRotation), glm::vec3(0.0f, 0.0f, 1.0f)) *
+                                             matrices.unjitteredPerspective;
+        }
+        applyJitter();
+    }
+
+    void applyJitter() { matrices.perspective = glm::translate(glm::mat4(1.0f), glm::vec3(jitter, 0.0f)) * matrices.unjitteredPerspective; }
 
     void updateViewMatrix() {
         glm::mat4 rotM = glm::mat4(1.0f);
@@ -49,7 +66,9 @@ public:
     float movementSpeed = 1.0f;
 
     struct {
+        // Offset by the jitter, if there is any
         glm::mat4 perspective;
+        glm::mat4 unjitteredPerspective;
         glm::mat4 view;
         glm::mat4 skyboxView;
     } matrices;
@@ -75,13 +94,29 @@ public:
         this->fov = fov;
         this->znear = znear;
         this->zfar = zfar;
-        matrices.perspective = glm::perspective(glm::radians(fov), aspect, znear, zfar);
+        updatePerspective(aspect);
     };
 
-    void updateAspectRatio(float aspect) { matrices.perspective = glm::perspective(glm::radians(fov), aspect, znear, zfar); }
+    void updateAspectRatio(float aspect) { updatePerspective(aspect); }
 
     void updateAspectRatio(const vk::Extent2D& size) { updateAspectRatio((float)size.width / (float)size.height); }
 
+    // Clockwise degrees the targets are rotated by on the display, see vks::SwapChain::preRotationDegrees.  The
+    // perspective rotates the view back, and the aspect ratios passed in remain those of the targets.
+    void setPreRotation(uint32_t degrees) {
+        if (degrees != preRotation) {
+            preRotation = degrees;
+            updatePerspective(aspect);
+        }
+    }
+
+    // Sub-pixel offset of the projection for temporal anti-aliasing, in normalized device coordinates: twice the offset
+    // in pixels over the rendered extent.  Zero turns it off.
+    void setJitter(const glm::vec2& offset) {
+        jitter = offset;
+        applyJitter();
+    }
+
     void setPosition(const glm::vec3& position) {
         this->position = position;
         updateViewMatrix();
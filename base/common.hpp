@@ -97,6 +97,7 @@ public:
 };
 
 #include "keycodes.hpp"
+#include "utils.hpp"
 #if defined(__ANDROID__)
 #include "android.hpp"
 
@@ -114,7 +115,9 @@ public:
 
 #define ENTRY_POINT_END }
 #else
-#define ENTRY_POINT_START int main(const int argc, const char* argv[]) {
+#define ENTRY_POINT_START                           \
+    int main(const int argc, const char* argv[]) { \
+        vkx::setCommandLine(argc, argv);
 #define ENTRY_POINT_END \
     return 0;           \
     }
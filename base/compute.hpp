@@ -1,12 +1,48 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+
 #include "vks/context.hpp"
+#include "vks/profiler.hpp"
 
 namespace vkx {
 
+// Workgroup counts in x and y for one invocation per item of `count`, in groups of `groupSize`.  Large counts spill
+// over into y past the device's limit for x, and shaders recover the item as
+// gl_GlobalInvocationID.x + gl_GlobalInvocationID.y * gl_NumWorkGroups.x * gl_WorkGroupSize.x, which they must bounds
+// check as the last rows are rounded up.
+inline std::array<uint32_t, 2> workGroupCounts(const vks::Context& context, uint32_t count, uint32_t groupSize) {
+    const uint32_t groups = (count + groupSize - 1) / groupSize;
+    const uint32_t x = std::max(1u, std::min(groups, context.deviceProperties.limits.maxComputeWorkGroupCount[0]));
+    return { x, (groups + x - 1) / x };
+}
+
 // Resources for the compute part of the example
+//
+// Storage the compute queue writes and the graphics queue reads can be double buffered in a SlotBuffer: submission k
+// writes slot writeSlot() (k % 2), and the frames drawn after it read readSlot(), the slot written by submission k.
+// With `overlap` and timeline semaphores, each submission only waits for the frame before the last one, which is the
+// last reader of the slot being overwritten, so compute for the next frame runs while the graphics queue draws the
+// current one.  Otherwise the binary semaphore handshake keeps the two queues in lock step.
 struct Compute {
     Compute(const vks::Context& context)
         : context(context) {}
 
+    static const uint32_t SLOT_COUNT = 2;
+
+    // SLOT_COUNT copies of the same storage in one buffer, shared concurrently by the graphics and compute queue
+    // families.  Both queues read the slot written last at the same time, which exclusive ownership can't express.
+    struct SlotBuffer {
+        vks::Buffer buffer;
+        vk::DeviceSize slotSize{ 0 };
+
+        vk::DeviceSize offset(uint32_t slot) const { return slotSize * slot; }
+        vk::DescriptorBufferInfo descriptor(uint32_t slot) const { return { buffer.buffer, offset(slot), slotSize }; }
+        void destroy() { buffer.destroy(); }
+    };
+
     const vks::Context& context;
     const vk::Device& device{ context.device };
     vk::Queue queue;
@@ -17,6 +53,14 @@ struct Compute {
         vk::Semaphore complete;
     } semaphores;
 
+    // Let submissions run alongside the frame drawn with the previous one, when timeline semaphores are enabled.
+    // Everything the graphics queue reads from the compute queue must be double buffered.
+    bool overlap{ false };
+
+    // Timings of the command buffers recorded with beginCommandBuffer, collected once a slot's last submission has
+    // completed, which takes timeline semaphores to find out
+    vks::debug::GpuProfiler profiler;
+
     virtual void prepare() {
         // Create a compute capable device queue
         queue = context.device.getQueue(context.queueIndices.compute, 0);
@@ -24,27 +68,172 @@ struct Compute {
         semaphores.complete = device.createSemaphore({});
         // Separate command pool as queue family for compute may be different than graphics
         commandPool = device.createCommandPool({ vk::CommandPoolCreateFlagBits::eResetCommandBuffer, context.queueIndices.compute });
+        if (context.timelineSemaphoresEnabled) {
+            profiler.create(context.physicalDevice, device, context.queueIndices.compute, SLOT_COUNT, 16);
+        }
     }
 
     virtual void destroy() {
+        profiler.destroy();
         context.device.destroy(semaphores.complete);
         context.device.destroy(semaphores.ready);
         context.device.destroy(commandPool);
     }
 
+    // Every slot starts out with `size` bytes of `data`.  The upload goes through the context, ahead of the first frame
+    SlotBuffer createSlotBuffer(const vk::BufferUsageFlags& usage, vk::DeviceSize size, const void* data) const {
+        SlotBuffer result;
+        result.slotSize = size;
+        result.buffer = context.createBuffer(usage | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal, size * SLOT_COUNT,
+                                             { context.queueIndices.graphics, context.queueIndices.compute });
+        context.stageUpload(size, data, 4, [&](const vk::CommandBuffer& copyCmd, const vk::Buffer& staging, vk::DeviceSize stagingOffset) {
+            for (uint32_t slot = 0; slot < SLOT_COUNT; ++slot) {
+                copyCmd.copyBuffer(staging, result.buffer.buffer, vk::BufferCopy(stagingOffset, result.offset(slot), size));
+            }
+        });
+        return result;
+    }
+
+    template <typename T>
+    SlotBuffer createSlotBuffer(const vk::BufferUsageFlags& usage, const std::vector<T>& data) const {
+        return createSlotBuffer(usage, sizeof(T) * data.size(), data.data());
+    }
+
+    // The slot the next submission writes
+    uint32_t writeSlot() const { return submissions % SLOT_COUNT; }
+    // The slot the last submission wrote, which frames submitted from now on should read
+    uint32_t readSlot() const { return (submissions + SLOT_COUNT - 1) % SLOT_COUNT; }
+
+    // Begin recording the command buffer submitted for `slot`, timed as a whole.  Command buffers should start by
+    // waiting for the writes of the previous submission, which they are only ordered after within the queue.
+    void beginCommandBuffer(const vk::CommandBuffer& commandBuffer, uint32_t slot) {
+        commandBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
+        profiler.beginCommandBuffer(commandBuffer, slot);
+        profiler.beginScope(commandBuffer, "Compute");
+    }
+
+    void endCommandBuffer(const vk::CommandBuffer& commandBuffer) {
+        profiler.endCommandBuffer(commandBuffer);
+        commandBuffer.end();
+    }
+
+    // The most recent compute submission, when the context has timeline semaphores enabled
+    vks::TimelinePoint complete;
+
+    // Submit the commands writing writeSlot()
     void submit(const vk::ArrayProxy<const vk::CommandBuffer>& commandBuffers) {
-        static const std::vector<vk::PipelineStageFlags> waitStages{ vk::PipelineStageFlagBits::eComputeShader };
+        // Transfers are waited for along with dispatches, they may write a slot too
+        static const vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer;
+        const uint32_t slot = writeSlot();
+        ++submissions;
+        if (context.timelineSemaphoresEnabled) {
+            // Pending uploads have to be on the graphics timeline before picking the value to wait for.  With overlap,
+            // only uploads flushed before the previous frame are guaranteed to be visible.
+            context.flushUploads();
+            const vks::TimelinePoint latest = context.getTimeline(context.queue);
+            // The frame before the latest is the last one that read `slot`.  The first submission waits for
+            // everything, including the initial uploads
+            const vks::TimelinePoint wait = overlap && previousFrame ? previousFrame : latest;
+            previousFrame = latest;
+            if (context.isComplete(slotComplete[slot])) {
+                profiler.collect(slot);
+            }
+            complete = context.submitTimeline(queue, commandBuffers, vks::TimelineWait{ wait, waitStage });
+            slotComplete[slot] = complete;
+            return;
+        }
         // Submit compute commands
         vk::SubmitInfo computeSubmitInfo;
         computeSubmitInfo.commandBufferCount = commandBuffers.size();
         computeSubmitInfo.pCommandBuffers = commandBuffers.data();
         computeSubmitInfo.waitSemaphoreCount = 1;
         computeSubmitInfo.pWaitSemaphores = &semaphores.ready;
-        computeSubmitInfo.pWaitDstStageMask = waitStages.data();
+        computeSubmitInfo.pWaitDstStageMask = &waitStage;
         computeSubmitInfo.signalSemaphoreCount = 1;
         computeSubmitInfo.pSignalSemaphores = &semaphores.complete;
-        queue.submit(computeSubmitInfo, {});
+        context.submitBatched(queue, computeSubmitInfo);
+    }
+
+    // Add the compute time and the part of it that overlapped a graphics frame to the reports of `graphics`, the
+    // profiler timing the frames.  Both queues are assumed to read the same device clock, as they do on common
+    // hardware.  Call once per frame.
+    void reportTimings(vks::debug::GpuProfiler& graphics) {
+        if (profiler.getCollectionCount() != computeCollections) {
+            computeCollections = profiler.getCollectionCount();
+            const auto& scopes = profiler.getScopes();
+            if (!scopes.empty()) {
+                intervals[nextInterval++ % intervals.size()] = { scopes[0].begin, scopes[0].end };
+                graphics.report("Compute", scopes[0].lastMilliseconds);
+            }
+        }
+        if (graphics.getCollectionCount() != graphicsCollections && nextInterval > 0) {
+            graphicsCollections = graphics.getCollectionCount();
+            double begin = DBL_MAX;
+            double end = 0.0;
+            for (const auto& scope : graphics.getScopes()) {
+                if (scope.depth == 0) {
+                    begin = std::min(begin, scope.begin);
+                    end = std::max(end, scope.end);
+                }
+            }
+            // Submissions on the compute queue run one after the other, so their overlaps with the frame add up
+            double overlapped = 0.0;
+            for (const auto& interval : intervals) {
+                overlapped += std::max(0.0, std::min(end, interval.second) - std::max(begin, interval.first));
+            }
+            graphics.report("Compute overlap", overlapped);
+        }
     }
+
+private:
+    uint64_t submissions{ 0 };
+    vks::TimelinePoint previousFrame;
+    std::array<vks::TimelinePoint, SLOT_COUNT> slotComplete;
+    // Begin and end of the most recently collected submissions, in milliseconds
+    std::array<std::pair<double, double>, 4> intervals;
+    uint32_t nextInterval{ 0 };
+    uint64_t computeCollections{ 0 };
+    uint64_t graphicsCollections{ 0 };
+};
+
+// Indirect draws of the slot the last compute submission wrote, for draws recorded once per swap chain image.  The
+// draw recorded for image i reads command i, which select() rewrites once the image's previous frame has completed,
+// that is between ExampleBase::prepareFrame and the submission of the frame.  `Command` is vk::DrawIndirectCommand
+// or vk::DrawIndexedIndirectCommand.
+template <typename Command>
+struct SlotDraws {
+    vks::Buffer buffer;
+
+    // `command` draws slot 0, whose vertices start at firstVertex (or vertexOffset), and every slot holds
+    // `slotVertices` vertices
+    void create(const vks::Context& context, uint32_t imageCount, const Command& command, uint32_t slotVertices) {
+        this->command = command;
+        this->slotVertices = slotVertices;
+        buffer = context.createBuffer(vk::BufferUsageFlagBits::eIndirectBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                      sizeof(Command) * imageCount);
+        buffer.map();
+        for (uint32_t image = 0; image < imageCount; ++image) {
+            select(image, 0);
+        }
+    }
+
+    void destroy() { buffer.destroy(); }
+
+    vk::DeviceSize offset(uint32_t image) const { return sizeof(Command) * image; }
+
+    void select(uint32_t image, uint32_t slot) {
+        assert(offset(image + 1) <= buffer.size);
+        Command selected = command;
+        shift(selected, slot * slotVertices);
+        memcpy(static_cast<uint8_t*>(buffer.mapped) + offset(image), &selected, sizeof(Command));
+    }
+
+private:
+    static void shift(vk::DrawIndirectCommand& command, uint32_t vertices) { command.firstVertex += vertices; }
+    static void shift(vk::DrawIndexedIndirectCommand& command, uint32_t vertices) { command.vertexOffset += (int32_t)vertices; }
+
+    Command command;
+    uint32_t slotVertices{ 0 };
 };
 
 }  // namespace vkx
@@ -0,0 +1,185 @@
+#include "heightmap.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "vks/scheduler.hpp"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define VKX_HEIGHTMAP_SSE 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+// 32 bit NEON has no vector division or square root
+#include <arm_neon.h>
+#define VKX_HEIGHTMAP_NEON 1
+#endif
+
+using namespace vkx;
+
+namespace {
+
+// Rows per task, enough vertices to be worth handing to another thread
+const size_t ROW_GRAIN = 8;
+
+#if defined(VKX_HEIGHTMAP_SSE)
+struct Lanes {
+    static const uint32_t WIDTH = 4;
+    using Float = __m128;
+    static Float load(const float* values) { return _mm_loadu_ps(values); }
+    static void store(float* values, Float value) { _mm_storeu_ps(values, value); }
+    static Float set(float value) { return _mm_set1_ps(value); }
+    static Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+    static Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+    static Float div(Float a, Float b) { return _mm_div_ps(a, b); }
+    static Float sqrt(Float a) { return _mm_sqrt_ps(a); }
+};
+#elif defined(VKX_HEIGHTMAP_NEON)
+struct Lanes {
+    static const uint32_t WIDTH = 4;
+    using Float = float32x4_t;
+    static Float load(const float* values) { return vld1q_f32(values); }
+    static void store(float* values, Float value) { vst1q_f32(values, value); }
+    static Float set(float value) { return vdupq_n_f32(value); }
+    static Float add(Float a, Float b) { return vaddq_f32(a, b); }
+    static Float sub(Float a, Float b) { return vsubq_f32(a, b); }
+    static Float mul(Float a, Float b) { return vmulq_f32(a, b); }
+    static Float div(Float a, Float b) { return vdivq_f32(a, b); }
+    static Float sqrt(Float a) { return vsqrtq_f32(a); }
+};
+#else
+struct Lanes {
+    static const uint32_t WIDTH = 1;
+    using Float = float;
+    static Float load(const float* values) { return *values; }
+    static void store(float* values, Float value) { *values = value; }
+    static Float set(float value) { return value; }
+    static Float add(Float a, Float b) { return a + b; }
+    static Float sub(Float a, Float b) { return a - b; }
+    static Float mul(Float a, Float b) { return a * b; }
+    static Float div(Float a, Float b) { return a / b; }
+    static Float sqrt(Float a) { return std::sqrt(a); }
+};
+#endif
+
+// (normalize(cross((1, 0, dx), (0, 1, dy))) + 1) / 2 with y and z swapped, the cross product being (-dx, -dy, 1).
+// The same arithmetic, in the same order, as the lanes below, so the border vertices match their neighbours.
+inline glm::vec3 packNormal(float dx, float dy) {
+    const float inverseLength = 1.0f / std::sqrt(dx * dx + dy * dy + 1.0f);
+    return glm::vec3((1.0f - dx * inverseLength) * 0.5f, (inverseLength + 1.0f) * 0.5f, (1.0f - dy * inverseLength) * 0.5f);
+}
+
+struct Patch {
+    // Sampled once per vertex, row by row
+    const float* heights;
+    uint32_t size;
+    glm::vec3 scale;
+    float uvScale;
+
+    HeightMap::Vertex vertex(uint32_t x, uint32_t y, const glm::vec3& normal) const {
+        const float wx = 2.0f;
+        const float wy = 2.0f;
+        HeightMap::Vertex result;
+        result.pos = glm::vec3((x * wx + wx / 2.0f - (float)size * wx / 2.0f) * scale.x, -heights[x + y * size],
+                               (y * wy + wy / 2.0f - (float)size * wy / 2.0f) * scale.z);
+        result.normal = normal;
+        result.uv = glm::vec2((float)x / size, (float)y / size) * uvScale;
+        return result;
+    }
+
+    // Staging memory may be write combined, so every vertex is written whole, in order, and never read back
+    void writeRow(uint32_t y, HeightMap::Vertex* out) const {
+        const float* row = heights + y * size;
+        const float* above = heights + (y > 0 ? y - 1 : y) * size;
+        const float* below = heights + (y < size - 1 ? y + 1 : y) * size;
+        // One sided differences at the borders, scaled up to the central ones
+        const float rowScale = (y == 0 || y == size - 1) ? 2.0f : 1.0f;
+        const auto borderNormal = [&](uint32_t x) {
+            float dx = row[x < size - 1 ? x + 1 : x] - row[x > 0 ? x - 1 : x];
+            if (x == 0 || x == size - 1) {
+                dx *= 2.0f;
+            }
+            return packNormal(dx, (below[x] - above[x]) * rowScale);
+        };
+
+        out[0] = vertex(0, y, borderNormal(0));
+        uint32_t x = 1;
+        // The inner vertices, whose neighbours on both sides are in the row
+        const Lanes::Float one = Lanes::set(1.0f);
+        const Lanes::Float half = Lanes::set(0.5f);
+        const Lanes::Float dyScale = Lanes::set(rowScale);
+        for (; x + Lanes::WIDTH < size; x += Lanes::WIDTH) {
+            const Lanes::Float dx = Lanes::sub(Lanes::load(row + x + 1), Lanes::load(row + x - 1));
+            const Lanes::Float dy = Lanes::mul(Lanes::sub(Lanes::load(below + x), Lanes::load(above + x)), dyScale);
+            const Lanes::Float squared = Lanes::add(Lanes::add(Lanes::mul(dx, dx), Lanes::mul(dy, dy)), one);
+            const Lanes::Float inverseLength = Lanes::div(one, Lanes::sqrt(squared));
+            float nx[Lanes::WIDTH], ny[Lanes::WIDTH], nz[Lanes::WIDTH];
+            Lanes::store(nx, Lanes::mul(Lanes::sub(one, Lanes::mul(dx, inverseLength)), half));
+            Lanes::store(ny, Lanes::mul(Lanes::add(inverseLength, one), half));
+            Lanes::store(nz, Lanes::mul(Lanes::sub(one, Lanes::mul(dy, inverseLength)), half));
+            for (uint32_t lane = 0; lane < Lanes::WIDTH; ++lane) {
+                out[x + lane] = vertex(x + lane, y, glm::vec3(nx[lane], ny[lane], nz[lane]));
+            }
+        }
+        for (; x < size; ++x) {
+            out[x] = vertex(x, y, borderNormal(x));
+        }
+    }
+};
+
+}  // namespace
+
+void HeightMap::loadFromFile(const vks::Context& context, const std::string& filename, uint32_t patchsize, glm::vec3 scale, Topology topology) {
+    assert(patchsize > 1);
+    loadHeights(filename);
+    this->scale = dim / patchsize;
+    this->heightScale = scale.y;
+    auto& scheduler = vks::TaskScheduler::shared();
+
+    // Every height is used by up to five vertices' positions and normals
+    std::vector<float> heights(patchsize * patchsize);
+    scheduler.parallelFor(0, patchsize, ROW_GRAIN, [&](size_t begin, size_t end) {
+        for (uint32_t y = (uint32_t)begin; y < (uint32_t)end; y++) {
+            for (uint32_t x = 0; x < patchsize; x++) {
+                heights[x + y * patchsize] = getHeight(x, y);
+            }
+        }
+    });
+
+    const Patch patch{ heights.data(), patchsize, scale, uvScale };
+    vertexBufferSize = patchsize * patchsize * sizeof(Vertex);
+    vertexBuffer = context.stageToDeviceBufferInPlace(vk::BufferUsageFlagBits::eVertexBuffer, vertexBufferSize, [&](uint8_t* staging) {
+        auto* vertices = reinterpret_cast<Vertex*>(staging);
+        scheduler.parallelFor(0, patchsize, ROW_GRAIN, [&](size_t begin, size_t end) {
+            for (uint32_t y = (uint32_t)begin; y < (uint32_t)end; y++) {
+                patch.writeRow(y, vertices + y * patchsize);
+            }
+        });
+    });
+
+    // Triangles, or quad patches for tessellation
+    const uint32_t w = (patchsize - 1);
+    const uint32_t indicesPerCell = topology == topologyTriangles ? 6 : 4;
+    indexCount = w * w * indicesPerCell;
+    indexBufferSize = indexCount * sizeof(uint32_t);
+    indexBuffer = context.stageToDeviceBufferInPlace(vk::BufferUsageFlagBits::eIndexBuffer, indexBufferSize, [&](uint8_t* staging) {
+        auto* indices = reinterpret_cast<uint32_t*>(staging);
+        scheduler.parallelFor(0, w, ROW_GRAIN * 4, [&](size_t begin, size_t end) {
+            for (uint32_t y = (uint32_t)begin; y < (uint32_t)end; y++) {
+                uint32_t* out = indices + y * w * indicesPerCell;
+                for (uint32_t x = 0; x < w; x++) {
+                    const uint32_t corner = x + y * patchsize;
+                    if (topology == topologyTriangles) {
+                        const uint32_t cell[6] = { corner, corner + patchsize, corner + patchsize + 1, corner + patchsize + 1, corner + 1, corner };
+                        std::copy(cell, cell + 6, out);
+                    } else {
+                        const uint32_t cell[4] = { corner, corner + patchsize, corner + patchsize + 1, corner + 1 };
+                        std::copy(cell, cell + 4, out);
+                    }
+                    out += indicesPerCell;
+                }
+            }
+        });
+    });
+}
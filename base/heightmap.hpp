@@ -6,6 +6,8 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#pragma once
+
 #include <glm/glm.hpp>
 #include <gli/gli.hpp>
 
@@ -59,7 +61,10 @@ public:
         return heightdata[offset] / 65535.0f * heightScale;
     }
 
-    void loadFromFile(const vks::Context& context, const std::string& filename, uint32_t patchsize, glm::vec3 scale, Topology topology) {
+    uint32_t dimension() const { return dim; }
+
+    // Load the height data of the first level of a square, 16 bit height map, without generating a mesh
+    void loadHeights(const std::string& filename) {
         std::shared_ptr<gli::texture2d> tex2Dptr;
         vks::file::withBinaryFileContents(filename, [&](size_t size, const void* data) {
             tex2Dptr = std::make_shared<gli::texture2d>(gli::load((const char*)data, size));
@@ -68,95 +73,52 @@ public:
         const auto& heightTex = *tex2Dptr;
         dim = static_cast<uint32_t>(heightTex.extent().x);
         heightdata.resize(dim * dim);
-        memcpy(heightdata.data(), heightTex.data(), heightTex.size());
-        this->scale = dim / patchsize;
-        this->heightScale = scale.y;
-
-        // Generate vertices
-
-        std::vector<Vertex> vertices;
-        vertices.resize(patchsize * patchsize * 4);
-
-        const float wx = 2.0f;
-        const float wy = 2.0f;
-
-        for (uint32_t x = 0; x < patchsize; x++) {
-            for (uint32_t y = 0; y < patchsize; y++) {
-                uint32_t index = (x + y * patchsize);
-                vertices[index].pos[0] = (x * wx + wx / 2.0f - (float)patchsize * wx / 2.0f) * scale.x;
-                vertices[index].pos[1] = -getHeight(x, y);
-                vertices[index].pos[2] = (y * wy + wy / 2.0f - (float)patchsize * wy / 2.0f) * scale.z;
-                vertices[index].uv = glm::vec2((float)x / patchsize, (float)y / patchsize) * uvScale;
-            }
-        }
-
-        for (uint32_t y = 0; y < patchsize; y++) {
-            for (uint32_t x = 0; x < patchsize; x++) {
-                float dx = getHeight(x < patchsize - 1 ? x + 1 : x, y) - getHeight(x > 0 ? x - 1 : x, y);
-                if (x == 0 || x == patchsize - 1)
-                    dx *= 2.0f;
-
-                float dy = getHeight(x, y < patchsize - 1 ? y + 1 : y) - getHeight(x, y > 0 ? y - 1 : y);
-                if (y == 0 || y == patchsize - 1)
-                    dy *= 2.0f;
-
-                glm::vec3 A = glm::vec3(1.0f, 0.0f, dx);
-                glm::vec3 B = glm::vec3(0.0f, 1.0f, dy);
-
-                glm::vec3 normal = (glm::normalize(glm::cross(A, B)) + 1.0f) * 0.5f;
-
-                vertices[x + y * patchsize].normal = glm::vec3(normal.x, normal.z, normal.y);
-            }
-        }
+        // Only the first level, the file may hold a whole mip chain
+        memcpy(heightdata.data(), heightTex[0].data(), heightdata.size() * sizeof(uint16_t));
+    }
 
-        // Generate indices
-
-        const uint32_t w = (patchsize - 1);
-        std::vector<uint32_t> indices;
-
-        switch (topology) {
-                // Indices for triangles
-            case topologyTriangles: {
-                indices.resize(w * w * 6);
-                for (uint32_t x = 0; x < w; x++) {
-                    for (uint32_t y = 0; y < w; y++) {
-                        uint32_t index = (x + y * w) * 6;
-                        indices[index] = (x + y * patchsize);
-                        indices[index + 1] = indices[index] + patchsize;
-                        indices[index + 2] = indices[index + 1] + 1;
-
-                        indices[index + 3] = indices[index + 1] + 1;
-                        indices[index + 4] = indices[index] + 1;
-                        indices[index + 5] = indices[index];
+    // Lowest and highest height, in [0, 1], of every node of a quadtree `levels` deep over the height map, for
+    // culling and LOD selection on the GPU.  The root comes first, followed by the nodes of each level row by row.
+    // Nodes include the texels on their far edges, which they share with their neighbours.
+    std::vector<glm::vec2> heightBounds(uint32_t levels) const {
+        assert(levels > 0 && (1u << (levels - 1)) <= dim);
+        std::vector<glm::vec2> bounds(((1u << (2 * levels)) - 1) / 3);
+        const uint32_t leaves = 1u << (levels - 1);
+        const size_t leafOffset = bounds.size() - leaves * leaves;
+        for (uint32_t y = 0; y < leaves; y++) {
+            for (uint32_t x = 0; x < leaves; x++) {
+                glm::vec2 range{ 1.0f, 0.0f };
+                for (uint32_t ty = y * dim / leaves; ty <= std::min(dim - 1, (y + 1) * dim / leaves); ty++) {
+                    for (uint32_t tx = x * dim / leaves; tx <= std::min(dim - 1, (x + 1) * dim / leaves); tx++) {
+                        const float height = heightdata[tx + ty * dim] / 65535.0f;
+                        range = glm::vec2(std::min(range.x, height), std::max(range.y, height));
                     }
                 }
-                indexCount = (patchsize - 1) * (patchsize - 1) * 6;
-                indexBufferSize = (w * w * 6) * sizeof(uint32_t);
-                break;
+                bounds[leafOffset + x + y * leaves] = range;
             }
-            // Indices for quad patches (tessellation)
-            case topologyQuads: {
-                indices.resize(w * w * 4);
-                for (uint32_t x = 0; x < w; x++) {
-                    for (uint32_t y = 0; y < w; y++) {
-                        uint32_t index = (x + y * w) * 4;
-                        indices[index] = (x + y * patchsize);
-                        indices[index + 1] = indices[index] + patchsize;
-                        indices[index + 2] = indices[index + 1] + 1;
-                        indices[index + 3] = indices[index] + 1;
+        }
+        // Coarser levels from their children
+        for (uint32_t level = levels - 1; level > 0; level--) {
+            const uint32_t count = 1u << (level - 1);
+            const size_t offset = ((1u << (2 * (level - 1))) - 1) / 3;
+            const size_t childOffset = offset + count * count;
+            for (uint32_t y = 0; y < count; y++) {
+                for (uint32_t x = 0; x < count; x++) {
+                    glm::vec2 range{ 1.0f, 0.0f };
+                    for (uint32_t child = 0; child < 4; child++) {
+                        const glm::vec2& childRange = bounds[childOffset + (x * 2 + (child & 1)) + (y * 2 + (child >> 1)) * count * 2];
+                        range = glm::vec2(std::min(range.x, childRange.x), std::max(range.y, childRange.y));
                     }
+                    bounds[offset + x + y * count] = range;
                 }
-                indexCount = (patchsize - 1) * (patchsize - 1) * 4;
-                indexBufferSize = (w * w * 4) * sizeof(uint32_t);
-                break;
             }
         }
-
-        assert(indexBufferSize > 0);
-
-        vertexBufferSize = (patchsize * patchsize * 4) * sizeof(Vertex);
-        vertexBuffer = context.stageToDeviceBuffer<Vertex>(vk::BufferUsageFlagBits::eVertexBuffer, vertices);
-        indexBuffer = context.stageToDeviceBuffer<uint32_t>(vk::BufferUsageFlagBits::eIndexBuffer, indices);
+        return bounds;
     }
+
+    // Load the height map and generate a grid of `patchsize` by `patchsize` vertices over it, with normals from the
+    // height differences of their neighbours and indices for `topology`.  The rows are generated in parallel, straight
+    // into staging memory.
+    void loadFromFile(const vks::Context& context, const std::string& filename, uint32_t patchsize, glm::vec3 scale, Topology topology);
 };
 }  // namespace vkx
@@ -1,708 +1,952 @@
 #include "pbr.hpp"
 
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <sys/stat.h>
+#if defined(WIN32)
+#include <direct.h>
+#endif
+
+#include <glm/gtc/matrix_transform.hpp>
+
 #include "vks/texture.hpp"
 #include "vks/context.hpp"
-#include "vks/pipelines.hpp"
+#include "vks/hash.hpp"
+#include "vks/helpers.hpp"
+#include "vks/profiler.hpp"
+#include "vks/shaders.hpp"
+#include "vks/storage.hpp"
 #include "utils.hpp"
-#include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
 
-// Generate a BRDF integration map used as a look-up-table (stores roughness / NdotV)
-void vkx::pbr::generateBRDFLUT(const vks::Context& context, vks::texture::Texture2D& target) {
-    auto tStart = std::chrono::high_resolution_clock::now();
+const uint32_t vkx::pbr::PrefilterSettings::MAX_SAMPLES;
+
+namespace {
+
+// Bump whenever the generated maps change, so files cached by an older build are ignored
+const uint32_t TEXTURE_CACHE_VERSION = 2;
+
+// Must match the local sizes of the pbr compute shaders
+const uint32_t LUT_GROUP_SIZE = 16;
+const uint32_t CUBE_GROUP_SIZE = 8;
+// Texels along a face of the environment level projected onto the spherical harmonics
+const uint32_t SH_SAMPLE_DIM = 64;
+
+// Push constants of prefilterenvmap.comp
+struct PrefilterPushBlock {
+    float roughness;
+    uint32_t numSamples;
+};
+
+enum class MapKind : uint32_t {
+    BrdfLut,
+    IrradianceCube,
+    PrefilteredCube,
+};
+
+gli::format toGliFormat(vk::Format format) {
+    switch (format) {
+        case vk::Format::eR16G16Sfloat:
+            return gli::FORMAT_RG16_SFLOAT_PACK16;
+        case vk::Format::eR16G16B16A16Sfloat:
+            return gli::FORMAT_RGBA16_SFLOAT_PACK16;
+        case vk::Format::eR32G32B32A32Sfloat:
+            return gli::FORMAT_RGBA32_SFLOAT_PACK32;
+        default:
+            throw std::runtime_error("Unsupported image based lighting map format");
+    }
+}
 
-    const vk::Format format = vk::Format::eR16G16Sfloat;  // R16G16 is supported pretty much everywhere
-    const int32_t dim = 512;
+// Key of a map generated with `parameters`.  Cubes also hash the whole environment map, and return false without one,
+// as there's nothing to tell two environments apart by.
+template <typename T>
+bool cacheKey(MapKind kind, const T& parameters, const std::string& environmentFile, uint64_t& outKey) {
+    vks::KeyHasher hasher;
+    hasher.add(TEXTURE_CACHE_VERSION);
+    hasher.add(kind);
+    hasher.add(parameters);
+    if (kind != MapKind::BrdfLut) {
+        struct stat info;
+        if (environmentFile.empty() || 0 != stat(environmentFile.c_str(), &info)) {
+            return false;
+        }
+        auto storage = vks::storage::Storage::readFile(environmentFile);
+        hasher.add(storage->data(), storage->size());
+    }
+    outKey = hasher.hash;
+    return true;
+}
 
-    const auto& device = context.device;
-    target.device = device;
+std::string cacheFile(const std::string& directory, uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.ktx", static_cast<unsigned long long>(key));
+    return directory + "/" + name;
+}
+
+// Whether `file` is a KTX file with the shape of the map, so a stale or truncated file is regenerated instead of loaded
+bool isCached(const std::string& file, vk::Format format, uint32_t dim, uint32_t levels, uint32_t faces) {
+    struct stat info;
+    if (0 != stat(file.c_str(), &info)) {
+        return false;
+    }
+    auto storage = vks::storage::Storage::readFile(file);
+    vks::texture::KtxLayout ktx;
+    return vks::texture::parseKtx(storage->data(), storage->size(), ktx) && ktx.format == toGliFormat(format) && ktx.width == dim && ktx.height == dim &&
+           ktx.levels == levels && ktx.faces == faces && ktx.layers == 1;
+}
+
+// The maps are only ever sampled with clamping to the edge, whether they were generated or loaded from the cache
+void createSampler(const vks::Context& context, vks::texture::Texture& target) {
+    vk::SamplerCreateInfo samplerCI;
+    samplerCI.magFilter = vk::Filter::eLinear;
+    samplerCI.minFilter = vk::Filter::eLinear;
+    samplerCI.mipmapMode = vk::SamplerMipmapMode::eLinear;
+    samplerCI.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+    samplerCI.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+    samplerCI.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+    samplerCI.maxLod = static_cast<float>(target.mipLevels);
+    samplerCI.borderColor = vk::BorderColor::eFloatOpaqueWhite;
+    target.sampler = vks::acquireSampler(context.device, samplerCI);
+    target.updateDescriptor();
+}
+
+// Replace the sampler the texture loader created
+void replaceSampler(const vks::Context& context, vks::texture::Texture& target) {
+    vks::releaseSampler(context.device, target.sampler);
+    createSampler(context, target);
+}
+
+// Storage image the compute shaders write every level of, sampled afterwards, and copied to the cache from
+void createTarget(const vks::Context& context,
+                  vks::texture::Texture& target,
+                  vk::Format format,
+                  uint32_t dim,
+                  uint32_t levels,
+                  uint32_t faces,
+                  vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc) {
+    vk::ImageCreateInfo imageCI;
+    imageCI.imageType = vk::ImageType::e2D;
+    imageCI.format = format;
+    imageCI.extent = vk::Extent3D{ dim, dim, 1 };
+    imageCI.mipLevels = levels;
+    imageCI.arrayLayers = faces;
+    imageCI.usage = usage;
+    if (faces == 6) {
+        imageCI.flags = vk::ImageCreateFlagBits::eCubeCompatible;
+    }
+    static_cast<vks::Image&>(target) = context.createImage(imageCI);
+    target.device = context.device;
+    target.mipLevels = levels;
+    target.layerCount = faces;
     target.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+    target.descriptor.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+
+    vk::ImageViewCreateInfo viewCI;
+    viewCI.viewType = faces == 6 ? vk::ImageViewType::eCube : vk::ImageViewType::e2D;
+    viewCI.format = format;
+    viewCI.subresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, levels, 0, faces };
+    viewCI.image = target.image;
+    target.view = context.device.createImageView(viewCI);
+    createSampler(context, target);
+}
+
+// A compute pipeline writing one level of the target per descriptor set, through a storage view of that level at
+// binding 1.  Cube filters also sample the environment map at binding 0.
+struct Generator {
+    vk::Device device;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::DescriptorPool descriptorPool;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline pipeline;
+    std::vector<vk::ImageView> views;
+    std::vector<vk::DescriptorSet> descriptorSets;
+
+    void create(const vks::Context& context,
+                const std::string& shader,
+                const vks::texture::Texture& target,
+                const vk::DescriptorImageInfo* environment,
+                uint32_t pushConstantSize,
+                const vk::SpecializationInfo* specializationInfo = nullptr) {
+        device = context.device;
+        const uint32_t levels = target.mipLevels;
+
+        std::vector<vk::DescriptorSetLayoutBinding> bindings{ { 1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute } };
+        std::vector<vk::DescriptorPoolSize> poolSizes{ { vk::DescriptorType::eStorageImage, levels } };
+        if (environment) {
+            bindings.push_back({ 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute });
+            poolSizes.push_back({ vk::DescriptorType::eCombinedImageSampler, levels });
+        }
+        descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)bindings.size(), bindings.data() });
+        vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, pushConstantSize };
+        pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout, pushConstantSize ? 1u : 0u, &pushConstantRange });
+
+        descriptorPool = device.createDescriptorPool({ {}, levels, (uint32_t)poolSizes.size(), poolSizes.data() });
+        std::vector<vk::DescriptorSetLayout> setLayouts(levels, descriptorSetLayout);
+        descriptorSets = device.allocateDescriptorSets({ descriptorPool, levels, setLayouts.data() });
+        for (uint32_t level = 0; level < levels; ++level) {
+            vk::ImageViewCreateInfo viewCI;
+            viewCI.viewType = target.layerCount == 1 ? vk::ImageViewType::e2D : vk::ImageViewType::e2DArray;
+            viewCI.format = target.format;
+            viewCI.subresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, level, 1, 0, target.layerCount };
+            viewCI.image = target.image;
+            views.push_back(device.createImageView(viewCI));
+
+            vk::DescriptorImageInfo outputInfo{ nullptr, views.back(), vk::ImageLayout::eGeneral };
+            std::vector<vk::WriteDescriptorSet> writes{
+                { descriptorSets[level], 1, 0, 1, vk::DescriptorType::eStorageImage, &outputInfo },
+            };
+            if (environment) {
+                writes.push_back({ descriptorSets[level], 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, environment });
+            }
+            device.updateDescriptorSets(writes, nullptr);
+        }
 
-    {
-        // Image
-        vk::ImageCreateInfo imageCI;
-        imageCI.imageType = vk::ImageType::e2D;
-        imageCI.format = format;
-        imageCI.extent.width = dim;
-        imageCI.extent.height = dim;
-        imageCI.extent.depth = 1;
-        imageCI.mipLevels = 1;
-        imageCI.arrayLayers = 1;
-        imageCI.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled;
-        (vks::Image&)target = context.createImage(imageCI);
-        // Image view
-        vk::ImageViewCreateInfo viewCI;
-        viewCI.viewType = vk::ImageViewType::e2D;
-        viewCI.format = format;
-        viewCI.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-        viewCI.subresourceRange.levelCount = 1;
-        viewCI.subresourceRange.layerCount = 1;
-        viewCI.image = target.image;
-        target.view = context.device.createImageView(viewCI);
-        // Sampler
-        vk::SamplerCreateInfo samplerCI;
-        samplerCI.magFilter = vk::Filter::eLinear;
-        samplerCI.minFilter = vk::Filter::eLinear;
-        samplerCI.mipmapMode = vk::SamplerMipmapMode::eLinear;
-        samplerCI.addressModeU = vk::SamplerAddressMode::eClampToEdge;
-        samplerCI.addressModeV = vk::SamplerAddressMode::eClampToEdge;
-        samplerCI.addressModeW = vk::SamplerAddressMode::eClampToEdge;
-        samplerCI.maxLod = 1.0f;
-        samplerCI.borderColor = vk::BorderColor::eFloatOpaqueWhite;
-        target.sampler = device.createSampler(samplerCI);
-        target.updateDescriptor();
+        vk::ComputePipelineCreateInfo pipelineCreateInfo;
+        pipelineCreateInfo.layout = pipelineLayout;
+        pipelineCreateInfo.stage = vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/pbr/" + shader, vk::ShaderStageFlagBits::eCompute);
+        pipelineCreateInfo.stage.pSpecializationInfo = specializationInfo;
+        pipeline = device.createComputePipeline(context.pipelineCache, pipelineCreateInfo);
+        device.destroyShaderModule(pipelineCreateInfo.stage.module);
     }
 
-    // FB, Att, RP, Pipe, etc.
-    vk::RenderPass renderpass;
-    {
-        vk::AttachmentDescription attDesc;
-        // Color attachment
-        attDesc.format = format;
-        attDesc.loadOp = vk::AttachmentLoadOp::eClear;
-        attDesc.storeOp = vk::AttachmentStoreOp::eStore;
-        attDesc.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
-        attDesc.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-        attDesc.initialLayout = vk::ImageLayout::eUndefined;
-        attDesc.finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-        vk::AttachmentReference colorReference{ 0, vk::ImageLayout::eColorAttachmentOptimal };
-
-        vk::SubpassDescription subpassDescription = {};
-        subpassDescription.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
-        subpassDescription.colorAttachmentCount = 1;
-        subpassDescription.pColorAttachments = &colorReference;
-
-        // Use subpass dependencies for layout transitions
-        std::array<vk::SubpassDependency, 2> dependencies{
-            vk::SubpassDependency{ VK_SUBPASS_EXTERNAL, 0, vk::PipelineStageFlagBits::eBottomOfPipe, vk::PipelineStageFlagBits::eColorAttachmentOutput,
-                                   vk::AccessFlagBits::eMemoryRead, vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
-                                   vk::DependencyFlagBits::eByRegion },
-            vk::SubpassDependency{ 0, VK_SUBPASS_EXTERNAL, vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eBottomOfPipe,
-                                   vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite, vk::AccessFlagBits::eMemoryRead,
-                                   vk::DependencyFlagBits::eByRegion },
-        };
+    void bind(const vk::CommandBuffer& commandBuffer, uint32_t level) const {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSets[level], nullptr);
+    }
 
-        // Create the actual renderpass
-        vk::RenderPassCreateInfo renderPassCI;
-        renderPassCI.attachmentCount = 1;
-        renderPassCI.pAttachments = &attDesc;
-        renderPassCI.subpassCount = 1;
-        renderPassCI.pSubpasses = &subpassDescription;
-        renderPassCI.dependencyCount = 2;
-        renderPassCI.pDependencies = dependencies.data();
-        renderpass = device.createRenderPass(renderPassCI);
+    void destroy() {
+        device.destroyPipeline(pipeline);
+        device.destroyPipelineLayout(pipelineLayout);
+        device.destroyDescriptorPool(descriptorPool);
+        device.destroyDescriptorSetLayout(descriptorSetLayout);
+        for (const auto& view : views) {
+            device.destroyImageView(view);
+        }
+    }
+};
+
+void imageBarrier(const vk::CommandBuffer& commandBuffer,
+                  const vk::Image& image,
+                  const vk::ImageSubresourceRange& range,
+                  vk::ImageLayout oldLayout,
+                  vk::ImageLayout newLayout,
+                  vk::PipelineStageFlags srcStageMask,
+                  vk::AccessFlags srcAccessMask,
+                  vk::PipelineStageFlags dstStageMask,
+                  vk::AccessFlags dstAccessMask) {
+    vk::ImageMemoryBarrier barrier;
+    barrier.srcAccessMask = srcAccessMask;
+    barrier.dstAccessMask = dstAccessMask;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = range;
+    commandBuffer.pipelineBarrier(srcStageMask, dstStageMask, {}, nullptr, nullptr, barrier);
+}
+
+// Every level and face of `target`
+void imageBarrier(const vk::CommandBuffer& commandBuffer,
+                  const vks::texture::Texture& target,
+                  vk::ImageLayout oldLayout,
+                  vk::ImageLayout newLayout,
+                  vk::PipelineStageFlags srcStageMask,
+                  vk::AccessFlags srcAccessMask,
+                  vk::PipelineStageFlags dstStageMask,
+                  vk::AccessFlags dstAccessMask) {
+    imageBarrier(commandBuffer, target.image, vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, target.mipLevels, 0, target.layerCount },
+                 oldLayout, newLayout, srcStageMask, srcAccessMask, dstStageMask, dstAccessMask);
+}
+
+// Samples per texel of every level of a pre-filtered cube.  Level 0 is a mirror, which one sample along the
+// reflection gets exactly.
+std::vector<uint32_t> prefilterSampleCounts(uint32_t numMips, const vkx::pbr::PrefilterSettings& settings) {
+    const uint32_t minSamples = std::min(settings.minSamples, settings.maxSamples);
+    const uint32_t maxSamples = std::min(settings.maxSamples, vkx::pbr::PrefilterSettings::MAX_SAMPLES);
+    std::vector<uint32_t> sampleCounts(numMips, 1);
+    for (uint32_t m = 1; m < numMips; m++) {
+        const float roughness = (float)m / (float)(numMips - 1);
+        sampleCounts[m] = std::max(minSamples, std::min(maxSamples, static_cast<uint32_t>(std::lround(maxSamples * roughness))));
     }
+    return sampleCounts;
+}
 
-    vk::Framebuffer framebuffer;
-    {
-        vk::FramebufferCreateInfo framebufferCI;
-        framebufferCI.renderPass = renderpass;
-        framebufferCI.attachmentCount = 1;
-        framebufferCI.pAttachments = &target.view;
-        framebufferCI.width = dim;
-        framebufferCI.height = dim;
-        framebufferCI.layers = 1;
-        framebuffer = device.createFramebuffer(framebufferCI);
+// Fill every level of `target` with the dispatches `record` makes, in a single submission, and save the result to
+// `file` unless that's empty
+void generate(const vks::Context& context,
+              const vks::texture::Texture& target,
+              const std::string& file,
+              const std::function<void(const vk::CommandBuffer& commandBuffer)>& record) {
+    // Laid out the way save_ktx writes it, so the copy lands in the texture's storage as is
+    gli::texture texture;
+    vks::Buffer readback;
+    std::vector<vk::BufferImageCopy> regions;
+    if (!file.empty()) {
+        texture = gli::texture(target.layerCount == 6 ? gli::TARGET_CUBE : gli::TARGET_2D, toGliFormat(target.format),
+                               gli::extent3d(target.extent.width, target.extent.height, 1), 1, target.layerCount, target.mipLevels);
+        readback = context.createBuffer(vk::BufferUsageFlagBits::eTransferDst,
+                                        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, texture.size());
+        for (uint32_t face = 0; face < target.layerCount; ++face) {
+            for (uint32_t level = 0; level < target.mipLevels; ++level) {
+                vk::BufferImageCopy region;
+                region.bufferOffset = static_cast<const uint8_t*>(texture.data(0, face, level)) - static_cast<const uint8_t*>(texture.data());
+                region.imageSubresource = vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, level, face, 1 };
+                region.imageExtent = vk::Extent3D{ std::max(target.extent.width >> level, 1u), std::max(target.extent.height >> level, 1u), 1 };
+                regions.push_back(region);
+            }
+        }
     }
 
-    // Desriptors
-    vk::DescriptorSetLayout descriptorsetlayout = device.createDescriptorSetLayout({});
-
-    // Descriptor Pool
-    std::vector<vk::DescriptorPoolSize> poolSizes{ { vk::DescriptorType::eCombinedImageSampler, 1 } };
-    vk::DescriptorPool descriptorpool = device.createDescriptorPool({ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
-
-    // Descriptor sets
-    vk::DescriptorSet descriptorset = device.allocateDescriptorSets({ descriptorpool, 1, &descriptorsetlayout })[0];
-
-    // Pipeline layout
-    vk::PipelineLayout pipelinelayout = device.createPipelineLayout({ {}, 1, &descriptorsetlayout });
-
-    // Pipeline
-    vks::pipelines::GraphicsPipelineBuilder pipelineBuilder{ device, pipelinelayout, renderpass };
-    pipelineBuilder.rasterizationState.cullMode = vk::CullModeFlagBits::eNone;
-    pipelineBuilder.depthStencilState = { false };
-    // Look-up-table (from BRDF) pipeline
-    pipelineBuilder.loadShader(vkx::getAssetPath() + "shaders/pbr/genbrdflut.vert.spv", vk::ShaderStageFlagBits::eVertex);
-    pipelineBuilder.loadShader(vkx::getAssetPath() + "shaders/pbr/genbrdflut.frag.spv", vk::ShaderStageFlagBits::eFragment);
-    vk::Pipeline pipeline = pipelineBuilder.create(context.pipelineCache);
-
-    // Render
-    vk::ClearValue clearValues[1];
-    clearValues[0].color = vks::util::clearColor({ 0.0f, 0.0f, 0.0f, 1.0f });
-
-    vk::RenderPassBeginInfo renderPassBeginInfo;
-    renderPassBeginInfo.renderPass = renderpass;
-    renderPassBeginInfo.renderArea.extent.width = dim;
-    renderPassBeginInfo.renderArea.extent.height = dim;
-    renderPassBeginInfo.clearValueCount = 1;
-    renderPassBeginInfo.pClearValues = clearValues;
-    renderPassBeginInfo.framebuffer = framebuffer;
-
-    context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& cmdBuf) {
-        cmdBuf.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-        vk::Viewport viewport{ 0, 0, (float)dim, (float)dim, 0, 1 };
-        vk::Rect2D scissor{ vk::Offset2D{}, vk::Extent2D{ (uint32_t)dim, (uint32_t)dim } };
-        cmdBuf.setViewport(0, viewport);
-        cmdBuf.setScissor(0, scissor);
-        cmdBuf.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
-        cmdBuf.draw(3, 1, 0, 0);
-        cmdBuf.endRenderPass();
+    static const vk::PipelineStageFlags SAMPLING_STAGES = vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader;
+    context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+        imageBarrier(commandBuffer, target, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eTopOfPipe, {},
+                     vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite);
+        record(commandBuffer);
+        if (regions.empty()) {
+            imageBarrier(commandBuffer, target, vk::ImageLayout::eGeneral, vk::ImageLayout::eShaderReadOnlyOptimal, vk::PipelineStageFlagBits::eComputeShader,
+                         vk::AccessFlagBits::eShaderWrite, SAMPLING_STAGES, vk::AccessFlagBits::eShaderRead);
+            return;
+        }
+        imageBarrier(commandBuffer, target, vk::ImageLayout::eGeneral, vk::ImageLayout::eTransferSrcOptimal, vk::PipelineStageFlagBits::eComputeShader,
+                     vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead);
+        commandBuffer.copyImageToBuffer(target.image, vk::ImageLayout::eTransferSrcOptimal, readback.buffer, regions);
+        vk::MemoryBarrier hostBarrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, hostBarrier, nullptr, nullptr);
+        imageBarrier(commandBuffer, target, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, vk::PipelineStageFlagBits::eTransfer,
+                     {}, SAMPLING_STAGES, vk::AccessFlagBits::eShaderRead);
     });
-    context.queue.waitIdle();
+    if (regions.empty()) {
+        return;
+    }
 
-    // todo: cleanup
-    device.destroyPipeline(pipeline);
-    device.destroyPipelineLayout(pipelinelayout);
-    device.destroyRenderPass(renderpass);
-    device.destroyFramebuffer(framebuffer);
-    device.destroyDescriptorSetLayout(descriptorsetlayout);
-    device.destroyDescriptorPool(descriptorpool);
+    readback.map();
+    memcpy(texture.data(), readback.mapped, texture.size());
+    readback.unmap();
+    readback.destroy();
+
+    const std::string directory = file.substr(0, file.find_last_of('/'));
+#if defined(WIN32)
+    _mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+    const std::string tempFile = file + ".tmp";
+    if (!gli::save_ktx(texture, tempFile)) {
+        std::remove(tempFile.c_str());
+        return;
+    }
+#ifdef WIN32
+    // rename does not replace an existing file on Windows
+    std::remove(file.c_str());
+#endif
+    std::rename(tempFile.c_str(), file.c_str());
+}
 
+void reportTime(const char* what, bool cached, const std::chrono::high_resolution_clock::time_point& tStart) {
     auto tEnd = std::chrono::high_resolution_clock::now();
     auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-    std::cout << "Generating BRDF LUT took " << tDiff << " ms" << std::endl;
+    std::cout << (cached ? "Loading cached " : "Generating ") << what << " took " << tDiff << " ms" << std::endl;
 }
 
-// Generate an irradiance cube map from the environment cube map
-void vkx::pbr::generateIrradianceCube(const vks::Context& context,
-                                      vks::texture::Texture& target,
-                                      const vks::model::Model& skybox,
-                                      const vks::model::VertexLayout& vertexLayout,
-                                      const vk::DescriptorImageInfo& skyboxDescriptor) {
+}  // namespace
+
+// Generate a BRDF integration map used as a look-up-table (stores roughness / NdotV)
+void vkx::pbr::generateBRDFLUT(const vks::Context& context, vks::texture::Texture2D& target) {
     auto tStart = std::chrono::high_resolution_clock::now();
 
-    const auto& device = context.device;
-    target.device = device;
+    // R16G16 is supported pretty much everywhere, but shaders can only write it with the extended storage formats
+    const bool twoChannels = context.enabledFeatures.shaderStorageImageExtendedFormats &&
+                             (context.getFormatProperties(vk::Format::eR16G16Sfloat).optimalTilingFeatures & vk::FormatFeatureFlagBits::eStorageImage);
+    const vk::Format format = twoChannels ? vk::Format::eR16G16Sfloat : vk::Format::eR16G16B16A16Sfloat;
+    const uint32_t dim = 512;
+    const uint32_t numSamples = 1024;
 
-    const vk::Format format = vk::Format::eR32G32B32A32Sfloat;
-    const int32_t dim = 64;
-    const uint32_t numMips = static_cast<uint32_t>(floor(log2(dim))) + 1;
+    struct {
+        vk::Format format;
+        uint32_t dim;
+        uint32_t numSamples;
+    } parameters{ format, dim, numSamples };
+    std::string file;
+    uint64_t key;
+    if (!context.textureCachePath.empty() && cacheKey(MapKind::BrdfLut, parameters, {}, key)) {
+        file = cacheFile(context.textureCachePath, key);
+        if (isCached(file, format, dim, 1, 1)) {
+            target.loadFromFile(context, file, format);
+            replaceSampler(context, target);
+            reportTime("BRDF LUT", true, tStart);
+            return;
+        }
+    }
 
-    {
-        // Pre-filtered cube map
-        // Image
-        vk::ImageCreateInfo imageCI;
-        imageCI.imageType = vk::ImageType::e2D;
-        imageCI.format = format;
-        imageCI.extent.width = dim;
-        imageCI.extent.height = dim;
-        imageCI.extent.depth = 1;
-        imageCI.mipLevels = numMips;
-        imageCI.arrayLayers = 6;
-        imageCI.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
-        imageCI.flags = vk::ImageCreateFlagBits::eCubeCompatible;
+    createTarget(context, target, format, dim, 1, 1);
+    vk::SpecializationMapEntry specializationEntry{ 0, 0, sizeof(uint32_t) };
+    vk::SpecializationInfo specializationInfo{ 1, &specializationEntry, sizeof(numSamples), &numSamples };
+    Generator generator;
+    generator.create(context, twoChannels ? "genbrdflut.comp.spv" : "genbrdflut_rgba.comp.spv", target, nullptr, 0, &specializationInfo);
+    generate(context, target, file, [&](const vk::CommandBuffer& commandBuffer) {
+        generator.bind(commandBuffer, 0);
+        const uint32_t groups = (dim + LUT_GROUP_SIZE - 1) / LUT_GROUP_SIZE;
+        commandBuffer.dispatch(groups, groups, 1);
+    });
+    generator.destroy();
 
-        target = context.createImage(imageCI);
-
-        // Image view
-        vk::ImageViewCreateInfo viewCI;
-        viewCI.viewType = vk::ImageViewType::eCube;
-        viewCI.format = format;
-        viewCI.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-        viewCI.subresourceRange.levelCount = numMips;
-        viewCI.subresourceRange.layerCount = 6;
-        viewCI.image = target.image;
-        target.view = device.createImageView(viewCI);
-        // Sampler
-        vk::SamplerCreateInfo samplerCI;
-        samplerCI.magFilter = vk::Filter::eLinear;
-        samplerCI.minFilter = vk::Filter::eLinear;
-        samplerCI.mipmapMode = vk::SamplerMipmapMode::eLinear;
-        samplerCI.addressModeU = vk::SamplerAddressMode::eClampToEdge;
-        samplerCI.addressModeV = vk::SamplerAddressMode::eClampToEdge;
-        samplerCI.addressModeW = vk::SamplerAddressMode::eClampToEdge;
-        samplerCI.maxLod = static_cast<float>(numMips);
-        samplerCI.borderColor = vk::BorderColor::eFloatOpaqueWhite;
-        target.sampler = device.createSampler(samplerCI);
-        target.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-        target.updateDescriptor();
-    }
+    reportTime("BRDF LUT", false, tStart);
+}
 
-    vk::RenderPass renderpass;
-    {
-        // FB, Att, RP, Pipe, etc.
-        vk::AttachmentDescription attDesc = {};
-        // Color attachment
-        attDesc.format = format;
-        attDesc.loadOp = vk::AttachmentLoadOp::eClear;
-        attDesc.storeOp = vk::AttachmentStoreOp::eStore;
-        attDesc.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
-        attDesc.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-        attDesc.initialLayout = vk::ImageLayout::eUndefined;
-        attDesc.finalLayout = vk::ImageLayout::eColorAttachmentOptimal;
-        vk::AttachmentReference colorReference{ 0, vk::ImageLayout::eColorAttachmentOptimal };
-        vk::SubpassDescription subpassDescription{ {}, vk::PipelineBindPoint::eGraphics, 0, nullptr, 1, &colorReference };
-
-        // Use subpass dependencies for layout transitions
-        std::array<vk::SubpassDependency, 2> dependencies{
-            vk::SubpassDependency{ VK_SUBPASS_EXTERNAL, 0, vk::PipelineStageFlagBits::eBottomOfPipe, vk::PipelineStageFlagBits::eColorAttachmentOutput,
-                                   vk::AccessFlagBits::eMemoryRead, vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
-                                   vk::DependencyFlagBits::eByRegion },
-            vk::SubpassDependency{ 0, VK_SUBPASS_EXTERNAL, vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eBottomOfPipe,
-                                   vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite, vk::AccessFlagBits::eMemoryRead,
-                                   vk::DependencyFlagBits::eByRegion },
-        };
+// Generate an irradiance cube map from the environment cube map
+void vkx::pbr::generateIrradianceCube(const vks::Context& context,
+                                      vks::texture::TextureCubeMap& target,
+                                      const vks::texture::TextureCubeMap& environment,
+                                      const std::string& environmentFile) {
+    auto tStart = std::chrono::high_resolution_clock::now();
 
-        // Renderpass
-        vk::RenderPassCreateInfo renderPassCI;
-        renderPassCI.attachmentCount = 1;
-        renderPassCI.pAttachments = &attDesc;
-        renderPassCI.subpassCount = 1;
-        renderPassCI.pSubpasses = &subpassDescription;
-        renderPassCI.dependencyCount = 2;
-        renderPassCI.pDependencies = dependencies.data();
+    const vk::Format format = vk::Format::eR32G32B32A32Sfloat;
+    const uint32_t dim = 64;
+    const uint32_t numMips = static_cast<uint32_t>(floor(log2(dim))) + 1;
 
-        renderpass = device.createRenderPass(renderPassCI);
-    }
+    // Sampling deltas
+    struct PushBlock {
+        float deltaPhi = (2.0f * float(M_PI)) / 180.0f;
+        float deltaTheta = (0.5f * float(M_PI)) / 64.0f;
+    } pushBlock;
 
     struct {
-        vks::Image image;
-        vk::Framebuffer framebuffer;
-    } offscreen;
-
-    // Offfscreen framebuffer
-    {
-        // Color attachment
-        vk::ImageCreateInfo imageCreateInfo;
-        imageCreateInfo.imageType = vk::ImageType::e2D;
-        imageCreateInfo.format = format;
-        imageCreateInfo.extent.width = dim;
-        imageCreateInfo.extent.height = dim;
-        imageCreateInfo.extent.depth = 1;
-        imageCreateInfo.mipLevels = 1;
-        imageCreateInfo.arrayLayers = 1;
-        imageCreateInfo.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc;
-        offscreen.image = context.createImage(imageCreateInfo);
-
-        vk::ImageViewCreateInfo colorImageView;
-        colorImageView.viewType = vk::ImageViewType::e2D;
-        colorImageView.format = format;
-        colorImageView.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-        colorImageView.subresourceRange.levelCount = 1;
-        colorImageView.subresourceRange.layerCount = 1;
-        colorImageView.image = offscreen.image.image;
-        offscreen.image.view = device.createImageView(colorImageView);
-
-        vk::FramebufferCreateInfo fbufCreateInfo;
-        fbufCreateInfo.renderPass = renderpass;
-        fbufCreateInfo.attachmentCount = 1;
-        fbufCreateInfo.pAttachments = &offscreen.image.view;
-        fbufCreateInfo.width = dim;
-        fbufCreateInfo.height = dim;
-        fbufCreateInfo.layers = 1;
-        offscreen.framebuffer = device.createFramebuffer(fbufCreateInfo);
-        context.setImageLayout(offscreen.image.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal);
+        vk::Format format;
+        uint32_t dim;
+        PushBlock pushBlock;
+    } parameters{ format, dim, pushBlock };
+    std::string file;
+    uint64_t key;
+    if (!context.textureCachePath.empty() && cacheKey(MapKind::IrradianceCube, parameters, environmentFile, key)) {
+        file = cacheFile(context.textureCachePath, key);
+        if (isCached(file, format, dim, numMips, 6)) {
+            target.loadFromFile(context, file, format);
+            replaceSampler(context, target);
+            reportTime("irradiance cube", true, tStart);
+            return;
+        }
     }
 
-    // Descriptors
-    vk::DescriptorSetLayout descriptorsetlayout;
-    vk::DescriptorSetLayoutBinding setLayoutBinding{ 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment };
-    descriptorsetlayout = device.createDescriptorSetLayout({ {}, 1, &setLayoutBinding });
+    createTarget(context, target, format, dim, numMips, 6);
+    Generator generator;
+    generator.create(context, "irradiancecube.comp.spv", target, &environment.descriptor, sizeof(PushBlock));
+    generate(context, target, file, [&](const vk::CommandBuffer& commandBuffer) {
+        for (uint32_t m = 0; m < numMips; m++) {
+            generator.bind(commandBuffer, m);
+            commandBuffer.pushConstants<PushBlock>(generator.pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushBlock);
+            const uint32_t groups = (std::max(dim >> m, 1u) + CUBE_GROUP_SIZE - 1) / CUBE_GROUP_SIZE;
+            commandBuffer.dispatch(groups, groups, 6);
+        }
+    });
+    generator.destroy();
+
+    reportTime("irradiance cube", false, tStart);
+}
 
-    // Descriptor Pool
-    vk::DescriptorPoolSize poolSize{ vk::DescriptorType::eCombinedImageSampler, 1 };
-    vk::DescriptorPool descriptorpool = device.createDescriptorPool({ {}, 2, 1, &poolSize });
-    // Descriptor sets
-    vk::DescriptorSet descriptorset = device.allocateDescriptorSets({ descriptorpool, 1, &descriptorsetlayout })[0];
-    vk::WriteDescriptorSet writeDescriptorSet{ descriptorset, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &skyboxDescriptor };
-    device.updateDescriptorSets(writeDescriptorSet, nullptr);
+// Project the environment cube map's irradiance onto the order 2 spherical harmonics
+void vkx::pbr::generateIrradianceSH(const vks::Context& context, vks::Buffer& target, const vks::texture::TextureCubeMap& environment) {
+    auto tStart = std::chrono::high_resolution_clock::now();
+    const auto& device = context.device;
 
-    // Pipeline layout
+    // The level that is about SH_SAMPLE_DIM wide, the harmonics are far too smooth to need more
     struct PushBlock {
-        glm::mat4 mvp;
-        // Sampling deltas
-        float deltaPhi = (2.0f * float(M_PI)) / 180.0f;
-        float deltaTheta = (0.5f * float(M_PI)) / 64.0f;
+        uint32_t size;
+        float lod;
     } pushBlock;
-    vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, sizeof(PushBlock) };
+    const uint32_t envDim = environment.extent.width;
+    pushBlock.size = std::min(envDim, SH_SAMPLE_DIM);
+    pushBlock.lod = std::min(log2f((float)envDim / (float)pushBlock.size), (float)(environment.mipLevels - 1));
 
-    vk::PipelineLayout pipelinelayout = device.createPipelineLayout(vk::PipelineLayoutCreateInfo{ {}, 1, &descriptorsetlayout, 1, &pushConstantRange });
+    target = context.createBuffer(vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+                                  vk::MemoryPropertyFlagBits::eDeviceLocal, IRRADIANCE_SH_SIZE);
+    target.setupDescriptor(IRRADIANCE_SH_SIZE);
 
-    // Pipeline
-    vks::pipelines::GraphicsPipelineBuilder pipelineBuilder{ device, pipelinelayout, renderpass };
-    pipelineBuilder.rasterizationState.cullMode = vk::CullModeFlagBits::eNone;
-    pipelineBuilder.depthStencilState = { false };
-    pipelineBuilder.vertexInputState.bindingDescriptions = {
-        { 0, vertexLayout.stride(), vk::VertexInputRate::eVertex },
+    std::vector<vk::DescriptorSetLayoutBinding> bindings{
+        { 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute },
+        { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
     };
-    pipelineBuilder.vertexInputState.attributeDescriptions = {
-        { 0, 0, vk::Format::eR32G32B32Sfloat, 0 },
+    std::vector<vk::DescriptorPoolSize> poolSizes{ { vk::DescriptorType::eCombinedImageSampler, 1 }, { vk::DescriptorType::eStorageBuffer, 1 } };
+    const auto descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)bindings.size(), bindings.data() });
+    vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushBlock) };
+    const auto pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout, 1, &pushConstantRange });
+    const auto descriptorPool = device.createDescriptorPool({ {}, 1, (uint32_t)poolSizes.size(), poolSizes.data() });
+    const auto descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+    std::vector<vk::WriteDescriptorSet> writes{
+        { descriptorSet, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &environment.descriptor },
+        { descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &target.descriptor },
     };
+    device.updateDescriptorSets(writes, nullptr);
+
+    vk::ComputePipelineCreateInfo pipelineCreateInfo;
+    pipelineCreateInfo.layout = pipelineLayout;
+    pipelineCreateInfo.stage = vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/pbr/irradiancesh.comp.spv", vk::ShaderStageFlagBits::eCompute);
+    const auto pipeline = device.createComputePipeline(context.pipelineCache, pipelineCreateInfo);
+    device.destroyShaderModule(pipelineCreateInfo.stage.module);
+
+    context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
+        commandBuffer.pushConstants<PushBlock>(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushBlock);
+        // A single workgroup does the whole reduction
+        commandBuffer.dispatch(1, 1, 1);
+        vk::BufferMemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eUniformRead, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                                         target.buffer, 0, VK_WHOLE_SIZE };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eFragmentShader, {}, nullptr, barrier, nullptr);
+    });
 
-    pipelineBuilder.loadShader(vkx::getAssetPath() + "shaders/pbr/filtercube.vert.spv", vk::ShaderStageFlagBits::eVertex);
-    pipelineBuilder.loadShader(vkx::getAssetPath() + "shaders/pbr/irradiancecube.frag.spv", vk::ShaderStageFlagBits::eFragment);
-    vk::Pipeline pipeline = pipelineBuilder.create(context.pipelineCache);
-
-    // Render
-    vk::ClearValue clearValues[1];
-    clearValues[0].color = vks::util::clearColor({ 0.0f, 0.0f, 0.2f, 0.0f });
-
-    vk::RenderPassBeginInfo renderPassBeginInfo{ renderpass, offscreen.framebuffer, vk::Rect2D{ vk::Offset2D{}, vk::Extent2D{ (uint32_t)dim, (uint32_t)dim } },
-                                                 1, clearValues };
-
-    const std::vector<glm::mat4> matrices = {
-        // POSITIVE_X
-        glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-        // NEGATIVE_X
-        glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-        // POSITIVE_Y
-        glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-        // NEGATIVE_Y
-        glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-        // POSITIVE_Z
-        glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-        // NEGATIVE_Z
-        glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
-    };
+    device.destroyPipeline(pipeline);
+    device.destroyPipelineLayout(pipelineLayout);
+    device.destroyDescriptorPool(descriptorPool);
+    device.destroyDescriptorSetLayout(descriptorSetLayout);
 
-    context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& cmdBuf) {
-        vk::Viewport viewport{ 0, 0, (float)dim, (float)dim, 0.0f, 1.0f };
-        vk::Rect2D scissor{ vk::Offset2D{}, vk::Extent2D{ (uint32_t)dim, (uint32_t)dim } };
+    reportTime("irradiance spherical harmonics", false, tStart);
+}
 
-        cmdBuf.setViewport(0, viewport);
-        cmdBuf.setScissor(0, scissor);
+// Prefilter environment cubemap
+// See https://placeholderart.wordpress.com/2015/07/28/implementation-notes-runtime-environment-map-filtering-for-image-based-lighting/
+void vkx::pbr::generatePrefilteredCube(const vks::Context& context,
+                                       vks::texture::TextureCubeMap& target,
+                                       const vks::texture::TextureCubeMap& environment,
+                                       const std::string& environmentFile,
+                                       const PrefilterSettings& settings) {
+    auto tStart = std::chrono::high_resolution_clock::now();
 
-        vk::ImageSubresourceRange subresourceRange = {};
-        subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-        subresourceRange.levelCount = numMips;
-        subresourceRange.layerCount = 6;
+    const vk::Format format = vk::Format::eR16G16B16A16Sfloat;
+    const uint32_t dim = 512;
+    const uint32_t numMips = static_cast<uint32_t>(floor(log2(dim))) + 1;
 
-        // Change image layout for all cubemap faces to transfer destination
-        context.setImageLayout(cmdBuf, target.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, subresourceRange);
+    struct PushBlock {
+        float roughness;
+        uint32_t numSamples;
+    } pushBlock;
 
-        for (uint32_t m = 0; m < numMips; m++) {
-            for (uint32_t f = 0; f < 6; f++) {
-                viewport.width = static_cast<float>(dim * std::pow(0.5f, m));
-                viewport.height = static_cast<float>(dim * std::pow(0.5f, m));
-                cmdBuf.setViewport(0, 1, &viewport);
-                // Render scene from cube face's point of view
-                cmdBuf.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-
-                // Update shader push constant block
-                pushBlock.mvp = glm::perspective((float)(M_PI / 2.0), 1.0f, 0.1f, 512.0f) * matrices[f];
-
-                cmdBuf.pushConstants<PushBlock>(pipelinelayout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, pushBlock);
-
-                cmdBuf.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
-                cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelinelayout, 0, descriptorset, nullptr);
-
-                std::vector<vk::DeviceSize> offsets{ 0 };
-
-                cmdBuf.bindVertexBuffers(0, skybox.vertices.buffer, offsets);
-                cmdBuf.bindIndexBuffer(skybox.indices.buffer, 0, vk::IndexType::eUint32);
-                cmdBuf.drawIndexed(skybox.indexCount, 1, 0, 0, 0);
-
-                cmdBuf.endRenderPass();
-
-                context.setImageLayout(cmdBuf, offscreen.image.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eColorAttachmentOptimal,
-                                       vk::ImageLayout::eTransferSrcOptimal);
-
-                // Copy region for transfer from framebuffer to cube face
-                vk::ImageCopy copyRegion;
-                copyRegion.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-                copyRegion.srcSubresource.baseArrayLayer = 0;
-                copyRegion.srcSubresource.mipLevel = 0;
-                copyRegion.srcSubresource.layerCount = 1;
-                copyRegion.srcOffset = vk::Offset3D{};
-                copyRegion.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-                copyRegion.dstSubresource.baseArrayLayer = f;
-                copyRegion.dstSubresource.mipLevel = m;
-                copyRegion.dstSubresource.layerCount = 1;
-                copyRegion.dstOffset = vk::Offset3D{};
-                copyRegion.extent.width = static_cast<uint32_t>(viewport.width);
-                copyRegion.extent.height = static_cast<uint32_t>(viewport.height);
-                copyRegion.extent.depth = 1;
-
-                cmdBuf.copyImage(offscreen.image.image, vk::ImageLayout::eTransferSrcOptimal, target.image, vk::ImageLayout::eTransferDstOptimal, copyRegion);
-
-                // Transform framebuffer color attachment back
-                context.setImageLayout(cmdBuf, offscreen.image.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eTransferSrcOptimal,
-                                       vk::ImageLayout::eColorAttachmentOptimal);
+    const uint32_t minSamples = std::min(settings.minSamples, settings.maxSamples);
+    const uint32_t maxSamples = std::min(settings.maxSamples, PrefilterSettings::MAX_SAMPLES);
+    struct {
+        vk::Format format;
+        uint32_t dim;
+        uint32_t minSamples;
+        uint32_t maxSamples;
+    } parameters{ format, dim, minSamples, maxSamples };
+    // The fixed count of the comparison pass, see PrefilterSettings::compareFixed
+    const uint32_t fixedSamples = 32;
+    const bool compareFixed = settings.report && settings.compareFixed;
+    std::string file;
+    uint64_t key;
+    if (!context.textureCachePath.empty() && cacheKey(MapKind::PrefilteredCube, parameters, environmentFile, key)) {
+        file = cacheFile(context.textureCachePath, key);
+        if (!compareFixed && isCached(file, format, dim, numMips, 6)) {
+            target.loadFromFile(context, file, format);
+            replaceSampler(context, target);
+            reportTime("pre-filtered environment cube", true, tStart);
+            return;
+        }
+    }
+    if (environment.mipLevels == 1) {
+        std::cout << "The environment cube has no mip chain, pre-filtering will alias at the sample counts used" << std::endl;
+    }
+
+    const std::vector<uint32_t> sampleCounts = prefilterSampleCounts(numMips, settings);
+
+    vks::debug::GpuProfiler profiler;
+    if (settings.report) {
+        profiler.create(context.physicalDevice, context.device, context.queueIndices.graphics, 1, compareFixed ? 2 * numMips : numMips);
+    }
+
+    createTarget(context, target, format, dim, numMips, 6);
+    Generator generator;
+    generator.create(context, "prefilterenvmap.comp.spv", target, &environment.descriptor, sizeof(PushBlock));
+    generate(context, target, file, [&](const vk::CommandBuffer& commandBuffer) {
+        profiler.beginCommandBuffer(commandBuffer, 0);
+        const auto filter = [&](const std::string& name, uint32_t m, uint32_t numSamples) {
+            profiler.beginScope(commandBuffer, name + std::to_string(m));
+            pushBlock.roughness = (float)m / (float)(numMips - 1);
+            pushBlock.numSamples = numSamples;
+            generator.bind(commandBuffer, m);
+            commandBuffer.pushConstants<PushBlock>(generator.pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushBlock);
+            const uint32_t groups = (std::max(dim >> m, 1u) + CUBE_GROUP_SIZE - 1) / CUBE_GROUP_SIZE;
+            commandBuffer.dispatch(groups, groups, 6);
+            profiler.endScope(commandBuffer);
+        };
+        if (compareFixed) {
+            for (uint32_t m = 0; m < numMips; m++) {
+                filter("Fixed level ", m, fixedSamples);
             }
+            // The adaptive pass overwrites the same texels
+            vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderWrite };
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr,
+                                          nullptr);
+        }
+        for (uint32_t m = 0; m < numMips; m++) {
+            filter("Level ", m, sampleCounts[m]);
         }
-        context.setImageLayout(cmdBuf, target.image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, subresourceRange);
+        profiler.endCommandBuffer(commandBuffer);
     });
+    generator.destroy();
+
+    // The sample total is put next to that of fixedSamples for every texel of every level.  The GPU time the fixed
+    // count takes is only known when compareFixed ran it, with the same shader, so the two times differ by the
+    // sample counts alone.
+    if (profiler.enabled()) {
+        profiler.collect(0);
+        const auto& scopes = profiler.getScopes();
+        const uint32_t first = compareFixed ? numMips : 0;
+        double gpuMilliseconds = 0.0;
+        double fixedGpuMilliseconds = 0.0;
+        uint64_t texelSamples = 0;
+        uint64_t fixedTexelSamples = 0;
+        for (uint32_t m = 0; m < numMips && first + m < scopes.size(); m++) {
+            const uint64_t texels = 6ull * std::max(dim >> m, 1u) * std::max(dim >> m, 1u);
+            texelSamples += texels * sampleCounts[m];
+            fixedTexelSamples += texels * fixedSamples;
+            gpuMilliseconds += scopes[first + m].lastMilliseconds;
+            std::cout << "  level " << m << ": " << sampleCounts[m] << " samples, " << scopes[first + m].lastMilliseconds << " ms";
+            if (compareFixed) {
+                fixedGpuMilliseconds += scopes[m].lastMilliseconds;
+                std::cout << " (" << scopes[m].lastMilliseconds << " ms with " << fixedSamples << ")";
+            }
+            std::cout << std::endl;
+        }
+        std::cout << "Pre-filtering took " << gpuMilliseconds << " ms on the GPU, for " << texelSamples << " environment samples ("
+                  << (100.0 * texelSamples / fixedTexelSamples) << "% of " << fixedSamples << " samples for every texel)" << std::endl;
+        if (compareFixed) {
+            std::cout << "With " << fixedSamples << " samples for every texel it took " << fixedGpuMilliseconds << " ms on the GPU" << std::endl;
+        }
+        profiler.destroy();
+    }
 
-    // todo: cleanup
-    device.destroyRenderPass(renderpass, nullptr);
-    device.destroyFramebuffer(offscreen.framebuffer, nullptr);
-    offscreen.image.destroy();
-    device.destroyDescriptorPool(descriptorpool, nullptr);
-    device.destroyDescriptorSetLayout(descriptorsetlayout, nullptr);
-    device.destroyPipeline(pipeline, nullptr);
-    device.destroyPipelineLayout(pipelinelayout, nullptr);
-
-    auto tEnd = std::chrono::high_resolution_clock::now();
-    auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-    std::cout << "Generating irradiance cube with " << numMips << " mip levels took " << tDiff << " ms" << std::endl;
+    reportTime("pre-filtered environment cube", false, tStart);
 }
 
-// Prefilter environment cubemap
-// See https://placeholderart.wordpress.com/2015/07/28/implementation-notes-runtime-environment-map-filtering-for-image-based-lighting/
-void vkx::pbr::generatePrefilteredCube(const vks::Context& context,
-                                       vks::texture::Texture& target,
-                                       const vks::model::Model& skybox,
-                                       const vks::model::VertexLayout& vertexLayout,
-                                       const vk::DescriptorImageInfo& skyboxDescriptor) {
-    auto tStart = std::chrono::high_resolution_clock::now();
+// The pre-filter of a reflection probe, reading its capture
+struct vkx::pbr::ReflectionProbe::Prefilter : Generator {};
+
+namespace {
+
+// Steps of a reflection probe update before the pre-filtering of its levels: the six faces and the capture's mip chain
+const uint32_t PROBE_CAPTURE_STEPS = 7;
+
+// Direction through the center of face i of a cube, and those of its texel's columns and rows, matching
+// cubeDirection in sampling.glsl
+const std::array<std::array<glm::vec3, 3>, 6> CUBE_FACE_AXES{ {
+    { { { 1, 0, 0 }, { 0, 0, -1 }, { 0, -1, 0 } } },
+    { { { -1, 0, 0 }, { 0, 0, 1 }, { 0, -1, 0 } } },
+    { { { 0, 1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } } },
+    { { { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, -1 } } },
+    { { { 0, 0, 1 }, { 1, 0, 0 }, { 0, -1, 0 } } },
+    { { { 0, 0, -1 }, { -1, 0, 0 }, { 0, -1, 0 } } },
+} };
+
+}  // namespace
 
+void vkx::pbr::ReflectionProbe::create(const vks::Context& context, const glm::vec3& position, uint32_t slotCount, const ReflectionProbeSettings& settings) {
+    destroy();
     const auto& device = context.device;
-    target.device = device;
-    target.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+    // The capture's mip chain is blitted, and its faces are rendered and filtered from
+    const vk::FormatFeatureFlags captureFeatures = vk::FormatFeatureFlagBits::eColorAttachment | vk::FormatFeatureFlagBits::eBlitSrc |
+                                                   vk::FormatFeatureFlagBits::eBlitDst | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+    if ((context.getFormatProperties(settings.format).optimalTilingFeatures & captureFeatures) != captureFeatures) {
+        throw std::runtime_error("Reflection probes can't capture in " + vk::to_string(settings.format));
+    }
+    this->context = &context;
+    this->position = position;
+    this->settings = settings;
+    depthFormat = context.getSupportedDepthFormat();
+
+    const uint32_t captureDim = settings.captureDim;
+    vk::ImageCreateInfo imageCI;
+    imageCI.imageType = vk::ImageType::e2D;
+    imageCI.format = settings.format;
+    imageCI.extent = vk::Extent3D{ captureDim, captureDim, 1 };
+    imageCI.mipLevels = static_cast<uint32_t>(floor(log2(captureDim))) + 1;
+    imageCI.arrayLayers = 6;
+    imageCI.flags = vk::ImageCreateFlagBits::eCubeCompatible;
+    imageCI.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc |
+                    vk::ImageUsageFlagBits::eTransferDst;
+    static_cast<vks::Image&>(capture) = context.createImage(imageCI);
+    capture.device = device;
+    capture.mipLevels = imageCI.mipLevels;
+    capture.layerCount = 6;
+    capture.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+    capture.descriptor.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+    vk::ImageViewCreateInfo viewCI;
+    viewCI.viewType = vk::ImageViewType::eCube;
+    viewCI.format = settings.format;
+    viewCI.subresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, capture.mipLevels, 0, 6 };
+    viewCI.image = capture.image;
+    capture.view = device.createImageView(viewCI);
+    createSampler(context, capture);
+
+    vk::ImageCreateInfo depthCI;
+    depthCI.imageType = vk::ImageType::e2D;
+    depthCI.format = depthFormat;
+    depthCI.extent = imageCI.extent;
+    depthCI.mipLevels = 1;
+    depthCI.arrayLayers = 1;
+    depthCI.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
+    depth = context.createImage(depthCI);
+    viewCI.viewType = vk::ImageViewType::e2D;
+    viewCI.format = depthFormat;
+    viewCI.subresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1 };
+    viewCI.image = depth.image;
+    depth.view = device.createImageView(viewCI);
+
+    // Every face is cleared and rendered whole, and left for the mip chain to be blitted from
+    std::array<vk::AttachmentDescription, 2> attachments;
+    attachments[0].format = settings.format;
+    attachments[0].loadOp = vk::AttachmentLoadOp::eClear;
+    attachments[0].storeOp = vk::AttachmentStoreOp::eStore;
+    attachments[0].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+    attachments[0].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+    attachments[0].initialLayout = vk::ImageLayout::eUndefined;
+    attachments[0].finalLayout = vk::ImageLayout::eTransferSrcOptimal;
+    attachments[1].format = depthFormat;
+    attachments[1].loadOp = vk::AttachmentLoadOp::eClear;
+    attachments[1].storeOp = vk::AttachmentStoreOp::eDontCare;
+    attachments[1].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+    attachments[1].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+    attachments[1].initialLayout = vk::ImageLayout::eUndefined;
+    attachments[1].finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+    vk::AttachmentReference colorReference{ 0, vk::ImageLayout::eColorAttachmentOptimal };
+    vk::AttachmentReference depthReference{ 1, vk::ImageLayout::eDepthStencilAttachmentOptimal };
+    vk::SubpassDescription subpass;
+    subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorReference;
+    subpass.pDepthStencilAttachment = &depthReference;
+
+    // The previous update's pre-filter read the capture, and the previous face used the same depth buffer
+    std::array<vk::SubpassDependency, 2> dependencies;
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eLateFragmentTests;
+    dependencies[0].dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests;
+    dependencies[0].srcAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+    dependencies[0].dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+    dependencies[1].dstStageMask = vk::PipelineStageFlagBits::eTransfer;
+    dependencies[1].srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
+    dependencies[1].dstAccessMask = vk::AccessFlagBits::eTransferRead;
+    vk::RenderPassCreateInfo renderPassInfo;
+    renderPassInfo.attachmentCount = (uint32_t)attachments.size();
+    renderPassInfo.pAttachments = attachments.data();
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = (uint32_t)dependencies.size();
+    renderPassInfo.pDependencies = dependencies.data();
+    renderPass = device.createRenderPass(renderPassInfo);
+
+    viewCI.format = settings.format;
+    viewCI.image = capture.image;
+    for (uint32_t face = 0; face < 6; ++face) {
+        viewCI.subresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, face, 1 };
+        faceViews.push_back(device.createImageView(viewCI));
+        const std::array<vk::ImageView, 2> views{ faceViews.back(), depth.view };
+        framebuffers.push_back(device.createFramebuffer({ {}, renderPass, (uint32_t)views.size(), views.data(), captureDim, captureDim, 1 }));
+    }
 
+    // Levels are pre-filtered into the back cube and copied to the front one as a whole, which starts out black
     const vk::Format format = vk::Format::eR16G16B16A16Sfloat;
-    const int32_t dim = 512;
-    const uint32_t numMips = static_cast<uint32_t>(floor(log2(dim))) + 1;
+    const uint32_t numMips = static_cast<uint32_t>(floor(log2(settings.dim))) + 1;
+    createTarget(context, back, format, settings.dim, numMips, 6);
+    createTarget(context, front, format, settings.dim, numMips, 6, vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst);
+    context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+        imageBarrier(commandBuffer, front, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, vk::PipelineStageFlagBits::eTopOfPipe, {},
+                     vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite);
+        commandBuffer.clearColorImage(front.image, vk::ImageLayout::eTransferDstOptimal, vks::util::clearColor(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)),
+                                      vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, numMips, 0, 6 });
+        imageBarrier(commandBuffer, front, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, vk::PipelineStageFlagBits::eTransfer,
+                     vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eFragmentShader, vk::AccessFlagBits::eShaderRead);
+    });
+    prefilter = new Prefilter();
+    prefilter->create(context, "prefilterenvmap.comp.spv", back, &capture.descriptor, sizeof(PrefilterPushBlock));
+    sampleCounts = prefilterSampleCounts(numMips, settings.prefilter);
+
+    // The faces, the capture's mip chain, every level and publishing the result
+    costs.assign(PROBE_CAPTURE_STEPS + numMips + 1, -1.0);
+    slotSteps.assign(slotCount, {});
+    profiler.create(context.physicalDevice, device, context.queueIndices.graphics, slotCount, (uint32_t)costs.size());
+    step = 0;
+    idle = false;
+}
 
-    // Pre-filtered cube map
-    // Image
-    {
-        vk::ImageCreateInfo imageCI;
-        imageCI.imageType = vk::ImageType::e2D;
-        imageCI.format = format;
-        imageCI.extent.width = dim;
-        imageCI.extent.height = dim;
-        imageCI.extent.depth = 1;
-        imageCI.mipLevels = numMips;
-        imageCI.arrayLayers = 6;
-        imageCI.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
-        imageCI.flags = vk::ImageCreateFlagBits::eCubeCompatible;
-        target = context.createImage(imageCI);
-        // Image view
-        vk::ImageViewCreateInfo viewCI;
-        viewCI.viewType = vk::ImageViewType::eCube;
-        viewCI.format = format;
-        viewCI.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-        viewCI.subresourceRange.levelCount = numMips;
-        viewCI.subresourceRange.layerCount = 6;
-        viewCI.image = target.image;
-        target.view = device.createImageView(viewCI);
-        // Sampler
-        vk::SamplerCreateInfo samplerCI;
-        samplerCI.magFilter = vk::Filter::eLinear;
-        samplerCI.minFilter = vk::Filter::eLinear;
-        samplerCI.mipmapMode = vk::SamplerMipmapMode::eLinear;
-        samplerCI.addressModeU = vk::SamplerAddressMode::eClampToEdge;
-        samplerCI.addressModeV = vk::SamplerAddressMode::eClampToEdge;
-        samplerCI.addressModeW = vk::SamplerAddressMode::eClampToEdge;
-        samplerCI.maxLod = static_cast<float>(numMips);
-        samplerCI.borderColor = vk::BorderColor::eFloatOpaqueWhite;
-        target.sampler = device.createSampler(samplerCI);
-        target.descriptor.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-        target.updateDescriptor();
+void vkx::pbr::ReflectionProbe::destroy() {
+    if (!context) {
+        return;
     }
+    const auto& device = context->device;
+    if (prefilter) {
+        prefilter->destroy();
+        delete prefilter;
+        prefilter = nullptr;
+    }
+    profiler.destroy();
+    for (const auto& framebuffer : framebuffers) {
+        device.destroyFramebuffer(framebuffer);
+    }
+    framebuffers.clear();
+    for (const auto& view : faceViews) {
+        device.destroyImageView(view);
+    }
+    faceViews.clear();
+    device.destroyRenderPass(renderPass);
+    renderPass = vk::RenderPass();
+    depth.destroy();
+    capture.destroy();
+    back.destroy();
+    front.destroy();
+    costs.clear();
+    slotSteps.clear();
+    context = nullptr;
+}
 
-    vk::RenderPass renderpass;
-    {
-        // FB, Att, RP, Pipe, etc.
-        vk::AttachmentDescription attDesc = {};
-        // Color attachment
-        attDesc.format = format;
-        attDesc.loadOp = vk::AttachmentLoadOp::eClear;
-        attDesc.storeOp = vk::AttachmentStoreOp::eStore;
-        attDesc.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
-        attDesc.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-        attDesc.initialLayout = vk::ImageLayout::eUndefined;
-        attDesc.finalLayout = vk::ImageLayout::eColorAttachmentOptimal;
-        vk::AttachmentReference colorReference{ 0, vk::ImageLayout::eColorAttachmentOptimal };
-
-        vk::SubpassDescription subpassDescription = {};
-        subpassDescription.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
-        subpassDescription.colorAttachmentCount = 1;
-        subpassDescription.pColorAttachments = &colorReference;
-
-        // Use subpass dependencies for layout transitions
-        std::array<vk::SubpassDependency, 2> dependencies{
-            vk::SubpassDependency{ VK_SUBPASS_EXTERNAL, 0, vk::PipelineStageFlagBits::eBottomOfPipe, vk::PipelineStageFlagBits::eColorAttachmentOutput,
-                                   vk::AccessFlagBits::eMemoryRead, vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
-                                   vk::DependencyFlagBits::eByRegion },
-            vk::SubpassDependency{ 0, VK_SUBPASS_EXTERNAL, vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eBottomOfPipe,
-                                   vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite, vk::AccessFlagBits::eMemoryRead,
-                                   vk::DependencyFlagBits::eByRegion },
-        };
-
-        // Renderpass
-        renderpass = device.createRenderPass({ {}, 1, &attDesc, 1, &subpassDescription, (uint32_t)dependencies.size(), dependencies.data() });
+bool vkx::pbr::ReflectionProbe::update(const vk::CommandBuffer& commandBuffer, uint32_t slot, const RenderFace& renderFace) {
+    // Fold in the timings of the steps the slot recorded last time
+    auto& steps = slotSteps[slot];
+    const uint64_t collections = profiler.getCollectionCount();
+    profiler.collect(slot);
+    if (profiler.getCollectionCount() != collections) {
+        const auto& scopes = profiler.getScopes();
+        for (size_t i = 0; i < scopes.size() && i < steps.size(); ++i) {
+            double& cost = costs[steps[i]];
+            cost = cost < 0.0 ? scopes[i].lastMilliseconds : cost * 0.9 + scopes[i].lastMilliseconds * 0.1;
+        }
+    }
+    steps.clear();
+    if (idle) {
+        return false;
     }
 
-    struct {
-        vks::Image image;
-        vk::Framebuffer framebuffer;
-    } offscreen;
-
-    // Offfscreen framebuffer
-    {
-        // Color attachment
-        vk::ImageCreateInfo imageCreateInfo;
-        imageCreateInfo.imageType = vk::ImageType::e2D;
-        imageCreateInfo.format = format;
-        imageCreateInfo.extent.width = dim;
-        imageCreateInfo.extent.height = dim;
-        imageCreateInfo.extent.depth = 1;
-        imageCreateInfo.mipLevels = 1;
-        imageCreateInfo.arrayLayers = 1;
-        imageCreateInfo.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc;
-        offscreen.image = context.createImage(imageCreateInfo);
-
-        vk::ImageViewCreateInfo colorImageView;
-        colorImageView.viewType = vk::ImageViewType::e2D;
-        colorImageView.format = format;
-        colorImageView.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-        colorImageView.subresourceRange.levelCount = 1;
-        colorImageView.subresourceRange.layerCount = 1;
-        colorImageView.image = offscreen.image.image;
-        offscreen.image.view = device.createImageView(colorImageView);
-
-        vk::FramebufferCreateInfo fbufCreateInfo;
-        fbufCreateInfo.renderPass = renderpass;
-        fbufCreateInfo.attachmentCount = 1;
-        fbufCreateInfo.pAttachments = &offscreen.image.view;
-        fbufCreateInfo.width = dim;
-        fbufCreateInfo.height = dim;
-        fbufCreateInfo.layers = 1;
-        offscreen.framebuffer = device.createFramebuffer(fbufCreateInfo);
-        context.setImageLayout(offscreen.image.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal);
+    // Only the first step of an update may be one that wasn't measured yet, and without timestamps that's all of them
+    const uint32_t publish = stepCount() - 1;
+    bool published = false;
+    double spent = 0.0;
+    profiler.beginCommandBuffer(commandBuffer, slot);
+    while (steps.empty() || (costs[step] >= 0.0 && costs[steps.back()] >= 0.0 && spent + costs[step] <= settings.budget)) {
+        profiler.beginScope(commandBuffer, "Probe step " + std::to_string(step));
+        recordStep(commandBuffer, step, renderFace);
+        profiler.endScope(commandBuffer);
+        steps.push_back(step);
+        spent += std::max(costs[step], 0.0);
+        if (step == publish) {
+            published = true;
+            step = 0;
+            idle = !settings.continuous;
+            break;
+        }
+        ++step;
     }
+    profiler.endCommandBuffer(commandBuffer);
+    return published;
+}
 
-    // Descriptors
-    vk::DescriptorSetLayoutBinding setLayoutBinding{ 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment };
-    vk::DescriptorSetLayout descriptorsetlayout = device.createDescriptorSetLayout({ {}, 1, &setLayoutBinding });
-    // Descriptor Pool
-    vk::DescriptorPoolSize poolSize{ vk::DescriptorType::eCombinedImageSampler, 1 };
-    vk::DescriptorPool descriptorpool = device.createDescriptorPool({ {}, 2, 1, &poolSize });
-    // Descriptor sets
-    vk::DescriptorSet descriptorset = device.allocateDescriptorSets({ descriptorpool, 1, &descriptorsetlayout })[0];
-    vk::WriteDescriptorSet writeDescriptorSet{ descriptorset, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &skyboxDescriptor };
-    device.updateDescriptorSets(writeDescriptorSet, nullptr);
-
-    // Pipeline layout
-    struct PushBlock {
-        glm::mat4 mvp;
-        float roughness;
-        uint32_t numSamples = 32u;
-    } pushBlock;
+void vkx::pbr::ReflectionProbe::invalidate() {
+    step = 0;
+    idle = false;
+}
 
-    vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, sizeof(PushBlock) };
-    vk::PipelineLayout pipelinelayout = device.createPipelineLayout({ {}, 1, &descriptorsetlayout, 1, &pushConstantRange });
+void vkx::pbr::ReflectionProbe::setPosition(const glm::vec3& position) {
+    this->position = position;
+    invalidate();
+}
 
-    // Pipeline
-    vks::pipelines::GraphicsPipelineBuilder pipelineBuilder{ device, pipelinelayout, renderpass };
-    pipelineBuilder.rasterizationState.cullMode = vk::CullModeFlagBits::eNone;
-    pipelineBuilder.depthStencilState = { false };
-    pipelineBuilder.vertexInputState.bindingDescriptions = {
-        { 0, vertexLayout.stride(), vk::VertexInputRate::eVertex },
-    };
-    pipelineBuilder.vertexInputState.attributeDescriptions = {
-        { 0, 0, vk::Format::eR32G32B32Sfloat, 0 },
-    };
+// Looks along the face's direction, with its texel columns and rows along x and y of the framebuffer
+glm::mat4 vkx::pbr::ReflectionProbe::faceView(uint32_t face) const {
+    const auto& axes = CUBE_FACE_AXES[face];
+    glm::mat4 view(1.0f);
+    for (int i = 0; i < 3; ++i) {
+        view[i][0] = axes[1][i];
+        view[i][1] = axes[2][i];
+        view[i][2] = -axes[0][i];
+    }
+    view[3] = glm::vec4(-glm::dot(axes[1], position), -glm::dot(axes[2], position), glm::dot(axes[0], position), 1.0f);
+    return view;
+}
 
-    pipelineBuilder.loadShader(vkx::getAssetPath() + "shaders/pbr/filtercube.vert.spv", vk::ShaderStageFlagBits::eVertex);
-    pipelineBuilder.loadShader(vkx::getAssetPath() + "shaders/pbr/prefilterenvmap.frag.spv", vk::ShaderStageFlagBits::eFragment);
-    vk::Pipeline pipeline = pipelineBuilder.create(context.pipelineCache);
-
-    // Render
-
-    vk::ClearValue clearValues[1];
-    clearValues[0].color = vks::util::clearColor({ 0.0f, 0.0f, 0.2f, 0.0f });
-
-    vk::RenderPassBeginInfo renderPassBeginInfo{ renderpass,
-                                                 offscreen.framebuffer,
-                                                 { vk::Offset2D{}, vk::Extent2D{ (uint32_t)dim, (uint32_t)dim } },
-                                                 1,
-                                                 clearValues };
-    // Reuse render pass from example pass
-
-    const std::vector<glm::mat4> matrices = {
-        // POSITIVE_X
-        glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-        // NEGATIVE_X
-        glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-        // POSITIVE_Y
-        glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-        // NEGATIVE_Y
-        glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-        // POSITIVE_Z
-        glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-        // NEGATIVE_Z
-        glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
-    };
+// Not flipped in y, the first row of a cube face is at the top of the framebuffer
+glm::mat4 vkx::pbr::ReflectionProbe::projection() const {
+    return glm::perspective(glm::radians(90.0f), 1.0f, settings.zNear, settings.zFar);
+}
 
-    context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& cmdBuf) {
-        vk::Viewport viewport{ 0, 0, (float)dim, (float)dim, 0, 1 };
-        vk::Rect2D scissor{ vk::Offset2D{}, vk::Extent2D{ (uint32_t)dim, (uint32_t)dim } };
-        cmdBuf.setViewport(0, viewport);
-        cmdBuf.setScissor(0, scissor);
-        vk::ImageSubresourceRange subresourceRange{ vk::ImageAspectFlagBits::eColor, 0, numMips, 0, 6 };
-        // Change image layout for all cubemap faces to transfer destination
-        context.setImageLayout(cmdBuf, target.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, subresourceRange);
+void vkx::pbr::ReflectionProbe::recordStep(const vk::CommandBuffer& commandBuffer, uint32_t step, const RenderFace& renderFace) {
+    const uint32_t captureDim = settings.captureDim;
+    if (step < 6) {
+        std::array<vk::ClearValue, 2> clearValues;
+        clearValues[0].color = vks::util::clearColor(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        clearValues[1].depthStencil = vk::ClearDepthStencilValue{ 1.0f, 0 };
+        const vk::Rect2D area = vks::util::rect2D(captureDim, captureDim);
+        commandBuffer.beginRenderPass({ renderPass, framebuffers[step], area, (uint32_t)clearValues.size(), clearValues.data() }, vk::SubpassContents::eInline);
+        commandBuffer.setViewport(0, vks::util::viewport((float)captureDim, (float)captureDim));
+        commandBuffer.setScissor(0, area);
+        renderFace(commandBuffer, step);
+        commandBuffer.endRenderPass();
+        return;
+    }
 
-        for (uint32_t m = 0; m < numMips; m++) {
-            pushBlock.roughness = (float)m / (float)(numMips - 1);
-            for (uint32_t f = 0; f < 6; f++) {
-                viewport.width = static_cast<float>(dim * std::pow(0.5f, m));
-                viewport.height = static_cast<float>(dim * std::pow(0.5f, m));
-                cmdBuf.setViewport(0, viewport);
-
-                // Render scene from cube face's point of view
-                cmdBuf.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-
-                // Update shader push constant block
-                pushBlock.mvp = glm::perspective((float)(M_PI / 2.0), 1.0f, 0.1f, 512.0f) * matrices[f];
-
-                cmdBuf.pushConstants<PushBlock>(pipelinelayout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, pushBlock);
-                cmdBuf.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
-                cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelinelayout, 0, descriptorset, nullptr);
-
-                std::vector<vk::DeviceSize> offsets{ 0 };
-                cmdBuf.bindVertexBuffers(0, skybox.vertices.buffer, offsets);
-                cmdBuf.bindIndexBuffer(skybox.indices.buffer, 0, vk::IndexType::eUint32);
-                cmdBuf.drawIndexed(skybox.indexCount, 1, 0, 0, 0);
-
-                cmdBuf.endRenderPass();
-
-                context.setImageLayout(cmdBuf, offscreen.image.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eColorAttachmentOptimal,
-                                       vk::ImageLayout::eTransferSrcOptimal);
-
-                // Copy region for transfer from framebuffer to cube face
-                vk::ImageCopy copyRegion;
-                copyRegion.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-                copyRegion.srcSubresource.baseArrayLayer = 0;
-                copyRegion.srcSubresource.mipLevel = 0;
-                copyRegion.srcSubresource.layerCount = 1;
-                copyRegion.srcOffset = vk::Offset3D{};
-
-                copyRegion.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-                copyRegion.dstSubresource.baseArrayLayer = f;
-                copyRegion.dstSubresource.mipLevel = m;
-                copyRegion.dstSubresource.layerCount = 1;
-                copyRegion.dstOffset = vk::Offset3D{};
-
-                copyRegion.extent.width = static_cast<uint32_t>(viewport.width);
-                copyRegion.extent.height = static_cast<uint32_t>(viewport.height);
-                copyRegion.extent.depth = 1;
-
-                cmdBuf.copyImage(offscreen.image.image, vk::ImageLayout::eTransferSrcOptimal, target.image, vk::ImageLayout::eTransferDstOptimal, copyRegion);
-                // Transform framebuffer color attachment back
-                context.setImageLayout(cmdBuf, offscreen.image.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eTransferSrcOptimal,
-                                       vk::ImageLayout::eColorAttachmentOptimal);
-            }
+    const uint32_t numMips = back.mipLevels;
+    if (step == 6) {
+        // Each level of all faces at once from the one above, level 0 was left for reading by the render pass
+        const uint32_t captureMips = capture.mipLevels;
+        if (captureMips > 1) {
+            imageBarrier(commandBuffer, capture.image, vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 1, captureMips - 1, 0, 6 },
+                         vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, vk::PipelineStageFlagBits::eComputeShader, {},
+                         vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite);
         }
-        context.setImageLayout(cmdBuf, target.image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, subresourceRange);
-    });
+        for (uint32_t level = 1; level < captureMips; ++level) {
+            const int32_t srcDim = (int32_t)std::max(captureDim >> (level - 1), 1u);
+            const int32_t dstDim = (int32_t)std::max(captureDim >> level, 1u);
+            vk::ImageBlit blit;
+            blit.srcSubresource = vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, level - 1, 0, 6 };
+            blit.srcOffsets[1] = vk::Offset3D{ srcDim, srcDim, 1 };
+            blit.dstSubresource = vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, level, 0, 6 };
+            blit.dstOffsets[1] = vk::Offset3D{ dstDim, dstDim, 1 };
+            commandBuffer.blitImage(capture.image, vk::ImageLayout::eTransferSrcOptimal, capture.image, vk::ImageLayout::eTransferDstOptimal, blit,
+                                    vk::Filter::eLinear);
+            imageBarrier(commandBuffer, capture.image, vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, level, 1, 0, 6 },
+                         vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal, vk::PipelineStageFlagBits::eTransfer,
+                         vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead);
+        }
+        imageBarrier(commandBuffer, capture, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+                     vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eComputeShader,
+                     vk::AccessFlagBits::eShaderRead);
+        return;
+    }
 
-    // todo: cleanup
-    device.destroyRenderPass(renderpass, nullptr);
-    device.destroyFramebuffer(offscreen.framebuffer, nullptr);
-    offscreen.image.destroy();
-    device.destroyDescriptorPool(descriptorpool, nullptr);
-    device.destroyDescriptorSetLayout(descriptorsetlayout, nullptr);
-    device.destroyPipeline(pipeline, nullptr);
-    device.destroyPipelineLayout(pipelinelayout, nullptr);
+    if (step < PROBE_CAPTURE_STEPS + numMips) {
+        // The previous update's publish copied from the level
+        const uint32_t level = step - PROBE_CAPTURE_STEPS;
+        const vk::ImageSubresourceRange range{ vk::ImageAspectFlagBits::eColor, level, 1, 0, 6 };
+        imageBarrier(commandBuffer, back.image, range, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eTransfer, {},
+                     vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite);
+        const PrefilterPushBlock pushBlock{ numMips > 1 ? (float)level / (float)(numMips - 1) : 0.0f, sampleCounts[level] };
+        prefilter->bind(commandBuffer, level);
+        commandBuffer.pushConstants<PrefilterPushBlock>(prefilter->pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushBlock);
+        const uint32_t groups = (std::max(settings.dim >> level, 1u) + CUBE_GROUP_SIZE - 1) / CUBE_GROUP_SIZE;
+        commandBuffer.dispatch(groups, groups, 6);
+        imageBarrier(commandBuffer, back.image, range, vk::ImageLayout::eGeneral, vk::ImageLayout::eTransferSrcOptimal,
+                     vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eTransfer,
+                     vk::AccessFlagBits::eTransferRead);
+        return;
+    }
 
-    auto tEnd = std::chrono::high_resolution_clock::now();
-    auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-    std::cout << "Generating pre-filtered enivornment cube with " << numMips << " mip levels took " << tDiff << " ms" << std::endl;
+    // Publish, the scene may have sampled the front cube in the previous frame
+    std::vector<vk::ImageCopy> regions;
+    for (uint32_t level = 0; level < numMips; ++level) {
+        const uint32_t levelDim = std::max(settings.dim >> level, 1u);
+        const vk::ImageSubresourceLayers layers{ vk::ImageAspectFlagBits::eColor, level, 0, 6 };
+        regions.push_back(vk::ImageCopy{ layers, {}, layers, {}, vk::Extent3D{ levelDim, levelDim, 1 } });
+    }
+    imageBarrier(commandBuffer, front, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eTransferDstOptimal,
+                 vk::PipelineStageFlagBits::eFragmentShader, {}, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite);
+    commandBuffer.copyImage(back.image, vk::ImageLayout::eTransferSrcOptimal, front.image, vk::ImageLayout::eTransferDstOptimal, regions);
+    imageBarrier(commandBuffer, front, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, vk::PipelineStageFlagBits::eTransfer,
+                 vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eFragmentShader, vk::AccessFlagBits::eShaderRead);
 }
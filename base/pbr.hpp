@@ -1,23 +1,142 @@
 #pragma once
 
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
 #include "vks/context.hpp"
+#include "vks/profiler.hpp"
 #include "vks/texture.hpp"
-#include "vks/model.hpp"
 
 namespace vkx { namespace pbr {
+// The maps are generated with compute shaders and, when Context::textureCachePath is set, saved there as KTX files that
+// later runs load instead.  The cubes are keyed by the contents of `environmentFile`, the file `environment` was
+// loaded from, and aren't cached without it.
+
 // Generate a BRDF integration map used as a look-up-table (stores roughness / NdotV)
 void generateBRDFLUT(const vks::Context& context, vks::texture::Texture2D& target);
 // Generate an irradiance cube map from the environment cube map
 void generateIrradianceCube(const vks::Context& context,
-                            vks::texture::Texture& target,
-                            const vks::model::Model& skybox,
-                            const vks::model::VertexLayout& vertexLayout,
-                            const vk::DescriptorImageInfo& skyboxDescriptor);
-// Prefilter environment cubemap
+                            vks::texture::TextureCubeMap& target,
+                            const vks::texture::TextureCubeMap& environment,
+                            const std::string& environmentFile = {});
+
+// Size of the buffer generateIrradianceSH fills, nine RGB coefficients padded to vec4s as a std140 array
+const vk::DeviceSize IRRADIANCE_SH_SIZE = 9 * 4 * sizeof(float);
+// Project the irradiance of the environment cube map onto the order 2 spherical harmonics, as an alternative to the
+// irradiance cube for diffuse lighting.  `target` is created as a device local uniform buffer, see sh.glsl for
+// evaluating it.  One small dispatch, so it isn't cached.
+void generateIrradianceSH(const vks::Context& context, vks::Buffer& target, const vks::texture::TextureCubeMap& environment);
+
+// Samples per texel of generatePrefilteredCube.  Every level is filtered for the roughness it stands for with samples
+// read from the level of the environment's mip chain that matches their footprint (filtered importance sampling), so
+// a few converge.  Level 0 is a mirror and takes one, the others take maxSamples scaled by their roughness, and at
+// least minSamples.
+struct PrefilterSettings {
+    // Must match MAX_SAMPLES in prefilterenvmap.comp
+    static const uint32_t MAX_SAMPLES = 256;
+
+    uint32_t minSamples{ 8 };
+    uint32_t maxSamples{ 64 };
+    // Print the sample count and GPU time of every level
+    bool report{ true };
+    // With report, first filter every level with the fixed 32 samples per texel pre-filtering used to take, in scopes
+    // of its own, for a before/after GPU time on the device at hand.  Skips the texture cache, so it always generates.
+    bool compareFixed{ false };
+};
+
+// Prefilter environment cubemap, whose mip chain the samples are read from
 // See https://placeholderart.wordpress.com/2015/07/28/implementation-notes-runtime-environment-map-filtering-for-image-based-lighting/
 void generatePrefilteredCube(const vks::Context& context,
-                             vks::texture::Texture& target,
-                             const vks::model::Model& skybox,
-                             const vks::model::VertexLayout& vertexLayout,
-                             const vk::DescriptorImageInfo& skyboxDescriptor);
+                             vks::texture::TextureCubeMap& target,
+                             const vks::texture::TextureCubeMap& environment,
+                             const std::string& environmentFile = {},
+                             const PrefilterSettings& settings = PrefilterSettings{});
+
+// Sizes, formats and budget of a ReflectionProbe
+struct ReflectionProbeSettings {
+    // Width of the captured faces and of the pre-filtered cube
+    uint32_t captureDim{ 128 };
+    uint32_t dim{ 128 };
+    // Of the captured faces, the pre-filtered cube is always RGBA16F like the ones generatePrefilteredCube makes
+    vk::Format format{ vk::Format::eR16G16B16A16Sfloat };
+    float zNear{ 0.1f };
+    float zFar{ 256.0f };
+    // GPU milliseconds of probe work per frame
+    float budget{ 0.5f };
+    // Start over once the probe was published, rather than waiting for invalidate
+    bool continuous{ true };
+    PrefilterSettings prefilter{ 8, 32, false };
+};
+
+// A pre-filtered environment cube captured from a point in the scene at runtime, for scenes that change.  Rendering
+// the six faces, building their mip chain and pre-filtering every level is split into steps, and each frame's update
+// records as many of them as fit in a GPU time budget, measured with timestamps, but always at least one.  Levels are
+// pre-filtered into a second cube that is only copied to the one the scene samples once complete, so the scene never
+// sees a half updated probe.
+//
+// The application owns the rendering of the faces, it records the scene for a face with the view and projection of
+// that face and pipelines made for the probe's render pass.
+class ReflectionProbe {
+public:
+    // Record the draws of face `face`, inside the probe's render pass, with its viewport and scissor set
+    using RenderFace = std::function<void(const vk::CommandBuffer& commandBuffer, uint32_t face)>;
+
+    // `slotCount` command buffers are updated in rotation, typically one per frame in flight
+    void create(const vks::Context& context,
+                const glm::vec3& position,
+                uint32_t slotCount,
+                const ReflectionProbeSettings& settings = ReflectionProbeSettings{});
+    void destroy();
+
+    // Record the steps of the update that fit in the budget into `commandBuffer`, outside of a render pass.  The last
+    // command buffer recorded for `slot` must have completed.  Returns whether the cube was published by them.
+    bool update(const vk::CommandBuffer& commandBuffer, uint32_t slot, const RenderFace& renderFace);
+    // Capture again from the first face, on the next update
+    void invalidate();
+
+    // View and projection of a face, with the faces in the order and orientation of cube map layers
+    glm::mat4 faceView(uint32_t face) const;
+    glm::mat4 projection() const;
+
+    void setPosition(const glm::vec3& position);
+    const glm::vec3& getPosition() const { return position; }
+
+    // The pre-filtered cube the scene samples, black until the first update completes
+    const vks::texture::TextureCubeMap& cube() const { return front; }
+    // Color attachment of settings.format and depth attachment of depthFormat
+    const vk::RenderPass& getRenderPass() const { return renderPass; }
+    uint32_t stepCount() const { return (uint32_t)costs.size(); }
+    // The step the next update starts with, and the smoothed GPU time of every step, negative until measured
+    uint32_t nextStep() const { return step; }
+    const std::vector<double>& stepCosts() const { return costs; }
+    ReflectionProbeSettings settings;
+
+private:
+    void recordStep(const vk::CommandBuffer& commandBuffer, uint32_t step, const RenderFace& renderFace);
+
+    const vks::Context* context{ nullptr };
+    glm::vec3 position;
+    vk::Format depthFormat;
+    vk::RenderPass renderPass;
+    // Faces rendered into level 0 of capture, which gets a mip chain for the pre-filter to read from
+    vks::texture::TextureCubeMap capture;
+    vks::Image depth;
+    std::vector<vk::ImageView> faceViews;
+    std::vector<vk::Framebuffer> framebuffers;
+    vks::texture::TextureCubeMap back;
+    vks::texture::TextureCubeMap front;
+    std::vector<uint32_t> sampleCounts;
+    // Compute pipeline and descriptor sets of the pre-filter, see pbr.cpp
+    struct Prefilter;
+    Prefilter* prefilter{ nullptr };
+    vks::debug::GpuProfiler profiler;
+    // The steps recorded for each slot, in the order of the profiler's scopes
+    std::vector<std::vector<uint32_t>> slotSteps;
+    std::vector<double> costs;
+    uint32_t step{ 0 };
+    bool idle{ false };
+};
 }}  // namespace vkx::pbr
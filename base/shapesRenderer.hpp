@@ -12,11 +12,23 @@
 
 #include "vks/offscreen.hpp"
 #include "vks/pipelines.hpp"
+#include "vks/frustum.hpp"
+#include "vks/shaders.hpp"
+#include "vks/debug.hpp"
+#include "compute.hpp"
 #include "shapes.h"
 #include "easings.hpp"
 #include "utils.hpp"
 
 namespace vkx {
+// Thousands of instances of a few shapes, drawn with one indirect draw per shape.  With `gpuDriven`, a compute shader
+// recorded in front of the render pass animates every instance once, culls it against the frustum of each eye and
+// appends the survivors to the eye's draws, so the vertex shader reads finished transforms and the instance counts of
+// the draws are the visible ones.  Otherwise every instance is drawn and the vertex shader animates every vertex.
+//
+// Stereo renders both eyes side by side into one target, one viewport and set of draws per eye, unless `multiview`
+// is set.  Then the target holds an eye per layer, framebufferSize is the size of one eye, and a single pass with
+// VK_KHR_multiview draws each instance to both, with the vertex shader picking the eye's matrices by gl_ViewIndex.
 class ShapesRenderer : public OffscreenRenderer {
     using Parent = vkx::OffscreenRenderer;
 
@@ -26,6 +38,16 @@ public:
     static const uint32_t INSTANCE_COUNT{ (INSTANCES_PER_SHAPE * SHAPES_COUNT) };
 
     const bool stereo;
+    const uint32_t eyeCount{ stereo ? 2u : 1u };
+    bool gpuDriven{ true };
+    // Set before prepare(), only for stereo and with Context::multiviewEnabled
+    bool multiview{ false };
+    // Set before prepare().  The uniforms are then device local, and every render() starts by copying them from the
+    // slot of a host visible ring the latest update() or latch() wrote.  The views can be latched right before the
+    // submission without racing the frame before, which still reads the last ones, as long as the frame submitted
+    // LATCH_SLOTS renders earlier is complete.
+    bool lateLatch{ false };
+    static const uint32_t LATCH_SLOTS{ 3 };
     vks::Buffer meshes;
 
     // Per-instance data block
@@ -48,19 +70,73 @@ public:
 
     // Contains the instanced data
     vks::Buffer instanceBuffer;
-    // Contains the instanced data
+    // Contains the indirect draw commands, one per shape, or with gpuDriven one per shape and eye
     vks::Buffer indirectBuffer;
 
+    // Must match the local size of shapes.comp
+    static const uint32_t CULL_GROUP_SIZE{ 64 };
+
+    // Output of shapes.comp, per visible instance and eye
+    struct AnimatedInstance {
+        // Quaternion, xyz: axis, w: angle
+        glm::vec4 rotation;
+        // xyz: position, w: scale
+        glm::vec4 offset;
+    };
+
+    struct UboCull {
+        glm::vec4 frustumPlanes[2][6];
+        float time{ 0.0f };
+        // Of the largest shape, before the instance scale
+        float boundingRadius{ 0.0f };
+        uint32_t instancesPerShape{ INSTANCES_PER_SHAPE };
+        uint32_t eyeCount{ 1 };
+        // Instances visible to any eye are appended to the draws of the first, which every view of a multiview
+        // pass draws
+        uint32_t mergeEyes{ 0 };
+    } uboCull;
+
+    struct {
+        // The draws with no instances, copied over indirectBuffer before every cull
+        vks::Buffer drawTemplate;
+        // Animated instances of eye e and shape s start at e * INSTANCE_COUNT + s * INSTANCES_PER_SHAPE, with
+        // multiview there is a single set shared by both eyes
+        vks::Buffer visible;
+        vks::Buffer uniform;
+        vk::DescriptorSetLayout descriptorSetLayout;
+        vk::DescriptorSet descriptorSet;
+        vk::PipelineLayout pipelineLayout;
+        vk::Pipeline pipeline;
+        vk::Pipeline drawPipeline;
+    } cull;
+
     struct UboVS {
         glm::mat4 projection;
         glm::mat4 view;
         float time = 0.0f;
     } uboVS;
 
+    // Vertex shader uniforms of a multiview pass, indexed by gl_ViewIndex
+    struct UboMultiview {
+        glm::mat4 projection[2];
+        glm::mat4 view[2];
+        float time = 0.0f;
+    } uboMultiview;
+
     struct {
         vks::Buffer vsScene;
     } uniformData;
 
+    struct {
+        // LATCH_SLOTS copies of the vertex shader uniforms followed by the cull uniforms
+        vks::Buffer staging;
+        vk::DeviceSize slotSize{ 0 };
+        vk::DeviceSize cullOffset{ 0 };
+        std::vector<vk::CommandBuffer> commandBuffers;
+        // The slot the next render() copies from
+        uint32_t slot{ 0 };
+    } latched;
+
     struct {
         vk::Pipeline solid;
     } pipelines;
@@ -70,7 +146,12 @@ public:
     vk::DescriptorSet descriptorSet;
     vk::DescriptorSetLayout descriptorSetLayout;
     vk::CommandBuffer cmdBuffer;
-    const vk::DescriptorType uniformType{ stereo ? vk::DescriptorType::eUniformBufferDynamic : vk::DescriptorType::eUniformBuffer };
+    // Stereo without multiview binds the uniforms of each eye at a dynamic offset
+    vk::DescriptorType uniformType() const {
+        return stereo && !multiview ? vk::DescriptorType::eUniformBufferDynamic : vk::DescriptorType::eUniformBuffer;
+    }
+    // Sets of draws, and of culled instances
+    uint32_t drawSetCount() const { return multiview ? 1u : eyeCount; }
     const float duration = 4.0f;
     const float interval = 6.0f;
 
@@ -99,6 +180,51 @@ public:
         context.device.destroyPipelineLayout(pipelineLayout);
         context.device.destroyDescriptorSetLayout(descriptorSetLayout);
         uniformData.vsScene.destroy();
+        if (lateLatch) {
+            context.device.freeCommandBuffers(cmdPool, latched.commandBuffers);
+            latched.staging.destroy();
+        }
+        if (gpuDriven) {
+            context.device.destroyPipeline(cull.drawPipeline);
+            context.device.destroyPipeline(cull.pipeline);
+            context.device.destroyPipelineLayout(cull.pipelineLayout);
+            context.device.destroyDescriptorSetLayout(cull.descriptorSetLayout);
+            cull.drawTemplate.destroy();
+            cull.visible.destroy();
+            cull.uniform.destroy();
+        }
+    }
+
+    // Reset the instance counts of the draws and fill them with the visible instances.  The draws and vertex
+    // input of the previous frame have to be done with the buffers first.
+    void recordCull(const vk::CommandBuffer& commandBuffer) {
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput,
+                                      vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, nullptr, nullptr);
+        commandBuffer.copyBuffer(cull.drawTemplate.buffer, indirectBuffer.buffer, vk::BufferCopy{ 0, 0, indirectBuffer.size });
+
+        vk::BufferMemoryBarrier reset;
+        reset.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        reset.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+        reset.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        reset.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        reset.buffer = indirectBuffer.buffer;
+        reset.size = VK_WHOLE_SIZE;
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, reset, nullptr);
+
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, cull.pipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, cull.pipelineLayout, 0, cull.descriptorSet, nullptr);
+        const auto groups = vkx::workGroupCounts(context, INSTANCE_COUNT, CULL_GROUP_SIZE);
+        commandBuffer.dispatch(groups[0], groups[1], 1);
+
+        std::array<vk::BufferMemoryBarrier, 2> written;
+        written[0] = reset;
+        written[0].srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+        written[0].dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead;
+        written[1] = written[0];
+        written[1].dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead;
+        written[1].buffer = cull.visible.buffer;
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput,
+                                      {}, nullptr, written, nullptr);
     }
 
     void buildCommandBuffer() {
@@ -120,10 +246,19 @@ public:
         clearValues[0].color = vks::util::clearColor({ 0.2f, 0.2f, 0.2f, 1 });
         clearValues[1].depthStencil = { 1.0f, 0 };
 
-        context.setImageLayout(cmdBuffer, framebuffer.colors[0].image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined,
-                               vk::ImageLayout::eColorAttachmentOptimal);
-        context.setImageLayout(cmdBuffer, framebuffer.depth.image, vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil,
-                               vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+        if (gpuDriven) {
+            vks::debug::marker::beginRegion(cmdBuffer, "Cull", glm::vec4(0.8f, 0.4f, 0.1f, 1.0f));
+            recordCull(cmdBuffer);
+            vks::debug::marker::endRegion(cmdBuffer);
+        }
+
+        // The previous frame's copies out of the color target on this queue, like a VR compositor reading it straight
+        // from its final layout, have to be done before it's cleared
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eColorAttachmentOutput, {}, nullptr, nullptr, nullptr);
+        context.setImageLayout(cmdBuffer, framebuffer.colors[0].image, vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal,
+                               { vk::ImageAspectFlagBits::eColor, 0, 1, 0, viewCount });
+        context.setImageLayout(cmdBuffer, framebuffer.depth.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal,
+                               { vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil, 0, 1, 0, viewCount });
 
         vk::RenderPassBeginInfo renderPassBeginInfo;
         renderPassBeginInfo.renderPass = renderPass;
@@ -133,8 +268,29 @@ public:
         renderPassBeginInfo.pClearValues = clearValues;
         renderPassBeginInfo.framebuffer = framebuffer.framebuffer;
         cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+        bindFoveation(cmdBuffer);
         cmdBuffer.setScissor(0, vks::util::rect2D(framebufferSize));
-        if (stereo) {
+        if (gpuDriven) {
+            auto viewport = vks::util::viewport(framebufferSize);
+            viewport.width /= (float)drawSetCount();
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, cull.drawPipeline);
+            // Binding point 0 : Mesh vertex buffer
+            cmdBuffer.bindVertexBuffers(0, meshes.buffer, { 0 });
+            // Binding point 1 : Animated instances of every eye, the draws of each eye start at its own
+            cmdBuffer.bindVertexBuffers(1, cull.visible.buffer, { 0 });
+            for (uint32_t eye = 0; eye < drawSetCount(); ++eye) {
+                cmdBuffer.setViewport(0, viewport);
+                if (uniformType() == vk::DescriptorType::eUniformBufferDynamic) {
+                    cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet,
+                                                 { eye * (uint32_t)uniformData.vsScene.alignment });
+                } else {
+                    cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
+                }
+                cmdBuffer.drawIndirect(indirectBuffer.buffer, eye * SHAPES_COUNT * sizeof(vk::DrawIndirectCommand), SHAPES_COUNT,
+                                       sizeof(vk::DrawIndirectCommand));
+                viewport.x += viewport.width;
+            }
+        } else if (stereo && !multiview) {
             auto viewport = vks::util::viewport(framebufferSize);
             viewport.width /= 2.0f;
             cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.solid);
@@ -202,6 +358,7 @@ public:
         appendShape<>(geometry::icosahedron(), vertexData);
         for (auto& vertex : vertexData) {
             vertex.position *= 0.2f;
+            uboCull.boundingRadius = std::max(uboCull.boundingRadius, glm::length(vertex.position));
         }
         meshes = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertexData);
     }
@@ -209,16 +366,38 @@ public:
     void setupDescriptorPool() {
         // Example uses one ubo
         std::vector<vk::DescriptorPoolSize> poolSizes{
-            { uniformType, 1 },
+            { uniformType(), 1 },
         };
-        descriptorPool = context.device.createDescriptorPool({ {}, 1, (uint32_t)poolSizes.size(), poolSizes.data() });
+        uint32_t maxSets = 1;
+        if (gpuDriven) {
+            // Culling uses another ubo and the instance, draw and output storage
+            poolSizes.push_back({ vk::DescriptorType::eUniformBuffer, 1 });
+            poolSizes.push_back({ vk::DescriptorType::eStorageBuffer, 3 });
+            ++maxSets;
+        }
+        descriptorPool = context.device.createDescriptorPool({ {}, maxSets, (uint32_t)poolSizes.size(), poolSizes.data() });
     }
 
     void setupDescriptorSetLayout() {
         // Binding 0 : Vertex shader uniform buffer
-        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{ { 0, uniformType, 1, vk::ShaderStageFlagBits::eVertex } };
+        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{ { 0, uniformType(), 1, vk::ShaderStageFlagBits::eVertex } };
         descriptorSetLayout = context.device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
         pipelineLayout = context.device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+
+        if (gpuDriven) {
+            std::vector<vk::DescriptorSetLayoutBinding> cullBindings{
+                // Binding 0 : Instances at rest
+                { 0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+                // Binding 1 : Frustums and animation time
+                { 1, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+                // Binding 2 : Indirect draws
+                { 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+                // Binding 3 : Animated instances
+                { 3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            };
+            cull.descriptorSetLayout = context.device.createDescriptorSetLayout({ {}, (uint32_t)cullBindings.size(), cullBindings.data() });
+            cull.pipelineLayout = context.device.createPipelineLayout({ {}, 1, &cull.descriptorSetLayout });
+        }
     }
 
     void setupDescriptorSet() {
@@ -227,17 +406,34 @@ public:
         // Binding 0 : Vertex shader uniform buffer
         vk::WriteDescriptorSet writeDescriptorSet;
         writeDescriptorSet.dstSet = descriptorSet;
-        writeDescriptorSet.descriptorType = uniformType;
+        writeDescriptorSet.descriptorType = uniformType();
         writeDescriptorSet.dstBinding = 0;
         writeDescriptorSet.pBufferInfo = &uniformData.vsScene.descriptor;
         writeDescriptorSet.descriptorCount = 1;
 
         context.device.updateDescriptorSets(writeDescriptorSet, nullptr);
+
+        if (gpuDriven) {
+            cull.descriptorSet = context.device.allocateDescriptorSets({ descriptorPool, 1, &cull.descriptorSetLayout })[0];
+            vk::DescriptorBufferInfo instanceInfo{ instanceBuffer.buffer, 0, VK_WHOLE_SIZE };
+            vk::DescriptorBufferInfo uniformInfo{ cull.uniform.buffer, 0, sizeof(UboCull) };
+            vk::DescriptorBufferInfo drawInfo{ indirectBuffer.buffer, 0, VK_WHOLE_SIZE };
+            vk::DescriptorBufferInfo visibleInfo{ cull.visible.buffer, 0, VK_WHOLE_SIZE };
+            std::vector<vk::WriteDescriptorSet> writes{
+                { cull.descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &instanceInfo },
+                { cull.descriptorSet, 1, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformInfo },
+                { cull.descriptorSet, 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &drawInfo },
+                { cull.descriptorSet, 3, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &visibleInfo },
+            };
+            context.device.updateDescriptorSets(writes, nullptr);
+        }
     }
 
     void preparePipelines() {
         vks::pipelines::GraphicsPipelineBuilder builder{ device, pipelineLayout, renderPass };
-        builder.loadShader(getAssetPath() + "shaders/indirect/indirect.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        applyFoveation(builder);
+        const std::string views = multiview ? "_multiview" : "";
+        builder.loadShader(getAssetPath() + "shaders/indirect/indirect" + views + ".vert.spv", vk::ShaderStageFlagBits::eVertex);
         builder.loadShader(getAssetPath() + "shaders/indirect/indirect.frag.spv", vk::ShaderStageFlagBits::eFragment);
         // Mesh vertex buffer (description) at binding point 0
         builder.vertexInputState.bindingDescriptions = { { 0, sizeof(Vertex), vk::VertexInputRate::eVertex },
@@ -257,6 +453,24 @@ public:
         attributes.push_back({ 5, 1, vk::Format::eR32Sfloat, offsetof(InstanceData, scale) });
 
         pipelines.solid = builder.create(context.pipelineCache);
+
+        if (gpuDriven) {
+            // Same as the solid pipeline, with the instances animated by the cull shader
+            builder.destroyShaderModules();
+            builder.loadShader(getAssetPath() + "shaders/indirect/shapes" + views + ".vert.spv", vk::ShaderStageFlagBits::eVertex);
+            builder.loadShader(getAssetPath() + "shaders/indirect/indirect.frag.spv", vk::ShaderStageFlagBits::eFragment);
+            builder.vertexInputState.bindingDescriptions[1].stride = sizeof(AnimatedInstance);
+            attributes.resize(3);
+            attributes.push_back({ 3, 1, vk::Format::eR32G32B32A32Sfloat, offsetof(AnimatedInstance, rotation) });
+            attributes.push_back({ 4, 1, vk::Format::eR32G32B32A32Sfloat, offsetof(AnimatedInstance, offset) });
+            cull.drawPipeline = builder.create(context.pipelineCache);
+
+            vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+            computePipelineCreateInfo.layout = cull.pipelineLayout;
+            computePipelineCreateInfo.stage = vks::shaders::loadShader(device, getAssetPath() + "shaders/indirect/shapes.comp.spv", vk::ShaderStageFlagBits::eCompute);
+            cull.pipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+            device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+        }
     }
 
     void prepareIndirectData() {
@@ -270,7 +484,24 @@ public:
             drawIndirectCommand.firstVertex = (uint32_t)shapeData.baseVertex;
             drawIndirectCommand.vertexCount = (uint32_t)shapeData.vertices;
         }
-        indirectBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer, indirectData);
+        if (!gpuDriven) {
+            indirectBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer, indirectData);
+            return;
+        }
+
+        // Every eye gets its own copy of the draws and of the instance range, unless a multiview pass shares them
+        std::vector<vk::DrawIndirectCommand> templateData;
+        for (uint32_t eye = 0; eye < drawSetCount(); ++eye) {
+            for (auto command : indirectData) {
+                command.firstInstance += eye * INSTANCE_COUNT;
+                command.instanceCount = 0;
+                templateData.push_back(command);
+            }
+        }
+        cull.drawTemplate = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eTransferSrc, templateData);
+        indirectBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer, templateData);
+        cull.visible = context.createDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+                                                  sizeof(AnimatedInstance) * INSTANCE_COUNT * drawSetCount());
     }
 
     void prepareInstanceData() {
@@ -291,18 +522,91 @@ public:
             instance.pos *= instance.scale * (1.0f + expDist(rndGenerator) / 2.0f) * 4.0f;
         }
 
-        instanceBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, instanceData);
+        instanceBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer, instanceData);
+    }
+
+    // `count` copies of `size` bytes, at multiples of the uniform buffer offset alignment.  Host visible and mapped,
+    // or device local and written by the latch copies
+    vks::Buffer createUniforms(vk::DeviceSize size, uint32_t count = 1) const {
+        const auto alignment = context.deviceProperties.limits.minUniformBufferOffsetAlignment;
+        const vk::DeviceSize alignedSize = (size + alignment - 1) / alignment * alignment;
+        vks::Buffer result;
+        if (lateLatch) {
+            result = context.createDeviceBuffer(vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst, alignedSize * count);
+        } else {
+            result = context.createBuffer(vk::BufferUsageFlagBits::eUniformBuffer,
+                                          vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, alignedSize * count);
+            result.map();
+        }
+        result.alignment = alignedSize;
+        result.descriptor.range = alignedSize;
+        return result;
+    }
+
+    void prepareUniformBuffers() {
+        // Stereo without multiview has the uniforms of each eye at its own dynamic offset
+        if (multiview) {
+            uniformData.vsScene = createUniforms(sizeof(UboMultiview));
+        } else {
+            uniformData.vsScene = createUniforms(sizeof(UboVS), eyeCount);
+        }
+        if (gpuDriven) {
+            uboCull.eyeCount = eyeCount;
+            uboCull.mergeEyes = multiview ? 1 : 0;
+            cull.uniform = createUniforms(sizeof(UboCull));
+        }
     }
 
-    void prepareUniformBuffers() { uniformData.vsScene = context.createUniformBuffer(uboVS); }
+    void prepareLatch() {
+        latched.cullOffset = uniformData.vsScene.size;
+        latched.slotSize = latched.cullOffset + (gpuDriven ? cull.uniform.size : 0);
+        latched.staging = context.createBuffer(vk::BufferUsageFlagBits::eTransferSrc,
+                                               vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                               latched.slotSize * LATCH_SLOTS);
+        latched.staging.map();
+        latched.commandBuffers = device.allocateCommandBuffers({ cmdPool, vk::CommandBufferLevel::ePrimary, LATCH_SLOTS });
+
+        const vk::PipelineStageFlags readers = vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eComputeShader;
+        for (uint32_t slot = 0; slot < LATCH_SLOTS; ++slot) {
+            const auto& commandBuffer = latched.commandBuffers[slot];
+            commandBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
+            // The previous frame's shaders have to be done reading the uniforms
+            commandBuffer.pipelineBarrier(readers, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, nullptr);
+            const vk::DeviceSize base = slot * latched.slotSize;
+            commandBuffer.copyBuffer(latched.staging.buffer, uniformData.vsScene.buffer, vk::BufferCopy{ base, 0, uniformData.vsScene.size });
+
+            vk::BufferMemoryBarrier barrier;
+            barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+            barrier.dstAccessMask = vk::AccessFlagBits::eUniformRead;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.buffer = uniformData.vsScene.buffer;
+            barrier.size = VK_WHOLE_SIZE;
+            std::vector<vk::BufferMemoryBarrier> barriers{ barrier };
+            if (gpuDriven) {
+                commandBuffer.copyBuffer(latched.staging.buffer, cull.uniform.buffer, vk::BufferCopy{ base + latched.cullOffset, 0, cull.uniform.size });
+                barrier.buffer = cull.uniform.buffer;
+                barriers.push_back(barrier);
+            }
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, readers, {}, nullptr, barriers, nullptr);
+            commandBuffer.end();
+        }
+    }
 
     void prepare() {
+        assert(!multiview || (stereo && context.multiviewEnabled));
+        viewCount = multiview ? eyeCount : 1;
+        // The eyes of a side by side target each get their own foveation center
+        foveation.columns = multiview ? 1 : eyeCount;
         depthFormat = context.getSupportedDepthFormat();
         OffscreenRenderer::prepare();
         loadShapes();
         prepareInstanceData();
         prepareIndirectData();
         prepareUniformBuffers();
+        if (lateLatch) {
+            prepareLatch();
+        }
         setupDescriptorSetLayout();
         preparePipelines();
         setupDescriptorPool();
@@ -314,13 +618,8 @@ public:
 
     void update(float deltaTime, const std::array<glm::mat4, 2>& projections, const std::array<glm::mat4, 2>& views) {
         uboVS.time += deltaTime * 0.05f;
-        uboVS.projection = projections[0];
-        uboVS.view = views[0];
-        uniformData.vsScene.copy(uboVS);
-
-        uboVS.projection = projections[1];
-        uboVS.view = views[1];
-        uniformData.vsScene.copy(uboVS, uniformData.vsScene.alignment);
+        uboMultiview.time = uboCull.time = uboVS.time;
+        latch(projections, views);
 #if 0
             frameTimer = deltaTime;
             if (!paused) {
@@ -345,10 +644,46 @@ public:
 #endif
     }
 
+    // Write the views the next render() draws, without advancing the animation.  With lateLatch this can wait until
+    // right before the submission, see lateLatch for when the slot written is free.
+    void latch(const std::array<glm::mat4, 2>& projections, const std::array<glm::mat4, 2>& views) {
+        const vks::Buffer& vsTarget = lateLatch ? latched.staging : uniformData.vsScene;
+        const vks::Buffer& cullTarget = lateLatch ? latched.staging : cull.uniform;
+        const vk::DeviceSize base = lateLatch ? latched.slot * latched.slotSize : 0;
+        if (multiview) {
+            for (uint32_t eye = 0; eye < eyeCount; ++eye) {
+                uboMultiview.projection[eye] = projections[eye];
+                uboMultiview.view[eye] = views[eye];
+            }
+            vsTarget.copy(uboMultiview, base);
+        } else {
+            for (uint32_t eye = 0; eye < eyeCount; ++eye) {
+                uboVS.projection = projections[eye];
+                uboVS.view = views[eye];
+                vsTarget.copy(uboVS, base + eye * uniformData.vsScene.alignment);
+            }
+        }
+
+        if (gpuDriven) {
+            vks::Frustum frustum;
+            for (uint32_t eye = 0; eye < eyeCount; ++eye) {
+                frustum.update(projections[eye] * views[eye]);
+                std::copy(frustum.planes.begin(), frustum.planes.end(), uboCull.frustumPlanes[eye]);
+            }
+            cullTarget.copy(uboCull, lateLatch ? base + latched.cullOffset : 0);
+        }
+    }
+
     void render(const vk::ArrayProxy<const vks::Context::SemaphoreStagePair>& wait,
                 const vk::ArrayProxy<const vk::Semaphore>& signals,
                 const vk::Fence& fence = vk::Fence()) {
-        context.submit(cmdBuffer, wait, signals, fence);
+        if (!lateLatch) {
+            context.submit(cmdBuffer, wait, signals, fence);
+            return;
+        }
+        const std::array<vk::CommandBuffer, 2> commandBuffers{ latched.commandBuffers[latched.slot], cmdBuffer };
+        context.submit(commandBuffers, wait, signals, fence);
+        latched.slot = (latched.slot + 1) % LATCH_SLOTS;
     }
 
     void render() { render({ { semaphores.renderStart, vk::PipelineStageFlagBits::eBottomOfPipe } }, { semaphores.renderComplete }); }
@@ -8,10 +8,13 @@
 
 #include "ui.hpp"
 
+#include <cmath>
+
 #include <imgui.h>
 
 #include "vks/helpers.hpp"
 #include "vks/pipelines.hpp"
+#include "vks/trace.hpp"
 
 #include "utils.hpp"
 #include "android.hpp"
@@ -19,6 +22,9 @@
 using namespace vkx;
 using namespace vkx::ui;
 
+const uint32_t UIOverlay::MIN_CAPACITY;
+const uint32_t UIOverlay::SPARSE_CAPACITY;
+
 void UIOverlay::create(const UIOverlayCreateInfo& createInfo) {
     this->createInfo = createInfo;
 #if defined(__ANDROID__)
@@ -48,13 +54,19 @@ void UIOverlay::create(const UIOverlayCreateInfo& createInfo) {
     style.Colors[ImGuiCol_CheckMark] = ImVec4(1.0f, 0.0f, 0.0f, 0.8f);
     // Dimensions
     ImGuiIO& io = ImGui::GetIO();
-    io.DisplaySize = ImVec2((float)createInfo.size.width, (float)createInfo.size.height);
+    io.DisplaySize = ImVec2((float)displaySize().width, (float)displaySize().height);
     io.FontGlobalScale = scale;
 
+    // One more geometry region than there are frames in flight, so update never writes a region the GPU may be reading
+    regionCount = std::max<uint32_t>(1, createInfo.framesInFlight) + 1;
+    regionSignatures.assign(regionCount, 0);
+    currentRegion = 0;
+    regionSubmitted = false;
+
     prepareResources();
     if (createInfo.renderPass) {
         renderPass = createInfo.renderPass;
-    } else {
+    } else if (!dynamicRendering()) {
         prepareRenderPass();
     }
     preparePipeline();
@@ -68,6 +80,8 @@ void UIOverlay::destroy() {
     if (commandPool) {
         vertexBuffer.destroy();
         indexBuffer.destroy();
+        sparseVertices.destroy();
+        sparseIndices.destroy();
         font.destroy();
         context.device.destroyDescriptorSetLayout(descriptorSetLayout);
         context.device.destroyDescriptorPool(descriptorPool);
@@ -78,7 +92,6 @@ void UIOverlay::destroy() {
         }
         context.device.freeCommandBuffers(commandPool, cmdBuffers);
         context.device.destroyCommandPool(commandPool);
-        context.device.destroyFence(fence);
     }
 }
 
@@ -129,7 +142,18 @@ void UIOverlay::prepareResources() {
     samplerInfo.addressModeV = vk::SamplerAddressMode::eClampToEdge;
     samplerInfo.addressModeW = vk::SamplerAddressMode::eClampToEdge;
     samplerInfo.borderColor = vk::BorderColor::eFloatOpaqueWhite;
-    font.sampler = context.device.createSampler(samplerInfo);
+    font.sampler = vks::acquireSampler(context.device, samplerInfo);
+
+    // Geometry, sparse where possible so that it grows without being reallocated
+    const auto hostMemory = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    sparseGeometry = vks::SparseBuffer::supported(context, vk::BufferUsageFlagBits::eVertexBuffer, hostMemory) &&
+                     vks::SparseBuffer::supported(context, vk::BufferUsageFlagBits::eIndexBuffer, hostMemory);
+    if (sparseGeometry) {
+        vertexCapacity = indexCapacity = SPARSE_CAPACITY;
+        vertexCommitted = indexCommitted = 0;
+        sparseVertices.create(context, vk::BufferUsageFlagBits::eVertexBuffer, sizeof(ImDrawVert) * SPARSE_CAPACITY * regionCount, hostMemory);
+        sparseIndices.create(context, vk::BufferUsageFlagBits::eIndexBuffer, sizeof(ImDrawIdx) * SPARSE_CAPACITY * regionCount, hostMemory);
+    }
 
     // Command buffer
 
@@ -172,15 +196,13 @@ void UIOverlay::prepareResources() {
     vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eVertex, 0, sizeof(PushConstBlock) };
     vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo{ {}, 1, &descriptorSetLayout, 1, &pushConstantRange };
     pipelineLayout = context.device.createPipelineLayout(pipelineLayoutCreateInfo);
-
-    // Command buffer execution fence
-    fence = context.device.createFence(vk::FenceCreateInfo{});
 }
 
 /** Prepare a separate pipeline for the UI overlay rendering decoupled from the main application */
 void UIOverlay::preparePipeline() {
     // Setup graphics pipeline for UI rendering
     vks::pipelines::GraphicsPipelineBuilder pipelineBuilder(context.device, pipelineLayout, renderPass);
+    pipelineBuilder.renderingState = { std::vector<vk::Format>(createInfo.attachmentCount, createInfo.colorformat), vk::Format::eUndefined };
     pipelineBuilder.depthStencilState = { false };
     pipelineBuilder.rasterizationState.cullMode = vk::CullModeFlagBits::eNone;
 
@@ -239,10 +261,11 @@ void UIOverlay::prepareRenderPass() {
     vk::SubpassDependency subpassDependencies[2];
 
     // Transition from final to initial (VK_SUBPASS_EXTERNAL refers to all commmands executed outside of the actual renderpass)
+    // The overlay is normally submitted in the same batch as the scene, so this has to order it after the scene's color writes
     subpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-    subpassDependencies[0].srcStageMask = vk::PipelineStageFlagBits::eBottomOfPipe;
+    subpassDependencies[0].srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
     subpassDependencies[0].dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-    subpassDependencies[0].srcAccessMask = vk::AccessFlagBits::eMemoryRead;
+    subpassDependencies[0].srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
     subpassDependencies[0].dstAccessMask = vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite;
     subpassDependencies[0].dependencyFlags = vk::DependencyFlagBits::eByRegion;
 
@@ -272,8 +295,79 @@ void UIOverlay::prepareRenderPass() {
     renderPass = context.device.createRenderPass(renderPassInfo);
 }
 
-/** Update the command buffers to reflect UI changes */
-void UIOverlay::updateCommandBuffers() {
+namespace {
+
+// FNV-1a over everything that is baked into a recorded overlay command buffer
+struct Signature {
+    uint64_t value{ 14695981039346656037ull };
+    template <typename T>
+    void add(const T& t) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&t);
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            value ^= bytes[i];
+            value *= 1099511628211ull;
+        }
+    }
+};
+
+uint64_t drawDataSignature(const ImDrawData* imDrawData, vk::Buffer vertexBuffer, vk::Buffer indexBuffer) {
+    Signature signature;
+    signature.add(static_cast<VkBuffer>(vertexBuffer));
+    signature.add(static_cast<VkBuffer>(indexBuffer));
+    signature.add(ImGui::GetIO().DisplaySize);
+    signature.add(imDrawData->CmdListsCount);
+    for (int32_t i = 0; i < imDrawData->CmdListsCount; i++) {
+        const ImDrawList* cmdList = imDrawData->CmdLists[i];
+        signature.add(cmdList->VtxBuffer.Size);
+        for (int32_t j = 0; j < cmdList->CmdBuffer.Size; j++) {
+            signature.add(cmdList->CmdBuffer[j].ElemCount);
+            signature.add(cmdList->CmdBuffer[j].ClipRect);
+        }
+    }
+    // 0 is reserved for "not recorded"
+    return signature.value ? signature.value : 1;
+}
+
+// A clip rectangle in display pixels, in a framebuffer of `size` rotated by `preRotation` degrees on the display
+vk::Rect2D framebufferRect(const ImVec4& clipRect, const vk::Extent2D& size, uint32_t preRotation) {
+    const float width = (float)size.width;
+    const float height = (float)size.height;
+    float x0 = clipRect.x, y0 = clipRect.y, x1 = clipRect.z, y1 = clipRect.w;
+    switch (preRotation) {
+        case 90:
+            x0 = width - clipRect.w;
+            x1 = width - clipRect.y;
+            y0 = clipRect.x;
+            y1 = clipRect.z;
+            break;
+        case 180:
+            x0 = width - clipRect.z;
+            x1 = width - clipRect.x;
+            y0 = height - clipRect.w;
+            y1 = height - clipRect.y;
+            break;
+        case 270:
+            x0 = clipRect.y;
+            x1 = clipRect.w;
+            y0 = height - clipRect.z;
+            y1 = height - clipRect.x;
+            break;
+        default:
+            break;
+    }
+    vk::Rect2D rect;
+    rect.offset.x = std::max((int32_t)x0, 0);
+    rect.offset.y = std::max((int32_t)y0, 0);
+    rect.extent.width = (uint32_t)std::max(x1 - (float)rect.offset.x, 0.0f);
+    rect.extent.height = (uint32_t)std::max(y1 - (float)rect.offset.y, 0.0f);
+    return rect;
+}
+
+}  // namespace
+
+/** Record the command buffers of one geometry region, for every framebuffer */
+void UIOverlay::updateCommandBuffers(uint32_t region) {
+    VKS_TRACE_ZONE("UIOverlay::updateCommandBuffers");
     vk::CommandBufferBeginInfo cmdBufInfo{ vk::CommandBufferUsageFlagBits::eSimultaneousUse };
 
     vk::RenderPassBeginInfo renderPassBeginInfo;
@@ -284,24 +378,28 @@ void UIOverlay::updateCommandBuffers() {
 
     ImGuiIO& io = ImGui::GetIO();
 
-    const vk::Viewport viewport{ 0.0f, 0.0f, io.DisplaySize.x, io.DisplaySize.y, 0.0f, 1.0f };
-    const vk::Rect2D scissor{ {}, vk::Extent2D{ (uint32_t)io.DisplaySize.x, (uint32_t)io.DisplaySize.y } };
-    // UI scale and translate via push constants
+    const vk::Viewport viewport{ 0.0f, 0.0f, (float)createInfo.size.width, (float)createInfo.size.height, 0.0f, 1.0f };
+    const vk::Rect2D scissor{ {}, createInfo.size };
+    // UI scale and translate via push constants, and the rotation from the display's orientation to the framebuffer's
     pushConstBlock.scale = glm::vec2(2.0f / io.DisplaySize.x, 2.0f / io.DisplaySize.y);
     pushConstBlock.translate = glm::vec2(-1.0f);
+    const float rotation = glm::radians((float)preRotation);
+    pushConstBlock.rotation = glm::vec2(std::cos(rotation), std::sin(rotation));
 
-    if (cmdBuffers.size()) {
-        context.trashAll<vk::CommandBuffer>(cmdBuffers,
-                                            [&](const std::vector<vk::CommandBuffer>& buffers) { context.device.freeCommandBuffers(commandPool, buffers); });
-        cmdBuffers.clear();
+    const uint32_t framebufferCount = (uint32_t)targetCount();
+    if (cmdBuffers.size() != framebufferCount * regionCount) {
+        if (cmdBuffers.size()) {
+            context.trashCommandBuffers(commandPool, cmdBuffers);
+        }
+        cmdBuffers = context.device.allocateCommandBuffers({ commandPool, vk::CommandBufferLevel::ePrimary, framebufferCount * regionCount });
+        std::fill(regionSignatures.begin(), regionSignatures.end(), 0);
     }
 
-    cmdBuffers = context.device.allocateCommandBuffers({ commandPool, vk::CommandBufferLevel::ePrimary, (uint32_t)createInfo.framebuffers.size() });
-
-    for (size_t i = 0; i < cmdBuffers.size(); ++i) {
-        renderPassBeginInfo.framebuffer = createInfo.framebuffers[i];
-
-        const auto& cmdBuffer = cmdBuffers[i];
+    const vk::DeviceSize regionVertexOffset = (vk::DeviceSize)region * vertexCapacity * sizeof(ImDrawVert);
+    const vk::DeviceSize regionIndexOffset = (vk::DeviceSize)region * indexCapacity * sizeof(ImDrawIdx);
+    for (uint32_t i = 0; i < framebufferCount; ++i) {
+        // The pool allows individual resets, and the region is not in use by the GPU, so begin can re-record in place
+        const auto& cmdBuffer = cmdBuffers[region * framebufferCount + i];
         cmdBuffer.begin(cmdBufInfo);
 
 #if 0
@@ -310,11 +408,38 @@ void UIOverlay::updateCommandBuffers() {
         }
 #endif
 
-        cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+        const vk::ImageSubresourceRange colorRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
+        if (dynamicRendering()) {
+            // The same dependencies as the overlay's render pass
+            const vk::ImageMemoryBarrier toAttachment{ vk::AccessFlagBits::eColorAttachmentWrite,
+                                                       vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
+                                                       vk::ImageLayout::ePresentSrcKHR,
+                                                       vk::ImageLayout::eColorAttachmentOptimal,
+                                                       VK_QUEUE_FAMILY_IGNORED,
+                                                       VK_QUEUE_FAMILY_IGNORED,
+                                                       createInfo.colorImages[i],
+                                                       colorRange };
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                                      vk::DependencyFlagBits::eByRegion, nullptr, nullptr, toAttachment);
+            vk::RenderingAttachmentInfoKHR colorAttachment;
+            colorAttachment.imageView = createInfo.colorViews[i];
+            colorAttachment.imageLayout = vk::ImageLayout::eColorAttachmentOptimal;
+            colorAttachment.loadOp = vk::AttachmentLoadOp::eLoad;
+            colorAttachment.storeOp = vk::AttachmentStoreOp::eStore;
+            vk::RenderingInfoKHR renderingInfo;
+            renderingInfo.renderArea.extent = createInfo.size;
+            renderingInfo.layerCount = 1;
+            renderingInfo.colorAttachmentCount = 1;
+            renderingInfo.pColorAttachments = &colorAttachment;
+            cmdBuffer.beginRenderingKHR(renderingInfo, context.dynamicDispatch);
+        } else {
+            renderPassBeginInfo.framebuffer = createInfo.framebuffers[i];
+            cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+        }
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, {});
-        cmdBuffer.bindVertexBuffers(0, vertexBuffer.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(indexBuffer.buffer, 0, vk::IndexType::eUint16);
+        cmdBuffer.bindVertexBuffers(0, vertexHandle(), { regionVertexOffset });
+        cmdBuffer.bindIndexBuffer(indexHandle(), regionIndexOffset, vk::IndexType::eUint16);
         cmdBuffer.setViewport(0, viewport);
         cmdBuffer.setScissor(0, scissor);
 
@@ -328,29 +453,37 @@ void UIOverlay::updateCommandBuffers() {
             const ImDrawList* cmd_list = imDrawData->CmdLists[j];
             for (int32_t k = 0; k < cmd_list->CmdBuffer.Size; k++) {
                 const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[k];
-                vk::Rect2D scissorRect;
-                scissorRect.offset.x = std::max((int32_t)(pcmd->ClipRect.x), 0);
-                scissorRect.offset.y = std::max((int32_t)(pcmd->ClipRect.y), 0);
-                scissorRect.extent.width = (uint32_t)(pcmd->ClipRect.z - pcmd->ClipRect.x);
-                scissorRect.extent.height = (uint32_t)(pcmd->ClipRect.w - pcmd->ClipRect.y);
-                cmdBuffer.setScissor(0, scissorRect);
+                cmdBuffer.setScissor(0, framebufferRect(pcmd->ClipRect, createInfo.size, preRotation));
                 cmdBuffer.drawIndexed(pcmd->ElemCount, 1, indexOffset, vertexOffset, 0);
                 indexOffset += pcmd->ElemCount;
             }
             vertexOffset += cmd_list->VtxBuffer.Size;
         }
 
-        // Add empty subpasses if requested
-        if (createInfo.subpassCount > 1) {
-            for (uint32_t j = 1; j < createInfo.subpassCount; j++) {
-                cmdBuffer.nextSubpass(vk::SubpassContents::eInline);
+        if (dynamicRendering()) {
+            cmdBuffer.endRenderingKHR(context.dynamicDispatch);
+            const vk::ImageMemoryBarrier toPresent{ vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
+                                                    vk::AccessFlagBits::eMemoryRead,
+                                                    vk::ImageLayout::eColorAttachmentOptimal,
+                                                    vk::ImageLayout::ePresentSrcKHR,
+                                                    VK_QUEUE_FAMILY_IGNORED,
+                                                    VK_QUEUE_FAMILY_IGNORED,
+                                                    createInfo.colorImages[i],
+                                                    colorRange };
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eBottomOfPipe,
+                                      vk::DependencyFlagBits::eByRegion, nullptr, nullptr, toPresent);
+        } else {
+            // Add empty subpasses if requested
+            if (createInfo.subpassCount > 1) {
+                for (uint32_t j = 1; j < createInfo.subpassCount; j++) {
+                    cmdBuffer.nextSubpass(vk::SubpassContents::eInline);
+                }
             }
+            cmdBuffer.endRenderPass();
         }
-
-        cmdBuffer.endRenderPass();
 #if 0 
         if (vkx::debug::marker::active) {
-            vkx::debug::marker::endRegion(cmdBuffers[i]);
+            vkx::debug::marker::endRegion(cmdBuffer);
         }
 #endif
 
@@ -358,96 +491,141 @@ void UIOverlay::updateCommandBuffers() {
     }
 }
 
-/** Update vertex and index buffer containing the imGui elements when required */
+/** Make sure `buffer` holds at least `required` elements per region, growing it geometrically if not */
+bool UIOverlay::reserve(vks::Buffer& buffer, uint32_t& capacity, uint32_t required, vk::DeviceSize elementSize, const vk::BufferUsageFlags& usage) {
+    if (buffer && required <= capacity) {
+        return false;
+    }
+    capacity = std::max(required, std::max<uint32_t>(capacity * 2, MIN_CAPACITY));
+    if (buffer) {
+        buffer.unmap();
+        context.trash(buffer);
+        buffer = vks::Buffer();
+    }
+    // Coherent, so that writes through the persistent mapping never need flushing
+    buffer = context.createBuffer(usage, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                  elementSize * capacity * regionCount);
+    buffer.map();
+    return true;
+}
+
+/** Make sure every region of the sparse `buffer` has at least `required` elements committed */
+void UIOverlay::commit(vks::SparseBuffer& buffer, uint32_t& committed, uint32_t required, vk::DeviceSize elementSize) {
+    if (required <= committed) {
+        return;
+    }
+    if (required > SPARSE_CAPACITY) {
+        throw std::runtime_error("UI overlay geometry exceeds the range reserved for it");
+    }
+    committed = std::min(SPARSE_CAPACITY, std::max(required, std::max<uint32_t>(committed * 2, MIN_CAPACITY)));
+    for (uint32_t region = 0; region < regionCount; ++region) {
+        // Regions in flight keep reading the pages they had, the new ones are past anything they draw
+        buffer.commit(elementSize * SPARSE_CAPACITY * region, elementSize * committed);
+    }
+}
+
+/** Copy the current ImGui geometry into a region of the vertex and index buffers that the GPU is not reading */
 void UIOverlay::update() {
+    VKS_TRACE_ZONE("UIOverlay::update");
     ImDrawData* imDrawData = ImGui::GetDrawData();
-    bool updateCmdBuffers = false;
-
     if (!imDrawData) {
         return;
     };
 
-    // Note: Alignment is done inside buffer creation
-    vk::DeviceSize vertexBufferSize = imDrawData->TotalVtxCount * sizeof(ImDrawVert);
-    vk::DeviceSize indexBufferSize = imDrawData->TotalIdxCount * sizeof(ImDrawIdx);
-
-    // Update buffers only if vertex or index count has been changed compared to current buffer size
-
-    // Vertex buffer
-    if (!vertexBuffer || (vertexCount != imDrawData->TotalVtxCount)) {
-        vertexCount = imDrawData->TotalVtxCount;
-        if (vertexBuffer) {
-            vertexBuffer.unmap();
-            context.trash<vks::Buffer>(vertexBuffer);
-            vertexBuffer = vks::Buffer();
-        }
-		if (vertexCount) {
-			vertexBuffer = context.createBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eHostVisible, vertexBufferSize);
-			vertexBuffer.map();
-			updateCmdBuffers = true;
-		}
+    empty = imDrawData->TotalVtxCount == 0 || imDrawData->TotalIdxCount == 0;
+    if (empty) {
+        return;
     }
 
-    // Index buffer
-    vk::DeviceSize indexSize = imDrawData->TotalIdxCount * sizeof(ImDrawIdx);
-    if (!indexBuffer || (indexCount < imDrawData->TotalIdxCount)) {
-        indexCount = imDrawData->TotalIdxCount;
-        if (indexBuffer) {
-            indexBuffer.unmap();
-            indexBuffer.destroy();
+    if (sparseGeometry) {
+        // The handles and region offsets stay the same, so nothing recorded needs to change
+        commit(sparseVertices, vertexCommitted, (uint32_t)imDrawData->TotalVtxCount, sizeof(ImDrawVert));
+        commit(sparseIndices, indexCommitted, (uint32_t)imDrawData->TotalIdxCount, sizeof(ImDrawIdx));
+    } else {
+        bool grown = reserve(vertexBuffer, vertexCapacity, (uint32_t)imDrawData->TotalVtxCount, sizeof(ImDrawVert), vk::BufferUsageFlagBits::eVertexBuffer);
+        grown |= reserve(indexBuffer, indexCapacity, (uint32_t)imDrawData->TotalIdxCount, sizeof(ImDrawIdx), vk::BufferUsageFlagBits::eIndexBuffer);
+        if (grown) {
+            std::fill(regionSignatures.begin(), regionSignatures.end(), 0);
         }
-		if (indexCount) {
-			indexBuffer = context.createBuffer(vk::BufferUsageFlagBits::eIndexBuffer, vk::MemoryPropertyFlagBits::eHostVisible, indexBufferSize);
-			indexBuffer.map();
-			updateCmdBuffers = true;
-		}
     }
 
-    // Upload data
-    ImDrawVert* vtxDst = (ImDrawVert*)vertexBuffer.mapped;
-    ImDrawIdx* idxDst = (ImDrawIdx*)indexBuffer.mapped;
-
-    for (int n = 0; n < imDrawData->CmdListsCount; n++) {
-        const ImDrawList* cmd_list = imDrawData->CmdLists[n];
-        memcpy(vtxDst, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
-        memcpy(idxDst, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
-        vtxDst += cmd_list->VtxBuffer.Size;
-        idxDst += cmd_list->IdxBuffer.Size;
+    // Once the current region has been handed out for submission it may be in flight, so move on to the next one.
+    // With one more region than frames in flight, that one has always been retired.
+    if (regionSubmitted) {
+        currentRegion = (currentRegion + 1) % regionCount;
+        regionSubmitted = false;
     }
 
-    // Flush to make writes visible to GPU
-	if (vertexBuffer) {
-		vertexBuffer.flush();
+    // Upload data
+    if (sparseGeometry) {
+        vk::DeviceSize vtxOffset = (vk::DeviceSize)currentRegion * vertexCapacity * sizeof(ImDrawVert);
+        vk::DeviceSize idxOffset = (vk::DeviceSize)currentRegion * indexCapacity * sizeof(ImDrawIdx);
+        for (int n = 0; n < imDrawData->CmdListsCount; n++) {
+            const ImDrawList* cmd_list = imDrawData->CmdLists[n];
+            sparseVertices.write(vtxOffset, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+            sparseIndices.write(idxOffset, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+            vtxOffset += cmd_list->VtxBuffer.Size * sizeof(ImDrawVert);
+            idxOffset += cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx);
+        }
+    } else {
+        ImDrawVert* vtxDst = (ImDrawVert*)vertexBuffer.mapped + (size_t)currentRegion * vertexCapacity;
+        ImDrawIdx* idxDst = (ImDrawIdx*)indexBuffer.mapped + (size_t)currentRegion * indexCapacity;
+        for (int n = 0; n < imDrawData->CmdListsCount; n++) {
+            const ImDrawList* cmd_list = imDrawData->CmdLists[n];
+            memcpy(vtxDst, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+            memcpy(idxDst, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+            vtxDst += cmd_list->VtxBuffer.Size;
+            idxDst += cmd_list->IdxBuffer.Size;
+        }
     }
-	if (indexBuffer) {
-		indexBuffer.flush();
-	}
 
-    if (updateCmdBuffers) {
-        updateCommandBuffers();
+    // Only re-record when the draw list layout baked into the command buffers actually changed
+    const uint64_t signature = drawDataSignature(imDrawData, vertexHandle(), indexHandle());
+    if (regionSignatures[currentRegion] != signature) {
+        updateCommandBuffers(currentRegion);
+        regionSignatures[currentRegion] = signature;
     }
 }
 
-void UIOverlay::resize(const vk::Extent2D& size, const std::vector<vk::Framebuffer>& framebuffers) {
+void UIOverlay::resize(const vk::Extent2D& size,
+                       const std::vector<vk::Framebuffer>& framebuffers,
+                       const std::vector<vk::Image>& colorImages,
+                       const std::vector<vk::ImageView>& colorViews) {
     ImGuiIO& io = ImGui::GetIO();
-    io.DisplaySize = ImVec2((float)(size.width), (float)(size.height));
     createInfo.size = size;
+    io.DisplaySize = ImVec2((float)displaySize().width, (float)displaySize().height);
     createInfo.framebuffers = framebuffers;
-    updateCommandBuffers();
+    createInfo.colorImages = colorImages;
+    createInfo.colorViews = colorViews;
+    // Every region refers to the old framebuffers.  The current one is needed for the next frame, the rest are
+    // re-recorded as they are reused.
+    std::fill(regionSignatures.begin(), regionSignatures.end(), 0);
+    if (!empty && vertexHandle() && ImGui::GetDrawData()) {
+        updateCommandBuffers(currentRegion);
+        regionSignatures[currentRegion] = drawDataSignature(ImGui::GetDrawData(), vertexHandle(), indexHandle());
+    }
+}
+
+bool UIOverlay::hasCommandBuffer(uint32_t bufferindex) const {
+    return visible && !empty && regionSignatures[currentRegion] != 0 && bufferindex < targetCount();
+}
+
+vk::CommandBuffer UIOverlay::getSubmitCommandBuffer(uint32_t bufferindex) const {
+    regionSubmitted = true;
+    return cmdBuffers[currentRegion * targetCount() + bufferindex];
 }
 
 /** Submit the overlay command buffers to a queue */
-void UIOverlay::submit(const vk::Queue& queue, uint32_t bufferindex, vk::SubmitInfo submitInfo) const {
-    if (!visible) {
+void UIOverlay::submit(const vk::Queue& queue, uint32_t bufferindex, vk::SubmitInfo submitInfo, const vk::Fence& fence) const {
+    if (!hasCommandBuffer(bufferindex)) {
         return;
     }
 
-    submitInfo.pCommandBuffers = &cmdBuffers[bufferindex];
+    const vk::CommandBuffer commandBuffer = getSubmitCommandBuffer(bufferindex);
+    submitInfo.pCommandBuffers = &commandBuffer;
     submitInfo.commandBufferCount = 1;
 
-    queue.submit(submitInfo, fence);
-    context.device.waitForFences(fence, VK_TRUE, UINT64_MAX);
-    context.device.resetFences(fence);
+    context.submitBatched(queue, submitInfo, fence);
 }
 
 bool UIOverlay::header(const char* caption) const {
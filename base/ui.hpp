@@ -9,6 +9,7 @@
 #pragma once
 
 #include "vks/context.hpp"
+#include "vks/sparsebuffer.hpp"
 #ifdef __ANDROID__
 #include <android/native_activity.h>
 #endif
@@ -19,6 +20,10 @@ struct UIOverlayCreateInfo {
     vk::Queue copyQueue;
     vk::RenderPass renderPass;
     std::vector<vk::Framebuffer> framebuffers;
+    // Without a render pass or framebuffers, the overlay draws into these with dynamic rendering (VK_KHR_dynamic_rendering),
+    // one per swap chain image.  They're expected in ePresentSrcKHR and left there.
+    std::vector<vk::Image> colorImages;
+    std::vector<vk::ImageView> colorViews;
     vk::Format colorformat;
     vk::Format depthformat;
     vk::Extent2D size;
@@ -27,16 +32,38 @@ struct UIOverlayCreateInfo {
     uint32_t subpassCount{ 1 };
     std::vector<vk::ClearValue> clearValues = {};
     uint32_t attachmentCount = 1;
+    // Frames the application may have in flight at once, which determines how many geometry regions are needed
+    uint32_t framesInFlight{ 2 };
 };
 
 class UIOverlay {
 private:
     UIOverlayCreateInfo createInfo;
     const vks::Context& context;
+    static const uint32_t MIN_CAPACITY = 4096;
+    // Elements reserved per region when the geometry is sparse, of which only what's been needed is committed
+    static const uint32_t SPARSE_CAPACITY = 1 << 20;
+
+    // Persistently mapped geometry, split into `regionCount` equal regions of `vertexCapacity` /
+    // `indexCapacity` elements.  Each update writes a region that no in-flight frame is reading.
     vks::Buffer vertexBuffer;
     vks::Buffer indexBuffer;
-    int32_t vertexCount = 0;
-    int32_t indexCount = 0;
+    uint32_t vertexCapacity{ 0 };
+    uint32_t indexCapacity{ 0 };
+    // Where sparse buffers are supported the geometry lives in these instead, with regions `SPARSE_CAPACITY` elements
+    // apart.  Growing commits more of each region, so the regions' command buffers stay valid.
+    bool sparseGeometry{ false };
+    vks::SparseBuffer sparseVertices;
+    vks::SparseBuffer sparseIndices;
+    uint32_t vertexCommitted{ 0 };
+    uint32_t indexCommitted{ 0 };
+    uint32_t regionCount{ 0 };
+    uint32_t currentRegion{ 0 };
+    // Set once the current region's command buffer has been handed out for submission
+    mutable bool regionSubmitted{ false };
+    // Signature of the draw data each region's command buffers were recorded for, 0 if not recorded
+    std::vector<uint64_t> regionSignatures;
+    bool empty{ true };
 
     vk::DescriptorPool descriptorPool;
     vk::DescriptorSetLayout descriptorSetLayout;
@@ -46,24 +73,36 @@ private:
     vk::Pipeline pipeline;
     vk::RenderPass renderPass;
     vk::CommandPool commandPool;
-    vk::Fence fence;
 
     vks::Image font;
 
+    // Must match the PushConstants block of uioverlay.vert
     struct PushConstBlock {
         glm::vec2 scale;
         glm::vec2 translate;
+        // Cosine and sine of the rotation by `preRotation`
+        glm::vec2 rotation;
     } pushConstBlock;
 
     void prepareResources();
     void preparePipeline();
     void prepareRenderPass();
-    void updateCommandBuffers();
+    void updateCommandBuffers(uint32_t region);
+    bool dynamicRendering() const { return !createInfo.renderPass && createInfo.framebuffers.empty(); }
+    size_t targetCount() const { return dynamicRendering() ? createInfo.colorViews.size() : createInfo.framebuffers.size(); }
+    bool reserve(vks::Buffer& buffer, uint32_t& capacity, uint32_t required, vk::DeviceSize elementSize, const vk::BufferUsageFlags& usage);
+    void commit(vks::SparseBuffer& buffer, uint32_t& committed, uint32_t required, vk::DeviceSize elementSize);
+    const vk::Buffer& vertexHandle() const { return sparseGeometry ? sparseVertices.handle() : vertexBuffer.buffer; }
+    const vk::Buffer& indexHandle() const { return sparseGeometry ? sparseIndices.handle() : indexBuffer.buffer; }
 
 public:
     bool visible = true;
     float scale = 1.0f;
+    // Clockwise degrees the framebuffers are rotated by on the display, see vks::SwapChain::preRotationDegrees.
+    // The overlay is laid out in the display's orientation.  Read by resize
+    uint32_t preRotation{ 0 };
 
+    // One command buffer per framebuffer for each geometry region, indexed by region * framebuffer count + framebuffer
     std::vector<vk::CommandBuffer> cmdBuffers;
 
     UIOverlay(const vks::Context& context)
@@ -74,9 +113,27 @@ public:
     void destroy();
 
     void update();
-    void resize(const vk::Extent2D& newSize, const std::vector<vk::Framebuffer>& framebuffers);
-
-    void submit(const vk::Queue& queue, uint32_t bufferindex, vk::SubmitInfo submitInfo) const;
+    // The framebuffer size in the display's orientation, which the overlay is laid out in
+    vk::Extent2D displaySize() const {
+        const bool swapsAxes = preRotation == 90 || preRotation == 270;
+        return swapsAxes ? vk::Extent2D{ createInfo.size.height, createInfo.size.width } : createInfo.size;
+    }
+
+    // The color images and views are only used with dynamic rendering
+    void resize(const vk::Extent2D& newSize,
+                const std::vector<vk::Framebuffer>& framebuffers,
+                const std::vector<vk::Image>& colorImages = {},
+                const std::vector<vk::ImageView>& colorViews = {});
+
+    // True if there is a recorded overlay command buffer for the given framebuffer
+    bool hasCommandBuffer(uint32_t bufferindex) const;
+    // The overlay command buffer for the given framebuffer and the most recent update.  The caller must submit
+    // it, as the next update will assume the geometry it references is in flight.
+    vk::CommandBuffer getSubmitCommandBuffer(uint32_t bufferindex) const;
+
+    // Submits without waiting on the host.  `fence`, if provided, is signaled when the overlay has rendered.
+    // Prefer appending cmdBuffers[bufferindex] to the frame's own submission where possible.
+    void submit(const vk::Queue& queue, uint32_t bufferindex, vk::SubmitInfo submitInfo, const vk::Fence& fence = vk::Fence()) const;
 
     bool header(const char* caption) const;
     bool checkBox(const char* caption, bool* value) const;
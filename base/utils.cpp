@@ -50,6 +50,19 @@ void vkx::logMessage(vkx::LogLevel level, const char* format, ...) {
     va_end(arglist);
 }
 
+static std::vector<std::string>& commandLine() {
+    static std::vector<std::string> arguments;
+    return arguments;
+}
+
+void vkx::setCommandLine(int argc, const char* argv[]) {
+    commandLine().assign(argv, argv + argc);
+}
+
+const std::vector<std::string>& vkx::getCommandLine() {
+    return commandLine();
+}
+
 const std::string& vkx::getAssetPath() {
 #if defined(__ANDROID__)
     static const std::string NOTHING;
@@ -1,10 +1,15 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 namespace vkx {
 const std::string& getAssetPath();
 
+// Command line arguments of the process, recorded by the example entry point.  Always empty on Android
+void setCommandLine(int argc, const char* argv[]);
+const std::vector<std::string>& getCommandLine();
+
 enum class LogLevel
 {
     LOG_DEBUG = 0,
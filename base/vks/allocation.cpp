@@ -0,0 +1,49 @@
+#include "allocation.hpp"
+#include "allocator.hpp"
+
+using namespace vks;
+
+void* Allocation::mapRange(vk::DeviceSize offset, vk::DeviceSize size) {
+    if (allocator) {
+        // The owning block stays mapped for its whole lifetime, so the range is implied
+        return static_cast<uint8_t*>(allocator->map(*this)) + offset;
+    }
+    return device.mapMemory(memory, offset, size, vk::MemoryMapFlags());
+}
+
+void Allocation::unmap() {
+    if (!allocator) {
+        device.unmapMemory(memory);
+    }
+    mapped = nullptr;
+}
+
+vk::MappedMemoryRange Allocation::memoryRange(vk::DeviceSize size, vk::DeviceSize offset) const {
+    if (allocator) {
+        return allocator->mappedRange(*this, offset, size);
+    }
+    return vk::MappedMemoryRange{ memory, offset, size };
+}
+
+void Allocation::flush(vk::DeviceSize size, vk::DeviceSize offset) const {
+    device.flushMappedMemoryRanges(memoryRange(size, offset));
+}
+
+void Allocation::invalidate(vk::DeviceSize size, vk::DeviceSize offset) const {
+    device.invalidateMappedMemoryRanges(memoryRange(size, offset));
+}
+
+void Allocation::destroy() {
+    if (nullptr != mapped) {
+        unmap();
+    }
+    if (memory) {
+        if (allocator) {
+            allocator->free(*this);
+        } else {
+            device.freeMemory(memory);
+        }
+        memory = vk::DeviceMemory();
+        offset = 0;
+    }
+}
@@ -4,30 +4,37 @@
 
 namespace vks {
 
+class Allocator;
+
 // A wrapper class for an allocation, either an Image or Buffer.  Not intended to be used used directly
 // but only as a base class providing common functionality for the classes below.
 //
 // Provides easy to use mechanisms for mapping, unmapping and copying host data to the device memory
+//
+// When the allocation was made through a vks::Allocator, `memory` is a shared block and `offset`
+// is the start of this allocation within it.  All the functions below take offsets relative to
+// the start of the allocation regardless.
 struct Allocation {
     vk::Device device;
     vk::DeviceMemory memory;
+    vk::DeviceSize offset{ 0 };
+    Allocator* allocator{ nullptr };
     vk::DeviceSize size{ 0 };
     vk::DeviceSize alignment{ 0 };
     vk::DeviceSize allocSize{ 0 };
     void* mapped{ nullptr };
     /** @brief Memory propertys flags to be filled by external source at buffer creation (to query at some later point) */
     vk::MemoryPropertyFlags memoryPropertyFlags;
+    /** @brief Index of the Allocator tag the allocation is accounted to, see Allocator::ScopedTag */
+    uint32_t tag{ 0 };
 
     template <typename T = void>
     inline T* map(size_t offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) {
-        mapped = device.mapMemory(memory, offset, size, vk::MemoryMapFlags());
+        mapped = mapRange(offset, size);
         return (T*)mapped;
     }
 
-    inline void unmap() {
-        device.unmapMemory(memory);
-        mapped = nullptr;
-    }
+    void unmap();
 
     inline void copy(size_t size, const void* data, VkDeviceSize offset = 0) const { memcpy(static_cast<uint8_t*>(mapped) + offset, data, size); }
 
@@ -51,9 +58,7 @@ struct Allocation {
         *
         * @return VkResult of the flush call
         */
-    void flush(vk::DeviceSize size = VK_WHOLE_SIZE, vk::DeviceSize offset = 0) {
-        return device.flushMappedMemoryRanges(vk::MappedMemoryRange{ memory, offset, size });
-    }
+    void flush(vk::DeviceSize size = VK_WHOLE_SIZE, vk::DeviceSize offset = 0) const;
 
     /**
         * Invalidate a memory range of the buffer to make it visible to the host
@@ -65,18 +70,12 @@ struct Allocation {
         *
         * @return VkResult of the invalidate call
         */
-    void invalidate(vk::DeviceSize size = VK_WHOLE_SIZE, vk::DeviceSize offset = 0) {
-        return device.invalidateMappedMemoryRanges(vk::MappedMemoryRange{ memory, offset, size });
-    }
+    void invalidate(vk::DeviceSize size = VK_WHOLE_SIZE, vk::DeviceSize offset = 0) const;
 
-    virtual void destroy() {
-        if (nullptr != mapped) {
-            unmap();
-        }
-        if (memory) {
-            device.freeMemory(memory);
-            memory = vk::DeviceMemory();
-        }
-    }
+    virtual void destroy();
+
+private:
+    void* mapRange(vk::DeviceSize offset, vk::DeviceSize size);
+    vk::MappedMemoryRange memoryRange(vk::DeviceSize size, vk::DeviceSize offset) const;
 };
 }  // namespace vks
@@ -0,0 +1,418 @@
+#include "allocator.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace vks;
+
+namespace {
+
+inline vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment) {
+    return alignment > 1 ? ((value + alignment - 1) / alignment) * alignment : value;
+}
+
+inline vk::DeviceSize alignDown(vk::DeviceSize value, vk::DeviceSize alignment) {
+    return alignment > 1 ? (value / alignment) * alignment : value;
+}
+
+// The name of the innermost ScopedTag of the thread
+thread_local const std::string* currentTag = nullptr;
+// Set while the thread runs the evictors, whose own allocations mustn't evict again
+thread_local bool evicting = false;
+
+}  // namespace
+
+const vk::DeviceSize Allocator::DEFAULT_BLOCK_SIZE;
+constexpr double Allocator::DEFAULT_BUDGET_FRACTION;
+
+Allocator::ScopedTag::ScopedTag(const std::string& name)
+    : name(name)
+    , previous(currentTag) {
+    currentTag = &this->name;
+}
+
+Allocator::ScopedTag::~ScopedTag() {
+    currentTag = previous;
+}
+
+Allocator::Allocator(const vk::PhysicalDevice& physicalDevice, const vk::Device& device, vk::DeviceSize blockSize, const vk::MemoryAllocateFlags& allocateFlags)
+    : device(device)
+    , blockSize(blockSize)
+    , allocateFlags(allocateFlags) {
+    memoryProperties = physicalDevice.getMemoryProperties();
+    const auto limits = physicalDevice.getProperties().limits;
+    nonCoherentAtomSize = std::max<vk::DeviceSize>(1, limits.nonCoherentAtomSize);
+    maxAllocationCount = limits.maxMemoryAllocationCount;
+    pools.resize(memoryProperties.memoryTypeCount * 2);
+    heapReserved.resize(memoryProperties.memoryHeapCount, 0);
+    heapUsed.resize(memoryProperties.memoryHeapCount, 0);
+    tagIndex("untagged");
+}
+
+Allocator::~Allocator() {
+    destroy();
+}
+
+uint32_t Allocator::findMemoryType(uint32_t typeBits, const vk::MemoryPropertyFlags& properties) const {
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        if ((typeBits & (1u << i)) && ((memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)) {
+            return i;
+        }
+    }
+    throw std::runtime_error("Unable to find memory type " + vk::to_string(properties));
+}
+
+Allocator::Block* Allocator::createBlock(uint32_t memoryTypeIndex, vk::DeviceSize size, bool dedicated) {
+    if (maxAllocationCount != 0 && blocks.size() >= maxAllocationCount) {
+        throw std::runtime_error("Device memory allocation count limit reached");
+    }
+    BlockPtr block{ new Block() };
+    vk::MemoryAllocateInfo allocateInfo{ size, memoryTypeIndex };
+    vk::MemoryAllocateFlagsInfo flagsInfo{ allocateFlags };
+    if (allocateFlags) {
+        allocateInfo.pNext = &flagsInfo;
+    }
+    block->memory = device.allocateMemory(allocateInfo);
+    block->size = size;
+    block->memoryTypeIndex = memoryTypeIndex;
+    block->dedicated = dedicated;
+    if (!dedicated) {
+        block->freeRanges[0] = size;
+    }
+    heapReserved[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex] += size;
+    Block* result = block.get();
+    blocks[result->memory] = std::move(block);
+    return result;
+}
+
+void Allocator::releaseBlock(Block* block) {
+    if (block->mapped) {
+        device.unmapMemory(block->memory);
+        block->mapped = nullptr;
+    }
+    heapReserved[memoryProperties.memoryTypes[block->memoryTypeIndex].heapIndex] -= block->size;
+    const VkDeviceMemory memory = block->memory;
+    device.freeMemory(block->memory);
+    blocks.erase(memory);
+}
+
+// First fit.  Any slack introduced by alignment at the front of a range stays in the free list.
+bool Allocator::allocateFromBlock(Block& block, vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& outOffset) {
+    for (auto itr = block.freeRanges.begin(); itr != block.freeRanges.end(); ++itr) {
+        const vk::DeviceSize rangeStart = itr->first;
+        const vk::DeviceSize rangeEnd = rangeStart + itr->second;
+        const vk::DeviceSize start = alignUp(rangeStart, alignment);
+        if (start + size > rangeEnd) {
+            continue;
+        }
+        block.freeRanges.erase(itr);
+        if (start > rangeStart) {
+            block.freeRanges[rangeStart] = start - rangeStart;
+        }
+        if (start + size < rangeEnd) {
+            block.freeRanges[start + size] = rangeEnd - (start + size);
+        }
+        outOffset = start;
+        return true;
+    }
+    return false;
+}
+
+void Allocator::freeToBlock(Block& block, vk::DeviceSize offset, vk::DeviceSize size) {
+    auto inserted = block.freeRanges.emplace(offset, size).first;
+    // Coalesce with the following range
+    auto next = std::next(inserted);
+    if (next != block.freeRanges.end() && inserted->first + inserted->second == next->first) {
+        inserted->second += next->second;
+        block.freeRanges.erase(next);
+    }
+    // Coalesce with the preceding range
+    if (inserted != block.freeRanges.begin()) {
+        auto prev = std::prev(inserted);
+        if (prev->first + prev->second == inserted->first) {
+            prev->second += inserted->second;
+            block.freeRanges.erase(inserted);
+        }
+    }
+}
+
+Allocation Allocator::allocate(const vk::MemoryRequirements& requirements, const vk::MemoryPropertyFlags& memoryPropertyFlags, ResourceKind kind) {
+    const uint32_t memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, memoryPropertyFlags);
+    const auto actualFlags = memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+    // Keep non-coherent sub-allocations on atom boundaries so that flushing one never touches another
+    vk::DeviceSize alignment = std::max<vk::DeviceSize>(1, requirements.alignment);
+    vk::DeviceSize size = requirements.size;
+    if (!(actualFlags & vk::MemoryPropertyFlagBits::eHostCoherent) && (actualFlags & vk::MemoryPropertyFlagBits::eHostVisible)) {
+        alignment = std::max(alignment, nonCoherentAtomSize);
+        size = alignUp(size, nonCoherentAtomSize);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    const uint32_t heapIndex = memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    const bool dedicated = size > blockSize / 2;
+    const vk::DeviceSize newBlockSize = dedicated ? size : blockSize;
+    auto& pool = pools[memoryTypeIndex * 2 + static_cast<uint32_t>(kind)];
+    vk::DeviceSize offset = 0;
+    const auto fromPool = [&]() -> Block* {
+        if (!dedicated) {
+            for (auto candidate : pool) {
+                if (allocateFromBlock(*candidate, size, alignment, offset)) {
+                    return candidate;
+                }
+            }
+        }
+        return nullptr;
+    };
+
+    Block* block = fromPool();
+    // Evictors releasing memory right away may leave room in the existing blocks
+    if (!block && exceedsBudget(heapIndex, newBlockSize) && evict(lock, heapIndex, newBlockSize)) {
+        block = fromPool();
+    }
+    const auto newBlock = [&] {
+        Block* result = createBlock(memoryTypeIndex, newBlockSize, dedicated);
+        if (!dedicated) {
+            pool.push_back(result);
+            if (!allocateFromBlock(*result, size, alignment, offset)) {
+                throw std::runtime_error("Unable to sub-allocate from a fresh memory block");
+            }
+        }
+        return result;
+    };
+    if (!block) {
+        try {
+            block = newBlock();
+        } catch (const vk::OutOfDeviceMemoryError&) {
+            if (!evict(lock, heapIndex, newBlockSize)) {
+                throw;
+            }
+            block = fromPool();
+            if (!block) {
+                block = newBlock();
+            }
+        }
+    }
+    ++block->allocationCount;
+    heapUsed[heapIndex] += size;
+    const uint32_t tag = currentTag ? tagIndex(*currentTag) : 0;
+    ++tags[tag].allocationCount;
+    tags[tag].bytes += size;
+
+    Allocation result;
+    result.device = device;
+    result.allocator = this;
+    result.memory = block->memory;
+    result.offset = offset;
+    result.alignment = requirements.alignment;
+    result.allocSize = size;
+    result.memoryPropertyFlags = actualFlags;
+    result.tag = tag;
+    return result;
+}
+
+void Allocator::free(Allocation& allocation) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto itr = blocks.find(allocation.memory);
+    if (itr == blocks.end()) {
+        throw std::runtime_error("Freeing memory not owned by this allocator");
+    }
+    Block* block = itr->second.get();
+    --block->allocationCount;
+    heapUsed[memoryProperties.memoryTypes[block->memoryTypeIndex].heapIndex] -= allocation.allocSize;
+    if (allocation.tag < tags.size()) {
+        --tags[allocation.tag].allocationCount;
+        tags[allocation.tag].bytes -= allocation.allocSize;
+    }
+    if (block->dedicated) {
+        releaseBlock(block);
+    } else {
+        freeToBlock(*block, allocation.offset, allocation.allocSize);
+    }
+    allocation.memory = vk::DeviceMemory();
+    allocation.mapped = nullptr;
+}
+
+void* Allocator::map(const Allocation& allocation) {
+    std::unique_lock<std::mutex> lock(mutex);
+    Block* block = blocks.at(allocation.memory).get();
+    if (!block->mapped) {
+        block->mapped = device.mapMemory(block->memory, 0, VK_WHOLE_SIZE, vk::MemoryMapFlags());
+    }
+    return static_cast<uint8_t*>(block->mapped) + allocation.offset;
+}
+
+vk::MappedMemoryRange Allocator::mappedRange(const Allocation& allocation, vk::DeviceSize offset, vk::DeviceSize size) const {
+    std::unique_lock<std::mutex> lock(mutex);
+    const Block* block = blocks.at(allocation.memory).get();
+    if (size == VK_WHOLE_SIZE) {
+        size = allocation.allocSize - offset;
+    }
+    const vk::DeviceSize begin = alignDown(allocation.offset + offset, nonCoherentAtomSize);
+    const vk::DeviceSize end = std::min(alignUp(allocation.offset + offset + size, nonCoherentAtomSize), block->size);
+    return vk::MappedMemoryRange{ block->memory, begin, end - begin };
+}
+
+Allocator::Stats Allocator::getStats() const {
+    std::unique_lock<std::mutex> lock(mutex);
+    Stats stats;
+    for (const auto& entry : blocks) {
+        const auto& block = *entry.second;
+        stats.reservedBytes += block.size;
+        stats.allocationCount += block.allocationCount;
+        if (block.dedicated) {
+            ++stats.dedicatedCount;
+            stats.usedBytes += block.size;
+            continue;
+        }
+        ++stats.blockCount;
+        vk::DeviceSize blockFree = 0;
+        for (const auto& range : block.freeRanges) {
+            blockFree += range.second;
+            stats.largestFreeRange = std::max(stats.largestFreeRange, range.second);
+        }
+        stats.freeBytes += blockFree;
+        stats.usedBytes += block.size - blockFree;
+    }
+    if (stats.freeBytes > 0) {
+        stats.fragmentation = 1.0f - (float)((double)stats.largestFreeRange / (double)stats.freeBytes);
+    }
+    return stats;
+}
+
+void Allocator::setBudgetQuery(const BudgetQuery& query) {
+    std::unique_lock<std::mutex> lock(mutex);
+    budgetQuery = query;
+}
+
+void Allocator::queryBudgets(std::vector<vk::DeviceSize>& budgets, std::vector<vk::DeviceSize>& usages) const {
+    budgets.assign(memoryProperties.memoryHeapCount, 0);
+    usages.assign(memoryProperties.memoryHeapCount, 0);
+    if (budgetQuery) {
+        budgetQuery(budgets, usages);
+        return;
+    }
+    for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; ++heap) {
+        budgets[heap] = (vk::DeviceSize)((double)memoryProperties.memoryHeaps[heap].size * DEFAULT_BUDGET_FRACTION);
+        usages[heap] = heapReserved[heap];
+    }
+}
+
+bool Allocator::exceedsBudget(uint32_t heapIndex, vk::DeviceSize bytes) const {
+    std::vector<vk::DeviceSize> budgets, usages;
+    queryBudgets(budgets, usages);
+    return usages[heapIndex] + bytes > budgets[heapIndex];
+}
+
+std::vector<Allocator::HeapBudget> Allocator::getHeapBudgets() const {
+    std::unique_lock<std::mutex> lock(mutex);
+    std::vector<vk::DeviceSize> budgets, usages;
+    queryBudgets(budgets, usages);
+    std::vector<HeapBudget> result(memoryProperties.memoryHeapCount);
+    for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; ++heap) {
+        auto& entry = result[heap];
+        entry.flags = memoryProperties.memoryHeaps[heap].flags;
+        entry.size = memoryProperties.memoryHeaps[heap].size;
+        entry.budget = budgets[heap];
+        entry.usage = usages[heap];
+        entry.reservedBytes = heapReserved[heap];
+        entry.usedBytes = heapUsed[heap];
+    }
+    return result;
+}
+
+bool Allocator::withinBudget(const vk::MemoryPropertyFlags& memoryPropertyFlags, vk::DeviceSize bytes) const {
+    const uint32_t heapIndex = memoryProperties.memoryTypes[findMemoryType(~0u, memoryPropertyFlags)].heapIndex;
+    std::unique_lock<std::mutex> lock(mutex);
+    return !exceedsBudget(heapIndex, bytes);
+}
+
+uint32_t Allocator::getHeapIndex(const Allocation& allocation) const {
+    std::unique_lock<std::mutex> lock(mutex);
+    return memoryProperties.memoryTypes[blocks.at(allocation.memory)->memoryTypeIndex].heapIndex;
+}
+
+uint32_t Allocator::addEvictor(const Evictor& evictor) {
+    std::unique_lock<std::mutex> lock(mutex);
+    evictors.emplace_back(nextEvictorId, evictor);
+    return nextEvictorId++;
+}
+
+void Allocator::removeEvictor(uint32_t id) {
+    std::unique_lock<std::mutex> lock(mutex);
+    evictors.erase(std::remove_if(evictors.begin(), evictors.end(), [&](const auto& entry) { return entry.first == id; }), evictors.end());
+}
+
+vk::DeviceSize Allocator::evict(std::unique_lock<std::mutex>& lock, uint32_t heapIndex, vk::DeviceSize bytes) {
+    if (evicting || evictors.empty()) {
+        return 0;
+    }
+    // Evictors free allocations, and may remove themselves, so they're called on a copy without the lock
+    const auto current = evictors;
+    lock.unlock();
+    evicting = true;
+    vk::DeviceSize released = 0;
+    try {
+        for (const auto& entry : current) {
+            if (released >= bytes) {
+                break;
+            }
+            released += entry.second(heapIndex, bytes - released);
+        }
+    } catch (...) {
+        evicting = false;
+        lock.lock();
+        throw;
+    }
+    evicting = false;
+    lock.lock();
+    return released;
+}
+
+uint32_t Allocator::tagIndex(const std::string& name) {
+    auto itr = tagIndices.find(name);
+    if (itr == tagIndices.end()) {
+        itr = tagIndices.insert({ name, (uint32_t)tags.size() }).first;
+        TagStats stats;
+        stats.name = name;
+        tags.push_back(stats);
+    }
+    return itr->second;
+}
+
+void Allocator::setTag(Allocation& allocation, const std::string& tag) {
+    std::unique_lock<std::mutex> lock(mutex);
+    const uint32_t index = tagIndex(tag);
+    if (allocation.memory && allocation.tag < tags.size()) {
+        --tags[allocation.tag].allocationCount;
+        tags[allocation.tag].bytes -= allocation.allocSize;
+        ++tags[index].allocationCount;
+        tags[index].bytes += allocation.allocSize;
+    }
+    allocation.tag = index;
+}
+
+std::vector<Allocator::TagStats> Allocator::getTagStats() const {
+    std::unique_lock<std::mutex> lock(mutex);
+    return tags;
+}
+
+void Allocator::destroy() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (auto& entry : blocks) {
+        auto& block = *entry.second;
+        if (block.mapped) {
+            device.unmapMemory(block.memory);
+        }
+        device.freeMemory(block.memory);
+    }
+    blocks.clear();
+    for (auto& pool : pools) {
+        pool.clear();
+    }
+    std::fill(heapReserved.begin(), heapReserved.end(), 0);
+    std::fill(heapUsed.begin(), heapUsed.end(), 0);
+    for (auto& tag : tags) {
+        tag.allocationCount = 0;
+        tag.bytes = 0;
+    }
+}
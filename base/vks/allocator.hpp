@@ -0,0 +1,188 @@
+/*
+* Vulkan device memory sub-allocator
+*
+* Carves buffers and images out of large per-memory-type blocks instead of issuing a
+* vkAllocateMemory call for every resource.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "allocation.hpp"
+
+namespace vks {
+
+// Owns all device memory handed out by the context.  Memory is allocated in blocks of
+// `blockSize` bytes, one set of blocks per (memory type, resource kind) pair.  Buffers and
+// linear images are never placed in the same block as optimal images, which keeps every
+// sub-allocation clear of the `bufferImageGranularity` limit without having to track
+// neighbouring resource types.
+//
+// Requests larger than half a block get a dedicated VkDeviceMemory of their own.
+//
+// Memory is accounted per heap, against the budget reported by VK_EXT_memory_budget where the context enabled it, and
+// per tag, a label like the ones given to debug::setDeviceMemoryName.  When a new block would take a heap over its
+// budget, or the driver runs out of device memory, the registered evictors are asked to release memory first.
+class Allocator {
+public:
+    enum class ResourceKind : uint32_t
+    {
+        Linear = 0,
+        Optimal = 1,
+    };
+
+    struct Stats {
+        uint32_t blockCount{ 0 };
+        uint32_t dedicatedCount{ 0 };
+        uint32_t allocationCount{ 0 };
+        vk::DeviceSize reservedBytes{ 0 };
+        vk::DeviceSize usedBytes{ 0 };
+        vk::DeviceSize freeBytes{ 0 };
+        vk::DeviceSize largestFreeRange{ 0 };
+        // 0 when all free space in the blocks is contiguous, approaching 1 as it gets chopped up
+        float fragmentation{ 0.0f };
+    };
+
+    struct HeapBudget {
+        vk::MemoryHeapFlags flags;
+        vk::DeviceSize size{ 0 };
+        // The driver's budget and the process' usage of the heap, with VK_EXT_memory_budget.  Otherwise the budget is
+        // DEFAULT_BUDGET_FRACTION of the heap and the usage is the memory of this allocator.
+        vk::DeviceSize budget{ 0 };
+        vk::DeviceSize usage{ 0 };
+        // Memory of this allocator's blocks on the heap, and how much of it is handed out
+        vk::DeviceSize reservedBytes{ 0 };
+        vk::DeviceSize usedBytes{ 0 };
+    };
+
+    struct TagStats {
+        std::string name;
+        uint32_t allocationCount{ 0 };
+        vk::DeviceSize bytes{ 0 };
+    };
+
+    // While alive, allocations made on the constructing thread are accounted to `name`, the innermost scope winning.
+    // Allocations outside of any scope are "untagged".
+    class ScopedTag {
+    public:
+        ScopedTag(const std::string& name);
+        ~ScopedTag();
+        ScopedTag(const ScopedTag&) = delete;
+        ScopedTag& operator=(const ScopedTag&) = delete;
+
+    private:
+        std::string name;
+        const std::string* previous;
+    };
+
+    // Fills in the budget and usage of every heap
+    using BudgetQuery = std::function<void(std::vector<vk::DeviceSize>& budgets, std::vector<vk::DeviceSize>& usages)>;
+
+    // Asked to release `bytes` of `heapIndex`, returns how much it releases.  Memory handed back through the context's
+    // deferred deletion counts, even though it's only freed once the device is done with it.  Evictors run on the
+    // allocating thread, outside of the allocator's lock, and allocations they make don't evict.
+    using Evictor = std::function<vk::DeviceSize(uint32_t heapIndex, vk::DeviceSize bytes)>;
+
+    static const vk::DeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+    // Of each heap, when the driver doesn't report a budget
+    static constexpr double DEFAULT_BUDGET_FRACTION = 0.8;
+
+    // Every block is allocated with `allocateFlags`, e.g. eDeviceAddress so that any buffer can have a device address
+    Allocator(const vk::PhysicalDevice& physicalDevice,
+              const vk::Device& device,
+              vk::DeviceSize blockSize = DEFAULT_BLOCK_SIZE,
+              const vk::MemoryAllocateFlags& allocateFlags = {});
+    ~Allocator();
+
+    // Returns an allocation with `device`, `memory`, `offset`, `allocSize`, `alignment` (that of `requirements`) and
+    // `memoryPropertyFlags` populated.  The caller is responsible for binding the resource.
+    Allocation allocate(const vk::MemoryRequirements& requirements, const vk::MemoryPropertyFlags& memoryPropertyFlags, ResourceKind kind);
+    void free(Allocation& allocation);
+
+    // Host visible blocks are mapped in their entirety the first time any allocation in
+    // them is mapped, and stay mapped until the block is released.
+    void* map(const Allocation& allocation);
+
+    // Translates an allocation relative range into a block relative range, widened to
+    // `nonCoherentAtomSize` as required for flush / invalidate of non-coherent memory.
+    vk::MappedMemoryRange mappedRange(const Allocation& allocation, vk::DeviceSize offset, vk::DeviceSize size) const;
+
+    Stats getStats() const;
+
+    void setBudgetQuery(const BudgetQuery& query);
+    std::vector<HeapBudget> getHeapBudgets() const;
+    // Whether `bytes` more of the heap memory with `memoryPropertyFlags` would come from stays within its budget
+    bool withinBudget(const vk::MemoryPropertyFlags& memoryPropertyFlags, vk::DeviceSize bytes) const;
+    // The heap an allocation of this allocator is on
+    uint32_t getHeapIndex(const Allocation& allocation) const;
+
+    // Returns an id for removeEvictor.  Evictors are asked in the order they were added.
+    uint32_t addEvictor(const Evictor& evictor);
+    void removeEvictor(uint32_t id);
+
+    // Accounts `allocation` to `tag` from now on
+    void setTag(Allocation& allocation, const std::string& tag);
+    // Every tag used so far, with what's allocated under it now
+    std::vector<TagStats> getTagStats() const;
+
+    // Frees every block.  Any allocations still outstanding become invalid.
+    void destroy();
+
+private:
+    struct Block {
+        vk::DeviceMemory memory;
+        vk::DeviceSize size{ 0 };
+        uint32_t memoryTypeIndex{ 0 };
+        bool dedicated{ false };
+        void* mapped{ nullptr };
+        uint32_t allocationCount{ 0 };
+        // Free ranges keyed by offset
+        std::map<vk::DeviceSize, vk::DeviceSize> freeRanges;
+    };
+    using BlockPtr = std::unique_ptr<Block>;
+
+    uint32_t findMemoryType(uint32_t typeBits, const vk::MemoryPropertyFlags& properties) const;
+    // Budget and usage of every heap, with the lock held
+    void queryBudgets(std::vector<vk::DeviceSize>& budgets, std::vector<vk::DeviceSize>& usages) const;
+    bool exceedsBudget(uint32_t heapIndex, vk::DeviceSize bytes) const;
+    // Asks the evictors, with the lock released, and returns the bytes they released
+    vk::DeviceSize evict(std::unique_lock<std::mutex>& lock, uint32_t heapIndex, vk::DeviceSize bytes);
+    uint32_t tagIndex(const std::string& name);
+    Block* createBlock(uint32_t memoryTypeIndex, vk::DeviceSize size, bool dedicated);
+    void releaseBlock(Block* block);
+    static bool allocateFromBlock(Block& block, vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& outOffset);
+    static void freeToBlock(Block& block, vk::DeviceSize offset, vk::DeviceSize size);
+
+    vk::Device device;
+    vk::PhysicalDeviceMemoryProperties memoryProperties;
+    vk::DeviceSize blockSize;
+    vk::MemoryAllocateFlags allocateFlags;
+    vk::DeviceSize nonCoherentAtomSize{ 1 };
+    uint32_t maxAllocationCount{ 0 };
+
+    mutable std::mutex mutex;
+    // Pools indexed by (memoryTypeIndex * 2 + ResourceKind)
+    std::vector<std::vector<Block*>> pools;
+    std::unordered_map<VkDeviceMemory, BlockPtr> blocks;
+    // Per heap
+    std::vector<vk::DeviceSize> heapReserved;
+    std::vector<vk::DeviceSize> heapUsed;
+    BudgetQuery budgetQuery;
+    std::vector<std::pair<uint32_t, Evictor>> evictors;
+    uint32_t nextEvictorId{ 1 };
+    std::vector<TagStats> tags;
+    std::unordered_map<std::string, uint32_t> tagIndices;
+};
+
+}  // namespace vks
@@ -0,0 +1,247 @@
+#include "animation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+#include <assimp/anim.h>
+#include <assimp/scene.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "scheduler.hpp"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define VKS_ANIMATION_SSE 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VKS_ANIMATION_NEON 1
+#endif
+
+using namespace vks::model;
+
+namespace {
+
+// Assimp matrices are row major
+glm::mat4 toMat4(const aiMatrix4x4& matrix) {
+    return glm::transpose(glm::make_mat4(&matrix.a1));
+}
+
+// out = a * b, one column of `out` at a time as a weighted sum of the columns of `a`.  `out` may alias `b`
+inline void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out) {
+#if defined(VKS_ANIMATION_SSE)
+    const __m128 a0 = _mm_loadu_ps(&a[0][0]);
+    const __m128 a1 = _mm_loadu_ps(&a[1][0]);
+    const __m128 a2 = _mm_loadu_ps(&a[2][0]);
+    const __m128 a3 = _mm_loadu_ps(&a[3][0]);
+    for (int column = 0; column < 4; ++column) {
+        const __m128 b0 = _mm_set1_ps(b[column][0]);
+        const __m128 b1 = _mm_set1_ps(b[column][1]);
+        const __m128 b2 = _mm_set1_ps(b[column][2]);
+        const __m128 b3 = _mm_set1_ps(b[column][3]);
+        const __m128 result = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, b0), _mm_mul_ps(a1, b1)), _mm_add_ps(_mm_mul_ps(a2, b2), _mm_mul_ps(a3, b3)));
+        _mm_storeu_ps(&out[column][0], result);
+    }
+#elif defined(VKS_ANIMATION_NEON)
+    const float32x4_t a0 = vld1q_f32(&a[0][0]);
+    const float32x4_t a1 = vld1q_f32(&a[1][0]);
+    const float32x4_t a2 = vld1q_f32(&a[2][0]);
+    const float32x4_t a3 = vld1q_f32(&a[3][0]);
+    for (int column = 0; column < 4; ++column) {
+        const float32x4_t weights = vld1q_f32(&b[column][0]);
+        float32x4_t result = vmulq_lane_f32(a0, vget_low_f32(weights), 0);
+        result = vmlaq_lane_f32(result, a1, vget_low_f32(weights), 1);
+        result = vmlaq_lane_f32(result, a2, vget_high_f32(weights), 0);
+        result = vmlaq_lane_f32(result, a3, vget_high_f32(weights), 1);
+        vst1q_f32(&out[column][0], result);
+    }
+#else
+    out = a * b;
+#endif
+}
+
+// translation * rotation * scale, without the matrix products
+glm::mat4 compose(const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale) {
+    glm::mat4 result = glm::mat4_cast(rotation);
+    result[0] *= scale.x;
+    result[1] *= scale.y;
+    result[2] *= scale.z;
+    result[3] = glm::vec4(translation, 1.0f);
+    return result;
+}
+
+// The last key at or before `time`.  Playback moves forward by less than a key per frame most of the time, so
+// starting from the previous result makes this constant time, and only wrapping around searches from the start.
+uint32_t seek(const float* times, uint32_t count, float time, uint32_t& cursor) {
+    if (cursor >= count || times[cursor] > time) {
+        cursor = 0;
+    }
+    while (cursor + 1 < count && times[cursor + 1] <= time) {
+        ++cursor;
+    }
+    return cursor;
+}
+
+float blendFactor(const float* times, uint32_t key, float time) {
+    const float span = times[key + 1] - times[key];
+    return span > 0.0f ? glm::clamp((time - times[key]) / span, 0.0f, 1.0f) : 0.0f;
+}
+
+glm::vec3 sample(const float* times, const glm::vec3* values, uint32_t count, float time, uint32_t& cursor, const glm::vec3& fallback) {
+    if (count == 0) {
+        return fallback;
+    }
+    const uint32_t key = seek(times, count, time, cursor);
+    if (key + 1 >= count) {
+        return values[key];
+    }
+    return glm::mix(values[key], values[key + 1], blendFactor(times, key, time));
+}
+
+glm::quat sample(const float* times, const glm::quat* values, uint32_t count, float time, uint32_t& cursor) {
+    if (count == 0) {
+        return glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    }
+    const uint32_t key = seek(times, count, time, cursor);
+    if (key + 1 >= count) {
+        return values[key];
+    }
+    return glm::normalize(glm::slerp(values[key], values[key + 1], blendFactor(times, key, time)));
+}
+
+void flatten(const aiNode* node, int32_t parent, Skeleton& skeleton) {
+    const int32_t index = static_cast<int32_t>(skeleton.parents.size());
+    skeleton.names.emplace_back(node->mName.data);
+    skeleton.parents.push_back(parent);
+    skeleton.restPose.push_back(toMat4(node->mTransformation));
+    for (uint32_t i = 0; i < node->mNumChildren; ++i) {
+        flatten(node->mChildren[i], index, skeleton);
+    }
+}
+
+}  // namespace
+
+int32_t Skeleton::find(const std::string& name) const {
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (names[i] == name) {
+            return static_cast<int32_t>(i);
+        }
+    }
+    return -1;
+}
+
+Skeleton vks::model::buildSkeleton(const aiNode* root) {
+    Skeleton skeleton;
+    if (root) {
+        flatten(root, -1, skeleton);
+    }
+    return skeleton;
+}
+
+AnimationClip vks::model::bakeAnimation(const aiAnimation* animation, const Skeleton& skeleton) {
+    std::unordered_map<std::string, uint32_t> joints;
+    for (uint32_t i = 0; i < skeleton.jointCount(); ++i) {
+        joints.emplace(skeleton.names[i], i);
+    }
+
+    AnimationClip clip;
+    // Keys are in ticks, which some exporters leave undefined
+    const double ticksPerSecond = animation->mTicksPerSecond != 0.0 ? animation->mTicksPerSecond : 25.0;
+    const auto seconds = [&](double ticks) { return static_cast<float>(ticks / ticksPerSecond); };
+    clip.duration = seconds(animation->mDuration);
+    for (uint32_t c = 0; c < animation->mNumChannels; ++c) {
+        const aiNodeAnim* nodeAnim = animation->mChannels[c];
+        auto joint = joints.find(nodeAnim->mNodeName.data);
+        if (joint == joints.end()) {
+            continue;
+        }
+        AnimationClip::Channel channel;
+        channel.joint = joint->second;
+
+        channel.translation = KeyRange{ static_cast<uint32_t>(clip.translations.size()), nodeAnim->mNumPositionKeys };
+        for (uint32_t k = 0; k < nodeAnim->mNumPositionKeys; ++k) {
+            const auto& key = nodeAnim->mPositionKeys[k];
+            clip.translationTimes.push_back(seconds(key.mTime));
+            clip.translations.emplace_back(key.mValue.x, key.mValue.y, key.mValue.z);
+        }
+        channel.rotation = KeyRange{ static_cast<uint32_t>(clip.rotations.size()), nodeAnim->mNumRotationKeys };
+        for (uint32_t k = 0; k < nodeAnim->mNumRotationKeys; ++k) {
+            const auto& key = nodeAnim->mRotationKeys[k];
+            clip.rotationTimes.push_back(seconds(key.mTime));
+            clip.rotations.emplace_back(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z);
+        }
+        channel.scale = KeyRange{ static_cast<uint32_t>(clip.scales.size()), nodeAnim->mNumScalingKeys };
+        for (uint32_t k = 0; k < nodeAnim->mNumScalingKeys; ++k) {
+            const auto& key = nodeAnim->mScalingKeys[k];
+            clip.scaleTimes.push_back(seconds(key.mTime));
+            clip.scales.emplace_back(key.mValue.x, key.mValue.y, key.mValue.z);
+        }
+        clip.channels.push_back(channel);
+    }
+    return clip;
+}
+
+void vks::model::evaluate(const Skeleton& skeleton, const AnimationClip& clip, float time, AnimationState& state) {
+    const uint32_t jointCount = skeleton.jointCount();
+    state.cursors.resize(clip.channels.size() * 3, 0);
+    state.locals.resize(jointCount);
+    state.globals.resize(jointCount);
+    std::copy(skeleton.restPose.begin(), skeleton.restPose.end(), state.locals.begin());
+
+    time = clip.duration > 0.0f ? fmodf(time, clip.duration) : 0.0f;
+    if (time < 0.0f) {
+        time += clip.duration;
+    }
+    for (size_t c = 0; c < clip.channels.size(); ++c) {
+        const auto& channel = clip.channels[c];
+        uint32_t* cursors = state.cursors.data() + c * 3;
+        const glm::vec3 translation = sample(clip.translationTimes.data() + channel.translation.first, clip.translations.data() + channel.translation.first,
+                                             channel.translation.count, time, cursors[0], glm::vec3(0.0f));
+        const glm::quat rotation =
+            sample(clip.rotationTimes.data() + channel.rotation.first, clip.rotations.data() + channel.rotation.first, channel.rotation.count, time, cursors[1]);
+        const glm::vec3 scale = sample(clip.scaleTimes.data() + channel.scale.first, clip.scales.data() + channel.scale.first, channel.scale.count, time,
+                                       cursors[2], glm::vec3(1.0f));
+        state.locals[channel.joint] = compose(translation, rotation, scale);
+    }
+
+    // Parents come first, so their model space transforms are always ready
+    for (uint32_t i = 0; i < jointCount; ++i) {
+        const int32_t parent = skeleton.parents[i];
+        if (parent < 0) {
+            state.globals[i] = state.locals[i];
+        } else {
+            multiply(state.globals[parent], state.locals[i], state.globals[i]);
+        }
+    }
+}
+
+void vks::model::computeSkinMatrices(const Skin& skin, const AnimationState& state, glm::mat4* output) {
+    computeSkinMatrices(skin, state, glm::mat4(1.0f), output);
+}
+
+void vks::model::computeSkinMatrices(const Skin& skin, const AnimationState& state, const glm::mat4& transform, glm::mat4* output) {
+    glm::mat4 root;
+    multiply(transform, skin.rootInverse, root);
+    for (size_t bone = 0; bone < skin.joints.size(); ++bone) {
+        // Built on the stack, so `output` (possibly uncached mapped memory) is only ever written
+        glm::mat4 jointToBone;
+        multiply(state.globals[skin.joints[bone]], skin.inverseBindMatrices[bone], jointToBone);
+        multiply(root, jointToBone, jointToBone);
+        output[bone] = jointToBone;
+    }
+}
+
+void vks::model::evaluateBatch(TaskScheduler& scheduler,
+                               const Skeleton& skeleton,
+                               const Skin& skin,
+                               const AnimationInstance* instances,
+                               size_t count,
+                               size_t grainSize) {
+    scheduler.parallelFor(0, count, grainSize, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const auto& instance = instances[i];
+            evaluate(skeleton, *instance.clip, instance.time, *instance.state);
+            computeSkinMatrices(skin, *instance.state, instance.transform, instance.palette);
+        }
+    });
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+struct aiAnimation;
+struct aiNode;
+
+namespace vks {
+class TaskScheduler;
+namespace model {
+
+// Keyframe animation baked out of an Assimp scene at load time, so playback never touches the scene: node names
+// are resolved to joint indices once, keys are stored as flat arrays of times and values, and every instance keeps
+// the key each track was last sampled at, so sampling the next frame doesn't search the keys again.
+
+// The node hierarchy flattened so that every joint comes after its parent, which lets the model space transforms
+// be computed in a single pass
+struct Skeleton {
+    std::vector<std::string> names;
+    // -1 for the root
+    std::vector<int32_t> parents;
+    // Local transform of every joint, used for the joints a clip doesn't animate
+    std::vector<glm::mat4> restPose;
+
+    uint32_t jointCount() const { return static_cast<uint32_t>(parents.size()); }
+    // Index of the joint called `name`, or -1
+    int32_t find(const std::string& name) const;
+};
+
+Skeleton buildSkeleton(const aiNode* root);
+
+// The keys of one track of one channel, in the clip's key arrays
+struct KeyRange {
+    uint32_t first{ 0 };
+    uint32_t count{ 0 };
+};
+
+struct AnimationClip {
+    // Seconds
+    float duration{ 0.0f };
+
+    struct Channel {
+        uint32_t joint;
+        KeyRange translation;
+        KeyRange rotation;
+        KeyRange scale;
+    };
+    std::vector<Channel> channels;
+
+    // Key times in seconds and the matching values, the keys of each track are consecutive
+    std::vector<float> translationTimes;
+    std::vector<glm::vec3> translations;
+    std::vector<float> rotationTimes;
+    std::vector<glm::quat> rotations;
+    std::vector<float> scaleTimes;
+    std::vector<glm::vec3> scales;
+};
+
+// Channels for nodes that aren't in `skeleton` are dropped
+AnimationClip bakeAnimation(const aiAnimation* animation, const Skeleton& skeleton);
+
+// Playback state of one animated instance.  Clips and skeletons are immutable and can be shared by any number of
+// instances, each with its own AnimationState
+struct AnimationState {
+    // The key each translation, rotation and scale track was last sampled at, three per channel
+    std::vector<uint32_t> cursors;
+    std::vector<glm::mat4> locals;
+    // Model space transform of every joint
+    std::vector<glm::mat4> globals;
+};
+
+// Sample `clip` at `time` seconds, wrapped to the clip's duration, and update the joint transforms of `state`.
+// Sampling is cheapest when time moves forward in small steps, as the cursors then advance by a key at most.
+void evaluate(const Skeleton& skeleton, const AnimationClip& clip, float time, AnimationState& state);
+
+// Maps the bones the vertices are weighted to onto skeleton joints
+struct Skin {
+    std::vector<uint32_t> joints;
+    // Model space to bone space, per bone
+    std::vector<glm::mat4> inverseBindMatrices;
+    // Applied after the joint transforms, usually the inverse of the scene root transform
+    glm::mat4 rootInverse{ 1.0f };
+};
+
+// Write one skinning matrix per bone of `skin` to `output`, optionally followed by `transform` to place the instance
+void computeSkinMatrices(const Skin& skin, const AnimationState& state, glm::mat4* output);
+void computeSkinMatrices(const Skin& skin, const AnimationState& state, const glm::mat4& transform, glm::mat4* output);
+
+// One character of a crowd sharing a skeleton and skin, see evaluateBatch
+struct AnimationInstance {
+    const AnimationClip* clip{ nullptr };
+    // Seconds
+    float time{ 0.0f };
+    AnimationState* state{ nullptr };
+    glm::mat4 transform{ 1.0f };
+    // Receives skin.joints.size() matrices, typically the instance's slice of a mapped palette buffer
+    glm::mat4* palette{ nullptr };
+};
+
+// evaluate and computeSkinMatrices for every instance, spread over `scheduler` in groups of `grainSize`.
+// Instances must not share states or palettes.  Returns once they are all done.
+void evaluateBatch(TaskScheduler& scheduler,
+                   const Skeleton& skeleton,
+                   const Skin& skin,
+                   const AnimationInstance* instances,
+                   size_t count,
+                   size_t grainSize = 4);
+
+}}  // namespace vks::model
@@ -0,0 +1,246 @@
+#include "assets.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <glm/gtc/packing.hpp>
+
+#include "context.hpp"
+#include "scheduler.hpp"
+#include "threadpool.hpp"
+
+using namespace vks;
+
+namespace {
+
+// Shown in place of every texture that is still loading
+const uint32_t PLACEHOLDER_TEXEL = 0xFF808080;
+const glm::vec3 PLACEHOLDER_COLOR{ 0.5f };
+
+}  // namespace
+
+AssetManager::AssetManager() = default;
+
+AssetManager::~AssetManager() {
+    destroy();
+}
+
+void AssetManager::create(const vks::Context& context, size_t threadCount) {
+    destroy();
+    this->context = &context;
+    this->threadCount = threadCount;
+}
+
+void AssetManager::destroy() {
+    for (auto& load : pending) {
+        if (!load.returned) {
+            load.future.wait();
+        }
+    }
+    pending.clear();
+    workers.reset();
+    scheduler.reset();
+    for (auto& slot : textures) {
+        slot->resource.destroy();
+    }
+    textures.clear();
+    for (auto& slot : models) {
+        slot->resource.destroy();
+        slot->ownPlaceholder.destroy();
+    }
+    models.clear();
+    placeholderTexture.destroy();
+    loaded = 0;
+    context = nullptr;
+}
+
+TextureAsset AssetManager::loadTexture2D(const std::string& filename, vk::Format format, vk::ImageUsageFlags imageUsageFlags) {
+    if (!placeholderTexture.image) {
+        uint32_t texel = PLACEHOLDER_TEXEL;
+        placeholderTexture.fromBuffer(*context, &texel, sizeof(texel), vk::Format::eR8G8B8A8Unorm, vk::Extent2D{ 1, 1 });
+    }
+    auto slot = std::make_shared<TextureAsset::Slot>();
+    slot->placeholder = &placeholderTexture;
+    textures.push_back(slot);
+
+    const vks::Context& context = *this->context;
+    Load load;
+    load.ticket = [slot] { return slot->resource.uploadTicket; };
+    load.swap = [slot] { slot->ready = true; };
+    queue([&context, slot, filename, format, imageUsageFlags] { slot->resource.loadFromFile(context, filename, format, imageUsageFlags); },
+          std::move(load));
+    return TextureAsset(slot);
+}
+
+ModelAsset AssetManager::loadModel(const std::string& filename,
+                                   const model::VertexLayout& layout,
+                                   const model::ModelCreateInfo& createInfo,
+                                   const model::Model::Dimension& bounds) {
+    auto slot = std::make_shared<ModelAsset::Slot>();
+    glm::vec3 min = bounds.min;
+    glm::vec3 max = bounds.max;
+    if (glm::any(glm::greaterThan(min, max))) {
+        min = glm::min(createInfo.scale * -0.5f, createInfo.scale * 0.5f) + createInfo.center;
+        max = glm::max(createInfo.scale * -0.5f, createInfo.scale * 0.5f) + createInfo.center;
+    }
+    slot->ownPlaceholder.scale = createInfo.scale;
+    slot->ownPlaceholder.uvscale = createInfo.uvscale;
+    slot->ownPlaceholder.center = createInfo.center;
+    buildBox(slot->ownPlaceholder, layout, min, max, createInfo.positionStream);
+    slot->placeholder = &slot->ownPlaceholder;
+    models.push_back(slot);
+
+    const vks::Context& context = *this->context;
+    Load load;
+    load.ticket = [slot] { return slot->resource.uploadTicket; };
+    load.swap = [&context, slot] {
+        slot->ready = true;
+        // Frames in flight may still draw the box
+        context.trash(slot->ownPlaceholder.vertices);
+        context.trash(slot->ownPlaceholder.indices);
+        if (slot->ownPlaceholder.positions) {
+            context.trash(slot->ownPlaceholder.positions);
+        }
+        slot->ownPlaceholder.vertices = vks::Buffer();
+        slot->ownPlaceholder.indices = vks::Buffer();
+        slot->ownPlaceholder.positions = vks::Buffer();
+    };
+    model::ModelCreateInfo loadCreateInfo = createInfo;
+    if (!loadCreateInfo.scheduler) {
+        if (!scheduler) {
+            scheduler.reset(new TaskScheduler(std::max<size_t>(2, TaskScheduler::defaultThreadCount() / 2)));
+        }
+        loadCreateInfo.scheduler = scheduler.get();
+    }
+    queue([&context, slot, filename, layout, loadCreateInfo] { slot->resource.loadFromFile(context, filename, layout, loadCreateInfo); },
+          std::move(load));
+    return ModelAsset(slot);
+}
+
+bool AssetManager::update() {
+    bool swapped = false;
+    for (auto itr = pending.begin(); itr != pending.end();) {
+        auto& load = *itr;
+        if (!load.returned) {
+            if (load.future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                ++itr;
+                continue;
+            }
+            load.returned = true;
+            try {
+                load.future.get();
+            } catch (...) {
+                pending.erase(itr);
+                throw;
+            }
+        }
+        // Uploads in the graphics queue batch are submitted ahead of the next frame, transfer queue batches once
+        // they've been acquired
+        if (!context->isUploadComplete(load.ticket())) {
+            ++itr;
+            continue;
+        }
+        load.swap();
+        ++loaded;
+        swapped = true;
+        itr = pending.erase(itr);
+    }
+    return swapped;
+}
+
+void AssetManager::queue(std::function<void()>&& job, Load&& load) {
+    if (!workers) {
+        workers.reset(new ThreadPool(threadCount));
+    }
+    const vks::Context& context = *this->context;
+    load.future = workers->submit([&context, job] {
+        Context::ScopedBackgroundUploads backgroundUploads(context);
+        job();
+    });
+    pending.push_back(std::move(load));
+}
+
+// Four vertices per face, so every face has its own normal, and the components without a meaning for a box left at 0
+void AssetManager::buildBox(model::Model& box,
+                            const model::VertexLayout& layout,
+                            const glm::vec3& min,
+                            const glm::vec3& max,
+                            bool positionStream) const {
+    const uint32_t FACE_COUNT = 6;
+    const size_t stride = layout.stride();
+    std::vector<uint8_t> vertices(FACE_COUNT * 4 * stride);
+    std::vector<uint16_t> indices;
+    const glm::vec3 center = (min + max) * 0.5f;
+    const glm::vec3 extent = (max - min) * 0.5f;
+    const glm::vec2 corners[4] = { { -1.0f, -1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f }, { -1.0f, 1.0f } };
+    for (uint32_t face = 0; face < FACE_COUNT; ++face) {
+        const uint32_t axis = face / 2;
+        const float side = face % 2 ? 1.0f : -1.0f;
+        glm::vec3 normal{ 0.0f };
+        normal[axis] = side;
+        const uint16_t base = (uint16_t)(face * 4);
+        for (uint32_t corner = 0; corner < 4; ++corner) {
+            glm::vec3 position = normal;
+            position[(axis + 1) % 3] = corners[corner].x;
+            position[(axis + 2) % 3] = corners[corner].y;
+            position = center + position * extent;
+            const glm::vec2 uv = corners[corner] * 0.5f + 0.5f;
+            uint8_t* vertex = vertices.data() + (base + corner) * stride;
+            for (uint32_t componentIndex = 0; componentIndex < layout.components.size(); ++componentIndex) {
+                uint8_t* out = vertex + layout.offset(componentIndex);
+                uint32_t packed = 0;
+                switch (layout.components[componentIndex]) {
+                    case model::VERTEX_COMPONENT_POSITION:
+                        memcpy(out, &position, sizeof(position));
+                        break;
+                    case model::VERTEX_COMPONENT_NORMAL:
+                        memcpy(out, &normal, sizeof(normal));
+                        break;
+                    case model::VERTEX_COMPONENT_NORMAL_PACKED:
+                        packed = glm::packSnorm3x10_1x2(glm::vec4{ normal, 0.0f });
+                        memcpy(out, &packed, sizeof(packed));
+                        break;
+                    case model::VERTEX_COMPONENT_UV:
+                        memcpy(out, &uv, sizeof(uv));
+                        break;
+                    case model::VERTEX_COMPONENT_UV_HALF:
+                        packed = glm::packHalf2x16(uv);
+                        memcpy(out, &packed, sizeof(packed));
+                        break;
+                    case model::VERTEX_COMPONENT_COLOR:
+                        memcpy(out, &PLACEHOLDER_COLOR, sizeof(PLACEHOLDER_COLOR));
+                        break;
+                    case model::VERTEX_COMPONENT_COLOR_UNORM8:
+                        packed = glm::packUnorm4x8(glm::vec4{ PLACEHOLDER_COLOR, 1.0f });
+                        memcpy(out, &packed, sizeof(packed));
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+        // Clockwise seen from outside, like the loaded models once their y is flipped
+        const uint16_t quad[6] = { 0, 2, 1, 2, 0, 3 };
+        const uint16_t flipped[6] = { 0, 1, 2, 2, 3, 0 };
+        for (uint32_t i = 0; i < 6; ++i) {
+            indices.push_back(base + (side > 0.0f ? quad[i] : flipped[i]));
+        }
+    }
+
+    box.device = context->device;
+    box.layout = layout;
+    box.vertexCount = FACE_COUNT * 4;
+    box.indexCount = (uint32_t)indices.size();
+    box.indexType = vk::IndexType::eUint16;
+    box.dim.min = min;
+    box.dim.max = max;
+    box.dim.size = max - min;
+    box.parts = { { "placeholder", 0, box.vertexCount, 0, box.indexCount, 0, 0, 0, 1 } };
+    box.lods = { { 0, box.indexCount, 0.0f, 0, 0 } };
+    box.vertices = context->stageToDeviceBuffer(box.vertexUsage, vertices);
+    box.indices = context->stageToDeviceBuffer(box.indexUsage, indices);
+    if (positionStream) {
+        box.stagePositions(*context, vertices.data());
+    }
+}
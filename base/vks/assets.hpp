@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "forward.hpp"
+#include "model.hpp"
+#include "texture.hpp"
+
+namespace vks {
+
+class ThreadPool;
+class TaskScheduler;
+class AssetManager;
+
+// One asset of an AssetManager, owned by the manager
+template <typename T>
+class AssetHandle {
+public:
+    AssetHandle() = default;
+
+    // The asset once it has been swapped in, the placeholder before
+    const T& get() const { return slot->ready ? slot->resource : *slot->placeholder; }
+    const T& operator*() const { return get(); }
+    const T* operator->() const { return &get(); }
+
+    bool ready() const { return slot && slot->ready; }
+    explicit operator bool() const { return (bool)slot; }
+
+private:
+    friend class AssetManager;
+
+    struct Slot {
+        T resource;
+        // Models have a placeholder of their own, the textures all share the manager's
+        T ownPlaceholder;
+        const T* placeholder{ nullptr };
+        // Only changed by AssetManager::update, on the thread that renders
+        bool ready{ false };
+    };
+
+    explicit AssetHandle(const std::shared_ptr<Slot>& slot)
+        : slot(slot) {}
+
+    std::shared_ptr<Slot> slot;
+};
+
+using TextureAsset = AssetHandle<texture::Texture2D>;
+using ModelAsset = AssetHandle<model::Model>;
+
+// Loads textures and models in the background, so that an example shows its first frames before its assets are
+// resident.
+//
+// The load functions return a handle at once, whose get() is a placeholder until the asset is ready: a 1x1 texture,
+// or a box with the vertex layout of the model.  The usual loaders run on the manager's threads, under a
+// Context::ScopedBackgroundUploads, and record their uploads into the context's batches like any other load, or the
+// transfer queue with Context::asyncUploads.  update() swaps in every asset whose loader has returned and whose uploads
+// have been submitted, so the swap always happens between frames, on the thread that renders.  Descriptor sets and
+// command buffers may still refer to the placeholders then, which is why ExampleBase waits for the device after an
+// update that swapped anything in and calls ExampleBase::assetsLoaded.
+//
+// Exceptions thrown by the loaders are rethrown from update().
+class AssetManager {
+public:
+    AssetManager();
+    ~AssetManager();
+
+    // The threads are only started by the first load
+    void create(const vks::Context& context, size_t threadCount = 2);
+    // Waits for the loads still running, the device must be done with the assets
+    void destroy();
+
+    // See Texture2D::loadFromFile
+    TextureAsset loadTexture2D(const std::string& filename,
+                               vk::Format format = vk::Format::eR8G8B8A8Unorm,
+                               vk::ImageUsageFlags imageUsageFlags = vk::ImageUsageFlagBits::eSampled);
+
+    // See Model::loadFromFile.  `bounds` is where the placeholder box goes, by default the unit box around the origin,
+    // scaled and moved like the model's vertices.  Without a ModelCreateInfo::scheduler the parts are packed on a
+    // scheduler of the manager's, so that the rendering thread never helps out with them while it waits for its own.
+    ModelAsset loadModel(const std::string& filename,
+                         const model::VertexLayout& layout,
+                         const model::ModelCreateInfo& createInfo,
+                         const model::Model::Dimension& bounds = {});
+
+    // Swap in the assets that are ready, returning whether there were any
+    bool update();
+
+    // Loads that haven't been swapped in yet
+    size_t pendingCount() const { return pending.size(); }
+    size_t loadedCount() const { return loaded; }
+
+    operator bool() const { return context != nullptr; }
+
+private:
+    struct Load {
+        std::future<void> future;
+        bool returned{ false };
+        std::function<UploadTicket()> ticket;
+        std::function<void()> swap;
+    };
+
+    void queue(std::function<void()>&& job, Load&& load);
+    void buildBox(model::Model& box, const model::VertexLayout& layout, const glm::vec3& min, const glm::vec3& max, bool positionStream) const;
+
+    const vks::Context* context{ nullptr };
+    size_t threadCount{ 0 };
+    std::unique_ptr<ThreadPool> workers;
+    std::unique_ptr<TaskScheduler> scheduler;
+    std::list<Load> pending;
+    size_t loaded{ 0 };
+    texture::Texture2D placeholderTexture;
+    std::vector<std::shared_ptr<TextureAsset::Slot>> textures;
+    std::vector<std::shared_ptr<ModelAsset::Slot>> models;
+};
+
+}  // namespace vks
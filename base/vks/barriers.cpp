@@ -0,0 +1,262 @@
+#include "barriers.hpp"
+
+#include <stdexcept>
+
+#include "context.hpp"
+
+using namespace vks;
+
+namespace {
+
+using Stage = vk::PipelineStageFlagBits2KHR;
+using Access = vk::AccessFlagBits2KHR;
+
+const vk::AccessFlags2KHR WRITE_ACCESS{ Access::eTransferWrite | Access::eColorAttachmentWrite | Access::eDepthStencilAttachmentWrite |
+                                        Access::eShaderWrite | Access::eShaderStorageWrite | Access::eHostWrite | Access::eMemoryWrite };
+
+bool isDepthStencil(vk::Format format) {
+    switch (format) {
+        case vk::Format::eD16Unorm:
+        case vk::Format::eX8D24UnormPack32:
+        case vk::Format::eD32Sfloat:
+        case vk::Format::eS8Uint:
+        case vk::Format::eD16UnormS8Uint:
+        case vk::Format::eD24UnormS8Uint:
+        case vk::Format::eD32SfloatS8Uint:
+            return true;
+        default:
+            return false;
+    }
+}
+
+vk::ImageAspectFlags aspectOf(vk::Format format) {
+    switch (format) {
+        case vk::Format::eS8Uint:
+            return vk::ImageAspectFlagBits::eStencil;
+        case vk::Format::eD16UnormS8Uint:
+        case vk::Format::eD24UnormS8Uint:
+        case vk::Format::eD32SfloatS8Uint:
+            return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+        default:
+            return isDepthStencil(format) ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
+    }
+}
+
+// The stages and accesses of an ImageAccess are all ones vkCmdPipelineBarrier has too, at the same bits, except for
+// the split shader reads and writes
+vk::PipelineStageFlags legacyStages(const vk::PipelineStageFlags2KHR& stages) {
+    return vk::PipelineStageFlags(static_cast<VkPipelineStageFlags>(static_cast<VkPipelineStageFlags2KHR>(stages)));
+}
+
+vk::AccessFlags legacyAccess(const vk::AccessFlags2KHR& access) {
+    vk::AccessFlags result(static_cast<VkAccessFlags>(static_cast<VkAccessFlags2KHR>(access) & 0xFFFFFFFFull));
+    if (access & (Access::eShaderSampledRead | Access::eShaderStorageRead)) {
+        result |= vk::AccessFlagBits::eShaderRead;
+    }
+    if (access & Access::eShaderStorageWrite) {
+        result |= vk::AccessFlagBits::eShaderWrite;
+    }
+    return result;
+}
+
+// The state after `access`, once whatever it needed has been waited for
+void update(ImageSubresourceState& state, const ImageAccess& access) {
+    state.layout = access.layout;
+    state.writeStages = access.stages;
+    state.writeAccess = access.write ? access.access & WRITE_ACCESS : vk::AccessFlags2KHR();
+    state.readStages = access.write ? vk::PipelineStageFlags2KHR() : access.stages;
+    state.visibleStages = access.stages;
+    state.visibleAccess = access.access;
+}
+
+vk::ImageSubresourceRange wholeImage(const vks::Image& image) {
+    return vk::ImageSubresourceRange{ aspectOf(image.format), 0, image.mipLevels, 0, image.arrayLayers };
+}
+
+void ensureStates(vks::Image& image) {
+    const size_t count = (size_t)image.mipLevels * image.arrayLayers;
+    if (image.subresourceStates.size() != count) {
+        image.subresourceStates.assign(count, ImageSubresourceState{});
+    }
+}
+
+bool sameDependency(const vk::ImageMemoryBarrier2KHR& a, const vk::ImageMemoryBarrier2KHR& b) {
+    return a.image == b.image && a.oldLayout == b.oldLayout && a.newLayout == b.newLayout && a.srcStageMask == b.srcStageMask &&
+           a.srcAccessMask == b.srcAccessMask && a.dstStageMask == b.dstStageMask && a.dstAccessMask == b.dstAccessMask;
+}
+
+}  // namespace
+
+ImageAccess vks::imageAccess(ImageUsage usage, vk::Format format) {
+    const vk::ImageLayout sampledLayout = isDepthStencil(format) ? vk::ImageLayout::eDepthStencilReadOnlyOptimal : vk::ImageLayout::eShaderReadOnlyOptimal;
+    const vk::PipelineStageFlags2KHR depthTests{ Stage::eEarlyFragmentTests | Stage::eLateFragmentTests };
+    switch (usage) {
+        case ImageUsage::TransferSrc:
+            return { vk::ImageLayout::eTransferSrcOptimal, Stage::eTransfer, Access::eTransferRead, false };
+        case ImageUsage::TransferDst:
+            return { vk::ImageLayout::eTransferDstOptimal, Stage::eTransfer, Access::eTransferWrite, true };
+        case ImageUsage::ColorAttachment:
+            return { vk::ImageLayout::eColorAttachmentOptimal, Stage::eColorAttachmentOutput,
+                     Access::eColorAttachmentRead | Access::eColorAttachmentWrite, true };
+        case ImageUsage::DepthStencilAttachment:
+            return { vk::ImageLayout::eDepthStencilAttachmentOptimal, depthTests,
+                     Access::eDepthStencilAttachmentRead | Access::eDepthStencilAttachmentWrite, true };
+        case ImageUsage::DepthStencilReadOnly:
+            return { vk::ImageLayout::eDepthStencilReadOnlyOptimal, depthTests, Access::eDepthStencilAttachmentRead, false };
+        case ImageUsage::FragmentSampled:
+            return { sampledLayout, Stage::eFragmentShader, Access::eShaderSampledRead, false };
+        case ImageUsage::ComputeSampled:
+            return { sampledLayout, Stage::eComputeShader, Access::eShaderSampledRead, false };
+        case ImageUsage::ComputeStorageRead:
+            return { vk::ImageLayout::eGeneral, Stage::eComputeShader, Access::eShaderStorageRead, false };
+        case ImageUsage::ComputeStorageWrite:
+            return { vk::ImageLayout::eGeneral, Stage::eComputeShader, Access::eShaderStorageWrite, true };
+        case ImageUsage::ComputeStorageReadWrite:
+            return { vk::ImageLayout::eGeneral, Stage::eComputeShader, Access::eShaderStorageRead | Access::eShaderStorageWrite, true };
+        case ImageUsage::Present:
+            return { vk::ImageLayout::ePresentSrcKHR, vk::PipelineStageFlags2KHR(), vk::AccessFlags2KHR(), false };
+    }
+    throw std::runtime_error("Unknown image usage");
+}
+
+Barriers& Barriers::image(vks::Image& image, ImageUsage usage, bool discard) {
+    return this->image(image, usage, wholeImage(image), discard);
+}
+
+Barriers& Barriers::image(vks::Image& image, ImageUsage usage, const vk::ImageSubresourceRange& range, bool discard) {
+    ensureStates(image);
+    const ImageAccess access = imageAccess(usage, image.format);
+    const uint32_t levelCount = range.levelCount == VK_REMAINING_MIP_LEVELS ? image.mipLevels - range.baseMipLevel : range.levelCount;
+    const uint32_t layerCount = range.layerCount == VK_REMAINING_ARRAY_LAYERS ? image.arrayLayers - range.baseArrayLayer : range.layerCount;
+    for (uint32_t layer = range.baseArrayLayer; layer < range.baseArrayLayer + layerCount; ++layer) {
+        for (uint32_t level = range.baseMipLevel; level < range.baseMipLevel + levelCount; ++level) {
+            transition(image, access, layer, level, discard);
+        }
+        // Layers that need the same barriers for the same levels share them
+        const size_t count = imageBarriers.size();
+        if (count >= 2) {
+            auto& previous = imageBarriers[count - 2];
+            const auto& last = imageBarriers[count - 1];
+            const auto& previousRange = previous.subresourceRange;
+            const auto& lastRange = last.subresourceRange;
+            if (sameDependency(previous, last) && previousRange.baseMipLevel == lastRange.baseMipLevel &&
+                previousRange.levelCount == lastRange.levelCount && lastRange.layerCount == 1 &&
+                previousRange.baseArrayLayer + previousRange.layerCount == lastRange.baseArrayLayer) {
+                ++previous.subresourceRange.layerCount;
+                imageBarriers.pop_back();
+            }
+        }
+    }
+    return *this;
+}
+
+void Barriers::transition(vks::Image& image, const ImageAccess& access, uint32_t layer, uint32_t level, bool discard) {
+    auto& state = image.subresourceStates[(size_t)layer * image.mipLevels + level];
+    const vk::ImageLayout oldLayout = discard ? vk::ImageLayout::eUndefined : state.layout;
+    vk::PipelineStageFlags2KHR srcStages;
+    vk::AccessFlags2KHR srcAccess;
+    if (oldLayout != access.layout || access.write) {
+        // Writes, and layout transitions, which are writes too, have to wait for the reads since the last write as well
+        srcStages = state.writeStages | state.readStages;
+        srcAccess = state.writeAccess;
+        update(state, access);
+    } else {
+        // Reads only wait for the last write, unless something that already waited covers them
+        if ((access.stages & ~state.visibleStages) || (access.access & ~state.visibleAccess)) {
+            srcStages = state.writeStages;
+            srcAccess = state.writeAccess;
+            state.visibleStages |= access.stages;
+            state.visibleAccess |= access.access;
+        }
+        state.readStages |= access.stages;
+    }
+    if (oldLayout == access.layout && !srcStages) {
+        return;
+    }
+
+    vk::ImageMemoryBarrier2KHR barrier;
+    barrier.srcStageMask = srcStages;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstStageMask = access.stages;
+    barrier.dstAccessMask = access.access;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = access.layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image.image;
+    barrier.subresourceRange = vk::ImageSubresourceRange{ aspectOf(image.format), level, 1, layer, 1 };
+    // Consecutive levels of a layer that need the same barrier share it
+    if (!imageBarriers.empty()) {
+        auto& last = imageBarriers.back();
+        const auto& lastRange = last.subresourceRange;
+        if (sameDependency(last, barrier) && lastRange.layerCount == 1 && lastRange.baseArrayLayer == layer &&
+            lastRange.baseMipLevel + lastRange.levelCount == level) {
+            ++last.subresourceRange.levelCount;
+            return;
+        }
+    }
+    imageBarriers.push_back(barrier);
+}
+
+Barriers& Barriers::memory(const vk::PipelineStageFlags2KHR& srcStages,
+                           const vk::AccessFlags2KHR& srcAccess,
+                           const vk::PipelineStageFlags2KHR& dstStages,
+                           const vk::AccessFlags2KHR& dstAccess) {
+    memoryBarriers.push_back(vk::MemoryBarrier2KHR{ srcStages, srcAccess, dstStages, dstAccess });
+    return *this;
+}
+
+void Barriers::assume(vks::Image& image, ImageUsage usage, const vk::ImageSubresourceRange& range) {
+    ensureStates(image);
+    const ImageAccess access = imageAccess(usage, image.format);
+    const uint32_t levelCount = range.levelCount == VK_REMAINING_MIP_LEVELS ? image.mipLevels - range.baseMipLevel : range.levelCount;
+    const uint32_t layerCount = range.layerCount == VK_REMAINING_ARRAY_LAYERS ? image.arrayLayers - range.baseArrayLayer : range.layerCount;
+    for (uint32_t layer = range.baseArrayLayer; layer < range.baseArrayLayer + layerCount; ++layer) {
+        for (uint32_t level = range.baseMipLevel; level < range.baseMipLevel + levelCount; ++level) {
+            update(image.subresourceStates[(size_t)layer * image.mipLevels + level], access);
+        }
+    }
+}
+
+void Barriers::assume(vks::Image& image, ImageUsage usage) {
+    assume(image, usage, wholeImage(image));
+}
+
+void Barriers::record(const vk::CommandBuffer& commandBuffer, const vks::Context& context) {
+    if (empty()) {
+        return;
+    }
+    if (context.synchronization2Enabled) {
+        vk::DependencyInfoKHR dependencyInfo;
+        dependencyInfo.memoryBarrierCount = (uint32_t)memoryBarriers.size();
+        dependencyInfo.pMemoryBarriers = memoryBarriers.data();
+        dependencyInfo.imageMemoryBarrierCount = (uint32_t)imageBarriers.size();
+        dependencyInfo.pImageMemoryBarriers = imageBarriers.data();
+        commandBuffer.pipelineBarrier2KHR(dependencyInfo, context.dynamicDispatch);
+    } else {
+        vk::PipelineStageFlags2KHR srcStages;
+        vk::PipelineStageFlags2KHR dstStages;
+        std::vector<vk::MemoryBarrier> memory;
+        memory.reserve(memoryBarriers.size());
+        for (const auto& barrier : memoryBarriers) {
+            srcStages |= barrier.srcStageMask;
+            dstStages |= barrier.dstStageMask;
+            memory.push_back(vk::MemoryBarrier{ legacyAccess(barrier.srcAccessMask), legacyAccess(barrier.dstAccessMask) });
+        }
+        std::vector<vk::ImageMemoryBarrier> images;
+        images.reserve(imageBarriers.size());
+        for (const auto& barrier : imageBarriers) {
+            srcStages |= barrier.srcStageMask;
+            dstStages |= barrier.dstStageMask;
+            images.push_back(vk::ImageMemoryBarrier{ legacyAccess(barrier.srcAccessMask), legacyAccess(barrier.dstAccessMask), barrier.oldLayout,
+                                                     barrier.newLayout, barrier.srcQueueFamilyIndex, barrier.dstQueueFamilyIndex, barrier.image,
+                                                     barrier.subresourceRange });
+        }
+        // Without synchronization2 neither side of a barrier can be empty
+        commandBuffer.pipelineBarrier(srcStages ? legacyStages(srcStages) : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe),
+                                      dstStages ? legacyStages(dstStages) : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eBottomOfPipe), {},
+                                      memory, nullptr, images);
+    }
+    memoryBarriers.clear();
+    imageBarriers.clear();
+}
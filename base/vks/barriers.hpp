@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "forward.hpp"
+#include "image.hpp"
+
+namespace vks {
+
+// What the commands after a barrier do with an image.  The layout, and the narrowest stages and accesses that
+// cover it, follow from that, see imageAccess.  Sampled depth and stencil images are in DepthStencilReadOnlyOptimal,
+// all other sampled images in ShaderReadOnlyOptimal.
+enum class ImageUsage {
+    TransferSrc,
+    TransferDst,
+    ColorAttachment,
+    DepthStencilAttachment,
+    // A depth stencil attachment with depth and stencil writes off
+    DepthStencilReadOnly,
+    FragmentSampled,
+    ComputeSampled,
+    ComputeStorageRead,
+    ComputeStorageWrite,
+    ComputeStorageReadWrite,
+    // Handed to the presentation engine, which the queue submission's semaphores already synchronize with
+    Present,
+};
+
+struct ImageAccess {
+    vk::ImageLayout layout{ vk::ImageLayout::eUndefined };
+    vk::PipelineStageFlags2KHR stages;
+    vk::AccessFlags2KHR access;
+    bool write{ false };
+};
+
+ImageAccess imageAccess(ImageUsage usage, vk::Format format = vk::Format::eUndefined);
+
+// Batches the barriers between what images were last used for, as tracked in their subresourceStates, and what
+// they're used for next, into one pipeline barrier.  Every transition waits on only the stages that last accessed
+// the subresources and makes visible only the accesses of the new usage, and reads of what is already visible to
+// them need no barrier at all, so transitions that would be redundant are dropped rather than recorded.
+//
+// The state is updated when a transition is added, not when it executes, so the barriers have to be recorded in
+// the order they were added, and the same subresource can only be transitioned once per batch.  Depth and stencil
+// aspects are tracked together.
+//
+// With Context::synchronization2Enabled the batch is recorded with vkCmdPipelineBarrier2KHR, keeping the stages of
+// each subresource separate, otherwise with one vkCmdPipelineBarrier for the union of them.
+class Barriers {
+public:
+    // Transition all of `image`.  With `discard` its contents don't have to be kept.
+    Barriers& image(vks::Image& image, ImageUsage usage, bool discard = false);
+    // Transition the levels and layers of `range`.  Its aspect mask is ignored.
+    Barriers& image(vks::Image& image, ImageUsage usage, const vk::ImageSubresourceRange& range, bool discard = false);
+    // A dependency on accesses to something that isn't tracked, such as an image used through a const reference
+    Barriers& memory(const vk::PipelineStageFlags2KHR& srcStages,
+                     const vk::AccessFlags2KHR& srcAccess,
+                     const vk::PipelineStageFlags2KHR& dstStages,
+                     const vk::AccessFlags2KHR& dstAccess);
+
+    // Take the subresources of `range` to be in use for `usage`, and already visible to it, after something other
+    // than a Barriers changed their layout, such as the final layout of a render pass
+    static void assume(vks::Image& image, ImageUsage usage, const vk::ImageSubresourceRange& range);
+    static void assume(vks::Image& image, ImageUsage usage);
+
+    bool empty() const { return imageBarriers.empty() && memoryBarriers.empty(); }
+    size_t size() const { return imageBarriers.size() + memoryBarriers.size(); }
+
+    // Records all of the batch, if anything, and clears it
+    void record(const vk::CommandBuffer& commandBuffer, const vks::Context& context);
+
+private:
+    void transition(vks::Image& image, const ImageAccess& access, uint32_t layer, uint32_t level, bool discard);
+
+    std::vector<vk::ImageMemoryBarrier2KHR> imageBarriers;
+    std::vector<vk::MemoryBarrier2KHR> memoryBarriers;
+};
+
+}  // namespace vks
@@ -0,0 +1,224 @@
+#include "basis.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <basisu/transcoder/basisu_transcoder.h>
+
+#include "context.hpp"
+#include "filesystem.hpp"
+#include "scheduler.hpp"
+
+using namespace vks;
+using namespace vks::texture;
+
+namespace {
+
+struct TranscodeTarget {
+    vk::Format vkFormat;
+    gli::format gliFormat;
+    basist::transcoder_texture_format basisFormat;
+};
+
+const TranscodeTarget TARGETS[] = {
+    { vk::Format::eBc7UnormBlock, gli::FORMAT_RGBA_BP_UNORM_BLOCK16, basist::transcoder_texture_format::cTFBC7_RGBA },
+    { vk::Format::eAstc4x4UnormBlock, gli::FORMAT_RGBA_ASTC_4X4_UNORM_BLOCK16, basist::transcoder_texture_format::cTFASTC_4x4_RGBA },
+    { vk::Format::eEtc2R8G8B8A8UnormBlock, gli::FORMAT_RGBA_ETC2_UNORM_BLOCK16, basist::transcoder_texture_format::cTFETC2_RGBA },
+    { vk::Format::eR8G8B8A8Unorm, gli::FORMAT_RGBA8_UNORM_PACK8, basist::transcoder_texture_format::cTFRGBA32 },
+};
+
+const TranscodeTarget& findTarget(vk::Format format) {
+    for (const auto& target : TARGETS) {
+        if (target.vkFormat == format) {
+            return target;
+        }
+    }
+    throw std::runtime_error("Basis files can't be transcoded to " + vk::to_string(format));
+}
+
+void initTranscoder() {
+    static std::once_flag once;
+    std::call_once(once, [] { basist::basisu_transcoder_init(); });
+}
+
+bool hasExtension(const std::string& filename, const std::string& extension) {
+    if (filename.size() < extension.size()) {
+        return false;
+    }
+    return std::equal(extension.rbegin(), extension.rend(), filename.rbegin(),
+                      [](char a, char b) { return a == std::tolower(static_cast<unsigned char>(b)); });
+}
+
+// One level of one layer and face
+struct Job {
+    uint32_t layer;
+    uint32_t face;
+    uint32_t level;
+};
+
+gli::target textureTarget(uint32_t layers, uint32_t faces) {
+    if (faces == 6) {
+        return layers > 1 ? gli::TARGET_CUBE_ARRAY : gli::TARGET_CUBE;
+    }
+    return layers > 1 ? gli::TARGET_2D_ARRAY : gli::TARGET_2D;
+}
+
+// Run `transcode` for every job across the scheduler.  The transcoders are only read once transcoding has started,
+// everything a transcode writes goes into the State, of which each range gets its own.
+template <typename State, typename F>
+void transcodeAll(const std::vector<Job>& jobs, const F& transcode) {
+    std::mutex errorMutex;
+    std::string error;
+    TaskScheduler::shared().parallelFor(0, jobs.size(), 1, [&](size_t begin, size_t end) {
+        State state;
+        for (size_t i = begin; i < end; ++i) {
+            if (!transcode(jobs[i], state)) {
+                std::unique_lock<std::mutex> lock(errorMutex);
+                error = "Failed to transcode level " + std::to_string(jobs[i].level) + " of layer " + std::to_string(jobs[i].layer);
+            }
+        }
+    });
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+}
+
+std::vector<Job> makeJobs(uint32_t layers, uint32_t faces, uint32_t levels) {
+    std::vector<Job> jobs;
+    jobs.reserve(layers * faces * levels);
+    // Largest levels first, so the scheduler isn't left waiting on one big level at the end
+    for (uint32_t level = 0; level < levels; ++level) {
+        for (uint32_t layer = 0; layer < layers; ++layer) {
+            for (uint32_t face = 0; face < faces; ++face) {
+                jobs.push_back({ layer, face, level });
+            }
+        }
+    }
+    return jobs;
+}
+
+// Where each image of a file goes
+using ImageDestination = std::function<uint8_t*(const Job& job)>;
+// Transcodes every image of an opened file to where `destination` says
+using TranscodeTo = std::function<void(const ImageDestination& destination)>;
+// Called once a file is open, with the layout of its images once transcoded
+using Opened = std::function<void(const KtxLayout& layout, const TranscodeTo& transcode)>;
+
+void openKtx2(const void* data, size_t size, const TranscodeTarget& target, size_t alignment, const Opened& opened) {
+    basist::ktx2_transcoder transcoder;
+    if (!transcoder.init(data, (uint32_t)size) || !transcoder.start_transcoding()) {
+        throw std::runtime_error("Invalid or unsupported KTX2 file");
+    }
+    // Non-array textures report zero layers
+    const uint32_t layers = std::max(transcoder.get_layers(), 1u);
+    const KtxLayout layout = packedKtxLayout(target.gliFormat, transcoder.get_width(), transcoder.get_height(), layers, transcoder.get_faces(),
+                                             transcoder.get_levels(), alignment);
+    const uint32_t unitSize = basist::basis_get_bytes_per_block_or_pixel(target.basisFormat);
+    opened(layout, [&](const ImageDestination& destination) {
+        const auto jobs = makeJobs(layout.layers, layout.faces, layout.levels);
+        transcodeAll<basist::ktx2_transcoder_state>(jobs, [&](const Job& job, basist::ktx2_transcoder_state& state) {
+            const uint32_t units = (uint32_t)(layout.imageSizes[job.level] / unitSize);
+            return transcoder.transcode_image_level(job.level, job.layer, job.face, destination(job), units, target.basisFormat, 0, 0, 0, -1, -1, &state);
+        });
+    });
+}
+
+void openBasisFile(const void* data, size_t size, const TranscodeTarget& target, size_t alignment, const Opened& opened) {
+    basist::basisu_transcoder transcoder;
+    basist::basisu_file_info fileInfo;
+    if (!transcoder.validate_header(data, (uint32_t)size) || !transcoder.get_file_info(data, (uint32_t)size, fileInfo) ||
+        fileInfo.m_total_images == 0) {
+        throw std::runtime_error("Invalid Basis file");
+    }
+    // Cube maps are stored as images of six consecutive faces
+    const bool cube = fileInfo.m_tex_type == basist::cBASISTexTypeCubemapArray;
+    if (!cube && fileInfo.m_tex_type != basist::cBASISTexType2D && fileInfo.m_tex_type != basist::cBASISTexType2DArray) {
+        throw std::runtime_error("Only 2D, 2D array and cube map Basis files are supported");
+    }
+    const uint32_t faces = cube ? 6 : 1;
+    const uint32_t layers = fileInfo.m_total_images / faces;
+    basist::basisu_image_info imageInfo;
+    transcoder.get_image_info(data, (uint32_t)size, imageInfo, 0);
+    // Every image of an array has to have the same dimensions and mip count
+    const uint32_t levels = *std::min_element(fileInfo.m_image_mipmap_levels.begin(), fileInfo.m_image_mipmap_levels.end());
+    if (!transcoder.start_transcoding(data, (uint32_t)size)) {
+        throw std::runtime_error("Invalid Basis file");
+    }
+    const KtxLayout layout = packedKtxLayout(target.gliFormat, imageInfo.m_orig_width, imageInfo.m_orig_height, layers, faces, levels, alignment);
+    const uint32_t unitSize = basist::basis_get_bytes_per_block_or_pixel(target.basisFormat);
+    opened(layout, [&](const ImageDestination& destination) {
+        transcodeAll<basist::basisu_transcoder_state>(makeJobs(layers, faces, levels), [&](const Job& job, basist::basisu_transcoder_state& state) {
+            const uint32_t units = (uint32_t)(layout.imageSizes[job.level] / unitSize);
+            return transcoder.transcode_image_level(data, (uint32_t)size, job.layer * faces + job.face, job.level, destination(job), units,
+                                                    target.basisFormat, 0, 0, &state);
+        });
+    });
+}
+
+void openBasis(const std::string& filename, vk::Format format, size_t alignment, const Opened& opened) {
+    initTranscoder();
+    const TranscodeTarget& target = findTarget(format);
+    vks::file::withBinaryFileContents(filename, [&](size_t size, const void* data) {
+        if (hasExtension(filename, ".ktx2")) {
+            openKtx2(data, size, target, alignment, opened);
+        } else {
+            openBasisFile(data, size, target, alignment, opened);
+        }
+    });
+}
+
+}  // namespace
+
+bool vks::texture::isBasisFile(const std::string& filename) {
+    return hasExtension(filename, ".basis") || hasExtension(filename, ".ktx2");
+}
+
+vk::Format vks::texture::basisTranscodeFormat(const vks::Context& context) {
+    vk::Format format = vk::Format::eR8G8B8A8Unorm;
+    if (context.enabledFeatures.textureCompressionBC) {
+        format = vk::Format::eBc7UnormBlock;
+    } else if (context.enabledFeatures.textureCompressionASTC_LDR) {
+        format = vk::Format::eAstc4x4UnormBlock;
+    } else if (context.enabledFeatures.textureCompressionETC2) {
+        format = vk::Format::eEtc2R8G8B8A8UnormBlock;
+    }
+    // The compression features only promise that some formats of each family are supported
+    if (!(context.getFormatProperties(format).optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage)) {
+        format = vk::Format::eR8G8B8A8Unorm;
+    }
+    return format;
+}
+
+gli::texture vks::texture::loadBasis(const std::string& filename, vk::Format format) {
+    gli::texture result;
+    openBasis(filename, format, 1, [&](const KtxLayout& layout, const TranscodeTo& transcode) {
+        result = gli::texture(textureTarget(layout.layers, layout.faces), layout.format, gli::extent3d(layout.width, layout.height, 1), layout.layers,
+                              layout.faces, layout.levels);
+        transcode([&](const Job& job) { return static_cast<uint8_t*>(result.data(job.layer, job.face, job.level)); });
+    });
+    return result;
+}
+
+void vks::texture::transcodeBasis(const std::string& filename,
+                                  vk::Format format,
+                                  size_t alignment,
+                                  const std::function<void(const KtxLayout& layout, const BasisTranscode& transcode)>& stage) {
+    openBasis(filename, format, alignment, [&](const KtxLayout& layout, const TranscodeTo& transcode) {
+        stage(layout, [&](uint8_t* destination) {
+            transcode([&](const Job& job) { return destination + layout.offset(job.level, job.layer, job.face); });
+        });
+    });
+}
+
+gli::texture vks::texture::loadTexture(const vks::Context& context, const std::string& filename, vk::Format& format) {
+    if (isBasisFile(filename)) {
+        format = basisTranscodeFormat(context);
+        return loadBasis(filename, format);
+    }
+    gli::texture result;
+    vks::file::withBinaryFileContents(filename, [&](size_t size, const void* data) { result = gli::load((const char*)data, size); });
+    return result;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include <gli/gli.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "forward.hpp"
+#include "ktx.hpp"
+
+namespace vks { namespace texture {
+
+// Supercompressed textures.  Basis Universal (.basis) and KTX2 (.ktx2) files hold ETC1S or UASTC data that is
+// transcoded at load time into whichever block compressed format the device samples, so one file serves every GPU
+// at a fraction of the download and disk size of a pre-baked KTX.
+
+// True if `filename` has a .basis or .ktx2 extension
+bool isBasisFile(const std::string& filename);
+
+// The format Basis files are transcoded to on `context`'s device: BC7, ASTC 4x4 or ETC2, depending on which
+// compression feature ExampleBase enabled, and uncompressed RGBA8 if none of them is available.
+vk::Format basisTranscodeFormat(const vks::Context& context);
+
+// Transcode every level, layer and face of a .basis or .ktx2 file into a gli texture of `format`, which must be one
+// basisTranscodeFormat can return.  The images are transcoded in parallel on worker threads.  Throws
+// std::runtime_error for files the transcoder rejects.
+gli::texture loadBasis(const std::string& filename, vk::Format format);
+
+// Transcodes every image of an opened Basis file to `destination`, laid out as the KtxLayout it was opened with
+using BasisTranscode = std::function<void(uint8_t* destination)>;
+
+// Open a .basis or .ktx2 file and call `stage` with where its images go once transcoded to `format`, packed as
+// packedKtxLayout does with levels aligned to `alignment`, and the function that transcodes them there in parallel.
+// Lets the loaders transcode straight into staging memory.  The file is only open while `stage` runs.
+void transcodeBasis(const std::string& filename,
+                    vk::Format format,
+                    size_t alignment,
+                    const std::function<void(const KtxLayout& layout, const BasisTranscode& transcode)>& stage);
+
+// Load any texture file the loaders in texture.hpp accept.  Basis files are transcoded to basisTranscodeFormat,
+// which then replaces `format`, everything else is read with gli::load and keeps `format`.
+gli::texture loadTexture(const vks::Context& context, const std::string& filename, vk::Format& format);
+
+}}  // namespace vks::texture
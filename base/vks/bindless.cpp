@@ -0,0 +1,125 @@
+#include "bindless.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "context.hpp"
+
+using namespace vks;
+
+const uint32_t BindlessTable::INVALID_INDEX;
+
+uint32_t BindlessTable::Slots::allocate() {
+    if (!free.empty()) {
+        const uint32_t index = free.back();
+        free.pop_back();
+        return index;
+    }
+    if (next == capacity) {
+        throw std::runtime_error("Bindless descriptor table is full");
+    }
+    return next++;
+}
+
+void BindlessTable::create(const vks::Context& context, uint32_t maxTextures, uint32_t maxBuffers) {
+    this->context = &context;
+    const auto& device = context.device;
+
+    auto properties =
+        context.physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>(context.dynamicDispatch);
+    const auto& limits = properties.get<vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
+    textures = Slots{};
+    textures.capacity = std::min({ maxTextures, limits.maxDescriptorSetUpdateAfterBindSampledImages, limits.maxDescriptorSetUpdateAfterBindSamplers,
+                                   limits.maxPerStageDescriptorUpdateAfterBindSampledImages, limits.maxPerStageDescriptorUpdateAfterBindSamplers });
+    buffers = Slots{};
+    buffers.capacity =
+        std::min({ maxBuffers, limits.maxDescriptorSetUpdateAfterBindStorageBuffers, limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers });
+
+    std::vector<vk::DescriptorSetLayoutBinding> bindings{
+        vk::DescriptorSetLayoutBinding{ 0, vk::DescriptorType::eCombinedImageSampler, textures.capacity, vk::ShaderStageFlagBits::eAll },
+        vk::DescriptorSetLayoutBinding{ 1, vk::DescriptorType::eStorageBuffer, buffers.capacity, vk::ShaderStageFlagBits::eAll },
+    };
+    const vk::DescriptorBindingFlagsEXT bindingFlags = vk::DescriptorBindingFlagBitsEXT::ePartiallyBound |
+                                                       vk::DescriptorBindingFlagBitsEXT::eUpdateAfterBind |
+                                                       vk::DescriptorBindingFlagBitsEXT::eUpdateUnusedWhilePending;
+    std::vector<vk::DescriptorBindingFlagsEXT> flags(bindings.size(), bindingFlags);
+    vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT flagsCreateInfo{ static_cast<uint32_t>(flags.size()), flags.data() };
+    vk::DescriptorSetLayoutCreateInfo layoutCreateInfo{ vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT,
+                                                        static_cast<uint32_t>(bindings.size()), bindings.data() };
+    layoutCreateInfo.pNext = &flagsCreateInfo;
+    descriptorSetLayout = device.createDescriptorSetLayout(layoutCreateInfo);
+
+    std::vector<vk::DescriptorPoolSize> poolSizes{
+        vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, textures.capacity },
+        vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, buffers.capacity },
+    };
+    descriptorPool = device.createDescriptorPool(
+        vk::DescriptorPoolCreateInfo{ vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT, 1, static_cast<uint32_t>(poolSizes.size()), poolSizes.data() });
+    descriptorSet = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{ descriptorPool, 1, &descriptorSetLayout })[0];
+}
+
+void BindlessTable::destroy() {
+    if (!context) {
+        return;
+    }
+    context->device.destroy(descriptorPool);
+    context->device.destroy(descriptorSetLayout);
+    descriptorPool = nullptr;
+    descriptorSetLayout = nullptr;
+    descriptorSet = nullptr;
+    textures = Slots{};
+    buffers = Slots{};
+    context = nullptr;
+}
+
+uint32_t BindlessTable::addTexture(const vk::DescriptorImageInfo& descriptor) {
+    std::unique_lock<std::mutex> lock(mutex);
+    const uint32_t index = textures.allocate();
+    writeTexture(index, descriptor);
+    return index;
+}
+
+void BindlessTable::updateTexture(uint32_t index, const vk::DescriptorImageInfo& descriptor) {
+    std::unique_lock<std::mutex> lock(mutex);
+    writeTexture(index, descriptor);
+}
+
+void BindlessTable::writeTexture(uint32_t index, const vk::DescriptorImageInfo& descriptor) {
+    context->device.updateDescriptorSets(vk::WriteDescriptorSet{ descriptorSet, 0, index, 1, vk::DescriptorType::eCombinedImageSampler, &descriptor }, nullptr);
+}
+
+void BindlessTable::releaseTexture(uint32_t index) {
+    release(textures, index);
+}
+
+uint32_t BindlessTable::addBuffer(const vk::DescriptorBufferInfo& descriptor) {
+    std::unique_lock<std::mutex> lock(mutex);
+    const uint32_t index = buffers.allocate();
+    writeBuffer(index, descriptor);
+    return index;
+}
+
+void BindlessTable::updateBuffer(uint32_t index, const vk::DescriptorBufferInfo& descriptor) {
+    std::unique_lock<std::mutex> lock(mutex);
+    writeBuffer(index, descriptor);
+}
+
+void BindlessTable::writeBuffer(uint32_t index, const vk::DescriptorBufferInfo& descriptor) {
+    context->device.updateDescriptorSets(vk::WriteDescriptorSet{ descriptorSet, 1, index, 1, vk::DescriptorType::eStorageBuffer, nullptr, &descriptor }, nullptr);
+}
+
+void BindlessTable::releaseBuffer(uint32_t index) {
+    release(buffers, index);
+}
+
+void BindlessTable::release(Slots& slots, uint32_t index) {
+    if (index == INVALID_INDEX) {
+        return;
+    }
+    // Frames in flight may still read the entry, so it only becomes free along with the rest of the dumpster
+    Slots* target = &slots;
+    context->dumpster.push_back([this, target, index] {
+        std::unique_lock<std::mutex> lock(mutex);
+        target->free.push_back(index);
+    });
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "forward.hpp"
+
+namespace vks {
+
+// One descriptor set holding every texture and storage buffer registered with it, with VK_EXT_descriptor_indexing.
+// Resources are referred to by index instead of by binding their own sets, so a whole scene can be drawn with the
+// table bound once and per draw indices in push constants or an indirect draw's instance data.  Shaders declare
+//
+//     #extension GL_EXT_nonuniform_qualifier : require
+//     layout (set = N, binding = 0) uniform sampler2D textures[];
+//     layout (set = N, binding = 1) buffer Buffers { uint data[]; } buffers[];
+//
+// and wrap indices that vary within a draw in nonuniformEXT().  Binding 0 may also be declared with other sampler
+// types (samplerCube, sampler2DArray, ...) to reach textures of those types.
+//
+// Both bindings are partially bound and update after bind, so entries can be added while command buffers using the
+// set are pending, as long as those command buffers don't read the entries being written.
+class BindlessTable {
+public:
+    static const uint32_t INVALID_INDEX = static_cast<uint32_t>(-1);
+
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::DescriptorSet descriptorSet;
+
+    // Capacities are clamped to the device's update after bind limits
+    void create(const vks::Context& context, uint32_t maxTextures = 16384, uint32_t maxBuffers = 4096);
+    void destroy();
+
+    uint32_t textureCapacity() const { return textures.capacity; }
+    uint32_t bufferCapacity() const { return buffers.capacity; }
+
+    // Write `descriptor` to a free entry and return its index, which stays valid until released.  Throws
+    // std::runtime_error once the table is full
+    uint32_t addTexture(const vk::DescriptorImageInfo& descriptor);
+    void updateTexture(uint32_t index, const vk::DescriptorImageInfo& descriptor);
+    // The index is reused once the frames submitted so far have completed
+    void releaseTexture(uint32_t index);
+
+    uint32_t addBuffer(const vk::DescriptorBufferInfo& descriptor);
+    void updateBuffer(uint32_t index, const vk::DescriptorBufferInfo& descriptor);
+    void releaseBuffer(uint32_t index);
+
+    void bind(const vk::CommandBuffer& commandBuffer, vk::PipelineBindPoint bindPoint, const vk::PipelineLayout& layout, uint32_t set) const {
+        commandBuffer.bindDescriptorSets(bindPoint, layout, set, descriptorSet, nullptr);
+    }
+
+private:
+    struct Slots {
+        uint32_t capacity{ 0 };
+        // Entries below this have been handed out at least once
+        uint32_t next{ 0 };
+        std::vector<uint32_t> free;
+
+        uint32_t allocate();
+    };
+
+    // Called with the mutex held
+    void writeTexture(uint32_t index, const vk::DescriptorImageInfo& descriptor);
+    void writeBuffer(uint32_t index, const vk::DescriptorBufferInfo& descriptor);
+    void release(Slots& slots, uint32_t index);
+
+    const vks::Context* context{ nullptr };
+    vk::DescriptorPool descriptorPool;
+    // Loaders register their textures from worker threads, and updates of one set must not overlap
+    std::mutex mutex;
+    Slots textures;
+    Slots buffers;
+};
+
+}  // namespace vks
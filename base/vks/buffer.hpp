@@ -26,17 +26,19 @@ public:
     /** @brief Usage flags to be filled by external source at buffer creation (to query at some later point) */
     vk::BufferUsageFlags usageFlags;
     vk::DescriptorBufferInfo descriptor;
+    /** @brief Device address of the buffer, set by Context::createBuffer for buffers created with eShaderDeviceAddress usage */
+    vk::DeviceAddress address{ 0 };
 
     operator bool() const { return buffer.operator bool(); }
 
     /** 
         * Attach the allocated memory block to the buffer
         * 
-        * @param offset (Optional) Byte offset (from the beginning) for the memory region to bind
+        * @param offset (Optional) Byte offset (from the beginning of the allocation) for the memory region to bind
         * 
         * @return VkResult of the bindBufferMemory call
         */
-    void bind(vk::DeviceSize offset = 0) { return device.bindBufferMemory(buffer, memory, offset); }
+    void bind(vk::DeviceSize offset = 0) { return device.bindBufferMemory(buffer, memory, this->offset + offset); }
 
     /**
         * Setup the default descriptor for this buffer
@@ -71,6 +73,7 @@ public:
             device.destroy(buffer);
             buffer = vk::Buffer{};
         }
+        address = 0;
         Parent::destroy();
     }
 };
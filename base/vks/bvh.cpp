@@ -0,0 +1,244 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include "scheduler.hpp"
+
+using namespace vks;
+using namespace vks::bvh;
+
+namespace {
+
+// Triangles per task when computing their bounds
+const size_t BOUNDS_GRAIN_SIZE = 4096;
+
+struct Bounds {
+    glm::vec3 min{ FLT_MAX };
+    glm::vec3 max{ -FLT_MAX };
+
+    void grow(const glm::vec3& point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void grow(const Bounds& other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    // Half the surface area, the heuristic only compares areas
+    float area() const {
+        const glm::vec3 extent = max - min;
+        return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    }
+};
+
+struct BuildNode {
+    Bounds bounds;
+    uint32_t begin{ 0 };
+    uint32_t count{ 0 };
+    std::unique_ptr<BuildNode> children[2];
+};
+
+class Builder {
+public:
+    Builder(const BuildSettings& settings, TaskScheduler* scheduler, const std::vector<Bounds>& triangleBounds, const std::vector<glm::vec3>& centroids,
+            std::vector<uint32_t>& references)
+        : settings(settings)
+        , scheduler(scheduler)
+        , triangleBounds(triangleBounds)
+        , centroids(centroids)
+        , references(references) {}
+
+    // Builds the subtree over references [begin, end), which it reorders so that every leaf's triangles are adjacent
+    void build(BuildNode& node, uint32_t begin, uint32_t end) const {
+        node.begin = begin;
+        node.count = end - begin;
+        Bounds centroidBounds;
+        for (uint32_t i = begin; i < end; ++i) {
+            node.bounds.grow(triangleBounds[references[i]]);
+            centroidBounds.grow(centroids[references[i]]);
+        }
+        if (node.count == 1) {
+            return;
+        }
+
+        uint32_t middle;
+        const Split split = findSplit(node, centroidBounds);
+        if (split.axis >= 0 && (split.cost < (float)node.count || node.count > settings.maxLeafSize)) {
+            const float binMin = centroidBounds.min[split.axis];
+            const float binScale = binScaleFor(centroidBounds, split.axis);
+            auto first = references.begin() + begin;
+            middle = (uint32_t)(std::partition(first, references.begin() + end, [&](uint32_t triangle) {
+                                    return binIndex(centroids[triangle][split.axis], binMin, binScale) < split.bin;
+                                }) - references.begin());
+        } else if (node.count > settings.maxLeafSize) {
+            // All centroids coincide, so no plane separates the triangles.  Halving them still bounds the leaf size.
+            middle = begin + node.count / 2;
+        } else {
+            return;
+        }
+
+        node.children[0].reset(new BuildNode());
+        node.children[1].reset(new BuildNode());
+        const uint32_t bounds[3] = { begin, middle, end };
+        auto buildChildren = [&](size_t first, size_t last) {
+            for (size_t child = first; child < last; ++child) {
+                build(*node.children[child], bounds[child], bounds[child + 1]);
+            }
+        };
+        if (scheduler && std::min(middle - begin, end - middle) >= settings.parallelThreshold) {
+            scheduler->parallelFor(0, 2, 1, buildChildren);
+        } else {
+            buildChildren(0, 2);
+        }
+    }
+
+private:
+    struct Split {
+        int axis{ -1 };
+        // The first bin on the far side of the plane
+        uint32_t bin{ 0 };
+        // In units of ray / triangle tests
+        float cost{ FLT_MAX };
+    };
+
+    struct Bin {
+        Bounds bounds;
+        uint32_t count{ 0 };
+    };
+
+    float binScaleFor(const Bounds& centroidBounds, int axis) const {
+        return (float)settings.binCount / (centroidBounds.max[axis] - centroidBounds.min[axis]);
+    }
+
+    uint32_t binIndex(float centroid, float binMin, float binScale) const {
+        return std::min((uint32_t)((centroid - binMin) * binScale), settings.binCount - 1);
+    }
+
+    Split findSplit(const BuildNode& node, const Bounds& centroidBounds) const {
+        Split best;
+        const float parentArea = std::max(node.bounds.area(), FLT_MIN);
+        std::vector<Bin> bins(settings.binCount);
+        // Area times triangle count of everything right of each plane
+        std::vector<float> rightCosts(settings.binCount);
+        std::vector<uint32_t> rightCounts(settings.binCount);
+        for (int axis = 0; axis < 3; ++axis) {
+            if (centroidBounds.max[axis] <= centroidBounds.min[axis]) {
+                continue;
+            }
+            const float binMin = centroidBounds.min[axis];
+            const float binScale = binScaleFor(centroidBounds, axis);
+            std::fill(bins.begin(), bins.end(), Bin{});
+            for (uint32_t i = node.begin; i < node.begin + node.count; ++i) {
+                const uint32_t triangle = references[i];
+                Bin& bin = bins[binIndex(centroids[triangle][axis], binMin, binScale)];
+                bin.bounds.grow(triangleBounds[triangle]);
+                ++bin.count;
+            }
+
+            Bounds right;
+            uint32_t rightCount = 0;
+            for (uint32_t i = settings.binCount - 1; i > 0; --i) {
+                right.grow(bins[i].bounds);
+                rightCount += bins[i].count;
+                rightCounts[i] = rightCount;
+                rightCosts[i] = rightCount ? right.area() * (float)rightCount : 0.0f;
+            }
+            Bounds left;
+            uint32_t leftCount = 0;
+            for (uint32_t i = 1; i < settings.binCount; ++i) {
+                left.grow(bins[i - 1].bounds);
+                leftCount += bins[i - 1].count;
+                if (!leftCount || !rightCounts[i]) {
+                    continue;
+                }
+                const float cost = settings.traversalCost + (left.area() * (float)leftCount + rightCosts[i]) / parentArea;
+                if (cost < best.cost) {
+                    best.axis = axis;
+                    best.bin = i;
+                    best.cost = cost;
+                }
+            }
+        }
+        return best;
+    }
+
+    const BuildSettings& settings;
+    TaskScheduler* scheduler;
+    const std::vector<Bounds>& triangleBounds;
+    const std::vector<glm::vec3>& centroids;
+    std::vector<uint32_t>& references;
+};
+
+// Appends `node` and its subtree depth first and returns its index
+uint32_t flatten(const BuildNode& node, std::vector<Node>& nodes, uint32_t depth, uint32_t& maxDepth) {
+    const uint32_t index = (uint32_t)nodes.size();
+    nodes.emplace_back();
+    maxDepth = std::max(maxDepth, depth);
+    Node result;
+    result.min = node.bounds.min;
+    result.max = node.bounds.max;
+    if (node.children[0]) {
+        flatten(*node.children[0], nodes, depth + 1, maxDepth);
+        result.offset = flatten(*node.children[1], nodes, depth + 1, maxDepth);
+        result.count = 0;
+    } else {
+        result.offset = node.begin;
+        result.count = node.count;
+    }
+    nodes[index] = result;
+    return index;
+}
+
+}  // namespace
+
+void Bvh::build(const uint8_t* positions,
+                size_t positionStride,
+                const uint32_t* indices,
+                size_t indexCount,
+                const BuildSettings& settings,
+                TaskScheduler* scheduler) {
+    const uint32_t triangleCount = (uint32_t)(indexCount / 3);
+    if (!triangleCount) {
+        throw std::runtime_error("A BVH needs at least one triangle");
+    }
+    if (settings.binCount < 2) {
+        throw std::runtime_error("A BVH needs at least two bins to split nodes");
+    }
+
+    std::vector<Bounds> triangleBounds(triangleCount);
+    std::vector<glm::vec3> centroids(triangleCount);
+    auto boundTriangles = [&](size_t first, size_t last) {
+        for (size_t triangle = first; triangle < last; ++triangle) {
+            Bounds& bounds = triangleBounds[triangle];
+            for (uint32_t corner = 0; corner < 3; ++corner) {
+                glm::vec3 position;
+                memcpy(&position, positions + indices[triangle * 3 + corner] * positionStride, sizeof(position));
+                bounds.grow(position);
+            }
+            centroids[triangle] = (bounds.min + bounds.max) * 0.5f;
+        }
+    };
+    if (scheduler) {
+        scheduler->parallelFor(0, triangleCount, BOUNDS_GRAIN_SIZE, boundTriangles);
+    } else {
+        boundTriangles(0, triangleCount);
+    }
+
+    triangles.resize(triangleCount);
+    for (uint32_t i = 0; i < triangleCount; ++i) {
+        triangles[i] = i;
+    }
+    BuildNode root;
+    Builder(settings, scheduler, triangleBounds, centroids, triangles).build(root, 0, triangleCount);
+
+    nodes.clear();
+    nodes.reserve(triangleCount * 2 - 1);
+    depth = 0;
+    flatten(root, nodes, 1, depth);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace vks {
+class TaskScheduler;
+namespace bvh {
+
+// Node of a flattened BVH, laid out to be read as a std430 struct of { vec3 min; uint offset; vec3 max; uint count; }.
+// Nodes are stored depth first, so the first child of an interior node is the node right after it and only the index
+// of the second child needs to be stored.
+struct Node {
+    glm::vec3 min;
+    // Interior nodes: index of the second child.  Leaves: first entry of their triangles in Bvh::triangles
+    uint32_t offset;
+    glm::vec3 max;
+    // Number of triangles of a leaf, 0 for interior nodes
+    uint32_t count;
+};
+
+static_assert(sizeof(Node) == 32, "BVH nodes must match the shader layout");
+
+struct BuildSettings {
+    // Centroid bins per axis the split candidates are taken from
+    uint32_t binCount{ 16 };
+    // Leaves are split further while they have more triangles than this, even when the split doesn't pay off
+    uint32_t maxLeafSize{ 8 };
+    // Cost of a ray / box test relative to a ray / triangle test, in the surface area heuristic
+    float traversalCost{ 1.0f };
+    // Subtrees with at least this many triangles are built concurrently with their sibling
+    uint32_t parallelThreshold{ 8192 };
+};
+
+// Bounding volume hierarchy over a triangle list.
+//
+// Every node is split at the best of `binCount` candidate planes per axis by the surface area heuristic, which
+// estimates the cost of tracing a ray through the node from the probability that a ray hitting it also hits either
+// child, taken to be proportional to the surface area of their bounds.  Nodes are turned into leaves once no split is
+// cheaper than testing all of their triangles.  The two halves of a split are independent, so large subtrees are
+// built in parallel on a TaskScheduler.
+struct Bvh {
+    std::vector<Node> nodes;
+    // Indices of the input triangles, in the order the leaves refer to them
+    std::vector<uint32_t> triangles;
+    // Number of nodes on the longest path from the root to a leaf, which bounds the stack a traversal needs
+    uint32_t depth{ 0 };
+
+    // Builds the hierarchy over the `indexCount / 3` triangles of `indices`, whose vertex positions are
+    // `positionStride` bytes apart starting at `positions`.  Runs on `scheduler` if one is given.
+    void build(const uint8_t* positions,
+               size_t positionStride,
+               const uint32_t* indices,
+               size_t indexCount,
+               const BuildSettings& settings = BuildSettings{},
+               TaskScheduler* scheduler = nullptr);
+};
+
+}}  // namespace vks::bvh
@@ -0,0 +1,109 @@
+#include "clusteredLights.hpp"
+
+#include <algorithm>
+
+#include "context.hpp"
+#include "shaders.hpp"
+
+using namespace vks;
+
+const uint32_t ClusteredLights::TILES_X;
+const uint32_t ClusteredLights::TILES_Y;
+const uint32_t ClusteredLights::SLICES;
+const uint32_t ClusteredLights::CLUSTER_COUNT;
+const uint32_t ClusteredLights::MAX_LIGHTS_PER_CLUSTER;
+
+namespace {
+
+// Must match the local size of clusters.comp
+const uint32_t GROUP_SIZE = 64;
+
+}  // namespace
+
+void ClusteredLights::create(const vks::Context& context, const std::string& shaderPath, uint32_t maxLights) {
+    device = context.device;
+    capacity = maxLights;
+    params = {};
+
+    bounds = context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                  (vk::DeviceSize)sizeof(glm::vec4) * std::max(1u, maxLights));
+    bounds.map();
+    uniform = context.createUniformBuffer(params);
+    grid = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer,
+                                      (vk::DeviceSize)sizeof(uint32_t) * CLUSTER_COUNT * (1 + MAX_LIGHTS_PER_CLUSTER));
+
+    std::vector<vk::DescriptorSetLayoutBinding> bindings{
+        { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        { 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+    };
+    descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)bindings.size(), bindings.data() });
+    pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+
+    std::vector<vk::DescriptorPoolSize> poolSizes{
+        { vk::DescriptorType::eUniformBuffer, 1 },
+        { vk::DescriptorType::eStorageBuffer, 2 },
+    };
+    descriptorPool = device.createDescriptorPool({ {}, 1, (uint32_t)poolSizes.size(), poolSizes.data() });
+    descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+    std::vector<vk::WriteDescriptorSet> writes{
+        { descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniform.descriptor },
+        { descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &bounds.descriptor },
+        { descriptorSet, 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &grid.descriptor },
+    };
+    device.updateDescriptorSets(writes, nullptr);
+
+    vk::ComputePipelineCreateInfo pipelineCreateInfo;
+    pipelineCreateInfo.layout = pipelineLayout;
+    pipelineCreateInfo.stage = shaders::loadShader(device, shaderPath, vk::ShaderStageFlagBits::eCompute);
+    pipeline = device.createComputePipeline(context.pipelineCache, pipelineCreateInfo);
+    device.destroyShaderModule(pipelineCreateInfo.stage.module);
+}
+
+void ClusteredLights::destroy() {
+    if (!device) {
+        return;
+    }
+    device.destroyPipeline(pipeline);
+    device.destroyPipelineLayout(pipelineLayout);
+    device.destroyDescriptorPool(descriptorPool);
+    device.destroyDescriptorSetLayout(descriptorSetLayout);
+    bounds.destroy();
+    uniform.destroy();
+    grid.destroy();
+    pipeline = nullptr;
+    pipelineLayout = nullptr;
+    descriptorPool = nullptr;
+    descriptorSetLayout = nullptr;
+    descriptorSet = nullptr;
+    device = nullptr;
+}
+
+void ClusteredLights::update(const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar, uint32_t lightCount) {
+    params.view = view;
+    params.projection = projection;
+    params.inverseProjection = glm::inverse(projection);
+    params.zNear = zNear;
+    params.zFar = zFar;
+    params.lightCount = std::min(lightCount, capacity);
+    uniform.copy(params);
+}
+
+void ClusteredLights::record(const vk::CommandBuffer& commandBuffer) const {
+    // The previous frame's composition has to be done reading the grid before it is overwritten
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, nullptr, nullptr);
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
+    commandBuffer.dispatch((CLUSTER_COUNT + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+    vk::BufferMemoryBarrier barrier;
+    barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = grid.buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eFragmentShader, {}, nullptr, barrier, nullptr);
+}
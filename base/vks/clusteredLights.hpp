@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "buffer.hpp"
+#include "forward.hpp"
+
+namespace vks {
+
+// Clustered light culling in a compute shader.  The view frustum is split into a grid of TILES_X by TILES_Y
+// screen tiles and SLICES exponentially spaced depth slices (froxels), and every cluster gets the list of lights
+// whose bounding sphere touches it, so a deferred composition pass only evaluates the lights near each fragment
+// instead of all of them.
+//
+// Lights are given as bounding spheres in any space `view` maps rigidly to view space, usually the space the
+// G-buffer positions are in.  Shaders find the lights of a fragment with clusters.glsl, which declares the
+// parameter uniform and the grid storage buffer at the bindings they choose (see uniformDescriptor and
+// gridDescriptor), and index their own light data with the light indices it yields.
+class ClusteredLights {
+public:
+    // Must match clusters.glsl
+    static const uint32_t TILES_X = 16;
+    static const uint32_t TILES_Y = 9;
+    static const uint32_t SLICES = 24;
+    static const uint32_t CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+    // Lights past this many in one cluster are dropped
+    static const uint32_t MAX_LIGHTS_PER_CLUSTER = 128;
+
+    // Bounding sphere per light, xyz center and w radius, host visible, coherent and persistently mapped
+    Buffer bounds;
+
+    void create(const vks::Context& context, const std::string& shaderPath, uint32_t maxLights);
+    void destroy();
+
+    uint32_t maxLights() const { return capacity; }
+    glm::vec4* lightBounds() const { return static_cast<glm::vec4*>(bounds.mapped); }
+
+    // The matrices the G-buffer was rendered with, and the depth range the slices cover.  Like the light bounds,
+    // takes effect for the command buffers executed from now on.
+    void update(const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar, uint32_t lightCount);
+
+    // Bin the lights, ordered after the fragment shaders of earlier commands and before the fragment shaders of
+    // later ones.  Must be recorded outside of a render pass.
+    void record(const vk::CommandBuffer& commandBuffer) const;
+
+    const vk::DescriptorBufferInfo& uniformDescriptor() const { return uniform.descriptor; }
+    const vk::DescriptorBufferInfo& gridDescriptor() const { return grid.descriptor; }
+
+private:
+    // Must match the Clusters block of clusters.glsl
+    struct Params {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::mat4 inverseProjection;
+        float zNear;
+        float zFar;
+        uint32_t lightCount;
+        float _pad;
+    } params;
+
+    vk::Device device;
+    uint32_t capacity{ 0 };
+    Buffer uniform;
+    // Light count of every cluster, followed by MAX_LIGHTS_PER_CLUSTER light indices per cluster
+    Buffer grid;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::DescriptorPool descriptorPool;
+    vk::DescriptorSet descriptorSet;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline pipeline;
+};
+
+}  // namespace vks
@@ -0,0 +1,98 @@
+#include "commandpools.hpp"
+
+#include <cassert>
+
+using namespace vks;
+
+namespace {
+
+// Command buffers allocated at once when a pool runs out
+const uint32_t BATCH_SIZE = 4;
+
+}  // namespace
+
+thread_local std::unordered_map<uint64_t, FrameCommandPools::ThreadPools*> FrameCommandPools::s_threadPools;
+
+void LinearCommandPool::create(const vk::Device& device, uint32_t queueFamilyIndex) {
+    destroy();
+    this->device = device;
+    pool = device.createCommandPool({ vk::CommandPoolCreateFlagBits::eTransient, queueFamilyIndex });
+}
+
+void LinearCommandPool::destroy() {
+    if (pool) {
+        // Takes the command buffers with it
+        device.destroyCommandPool(pool);
+        pool = vk::CommandPool();
+    }
+    primary = Level{};
+    secondary = Level{};
+}
+
+vk::CommandBuffer LinearCommandPool::allocate(vk::CommandBufferLevel level) {
+    Level& buffers = level == vk::CommandBufferLevel::ePrimary ? primary : secondary;
+    if (buffers.next == buffers.buffers.size()) {
+        const auto batch = device.allocateCommandBuffers({ pool, level, BATCH_SIZE });
+        buffers.buffers.insert(buffers.buffers.end(), batch.begin(), batch.end());
+    }
+    return buffers.buffers[buffers.next++];
+}
+
+void LinearCommandPool::reset() {
+    if (!usedCount()) {
+        return;
+    }
+    device.resetCommandPool(pool, {});
+    primary.next = 0;
+    secondary.next = 0;
+}
+
+void FrameCommandPools::create(const vk::Device& device, uint32_t queueFamilyIndex, uint32_t frameCount) {
+    destroy();
+    this->device = device;
+    this->queueFamilyIndex = queueFamilyIndex;
+    this->frameCount = frameCount;
+    currentFrame = 0;
+    id = newId();
+}
+
+void FrameCommandPools::destroy() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (auto& thread : threads) {
+        for (auto& pool : thread->frames) {
+            pool.destroy();
+        }
+    }
+    threads.clear();
+    // Other threads keep their entries, which no later create shares the id of
+    s_threadPools.erase(id);
+    frameCount = 0;
+}
+
+void FrameCommandPools::begin(uint32_t frame) {
+    assert(frame < frameCount);
+    std::unique_lock<std::mutex> lock(mutex);
+    for (auto& thread : threads) {
+        thread->frames[frame].reset();
+    }
+    currentFrame = frame;
+}
+
+vk::CommandBuffer FrameCommandPools::allocate(vk::CommandBufferLevel level) {
+    return threadPools().frames[currentFrame].allocate(level);
+}
+
+FrameCommandPools::ThreadPools& FrameCommandPools::threadPools() {
+    auto& pools = s_threadPools[id];
+    if (!pools) {
+        std::unique_ptr<ThreadPools> created{ new ThreadPools() };
+        created->frames.resize(frameCount);
+        for (auto& pool : created->frames) {
+            pool.create(device, queueFamilyIndex);
+        }
+        pools = created.get();
+        std::unique_lock<std::mutex> lock(mutex);
+        threads.push_back(std::move(created));
+    }
+    return *pools;
+}
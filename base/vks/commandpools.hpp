@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+namespace vks {
+
+// A transient command pool whose command buffers are handed out in order and recycled all at once by reset, which
+// resets the pool instead of freeing them one by one.  Buffers are allocated in batches as they're needed and kept
+// across resets, so once the pool has grown to its working set allocating one is an index increment.  Like any
+// command pool it must only be used by one thread at a time.
+class LinearCommandPool {
+public:
+    void create(const vk::Device& device, uint32_t queueFamilyIndex);
+    void destroy();
+
+    operator bool() const { return pool.operator bool(); }
+    const vk::CommandPool& handle() const { return pool; }
+
+    // Valid until the next reset, and never freed by the caller
+    vk::CommandBuffer allocate(vk::CommandBufferLevel level = vk::CommandBufferLevel::ePrimary);
+    // Everything allocated since the last reset must no longer be in use by the device
+    void reset();
+
+    // Command buffers handed out since the last reset, and allocated in total
+    size_t usedCount() const { return primary.next + secondary.next; }
+    size_t allocatedCount() const { return primary.buffers.size() + secondary.buffers.size(); }
+
+private:
+    struct Level {
+        std::vector<vk::CommandBuffer> buffers;
+        size_t next{ 0 };
+    };
+
+    vk::Device device;
+    vk::CommandPool pool;
+    Level primary;
+    Level secondary;
+};
+
+// A LinearCommandPool per thread and frame in flight, for command buffers that are recorded and submitted within a
+// frame.  Each thread allocating gets pools of its own, so recording threads need no locking, and `begin` resets the
+// pools of a frame slot on every thread once the slot's previous submissions have completed.
+class FrameCommandPools {
+public:
+    FrameCommandPools() = default;
+    FrameCommandPools(const FrameCommandPools& other) = delete;
+    FrameCommandPools& operator=(const FrameCommandPools& other) = delete;
+    ~FrameCommandPools() { destroy(); }
+
+    void create(const vk::Device& device, uint32_t queueFamilyIndex, uint32_t frameCount);
+    // Destroys the pools of every thread, which must not be allocating meanwhile
+    void destroy();
+
+    operator bool() const { return frameCount != 0; }
+
+    // Reset the pools of frame slot `frame` and allocate from them from now on.  Everything allocated for the slot
+    // must no longer be in use by the device, and no other thread may be allocating meanwhile.
+    void begin(uint32_t frame);
+
+    // A command buffer of the calling thread's pool for the current frame, which is recycled by the next begin of the
+    // same slot
+    vk::CommandBuffer allocate(vk::CommandBufferLevel level = vk::CommandBufferLevel::ePrimary);
+
+private:
+    struct ThreadPools {
+        std::vector<LinearCommandPool> frames;
+    };
+
+    ThreadPools& threadPools();
+
+    vk::Device device;
+    uint32_t queueFamilyIndex{ 0 };
+    uint32_t frameCount{ 0 };
+    std::atomic<uint32_t> currentFrame{ 0 };
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadPools>> threads;
+
+    static uint64_t newId() {
+        static std::atomic<uint64_t> next{ 0 };
+        return ++next;
+    }
+    // A new one for every create and never reused, so threads' entries for pools destroyed since are never looked up
+    uint64_t id{ 0 };
+    static thread_local std::unordered_map<uint64_t, ThreadPools*> s_threadPools;
+};
+
+}  // namespace vks
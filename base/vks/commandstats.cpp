@@ -0,0 +1,277 @@
+#include "commandstats.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+using namespace vks::commandstats;
+
+const char* vks::commandstats::counterName(Counter counter) {
+    switch (counter) {
+        case Counter::Draws:
+            return "draws";
+        case Counter::Dispatches:
+            return "dispatches";
+        case Counter::PipelineBinds:
+            return "pipelineBinds";
+        case Counter::DescriptorBinds:
+            return "descriptorBinds";
+        case Counter::BufferBinds:
+            return "bufferBinds";
+        case Counter::PushConstants:
+            return "pushConstants";
+        case Counter::Barriers:
+            return "barriers";
+        case Counter::RenderPasses:
+            return "renderPasses";
+        case Counter::Submits:
+            return "submits";
+        default:
+            return "unknown";
+    }
+}
+
+#if defined(VKS_COMMAND_STATS)
+
+// The entry points defined below, forwarded to the device's own
+#define VKS_COMMAND_STATS_ENTRY_POINTS(X) \
+    X(vkBeginCommandBuffer)               \
+    X(vkCmdDraw)                          \
+    X(vkCmdDrawIndexed)                   \
+    X(vkCmdDrawIndirect)                  \
+    X(vkCmdDrawIndexedIndirect)           \
+    X(vkCmdDispatch)                      \
+    X(vkCmdDispatchIndirect)              \
+    X(vkCmdBindPipeline)                  \
+    X(vkCmdBindDescriptorSets)            \
+    X(vkCmdBindVertexBuffers)             \
+    X(vkCmdBindIndexBuffer)               \
+    X(vkCmdPushConstants)                 \
+    X(vkCmdPipelineBarrier)               \
+    X(vkCmdBeginRenderPass)               \
+    X(vkCmdExecuteCommands)               \
+    X(vkQueueSubmit)
+
+namespace {
+
+struct DeviceFunctions {
+#define VKS_COMMAND_STATS_MEMBER(name) PFN_##name name{ nullptr };
+    VKS_COMMAND_STATS_ENTRY_POINTS(VKS_COMMAND_STATS_MEMBER)
+#undef VKS_COMMAND_STATS_MEMBER
+};
+
+DeviceFunctions s_device;
+std::atomic<bool> s_enabled{ false };
+
+// Never erased, so pointers to the counts stay valid.  Handles are reused by command pools, so this only grows
+// with the number of command buffers alive at once.
+std::mutex s_mutex;
+std::unordered_map<VkCommandBuffer, CommandCounts> s_commandBuffers;
+FrameStats s_frame;
+
+// Command buffers are externally synchronized, so the counts of the one the calling thread last recorded into can
+// be updated without the lock
+thread_local VkCommandBuffer s_cachedBuffer = VK_NULL_HANDLE;
+thread_local CommandCounts* s_cachedCounts = nullptr;
+
+CommandCounts& countsOf(VkCommandBuffer commandBuffer) {
+    if (commandBuffer != s_cachedBuffer) {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        s_cachedCounts = &s_commandBuffers[commandBuffer];
+        s_cachedBuffer = commandBuffer;
+    }
+    return *s_cachedCounts;
+}
+
+inline void count(VkCommandBuffer commandBuffer, Counter counter) {
+    if (s_enabled.load(std::memory_order_relaxed)) {
+        ++countsOf(commandBuffer)[counter];
+    }
+}
+
+}  // namespace
+
+bool vks::commandstats::available() {
+    return true;
+}
+
+void vks::commandstats::install(const vk::Device& device) {
+#define VKS_COMMAND_STATS_RESOLVE(name) s_device.name = (PFN_##name)vkGetDeviceProcAddr(static_cast<VkDevice>(device), #name);
+    VKS_COMMAND_STATS_ENTRY_POINTS(VKS_COMMAND_STATS_RESOLVE)
+#undef VKS_COMMAND_STATS_RESOLVE
+}
+
+void vks::commandstats::setEnabled(bool enabled) {
+    s_enabled = enabled;
+}
+
+bool vks::commandstats::enabled() {
+    return s_enabled;
+}
+
+FrameStats vks::commandstats::endFrame() {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    FrameStats result;
+    std::swap(result, s_frame);
+    return result;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBeginCommandBuffer(VkCommandBuffer commandBuffer, const VkCommandBufferBeginInfo* pBeginInfo) {
+    if (s_enabled.load(std::memory_order_relaxed)) {
+        countsOf(commandBuffer) = CommandCounts{};
+    }
+    return s_device.vkBeginCommandBuffer(commandBuffer, pBeginInfo);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdDraw(VkCommandBuffer commandBuffer,
+                                     uint32_t vertexCount,
+                                     uint32_t instanceCount,
+                                     uint32_t firstVertex,
+                                     uint32_t firstInstance) {
+    count(commandBuffer, Counter::Draws);
+    s_device.vkCmdDraw(commandBuffer, vertexCount, instanceCount, firstVertex, firstInstance);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdDrawIndexed(VkCommandBuffer commandBuffer,
+                                            uint32_t indexCount,
+                                            uint32_t instanceCount,
+                                            uint32_t firstIndex,
+                                            int32_t vertexOffset,
+                                            uint32_t firstInstance) {
+    count(commandBuffer, Counter::Draws);
+    s_device.vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdDrawIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride) {
+    count(commandBuffer, Counter::Draws);
+    s_device.vkCmdDrawIndirect(commandBuffer, buffer, offset, drawCount, stride);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdDrawIndexedIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride) {
+    count(commandBuffer, Counter::Draws);
+    s_device.vkCmdDrawIndexedIndirect(commandBuffer, buffer, offset, drawCount, stride);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdDispatch(VkCommandBuffer commandBuffer, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+    count(commandBuffer, Counter::Dispatches);
+    s_device.vkCmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdDispatchIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset) {
+    count(commandBuffer, Counter::Dispatches);
+    s_device.vkCmdDispatchIndirect(commandBuffer, buffer, offset);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBindPipeline(VkCommandBuffer commandBuffer, VkPipelineBindPoint pipelineBindPoint, VkPipeline pipeline) {
+    count(commandBuffer, Counter::PipelineBinds);
+    s_device.vkCmdBindPipeline(commandBuffer, pipelineBindPoint, pipeline);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBindDescriptorSets(VkCommandBuffer commandBuffer,
+                                                   VkPipelineBindPoint pipelineBindPoint,
+                                                   VkPipelineLayout layout,
+                                                   uint32_t firstSet,
+                                                   uint32_t descriptorSetCount,
+                                                   const VkDescriptorSet* pDescriptorSets,
+                                                   uint32_t dynamicOffsetCount,
+                                                   const uint32_t* pDynamicOffsets) {
+    count(commandBuffer, Counter::DescriptorBinds);
+    s_device.vkCmdBindDescriptorSets(commandBuffer, pipelineBindPoint, layout, firstSet, descriptorSetCount, pDescriptorSets, dynamicOffsetCount,
+                                     pDynamicOffsets);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBindVertexBuffers(VkCommandBuffer commandBuffer,
+                                                  uint32_t firstBinding,
+                                                  uint32_t bindingCount,
+                                                  const VkBuffer* pBuffers,
+                                                  const VkDeviceSize* pOffsets) {
+    count(commandBuffer, Counter::BufferBinds);
+    s_device.vkCmdBindVertexBuffers(commandBuffer, firstBinding, bindingCount, pBuffers, pOffsets);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBindIndexBuffer(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkIndexType indexType) {
+    count(commandBuffer, Counter::BufferBinds);
+    s_device.vkCmdBindIndexBuffer(commandBuffer, buffer, offset, indexType);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdPushConstants(VkCommandBuffer commandBuffer,
+                                              VkPipelineLayout layout,
+                                              VkShaderStageFlags stageFlags,
+                                              uint32_t offset,
+                                              uint32_t size,
+                                              const void* pValues) {
+    count(commandBuffer, Counter::PushConstants);
+    s_device.vkCmdPushConstants(commandBuffer, layout, stageFlags, offset, size, pValues);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdPipelineBarrier(VkCommandBuffer commandBuffer,
+                                                VkPipelineStageFlags srcStageMask,
+                                                VkPipelineStageFlags dstStageMask,
+                                                VkDependencyFlags dependencyFlags,
+                                                uint32_t memoryBarrierCount,
+                                                const VkMemoryBarrier* pMemoryBarriers,
+                                                uint32_t bufferMemoryBarrierCount,
+                                                const VkBufferMemoryBarrier* pBufferMemoryBarriers,
+                                                uint32_t imageMemoryBarrierCount,
+                                                const VkImageMemoryBarrier* pImageMemoryBarriers) {
+    count(commandBuffer, Counter::Barriers);
+    s_device.vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, dependencyFlags, memoryBarrierCount, pMemoryBarriers, bufferMemoryBarrierCount,
+                                  pBufferMemoryBarriers, imageMemoryBarrierCount, pImageMemoryBarriers);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBeginRenderPass(VkCommandBuffer commandBuffer, const VkRenderPassBeginInfo* pRenderPassBegin, VkSubpassContents contents) {
+    count(commandBuffer, Counter::RenderPasses);
+    s_device.vkCmdBeginRenderPass(commandBuffer, pRenderPassBegin, contents);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdExecuteCommands(VkCommandBuffer commandBuffer, uint32_t commandBufferCount, const VkCommandBuffer* pCommandBuffers) {
+    if (s_enabled.load(std::memory_order_relaxed)) {
+        // The secondaries are executable by now, so their counts are final
+        CommandCounts secondaries;
+        {
+            std::lock_guard<std::mutex> lock(s_mutex);
+            for (uint32_t i = 0; i < commandBufferCount; ++i) {
+                secondaries += s_commandBuffers[pCommandBuffers[i]];
+            }
+        }
+        countsOf(commandBuffer) += secondaries;
+    }
+    s_device.vkCmdExecuteCommands(commandBuffer, commandBufferCount, pCommandBuffers);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkQueueSubmit(VkQueue queue, uint32_t submitCount, const VkSubmitInfo* pSubmits, VkFence fence) {
+    if (s_enabled.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        ++s_frame.commands[Counter::Submits];
+        for (uint32_t i = 0; i < submitCount; ++i) {
+            for (uint32_t j = 0; j < pSubmits[i].commandBufferCount; ++j) {
+                const auto& counts = s_commandBuffers[pSubmits[i].pCommandBuffers[j]];
+                s_frame.commands += counts;
+                s_frame.commandBuffers.push_back(counts);
+            }
+        }
+    }
+    return s_device.vkQueueSubmit(queue, submitCount, pSubmits, fence);
+}
+
+#else
+
+bool vks::commandstats::available() {
+    return false;
+}
+
+void vks::commandstats::install(const vk::Device&) {
+}
+
+void vks::commandstats::setEnabled(bool) {
+}
+
+bool vks::commandstats::enabled() {
+    return false;
+}
+
+FrameStats vks::commandstats::endFrame() {
+    return {};
+}
+
+#endif
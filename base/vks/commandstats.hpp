@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+namespace vks { namespace commandstats {
+
+// Per frame counts of the commands recorded and submitted, without an external layer or capture tool.
+//
+// With VKS_COMMAND_STATS (the CMake option of the same name), the base library defines the core vkCmd* entry points
+// it counts, along with vkBeginCommandBuffer and vkQueueSubmit, ahead of the Vulkan loader's.  Everything the
+// examples record through vulkan.hpp's static dispatch then goes through them, and they forward to the device's
+// functions, only counting while enabled.  Functions reached through a vk::DispatchLoaderDynamic, like those of
+// extensions, aren't counted.
+
+enum class Counter : uint32_t {
+    // Draw and dispatch commands, an indirect one counts once whatever its draw count
+    Draws,
+    Dispatches,
+    PipelineBinds,
+    // vkCmdBindDescriptorSets calls, not sets
+    DescriptorBinds,
+    // Vertex and index buffer binds
+    BufferBinds,
+    PushConstants,
+    // vkCmdPipelineBarrier calls
+    Barriers,
+    RenderPasses,
+    // vkQueueSubmit calls, only counted for frames
+    Submits,
+    Count
+};
+
+const char* counterName(Counter counter);
+
+struct CommandCounts {
+    uint32_t values[(size_t)Counter::Count]{};
+
+    uint32_t& operator[](Counter counter) { return values[(size_t)counter]; }
+    uint32_t operator[](Counter counter) const { return values[(size_t)counter]; }
+    CommandCounts& operator+=(const CommandCounts& other) {
+        for (size_t i = 0; i < (size_t)Counter::Count; ++i) {
+            values[i] += other.values[i];
+        }
+        return *this;
+    }
+};
+
+struct FrameStats {
+    // Everything submitted in the frame
+    CommandCounts commands;
+    // Per primary command buffer submitted, in submission order.  Secondary command buffers are counted in the
+    // primaries executing them.
+    std::vector<CommandCounts> commandBuffers;
+};
+
+// Whether the counting entry points are compiled in
+bool available();
+// Point the entry points at the functions of `device`, called by Context::createDevice.  Counting only supports the
+// one device.
+void install(const vk::Device& device);
+
+// Command buffers recorded while disabled have no counts, so pre-recorded ones need to be recorded again after
+// enabling
+void setEnabled(bool enabled);
+bool enabled();
+
+// The counts of everything submitted since the previous call, which ExampleBase makes at the start of every frame
+FrameStats endFrame();
+
+}}  // namespace vks::commandstats
@@ -1,12 +1,504 @@
 #include "context.hpp"
 
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
 using namespace vks;
 
+thread_local std::unordered_map<uint64_t, vk::CommandPool> Context::s_cmdPools;
+thread_local std::unordered_map<uint64_t, Context::ImmediateCommandPool> Context::s_immediatePools;
+
+// Drivers reject (or worse, misuse) cache data from a different device or driver build, so check the
+// header against the current physical device before handing the blob over
+bool Context::isPipelineCacheCompatible(const std::vector<uint8_t>& data) const {
+    struct Header {
+        uint32_t headerSize;
+        uint32_t headerVersion;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    } header;
+    if (data.size() < sizeof(Header)) {
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(Header));
+    return header.headerSize >= sizeof(Header) && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           header.vendorID == deviceProperties.vendorID && header.deviceID == deviceProperties.deviceID &&
+           0 == memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+}
+
+vk::PipelineCache Context::loadPipelineCache() {
+    std::vector<uint8_t> data;
+    if (!pipelineCachePath.empty()) {
+        std::ifstream file(pipelineCachePath, std::ios::binary | std::ios::ate);
+        if (file) {
+            data.resize(static_cast<size_t>(file.tellg()));
+            file.seekg(0, std::ios::beg);
+            if (!file.read(reinterpret_cast<char*>(data.data()), data.size())) {
+                data.clear();
+            }
+        }
+        if (!isPipelineCacheCompatible(data)) {
+            data.clear();
+        }
+    }
+    pipelineCacheWarm = !data.empty();
+    return device.createPipelineCache({ {}, data.size(), data.data() });
+}
+
+// Write to a temporary file and rename it over the old one, so that a crash part way through the
+// write can never leave a truncated cache behind
+void Context::savePipelineCache() const {
+    if (pipelineCachePath.empty() || !pipelineCache) {
+        return;
+    }
+    auto data = device.getPipelineCacheData(pipelineCache);
+    if (data.empty()) {
+        return;
+    }
+    const std::string tempPath = pipelineCachePath + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.write(reinterpret_cast<const char*>(data.data()), data.size())) {
+            std::remove(tempPath.c_str());
+            return;
+        }
+    }
 #ifdef WIN32
-__declspec(thread) vk::CommandPool Context::s_cmdPool;
-#else
-thread_local vk::CommandPool Context::s_cmdPool;
+    // rename does not replace an existing file on Windows
+    std::remove(pipelineCachePath.c_str());
 #endif
+    std::rename(tempPath.c_str(), pipelineCachePath.c_str());
+}
+
+const std::unordered_set<std::string>& Context::getAvailableLayers() {
+    static const std::unordered_set<std::string> layerNames = [] {
+        std::unordered_set<std::string> result;
+        for (const auto& layer : vk::enumerateInstanceLayerProperties()) {
+            result.insert(layer.layerName);
+        }
+        return result;
+    }();
+    return layerNames;
+}
+
+const std::unordered_set<std::string>& Context::getExtensionNames() {
+    static const std::unordered_set<std::string> extensionNames = [] {
+        std::unordered_set<std::string> result;
+        for (const auto& extension : getExtensions()) {
+            result.insert(extension.extensionName);
+        }
+        return result;
+    }();
+    return extensionNames;
+}
+
+namespace {
+struct DeviceExtensionNames {
+    std::mutex mutex;
+    std::unordered_map<VkPhysicalDevice, std::unordered_set<std::string>> names;
+};
+
+DeviceExtensionNames& deviceExtensionNames() {
+    static DeviceExtensionNames instance;
+    return instance;
+}
+}  // namespace
+
+const std::unordered_set<std::string>& Context::getDeviceExtensionNames(const vk::PhysicalDevice& physicalDevice) {
+    auto& cache = deviceExtensionNames();
+    std::unique_lock<std::mutex> lock(cache.mutex);
+    auto itr = cache.names.find(static_cast<VkPhysicalDevice>(physicalDevice));
+    if (itr == cache.names.end()) {
+        std::unordered_set<std::string> names;
+        for (const auto& extension : getDeviceExtensions(physicalDevice)) {
+            names.insert(extension.extensionName);
+        }
+        itr = cache.names.insert({ static_cast<VkPhysicalDevice>(physicalDevice), std::move(names) }).first;
+    }
+    return itr->second;
+}
+
+void Context::clearDeviceExtensionNames() {
+    auto& cache = deviceExtensionNames();
+    std::unique_lock<std::mutex> lock(cache.mutex);
+    cache.names.clear();
+}
+
+// One vkGetPhysicalDeviceFeatures2 for every optional feature, chaining only the structures the device knows about
+void Context::querySupportedFeatures() {
+    supportedFeatures = SupportedFeatures{};
+    const uint32_t version = std::min(apiVersion, deviceProperties.apiVersion);
+    const auto& extensions = getDeviceExtensionNames(physicalDevice);
+    std::vector<void**> links;
+    vk::PhysicalDeviceFeatures2 features2;
+    const auto link = [&](auto& features, const char* extension, uint32_t coreVersion) {
+        if (extensions.count(extension) != 0 || (coreVersion != 0 && version >= coreVersion)) {
+            features.pNext = features2.pNext;
+            features2.pNext = &features;
+            links.push_back(&features.pNext);
+        }
+    };
+    link(supportedFeatures.timelineSemaphore, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME, VK_MAKE_VERSION(1, 2, 0));
+    link(supportedFeatures.descriptorIndexing, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME, VK_MAKE_VERSION(1, 2, 0));
+    link(supportedFeatures.multiview, VK_KHR_MULTIVIEW_EXTENSION_NAME, VK_MAKE_VERSION(1, 1, 0));
+    link(supportedFeatures.shadingRateImage, VK_NV_SHADING_RATE_IMAGE_EXTENSION_NAME, 0);
+    link(supportedFeatures.conditionalRendering, VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME, 0);
+    link(supportedFeatures.bufferDeviceAddress, VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME, VK_MAKE_VERSION(1, 2, 0));
+    link(supportedFeatures.accelerationStructure, VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME, 0);
+    link(supportedFeatures.rayTracingPipeline, VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME, 0);
+    link(supportedFeatures.rayQuery, VK_KHR_RAY_QUERY_EXTENSION_NAME, 0);
+    link(supportedFeatures.dynamicRendering, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME, VK_MAKE_VERSION(1, 3, 0));
+    link(supportedFeatures.extendedDynamicState, VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME, VK_MAKE_VERSION(1, 3, 0));
+    link(supportedFeatures.extendedDynamicState2, VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME, VK_MAKE_VERSION(1, 3, 0));
+    link(supportedFeatures.extendedDynamicState3, VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME, 0);
+    link(supportedFeatures.synchronization2, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME, VK_MAKE_VERSION(1, 3, 0));
+    link(supportedFeatures.meshShader, VK_EXT_MESH_SHADER_EXTENSION_NAME, 0);
+    link(supportedFeatures.shaderFloat16Int8, VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME, VK_MAKE_VERSION(1, 2, 0));
+    if (links.empty()) {
+        return;
+    }
+    physicalDevice.getFeatures2(&features2, dynamicDispatch);
+    for (auto pNext : links) {
+        *pNext = nullptr;
+    }
+}
+
+namespace {
+std::string toLower(std::string value) {
+    std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    return value;
+}
+}  // namespace
+
+vk::PhysicalDevice Context::pickDefaultDevice(const std::vector<vk::PhysicalDevice>& devices, const vk::SurfaceKHR& surface) const {
+    if (devices.empty()) {
+        throw std::runtime_error("No Vulkan devices found");
+    }
+
+    // An index into the enumerated devices, or part of a device name
+    const char* override = std::getenv("VKX_DEVICE");
+    if (override && *override) {
+        const std::string wanted = override;
+        char* end = nullptr;
+        const unsigned long index = std::strtoul(override, &end, 10);
+        for (size_t i = 0; i < devices.size(); ++i) {
+            const std::string name = devices[i].getProperties().deviceName;
+            if ((*end == 0 && index == i) || (*end != 0 && toLower(name).find(toLower(wanted)) != std::string::npos)) {
+                std::cout << "Using device " << i << ": " << name << " (VKX_DEVICE=" << wanted << ")" << std::endl;
+                return devices[i];
+            }
+        }
+        std::cout << "VKX_DEVICE=" << wanted << " matches no device, picking one" << std::endl;
+    }
+
+    size_t best = devices.size();
+    int64_t bestScore = 0;
+    std::string bestReason;
+    for (size_t i = 0; i < devices.size(); ++i) {
+        const auto& device = devices[i];
+        const auto properties = device.getProperties();
+        const auto families = device.getQueueFamilyProperties();
+        const auto& extensions = getDeviceExtensionNames(device);
+
+        // Unusable devices are skipped
+        bool canPresent = false;
+        for (uint32_t family = 0; family < families.size() && !canPresent; ++family) {
+            canPresent = (families[family].queueFlags & vk::QueueFlagBits::eGraphics) && (!surface || device.getSurfaceSupportKHR(family, surface));
+        }
+        const bool hasExtensions = std::all_of(requiredDeviceExtensions.begin(), requiredDeviceExtensions.end(),
+                                               [&](const std::string& extension) { return extensions.count(extension) != 0; });
+        if (!canPresent || !hasExtensions) {
+            std::cout << "Skipping device " << i << ": " << properties.deviceName << " ("
+                      << (!canPresent ? "no graphics queue that can present" : "missing required device extensions") << ")" << std::endl;
+            continue;
+        }
+
+        std::stringstream reason;
+        int64_t score = 0;
+        switch (properties.deviceType) {
+            case vk::PhysicalDeviceType::eDiscreteGpu:
+                score += 10000;
+                break;
+            case vk::PhysicalDeviceType::eIntegratedGpu:
+                score += 5000;
+                break;
+            case vk::PhysicalDeviceType::eVirtualGpu:
+                score += 2000;
+                break;
+            case vk::PhysicalDeviceType::eCpu:
+                score += 500;
+                break;
+            default:
+                break;
+        }
+        reason << vk::to_string(properties.deviceType);
+
+        // Integrated GPUs may report much of system memory as device local, which the device type outweighs
+        vk::DeviceSize heapSize = 0;
+        const auto memoryProperties = device.getMemoryProperties();
+        for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; ++heap) {
+            if (memoryProperties.memoryHeaps[heap].flags & vk::MemoryHeapFlagBits::eDeviceLocal) {
+                heapSize = std::max(heapSize, memoryProperties.memoryHeaps[heap].size);
+            }
+        }
+        const vk::DeviceSize heapMiB = heapSize >> 20;
+        score += (int64_t)std::min<vk::DeviceSize>(heapMiB >> 10, 32) * 50;
+        reason << ", " << heapMiB << " MiB device local";
+
+        bool asyncCompute = false;
+        bool dedicatedTransfer = false;
+        for (const auto& family : families) {
+            const auto flags = family.queueFlags;
+            asyncCompute |= (flags & vk::QueueFlagBits::eCompute) && !(flags & vk::QueueFlagBits::eGraphics);
+            dedicatedTransfer |= (flags & vk::QueueFlagBits::eTransfer) && !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute));
+        }
+        if (asyncCompute) {
+            score += 500;
+            reason << ", async compute";
+        }
+        if (dedicatedTransfer) {
+            score += 250;
+            reason << ", dedicated transfer";
+        }
+
+        const std::vector<std::pair<bool, const char*>> optional{
+            { enableTimelineSemaphores, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME },
+            { enableBindless, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME },
+            { enableMultiview, VK_KHR_MULTIVIEW_EXTENSION_NAME },
+            { enableShadingRateImage, VK_NV_SHADING_RATE_IMAGE_EXTENSION_NAME },
+            { enableConditionalRendering, VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME },
+            { enableRayTracing, VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME },
+            { enableRayQuery, VK_KHR_RAY_QUERY_EXTENSION_NAME },
+            { enableBufferDeviceAddress, VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME },
+            { enableDepthStencilResolve, VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME },
+            { enableDynamicRendering, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME },
+            { enableExtendedDynamicState, VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME },
+            { enableSynchronization2, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME },
+            { enableMeshShader, VK_EXT_MESH_SHADER_EXTENSION_NAME },
+            { enableDisplayTiming, VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME },
+        };
+        uint32_t optionalCount = 0;
+        for (const auto& feature : optional) {
+            if (feature.first && extensions.count(feature.second) != 0) {
+                ++optionalCount;
+            }
+        }
+        score += optionalCount * 200;
+        if (optionalCount) {
+            reason << ", " << optionalCount << " requested optional features";
+        }
+
+        if (best == devices.size() || score > bestScore) {
+            best = i;
+            bestScore = score;
+            bestReason = reason.str();
+        }
+    }
+
+    if (best == devices.size()) {
+        throw std::runtime_error("No Vulkan device can present and has the required device extensions");
+    }
+    std::cout << "Using device " << best << ": " << devices[best].getProperties().deviceName << " (" << bestReason << ")" << std::endl;
+    return devices[best];
+}
+
+const vk::FormatProperties& Context::getFormatProperties(vk::Format format) const {
+    std::unique_lock<std::mutex> lock(formatPropertiesMutex);
+    auto itr = formatProperties.find(static_cast<VkFormat>(format));
+    if (itr == formatProperties.end()) {
+        itr = formatProperties.insert({ static_cast<VkFormat>(format), physicalDevice.getFormatProperties(format) }).first;
+    }
+    // Elements of an unordered_map stay put when it rehashes, so the reference outlives the lock
+    return itr->second;
+}
+
+Context::MipmapMethod Context::getMipmapMethod(const vk::ImageCreateInfo& imageCreateInfo) const {
+    const vk::FormatFeatureFlags features = getFormatProperties(imageCreateInfo.format).optimalTilingFeatures;
+    const bool canBlit = (features & vk::FormatFeatureFlagBits::eBlitSrc) && (features & vk::FormatFeatureFlagBits::eBlitDst) &&
+                         (imageCreateInfo.usage & vk::ImageUsageFlagBits::eTransferSrc);
+    if (canBlit && (features & vk::FormatFeatureFlagBits::eSampledImageFilterLinear)) {
+        return MipmapMethod::Blit;
+    }
+    const bool canCompute = !mipmapShaderPath.empty() && imageCreateInfo.imageType == vk::ImageType::e2D &&
+                            enabledFeatures.shaderStorageImageWriteWithoutFormat && (features & vk::FormatFeatureFlagBits::eStorageImage) &&
+                            (features & vk::FormatFeatureFlagBits::eSampledImage) && (imageCreateInfo.usage & vk::ImageUsageFlagBits::eStorage) &&
+                            (imageCreateInfo.usage & vk::ImageUsageFlagBits::eSampled);
+    if (canCompute) {
+        return MipmapMethod::Compute;
+    }
+    // Nearest filtering still beats no mips at all
+    return canBlit ? MipmapMethod::Blit : MipmapMethod::None;
+}
+
+void Context::generateMipmaps(const vk::CommandBuffer& commandBuffer,
+                              const vk::Image& image,
+                              const vk::ImageCreateInfo& imageCreateInfo,
+                              vk::ImageLayout finalLayout) const {
+    const uint32_t mipLevels = imageCreateInfo.mipLevels;
+    vk::ImageSubresourceRange range{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, imageCreateInfo.arrayLayers };
+    if (mipLevels == 1) {
+        setImageLayout(commandBuffer, image, vk::ImageLayout::eTransferDstOptimal, finalLayout, range);
+        return;
+    }
+
+    switch (getMipmapMethod(imageCreateInfo)) {
+        case MipmapMethod::Blit: {
+            generateMipmapsBlit(commandBuffer, image, imageCreateInfo);
+            // Every level but the last was the source of a blit
+            range.levelCount = mipLevels - 1;
+            setImageLayout(commandBuffer, image, vk::ImageLayout::eTransferSrcOptimal, finalLayout, range);
+            range.baseMipLevel = mipLevels - 1;
+            range.levelCount = 1;
+            setImageLayout(commandBuffer, image, vk::ImageLayout::eTransferDstOptimal, finalLayout, range);
+            break;
+        }
+        case MipmapMethod::Compute: {
+            generateMipmapsCompute(commandBuffer, image, imageCreateInfo);
+            range.levelCount = mipLevels;
+            vk::ImageMemoryBarrier barrier;
+            barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+            barrier.dstAccessMask = vks::util::accessFlagsForLayout(finalLayout);
+            barrier.oldLayout = vk::ImageLayout::eGeneral;
+            barrier.newLayout = finalLayout;
+            barrier.image = image;
+            barrier.subresourceRange = range;
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vks::util::pipelineStageForLayout(finalLayout), {}, nullptr,
+                                          nullptr, barrier);
+            break;
+        }
+        default:
+            throw std::runtime_error("Unable to generate mipmaps for format " + vk::to_string(imageCreateInfo.format));
+    }
+}
+
+void Context::generateMipmapsBlit(const vk::CommandBuffer& commandBuffer, const vk::Image& image, const vk::ImageCreateInfo& imageCreateInfo) const {
+    const vk::FormatFeatureFlags features = getFormatProperties(imageCreateInfo.format).optimalTilingFeatures;
+    const vk::Filter filter = (features & vk::FormatFeatureFlagBits::eSampledImageFilterLinear) ? vk::Filter::eLinear : vk::Filter::eNearest;
+    const uint32_t layerCount = imageCreateInfo.arrayLayers;
+    vk::ImageSubresourceRange range{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, layerCount };
+    vk::Offset3D size{ (int32_t)imageCreateInfo.extent.width, (int32_t)imageCreateInfo.extent.height, (int32_t)imageCreateInfo.extent.depth };
+    for (uint32_t level = 1; level < imageCreateInfo.mipLevels; ++level) {
+        range.baseMipLevel = level - 1;
+        setImageLayout(commandBuffer, image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal, range);
+        range.baseMipLevel = level;
+        setImageLayout(commandBuffer, image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, range);
+
+        vk::ImageBlit blit;
+        blit.srcSubresource = { vk::ImageAspectFlagBits::eColor, level - 1, 0, layerCount };
+        blit.srcOffsets[1] = size;
+        size = vk::Offset3D{ std::max(size.x / 2, 1), std::max(size.y / 2, 1), std::max(size.z / 2, 1) };
+        blit.dstSubresource = { vk::ImageAspectFlagBits::eColor, level, 0, layerCount };
+        blit.dstOffsets[1] = size;
+        commandBuffer.blitImage(image, vk::ImageLayout::eTransferSrcOptimal, image, vk::ImageLayout::eTransferDstOptimal, blit, filter);
+    }
+}
+
+void Context::generateMipmapsCompute(const vk::CommandBuffer& commandBuffer, const vk::Image& image, const vk::ImageCreateInfo& imageCreateInfo) const {
+    {
+        std::unique_lock<std::mutex> lock(mipmapPipelineMutex);
+        if (!mipmapPipeline.pipeline) {
+            std::vector<vk::DescriptorSetLayoutBinding> bindings{
+                { 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute },
+                { 1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute },
+            };
+            mipmapPipeline.descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)bindings.size(), bindings.data() });
+            mipmapPipeline.pipelineLayout = device.createPipelineLayout({ {}, 1, &mipmapPipeline.descriptorSetLayout });
+            vk::ComputePipelineCreateInfo pipelineCreateInfo;
+            pipelineCreateInfo.layout = mipmapPipeline.pipelineLayout;
+            pipelineCreateInfo.stage = shaders::loadShader(device, mipmapShaderPath, vk::ShaderStageFlagBits::eCompute);
+            mipmapPipeline.pipeline = device.createComputePipeline(pipelineCache, pipelineCreateInfo);
+            device.destroyShaderModule(pipelineCreateInfo.stage.module);
+            // The shader only uses texelFetch, so the sampler's filtering is irrelevant
+            vk::SamplerCreateInfo samplerCreateInfo;
+            samplerCreateInfo.maxAnisotropy = 1.0f;
+            mipmapPipeline.sampler = device.createSampler(samplerCreateInfo);
+        }
+    }
+
+    const uint32_t mipLevels = imageCreateInfo.mipLevels;
+    const uint32_t layerCount = imageCreateInfo.arrayLayers;
+    // Keep every level in the general layout, so one level can be sampled while the next is written
+    vk::ImageSubresourceRange range{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, layerCount };
+    vk::ImageMemoryBarrier barrier;
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+    barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+    barrier.newLayout = vk::ImageLayout::eGeneral;
+    barrier.image = image;
+    barrier.subresourceRange = range;
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, nullptr, barrier);
+    barrier.srcAccessMask = vk::AccessFlags();
+    barrier.dstAccessMask = vk::AccessFlagBits::eShaderWrite;
+    barrier.oldLayout = vk::ImageLayout::eUndefined;
+    barrier.subresourceRange.baseMipLevel = 1;
+    barrier.subresourceRange.levelCount = mipLevels - 1;
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, nullptr, barrier);
+
+    std::vector<vk::DescriptorPoolSize> poolSizes{
+        { vk::DescriptorType::eCombinedImageSampler, mipLevels - 1 },
+        { vk::DescriptorType::eStorageImage, mipLevels - 1 },
+    };
+    const vk::DescriptorPool descriptorPool = device.createDescriptorPool({ {}, mipLevels - 1, (uint32_t)poolSizes.size(), poolSizes.data() });
+    std::vector<vk::DescriptorSetLayout> setLayouts(mipLevels - 1, mipmapPipeline.descriptorSetLayout);
+    const auto descriptorSets = device.allocateDescriptorSets({ descriptorPool, (uint32_t)setLayouts.size(), setLayouts.data() });
+    std::vector<vk::ImageView> views(mipLevels);
+    vk::ImageViewCreateInfo viewCreateInfo;
+    viewCreateInfo.image = image;
+    viewCreateInfo.viewType = vk::ImageViewType::e2DArray;
+    viewCreateInfo.format = imageCreateInfo.format;
+    viewCreateInfo.subresourceRange = range;
+    for (uint32_t level = 0; level < mipLevels; ++level) {
+        viewCreateInfo.subresourceRange.baseMipLevel = level;
+        views[level] = device.createImageView(viewCreateInfo);
+    }
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, mipmapPipeline.pipeline);
+    uint32_t width = imageCreateInfo.extent.width, height = imageCreateInfo.extent.height;
+    for (uint32_t level = 1; level < mipLevels; ++level) {
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+        const vk::DescriptorSet& descriptorSet = descriptorSets[level - 1];
+        vk::DescriptorImageInfo sourceInfo{ mipmapPipeline.sampler, views[level - 1], vk::ImageLayout::eGeneral };
+        vk::DescriptorImageInfo targetInfo{ nullptr, views[level], vk::ImageLayout::eGeneral };
+        std::vector<vk::WriteDescriptorSet> writes{
+            { descriptorSet, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &sourceInfo },
+            { descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageImage, &targetInfo },
+        };
+        device.updateDescriptorSets(writes, nullptr);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, mipmapPipeline.pipelineLayout, 0, descriptorSet, nullptr);
+        commandBuffer.dispatch((width + 7) / 8, (height + 7) / 8, layerCount);
+        // The next level reads this one
+        barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+        barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+        barrier.oldLayout = vk::ImageLayout::eGeneral;
+        barrier.subresourceRange.baseMipLevel = level;
+        barrier.subresourceRange.levelCount = 1;
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, nullptr,
+                                      barrier);
+    }
+
+    // The views and sets only have to live until the commands have executed
+    for (const auto& view : views) {
+        trash(view);
+    }
+    trash(descriptorPool);
+}
+
+void Context::destroyMipmapPipeline() {
+    if (mipmapPipeline.pipeline) {
+        device.destroyPipeline(mipmapPipeline.pipeline);
+        device.destroyPipelineLayout(mipmapPipeline.pipelineLayout);
+        device.destroyDescriptorSetLayout(mipmapPipeline.descriptorSetLayout);
+        device.destroySampler(mipmapPipeline.sampler);
+        mipmapPipeline = MipmapPipeline();
+    }
+}
 
 #if 0
 #if defined(__ANDROID__)
@@ -1,10 +1,15 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <functional>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <queue>
 
@@ -14,10 +19,25 @@
 #include <vulkan/vulkan.hpp>
 
 #include "forward.hpp"
+#include "bindless.hpp"
+#include "commandstats.hpp"
 #include "debug.hpp"
+#include "allocator.hpp"
 #include "image.hpp"
+#include "barriers.hpp"
 #include "buffer.hpp"
+#include "staging.hpp"
+#include "fences.hpp"
+#include "commandpools.hpp"
+#include "submitbatch.hpp"
+#include "deletion.hpp"
+#include "descriptors.hpp"
+#include "shaders.hpp"
+#include "samplers.hpp"
+#include "glsl.hpp"
 #include "helpers.hpp"
+#include "startup.hpp"
+#include "trace.hpp"
 
 namespace vks {
 
@@ -31,6 +51,8 @@ using InstanceExtensionsPickerFunction = std::function<std::set<std::string>()>;
 using InstanceExtensionsPickerFunctions = std::list<InstanceExtensionsPickerFunction>;
 using LayerVector = std::vector<const char*>;
 using MipData = ::std::pair<vk::Extent3D, vk::DeviceSize>;
+// Identifies a batch of uploads made on the transfer queue.  Tickets increase monotonically, and 0 is always complete
+using UploadTicket = uint64_t;
 
 namespace queues {
 
@@ -84,10 +106,74 @@ struct DeviceCreateInfo : public vk::DeviceCreateInfo {
 //
 // Finally, an application can call the recycle function at regular intervals (perhaps once per frame, perhaps less often)
 // in order to check the fences and execute the associated destructors for any that are signalled.
+//
+// Plain handles, command buffers, vks::Buffer and vks::Image don't go through the dumpster at all.  They're queued in
+// the typed vectors of a DeletionQueue, and emptying the dumpster closes the current batch of them along with it.
 using VoidLambda = std::function<void()>;
 using VoidLambdaList = std::list<VoidLambda>;
-using FencedLambda = std::pair<vk::Fence, VoidLambda>;
-using FencedLambdaQueue = std::queue<FencedLambda>;
+
+// Fixed capacity FIFO of fences and the destructors waiting on them.  Slots and their destructor vectors are
+// reused, so once warmed up, migrating and retiring batches doesn't allocate.
+class FencedLambdaRing {
+public:
+    explicit FencedLambdaRing(size_t capacity = 64)
+        : slots(capacity) {}
+
+    bool empty() const { return count == 0; }
+    bool full() const { return count == slots.size(); }
+    const vk::Fence& frontFence() const { return slots[head].fence; }
+    const vk::Fence& backFence() const { return slots[(head + count - 1) % slots.size()].fence; }
+
+    // The destructors to run once `fence` signals.  Consecutive pushes with the same fence share a slot, otherwise
+    // the ring must not be full.
+    std::vector<VoidLambda>& push(const vk::Fence& fence) {
+        if (empty() || backFence() != fence) {
+            assert(!full());
+            auto& slot = slots[(head + count) % slots.size()];
+            slot.fence = fence;
+            ++count;
+        }
+        return slots[(head + count - 1) % slots.size()].lambdas;
+    }
+
+    // Remove the oldest slot, swapping its destructors into `outLambdas` (which should be empty, so that the
+    // slot keeps a vector with capacity for next time)
+    vk::Fence pop(std::vector<VoidLambda>& outLambdas) {
+        auto& slot = slots[head];
+        vk::Fence fence = slot.fence;
+        slot.fence = vk::Fence();
+        outLambdas.swap(slot.lambdas);
+        head = (head + 1) % slots.size();
+        --count;
+        return fence;
+    }
+
+private:
+    struct Slot {
+        vk::Fence fence;
+        std::vector<VoidLambda> lambdas;
+    };
+    std::vector<Slot> slots;
+    size_t head{ 0 };
+    size_t count{ 0 };
+};
+
+// A value on a queue's timeline semaphore (VK_KHR_timeline_semaphore).  The value is reached once the submission
+// it was handed out for, and every earlier submission to the same queue, has completed.
+struct TimelinePoint {
+    vk::Semaphore semaphore;
+    uint64_t value{ 0 };
+
+    explicit operator bool() const { return (bool)semaphore; }
+};
+
+struct TimelineWait {
+    TimelinePoint point;
+    vk::PipelineStageFlags stages;
+};
+
+using TimelineLambda = std::pair<TimelinePoint, VoidLambda>;
+using TimelineLambdaList = std::list<TimelineLambda>;
 
 struct Context {
 private:
@@ -110,7 +196,7 @@ private:
     }
 
     static CStringVector filterLayers(const StringList& desiredLayers) {
-        static std::set<std::string> validLayerNames = getAvailableLayers();
+        const auto& validLayerNames = getAvailableLayers();
         CStringVector result;
         for (const auto& string : desiredLayers) {
             if (validLayerNames.count(string) != 0) {
@@ -121,25 +207,13 @@ private:
     }
 
 public:
-    // Create application wide Vulkan instance
-    static std::set<std::string> getAvailableLayers() {
-        std::set<std::string> result;
-        auto layers = vk::enumerateInstanceLayerProperties();
-        for (auto layer : layers) {
-            result.insert(layer.layerName);
-        }
-        return result;
-    }
+    // Instance layers and extensions are enumerated once per process, and the extensions of each physical device once
+    // per instance, so that the lookups below are hash lookups after the first
+    static const std::unordered_set<std::string>& getAvailableLayers();
 
     static std::vector<vk::ExtensionProperties> getExtensions() { return vk::enumerateInstanceExtensionProperties(); }
 
-    static std::set<std::string> getExtensionNames() {
-        std::set<std::string> extensionNames;
-        for (auto& ext : getExtensions()) {
-            extensionNames.insert(ext.extensionName);
-        }
-        return extensionNames;
-    }
+    static const std::unordered_set<std::string>& getExtensionNames();
 
     static bool isExtensionPresent(const std::string& extensionName) { return getExtensionNames().count(extensionName) != 0; }
 
@@ -147,13 +221,7 @@ public:
         return physicalDevice.enumerateDeviceExtensionProperties();
     }
 
-    static std::set<std::string> getDeviceExtensionNames(const vk::PhysicalDevice& physicalDevice) {
-        std::set<std::string> extensionNames;
-        for (auto& ext : getDeviceExtensions(physicalDevice)) {
-            extensionNames.insert(ext.extensionName);
-        }
-        return extensionNames;
-    }
+    static const std::unordered_set<std::string>& getDeviceExtensionNames(const vk::PhysicalDevice& physicalDevice);
 
     static bool isDeviceExtensionPresent(const vk::PhysicalDevice& physicalDevice, const std::string& extension) {
         return getDeviceExtensionNames(physicalDevice).count(extension) != 0;
@@ -169,6 +237,7 @@ public:
 
     void addInstanceExtensionPicker(const InstanceExtensionsPickerFunction& function) { instanceExtensionsPickers.push_back(function); }
 
+    // Replaces the default choice of physical device, see pickDefaultDevice
     void setDevicePicker(const DevicePickerFunction& picker) { devicePicker = picker; }
 
     void setDeviceFeaturesPicker(const DeviceFeaturesPickerFunction& picker) { deviceFeaturesPicker = picker; }
@@ -192,6 +261,7 @@ public:
         appInfo.pApplicationName = "VulkanExamples";
         appInfo.pEngineName = "VulkanExamples";
         appInfo.apiVersion = version;
+        apiVersion = version;
 
         std::set<std::string> instanceExtensions;
         instanceExtensions.insert(requiredExtensions.begin(), requiredExtensions.end());
@@ -233,38 +303,123 @@ public:
         pickDevice(surface);
         buildDevice();
         dynamicDispatch.init(instance, &vkGetInstanceProcAddr, device, &vkGetDeviceProcAddr);
+        // Before anything is recorded or submitted, see vks/commandstats.hpp
+        commandstats::install(device);
 
 
         if (enableDebugMarkers) {
             debug::marker::setup(instance, device);
         }
 
-        pipelineCache = device.createPipelineCache(vk::PipelineCacheCreateInfo());
+        // Ray tracing and GPU driven scenes read buffers through their device addresses, which any block may back
+        allocator = std::make_shared<Allocator>(physicalDevice, device, Allocator::DEFAULT_BLOCK_SIZE,
+                                                bufferDeviceAddressEnabled ? vk::MemoryAllocateFlags{ vk::MemoryAllocateFlagBits::eDeviceAddress }
+                                                                           : vk::MemoryAllocateFlags{});
+        if (memoryBudgetEnabled) {
+            allocator->setBudgetQuery([this](std::vector<vk::DeviceSize>& budgets, std::vector<vk::DeviceSize>& usages) {
+                const auto properties =
+                    physicalDevice.getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2, vk::PhysicalDeviceMemoryBudgetPropertiesEXT>(dynamicDispatch);
+                const auto& budget = properties.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+                for (size_t heap = 0; heap < budgets.size(); ++heap) {
+                    budgets[heap] = budget.heapBudget[heap];
+                    usages[heap] = budget.heapUsage[heap];
+                }
+            });
+        }
+        stagingRing.buffer = createBuffer(vk::BufferUsageFlagBits::eTransferSrc,
+                                          vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, stagingRingSize);
+        stagingRing.buffer.map();
+        stagingRing.capacity = stagingRingSize;
+        fencePool = std::make_shared<FencePool>(device);
+        pipelineCache = loadPipelineCache();
+        shaderModuleCache = std::make_shared<shaders::ModuleCache>(device);
+        layoutCache = std::make_shared<LayoutCache>(device);
+        samplerCache = std::make_shared<SamplerCache>(device);
+        if (enableShaderCompiler || enableShaderHotReload) {
+            auto compiler = std::make_shared<shaders::GlslCompiler>(shaderCachePath);
+            if (enableShaderHotReload) {
+                shaderWatcher = std::make_shared<shaders::ShaderWatcher>(compiler);
+            }
+            shaderModuleCache->setCompiler(compiler, shaderWatcher);
+        }
+        if (bindlessEnabled) {
+            bindless = std::make_shared<BindlessTable>();
+            bindless->create(*this);
+        }
         // Find a queue that supports graphics operations
 
         // Get the graphics queue
         queue = device.getQueue(queueIndices.graphics, 0);
+        // Transfer queue uploads are only worthwhile if the transfer queue is in a separate family
+        if (queueIndices.transfer != VK_QUEUE_FAMILY_IGNORED && queueIndices.transfer != queueIndices.graphics) {
+            transferQueue = device.getQueue(queueIndices.transfer, 0);
+        }
     }
 
     void destroy() {
         if (queue) {
-            queue.waitIdle();
+            flushUploads(true);
         }
+        flushSubmits();
         device.waitIdle();
         for (const auto& trash : dumpster) {
             trash();
         }
 
-        while (!recycler.empty()) {
+        while (!recycler.empty() || !timelineRecycler.empty()) {
             recycle();
         }
+        deletions.destroyAll(device);
+        for (const auto& timeline : timelines) {
+            device.destroySemaphore(timeline.second.semaphore);
+        }
+        timelines.clear();
 
         destroyCommandPool();
+        if (uploadCommandPool) {
+            device.destroyCommandPool(uploadCommandPool);
+            uploadCommandPool = vk::CommandPool();
+        }
+        if (transferCommandPool) {
+            device.destroyCommandPool(transferCommandPool);
+            transferCommandPool = vk::CommandPool();
+        }
+        stagingRing.destroy();
+        destroyMipmapPipeline();
+        if (bindless) {
+            bindless->destroy();
+            bindless.reset();
+        }
+        savePipelineCache();
         device.destroyPipelineCache(pipelineCache);
+        shaderWatcher.reset();
+        if (layoutCache) {
+            layoutCache->destroy();
+            layoutCache.reset();
+        }
+        // After the layouts, which may hold cached samplers as immutable samplers
+        if (samplerCache) {
+            samplerCache->destroy();
+            samplerCache.reset();
+        }
+        if (shaderModuleCache) {
+            shaderModuleCache->destroy();
+            shaderModuleCache.reset();
+        }
+        if (fencePool) {
+            fencePool->destroy();
+            fencePool.reset();
+        }
+        if (allocator) {
+            allocator->destroy();
+            allocator.reset();
+        }
         device.destroy();
         if (enableValidation) {
             debug::freeDebugCallback(instance);
         }
+        // Handles of a later instance's physical devices may repeat these ones
+        clearDeviceExtensionNames();
         instance.destroy();
     }
 
@@ -322,48 +477,186 @@ public:
     }
 
     //
-    // Convenience functions for trashing specific types.  These functions know what kind of function
-    // call to make for destroying a given Vulkan object.
+    // Convenience functions for trashing specific types.  These know how to destroy the object, so
+    // they're queued in the typed deletion queues instead of the dumpster.
     //
 
-    void trashPipeline(vk::Pipeline& pipeline) const {
-        trash<vk::Pipeline>(pipeline, [this](vk::Pipeline pipeline) { device.destroyPipeline(pipeline); });
-    }
+    void trash(const vk::Buffer& value) const { deletions.push(value); }
+    void trash(const vk::BufferView& value) const { deletions.push(value); }
+    void trash(const vk::Image& value) const { deletions.push(value); }
+    void trash(const vk::ImageView& value) const { deletions.push(value); }
+    void trash(const vk::Sampler& value) const { deletions.push(value); }
+    void trash(const vk::DeviceMemory& value) const { deletions.push(value); }
+    void trash(const vk::Framebuffer& value) const { deletions.push(value); }
+    void trash(const vk::RenderPass& value) const { deletions.push(value); }
+    void trash(const vk::Pipeline& value) const { deletions.push(value); }
+    void trash(const vk::PipelineLayout& value) const { deletions.push(value); }
+    void trash(const vk::DescriptorSetLayout& value) const { deletions.push(value); }
+    void trash(const vk::DescriptorPool& value) const { deletions.push(value); }
+    void trash(const vk::ShaderModule& value) const { deletions.push(value); }
+    void trash(const vk::Semaphore& value) const { deletions.push(value); }
+    void trash(const vk::Event& value) const { deletions.push(value); }
+    void trash(const vk::QueryPool& value) const { deletions.push(value); }
+    void trash(const vks::Buffer& value) const { deletions.push(value); }
+    void trash(const vks::Image& value) const { deletions.push(value); }
+    // The command buffer must have been allocated from this thread's getCommandPool()
+    void trash(const vk::CommandBuffer& value) const { deletions.push(getCommandPool(), value); }
+
+    void trashPipeline(vk::Pipeline& pipeline) const { deletions.push(pipeline); }
 
     void trashCommandBuffers(const vk::CommandPool& commandPool, std::vector<vk::CommandBuffer>& cmdBuffers) const {
-        std::function<void(const std::vector<vk::CommandBuffer>& t)> destructor = [=](const std::vector<vk::CommandBuffer>& cmdBuffers) {
-            device.freeCommandBuffers(commandPool, cmdBuffers);
-        };
-        trashAll(cmdBuffers, destructor);
+        for (const auto& cmdBuffer : cmdBuffers) {
+            deletions.push(commandPool, cmdBuffer);
+        }
+        cmdBuffers.clear();
     }
 
+    // For callers that track completion themselves, such as per frame fences: ends the current batch of typed
+    // deletions and returns its index, to be passed to completeDeletions once the device is done with everything
+    // submitted so far.  Returns DeletionQueue::NONE if nothing was queued.
+    uint64_t closeDeletions() const { return deletions.close(); }
+    void completeDeletions(uint64_t index) const { deletions.complete(device, index); }
+
     // Should be called from time to time by the application to migrate zombie resources
     // to the recycler along with a fence that will be signalled when the objects are
-    // safe to delete.
-    void emptyDumpster(vk::Fence fence) {
+    // safe to delete.  The recycler takes ownership of `fence` and returns it to the fence pool.
+    void emptyDumpster(vk::Fence fence) const {
+        const uint64_t index = deletions.close();
+        // Even with nothing to release, the fence is about to be submitted with, so it only goes back to the pool
+        // once recycle() has seen it signal
+        auto& lambdas = pushRecycler(fence);
+        for (auto& lambda : dumpster) {
+            lambdas.push_back(std::move(lambda));
+        }
+        dumpster.clear();
+        if (index != DeletionQueue::NONE) {
+            lambdas.push_back([this, index] { deletions.complete(device, index); });
+        }
+    }
+
+    // As above, but the objects are released once `point` is reached instead of when a fence signals
+    void emptyDumpster(const TimelinePoint& point) const {
         VoidLambdaList newDumpster;
         newDumpster.swap(dumpster);
-        recycler.push(FencedLambda{ fence, [newDumpster] {
-                                       for (const auto& f : newDumpster) {
-                                           f();
-                                       }
-                                   } });
+        const uint64_t index = deletions.close();
+        timelineRecycler.push_back(TimelineLambda{ point, [this, newDumpster, index] {
+                                                      for (const auto& f : newDumpster) {
+                                                          f();
+                                                      }
+                                                      deletions.complete(device, index);
+                                                  } });
     }
 
-    // Check the recycler fences for signalled status.  Any that are signalled will have their corresponding
-    // lambdas executed, freeing up the associated resources
-    void recycle() {
-        while (!recycler.empty() && vk::Result::eSuccess == device.getFenceStatus(recycler.front().first)) {
-            vk::Fence fence = recycler.front().first;
-            VoidLambda lambda = recycler.front().second;
-            recycler.pop();
+    // Check the recycler fences and timelines for signalled status.  Any that are signalled will have their
+    // corresponding lambdas executed, freeing up the associated resources
+    void recycle() const {
+        VKS_TRACE_ZONE("Context::recycle");
+        std::vector<VoidLambda> lambdas;
+        while (!recycler.empty() && vk::Result::eSuccess == device.getFenceStatus(recycler.frontFence())) {
+            vk::Fence fence = recycler.pop(lambdas);
+            for (const auto& lambda : lambdas) {
+                lambda();
+            }
+            lambdas.clear();
+            if (recycler.empty() || fence != recycler.frontFence()) {
+                fencePool->release(fence);
+            }
+        }
 
+        // Entries on different queues complete independently, so each one is checked rather than stopping at the first
+        std::vector<std::pair<vk::Semaphore, uint64_t>> reached;
+        for (auto itr = timelineRecycler.begin(); itr != timelineRecycler.end();) {
+            const TimelinePoint& point = itr->first;
+            auto reachedItr = std::find_if(reached.begin(), reached.end(), [&](const std::pair<vk::Semaphore, uint64_t>& entry) {
+                return entry.first == point.semaphore;
+            });
+            if (reachedItr == reached.end()) {
+                reached.push_back({ point.semaphore, device.getSemaphoreCounterValueKHR(point.semaphore, dynamicDispatch) });
+                reachedItr = reached.end() - 1;
+            }
+            if (reachedItr->second < point.value) {
+                ++itr;
+                continue;
+            }
+            VoidLambda lambda = itr->second;
+            itr = timelineRecycler.erase(itr);
             lambda();
+        }
+    }
 
-            if (recycler.empty() || fence != recycler.front().first) {
-                device.destroyFence(fence);
-            }
+    //
+    // Timeline semaphores
+    //
+    // When timelineSemaphoresEnabled is set, every queue submitted to through the functions below gets a timeline
+    // semaphore whose value counts the submissions made to it.  Work on one queue can wait for work on another by
+    // waiting on getTimeline(otherQueue), so no binary semaphores need to be created and paired between queues,
+    // and completion can be tested without a fence per submission.
+    //
+
+    // The most recent value handed out on `queue`'s timeline.  Null if nothing has been submitted with a timeline
+    TimelinePoint getTimeline(const vk::Queue& queue) const {
+        std::unique_lock<std::recursive_mutex> lock(timelineMutex);
+        auto itr = timelines.find(static_cast<VkQueue>(queue));
+        if (itr == timelines.end()) {
+            return TimelinePoint{};
+        }
+        return itr->second;
+    }
+
+    // Reserve the next value on `queue`'s timeline.  The caller must signal it from its next submission to `queue`,
+    // and reservations on the same queue must be submitted in the order they were made.
+    TimelinePoint nextTimelinePoint(const vk::Queue& queue) const {
+        if (!timelineSemaphoresEnabled) {
+            throw std::runtime_error("Timeline semaphores are not enabled");
+        }
+        std::unique_lock<std::recursive_mutex> lock(timelineMutex);
+        TimelinePoint& timeline = timelines[static_cast<VkQueue>(queue)];
+        if (!timeline.semaphore) {
+            vk::SemaphoreTypeCreateInfoKHR typeInfo{ vk::SemaphoreTypeKHR::eTimeline, 0 };
+            vk::SemaphoreCreateInfo createInfo;
+            createInfo.pNext = &typeInfo;
+            timeline.semaphore = device.createSemaphore(createInfo);
+        }
+        ++timeline.value;
+        return timeline;
+    }
+
+    bool isComplete(const TimelinePoint& point) const {
+        return !point || device.getSemaphoreCounterValueKHR(point.semaphore, dynamicDispatch) >= point.value;
+    }
+
+    void waitTimeline(const TimelinePoint& point, uint64_t timeout = UINT64_MAX) const {
+        if (!point) {
+            return;
         }
+        // The submission signalling it may still be held back
+        flushSubmits();
+        vk::SemaphoreWaitInfoKHR waitInfo;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &point.semaphore;
+        waitInfo.pValues = &point.value;
+        device.waitSemaphoresKHR(waitInfo, timeout, dynamicDispatch);
+    }
+
+    // Submit `submitInfo` to `queue` after `waits` as well as any binary semaphores it already waits on, signalling
+    // and returning the next value of the queue's timeline along with any binary semaphores it already signals.
+    // Also signals `fence`, if given.
+    TimelinePoint submitTimeline(const vk::Queue& queue,
+                                 const vk::SubmitInfo& submitInfo,
+                                 const vk::ArrayProxy<const TimelineWait>& waits = {},
+                                 const vk::Fence& fence = vk::Fence()) const {
+        flushUploads();
+        return submitToTimeline(queue, submitInfo, waits, fence);
+    }
+
+    TimelinePoint submitTimeline(const vk::Queue& queue,
+                                 const vk::ArrayProxy<const vk::CommandBuffer>& commandBuffers,
+                                 const vk::ArrayProxy<const TimelineWait>& waits = {},
+                                 const vk::Fence& fence = vk::Fence()) const {
+        vk::SubmitInfo info;
+        info.commandBufferCount = commandBuffers.size();
+        info.pCommandBuffers = commandBuffers.data();
+        return submitTimeline(queue, info, waits, fence);
     }
 
     // Create an image memory barrier for changing the layout of
@@ -411,6 +704,14 @@ public:
         setImageLayout(cmdbuffer, image, oldImageLayout, newImageLayout, subresourceRange);
     }
 
+    // Transition all of `image` from whatever vks::Barriers last tracked it being used for, with a barrier that only
+    // waits for and makes visible what that and `usage` need, if any
+    void setImageLayout(vk::CommandBuffer cmdbuffer, vks::Image& image, ImageUsage usage, bool discard = false) const {
+        Barriers barriers;
+        barriers.image(image, usage, discard);
+        barriers.record(cmdbuffer, *this);
+    }
+
     void setImageLayout(vk::Image image, vk::ImageLayout oldImageLayout, vk::ImageLayout newImageLayout, vk::ImageSubresourceRange subresourceRange) const {
         withPrimaryCommandBuffer([&](const auto& commandBuffer) { setImageLayout(commandBuffer, image, oldImageLayout, newImageLayout, subresourceRange); });
     }
@@ -425,11 +726,7 @@ protected:
         // Physical device
         physicalDevices = instance.enumeratePhysicalDevices();
 
-        // Note :
-        // This example will always use the first physical device reported,
-        // change the vector index if you have multiple Vulkan devices installed
-        // and want to use another one
-        physicalDevice = devicePicker(physicalDevices);
+        physicalDevice = devicePicker ? devicePicker(physicalDevices) : pickDefaultDevice(physicalDevices, surface);
         struct Version {
             uint32_t patch : 12;
             uint32_t minor : 10;
@@ -441,6 +738,13 @@ protected:
         deviceProperties = physicalDevice.getProperties();
         memcpy(&_version, &deviceProperties.apiVersion, sizeof(uint32_t));
         deviceFeatures = physicalDevice.getFeatures();
+        querySupportedFeatures();
+        // Subgroup properties are core in Vulkan 1.1 and stay zeroed on older devices or instances
+        subgroupProperties = vk::PhysicalDeviceSubgroupProperties{};
+        if (std::min(apiVersion, deviceProperties.apiVersion) >= VK_MAKE_VERSION(1, 1, 0)) {
+            subgroupProperties = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceSubgroupProperties>(dynamicDispatch)
+                                     .get<vk::PhysicalDeviceSubgroupProperties>();
+        }
         // Gather physical device memory properties
         deviceMemoryProperties = physicalDevice.getMemoryProperties();
         queueIndices.graphics = findQueue(vk::QueueFlagBits::eGraphics, surface);
@@ -453,6 +757,254 @@ protected:
         vks::queues::DeviceCreateInfo deviceCreateInfo;
 
         deviceFeaturesPicker(physicalDevice, enabledFeatures2);
+        timelineSemaphoresEnabled = false;
+        if (enableTimelineSemaphores && isDeviceExtensionPresent(physicalDevice, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)) {
+            if (supportedFeatures.timelineSemaphore.timelineSemaphore) {
+                timelineSemaphoreFeatures = vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR{};
+                timelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+                timelineSemaphoreFeatures.pNext = enabledFeatures2.pNext;
+                enabledFeatures2.pNext = &timelineSemaphoreFeatures;
+                requiredDeviceExtensions.insert(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+                timelineSemaphoresEnabled = true;
+            }
+        }
+        bindlessEnabled = false;
+        if (enableBindless && isDeviceExtensionPresent(physicalDevice, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)) {
+            const auto& supported = supportedFeatures.descriptorIndexing;
+            if (supported.runtimeDescriptorArray && supported.descriptorBindingPartiallyBound && supported.descriptorBindingUpdateUnusedWhilePending &&
+                supported.descriptorBindingSampledImageUpdateAfterBind && supported.descriptorBindingStorageBufferUpdateAfterBind &&
+                supported.shaderSampledImageArrayNonUniformIndexing) {
+                descriptorIndexingFeatures = vk::PhysicalDeviceDescriptorIndexingFeaturesEXT{};
+                descriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+                descriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+                descriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+                descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+                descriptorIndexingFeatures.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+                descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+                descriptorIndexingFeatures.shaderStorageBufferArrayNonUniformIndexing = supported.shaderStorageBufferArrayNonUniformIndexing;
+                descriptorIndexingFeatures.pNext = enabledFeatures2.pNext;
+                enabledFeatures2.pNext = &descriptorIndexingFeatures;
+                requiredDeviceExtensions.insert(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+                requiredDeviceExtensions.insert(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+                bindlessEnabled = true;
+            }
+        }
+        multiviewEnabled = false;
+        if (enableMultiview && isDeviceExtensionPresent(physicalDevice, VK_KHR_MULTIVIEW_EXTENSION_NAME)) {
+            if (supportedFeatures.multiview.multiview) {
+                multiviewFeatures = vk::PhysicalDeviceMultiviewFeatures{};
+                multiviewFeatures.multiview = VK_TRUE;
+                multiviewFeatures.pNext = enabledFeatures2.pNext;
+                enabledFeatures2.pNext = &multiviewFeatures;
+                requiredDeviceExtensions.insert(VK_KHR_MULTIVIEW_EXTENSION_NAME);
+                multiviewProperties = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceMultiviewProperties>(dynamicDispatch)
+                                          .get<vk::PhysicalDeviceMultiviewProperties>();
+                multiviewEnabled = true;
+            }
+        }
+        shadingRateImageEnabled = false;
+        if (enableShadingRateImage && isDeviceExtensionPresent(physicalDevice, VK_NV_SHADING_RATE_IMAGE_EXTENSION_NAME)) {
+            if (supportedFeatures.shadingRateImage.shadingRateImage) {
+                shadingRateImageFeatures = vk::PhysicalDeviceShadingRateImageFeaturesNV{};
+                shadingRateImageFeatures.shadingRateImage = VK_TRUE;
+                shadingRateImageFeatures.pNext = enabledFeatures2.pNext;
+                enabledFeatures2.pNext = &shadingRateImageFeatures;
+                requiredDeviceExtensions.insert(VK_NV_SHADING_RATE_IMAGE_EXTENSION_NAME);
+                shadingRateImageProperties =
+                    physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceShadingRateImagePropertiesNV>(dynamicDispatch)
+                        .get<vk::PhysicalDeviceShadingRateImagePropertiesNV>();
+                shadingRateImageEnabled = true;
+            }
+        }
+        conditionalRenderingEnabled = false;
+        if (enableConditionalRendering && isDeviceExtensionPresent(physicalDevice, VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME)) {
+            if (supportedFeatures.conditionalRendering.conditionalRendering) {
+                conditionalRenderingFeatures = vk::PhysicalDeviceConditionalRenderingFeaturesEXT{};
+                conditionalRenderingFeatures.conditionalRendering = VK_TRUE;
+                conditionalRenderingFeatures.pNext = enabledFeatures2.pNext;
+                enabledFeatures2.pNext = &conditionalRenderingFeatures;
+                requiredDeviceExtensions.insert(VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME);
+                conditionalRenderingEnabled = true;
+            }
+        }
+        rayTracingEnabled = false;
+        rayQueryEnabled = false;
+        accelerationStructuresEnabled = false;
+        if ((enableRayTracing || enableRayQuery) && isDeviceExtensionPresent(physicalDevice, VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME)) {
+            const bool rayTracingSupported = enableRayTracing && supportedFeatures.rayTracingPipeline.rayTracingPipeline;
+            const bool rayQuerySupported = enableRayQuery && supportedFeatures.rayQuery.rayQuery;
+            if (supportedFeatures.bufferDeviceAddress.bufferDeviceAddress && supportedFeatures.accelerationStructure.accelerationStructure &&
+                (rayTracingSupported || rayQuerySupported)) {
+                accelerationStructureFeatures = vk::PhysicalDeviceAccelerationStructureFeaturesKHR{};
+                accelerationStructureFeatures.accelerationStructure = VK_TRUE;
+                accelerationStructureFeatures.pNext = enabledFeatures2.pNext;
+                enabledFeatures2.pNext = &accelerationStructureFeatures;
+                // The extensions acceleration structures depend on, ray queries and ray tracing pipelines also need SPIR-V 1.4.
+                // Buffer device addresses are enabled below
+                requiredDeviceExtensions.insert({ VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME, VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME,
+                                                  VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME, VK_KHR_MAINTENANCE3_EXTENSION_NAME,
+                                                  VK_KHR_SPIRV_1_4_EXTENSION_NAME, VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME });
+                auto properties = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceRayTracingPipelinePropertiesKHR,
+                                                                vk::PhysicalDeviceAccelerationStructurePropertiesKHR>(dynamicDispatch);
+                accelerationStructureProperties = properties.get<vk::PhysicalDeviceAccelerationStructurePropertiesKHR>();
+                accelerationStructureProperties.pNext = nullptr;
+                accelerationStructuresEnabled = true;
+                if (rayTracingSupported) {
+                    rayTracingPipelineFeatures = vk::PhysicalDeviceRayTracingPipelineFeaturesKHR{};
+                    rayTracingPipelineFeatures.rayTracingPipeline = VK_TRUE;
+                    rayTracingPipelineFeatures.pNext = enabledFeatures2.pNext;
+                    enabledFeatures2.pNext = &rayTracingPipelineFeatures;
+                    requiredDeviceExtensions.insert(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME);
+                    rayTracingPipelineProperties = properties.get<vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>();
+                    rayTracingPipelineProperties.pNext = nullptr;
+                    rayTracingEnabled = true;
+                }
+                if (rayQuerySupported) {
+                    rayQueryFeatures = vk::PhysicalDeviceRayQueryFeaturesKHR{};
+                    rayQueryFeatures.rayQuery = VK_TRUE;
+                    rayQueryFeatures.pNext = enabledFeatures2.pNext;
+                    enabledFeatures2.pNext = &rayQueryFeatures;
+                    requiredDeviceExtensions.insert(VK_KHR_RAY_QUERY_EXTENSION_NAME);
+                    rayQueryEnabled = true;
+                }
+            }
+        }
+        // Acceleration structures are built from and read through buffer device addresses, so they enable them as well
+        bufferDeviceAddressEnabled = false;
+        if ((enableBufferDeviceAddress || accelerationStructuresEnabled) &&
+            isDeviceExtensionPresent(physicalDevice, VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME) &&
+            supportedFeatures.bufferDeviceAddress.bufferDeviceAddress) {
+            bufferDeviceAddressFeatures = vk::PhysicalDeviceBufferDeviceAddressFeatures{};
+            bufferDeviceAddressFeatures.bufferDeviceAddress = VK_TRUE;
+            bufferDeviceAddressFeatures.pNext = enabledFeatures2.pNext;
+            enabledFeatures2.pNext = &bufferDeviceAddressFeatures;
+            requiredDeviceExtensions.insert(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME);
+            bufferDeviceAddressEnabled = true;
+        }
+        depthStencilResolveEnabled = false;
+        if (enableDepthStencilResolve && isDeviceExtensionPresent(physicalDevice, VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME) &&
+            isDeviceExtensionPresent(physicalDevice, VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME)) {
+            // Render pass 2 only needs the multiview and maintenance2 extensions, not their features
+            requiredDeviceExtensions.insert({ VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME, VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME,
+                                              VK_KHR_MULTIVIEW_EXTENSION_NAME, VK_KHR_MAINTENANCE2_EXTENSION_NAME });
+            depthStencilResolveProperties =
+                physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDepthStencilResolveProperties>(dynamicDispatch)
+                    .get<vk::PhysicalDeviceDepthStencilResolveProperties>();
+            depthStencilResolveProperties.pNext = nullptr;
+            depthStencilResolveEnabled = true;
+        }
+        conservativeRasterizationEnabled = false;
+        if (enableConservativeRasterization && isDeviceExtensionPresent(physicalDevice, VK_EXT_CONSERVATIVE_RASTERIZATION_EXTENSION_NAME)) {
+            // Only adds pipeline state, there are no features to enable
+            requiredDeviceExtensions.insert(VK_EXT_CONSERVATIVE_RASTERIZATION_EXTENSION_NAME);
+            conservativeRasterizationProperties =
+                physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceConservativeRasterizationPropertiesEXT>(dynamicDispatch)
+                    .get<vk::PhysicalDeviceConservativeRasterizationPropertiesEXT>();
+            conservativeRasterizationProperties.pNext = nullptr;
+            conservativeRasterizationEnabled = true;
+        }
+        shaderViewportIndexLayerEnabled = false;
+        if (enableShaderViewportIndexLayer && isDeviceExtensionPresent(physicalDevice, VK_EXT_SHADER_VIEWPORT_INDEX_LAYER_EXTENSION_NAME)) {
+            // Only lets vertex and tessellation shaders write gl_ViewportIndex and gl_Layer, there are no features to enable
+            requiredDeviceExtensions.insert(VK_EXT_SHADER_VIEWPORT_INDEX_LAYER_EXTENSION_NAME);
+            shaderViewportIndexLayerEnabled = true;
+        }
+        dynamicRenderingEnabled = false;
+        if (enableDynamicRendering && isDeviceExtensionPresent(physicalDevice, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)) {
+            if (supportedFeatures.dynamicRendering.dynamicRendering) {
+                dynamicRenderingFeatures = vk::PhysicalDeviceDynamicRenderingFeaturesKHR{};
+                dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
+                dynamicRenderingFeatures.pNext = enabledFeatures2.pNext;
+                enabledFeatures2.pNext = &dynamicRenderingFeatures;
+                // Dynamic rendering depends on depth stencil resolves, and through them on render pass 2
+                requiredDeviceExtensions.insert({ VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME, VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME,
+                                                  VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME, VK_KHR_MULTIVIEW_EXTENSION_NAME,
+                                                  VK_KHR_MAINTENANCE2_EXTENSION_NAME });
+                dynamicRenderingEnabled = true;
+            }
+        }
+        extendedDynamicStateEnabled = false;
+        extendedDynamicState2Enabled = false;
+        dynamicPolygonModeEnabled = false;
+        if (enableExtendedDynamicState && isDeviceExtensionPresent(physicalDevice, VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME) &&
+            supportedFeatures.extendedDynamicState.extendedDynamicState) {
+            extendedDynamicStateFeatures = vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT{};
+            extendedDynamicStateFeatures.extendedDynamicState = VK_TRUE;
+            extendedDynamicStateFeatures.pNext = enabledFeatures2.pNext;
+            enabledFeatures2.pNext = &extendedDynamicStateFeatures;
+            requiredDeviceExtensions.insert(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+            extendedDynamicStateEnabled = true;
+            // The later extensions each add a few more states, and are used where they're there
+            if (isDeviceExtensionPresent(physicalDevice, VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME) &&
+                supportedFeatures.extendedDynamicState2.extendedDynamicState2) {
+                extendedDynamicState2Features = vk::PhysicalDeviceExtendedDynamicState2FeaturesEXT{};
+                extendedDynamicState2Features.extendedDynamicState2 = VK_TRUE;
+                extendedDynamicState2Features.pNext = enabledFeatures2.pNext;
+                enabledFeatures2.pNext = &extendedDynamicState2Features;
+                requiredDeviceExtensions.insert(VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME);
+                extendedDynamicState2Enabled = true;
+            }
+            if (isDeviceExtensionPresent(physicalDevice, VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME) &&
+                supportedFeatures.extendedDynamicState3.extendedDynamicState3PolygonMode) {
+                extendedDynamicState3Features = vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT{};
+                extendedDynamicState3Features.extendedDynamicState3PolygonMode = VK_TRUE;
+                extendedDynamicState3Features.pNext = enabledFeatures2.pNext;
+                enabledFeatures2.pNext = &extendedDynamicState3Features;
+                requiredDeviceExtensions.insert(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+                dynamicPolygonModeEnabled = true;
+            }
+        }
+        synchronization2Enabled = false;
+        if (enableSynchronization2 && isDeviceExtensionPresent(physicalDevice, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME) &&
+            supportedFeatures.synchronization2.synchronization2) {
+            synchronization2Features = vk::PhysicalDeviceSynchronization2FeaturesKHR{};
+            synchronization2Features.synchronization2 = VK_TRUE;
+            synchronization2Features.pNext = enabledFeatures2.pNext;
+            enabledFeatures2.pNext = &synchronization2Features;
+            requiredDeviceExtensions.insert(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+            synchronization2Enabled = true;
+        }
+        meshShaderEnabled = false;
+        if (enableMeshShader && isDeviceExtensionPresent(physicalDevice, VK_EXT_MESH_SHADER_EXTENSION_NAME) &&
+            std::min(apiVersion, deviceProperties.apiVersion) >= VK_MAKE_VERSION(1, 1, 0) && supportedFeatures.meshShader.taskShader &&
+            supportedFeatures.meshShader.meshShader) {
+            meshShaderFeatures = vk::PhysicalDeviceMeshShaderFeaturesEXT{};
+            meshShaderFeatures.taskShader = VK_TRUE;
+            meshShaderFeatures.meshShader = VK_TRUE;
+            meshShaderFeatures.pNext = enabledFeatures2.pNext;
+            enabledFeatures2.pNext = &meshShaderFeatures;
+            // Mesh shaders are SPIR-V 1.4, which VK_KHR_spirv_1_4 allows on Vulkan 1.1
+            requiredDeviceExtensions.insert({ VK_EXT_MESH_SHADER_EXTENSION_NAME, VK_KHR_SPIRV_1_4_EXTENSION_NAME, VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME });
+            meshShaderProperties = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceMeshShaderPropertiesEXT>(dynamicDispatch)
+                                       .get<vk::PhysicalDeviceMeshShaderPropertiesEXT>();
+            meshShaderProperties.pNext = nullptr;
+            meshShaderEnabled = true;
+        }
+        shaderFloat16Enabled = false;
+        if (enableShaderFloat16 && isDeviceExtensionPresent(physicalDevice, VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME) &&
+            supportedFeatures.shaderFloat16Int8.shaderFloat16) {
+            // Only the arithmetic, 16 bit inputs and buffers would need the storage features of VK_KHR_16bit_storage too
+            shaderFloat16Int8Features = vk::PhysicalDeviceShaderFloat16Int8FeaturesKHR{};
+            shaderFloat16Int8Features.shaderFloat16 = VK_TRUE;
+            shaderFloat16Int8Features.pNext = enabledFeatures2.pNext;
+            enabledFeatures2.pNext = &shaderFloat16Int8Features;
+            requiredDeviceExtensions.insert(VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME);
+            shaderFloat16Enabled = true;
+        }
+        displayTimingEnabled = enableDisplayTiming && isDeviceExtensionPresent(physicalDevice, VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+        if (displayTimingEnabled) {
+            requiredDeviceExtensions.insert(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+        }
+        // Only read by the allocator, through vkGetPhysicalDeviceMemoryProperties2, which is core in Vulkan 1.1
+        memoryBudgetEnabled = std::min(apiVersion, deviceProperties.apiVersion) >= VK_MAKE_VERSION(1, 1, 0) &&
+                              isDeviceExtensionPresent(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        if (memoryBudgetEnabled) {
+            requiredDeviceExtensions.insert(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+        calibratedTimestampsEnabled = isDeviceExtensionPresent(physicalDevice, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+        if (calibratedTimestampsEnabled) {
+            requiredDeviceExtensions.insert(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+        }
         if (enabledFeatures2.pNext) {
             deviceCreateInfo.pNext = &enabledFeatures2;
         } else {
@@ -493,6 +1045,8 @@ protected:
 public:
     // Vulkan instance, stores all per-application states
     vk::Instance instance;
+    // The API version the instance was created for
+    uint32_t apiVersion{ 0 };
     std::vector<vk::PhysicalDevice> physicalDevices;
     // Physical device (GPU) that Vulkan will ise
     vk::PhysicalDevice physicalDevice;
@@ -503,6 +1057,34 @@ public:
     vk::PhysicalDeviceProperties deviceProperties;
     // Stores phyiscal device features (for e.g. checking if a feature is available)
     vk::PhysicalDeviceFeatures deviceFeatures;
+    // Set along with deviceProperties on Vulkan 1.1 devices, see supportsSubgroupOperations
+    vk::PhysicalDeviceSubgroupProperties subgroupProperties;
+    // The optional features createDevice can enable, set along with deviceFeatures in one query.  Features of
+    // extensions the device doesn't have, and that aren't core in its version, stay zeroed.  The structures aren't
+    // chained to each other.
+    struct SupportedFeatures {
+        vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphore;
+        vk::PhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexing;
+        vk::PhysicalDeviceMultiviewFeatures multiview;
+        vk::PhysicalDeviceShadingRateImageFeaturesNV shadingRateImage;
+        vk::PhysicalDeviceConditionalRenderingFeaturesEXT conditionalRendering;
+        vk::PhysicalDeviceBufferDeviceAddressFeatures bufferDeviceAddress;
+        vk::PhysicalDeviceAccelerationStructureFeaturesKHR accelerationStructure;
+        vk::PhysicalDeviceRayTracingPipelineFeaturesKHR rayTracingPipeline;
+        vk::PhysicalDeviceRayQueryFeaturesKHR rayQuery;
+        vk::PhysicalDeviceDynamicRenderingFeaturesKHR dynamicRendering;
+        vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicState;
+        vk::PhysicalDeviceExtendedDynamicState2FeaturesEXT extendedDynamicState2;
+        vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT extendedDynamicState3;
+        vk::PhysicalDeviceSynchronization2FeaturesKHR synchronization2;
+        vk::PhysicalDeviceMeshShaderFeaturesEXT meshShader;
+        vk::PhysicalDeviceShaderFloat16Int8FeaturesKHR shaderFloat16Int8;
+    } supportedFeatures;
+
+    // True if shaders of `stage` can use all of `operations` in their subgroups
+    bool supportsSubgroupOperations(vk::ShaderStageFlagBits stage, const vk::SubgroupFeatureFlags& operations) const {
+        return (subgroupProperties.supportedStages & stage) && (subgroupProperties.supportedOperations & operations) == operations;
+    }
 
     vk::PhysicalDeviceFeatures2 enabledFeatures2;
     vk::PhysicalDeviceFeatures& enabledFeatures = enabledFeatures2.features;
@@ -512,6 +1094,41 @@ public:
     vk::Device device;
     // vk::Pipeline cache object
     vk::PipelineCache pipelineCache;
+    // File the pipeline cache is seeded from in createDevice and written back to in destroy.  Empty disables persistence
+    std::string pipelineCachePath;
+    // Set by createDevice if compatible cache data was loaded from pipelineCachePath
+    bool pipelineCacheWarm{ false };
+    // Directory Model::loadFromFile keeps baked meshes in, created on first use.  Empty disables the mesh cache
+    std::string modelCachePath;
+    // Directory vkx::pbr keeps the image based lighting maps it generated in, as KTX files.  Empty disables the cache
+    std::string textureCachePath;
+    // Compute shader generateMipmaps downsamples with, for formats that can't be blitted.  Empty disables the compute path
+    std::string mipmapShaderPath;
+    // Texture and storage buffer arrays shared by all pipelines, created by createDevice when bindlessEnabled.  The
+    // texture loaders register every texture they create in it, see Texture::bindlessIndex
+    std::shared_ptr<BindlessTable> bindless;
+    // Sub-allocates the memory behind createBuffer / createImage out of large per memory type blocks
+    std::shared_ptr<Allocator> allocator;
+    // Fences for the context's own submissions and for the recycler, also used by SwapChain::getSubmitFence
+    std::shared_ptr<FencePool> fencePool;
+    // Shared by every GraphicsPipelineBuilder on `device`, so pipeline variants built from the same SPIR-V reuse one module
+    std::shared_ptr<shaders::ModuleCache> shaderModuleCache;
+    // Descriptor set and pipeline layouts shared by everything defining the same ones, see
+    // vks::shaders::ShaderLayout for making them from the shaders
+    std::shared_ptr<LayoutCache> layoutCache;
+    // Samplers shared by every texture sampled the same way, see vks::acquireSampler
+    std::shared_ptr<SamplerCache> samplerCache;
+    // Compile the GLSL sources next to the SPIR-V files the shader module cache loads at runtime, instead of reading
+    // the SPIR-V, see vks::shaders::GlslCompiler.  Must be set before createDevice
+    bool enableShaderCompiler{ false };
+    // Also watch the sources for changes, see shaderWatcher.  Must be set before createDevice
+    bool enableShaderHotReload{ false };
+    // Directory the compiled SPIR-V is cached in.  Empty disables the cache
+    std::string shaderCachePath;
+    // With enableShaderHotReload, reports the SPIR-V files whose sources changed and recompiled
+    std::shared_ptr<shaders::ShaderWatcher> shaderWatcher;
+    // Size of the persistently mapped staging ring used for batched uploads.  Must be set before createDevice
+    vk::DeviceSize stagingRingSize{ 32 * 1024 * 1024 };
     // Helper for accessing functionality not available in the statically linked Vulkan library
     vk::DispatchLoaderDynamic dynamicDispatch;
 
@@ -522,22 +1139,41 @@ public:
     } queueIndices;
 
     vk::Queue queue;
+    // Only populated when the device has a transfer capable queue family other than the graphics family
+    vk::Queue transferQueue;
 
+    // When set, Texture2D and Model loads go through the transfer queue.  Callers must check the
+    // `uploadTicket` of the loaded object with isUploadComplete before using it for rendering.
+    bool asyncUploads{ false };
+
+    // Each thread gets its own command pool, so worker threads can record without any locking.  Command
+    // buffers must only be allocated, recorded or freed on the thread (or while no other thread is using the pool)
+    // that owns their pool.  Pools are per context as well, for threads working with contexts of several devices.
     vk::CommandPool getCommandPool() const {
-        if (!s_cmdPool) {
+        auto& pool = s_cmdPools[contextId];
+        if (!pool) {
             vk::CommandPoolCreateInfo cmdPoolInfo;
             cmdPoolInfo.queueFamilyIndex = queueIndices.graphics;
             cmdPoolInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
-            s_cmdPool = device.createCommandPool(cmdPoolInfo);
+            pool = device.createCommandPool(cmdPoolInfo);
+            std::unique_lock<std::mutex> lock(threadCommandPoolsMutex);
+            threadCommandPools.push_back(pool);
         }
-        return s_cmdPool;
+        return pool;
     }
 
+    // Destroys the pools of every thread that has called getCommandPool or withPrimaryCommandBuffer, and the frame
+    // command pools
     void destroyCommandPool() const {
-        if (s_cmdPool) {
-            device.destroyCommandPool(s_cmdPool);
-            s_cmdPool = vk::CommandPool();
+        std::unique_lock<std::mutex> lock(threadCommandPoolsMutex);
+        for (const auto& pool : threadCommandPools) {
+            device.destroyCommandPool(pool);
         }
+        threadCommandPools.clear();
+        // Other threads keep their entries, which no later context shares the id of
+        s_cmdPools.erase(contextId);
+        s_immediatePools.erase(contextId);
+        frameCommandPools.destroy();
     }
 
     std::vector<vk::CommandBuffer> allocateCommandBuffers(uint32_t count, vk::CommandBufferLevel level = vk::CommandBufferLevel::ePrimary) const {
@@ -564,7 +1200,9 @@ public:
         if (!commandBuffer) {
             return;
         }
-        queue.submit(vk::SubmitInfo{ 0, nullptr, nullptr, 1, &commandBuffer }, vk::Fence());
+        flushUploads();
+        submitBatched(queue, vk::SubmitInfo{ 0, nullptr, nullptr, 1, &commandBuffer });
+        flushSubmits();
         queue.waitIdle();
         device.waitIdle();
     }
@@ -572,69 +1210,134 @@ public:
     // Create a short lived command buffer which is immediately executed and released
     // This function is intended for initialization only.  It incurs a queue and device
     // flush and may impact performance if used in non-setup code
+    //
+    // The command buffers come from a transient pool of the calling thread's, which is reset as a whole rather than
+    // freeing them one by one.  Calls may nest.
     void withPrimaryCommandBuffer(const std::function<void(const vk::CommandBuffer& commandBuffer)>& f) const {
-        vk::CommandBuffer commandBuffer = createCommandBuffer(vk::CommandBufferLevel::ePrimary);
+        ImmediateCommandPool& immediate = getImmediateCommandPool();
+        vk::CommandBuffer commandBuffer = immediate.pool.allocate();
+        ImmediateCommandPool::ScopedCall call(immediate);
         commandBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
         f(commandBuffer);
         commandBuffer.end();
         flushCommandBuffer(commandBuffer);
-        device.freeCommandBuffers(getCommandPool(), commandBuffer);
+        call.finish();
     }
 
     Image createImage(const vk::ImageCreateInfo& imageCreateInfo,
                       const vk::MemoryPropertyFlags& memoryPropertyFlags = vk::MemoryPropertyFlagBits::eDeviceLocal) const {
         Image result;
-        result.device = device;
-        result.image = device.createImage(imageCreateInfo);
+        auto image = device.createImage(imageCreateInfo);
+        vk::MemoryRequirements memReqs = device.getImageMemoryRequirements(image);
+        auto kind = imageCreateInfo.tiling == vk::ImageTiling::eLinear ? Allocator::ResourceKind::Linear : Allocator::ResourceKind::Optimal;
+        static_cast<Allocation&>(result) = allocator->allocate(memReqs, memoryPropertyFlags, kind);
+        result.image = image;
+        result.format = imageCreateInfo.format;
+        result.extent = imageCreateInfo.extent;
+        result.mipLevels = imageCreateInfo.mipLevels;
+        result.arrayLayers = imageCreateInfo.arrayLayers;
+        device.bindImageMemory(result.image, result.memory, result.offset);
+        return result;
+    }
+
+    // For attachments that never leave tile memory, which get eTransientAttachment usage.  Their memory is lazily
+    // allocated where the device has such memory for the image, so that it's only backed if the implementation runs
+    // out of tile memory, and device local otherwise.
+    Image createTransientImage(vk::ImageCreateInfo imageCreateInfo) const {
+        imageCreateInfo.usage |= vk::ImageUsageFlagBits::eTransientAttachment;
+        Image result;
+        auto image = device.createImage(imageCreateInfo);
+        vk::MemoryRequirements memReqs = device.getImageMemoryRequirements(image);
+        uint32_t typeIndex;
+        const vk::MemoryPropertyFlags memoryPropertyFlags =
+            getMemoryType(memReqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eLazilyAllocated, &typeIndex) ? vk::MemoryPropertyFlagBits::eLazilyAllocated
+                                                                                                           : vk::MemoryPropertyFlagBits::eDeviceLocal;
+        static_cast<Allocation&>(result) = allocator->allocate(memReqs, memoryPropertyFlags, Allocator::ResourceKind::Optimal);
+        result.image = image;
         result.format = imageCreateInfo.format;
         result.extent = imageCreateInfo.extent;
-        vk::MemoryRequirements memReqs = device.getImageMemoryRequirements(result.image);
-        vk::MemoryAllocateInfo memAllocInfo;
-        memAllocInfo.allocationSize = result.allocSize = memReqs.size;
-        memAllocInfo.memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
-        result.memory = device.allocateMemory(memAllocInfo);
-        device.bindImageMemory(result.image, result.memory, 0);
+        result.mipLevels = imageCreateInfo.mipLevels;
+        result.arrayLayers = imageCreateInfo.arrayLayers;
+        device.bindImageMemory(result.image, result.memory, result.offset);
         return result;
     }
 
+    // If `ticket` is provided and the device has a separate transfer queue family the upload is made on the
+    // transfer queue and ownership is handed back to the graphics family once it completes.  In that case
+    // the image must not be used until isUploadComplete(*ticket) returns true.  Otherwise `*ticket` is 0.
     Image stageToDeviceImage(vk::ImageCreateInfo imageCreateInfo,
                              const vk::MemoryPropertyFlags& memoryPropertyFlags,
                              vk::DeviceSize size,
                              const void* data,
                              const std::vector<MipData>& mipData = {},
-                             const vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal) const {
-        Buffer staging = createStagingBuffer(size, data);
+                             const vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal,
+                             UploadTicket* ticket = nullptr) const {
+        VKS_TRACE_ZONE("Context::stageToDeviceImage");
+        startup::ScopedPhase startupPhase(startup::Phase::Upload);
         imageCreateInfo.usage = imageCreateInfo.usage | vk::ImageUsageFlagBits::eTransferDst;
         Image result = createImage(imageCreateInfo, memoryPropertyFlags);
+        vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, imageCreateInfo.mipLevels, 0, 1);
+
+        std::vector<vk::BufferImageCopy> bufferCopyRegions;
+        {
+            vk::BufferImageCopy bufferCopyRegion;
+            bufferCopyRegion.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+            bufferCopyRegion.imageSubresource.layerCount = 1;
+            if (!mipData.empty()) {
+                for (uint32_t i = 0; i < imageCreateInfo.mipLevels; i++) {
+                    bufferCopyRegion.imageSubresource.mipLevel = i;
+                    bufferCopyRegion.imageExtent = mipData[i].first;
+                    bufferCopyRegions.push_back(bufferCopyRegion);
+                    bufferCopyRegion.bufferOffset += mipData[i].second;
+                }
+            } else {
+                bufferCopyRegion.imageExtent = imageCreateInfo.extent;
+                bufferCopyRegions.push_back(bufferCopyRegion);
+            }
+        }
 
-        withPrimaryCommandBuffer([&](const vk::CommandBuffer& copyCmd) {
-            vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, imageCreateInfo.mipLevels, 0, 1);
+        auto recordCopy = [&](const vk::CommandBuffer& copyCmd, const vk::Buffer& staging, vk::DeviceSize stagingOffset) {
+            for (auto& region : bufferCopyRegions) {
+                region.bufferOffset += stagingOffset;
+            }
             // Prepare for transfer
             setImageLayout(copyCmd, result.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, range);
+            copyCmd.copyBufferToImage(staging, result.image, vk::ImageLayout::eTransferDstOptimal, bufferCopyRegions);
+        };
 
-            // Prepare for transfer
-            std::vector<vk::BufferImageCopy> bufferCopyRegions;
-            {
-                vk::BufferImageCopy bufferCopyRegion;
-                bufferCopyRegion.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-                bufferCopyRegion.imageSubresource.layerCount = 1;
-                if (!mipData.empty()) {
-                    for (uint32_t i = 0; i < imageCreateInfo.mipLevels; i++) {
-                        bufferCopyRegion.imageSubresource.mipLevel = i;
-                        bufferCopyRegion.imageExtent = mipData[i].first;
-                        bufferCopyRegions.push_back(bufferCopyRegion);
-                        bufferCopyRegion.bufferOffset += mipData[i].second;
-                    }
-                } else {
-                    bufferCopyRegion.imageExtent = imageCreateInfo.extent;
-                    bufferCopyRegions.push_back(bufferCopyRegion);
-                }
+        if (ticket && hasTransferQueue()) {
+            // The layout transition to the final layout is part of the ownership transfer, and must be
+            // identical in the release and acquire halves
+            vk::ImageMemoryBarrier barrier;
+            barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+            barrier.newLayout = layout;
+            barrier.srcQueueFamilyIndex = queueIndices.transfer;
+            barrier.dstQueueFamilyIndex = queueIndices.graphics;
+            barrier.image = result.image;
+            barrier.subresourceRange = range;
+            *ticket = stageUploadAsync(
+                size, data, getImageStagingAlignment(),
+                [&](const vk::CommandBuffer& copyCmd, const vk::Buffer& staging, vk::DeviceSize stagingOffset) {
+                    recordCopy(copyCmd, staging, stagingOffset);
+                    auto release = barrier;
+                    release.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+                    copyCmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, nullptr, release);
+                },
+                [&](const vk::CommandBuffer& acquireCmd) {
+                    auto acquire = barrier;
+                    acquire.dstAccessMask = vks::util::accessFlagsForLayout(layout);
+                    acquireCmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vks::util::pipelineStageForLayout(layout), {}, nullptr, nullptr, acquire);
+                });
+        } else {
+            if (ticket) {
+                *ticket = 0;
             }
-            copyCmd.copyBufferToImage(staging.buffer, result.image, vk::ImageLayout::eTransferDstOptimal, bufferCopyRegions);
-            // Prepare for shader read
-            setImageLayout(copyCmd, result.image, vk::ImageLayout::eTransferDstOptimal, layout, range);
-        });
-        staging.destroy();
+            stageUpload(size, data, getImageStagingAlignment(), [&](const vk::CommandBuffer& copyCmd, const vk::Buffer& staging, vk::DeviceSize stagingOffset) {
+                recordCopy(copyCmd, staging, stagingOffset);
+                // Prepare for shader read
+                setImageLayout(copyCmd, result.image, vk::ImageLayout::eTransferDstOptimal, layout, range);
+            });
+        }
         return result;
     }
 
@@ -651,35 +1354,53 @@ public:
     Image stageToDeviceImage(const vk::ImageCreateInfo& imageCreateInfo,
                              const vk::MemoryPropertyFlags& memoryPropertyFlags,
                              const gli::texture2d& tex2D,
-                             const vk::ImageLayout& layout) const {
+                             const vk::ImageLayout& layout,
+                             UploadTicket* ticket = nullptr) const {
         std::vector<MipData> mips;
         for (size_t i = 0; i < imageCreateInfo.mipLevels; ++i) {
             const auto& mip = tex2D[i];
             const auto dims = mip.extent();
             mips.push_back({ vk::Extent3D{ (uint32_t)dims.x, (uint32_t)dims.y, 1 }, (uint32_t)mip.size() });
         }
-        return stageToDeviceImage(imageCreateInfo, memoryPropertyFlags, (vk::DeviceSize)tex2D.size(), tex2D.data(), mips, layout);
+        return stageToDeviceImage(imageCreateInfo, memoryPropertyFlags, (vk::DeviceSize)tex2D.size(), tex2D.data(), mips, layout, ticket);
     }
 
-    Buffer createBuffer(const vk::BufferUsageFlags& usageFlags, const vk::MemoryPropertyFlags& memoryPropertyFlags, vk::DeviceSize size) const {
+    // With more than one distinct family in `queueFamilies` the buffer is shared concurrently between them, so
+    // queues of those families can use it without ownership transfers
+    Buffer createBuffer(const vk::BufferUsageFlags& usageFlags,
+                        const vk::MemoryPropertyFlags& memoryPropertyFlags,
+                        vk::DeviceSize size,
+                        std::vector<uint32_t> queueFamilies = {}) const {
         Buffer result;
         result.device = device;
-        result.size = size;
         result.descriptor.range = VK_WHOLE_SIZE;
         result.descriptor.offset = 0;
 
         vk::BufferCreateInfo bufferCreateInfo;
         bufferCreateInfo.usage = usageFlags;
+        // Buffers shaders can read get an address too, staging and readback buffers don't need one
+        if (bufferDeviceAddressEnabled && (usageFlags & vk::BufferUsageFlags(ADDRESSABLE_BUFFER_USAGE))) {
+            bufferCreateInfo.usage |= vk::BufferUsageFlagBits::eShaderDeviceAddress;
+        }
         bufferCreateInfo.size = size;
+        std::sort(queueFamilies.begin(), queueFamilies.end());
+        queueFamilies.erase(std::unique(queueFamilies.begin(), queueFamilies.end()), queueFamilies.end());
+        if (queueFamilies.size() > 1) {
+            bufferCreateInfo.sharingMode = vk::SharingMode::eConcurrent;
+            bufferCreateInfo.queueFamilyIndexCount = (uint32_t)queueFamilies.size();
+            bufferCreateInfo.pQueueFamilyIndices = queueFamilies.data();
+        }
 
         result.descriptor.buffer = result.buffer = device.createBuffer(bufferCreateInfo);
 
         vk::MemoryRequirements memReqs = device.getBufferMemoryRequirements(result.buffer);
-        vk::MemoryAllocateInfo memAlloc;
-        result.allocSize = memAlloc.allocationSize = memReqs.size;
-        memAlloc.memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
-        result.memory = device.allocateMemory(memAlloc);
-        device.bindBufferMemory(result.buffer, result.memory, 0);
+        static_cast<Allocation&>(result) = allocator->allocate(memReqs, memoryPropertyFlags, Allocator::ResourceKind::Linear);
+        result.size = size;
+        result.usageFlags = bufferCreateInfo.usage;
+        device.bindBufferMemory(result.buffer, result.memory, result.offset);
+        if (bufferCreateInfo.usage & vk::BufferUsageFlagBits::eShaderDeviceAddress) {
+            result.address = getBufferAddress(result.buffer);
+        }
         return result;
     }
 
@@ -687,7 +1408,9 @@ public:
         auto result =
             createBuffer(vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, size);
         if (data != nullptr) {
-            copyToMemory(result.memory, data, size);
+            result.map();
+            result.copy(size, data);
+            result.unmap();
         }
         return result;
     }
@@ -696,6 +1419,12 @@ public:
         return createBuffer(usageFlags, vk::MemoryPropertyFlagBits::eDeviceLocal, size);
     }
 
+    // Only with bufferDeviceAddressEnabled, for buffers created with eShaderDeviceAddress usage.  createBuffer adds it
+    // and sets Buffer::address for the usages in ADDRESSABLE_BUFFER_USAGE
+    vk::DeviceAddress getBufferAddress(const vk::Buffer& buffer) const {
+        return device.getBufferAddressKHR(vk::BufferDeviceAddressInfo{ buffer }, dynamicDispatch);
+    }
+
     template <typename T>
     Buffer createStagingBuffer(const std::vector<T>& data) const {
         return createStagingBuffer(data.size() * sizeof(T), (void*)data.data());
@@ -727,6 +1456,8 @@ public:
         return result;
     }
 
+    // Only valid for memory allocated directly with vkAllocateMemory.  Allocations made through `allocator`
+    // share persistently mapped blocks and should be written through Allocation::map / copy instead.
     void copyToMemory(const vk::DeviceMemory& memory, const void* data, vk::DeviceSize size, vk::DeviceSize offset = 0) const {
         void* mapped = device.mapMemory(memory, offset, size, vk::MemoryMapFlags());
         memcpy(mapped, data, size);
@@ -743,17 +1474,45 @@ public:
         copyToMemory(memory, data.data(), data.size() * sizeof(T), offset);
     }
 
-    Buffer stageToDeviceBuffer(const vk::BufferUsageFlags& usage, size_t size, const void* data) const {
-        Buffer staging = createStagingBuffer(size, data);
+    // See stageToDeviceImage for the meaning of `ticket`
+    Buffer stageToDeviceBuffer(const vk::BufferUsageFlags& usage, size_t size, const void* data, UploadTicket* ticket = nullptr) const {
+        VKS_TRACE_ZONE("Context::stageToDeviceBuffer");
+        startup::ScopedPhase startupPhase(startup::Phase::Upload);
         Buffer result = createDeviceBuffer(usage | vk::BufferUsageFlagBits::eTransferDst, size);
-        withPrimaryCommandBuffer([&](vk::CommandBuffer copyCmd) { copyCmd.copyBuffer(staging.buffer, result.buffer, vk::BufferCopy(0, 0, size)); });
-        staging.destroy();
+        auto recordCopy = [&](const vk::CommandBuffer& copyCmd, const vk::Buffer& staging, vk::DeviceSize stagingOffset) {
+            copyCmd.copyBuffer(staging, result.buffer, vk::BufferCopy(stagingOffset, 0, size));
+        };
+        if (ticket && hasTransferQueue()) {
+            vk::BufferMemoryBarrier barrier;
+            barrier.srcQueueFamilyIndex = queueIndices.transfer;
+            barrier.dstQueueFamilyIndex = queueIndices.graphics;
+            barrier.buffer = result.buffer;
+            barrier.size = VK_WHOLE_SIZE;
+            *ticket = stageUploadAsync(
+                size, data, 4,
+                [&](const vk::CommandBuffer& copyCmd, const vk::Buffer& staging, vk::DeviceSize stagingOffset) {
+                    recordCopy(copyCmd, staging, stagingOffset);
+                    auto release = barrier;
+                    release.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+                    copyCmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, release, nullptr);
+                },
+                [&](const vk::CommandBuffer& acquireCmd) {
+                    auto acquire = barrier;
+                    acquire.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
+                    acquireCmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr, acquire, nullptr);
+                });
+        } else {
+            if (ticket) {
+                *ticket = 0;
+            }
+            stageUpload(size, data, 4, recordCopy);
+        }
         return result;
     }
 
     template <typename T>
-    Buffer stageToDeviceBuffer(const vk::BufferUsageFlags& usage, const std::vector<T>& data) const {
-        return stageToDeviceBuffer(usage, sizeof(T) * data.size(), data.data());
+    Buffer stageToDeviceBuffer(const vk::BufferUsageFlags& usage, const std::vector<T>& data, UploadTicket* ticket = nullptr) const {
+        return stageToDeviceBuffer(usage, sizeof(T) * data.size(), data.data(), ticket);
     }
 
     template <typename T>
@@ -761,6 +1520,248 @@ public:
         return stageToDeviceBuffer(usage, sizeof(T), (void*)&data);
     }
 
+    //
+    // Batched uploads
+    //
+    // The stageToDevice* functions don't submit anything themselves.  Their source data is copied into
+    // a persistently mapped staging ring and the copy commands are recorded into a pending batch command
+    // buffer.  The batch is submitted to `queue` by flushUploads, which is called automatically before any
+    // other submission made through the context, so work submitted afterwards on the same queue will see
+    // the uploaded data.  Ring space and the batch command buffer are reclaimed through the recycler once
+    // the batch fence signals.
+    //
+    // Uploads larger than half the ring fall back to a temporary staging buffer owned by the batch.
+    //
+
+    using UploadRecorder = std::function<void(const vk::CommandBuffer& commandBuffer, const vk::Buffer& staging, vk::DeviceSize stagingOffset)>;
+
+    // Copy `size` bytes of `data` into staging memory aligned to `alignment` and let `record` add the
+    // transfer commands that consume it to the pending upload batch.
+    void stageUpload(vk::DeviceSize size, const void* data, vk::DeviceSize alignment, const UploadRecorder& record) const {
+        stageUploadInPlace(size, [&](uint8_t* staging) { memcpy(staging, data, size); }, alignment, record);
+    }
+
+    using UploadWriter = std::function<void(uint8_t* staging)>;
+
+    // Like stageUpload, with `write` filling the `size` bytes of staging memory itself, so data that has to be decoded
+    // first can be decoded straight into it.  `write` may spread the work over other threads but must not stage
+    // uploads from them.
+    void stageUploadInPlace(vk::DeviceSize size, const UploadWriter& write, vk::DeviceSize alignment, const UploadRecorder& record) const {
+        std::unique_lock<std::recursive_mutex> lock(uploadMutex);
+        vk::Buffer staging;
+        vk::DeviceSize stagingOffset = 0;
+        bool ring = size <= stagingRing.capacity / 2;
+        vk::DeviceSize reserved = 0;
+        while (ring && !stagingRing.allocate(size, alignment, stagingOffset, reserved)) {
+            // Waiting for ring space means submitting and waiting on the queue, which only the rendering thread
+            // may do while anything stages uploads in the background
+            if (backgroundUploads) {
+                ring = false;
+                break;
+            }
+            // The ring is exhausted, so submit what we have and wait for the GPU to hand space back
+            auto used = stagingRing.used;
+            flushUploads(true);
+            recycle();
+            if (stagingRing.used == used) {
+                throw std::runtime_error("Unable to reclaim staging ring space");
+            }
+        }
+        if (!ring) {
+            // Owned by the batch before `write` runs, so that nothing leaks if it throws
+            Buffer temporary = createStagingBuffer(size);
+            pendingUploads.temporaryBuffers.push_back(temporary);
+            write(temporary.map<uint8_t>());
+            temporary.unmap();
+            staging = temporary.buffer;
+        } else {
+            pendingUploads.ringBytes += reserved;
+            write(stagingRing.data() + stagingOffset);
+            staging = stagingRing.buffer.buffer;
+        }
+        record(getUploadCommandBuffer(), staging, stagingOffset);
+    }
+
+    // Marks the lifetime of a load staging uploads on another thread than the one rendering, see AssetManager.
+    // Staging never submits or waits on a queue meanwhile, on any thread.
+    class ScopedBackgroundUploads {
+    public:
+        explicit ScopedBackgroundUploads(const Context& context)
+            : context(context) {
+            ++context.backgroundUploads;
+        }
+        ~ScopedBackgroundUploads() { --context.backgroundUploads; }
+
+        ScopedBackgroundUploads(const ScopedBackgroundUploads&) = delete;
+        ScopedBackgroundUploads& operator=(const ScopedBackgroundUploads&) = delete;
+
+    private:
+        const Context& context;
+    };
+
+    // stageToDeviceBuffer with `write` filling the staging memory, see stageUploadInPlace, for data that is generated
+    // rather than copied
+    Buffer stageToDeviceBufferInPlace(const vk::BufferUsageFlags& usage, vk::DeviceSize size, const UploadWriter& write) const {
+        VKS_TRACE_ZONE("Context::stageToDeviceBufferInPlace");
+        startup::ScopedPhase startupPhase(startup::Phase::Upload);
+        Buffer result = createDeviceBuffer(usage | vk::BufferUsageFlagBits::eTransferDst, size);
+        stageUploadInPlace(size, write, 4, [&](const vk::CommandBuffer& copyCmd, const vk::Buffer& staging, vk::DeviceSize stagingOffset) {
+            copyCmd.copyBuffer(staging, result.buffer, vk::BufferCopy(stagingOffset, 0, size));
+        });
+        return result;
+    }
+
+    // Record commands that don't read staging memory, like copies between images, into the pending upload batch
+    void recordUpload(const std::function<void(const vk::CommandBuffer& commandBuffer)>& record) const {
+        std::unique_lock<std::recursive_mutex> lock(uploadMutex);
+        record(getUploadCommandBuffer());
+    }
+
+    // Submit any pending uploads.  If `wait` is true, block until the queue is idle, which also guarantees
+    // uploaded resources are safe to use from other queues.
+    void flushUploads(bool wait = false) const {
+        VKS_TRACE_ZONE("Context::flushUploads");
+        startup::ScopedPhase startupPhase(startup::Phase::Upload);
+        std::unique_lock<std::recursive_mutex> lock(uploadMutex);
+        if (pendingUploads.commandBuffer) {
+            vk::CommandBuffer commandBuffer = pendingUploads.commandBuffer;
+            // Make the transfer writes available to everything submitted after this batch
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {},
+                                          vk::MemoryBarrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite },
+                                          nullptr, nullptr);
+            commandBuffer.end();
+
+            auto ringBytes = pendingUploads.ringBytes;
+            auto temporaryBuffers = pendingUploads.temporaryBuffers;
+            submitAndRecycle(queue, commandBuffer, [this, commandBuffer, ringBytes, temporaryBuffers]() mutable {
+                std::unique_lock<std::recursive_mutex> lock(uploadMutex);
+                stagingRing.release(ringBytes);
+                for (auto& buffer : temporaryBuffers) {
+                    buffer.destroy();
+                }
+                device.freeCommandBuffers(uploadCommandPool, commandBuffer);
+            });
+            pendingUploads = PendingUploads{};
+        }
+        flushAsyncUploads();
+        if (wait) {
+            while (!asyncUploadsInFlight.empty()) {
+                device.waitForFences(asyncUploadsInFlight.front().fence, VK_TRUE, UINT64_MAX);
+                pollAsyncUploads();
+            }
+            flushSubmits();
+            queue.waitIdle();
+        } else {
+            pollAsyncUploads();
+        }
+    }
+
+    //
+    // Transfer queue uploads
+    //
+    // Uploads made with stageUploadAsync are recorded into a batch for the transfer queue, together with the
+    // release half of a queue family ownership transfer.  The matching acquire half is recorded into a second
+    // command buffer that is submitted to the graphics queue only once the transfer batch fence has signalled,
+    // so the graphics queue never stalls waiting on the transfer queue.  Each batch gets a ticket; a ticket is
+    // complete once its acquire has been submitted, after which any later graphics submission may use the
+    // resources.
+    //
+    // Staging memory for these uploads always comes from temporary (sub-allocated) staging buffers, since the
+    // staging ring must be retired in submission order on a single queue.
+    //
+
+    using OwnershipRecorder = std::function<void(const vk::CommandBuffer& commandBuffer)>;
+
+    bool hasTransferQueue() const { return transferQueue && queueIndices.transfer != queueIndices.graphics; }
+
+    // `record` must copy out of the staging buffer and release ownership of the destination to the graphics
+    // queue family.  `acquire` must record the matching acquire barrier.
+    UploadTicket stageUploadAsync(vk::DeviceSize size, const void* data, vk::DeviceSize alignment, const UploadRecorder& record, const OwnershipRecorder& acquire) const {
+        std::unique_lock<std::recursive_mutex> lock(uploadMutex);
+        if (!transferCommandPool) {
+            transferCommandPool = device.createCommandPool({ vk::CommandPoolCreateFlagBits::eTransient, queueIndices.transfer });
+        }
+        if (!pendingAsyncUploads.transferCommandBuffer) {
+            const vk::CommandBufferBeginInfo beginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit };
+            pendingAsyncUploads.ticket = nextUploadTicket++;
+            pendingAsyncUploads.transferCommandBuffer = device.allocateCommandBuffers({ transferCommandPool, vk::CommandBufferLevel::ePrimary, 1 })[0];
+            pendingAsyncUploads.transferCommandBuffer.begin(beginInfo);
+            if (!uploadCommandPool) {
+                uploadCommandPool = device.createCommandPool({ vk::CommandPoolCreateFlagBits::eTransient, queueIndices.graphics });
+            }
+            pendingAsyncUploads.acquireCommandBuffer = device.allocateCommandBuffers({ uploadCommandPool, vk::CommandBufferLevel::ePrimary, 1 })[0];
+            pendingAsyncUploads.acquireCommandBuffer.begin(beginInfo);
+        }
+        Buffer staging = createStagingBuffer(size, data);
+        pendingAsyncUploads.stagingBuffers.push_back(staging);
+        record(pendingAsyncUploads.transferCommandBuffer, staging.buffer, 0);
+        acquire(pendingAsyncUploads.acquireCommandBuffer);
+        return pendingAsyncUploads.ticket;
+    }
+
+    // Submit the pending transfer queue batch, if any
+    void flushAsyncUploads() const {
+        std::unique_lock<std::recursive_mutex> lock(uploadMutex);
+        if (!pendingAsyncUploads.transferCommandBuffer) {
+            return;
+        }
+        pendingAsyncUploads.transferCommandBuffer.end();
+        pendingAsyncUploads.acquireCommandBuffer.end();
+        pendingAsyncUploads.fence = fencePool->acquire();
+        submitBatched(transferQueue, vk::SubmitInfo{ 0, nullptr, nullptr, 1, &pendingAsyncUploads.transferCommandBuffer }, pendingAsyncUploads.fence);
+        asyncUploadsInFlight.push_back(pendingAsyncUploads);
+        pendingAsyncUploads = AsyncUploads{};
+    }
+
+    // Submit the acquire half of every transfer batch that has finished.  Called by flushUploads.
+    void pollAsyncUploads() const {
+        std::unique_lock<std::recursive_mutex> lock(uploadMutex);
+        while (!asyncUploadsInFlight.empty() && vk::Result::eSuccess == device.getFenceStatus(asyncUploadsInFlight.front().fence)) {
+            AsyncUploads batch = asyncUploadsInFlight.front();
+            asyncUploadsInFlight.pop_front();
+            fencePool->release(batch.fence);
+
+            submitAndRecycle(queue, batch.acquireCommandBuffer, [this, batch]() mutable {
+                std::unique_lock<std::recursive_mutex> lock(uploadMutex);
+                for (auto& buffer : batch.stagingBuffers) {
+                    buffer.destroy();
+                }
+                device.freeCommandBuffers(transferCommandPool, batch.transferCommandBuffer);
+                device.freeCommandBuffers(uploadCommandPool, batch.acquireCommandBuffer);
+            });
+            completedUploadTicket = batch.ticket;
+        }
+    }
+
+    bool isUploadComplete(UploadTicket ticket) const {
+        std::unique_lock<std::recursive_mutex> lock(uploadMutex);
+        if (ticket <= completedUploadTicket) {
+            return true;
+        }
+        if (ticket == pendingAsyncUploads.ticket) {
+            flushAsyncUploads();
+        }
+        pollAsyncUploads();
+        return ticket <= completedUploadTicket;
+    }
+
+    // Block until the batch identified by `ticket` has been handed over to the graphics queue
+    void waitForUpload(UploadTicket ticket) const {
+        std::unique_lock<std::recursive_mutex> lock(uploadMutex);
+        while (!isUploadComplete(ticket)) {
+            if (asyncUploadsInFlight.empty()) {
+                throw std::runtime_error("Invalid upload ticket");
+            }
+            device.waitForFences(asyncUploadsInFlight.front().fence, VK_TRUE, UINT64_MAX);
+        }
+    }
+
+    // bufferOffset for buffer to image copies must be a multiple of the texel block size.  Power of two
+    // sizes are covered by 16 bytes and the three component formats by the factor of three.
+    vk::DeviceSize getImageStagingAlignment() const {
+        return 3 * std::max<vk::DeviceSize>(16, deviceProperties.limits.optimalBufferCopyOffsetAlignment);
+    }
+
     vk::Bool32 getMemoryType(uint32_t typeBits, const vk::MemoryPropertyFlags& properties, uint32_t* typeIndex) const {
         for (uint32_t i = 0; i < 32; i++) {
             if ((typeBits & 1) == 1) {
@@ -788,6 +1789,7 @@ public:
                 const vk::ArrayProxy<const vk::PipelineStageFlags>& waitStages = {},
                 const vk::ArrayProxy<const vk::Semaphore>& signals = {},
                 const vk::Fence& fence = vk::Fence()) const {
+        flushUploads();
         vk::SubmitInfo info;
         info.commandBufferCount = commandBuffers.size();
         info.pCommandBuffers = commandBuffers.data();
@@ -807,7 +1809,7 @@ public:
         info.pWaitDstStageMask = waitStages.data();
 
         info.signalSemaphoreCount = signals.size();
-        queue.submit(info, fence);
+        submitBatched(queue, info, fence);
     }
 
     using SemaphoreStagePair = std::pair<const vk::Semaphore, const vk::PipelineStageFlags>;
@@ -834,6 +1836,42 @@ public:
         submit(commandBuffers, wait.first, wait.second, signals, fence);
     }
 
+    //
+    // Submission batching
+    //
+    // With batchSubmits, every submission the context makes, through submit, submitTimeline and the upload code, is
+    // held back and sent along with the ones after it to the same queue in a single vkQueueSubmit.  The sync points
+    // that send them are a submission with a fence, one to another queue, which sends the held back ones first to
+    // keep the order semaphores are signaled and waited in, and flushSubmits, which waits on the device, timelines
+    // and destroy call as well.  A frame's submissions then take one call into the driver, ending with the one that
+    // signals the frame's fence.
+    //
+    // Code submitting to a queue directly must call flushSubmits first.
+    //
+
+    // `submitInfo` with its arrays copied, see vks::SubmitBatch
+    void submitBatched(const vk::Queue& queue, const vk::SubmitInfo& submitInfo, const vk::Fence& fence = vk::Fence()) const {
+        std::unique_lock<std::mutex> lock(submitMutex);
+        if (pendingSubmitQueue && pendingSubmitQueue != queue) {
+            pendingSubmits.flush(pendingSubmitQueue, vk::Fence(), synchronization2Enabled, dynamicDispatch);
+        }
+        pendingSubmitQueue = queue;
+        pendingSubmits.add(submitInfo);
+        if (!batchSubmits || fence) {
+            pendingSubmits.flush(queue, fence, synchronization2Enabled, dynamicDispatch);
+            pendingSubmitQueue = vk::Queue();
+        }
+    }
+
+    // Send everything held back
+    void flushSubmits() const {
+        std::unique_lock<std::mutex> lock(submitMutex);
+        if (pendingSubmitQueue) {
+            pendingSubmits.flush(pendingSubmitQueue, vk::Fence(), synchronization2Enabled, dynamicDispatch);
+            pendingSubmitQueue = vk::Queue();
+        }
+    }
+
     vk::Format getSupportedDepthFormat() const {
         // Since all depth formats may be optional, we need to find a suitable depth format to use
         // Start with the highest precision packed format
@@ -841,10 +1879,8 @@ public:
                                                  vk::Format::eD16Unorm };
 
         for (auto& format : depthFormats) {
-            vk::FormatProperties formatProps;
-            formatProps = physicalDevice.getFormatProperties(format);
             // vk::Format must support depth stencil attachment for optimal tiling
-            if (formatProps.optimalTilingFeatures & vk::FormatFeatureFlagBits::eDepthStencilAttachment) {
+            if (getFormatProperties(format).optimalTilingFeatures & vk::FormatFeatureFlagBits::eDepthStencilAttachment) {
                 return format;
             }
         }
@@ -852,11 +1888,176 @@ public:
         throw std::runtime_error("No supported depth format");
     }
 
+    // The smallest float format for HDR color that supports `features` for optimal tiling.  Without `alpha` that's
+    // B10G11R11 or E5B9G9R9, a quarter of the size of 32 bit RGBA, otherwise 16 bit RGBA.  Both packed formats are
+    // unsigned, and E5B9G9R9 shares one exponent between its channels.  Storage images of the packed formats need
+    // shaderStorageImageExtendedFormats, and E5B9G9R9 has no GLSL format qualifier, so it's never used for them.
+    vk::Format getSupportedHdrColorFormat(bool alpha,
+                                          const vk::FormatFeatureFlags& features = vk::FormatFeatureFlagBits::eColorAttachment |
+                                                                                   vk::FormatFeatureFlagBits::eSampledImage) const {
+        std::vector<vk::Format> colorFormats;
+        if (!alpha) {
+            const bool storage = (bool)(features & vk::FormatFeatureFlagBits::eStorageImage);
+            if (!storage || enabledFeatures.shaderStorageImageExtendedFormats) {
+                colorFormats.push_back(vk::Format::eB10G11R11UfloatPack32);
+            }
+            if (!storage) {
+                colorFormats.push_back(vk::Format::eE5B9G9R9UfloatPack32);
+            }
+        }
+        colorFormats.push_back(vk::Format::eR16G16B16A16Sfloat);
+        colorFormats.push_back(vk::Format::eR32G32B32A32Sfloat);
+
+        for (auto& format : colorFormats) {
+            if ((getFormatProperties(format).optimalTilingFeatures & features) == features) {
+                return format;
+            }
+        }
+
+        throw std::runtime_error("No supported HDR color format");
+    }
+
+    // Properties of `format` on the physical device, queried once per format and then served from a cache
+    const vk::FormatProperties& getFormatProperties(vk::Format format) const;
+
+    enum class MipmapMethod {
+        None,
+        // vkCmdBlitImage from each level to the next, with linear filtering where the format supports it
+        Blit,
+        // A 2x2 box filter dispatched with the shader in mipmapShaderPath
+        Compute,
+    };
+
+    // How generateMipmaps would fill the levels of an optimally tiled image created with `imageCreateInfo`.  Blits are
+    // preferred, the compute path is used when the format can't be blitted with linear filtering and the image is a
+    // 2D storage image that the device can write without a declared format.
+    MipmapMethod getMipmapMethod(const vk::ImageCreateInfo& imageCreateInfo) const;
+
+    // Record commands filling levels 1 to imageCreateInfo.mipLevels - 1 of every layer of `image` from level 0, and
+    // leaving all levels in `finalLayout`.  Level 0 must be in eTransferDstOptimal, the contents of the other levels
+    // are discarded.  The image needs eTransferSrc usage for the blit path and eStorage for the compute path.
+    void generateMipmaps(const vk::CommandBuffer& commandBuffer,
+                         const vk::Image& image,
+                         const vk::ImageCreateInfo& imageCreateInfo,
+                         vk::ImageLayout finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal) const;
+
     // A collection of items queued for destruction.  Once a fence has been created
     // for a queued submit, these items can be moved to the recycler for actual destruction
     // by calling the rec
     mutable VoidLambdaList dumpster;
-    FencedLambdaQueue recycler;
+    mutable DeletionQueue deletions;
+    mutable FencedLambdaRing recycler;
+    mutable TimelineLambdaList timelineRecycler;
+    // Command buffers for work submitted within a frame, on the graphics queue family.  The example base creates them
+    // with a slot per frame in flight and begins each frame's slot once the frame's fence has signaled, which resets
+    // all of the slot's buffers at once.  They're never freed or trashed by whoever allocates them.
+    mutable FrameCommandPools frameCommandPools;
+
+    // Hold submissions back until a sync point, see submitBatched
+    bool batchSubmits{ false };
+
+    // Request VK_KHR_timeline_semaphore.  Must be set before createDevice
+    bool enableTimelineSemaphores{ false };
+    // Set by createDevice if timeline semaphores were requested and the device supports them
+    bool timelineSemaphoresEnabled{ false };
+    // Request VK_EXT_descriptor_indexing and create the bindless table.  Must be set before createDevice
+    bool enableBindless{ false };
+    // Set by createDevice if the bindless table was requested and the device supports update after bind arrays
+    bool bindlessEnabled{ false };
+    // Request VK_KHR_multiview.  Must be set before createDevice
+    bool enableMultiview{ false };
+    // Set by createDevice if multiview was requested and the device supports it, along with multiviewProperties
+    bool multiviewEnabled{ false };
+    vk::PhysicalDeviceMultiviewProperties multiviewProperties;
+    // Request VK_NV_shading_rate_image.  Must be set before createDevice
+    bool enableShadingRateImage{ false };
+    // Set by createDevice if shading rate images were requested and the device supports them, along with
+    // shadingRateImageProperties
+    bool shadingRateImageEnabled{ false };
+    vk::PhysicalDeviceShadingRateImagePropertiesNV shadingRateImageProperties;
+    // Request VK_EXT_conditional_rendering.  Must be set before createDevice
+    bool enableConditionalRendering{ false };
+    // Set by createDevice if conditional rendering was requested and the device supports it
+    bool conditionalRenderingEnabled{ false };
+    // Request VK_KHR_acceleration_structure and VK_KHR_ray_tracing_pipeline.  Must be set before createDevice
+    bool enableRayTracing{ false };
+    // Set by createDevice if ray tracing was requested and the device supports it, along with rayTracingPipelineProperties
+    bool rayTracingEnabled{ false };
+    vk::PhysicalDeviceRayTracingPipelinePropertiesKHR rayTracingPipelineProperties;
+    // Request VK_KHR_acceleration_structure and VK_KHR_ray_query, for tracing rays from any shader stage.  Must be set
+    // before createDevice
+    bool enableRayQuery{ false };
+    // Set by createDevice if ray queries were requested and the device supports them
+    bool rayQueryEnabled{ false };
+    // Set by createDevice along with rayTracingEnabled or rayQueryEnabled, see vks::raytracing.  Enables buffer device
+    // addresses as well, see bufferDeviceAddressEnabled
+    bool accelerationStructuresEnabled{ false };
+    vk::PhysicalDeviceAccelerationStructurePropertiesKHR accelerationStructureProperties;
+    // Request VK_KHR_buffer_device_address, see getBufferAddress.  Must be set before createDevice
+    bool enableBufferDeviceAddress{ false };
+    // Set by createDevice if buffer device addresses were requested, or acceleration structures enabled, and the device
+    // supports them.  Every allocation of `allocator` can then be used with buffer device addresses
+    bool bufferDeviceAddressEnabled{ false };
+    // Usages createBuffer adds eShaderDeviceAddress to when bufferDeviceAddressEnabled
+    static constexpr VkBufferUsageFlags ADDRESSABLE_BUFFER_USAGE = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                                  VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                                                                  VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+    // Request VK_KHR_depth_stencil_resolve, along with VK_KHR_create_renderpass2 whose createRenderPass2KHR is called
+    // through dynamicDispatch.  Must be set before createDevice
+    bool enableDepthStencilResolve{ false };
+    // Set by createDevice if depth stencil resolves were requested and the device supports them, along with
+    // depthStencilResolveProperties
+    bool depthStencilResolveEnabled{ false };
+    vk::PhysicalDeviceDepthStencilResolveProperties depthStencilResolveProperties;
+    // Request VK_EXT_conservative_rasterization, see vk::PipelineRasterizationConservativeStateCreateInfoEXT.  Must be
+    // set before createDevice
+    bool enableConservativeRasterization{ false };
+    // Set by createDevice if conservative rasterization was requested and the device supports it, along with
+    // conservativeRasterizationProperties
+    bool conservativeRasterizationEnabled{ false };
+    vk::PhysicalDeviceConservativeRasterizationPropertiesEXT conservativeRasterizationProperties;
+    // Request VK_EXT_shader_viewport_index_layer, see vks::ViewportArray.  Must be set before createDevice
+    bool enableShaderViewportIndexLayer{ false };
+    // Set by createDevice if writing the viewport index and layer from vertex shaders was requested and the device
+    // supports it
+    bool shaderViewportIndexLayerEnabled{ false };
+    // Request VK_KHR_dynamic_rendering, whose cmdBeginRenderingKHR is called through dynamicDispatch.  Must be set
+    // before createDevice
+    bool enableDynamicRendering{ false };
+    // Set by createDevice if dynamic rendering was requested and the device supports it
+    bool dynamicRenderingEnabled{ false };
+    // Request VK_EXT_extended_dynamic_state, and VK_EXT_extended_dynamic_state2 and the polygon mode of
+    // VK_EXT_extended_dynamic_state3 where the device has them, see vks::pipelines::ExtendedDynamicState.  Their
+    // commands are called through dynamicDispatch.  Must be set before createDevice
+    bool enableExtendedDynamicState{ false };
+    // Set by createDevice for each of them that was requested and the device supports
+    bool extendedDynamicStateEnabled{ false };
+    bool extendedDynamicState2Enabled{ false };
+    bool dynamicPolygonModeEnabled{ false };
+    // Request VK_KHR_synchronization2, which vks::Barriers records with through dynamicDispatch.  Must be set before
+    // createDevice
+    bool enableSynchronization2{ false };
+    // Set by createDevice if synchronization2 was requested and the device supports it
+    bool synchronization2Enabled{ false };
+    // Request VK_EXT_mesh_shader with task and mesh shaders, whose draws are called through dynamicDispatch, see
+    // vks::model::MeshletGeometry.  Must be set before createDevice
+    bool enableMeshShader{ false };
+    // Set by createDevice if mesh shaders were requested and the device supports them, along with meshShaderProperties
+    bool meshShaderEnabled{ false };
+    vk::PhysicalDeviceMeshShaderPropertiesEXT meshShaderProperties;
+    // Request 16 bit float arithmetic in shaders, from VK_KHR_shader_float16_int8, for the _fp16 shader variants, see
+    // data/shaders/base/precision.glsl.  Must be set before createDevice
+    bool enableShaderFloat16{ false };
+    // Set by createDevice if 16 bit float arithmetic was requested and the device supports it
+    bool shaderFloat16Enabled{ false };
+    // Request VK_GOOGLE_display_timing.  Must be set before createDevice
+    bool enableDisplayTiming{ false };
+    // Set by createDevice if display timing was requested and the device supports it
+    bool displayTimingEnabled{ false };
+    // Set by createDevice where the device has VK_EXT_memory_budget, whose budgets the allocator then works to
+    bool memoryBudgetEnabled{ false };
+    // Set by createDevice where the device has VK_EXT_calibrated_timestamps, which CPU traces place GPU timings with
+    bool calibratedTimestampsEnabled{ false };
 
     InstanceExtensionsPickerFunctions instanceExtensionsPickers;
     // Set to true when example is created with enabled validation layers
@@ -872,15 +2073,235 @@ private:
     std::set<std::string> requiredExtensions;
     std::set<std::string> requiredDeviceExtensions;
 
-    DevicePickerFunction devicePicker = [](const std::vector<vk::PhysicalDevice>& devices) -> vk::PhysicalDevice { return devices[0]; };
+    DevicePickerFunction devicePicker;
     DeviceFeaturesPickerFunction deviceFeaturesPicker = [](const vk::PhysicalDevice& device, vk::PhysicalDeviceFeatures2& features) {};
     DeviceExtensionsPickerFunction deviceExtensionsPicker = [](const vk::PhysicalDevice& device) -> std::set<std::string> { return {}; };
 
-#ifdef WIN32
-    static __declspec(thread) vk::CommandPool s_cmdPool;
-#else
-    static thread_local vk::CommandPool s_cmdPool;
-#endif
+    bool isPipelineCacheCompatible(const std::vector<uint8_t>& data) const;
+    void querySupportedFeatures();
+    // The device named or numbered by the VKX_DEVICE environment variable if there is one, otherwise the best scoring
+    // device that can present to `surface` and has the required device extensions: discrete before integrated GPUs,
+    // then by device local memory, dedicated compute and transfer queue families, and the optional features
+    // requested through the enable flags.  The choice and its reason are logged.
+    vk::PhysicalDevice pickDefaultDevice(const std::vector<vk::PhysicalDevice>& devices, const vk::SurfaceKHR& surface) const;
+    static void clearDeviceExtensionNames();
+
+    void generateMipmapsBlit(const vk::CommandBuffer& commandBuffer, const vk::Image& image, const vk::ImageCreateInfo& imageCreateInfo) const;
+    void generateMipmapsCompute(const vk::CommandBuffer& commandBuffer, const vk::Image& image, const vk::ImageCreateInfo& imageCreateInfo) const;
+    void destroyMipmapPipeline();
+
+    mutable std::mutex formatPropertiesMutex;
+    mutable std::unordered_map<VkFormat, vk::FormatProperties> formatProperties;
+
+    // Created on the first compute mip generation
+    struct MipmapPipeline {
+        vk::DescriptorSetLayout descriptorSetLayout;
+        vk::PipelineLayout pipelineLayout;
+        vk::Pipeline pipeline;
+        vk::Sampler sampler;
+    };
+    mutable std::mutex mipmapPipelineMutex;
+    mutable MipmapPipeline mipmapPipeline;
+    vk::PipelineCache loadPipelineCache();
+    void savePipelineCache() const;
+
+    // submitTimeline without flushing pending uploads first, for use by the upload code itself
+    TimelinePoint submitToTimeline(const vk::Queue& queue,
+                                   const vk::SubmitInfo& submitInfo,
+                                   const vk::ArrayProxy<const TimelineWait>& waits = {},
+                                   const vk::Fence& fence = vk::Fence()) const {
+        // Binary semaphores in `submitInfo` keep their place ahead of the timeline ones, and their values are ignored
+        std::vector<vk::Semaphore> waitSemaphores(submitInfo.pWaitSemaphores, submitInfo.pWaitSemaphores + submitInfo.waitSemaphoreCount);
+        std::vector<vk::PipelineStageFlags> waitStages(submitInfo.pWaitDstStageMask, submitInfo.pWaitDstStageMask + submitInfo.waitSemaphoreCount);
+        std::vector<uint64_t> waitValues(submitInfo.waitSemaphoreCount, 0);
+        for (const auto& wait : waits) {
+            if (wait.point) {
+                waitSemaphores.push_back(wait.point.semaphore);
+                waitValues.push_back(wait.point.value);
+                waitStages.push_back(wait.stages);
+            }
+        }
+        std::vector<vk::Semaphore> signalSemaphores(submitInfo.pSignalSemaphores, submitInfo.pSignalSemaphores + submitInfo.signalSemaphoreCount);
+        std::vector<uint64_t> signalValues(submitInfo.signalSemaphoreCount, 0);
+
+        // Reservation and submission happen under one lock, so values are always signalled in increasing order
+        std::unique_lock<std::recursive_mutex> lock(timelineMutex);
+        const TimelinePoint signal = nextTimelinePoint(queue);
+        signalSemaphores.push_back(signal.semaphore);
+        signalValues.push_back(signal.value);
+
+        vk::TimelineSemaphoreSubmitInfoKHR timelineInfo;
+        timelineInfo.waitSemaphoreValueCount = (uint32_t)waitValues.size();
+        timelineInfo.pWaitSemaphoreValues = waitValues.data();
+        timelineInfo.signalSemaphoreValueCount = (uint32_t)signalValues.size();
+        timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+        vk::SubmitInfo info = submitInfo;
+        info.pNext = &timelineInfo;
+        info.waitSemaphoreCount = (uint32_t)waitSemaphores.size();
+        info.pWaitSemaphores = waitSemaphores.data();
+        info.pWaitDstStageMask = waitStages.data();
+        info.signalSemaphoreCount = (uint32_t)signalSemaphores.size();
+        info.pSignalSemaphores = signalSemaphores.data();
+        submitBatched(queue, info, fence);
+        return signal;
+    }
+
+    // Submit `commandBuffer` to `queue` and run `onComplete` from recycle once it has executed.  Completion is
+    // tracked on the queue's timeline when timeline semaphores are enabled, and with a new fence otherwise.
+    void submitAndRecycle(const vk::Queue& queue, const vk::CommandBuffer& commandBuffer, const VoidLambda& onComplete) const {
+        if (timelineSemaphoresEnabled) {
+            const TimelinePoint point = submitToTimeline(queue, vk::SubmitInfo{ 0, nullptr, nullptr, 1, &commandBuffer });
+            timelineRecycler.push_back(TimelineLambda{ point, onComplete });
+            return;
+        }
+        vk::Fence fence = fencePool->acquire();
+        submitBatched(queue, vk::SubmitInfo{ 0, nullptr, nullptr, 1, &commandBuffer }, fence);
+        pushRecycler(fence).push_back(onComplete);
+    }
+
+    // The recycler slot for `fence`.  If the ring is full, blocks until the oldest batch completes and retires it.
+    std::vector<VoidLambda>& pushRecycler(const vk::Fence& fence) const {
+        if (recycler.full() && recycler.backFence() != fence) {
+            device.waitForFences(recycler.frontFence(), VK_TRUE, UINT64_MAX);
+            recycle();
+        }
+        return recycler.push(fence);
+    }
+
+    vk::CommandBuffer getUploadCommandBuffer() const {
+        if (!uploadCommandPool) {
+            uploadCommandPool = device.createCommandPool({ vk::CommandPoolCreateFlagBits::eTransient, queueIndices.graphics });
+        }
+        if (!pendingUploads.commandBuffer) {
+            pendingUploads.commandBuffer = device.allocateCommandBuffers({ uploadCommandPool, vk::CommandBufferLevel::ePrimary, 1 })[0];
+            pendingUploads.commandBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+        }
+        return pendingUploads.commandBuffer;
+    }
+
+    struct PendingUploads {
+        vk::CommandBuffer commandBuffer;
+        vk::DeviceSize ringBytes{ 0 };
+        std::vector<Buffer> temporaryBuffers;
+    };
+
+    mutable std::recursive_mutex uploadMutex;
+    mutable StagingRing stagingRing;
+    // Loads in progress under a ScopedBackgroundUploads
+    mutable std::atomic<uint32_t> backgroundUploads{ 0 };
+    mutable PendingUploads pendingUploads;
+    mutable vk::CommandPool uploadCommandPool;
+
+    struct AsyncUploads {
+        UploadTicket ticket{ 0 };
+        vk::CommandBuffer transferCommandBuffer;
+        vk::CommandBuffer acquireCommandBuffer;
+        vk::Fence fence;
+        std::vector<Buffer> stagingBuffers;
+    };
+
+    mutable AsyncUploads pendingAsyncUploads;
+    mutable std::list<AsyncUploads> asyncUploadsInFlight;
+    mutable UploadTicket nextUploadTicket{ 1 };
+    mutable UploadTicket completedUploadTicket{ 0 };
+    mutable vk::CommandPool transferCommandPool;
+
+    // The latest value handed out on each queue's timeline
+    mutable std::unordered_map<VkQueue, TimelinePoint> timelines;
+    mutable std::recursive_mutex timelineMutex;
+    // Chained into the device create info when timeline semaphores are enabled
+    vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures;
+    // Chained into the device create info when the bindless table is enabled
+    vk::PhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures;
+    // Chained into the device create info when multiview is enabled
+    vk::PhysicalDeviceMultiviewFeatures multiviewFeatures;
+    // Chained into the device create info when shading rate images are enabled
+    vk::PhysicalDeviceShadingRateImageFeaturesNV shadingRateImageFeatures;
+    // Chained into the device create info when conditional rendering is enabled
+    vk::PhysicalDeviceConditionalRenderingFeaturesEXT conditionalRenderingFeatures;
+    // Chained into the device create info when buffer device addresses are enabled
+    vk::PhysicalDeviceBufferDeviceAddressFeatures bufferDeviceAddressFeatures;
+    // Chained into the device create info when ray tracing is enabled
+    vk::PhysicalDeviceAccelerationStructureFeaturesKHR accelerationStructureFeatures;
+    vk::PhysicalDeviceRayTracingPipelineFeaturesKHR rayTracingPipelineFeatures;
+    vk::PhysicalDeviceRayQueryFeaturesKHR rayQueryFeatures;
+    // Chained into the device create info when dynamic rendering is enabled
+    vk::PhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures;
+    // Chained into the device create info when extended dynamic state is enabled
+    vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicStateFeatures;
+    vk::PhysicalDeviceExtendedDynamicState2FeaturesEXT extendedDynamicState2Features;
+    vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT extendedDynamicState3Features;
+    // Chained into the device create info when synchronization2 is enabled
+    vk::PhysicalDeviceSynchronization2FeaturesKHR synchronization2Features;
+    // Chained into the device create info when mesh shaders are enabled
+    vk::PhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures;
+    // Chained into the device create info when 16 bit float arithmetic is enabled
+    vk::PhysicalDeviceShaderFloat16Int8FeaturesKHR shaderFloat16Int8Features;
+
+    mutable std::mutex threadCommandPoolsMutex;
+    mutable std::vector<vk::CommandPool> threadCommandPools;
+
+    // Submissions held back by submitBatched, all to the same queue
+    mutable std::mutex submitMutex;
+    mutable vk::Queue pendingSubmitQueue;
+    mutable SubmitBatch pendingSubmits;
+
+    // Of withPrimaryCommandBuffer, with the number of its calls on the thread that haven't returned yet
+    struct ImmediateCommandPool {
+        LinearCommandPool pool;
+        uint32_t depth{ 0 };
+
+        // One call, whose depth is given back even when its function or the flush throws, so that the next
+        // outermost call still resets the pool.  The pool is only reset by finish(), as the command buffer of a call
+        // that threw may never have been submitted, or still be pending if the wait for it failed.
+        class ScopedCall {
+        public:
+            explicit ScopedCall(ImmediateCommandPool& immediate)
+                : immediate(immediate) {
+                ++immediate.depth;
+            }
+            ~ScopedCall() {
+                if (!finished) {
+                    --immediate.depth;
+                }
+            }
+
+            // The flush waited for the device, so once the outermost call is done nothing from the pool is in use
+            void finish() {
+                finished = true;
+                if (--immediate.depth == 0) {
+                    immediate.pool.reset();
+                }
+            }
+
+            ScopedCall(const ScopedCall&) = delete;
+            ScopedCall& operator=(const ScopedCall&) = delete;
+
+        private:
+            ImmediateCommandPool& immediate;
+            bool finished{ false };
+        };
+    };
+
+    ImmediateCommandPool& getImmediateCommandPool() const {
+        auto& immediate = s_immediatePools[contextId];
+        if (!immediate.pool) {
+            immediate.pool.create(device, queueIndices.graphics);
+            std::unique_lock<std::mutex> lock(threadCommandPoolsMutex);
+            threadCommandPools.push_back(immediate.pool.handle());
+        }
+        return immediate;
+    }
+
+    static uint64_t newContextId() {
+        static std::atomic<uint64_t> next{ 0 };
+        return ++next;
+    }
+    // Never reused, unlike the address of a context, so a pool of a destroyed context is never handed out
+    const uint64_t contextId{ newContextId() };
+    static thread_local std::unordered_map<uint64_t, vk::CommandPool> s_cmdPools;
+    static thread_local std::unordered_map<uint64_t, ImmediateCommandPool> s_immediatePools;
 };
 
 // Template specialization for texture objects
@@ -908,12 +2329,4 @@ template <>
 inline void Context::copyToMemory(const vk::DeviceMemory& memory, const gli::texture& data, size_t offset) const {
     copyToMemory(memory, data.data(), static_cast<vk::DeviceSize>(data.size()), offset);
 }
-
-template <>
-inline void Context::trash<vk::CommandBuffer>(vk::CommandBuffer value) const {
-    std::function<void(vk::CommandBuffer t)> destructor = [this](vk::CommandBuffer commandBuffer) {
-        device.freeCommandBuffers(getCommandPool(), commandBuffer);
-    };
-    trash<vk::CommandBuffer>(value, destructor);
-}
 }  // namespace vks
@@ -7,6 +7,7 @@
 */
 
 #include "debug.hpp"
+#include "profiler.hpp"
 #include <iostream>
 #include <sstream>
 #include <mutex>
@@ -90,6 +91,11 @@ namespace marker {
 bool active = false;
 static std::once_flag markerDispatcherInitFlag;
 vk::DispatchLoaderDynamic markerDispatcher;
+static GpuProfiler* markerProfiler = nullptr;
+
+void setProfiler(GpuProfiler* profiler) {
+    markerProfiler = profiler;
+}
 
 void setup(const vk::Instance& instance, const vk::Device& device) {
     std::call_once(markerDispatcherInitFlag, [&] { markerDispatcher.init(instance, &vkGetInstanceProcAddr, device, &vkGetDeviceProcAddr); });
@@ -120,6 +126,9 @@ void beginRegion(const vk::CommandBuffer& cmdbuffer, const std::string& markerNa
     if (markerDispatcher.vkCmdDebugMarkerBeginEXT) {
         cmdbuffer.debugMarkerBeginEXT({ markerName.c_str(), toFloatArray(color) }, markerDispatcher);
     }
+    if (markerProfiler) {
+        markerProfiler->beginScope(cmdbuffer, markerName);
+    }
 }
 
 void insert(const vk::CommandBuffer& cmdbuffer, const std::string& markerName, const glm::vec4& color) {
@@ -134,6 +143,9 @@ void endRegion(const vk::CommandBuffer& cmdbuffer) {
     if (markerDispatcher.vkCmdDebugMarkerEndEXT) {
         cmdbuffer.debugMarkerEndEXT(markerDispatcher);
     }
+    if (markerProfiler) {
+        markerProfiler->endScope(cmdbuffer);
+    }
 }
 
 void setCommandBufferName(const vk::Device& device, const VkCommandBuffer& cmdBuffer, const char* name) {
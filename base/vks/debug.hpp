@@ -40,10 +40,15 @@ void freeDebugCallback(const vk::Instance& instance);
 // The actual check for extension presence and enabling it on the device is done in the example base class
 // See ExampleBase::createInstance and ExampleBase::createDevice (base/vkx::ExampleBase.cpp)
 
+class GpuProfiler;
+
 namespace marker {
 // Set to true if function pointer for the debug marker are available
 extern bool active;
 
+// While set, beginRegion / endRegion also record timestamp scopes on command buffers the profiler is tracking
+void setProfiler(GpuProfiler* profiler);
+
 // Get function pointers for the debug report extensions from the device
 void setup(const vk::Instance& instance, const vk::Device& device);
 
@@ -86,15 +91,9 @@ class Marker {
 public:
     Marker(const vk::CommandBuffer& cmdBuffer, const std::string& name, const glm::vec4& color = glm::vec4(0.8f))
         : cmdBuffer(cmdBuffer) {
-        if (active) {
-            beginRegion(cmdBuffer, name, color);
-        }
-    }
-    ~Marker() {
-        if (active) {
-            endRegion(cmdBuffer);
-        }
+        beginRegion(cmdBuffer, name, color);
     }
+    ~Marker() { endRegion(cmdBuffer); }
 
 private:
     const vk::CommandBuffer& cmdBuffer;
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "buffer.hpp"
+#include "image.hpp"
+
+namespace vks {
+
+// Deferred destruction of the common Vulkan handle types without any type erasure.
+//
+// Each handle type has its own vector, and every entry is tagged with the batch it was queued in.  close() ends
+// the current batch and returns its index, which the caller ties to a fence, timeline point or frame slot.
+// Once that submission has executed, complete(index) destroys the batch.  Batches may complete in any order,
+// but their contents are only destroyed once every earlier batch has completed too, so each vector can be
+// retired from the front in one tight loop.  Once the vectors have grown to their working size, queueing and
+// retiring objects doesn't allocate.
+class DeletionQueue {
+public:
+    // Index 0 means "no batch"
+    static const uint64_t NONE = 0;
+
+    void push(const vk::Buffer& buffer) { queue(buffers, buffer); }
+    void push(const vk::BufferView& view) { queue(bufferViews, view); }
+    void push(const vk::Image& image) { queue(images, image); }
+    void push(const vk::ImageView& view) { queue(imageViews, view); }
+    void push(const vk::Sampler& sampler) { queue(samplers, sampler); }
+    void push(const vk::DeviceMemory& memory) { queue(memories, memory); }
+    void push(const vk::Framebuffer& framebuffer) { queue(framebuffers, framebuffer); }
+    void push(const vk::RenderPass& renderPass) { queue(renderPasses, renderPass); }
+    void push(const vk::Pipeline& pipeline) { queue(pipelines, pipeline); }
+    void push(const vk::PipelineLayout& layout) { queue(pipelineLayouts, layout); }
+    void push(const vk::DescriptorSetLayout& layout) { queue(descriptorSetLayouts, layout); }
+    void push(const vk::DescriptorPool& pool) { queue(descriptorPools, pool); }
+    void push(const vk::ShaderModule& shaderModule) { queue(shaderModules, shaderModule); }
+    void push(const vk::Semaphore& semaphore) { queue(semaphores, semaphore); }
+    void push(const vk::Event& event) { queue(events, event); }
+    void push(const vk::QueryPool& queryPool) { queue(queryPools, queryPool); }
+    void push(const vks::Buffer& buffer) { queue(allocatedBuffers, buffer); }
+    void push(const vks::Image& image) { queue(allocatedImages, image); }
+    void push(const vk::CommandPool& pool, const vk::CommandBuffer& commandBuffer) { queue(commandBuffers, CommandBufferEntry{ pool, commandBuffer }); }
+
+    // Ends the batch everything queued since the previous call belongs to and returns its index, or NONE if
+    // nothing was queued
+    uint64_t close() {
+        if (!open) {
+            return NONE;
+        }
+        open = false;
+        return openIndex++;
+    }
+
+    // Marks batch `index` as no longer in use by the device, destroying it and any later batches that were
+    // waiting on it.  Every index returned by close() must eventually be completed.
+    void complete(const vk::Device& device, uint64_t index) {
+        if (index == NONE || index <= retired) {
+            return;
+        }
+        if (index != retired + 1) {
+            finished.insert(std::upper_bound(finished.begin(), finished.end(), index), index);
+            return;
+        }
+        retired = index;
+        auto itr = finished.begin();
+        while (itr != finished.end() && *itr == retired + 1) {
+            retired = *itr++;
+        }
+        finished.erase(finished.begin(), itr);
+        destroyThrough(device, retired);
+    }
+
+    // Destroys everything, including the open batch.  The device must be idle.
+    void destroyAll(const vk::Device& device) {
+        close();
+        retired = openIndex - 1;
+        finished.clear();
+        destroyThrough(device, UINT64_MAX);
+    }
+
+private:
+    template <typename T>
+    using Entries = std::vector<std::pair<uint64_t, T>>;
+
+    struct CommandBufferEntry {
+        vk::CommandPool pool;
+        vk::CommandBuffer commandBuffer;
+
+        explicit operator bool() const { return (bool)commandBuffer; }
+    };
+
+    template <typename T>
+    void queue(Entries<T>& entries, const T& value) {
+        if (!value) {
+            return;
+        }
+        entries.emplace_back(openIndex, value);
+        open = true;
+    }
+
+    // Destroys the leading entries tagged at or before `index`
+    template <typename T, typename F>
+    static void retire(Entries<T>& entries, uint64_t index, F destroy) {
+        auto end = entries.begin();
+        while (end != entries.end() && end->first <= index) {
+            destroy(end->second);
+            ++end;
+        }
+        entries.erase(entries.begin(), end);
+    }
+
+    void destroyThrough(const vk::Device& device, uint64_t index) {
+        // Views and the objects referencing others go first
+        retire(framebuffers, index, [&](const vk::Framebuffer& h) { device.destroyFramebuffer(h); });
+        retire(pipelines, index, [&](const vk::Pipeline& h) { device.destroyPipeline(h); });
+        retire(commandBuffers, index, [&](const CommandBufferEntry& h) { device.freeCommandBuffers(h.pool, h.commandBuffer); });
+        retire(renderPasses, index, [&](const vk::RenderPass& h) { device.destroyRenderPass(h); });
+        retire(pipelineLayouts, index, [&](const vk::PipelineLayout& h) { device.destroyPipelineLayout(h); });
+        retire(descriptorPools, index, [&](const vk::DescriptorPool& h) { device.destroyDescriptorPool(h); });
+        retire(descriptorSetLayouts, index, [&](const vk::DescriptorSetLayout& h) { device.destroyDescriptorSetLayout(h); });
+        retire(shaderModules, index, [&](const vk::ShaderModule& h) { device.destroyShaderModule(h); });
+        retire(samplers, index, [&](const vk::Sampler& h) { device.destroySampler(h); });
+        retire(imageViews, index, [&](const vk::ImageView& h) { device.destroyImageView(h); });
+        retire(bufferViews, index, [&](const vk::BufferView& h) { device.destroyBufferView(h); });
+        retire(images, index, [&](const vk::Image& h) { device.destroyImage(h); });
+        retire(buffers, index, [&](const vk::Buffer& h) { device.destroyBuffer(h); });
+        retire(allocatedImages, index, [](vks::Image& h) { h.destroy(); });
+        retire(allocatedBuffers, index, [](vks::Buffer& h) { h.destroy(); });
+        retire(memories, index, [&](const vk::DeviceMemory& h) { device.freeMemory(h); });
+        retire(semaphores, index, [&](const vk::Semaphore& h) { device.destroySemaphore(h); });
+        retire(events, index, [&](const vk::Event& h) { device.destroyEvent(h); });
+        retire(queryPools, index, [&](const vk::QueryPool& h) { device.destroyQueryPool(h); });
+    }
+
+    Entries<vk::Buffer> buffers;
+    Entries<vk::BufferView> bufferViews;
+    Entries<vk::Image> images;
+    Entries<vk::ImageView> imageViews;
+    Entries<vk::Sampler> samplers;
+    Entries<vk::DeviceMemory> memories;
+    Entries<vk::Framebuffer> framebuffers;
+    Entries<vk::RenderPass> renderPasses;
+    Entries<vk::Pipeline> pipelines;
+    Entries<vk::PipelineLayout> pipelineLayouts;
+    Entries<vk::DescriptorSetLayout> descriptorSetLayouts;
+    Entries<vk::DescriptorPool> descriptorPools;
+    Entries<vk::ShaderModule> shaderModules;
+    Entries<vk::Semaphore> semaphores;
+    Entries<vk::Event> events;
+    Entries<vk::QueryPool> queryPools;
+    Entries<vks::Buffer> allocatedBuffers;
+    Entries<vks::Image> allocatedImages;
+    Entries<CommandBufferEntry> commandBuffers;
+
+    // The batch new entries are tagged with, and whether anything has been tagged with it yet
+    uint64_t openIndex{ 1 };
+    bool open{ false };
+    // Every batch up to and including this one has been destroyed
+    uint64_t retired{ 0 };
+    // Completed batches still waiting on an earlier one, sorted
+    std::vector<uint64_t> finished;
+};
+
+}  // namespace vks
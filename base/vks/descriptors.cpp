@@ -0,0 +1,261 @@
+#include "descriptors.hpp"
+#include "reflection.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+
+using namespace vks;
+
+namespace {
+
+// Upper bound for the sets of a single pool, later pools stop growing here
+const uint32_t MAX_POOL_SETS = 4096;
+
+template <typename T>
+void appendKey(std::string& key, const T& value) {
+    key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+}  // namespace
+
+const DescriptorAllocator::PoolRatios& DescriptorAllocator::defaultRatios() {
+    static const PoolRatios ratios{
+        { vk::DescriptorType::eSampler, 0.5f },
+        { vk::DescriptorType::eCombinedImageSampler, 4.0f },
+        { vk::DescriptorType::eSampledImage, 4.0f },
+        { vk::DescriptorType::eStorageImage, 1.0f },
+        { vk::DescriptorType::eUniformTexelBuffer, 1.0f },
+        { vk::DescriptorType::eStorageTexelBuffer, 1.0f },
+        { vk::DescriptorType::eUniformBuffer, 2.0f },
+        { vk::DescriptorType::eStorageBuffer, 2.0f },
+        { vk::DescriptorType::eUniformBufferDynamic, 1.0f },
+        { vk::DescriptorType::eStorageBufferDynamic, 1.0f },
+        { vk::DescriptorType::eInputAttachment, 0.5f },
+    };
+    return ratios;
+}
+
+void DescriptorAllocator::create(const vk::Device& device, uint32_t setsPerPool, const PoolRatios& ratios) {
+    this->device = device;
+    this->ratios = ratios;
+    this->setsPerPool = std::max(setsPerPool, 1u);
+    nextPoolSets = this->setsPerPool;
+    current = 0;
+}
+
+void DescriptorAllocator::destroy() {
+    if (!device) {
+        return;
+    }
+    for (const auto& pool : pools) {
+        device.destroyDescriptorPool(pool);
+    }
+    pools.clear();
+    cache.clear();
+    current = 0;
+    device = nullptr;
+}
+
+vk::DescriptorPool DescriptorAllocator::createPool(uint32_t maxSets) const {
+    std::vector<vk::DescriptorPoolSize> sizes;
+    sizes.reserve(ratios.size());
+    for (const auto& ratio : ratios) {
+        sizes.emplace_back(ratio.first, std::max(1u, (uint32_t)(ratio.second * maxSets)));
+    }
+    return device.createDescriptorPool({ {}, maxSets, (uint32_t)sizes.size(), sizes.data() });
+}
+
+vk::DescriptorSet DescriptorAllocator::allocateLocked(const vk::DescriptorSetLayout& layout) {
+    while (true) {
+        uint32_t createdSets = 0;
+        if (current == pools.size()) {
+            createdSets = nextPoolSets;
+            pools.push_back(createPool(createdSets));
+            nextPoolSets = std::min(nextPoolSets * 2, MAX_POOL_SETS);
+        }
+        vk::DescriptorSet set;
+        const vk::DescriptorSetAllocateInfo allocateInfo{ pools[current], 1, &layout };
+        const vk::Result result = device.allocateDescriptorSets(&allocateInfo, &set);
+        if (result == vk::Result::eSuccess) {
+            return set;
+        }
+        if (result != vk::Result::eErrorOutOfPoolMemory && result != vk::Result::eErrorFragmentedPool) {
+            throw std::runtime_error("Failed to allocate descriptor set: " + vk::to_string(result));
+        }
+        // A set that doesn't fit into an empty pool of the largest size never will
+        if (createdSets == MAX_POOL_SETS) {
+            throw std::runtime_error("Descriptor set layout needs more descriptors than a pool holds");
+        }
+        ++current;
+    }
+}
+
+vk::DescriptorSet DescriptorAllocator::allocate(const vk::DescriptorSetLayout& layout) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return allocateLocked(layout);
+}
+
+vk::DescriptorSet DescriptorAllocator::get(const vk::DescriptorSetLayout& layout, const std::vector<DescriptorBinding>& bindings) {
+    // Everything the set is made of, field by field so that struct padding doesn't end up in the key
+    std::string key;
+    appendKey(key, static_cast<VkDescriptorSetLayout>(layout));
+    for (const auto& binding : bindings) {
+        appendKey(key, binding.binding);
+        appendKey(key, binding.type);
+        appendKey(key, (uint32_t)(binding.buffers.size() + binding.images.size()));
+        for (const auto& buffer : binding.buffers) {
+            appendKey(key, static_cast<VkBuffer>(buffer.buffer));
+            appendKey(key, buffer.offset);
+            appendKey(key, buffer.range);
+        }
+        for (const auto& image : binding.images) {
+            appendKey(key, static_cast<VkSampler>(image.sampler));
+            appendKey(key, static_cast<VkImageView>(image.imageView));
+            appendKey(key, image.imageLayout);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto itr = cache.find(key);
+    if (itr != cache.end()) {
+        return itr->second;
+    }
+    const vk::DescriptorSet set = allocateLocked(layout);
+    std::vector<vk::WriteDescriptorSet> writes;
+    writes.reserve(bindings.size());
+    for (const auto& binding : bindings) {
+        vk::WriteDescriptorSet write{ set, binding.binding, 0, 0, binding.type };
+        if (!binding.buffers.empty()) {
+            write.descriptorCount = (uint32_t)binding.buffers.size();
+            write.pBufferInfo = binding.buffers.data();
+        } else {
+            write.descriptorCount = (uint32_t)binding.images.size();
+            write.pImageInfo = binding.images.data();
+        }
+        writes.push_back(write);
+    }
+    device.updateDescriptorSets(writes, nullptr);
+    cache.emplace(std::move(key), set);
+    return set;
+}
+
+void DescriptorAllocator::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < pools.size() && i <= current; ++i) {
+        device.resetDescriptorPool(pools[i], {});
+    }
+    cache.clear();
+    current = 0;
+}
+
+void FrameDescriptorAllocator::create(const vk::Device& device, uint32_t frameCount, uint32_t setsPerPool) {
+    destroy();
+    for (uint32_t i = 0; i < frameCount; ++i) {
+        frames.emplace_back(new DescriptorAllocator());
+        frames.back()->create(device, setsPerPool);
+    }
+    currentFrame = 0;
+}
+
+void FrameDescriptorAllocator::destroy() {
+    for (auto& frame : frames) {
+        frame->destroy();
+    }
+    frames.clear();
+}
+
+void FrameDescriptorAllocator::begin(uint32_t frame) {
+    currentFrame = frame;
+    frames[currentFrame]->reset();
+}
+
+vk::DescriptorSetLayout LayoutCache::getDescriptorSetLayout(const std::vector<vk::DescriptorSetLayoutBinding>& bindings,
+                                                            const vk::DescriptorSetLayoutCreateFlags& flags) {
+    std::vector<vk::DescriptorSetLayoutBinding> sorted = bindings;
+    std::sort(sorted.begin(), sorted.end(),
+              [](const vk::DescriptorSetLayoutBinding& a, const vk::DescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+    std::string key;
+    appendKey(key, static_cast<VkDescriptorSetLayoutCreateFlags>(flags));
+    for (const auto& binding : sorted) {
+        appendKey(key, binding.binding);
+        appendKey(key, binding.descriptorType);
+        appendKey(key, binding.descriptorCount);
+        appendKey(key, static_cast<VkShaderStageFlags>(binding.stageFlags));
+        const bool immutable = binding.pImmutableSamplers != nullptr;
+        appendKey(key, immutable);
+        for (uint32_t i = 0; immutable && i < binding.descriptorCount; ++i) {
+            appendKey(key, static_cast<VkSampler>(binding.pImmutableSamplers[i]));
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    auto itr = setLayouts.find(key);
+    if (itr != setLayouts.end()) {
+        return itr->second;
+    }
+    auto layout = device.createDescriptorSetLayout({ flags, (uint32_t)sorted.size(), sorted.data() });
+    setLayouts.emplace(std::move(key), layout);
+    return layout;
+}
+
+vk::PipelineLayout LayoutCache::getPipelineLayout(const std::vector<vk::DescriptorSetLayout>& layouts,
+                                                  const std::vector<vk::PushConstantRange>& pushConstantRanges) {
+    std::vector<vk::PushConstantRange> sorted = pushConstantRanges;
+    std::sort(sorted.begin(), sorted.end(), [](const vk::PushConstantRange& a, const vk::PushConstantRange& b) {
+        return std::make_tuple((VkShaderStageFlags)a.stageFlags, a.offset, a.size) < std::make_tuple((VkShaderStageFlags)b.stageFlags, b.offset, b.size);
+    });
+    std::string key;
+    appendKey(key, (uint32_t)layouts.size());
+    for (const auto& layout : layouts) {
+        appendKey(key, static_cast<VkDescriptorSetLayout>(layout));
+    }
+    for (const auto& range : sorted) {
+        appendKey(key, static_cast<VkShaderStageFlags>(range.stageFlags));
+        appendKey(key, range.offset);
+        appendKey(key, range.size);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    auto itr = pipelineLayouts.find(key);
+    if (itr != pipelineLayouts.end()) {
+        return itr->second;
+    }
+    auto layout = device.createPipelineLayout({ {}, (uint32_t)layouts.size(), layouts.data(), (uint32_t)sorted.size(), sorted.data() });
+    pipelineLayouts.emplace(std::move(key), layout);
+    return layout;
+}
+
+vk::DescriptorSetLayout LayoutCache::getDescriptorSetLayout(const shaders::ShaderLayout& layout, uint32_t set) {
+    return getDescriptorSetLayout(layout.getBindings(set));
+}
+
+vk::PipelineLayout LayoutCache::getPipelineLayout(const shaders::ShaderLayout& layout) {
+    std::vector<vk::DescriptorSetLayout> layouts;
+    for (uint32_t set = 0; set < layout.setCount(); ++set) {
+        layouts.push_back(getDescriptorSetLayout(layout, set));
+    }
+    return getPipelineLayout(layouts, layout.pushConstantRanges);
+}
+
+void LayoutCache::destroy() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (const auto& layout : pipelineLayouts) {
+        device.destroyPipelineLayout(layout.second);
+    }
+    for (const auto& layout : setLayouts) {
+        device.destroyDescriptorSetLayout(layout.second);
+    }
+    pipelineLayouts.clear();
+    setLayouts.clear();
+}
+
+size_t LayoutCache::descriptorSetLayoutCount() const {
+    std::unique_lock<std::mutex> lock(mutex);
+    return setLayouts.size();
+}
+
+size_t LayoutCache::pipelineLayoutCount() const {
+    std::unique_lock<std::mutex> lock(mutex);
+    return pipelineLayouts.size();
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+namespace vks {
+
+// The contents of one binding of a set, for DescriptorAllocator::get
+struct DescriptorBinding {
+    uint32_t binding{ 0 };
+    vk::DescriptorType type{ vk::DescriptorType::eUniformBuffer };
+    std::vector<vk::DescriptorBufferInfo> buffers;
+    std::vector<vk::DescriptorImageInfo> images;
+
+    DescriptorBinding(uint32_t binding, vk::DescriptorType type, const vk::DescriptorBufferInfo& buffer)
+        : binding(binding)
+        , type(type)
+        , buffers{ buffer } {}
+    DescriptorBinding(uint32_t binding, vk::DescriptorType type, const vk::DescriptorImageInfo& image)
+        : binding(binding)
+        , type(type)
+        , images{ image } {}
+    DescriptorBinding(uint32_t binding, vk::DescriptorType type, std::vector<vk::DescriptorImageInfo> images)
+        : binding(binding)
+        , type(type)
+        , images(std::move(images)) {}
+};
+
+// Descriptor sets from a list of pools that grows instead of being sized up front.  Each pool holds a number of
+// sets and a multiple of that many descriptors of each type; when a pool runs out of either, allocation moves on to
+// a new pool, twice the size of the last one.  Sets are never freed one at a time, `reset` recycles all of them and
+// keeps the pools.
+//
+// `get` additionally caches sets by layout and contents, so asking twice for a set with the same layout and
+// resources returns the same set, written once.  Cached sets live until the next reset.
+//
+// Safe to use from several recording threads at once.
+class DescriptorAllocator {
+public:
+    // Descriptors of each type per set in a pool
+    using PoolRatios = std::vector<std::pair<vk::DescriptorType, float>>;
+    static const PoolRatios& defaultRatios();
+
+    void create(const vk::Device& device, uint32_t setsPerPool = 64, const PoolRatios& ratios = defaultRatios());
+    void destroy();
+
+    operator bool() const { return device.operator bool(); }
+
+    // An uninitialized set
+    vk::DescriptorSet allocate(const vk::DescriptorSetLayout& layout);
+    // A set with `bindings` written to it, shared with every earlier call for the same layout and bindings
+    vk::DescriptorSet get(const vk::DescriptorSetLayout& layout, const std::vector<DescriptorBinding>& bindings);
+
+    // Returns every set to the pools.  None of them may still be in use by the device
+    void reset();
+
+    size_t poolCount() const { return pools.size(); }
+    size_t cachedSets() const { return cache.size(); }
+
+private:
+    vk::DescriptorSet allocateLocked(const vk::DescriptorSetLayout& layout);
+    vk::DescriptorPool createPool(uint32_t maxSets) const;
+
+    vk::Device device;
+    PoolRatios ratios;
+    uint32_t setsPerPool{ 0 };
+    // Sets of the next pool created
+    uint32_t nextPoolSets{ 0 };
+    std::vector<vk::DescriptorPool> pools;
+    // Index in `pools` to allocate from, the ones before it are full
+    size_t current{ 0 };
+    std::unordered_map<std::string, vk::DescriptorSet> cache;
+    std::mutex mutex;
+};
+
+// A DescriptorAllocator per frame in flight, for sets that only live for a frame.  `begin` resets the allocator of
+// the frame slot about to be recorded, which must have completed on the device.
+class FrameDescriptorAllocator {
+public:
+    void create(const vk::Device& device, uint32_t frameCount, uint32_t setsPerPool = 64);
+    void destroy();
+
+    operator bool() const { return !frames.empty(); }
+
+    void begin(uint32_t frame);
+    DescriptorAllocator& current() { return *frames[currentFrame]; }
+
+    vk::DescriptorSet allocate(const vk::DescriptorSetLayout& layout) { return current().allocate(layout); }
+    vk::DescriptorSet get(const vk::DescriptorSetLayout& layout, const std::vector<DescriptorBinding>& bindings) {
+        return current().get(layout, bindings);
+    }
+
+private:
+    // DescriptorAllocator holds a mutex and can't be moved
+    std::vector<std::unique_ptr<DescriptorAllocator>> frames;
+    uint32_t currentFrame{ 0 };
+};
+
+namespace shaders {
+struct ShaderLayout;
+}
+
+// Descriptor set and pipeline layouts, created once per distinct definition and shared by everything asking for the
+// same one, like the context's shader module cache.  Pipelines whose layouts come from here with the same sets and
+// push constants share the layout object itself, so switching between them keeps the bound sets.
+//
+// Layouts are owned by the cache and live until `destroy`, callers never destroy them.  Safe to use from several
+// threads at once.
+class LayoutCache {
+public:
+    explicit LayoutCache(const vk::Device& device)
+        : device(device) {}
+    ~LayoutCache() { destroy(); }
+
+    LayoutCache(const LayoutCache&) = delete;
+    LayoutCache& operator=(const LayoutCache&) = delete;
+
+    // Bindings may come in any order.  Immutable samplers are part of the definition.
+    vk::DescriptorSetLayout getDescriptorSetLayout(const std::vector<vk::DescriptorSetLayoutBinding>& bindings,
+                                                   const vk::DescriptorSetLayoutCreateFlags& flags = {});
+    vk::PipelineLayout getPipelineLayout(const std::vector<vk::DescriptorSetLayout>& setLayouts,
+                                         const std::vector<vk::PushConstantRange>& pushConstantRanges = {});
+
+    // Reflected layouts, see vks::shaders::ShaderLayout
+    vk::DescriptorSetLayout getDescriptorSetLayout(const shaders::ShaderLayout& layout, uint32_t set);
+    vk::PipelineLayout getPipelineLayout(const shaders::ShaderLayout& layout);
+
+    void destroy();
+
+    size_t descriptorSetLayoutCount() const;
+    size_t pipelineLayoutCount() const;
+
+private:
+    vk::Device device;
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, vk::DescriptorSetLayout> setLayouts;
+    std::unordered_map<std::string, vk::PipelineLayout> pipelineLayouts;
+};
+
+}  // namespace vks
@@ -0,0 +1,184 @@
+#include "drawlist.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace vks;
+
+namespace {
+
+const uint64_t PIPELINE_MASK = (1ull << 14) - 1;
+const uint64_t FIELD_MASK = (1ull << 24) - 1;
+const uint64_t TRANSPARENT_LAYER = 1ull << 62;
+
+}  // namespace
+
+uint64_t DrawList::opaqueKey(uint32_t pipeline, uint32_t material, uint32_t depth) {
+    return ((pipeline & PIPELINE_MASK) << 48) | ((material & FIELD_MASK) << 24) | (depth & FIELD_MASK);
+}
+
+uint64_t DrawList::transparentKey(uint32_t pipeline, uint32_t material, uint32_t depth) {
+    return TRANSPARENT_LAYER | ((~uint64_t(depth) & FIELD_MASK) << 38) | ((pipeline & PIPELINE_MASK) << 24) | (material & FIELD_MASK);
+}
+
+uint64_t DrawList::depthOnlyKey(uint32_t pipeline, uint32_t depth) {
+    return ((depth & FIELD_MASK) << 38) | ((pipeline & PIPELINE_MASK) << 24);
+}
+
+uint32_t DrawList::depthBucket(float distance, float farDistance) {
+    if (!(farDistance > 0.0f) || !(distance > 0.0f)) {
+        return 0;
+    }
+    const float normalized = std::min(distance / farDistance, 1.0f);
+    return static_cast<uint32_t>(normalized * float(FIELD_MASK));
+}
+
+void DrawList::clear() {
+    draws.clear();
+    pushConstantOffsets.clear();
+    pushConstantData.clear();
+    order.clear();
+    sorted = false;
+}
+
+void DrawList::add(const Draw& draw, const void* pushConstants) {
+    if (draw.setCount > MAX_DESCRIPTOR_SETS || draw.firstSet > MAX_DESCRIPTOR_SETS - draw.setCount) {
+        throw std::runtime_error("Too many descriptor sets for a draw list entry");
+    }
+    if (draw.pushConstantSize > MAX_PUSH_CONSTANTS_SIZE || (draw.pushConstantSize && !pushConstants)) {
+        throw std::runtime_error("Invalid push constants for a draw list entry");
+    }
+    pushConstantOffsets.push_back(static_cast<uint32_t>(pushConstantData.size()));
+    if (draw.pushConstantSize) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(pushConstants);
+        pushConstantData.insert(pushConstantData.end(), bytes, bytes + draw.pushConstantSize);
+    }
+    draws.push_back(draw);
+    sorted = false;
+}
+
+void DrawList::sort() {
+    const size_t count = draws.size();
+    order.resize(count);
+    scratch.resize(count);
+    // One pass over the keys counts the bytes for all eight passes
+    std::array<std::array<uint32_t, 256>, 8> histograms{};
+    for (size_t i = 0; i < count; ++i) {
+        const uint64_t key = draws[i].key;
+        order[i] = { key, static_cast<uint32_t>(i) };
+        for (uint32_t pass = 0; pass < 8; ++pass) {
+            ++histograms[pass][(key >> (pass * 8)) & 0xFF];
+        }
+    }
+    for (uint32_t pass = 0; count > 1 && pass < 8; ++pass) {
+        const uint32_t shift = pass * 8;
+        auto& histogram = histograms[pass];
+        // Every key has the same byte here, so the pass wouldn't move anything
+        if (histogram[(order[0].key >> shift) & 0xFF] == count) {
+            continue;
+        }
+        uint32_t sum = 0;
+        for (auto& bucket : histogram) {
+            const uint32_t bucketCount = bucket;
+            bucket = sum;
+            sum += bucketCount;
+        }
+        for (const auto& entry : order) {
+            scratch[histogram[(entry.key >> shift) & 0xFF]++] = entry;
+        }
+        order.swap(scratch);
+    }
+    sorted = true;
+}
+
+DrawList::Stats DrawList::record(const vk::CommandBuffer& commandBuffer) const {
+    Stats stats;
+    vk::Pipeline boundPipeline;
+    vk::PipelineLayout boundLayout;
+    std::array<vk::DescriptorSet, MAX_DESCRIPTOR_SETS> boundSets;
+    vk::Buffer boundVertexBuffer;
+    vk::DeviceSize boundVertexBufferOffset{ 0 };
+    vk::Buffer boundIndexBuffer;
+    vk::DeviceSize boundIndexBufferOffset{ 0 };
+    vk::IndexType boundIndexType{ vk::IndexType::eUint32 };
+    const Draw* boundPushConstants{ nullptr };
+    const uint8_t* boundPushConstantData{ nullptr };
+
+    for (size_t i = 0; i < draws.size(); ++i) {
+        const uint32_t index = sorted ? order[i].index : static_cast<uint32_t>(i);
+        const Draw& draw = draws[index];
+        const uint8_t* pushConstantData = this->pushConstantData.data() + pushConstantOffsets[index];
+        ++stats.draws;
+
+        if (draw.pipeline) {
+            ++stats.naiveBinds;
+            if (draw.pipeline != boundPipeline) {
+                commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, draw.pipeline);
+                boundPipeline = draw.pipeline;
+                ++stats.binds;
+            }
+        }
+
+        // Sets and push constants bound with one layout say nothing about another
+        if (draw.layout != boundLayout) {
+            boundLayout = draw.layout;
+            boundSets.fill(vk::DescriptorSet());
+            boundPushConstants = nullptr;
+        }
+
+        if (draw.setCount) {
+            ++stats.naiveBinds;
+            const uint32_t end = draw.firstSet + draw.setCount;
+            uint32_t first = draw.firstSet;
+            while (first < end && draw.sets[first - draw.firstSet] == boundSets[first]) {
+                ++first;
+            }
+            if (first < end) {
+                commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, draw.layout, first, end - first,
+                                                 draw.sets.data() + (first - draw.firstSet), 0, nullptr);
+                std::copy(draw.sets.begin() + (first - draw.firstSet), draw.sets.begin() + draw.setCount, boundSets.begin() + first);
+                ++stats.binds;
+            }
+        }
+
+        if (draw.pushConstantSize) {
+            ++stats.naiveBinds;
+            const bool same = boundPushConstants && boundPushConstants->pushConstantStages == draw.pushConstantStages &&
+                              boundPushConstants->pushConstantOffset == draw.pushConstantOffset &&
+                              boundPushConstants->pushConstantSize == draw.pushConstantSize &&
+                              0 == memcmp(boundPushConstantData, pushConstantData, draw.pushConstantSize);
+            if (!same) {
+                commandBuffer.pushConstants(draw.layout, draw.pushConstantStages, draw.pushConstantOffset, draw.pushConstantSize, pushConstantData);
+                boundPushConstants = &draw;
+                boundPushConstantData = pushConstantData;
+                ++stats.binds;
+            }
+        }
+
+        if (draw.vertexBuffer) {
+            ++stats.naiveBinds;
+            if (draw.vertexBuffer != boundVertexBuffer || draw.vertexBufferOffset != boundVertexBufferOffset) {
+                commandBuffer.bindVertexBuffers(0, draw.vertexBuffer, draw.vertexBufferOffset);
+                boundVertexBuffer = draw.vertexBuffer;
+                boundVertexBufferOffset = draw.vertexBufferOffset;
+                ++stats.binds;
+            }
+        }
+
+        if (draw.indexBuffer) {
+            ++stats.naiveBinds;
+            if (draw.indexBuffer != boundIndexBuffer || draw.indexBufferOffset != boundIndexBufferOffset || draw.indexType != boundIndexType) {
+                commandBuffer.bindIndexBuffer(draw.indexBuffer, draw.indexBufferOffset, draw.indexType);
+                boundIndexBuffer = draw.indexBuffer;
+                boundIndexBufferOffset = draw.indexBufferOffset;
+                boundIndexType = draw.indexType;
+                ++stats.binds;
+            }
+            commandBuffer.drawIndexed(draw.indexCount, draw.instanceCount, draw.firstIndex, draw.vertexOffset, draw.firstInstance);
+        } else {
+            commandBuffer.draw(draw.indexCount, draw.instanceCount, static_cast<uint32_t>(draw.vertexOffset), draw.firstInstance);
+        }
+    }
+    return stats;
+}
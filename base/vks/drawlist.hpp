@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace vks {
+
+// Draws collected with a 64 bit sort key and recorded in key order, so that draws sharing a pipeline, and then a
+// material, end up next to each other and the binds they have in common are only made once.
+//
+// Keys put a layer in the top two bits, opaque before transparent.  Opaque draws sort by pipeline, material, then
+// depth front to back, transparent draws by depth back to front, then pipeline and material.  Depth only passes
+// bind no materials and gain more from early depth rejection than from fewer pipeline binds, so their draws sort
+// front to back first:
+//
+//   opaque       | 0 : 2 | pipeline : 14 | material : 24 | depth : 24 |
+//   transparent  | 1 : 2 | ~depth : 24 | pipeline : 14 | material : 24 |
+//   depth only   | 0 : 2 | depth : 24 | pipeline : 14 | 0 : 24 |
+//
+// The ids are whatever the caller numbers its pipelines and materials by, and only need to be small and stable.
+// Draws with equal keys keep the order they were added in.
+class DrawList {
+public:
+    static const uint32_t MAX_DESCRIPTOR_SETS = 4;
+    // The smallest maxPushConstantsSize a device may have
+    static const uint32_t MAX_PUSH_CONSTANTS_SIZE = 128;
+
+    struct Draw {
+        uint64_t key{ 0 };
+        vk::Pipeline pipeline;
+        vk::PipelineLayout layout;
+        // Descriptor sets [firstSet, firstSet + setCount) of `layout`
+        uint32_t firstSet{ 0 };
+        uint32_t setCount{ 0 };
+        std::array<vk::DescriptorSet, MAX_DESCRIPTOR_SETS> sets;
+        vk::Buffer vertexBuffer;
+        vk::DeviceSize vertexBufferOffset{ 0 };
+        // Draws without an index buffer are recorded with draw, not drawIndexed
+        vk::Buffer indexBuffer;
+        vk::DeviceSize indexBufferOffset{ 0 };
+        vk::IndexType indexType{ vk::IndexType::eUint32 };
+        // Push constants, the bytes of which are passed to add
+        vk::ShaderStageFlags pushConstantStages;
+        uint32_t pushConstantOffset{ 0 };
+        uint32_t pushConstantSize{ 0 };
+        // Vertex count and first vertex when not indexed
+        uint32_t indexCount{ 0 };
+        uint32_t instanceCount{ 1 };
+        uint32_t firstIndex{ 0 };
+        int32_t vertexOffset{ 0 };
+        uint32_t firstInstance{ 0 };
+    };
+
+    // Binds of pipelines, descriptor sets, vertex and index buffers and push constants.  `naiveBinds` is what
+    // recording every draw with all of its state would have bound.
+    struct Stats {
+        uint32_t draws{ 0 };
+        uint32_t binds{ 0 };
+        uint32_t naiveBinds{ 0 };
+        uint32_t saved() const { return naiveBinds - binds; }
+    };
+
+    static uint64_t opaqueKey(uint32_t pipeline, uint32_t material, uint32_t depth);
+    static uint64_t transparentKey(uint32_t pipeline, uint32_t material, uint32_t depth);
+    static uint64_t depthOnlyKey(uint32_t pipeline, uint32_t depth);
+    // Quantize a view distance in [0, farDistance] to the 24 bits of depth in a key
+    static uint32_t depthBucket(float distance, float farDistance);
+
+    void clear();
+    // `pushConstants` points to draw.pushConstantSize bytes, which are copied.  Throws std::runtime_error for more
+    // than MAX_DESCRIPTOR_SETS sets or MAX_PUSH_CONSTANTS_SIZE bytes.
+    void add(const Draw& draw, const void* pushConstants = nullptr);
+    // Radix sort the draws by key, skipping the passes over bytes every key has in common
+    void sort();
+    // Record the draws in sorted order, or in the order they were added if sort wasn't called since, leaving out the
+    // binds of state the previous draw already bound
+    Stats record(const vk::CommandBuffer& commandBuffer) const;
+
+    size_t size() const { return draws.size(); }
+    bool empty() const { return draws.empty(); }
+
+private:
+    struct SortEntry {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    std::vector<Draw> draws;
+    // Offsets of the push constants of each draw in pushConstantData
+    std::vector<uint32_t> pushConstantOffsets;
+    std::vector<uint8_t> pushConstantData;
+    std::vector<SortEntry> order;
+    std::vector<SortEntry> scratch;
+    bool sorted{ false };
+};
+
+}  // namespace vks
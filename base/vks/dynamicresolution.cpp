@@ -0,0 +1,53 @@
+#include "dynamicresolution.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vks;
+
+void DynamicResolution::setEnabled(bool enable) {
+    active = enable;
+    currentScale = config.maxScale;
+    sampleSum = 0.0f;
+    samples = 0;
+}
+
+bool DynamicResolution::update(float gpuMilliseconds) {
+    if (!active || gpuMilliseconds <= 0.0f) {
+        return false;
+    }
+    sampleSum += gpuMilliseconds;
+    if (++samples < std::max(config.sampleCount, 1u)) {
+        return false;
+    }
+    const float average = sampleSum / (float)samples;
+    sampleSum = 0.0f;
+    samples = 0;
+
+    float target = currentScale;
+    if (average > config.targetMilliseconds) {
+        target = currentScale * std::sqrt(config.targetMilliseconds / average);
+    } else if (average < config.targetMilliseconds * config.headroom) {
+        target = currentScale * std::sqrt(config.targetMilliseconds * config.headroom / average);
+    }
+    target = std::min(std::max(target, currentScale - config.maxStep), currentScale + config.maxStep);
+    if (config.granularity > 0.0f) {
+        // Down, so that being over the budget at all takes a step, and small increases don't happen until there's
+        // room for a whole one
+        target = currentScale + std::floor((target - currentScale) / config.granularity) * config.granularity;
+    }
+    target = std::min(std::max(target, config.minScale), config.maxScale);
+    if (target == currentScale) {
+        return false;
+    }
+    currentScale = target;
+    return true;
+}
+
+uint32_t DynamicResolution::extentOf(uint32_t full) const {
+    return std::min(full, std::max(1u, (uint32_t)std::lround((float)full * currentScale)));
+}
+
+vk::Extent2D DynamicResolution::extent(const vk::Extent2D& full) const {
+    return vk::Extent2D{ extentOf(full.width), extentOf(full.height) };
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+
+#include <vulkan/vulkan.hpp>
+
+namespace vks {
+
+// Picks the scale of the resolution an example renders its scene at from the GPU time of its frames, to stay within
+// a frame time budget by trading resolution rather than dropping frames.
+//
+// The targets stay allocated at full size and only the viewport shrinks, so a change of scale costs re-recording the
+// commands that set it and no reallocation.  The composition samples the rendered corner of the targets, see
+// uvScale, and upscales it to the swapchain.
+//
+// GPU cost is taken to be proportional to the pixel count, so each decision moves the scale by the square root of
+// the ratio of the budget to the measured time, limited to `maxStep`.  Times are averaged over `sampleCount`
+// measurements between decisions and the scale is quantized to `granularity`, which keeps it from changing every
+// frame on noise: each change makes the example wait for the GPU before it re-records.
+class DynamicResolution {
+public:
+    struct Config {
+        // The GPU frame time budget
+        float targetMilliseconds{ 16.0f };
+        float minScale{ 0.5f };
+        float maxScale{ 1.0f };
+        // The scale only grows again once the frames are this far within the budget
+        float headroom{ 0.85f };
+        float maxStep{ 0.1f };
+        float granularity{ 1.0f / 32.0f };
+        uint32_t sampleCount{ 8 };
+    };
+
+    Config config;
+
+    bool enabled() const { return active; }
+    // Disabling returns to `maxScale`
+    void setEnabled(bool enable);
+
+    // Add the GPU time of a frame, and return true if the scale changed
+    bool update(float gpuMilliseconds);
+
+    float scale() const { return currentScale; }
+    // The part of a full size target that's rendered to, never empty
+    vk::Extent2D extent(const vk::Extent2D& full) const;
+    // The fraction of a full size target that's rendered to, for scaling the texture coordinates of the composition
+    float uvScale(uint32_t full) const { return full ? (float)extentOf(full) / (float)full : 1.0f; }
+
+private:
+    uint32_t extentOf(uint32_t full) const;
+
+    bool active{ false };
+    float currentScale{ 1.0f };
+    float sampleSum{ 0.0f };
+    uint32_t samples{ 0 };
+};
+
+}  // namespace vks
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+namespace vks {
+
+// Recycles fences instead of creating and destroying one per submission.
+//
+// Released fences are only reset once the pool runs out of ready ones, so a burst of
+// releases costs a single vkResetFences call.  Fences from anywhere (including ones the
+// pool didn't create) may be released into it, after which the pool owns them.
+class FencePool {
+public:
+    explicit FencePool(const vk::Device& device)
+        : device(device) {}
+    ~FencePool() { destroy(); }
+
+    FencePool(const FencePool&) = delete;
+    FencePool& operator=(const FencePool&) = delete;
+
+    // Returns an unsignaled fence
+    vk::Fence acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (ready.empty() && !released.empty()) {
+            device.resetFences(released);
+            ready.swap(released);
+        }
+        if (ready.empty()) {
+            return device.createFence({});
+        }
+        vk::Fence fence = ready.back();
+        ready.pop_back();
+        return fence;
+    }
+
+    // `fence` must not be in use by any pending submission
+    void release(const vk::Fence& fence) {
+        if (!fence) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        released.push_back(fence);
+    }
+
+    void destroy() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (const auto& fence : ready) {
+            device.destroyFence(fence);
+        }
+        for (const auto& fence : released) {
+            device.destroyFence(fence);
+        }
+        ready.clear();
+        released.clear();
+    }
+
+private:
+    vk::Device device;
+    std::mutex mutex;
+    // Reset and ready to be handed out
+    std::vector<vk::Fence> ready;
+    // Possibly signaled, reset in one batch on demand
+    std::vector<vk::Fence> released;
+};
+
+}  // namespace vks
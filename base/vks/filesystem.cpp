@@ -28,6 +28,10 @@ std::vector<uint8_t> readBinaryFile(const std::string& filename) {
     return result;
 }
 
+void prefetch(const std::vector<std::string>& filenames) {
+    storage::Storage::prefetch(filenames);
+}
+
 std::string readTextFile(const std::string& fileName) {
     std::string fileContent;
     std::ifstream fileStream(fileName, std::ios::in);
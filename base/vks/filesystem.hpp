@@ -13,4 +13,9 @@ void withBinaryFileContents(const std::string& filename, std::function<void(size
 
 std::string readTextFile(const std::string& fileName);
 
+// Start reading the given files on the background I/O pool, so that subsequent loads of them
+// (through withBinaryFileContents, shader loading or any other Storage::readFile user) overlap
+// their disk access with each other and with whatever decoding the caller is doing meanwhile
+void prefetch(const std::vector<std::string>& filenames);
+
 }}  // namespace vks::file
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+#include "context.hpp"
+#include "staging.hpp"
+
+namespace vks {
+
+// Linear allocator for constants that only live for one frame, like per object matrices.
+//
+// One persistently mapped, host coherent buffer is split into a region per frame in flight.  Allocations bump an
+// offset into the current frame's region and are never freed individually; `begin` hands the whole region out again
+// once the frame that last used it has completed.  Since every region is part of the same buffer, a single
+// descriptor set with a dynamic uniform (or storage) buffer binding covers them all, and each draw picks its data
+// with the dynamic offset returned by `push`.
+//
+// Allocation sizes are rounded up to the offset alignment, so allocating is a single atomic add and can be done from
+// several recording threads at once.
+class FrameAllocator {
+public:
+    struct Allocation {
+        void* mapped{ nullptr };
+        // Offset from the start of the buffer, to be passed as the dynamic offset
+        uint32_t offset{ 0 };
+    };
+
+    operator bool() const { return buffer.operator bool(); }
+
+    // `capacity` bytes per frame.  Dynamic descriptors can cover up to `range` bytes from any allocation, the last
+    // region is padded so that even the final allocation of a frame stays inside the buffer.
+    void create(const Context& context,
+                vk::DeviceSize capacity,
+                uint32_t frameCount,
+                vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eUniformBuffer,
+                vk::DeviceSize range = 0) {
+        const auto& limits = context.deviceProperties.limits;
+        alignment = 1;
+        if (usage & vk::BufferUsageFlagBits::eUniformBuffer) {
+            alignment = std::max(alignment, limits.minUniformBufferOffsetAlignment);
+        }
+        if (usage & vk::BufferUsageFlagBits::eStorageBuffer) {
+            alignment = std::max(alignment, limits.minStorageBufferOffsetAlignment);
+        }
+        if (!range) {
+            range = (usage & vk::BufferUsageFlagBits::eUniformBuffer) ? std::min<vk::DeviceSize>(limits.maxUniformBufferRange, 65536) : 65536;
+        }
+        regionSize = StagingRing::alignUp(capacity, alignment);
+        this->range = range;
+        this->frameCount = frameCount;
+        buffer = context.createBuffer(usage, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                      regionSize * frameCount + range);
+        buffer.map();
+        begin(0);
+    }
+
+    void destroy() {
+        buffer.destroy();
+        regionSize = 0;
+        frameCount = 0;
+    }
+
+    // Start allocating for frame slot `frame`.  Everything previously allocated for the slot must no longer be in
+    // use by the device.
+    void begin(uint32_t frame) {
+        assert(frame < frameCount);
+        regionStart = regionSize * frame;
+        head = 0;
+    }
+
+    // `size` bytes of the current frame's region, aligned for use as a dynamic offset
+    Allocation allocate(vk::DeviceSize size) {
+        const vk::DeviceSize reserved = StagingRing::alignUp(std::max<vk::DeviceSize>(size, 1), alignment);
+        const vk::DeviceSize offset = head.fetch_add(reserved);
+        if (offset + reserved > regionSize) {
+            throw std::runtime_error("Frame allocator region exhausted");
+        }
+        Allocation result;
+        result.offset = (uint32_t)(regionStart + offset);
+        result.mapped = static_cast<uint8_t*>(buffer.mapped) + result.offset;
+        return result;
+    }
+
+    // Copies `data` into the current frame and returns its dynamic offset
+    template <typename T>
+    uint32_t push(const T& data) {
+        const Allocation allocation = allocate(sizeof(T));
+        memcpy(allocation.mapped, &data, sizeof(T));
+        return allocation.offset;
+    }
+
+    // For a dynamic descriptor of `size` bytes, at most `range`
+    vk::DescriptorBufferInfo descriptor(vk::DeviceSize size) const {
+        assert(size <= range);
+        return vk::DescriptorBufferInfo{ buffer.buffer, 0, size };
+    }
+
+    // Bytes allocated so far from the current frame's region
+    vk::DeviceSize used() const { return std::min(head.load(), regionSize); }
+    vk::DeviceSize capacity() const { return regionSize; }
+    // What every allocation size is rounded up to, for laying out arrays that are bound at offsets into one allocation
+    vk::DeviceSize offsetAlignment() const { return alignment; }
+    // The current frame's region, for binding allocations other than through dynamic offsets
+    vk::DeviceSize regionOffset() const { return regionStart; }
+    const vk::Buffer& handle() const { return buffer.buffer; }
+
+private:
+    Buffer buffer;
+    vk::DeviceSize alignment{ 1 };
+    vk::DeviceSize regionSize{ 0 };
+    vk::DeviceSize regionStart{ 0 };
+    vk::DeviceSize range{ 0 };
+    uint32_t frameCount{ 0 };
+    std::atomic<vk::DeviceSize> head{ 0 };
+};
+
+}  // namespace vks
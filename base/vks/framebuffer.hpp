@@ -39,13 +39,16 @@ struct Framebuffer {
     // Prepare a new framebuffer for offscreen rendering
     // The contents of this framebuffer are then
     // blitted to our render target
+    // With more than one layer the attachments are array images viewed as a whole, for render passes with a
+    // multiview view mask covering `layers` views
     void create(const vks::Context& context,
                 const glm::uvec2& size,
                 const std::vector<vk::Format>& colorFormats,
                 vk::Format depthFormat,
                 const vk::RenderPass& renderPass,
                 vk::ImageUsageFlags colorUsage = vk::ImageUsageFlagBits::eSampled,
-                vk::ImageUsageFlags depthUsage = vk::ImageUsageFlags()) {
+                vk::ImageUsageFlags depthUsage = vk::ImageUsageFlags(),
+                uint32_t layers = 1) {
         device = context.device;
         destroy();
 
@@ -58,17 +61,18 @@ struct Framebuffer {
         image.extent.height = size.y;
         image.extent.depth = 1;
         image.mipLevels = 1;
-        image.arrayLayers = 1;
+        image.arrayLayers = layers;
         image.samples = vk::SampleCountFlagBits::e1;
         image.tiling = vk::ImageTiling::eOptimal;
         // vk::Image of the framebuffer is blit source
         image.usage = vk::ImageUsageFlagBits::eColorAttachment | colorUsage;
 
+        const vk::ImageViewType viewType = layers > 1 ? vk::ImageViewType::e2DArray : vk::ImageViewType::e2D;
         vk::ImageViewCreateInfo colorImageView;
-        colorImageView.viewType = vk::ImageViewType::e2D;
+        colorImageView.viewType = viewType;
         colorImageView.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
         colorImageView.subresourceRange.levelCount = 1;
-        colorImageView.subresourceRange.layerCount = 1;
+        colorImageView.subresourceRange.layerCount = layers;
 
         for (size_t i = 0; i < colorFormats.size(); ++i) {
             image.format = colorFormats[i];
@@ -86,11 +90,11 @@ struct Framebuffer {
             depth = context.createImage(image, vk::MemoryPropertyFlagBits::eDeviceLocal);
 
             vk::ImageViewCreateInfo depthStencilView;
-            depthStencilView.viewType = vk::ImageViewType::e2D;
+            depthStencilView.viewType = viewType;
             depthStencilView.format = depthFormat;
             depthStencilView.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth;
             depthStencilView.subresourceRange.levelCount = 1;
-            depthStencilView.subresourceRange.layerCount = 1;
+            depthStencilView.subresourceRange.layerCount = layers;
             depthStencilView.image = depth.image;
             depth.view = device.createImageView(depthStencilView);
         }
@@ -110,6 +114,7 @@ struct Framebuffer {
         fbufCreateInfo.pAttachments = attachments.data();
         fbufCreateInfo.width = size.x;
         fbufCreateInfo.height = size.y;
+        // Multiview renders to the layers of the attachments, the framebuffer itself stays single layered
         fbufCreateInfo.layers = 1;
         framebuffer = context.device.createFramebuffer(fbufCreateInfo);
     }
@@ -88,7 +88,7 @@ public:
         for (auto attachment : attachments) {
             attachment.destroy();
         }
-        device.destroy(sampler);
+        vks::releaseSampler(device, sampler);
         device.destroy(renderPass);
         device.destroy(framebuffer);
     }
@@ -190,7 +190,7 @@ public:
         samplerInfo.minLod = 0.0f;
         samplerInfo.maxLod = 1.0f;
         samplerInfo.borderColor = vk::BorderColor::eFloatOpaqueWhite;
-        sampler = device.createSampler(samplerInfo);
+        sampler = vks::acquireSampler(device, samplerInfo);
     }
 
     /**
@@ -0,0 +1,73 @@
+#include "framehistory.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vks;
+
+FrameHistory::FrameHistory()
+    : cpuTimes(CAPACITY, 0.0f)
+    , gpuTimes(CAPACITY, 0.0f)
+    , frameStart(std::chrono::steady_clock::now()) {
+    zones.reserve(MAX_ZONES);
+}
+
+void FrameHistory::addZone(const char* name, float milliseconds) {
+    if (zones.size() < MAX_ZONES) {
+        zones.push_back({ name, milliseconds });
+    }
+}
+
+void FrameHistory::endFrame() {
+    const auto now = std::chrono::steady_clock::now();
+    const float milliseconds = std::chrono::duration<float, std::milli>(now - frameStart).count();
+    frameStart = now;
+
+    // The median of a partial ring is still useful once a few frames are in
+    if (cpuCount >= 16 && (median == 0.0f || cpuCount % 32 == 0)) {
+        median = percentiles(cpuTimes, cpuCount).p50;
+    }
+    if (median > 0.0f && milliseconds > median * config.hitchFactor && milliseconds - median >= config.hitchMinimum) {
+        Hitch hitch;
+        hitch.frame = cpuCount;
+        hitch.cpuMilliseconds = milliseconds;
+        hitch.medianMilliseconds = median;
+        hitch.cpuZones = zones;
+        hitches.push_back(std::move(hitch));
+        while (hitches.size() > std::max<size_t>(config.maxHitches, 1)) {
+            hitches.pop_front();
+        }
+        ++totalHitches;
+    }
+
+    cpuTimes[cpuCount % CAPACITY] = milliseconds;
+    ++cpuCount;
+    zones.clear();
+}
+
+std::vector<float> FrameHistory::cpuHistogram(size_t bins, float maxMilliseconds) const {
+    std::vector<float> result(std::max<size_t>(bins, 1), 0.0f);
+    const size_t count = cpuValueCount();
+    for (size_t i = 0; i < count; ++i) {
+        const size_t bin = (size_t)std::floor(cpuTimes[i] / maxMilliseconds * (float)result.size());
+        result[std::min(bin, result.size() - 1)] += 1.0f;
+    }
+    return result;
+}
+
+FrameHistory::Percentiles FrameHistory::percentiles(const std::vector<float>& ring, uint64_t count) {
+    Percentiles result;
+    const size_t size = count < CAPACITY ? (size_t)count : CAPACITY;
+    if (!size) {
+        return result;
+    }
+    std::vector<float> sorted(ring.begin(), ring.begin() + size);
+    std::sort(sorted.begin(), sorted.end());
+    // Nearest rank
+    auto percentile = [&](float p) { return sorted[std::min(size - 1, (size_t)std::ceil(p * size) - 1)]; };
+    result.p50 = percentile(0.50f);
+    result.p95 = percentile(0.95f);
+    result.p99 = percentile(0.99f);
+    result.max = sorted.back();
+    return result;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace vks {
+
+// The CPU and GPU times of the last CAPACITY frames, for percentiles and plots that show stutter an average hides,
+// and a hitch detector keeping what each frame far over the recent median spent its time on.
+//
+// The CPU time of a frame is measured between calls to endFrame, and broken down by the zones in it.  GPU times come
+// from the profiler's collections, which lag the CPU by the frames in flight, so the GPU zones of a hitch are those of
+// the first collection after it.
+class FrameHistory {
+public:
+    static const size_t CAPACITY = 512;
+    static const size_t MAX_ZONES = 32;
+
+    struct Zone {
+        // A string literal
+        const char* name;
+        float milliseconds;
+    };
+
+    struct Hitch {
+        uint64_t frame{ 0 };
+        float cpuMilliseconds{ 0.0f };
+        // The median CPU time it was compared against
+        float medianMilliseconds{ 0.0f };
+        std::vector<Zone> cpuZones;
+        std::vector<std::pair<std::string, float>> gpuZones;
+        bool gpuPending{ true };
+    };
+
+    struct Percentiles {
+        float p50{ 0.0f };
+        float p95{ 0.0f };
+        float p99{ 0.0f };
+        float max{ 0.0f };
+    };
+
+    struct Config {
+        // A frame is a hitch when its CPU time is over `hitchFactor` times the median, and at least `hitchMinimum`
+        // milliseconds over it
+        float hitchFactor{ 2.0f };
+        float hitchMinimum{ 4.0f };
+        // Only the most recent ones are kept
+        size_t maxHitches{ 16 };
+    };
+
+    // Times the enclosing scope as a zone of the current frame.  Zones may nest, each is reported on its own.
+    class ScopedZone {
+    public:
+        ScopedZone(FrameHistory& history, const char* name)
+            : history(history)
+            , name(name)
+            , start(std::chrono::steady_clock::now()) {}
+        ~ScopedZone() { history.addZone(name, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count()); }
+
+        ScopedZone(const ScopedZone&) = delete;
+        ScopedZone& operator=(const ScopedZone&) = delete;
+
+    private:
+        FrameHistory& history;
+        const char* name;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    FrameHistory();
+
+    Config config;
+
+    void addZone(const char* name, float milliseconds);
+    // Close the current frame, taking its CPU time since the previous call, and check it for a hitch
+    void endFrame();
+
+    // The GPU time of a new profiler collection.  `zones` is only called when a hitch is waiting for its GPU zones,
+    // and appends (name, milliseconds) pairs to the vector it's given.
+    template <typename F>
+    void addGpuTime(float milliseconds, const F& zones) {
+        gpuTimes[gpuCount % CAPACITY] = milliseconds;
+        ++gpuCount;
+        for (auto& hitch : hitches) {
+            if (hitch.gpuPending) {
+                zones(hitch.gpuZones);
+                hitch.gpuPending = false;
+            }
+        }
+    }
+
+    Percentiles cpuPercentiles() const { return percentiles(cpuTimes, cpuCount); }
+    Percentiles gpuPercentiles() const { return percentiles(gpuTimes, gpuCount); }
+    // `bins` frame counts of the recorded CPU times, the last bin holding every frame of `maxMilliseconds` or more
+    std::vector<float> cpuHistogram(size_t bins, float maxMilliseconds) const;
+
+    // Ring buffers in the layout ImGui::PlotLines takes, with the oldest frame at the offset
+    const float* cpuValues() const { return cpuTimes.data(); }
+    size_t cpuValueCount() const { return cpuCount < CAPACITY ? (size_t)cpuCount : CAPACITY; }
+    size_t cpuValueOffset() const { return cpuCount < CAPACITY ? 0 : (size_t)(cpuCount % CAPACITY); }
+
+    uint64_t frameCount() const { return cpuCount; }
+    uint64_t hitchCount() const { return totalHitches; }
+    // Oldest first
+    const std::deque<Hitch>& getHitches() const { return hitches; }
+
+private:
+    static Percentiles percentiles(const std::vector<float>& ring, uint64_t count);
+
+    std::vector<float> cpuTimes;
+    std::vector<float> gpuTimes;
+    uint64_t cpuCount{ 0 };
+    uint64_t gpuCount{ 0 };
+    std::chrono::steady_clock::time_point frameStart;
+    std::vector<Zone> zones;
+    // Recomputed every few frames rather than sorting the ring every frame
+    float median{ 0.0f };
+    std::deque<Hitch> hitches;
+    uint64_t totalHitches{ 0 };
+};
+
+}  // namespace vks
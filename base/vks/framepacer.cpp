@@ -0,0 +1,148 @@
+#include "framepacer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vks;
+
+void FramePacer::setEnabled(bool enable) {
+    active = enable;
+    sampleSum = 0.0f;
+    samples = 0;
+    windowSeconds = 0.0f;
+    fitSeconds = 0.0f;
+    cadenceSeconds = 0.0f;
+    hold = config.holdSeconds;
+    lastChangeWasRise = false;
+    currentInterval = intervals.empty() ? 0 : minimumInterval();
+}
+
+void FramePacer::setRefreshDuration(uint64_t nanoseconds) {
+    if (nanoseconds == refreshDuration) {
+        return;
+    }
+    // Stay as close to the previous cadence as the new refresh rate allows
+    const float previousRate = currentInterval ? rate() : 0.0f;
+    refreshDuration = nanoseconds;
+    updateIntervals();
+    currentInterval = intervals.empty() ? 0 : minimumInterval();
+    for (const auto interval : intervals) {
+        if (interval >= currentInterval && previousRate > 0.0f && 1.0e9f / ((float)refreshDuration * interval) <= previousRate * 1.05f) {
+            currentInterval = interval;
+            break;
+        }
+    }
+}
+
+void FramePacer::setThermalStatus(ThermalStatus status) {
+    thermal = status;
+}
+
+float FramePacer::rate() const {
+    if (!active || !currentInterval || !refreshDuration) {
+        return 0.0f;
+    }
+    return (float)(1.0e9 / ((double)refreshDuration * currentInterval));
+}
+
+void FramePacer::updateIntervals() {
+    intervals.clear();
+    if (!refreshDuration) {
+        return;
+    }
+    const double refreshRate = 1.0e9 / (double)refreshDuration;
+    for (const auto rate : config.rates) {
+        const uint32_t interval = std::max(1u, (uint32_t)std::lround(refreshRate / rate));
+        if (std::abs(refreshRate / interval - rate) <= rate * 0.05) {
+            intervals.push_back(interval);
+        }
+    }
+    std::sort(intervals.begin(), intervals.end());
+    intervals.erase(std::unique(intervals.begin(), intervals.end()), intervals.end());
+    if (intervals.empty()) {
+        intervals.push_back(1);
+    }
+}
+
+uint32_t FramePacer::minimumInterval() const {
+    uint32_t cap = 0;
+    if (thermal >= ThermalStatus::Severe) {
+        cap = config.severeRate;
+    } else if (thermal >= ThermalStatus::Moderate) {
+        cap = config.moderateRate;
+    }
+    if (!cap) {
+        return intervals.front();
+    }
+    for (const auto interval : intervals) {
+        if (1.0e9 / ((double)refreshDuration * interval) <= cap * 1.05) {
+            return interval;
+        }
+    }
+    return intervals.back();
+}
+
+bool FramePacer::setInterval(uint32_t interval) {
+    sampleSum = 0.0f;
+    samples = 0;
+    windowSeconds = 0.0f;
+    fitSeconds = 0.0f;
+    if (interval == currentInterval) {
+        return false;
+    }
+    lastChangeWasRise = interval < currentInterval;
+    currentInterval = interval;
+    cadenceSeconds = 0.0f;
+    return true;
+}
+
+bool FramePacer::update(float workMilliseconds, float elapsedSeconds) {
+    if (!active || intervals.empty()) {
+        return false;
+    }
+    cadenceSeconds += elapsedSeconds;
+    if (cadenceSeconds >= config.maxHoldSeconds) {
+        hold = config.holdSeconds;
+    }
+    const uint32_t minimum = minimumInterval();
+    if (currentInterval < minimum) {
+        return setInterval(minimum);
+    }
+
+    sampleSum += workMilliseconds;
+    windowSeconds += elapsedSeconds;
+    if (++samples < std::max(config.sampleCount, 1u)) {
+        return false;
+    }
+    const float average = sampleSum / (float)samples;
+    const float window = windowSeconds;
+    sampleSum = 0.0f;
+    samples = 0;
+    windowSeconds = 0.0f;
+
+    const auto current = std::find(intervals.begin(), intervals.end(), currentInterval);
+    if (average > budgetMilliseconds(currentInterval)) {
+        // The fastest slower cadence the frames fit in, or the slowest there is
+        auto slower = std::find_if(current, intervals.end(), [&](uint32_t interval) { return budgetMilliseconds(interval) >= average; });
+        const uint32_t next = slower != intervals.end() ? *slower : intervals.back();
+        if (next != currentInterval && lastChangeWasRise && cadenceSeconds < hold * 2.0f) {
+            hold = std::min(std::max(hold, config.holdSeconds) * 2.0f, config.maxHoldSeconds);
+        }
+        return setInterval(next);
+    }
+
+    if (current == intervals.begin() || *(current - 1) < minimum) {
+        fitSeconds = 0.0f;
+        return false;
+    }
+    const uint32_t faster = *(current - 1);
+    if (average >= budgetMilliseconds(faster) * config.headroom) {
+        fitSeconds = 0.0f;
+        return false;
+    }
+    fitSeconds += window;
+    if (fitSeconds < std::max(hold, config.holdSeconds)) {
+        return false;
+    }
+    return setInterval(faster);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace vks {
+
+// Picks a steady presentation cadence that divides the display's refresh rate, like 30, 60 or 90 Hz, from the work
+// time of the frames and the device's thermal status, so frames are shown at even intervals instead of alternating
+// between refreshes whenever a frame misses one.
+//
+// The cadence drops to the fastest slower one as soon as the average work time of `sampleCount` frames is over the
+// budget of the current one, and only rises again once the frames have fit in `headroom` of the faster budget for
+// `holdSeconds`.  Each drop that follows a rise within twice that time doubles the hold, up to `maxHoldSeconds`, so
+// a load right at the edge of a budget settles at the slower cadence rather than oscillating.  The hold returns to
+// `holdSeconds` once a cadence has lasted `maxHoldSeconds`.  Rising thermal status caps the cadence before the
+// device throttles the clocks.
+class FramePacer {
+public:
+    // The levels of Android's AThermal_getCurrentThermalStatus
+    enum class ThermalStatus : int32_t {
+        None = 0,
+        Light,
+        Moderate,
+        Severe,
+        Critical,
+        Emergency,
+        Shutdown,
+    };
+
+    struct Config {
+        // Cadences to pick from in Hz, those within 5% of the refresh rate divided by a whole number are used
+        std::vector<uint32_t> rates{ 90, 60, 30 };
+        float headroom{ 0.8f };
+        float holdSeconds{ 2.0f };
+        float maxHoldSeconds{ 16.0f };
+        uint32_t sampleCount{ 8 };
+        // The fastest cadences at Moderate, and at Severe and above
+        uint32_t moderateRate{ 60 };
+        uint32_t severeRate{ 30 };
+    };
+
+    Config config;
+
+    bool enabled() const { return active; }
+    // Disabling returns to presenting at every refresh
+    void setEnabled(bool enable);
+
+    // The duration of a display refresh, from VK_GOOGLE_display_timing or the vsync callbacks of the platform
+    void setRefreshDuration(uint64_t nanoseconds);
+    void setThermalStatus(ThermalStatus status);
+
+    // Add the work time of a frame, the longer of its CPU time without waiting for the display and its GPU time,
+    // `elapsedSeconds` after the previous one.  Returns true if the interval changed.
+    bool update(float workMilliseconds, float elapsedSeconds);
+
+    // Refreshes from one present to the next, 0 while disabled or before the refresh duration is known
+    uint32_t interval() const { return active ? currentInterval : 0; }
+    // The cadence in Hz, 0 while disabled or before the refresh duration is known
+    float rate() const;
+    ThermalStatus thermalStatus() const { return thermal; }
+
+private:
+    // The intervals of the usable cadences, fastest first
+    void updateIntervals();
+    // The fastest interval the thermal status allows
+    uint32_t minimumInterval() const;
+    float budgetMilliseconds(uint32_t interval) const { return (float)((double)refreshDuration * interval / 1.0e6); }
+    bool setInterval(uint32_t interval);
+
+    bool active{ false };
+    uint64_t refreshDuration{ 0 };
+    ThermalStatus thermal{ ThermalStatus::None };
+    std::vector<uint32_t> intervals;
+    uint32_t currentInterval{ 0 };
+
+    float sampleSum{ 0.0f };
+    uint32_t samples{ 0 };
+    float windowSeconds{ 0.0f };
+    // How long the frames have fit the faster cadence, and how long the current one has lasted
+    float fitSeconds{ 0.0f };
+    float cadenceSeconds{ 0.0f };
+    float hold{ 0.0f };
+    bool lastChangeWasRise{ false };
+};
+
+}  // namespace vks
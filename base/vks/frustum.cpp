@@ -0,0 +1,204 @@
+#include "frustum.hpp"
+
+#include <algorithm>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define VKS_FRUSTUM_AVX 1
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define VKS_FRUSTUM_SSE 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VKS_FRUSTUM_NEON 1
+#endif
+
+using namespace vks;
+
+namespace {
+
+// The handful of operations the batch tests need, on as many floats at a time as the target has.  Without any of
+// the instruction sets this degenerates to one element at a time.
+#if defined(VKS_FRUSTUM_AVX)
+struct Lanes {
+    static const size_t WIDTH = 8;
+    using Float = __m256;
+    using Mask = __m256;
+    static Float load(const float* values) { return _mm256_loadu_ps(values); }
+    static Float set(float value) { return _mm256_set1_ps(value); }
+    static Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+    static Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+    static Mask greater(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static Mask both(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+    static Mask all() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+    static uint32_t bits(Mask mask) { return (uint32_t)_mm256_movemask_ps(mask); }
+};
+#elif defined(VKS_FRUSTUM_SSE)
+struct Lanes {
+    static const size_t WIDTH = 4;
+    using Float = __m128;
+    using Mask = __m128;
+    static Float load(const float* values) { return _mm_loadu_ps(values); }
+    static Float set(float value) { return _mm_set1_ps(value); }
+    static Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+    static Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+    static Mask greater(Float a, Float b) { return _mm_cmpgt_ps(a, b); }
+    static Mask both(Mask a, Mask b) { return _mm_and_ps(a, b); }
+    static Mask all() { return _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps()); }
+    static uint32_t bits(Mask mask) { return (uint32_t)_mm_movemask_ps(mask); }
+};
+#elif defined(VKS_FRUSTUM_NEON)
+struct Lanes {
+    static const size_t WIDTH = 4;
+    using Float = float32x4_t;
+    using Mask = uint32x4_t;
+    static Float load(const float* values) { return vld1q_f32(values); }
+    static Float set(float value) { return vdupq_n_f32(value); }
+    static Float add(Float a, Float b) { return vaddq_f32(a, b); }
+    static Float sub(Float a, Float b) { return vsubq_f32(a, b); }
+    static Float mul(Float a, Float b) { return vmulq_f32(a, b); }
+    static Mask greater(Float a, Float b) { return vcgtq_f32(a, b); }
+    static Mask both(Mask a, Mask b) { return vandq_u32(a, b); }
+    static Mask all() { return vdupq_n_u32(0xFFFFFFFFu); }
+    static uint32_t bits(Mask mask) {
+        static const uint32_t weights[4] = { 1, 2, 4, 8 };
+        const uint32x4_t weighted = vandq_u32(mask, vld1q_u32(weights));
+        return vgetq_lane_u32(weighted, 0) | vgetq_lane_u32(weighted, 1) | vgetq_lane_u32(weighted, 2) | vgetq_lane_u32(weighted, 3);
+    }
+};
+#else
+struct Lanes {
+    static const size_t WIDTH = 1;
+    using Float = float;
+    using Mask = bool;
+    static Float load(const float* values) { return *values; }
+    static Float set(float value) { return value; }
+    static Float add(Float a, Float b) { return a + b; }
+    static Float sub(Float a, Float b) { return a - b; }
+    static Float mul(Float a, Float b) { return a * b; }
+    static Mask greater(Float a, Float b) { return a > b; }
+    static Mask both(Mask a, Mask b) { return a && b; }
+    static Mask all() { return true; }
+    static uint32_t bits(Mask mask) { return mask ? 1 : 0; }
+};
+#endif
+
+// The planes selected by a mask, and their components broadcast to every lane
+struct PlaneSet {
+    std::array<glm::vec4, 6> planes;
+    std::array<std::array<Lanes::Float, 4>, 6> lanes;
+    uint32_t count{ 0 };
+
+    PlaneSet(const std::array<glm::vec4, 6>& all, uint32_t mask) {
+        for (uint32_t side = 0; side < 6; ++side) {
+            if (mask & (1u << side)) {
+                const glm::vec4& plane = all[side];
+                lanes[count] = { Lanes::set(plane.x), Lanes::set(plane.y), Lanes::set(plane.z), Lanes::set(plane.w) };
+                planes[count++] = plane;
+            }
+        }
+    }
+};
+
+// Writes `base + lane` for every set bit of `mask`, lowest lane first
+inline uint32_t* append(uint32_t* out, uint32_t mask, size_t base) {
+    for (uint32_t lane = 0; mask; ++lane, mask >>= 1) {
+        if (mask & 1) {
+            *out++ = (uint32_t)(base + lane);
+        }
+    }
+    return out;
+}
+
+// Same arithmetic, in the same order, as the full width tests, so an element gets the same result either way
+inline float distance(const glm::vec4& plane, float x, float y, float z) {
+    return plane.x * x + plane.y * y + plane.z * z + plane.w;
+}
+
+// Runs `test(begin, end, out)` over [first, last) of a structure of arrays, collecting the visible indices in `visible`
+template <typename Test>
+size_t compact(std::vector<uint32_t>& visible, size_t first, size_t last, size_t size, const Test& test) {
+    last = std::min(last, size);
+    if (first >= last) {
+        return 0;
+    }
+    const size_t offset = visible.size();
+    visible.resize(offset + (last - first));
+    uint32_t* const begin = visible.data() + offset;
+    const uint32_t* end = test(first, last, begin);
+    visible.resize(offset + (end - begin));
+    return end - begin;
+}
+
+}  // namespace
+
+size_t Frustum::cullSpheres(const SphereArray& spheres, std::vector<uint32_t>& visible, size_t first, size_t last, uint32_t planeMask) const {
+    const PlaneSet set(planes, planeMask);
+    return compact(visible, first, last, spheres.size(), [&](size_t begin, size_t end, uint32_t* out) {
+        size_t i = begin;
+        for (; i + Lanes::WIDTH <= end; i += Lanes::WIDTH) {
+            const Lanes::Float x = Lanes::load(spheres.x.data() + i);
+            const Lanes::Float y = Lanes::load(spheres.y.data() + i);
+            const Lanes::Float z = Lanes::load(spheres.z.data() + i);
+            const Lanes::Float negativeRadius = Lanes::sub(Lanes::set(0.0f), Lanes::load(spheres.radius.data() + i));
+            Lanes::Mask inside = Lanes::all();
+            for (uint32_t p = 0; p < set.count; ++p) {
+                const auto& plane = set.lanes[p];
+                const Lanes::Float d = Lanes::add(Lanes::add(Lanes::add(Lanes::mul(plane[0], x), Lanes::mul(plane[1], y)), Lanes::mul(plane[2], z)), plane[3]);
+                inside = Lanes::both(inside, Lanes::greater(d, negativeRadius));
+            }
+            out = append(out, Lanes::bits(inside), i);
+        }
+        for (; i < end; ++i) {
+            bool inside = true;
+            for (uint32_t p = 0; p < set.count && inside; ++p) {
+                inside = distance(set.planes[p], spheres.x[i], spheres.y[i], spheres.z[i]) > -spheres.radius[i];
+            }
+            if (inside) {
+                *out++ = (uint32_t)i;
+            }
+        }
+        return out;
+    });
+}
+
+size_t Frustum::cullBoxes(const BoxArray& boxes, std::vector<uint32_t>& visible, size_t first, size_t last, uint32_t planeMask) const {
+    const PlaneSet set(planes, planeMask);
+    // The corner furthest along each normal, picked once per plane rather than per box
+    std::array<std::array<const float*, 3>, 6> corners;
+    for (uint32_t p = 0; p < set.count; ++p) {
+        const glm::vec4& plane = set.planes[p];
+        corners[p] = { (plane.x >= 0.0f ? boxes.maxX : boxes.minX).data(), (plane.y >= 0.0f ? boxes.maxY : boxes.minY).data(),
+                       (plane.z >= 0.0f ? boxes.maxZ : boxes.minZ).data() };
+    }
+    return compact(visible, first, last, boxes.size(), [&](size_t begin, size_t end, uint32_t* out) {
+        size_t i = begin;
+        const Lanes::Float zero = Lanes::set(0.0f);
+        for (; i + Lanes::WIDTH <= end; i += Lanes::WIDTH) {
+            Lanes::Mask inside = Lanes::all();
+            for (uint32_t p = 0; p < set.count; ++p) {
+                const auto& plane = set.lanes[p];
+                const auto& corner = corners[p];
+                const Lanes::Float x = Lanes::load(corner[0] + i);
+                const Lanes::Float y = Lanes::load(corner[1] + i);
+                const Lanes::Float z = Lanes::load(corner[2] + i);
+                const Lanes::Float d = Lanes::add(Lanes::add(Lanes::add(Lanes::mul(plane[0], x), Lanes::mul(plane[1], y)), Lanes::mul(plane[2], z)), plane[3]);
+                inside = Lanes::both(inside, Lanes::greater(d, zero));
+            }
+            out = append(out, Lanes::bits(inside), i);
+        }
+        for (; i < end; ++i) {
+            bool inside = true;
+            for (uint32_t p = 0; p < set.count && inside; ++p) {
+                const auto& corner = corners[p];
+                inside = distance(set.planes[p], corner[0][i], corner[1][i], corner[2][i]) > 0.0f;
+            }
+            if (inside) {
+                *out++ = (uint32_t)i;
+            }
+        }
+        return out;
+    });
+}
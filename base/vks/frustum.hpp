@@ -6,67 +6,160 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#pragma once
+
 #include <array>
+#include <cstdint>
+#include <vector>
 #include <math.h>
 #include <glm/glm.hpp>
 
-namespace vks
-{
-	class Frustum
-	{
-	public:
-		enum side { LEFT = 0, RIGHT = 1, TOP = 2, BOTTOM = 3, BACK = 4, FRONT = 5 };
-		std::array<glm::vec4, 6> planes;
-
-		void update(glm::mat4 matrix)
-		{
-			planes[LEFT].x = matrix[0].w + matrix[0].x;
-			planes[LEFT].y = matrix[1].w + matrix[1].x;
-			planes[LEFT].z = matrix[2].w + matrix[2].x;
-			planes[LEFT].w = matrix[3].w + matrix[3].x;
-
-			planes[RIGHT].x = matrix[0].w - matrix[0].x;
-			planes[RIGHT].y = matrix[1].w - matrix[1].x;
-			planes[RIGHT].z = matrix[2].w - matrix[2].x;
-			planes[RIGHT].w = matrix[3].w - matrix[3].x;
-
-			planes[TOP].x = matrix[0].w - matrix[0].y;
-			planes[TOP].y = matrix[1].w - matrix[1].y;
-			planes[TOP].z = matrix[2].w - matrix[2].y;
-			planes[TOP].w = matrix[3].w - matrix[3].y;
-
-			planes[BOTTOM].x = matrix[0].w + matrix[0].y;
-			planes[BOTTOM].y = matrix[1].w + matrix[1].y;
-			planes[BOTTOM].z = matrix[2].w + matrix[2].y;
-			planes[BOTTOM].w = matrix[3].w + matrix[3].y;
-
-			planes[BACK].x = matrix[0].w + matrix[0].z;
-			planes[BACK].y = matrix[1].w + matrix[1].z;
-			planes[BACK].z = matrix[2].w + matrix[2].z;
-			planes[BACK].w = matrix[3].w + matrix[3].z;
-
-			planes[FRONT].x = matrix[0].w - matrix[0].z;
-			planes[FRONT].y = matrix[1].w - matrix[1].z;
-			planes[FRONT].z = matrix[2].w - matrix[2].z;
-			planes[FRONT].w = matrix[3].w - matrix[3].z;
-
-			for (auto i = 0; i < planes.size(); i++)
-			{
-				float length = sqrtf(planes[i].x * planes[i].x + planes[i].y * planes[i].y + planes[i].z * planes[i].z);
-				planes[i] /= length;
-			}
-		}
-		
-		bool checkSphere(glm::vec3 pos, float radius)
-		{
-			for (auto i = 0; i < planes.size(); i++)
-			{
-				if ((planes[i].x * pos.x) + (planes[i].y * pos.y) + (planes[i].z * pos.z) + planes[i].w <= -radius)
-				{
-					return false;
-				}
-			}
-			return true;
-		}
-	};
-}
+namespace vks {
+
+// Bounding spheres as a structure of arrays, the layout the batch tests of Frustum read several at a time
+struct SphereArray {
+    std::vector<float> x, y, z, radius;
+
+    size_t size() const { return x.size(); }
+    void reserve(size_t count) {
+        x.reserve(count);
+        y.reserve(count);
+        z.reserve(count);
+        radius.reserve(count);
+    }
+    void resize(size_t count) {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+        radius.resize(count);
+    }
+    void clear() { resize(0); }
+    void set(size_t index, const glm::vec3& center, float r) {
+        x[index] = center.x;
+        y[index] = center.y;
+        z[index] = center.z;
+        radius[index] = r;
+    }
+    void push_back(const glm::vec3& center, float r) {
+        x.push_back(center.x);
+        y.push_back(center.y);
+        z.push_back(center.z);
+        radius.push_back(r);
+    }
+};
+
+// Axis aligned bounding boxes as a structure of arrays
+struct BoxArray {
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+
+    size_t size() const { return minX.size(); }
+    void reserve(size_t count) {
+        for (auto* values : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ }) {
+            values->reserve(count);
+        }
+    }
+    void resize(size_t count) {
+        for (auto* values : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ }) {
+            values->resize(count);
+        }
+    }
+    void clear() { resize(0); }
+    void set(size_t index, const glm::vec3& min, const glm::vec3& max) {
+        minX[index] = min.x;
+        minY[index] = min.y;
+        minZ[index] = min.z;
+        maxX[index] = max.x;
+        maxY[index] = max.y;
+        maxZ[index] = max.z;
+    }
+    void push_back(const glm::vec3& min, const glm::vec3& max) {
+        resize(size() + 1);
+        set(size() - 1, min, max);
+    }
+};
+
+class Frustum {
+public:
+    enum side
+    {
+        LEFT = 0,
+        RIGHT = 1,
+        TOP = 2,
+        BOTTOM = 3,
+        BACK = 4,
+        FRONT = 5
+    };
+    // Plane masks for the batch tests, one bit per side
+    static const uint32_t ALL_PLANES = 0x3F;
+
+    std::array<glm::vec4, 6> planes;
+
+    void update(glm::mat4 matrix) {
+        planes[LEFT].x = matrix[0].w + matrix[0].x;
+        planes[LEFT].y = matrix[1].w + matrix[1].x;
+        planes[LEFT].z = matrix[2].w + matrix[2].x;
+        planes[LEFT].w = matrix[3].w + matrix[3].x;
+
+        planes[RIGHT].x = matrix[0].w - matrix[0].x;
+        planes[RIGHT].y = matrix[1].w - matrix[1].x;
+        planes[RIGHT].z = matrix[2].w - matrix[2].x;
+        planes[RIGHT].w = matrix[3].w - matrix[3].x;
+
+        planes[TOP].x = matrix[0].w - matrix[0].y;
+        planes[TOP].y = matrix[1].w - matrix[1].y;
+        planes[TOP].z = matrix[2].w - matrix[2].y;
+        planes[TOP].w = matrix[3].w - matrix[3].y;
+
+        planes[BOTTOM].x = matrix[0].w + matrix[0].y;
+        planes[BOTTOM].y = matrix[1].w + matrix[1].y;
+        planes[BOTTOM].z = matrix[2].w + matrix[2].y;
+        planes[BOTTOM].w = matrix[3].w + matrix[3].y;
+
+        planes[BACK].x = matrix[0].w + matrix[0].z;
+        planes[BACK].y = matrix[1].w + matrix[1].z;
+        planes[BACK].z = matrix[2].w + matrix[2].z;
+        planes[BACK].w = matrix[3].w + matrix[3].z;
+
+        planes[FRONT].x = matrix[0].w - matrix[0].z;
+        planes[FRONT].y = matrix[1].w - matrix[1].z;
+        planes[FRONT].z = matrix[2].w - matrix[2].z;
+        planes[FRONT].w = matrix[3].w - matrix[3].z;
+
+        for (auto i = 0; i < planes.size(); i++) {
+            float length = sqrtf(planes[i].x * planes[i].x + planes[i].y * planes[i].y + planes[i].z * planes[i].z);
+            planes[i] /= length;
+        }
+    }
+
+    bool checkSphere(glm::vec3 pos, float radius) const {
+        for (auto i = 0; i < planes.size(); i++) {
+            if ((planes[i].x * pos.x) + (planes[i].y * pos.y) + (planes[i].z * pos.z) + planes[i].w <= -radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Tests the corner of the box furthest along each plane normal
+    bool checkBox(const glm::vec3& min, const glm::vec3& max) const {
+        for (const auto& plane : planes) {
+            const glm::vec3 corner{ plane.x >= 0.0f ? max.x : min.x, plane.y >= 0.0f ? max.y : min.y, plane.z >= 0.0f ? max.z : min.z };
+            if (glm::dot(glm::vec3(plane), corner) + plane.w <= 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+        Batch tests of the elements [first, last) of a structure of arrays, several elements per instruction with
+        SSE (or AVX where the compiler targets it) and NEON.  The indices of the visible elements are appended to
+        `visible` in ascending order, and their count is returned.  `planeMask` selects the sides tested, one bit per
+        side, e.g. to leave out the near plane of a light volume that casters in front of it still shadow.
+    */
+    size_t cullSpheres(const SphereArray& spheres, std::vector<uint32_t>& visible, size_t first = 0, size_t last = SIZE_MAX,
+                       uint32_t planeMask = ALL_PLANES) const;
+    size_t cullBoxes(const BoxArray& boxes, std::vector<uint32_t>& visible, size_t first = 0, size_t last = SIZE_MAX,
+                     uint32_t planeMask = ALL_PLANES) const;
+};
+}  // namespace vks
@@ -0,0 +1,332 @@
+#include "glsl.hpp"
+#include "hash.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <sys/stat.h>
+#if defined(WIN32)
+#include <direct.h>
+#endif
+
+#include <glslang/Public/ResourceLimits.h>
+#include <glslang/Public/ShaderLang.h>
+#include <glslang/SPIRV/GlslangToSpv.h>
+
+using namespace vks::shaders;
+
+namespace {
+
+// Bump when a change to the compile options makes the cached SPIR-V stale
+const uint32_t CACHE_VERSION = 1;
+const uint32_t SPIRV_MAGIC = 0x07230203;
+
+const std::unordered_map<std::string, EShLanguage>& stages() {
+    static const std::unordered_map<std::string, EShLanguage> stages{
+        { "vert", EShLangVertex },      { "frag", EShLangFragment },          { "comp", EShLangCompute },
+        { "tesc", EShLangTessControl }, { "tese", EShLangTessEvaluation },    { "geom", EShLangGeometry },
+        { "rgen", EShLangRayGen },      { "rmiss", EShLangMiss },             { "rchit", EShLangClosestHit },
+        { "rahit", EShLangAnyHit },     { "task", EShLangTask },              { "mesh", EShLangMesh },
+    };
+    return stages;
+}
+
+struct Target {
+    glslang::EShTargetClientVersion client{ glslang::EShTargetVulkan_1_0 };
+    glslang::EShTargetLanguageVersion spirv{ glslang::EShTargetSpv_1_0 };
+};
+
+// The --target-env rules of CompileSpirvShader.cmake
+Target target(const std::string& sourceFile, EShLanguage stage) {
+    const auto slash = sourceFile.find_last_of("/\\");
+    const auto fileName = slash == std::string::npos ? sourceFile : sourceFile.substr(slash + 1);
+    const auto name = fileName.substr(0, fileName.find('.'));
+    auto endsWith = [&](const std::string& suffix) {
+        return name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+
+    Target result;
+    if (endsWith("_subgroup")) {
+        result = { glslang::EShTargetVulkan_1_1, glslang::EShTargetSpv_1_3 };
+    }
+    const bool rayStage = stage == EShLangRayGen || stage == EShLangMiss || stage == EShLangClosestHit || stage == EShLangAnyHit;
+    const bool meshStage = stage == EShLangTask || stage == EShLangMesh;
+    if (rayStage || meshStage || endsWith("_rayquery")) {
+        result = { glslang::EShTargetVulkan_1_1, glslang::EShTargetSpv_1_4 };
+    }
+    return result;
+}
+
+bool readText(const std::string& filename, std::string& outText) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    outText = buffer.str();
+    return true;
+}
+
+bool modificationTime(const std::string& filename, time_t& outTime) {
+    struct stat info;
+    if (0 != stat(filename.c_str(), &info)) {
+        return false;
+    }
+    outTime = info.st_mtime;
+    return true;
+}
+
+// Resolves `#include "file"` relative to the including file, recording what it read
+class Includer : public glslang::TShader::Includer {
+public:
+    explicit Includer(std::vector<std::string>& dependencies)
+        : dependencies(dependencies) {}
+
+    IncludeResult* includeLocal(const char* headerName, const char* includerName, size_t depth) override {
+        const std::string includer{ includerName };
+        const auto slash = includer.find_last_of("/\\");
+        const std::string path = (slash == std::string::npos ? std::string() : includer.substr(0, slash + 1)) + headerName;
+        auto contents = new std::string();
+        if (!readText(path, *contents)) {
+            delete contents;
+            return nullptr;
+        }
+        if (std::find(dependencies.begin(), dependencies.end(), path) == dependencies.end()) {
+            dependencies.push_back(path);
+        }
+        return new IncludeResult(path, contents->data(), contents->size(), contents);
+    }
+
+    void releaseInclude(IncludeResult* result) override {
+        if (result) {
+            delete static_cast<std::string*>(result->userData);
+            delete result;
+        }
+    }
+
+private:
+    std::vector<std::string>& dependencies;
+};
+
+struct Shader {
+    Shader(const std::string& sourceFile, const std::string& source, EShLanguage stage, const Target& target)
+        : shader(stage) {
+        const char* text = source.c_str();
+        const int length = static_cast<int>(source.size());
+        const char* name = sourceFile.c_str();
+        shader.setStringsWithLengthsAndNames(&text, &length, &name, 1);
+        shader.setEnvInput(glslang::EShSourceGlsl, stage, glslang::EShClientVulkan, 100);
+        shader.setEnvClient(glslang::EShClientVulkan, target.client);
+        shader.setEnvTarget(glslang::EShTargetSpv, target.spirv);
+    }
+
+    glslang::TShader shader;
+};
+
+const EShMessages MESSAGES = static_cast<EShMessages>(EShMsgSpvRules | EShMsgVulkanRules);
+
+}  // namespace
+
+GlslCompiler::GlslCompiler(const std::string& cacheDirectory)
+    : cacheDirectory(cacheDirectory) {
+    // Reference counted by glslang, so any number of compilers can coexist
+    glslang::InitializeProcess();
+}
+
+GlslCompiler::~GlslCompiler() {
+    glslang::FinalizeProcess();
+}
+
+std::string GlslCompiler::sourceFile(const std::string& spirvFile) {
+    static const std::string SPIRV_EXTENSION{ ".spv" };
+    if (spirvFile.size() <= SPIRV_EXTENSION.size() ||
+        spirvFile.compare(spirvFile.size() - SPIRV_EXTENSION.size(), SPIRV_EXTENSION.size(), SPIRV_EXTENSION) != 0) {
+        return {};
+    }
+    const auto source = spirvFile.substr(0, spirvFile.size() - SPIRV_EXTENSION.size());
+    const auto dot = source.find_last_of('.');
+    if (dot == std::string::npos || stages().count(source.substr(dot + 1)) == 0) {
+        return {};
+    }
+    return source;
+}
+
+CompileResult GlslCompiler::compile(const std::string& sourceFile) const {
+    const auto dot = sourceFile.find_last_of('.');
+    const auto stageItr = dot == std::string::npos ? stages().end() : stages().find(sourceFile.substr(dot + 1));
+    if (stageItr == stages().end()) {
+        throw std::runtime_error("Unknown shader stage of " + sourceFile);
+    }
+    const EShLanguage stage = stageItr->second;
+    const Target shaderTarget = target(sourceFile, stage);
+
+    std::string source;
+    if (!readText(sourceFile, source)) {
+        throw std::runtime_error("Unable to read shader source " + sourceFile);
+    }
+
+    CompileResult result;
+    result.dependencies.push_back(sourceFile);
+    Includer includer(result.dependencies);
+    const TBuiltInResource* resources = GetDefaultResources();
+
+    std::string preprocessed;
+    {
+        Shader shader(sourceFile, source, stage, shaderTarget);
+        if (!shader.shader.preprocess(resources, 100, ENoProfile, false, false, MESSAGES, &preprocessed, includer)) {
+            throw std::runtime_error("Failed to preprocess " + sourceFile + ":\n" + shader.shader.getInfoLog());
+        }
+    }
+
+    std::string cacheFile;
+    if (!cacheDirectory.empty()) {
+        KeyHasher hasher;
+        hasher.add(CACHE_VERSION);
+        hasher.add(stage);
+        hasher.add(shaderTarget.client);
+        hasher.add(shaderTarget.spirv);
+        hasher.add(preprocessed.data(), preprocessed.size());
+        char name[17];
+        snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hasher.hash));
+        cacheFile = cacheDirectory + "/" + name + ".spv";
+
+        std::ifstream file(cacheFile, std::ios::binary | std::ios::ate);
+        const auto size = file ? static_cast<size_t>(file.tellg()) : 0;
+        if (size >= sizeof(uint32_t) && size % sizeof(uint32_t) == 0) {
+            result.spirv.resize(size / sizeof(uint32_t));
+            file.seekg(0, std::ios::beg);
+            if (file.read(reinterpret_cast<char*>(result.spirv.data()), size) && result.spirv[0] == SPIRV_MAGIC) {
+                result.cached = true;
+                return result;
+            }
+            result.spirv.clear();
+        }
+    }
+
+    // Includes were already recorded by the preprocessor
+    std::vector<std::string> ignored;
+    Includer compileIncluder(ignored);
+    Shader shader(sourceFile, source, stage, shaderTarget);
+    if (!shader.shader.parse(resources, 100, false, MESSAGES, compileIncluder)) {
+        throw std::runtime_error("Failed to compile " + sourceFile + ":\n" + shader.shader.getInfoLog());
+    }
+    glslang::TProgram program;
+    program.addShader(&shader.shader);
+    if (!program.link(MESSAGES)) {
+        throw std::runtime_error("Failed to link " + sourceFile + ":\n" + program.getInfoLog());
+    }
+    glslang::GlslangToSpv(*program.getIntermediate(stage), result.spirv);
+
+    // Write to a temporary file and rename it over the old one, so that an interrupted write can never leave a
+    // truncated cache file behind
+    if (!cacheFile.empty()) {
+        std::unique_lock<std::mutex> lock(cacheMutex);
+#if defined(WIN32)
+        _mkdir(cacheDirectory.c_str());
+#else
+        mkdir(cacheDirectory.c_str(), 0755);
+#endif
+        const std::string tempFile = cacheFile + ".tmp";
+        {
+            std::ofstream file(tempFile, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(result.spirv.data()), result.spirv.size() * sizeof(uint32_t));
+        }
+#if defined(WIN32)
+        std::remove(cacheFile.c_str());
+#endif
+        std::rename(tempFile.c_str(), cacheFile.c_str());
+    }
+    return result;
+}
+
+ShaderWatcher::ShaderWatcher(const std::shared_ptr<GlslCompiler>& compiler, const std::chrono::milliseconds& interval)
+    : compiler(compiler)
+    , interval(interval) {
+    thread = std::thread([this] { run(); });
+}
+
+ShaderWatcher::~ShaderWatcher() {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    thread.join();
+}
+
+void ShaderWatcher::watch(const std::string& spirvFile, const std::vector<std::string>& dependencies) {
+    const auto source = GlslCompiler::sourceFile(spirvFile);
+    if (source.empty()) {
+        return;
+    }
+    Watched entry;
+    entry.source = source;
+    for (const auto& dependency : dependencies) {
+        time_t time = 0;
+        modificationTime(dependency, time);
+        entry.files.emplace_back(dependency, time);
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    watched[spirvFile] = entry;
+}
+
+std::vector<std::string> ShaderWatcher::changed() {
+    std::unique_lock<std::mutex> lock(mutex);
+    std::vector<std::string> result{ compiled.begin(), compiled.end() };
+    compiled.clear();
+    return result;
+}
+
+void ShaderWatcher::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!condition.wait_for(lock, interval, [this] { return stopping; })) {
+        // Compiles happen outside the lock, so that watch and changed never wait on glslang
+        const auto snapshot = watched;
+        lock.unlock();
+        std::vector<std::pair<std::string, Watched>> updates;
+        std::vector<std::string> succeeded;
+        for (const auto& entry : snapshot) {
+            bool modified = false;
+            for (const auto& file : entry.second.files) {
+                time_t time = 0;
+                modificationTime(file.first, time);
+                modified |= time != file.second;
+            }
+            if (!modified) {
+                continue;
+            }
+
+            // Dependencies are refreshed even if the compile fails, so a broken source is only retried once it
+            // changes again
+            std::vector<std::string> dependencies;
+            try {
+                auto result = compiler->compile(entry.second.source);
+                dependencies = result.dependencies;
+                succeeded.push_back(entry.first);
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                for (const auto& file : entry.second.files) {
+                    dependencies.push_back(file.first);
+                }
+            }
+            Watched update;
+            update.source = entry.second.source;
+            for (const auto& dependency : dependencies) {
+                time_t time = 0;
+                modificationTime(dependency, time);
+                update.files.emplace_back(dependency, time);
+            }
+            updates.emplace_back(entry.first, update);
+        }
+        lock.lock();
+        for (const auto& update : updates) {
+            watched[update.first] = update.second;
+        }
+        compiled.insert(succeeded.begin(), succeeded.end());
+    }
+}
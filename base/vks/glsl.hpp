@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace vks { namespace shaders {
+
+struct CompileResult {
+    std::vector<uint32_t> spirv;
+    // The source and every file it included, which is what the SPIR-V depends on
+    std::vector<std::string> dependencies;
+    // Whether the SPIR-V came from the disk cache
+    bool cached{ false };
+};
+
+// GLSL to SPIR-V through glslang, in process.  The stage comes from the file extension and the target environment
+// from the same naming rules as CompileSpirvShader.cmake, so that `foo.vert` compiles to what `foo.vert.spv` would
+// have held, short of the spirv-opt pass.  Local includes are resolved relative to the including file.
+//
+// The SPIR-V is cached on disk, keyed by the preprocessed source along with the stage and target, so edits that
+// don't change the preprocessed source, like ones to comments or to an unused part of an include, hit the cache.
+//
+// Thread safe.
+class GlslCompiler {
+public:
+    // Empty `cacheDirectory` disables the disk cache, otherwise it's created on first use
+    explicit GlslCompiler(const std::string& cacheDirectory = {});
+    ~GlslCompiler();
+
+    GlslCompiler(const GlslCompiler&) = delete;
+    GlslCompiler& operator=(const GlslCompiler&) = delete;
+
+    // Throws std::runtime_error with glslang's log if compilation fails
+    CompileResult compile(const std::string& sourceFile) const;
+
+    // The GLSL source a SPIR-V file is compiled from, `foo.vert` for `foo.vert.spv`, or empty for anything that
+    // isn't the output of a shader stage
+    static std::string sourceFile(const std::string& spirvFile);
+
+private:
+    std::string cacheDirectory;
+    mutable std::mutex cacheMutex;
+};
+
+// Polls the sources of the SPIR-V files it's told about, and their includes, on a thread of its own, and compiles
+// the ones that changed.  As compiling leaves the result in the compiler's disk cache, loading the SPIR-V file again
+// through the ModuleCache afterwards is cheap.
+class ShaderWatcher {
+public:
+    explicit ShaderWatcher(const std::shared_ptr<GlslCompiler>& compiler,
+                           const std::chrono::milliseconds& interval = std::chrono::milliseconds(250));
+    ~ShaderWatcher();
+
+    ShaderWatcher(const ShaderWatcher&) = delete;
+    ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+    // `dependencies` are those of the compile of its source that the current SPIR-V of `spirvFile` came from
+    void watch(const std::string& spirvFile, const std::vector<std::string>& dependencies);
+
+    // The SPIR-V files whose sources changed and compiled since the last call.  Sources that fail to compile are
+    // reported on stderr and show up once a later change makes them compile.
+    std::vector<std::string> changed();
+
+private:
+    struct Watched {
+        std::string source;
+        std::vector<std::pair<std::string, time_t>> files;
+    };
+
+    void run();
+
+    std::shared_ptr<GlslCompiler> compiler;
+    std::chrono::milliseconds interval;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping{ false };
+    std::unordered_map<std::string, Watched> watched;
+    std::set<std::string> compiled;
+    std::thread thread;
+};
+
+}}  // namespace vks::shaders
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vks {
+
+// FNV-1a, for the keys of the on disk caches
+struct KeyHasher {
+    uint64_t hash{ 14695981039346656037ull };
+
+    void add(const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    }
+
+    template <typename T>
+    void add(const T& value) {
+        add(&value, sizeof(T));
+    }
+};
+
+}  // namespace vks
@@ -8,6 +8,8 @@
 
 #pragma once
 
+#include <algorithm>
+
 #include <glm/glm.hpp>
 
 #include <vulkan/vulkan.hpp>
@@ -66,6 +68,8 @@ inline vk::AccessFlags accessFlagsForLayout(vk::ImageLayout layout) {
             return vk::AccessFlagBits::eDepthStencilAttachmentWrite;
         case vk::ImageLayout::eShaderReadOnlyOptimal:
             return vk::AccessFlagBits::eShaderRead;
+        case vk::ImageLayout::eShadingRateOptimalNV:
+            return vk::AccessFlagBits::eShadingRateImageReadNV;
         default:
             return vk::AccessFlags();
     }
@@ -86,6 +90,9 @@ inline vk::PipelineStageFlags pipelineStageForLayout(vk::ImageLayout layout) {
         case vk::ImageLayout::eShaderReadOnlyOptimal:
             return vk::PipelineStageFlagBits::eFragmentShader;
 
+        case vk::ImageLayout::eShadingRateOptimalNV:
+            return vk::PipelineStageFlagBits::eShadingRateImageNV;
+
         case vk::ImageLayout::ePreinitialized:
             return vk::PipelineStageFlagBits::eHost;
 
@@ -103,4 +110,15 @@ inline vk::ClearColorValue clearColor(const glm::vec4& v = glm::vec4(0)) {
     return result;
 }
 
+// Number of levels in a full mip chain for `extent`, down to 1x1x1
+inline uint32_t mipLevelCount(const vk::Extent3D& extent) {
+    uint32_t size = std::max(std::max(extent.width, extent.height), extent.depth);
+    uint32_t levels = 1;
+    while (size > 1) {
+        size >>= 1;
+        ++levels;
+    }
+    return levels;
+}
+
 }}  // namespace vks::util
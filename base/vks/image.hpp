@@ -1,13 +1,33 @@
 #pragma once
 
+#include <vector>
+
 #include "allocation.hpp"
+#include "samplers.hpp"
 
 namespace vks {
+
+// The layout of one mip level of one layer of an image, and what of its accesses so far a barrier before the next
+// one has to wait for, see vks::Barriers
+struct ImageSubresourceState {
+    vk::ImageLayout layout{ vk::ImageLayout::eUndefined };
+    // Of the last write
+    vk::PipelineStageFlags2KHR writeStages;
+    vk::AccessFlags2KHR writeAccess;
+    // Of the reads since the last write
+    vk::PipelineStageFlags2KHR readStages;
+    // What the last write has been made visible to
+    vk::PipelineStageFlags2KHR visibleStages;
+    vk::AccessFlags2KHR visibleAccess;
+};
+
 // Encaspulates an image, the memory for that image, a view of the image,
 // as well as a sampler and the image format.
 //
 // The sampler is not populated by the allocation code, but is provided
-// for convenience and easy cleanup if it is populated.
+// for convenience and easy cleanup if it is populated.  It is released
+// rather than destroyed, as the texture loaders share theirs through the
+// device's SamplerCache.
 struct Image : public Allocation {
 private:
     using Parent = Allocation;
@@ -18,12 +38,17 @@ public:
     vk::ImageView view;
     vk::Sampler sampler;
     vk::Format format{ vk::Format::eUndefined };
+    uint32_t mipLevels{ 1 };
+    uint32_t arrayLayers{ 1 };
+    // Indexed by layer, then level.  Only vks::Barriers keeps these up to date, so images whose layout changes any
+    // other way have to be told with Barriers::assume.  Copies of an Image track separately.
+    std::vector<ImageSubresourceState> subresourceStates;
 
     operator bool() const { return image.operator bool(); }
 
     void destroy() override {
         if (sampler) {
-            device.destroySampler(sampler);
+            releaseSampler(device, sampler);
             sampler = vk::Sampler();
         }
         if (view) {
@@ -34,6 +59,7 @@ public:
             device.destroyImage(image);
             image = vk::Image();
         }
+        subresourceStates.clear();
         Parent::destroy();
     }
 };
@@ -0,0 +1,220 @@
+#include "impostor.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "context.hpp"
+#include "model.hpp"
+#include "pipelines.hpp"
+
+using namespace vks::model;
+
+const uint32_t Impostor::QUAD_VERTEX_COUNT;
+
+namespace {
+
+const vk::Format ATLAS_FORMAT = vk::Format::eR8G8B8A8Unorm;
+
+// Texels along each side of a view in the last mip level.  Smaller ones would average neighbouring views together
+const uint32_t MIN_MIP_FRAME_SIZE = 4;
+
+bool isPowerOfTwo(uint32_t value) {
+    return value && !(value & (value - 1));
+}
+
+// The vertex inputs of impostorbake.vert by location, and the quantized components that may stand in for them
+const Component BAKE_INPUTS[3][2]{
+    { VERTEX_COMPONENT_POSITION, VERTEX_COMPONENT_POSITION },
+    { VERTEX_COMPONENT_NORMAL, VERTEX_COMPONENT_NORMAL_PACKED },
+    { VERTEX_COMPONENT_COLOR, VERTEX_COMPONENT_COLOR_UNORM8 },
+};
+
+}  // namespace
+
+glm::vec3 Impostor::frameDirection(uint32_t x, uint32_t y, uint32_t frames) {
+    // The octahedron around y, its lower half folded out over the corners
+    const glm::vec2 uv = (glm::vec2((float)x, (float)y) + 0.5f) / (float)frames * 2.0f - 1.0f;
+    glm::vec3 direction{ uv.x, 1.0f - std::abs(uv.x) - std::abs(uv.y), uv.y };
+    if (direction.y < 0.0f) {
+        const float fx = (1.0f - std::abs(direction.z)) * (direction.x >= 0.0f ? 1.0f : -1.0f);
+        const float fz = (1.0f - std::abs(direction.x)) * (direction.z >= 0.0f ? 1.0f : -1.0f);
+        direction.x = fx;
+        direction.z = fz;
+    }
+    return glm::normalize(direction);
+}
+
+void Impostor::bake(const vks::Context& context, const std::string& assetPath, const Model& model, const Config& config) {
+    if (!config.frames || !isPowerOfTwo(config.frameSize) || config.frameSize < MIN_MIP_FRAME_SIZE) {
+        throw std::runtime_error("Impostor views must be powers of two of at least " + std::to_string(MIN_MIP_FRAME_SIZE) + " texels");
+    }
+    std::vector<vk::VertexInputAttributeDescription> attributes;
+    for (uint32_t location = 0; location < 3; ++location) {
+        uint32_t index = model.layout.componentIndex(BAKE_INPUTS[location][0]);
+        if (index == (uint32_t)-1) {
+            index = model.layout.componentIndex(BAKE_INPUTS[location][1]);
+        }
+        if (index == (uint32_t)-1) {
+            throw std::runtime_error("Impostors need models with positions, normals and colors");
+        }
+        attributes.push_back({ location, 0, VertexLayout::componentFormat(model.layout.components[index]), model.layout.offset(index) });
+    }
+
+    const vk::Device& device = context.device;
+    frameCount = config.frames;
+    const glm::vec3 center = (model.dim.min + model.dim.max) * 0.5f;
+    const float radius = glm::length(model.dim.max - model.dim.min) * 0.5f;
+    bounds = glm::vec4(center, radius);
+
+    const uint32_t frameSize = config.frameSize;
+    const uint32_t atlasSize = config.frames * frameSize;
+    vk::ImageCreateInfo imageCreateInfo;
+    imageCreateInfo.imageType = vk::ImageType::e2D;
+    imageCreateInfo.format = ATLAS_FORMAT;
+    imageCreateInfo.extent = vk::Extent3D{ atlasSize, atlasSize, 1 };
+    imageCreateInfo.mipLevels = 1;
+    for (uint32_t size = frameSize; size > MIN_MIP_FRAME_SIZE; size /= 2) {
+        ++imageCreateInfo.mipLevels;
+    }
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc |
+                            vk::ImageUsageFlagBits::eTransferDst;
+    vk::ImageViewCreateInfo viewCreateInfo;
+    viewCreateInfo.viewType = vk::ImageViewType::e2D;
+    viewCreateInfo.format = ATLAS_FORMAT;
+    viewCreateInfo.subresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, imageCreateInfo.mipLevels, 0, 1 };
+    vk::SamplerCreateInfo samplerCreateInfo;
+    samplerCreateInfo.magFilter = vk::Filter::eLinear;
+    samplerCreateInfo.minFilter = vk::Filter::eLinear;
+    samplerCreateInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
+    samplerCreateInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+    samplerCreateInfo.addressModeV = samplerCreateInfo.addressModeU;
+    samplerCreateInfo.addressModeW = samplerCreateInfo.addressModeU;
+    samplerCreateInfo.maxLod = (float)imageCreateInfo.mipLevels;
+
+    // The render pass draws into level 0 only
+    std::vector<vk::ImageView> attachmentViews;
+    for (auto* atlas : { &albedo, &normalDepth }) {
+        *atlas = context.createImage(imageCreateInfo);
+        viewCreateInfo.image = atlas->image;
+        atlas->view = device.createImageView(viewCreateInfo);
+        atlas->sampler = vks::acquireSampler(device, samplerCreateInfo);
+        vk::ImageViewCreateInfo levelCreateInfo{ viewCreateInfo };
+        levelCreateInfo.subresourceRange.levelCount = 1;
+        attachmentViews.push_back(device.createImageView(levelCreateInfo));
+    }
+    const vk::Format depthFormat = context.getSupportedDepthFormat();
+    vk::ImageCreateInfo depthCreateInfo{ imageCreateInfo };
+    depthCreateInfo.format = depthFormat;
+    depthCreateInfo.mipLevels = 1;
+    depthCreateInfo.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
+    vks::Image depth = context.createTransientImage(depthCreateInfo);
+    vk::ImageViewCreateInfo depthViewCreateInfo{ viewCreateInfo };
+    depthViewCreateInfo.image = depth.image;
+    depthViewCreateInfo.format = depthFormat;
+    depthViewCreateInfo.subresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1 };
+    depth.view = device.createImageView(depthViewCreateInfo);
+    attachmentViews.push_back(depth.view);
+
+    // Level 0 is left for generateMipmaps, as it would be after an upload
+    std::vector<vk::AttachmentDescription> attachments(3);
+    for (uint32_t i = 0; i < 2; ++i) {
+        attachments[i].format = ATLAS_FORMAT;
+        attachments[i].loadOp = vk::AttachmentLoadOp::eClear;
+        attachments[i].storeOp = vk::AttachmentStoreOp::eStore;
+        attachments[i].finalLayout = vk::ImageLayout::eTransferDstOptimal;
+    }
+    attachments[2].format = depthFormat;
+    attachments[2].loadOp = vk::AttachmentLoadOp::eClear;
+    attachments[2].storeOp = vk::AttachmentStoreOp::eDontCare;
+    attachments[2].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+    attachments[2].finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+    const vk::AttachmentReference colorReferences[2]{
+        { 0, vk::ImageLayout::eColorAttachmentOptimal },
+        { 1, vk::ImageLayout::eColorAttachmentOptimal },
+    };
+    const vk::AttachmentReference depthReference{ 2, vk::ImageLayout::eDepthStencilAttachmentOptimal };
+    vk::SubpassDescription subpass;
+    subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+    subpass.colorAttachmentCount = 2;
+    subpass.pColorAttachments = colorReferences;
+    subpass.pDepthStencilAttachment = &depthReference;
+    const vk::SubpassDependency dependency{ 0,
+                                            VK_SUBPASS_EXTERNAL,
+                                            vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                                            vk::PipelineStageFlagBits::eTransfer,
+                                            vk::AccessFlagBits::eColorAttachmentWrite,
+                                            vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite };
+    const vk::RenderPass renderPass = device.createRenderPass({ {}, (uint32_t)attachments.size(), attachments.data(), 1, &subpass, 1, &dependency });
+    const vk::Framebuffer framebuffer =
+        device.createFramebuffer({ {}, renderPass, (uint32_t)attachmentViews.size(), attachmentViews.data(), atlasSize, atlasSize, 1 });
+
+    const vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::mat4) };
+    const vk::PipelineLayout pipelineLayout = device.createPipelineLayout({ {}, 0, nullptr, 1, &pushConstantRange });
+    vk::Pipeline pipeline;
+    {
+        vks::pipelines::GraphicsPipelineBuilder builder{ device, pipelineLayout, renderPass };
+        // Views come from every side, whatever the winding of the model
+        builder.rasterizationState.cullMode = vk::CullModeFlagBits::eNone;
+        builder.colorBlendState.blendAttachmentStates.resize(2);
+        builder.vertexInputState.bindingDescriptions.push_back({ 0, model.layout.stride(), vk::VertexInputRate::eVertex });
+        builder.vertexInputState.attributeDescriptions = attributes;
+        builder.loadShader(assetPath + "shaders/base/impostorbake.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        builder.loadShader(assetPath + "shaders/base/impostorbake.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipeline = builder.create(context.pipelineCache);
+    }
+
+    // The model may still be on its way from the transfer queue
+    if (model.uploadTicket) {
+        context.waitForUpload(model.uploadTicket);
+    }
+    context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+        // Empty texels are zero in all channels, so that filtering stays premultiplied by coverage
+        const vk::ClearValue clearValues[3]{
+            vk::ClearColorValue{ std::array<float, 4>{ { 0.0f, 0.0f, 0.0f, 0.0f } } },
+            vk::ClearColorValue{ std::array<float, 4>{ { 0.0f, 0.0f, 0.0f, 0.0f } } },
+            vk::ClearDepthStencilValue{ 1.0f, 0 },
+        };
+        commandBuffer.beginRenderPass({ renderPass, framebuffer, vk::Rect2D{ {}, vk::Extent2D{ atlasSize, atlasSize } }, 3, clearValues },
+                                      vk::SubpassContents::eInline);
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+        commandBuffer.bindVertexBuffers(0, model.vertices.buffer, { 0 });
+        commandBuffer.bindIndexBuffer(model.indices.buffer, 0, model.indexType);
+        // From the side of the sphere facing the view to the far side
+        const glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, 0.0f, radius * 2.0f);
+        for (uint32_t y = 0; y < config.frames; ++y) {
+            for (uint32_t x = 0; x < config.frames; ++x) {
+                // The same basis as impostorBasis of impostor.glsl
+                const glm::vec3 direction = frameDirection(x, y, config.frames);
+                const glm::vec3 upHint = std::abs(direction.y) > 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+                const glm::mat4 viewProjection = projection * glm::lookAt(center + direction * radius, center, upHint);
+                const vk::Offset2D offset{ (int32_t)(x * frameSize), (int32_t)(y * frameSize) };
+                commandBuffer.setViewport(0, vk::Viewport{ (float)offset.x, (float)offset.y, (float)frameSize, (float)frameSize, 0.0f, 1.0f });
+                commandBuffer.setScissor(0, vk::Rect2D{ offset, vk::Extent2D{ frameSize, frameSize } });
+                commandBuffer.pushConstants<glm::mat4>(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, viewProjection);
+                commandBuffer.drawIndexed(model.indexCount, 1, 0, 0, 0);
+            }
+        }
+        commandBuffer.endRenderPass();
+        context.generateMipmaps(commandBuffer, albedo.image, imageCreateInfo);
+        context.generateMipmaps(commandBuffer, normalDepth.image, imageCreateInfo);
+    });
+
+    device.destroyPipeline(pipeline);
+    device.destroyPipelineLayout(pipelineLayout);
+    device.destroyFramebuffer(framebuffer);
+    device.destroyRenderPass(renderPass);
+    // The depth view is destroyed with its image
+    for (uint32_t i = 0; i < 2; ++i) {
+        device.destroyImageView(attachmentViews[i]);
+    }
+    depth.destroy();
+}
+
+void Impostor::destroy() {
+    albedo.destroy();
+    normalDepth.destroy();
+    frameCount = 0;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "forward.hpp"
+#include "image.hpp"
+
+namespace vks { namespace model {
+
+struct Model;
+
+// A far level of detail for a Model, as one camera facing quad textured with pictures of the model taken at load
+// time.  The pictures are orthographic views of the model's bounding sphere from frames x frames directions spread
+// over the whole sphere by an octahedral mapping, laid out side by side in two atlases:
+//
+//     albedo:       the vertex color in rgb, coverage in a
+//     normalDepth:  the model space normal, scaled to [0, 1], in rgb and the depth through the sphere in a, from 0 at
+//                   the side facing the view to 1 at the far side
+//
+// Both are premultiplied by coverage, so the mip levels don't bleed the background into the edges, and have levels
+// down to 4 texels per frame.  data/shaders/base/impostor.glsl has the matching billboard and atlas lookups, the
+// vertex shader draws QUAD_VERTEX_COUNT vertices per impostor without any vertex input.
+//
+// The model needs position, normal and color components, see VertexLayout.
+class Impostor {
+public:
+    struct Config {
+        // Views along each side of the atlas
+        uint32_t frames{ 8 };
+        // Texels along each side of a view, a power of two
+        uint32_t frameSize{ 64 };
+    };
+
+    static const uint32_t QUAD_VERTEX_COUNT = 6;
+
+    vks::Image albedo;
+    vks::Image normalDepth;
+
+    // Render the views of `model` with the impostorbake shaders of `assetPath`, waiting for them to finish
+    void bake(const vks::Context& context, const std::string& assetPath, const Model& model, const Config& config = {});
+    void destroy();
+
+    // The bounding sphere of the model the views were taken of, center and radius
+    const glm::vec4& sphere() const { return bounds; }
+    uint32_t frames() const { return frameCount; }
+
+    vk::DescriptorImageInfo albedoDescriptor() const { return { albedo.sampler, albedo.view, vk::ImageLayout::eShaderReadOnlyOptimal }; }
+    vk::DescriptorImageInfo normalDepthDescriptor() const { return { normalDepth.sampler, normalDepth.view, vk::ImageLayout::eShaderReadOnlyOptimal }; }
+
+    // The direction from the model towards the camera of the view at `x`, `y`, see impostorFrameDirection of impostor.glsl
+    static glm::vec3 frameDirection(uint32_t x, uint32_t y, uint32_t frames);
+
+private:
+    glm::vec4 bounds{ 0.0f };
+    uint32_t frameCount{ 0 };
+};
+
+}}  // namespace vks::model
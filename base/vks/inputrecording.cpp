@@ -0,0 +1,120 @@
+#include "inputrecording.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using namespace vks;
+
+const char InputRecording::MAGIC[8] = { 'V', 'K', 'S', 'I', 'N', 'P', 'U', 'T' };
+
+namespace {
+
+// The fixed size part of a frame, as stored
+struct FrameHeader {
+    float deltaTime;
+    float timer;
+    uint32_t paused;
+    float cameraRotation[3];
+    float cameraPosition[3];
+    uint32_t cameraKeys;
+    float mousePosition[2];
+    uint32_t mouseButtons;
+    uint32_t eventCount;
+};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t exampleLength;
+    uint64_t frameCount;
+};
+
+template <typename T>
+void write(std::ofstream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+void read(std::ifstream& in, T& value, const std::string& filename) {
+    if (!in.read(reinterpret_cast<char*>(&value), sizeof(T))) {
+        throw std::runtime_error("Truncated input recording " + filename);
+    }
+}
+
+}  // namespace
+
+void InputRecording::save(const std::string& filename) const {
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Unable to write input recording " + filename);
+    }
+    FileHeader header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.width = width;
+    header.height = height;
+    header.exampleLength = (uint32_t)example.size();
+    header.frameCount = frames.size();
+    write(out, header);
+    out.write(example.data(), example.size());
+    for (const auto& frame : frames) {
+        FrameHeader stored{};
+        stored.deltaTime = frame.deltaTime;
+        stored.timer = frame.timer;
+        stored.paused = frame.paused;
+        memcpy(stored.cameraRotation, frame.cameraRotation, sizeof(stored.cameraRotation));
+        memcpy(stored.cameraPosition, frame.cameraPosition, sizeof(stored.cameraPosition));
+        stored.cameraKeys = frame.cameraKeys;
+        memcpy(stored.mousePosition, frame.mousePosition, sizeof(stored.mousePosition));
+        stored.mouseButtons = frame.mouseButtons;
+        stored.eventCount = (uint32_t)frame.events.size();
+        write(out, stored);
+        for (const auto& event : frame.events) {
+            write(out, event);
+        }
+    }
+    if (!out) {
+        throw std::runtime_error("Unable to write input recording " + filename);
+    }
+}
+
+void InputRecording::load(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Unable to open input recording " + filename);
+    }
+    FileHeader header;
+    read(in, header, filename);
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) {
+        throw std::runtime_error(filename + " is not an input recording of version " + std::to_string(VERSION));
+    }
+    width = header.width;
+    height = header.height;
+    example.resize(header.exampleLength);
+    if (!in.read(&example[0], example.size())) {
+        throw std::runtime_error("Truncated input recording " + filename);
+    }
+    frames.clear();
+    frames.reserve((size_t)header.frameCount);
+    for (uint64_t i = 0; i < header.frameCount; ++i) {
+        FrameHeader stored;
+        read(in, stored, filename);
+        FrameInputs frame;
+        frame.deltaTime = stored.deltaTime;
+        frame.timer = stored.timer;
+        frame.paused = stored.paused;
+        memcpy(frame.cameraRotation, stored.cameraRotation, sizeof(frame.cameraRotation));
+        memcpy(frame.cameraPosition, stored.cameraPosition, sizeof(frame.cameraPosition));
+        frame.cameraKeys = stored.cameraKeys;
+        memcpy(frame.mousePosition, stored.mousePosition, sizeof(frame.mousePosition));
+        frame.mouseButtons = stored.mouseButtons;
+        frame.events.resize(stored.eventCount);
+        for (auto& event : frame.events) {
+            read(in, event, filename);
+        }
+        frames.push_back(std::move(frame));
+    }
+}
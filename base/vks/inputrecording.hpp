@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vks {
+
+// The per frame inputs of a run of an example, for replaying the exact same frames on other drivers and hardware.
+//
+// Every frame has the timestep it was updated with, the state the frame started from (the animation timer, the
+// camera and the mouse state the UI overlay reads) and the window events that arrived before it.  Replaying feeds
+// the events through the same handlers and then restores the state, so the frames don't depend on input timing or on
+// how long anything took.
+//
+// The file is the header, then per frame a FrameInputs without its events, the event count and the events, all in the
+// byte order of the machine that recorded them.
+struct InputEvent {
+    enum class Type : uint32_t {
+        KeyPress,
+        KeyRelease,
+        // `code` is the button and `action` its GLFW action
+        MouseButton,
+        // `x`, `y` is the cursor position
+        MouseMove,
+        // `y` is the scroll delta
+        MouseScroll,
+    };
+    Type type{ Type::KeyPress };
+    int32_t code{ 0 };
+    int32_t action{ 0 };
+    int32_t mods{ 0 };
+    float x{ 0.0f };
+    float y{ 0.0f };
+};
+
+struct FrameInputs {
+    float deltaTime{ 0.0f };
+    float timer{ 0.0f };
+    uint32_t paused{ 0 };
+    // Camera::rotation and Camera::position
+    float cameraRotation[3]{};
+    float cameraPosition[3]{};
+    // Camera::keys, left, right, up and down in the low bits
+    uint32_t cameraKeys{ 0 };
+    float mousePosition[2]{};
+    // Left, right and middle in the low bits
+    uint32_t mouseButtons{ 0 };
+    std::vector<InputEvent> events;
+};
+
+class InputRecording {
+public:
+    static const char MAGIC[8];
+    static const uint32_t VERSION = 1;
+
+    // The example and the window size it was recorded with
+    std::string example;
+    uint32_t width{ 0 };
+    uint32_t height{ 0 };
+    std::vector<FrameInputs> frames;
+
+    // Both throw std::runtime_error if the file can't be written or read, or isn't a recording of this version
+    void save(const std::string& filename) const;
+    void load(const std::string& filename);
+};
+
+}  // namespace vks
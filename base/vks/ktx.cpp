@@ -0,0 +1,118 @@
+#include "ktx.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace vks::texture;
+
+namespace {
+
+struct Header {
+    uint8_t identifier[12];
+    uint32_t endianness;
+    uint32_t glType;
+    uint32_t glTypeSize;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+const uint8_t MAGIC[] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+const uint32_t NATIVE_ENDIANNESS = 0x04030201;
+
+size_t alignTo4(size_t value) {
+    return (value + 3) & ~size_t(3);
+}
+
+// Bytes in one layer or face of `extent` without any padding
+size_t tightImageSize(gli::format format, const vk::Extent3D& extent) {
+    const gli::extent3d blockExtent = gli::block_extent(format);
+    return ((extent.width + blockExtent.x - 1) / blockExtent.x) * ((extent.height + blockExtent.y - 1) / blockExtent.y) * gli::block_size(format);
+}
+
+}  // namespace
+
+bool vks::texture::parseKtx(const uint8_t* data, size_t size, KtxLayout& layout) {
+    Header header;
+    if (size < sizeof(Header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(Header));
+    if (memcmp(header.identifier, MAGIC, sizeof(MAGIC)) != 0 || header.endianness != NATIVE_ENDIANNESS) {
+        return false;
+    }
+    if (header.pixelHeight == 0 || header.pixelDepth > 1 || (header.numberOfFaces != 1 && header.numberOfFaces != 6)) {
+        return false;
+    }
+
+    // The same lookup gli::load_ktx does
+    gli::gl gl(gli::gl::PROFILE_KTX);
+    layout.format = gl.find(static_cast<gli::gl::internal_format>(header.glInternalFormat), static_cast<gli::gl::external_format>(header.glFormat),
+                            static_cast<gli::gl::type_format>(header.glType));
+    if (layout.format == gli::FORMAT_UNDEFINED) {
+        return false;
+    }
+    layout.width = header.pixelWidth;
+    layout.height = header.pixelHeight;
+    layout.layers = std::max(header.numberOfArrayElements, 1u);
+    layout.faces = header.numberOfFaces;
+    layout.levels = std::max(header.numberOfMipmapLevels, 1u);
+    layout.levelOffsets.clear();
+    layout.imageSizes.clear();
+
+    // Only non-array cube maps give imageSize per face, everything else gives it for the whole level
+    const bool sizePerFace = header.numberOfFaces == 6 && header.numberOfArrayElements == 0;
+    size_t offset = sizeof(Header) + header.bytesOfKeyValueData;
+    for (uint32_t level = 0; level < layout.levels; ++level) {
+        if (offset + sizeof(uint32_t) > size) {
+            return false;
+        }
+        uint32_t imageSize;
+        memcpy(&imageSize, data + offset, sizeof(imageSize));
+        offset += sizeof(uint32_t);
+
+        const size_t tightSize = tightImageSize(layout.format, layout.extent(level));
+        const size_t images = sizePerFace ? 1 : layout.layers * layout.faces;
+        // Padded rows make the sizes disagree, and cube faces are only contiguous if they need no padding
+        if (imageSize != tightSize * images || (layout.faces == 6 && tightSize % 4 != 0)) {
+            return false;
+        }
+        layout.levelOffsets.push_back(offset);
+        layout.imageSizes.push_back(tightSize);
+        if (offset + layout.levelSize(level) > size) {
+            return false;
+        }
+        offset += alignTo4(layout.levelSize(level));
+    }
+    return true;
+}
+
+KtxLayout vks::texture::packedKtxLayout(gli::format format,
+                                        uint32_t width,
+                                        uint32_t height,
+                                        uint32_t layers,
+                                        uint32_t faces,
+                                        uint32_t levels,
+                                        size_t alignment) {
+    KtxLayout layout;
+    layout.format = format;
+    layout.width = width;
+    layout.height = height;
+    layout.layers = layers;
+    layout.faces = faces;
+    layout.levels = levels;
+    size_t offset = 0;
+    for (uint32_t level = 0; level < levels; ++level) {
+        layout.levelOffsets.push_back(offset);
+        layout.imageSizes.push_back(tightImageSize(format, layout.extent(level)));
+        offset += (layout.levelSize(level) + alignment - 1) / alignment * alignment;
+    }
+    return layout;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <gli/gli.hpp>
+#include <vulkan/vulkan.hpp>
+
+namespace vks { namespace texture {
+
+// Where the images of a KTX (version 1) file are, so loaders can stage them straight out of the file contents
+// instead of decoding the file into a gli texture first
+struct KtxLayout {
+    gli::format format{ gli::FORMAT_UNDEFINED };
+    uint32_t width{ 0 };
+    uint32_t height{ 0 };
+    // At least 1, also for files that aren't arrays
+    uint32_t layers{ 1 };
+    uint32_t faces{ 1 };
+    uint32_t levels{ 1 };
+    // From the start of the file to the first image of each level
+    std::vector<size_t> levelOffsets;
+    // Bytes in one layer or face of each level
+    std::vector<size_t> imageSizes;
+
+    size_t offset(uint32_t level, uint32_t layer, uint32_t face) const { return levelOffsets[level] + (layer * faces + face) * imageSizes[level]; }
+    // Bytes in all layers and faces of a level, which are contiguous
+    size_t levelSize(uint32_t level) const { return imageSizes[level] * layers * faces; }
+    vk::Extent3D extent(uint32_t level) const { return { std::max(width >> level, 1u), std::max(height >> level, 1u), 1 }; }
+    // Just past the end of the last level
+    size_t end() const { return levelOffsets.back() + levelSize(levels - 1); }
+};
+
+// The layout of `levels` tightly packed levels of `layers` layers and `faces` faces of `format` one after the other
+// from offset 0, each level starting on a multiple of `alignment`.  How the loaders lay out images in staging memory.
+KtxLayout packedKtxLayout(gli::format format, uint32_t width, uint32_t height, uint32_t layers, uint32_t faces, uint32_t levels, size_t alignment);
+
+// Parse the header of the KTX file in `data`.  Only succeeds for little endian 2D files whose images are tightly
+// packed, which is the layout vkCmdCopyBufferToImage reads with a zero row length, so every image can be copied
+// from where it is in the file.  Anything else, like rows padded to 4 bytes, is left to gli.
+bool parseKtx(const uint8_t* data, size_t size, KtxLayout& layout);
+
+}}  // namespace vks::texture
@@ -0,0 +1,150 @@
+#include "lz4.hpp"
+
+#include <cstring>
+
+namespace {
+
+const size_t MIN_MATCH = 4;
+// The last match starts at least this far from the end of the input, and the last five bytes are always literals
+const size_t MATCH_FIND_LIMIT = 12;
+const size_t LAST_LITERALS = 5;
+const size_t MAX_OFFSET = 65535;
+const uint32_t HASH_LOG = 16;
+const uint32_t NO_POSITION = UINT32_MAX;
+
+uint32_t read32(const uint8_t* data) {
+    uint32_t result;
+    memcpy(&result, data, sizeof(result));
+    return result;
+}
+
+uint32_t hashPosition(uint32_t value) {
+    return (value * 2654435761u) >> (32 - HASH_LOG);
+}
+
+// Lengths past the 15 the token holds continue in bytes of 255, ended by a smaller one
+void writeLength(std::vector<uint8_t>& output, size_t length) {
+    for (; length >= 255; length -= 255) {
+        output.push_back(255);
+    }
+    output.push_back(static_cast<uint8_t>(length));
+}
+
+void writeSequence(std::vector<uint8_t>& output, const uint8_t* literals, size_t literalCount, size_t offset, size_t matchLength) {
+    const size_t matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+    uint8_t token = static_cast<uint8_t>((literalCount < 15 ? literalCount : 15) << 4);
+    token |= static_cast<uint8_t>(matchCode < 15 ? matchCode : 15);
+    output.push_back(token);
+    if (literalCount >= 15) {
+        writeLength(output, literalCount - 15);
+    }
+    output.insert(output.end(), literals, literals + literalCount);
+    if (!matchLength) {
+        return;
+    }
+    output.push_back(static_cast<uint8_t>(offset & 0xFF));
+    output.push_back(static_cast<uint8_t>(offset >> 8));
+    if (matchCode >= 15) {
+        writeLength(output, matchCode - 15);
+    }
+}
+
+bool readLength(const uint8_t* data, size_t size, size_t& position, size_t& length) {
+    uint8_t byte;
+    do {
+        if (position >= size) {
+            return false;
+        }
+        byte = data[position++];
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+}  // namespace
+
+std::vector<uint8_t> vks::lz4::compress(const uint8_t* data, size_t size) {
+    std::vector<uint8_t> output;
+    output.reserve(size + size / 255 + 16);
+    size_t anchor = 0;
+    if (size > MATCH_FIND_LIMIT) {
+        std::vector<uint32_t> table(size_t(1) << HASH_LOG, NO_POSITION);
+        const size_t matchLimit = size - LAST_LITERALS;
+        size_t position = 0;
+        while (position + MATCH_FIND_LIMIT <= size) {
+            const uint32_t value = read32(data + position);
+            uint32_t& slot = table[hashPosition(value)];
+            const uint32_t candidate = slot;
+            slot = static_cast<uint32_t>(position);
+            if (candidate == NO_POSITION || position - candidate > MAX_OFFSET || read32(data + candidate) != value) {
+                ++position;
+                continue;
+            }
+            size_t start = position;
+            size_t source = candidate;
+            while (start > anchor && source > 0 && data[start - 1] == data[source - 1]) {
+                --start;
+                --source;
+            }
+            size_t length = MIN_MATCH + (position - start);
+            while (start + length < matchLimit && data[source + length] == data[start + length]) {
+                ++length;
+            }
+            writeSequence(output, data + anchor, start - anchor, start - source, length);
+            position = start + length;
+            anchor = position;
+        }
+    }
+    writeSequence(output, data + anchor, size - anchor, 0, 0);
+    return output;
+}
+
+bool vks::lz4::decompress(const uint8_t* data, size_t size, uint8_t* output, size_t outputSize) {
+    size_t position = 0;
+    size_t written = 0;
+    while (position < size) {
+        const uint8_t token = data[position++];
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 && !readLength(data, size, position, literalCount)) {
+            return false;
+        }
+        if (literalCount > size - position || literalCount > outputSize - written) {
+            return false;
+        }
+        memcpy(output + written, data + position, literalCount);
+        position += literalCount;
+        written += literalCount;
+        // The last sequence has no match
+        if (position == size) {
+            break;
+        }
+        if (size - position < 2) {
+            return false;
+        }
+        const size_t offset = data[position] | (size_t(data[position + 1]) << 8);
+        position += 2;
+        if (offset == 0 || offset > written) {
+            return false;
+        }
+        size_t length = token & 15;
+        if (length == 15 && !readLength(data, size, position, length)) {
+            return false;
+        }
+        length += MIN_MATCH;
+        if (length > outputSize - written) {
+            return false;
+        }
+        uint8_t* target = output + written;
+        const uint8_t* source = target - offset;
+        if (offset >= length) {
+            memcpy(target, source, length);
+        } else {
+            // Overlapping matches repeat the bytes they've just written
+            for (size_t i = 0; i < length; ++i) {
+                target[i] = source[i];
+            }
+        }
+        written += length;
+    }
+    return written == outputSize;
+}
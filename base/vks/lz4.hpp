@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vks { namespace lz4 {
+
+// The LZ4 block format, without the frame around it, for the compressed entries of asset packs.  Blocks carry neither
+// their decompressed size nor a checksum, whoever stores a block stores its size next to it.
+//
+// The compressor is the greedy single probe one, which trades some ratio for speed like the reference fast mode does.
+// What it writes decompresses with any LZ4 block decoder, and the decoder takes blocks from any LZ4 encoder.
+
+std::vector<uint8_t> compress(const uint8_t* data, size_t size);
+
+// False for malformed input, or input that doesn't decompress to exactly `outputSize` bytes
+bool decompress(const uint8_t* data, size_t size, uint8_t* output, size_t outputSize);
+
+}}  // namespace vks::lz4
@@ -0,0 +1,162 @@
+#include "meshlets.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+using namespace vks::model;
+
+namespace {
+
+const uint32_t INVALID = static_cast<uint32_t>(-1);
+
+// Cones wider than this (the cosine of their half angle) cull too rarely to be worth testing
+const float MIN_CONE_DOT = 0.1f;
+
+glm::vec3 readVec3(const uint8_t* data, size_t stride, uint32_t vertex) {
+    glm::vec3 result;
+    memcpy(&result, data + vertex * stride, sizeof(result));
+    return result;
+}
+
+Meshlet bound(const uint32_t* indices, uint32_t firstIndex, uint32_t indexCount, uint32_t vertexCount, const uint8_t* positions,
+              const uint8_t* normals, size_t stride) {
+    Meshlet meshlet;
+    meshlet.firstIndex = firstIndex;
+    meshlet.indexCount = indexCount;
+    meshlet.vertexCount = vertexCount;
+
+    // The sphere is centered on the bounding box, which is close enough to minimal for the clusters' compact shapes
+    const uint32_t* begin = indices + firstIndex;
+    const uint32_t* end = begin + indexCount;
+    glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+    for (const uint32_t* index = begin; index != end; ++index) {
+        const glm::vec3 position = readVec3(positions, stride, *index);
+        min = glm::min(min, position);
+        max = glm::max(max, position);
+    }
+    const glm::vec3 center = (min + max) * 0.5f;
+    float radius = 0.0f;
+    for (const uint32_t* index = begin; index != end; ++index) {
+        radius = std::max(radius, glm::length(readVec3(positions, stride, *index) - center));
+    }
+    meshlet.sphere = glm::vec4(center, radius);
+
+    // The cone axis is the average of the face normals, and its cutoff follows from the face that deviates most
+    meshlet.cone = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    if (!normals) {
+        return meshlet;
+    }
+    std::vector<glm::vec3> faceNormals;
+    faceNormals.reserve(indexCount / 3);
+    glm::vec3 axis(0.0f);
+    for (const uint32_t* triangle = begin; triangle != end; triangle += 3) {
+        const glm::vec3 p0 = readVec3(positions, stride, triangle[0]);
+        const glm::vec3 p1 = readVec3(positions, stride, triangle[1]);
+        const glm::vec3 p2 = readVec3(positions, stride, triangle[2]);
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        const float length = glm::length(normal);
+        if (length <= 0.0f) {
+            continue;
+        }
+        normal /= length;
+        // The winding depends on the import flags, the vertex normals don't
+        const glm::vec3 shading = readVec3(normals, stride, triangle[0]) + readVec3(normals, stride, triangle[1]) + readVec3(normals, stride, triangle[2]);
+        if (glm::dot(normal, shading) < 0.0f) {
+            normal = -normal;
+        }
+        faceNormals.push_back(normal);
+        axis += normal;
+    }
+    const float axisLength = glm::length(axis);
+    if (faceNormals.empty() || axisLength <= 0.0f) {
+        return meshlet;
+    }
+    axis /= axisLength;
+    float minDot = 1.0f;
+    for (const auto& normal : faceNormals) {
+        minDot = std::min(minDot, glm::dot(normal, axis));
+    }
+    if (minDot >= MIN_CONE_DOT) {
+        // Every face points within acos(minDot) of the axis, so the cluster is back facing wherever the direction
+        // towards it is within 90 degrees minus that of the axis
+        meshlet.cone = glm::vec4(axis, sqrtf(1.0f - minDot * minDot));
+    }
+    return meshlet;
+}
+
+}  // namespace
+
+void vks::model::buildMeshlets(std::vector<Meshlet>& meshlets,
+                               const uint32_t* indices,
+                               size_t indexCount,
+                               const uint8_t* positions,
+                               const uint8_t* normals,
+                               size_t stride,
+                               size_t vertexCount) {
+    const size_t triangleCount = indexCount / 3;
+    // The meshlet each vertex was last counted in
+    std::vector<uint32_t> owners(vertexCount, INVALID);
+    uint32_t current = 0;
+    uint32_t firstTriangle = 0;
+    uint32_t meshletVertices = 0;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        const uint32_t* triangle = indices + t * 3;
+        // Vertices repeated within the triangle only count once
+        const uint32_t a = triangle[0], b = triangle[1], c = triangle[2];
+        const uint32_t newVertices = (owners[a] != current ? 1 : 0) + (b != a && owners[b] != current ? 1 : 0) +
+                                     (c != a && c != b && owners[c] != current ? 1 : 0);
+        if (meshletVertices + newVertices > MESHLET_MAX_VERTICES || t - firstTriangle == MESHLET_MAX_TRIANGLES) {
+            meshlets.push_back(bound(indices, firstTriangle * 3, (uint32_t)(t - firstTriangle) * 3, meshletVertices, positions, normals, stride));
+            ++current;
+            firstTriangle = (uint32_t)t;
+            meshletVertices = 0;
+        }
+        for (size_t k = 0; k < 3; ++k) {
+            if (owners[triangle[k]] != current) {
+                owners[triangle[k]] = current;
+                ++meshletVertices;
+            }
+        }
+    }
+    if (firstTriangle < triangleCount) {
+        meshlets.push_back(
+            bound(indices, firstTriangle * 3, (uint32_t)(triangleCount - firstTriangle) * 3, meshletVertices, positions, normals, stride));
+    }
+}
+
+MeshletPrimitives vks::model::buildMeshletPrimitives(const std::vector<Meshlet>& meshlets, const uint32_t* indices) {
+    MeshletPrimitives result;
+    result.ranges.reserve(meshlets.size());
+    size_t vertexTotal = 0, triangleTotal = 0;
+    for (const auto& meshlet : meshlets) {
+        vertexTotal += meshlet.vertexCount;
+        triangleTotal += meshlet.indexCount / 3;
+    }
+    result.vertices.reserve(vertexTotal);
+    result.triangles.reserve(triangleTotal);
+
+    // Meshlets only have a few dozen vertices, so a linear search finds the repeated ones quickly enough
+    for (const auto& meshlet : meshlets) {
+        const uint32_t vertexOffset = (uint32_t)result.vertices.size();
+        result.ranges.emplace_back(vertexOffset, (uint32_t)result.triangles.size());
+        const uint32_t* begin = indices + meshlet.firstIndex;
+        const uint32_t* end = begin + meshlet.indexCount;
+        for (const uint32_t* triangle = begin; triangle != end; triangle += 3) {
+            uint32_t packed = 0;
+            for (uint32_t k = 0; k < 3; ++k) {
+                const auto first = result.vertices.begin() + vertexOffset;
+                const uint32_t local = (uint32_t)(std::find(first, result.vertices.end(), triangle[k]) - first);
+                if (vertexOffset + local == result.vertices.size()) {
+                    result.vertices.push_back(triangle[k]);
+                }
+                packed |= local << (k * 8);
+            }
+            result.triangles.push_back(packed);
+        }
+        assert(result.vertices.size() - vertexOffset == meshlet.vertexCount);
+    }
+    return result;
+}
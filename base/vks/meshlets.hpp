@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace vks { namespace model {
+
+// A run of consecutive triangles of one part, small enough to be culled on its own.  The layout matches std430, so
+// Model::meshlets can be uploaded as is and read as an array of
+//
+//     struct Meshlet { vec4 sphere; vec4 cone; uint firstIndex; uint indexCount; uint vertexCount; uint pad; };
+struct Meshlet {
+    // Bounding sphere, xyz is the center and w the radius, in model space
+    glm::vec4 sphere;
+    // Normal cone, xyz is the average facing direction and w the cutoff.  The meshlet faces away from every camera
+    // position p with
+    //
+    //     dot(sphere.xyz - p, cone.xyz) >= cone.w * length(sphere.xyz - p) + sphere.w
+    //
+    // A cutoff of 1 never passes, which is what meshlets with no usable cone get.
+    glm::vec4 cone;
+    // Into the model's index buffer
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    // Distinct vertices referenced
+    uint32_t vertexCount;
+    uint32_t pad{ 0 };
+};
+
+// Limits that suit both mesh shader hardware and a compute culling pass
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// Splits a triangle list, with indices local to one part in the range [0, vertexCount), into meshlets of consecutive
+// triangles and appends them to `meshlets`, with firstIndex relative to `indices`.  The triangle order is kept, so
+// run this after optimizeVertexCache, whose order keeps the triangles of each meshlet close together.
+//
+// `positions` points at the first vertex's position (three floats) and `stride` is the byte distance between
+// vertices.  Triangles face the way their `normals` (three floats, or nullptr) point, without normals no cones
+// are generated.
+void buildMeshlets(std::vector<Meshlet>& meshlets,
+                   const uint32_t* indices,
+                   size_t indexCount,
+                   const uint8_t* positions,
+                   const uint8_t* normals,
+                   size_t stride,
+                   size_t vertexCount);
+
+// The meshlets in the form mesh shaders output them: the distinct vertices each references, and its triangles as
+// indices into those.  Meshlet `m` has meshlet.vertexCount vertices starting at ranges[m].x and indexCount / 3
+// triangles starting at ranges[m].y, each packed into one uint32 with its local indices in bits 0-7, 8-15 and 16-23.
+struct MeshletPrimitives {
+    std::vector<glm::uvec2> ranges;
+    // Indices into the vertex buffer, as `indices` holds them
+    std::vector<uint32_t> vertices;
+    std::vector<uint32_t> triangles;
+};
+
+// `indices` is what the meshlets' firstIndex is relative to, usually all of a model's indices, see Model::hostIndices
+MeshletPrimitives buildMeshletPrimitives(const std::vector<Meshlet>& meshlets, const uint32_t* indices);
+
+}}  // namespace vks::model
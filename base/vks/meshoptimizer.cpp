@@ -0,0 +1,261 @@
+#include "meshoptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+using namespace vks::model;
+
+namespace {
+
+const uint32_t INVALID = static_cast<uint32_t>(-1);
+
+// Scoring constants from the paper
+const size_t CACHE_SIZE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+// The cache behaviour optimizeOverdraw assumes when deciding where clusters may be split
+const uint32_t FIFO_SIZE = 16;
+
+float vertexScore(int32_t cachePosition, uint32_t remainingTriangles) {
+    if (remainingTriangles == 0) {
+        return -1.0f;
+    }
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            // The vertices of the last triangle get a fixed score, so it isn't simply re-used from the other side
+            score = LAST_TRIANGLE_SCORE;
+        } else {
+            const float scale = 1.0f / (CACHE_SIZE - 3);
+            score = powf(1.0f - (cachePosition - 3) * scale, CACHE_DECAY_POWER);
+        }
+    }
+    // Favour vertices with few triangles left, so that lone triangles don't get stranded
+    score += VALENCE_BOOST_SCALE * powf((float)remainingTriangles, -VALENCE_BOOST_POWER);
+    return score;
+}
+
+glm::vec3 readPosition(const uint8_t* positions, size_t stride, uint32_t vertex) {
+    glm::vec3 result;
+    memcpy(&result, positions + vertex * stride, sizeof(result));
+    return result;
+}
+
+}  // namespace
+
+void vks::model::optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount) {
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2) {
+        return;
+    }
+
+    // The not yet emitted triangles using each vertex
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i) {
+        ++remaining[indices[i]];
+    }
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remaining[v];
+    }
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    {
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; ++i) {
+            adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+        }
+    }
+
+    std::vector<int32_t> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        vertexScores[v] = vertexScore(-1, remaining[v]);
+    }
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    uint32_t bestTriangle = INVALID;
+    float bestScore = -1.0f;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        const uint32_t* triangle = indices + t * 3;
+        triangleScores[t] = vertexScores[triangle[0]] + vertexScores[triangle[1]] + vertexScores[triangle[2]];
+        if (triangleScores[t] > bestScore) {
+            bestScore = triangleScores[t];
+            bestTriangle = (uint32_t)t;
+        }
+    }
+
+    std::vector<uint32_t> output(triangleCount * 3);
+    uint32_t cache[CACHE_SIZE + 3];
+    size_t cacheCount = 0;
+    size_t scanCursor = 0;
+    for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+        if (bestTriangle == INVALID) {
+            // Nothing in the cache has triangles left, so continue with the next triangle in the original order
+            while (emitted[scanCursor]) {
+                ++scanCursor;
+            }
+            bestTriangle = (uint32_t)scanCursor;
+        }
+        const uint32_t* triangle = indices + bestTriangle * 3;
+        memcpy(output.data() + emittedCount * 3, triangle, 3 * sizeof(uint32_t));
+        emitted[bestTriangle] = true;
+
+        // Take the triangle out of its vertices' adjacency lists, and move its vertices to the front of the cache
+        uint32_t newCache[CACHE_SIZE + 3];
+        size_t newCacheCount = 0;
+        for (size_t k = 0; k < 3; ++k) {
+            const uint32_t v = triangle[k];
+            uint32_t* begin = adjacency.data() + adjacencyOffsets[v];
+            uint32_t* end = begin + remaining[v];
+            uint32_t* found = std::find(begin, end, bestTriangle);
+            if (found != end) {
+                *found = *(end - 1);
+                --remaining[v];
+            }
+            if (std::find(newCache, newCache + newCacheCount, v) == newCache + newCacheCount) {
+                newCache[newCacheCount++] = v;
+            }
+        }
+        for (size_t i = 0; i < cacheCount; ++i) {
+            const uint32_t v = cache[i];
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                newCache[newCacheCount++] = v;
+            }
+        }
+
+        // Rescore everything that moved, including the vertices that just fell out of the cache
+        for (size_t i = 0; i < newCacheCount; ++i) {
+            const uint32_t v = newCache[i];
+            cachePositions[v] = i < CACHE_SIZE ? (int32_t)i : -1;
+            vertexScores[v] = vertexScore(cachePositions[v], remaining[v]);
+        }
+        cacheCount = std::min(newCacheCount, CACHE_SIZE);
+        memcpy(cache, newCache, cacheCount * sizeof(uint32_t));
+
+        // The next triangle is the best one touching a vertex whose score changed
+        bestTriangle = INVALID;
+        bestScore = -1.0f;
+        for (size_t i = 0; i < newCacheCount; ++i) {
+            const uint32_t v = newCache[i];
+            const uint32_t* adjacent = adjacency.data() + adjacencyOffsets[v];
+            for (uint32_t a = 0; a < remaining[v]; ++a) {
+                const uint32_t t = adjacent[a];
+                const uint32_t* candidate = indices + t * 3;
+                triangleScores[t] = vertexScores[candidate[0]] + vertexScores[candidate[1]] + vertexScores[candidate[2]];
+                if (triangleScores[t] > bestScore) {
+                    bestScore = triangleScores[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+    }
+    memcpy(indices, output.data(), output.size() * sizeof(uint32_t));
+}
+
+void vks::model::optimizeOverdraw(uint32_t* indices, size_t indexCount, const uint8_t* positions, size_t stride, size_t vertexCount) {
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2) {
+        return;
+    }
+
+    // A triangle that misses the cache on all three vertices is where the cache optimized order jumped, so
+    // starting a cluster there costs next to nothing in cache efficiency
+    std::vector<uint32_t> clusterStarts;
+    {
+        std::vector<uint32_t> stamps(vertexCount, 0);
+        uint32_t time = FIFO_SIZE + 1;
+        for (size_t t = 0; t < triangleCount; ++t) {
+            uint32_t misses = 0;
+            for (size_t k = 0; k < 3; ++k) {
+                const uint32_t v = indices[t * 3 + k];
+                if (time - stamps[v] > FIFO_SIZE) {
+                    stamps[v] = time++;
+                    ++misses;
+                }
+            }
+            if (t == 0 || misses == 3) {
+                clusterStarts.push_back((uint32_t)t);
+            }
+        }
+    }
+    const size_t clusterCount = clusterStarts.size();
+    if (clusterCount < 2) {
+        return;
+    }
+    clusterStarts.push_back((uint32_t)triangleCount);
+
+    // Area weighted centroid and normal of every cluster, and of the whole mesh
+    std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0));
+    std::vector<glm::vec3> normals(clusterCount, glm::vec3(0));
+    std::vector<float> areas(clusterCount, 0.0f);
+    glm::vec3 meshCentroid(0);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; ++c) {
+        for (uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t) {
+            const glm::vec3 p0 = readPosition(positions, stride, indices[t * 3 + 0]);
+            const glm::vec3 p1 = readPosition(positions, stride, indices[t * 3 + 1]);
+            const glm::vec3 p2 = readPosition(positions, stride, indices[t * 3 + 2]);
+            const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            const float area = glm::length(normal);
+            centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+            normals[c] += normal;
+            areas[c] += area;
+        }
+        meshCentroid += centroids[c];
+        meshArea += areas[c];
+    }
+    if (meshArea <= 0.0f) {
+        return;
+    }
+    meshCentroid /= meshArea;
+
+    // Clusters facing away from the middle of the mesh are the likeliest occluders, so draw them first
+    std::vector<float> keys(clusterCount, 0.0f);
+    for (size_t c = 0; c < clusterCount; ++c) {
+        const float normalLength = glm::length(normals[c]);
+        if (areas[c] > 0.0f && normalLength > 0.0f) {
+            keys[c] = glm::dot(centroids[c] / areas[c] - meshCentroid, normals[c] / normalLength);
+        }
+    }
+    std::vector<uint32_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; ++c) {
+        order[c] = (uint32_t)c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+    for (const auto& c : order) {
+        output.insert(output.end(), indices + clusterStarts[c] * 3, indices + clusterStarts[c + 1] * 3);
+    }
+    memcpy(indices, output.data(), output.size() * sizeof(uint32_t));
+}
+
+void vks::model::optimizeVertexFetch(uint8_t* vertices, uint32_t* indices, size_t indexCount, size_t vertexCount, size_t stride) {
+    std::vector<uint32_t> remap(vertexCount, INVALID);
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; ++i) {
+        uint32_t& target = remap[indices[i]];
+        if (target == INVALID) {
+            target = next++;
+        }
+        indices[i] = target;
+    }
+    for (auto& target : remap) {
+        if (target == INVALID) {
+            target = next++;
+        }
+    }
+
+    std::vector<uint8_t> original(vertices, vertices + vertexCount * stride);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        memcpy(vertices + remap[v] * stride, original.data() + v * stride, stride);
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vks { namespace model {
+
+// Index and vertex reordering for post-transform cache locality, overdraw and vertex fetch.  All functions work on
+// triangle lists with indices local to one part, in the range [0, vertexCount).
+//
+// The usual order is optimizeVertexCache, then optimizeOverdraw (which keeps most of the cache locality by only
+// reordering whole clusters) and finally optimizeVertexFetch, which renumbers the vertices and so has to come last.
+
+// Reorder triangles with Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+void optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+// Split the triangles into clusters at the points the cache optimized order jumps across the mesh, and sort the
+// clusters so that the ones facing away from the middle of the mesh come first and occlude the rest, as in Sander,
+// Nehab and Barczak's "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw".  `positions` points at
+// the first vertex's position (three floats), `stride` is the byte distance between vertices.
+void optimizeOverdraw(uint32_t* indices, size_t indexCount, const uint8_t* positions, size_t stride, size_t vertexCount);
+
+// Renumber the vertices in the order the indices first reference them, so vertex fetch streams through memory.
+// `vertices` holds `vertexCount` interleaved vertices of `stride` bytes and is permuted in place.  Vertices no
+// triangle references keep their relative order after all the referenced ones.
+void optimizeVertexFetch(uint8_t* vertices, uint32_t* indices, size_t indexCount, size_t vertexCount, size_t stride);
+
+}}  // namespace vks::model
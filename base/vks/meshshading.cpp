@@ -0,0 +1,43 @@
+#include "meshshading.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "context.hpp"
+#include "meshlets.hpp"
+#include "model.hpp"
+
+using namespace vks::model;
+
+void MeshletGeometry::create(const vks::Context& context, const Model& model) {
+    if (model.meshlets.empty() || model.hostIndices.empty()) {
+        throw std::runtime_error("Mesh shading needs a model loaded with meshlets and a host copy");
+    }
+    this->context = &context;
+    count = (uint32_t)model.meshlets.size();
+    const MeshletPrimitives primitives = buildMeshletPrimitives(model.meshlets, model.hostIndices.data());
+    const vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eStorageBuffer;
+    meshlets = context.stageToDeviceBuffer(usage, model.meshlets);
+    ranges = context.stageToDeviceBuffer(usage, primitives.ranges);
+    vertices = context.stageToDeviceBuffer(usage, primitives.vertices);
+    triangles = context.stageToDeviceBuffer(usage, primitives.triangles);
+}
+
+void MeshletGeometry::destroy() {
+    meshlets.destroy();
+    ranges.destroy();
+    vertices.destroy();
+    triangles.destroy();
+    context = nullptr;
+    count = 0;
+}
+
+void MeshletGeometry::drawTasks(const vk::CommandBuffer& commandBuffer, const vk::PipelineLayout& layout, uint32_t pushOffset, uint32_t groupCount) const {
+    const auto& properties = context->meshShaderProperties;
+    const uint32_t maxGroups = std::max(1u, std::min(properties.maxTaskWorkGroupCount[0], properties.maxTaskWorkGroupTotalCount));
+    const vk::ShaderStageFlags stages = vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT;
+    for (uint32_t first = 0; first < groupCount; first += maxGroups) {
+        commandBuffer.pushConstants<uint32_t>(layout, stages, pushOffset, first);
+        commandBuffer.drawMeshTasksEXT(std::min(maxGroups, groupCount - first), 1, 1, context->dynamicDispatch);
+    }
+}
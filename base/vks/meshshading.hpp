@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+#include <vulkan/vulkan.hpp>
+
+#include "buffer.hpp"
+#include "forward.hpp"
+
+namespace vks { namespace model {
+
+struct Model;
+
+// The meshlets of a Model on the device, for task and mesh shaders that fetch vertices straight from the model's
+// vertex buffer instead of going through vertex input.  The model needs ModelCreateInfo::meshlets, hostCopy for the
+// indices the meshlets' triangles are taken from, and storage buffer usage on its vertices, see
+// ModelCreateInfo::vertexUsage.  Needs Context::meshShaderEnabled to draw.
+//
+// The buffers are std430 arrays of
+//
+//     meshlets:  struct Meshlet, see meshlets.hpp
+//     ranges:    uvec2, the first of the meshlet's vertices and triangles, see MeshletPrimitives
+//     vertices:  uint, indices into the model's vertices
+//     triangles: uint, three 8 bit indices into the meshlet's vertices
+class MeshletGeometry {
+public:
+    Buffer meshlets;
+    Buffer ranges;
+    Buffer vertices;
+    Buffer triangles;
+
+    void create(const vks::Context& context, const Model& model);
+    void destroy();
+
+    uint32_t meshletCount() const { return count; }
+
+    // Draw `groupCount` task shader workgroups along x, in as many vkCmdDrawMeshTasksEXT as the device's limits need.
+    // The first workgroup of each draw is pushed as a uint at `pushOffset` of `layout`, for the task shader to add to
+    // gl_WorkGroupID.x.
+    void drawTasks(const vk::CommandBuffer& commandBuffer, const vk::PipelineLayout& layout, uint32_t pushOffset, uint32_t groupCount) const;
+
+private:
+    const vks::Context* context{ nullptr };
+    uint32_t count{ 0 };
+};
+
+}}  // namespace vks::model
@@ -0,0 +1,339 @@
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#if defined(_MSC_VER)
+#pragma comment(lib, "Ws2_32.lib")
+#endif
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using namespace vks::metrics;
+
+const double Histogram::BOUNDS[Histogram::BUCKET_COUNT - 1] = { 1.0, 2.0, 4.0, 8.0, 12.0, 16.7, 25.0, 33.4, 50.0, 100.0, 250.0 };
+
+void Histogram::add(double milliseconds) {
+    const size_t index = std::upper_bound(BOUNDS, BOUNDS + BUCKET_COUNT - 1, milliseconds) - BOUNDS;
+    ++buckets[index];
+    minimum = samples ? std::min(minimum, milliseconds) : milliseconds;
+    maximum = samples ? std::max(maximum, milliseconds) : milliseconds;
+    total += milliseconds;
+    ++samples;
+}
+
+double Histogram::quantile(double q) const {
+    if (!samples) {
+        return 0.0;
+    }
+    const double rank = q * (double)samples;
+    uint64_t below = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        if (buckets[i] && (double)(below + buckets[i]) >= rank) {
+            const double low = i ? BOUNDS[i - 1] : 0.0;
+            const double high = i < BUCKET_COUNT - 1 ? BOUNDS[i] : maximum;
+            const double value = low + (high - low) * (rank - (double)below) / (double)buckets[i];
+            return std::min(std::max(value, minimum), maximum);
+        }
+        below += buckets[i];
+    }
+    return maximum;
+}
+
+namespace {
+
+#if defined(_WIN32)
+using SocketHandle = SOCKET;
+const SocketHandle INVALID_SOCKET_HANDLE = INVALID_SOCKET;
+void closeSocket(SocketHandle socket) {
+    closesocket(socket);
+}
+// Winsock has to be initialized once before any socket is created
+void initSockets() {
+    static const bool initialized = [] {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    (void)initialized;
+}
+#else
+using SocketHandle = int;
+const SocketHandle INVALID_SOCKET_HANDLE = -1;
+void closeSocket(SocketHandle socket) {
+    close(socket);
+}
+void initSockets() {
+}
+#endif
+
+void writeHistogram(std::ostream& out, const Histogram& histogram) {
+    out << "{\"count\":" << histogram.count() << ",\"mean\":" << histogram.mean() << ",\"min\":" << histogram.min() << ",\"p50\":" << histogram.quantile(0.5)
+        << ",\"p90\":" << histogram.quantile(0.9) << ",\"p99\":" << histogram.quantile(0.99) << ",\"max\":" << histogram.max() << "}";
+}
+
+class StdoutBackend : public Backend {
+public:
+    void publish(const Snapshot& snapshot) override {
+        std::ostringstream out;
+        out << "{\"time\":" << snapshot.time << ",\"interval\":" << snapshot.interval << ",\"cpuMs\":";
+        writeHistogram(out, snapshot.cpu);
+        out << ",\"gpuMs\":";
+        writeHistogram(out, snapshot.gpu);
+        out << ",\"hitches\":" << snapshot.hitches << ",\"totalHitches\":" << snapshot.totalHitches << ",\"dropped\":" << snapshot.dropped
+            << ",\"deviceMemoryBytes\":" << snapshot.deviceMemoryBytes << "}\n";
+        const std::string line = out.str();
+        fwrite(line.data(), 1, line.size(), stdout);
+        fflush(stdout);
+    }
+};
+
+class StatsdBackend : public Backend {
+public:
+    StatsdBackend(const std::string& host, uint16_t port, const std::string& prefix)
+        : prefix(prefix) {
+        initSockets();
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_DGRAM;
+        addrinfo* addresses = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0 || !addresses) {
+            throw std::runtime_error("Unable to resolve statsd host " + host);
+        }
+        memcpy(&address, addresses->ai_addr, addresses->ai_addrlen);
+        addressLength = (socklen_t)addresses->ai_addrlen;
+        socket = ::socket(addresses->ai_family, SOCK_DGRAM, IPPROTO_UDP);
+        freeaddrinfo(addresses);
+        if (socket == INVALID_SOCKET_HANDLE) {
+            throw std::runtime_error("Unable to create statsd socket");
+        }
+    }
+
+    ~StatsdBackend() override { closeSocket(socket); }
+
+    void publish(const Snapshot& snapshot) override {
+        std::ostringstream out;
+        auto histogram = [&](const char* name, const Histogram& values) {
+            if (!values.count()) {
+                return;
+            }
+            out << prefix << "." << name << ".mean:" << values.mean() << "|g\n";
+            out << prefix << "." << name << ".p50:" << values.quantile(0.5) << "|g\n";
+            out << prefix << "." << name << ".p90:" << values.quantile(0.9) << "|g\n";
+            out << prefix << "." << name << ".p99:" << values.quantile(0.99) << "|g\n";
+            out << prefix << "." << name << ".max:" << values.max() << "|g\n";
+        };
+        out << prefix << ".frames:" << snapshot.cpu.count() << "|c\n";
+        out << prefix << ".hitches:" << snapshot.hitches << "|c\n";
+        histogram("cpu_ms", snapshot.cpu);
+        histogram("gpu_ms", snapshot.gpu);
+        out << prefix << ".dropped:" << snapshot.dropped << "|g\n";
+        out << prefix << ".device_memory_bytes:" << snapshot.deviceMemoryBytes << "|g";
+        const std::string message = out.str();
+        // Best effort, like statsd itself
+        sendto(socket, message.data(), (int)message.size(), 0, (const sockaddr*)&address, addressLength);
+    }
+
+private:
+    const std::string prefix;
+    SocketHandle socket{ INVALID_SOCKET_HANDLE };
+    sockaddr_storage address{};
+    socklen_t addressLength{ 0 };
+};
+
+// A minimal HTTP/1.0 server answering every request with the latest exposition, on a thread of its own so a slow
+// scraper never holds up the exporter
+class PrometheusBackend : public Backend {
+public:
+    explicit PrometheusBackend(uint16_t port) {
+        initSockets();
+        listener = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (listener == INVALID_SOCKET_HANDLE) {
+            throw std::runtime_error("Unable to create metrics socket");
+        }
+        int reuse = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        if (bind(listener, (const sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 4) != 0) {
+            closeSocket(listener);
+            throw std::runtime_error("Unable to listen for metrics scrapes on port " + std::to_string(port));
+        }
+        thread = std::thread([this] { serve(); });
+    }
+
+    ~PrometheusBackend() override {
+        stopping = true;
+        thread.join();
+        closeSocket(listener);
+    }
+
+    void publish(const Snapshot& snapshot) override {
+        std::ostringstream out;
+        auto histogram = [&](const char* name, const char* help, const Histogram& values) {
+            out << "# HELP " << name << " " << help << "\n# TYPE " << name << " histogram\n";
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i < Histogram::BUCKET_COUNT - 1; ++i) {
+                cumulative += values.bucket(i);
+                out << name << "_bucket{le=\"" << Histogram::BOUNDS[i] << "\"} " << cumulative << "\n";
+            }
+            out << name << "_bucket{le=\"+Inf\"} " << values.count() << "\n";
+            out << name << "_sum " << values.sum() << "\n" << name << "_count " << values.count() << "\n";
+        };
+        histogram("vks_cpu_frame_milliseconds", "CPU time of a frame", snapshot.totalCpu);
+        histogram("vks_gpu_frame_milliseconds", "GPU time of a frame", snapshot.totalGpu);
+        out << "# HELP vks_hitches_total Frames far slower than the recent average\n# TYPE vks_hitches_total counter\n";
+        out << "vks_hitches_total " << snapshot.totalHitches << "\n";
+        out << "# HELP vks_dropped_samples_total Frames the exporter fell behind on\n# TYPE vks_dropped_samples_total counter\n";
+        out << "vks_dropped_samples_total " << snapshot.dropped << "\n";
+        out << "# HELP vks_device_memory_bytes Device local memory in use\n# TYPE vks_device_memory_bytes gauge\n";
+        out << "vks_device_memory_bytes " << snapshot.deviceMemoryBytes << "\n";
+        std::lock_guard<std::mutex> lock(mutex);
+        exposition = out.str();
+    }
+
+private:
+    void serve() {
+        while (!stopping) {
+            // Wakes up regularly to notice `stopping`
+            fd_set readable;
+            FD_ZERO(&readable);
+            FD_SET(listener, &readable);
+            timeval timeout{ 0, 200000 };
+            if (select((int)listener + 1, &readable, nullptr, nullptr, &timeout) <= 0) {
+                continue;
+            }
+            SocketHandle client = accept(listener, nullptr, nullptr);
+            if (client == INVALID_SOCKET_HANDLE) {
+                continue;
+            }
+            // The request itself doesn't matter, every path gets the metrics
+            char request[1024];
+            recv(client, request, sizeof(request), 0);
+            std::string body;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                body = exposition;
+            }
+            const std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                                         std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+            send(client, response.data(), (int)response.size(), 0);
+            closeSocket(client);
+        }
+    }
+
+    SocketHandle listener{ INVALID_SOCKET_HANDLE };
+    std::atomic<bool> stopping{ false };
+    std::thread thread;
+    std::mutex mutex;
+    std::string exposition;
+};
+
+}  // namespace
+
+std::unique_ptr<Backend> vks::metrics::createStdoutBackend() {
+    return std::unique_ptr<Backend>(new StdoutBackend());
+}
+
+std::unique_ptr<Backend> vks::metrics::createStatsdBackend(const std::string& host, uint16_t port, const std::string& prefix) {
+    return std::unique_ptr<Backend>(new StatsdBackend(host, port, prefix));
+}
+
+std::unique_ptr<Backend> vks::metrics::createPrometheusBackend(uint16_t port) {
+    return std::unique_ptr<Backend>(new PrometheusBackend(port));
+}
+
+std::unique_ptr<Backend> vks::metrics::createBackend(const std::string& spec) {
+    if (spec == "stdout") {
+        return createStdoutBackend();
+    }
+    static const std::string STATSD = "statsd:";
+    static const std::string PROMETHEUS = "prometheus:";
+    if (spec.compare(0, STATSD.size(), STATSD) == 0) {
+        const auto separator = spec.rfind(':');
+        if (separator > STATSD.size()) {
+            return createStatsdBackend(spec.substr(STATSD.size(), separator - STATSD.size()), (uint16_t)std::stoul(spec.substr(separator + 1)));
+        }
+    } else if (spec.compare(0, PROMETHEUS.size(), PROMETHEUS) == 0) {
+        return createPrometheusBackend((uint16_t)std::stoul(spec.substr(PROMETHEUS.size())));
+    }
+    throw std::runtime_error("Unknown metrics backend " + spec + ", expected stdout, statsd:<host>:<port> or prometheus:<port>");
+}
+
+MetricsSink::MetricsSink(std::unique_ptr<Backend>&& backend, const Config& config)
+    : config(config)
+    , backend(std::move(backend))
+    , queue(config.queueCapacity) {
+    start = windowStart = std::chrono::steady_clock::now();
+    thread = std::thread([this] { run(); });
+}
+
+MetricsSink::~MetricsSink() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_one();
+    thread.join();
+}
+
+void MetricsSink::run() {
+    const auto interval = std::chrono::duration<double>(config.interval);
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        // Draining often keeps the queue short, without waking up every frame
+        condition.wait_for(lock, std::chrono::milliseconds(50));
+        drain();
+        if (std::chrono::steady_clock::now() - windowStart >= interval) {
+            publish();
+        }
+    }
+    drain();
+    publish();
+}
+
+void MetricsSink::drain() {
+    FrameSample sample;
+    while (queue.pop(sample)) {
+        const double cpu = sample.cpuMilliseconds;
+        state.cpu.add(cpu);
+        state.totalCpu.add(cpu);
+        if (sample.gpuMilliseconds >= 0.0f) {
+            state.gpu.add(sample.gpuMilliseconds);
+            state.totalGpu.add(sample.gpuMilliseconds);
+        }
+        if (sample.deviceMemoryBytes) {
+            state.deviceMemoryBytes = sample.deviceMemoryBytes;
+        }
+        if (averageCpu > 0.0 && cpu > averageCpu * config.hitchFactor && cpu - averageCpu >= config.hitchMinimum) {
+            ++state.hitches;
+            ++state.totalHitches;
+        }
+        averageCpu = averageCpu > 0.0 ? averageCpu + (cpu - averageCpu) * 0.05 : cpu;
+    }
+}
+
+void MetricsSink::publish() {
+    const auto now = std::chrono::steady_clock::now();
+    state.time = std::chrono::duration<double>(now - start).count();
+    state.interval = std::chrono::duration<double>(now - windowStart).count();
+    state.dropped = dropped.load(std::memory_order_relaxed);
+    backend->publish(state);
+    state.cpu.clear();
+    state.gpu.clear();
+    state.hitches = 0;
+    windowStart = now;
+}
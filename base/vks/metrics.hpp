@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "spsc.hpp"
+
+namespace vks { namespace metrics {
+
+// Continuous export of frame statistics, for soak tests and unattended deployments where nobody looks at the UI
+// overlay.
+//
+// The frame loop pushes a FrameSample per frame into a lock free queue, which is all it pays.  An exporter thread
+// drains the queue into histograms, and every interval hands a Snapshot of them to a Backend: JSON lines on stdout,
+// statsd over UDP, or a Prometheus text endpoint over HTTP.
+
+struct FrameSample {
+    float cpuMilliseconds{ 0.0f };
+    // Negative for frames without a new GPU timestamp collection
+    float gpuMilliseconds{ -1.0f };
+    // Device local memory in use, 0 if not sampled this frame
+    uint64_t deviceMemoryBytes{ 0 };
+};
+
+// Milliseconds in fixed, roughly exponential buckets, so merging and exporting them is cheap and every export has the
+// same buckets
+class Histogram {
+public:
+    static const size_t BUCKET_COUNT = 12;
+    // Upper bounds of the buckets, the last one is unbounded
+    static const double BOUNDS[BUCKET_COUNT - 1];
+
+    void add(double milliseconds);
+    void clear() { *this = Histogram{}; }
+
+    uint64_t count() const { return samples; }
+    double sum() const { return total; }
+    double min() const { return samples ? minimum : 0.0; }
+    double max() const { return samples ? maximum : 0.0; }
+    double mean() const { return samples ? total / samples : 0.0; }
+    uint64_t bucket(size_t index) const { return buckets[index]; }
+    // Interpolated within the bucket holding the quantile, and clamped to the observed range
+    double quantile(double q) const;
+
+private:
+    uint64_t buckets[BUCKET_COUNT]{};
+    uint64_t samples{ 0 };
+    double total{ 0.0 };
+    double minimum{ 0.0 };
+    double maximum{ 0.0 };
+};
+
+struct Snapshot {
+    // Seconds since the sink started, and the length of the window this covers
+    double time{ 0.0 };
+    double interval{ 0.0 };
+    // This window alone
+    Histogram cpu;
+    Histogram gpu;
+    uint64_t hitches{ 0 };
+    // Since the sink started, for backends whose consumers expect cumulative values, like Prometheus
+    Histogram totalCpu;
+    Histogram totalGpu;
+    uint64_t totalHitches{ 0 };
+    // Samples the queue had no room for
+    uint64_t dropped{ 0 };
+    uint64_t deviceMemoryBytes{ 0 };
+};
+
+class Backend {
+public:
+    virtual ~Backend() = default;
+    // Called on the exporter thread
+    virtual void publish(const Snapshot& snapshot) = 0;
+};
+
+// One JSON object per line on stdout
+std::unique_ptr<Backend> createStdoutBackend();
+// Gauges and counters in statsd's line protocol, one datagram per snapshot.  Throws if `host` can't be resolved.
+std::unique_ptr<Backend> createStatsdBackend(const std::string& host, uint16_t port, const std::string& prefix = "vks");
+// Serves the latest snapshot in Prometheus' text format at any path of http://<host>:<port>/.  Throws if the port
+// can't be bound.
+std::unique_ptr<Backend> createPrometheusBackend(uint16_t port);
+// From a command line value: "stdout", "statsd:<host>:<port>" or "prometheus:<port>"
+std::unique_ptr<Backend> createBackend(const std::string& spec);
+
+class MetricsSink {
+public:
+    struct Config {
+        // Seconds between exports
+        double interval{ 10.0 };
+        // A frame is a hitch when its CPU time is over `hitchFactor` times the recent average, and at least
+        // `hitchMinimum` milliseconds over it
+        double hitchFactor{ 2.0 };
+        double hitchMinimum{ 4.0 };
+        // Frames of slack between the frame loop and the exporter thread
+        size_t queueCapacity{ 4096 };
+    };
+
+    MetricsSink(std::unique_ptr<Backend>&& backend, const Config& config);
+    explicit MetricsSink(std::unique_ptr<Backend>&& backend)
+        : MetricsSink(std::move(backend), Config{}) {}
+    // Exports a final snapshot of the samples so far
+    ~MetricsSink();
+
+    MetricsSink(const MetricsSink&) = delete;
+    MetricsSink& operator=(const MetricsSink&) = delete;
+
+    // From one thread only, normally the frame loop.  Never blocks, drops the sample if the exporter is behind.
+    void push(const FrameSample& sample) {
+        if (!queue.push(sample)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    // On the exporter thread
+    void run();
+    void drain();
+    void publish();
+
+    const Config config;
+    std::unique_ptr<Backend> backend;
+    SpscQueue<FrameSample> queue;
+    std::atomic<uint64_t> dropped{ 0 };
+
+    // Only touched by the exporter thread
+    Snapshot state;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point windowStart;
+    // Exponential moving average of the CPU frame time, for telling hitches apart
+    double averageCpu{ 0.0 };
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping{ false };
+    std::thread thread;
+};
+
+}}  // namespace vks::metrics
@@ -8,6 +8,25 @@
 
 #include "model.hpp"
 #include "filesystem.hpp"
+#include "hash.hpp"
+#include "storage.hpp"
+#include "scheduler.hpp"
+#include "meshoptimizer.hpp"
+#include "meshlets.hpp"
+#include "simplify.hpp"
+#include "startup.hpp"
+#include "trace.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <sys/stat.h>
+#if defined(WIN32)
+#include <direct.h>
+#endif
+
+#include <glm/gtc/packing.hpp>
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -21,13 +40,293 @@ using namespace vks::model;
 const int Model::defaultFlags =
     aiProcess_FlipWindingOrder | aiProcess_Triangulate | aiProcess_PreTransformVertices | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals;
 
+namespace {
+
+// Baked mesh cache
+//
+// A cache file holds everything loadFromFile produces from an Assimp import: the header below, the parts, their
+// names, then the interleaved vertex data and the index data exactly as they're uploaded, the meshlets and the LODs.  The
+// file is named after a hash of everything that affects that output, so a changed source file, layout, create info
+// or flag set simply misses and bakes a new file.  Bump the version whenever the vertex generation changes.
+const uint32_t MESH_CACHE_MAGIC = 0x4d584b56;  // "VKXM"
+const uint32_t MESH_CACHE_VERSION = 4;
+
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t partCount;
+    uint32_t stride;
+    float dimMin[3];
+    float dimMax[3];
+    uint64_t namesSize;
+    uint64_t vertexSize;
+    uint64_t indexSize;
+    // Bytes per index, 2 or 4
+    uint32_t indexStride;
+    uint32_t meshletCount;
+    uint32_t lodCount;
+    uint32_t reserved;
+};
+
+struct MeshCachePart {
+    uint32_t vertexBase;
+    uint32_t vertexCount;
+    uint32_t indexBase;
+    uint32_t indexCount;
+    uint32_t nameOffset;
+    uint32_t nameSize;
+    uint32_t meshletBase;
+    uint32_t meshletCount;
+    uint32_t lodBase;
+    uint32_t lodCount;
+};
+
+size_t alignTo4(size_t size) {
+    return (size + 3) & ~size_t(3);
+}
+
+// Returns false if the source can't be stat'ed, in which case there's nothing reliable to key the cache on
+bool meshCacheKey(const std::string& filename, const VertexLayout& layout, const ModelCreateInfo& createInfo, int flags, uint64_t& outKey) {
+    struct stat info;
+    if (0 != stat(filename.c_str(), &info)) {
+        return false;
+    }
+    KeyHasher hasher;
+    hasher.add(MESH_CACHE_VERSION);
+    hasher.add(filename.data(), filename.size());
+    hasher.add(static_cast<uint64_t>(info.st_size));
+    hasher.add(static_cast<int64_t>(info.st_mtime));
+    for (const auto& component : layout.components) {
+        hasher.add(static_cast<uint32_t>(component));
+    }
+    hasher.add(createInfo.center);
+    hasher.add(createInfo.scale);
+    hasher.add(createInfo.uvscale);
+    hasher.add(createInfo.optimize);
+    hasher.add(createInfo.meshlets);
+    hasher.add(createInfo.lodCount);
+    if (createInfo.lodCount > 1) {
+        hasher.add(createInfo.lodRatio);
+        hasher.add(createInfo.lodMaxError);
+    }
+    hasher.add(flags);
+    outKey = hasher.hash;
+    return true;
+}
+
+uint32_t triangleCount(const aiMesh* paiMesh) {
+    if (paiMesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE) {
+        return paiMesh->mNumFaces;
+    }
+    uint32_t count = 0;
+    for (unsigned int j = 0; j < paiMesh->mNumFaces; j++) {
+        if (paiMesh->mFaces[j].mNumIndices == 3) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+std::string meshCacheFile(const std::string& directory, uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.mesh", static_cast<unsigned long long>(key));
+    return directory + "/" + name;
+}
+
+}  // namespace
+
+bool Model::loadFromCache(const Context& context, const std::string& cacheFile, uint64_t key, bool hostCopy, bool positionStream) {
+    struct stat info;
+    if (0 != stat(cacheFile.c_str(), &info)) {
+        return false;
+    }
+    // The file is memory mapped, and the vertex and index data are staged straight out of the mapping
+    auto storage = storage::Storage::readFile(cacheFile);
+    const uint8_t* data = storage->data();
+    const size_t size = storage->size();
+
+    MeshCacheHeader header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION || header.key != key || header.stride != layout.stride()) {
+        return false;
+    }
+    const size_t partsOffset = sizeof(header);
+    const size_t namesOffset = partsOffset + header.partCount * sizeof(MeshCachePart);
+    const size_t vertexOffset = alignTo4(namesOffset + header.namesSize);
+    const size_t indexOffset = vertexOffset + header.vertexSize;
+    const size_t meshletOffset = alignTo4(indexOffset + header.indexSize);
+    const size_t lodOffset = meshletOffset + header.meshletCount * sizeof(Meshlet);
+    if ((header.indexStride != sizeof(uint16_t) && header.indexStride != sizeof(uint32_t)) || lodOffset + header.lodCount * sizeof(Lod) != size ||
+        header.vertexSize != (uint64_t)header.vertexCount * header.stride || header.indexSize != (uint64_t)header.indexCount * header.indexStride) {
+        return false;
+    }
+
+    parts.resize(header.partCount);
+    for (uint32_t i = 0; i < header.partCount; ++i) {
+        MeshCachePart cached;
+        memcpy(&cached, data + partsOffset + i * sizeof(cached), sizeof(cached));
+        if ((uint64_t)cached.nameOffset + cached.nameSize > header.namesSize || (uint64_t)cached.meshletBase + cached.meshletCount > header.meshletCount ||
+            (uint64_t)cached.lodBase + cached.lodCount > header.lodCount) {
+            parts.clear();
+            return false;
+        }
+        auto& part = parts[i];
+        part.name.assign(reinterpret_cast<const char*>(data + namesOffset + cached.nameOffset), cached.nameSize);
+        part.vertexBase = cached.vertexBase;
+        part.vertexCount = cached.vertexCount;
+        part.indexBase = cached.indexBase;
+        part.indexCount = cached.indexCount;
+        part.meshletBase = cached.meshletBase;
+        part.meshletCount = cached.meshletCount;
+        part.lodBase = cached.lodBase;
+        part.lodCount = cached.lodCount;
+    }
+    meshlets.resize(header.meshletCount);
+    memcpy(meshlets.data(), data + meshletOffset, meshlets.size() * sizeof(Meshlet));
+    lods.resize(header.lodCount);
+    memcpy(lods.data(), data + lodOffset, lods.size() * sizeof(Lod));
+    vertexCount = header.vertexCount;
+    indexCount = header.indexCount;
+    dim.min = glm::vec3(header.dimMin[0], header.dimMin[1], header.dimMin[2]);
+    dim.max = glm::vec3(header.dimMax[0], header.dimMax[1], header.dimMax[2]);
+    dim.size = dim.max - dim.min;
+    indexType = header.indexStride == sizeof(uint16_t) ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+    if (hostCopy) {
+        hostVertices.assign(data + vertexOffset, data + vertexOffset + header.vertexSize);
+        hostIndices.resize(indexCount);
+        for (uint32_t i = 0; i < indexCount; ++i) {
+            if (indexType == vk::IndexType::eUint16) {
+                uint16_t index;
+                memcpy(&index, data + indexOffset + i * sizeof(index), sizeof(index));
+                hostIndices[i] = index;
+            } else {
+                memcpy(&hostIndices[i], data + indexOffset + i * sizeof(uint32_t), sizeof(uint32_t));
+            }
+        }
+    }
+
+    UploadTicket* ticket = context.asyncUploads ? &uploadTicket : nullptr;
+    vertices = context.stageToDeviceBuffer(vertexUsage, (size_t)header.vertexSize, data + vertexOffset, ticket);
+    indices = context.stageToDeviceBuffer(indexUsage, (size_t)header.indexSize, data + indexOffset, ticket);
+    if (positionStream) {
+        stagePositions(context, data + vertexOffset, ticket);
+    }
+    return true;
+}
+
+void Model::stagePositions(const Context& context, const uint8_t* vertexData, UploadTicket* ticket) {
+    const uint32_t positionComponent = layout.componentIndex(VERTEX_COMPONENT_POSITION);
+    if (positionComponent == static_cast<uint32_t>(-1)) {
+        throw std::runtime_error("A position stream needs a position component in the vertex layout");
+    }
+    const size_t stride = layout.stride();
+    const size_t offset = layout.offset(positionComponent);
+    std::vector<glm::vec3> packed(vertexCount);
+    for (uint32_t i = 0; i < vertexCount; ++i) {
+        memcpy(&packed[i], vertexData + i * stride + offset, sizeof(glm::vec3));
+    }
+    positions = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, packed, ticket);
+}
+
+// Write to a temporary file and rename it over the old one, so that a concurrent or interrupted bake can never
+// leave a truncated cache file behind
+void Model::saveToCache(const std::string& cacheDirectory, const std::string& cacheFile, uint64_t key,
+                        const std::vector<uint8_t>& vertexBuffer, const void* indexData, size_t indexSize) const {
+#if defined(WIN32)
+    _mkdir(cacheDirectory.c_str());
+#else
+    mkdir(cacheDirectory.c_str(), 0755);
+#endif
+
+    std::vector<MeshCachePart> cachedParts(parts.size());
+    std::string names;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        const auto& part = parts[i];
+        cachedParts[i] = { part.vertexBase, part.vertexCount, part.indexBase, part.indexCount, (uint32_t)names.size(), (uint32_t)part.name.size(),
+                           part.meshletBase, part.meshletCount, part.lodBase, part.lodCount };
+        names += part.name;
+    }
+
+    MeshCacheHeader header;
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.key = key;
+    header.vertexCount = vertexCount;
+    header.indexCount = indexCount;
+    header.partCount = (uint32_t)parts.size();
+    header.stride = layout.stride();
+    for (int i = 0; i < 3; ++i) {
+        header.dimMin[i] = dim.min[i];
+        header.dimMax[i] = dim.max[i];
+    }
+    header.namesSize = names.size();
+    header.vertexSize = vertexBuffer.size();
+    header.indexSize = indexSize;
+    header.indexStride = indexType == vk::IndexType::eUint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    header.meshletCount = (uint32_t)meshlets.size();
+    header.lodCount = (uint32_t)lods.size();
+    header.reserved = 0;
+
+    const size_t padding = alignTo4(sizeof(header) + cachedParts.size() * sizeof(MeshCachePart) + names.size()) -
+                           (sizeof(header) + cachedParts.size() * sizeof(MeshCachePart) + names.size());
+    const size_t indexPadding = alignTo4(indexSize) - indexSize;
+    const char zeros[4] = {};
+
+    const std::string tempFile = cacheFile + ".tmp";
+    {
+        std::ofstream file(tempFile, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(cachedParts.data()), cachedParts.size() * sizeof(MeshCachePart));
+        file.write(names.data(), names.size());
+        file.write(zeros, padding);
+        file.write(reinterpret_cast<const char*>(vertexBuffer.data()), vertexBuffer.size());
+        file.write(reinterpret_cast<const char*>(indexData), indexSize);
+        file.write(zeros, indexPadding);
+        file.write(reinterpret_cast<const char*>(meshlets.data()), meshlets.size() * sizeof(Meshlet));
+        file.write(reinterpret_cast<const char*>(lods.data()), lods.size() * sizeof(Lod));
+        if (!file) {
+            file.close();
+            std::remove(tempFile.c_str());
+            return;
+        }
+    }
+#ifdef WIN32
+    // rename does not replace an existing file on Windows
+    std::remove(cacheFile.c_str());
+#endif
+    std::rename(tempFile.c_str(), cacheFile.c_str());
+}
+
 void Model::loadFromFile(const Context& context, const std::string& filename, const VertexLayout& layout, const ModelCreateInfo& createInfo, const int flags) {
+    VKS_TRACE_ZONE("Model::loadFromFile");
+    startup::ScopedPhase startupPhase(startup::Phase::Decode);
+    Allocator::ScopedTag tag("models");
     this->layout = layout;
     scale = createInfo.scale;
     uvscale = createInfo.uvscale;
     center = createInfo.center;
+    vertexUsage = vk::BufferUsageFlagBits::eVertexBuffer | createInfo.vertexUsage;
+    indexUsage = vk::BufferUsageFlagBits::eIndexBuffer | createInfo.indexUsage;
     destroy();
     device = context.device;
+    dim = Dimension();
+    hostVertices.clear();
+    hostIndices.clear();
+
+    uint64_t cacheKey = 0;
+    std::string cacheFile;
+    if (!context.modelCachePath.empty() && cacheable() && meshCacheKey(filename, layout, createInfo, flags, cacheKey)) {
+        cacheFile = meshCacheFile(context.modelCachePath, cacheKey);
+        if (loadFromCache(context, cacheFile, cacheKey, createInfo.hostCopy, createInfo.positionStream)) {
+            return;
+        }
+    }
 
     Assimp::Importer importer;
     const aiScene* pScene;
@@ -47,6 +346,9 @@ void Model::loadFromFile(const Context& context, const std::string& filename, co
 
     parts.clear();
     parts.resize(pScene->mNumMeshes);
+    meshlets.clear();
+    lods.clear();
+    vertexCount = 0;
     for (unsigned int i = 0; i < pScene->mNumMeshes; i++) {
         const aiMesh* paiMesh = pScene->mMeshes[i];
         parts[i] = {};
@@ -58,111 +360,312 @@ void Model::loadFromFile(const Context& context, const std::string& filename, co
 
     onLoad(context, importer, pScene);
 
-    std::vector<uint8_t> vertexBuffer;
-    std::vector<uint32_t> indexBuffer;
-
-    vertexCount = 0;
+    // Each part gets a precomputed slice of one vertex buffer and one index buffer, so the parts can be
+    // packed independently on the worker threads
+    const size_t stride = layout.stride();
     indexCount = 0;
-
-    // Load meshes
     for (unsigned int meshIndex = 0; meshIndex < pScene->mNumMeshes; meshIndex++) {
         auto& part = parts[meshIndex];
         const aiMesh* paiMesh = pScene->mMeshes[meshIndex];
-        const auto& numVertices = pScene->mMeshes[meshIndex]->mNumVertices;
-        for (unsigned int vertexIndex = 0; vertexIndex < numVertices; vertexIndex++) {
-            appendVertex(vertexBuffer, pScene, meshIndex, vertexIndex);
+        part.indexBase = indexCount;
+        part.indexCount = 3 * triangleCount(paiMesh);
+        indexCount += part.indexCount;
+    }
+    std::vector<uint8_t> vertexBuffer(vertexCount * stride);
+    std::vector<uint32_t> indexBuffer(indexCount);
+    // Each part's indices are offset by its indexBase, which bounds the largest index written.  If that fits, the
+    // indices are narrowed to 16 bits, keeping 0xFFFF free as it doubles as the primitive restart index.
+    uint32_t maxIndex = 0;
+    for (const auto& part : parts) {
+        if (part.indexCount) {
+            maxIndex = std::max(maxIndex, part.indexBase + part.vertexCount - 1);
         }
+    }
+    indexType = maxIndex < 0xFFFF ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+    std::vector<uint16_t> shortIndexBuffer(indexType == vk::IndexType::eUint16 ? indexCount : 0);
+    const size_t indexStride = indexType == vk::IndexType::eUint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    auto indexData = [&] {
+        return indexType == vk::IndexType::eUint16 ? reinterpret_cast<const uint8_t*>(shortIndexBuffer.data())
+                                                   : reinterpret_cast<const uint8_t*>(indexBuffer.data());
+    };
+    std::vector<Dimension> meshBounds(pScene->mNumMeshes);
+    std::vector<std::vector<Meshlet>> partMeshlets(createInfo.meshlets ? pScene->mNumMeshes : 0);
+    // The simplified levels of each part, with indices local to the part
+    struct GeneratedLod {
+        std::vector<uint32_t> indices;
+        float error{ 0.0f };
+        std::vector<Meshlet> meshlets;
+    };
+    std::vector<std::vector<GeneratedLod>> partLods(pScene->mNumMeshes);
 
-        dim.size = dim.max - dim.min;
-
-        vertexCount += numVertices;
-        part.indexBase = static_cast<uint32_t>(indexBuffer.size());
-        for (unsigned int j = 0; j < paiMesh->mNumFaces; j++) {
-            const aiFace& Face = paiMesh->mFaces[j];
-            if (Face.mNumIndices != 3)
-                continue;
-            indexBuffer.push_back(part.indexBase + Face.mIndices[0]);
-            indexBuffer.push_back(part.indexBase + Face.mIndices[1]);
-            indexBuffer.push_back(part.indexBase + Face.mIndices[2]);
-            part.indexCount += 3;
+    // Unless the upload has to go through the transfer queue, the device buffers are created up front and every
+    // worker stages its parts as soon as they're packed, overlapping the staging copies with the packing of
+    // other parts.  Otherwise both buffers are uploaded once everything has been packed, as they are when the LODs
+    // make the size of the index buffer unknown until then.
+    UploadTicket* ticket = context.asyncUploads ? &uploadTicket : nullptr;
+    const bool uploadWhilePacking = !(ticket && context.hasTransferQueue()) && vertexCount && indexCount && createInfo.lodCount <= 1;
+    if (uploadWhilePacking) {
+        uploadTicket = 0;
+        vertices = context.createDeviceBuffer(vertexUsage | vk::BufferUsageFlagBits::eTransferDst, vertexBuffer.size());
+        indices = context.createDeviceBuffer(indexUsage | vk::BufferUsageFlagBits::eTransferDst, indexCount * indexStride);
+    }
+    auto stageSlice = [&](const vk::Buffer& target, const uint8_t* data, vk::DeviceSize offset, vk::DeviceSize size) {
+        if (!size) {
+            return;
         }
-        indexCount += part.indexCount;
+        context.stageUpload(size, data + offset, 4, [&](const vk::CommandBuffer& copyCmd, const vk::Buffer& staging, vk::DeviceSize stagingOffset) {
+            copyCmd.copyBuffer(staging, target, vk::BufferCopy(stagingOffset, offset, size));
+        });
+    };
+
+    const uint32_t INVALID_OFFSET = static_cast<uint32_t>(-1);
+    const uint32_t positionComponent = layout.componentIndex(VERTEX_COMPONENT_POSITION);
+    const uint32_t positionOffset = positionComponent != INVALID_OFFSET ? layout.offset(positionComponent) : INVALID_OFFSET;
+    // Meshlets only get normal cones from full precision normals
+    const uint32_t normalComponent = layout.componentIndex(VERTEX_COMPONENT_NORMAL);
+    const uint32_t normalOffset = normalComponent != INVALID_OFFSET ? layout.offset(normalComponent) : INVALID_OFFSET;
+    // Simplification keeps the full precision normals and UVs where it can
+    std::vector<SimplifyAttribute> lodAttributes;
+    if (normalOffset != INVALID_OFFSET) {
+        lodAttributes.push_back({ normalOffset, 3, 0.5f });
     }
+    const uint32_t uvComponent = layout.componentIndex(VERTEX_COMPONENT_UV);
+    if (uvComponent != INVALID_OFFSET) {
+        lodAttributes.push_back({ layout.offset(uvComponent), 2, 1.0f });
+    }
+    auto packParts = [&](size_t first, size_t last) {
+        for (size_t meshIndex = first; meshIndex < last; ++meshIndex) {
+            const auto& part = parts[meshIndex];
+            const aiMesh* paiMesh = pScene->mMeshes[meshIndex];
+            uint8_t* partVertices = vertexBuffer.data() + part.vertexBase * stride;
+            uint32_t* partIndices = indexBuffer.data() + part.indexBase;
+            packMesh(partVertices, pScene, (uint32_t)meshIndex, meshBounds[meshIndex]);
+            uint32_t* outIndex = partIndices;
+            for (unsigned int j = 0; j < paiMesh->mNumFaces; j++) {
+                const aiFace& Face = paiMesh->mFaces[j];
+                if (Face.mNumIndices != 3)
+                    continue;
+                *outIndex++ = Face.mIndices[0];
+                *outIndex++ = Face.mIndices[1];
+                *outIndex++ = Face.mIndices[2];
+            }
+            if (createInfo.optimize) {
+                optimizeVertexCache(partIndices, part.indexCount, part.vertexCount);
+                if (positionOffset != INVALID_OFFSET) {
+                    optimizeOverdraw(partIndices, part.indexCount, partVertices + positionOffset, stride, part.vertexCount);
+                }
+                optimizeVertexFetch(partVertices, partIndices, part.indexCount, part.vertexCount, stride);
+            }
+            if (createInfo.meshlets && positionOffset != INVALID_OFFSET) {
+                buildMeshlets(partMeshlets[meshIndex], partIndices, part.indexCount, partVertices + positionOffset,
+                              normalOffset != INVALID_OFFSET ? partVertices + normalOffset : nullptr, stride, part.vertexCount);
+            }
+            // Every level is simplified from the full detail one, and the vertices it leaves out are shared with it
+            size_t previousCount = part.indexCount;
+            for (uint32_t level = 1; level < createInfo.lodCount && positionOffset != INVALID_OFFSET; ++level) {
+                GeneratedLod lod;
+                lod.indices.resize(part.indexCount);
+                const size_t target = static_cast<size_t>(previousCount * createInfo.lodRatio) / 3 * 3;
+                lod.indices.resize(simplify(lod.indices.data(), partIndices, part.indexCount, partVertices, part.vertexCount, stride, positionOffset,
+                                            lodAttributes, target, createInfo.lodMaxError, lod.error));
+                // Stuck at the error limit, or on seams and borders
+                if (lod.indices.empty() || lod.indices.size() >= previousCount) {
+                    break;
+                }
+                optimizeVertexCache(lod.indices.data(), lod.indices.size(), part.vertexCount);
+                if (createInfo.meshlets) {
+                    buildMeshlets(lod.meshlets, lod.indices.data(), lod.indices.size(), partVertices + positionOffset,
+                                  normalOffset != INVALID_OFFSET ? partVertices + normalOffset : nullptr, stride, part.vertexCount);
+                }
+                previousCount = lod.indices.size();
+                partLods[meshIndex].push_back(std::move(lod));
+            }
+            for (uint32_t i = 0; i < part.indexCount; ++i) {
+                partIndices[i] += part.indexBase;
+            }
+            if (!shortIndexBuffer.empty()) {
+                std::copy(partIndices, partIndices + part.indexCount, shortIndexBuffer.data() + part.indexBase);
+            }
+        }
+        if (uploadWhilePacking) {
+            // The parts of a range are adjacent in both buffers
+            const auto& firstPart = parts[first];
+            const auto& lastPart = parts[last - 1];
+            stageSlice(vertices.buffer, vertexBuffer.data(), firstPart.vertexBase * stride,
+                       (lastPart.vertexBase + lastPart.vertexCount - firstPart.vertexBase) * stride);
+            stageSlice(indices.buffer, indexData(), firstPart.indexBase * indexStride,
+                       (lastPart.indexBase + lastPart.indexCount - firstPart.indexBase) * indexStride);
+        }
+    };
+    TaskScheduler& scheduler = createInfo.scheduler ? *createInfo.scheduler : TaskScheduler::shared();
+    scheduler.parallelFor(0, pScene->mNumMeshes, 1, packParts);
 
+    for (const auto& bounds : meshBounds) {
+        dim.max = glm::max(bounds.max, dim.max);
+        dim.min = glm::min(bounds.min, dim.min);
+    }
+    dim.size = dim.max - dim.min;
 
-    // Vertex buffer
-    vertices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertexBuffer);
-    // Index buffer
-    indices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indexBuffer);
+    for (size_t meshIndex = 0; meshIndex < partMeshlets.size(); ++meshIndex) {
+        auto& part = parts[meshIndex];
+        part.meshletBase = (uint32_t)meshlets.size();
+        part.meshletCount = (uint32_t)partMeshlets[meshIndex].size();
+        for (auto& meshlet : partMeshlets[meshIndex]) {
+            meshlet.firstIndex += part.indexBase;
+            meshlets.push_back(meshlet);
+        }
+    }
+
+    // The simplified levels go behind all the parts' indices, offset like the full detail ones
+    std::vector<std::vector<Lod>> simplifiedLods(parts.size());
+    for (size_t meshIndex = 0; meshIndex < partLods.size(); ++meshIndex) {
+        const auto& part = parts[meshIndex];
+        for (const auto& generated : partLods[meshIndex]) {
+            Lod lod{ indexCount, (uint32_t)generated.indices.size(), generated.error, (uint32_t)meshlets.size(), (uint32_t)generated.meshlets.size() };
+            for (const auto index : generated.indices) {
+                indexBuffer.push_back(index + part.indexBase);
+                if (indexType == vk::IndexType::eUint16) {
+                    shortIndexBuffer.push_back(static_cast<uint16_t>(index + part.indexBase));
+                }
+            }
+            for (auto meshlet : generated.meshlets) {
+                meshlet.firstIndex += lod.indexBase;
+                meshlets.push_back(meshlet);
+            }
+            indexCount += lod.indexCount;
+            simplifiedLods[meshIndex].push_back(lod);
+        }
+    }
+    for (size_t meshIndex = 0; meshIndex < parts.size(); ++meshIndex) {
+        auto& part = parts[meshIndex];
+        part.lodBase = (uint32_t)lods.size();
+        part.lodCount = 1 + (uint32_t)simplifiedLods[meshIndex].size();
+        lods.push_back({ part.indexBase, part.indexCount, 0.0f, part.meshletBase, part.meshletCount });
+        lods.insert(lods.end(), simplifiedLods[meshIndex].begin(), simplifiedLods[meshIndex].end());
+    }
+
+    if (!cacheFile.empty()) {
+        saveToCache(context.modelCachePath, cacheFile, cacheKey, vertexBuffer, indexData(), indexCount * indexStride);
+    }
+
+    if (!uploadWhilePacking) {
+        // Both buffers land in the same transfer batch, or the index buffer in a later one, so the
+        // second ticket covers both
+        vertices = context.stageToDeviceBuffer(vertexUsage, vertexBuffer, ticket);
+        indices = context.stageToDeviceBuffer(indexUsage, indexCount * indexStride, indexData(), ticket);
+    }
+    if (createInfo.positionStream && vertexCount) {
+        stagePositions(context, vertexBuffer.data(), ticket);
+    }
+
+    // The buffers have been staged, so their contents can be handed over
+    if (createInfo.hostCopy) {
+        hostVertices = std::move(vertexBuffer);
+        hostIndices = std::move(indexBuffer);
+    }
 };
 
-void Model::appendVertex(std::vector<uint8_t>& outputBuffer, const aiScene* pScene, uint32_t meshIndex, uint32_t vertexIndex) {
-    static const aiVector3D Zero3D(0.0f, 0.0f, 0.0f);
+void Model::packMesh(uint8_t* output, const aiScene* pScene, uint32_t meshIndex, Dimension& bounds) const {
     const aiMesh* paiMesh = pScene->mMeshes[meshIndex];
-    const auto& j = vertexIndex;
+    const uint32_t numVertices = paiMesh->mNumVertices;
+    const size_t stride = layout.stride();
+    // The color is per material, not per vertex
     aiColor3D pColor(0.f, 0.f, 0.f);
     pScene->mMaterials[paiMesh->mMaterialIndex]->Get(AI_MATKEY_COLOR_DIFFUSE, pColor);
-    const aiVector3D* pPos = &(paiMesh->mVertices[j]);
-    const aiVector3D* pNormal = &(paiMesh->mNormals[j]);
-    const aiVector3D* pTexCoord = (paiMesh->HasTextureCoords(0)) ? &(paiMesh->mTextureCoords[0][j]) : &Zero3D;
-    const aiVector3D* pTangent = (paiMesh->HasTangentsAndBitangents()) ? &(paiMesh->mTangents[j]) : &Zero3D;
-    const aiVector3D* pBiTangent = (paiMesh->HasTangentsAndBitangents()) ? &(paiMesh->mBitangents[j]) : &Zero3D;
-    std::vector<float> vertexBuffer;
-    glm::vec3 scaledPos{ pPos->x, -pPos->y, pPos->z };
-    scaledPos *= scale;
-    scaledPos += center;
-
-    // preallocate float buffer with approximate size
-    vertexBuffer.reserve(layout.components.size() * 4);
-    for (auto& component : layout.components) {
-        switch (component) {
+
+    // One strided pass over the mesh per component.  Absent attributes and the dummy padding components are left
+    // at the zeros the output is filled with.
+    for (uint32_t componentIndex = 0; componentIndex < layout.components.size(); ++componentIndex) {
+        uint8_t* out = output + layout.offset(componentIndex);
+        switch (layout.components[componentIndex]) {
             case VERTEX_COMPONENT_POSITION:
-                vertexBuffer.push_back(scaledPos.x);
-                vertexBuffer.push_back(scaledPos.y);
-                vertexBuffer.push_back(scaledPos.z);
+                for (uint32_t j = 0; j < numVertices; ++j, out += stride) {
+                    const aiVector3D& pos = paiMesh->mVertices[j];
+                    const glm::vec3 scaledPos = glm::vec3{ pos.x, -pos.y, pos.z } * scale + center;
+                    memcpy(out, &scaledPos, sizeof(scaledPos));
+                    bounds.max = glm::max(scaledPos, bounds.max);
+                    bounds.min = glm::min(scaledPos, bounds.min);
+                }
                 break;
             case VERTEX_COMPONENT_NORMAL:
-                vertexBuffer.push_back(pNormal->x);
-                vertexBuffer.push_back(-pNormal->y);
-                vertexBuffer.push_back(pNormal->z);
+                if (paiMesh->HasNormals()) {
+                    for (uint32_t j = 0; j < numVertices; ++j, out += stride) {
+                        const aiVector3D& normal = paiMesh->mNormals[j];
+                        const float value[3] = { normal.x, -normal.y, normal.z };
+                        memcpy(out, value, sizeof(value));
+                    }
+                }
                 break;
             case VERTEX_COMPONENT_UV:
-                vertexBuffer.push_back(pTexCoord->x * uvscale.s);
-                vertexBuffer.push_back(pTexCoord->y * uvscale.t);
+                if (paiMesh->HasTextureCoords(0)) {
+                    for (uint32_t j = 0; j < numVertices; ++j, out += stride) {
+                        const aiVector3D& texCoord = paiMesh->mTextureCoords[0][j];
+                        const float value[2] = { texCoord.x * uvscale.s, texCoord.y * uvscale.t };
+                        memcpy(out, value, sizeof(value));
+                    }
+                }
                 break;
-            case VERTEX_COMPONENT_COLOR:
-                vertexBuffer.push_back(pColor.r);
-                vertexBuffer.push_back(pColor.g);
-                vertexBuffer.push_back(pColor.b);
+            case VERTEX_COMPONENT_UV_HALF:
+                if (paiMesh->HasTextureCoords(0)) {
+                    for (uint32_t j = 0; j < numVertices; ++j, out += stride) {
+                        const aiVector3D& texCoord = paiMesh->mTextureCoords[0][j];
+                        const uint32_t value = glm::packHalf2x16(glm::vec2{ texCoord.x * uvscale.s, texCoord.y * uvscale.t });
+                        memcpy(out, &value, sizeof(value));
+                    }
+                }
                 break;
-            case VERTEX_COMPONENT_TANGENT:
-                vertexBuffer.push_back(pTangent->x);
-                vertexBuffer.push_back(pTangent->y);
-                vertexBuffer.push_back(pTangent->z);
+            case VERTEX_COMPONENT_NORMAL_PACKED:
+                if (paiMesh->HasNormals()) {
+                    for (uint32_t j = 0; j < numVertices; ++j, out += stride) {
+                        const aiVector3D& normal = paiMesh->mNormals[j];
+                        const uint32_t value = glm::packSnorm3x10_1x2(glm::vec4{ normal.x, -normal.y, normal.z, 0.0f });
+                        memcpy(out, &value, sizeof(value));
+                    }
+                }
+                break;
+            case VERTEX_COMPONENT_COLOR_UNORM8: {
+                const uint32_t value = glm::packUnorm4x8(glm::vec4{ pColor.r, pColor.g, pColor.b, 1.0f });
+                for (uint32_t j = 0; j < numVertices; ++j, out += stride) {
+                    memcpy(out, &value, sizeof(value));
+                }
+                break;
+            }
+            case VERTEX_COMPONENT_TANGENT_PACKED:
+            case VERTEX_COMPONENT_BITANGENT_PACKED:
+                if (paiMesh->HasTangentsAndBitangents()) {
+                    const aiVector3D* source =
+                        layout.components[componentIndex] == VERTEX_COMPONENT_TANGENT_PACKED ? paiMesh->mTangents : paiMesh->mBitangents;
+                    for (uint32_t j = 0; j < numVertices; ++j, out += stride) {
+                        // Assimp's tangents aren't always unit length, and anything outside [-1, 1] would clamp
+                        const glm::vec3 tangent{ source[j].x, source[j].y, source[j].z };
+                        const float length = glm::length(tangent);
+                        const glm::vec3 direction = length > 0.0f ? tangent / length : tangent;
+                        const uint32_t value = glm::packSnorm3x10_1x2(glm::vec4{ direction, 0.0f });
+                        memcpy(out, &value, sizeof(value));
+                    }
+                }
+                break;
+            case VERTEX_COMPONENT_COLOR: {
+                const float value[3] = { pColor.r, pColor.g, pColor.b };
+                for (uint32_t j = 0; j < numVertices; ++j, out += stride) {
+                    memcpy(out, value, sizeof(value));
+                }
                 break;
+            }
+            case VERTEX_COMPONENT_TANGENT:
             case VERTEX_COMPONENT_BITANGENT:
-                vertexBuffer.push_back(pBiTangent->x);
-                vertexBuffer.push_back(pBiTangent->y);
-                vertexBuffer.push_back(pBiTangent->z);
+                if (paiMesh->HasTangentsAndBitangents()) {
+                    const aiVector3D* source =
+                        layout.components[componentIndex] == VERTEX_COMPONENT_TANGENT ? paiMesh->mTangents : paiMesh->mBitangents;
+                    for (uint32_t j = 0; j < numVertices; ++j, out += stride) {
+                        const float value[3] = { source[j].x, source[j].y, source[j].z };
+                        memcpy(out, value, sizeof(value));
+                    }
+                }
                 break;
             // Dummy components for padding
-            case VERTEX_COMPONENT_DUMMY_INT:
-            case VERTEX_COMPONENT_DUMMY_FLOAT:
-                vertexBuffer.push_back(0.0f);
-                break;
-            case VERTEX_COMPONENT_DUMMY_INT4:
-            case VERTEX_COMPONENT_DUMMY_UINT4:
-            case VERTEX_COMPONENT_DUMMY_VEC4:
-                vertexBuffer.push_back(0.0f);
-                vertexBuffer.push_back(0.0f);
-                vertexBuffer.push_back(0.0f);
-                vertexBuffer.push_back(0.0f);
+            default:
                 break;
-        };
+        }
     }
-    appendOutput(outputBuffer, vertexBuffer);
-
-    dim.max = glm::max(scaledPos, dim.max);
-    dim.min = glm::min(scaledPos, dim.min);
 }
-
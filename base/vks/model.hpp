@@ -14,13 +14,16 @@
 
 #include "buffer.hpp"
 #include "context.hpp"
+#include "meshlets.hpp"
 
 struct aiScene;
 namespace Assimp {
 class Importer;
 };
 
-namespace vks { namespace model {
+namespace vks {
+class TaskScheduler;
+namespace model {
 
 /** @brief Vertex layout components */
 enum Component
@@ -36,6 +39,15 @@ enum Component
     VERTEX_COMPONENT_DUMMY_VEC4 = 0x8,
     VERTEX_COMPONENT_DUMMY_INT4 = 0x9,
     VERTEX_COMPONENT_DUMMY_UINT4 = 0xA,
+    // Quantized variants, 4 bytes each, for when vertex fetch bandwidth matters more than precision.  The shader
+    // inputs keep their float types.
+    VERTEX_COMPONENT_UV_HALF = 0xB,
+    // Signed normalized 10_10_10_2.  Vertex buffer support for this format is optional, though very widespread.
+    VERTEX_COMPONENT_NORMAL_PACKED = 0xC,
+    VERTEX_COMPONENT_TANGENT_PACKED = 0xD,
+    VERTEX_COMPONENT_BITANGENT_PACKED = 0xE,
+    // RGBA8 unorm, alpha is 1
+    VERTEX_COMPONENT_COLOR_UNORM8 = 0xF,
 };
 
 /** @brief Stores vertex layout components for model loading and Vulkan vertex input and atribute bindings  */
@@ -70,6 +82,14 @@ public:
                 return vk::Format::eR32G32B32A32Sint;
             case VERTEX_COMPONENT_DUMMY_UINT4:
                 return vk::Format::eR32G32B32A32Uint;
+            case VERTEX_COMPONENT_UV_HALF:
+                return vk::Format::eR16G16Sfloat;
+            case VERTEX_COMPONENT_NORMAL_PACKED:
+            case VERTEX_COMPONENT_TANGENT_PACKED:
+            case VERTEX_COMPONENT_BITANGENT_PACKED:
+                return vk::Format::eA2B10G10R10SnormPack32;
+            case VERTEX_COMPONENT_COLOR_UNORM8:
+                return vk::Format::eR8G8B8A8Unorm;
             default:
                 return vk::Format::eR32G32B32Sfloat;
         }
@@ -89,6 +109,12 @@ public:
                 return 4 * sizeof(int32_t);
             case VERTEX_COMPONENT_DUMMY_UINT4:
                 return 4 * sizeof(uint32_t);
+            case VERTEX_COMPONENT_UV_HALF:
+            case VERTEX_COMPONENT_NORMAL_PACKED:
+            case VERTEX_COMPONENT_TANGENT_PACKED:
+            case VERTEX_COMPONENT_BITANGENT_PACKED:
+            case VERTEX_COMPONENT_COLOR_UNORM8:
+                return sizeof(uint32_t);
             default:
                 // All components except the ones listed above are made up of 3 floats
                 return 3 * sizeof(float);
@@ -118,6 +144,30 @@ struct ModelCreateInfo {
     glm::vec3 center{ 0 };
     glm::vec3 scale{ 1 };
     glm::vec2 uvscale{ 1 };
+    /** @brief Reorder each part's triangles and vertices for the post-transform cache, overdraw and vertex fetch, see meshoptimizer.hpp */
+    bool optimize{ false };
+    /** @brief Split each part into meshlets with culling bounds, see Model::meshlets */
+    bool meshlets{ false };
+    /**
+    * @brief Levels of detail per part, the full detail one included, see Model::lods.  More than one adds index
+    * ranges for simplified versions of each part behind the full detail indices, which Model::indexCount then covers
+    * as well, so the parts have to be drawn by their LOD ranges.
+    */
+    uint32_t lodCount{ 1 };
+    /** @brief Index count of each level relative to the one before it */
+    float lodRatio{ 0.5f };
+    /** @brief Largest error of any level, relative to the size of the part, see simplify.hpp.  Parts that reach it stop with fewer levels */
+    float lodMaxError{ 0.05f };
+    /** @brief Usage flags added to the vertex buffer's, e.g. eStorageBuffer for a compute pass that reads the vertices */
+    vk::BufferUsageFlags vertexUsage;
+    /** @brief Usage flags added to the index buffer's, e.g. for building acceleration structures from it */
+    vk::BufferUsageFlags indexUsage;
+    /** @brief Keep a copy of the vertices and indices on the host, see Model::hostVertices */
+    bool hostCopy{ false };
+    /** @brief Also upload the positions on their own, see Model::positions */
+    bool positionStream{ false };
+    /** @brief (Optional) Scheduler to pack the parts on in parallel.  A scheduler shared by all model loads is used otherwise */
+    TaskScheduler* scheduler{ nullptr };
 
     ModelCreateInfo() = default;
 
@@ -134,12 +184,25 @@ struct Model {
     vk::Device device;
     Buffer vertices;
     Buffer indices;
+    /**
+    * @brief If ModelCreateInfo::positionStream was set, the vertex positions as tightly packed vec3s, in the order of
+    * `vertices`.  Passes that only need the positions, like a depth pre-pass, fetch a third or less of the bytes
+    */
+    Buffer positions;
     uint32_t indexCount = 0;
     uint32_t vertexCount = 0;
+    /** @brief Type of the elements of `indices`.  Models whose indices all fit in 16 bits get 16 bit indices */
+    vk::IndexType indexType{ vk::IndexType::eUint32 };
     VertexLayout layout;
     glm::vec3 scale{ 1.0f };
     glm::vec3 center{ 0.0f };
     glm::vec2 uvscale{ 1.0f };
+    /** @brief Usage of `vertices`, see ModelCreateInfo::vertexUsage */
+    vk::BufferUsageFlags vertexUsage{ vk::BufferUsageFlagBits::eVertexBuffer };
+    /** @brief Usage of `indices`, see ModelCreateInfo::indexUsage */
+    vk::BufferUsageFlags indexUsage{ vk::BufferUsageFlagBits::eIndexBuffer };
+    /** @brief Non-zero if the buffers are still in flight on the transfer queue, see Context::isUploadComplete */
+    UploadTicket uploadTicket{ 0 };
 
     /** @brief Stores vertex and index base and counts for each part of a model */
     struct ModelPart {
@@ -148,9 +211,38 @@ struct Model {
         uint32_t vertexCount;
         uint32_t indexBase;
         uint32_t indexCount;
+        /** @brief The part's range of `meshlets` */
+        uint32_t meshletBase;
+        uint32_t meshletCount;
+        /** @brief The part's range of `lods`, full detail first */
+        uint32_t lodBase;
+        uint32_t lodCount;
     };
     std::vector<ModelPart> parts;
 
+    /** @brief One level of detail of a part, as a range of `indices` into the part's vertices */
+    struct Lod {
+        uint32_t indexBase;
+        uint32_t indexCount;
+        /** @brief The largest distance, in model space, by which the level deviates from the full detail part */
+        float error;
+        /** @brief The level's range of `meshlets`, if ModelCreateInfo::meshlets was set */
+        uint32_t meshletBase;
+        uint32_t meshletCount;
+    };
+    /** @brief The levels of detail of all parts, see ModelCreateInfo::lodCount.  Every part has at least its full detail level */
+    std::vector<Lod> lods;
+
+    /**
+    * @brief The meshlets of all parts and levels of detail if ModelCreateInfo::meshlets was set, in index buffer order.
+    * Kept on the host, for the application to upload
+    */
+    std::vector<Meshlet> meshlets;
+
+    /** @brief If ModelCreateInfo::hostCopy was set, the contents of `vertices` and the indices as 32 bit, e.g. for building acceleration structures */
+    std::vector<uint8_t> hostVertices;
+    std::vector<uint32_t> hostIndices;
+
     static const int defaultFlags;
 
     struct Dimension {
@@ -163,8 +255,12 @@ struct Model {
     void destroy() {
         vertices.destroy();
         indices.destroy();
+        positions.destroy();
     }
 
+    /** @brief Fill `positions` from `vertexCount` vertices of `layout` at `vertexData`.  Throws std::runtime_error without a position component */
+    void stagePositions(const Context& context, const uint8_t* vertexData, UploadTicket* ticket = nullptr);
+
     /**
     * Loads a 3D model from a file into Vulkan buffers
     *
@@ -195,25 +291,35 @@ struct Model {
         loadFromFile(context, filename, layout, ModelCreateInfo{ scale, 1.0f, 0.0f }, flags);
     }
 
-    virtual void onLoad(const Context& context, Assimp::Importer& importer, const aiScene* pScene) {}
+    /**
+    * Whether loadFromFile may read and write the baked mesh cache in Context::modelCachePath.  A cached load
+    * never runs Assimp, so subclasses that need the scene in onLoad or packMesh must return false.
+    */
+    virtual bool cacheable() const { return true; }
 
-    virtual void appendVertex(std::vector<uint8_t>& outputBuffer, const aiScene* pScene, uint32_t meshIndex, uint32_t vertexIndex);
+    virtual void onLoad(const Context& context, Assimp::Importer& importer, const aiScene* pScene) {}
 
-    template <typename T>
-    void appendOutput(std::vector<uint8_t>& outputBuffer, const T& t) {
-        auto offset = outputBuffer.size();
-        auto copySize = sizeof(T);
-        outputBuffer.resize(offset + copySize);
-        memcpy(outputBuffer.data() + offset, &t, copySize);
-    }
+    /**
+    * Writes the interleaved vertices of one mesh
+    *
+    * @param output Start of the mesh's vertices, zero filled and sized for `layout.stride()` bytes per vertex
+    * @param pScene Imported scene
+    * @param meshIndex Mesh to pack, see `parts[meshIndex]`
+    * @param bounds Must be extended by every vertex position written
+    *
+    * @note Meshes may be packed concurrently, so implementations must not modify the model
+    */
+    virtual void packMesh(uint8_t* output, const aiScene* pScene, uint32_t meshIndex, Dimension& bounds) const;
 
-    template <typename T>
-    void appendOutput(std::vector<uint8_t>& outputBuffer, const std::vector<T>& v) {
-        auto offset = outputBuffer.size();
-        auto copySize = v.size() * sizeof(T);
-        outputBuffer.resize(offset + copySize);
-        memcpy(outputBuffer.data() + offset, v.data(), copySize);
-    }
+private:
+    // Returns false if `cacheFile` is missing or doesn't match `key`, leaving the model to be loaded through Assimp
+    bool loadFromCache(const Context& context, const std::string& cacheFile, uint64_t key, bool hostCopy, bool positionStream);
+    void saveToCache(const std::string& cacheDirectory,
+                     const std::string& cacheFile,
+                     uint64_t key,
+                     const std::vector<uint8_t>& vertexBuffer,
+                     const void* indexData,
+                     size_t indexSize) const;
 };
 
 }}  // namespace vks::model
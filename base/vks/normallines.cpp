@@ -0,0 +1,111 @@
+#include "normallines.hpp"
+
+#include <stdexcept>
+
+#include "context.hpp"
+#include "shaders.hpp"
+
+using namespace vks::model;
+
+const uint32_t NormalLines::OUTPUT_STRIDE;
+
+namespace {
+
+// Must match the local size of normallines.comp
+const uint32_t GROUP_SIZE = 64;
+
+struct PushConstants {
+    uint32_t vertexCount;
+    float length;
+};
+
+}  // namespace
+
+void NormalLines::create(const vks::Context& context,
+                         const std::string& shaderPath,
+                         const vk::Buffer& vertices,
+                         uint32_t vertexCount,
+                         const SourceLayout& layout) {
+    if ((layout.stride | layout.position | layout.normal) % 4) {
+        throw std::runtime_error("Normal line inputs must be aligned to 4 bytes");
+    }
+    device = context.device;
+    this->vertexCount = vertexCount;
+
+    lines = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer,
+                                       (vk::DeviceSize)lineVertexCount() * OUTPUT_STRIDE);
+
+    std::vector<vk::DescriptorSetLayoutBinding> bindings{
+        { 0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+    };
+    descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)bindings.size(), bindings.data() });
+    vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants) };
+    pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout, 1, &pushConstantRange });
+
+    vk::DescriptorPoolSize poolSize{ vk::DescriptorType::eStorageBuffer, (uint32_t)bindings.size() };
+    descriptorPool = device.createDescriptorPool({ {}, 1, 1, &poolSize });
+    descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+    vk::DescriptorBufferInfo sourceInfo{ vertices, 0, VK_WHOLE_SIZE };
+    vk::DescriptorBufferInfo linesInfo{ lines.buffer, 0, VK_WHOLE_SIZE };
+    std::vector<vk::WriteDescriptorSet> writes{
+        { descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &sourceInfo },
+        { descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &linesInfo },
+    };
+    device.updateDescriptorSets(writes, nullptr);
+
+    // The source layout is baked into the shader, in 32 bit words
+    const uint32_t words[] = { layout.stride / 4, layout.position / 4, layout.normal / 4 };
+    std::vector<vk::SpecializationMapEntry> entries;
+    for (uint32_t i = 0; i < 3; ++i) {
+        entries.emplace_back(i, i * (uint32_t)sizeof(uint32_t), sizeof(uint32_t));
+    }
+    vk::SpecializationInfo specializationInfo{ (uint32_t)entries.size(), entries.data(), sizeof(words), words };
+    vk::ComputePipelineCreateInfo pipelineCreateInfo;
+    pipelineCreateInfo.layout = pipelineLayout;
+    pipelineCreateInfo.stage = shaders::loadShader(device, shaderPath, vk::ShaderStageFlagBits::eCompute);
+    pipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+    pipeline = device.createComputePipeline(context.pipelineCache, pipelineCreateInfo);
+    device.destroyShaderModule(pipelineCreateInfo.stage.module);
+}
+
+void NormalLines::destroy() {
+    if (!device) {
+        return;
+    }
+    device.destroyPipeline(pipeline);
+    device.destroyPipelineLayout(pipelineLayout);
+    device.destroyDescriptorPool(descriptorPool);
+    device.destroyDescriptorSetLayout(descriptorSetLayout);
+    lines.destroy();
+    pipeline = nullptr;
+    pipelineLayout = nullptr;
+    descriptorPool = nullptr;
+    descriptorSetLayout = nullptr;
+    descriptorSet = nullptr;
+    device = nullptr;
+}
+
+void NormalLines::record(const vk::CommandBuffer& commandBuffer, float length) const {
+    if (vertexCount == 0) {
+        return;
+    }
+    // Draws of the previous lines, from earlier submissions too, have to be done before they are overwritten
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eVertexInput, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, nullptr, nullptr);
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
+    const PushConstants pushConstants{ vertexCount, length };
+    commandBuffer.pushConstants<PushConstants>(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushConstants);
+    commandBuffer.dispatch((vertexCount + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+    vk::BufferMemoryBarrier barrier;
+    barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = lines.buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eVertexInput, {}, nullptr, barrier, nullptr);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <vulkan/vulkan.hpp>
+
+#include "buffer.hpp"
+#include "forward.hpp"
+
+namespace vks { namespace model {
+
+// Debug lines along the vertex normals of a mesh, expanded by a compute shader into a line list of two vertices
+// per source vertex, the vertex itself and the end of its normal.  The lines only change with the mesh or their
+// length, so they are generated once rather than every frame, and drawing them is a plain line list draw with no
+// geometry shader, which tile based GPUs run poorly.
+//
+// Draw `lines` as a per vertex stream of OUTPUT_STRIDE bytes (vec3 position), with lineVertexCount() vertices.
+// Even vertices are the bases of the lines and odd ones their tips.
+class NormalLines {
+public:
+    // Where positions and normals are in the source vertices, both three floats.  Offsets and the stride are in
+    // bytes and must be multiples of 4.
+    struct SourceLayout {
+        uint32_t stride{ 0 };
+        uint32_t position{ 0 };
+        uint32_t normal{ 0 };
+    };
+
+    static const uint32_t OUTPUT_STRIDE = 3 * sizeof(float);
+
+    Buffer lines;
+
+    // `vertices` needs storage buffer usage, see ModelCreateInfo::vertexUsage
+    void create(const vks::Context& context, const std::string& shaderPath, const vk::Buffer& vertices, uint32_t vertexCount, const SourceLayout& layout);
+    void destroy();
+
+    uint32_t lineVertexCount() const { return vertexCount * 2; }
+
+    // Generate the lines with normals scaled to `length`, ordered after the vertex input of earlier commands and
+    // before the vertex input of later ones.  Must be recorded outside of a render pass.
+    void record(const vk::CommandBuffer& commandBuffer, float length) const;
+
+private:
+    vk::Device device;
+    uint32_t vertexCount{ 0 };
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::DescriptorPool descriptorPool;
+    vk::DescriptorSet descriptorSet;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline pipeline;
+};
+
+}}  // namespace vks::model
@@ -0,0 +1,346 @@
+#include "occlusion.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "scheduler.hpp"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define VKS_OCCLUSION_AVX 1
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define VKS_OCCLUSION_SSE 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VKS_OCCLUSION_NEON 1
+#endif
+
+using namespace vks;
+
+namespace {
+
+// The operations the coverage of a row of pixels needs, on as many pixels at a time as the target has, as in
+// frustum.cpp
+#if defined(VKS_OCCLUSION_AVX)
+struct Lanes {
+    static const uint32_t WIDTH = 8;
+    using Float = __m256;
+    using Mask = __m256;
+    static Float load(const float* values) { return _mm256_loadu_ps(values); }
+    static Float set(float value) { return _mm256_set1_ps(value); }
+    static Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+    static Mask positive(Float a) { return _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_GT_OQ); }
+    static Mask both(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+    static uint32_t bits(Mask mask) { return (uint32_t)_mm256_movemask_ps(mask); }
+};
+#elif defined(VKS_OCCLUSION_SSE)
+struct Lanes {
+    static const uint32_t WIDTH = 4;
+    using Float = __m128;
+    using Mask = __m128;
+    static Float load(const float* values) { return _mm_loadu_ps(values); }
+    static Float set(float value) { return _mm_set1_ps(value); }
+    static Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+    static Mask positive(Float a) { return _mm_cmpgt_ps(a, _mm_setzero_ps()); }
+    static Mask both(Mask a, Mask b) { return _mm_and_ps(a, b); }
+    static uint32_t bits(Mask mask) { return (uint32_t)_mm_movemask_ps(mask); }
+};
+#elif defined(VKS_OCCLUSION_NEON)
+struct Lanes {
+    static const uint32_t WIDTH = 4;
+    using Float = float32x4_t;
+    using Mask = uint32x4_t;
+    static Float load(const float* values) { return vld1q_f32(values); }
+    static Float set(float value) { return vdupq_n_f32(value); }
+    static Float add(Float a, Float b) { return vaddq_f32(a, b); }
+    static Float mul(Float a, Float b) { return vmulq_f32(a, b); }
+    static Mask positive(Float a) { return vcgtq_f32(a, vdupq_n_f32(0.0f)); }
+    static Mask both(Mask a, Mask b) { return vandq_u32(a, b); }
+    static uint32_t bits(Mask mask) {
+        static const uint32_t weights[4] = { 1, 2, 4, 8 };
+        const uint32x4_t weighted = vandq_u32(mask, vld1q_u32(weights));
+        return vgetq_lane_u32(weighted, 0) | vgetq_lane_u32(weighted, 1) | vgetq_lane_u32(weighted, 2) | vgetq_lane_u32(weighted, 3);
+    }
+};
+#else
+struct Lanes {
+    static const uint32_t WIDTH = 1;
+    using Float = float;
+    using Mask = bool;
+    static Float load(const float* values) { return *values; }
+    static Float set(float value) { return value; }
+    static Float add(Float a, Float b) { return a + b; }
+    static Float mul(Float a, Float b) { return a * b; }
+    static Mask positive(Float a) { return a > 0.0f; }
+    static Mask both(Mask a, Mask b) { return a && b; }
+    static uint32_t bits(Mask mask) { return mask ? 1 : 0; }
+};
+#endif
+
+static_assert(OcclusionBuffer::TILE_WIDTH == 8 && OcclusionBuffer::TILE_HEIGHT == 8, "A tile's mask is 8 rows of 8 bits");
+
+const uint64_t FULL_MASK = ~0ull;
+// Vertices closer to the eye plane than this, in clip space w, take their triangle out of the occluders
+const float MIN_W = 1e-4f;
+
+// Pixel centers within a row of a tile
+const float PIXEL_CENTERS[8] = { 0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f };
+
+// The bits of columns [first, last] of a row of a tile
+inline uint32_t columnBits(uint32_t first, uint32_t last) {
+    return (0xFFu >> (7 - (last - first))) << first;
+}
+
+}  // namespace
+
+void OcclusionBuffer::resize(uint32_t width, uint32_t height) {
+    tilesX = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+    tilesY = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    tiles.resize(tilesX * tilesY);
+    rowBins.resize(tilesY);
+    begin(viewProjection);
+}
+
+void OcclusionBuffer::begin(const glm::mat4& matrix) {
+    viewProjection = matrix;
+    std::fill(tiles.begin(), tiles.end(), Tile{ 0, FLT_MAX, -FLT_MAX });
+    triangles.clear();
+    for (auto& bin : rowBins) {
+        bin.clear();
+    }
+    frameStats = {};
+}
+
+void OcclusionBuffer::addOccluder(const glm::mat4& model, const glm::vec3* positions, size_t vertexCount, const uint32_t* indices, size_t indexCount) {
+    if (!tilesX || !tilesY) {
+        return;
+    }
+    const glm::mat4 matrix = viewProjection * model;
+    const float screenWidth = float(width());
+    const float screenHeight = float(height());
+    std::vector<glm::vec4> clip(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i) {
+        clip[i] = matrix * glm::vec4(positions[i], 1.0f);
+    }
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        Triangle triangle;
+        bool behind = false;
+        for (uint32_t corner = 0; corner < 3; ++corner) {
+            const glm::vec4& position = clip[indices[i + corner]];
+            if (position.w < MIN_W) {
+                behind = true;
+                break;
+            }
+            const float inverseW = 1.0f / position.w;
+            triangle.v[corner] = glm::vec3((position.x * inverseW * 0.5f + 0.5f) * screenWidth, (position.y * inverseW * 0.5f + 0.5f) * screenHeight,
+                                           position.z * inverseW);
+        }
+        if (behind) {
+            ++frameStats.rejected;
+            continue;
+        }
+
+        // Wound so that the edge functions are positive inside, whichever way the triangle faces
+        const glm::vec3& a = triangle.v[0];
+        const float area = (triangle.v[1].x - a.x) * (triangle.v[2].y - a.y) - (triangle.v[1].y - a.y) * (triangle.v[2].x - a.x);
+        if (!(std::abs(area) > 1e-6f)) {
+            ++frameStats.rejected;
+            continue;
+        }
+        if (area < 0.0f) {
+            std::swap(triangle.v[1], triangle.v[2]);
+        }
+
+        const float minX = std::min({ triangle.v[0].x, triangle.v[1].x, triangle.v[2].x });
+        const float maxX = std::max({ triangle.v[0].x, triangle.v[1].x, triangle.v[2].x });
+        const float minY = std::min({ triangle.v[0].y, triangle.v[1].y, triangle.v[2].y });
+        const float maxY = std::max({ triangle.v[0].y, triangle.v[1].y, triangle.v[2].y });
+        if (maxX < 0.0f || maxY < 0.0f || minX >= screenWidth || minY >= screenHeight) {
+            continue;
+        }
+        const uint32_t firstRow = static_cast<uint32_t>(std::max(minY, 0.0f)) / TILE_HEIGHT;
+        const uint32_t lastRow = static_cast<uint32_t>(std::min(maxY, screenHeight - 1.0f)) / TILE_HEIGHT;
+        const uint32_t index = static_cast<uint32_t>(triangles.size());
+        triangles.push_back(triangle);
+        for (uint32_t row = firstRow; row <= lastRow; ++row) {
+            rowBins[row].push_back(index);
+        }
+        ++frameStats.triangles;
+    }
+}
+
+void OcclusionBuffer::rasterize(const Triangle& triangle, uint32_t tileY) {
+    const glm::vec3* v = triangle.v;
+    // Edge functions A x + B y + C, positive inside
+    float edgeA[3], edgeB[3], edgeC[3];
+    for (uint32_t edge = 0; edge < 3; ++edge) {
+        const glm::vec3& p = v[edge];
+        const glm::vec3& q = v[(edge + 1) % 3];
+        edgeA[edge] = p.y - q.y;
+        edgeB[edge] = q.x - p.x;
+        edgeC[edge] = -(edgeA[edge] * p.x + edgeB[edge] * p.y);
+    }
+    // Depth as a plane over the screen, to bound it within a tile
+    const glm::vec3 normal = glm::cross(v[1] - v[0], v[2] - v[0]);
+    const float depthA = -normal.x / normal.z;
+    const float depthB = -normal.y / normal.z;
+    const float depthC = v[0].z - depthA * v[0].x - depthB * v[0].y;
+    const float triangleMinZ = std::min({ v[0].z, v[1].z, v[2].z });
+    const float triangleMaxZ = std::max({ v[0].z, v[1].z, v[2].z });
+
+    const float minX = std::max(std::min({ v[0].x, v[1].x, v[2].x }), 0.0f);
+    const float maxX = std::min(std::max({ v[0].x, v[1].x, v[2].x }), float(width()));
+    const float minY = std::max(std::min({ v[0].y, v[1].y, v[2].y }), float(tileY * TILE_HEIGHT));
+    const float maxY = std::min(std::max({ v[0].y, v[1].y, v[2].y }), float((tileY + 1) * TILE_HEIGHT));
+    if (minX >= maxX || minY >= maxY) {
+        return;
+    }
+    const uint32_t firstTile = static_cast<uint32_t>(minX) / TILE_WIDTH;
+    const uint32_t lastTile = std::min(static_cast<uint32_t>(maxX) / TILE_WIDTH, tilesX - 1);
+    const uint32_t firstRow = static_cast<uint32_t>(minY) - tileY * TILE_HEIGHT;
+    const uint32_t lastRow = std::min(static_cast<uint32_t>(maxY) - tileY * TILE_HEIGHT, TILE_HEIGHT - 1);
+
+    for (uint32_t tileX = firstTile; tileX <= lastTile; ++tileX) {
+        Tile& tile = tiles[tileY * tilesX + tileX];
+        // Entirely behind what the tile already has
+        if (triangleMinZ >= tile.zMax0) {
+            continue;
+        }
+
+        const float x0 = float(tileX * TILE_WIDTH);
+        const Lanes::Float a0 = Lanes::set(edgeA[0]), a1 = Lanes::set(edgeA[1]), a2 = Lanes::set(edgeA[2]);
+        uint64_t coverage = 0;
+        for (uint32_t row = firstRow; row <= lastRow; ++row) {
+            const float y = float(tileY * TILE_HEIGHT + row) + 0.5f;
+            const Lanes::Float c0 = Lanes::set(edgeB[0] * y + edgeC[0]);
+            const Lanes::Float c1 = Lanes::set(edgeB[1] * y + edgeC[1]);
+            const Lanes::Float c2 = Lanes::set(edgeB[2] * y + edgeC[2]);
+            uint32_t rowBits = 0;
+            for (uint32_t column = 0; column < TILE_WIDTH; column += Lanes::WIDTH) {
+                const Lanes::Float x = Lanes::add(Lanes::set(x0), Lanes::load(PIXEL_CENTERS + column));
+                const Lanes::Mask inside0 = Lanes::positive(Lanes::add(Lanes::mul(a0, x), c0));
+                const Lanes::Mask inside1 = Lanes::positive(Lanes::add(Lanes::mul(a1, x), c1));
+                const Lanes::Mask inside2 = Lanes::positive(Lanes::add(Lanes::mul(a2, x), c2));
+                const Lanes::Mask inside = Lanes::both(Lanes::both(inside0, inside1), inside2);
+                rowBits |= Lanes::bits(inside) << column;
+            }
+            coverage |= uint64_t(rowBits) << (row * TILE_WIDTH);
+        }
+        if (!coverage) {
+            continue;
+        }
+
+        // The deepest the triangle gets within the tile: its plane at the corners of where the tile and the triangle's
+        // bounds overlap, and never deeper than its deepest vertex
+        const float cornerX0 = std::max(x0, minX), cornerX1 = std::min(x0 + float(TILE_WIDTH), maxX);
+        const float cornerY0 = minY, cornerY1 = maxY;
+        float depth = -FLT_MAX;
+        for (float cornerX : { cornerX0, cornerX1 }) {
+            for (float cornerY : { cornerY0, cornerY1 }) {
+                depth = std::max(depth, depthA * cornerX + depthB * cornerY + depthC);
+            }
+        }
+        depth = std::min(depth, triangleMaxZ);
+
+        if (tile.mask == 0) {
+            tile.zMax1 = depth;
+            tile.mask = coverage;
+        } else if (tile.zMax1 - depth > tile.zMax0 - tile.zMax1) {
+            // Much nearer than the working layer, which is discarded rather than merged into a layer as deep as it
+            tile.zMax1 = depth;
+            tile.mask = coverage;
+        } else {
+            tile.zMax1 = std::max(tile.zMax1, depth);
+            tile.mask |= coverage;
+        }
+        if (tile.mask == FULL_MASK) {
+            tile.zMax0 = std::min(tile.zMax0, tile.zMax1);
+            tile.mask = 0;
+        }
+    }
+}
+
+void OcclusionBuffer::render(TaskScheduler* scheduler) {
+    auto renderRows = [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; ++row) {
+            for (uint32_t index : rowBins[row]) {
+                rasterize(triangles[index], static_cast<uint32_t>(row));
+            }
+        }
+    };
+    if (scheduler) {
+        scheduler->parallelFor(0, tilesY, 1, renderRows);
+    } else {
+        renderRows(0, tilesY);
+    }
+}
+
+bool OcclusionBuffer::testBox(const glm::vec3& min, const glm::vec3& max) const {
+    const float screenWidth = float(width());
+    const float screenHeight = float(height());
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, minZ = FLT_MAX;
+    for (uint32_t corner = 0; corner < 8; ++corner) {
+        const glm::vec4 position{ corner & 1 ? max.x : min.x, corner & 2 ? max.y : min.y, corner & 4 ? max.z : min.z, 1.0f };
+        const glm::vec4 clip = viewProjection * position;
+        if (clip.w < MIN_W) {
+            return true;
+        }
+        const float inverseW = 1.0f / clip.w;
+        const float x = (clip.x * inverseW * 0.5f + 0.5f) * screenWidth;
+        const float y = (clip.y * inverseW * 0.5f + 0.5f) * screenHeight;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        minZ = std::min(minZ, clip.z * inverseW);
+    }
+    // Off screen, which is for the frustum test to decide
+    if (maxX < 0.0f || maxY < 0.0f || minX >= screenWidth || minY >= screenHeight) {
+        return true;
+    }
+    // Every pixel the box touches
+    const uint32_t pixelX0 = static_cast<uint32_t>(std::max(minX, 0.0f));
+    const uint32_t pixelY0 = static_cast<uint32_t>(std::max(minY, 0.0f));
+    const uint32_t pixelX1 = static_cast<uint32_t>(std::min(maxX, screenWidth - 1.0f));
+    const uint32_t pixelY1 = static_cast<uint32_t>(std::min(maxY, screenHeight - 1.0f));
+
+    for (uint32_t tileY = pixelY0 / TILE_HEIGHT; tileY <= pixelY1 / TILE_HEIGHT; ++tileY) {
+        const uint32_t firstRow = std::max(pixelY0, tileY * TILE_HEIGHT) - tileY * TILE_HEIGHT;
+        const uint32_t lastRow = std::min(pixelY1, tileY * TILE_HEIGHT + TILE_HEIGHT - 1) - tileY * TILE_HEIGHT;
+        for (uint32_t tileX = pixelX0 / TILE_WIDTH; tileX <= pixelX1 / TILE_WIDTH; ++tileX) {
+            const Tile& tile = tiles[tileY * tilesX + tileX];
+            if (minZ > tile.zMax0) {
+                continue;
+            }
+            if (tile.mask && minZ > tile.zMax1) {
+                const uint32_t firstColumn = std::max(pixelX0, tileX * TILE_WIDTH) - tileX * TILE_WIDTH;
+                const uint32_t lastColumn = std::min(pixelX1, tileX * TILE_WIDTH + TILE_WIDTH - 1) - tileX * TILE_WIDTH;
+                const uint64_t rowMask = columnBits(firstColumn, lastColumn);
+                uint64_t rect = 0;
+                for (uint32_t row = firstRow; row <= lastRow; ++row) {
+                    rect |= rowMask << (row * TILE_WIDTH);
+                }
+                if ((rect & ~tile.mask) == 0) {
+                    continue;
+                }
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t OcclusionBuffer::cullBoxes(const Frustum& frustum, const BoxArray& boxes, std::vector<uint32_t>& visible, size_t first, size_t last) const {
+    const size_t offset = visible.size();
+    frustum.cullBoxes(boxes, visible, first, last);
+    auto end = std::remove_if(visible.begin() + offset, visible.end(), [&](uint32_t index) {
+        return !testBox({ boxes.minX[index], boxes.minY[index], boxes.minZ[index] }, { boxes.maxX[index], boxes.maxY[index], boxes.maxZ[index] });
+    });
+    visible.erase(end, visible.end());
+    return visible.size() - offset;
+}
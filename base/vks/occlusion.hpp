@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+
+namespace vks {
+class TaskScheduler;
+
+// Software occlusion culling for paths that record their draws on the CPU: a handful of low poly occluders are
+// rasterized into a coarse depth buffer, which the bounding boxes of objects are then tested against before anything
+// about them is recorded.
+//
+// The buffer is masked in the sense of Andersson et al., "Masked Software Occlusion Culling": rather than a depth per
+// pixel, every tile of TILE_WIDTH x TILE_HEIGHT pixels has a coverage mask and two depths.  All pixels of a tile are
+// at most zMax0 deep, and the pixels in the mask at most zMax1, which is merged into zMax0 once the mask is full.
+// Coverage is found for a row of a tile at a time, as wide as the target's SIMD (AVX, SSE or NEON) allows.
+//
+// Depths are z / w after the view projection, so they only need to increase with distance, whatever the depth range
+// convention.  Triangles reaching behind the near plane are left out rather than clipped, which only means fewer
+// occluders.  Coverage is sampled at pixel centers, so at the coarse resolution this is meant for, a sliver of an
+// object next to an occluder's edge can be culled.
+class OcclusionBuffer {
+public:
+    static const uint32_t TILE_WIDTH = 8;
+    static const uint32_t TILE_HEIGHT = 8;
+
+    struct Stats {
+        // Occluder triangles rasterized, and those left out for crossing the near plane or having no area
+        uint32_t triangles{ 0 };
+        uint32_t rejected{ 0 };
+    };
+
+    // Rounded up to whole tiles
+    void resize(uint32_t width, uint32_t height);
+    uint32_t width() const { return tilesX * TILE_WIDTH; }
+    uint32_t height() const { return tilesY * TILE_HEIGHT; }
+
+    // Clear the buffer and the queued occluders for a new view
+    void begin(const glm::mat4& viewProjection);
+    // Queue the triangles of an occluder, transformed to the screen right away
+    void addOccluder(const glm::mat4& model, const glm::vec3* positions, size_t vertexCount, const uint32_t* indices, size_t indexCount);
+    // Rasterize the queued occluders, tile rows spread over `scheduler` if there is one.  Every tile only sees the
+    // triangles in the order they were added, so the result doesn't depend on the number of threads.
+    void render(TaskScheduler* scheduler = nullptr);
+
+    // Whether any part of the world space box may be visible past the occluders.  Boxes reaching behind the near
+    // plane always are.
+    bool testBox(const glm::vec3& min, const glm::vec3& max) const;
+    // Frustum::cullBoxes followed by testBox for the boxes inside the frustum, with the same output
+    size_t cullBoxes(const Frustum& frustum, const BoxArray& boxes, std::vector<uint32_t>& visible, size_t first = 0, size_t last = SIZE_MAX) const;
+
+    const Stats& stats() const { return frameStats; }
+
+private:
+    struct Tile {
+        uint64_t mask;
+        float zMax0;
+        float zMax1;
+    };
+
+    // Screen space vertices, with z the depth
+    struct Triangle {
+        glm::vec3 v[3];
+    };
+
+    void rasterize(const Triangle& triangle, uint32_t tileY);
+
+    uint32_t tilesX{ 0 };
+    uint32_t tilesY{ 0 };
+    glm::mat4 viewProjection;
+    std::vector<Tile> tiles;
+    std::vector<Triangle> triangles;
+    // The triangles overlapping each row of tiles
+    std::vector<std::vector<uint32_t>> rowBins;
+    Stats frameStats;
+};
+
+}  // namespace vks
@@ -2,6 +2,7 @@
 
 #include "context.hpp"
 #include "framebuffer.hpp"
+#include "pipelines.hpp"
 
 namespace vkx {
 
@@ -28,6 +29,26 @@ struct OffscreenRenderer {
     vk::SubmitInfo submitInfo;
     vk::ImageUsageFlags attachmentUsage{ vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eInputAttachment };
     vk::DescriptorPool descriptorPool;
+    // Views rendered in a single pass with VK_KHR_multiview, one per layer of the attachments, each the size of
+    // framebufferSize.  More than one requires Context::multiviewEnabled.
+    uint32_t viewCount{ 1 };
+
+    // Fixed foveated rendering with VK_NV_shading_rate_image, which shades the periphery of every view, where lenses
+    // spread the pixels out anyway, coarser than its center.  Needs Context::shadingRateImageEnabled, see foveated().
+    // Set before prepare(), pipelines enable it with applyFoveation and command buffers with bindFoveation.
+    struct Foveation {
+        bool enabled{ false };
+        // Views side by side in every layer of the attachments
+        uint32_t columns{ 1 };
+        // Centers of the views, of the layers or else the columns, in [0, 1] across the view.  Lens centers usually
+        // sit a little towards the nose
+        std::array<glm::vec2, 2> centers{ { glm::vec2{ 0.5f }, glm::vec2{ 0.5f } } };
+        // Distances from the center, relative to half the extent of the view, out to which fragments are shaded at
+        // full rate, once per 2x2 and once per 4x2 pixels.  Beyond the last they are shaded once per 4x4 pixels.
+        glm::vec3 radii{ 0.45f, 0.75f, 1.05f };
+    } foveation;
+    // Palette index of every shading rate texel, one layer per view
+    vks::Image shadingRateImage;
 
     OffscreenRenderer(const vks::Context& context)
         : context(context)
@@ -39,6 +60,7 @@ struct OffscreenRenderer {
         queue.waitIdle();
         device.waitIdle();
         framebuffer.destroy();
+        shadingRateImage.destroy();
         device.destroyRenderPass(renderPass);
         device.destroySemaphore(semaphores.renderComplete);
         device.destroySemaphore(semaphores.renderStart);
@@ -51,12 +73,101 @@ struct OffscreenRenderer {
         prepareRenderPass();
         prepareFramebuffer();
         prepareSampler();
+        if (foveated()) {
+            prepareFoveation();
+        }
+    }
+
+    bool foveated() const { return foveation.enabled && context.shadingRateImageEnabled; }
+
+    void prepareFoveation() {
+        const auto& texelSize = context.shadingRateImageProperties.shadingRateTexelSize;
+        const glm::uvec2 size{ (framebufferSize.x + texelSize.width - 1) / texelSize.width, (framebufferSize.y + texelSize.height - 1) / texelSize.height };
+        const uint32_t paletteSize = std::min((uint32_t)shadingRatePaletteEntries.size(), context.shadingRateImageProperties.shadingRatePaletteSize);
+        const float columnWidth = (float)size.x / (float)foveation.columns;
+        std::vector<uint8_t> rates;
+        rates.reserve(size.x * size.y * viewCount);
+        for (uint32_t layer = 0; layer < viewCount; ++layer) {
+            for (uint32_t y = 0; y < size.y; ++y) {
+                for (uint32_t x = 0; x < size.x; ++x) {
+                    const uint32_t column = std::min((uint32_t)((float)x / columnWidth), foveation.columns - 1);
+                    const glm::vec2& center = foveation.centers[std::min(layer + column, 1u)];
+                    const glm::vec2 position{ ((float)x + 0.5f) / columnWidth - (float)column, ((float)y + 0.5f) / (float)size.y };
+                    const float distance = glm::length(position - center) * 2.0f;
+                    uint32_t rate = 3;
+                    for (uint32_t i = 0; i < 3; ++i) {
+                        if (distance < foveation.radii[i]) {
+                            rate = i;
+                            break;
+                        }
+                    }
+                    rates.push_back((uint8_t)std::min(rate, paletteSize - 1));
+                }
+            }
+        }
+
+        vk::ImageCreateInfo imageCreateInfo;
+        imageCreateInfo.imageType = vk::ImageType::e2D;
+        imageCreateInfo.format = vk::Format::eR8Uint;
+        imageCreateInfo.extent = vk::Extent3D{ size.x, size.y, 1 };
+        imageCreateInfo.mipLevels = 1;
+        imageCreateInfo.arrayLayers = viewCount;
+        imageCreateInfo.usage = vk::ImageUsageFlagBits::eShadingRateImageNV | vk::ImageUsageFlagBits::eTransferDst;
+        shadingRateImage = context.createImage(imageCreateInfo);
+        const vk::ImageSubresourceRange range{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, viewCount };
+        auto recordCopy = [&](const vk::CommandBuffer& copyCmd, const vk::Buffer& staging, vk::DeviceSize stagingOffset) {
+            context.setImageLayout(copyCmd, shadingRateImage.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, range);
+            vk::BufferImageCopy region;
+            region.bufferOffset = stagingOffset;
+            region.imageSubresource = { vk::ImageAspectFlagBits::eColor, 0, 0, viewCount };
+            region.imageExtent = imageCreateInfo.extent;
+            copyCmd.copyBufferToImage(staging, shadingRateImage.image, vk::ImageLayout::eTransferDstOptimal, region);
+            context.setImageLayout(copyCmd, shadingRateImage.image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShadingRateOptimalNV, range);
+        };
+        context.stageUpload(rates.size(), rates.data(), context.getImageStagingAlignment(), recordCopy);
+
+        vk::ImageViewCreateInfo viewCreateInfo;
+        viewCreateInfo.image = shadingRateImage.image;
+        viewCreateInfo.viewType = viewCount > 1 ? vk::ImageViewType::e2DArray : vk::ImageViewType::e2D;
+        viewCreateInfo.format = imageCreateInfo.format;
+        viewCreateInfo.subresourceRange = range;
+        shadingRateImage.view = device.createImageView(viewCreateInfo);
     }
 
+    // Shade the viewports of pipelines built with `builder` at the rates of the shading rate image, when foveated
+    void applyFoveation(vks::pipelines::GraphicsPipelineBuilder& builder, uint32_t viewportCount = 1) {
+        if (!foveated()) {
+            return;
+        }
+        const uint32_t paletteSize = std::min((uint32_t)shadingRatePaletteEntries.size(), context.shadingRateImageProperties.shadingRatePaletteSize);
+        shadingRatePalettes.assign(viewportCount, vk::ShadingRatePaletteNV{ paletteSize, shadingRatePaletteEntries.data() });
+        shadingRateState.shadingRateImageEnable = VK_TRUE;
+        shadingRateState.viewportCount = viewportCount;
+        shadingRateState.pShadingRatePalettes = shadingRatePalettes.data();
+        builder.viewportState.pNext = &shadingRateState;
+    }
+
+    // Bind the shading rate image for the draws of pipelines foveated with applyFoveation
+    void bindFoveation(const vk::CommandBuffer& commandBuffer) const {
+        if (foveated()) {
+            commandBuffer.bindShadingRateImageNV(shadingRateImage.view, vk::ImageLayout::eShadingRateOptimalNV, context.dynamicDispatch);
+        }
+    }
+
+private:
+    // Indexed by the values of the shading rate image, from the center of a view out
+    std::array<vk::ShadingRatePaletteEntryNV, 4> shadingRatePaletteEntries{ { vk::ShadingRatePaletteEntryNV::e1InvocationPerPixel,
+                                                                               vk::ShadingRatePaletteEntryNV::e1InvocationPer2x2Pixels,
+                                                                               vk::ShadingRatePaletteEntryNV::e1InvocationPer4x2Pixels,
+                                                                               vk::ShadingRatePaletteEntryNV::e1InvocationPer4x4Pixels } };
+    std::vector<vk::ShadingRatePaletteNV> shadingRatePalettes;
+    vk::PipelineViewportShadingRateImageStateCreateInfoNV shadingRateState;
+
+public:
     void prepareFramebuffer() {
         assert(framebufferSize != glm::uvec2());
         depthFormat = context.getSupportedDepthFormat();
-        framebuffer.create(context, framebufferSize, colorFormats, depthFormat, renderPass, attachmentUsage);
+        framebuffer.create(context, framebufferSize, colorFormats, depthFormat, renderPass, attachmentUsage, {}, viewCount);
     }
 
     void prepareSampler() {
@@ -75,7 +186,7 @@ struct OffscreenRenderer {
         sampler.maxLod = 0.0f;
         sampler.borderColor = vk::BorderColor::eFloatOpaqueWhite;
         for (auto& color : framebuffer.colors) {
-            color.sampler = device.createSampler(sampler);
+            color.sampler = vks::acquireSampler(device, sampler);
         }
     }
 
@@ -146,7 +257,19 @@ struct OffscreenRenderer {
             device.destroyRenderPass(renderPass);
         }
 
+        // The subpass renders every view, all correlated as they typically see nearly the same geometry
+        const uint32_t viewMask = (1u << viewCount) - 1;
+        vk::RenderPassMultiviewCreateInfo multiviewInfo;
+        multiviewInfo.subpassCount = 1;
+        multiviewInfo.pViewMasks = &viewMask;
+        multiviewInfo.correlationMaskCount = 1;
+        multiviewInfo.pCorrelationMasks = &viewMask;
+
         vk::RenderPassCreateInfo renderPassInfo;
+        if (viewCount > 1) {
+            assert(context.multiviewEnabled);
+            renderPassInfo.pNext = &multiviewInfo;
+        }
         renderPassInfo.attachmentCount = (uint32_t)attachments.size();
         renderPassInfo.pAttachments = attachments.data();
         renderPassInfo.subpassCount = (uint32_t)subpasses.size();
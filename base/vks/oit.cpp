@@ -0,0 +1,318 @@
+#include "oit.hpp"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include "barriers.hpp"
+#include "context.hpp"
+#include "helpers.hpp"
+
+using namespace vks;
+
+const uint32_t OrderIndependentTransparency::MAX_FRAGMENTS;
+
+namespace {
+
+const vk::Format ACCUMULATION_FORMAT = vk::Format::eR16G16B16A16Sfloat;
+const vk::Format REVEALAGE_FORMAT = vk::Format::eR16G16B16A16Sfloat;
+
+// Must match the Nodes block of oit.glsl: the node count and capacity, padded to the size of a node, then the nodes
+const vk::DeviceSize NODE_SIZE = 16;
+const vk::DeviceSize NODES_HEADER = 16;
+
+}  // namespace
+
+bool OrderIndependentTransparency::linkedListSupported(const vks::Context& context) {
+    return context.enabledFeatures.fragmentStoresAndAtomics == VK_TRUE;
+}
+
+void OrderIndependentTransparency::create(const vks::Context& context,
+                                          const std::string& assetPath,
+                                          const vk::Extent2D& extent,
+                                          vk::Format depthFormat,
+                                          const vk::RenderPass& compositeRenderPass,
+                                          uint32_t compositeSubpass) {
+    this->context = &context;
+    device = context.device;
+    size = extent;
+    this->depthFormat = depthFormat;
+    listSupported = linkedListSupported(context);
+
+    // The targets start out cleared every frame, and what the transparent draws left in them is read by the composite
+    std::vector<vk::AttachmentDescription> attachments(3);
+    attachments[0].format = ACCUMULATION_FORMAT;
+    attachments[1].format = REVEALAGE_FORMAT;
+    for (uint32_t i = 0; i < 2; ++i) {
+        attachments[i].loadOp = vk::AttachmentLoadOp::eClear;
+        attachments[i].storeOp = vk::AttachmentStoreOp::eStore;
+        attachments[i].finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+    }
+    attachments[2].format = depthFormat;
+    attachments[2].loadOp = vk::AttachmentLoadOp::eClear;
+    attachments[2].storeOp = vk::AttachmentStoreOp::eDontCare;
+    attachments[2].finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+    const vk::AttachmentReference colorReferences[2]{
+        { 0, vk::ImageLayout::eColorAttachmentOptimal },
+        { 1, vk::ImageLayout::eColorAttachmentOptimal },
+    };
+    const vk::AttachmentReference depthReference{ 2, vk::ImageLayout::eDepthStencilAttachmentOptimal };
+    vk::SubpassDescription subpass;
+    subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+    subpass.colorAttachmentCount = 2;
+    subpass.pColorAttachments = colorReferences;
+    subpass.pDepthStencilAttachment = &depthReference;
+
+    using Stage = vk::PipelineStageFlagBits;
+    using Access = vk::AccessFlagBits;
+    // The previous frame's composite read the targets, and this frame's reads what the subpass wrote to them, to
+    // the linked list included
+    const std::vector<vk::SubpassDependency> dependencies{
+        { VK_SUBPASS_EXTERNAL, 0, Stage::eFragmentShader, Stage::eColorAttachmentOutput | Stage::eEarlyFragmentTests, Access::eShaderRead,
+          Access::eColorAttachmentWrite | Access::eDepthStencilAttachmentWrite, vk::DependencyFlagBits::eByRegion },
+        { 0, VK_SUBPASS_EXTERNAL, Stage::eColorAttachmentOutput | Stage::eFragmentShader, Stage::eFragmentShader,
+          Access::eColorAttachmentWrite | Access::eShaderWrite, Access::eShaderRead, vk::DependencyFlagBits::eByRegion },
+    };
+    renderPass = device.createRenderPass({ {}, (uint32_t)attachments.size(), attachments.data(), 1, &subpass, (uint32_t)dependencies.size(),
+                                           dependencies.data() });
+
+    std::vector<vk::DescriptorSetLayoutBinding> bindings{
+        { 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
+        { 1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
+    };
+    compositeSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)bindings.size(), bindings.data() });
+    bindings = {
+        { 0, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eFragment },
+        { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment },
+    };
+    listSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)bindings.size(), bindings.data() });
+    const vk::DescriptorSetLayout setLayouts[2]{ compositeSetLayout, listSetLayout };
+    compositeLayout = device.createPipelineLayout({ {}, listSupported ? 2u : 1u, setLayouts });
+
+    // A full screen triangle, the colors of which come premultiplied with what's left of the scene behind them in
+    // alpha
+    using BF = vk::BlendFactor;
+    using BO = vk::BlendOp;
+    pipelines::GraphicsPipelineBuilder builder{ device, compositeLayout, compositeRenderPass };
+    builder.subpass = compositeSubpass;
+    builder.rasterizationState.cullMode = vk::CullModeFlagBits::eNone;
+    builder.depthStencilState = false;
+    builder.colorBlendState.blendAttachmentStates[0] = { VK_TRUE, BF::eOne, BF::eSrcAlpha, BO::eAdd, BF::eZero, BF::eOne, BO::eAdd };
+    builder.loadShader(assetPath + "shaders/base/oit_composite.vert.spv", vk::ShaderStageFlagBits::eVertex);
+    builder.loadShader(assetPath + "shaders/base/oit_composite.frag.spv", vk::ShaderStageFlagBits::eFragment);
+    compositePipelines.weightedBlended = builder.create(context.pipelineCache);
+    if (listSupported) {
+        builder.destroyShaderModules();
+        builder.loadShader(assetPath + "shaders/base/oit_composite.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        builder.loadShader(assetPath + "shaders/base/oit_composite_list.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        compositePipelines.linkedList = builder.create(context.pipelineCache);
+    }
+
+    createTargets();
+}
+
+void OrderIndependentTransparency::createTargets() {
+    vk::ImageCreateInfo imageCreateInfo;
+    imageCreateInfo.imageType = vk::ImageType::e2D;
+    imageCreateInfo.extent = vk::Extent3D{ size.width, size.height, 1 };
+    imageCreateInfo.mipLevels = 1;
+    imageCreateInfo.arrayLayers = 1;
+    vk::ImageViewCreateInfo viewCreateInfo;
+    viewCreateInfo.viewType = vk::ImageViewType::e2D;
+    viewCreateInfo.subresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
+    // The composite fetches, it never filters
+    vk::SamplerCreateInfo samplerCreateInfo;
+    samplerCreateInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+    samplerCreateInfo.addressModeV = samplerCreateInfo.addressModeU;
+    samplerCreateInfo.addressModeW = samplerCreateInfo.addressModeU;
+
+    const auto createTarget = [&](vk::Format format, const vk::ImageUsageFlags& usage) {
+        imageCreateInfo.format = format;
+        imageCreateInfo.usage = usage;
+        vks::Image result = context->createImage(imageCreateInfo);
+        viewCreateInfo.image = result.image;
+        viewCreateInfo.format = format;
+        result.view = device.createImageView(viewCreateInfo);
+        return result;
+    };
+    const vk::ImageUsageFlags colorUsage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled;
+    accumulation = createTarget(ACCUMULATION_FORMAT, colorUsage);
+    accumulation.sampler = acquireSampler(device, samplerCreateInfo);
+    revealage = createTarget(REVEALAGE_FORMAT, colorUsage);
+    revealage.sampler = acquireSampler(device, samplerCreateInfo);
+    // Only the occluders and transparent draws of the render pass test against it
+    vk::ImageCreateInfo depthCreateInfo{ imageCreateInfo };
+    depthCreateInfo.format = depthFormat;
+    depthCreateInfo.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
+    depth = context->createTransientImage(depthCreateInfo);
+    vk::ImageViewCreateInfo depthViewCreateInfo{ viewCreateInfo };
+    depthViewCreateInfo.image = depth.image;
+    depthViewCreateInfo.format = depthFormat;
+    depthViewCreateInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth;
+    depth.view = device.createImageView(depthViewCreateInfo);
+
+    const vk::ImageView views[3]{ accumulation.view, revealage.view, depth.view };
+    framebuffer = device.createFramebuffer({ {}, renderPass, 3, views, size.width, size.height, 1 });
+
+    uint32_t poolSets = 1;
+    std::vector<vk::DescriptorPoolSize> poolSizes{ { vk::DescriptorType::eCombinedImageSampler, 2 } };
+    if (listSupported) {
+        heads = createTarget(vk::Format::eR32Uint, vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferDst);
+        // Stays in General, begin clears it and the fragment shaders read and write it
+        context->withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+            context->setImageLayout(commandBuffer, heads.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+        });
+        nodeCapacity = size.width * size.height * std::max(nodesPerPixel, 1u);
+        nodes = context->createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                            NODES_HEADER + NODE_SIZE * nodeCapacity);
+        ++poolSets;
+        poolSizes.push_back({ vk::DescriptorType::eStorageImage, 1 });
+        poolSizes.push_back({ vk::DescriptorType::eStorageBuffer, 1 });
+    }
+    descriptorPool = device.createDescriptorPool({ {}, poolSets, (uint32_t)poolSizes.size(), poolSizes.data() });
+
+    compositeSet = device.allocateDescriptorSets({ descriptorPool, 1, &compositeSetLayout })[0];
+    const vk::DescriptorImageInfo accumulationInfo{ accumulation.sampler, accumulation.view, vk::ImageLayout::eShaderReadOnlyOptimal };
+    const vk::DescriptorImageInfo revealageInfo{ revealage.sampler, revealage.view, vk::ImageLayout::eShaderReadOnlyOptimal };
+    const vk::DescriptorImageInfo headsInfo{ nullptr, heads.view, vk::ImageLayout::eGeneral };
+    std::vector<vk::WriteDescriptorSet> writes{
+        { compositeSet, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &accumulationInfo },
+        { compositeSet, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &revealageInfo },
+    };
+    if (listSupported) {
+        listSet = device.allocateDescriptorSets({ descriptorPool, 1, &listSetLayout })[0];
+        writes.push_back({ listSet, 0, 0, 1, vk::DescriptorType::eStorageImage, &headsInfo });
+        writes.push_back({ listSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &nodes.descriptor });
+    }
+    device.updateDescriptorSets(writes, nullptr);
+}
+
+void OrderIndependentTransparency::destroyTargets(bool deferred) {
+    if (deferred) {
+        context->trash(framebuffer);
+        context->trash(descriptorPool);
+        context->trash(accumulation);
+        context->trash(revealage);
+        context->trash(depth);
+        context->trash(heads);
+        context->trash(nodes);
+    } else {
+        device.destroyFramebuffer(framebuffer);
+        device.destroyDescriptorPool(descriptorPool);
+        accumulation.destroy();
+        revealage.destroy();
+        depth.destroy();
+        heads.destroy();
+        nodes.destroy();
+    }
+    accumulation = vks::Image();
+    revealage = vks::Image();
+    depth = vks::Image();
+    heads = vks::Image();
+    nodes = vks::Buffer();
+    framebuffer = nullptr;
+    descriptorPool = nullptr;
+    compositeSet = nullptr;
+    listSet = nullptr;
+    nodeCapacity = 0;
+}
+
+void OrderIndependentTransparency::resize(const vk::Extent2D& extent) {
+    destroyTargets(true);
+    size = extent;
+    createTargets();
+}
+
+void OrderIndependentTransparency::destroy() {
+    if (!device) {
+        return;
+    }
+    destroyTargets(false);
+    device.destroyPipeline(compositePipelines.weightedBlended);
+    device.destroyPipeline(compositePipelines.linkedList);
+    device.destroyPipelineLayout(compositeLayout);
+    device.destroyDescriptorSetLayout(compositeSetLayout);
+    device.destroyDescriptorSetLayout(listSetLayout);
+    device.destroyRenderPass(renderPass);
+    compositePipelines.weightedBlended = nullptr;
+    compositePipelines.linkedList = nullptr;
+    compositeLayout = nullptr;
+    compositeSetLayout = nullptr;
+    listSetLayout = nullptr;
+    renderPass = nullptr;
+    device = nullptr;
+    context = nullptr;
+}
+
+void OrderIndependentTransparency::setupOccluderPipeline(pipelines::GraphicsPipelineBuilder& builder) const {
+    builder.renderPass = renderPass;
+    builder.subpass = 0;
+    builder.depthStencilState = true;
+    builder.colorBlendState.blendAttachmentStates.assign(2, { VK_FALSE, {}, {}, {}, {}, {}, {}, vk::ColorComponentFlags() });
+}
+
+void OrderIndependentTransparency::setupTransparentPipeline(pipelines::GraphicsPipelineBuilder& builder, Mode mode) const {
+    using BF = vk::BlendFactor;
+    using BO = vk::BlendOp;
+    builder.renderPass = renderPass;
+    builder.subpass = 0;
+    builder.depthStencilState = true;
+    builder.depthStencilState.depthWriteEnable = VK_FALSE;
+    auto& states = builder.colorBlendState.blendAttachmentStates;
+    if (mode == Mode::LinkedList) {
+        // Everything goes to the list
+        states.assign(2, { VK_FALSE, {}, {}, {}, {}, {}, {}, vk::ColorComponentFlags() });
+        return;
+    }
+    // Weighted sums, and the emission summed while the transmittance is multiplied by one minus the coverage
+    states.resize(2);
+    states[0] = { VK_TRUE, BF::eOne, BF::eOne, BO::eAdd, BF::eOne, BF::eOne, BO::eAdd };
+    states[1] = { VK_TRUE, BF::eOne, BF::eOne, BO::eAdd, BF::eZero, BF::eOneMinusSrcAlpha, BO::eAdd };
+}
+
+void OrderIndependentTransparency::begin(const vk::CommandBuffer& commandBuffer, Mode mode) {
+    if (mode == Mode::LinkedList) {
+        if (!listSupported) {
+            throw std::runtime_error("Linked list transparency needs fragmentStoresAndAtomics");
+        }
+        using Stage = vk::PipelineStageFlagBits2KHR;
+        using Access = vk::AccessFlagBits2KHR;
+        // The previous frame's composite is done with the lists before they're reset
+        Barriers barriers;
+        barriers.memory(Stage::eFragmentShader, Access::eShaderStorageRead, Stage::eTransfer, Access::eTransferWrite);
+        barriers.record(commandBuffer, *context);
+        const vk::ClearColorValue none{ std::array<uint32_t, 4>{ ~0u, ~0u, ~0u, ~0u } };
+        commandBuffer.clearColorImage(heads.image, vk::ImageLayout::eGeneral, none, vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
+        const uint32_t header[2]{ 0, nodeCapacity };
+        commandBuffer.updateBuffer(nodes.buffer, 0, sizeof(header), header);
+        barriers.memory(Stage::eTransfer, Access::eTransferWrite, Stage::eFragmentShader,
+                        Access::eShaderStorageRead | Access::eShaderStorageWrite);
+        barriers.record(commandBuffer, *context);
+    }
+
+    const vk::ClearValue clearValues[3]{
+        vk::ClearColorValue{ std::array<float, 4>{ 0.0f, 0.0f, 0.0f, 0.0f } },
+        // Nothing in front of the scene yet, everything of it shows
+        vk::ClearColorValue{ std::array<float, 4>{ 0.0f, 0.0f, 0.0f, 1.0f } },
+        vk::ClearDepthStencilValue{ 1.0f, 0 },
+    };
+    vk::RenderPassBeginInfo beginInfo{ renderPass, framebuffer, vk::Rect2D{ {}, size }, 3, clearValues };
+    commandBuffer.beginRenderPass(beginInfo, vk::SubpassContents::eInline);
+    commandBuffer.setViewport(0, vks::util::viewport(size));
+    commandBuffer.setScissor(0, vks::util::rect2D(size));
+}
+
+void OrderIndependentTransparency::end(const vk::CommandBuffer& commandBuffer) const {
+    commandBuffer.endRenderPass();
+}
+
+void OrderIndependentTransparency::composite(const vk::CommandBuffer& commandBuffer, Mode mode) const {
+    if (mode == Mode::LinkedList) {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, compositePipelines.linkedList);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, compositeLayout, 0, { compositeSet, listSet }, nullptr);
+    } else {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, compositePipelines.weightedBlended);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, compositeLayout, 0, compositeSet, nullptr);
+    }
+    commandBuffer.draw(3, 1, 0, 0);
+}
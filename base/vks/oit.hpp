@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <vulkan/vulkan.hpp>
+
+#include "buffer.hpp"
+#include "image.hpp"
+#include "forward.hpp"
+#include "pipelines.hpp"
+
+namespace vks {
+
+// Order independent transparency, so that transparent draws can be submitted in any order without sorting them.
+//
+// The transparent geometry is drawn in a render pass of its own, see begin and end, after the opaque occluders have
+// been drawn into its depth attachment, and composite blends the result over the opaque scene in the caller's render
+// pass.  The fragment shaders of the transparent draws include data/shaders/base/oit.glsl with OIT_WEIGHTED_BLENDED
+// or OIT_LINKED_LIST defined, and hand their premultiplied color and any additive emission to oitOutput.
+//
+//   WeightedBlended  McGuire and Bavoil's weighted blended OIT.  Every fragment is accumulated, weighted by its
+//                    coverage and depth, into a sum of colors and a product of transmittances, so the cost doesn't
+//                    depend on the depth complexity.  Closely layered surfaces of similar alpha are averaged rather
+//                    than ordered.
+//   LinkedList       Every fragment is appended to a per-pixel list of at most nodesPerPixel fragments on average,
+//                    and the composite sorts the nearest MAX_FRAGMENTS of each pixel and blends them in order, exact up
+//                    to that depth complexity.  Needs fragmentStoresAndAtomics, see linkedListSupported.  The
+//                    transparent draws bind listDescriptorSet in their pipeline layout, at set OIT_SET of oit.glsl.
+//
+// Additive emission is summed apart from the coverage in both modes, as weighted blending can't normalize fragments
+// without coverage.
+class OrderIndependentTransparency {
+public:
+    enum class Mode {
+        WeightedBlended,
+        LinkedList,
+    };
+
+    // Must match OIT_MAX_FRAGMENTS of oit_composite_list.frag
+    static const uint32_t MAX_FRAGMENTS = 16;
+
+    // The device features linked lists need have to be enabled
+    static bool linkedListSupported(const vks::Context& context);
+
+    // Average fragments per pixel the linked list has room for, fragments past that are dropped.  Read by create
+    // and resize.
+    uint32_t nodesPerPixel{ 4 };
+
+    // Targets of `extent`, composited in `compositeSubpass` of `compositeRenderPass` by pipelines loaded from
+    // `assetPath`.  The transparent draws and occluders test against a depth attachment of `depthFormat`.
+    void create(const vks::Context& context,
+                const std::string& assetPath,
+                const vk::Extent2D& extent,
+                vk::Format depthFormat,
+                const vk::RenderPass& compositeRenderPass,
+                uint32_t compositeSubpass = 0);
+    // Recreate the targets for `extent`.  The old ones are released through the context once the frames using them
+    // are done, but command buffers recorded with them have to be recorded again.
+    void resize(const vk::Extent2D& extent);
+    void destroy();
+
+    operator bool() const { return renderPass.operator bool(); }
+
+    // What the pipelines of the occluders and the transparent draws in `mode` need, on top of their shaders, vertex
+    // input and layout.  Depth is tested in both and only written by the occluders, which write no color.
+    void setupOccluderPipeline(pipelines::GraphicsPipelineBuilder& builder) const;
+    void setupTransparentPipeline(pipelines::GraphicsPipelineBuilder& builder, Mode mode) const;
+
+    // For the pipeline layouts of the transparent draws in LinkedList mode.  Only valid if linkedListSupported.
+    const vk::DescriptorSetLayout& listDescriptorSetLayout() const { return listSetLayout; }
+    const vk::DescriptorSet& listDescriptorSet() const { return listSet; }
+
+    // Clears the targets and starts the render pass the occluders and then the transparent draws are recorded in.
+    // Must be recorded outside of a render pass, and so before the render pass composite is recorded in.
+    void begin(const vk::CommandBuffer& commandBuffer, Mode mode);
+    void end(const vk::CommandBuffer& commandBuffer) const;
+
+    // Blends what was drawn between begin and end over the color attachment of the composite render pass
+    void composite(const vk::CommandBuffer& commandBuffer, Mode mode) const;
+
+    const vk::Extent2D& extent() const { return size; }
+
+private:
+    void createTargets();
+    void destroyTargets(bool deferred);
+
+    const vks::Context* context{ nullptr };
+    vk::Device device;
+    vk::Extent2D size;
+    vk::Format depthFormat{ vk::Format::eUndefined };
+    bool listSupported{ false };
+
+    // The sum of the weighted colors and coverage, and the additive emission with the product of the transmittances
+    vks::Image accumulation;
+    vks::Image revealage;
+    vks::Image depth;
+    // Index of the first node of every pixel's list, ~0 for none
+    vks::Image heads;
+    vks::Buffer nodes;
+    uint32_t nodeCapacity{ 0 };
+    vk::Framebuffer framebuffer;
+
+    vk::RenderPass renderPass;
+    vk::DescriptorSetLayout compositeSetLayout;
+    vk::DescriptorSetLayout listSetLayout;
+    // Recreated with the targets, as the sets of frames still in flight can't be updated
+    vk::DescriptorPool descriptorPool;
+    vk::DescriptorSet compositeSet;
+    vk::DescriptorSet listSet;
+    vk::PipelineLayout compositeLayout;
+    struct {
+        vk::Pipeline weightedBlended;
+        vk::Pipeline linkedList;
+    } compositePipelines;
+};
+
+}  // namespace vks
@@ -0,0 +1,201 @@
+#include "pack.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "hash.hpp"
+#include "lz4.hpp"
+
+using namespace vks::storage;
+
+namespace {
+
+class DecompressedStorage : public Storage {
+public:
+    DecompressedStorage(ByteArray&& data)
+        : _data(std::move(data)) {}
+    const uint8_t* data() const override { return _data.data(); }
+    size_t size() const override { return _data.size(); }
+    bool isFast() const override { return true; }
+
+private:
+    const ByteArray _data;
+};
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool entryLess(const pack::Entry& entry, uint64_t hash) {
+    return entry.pathHash < hash;
+}
+
+}  // namespace
+
+uint64_t pack::hashPath(const std::string& path) {
+    KeyHasher hasher;
+    hasher.add(path.data(), path.size());
+    return hasher.hash;
+}
+
+Pack::Pack(const StoragePointer& packStorage)
+    : storage(packStorage) {
+    const size_t packSize = storage ? storage->size() : 0;
+    if (packSize < sizeof(pack::Header)) {
+        throw std::runtime_error("Not an asset pack");
+    }
+    pack::Header header;
+    memcpy(&header, storage->data(), sizeof(header));
+    if (0 != memcmp(header.magic, pack::MAGIC, sizeof(pack::MAGIC))) {
+        throw std::runtime_error("Not an asset pack");
+    }
+    if (header.version != pack::VERSION) {
+        throw std::runtime_error("Unsupported asset pack version " + std::to_string(header.version));
+    }
+    const uint64_t indexSize = uint64_t(header.entryCount) * sizeof(pack::Entry);
+    if (header.indexOffset % alignof(pack::Entry) != 0 || header.indexOffset > packSize || indexSize > packSize - header.indexOffset ||
+        header.pathsOffset > packSize || header.pathsSize > packSize - header.pathsOffset) {
+        throw std::runtime_error("Truncated asset pack");
+    }
+    entries = reinterpret_cast<const pack::Entry*>(storage->data() + header.indexOffset);
+    paths = reinterpret_cast<const char*>(storage->data() + header.pathsOffset);
+    entryCount = header.entryCount;
+    for (uint32_t i = 0; i < entryCount; ++i) {
+        const auto& entry = entries[i];
+        if (entry.offset > packSize || entry.storedSize > packSize - entry.offset || uint64_t(entry.pathOffset) + entry.pathLength > header.pathsSize) {
+            throw std::runtime_error("Truncated asset pack");
+        }
+    }
+}
+
+const pack::Entry* Pack::lookup(const std::string& path) const {
+    const uint64_t hash = pack::hashPath(path);
+    const pack::Entry* end = entries + entryCount;
+    // Paths with the same hash are next to each other
+    for (auto itr = std::lower_bound(entries, end, hash, entryLess); itr != end && itr->pathHash == hash; ++itr) {
+        if (itr->pathLength == path.size() && 0 == memcmp(paths + itr->pathOffset, path.data(), path.size())) {
+            return itr;
+        }
+    }
+    return nullptr;
+}
+
+StoragePointer Pack::find(const std::string& path) const {
+    const auto entry = lookup(path);
+    if (!entry) {
+        return StoragePointer();
+    }
+    const uint8_t* stored = storage->data() + entry->offset;
+    switch (entry->compression) {
+        case pack::Compression::None:
+            // A view of no size would be a view of the whole pack
+            if (entry->size == 0) {
+                return Storage::create(0, nullptr);
+            }
+            return storage->createView(static_cast<size_t>(entry->size), static_cast<size_t>(entry->offset));
+        case pack::Compression::Lz4: {
+            ByteArray data(static_cast<size_t>(entry->size));
+            if (!lz4::decompress(stored, static_cast<size_t>(entry->storedSize), data.data(), data.size())) {
+                throw std::runtime_error("Corrupt asset pack entry " + path);
+            }
+            return std::make_shared<DecompressedStorage>(std::move(data));
+        }
+    }
+    throw std::runtime_error("Unsupported compression for asset pack entry " + path);
+}
+
+PackWriter::PackWriter(const std::string& packFilename, const std::vector<std::string>& paths)
+    : filename(packFilename) {
+    pending.resize(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        pending[i].path = paths[i];
+        pending[i].entry = {};
+        pending[i].entry.pathHash = pack::hashPath(paths[i]);
+    }
+    std::sort(pending.begin(), pending.end(), [](const PendingEntry& a, const PendingEntry& b) {
+        return a.entry.pathHash != b.entry.pathHash ? a.entry.pathHash < b.entry.pathHash : a.path < b.path;
+    });
+    for (size_t i = 0; i < pending.size(); ++i) {
+        auto& entry = pending[i];
+        if (!byPath.insert({ entry.path, i }).second) {
+            throw std::runtime_error("Path " + entry.path + " added to the pack twice");
+        }
+        entry.entry.pathOffset = static_cast<uint32_t>(pathTable.size());
+        entry.entry.pathLength = static_cast<uint32_t>(entry.path.size());
+        pathTable += entry.path;
+    }
+
+    file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("Failed to create " + filename);
+    }
+    // Space for the header, index and paths, written by finish
+    offset = sizeof(pack::Header) + pending.size() * sizeof(pack::Entry) + pathTable.size();
+    const std::vector<char> zeros(static_cast<size_t>(offset), 0);
+    file.write(zeros.data(), zeros.size());
+}
+
+void PackWriter::pad(uint64_t alignment) {
+    static const char zeros[pack::PACK_ALIGNMENT] = {};
+    const uint64_t aligned = alignUp(offset, alignment);
+    file.write(zeros, static_cast<std::streamsize>(aligned - offset));
+    offset = aligned;
+}
+
+void PackWriter::add(const std::string& path, const uint8_t* data, size_t size, bool compress) {
+    auto itr = byPath.find(path);
+    if (itr == byPath.end()) {
+        throw std::runtime_error("Path " + path + " isn't in the pack");
+    }
+    auto& pendingEntry = pending[itr->second];
+    if (pendingEntry.added) {
+        throw std::runtime_error("Path " + path + " added to the pack twice");
+    }
+    std::vector<uint8_t> compressed;
+    if (compress && size > 0) {
+        compressed = lz4::compress(data, size);
+    }
+    const bool useCompressed = !compressed.empty() && compressed.size() < size - size / 8;
+    pad(pack::PACK_ALIGNMENT);
+    auto& entry = pendingEntry.entry;
+    entry.offset = offset;
+    entry.size = size;
+    entry.compression = useCompressed ? pack::Compression::Lz4 : pack::Compression::None;
+    entry.storedSize = useCompressed ? compressed.size() : size;
+    file.write(reinterpret_cast<const char*>(useCompressed ? compressed.data() : data), static_cast<std::streamsize>(entry.storedSize));
+    offset += entry.storedSize;
+    pendingEntry.added = true;
+
+    ++stats.entries;
+    stats.compressed += useCompressed ? 1 : 0;
+    stats.inputBytes += size;
+    stats.storedBytes += entry.storedSize;
+}
+
+PackWriter::Stats PackWriter::finish() {
+    for (const auto& entry : pending) {
+        if (!entry.added) {
+            throw std::runtime_error("Path " + entry.path + " was never added to the pack");
+        }
+    }
+    pack::Header header;
+    memcpy(header.magic, pack::MAGIC, sizeof(pack::MAGIC));
+    header.version = pack::VERSION;
+    header.entryCount = static_cast<uint32_t>(pending.size());
+    header.indexOffset = sizeof(pack::Header);
+    header.pathsOffset = header.indexOffset + pending.size() * sizeof(pack::Entry);
+    header.pathsSize = pathTable.size();
+
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& entry : pending) {
+        file.write(reinterpret_cast<const char*>(&entry.entry), sizeof(entry.entry));
+    }
+    file.write(pathTable.data(), pathTable.size());
+    file.close();
+    if (!file) {
+        throw std::runtime_error("Failed to write " + filename);
+    }
+    return stats;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "storage.hpp"
+
+namespace vks { namespace storage {
+
+// Asset packs: the files of a directory tree in one file, so that loading an asset is a lookup in memory that's
+// already mapped rather than an open, a stat and a mapping of its own.
+//
+// A pack is the header, the index, the paths, then the contents of every entry at PACK_ALIGNMENT.  Index entries are
+// sorted by the FNV-1a hash of their path, relative to the packed directory and with '/' separators, so that finding
+// one is a binary search of the mapped index followed by a comparison of the path.  Entries are stored as they are,
+// which Pack::find returns views of without copying, or as LZ4 blocks, which it decompresses.  Integers are little
+// endian.
+//
+// vkpack (tools/vkpack) builds packs, and Storage::mountPack makes readFile look in them.
+namespace pack {
+
+const char MAGIC[8] = { 'V', 'K', 'S', 'P', 'A', 'C', 'K', 0 };
+const uint32_t VERSION = 1;
+// Enough for the contents of any entry to be read in place as any scalar or vector type
+const uint64_t PACK_ALIGNMENT = 64;
+
+enum class Compression : uint32_t {
+    None = 0,
+    Lz4 = 1,
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t entryCount;
+    uint64_t indexOffset;
+    uint64_t pathsOffset;
+    uint64_t pathsSize;
+};
+static_assert(sizeof(Header) == 40, "Pack header layout");
+
+struct Entry {
+    uint64_t pathHash;
+    uint64_t offset;
+    // Stored and decompressed sizes, the same for uncompressed entries
+    uint64_t storedSize;
+    uint64_t size;
+    uint32_t pathOffset;
+    uint32_t pathLength;
+    Compression compression;
+    uint32_t reserved;
+};
+static_assert(sizeof(Entry) == 48, "Pack entry layout");
+
+uint64_t hashPath(const std::string& path);
+
+}  // namespace pack
+
+class Pack {
+public:
+    // Throws std::runtime_error if `storage` isn't a pack this version reads
+    explicit Pack(const StoragePointer& storage);
+
+    // The contents of the entry at `path`, relative to the packed directory, or nothing if there is no such entry.
+    // Throws std::runtime_error for a compressed entry that doesn't decompress.
+    StoragePointer find(const std::string& path) const;
+
+    size_t size() const { return entryCount; }
+
+private:
+    const pack::Entry* lookup(const std::string& path) const;
+
+    StoragePointer storage;
+    const pack::Entry* entries{ nullptr };
+    const char* paths{ nullptr };
+    uint32_t entryCount{ 0 };
+};
+
+// Writes a pack.  Entries are added one at a time, through a file opened on the first, and the header, index and
+// paths are written by finish, in the space left for them at the start.
+class PackWriter {
+public:
+    struct Stats {
+        size_t entries{ 0 };
+        size_t compressed{ 0 };
+        uint64_t inputBytes{ 0 };
+        uint64_t storedBytes{ 0 };
+    };
+
+    // Every path going into the pack, which sizes the index and path table up front.  Throws std::runtime_error if
+    // the file can't be created or a path is repeated.
+    PackWriter(const std::string& filename, const std::vector<std::string>& paths);
+
+    // Add the contents of one of the paths given to the constructor.  With `compress`, they are stored as LZ4 unless
+    // that saves less than an eighth of their size.
+    void add(const std::string& path, const uint8_t* data, size_t size, bool compress);
+    // Throws std::runtime_error if any path wasn't added
+    Stats finish();
+
+private:
+    struct PendingEntry {
+        std::string path;
+        pack::Entry entry;
+        bool added{ false };
+    };
+
+    void pad(uint64_t alignment);
+
+    std::string filename;
+    std::ofstream file;
+    std::vector<PendingEntry> pending;
+    std::unordered_map<std::string, size_t> byPath;
+    std::string pathTable;
+    uint64_t offset{ 0 };
+    Stats stats;
+};
+
+}}  // namespace vks::storage
@@ -0,0 +1,374 @@
+#include "parallel.hpp"
+
+#include <stdexcept>
+
+#include "context.hpp"
+#include "shaders.hpp"
+
+using namespace vks::parallel;
+
+const uint32_t Scan::GROUP_SIZE;
+const uint32_t Scan::ITEMS;
+const uint32_t Scan::BLOCK_SIZE;
+const uint32_t RadixSort::RADIX_BITS;
+const uint32_t RadixSort::GROUP_SIZE;
+const uint32_t RadixSort::ITEMS;
+const uint32_t RadixSort::TILE_SIZE;
+
+namespace {
+
+const uint32_t RADIX = 1 << RadixSort::RADIX_BITS;
+// Must match radix.glsl
+const uint32_t MAX_PASSES = 4;
+// Look-back counts have 30 bits
+const uint32_t MAX_SORT_COUNT = 1u << 30;
+
+// All the sets here are storage buffers only
+const vks::DescriptorAllocator::PoolRatios& storageRatios() {
+    static const vks::DescriptorAllocator::PoolRatios ratios{ { vk::DescriptorType::eStorageBuffer, 8.0f } };
+    return ratios;
+}
+
+uint32_t divideRoundingUp(uint32_t value, uint32_t divisor) {
+    return (value + divisor - 1) / divisor;
+}
+
+vk::DescriptorSetLayout createStorageLayout(const vk::Device& device, uint32_t bindingCount) {
+    std::vector<vk::DescriptorSetLayoutBinding> bindings;
+    for (uint32_t binding = 0; binding < bindingCount; ++binding) {
+        bindings.push_back({ binding, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute });
+    }
+    return device.createDescriptorSetLayout({ {}, (uint32_t)bindings.size(), bindings.data() });
+}
+
+vk::PipelineLayout createPipelineLayout(const vk::Device& device, const vk::DescriptorSetLayout& setLayout, uint32_t pushConstantSize) {
+    const vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, pushConstantSize };
+    return device.createPipelineLayout({ {}, 1, &setLayout, 1, &pushConstantRange });
+}
+
+// The local size of shaders with local_size_x_id = 0 comes from `groupSize`, others ignore it
+vk::Pipeline createPipeline(const vks::Context& context, const vk::PipelineLayout& layout, const std::string& shaderFile, uint32_t groupSize) {
+    const vk::SpecializationMapEntry entry{ 0, 0, sizeof(uint32_t) };
+    const vk::SpecializationInfo specializationInfo{ 1, &entry, sizeof(groupSize), &groupSize };
+    vk::ComputePipelineCreateInfo pipelineCreateInfo;
+    pipelineCreateInfo.layout = layout;
+    pipelineCreateInfo.stage = vks::shaders::loadShader(context.device, shaderFile, vk::ShaderStageFlagBits::eCompute);
+    pipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+    vk::Pipeline pipeline = context.device.createComputePipeline(context.pipelineCache, pipelineCreateInfo);
+    context.device.destroyShaderModule(pipelineCreateInfo.stage.module);
+    return pipeline;
+}
+
+vks::DescriptorBinding storage(uint32_t binding, const vk::DescriptorBufferInfo& buffer) {
+    return { binding, vk::DescriptorType::eStorageBuffer, buffer };
+}
+
+void memoryBarrier(const vk::CommandBuffer& commandBuffer,
+                   const vk::PipelineStageFlags& srcStages,
+                   const vk::AccessFlags& srcAccess,
+                   const vk::PipelineStageFlags& dstStages,
+                   const vk::AccessFlags& dstAccess) {
+    commandBuffer.pipelineBarrier(srcStages, dstStages, {}, vk::MemoryBarrier{ srcAccess, dstAccess }, nullptr, nullptr);
+}
+
+const vk::PipelineStageFlags WRITE_STAGES = vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer;
+const vk::AccessFlags WRITE_ACCESS = vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite;
+const vk::AccessFlags READ_WRITE_ACCESS =
+    vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite;
+
+// Between the steps of a primitive, and against earlier commands
+void stepBarrier(const vk::CommandBuffer& commandBuffer) {
+    memoryBarrier(commandBuffer, WRITE_STAGES, WRITE_ACCESS, WRITE_STAGES, READ_WRITE_ACCESS);
+}
+
+// The results of a primitive, for later commands
+void resultBarrier(const vk::CommandBuffer& commandBuffer) {
+    memoryBarrier(commandBuffer, WRITE_STAGES, WRITE_ACCESS, WRITE_STAGES | vk::PipelineStageFlagBits::eDrawIndirect,
+                  READ_WRITE_ACCESS | vk::AccessFlagBits::eIndirectCommandRead);
+}
+
+}  // namespace
+
+//
+// Scan
+//
+
+namespace {
+
+// Must match scan.glsl
+struct ScanPushConstants {
+    uint32_t count;
+    uint32_t writeSums;
+};
+
+}  // namespace
+
+void Scan::create(const vks::Context& context, const std::string& shaderDirectory, uint32_t maxCount) {
+    if (divideRoundingUp(maxCount, BLOCK_SIZE) > context.deviceProperties.limits.maxComputeWorkGroupCount[0]) {
+        throw std::runtime_error("Too many elements to scan");
+    }
+    device = context.device;
+    capacity = maxCount;
+    useSubgroups = context.supportsSubgroupOperations(vk::ShaderStageFlagBits::eCompute,
+                                                      vk::SubgroupFeatureFlagBits::eBasic | vk::SubgroupFeatureFlagBits::eArithmetic);
+    descriptors.create(device, 16, storageRatios());
+    descriptorSetLayout = createStorageLayout(device, 3);
+    pipelineLayout = createPipelineLayout(device, descriptorSetLayout, sizeof(ScanPushConstants));
+    scanPipeline = createPipeline(context, pipelineLayout, shaderDirectory + (useSubgroups ? "scan_subgroup.comp.spv" : "scan.comp.spv"), GROUP_SIZE);
+    addPipeline = createPipeline(context, pipelineLayout, shaderDirectory + "scan_add.comp.spv", GROUP_SIZE);
+
+    // Every level has somewhere to write its totals, even the last one that doesn't
+    uint32_t count = std::max(maxCount, 1u);
+    do {
+        count = divideRoundingUp(count, BLOCK_SIZE);
+        levels.push_back(context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, sizeof(uint32_t) * count));
+    } while (count > 1);
+}
+
+void Scan::destroy() {
+    if (!device) {
+        return;
+    }
+    for (auto& level : levels) {
+        level.destroy();
+    }
+    levels.clear();
+    descriptors.destroy();
+    device.destroyPipeline(scanPipeline);
+    device.destroyPipeline(addPipeline);
+    device.destroyPipelineLayout(pipelineLayout);
+    device.destroyDescriptorSetLayout(descriptorSetLayout);
+    scanPipeline = nullptr;
+    addPipeline = nullptr;
+    pipelineLayout = nullptr;
+    descriptorSetLayout = nullptr;
+    device = nullptr;
+}
+
+void Scan::record(const vk::CommandBuffer& commandBuffer, const vk::DescriptorBufferInfo& input, const vk::DescriptorBufferInfo& output, uint32_t count) {
+    if (count == 0) {
+        return;
+    }
+    if (count > capacity) {
+        throw std::runtime_error("More elements than the scan was created for");
+    }
+    stepBarrier(commandBuffer);
+    recordLevel(commandBuffer, input, output, count, 0);
+    resultBarrier(commandBuffer);
+}
+
+void Scan::recordLevel(const vk::CommandBuffer& commandBuffer,
+                       const vk::DescriptorBufferInfo& input,
+                       const vk::DescriptorBufferInfo& output,
+                       uint32_t count,
+                       size_t level) {
+    const uint32_t blocks = divideRoundingUp(count, BLOCK_SIZE);
+    const auto& sums = levels[level].descriptor;
+    const vk::DescriptorSet descriptorSet = descriptors.get(descriptorSetLayout, { storage(0, input), storage(1, output), storage(2, sums) });
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, scanPipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
+    commandBuffer.pushConstants<ScanPushConstants>(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, ScanPushConstants{ count, blocks > 1 ? 1u : 0u });
+    commandBuffer.dispatch(blocks, 1, 1);
+    if (blocks == 1) {
+        return;
+    }
+
+    // The block totals, scanned in place, are what every block adds to its elements
+    stepBarrier(commandBuffer);
+    recordLevel(commandBuffer, sums, sums, blocks, level + 1);
+    stepBarrier(commandBuffer);
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, addPipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
+    commandBuffer.pushConstants<ScanPushConstants>(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, ScanPushConstants{ count, 0 });
+    commandBuffer.dispatch(blocks, 1, 1);
+}
+
+//
+// Compaction
+//
+
+namespace {
+
+// Must match compact.comp
+const uint32_t COMPACT_GROUP_SIZE = 256;
+
+}  // namespace
+
+void Compaction::create(const vks::Context& context, const std::string& shaderDirectory, uint32_t maxCount) {
+    if (divideRoundingUp(maxCount, COMPACT_GROUP_SIZE) > context.deviceProperties.limits.maxComputeWorkGroupCount[0]) {
+        throw std::runtime_error("Too many elements to compact");
+    }
+    device = context.device;
+    scan.create(context, shaderDirectory, maxCount);
+    offsets = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, sizeof(uint32_t) * std::max(maxCount, 1u));
+    descriptors.create(device, 16, storageRatios());
+    descriptorSetLayout = createStorageLayout(device, 5);
+    pipelineLayout = createPipelineLayout(device, descriptorSetLayout, sizeof(uint32_t));
+    pipeline = createPipeline(context, pipelineLayout, shaderDirectory + "compact.comp.spv", COMPACT_GROUP_SIZE);
+}
+
+void Compaction::destroy() {
+    if (!device) {
+        return;
+    }
+    scan.destroy();
+    offsets.destroy();
+    descriptors.destroy();
+    device.destroyPipeline(pipeline);
+    device.destroyPipelineLayout(pipelineLayout);
+    device.destroyDescriptorSetLayout(descriptorSetLayout);
+    pipeline = nullptr;
+    pipelineLayout = nullptr;
+    descriptorSetLayout = nullptr;
+    device = nullptr;
+}
+
+void Compaction::record(const vk::CommandBuffer& commandBuffer,
+                        const vk::DescriptorBufferInfo& flags,
+                        const vk::DescriptorBufferInfo& values,
+                        const vk::DescriptorBufferInfo& output,
+                        const vk::DescriptorBufferInfo& count,
+                        uint32_t elementCount) {
+    if (elementCount == 0) {
+        return;
+    }
+    scan.record(commandBuffer, flags, offsets.descriptor, elementCount);
+    const vk::DescriptorSet descriptorSet = descriptors.get(
+        descriptorSetLayout, { storage(0, flags), storage(1, values), storage(2, offsets.descriptor), storage(3, output), storage(4, count) });
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
+    commandBuffer.pushConstants<uint32_t>(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, elementCount);
+    commandBuffer.dispatch(divideRoundingUp(elementCount, COMPACT_GROUP_SIZE), 1, 1);
+    resultBarrier(commandBuffer);
+}
+
+//
+// RadixSort
+//
+
+namespace {
+
+// Must match radix.glsl
+struct RadixPushConstants {
+    uint32_t count;
+    uint32_t shift;
+    uint32_t passCount;
+    uint32_t hasValues;
+};
+
+}  // namespace
+
+bool RadixSort::supported(const vks::Context& context) {
+    return context.supportsSubgroupOperations(vk::ShaderStageFlagBits::eCompute, vk::SubgroupFeatureFlagBits::eBasic | vk::SubgroupFeatureFlagBits::eBallot) &&
+           // Ballots are uvec4, and subgroups have to tile the workgroup
+           context.subgroupProperties.subgroupSize <= 128 && context.subgroupProperties.subgroupSize <= GROUP_SIZE;
+}
+
+void RadixSort::create(const vks::Context& context, const std::string& shaderDirectory, uint32_t maxCount) {
+    if (!supported(context)) {
+        throw std::runtime_error("Radix sort needs subgroup ballots in compute shaders");
+    }
+    if (maxCount > MAX_SORT_COUNT || divideRoundingUp(maxCount, TILE_SIZE) > context.deviceProperties.limits.maxComputeWorkGroupCount[0]) {
+        throw std::runtime_error("Too many keys to sort");
+    }
+    device = context.device;
+    capacity = maxCount;
+    descriptors.create(device, 16, storageRatios());
+    descriptorSetLayout = createStorageLayout(device, 6);
+    pipelineLayout = createPipelineLayout(device, descriptorSetLayout, sizeof(RadixPushConstants));
+    histogramPipeline = createPipeline(context, pipelineLayout, shaderDirectory + "radix_histogram.comp.spv", GROUP_SIZE);
+    offsetsPipeline = createPipeline(context, pipelineLayout, shaderDirectory + "radix_offsets.comp.spv", GROUP_SIZE);
+    onesweepPipeline = createPipeline(context, pipelineLayout, shaderDirectory + "radix_onesweep_subgroup.comp.spv", GROUP_SIZE);
+
+    const vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc;
+    const vk::DeviceSize size = sizeof(uint32_t) * std::max(maxCount, 1u);
+    scratchKeys = context.createDeviceBuffer(usage, size);
+    scratchValues = context.createDeviceBuffer(usage, size);
+    globals = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                         sizeof(uint32_t) * (MAX_PASSES * RADIX + MAX_PASSES));
+    status = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                        sizeof(uint32_t) * RADIX * std::max(divideRoundingUp(maxCount, TILE_SIZE), 1u));
+}
+
+void RadixSort::destroy() {
+    if (!device) {
+        return;
+    }
+    scratchKeys.destroy();
+    scratchValues.destroy();
+    globals.destroy();
+    status.destroy();
+    descriptors.destroy();
+    device.destroyPipeline(histogramPipeline);
+    device.destroyPipeline(offsetsPipeline);
+    device.destroyPipeline(onesweepPipeline);
+    device.destroyPipelineLayout(pipelineLayout);
+    device.destroyDescriptorSetLayout(descriptorSetLayout);
+    histogramPipeline = nullptr;
+    offsetsPipeline = nullptr;
+    onesweepPipeline = nullptr;
+    pipelineLayout = nullptr;
+    descriptorSetLayout = nullptr;
+    device = nullptr;
+}
+
+void RadixSort::record(const vk::CommandBuffer& commandBuffer,
+                       const vk::DescriptorBufferInfo& keys,
+                       const vk::DescriptorBufferInfo& values,
+                       uint32_t count,
+                       uint32_t keyBits) {
+    const uint32_t passCount = std::min(divideRoundingUp(keyBits, RADIX_BITS), MAX_PASSES);
+    if (count == 0 || passCount == 0) {
+        return;
+    }
+    if (count > capacity) {
+        throw std::runtime_error("More keys than the sort was created for");
+    }
+    const uint32_t tiles = divideRoundingUp(count, TILE_SIZE);
+    const bool hasValues = values.buffer.operator bool();
+    // Without values, the keys stand in for them in the bindings, the shaders don't touch them
+    const vk::DescriptorBufferInfo& userValues = hasValues ? values : keys;
+    const vk::DescriptorBufferInfo& userScratchValues = hasValues ? scratchValues.descriptor : scratchKeys.descriptor;
+    // Even passes go from the caller's buffers to the scratch buffers, odd ones back
+    const vk::DescriptorSet toScratch =
+        descriptors.get(descriptorSetLayout, { storage(0, keys), storage(1, userValues), storage(2, scratchKeys.descriptor), storage(3, userScratchValues),
+                                               storage(4, globals.descriptor), storage(5, status.descriptor) });
+    const vk::DescriptorSet fromScratch =
+        descriptors.get(descriptorSetLayout, { storage(0, scratchKeys.descriptor), storage(1, userScratchValues), storage(2, keys), storage(3, userValues),
+                                               storage(4, globals.descriptor), storage(5, status.descriptor) });
+    RadixPushConstants pushConstants{ count, 0, passCount, hasValues ? 1u : 0u };
+
+    stepBarrier(commandBuffer);
+    commandBuffer.fillBuffer(globals.buffer, 0, VK_WHOLE_SIZE, 0);
+    stepBarrier(commandBuffer);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, toScratch, nullptr);
+    commandBuffer.pushConstants<RadixPushConstants>(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushConstants);
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, histogramPipeline);
+    commandBuffer.dispatch(tiles, 1, 1);
+    stepBarrier(commandBuffer);
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, offsetsPipeline);
+    commandBuffer.dispatch(1, 1, 1);
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, onesweepPipeline);
+    for (uint32_t pass = 0; pass < passCount; ++pass) {
+        // Look-back starts over every pass
+        stepBarrier(commandBuffer);
+        commandBuffer.fillBuffer(status.buffer, 0, sizeof(uint32_t) * RADIX * tiles, 0);
+        stepBarrier(commandBuffer);
+        pushConstants.shift = pass * RADIX_BITS;
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, pass % 2 ? fromScratch : toScratch, nullptr);
+        commandBuffer.pushConstants<RadixPushConstants>(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushConstants);
+        commandBuffer.dispatch(tiles, 1, 1);
+    }
+
+    if (passCount % 2) {
+        stepBarrier(commandBuffer);
+        const vk::DeviceSize size = sizeof(uint32_t) * count;
+        commandBuffer.copyBuffer(scratchKeys.buffer, keys.buffer, vk::BufferCopy{ 0, keys.offset, size });
+        if (hasValues) {
+            commandBuffer.copyBuffer(scratchValues.buffer, values.buffer, vk::BufferCopy{ 0, values.offset, size });
+        }
+    }
+    resultBarrier(commandBuffer);
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "buffer.hpp"
+#include "descriptors.hpp"
+#include "forward.hpp"
+
+namespace vks { namespace parallel {
+
+// Data parallel building blocks over buffers of uint32, for sorting, binning and compaction on the GPU.  Each is
+// created once for the largest count it will see, with the directory holding the compiled shaders of
+// data/shaders/base, and records its work into any compute capable command buffer, outside of a render pass.
+//
+// Recorded work is ordered after the compute shader and transfer writes of earlier commands, and its results are
+// visible to the compute shaders, indirect commands and transfers of later ones; graphics queue users add their own
+// barrier for vertex input.  Descriptor sets are cached by the buffers they're recorded with, so recording again with
+// the same buffers costs nothing extra.
+
+// Exclusive prefix sum, as blocks of BLOCK_SIZE elements scanned in one dispatch each, whose totals are scanned the
+// same way, recursively, and added back.  Within a block, subgroups sum their elements first, where the device
+// supports subgroup arithmetic in compute shaders.
+class Scan {
+public:
+    static const uint32_t GROUP_SIZE = 256;
+    // Must match scan.glsl
+    static const uint32_t ITEMS = 4;
+    static const uint32_t BLOCK_SIZE = GROUP_SIZE * ITEMS;
+
+    void create(const vks::Context& context, const std::string& shaderDirectory, uint32_t maxCount);
+    void destroy();
+
+    uint32_t maxCount() const { return capacity; }
+    bool subgroups() const { return useSubgroups; }
+
+    // `output[i]` becomes the sum of `input[0, i)` for the first `count` elements.  Input and output may be the same.
+    void record(const vk::CommandBuffer& commandBuffer, const vk::DescriptorBufferInfo& input, const vk::DescriptorBufferInfo& output, uint32_t count);
+
+private:
+    void recordLevel(const vk::CommandBuffer& commandBuffer,
+                     const vk::DescriptorBufferInfo& input,
+                     const vk::DescriptorBufferInfo& output,
+                     uint32_t count,
+                     size_t level);
+
+    vk::Device device;
+    uint32_t capacity{ 0 };
+    bool useSubgroups{ false };
+    DescriptorAllocator descriptors;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline scanPipeline;
+    vk::Pipeline addPipeline;
+    // Block totals of each level of the recursion
+    std::vector<Buffer> levels;
+};
+
+// Stream compaction: the values whose flag is 1, in their order, packed at the start of the output, along with their
+// number.  The flags have to be 0 or 1.
+class Compaction {
+public:
+    void create(const vks::Context& context, const std::string& shaderDirectory, uint32_t maxCount);
+    void destroy();
+
+    uint32_t maxCount() const { return scan.maxCount(); }
+    bool subgroups() const { return scan.subgroups(); }
+
+    // `count` is a single uint, like the instance count of an indirect draw, see the visibility guarantees above.
+    // Nothing is recorded for no elements, and the count is left as it was.
+    void record(const vk::CommandBuffer& commandBuffer,
+                const vk::DescriptorBufferInfo& flags,
+                const vk::DescriptorBufferInfo& values,
+                const vk::DescriptorBufferInfo& output,
+                const vk::DescriptorBufferInfo& count,
+                uint32_t elementCount);
+
+private:
+    vk::Device device;
+    Scan scan;
+    // The scanned flags
+    Buffer offsets;
+    DescriptorAllocator descriptors;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline pipeline;
+};
+
+// Stable LSD radix sort of uint32 keys, optionally with a uint32 value each, 8 bits per pass.  Passes go the way of
+// Onesweep: the digit counts of every pass come from a single read of the keys up front, after which each pass reads
+// and writes the keys once, with each tile of keys finding where its keys go by looking back at the tiles before it.
+//
+// Ranking keys within a tile takes subgroup ballots in compute shaders, see supported.  The look-back spins on the
+// progress of other workgroups, which desktop GPUs make, but which Vulkan doesn't promise.
+class RadixSort {
+public:
+    // Must match radix.glsl
+    static const uint32_t RADIX_BITS = 8;
+    static const uint32_t GROUP_SIZE = 256;
+    static const uint32_t ITEMS = 4;
+    static const uint32_t TILE_SIZE = GROUP_SIZE * ITEMS;
+
+    static bool supported(const vks::Context& context);
+
+    // Throws std::runtime_error if the device isn't supported
+    void create(const vks::Context& context, const std::string& shaderDirectory, uint32_t maxCount);
+    void destroy();
+
+    uint32_t maxCount() const { return capacity; }
+
+    // Sorts the first `count` keys by their low `keyBits` bits, the values along with them unless `values` has no
+    // buffer.  The buffers need transfer usage when an odd number of passes, (keyBits + 7) / 8, leaves the result in
+    // the scratch buffers, to copy it back.
+    void record(const vk::CommandBuffer& commandBuffer,
+                const vk::DescriptorBufferInfo& keys,
+                const vk::DescriptorBufferInfo& values,
+                uint32_t count,
+                uint32_t keyBits = 32);
+
+private:
+    vk::Device device;
+    uint32_t capacity{ 0 };
+    DescriptorAllocator descriptors;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline histogramPipeline;
+    vk::Pipeline offsetsPipeline;
+    vk::Pipeline onesweepPipeline;
+    // Keys and values between passes
+    Buffer scratchKeys;
+    Buffer scratchValues;
+    // Digit counts and offsets of every pass, and the tile counters, see radix.glsl
+    Buffer globals;
+    // Look-back state per tile and digit, of one pass
+    Buffer status;
+};
+
+}}  // namespace vks::parallel
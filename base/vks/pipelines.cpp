@@ -0,0 +1,422 @@
+#include "pipelines.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <thread>
+
+#include "hash.hpp"
+#include "threadpool.hpp"
+
+vks::shaders::ShaderLayout vks::pipelines::GraphicsPipelineBuilder::reflectLayout() const {
+    shaders::ShaderLayout result;
+    for (size_t i = 0; i < shaderStages.size(); ++i) {
+        result.merge(shaders::reflectShader(device, shaderFiles[i], shaderStages[i].stage));
+    }
+    return result;
+}
+
+std::vector<vk::Pipeline> vks::pipelines::createGraphicsPipelines(const vk::Device& device,
+                                                                  const std::vector<GraphicsPipelineBuilder*>& builders,
+                                                                  const vk::PipelineCache& cache,
+                                                                  size_t threadCount) {
+    startup::ScopedPhase startupPhase(startup::Phase::Pipelines);
+    std::vector<vk::Pipeline> result(builders.size());
+    if (builders.empty()) {
+        return result;
+    }
+    if (threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    threadCount = std::max<size_t>(1, std::min(threadCount, builders.size()));
+
+    std::vector<uint8_t> seed;
+    if (cache) {
+        seed = device.getPipelineCacheData(cache);
+    }
+    std::vector<vk::PipelineCache> threadCaches(threadCount);
+    for (auto& threadCache : threadCaches) {
+        threadCache = device.createPipelineCache({ {}, seed.size(), seed.data() });
+    }
+
+    std::atomic<size_t> next{ 0 };
+    std::vector<std::exception_ptr> errors(threadCount);
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount);
+    for (size_t t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&, t] {
+            try {
+                for (size_t i = next++; i < builders.size(); i = next++) {
+                    result[i] = builders[i]->create(threadCaches[t]);
+                }
+            } catch (...) {
+                errors[t] = std::current_exception();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (cache) {
+        device.mergePipelineCaches(cache, threadCaches);
+    }
+    for (const auto& threadCache : threadCaches) {
+        device.destroyPipelineCache(threadCache);
+    }
+
+    for (const auto& error : errors) {
+        if (error) {
+            for (const auto& pipeline : result) {
+                if (pipeline) {
+                    device.destroyPipeline(pipeline);
+                }
+            }
+            std::rethrow_exception(error);
+        }
+    }
+    return result;
+}
+
+uint64_t vks::pipelines::SpecializationConstants::hash() const {
+    KeyHasher hasher;
+    for (const auto& value : values) {
+        hasher.add(value.first);
+        hasher.add(value.second);
+    }
+    return hasher.hash;
+}
+
+using namespace vks::pipelines;
+
+void ExtendedDynamicState::append(std::vector<vk::DynamicState>& states) const {
+    const auto add = [&](vk::DynamicState state) {
+        if (std::find(states.begin(), states.end(), state) == states.end()) {
+            states.push_back(state);
+        }
+    };
+    if (rasterization) {
+        add(vk::DynamicState::eCullModeEXT);
+        add(vk::DynamicState::eFrontFaceEXT);
+        add(vk::DynamicState::ePrimitiveTopologyEXT);
+        add(vk::DynamicState::eDepthTestEnableEXT);
+        add(vk::DynamicState::eDepthWriteEnableEXT);
+        add(vk::DynamicState::eDepthCompareOpEXT);
+    }
+    if (depthBias) {
+        add(vk::DynamicState::eDepthBiasEnableEXT);
+        add(vk::DynamicState::eDepthBias);
+    }
+    if (polygonMode) {
+        add(vk::DynamicState::ePolygonModeEXT);
+    }
+}
+
+namespace {
+// A dynamic topology still has to be of the class the pipeline was created with
+uint32_t topologyClass(vk::PrimitiveTopology topology) {
+    switch (topology) {
+        case vk::PrimitiveTopology::ePointList:
+            return 0;
+        case vk::PrimitiveTopology::eLineList:
+        case vk::PrimitiveTopology::eLineStrip:
+        case vk::PrimitiveTopology::eLineListWithAdjacency:
+        case vk::PrimitiveTopology::eLineStripWithAdjacency:
+            return 1;
+        case vk::PrimitiveTopology::ePatchList:
+            return 3;
+        default:
+            return 2;
+    }
+}
+}  // namespace
+
+uint64_t DynamicRasterizationState::staticHash(const ExtendedDynamicState& dynamic) const {
+    KeyHasher hasher;
+    if (dynamic.rasterization) {
+        hasher.add(topologyClass(topology));
+    } else {
+        hasher.add((VkCullModeFlags)cullMode);
+        hasher.add(frontFace);
+        hasher.add(topology);
+        hasher.add(depthTestEnable);
+        hasher.add(depthWriteEnable);
+        hasher.add(depthCompareOp);
+    }
+    if (!dynamic.depthBias) {
+        hasher.add(depthBiasEnable);
+        hasher.add(depthBiasConstantFactor);
+        hasher.add(depthBiasClamp);
+        hasher.add(depthBiasSlopeFactor);
+    }
+    if (!dynamic.polygonMode) {
+        hasher.add(polygonMode);
+    }
+    return hasher.hash;
+}
+
+void DynamicRasterizationState::record(const vk::CommandBuffer& commandBuffer,
+                                       const ExtendedDynamicState& dynamic,
+                                       const vk::DispatchLoaderDynamic& dispatch) const {
+    if (dynamic.rasterization) {
+        commandBuffer.setCullModeEXT(cullMode, dispatch);
+        commandBuffer.setFrontFaceEXT(frontFace, dispatch);
+        commandBuffer.setPrimitiveTopologyEXT(topology, dispatch);
+        commandBuffer.setDepthTestEnableEXT(depthTestEnable, dispatch);
+        commandBuffer.setDepthWriteEnableEXT(depthWriteEnable, dispatch);
+        commandBuffer.setDepthCompareOpEXT(depthCompareOp, dispatch);
+    }
+    if (dynamic.depthBias) {
+        commandBuffer.setDepthBiasEnableEXT(depthBiasEnable, dispatch);
+        commandBuffer.setDepthBias(depthBiasConstantFactor, depthBiasClamp, depthBiasSlopeFactor);
+    }
+    if (dynamic.polygonMode) {
+        commandBuffer.setPolygonModeEXT(polygonMode, dispatch);
+    }
+}
+
+DynamicRasterizationState GraphicsPipelineBuilder::dynamicRasterizationState() const {
+    DynamicRasterizationState state;
+    state.cullMode = rasterizationState.cullMode;
+    state.frontFace = rasterizationState.frontFace;
+    state.topology = inputAssemblyState.topology;
+    state.depthTestEnable = depthStencilState.depthTestEnable;
+    state.depthWriteEnable = depthStencilState.depthWriteEnable;
+    state.depthCompareOp = depthStencilState.depthCompareOp;
+    state.depthBiasEnable = rasterizationState.depthBiasEnable;
+    state.depthBiasConstantFactor = rasterizationState.depthBiasConstantFactor;
+    state.depthBiasClamp = rasterizationState.depthBiasClamp;
+    state.depthBiasSlopeFactor = rasterizationState.depthBiasSlopeFactor;
+    state.polygonMode = rasterizationState.polygonMode;
+    return state;
+}
+
+void GraphicsPipelineBuilder::setDynamicRasterizationState(const DynamicRasterizationState& state) {
+    rasterizationState.cullMode = state.cullMode;
+    rasterizationState.frontFace = state.frontFace;
+    inputAssemblyState.topology = state.topology;
+    depthStencilState.depthTestEnable = state.depthTestEnable;
+    depthStencilState.depthWriteEnable = state.depthWriteEnable;
+    depthStencilState.depthCompareOp = state.depthCompareOp;
+    rasterizationState.depthBiasEnable = state.depthBiasEnable;
+    rasterizationState.depthBiasConstantFactor = state.depthBiasConstantFactor;
+    rasterizationState.depthBiasClamp = state.depthBiasClamp;
+    rasterizationState.depthBiasSlopeFactor = state.depthBiasSlopeFactor;
+    rasterizationState.polygonMode = state.polygonMode;
+}
+
+DynamicStatePipelines::DynamicStatePipelines(const vk::Device& device, const vk::PipelineLayout& layout, const vk::RenderPass& renderPass)
+    : builder(device, layout, renderPass) {}
+
+DynamicStatePipelines::~DynamicStatePipelines() {
+    destroy();
+}
+
+vk::Pipeline DynamicStatePipelines::get(const DynamicRasterizationState& state, const vk::PipelineCache& cache) {
+    const uint64_t key = state.staticHash(builder.extendedDynamicState);
+    auto itr = pipelines.find(key);
+    if (itr != pipelines.end()) {
+        return itr->second;
+    }
+    builder.setDynamicRasterizationState(state);
+    const vk::Pipeline pipeline = builder.create(cache);
+    pipelines[key] = pipeline;
+    return pipeline;
+}
+
+void DynamicStatePipelines::bind(const vk::CommandBuffer& commandBuffer,
+                                 const DynamicRasterizationState& state,
+                                 const vk::DispatchLoaderDynamic& dispatch,
+                                 const vk::PipelineCache& cache) {
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, get(state, cache));
+    state.record(commandBuffer, builder.extendedDynamicState, dispatch);
+}
+
+void DynamicStatePipelines::destroy() {
+    for (const auto& entry : pipelines) {
+        builder.device.destroyPipeline(entry.second);
+    }
+    pipelines.clear();
+}
+
+GraphicsPipelineVariants::GraphicsPipelineVariants(const vk::Device& device, const vk::PipelineLayout& layout, const vk::RenderPass& renderPass)
+    : builder(device, layout, renderPass) {}
+
+GraphicsPipelineVariants::~GraphicsPipelineVariants() {
+    destroy();
+}
+
+void GraphicsPipelineVariants::create(const SpecializationConstants& fallback,
+                                      const std::vector<SpecializationConstants>& queued,
+                                      const vk::PipelineCache& pipelineCache,
+                                      size_t threadCount) {
+    destroy();
+    cache = pipelineCache;
+    builder.update();
+    builder.pipelineCreateInfo.flags |= vk::PipelineCreateFlagBits::eAllowDerivatives;
+
+    fallbackVariant = &add(fallback);
+    fallbackVariant->pipeline = compile(*fallbackVariant, nullptr);
+    fallbackPipeline = fallbackVariant->pipeline;
+
+    if (threadCount == 0) {
+        threadCount = std::max<size_t>(1, ThreadPool::defaultThreadCount() - 1);
+    }
+    workers.reset(new ThreadPool(threadCount));
+    for (const auto& constants : queued) {
+        get(constants);
+    }
+}
+
+void GraphicsPipelineVariants::destroy() {
+    const auto& device = builder.device;
+    // Whatever is still compiling has to finish before anything it derives from or reads is gone
+    for (auto variant : pending) {
+        try {
+            auto pipeline = variant->compile.get();
+            if (pipeline) {
+                device.destroyPipeline(pipeline);
+            }
+        } catch (...) {
+        }
+    }
+    pending.clear();
+    workers.reset();
+
+    for (const auto& entry : variants) {
+        if (entry.second->pipeline) {
+            device.destroyPipeline(entry.second->pipeline);
+        }
+    }
+    variants.clear();
+    if (staleBase) {
+        device.destroyPipeline(staleBase);
+        staleBase = nullptr;
+    }
+    fallbackPipeline = nullptr;
+    fallbackVariant = nullptr;
+}
+
+vk::Pipeline GraphicsPipelineVariants::get(const SpecializationConstants& constants) {
+    if (!workers) {
+        throw std::runtime_error("Pipeline variants requested before create");
+    }
+    auto itr = variants.find(constants.hash());
+    if (itr != variants.end()) {
+        return itr->second->pipeline ? itr->second->pipeline : fallbackPipeline;
+    }
+
+    queue(add(constants), fallbackPipeline);
+    return fallbackPipeline;
+}
+
+void GraphicsPipelineVariants::queue(Variant& variant, const vk::Pipeline& base) {
+    const Variant* compiled = &variant;
+    variant.compile = workers->submit([this, compiled, base] { return compile(*compiled, base); });
+    pending.push_back(&variant);
+}
+
+bool GraphicsPipelineVariants::poll() {
+    bool ready = false;
+    for (auto itr = pending.begin(); itr != pending.end();) {
+        auto& variant = **itr;
+        if (variant.compile.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++itr;
+            continue;
+        }
+        // Out of the pending list before get can throw, a failed variant keeps falling back
+        itr = pending.erase(itr);
+        const auto pipeline = variant.compile.get();
+        if (&variant == fallbackVariant) {
+            // Reloaded variants still compiling may derive from the old fallback
+            staleBase = variant.pipeline;
+            fallbackPipeline = pipeline;
+        } else if (variant.pipeline) {
+            retirePipeline(variant.pipeline);
+        }
+        variant.pipeline = pipeline;
+        ready = true;
+    }
+    if (staleBase && pending.empty()) {
+        retirePipeline(staleBase);
+        staleBase = nullptr;
+    }
+    return ready;
+}
+
+void GraphicsPipelineVariants::wait() {
+    for (const auto variant : pending) {
+        variant->compile.wait();
+    }
+    poll();
+}
+
+bool GraphicsPipelineVariants::reload(const std::vector<std::string>& files) {
+    std::vector<size_t> stages;
+    for (size_t i = 0; i < builder.shaderFiles.size(); ++i) {
+        if (std::find(files.begin(), files.end(), builder.shaderFiles[i]) != files.end()) {
+            stages.push_back(i);
+        }
+    }
+    if (stages.empty() || !workers) {
+        return !stages.empty();
+    }
+
+    // Compiles in flight read the stages being replaced
+    wait();
+    for (const auto i : stages) {
+        auto& stage = builder.shaderStages[i];
+        vks::shaders::releaseShaderModule(builder.device, stage.module);
+        stage.module = vks::shaders::acquireShaderModule(builder.device, builder.shaderFiles[i]);
+    }
+    builder.update();
+    // Derived from the pipeline the fallback replaces, which only has to exist while they're created
+    for (const auto& entry : variants) {
+        queue(*entry.second, fallbackPipeline);
+    }
+    return true;
+}
+
+void GraphicsPipelineVariants::retirePipeline(const vk::Pipeline& pipeline) {
+    if (retire) {
+        retire(pipeline);
+    } else {
+        builder.device.waitIdle();
+        builder.device.destroyPipeline(pipeline);
+    }
+}
+
+GraphicsPipelineVariants::Variant& GraphicsPipelineVariants::add(const SpecializationConstants& constants) {
+    auto& variant = variants[constants.hash()];
+    variant.reset(new Variant());
+    for (const auto& value : constants.values) {
+        const auto offset = static_cast<uint32_t>(variant->data.size() * sizeof(uint32_t));
+        variant->entries.push_back({ value.first, offset, sizeof(uint32_t) });
+        variant->data.push_back(value.second);
+    }
+    variant->info.mapEntryCount = static_cast<uint32_t>(variant->entries.size());
+    variant->info.pMapEntries = variant->entries.data();
+    variant->info.dataSize = variant->data.size() * sizeof(uint32_t);
+    variant->info.pData = variant->data.data();
+    return *variant;
+}
+
+// Only reads the builder, so any number of these run at once.  Pipeline caches are internally synchronized.
+vk::Pipeline GraphicsPipelineVariants::compile(const Variant& variant, const vk::Pipeline& base) const {
+    VKS_TRACE_ZONE("GraphicsPipelineVariants::compile");
+    startup::ScopedPhase startupPhase(startup::Phase::Pipelines);
+    auto stages = builder.shaderStages;
+    for (auto& stage : stages) {
+        stage.pSpecializationInfo = &variant.info;
+    }
+    auto createInfo = builder.pipelineCreateInfo;
+    createInfo.stageCount = static_cast<uint32_t>(stages.size());
+    createInfo.pStages = stages.data();
+    if (base) {
+        createInfo.flags |= vk::PipelineCreateFlagBits::eDerivative;
+        createInfo.basePipelineHandle = base;
+        createInfo.basePipelineIndex = -1;
+    }
+    return builder.device.createGraphicsPipeline(cache, createInfo);
+}
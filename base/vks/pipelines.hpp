@@ -1,8 +1,18 @@
 #pragma once
 
+#include <cstring>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <unordered_map>
+
 #include "context.hpp"
 #include "model.hpp"
+#include "reflection.hpp"
 #include "shaders.hpp"
+#include "startup.hpp"
+#include "trace.hpp"
 
 namespace vks { namespace pipelines {
 struct PipelineRasterizationStateCreateInfo : public vk::PipelineRasterizationStateCreateInfo {
@@ -50,15 +60,44 @@ struct PipelineColorBlendStateCreateInfo : public vk::PipelineColorBlendStateCre
     }
 };
 
+// Groups of the state in DynamicRasterizationState that pipelines leave to the command buffer rather than bake in,
+// Context::enableExtendedDynamicState requests the extensions
+struct ExtendedDynamicState {
+    // VK_EXT_extended_dynamic_state: cull mode, front face, topology and the depth test, write and compare op
+    bool rasterization{ false };
+    // VK_EXT_extended_dynamic_state2: whether depth bias is enabled, along with the bias
+    bool depthBias{ false };
+    // VK_EXT_extended_dynamic_state3: polygon mode
+    bool polygonMode{ false };
+
+    // Every group the context enabled
+    static ExtendedDynamicState enabled(const vks::Context& context) {
+        ExtendedDynamicState result;
+        result.rasterization = context.extendedDynamicStateEnabled;
+        result.depthBias = context.extendedDynamicState2Enabled;
+        result.polygonMode = context.dynamicPolygonModeEnabled;
+        return result;
+    }
+
+    // Add the dynamic states of the groups that are set to `states`, skipping any that are there already
+    void append(std::vector<vk::DynamicState>& states) const;
+};
+
 struct PipelineDynamicStateCreateInfo : public vk::PipelineDynamicStateCreateInfo {
     std::vector<vk::DynamicState> dynamicStateEnables;
 
     PipelineDynamicStateCreateInfo() { dynamicStateEnables = { vk::DynamicState::eViewport, vk::DynamicState::eScissor }; }
 
-    void update() {
-        this->dynamicStateCount = (uint32_t)dynamicStateEnables.size();
-        this->pDynamicStates = dynamicStateEnables.data();
+    void update(const ExtendedDynamicState& extended = {}) {
+        enabledStates = dynamicStateEnables;
+        extended.append(enabledStates);
+        this->dynamicStateCount = (uint32_t)enabledStates.size();
+        this->pDynamicStates = enabledStates.data();
     }
+
+private:
+    // dynamicStateEnables and those of the extended state
+    std::vector<vk::DynamicState> enabledStates;
 };
 
 struct PipelineVertexInputStateCreateInfo : public vk::PipelineVertexInputStateCreateInfo {
@@ -118,6 +157,49 @@ struct PipelineDepthStencilStateCreateInfo : public vk::PipelineDepthStencilStat
         }
     }
 };
+// The attachment formats of a pipeline used with dynamic rendering (VK_KHR_dynamic_rendering) rather than within a
+// render pass.  Pipelines with the same formats work with any targets of those formats.
+struct PipelineRenderingCreateInfo : public vk::PipelineRenderingCreateInfoKHR {
+    std::vector<vk::Format> colorAttachmentFormats;
+
+    PipelineRenderingCreateInfo() = default;
+    PipelineRenderingCreateInfo(const std::vector<vk::Format>& colorFormats, vk::Format depthFormat, vk::Format stencilFormat = vk::Format::eUndefined)
+        : colorAttachmentFormats(colorFormats) {
+        depthAttachmentFormat = depthFormat;
+        stencilAttachmentFormat = stencilFormat;
+    }
+
+    bool empty() const {
+        return colorAttachmentFormats.empty() && depthAttachmentFormat == vk::Format::eUndefined && stencilAttachmentFormat == vk::Format::eUndefined;
+    }
+
+    void update() {
+        colorAttachmentCount = (uint32_t)colorAttachmentFormats.size();
+        pColorAttachmentFormats = colorAttachmentFormats.data();
+    }
+};
+
+// The state ExtendedDynamicState covers.  The builder bakes it into pipelines where the device can't set it on the
+// command buffer.
+struct DynamicRasterizationState {
+    vk::CullModeFlags cullMode{ vk::CullModeFlagBits::eBack };
+    vk::FrontFace frontFace{ vk::FrontFace::eCounterClockwise };
+    vk::PrimitiveTopology topology{ vk::PrimitiveTopology::eTriangleList };
+    vk::Bool32 depthTestEnable{ VK_TRUE };
+    vk::Bool32 depthWriteEnable{ VK_TRUE };
+    vk::CompareOp depthCompareOp{ vk::CompareOp::eLessOrEqual };
+    vk::Bool32 depthBiasEnable{ VK_FALSE };
+    float depthBiasConstantFactor{ 0.0f };
+    float depthBiasClamp{ 0.0f };
+    float depthBiasSlopeFactor{ 0.0f };
+    vk::PolygonMode polygonMode{ vk::PolygonMode::eFill };
+
+    // Of the values `dynamic` doesn't cover, which are all a pipeline has to be specific to
+    uint64_t staticHash(const ExtendedDynamicState& dynamic) const;
+    // Set the values `dynamic` covers
+    void record(const vk::CommandBuffer& commandBuffer, const ExtendedDynamicState& dynamic, const vk::DispatchLoaderDynamic& dispatch) const;
+};
+
 struct GraphicsPipelineBuilder {
 private:
     void init() {
@@ -139,8 +221,16 @@ public:
         init();
     }
 
+    GraphicsPipelineBuilder(const vk::Device& device, const vk::PipelineLayout layout, const PipelineRenderingCreateInfo& renderingState)
+        : GraphicsPipelineBuilder(device, layout, vk::RenderPass()) {
+        this->renderingState = renderingState;
+    }
+
     GraphicsPipelineBuilder(const GraphicsPipelineBuilder& other)
-        : GraphicsPipelineBuilder(other.device, other.layout, other.renderPass) {}
+        : GraphicsPipelineBuilder(other.device, other.layout, other.renderPass) {
+        renderingState = other.renderingState;
+        extendedDynamicState = other.extendedDynamicState;
+    }
 
     GraphicsPipelineBuilder& operator=(const GraphicsPipelineBuilder& other) = delete;
 
@@ -159,38 +249,203 @@ public:
     PipelineDynamicStateCreateInfo dynamicState;
     PipelineColorBlendStateCreateInfo colorBlendState;
     PipelineVertexInputStateCreateInfo vertexInputState;
+    // Only used without a render pass, for dynamic rendering
+    PipelineRenderingCreateInfo renderingState;
+    // The groups of DynamicRasterizationState to make dynamic, none by default.  Their static values are ignored and
+    // must be recorded in the command buffers, see DynamicStatePipelines.
+    ExtendedDynamicState extendedDynamicState;
     std::vector<vk::PipelineShaderStageCreateInfo> shaderStages;
+    // The file each of shaderStages was loaded from
+    std::vector<std::string> shaderFiles;
 
     vk::GraphicsPipelineCreateInfo pipelineCreateInfo;
 
     void update() {
         pipelineCreateInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
         pipelineCreateInfo.pStages = shaderStages.data();
-        dynamicState.update();
+        dynamicState.update(extendedDynamicState);
         colorBlendState.update();
         vertexInputState.update();
         viewportState.update();
+        renderingState.update();
+        pipelineCreateInfo.pNext = (!renderPass && !renderingState.empty()) ? &renderingState : nullptr;
     }
 
+    // Modules that came from the device's shader module cache are released back to it rather than destroyed
     void destroyShaderModules() {
         for (const auto shaderStage : shaderStages) {
-            device.destroyShaderModule(shaderStage.module);
+            vks::shaders::releaseShaderModule(device, shaderStage.module);
         }
         shaderStages.clear();
+        shaderFiles.clear();
     }
 
-    // Load a SPIR-V shader
+    // Load a SPIR-V shader, through the device's shader module cache if it has one
     vk::PipelineShaderStageCreateInfo& loadShader(const std::string& fileName, vk::ShaderStageFlagBits stage, const char* entryPoint = "main") {
-        vk::PipelineShaderStageCreateInfo shaderStage = vks::shaders::loadShader(device, fileName, stage, entryPoint);
+        startup::ScopedPhase startupPhase(startup::Phase::Pipelines);
+        vk::PipelineShaderStageCreateInfo shaderStage;
+        shaderStage.stage = stage;
+        shaderStage.module = vks::shaders::acquireShaderModule(device, fileName);
+        shaderStage.pName = entryPoint;
         shaderStages.push_back(shaderStage);
+        shaderFiles.push_back(fileName);
         return shaderStages.back();
     }
 
+    // The layout of the loaded stages, for vks::LayoutCache
+    shaders::ShaderLayout reflectLayout() const;
+
+    // The static values of the state extendedDynamicState can cover, and setting them
+    DynamicRasterizationState dynamicRasterizationState() const;
+    void setDynamicRasterizationState(const DynamicRasterizationState& state);
+
     vk::Pipeline create(const vk::PipelineCache& cache) {
+        VKS_TRACE_ZONE("GraphicsPipelineBuilder::create");
+        startup::ScopedPhase startupPhase(startup::Phase::Pipelines);
         update();
         return device.createGraphicsPipeline(cache, pipelineCreateInfo);
     }
 
     vk::Pipeline create() { return create(pipelineCache); }
 };
+
+// Compile all of `builders` across `threadCount` threads (0 means one per hardware thread).  Each thread
+// compiles into a private pipeline cache seeded from `cache`, and the private caches are merged back
+// into `cache` afterwards, so the driver never serializes the workers on a shared cache lock.
+//
+// The returned pipelines are in the same order as `builders`.
+std::vector<vk::Pipeline> createGraphicsPipelines(const vk::Device& device,
+                                                  const std::vector<GraphicsPipelineBuilder*>& builders,
+                                                  const vk::PipelineCache& cache = vk::PipelineCache(),
+                                                  size_t threadCount = 0);
+
+// Values of specialization constants, by constant id.  Every constant is 32 bits, which covers GLSL int, uint, float
+// and bool constants.  The same values go to all shader stages, stages ignore the ids they don't declare.
+struct SpecializationConstants {
+    std::map<uint32_t, uint32_t> values;
+
+    SpecializationConstants& set(uint32_t id, uint32_t value) {
+        values[id] = value;
+        return *this;
+    }
+    SpecializationConstants& set(uint32_t id, int32_t value) { return set(id, static_cast<uint32_t>(value)); }
+    SpecializationConstants& set(uint32_t id, float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return set(id, bits);
+    }
+    SpecializationConstants& set(uint32_t id, bool value) { return set(id, static_cast<uint32_t>(value ? VK_TRUE : VK_FALSE)); }
+
+    uint64_t hash() const;
+};
+
+// Pipelines that share all of their state but the DynamicRasterizationState, each drawn by binding it along with
+// that state.  Only what the device can't set dynamically gets a pipeline of its own, values that differ just in
+// the groups of builder.extendedDynamicState share one.  With all of ExtendedDynamicState, cull mode, depth state,
+// depth bias and wireframe variants are a single pipeline.
+class DynamicStatePipelines {
+public:
+    DynamicStatePipelines(const vk::Device& device,
+                          const vk::PipelineLayout& layout = vk::PipelineLayout(),
+                          const vk::RenderPass& renderPass = vk::RenderPass());
+    ~DynamicStatePipelines();
+
+    DynamicStatePipelines(const DynamicStatePipelines& other) = delete;
+    DynamicStatePipelines& operator=(const DynamicStatePipelines& other) = delete;
+
+    // The state the pipelines share, which must not change once there are any.  Set extendedDynamicState to the
+    // groups the device has, see ExtendedDynamicState::enabled.
+    GraphicsPipelineBuilder builder;
+
+    // The pipeline for `state`, created on first use
+    vk::Pipeline get(const DynamicRasterizationState& state, const vk::PipelineCache& cache = vk::PipelineCache());
+    // Bind the pipeline for `state` and set its dynamic parts
+    void bind(const vk::CommandBuffer& commandBuffer,
+              const DynamicRasterizationState& state,
+              const vk::DispatchLoaderDynamic& dispatch,
+              const vk::PipelineCache& cache = vk::PipelineCache());
+    void destroy();
+
+    size_t pipelineCount() const { return pipelines.size(); }
+
+private:
+    std::unordered_map<uint64_t, vk::Pipeline> pipelines;
+};
+
+class ThreadPool;
+
+// Pipelines that share all of their state but the values of their specialization constants, compiled on demand.
+// The pipeline of the values given to create is the fallback, which is built right away and which all other
+// variants derive from.  The first get of any other values queues their pipeline for compilation on a background
+// thread and returns the fallback until it's done, so the number of permutations doesn't add to startup time.
+//
+// One instance per base pipeline state, variants are keyed by their values.  Not thread safe, only the compiles run
+// on other threads.
+class GraphicsPipelineVariants {
+public:
+    GraphicsPipelineVariants(const vk::Device& device,
+                             const vk::PipelineLayout& layout = vk::PipelineLayout(),
+                             const vk::RenderPass& renderPass = vk::RenderPass());
+    ~GraphicsPipelineVariants();
+
+    GraphicsPipelineVariants(const GraphicsPipelineVariants& other) = delete;
+    GraphicsPipelineVariants& operator=(const GraphicsPipelineVariants& other) = delete;
+
+    // The state the variants share, which must not change after create.  The specialization info of its shader
+    // stages is replaced by that of each variant.
+    GraphicsPipelineBuilder builder;
+
+    // Builds the fallback and queues the compiles of `queued`.  Compiles use `cache`, which has to outlive them, and
+    // `threadCount` threads, 0 leaving one hardware thread to the caller.
+    void create(const SpecializationConstants& fallback,
+                const std::vector<SpecializationConstants>& queued = {},
+                const vk::PipelineCache& cache = vk::PipelineCache(),
+                size_t threadCount = 0);
+    // Waits for the compiles in flight and destroys all pipelines
+    void destroy();
+
+    // The pipeline of `constants` if it's compiled, otherwise the fallback, queuing the compile if it isn't already
+    vk::Pipeline get(const SpecializationConstants& constants);
+    vk::Pipeline fallback() const { return fallbackPipeline; }
+    // Whether any variants finished compiling since the last call, in which case command buffers recorded with the
+    // fallback in their place are worth recording again.  Rethrows the errors of failed compiles.
+    bool poll();
+    // Blocks until all queued variants are compiled
+    void wait();
+    // If any of the builder's shaders is in `files`, loads them again and recompiles every variant in the background.
+    // Until its new pipeline is done each variant keeps its old one, which poll hands to `retire` once replaced.
+    // Returns whether the variants use any of `files`.
+    bool reload(const std::vector<std::string>& files);
+
+    // Destroys pipelines replaced by reload, it defaults to waiting for the device to be idle first.  Pipelines
+    // still in use by command buffers in flight are best left to something like Context::trash.
+    std::function<void(const vk::Pipeline&)> retire;
+
+    size_t readyCount() const { return variants.size() - pending.size(); }
+    size_t pendingCount() const { return pending.size(); }
+
+private:
+    struct Variant {
+        std::vector<vk::SpecializationMapEntry> entries;
+        std::vector<uint32_t> data;
+        vk::SpecializationInfo info;
+        std::future<vk::Pipeline> compile;
+        vk::Pipeline pipeline;
+    };
+
+    Variant& add(const SpecializationConstants& constants);
+    void queue(Variant& variant, const vk::Pipeline& base);
+    void retirePipeline(const vk::Pipeline& pipeline);
+    vk::Pipeline compile(const Variant& variant, const vk::Pipeline& base) const;
+
+    vk::PipelineCache cache;
+    vk::Pipeline fallbackPipeline;
+    Variant* fallbackVariant{ nullptr };
+    // A fallback replaced by reload, kept until nothing compiling derives from it
+    vk::Pipeline staleBase;
+    std::unordered_map<uint64_t, std::unique_ptr<Variant>> variants;
+    // Queued or compiling
+    std::vector<Variant*> pending;
+    std::unique_ptr<ThreadPool> workers;
+};
 }}  // namespace vks::pipelines
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "swapchain.hpp"
+
+namespace vks {
+
+// Presents the current images of several swap chains of one device in a single vkQueuePresentKHR, so that windows
+// drawn by one frame loop go to the presentation engine together, in one call into the driver per frame rather than
+// one per window.  Each image waits on a semaphore of its own, and with display timing gets the next present id of
+// its swap chain and a desired present time, see SwapChain::queuePresent.
+class PresentBatch {
+public:
+    void add(SwapChain& swapChain, const vk::Semaphore& waitSemaphore, uint64_t desiredPresentTime = 0) {
+        swapChains.push_back(swapChain.swapChain);
+        imageIndices.push_back(swapChain.currentImage);
+        if (waitSemaphore) {
+            waitSemaphores.push_back(waitSemaphore);
+        }
+        // Display timing is a device extension, so the swap chains either all have it or none of them do
+        if (swapChain.displayTiming) {
+            times.push_back({ ++swapChain.presentId, desiredPresentTime });
+        }
+    }
+
+    size_t size() const { return swapChains.size(); }
+    bool empty() const { return swapChains.empty(); }
+
+    // Present everything added since the last call, returning the result of each swap chain in the order they were
+    // added.  Out of date swap chains are reported there rather than thrown, so one window being resized doesn't
+    // lose the presents of the others, which still go ahead.  Other errors throw as usual.
+    const std::vector<vk::Result>& present(const vk::Queue& queue) {
+        results.assign(swapChains.size(), vk::Result::eSuccess);
+        if (!swapChains.empty()) {
+            vk::PresentTimesInfoGOOGLE timesInfo{ (uint32_t)times.size(), times.data() };
+            vk::PresentInfoKHR presentInfo;
+            presentInfo.pNext = times.size() == swapChains.size() ? &timesInfo : nullptr;
+            presentInfo.waitSemaphoreCount = (uint32_t)waitSemaphores.size();
+            presentInfo.pWaitSemaphores = waitSemaphores.data();
+            presentInfo.swapchainCount = (uint32_t)swapChains.size();
+            presentInfo.pSwapchains = swapChains.data();
+            presentInfo.pImageIndices = imageIndices.data();
+            presentInfo.pResults = results.data();
+            try {
+                queue.presentKHR(presentInfo);
+            } catch (const vk::OutOfDateKHRError&) {
+                // pResults has the swap chains it applies to
+            }
+        }
+        swapChains.clear();
+        imageIndices.clear();
+        waitSemaphores.clear();
+        times.clear();
+        return results;
+    }
+
+private:
+    std::vector<vk::SwapchainKHR> swapChains;
+    std::vector<uint32_t> imageIndices;
+    std::vector<vk::Semaphore> waitSemaphores;
+    std::vector<vk::PresentTimeGOOGLE> times;
+    std::vector<vk::Result> results;
+};
+
+}  // namespace vks
@@ -0,0 +1,291 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+
+#include "trace.hpp"
+
+using namespace vks::debug;
+
+namespace {
+
+// In the order of the bits, which is the order query results are written in
+const std::vector<std::pair<vk::QueryPipelineStatisticFlagBits, const char*>> STATISTICS{
+    { vk::QueryPipelineStatisticFlagBits::eInputAssemblyVertices, "inputAssemblyVertices" },
+    { vk::QueryPipelineStatisticFlagBits::eInputAssemblyPrimitives, "inputAssemblyPrimitives" },
+    { vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations, "vertexShaderInvocations" },
+    { vk::QueryPipelineStatisticFlagBits::eGeometryShaderInvocations, "geometryShaderInvocations" },
+    { vk::QueryPipelineStatisticFlagBits::eGeometryShaderPrimitives, "geometryShaderPrimitives" },
+    { vk::QueryPipelineStatisticFlagBits::eClippingInvocations, "clippingInvocations" },
+    { vk::QueryPipelineStatisticFlagBits::eClippingPrimitives, "clippingPrimitives" },
+    { vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations, "fragmentShaderInvocations" },
+    { vk::QueryPipelineStatisticFlagBits::eTessellationControlShaderPatches, "tessellationControlShaderPatches" },
+    { vk::QueryPipelineStatisticFlagBits::eTessellationEvaluationShaderInvocations, "tessellationEvaluationShaderInvocations" },
+    { vk::QueryPipelineStatisticFlagBits::eComputeShaderInvocations, "computeShaderInvocations" },
+};
+
+// Whether every query of `count` results, each followed by its availability, is available
+bool available(const std::vector<uint64_t>& results, uint32_t count, uint32_t valuesPerQuery) {
+    for (uint32_t i = 0; i < count; ++i) {
+        if (results[i * (valuesPerQuery + 1) + valuesPerQuery] == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+void GpuProfiler::create(const vk::PhysicalDevice& physicalDevice,
+                         const vk::Device& device,
+                         uint32_t queueFamilyIndex,
+                         uint32_t slotCount,
+                         uint32_t maxScopes,
+                         vk::QueryPipelineStatisticFlags statistics,
+                         uint32_t statisticsDepth) {
+    destroy();
+    const auto queueFamilies = physicalDevice.getQueueFamilyProperties();
+    const uint32_t validBits = queueFamilyIndex < queueFamilies.size() ? queueFamilies[queueFamilyIndex].timestampValidBits : 0;
+    if (validBits == 0 || slotCount == 0 || maxScopes == 0) {
+        return;
+    }
+
+    this->device = device;
+    this->maxScopes = maxScopes;
+    timestampPeriod = physicalDevice.getProperties().limits.timestampPeriod;
+    timestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+    statisticFlags = statistics;
+    this->statisticsDepth = statisticsDepth;
+    statisticNames.clear();
+    for (const auto& statistic : STATISTICS) {
+        if (statistics & statistic.first) {
+            statisticNames.push_back(statistic.second);
+        }
+    }
+    slots.resize(slotCount);
+    for (auto& slot : slots) {
+        slot.pool = device.createQueryPool({ {}, vk::QueryType::eTimestamp, maxScopes * 2 });
+        if (statistics) {
+            slot.statisticsPool = device.createQueryPool({ {}, vk::QueryType::ePipelineStatistics, maxScopes, statistics });
+        }
+    }
+}
+
+void GpuProfiler::destroy() {
+    for (auto& slot : slots) {
+        device.destroyQueryPool(slot.pool);
+        device.destroyQueryPool(slot.statisticsPool);
+    }
+    slots.clear();
+    recordings.clear();
+    scopes.clear();
+    reports.clear();
+    statisticNames.clear();
+    statisticFlags = {};
+}
+
+void GpuProfiler::beginCommandBuffer(const vk::CommandBuffer& cmdBuffer, uint32_t slotIndex) {
+    if (slotIndex >= slots.size()) {
+        return;
+    }
+    auto& slot = slots[slotIndex];
+    slot.names.clear();
+    slot.depths.clear();
+    slot.statisticsQueries.clear();
+    slot.statisticsCount = 0;
+    cmdBuffer.resetQueryPool(slot.pool, 0, maxScopes * 2);
+    if (slot.statisticsPool) {
+        cmdBuffer.resetQueryPool(slot.statisticsPool, 0, maxScopes);
+    }
+    auto& recording = recordings[static_cast<VkCommandBuffer>(cmdBuffer)];
+    recording.slot = slotIndex;
+    recording.open.clear();
+}
+
+void GpuProfiler::endCommandBuffer(const vk::CommandBuffer& cmdBuffer) {
+    auto itr = recordings.find(static_cast<VkCommandBuffer>(cmdBuffer));
+    if (itr == recordings.end()) {
+        return;
+    }
+    // Close anything left open so that every scope has both of its timestamps written
+    while (!itr->second.open.empty()) {
+        endScope(cmdBuffer);
+    }
+    recordings.erase(itr);
+}
+
+void GpuProfiler::beginScope(const vk::CommandBuffer& cmdBuffer, const std::string& name) {
+    auto itr = recordings.find(static_cast<VkCommandBuffer>(cmdBuffer));
+    if (itr == recordings.end()) {
+        return;
+    }
+    auto& recording = itr->second;
+    auto& slot = slots[recording.slot];
+    const uint32_t index = (uint32_t)slot.names.size();
+    if (index >= maxScopes) {
+        // Mark the scope as open without a query, so the matching endScope stays balanced
+        recording.open.push_back(UINT32_MAX);
+        return;
+    }
+    const uint32_t depth = (uint32_t)recording.open.size();
+    slot.names.push_back(name);
+    slot.depths.push_back(depth);
+    recording.open.push_back(index);
+    cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, slot.pool, index * 2);
+    if (slot.statisticsPool && depth == statisticsDepth) {
+        slot.statisticsQueries.push_back(slot.statisticsCount);
+        cmdBuffer.beginQuery(slot.statisticsPool, slot.statisticsCount++, {});
+    } else {
+        slot.statisticsQueries.push_back(UINT32_MAX);
+    }
+}
+
+void GpuProfiler::endScope(const vk::CommandBuffer& cmdBuffer) {
+    auto itr = recordings.find(static_cast<VkCommandBuffer>(cmdBuffer));
+    if (itr == recordings.end() || itr->second.open.empty()) {
+        return;
+    }
+    auto& recording = itr->second;
+    const uint32_t index = recording.open.back();
+    recording.open.pop_back();
+    if (index != UINT32_MAX) {
+        const auto& slot = slots[recording.slot];
+        if (slot.statisticsQueries[index] != UINT32_MAX) {
+            cmdBuffer.endQuery(slot.statisticsPool, slot.statisticsQueries[index]);
+        }
+        cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, slot.pool, index * 2 + 1);
+    }
+}
+
+void GpuProfiler::collect(uint32_t slotIndex) {
+    if (slotIndex >= slots.size()) {
+        return;
+    }
+    const auto& slot = slots[slotIndex];
+    const uint32_t count = (uint32_t)slot.names.size();
+    if (count == 0) {
+        return;
+    }
+
+    // Value / availability pairs for each query
+    std::vector<uint64_t> results(count * 2 * 2);
+    const vk::Result result = device.getQueryPoolResults(slot.pool, 0, count * 2, results.size() * sizeof(uint64_t), results.data(),
+                                                         sizeof(uint64_t) * 2, vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+    if (result != vk::Result::eSuccess && result != vk::Result::eNotReady) {
+        return;
+    }
+    if (!available(results, count * 2, 1)) {
+        return;
+    }
+
+    // Counters / availability for each statistics query
+    const uint32_t counters = (uint32_t)statisticNames.size();
+    std::vector<uint64_t> statistics(slot.statisticsCount * (counters + 1));
+    if (slot.statisticsCount) {
+        const vk::Result statisticsResult =
+            device.getQueryPoolResults(slot.statisticsPool, 0, slot.statisticsCount, statistics.size() * sizeof(uint64_t), statistics.data(),
+                                       sizeof(uint64_t) * (counters + 1), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+        if ((statisticsResult != vk::Result::eSuccess && statisticsResult != vk::Result::eNotReady) || !available(statistics, slot.statisticsCount, counters)) {
+            return;
+        }
+    }
+
+    const bool sameLayout = scopes.size() == count;
+    scopes.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint64_t begin = results[i * 4] & timestampMask;
+        const uint64_t end = results[i * 4 + 2] & timestampMask;
+        const double milliseconds = (double)((end - begin) & timestampMask) * timestampPeriod / 1.0e6;
+        auto& scope = scopes[i];
+        if (sameLayout && scope.name == slot.names[i]) {
+            scope.milliseconds = scope.milliseconds * 0.9 + milliseconds * 0.1;
+        } else {
+            scope.name = slot.names[i];
+            scope.milliseconds = milliseconds;
+        }
+        scope.lastMilliseconds = milliseconds;
+        scope.depth = slot.depths[i];
+        scope.begin = (double)begin * timestampPeriod / 1.0e6;
+        scope.end = scope.begin + milliseconds;
+        scope.statistics.clear();
+        const uint32_t query = slot.statisticsQueries[i];
+        if (query != UINT32_MAX) {
+            const auto first = statistics.begin() + query * (counters + 1);
+            scope.statistics.assign(first, first + counters);
+        }
+    }
+    ++collections;
+}
+
+const GpuProfiler::Scope* GpuProfiler::findScope(const std::string& name) const {
+    const auto itr = std::find_if(scopes.begin(), scopes.end(), [&](const Scope& scope) { return scope.name == name; });
+    return itr != scopes.end() ? &*itr : nullptr;
+}
+
+uint64_t GpuProfiler::getStatistic(const std::string& scopeName, const std::string& counterName) const {
+    const Scope* scope = findScope(scopeName);
+    const auto counter = std::find(statisticNames.begin(), statisticNames.end(), counterName);
+    if (!scope || counter == statisticNames.end() || scope->statistics.empty()) {
+        return 0;
+    }
+    return scope->statistics[counter - statisticNames.begin()];
+}
+
+void GpuProfiler::report(const std::string& name, double milliseconds) {
+    for (auto& report : reports) {
+        if (report.name == name) {
+            report.milliseconds = report.milliseconds * 0.9 + milliseconds * 0.1;
+            report.lastMilliseconds = milliseconds;
+            return;
+        }
+    }
+    Scope report;
+    report.name = name;
+    report.milliseconds = milliseconds;
+    report.lastMilliseconds = milliseconds;
+    reports.push_back(report);
+}
+
+bool TimestampCalibration::calibrate(const vk::PhysicalDevice& physicalDevice, const vk::Device& device, const vk::DispatchLoaderDynamic& dispatch) {
+    if (!dispatch.vkGetCalibratedTimestampsEXT || !dispatch.vkGetPhysicalDeviceCalibrateableTimeDomainsEXT) {
+        return false;
+    }
+    // The time domains of std::chrono::steady_clock, see vks::trace::now
+#if defined(_WIN32)
+    const VkTimeDomainEXT cpuDomain = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+#elif defined(__linux__) || defined(__ANDROID__)
+    const VkTimeDomainEXT cpuDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+#else
+    // None known, so the domain check below fails
+    const VkTimeDomainEXT cpuDomain = VK_TIME_DOMAIN_MAX_ENUM_EXT;
+#endif
+    uint32_t domainCount = 0;
+    dispatch.vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(physicalDevice, &domainCount, nullptr);
+    std::vector<VkTimeDomainEXT> domains(domainCount);
+    dispatch.vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(physicalDevice, &domainCount, domains.data());
+    if (std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_DEVICE_EXT) == domains.end() ||
+        std::find(domains.begin(), domains.end(), cpuDomain) == domains.end()) {
+        return false;
+    }
+
+    VkCalibratedTimestampInfoEXT infos[2]{};
+    infos[0].sType = infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+    infos[1].timeDomain = cpuDomain;
+    uint64_t timestamps[2]{};
+    uint64_t maxDeviation = 0;
+    if (dispatch.vkGetCalibratedTimestampsEXT(device, 2, infos, timestamps, &maxDeviation) != VK_SUCCESS) {
+        return false;
+    }
+#if defined(_WIN32)
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    const double cpuNanoseconds = (double)timestamps[1] * 1.0e9 / (double)frequency.QuadPart;
+#else
+    const double cpuNanoseconds = (double)timestamps[1];
+#endif
+    const double timestampPeriod = physicalDevice.getProperties().limits.timestampPeriod;
+    offset = cpuNanoseconds - (double)timestamps[0] * timestampPeriod;
+    calibrated = true;
+    calibratedAt = vks::trace::now();
+    return true;
+}
@@ -0,0 +1,143 @@
+/*
+* GPU timestamp profiler
+*
+* Turns debug marker regions into timestamp query pairs, so the same
+* vks::debug::marker::beginRegion / endRegion calls used for RenderDoc labels
+* also produce per pass GPU timings, and optionally per pass pipeline
+* statistics.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+namespace vks { namespace debug {
+
+// Command buffers are profiled in "slots", each with its own query pool.  A slot must only be
+// recorded into again (or collected) once the previous submission of the command buffer using it
+// has completed, so typically there is one slot per pre-recorded command buffer (or per frame in
+// flight for command buffers that are re-recorded every frame).
+//
+// With pipeline statistics, the scopes at `statisticsDepth` also count the primitives and shader
+// invocations of their commands.  Only one pipeline statistics query can be active at a time, so
+// scopes at that depth must not be nested in each other, and like any query they must begin and
+// end in the same subpass when they begin inside a render pass.
+class GpuProfiler {
+public:
+    struct Scope {
+        std::string name;
+        uint32_t depth{ 0 };
+        // Exponentially smoothed over successive collections
+        double milliseconds{ 0.0 };
+        // Unsmoothed result of the most recent collection
+        double lastMilliseconds{ 0.0 };
+        // When the most recent collection began and ended on the device's timestamp clock, in milliseconds
+        double begin{ 0.0 };
+        double end{ 0.0 };
+        // Pipeline statistics of the most recent collection, in the order of getStatisticNames(), empty for scopes
+        // that don't count them
+        std::vector<uint64_t> statistics;
+    };
+
+    // Does nothing if the queue family doesn't support timestamps.  `statistics` requires the pipelineStatisticsQuery
+    // feature, along with the geometry and tessellation shader features for their counters.
+    void create(const vk::PhysicalDevice& physicalDevice,
+                const vk::Device& device,
+                uint32_t queueFamilyIndex,
+                uint32_t slotCount,
+                uint32_t maxScopes = 64,
+                vk::QueryPipelineStatisticFlags statistics = {},
+                uint32_t statisticsDepth = 0);
+    void destroy();
+
+    // Names of the counters of Scope::statistics, like "fragmentShaderInvocations"
+    const std::vector<std::string>& getStatisticNames() const { return statisticNames; }
+
+    bool enabled() const { return !slots.empty(); }
+    uint32_t slotCount() const { return (uint32_t)slots.size(); }
+
+    // Associate `cmdBuffer` with `slot` until endCommandBuffer, and reset the slot's queries.
+    // Must be recorded outside of a render pass.
+    void beginCommandBuffer(const vk::CommandBuffer& cmdBuffer, uint32_t slot);
+    void endCommandBuffer(const vk::CommandBuffer& cmdBuffer);
+
+    // Scopes on command buffers not associated with a slot are ignored
+    void beginScope(const vk::CommandBuffer& cmdBuffer, const std::string& name);
+    void endScope(const vk::CommandBuffer& cmdBuffer);
+
+    // Read back the timings of `slot`, which must not have work pending on the GPU.  Never waits:
+    // if any result is unavailable the collection is skipped.
+    void collect(uint32_t slot);
+
+    const std::vector<Scope>& getScopes() const { return scopes; }
+    // The first scope named `name` of the most recent collection, nullptr if there is none
+    const Scope* findScope(const std::string& name) const;
+    // Scope::statistics of the scope named `scopeName` for the counter named `counterName`, 0 if either isn't there
+    uint64_t getStatistic(const std::string& scopeName, const std::string& counterName) const;
+    // Incremented every time collect produces new results
+    uint64_t getCollectionCount() const { return collections; }
+
+    // Timings measured elsewhere, like on another queue with a profiler of its own, listed and smoothed along with
+    // the scopes.  Reports only have a name, a depth of zero and their milliseconds.
+    void report(const std::string& name, double milliseconds);
+    const std::vector<Scope>& getReports() const { return reports; }
+
+private:
+    struct Slot {
+        vk::QueryPool pool;
+        vk::QueryPool statisticsPool;
+        std::vector<std::string> names;
+        std::vector<uint32_t> depths;
+        // Per scope, its query in statisticsPool or UINT32_MAX
+        std::vector<uint32_t> statisticsQueries;
+        uint32_t statisticsCount{ 0 };
+    };
+    struct Recording {
+        uint32_t slot{ 0 };
+        // Indices of the scopes that have been begun but not ended
+        std::vector<uint32_t> open;
+    };
+
+    vk::Device device;
+    double timestampPeriod{ 1.0 };
+    uint64_t timestampMask{ ~0ull };
+    uint32_t maxScopes{ 0 };
+    vk::QueryPipelineStatisticFlags statisticFlags;
+    uint32_t statisticsDepth{ 0 };
+    std::vector<std::string> statisticNames;
+    std::vector<Slot> slots;
+    std::unordered_map<VkCommandBuffer, Recording> recordings;
+    std::vector<Scope> scopes;
+    std::vector<Scope> reports;
+    uint64_t collections{ 0 };
+};
+
+// Maps times on the device's timestamp clock, like those of GpuProfiler::Scope, to the CPU clock of vks::trace::now,
+// through a pair of timestamps sampled together with VK_EXT_calibrated_timestamps.  The clocks drift apart, so
+// calibrate again every so often.
+class TimestampCalibration {
+public:
+    // Returns false, and leaves the previous calibration, without the extension on `device` or without a CPU time
+    // domain that matches the trace clock
+    bool calibrate(const vk::PhysicalDevice& physicalDevice, const vk::Device& device, const vk::DispatchLoaderDynamic& dispatch);
+    bool valid() const { return calibrated; }
+    // On the trace clock, when calibrate last succeeded
+    int64_t time() const { return calibratedAt; }
+
+    // Device milliseconds, as GpuProfiler::Scope::begin and end, to CPU nanoseconds
+    int64_t toCpu(double deviceMilliseconds) const { return (int64_t)(deviceMilliseconds * 1.0e6 + offset); }
+
+private:
+    bool calibrated{ false };
+    // CPU nanoseconds minus device nanoseconds
+    double offset{ 0.0 };
+    int64_t calibratedAt{ 0 };
+};
+
+}}  // namespace vks::debug
@@ -0,0 +1,383 @@
+#include "raytracing.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "shaders.hpp"
+
+using namespace vks;
+using namespace vks::raytracing;
+
+namespace {
+
+inline vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment) {
+    return alignment > 1 ? ((value + alignment - 1) / alignment) * alignment : value;
+}
+
+AccelerationStructure createStructure(const Context& context, vk::AccelerationStructureTypeKHR type, vk::DeviceSize size) {
+    AccelerationStructure result;
+    result.device = context.device;
+    result.dispatch = &context.dynamicDispatch;
+    result.buffer =
+        context.createDeviceBuffer(vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress, size);
+    result.handle = context.device.createAccelerationStructureKHR(vk::AccelerationStructureCreateInfoKHR{ {}, result.buffer.buffer, 0, size, type },
+                                                                  nullptr, context.dynamicDispatch);
+    result.address = context.device.getAccelerationStructureAddressKHR(vk::AccelerationStructureDeviceAddressInfoKHR{ result.handle },
+                                                                       context.dynamicDispatch);
+    return result;
+}
+
+// Scratch memory of at least `size` bytes, at `address` aligned as builds require it
+struct Scratch {
+    Buffer buffer;
+    vk::DeviceAddress address{ 0 };
+
+    Scratch(const Context& context, vk::DeviceSize size) {
+        const vk::DeviceSize alignment = context.accelerationStructureProperties.minAccelerationStructureScratchOffsetAlignment;
+        buffer = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress, size + alignment);
+        address = alignUp(context.getBufferAddress(buffer.buffer), alignment);
+    }
+
+    ~Scratch() { buffer.destroy(); }
+};
+
+// Build inputs may have just been uploaded or written by the host
+void inputBarrier(const vk::CommandBuffer& commandBuffer) {
+    const vk::MemoryBarrier barrier{ vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eHostWrite, vk::AccessFlagBits::eShaderRead };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eHost,
+                                  vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, {}, barrier, nullptr, nullptr);
+}
+
+// Between builds sharing scratch memory, and before reading back or copying built structures
+void buildBarrier(const vk::CommandBuffer& commandBuffer) {
+    const vk::MemoryBarrier barrier{ vk::AccessFlagBits::eAccelerationStructureWriteKHR,
+                                     vk::AccessFlagBits::eAccelerationStructureReadKHR | vk::AccessFlagBits::eAccelerationStructureWriteKHR };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, {},
+                                  barrier, nullptr, nullptr);
+}
+
+}  // namespace
+
+void AccelerationStructure::destroy() {
+    if (handle) {
+        device.destroyAccelerationStructureKHR(handle, nullptr, *dispatch);
+        handle = nullptr;
+    }
+    buffer.destroy();
+    address = 0;
+}
+
+BottomLevelInput vks::raytracing::modelInput(const Context& context, const model::Model& model, const vk::GeometryFlagsKHR& flags) {
+    const uint32_t positionComponent = model.layout.componentIndex(model::VERTEX_COMPONENT_POSITION);
+    if (positionComponent == static_cast<uint32_t>(-1)) {
+        throw std::runtime_error("Acceleration structures need the vertex positions");
+    }
+    vk::AccelerationStructureGeometryTrianglesDataKHR triangles;
+    triangles.vertexFormat = vk::Format::eR32G32B32Sfloat;
+    triangles.vertexData.deviceAddress = context.getBufferAddress(model.vertices.buffer) + model.layout.offset(positionComponent);
+    triangles.vertexStride = model.layout.stride();
+    // The parts index the vertex buffer as a whole
+    triangles.maxVertex = model.vertexCount ? model.vertexCount - 1 : 0;
+    triangles.indexType = model.indexType;
+    triangles.indexData.deviceAddress = context.getBufferAddress(model.indices.buffer);
+    const uint32_t indexSize = model.indexType == vk::IndexType::eUint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+
+    BottomLevelInput result;
+    // Parts without triangles still get a geometry, which keeps the geometry indices equal to the part indices
+    for (const auto& part : model.parts) {
+        result.geometries.push_back(vk::AccelerationStructureGeometryKHR{ vk::GeometryTypeKHR::eTriangles, triangles, flags });
+        result.ranges.push_back(vk::AccelerationStructureBuildRangeInfoKHR{ part.indexCount / 3, part.indexBase * indexSize, 0, 0 });
+    }
+    return result;
+}
+
+std::vector<AccelerationStructure> vks::raytracing::buildBottomLevel(const Context& context,
+                                                                     const std::vector<BottomLevelInput>& inputs,
+                                                                     vk::DeviceSize scratchBudget) {
+    const auto& device = context.device;
+    const auto& dispatch = context.dynamicDispatch;
+    const vk::DeviceSize scratchAlignment = context.accelerationStructureProperties.minAccelerationStructureScratchOffsetAlignment;
+    std::vector<AccelerationStructure> result(inputs.size());
+    std::vector<vk::AccelerationStructureBuildGeometryInfoKHR> infos(inputs.size());
+    std::vector<vk::DeviceSize> scratchSizes(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        const auto& input = inputs[i];
+        auto& info = infos[i];
+        info.type = vk::AccelerationStructureTypeKHR::eBottomLevel;
+        info.flags = input.flags;
+        info.mode = vk::BuildAccelerationStructureModeKHR::eBuild;
+        info.geometryCount = (uint32_t)input.geometries.size();
+        info.pGeometries = input.geometries.data();
+        std::vector<uint32_t> primitiveCounts;
+        for (const auto& range : input.ranges) {
+            primitiveCounts.push_back(range.primitiveCount);
+        }
+        const auto sizes = device.getAccelerationStructureBuildSizesKHR(vk::AccelerationStructureBuildTypeKHR::eDevice, info, primitiveCounts, dispatch);
+        result[i] = createStructure(context, vk::AccelerationStructureTypeKHR::eBottomLevel, sizes.accelerationStructureSize);
+        info.dstAccelerationStructure = result[i].handle;
+        scratchSizes[i] = alignUp(sizes.buildScratchSize, scratchAlignment);
+    }
+
+    // Consecutive inputs whose scratch fits in the budget together, or single inputs that need more on their own
+    std::vector<std::pair<size_t, size_t>> batches;
+    vk::DeviceSize scratchSize = 0;
+    vk::DeviceSize batchScratchSize = 0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        if (batches.empty() || batchScratchSize + scratchSizes[i] > scratchBudget) {
+            batches.emplace_back(i, i);
+            batchScratchSize = 0;
+        }
+        ++batches.back().second;
+        batchScratchSize += scratchSizes[i];
+        scratchSize = std::max(scratchSize, batchScratchSize);
+    }
+
+    std::vector<vk::AccelerationStructureKHR> compactable;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        if (inputs[i].flags & vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction) {
+            compactable.push_back(result[i].handle);
+        }
+    }
+    vk::QueryPool queryPool;
+    if (!compactable.empty()) {
+        queryPool = device.createQueryPool({ {}, vk::QueryType::eAccelerationStructureCompactedSizeKHR, (uint32_t)compactable.size() });
+    }
+
+    {
+        Scratch scratch{ context, scratchSize };
+        context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+            inputBarrier(commandBuffer);
+            if (queryPool) {
+                commandBuffer.resetQueryPool(queryPool, 0, (uint32_t)compactable.size());
+            }
+            for (const auto& batch : batches) {
+                if (batch.first != 0) {
+                    buildBarrier(commandBuffer);
+                }
+                std::vector<const vk::AccelerationStructureBuildRangeInfoKHR*> ranges;
+                vk::DeviceSize scratchOffset = 0;
+                for (size_t i = batch.first; i < batch.second; ++i) {
+                    infos[i].scratchData.deviceAddress = scratch.address + scratchOffset;
+                    scratchOffset += scratchSizes[i];
+                    ranges.push_back(inputs[i].ranges.data());
+                }
+                commandBuffer.buildAccelerationStructuresKHR((uint32_t)(batch.second - batch.first), infos.data() + batch.first, ranges.data(),
+                                                             dispatch);
+            }
+            if (queryPool) {
+                buildBarrier(commandBuffer);
+                commandBuffer.writeAccelerationStructuresPropertiesKHR(compactable, vk::QueryType::eAccelerationStructureCompactedSizeKHR, queryPool, 0,
+                                                                       dispatch);
+            }
+        });
+    }
+
+    if (!queryPool) {
+        return result;
+    }
+    std::vector<vk::DeviceSize> compactedSizes(compactable.size());
+    device.getQueryPoolResults(queryPool, 0, (uint32_t)compactable.size(), vk::ArrayProxy<vk::DeviceSize>{ compactedSizes }, sizeof(vk::DeviceSize),
+                               vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+    device.destroyQueryPool(queryPool);
+
+    std::vector<AccelerationStructure> compacted(inputs.size());
+    context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+        size_t query = 0;
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            if (!(inputs[i].flags & vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction)) {
+                continue;
+            }
+            compacted[i] = createStructure(context, vk::AccelerationStructureTypeKHR::eBottomLevel, compactedSizes[query++]);
+            commandBuffer.copyAccelerationStructureKHR(
+                vk::CopyAccelerationStructureInfoKHR{ result[i].handle, compacted[i].handle, vk::CopyAccelerationStructureModeKHR::eCompact }, dispatch);
+        }
+    });
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        if (compacted[i]) {
+            result[i].destroy();
+            result[i] = compacted[i];
+        }
+    }
+    return result;
+}
+
+vk::AccelerationStructureInstanceKHR vks::raytracing::instance(const AccelerationStructure& blas,
+                                                               const glm::mat4& transform,
+                                                               uint32_t customIndex,
+                                                               uint32_t hitGroupOffset,
+                                                               uint8_t mask) {
+    vk::AccelerationStructureInstanceKHR result;
+    // Row major 3x4
+    for (int row = 0; row < 3; ++row) {
+        for (int column = 0; column < 4; ++column) {
+            result.transform.matrix[row][column] = transform[column][row];
+        }
+    }
+    result.setInstanceCustomIndex(customIndex);
+    result.setMask(mask);
+    result.setInstanceShaderBindingTableRecordOffset(hitGroupOffset);
+    result.setFlags(vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable);
+    result.setAccelerationStructureReference(blas.address);
+    return result;
+}
+
+AccelerationStructure vks::raytracing::buildTopLevel(const Context& context,
+                                                     const std::vector<vk::AccelerationStructureInstanceKHR>& instances,
+                                                     const vk::BuildAccelerationStructureFlagsKHR& flags) {
+    const auto& dispatch = context.dynamicDispatch;
+    // Only read by the build
+    Buffer instanceBuffer = context.createBuffer(
+        vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR,
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+        sizeof(vk::AccelerationStructureInstanceKHR) * std::max<size_t>(instances.size(), 1));
+    instanceBuffer.map();
+    if (!instances.empty()) {
+        instanceBuffer.copy(sizeof(vk::AccelerationStructureInstanceKHR) * instances.size(), instances.data());
+    }
+
+    vk::AccelerationStructureGeometryInstancesDataKHR instancesData;
+    instancesData.data.deviceAddress = context.getBufferAddress(instanceBuffer.buffer);
+    vk::AccelerationStructureGeometryKHR geometry{ vk::GeometryTypeKHR::eInstances, instancesData };
+    vk::AccelerationStructureBuildGeometryInfoKHR info;
+    info.type = vk::AccelerationStructureTypeKHR::eTopLevel;
+    info.flags = flags;
+    info.mode = vk::BuildAccelerationStructureModeKHR::eBuild;
+    info.geometryCount = 1;
+    info.pGeometries = &geometry;
+    const uint32_t instanceCount = (uint32_t)instances.size();
+    const auto sizes = context.device.getAccelerationStructureBuildSizesKHR(vk::AccelerationStructureBuildTypeKHR::eDevice, info, instanceCount, dispatch);
+    AccelerationStructure result = createStructure(context, vk::AccelerationStructureTypeKHR::eTopLevel, sizes.accelerationStructureSize);
+    info.dstAccelerationStructure = result.handle;
+
+    {
+        Scratch scratch{ context, sizes.buildScratchSize };
+        info.scratchData.deviceAddress = scratch.address;
+        const vk::AccelerationStructureBuildRangeInfoKHR range{ instanceCount, 0, 0, 0 };
+        const vk::AccelerationStructureBuildRangeInfoKHR* ranges = &range;
+        context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+            inputBarrier(commandBuffer);
+            commandBuffer.buildAccelerationStructuresKHR(1, &info, &ranges, dispatch);
+        });
+    }
+    instanceBuffer.destroy();
+    return result;
+}
+
+uint32_t RayTracingPipelineBuilder::loadShader(const std::string& fileName, vk::ShaderStageFlagBits stage) {
+    vk::PipelineShaderStageCreateInfo shaderStage;
+    shaderStage.stage = stage;
+    shaderStage.module = vks::shaders::acquireShaderModule(context.device, fileName);
+    shaderStage.pName = "main";
+    shaderStages.push_back(shaderStage);
+    return (uint32_t)shaderStages.size() - 1;
+}
+
+uint32_t RayTracingPipelineBuilder::addShader(const std::string& fileName, vk::ShaderStageFlagBits stage) {
+    const uint32_t shader = loadShader(fileName, stage);
+    groups.push_back({ vk::RayTracingShaderGroupTypeKHR::eGeneral, shader, VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR });
+    return (uint32_t)groups.size() - 1;
+}
+
+uint32_t RayTracingPipelineBuilder::addHitGroup(const std::string& closestHitFileName, const std::string& anyHitFileName) {
+    const uint32_t closestHit = closestHitFileName.empty() ? VK_SHADER_UNUSED_KHR : loadShader(closestHitFileName, vk::ShaderStageFlagBits::eClosestHitKHR);
+    const uint32_t anyHit = anyHitFileName.empty() ? VK_SHADER_UNUSED_KHR : loadShader(anyHitFileName, vk::ShaderStageFlagBits::eAnyHitKHR);
+    groups.push_back({ vk::RayTracingShaderGroupTypeKHR::eTrianglesHitGroup, VK_SHADER_UNUSED_KHR, closestHit, anyHit, VK_SHADER_UNUSED_KHR });
+    return (uint32_t)groups.size() - 1;
+}
+
+void RayTracingPipelineBuilder::destroyShaderModules() {
+    for (const auto& shaderStage : shaderStages) {
+        vks::shaders::releaseShaderModule(context.device, shaderStage.module);
+    }
+    shaderStages.clear();
+    groups.clear();
+}
+
+vk::Pipeline RayTracingPipelineBuilder::create(const vk::PipelineCache& cache) const {
+    vk::RayTracingPipelineCreateInfoKHR createInfo;
+    createInfo.stageCount = (uint32_t)shaderStages.size();
+    createInfo.pStages = shaderStages.data();
+    createInfo.groupCount = (uint32_t)groups.size();
+    createInfo.pGroups = groups.data();
+    createInfo.maxPipelineRayRecursionDepth = std::min(maxRecursionDepth, context.rayTracingPipelineProperties.maxRayRecursionDepth);
+    createInfo.layout = layout;
+    return context.device.createRayTracingPipelineKHR(nullptr, cache, createInfo, nullptr, context.dynamicDispatch).value;
+}
+
+void ShaderBindingTable::create(const Context& context, const vk::Pipeline& pipeline, const RayTracingPipelineBuilder& builder) {
+    dispatch = &context.dynamicDispatch;
+    const auto& properties = context.rayTracingPipelineProperties;
+    const uint32_t handleSize = properties.shaderGroupHandleSize;
+    const vk::DeviceSize handleStride = alignUp(handleSize, properties.shaderGroupHandleAlignment);
+    const vk::DeviceSize baseAlignment = properties.shaderGroupBaseAlignment;
+
+    enum Region
+    {
+        RAYGEN = 0,
+        MISS,
+        HIT,
+        CALLABLE,
+        REGION_COUNT
+    };
+    std::vector<uint32_t> regionGroups[REGION_COUNT];
+    for (uint32_t group = 0; group < (uint32_t)builder.groups.size(); ++group) {
+        const auto& info = builder.groups[group];
+        if (info.type != vk::RayTracingShaderGroupTypeKHR::eGeneral) {
+            regionGroups[HIT].push_back(group);
+            continue;
+        }
+        switch (builder.shaderStages[info.generalShader].stage) {
+            case vk::ShaderStageFlagBits::eRaygenKHR:
+                regionGroups[RAYGEN].push_back(group);
+                break;
+            case vk::ShaderStageFlagBits::eMissKHR:
+                regionGroups[MISS].push_back(group);
+                break;
+            default:
+                regionGroups[CALLABLE].push_back(group);
+                break;
+        }
+    }
+    if (regionGroups[RAYGEN].empty()) {
+        throw std::runtime_error("A shader binding table needs a ray generation shader");
+    }
+
+    // Ray generation entries are traced one at a time, so each is a region of its own whose size equals its stride
+    vk::DeviceSize strides[REGION_COUNT] = { alignUp(handleStride, baseAlignment), handleStride, handleStride, handleStride };
+    vk::DeviceSize offsets[REGION_COUNT];
+    vk::DeviceSize size = 0;
+    for (uint32_t region = 0; region < REGION_COUNT; ++region) {
+        offsets[region] = size;
+        size += alignUp(strides[region] * regionGroups[region].size(), baseAlignment);
+    }
+
+    const uint32_t groupCount = (uint32_t)builder.groups.size();
+    const auto handles = context.device.getRayTracingShaderGroupHandlesKHR<uint8_t>(pipeline, 0, groupCount, groupCount * handleSize, *dispatch);
+    buffer = context.createBuffer(vk::BufferUsageFlagBits::eShaderBindingTableKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+                                  vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, size + baseAlignment);
+    buffer.map();
+    const vk::DeviceAddress bufferAddress = context.getBufferAddress(buffer.buffer);
+    const vk::DeviceAddress address = alignUp(bufferAddress, baseAlignment);
+    uint8_t* data = static_cast<uint8_t*>(buffer.mapped) + (address - bufferAddress);
+    vk::StridedDeviceAddressRegionKHR* regions[REGION_COUNT] = { &raygen, &miss, &hit, &callable };
+    for (uint32_t region = 0; region < REGION_COUNT; ++region) {
+        const auto& groups = regionGroups[region];
+        for (size_t entry = 0; entry < groups.size(); ++entry) {
+            memcpy(data + offsets[region] + strides[region] * entry, handles.data() + groups[entry] * handleSize, handleSize);
+        }
+        *regions[region] = groups.empty() ? vk::StridedDeviceAddressRegionKHR{}
+                                          : vk::StridedDeviceAddressRegionKHR{ address + offsets[region], strides[region], strides[region] * groups.size() };
+    }
+    raygen.size = raygen.stride;
+    buffer.unmap();
+}
+
+void ShaderBindingTable::destroy() {
+    buffer.destroy();
+    raygen = miss = hit = callable = vk::StridedDeviceAddressRegionKHR{};
+}
+
+void ShaderBindingTable::traceRays(const vk::CommandBuffer& commandBuffer, uint32_t width, uint32_t height, uint32_t depth) const {
+    commandBuffer.traceRaysKHR(raygen, miss, hit, callable, width, height, depth, *dispatch);
+}
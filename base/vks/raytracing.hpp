@@ -0,0 +1,117 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "context.hpp"
+#include "model.hpp"
+
+// Hardware ray tracing through VK_KHR_acceleration_structure, which the context has to have been created with, see
+// Context::enableRayTracing and enableRayQuery.  The pipeline and shader binding table helpers also need
+// VK_KHR_ray_tracing_pipeline, acceleration structures alone are enough for ray queries.  The extension functions are
+// called through Context::dynamicDispatch.
+namespace vks { namespace raytracing {
+
+// Usage to add to the buffers acceleration structures are built from, see ModelCreateInfo::vertexUsage and indexUsage
+const vk::BufferUsageFlags BUILD_INPUT_USAGE{ vk::BufferUsageFlagBits::eShaderDeviceAddress |
+                                              vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR };
+
+struct AccelerationStructure {
+    vk::Device device;
+    const vk::DispatchLoaderDynamic* dispatch{ nullptr };
+    vk::AccelerationStructureKHR handle;
+    // The structure lives at the start of the buffer
+    Buffer buffer;
+    // For the instances of a top level structure, and for shaders
+    vk::DeviceAddress address{ 0 };
+
+    operator bool() const { return handle.operator bool(); }
+
+    void destroy();
+};
+
+// The geometries of one bottom level acceleration structure
+struct BottomLevelInput {
+    std::vector<vk::AccelerationStructureGeometryKHR> geometries;
+    // One per geometry
+    std::vector<vk::AccelerationStructureBuildRangeInfoKHR> ranges;
+    // With eAllowCompaction the structure is copied into one that only takes the memory it actually needs once built
+    vk::BuildAccelerationStructureFlagsKHR flags{ vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace |
+                                                  vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction };
+};
+
+// One triangle geometry per part of `model`, in the order of Model::parts, so that gl_GeometryIndexEXT is the part
+// index.  The model's buffers have to have been created with BUILD_INPUT_USAGE and must have finished uploading.
+BottomLevelInput modelInput(const Context& context, const model::Model& model, const vk::GeometryFlagsKHR& flags = vk::GeometryFlagBitsKHR::eOpaque);
+
+// Builds one structure per input and waits for the builds to complete.  Builds are recorded in batches whose scratch
+// memory fits in `scratchBudget` bytes, the builds of a batch run concurrently and the batches one after the other
+// in the same submission, reusing the scratch memory.  Inputs that allow compaction are compacted afterwards.
+std::vector<AccelerationStructure> buildBottomLevel(const Context& context,
+                                                    const std::vector<BottomLevelInput>& inputs,
+                                                    vk::DeviceSize scratchBudget = 256 * 1024 * 1024);
+
+// Instance of `blas` with the given object to world transform
+vk::AccelerationStructureInstanceKHR instance(const AccelerationStructure& blas,
+                                              const glm::mat4& transform,
+                                              uint32_t customIndex = 0,
+                                              uint32_t hitGroupOffset = 0,
+                                              uint8_t mask = 0xFF);
+
+// Builds a top level structure over `instances` and waits for the build to complete
+AccelerationStructure buildTopLevel(const Context& context,
+                                    const std::vector<vk::AccelerationStructureInstanceKHR>& instances,
+                                    const vk::BuildAccelerationStructureFlagsKHR& flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace);
+
+// Collects the shader stages and groups of a ray tracing pipeline.  Groups get their index in the order they're
+// added, which is also their order within their region of a ShaderBindingTable.
+struct RayTracingPipelineBuilder {
+    RayTracingPipelineBuilder(const Context& context, const vk::PipelineLayout& layout)
+        : context(context)
+        , layout(layout) {}
+
+    RayTracingPipelineBuilder(const RayTracingPipelineBuilder& other) = delete;
+    RayTracingPipelineBuilder& operator=(const RayTracingPipelineBuilder& other) = delete;
+
+    ~RayTracingPipelineBuilder() { destroyShaderModules(); }
+
+    const Context& context;
+    vk::PipelineLayout layout;
+    // Depth of traceRayEXT calls from within hit and miss shaders, 1 if only the ray generation shader traces rays
+    uint32_t maxRecursionDepth{ 1 };
+    std::vector<vk::PipelineShaderStageCreateInfo> shaderStages;
+    std::vector<vk::RayTracingShaderGroupCreateInfoKHR> groups;
+
+    // Ray generation, miss and callable shaders each make up a group of their own
+    uint32_t addShader(const std::string& fileName, vk::ShaderStageFlagBits stage);
+    // Triangle hit group, either shader may be empty
+    uint32_t addHitGroup(const std::string& closestHitFileName, const std::string& anyHitFileName = {});
+
+    void destroyShaderModules();
+
+    vk::Pipeline create(const vk::PipelineCache& cache) const;
+
+private:
+    uint32_t loadShader(const std::string& fileName, vk::ShaderStageFlagBits stage);
+};
+
+// The shader group handles of a pipeline, laid out in one region per group type as traceRaysKHR expects them
+struct ShaderBindingTable {
+    const vk::DispatchLoaderDynamic* dispatch{ nullptr };
+    Buffer buffer;
+    vk::StridedDeviceAddressRegionKHR raygen;
+    vk::StridedDeviceAddressRegionKHR miss;
+    vk::StridedDeviceAddressRegionKHR hit;
+    vk::StridedDeviceAddressRegionKHR callable;
+
+    // `builder` is the one `pipeline` was created with
+    void create(const Context& context, const vk::Pipeline& pipeline, const RayTracingPipelineBuilder& builder);
+    void destroy();
+
+    // Traces with the first ray generation shader, the pipeline has to be bound
+    void traceRays(const vk::CommandBuffer& commandBuffer, uint32_t width, uint32_t height, uint32_t depth = 1) const;
+};
+
+}}  // namespace vks::raytracing
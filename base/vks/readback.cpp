@@ -0,0 +1,255 @@
+#include "readback.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "context.hpp"
+#include "threadpool.hpp"
+
+using namespace vks;
+
+namespace {
+
+uint32_t texelSize(vk::Format format) {
+    switch (format) {
+        case vk::Format::eR8G8B8A8Unorm:
+        case vk::Format::eR8G8B8A8Srgb:
+        case vk::Format::eB8G8R8A8Unorm:
+        case vk::Format::eB8G8R8A8Srgb:
+        case vk::Format::eA2B10G10R10UnormPack32:
+        case vk::Format::eA2R10G10B10UnormPack32:
+            return 4;
+        case vk::Format::eR16G16B16A16Sfloat:
+            return 8;
+        default:
+            throw std::runtime_error("Unsupported readback format");
+    }
+}
+
+// Whether an 8 bit capture is BGRA rather than RGBA, for the file types that can only be written from either
+bool isBgra(vk::Format format, const char* fileType) {
+    switch (format) {
+        case vk::Format::eR8G8B8A8Unorm:
+        case vk::Format::eR8G8B8A8Srgb:
+            return false;
+        case vk::Format::eB8G8R8A8Unorm:
+        case vk::Format::eB8G8R8A8Srgb:
+            return true;
+        default:
+            throw std::runtime_error(std::string(fileType) + " files can only be written from 8 bit RGBA or BGRA captures");
+    }
+}
+
+}  // namespace
+
+Readback::Readback() = default;
+
+Readback::~Readback() {
+    destroy();
+}
+
+void Readback::create(const vks::Context& context, uint32_t slotCount, size_t threadCount) {
+    destroy();
+    this->context = &context;
+    commandPool = context.device.createCommandPool({ vk::CommandPoolCreateFlagBits::eResetCommandBuffer, context.queueIndices.graphics });
+    const auto commandBuffers = context.device.allocateCommandBuffers({ commandPool, vk::CommandBufferLevel::ePrimary, slotCount });
+    for (const auto& commandBuffer : commandBuffers) {
+        slots.emplace_back(new Slot);
+        slots.back()->commandBuffer = commandBuffer;
+    }
+    workers.reset(new ThreadPool(threadCount));
+    next = 0;
+}
+
+void Readback::destroy() {
+    if (!context) {
+        return;
+    }
+    // Runs the callbacks already handed over before the workers exit
+    workers.reset();
+    for (auto& slot : slots) {
+        slot->buffer.destroy();
+    }
+    slots.clear();
+    context->device.destroyCommandPool(commandPool);
+    commandPool = nullptr;
+    context = nullptr;
+}
+
+vk::CommandBuffer Readback::record(const vk::Image& image,
+                                   vk::ImageLayout layout,
+                                   const vk::Extent2D& extent,
+                                   vk::Format format,
+                                   const Callback& onComplete) {
+    assert(context);
+    ++sequence;
+    // Slots are taken in order, so captures complete in the order they were taken
+    Slot& slot = *slots[next];
+    if (slot.state != State::Free) {
+        ++dropped;
+        return nullptr;
+    }
+    next = (next + 1) % (uint32_t)slots.size();
+
+    const vk::DeviceSize size = (vk::DeviceSize)extent.width * extent.height * texelSize(format);
+    if (slot.buffer.size < size) {
+        slot.buffer.destroy();
+        slot.buffer = context->createBuffer(vk::BufferUsageFlagBits::eTransferDst,
+                                            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, size);
+        slot.buffer.map();
+    }
+    slot.callback = onComplete;
+    slot.capture.data = static_cast<const uint8_t*>(slot.buffer.mapped);
+    slot.capture.extent = extent;
+    slot.capture.format = format;
+    slot.capture.sequence = sequence;
+
+    const auto& commandBuffer = slot.commandBuffer;
+    commandBuffer.reset({});
+    commandBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    vk::ImageMemoryBarrier barrier;
+    barrier.srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+    barrier.oldLayout = layout;
+    barrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, barrier);
+
+    vk::BufferImageCopy region;
+    region.imageSubresource = { vk::ImageAspectFlagBits::eColor, 0, 0, 1 };
+    region.imageExtent = vk::Extent3D{ extent.width, extent.height, 1 };
+    commandBuffer.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, slot.buffer.buffer, region);
+
+    // The image goes back to its layout for whatever follows, presentation for swap chain images, and the copy is
+    // made visible to the host reading it once the fence signals
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
+    barrier.dstAccessMask = vk::AccessFlags{};
+    barrier.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
+    barrier.newLayout = layout;
+    vk::BufferMemoryBarrier written;
+    written.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    written.dstAccessMask = vk::AccessFlagBits::eHostRead;
+    written.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    written.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    written.buffer = slot.buffer.buffer;
+    written.size = VK_WHOLE_SIZE;
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost | vk::PipelineStageFlagBits::eBottomOfPipe, {},
+                                  nullptr, written, barrier);
+    commandBuffer.end();
+    slot.state = State::Recorded;
+    return commandBuffer;
+}
+
+void Readback::submitted(const vk::Fence& fence) {
+    for (auto& slot : slots) {
+        if (slot->state == State::Recorded) {
+            slot->fence = fence;
+            slot->state = State::Submitted;
+        }
+    }
+}
+
+void Readback::poll() {
+    for (auto& pointer : slots) {
+        Slot* slot = pointer.get();
+        if (slot->state != State::Submitted || context->device.getFenceStatus(slot->fence) != vk::Result::eSuccess) {
+            continue;
+        }
+        slot->state = State::Encoding;
+        workers->submit([slot] {
+            try {
+                slot->callback(slot->capture);
+            } catch (const std::exception& e) {
+                std::cerr << "Readback callback failed: " << e.what() << std::endl;
+            }
+            slot->callback = nullptr;
+            slot->state = State::Free;
+        });
+    }
+}
+
+void vks::writePpm(const std::string& filename, const Readback::Capture& capture) {
+    const bool swizzle = isBgra(capture.format, "PPM");
+    std::ofstream file(filename, std::ios::out | std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Unable to open " + filename);
+    }
+    file << "P6\n" << capture.extent.width << "\n" << capture.extent.height << "\n" << 255 << "\n";
+    // A row at a time rather than a byte at a time
+    std::vector<uint8_t> row(capture.extent.width * 3);
+    const uint8_t* texel = capture.data;
+    for (uint32_t y = 0; y < capture.extent.height; ++y) {
+        for (uint32_t x = 0; x < capture.extent.width; ++x, texel += 4) {
+            row[x * 3 + 0] = texel[swizzle ? 2 : 0];
+            row[x * 3 + 1] = texel[1];
+            row[x * 3 + 2] = texel[swizzle ? 0 : 2];
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
+}
+
+void vks::writeTga(const std::string& filename, const Readback::Capture& capture) {
+    // TGA stores BGR
+    const bool swizzle = !isBgra(capture.format, "TGA");
+    const auto& extent = capture.extent;
+    if (extent.width > UINT16_MAX || extent.height > UINT16_MAX) {
+        throw std::runtime_error("Captures are too large for TGA files");
+    }
+    std::ofstream file(filename, std::ios::out | std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Unable to open " + filename);
+    }
+    // Run length encoded true color, 24 bits per pixel, rows from the top
+    uint8_t header[18]{};
+    header[2] = 10;
+    header[12] = (uint8_t)(extent.width & 0xFF);
+    header[13] = (uint8_t)(extent.width >> 8);
+    header[14] = (uint8_t)(extent.height & 0xFF);
+    header[15] = (uint8_t)(extent.height >> 8);
+    header[16] = 24;
+    header[17] = 0x20;
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    // Packets of up to 128 pixels, either one pixel repeated or literal pixels, which don't cross rows
+    std::vector<uint8_t> row(extent.width * 3);
+    std::vector<uint8_t> packets;
+    packets.reserve(row.size() + row.size() / 128 + 1);
+    const uint8_t* texel = capture.data;
+    for (uint32_t y = 0; y < extent.height; ++y) {
+        for (uint32_t x = 0; x < extent.width; ++x, texel += 4) {
+            row[x * 3 + 0] = texel[swizzle ? 2 : 0];
+            row[x * 3 + 1] = texel[1];
+            row[x * 3 + 2] = texel[swizzle ? 0 : 2];
+        }
+        const auto same = [&](uint32_t a, uint32_t b) { return memcmp(&row[a * 3], &row[b * 3], 3) == 0; };
+        packets.clear();
+        uint32_t x = 0;
+        while (x < extent.width) {
+            uint32_t run = 1;
+            while (x + run < extent.width && run < 128 && same(x, x + run)) {
+                ++run;
+            }
+            if (run > 1) {
+                packets.push_back((uint8_t)(0x80 | (run - 1)));
+                packets.insert(packets.end(), &row[x * 3], &row[x * 3] + 3);
+                x += run;
+                continue;
+            }
+            // Literal pixels up to the next pair of equal ones
+            uint32_t count = 1;
+            while (x + count < extent.width && count < 128 && !(x + count + 1 < extent.width && same(x + count, x + count + 1))) {
+                ++count;
+            }
+            packets.push_back((uint8_t)(count - 1));
+            packets.insert(packets.end(), &row[x * 3], &row[(x + count) * 3]);
+            x += count;
+        }
+        file.write(reinterpret_cast<const char*>(packets.data()), packets.size());
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "buffer.hpp"
+#include "forward.hpp"
+
+namespace vks {
+
+class ThreadPool;
+
+// Pipelined copies of images into host memory, for capturing frames continuously without stalling them.
+//
+// Every capture takes a slot of a ring of host visible buffers.  record() fills the slot's command buffer with a copy
+// of the image, which goes into the batch of the frame that rendered it, right before the semaphore that presents the
+// image is signalled, and submitted() hands the slot the fence of that batch.  Once poll() finds the fence signalled,
+// the slot's callback runs on a worker thread, which is where captures are encoded and written, and the slot is free
+// again when it returns.  Captures are dropped when every slot is still in use, rather than waiting for one.
+class Readback {
+public:
+    // A capture, valid for the duration of the callback
+    struct Capture {
+        // Tightly packed rows, top to bottom, in `format`
+        const uint8_t* data{ nullptr };
+        vk::Extent2D extent;
+        vk::Format format{ vk::Format::eUndefined };
+        // Counts the captures recorded, including dropped ones
+        uint64_t sequence{ 0 };
+    };
+    using Callback = std::function<void(const Capture&)>;
+
+    Readback();
+    ~Readback();
+
+    void create(const vks::Context& context, uint32_t slotCount = 3, size_t threadCount = 1);
+    // Waits for the workers, submissions still pending must be complete
+    void destroy();
+
+    // Record a copy of `image`, whose color aspect is in `layout` and is returned to it, into the next free slot and
+    // return the command buffer to submit, or a null handle if the capture is dropped.  The copy is ordered after
+    // color attachment writes of earlier commands, and submitted() must be called with the fence of its batch.
+    vk::CommandBuffer record(const vk::Image& image, vk::ImageLayout layout, const vk::Extent2D& extent, vk::Format format, const Callback& onComplete);
+    void submitted(const vk::Fence& fence);
+
+    // Hand the slots whose batches completed to the workers.  The fences must still be signalled from those batches,
+    // so this has to be called between waiting for a fence and resetting it.
+    void poll();
+
+    // Whether the next record() gets a slot.  Callers that can't drop captures poll() until it does
+    bool available() const { return slots[next]->state == State::Free; }
+
+    operator bool() const { return context != nullptr; }
+
+    uint64_t getCaptureCount() const { return sequence; }
+    uint64_t getDroppedCount() const { return dropped; }
+
+private:
+    enum class State
+    {
+        Free,
+        // Recorded, waiting for submitted()
+        Recorded,
+        Submitted,
+        // Owned by a worker
+        Encoding,
+    };
+
+    struct Slot {
+        vks::Buffer buffer;
+        vk::CommandBuffer commandBuffer;
+        vk::Fence fence;
+        Callback callback;
+        Capture capture;
+        std::atomic<State> state{ State::Free };
+    };
+
+    const vks::Context* context{ nullptr };
+    vk::CommandPool commandPool;
+    std::vector<std::unique_ptr<Slot>> slots;
+    std::unique_ptr<ThreadPool> workers;
+    uint32_t next{ 0 };
+    uint64_t sequence{ 0 };
+    uint64_t dropped{ 0 };
+};
+
+// Write the RGB channels of an 8 bit RGBA or BGRA capture as a binary PPM file
+void writePpm(const std::string& filename, const Readback::Capture& capture);
+// Write the RGB channels of an 8 bit RGBA or BGRA capture as a run length encoded TGA file
+void writeTga(const std::string& filename, const Readback::Capture& capture);
+
+}  // namespace vks
@@ -0,0 +1,347 @@
+#include "reflection.hpp"
+#include "shaders.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <vulkan/spirv.hpp11>
+
+using namespace vks::shaders;
+
+namespace {
+
+const uint32_t SPIRV_MAGIC = 0x07230203;
+// OpTypeAccelerationStructureKHR, named differently across SPIR-V header versions
+const uint32_t OP_TYPE_ACCELERATION_STRUCTURE = 5341;
+
+// The instructions making up the types and decorations of the interface variables of a module, by result id
+class Module {
+public:
+    explicit Module(const std::vector<uint32_t>& spirv) {
+        if (spirv.size() < 5 || spirv[0] != SPIRV_MAGIC) {
+            throw std::runtime_error("Not a SPIR-V module");
+        }
+        for (size_t i = 5; i < spirv.size();) {
+            const uint32_t wordCount = spirv[i] >> 16;
+            if (wordCount == 0 || i + wordCount > spirv.size()) {
+                throw std::runtime_error("Truncated SPIR-V instruction");
+            }
+            const std::vector<uint32_t> operands(spirv.begin() + i + 1, spirv.begin() + i + wordCount);
+            parse(spirv[i] & 0xffff, operands);
+            i += wordCount;
+        }
+    }
+
+    struct Type {
+        uint32_t op{ 0 };
+        std::vector<uint32_t> operands;
+    };
+
+    struct Decorations {
+        uint32_t binding{ 0 };
+        uint32_t set{ 0 };
+        bool hasBinding{ false };
+        bool block{ false };
+        bool bufferBlock{ false };
+        uint32_t arrayStride{ 0 };
+        // Of struct members
+        std::map<uint32_t, uint32_t> offsets;
+        std::map<uint32_t, uint32_t> matrixStrides;
+    };
+
+    struct Variable {
+        uint32_t id{ 0 };
+        uint32_t pointerType{ 0 };
+        spv::StorageClass storageClass;
+    };
+
+    std::unordered_map<uint32_t, Type> types;
+    std::unordered_map<uint32_t, uint32_t> constants;
+    std::unordered_map<uint32_t, Decorations> decorations;
+    std::unordered_map<uint32_t, std::string> names;
+    std::vector<Variable> variables;
+
+    const Type& type(uint32_t id) const {
+        auto itr = types.find(id);
+        if (itr == types.end()) {
+            throw std::runtime_error("SPIR-V references an unknown type");
+        }
+        return itr->second;
+    }
+
+    Decorations decorationsOf(uint32_t id) const {
+        auto itr = decorations.find(id);
+        return itr == decorations.end() ? Decorations{} : itr->second;
+    }
+
+    std::string nameOf(uint32_t id) const {
+        auto itr = names.find(id);
+        return itr == names.end() ? "id " + std::to_string(id) : itr->second;
+    }
+
+    // Bytes occupied by a value of `id` in a block, following the explicit layout decorations
+    uint32_t sizeOf(uint32_t id, uint32_t matrixStride = 0) const {
+        const auto& t = type(id);
+        switch (spv::Op(t.op)) {
+            case spv::Op::OpTypeBool:
+                return 4;
+            case spv::Op::OpTypeInt:
+            case spv::Op::OpTypeFloat:
+                return t.operands[1] / 8;
+            case spv::Op::OpTypeVector:
+                return t.operands[2] * sizeOf(t.operands[1]);
+            case spv::Op::OpTypeMatrix:
+                return t.operands[2] * (matrixStride ? matrixStride : sizeOf(t.operands[1]));
+            case spv::Op::OpTypeArray: {
+                const uint32_t stride = decorationsOf(id).arrayStride;
+                return length(t.operands[2]) * (stride ? stride : sizeOf(t.operands[1]));
+            }
+            case spv::Op::OpTypeStruct: {
+                const auto members = decorationsOf(id);
+                uint32_t size = 0;
+                for (uint32_t member = 1; member < t.operands.size(); ++member) {
+                    const uint32_t memberIndex = member - 1;
+                    const uint32_t offset = members.offsets.count(memberIndex) ? members.offsets.at(memberIndex) : 0;
+                    const uint32_t stride = members.matrixStrides.count(memberIndex) ? members.matrixStrides.at(memberIndex) : 0;
+                    size = std::max(size, offset + sizeOf(t.operands[member], stride));
+                }
+                return size;
+            }
+            default:
+                throw std::runtime_error("Unsupported type in a SPIR-V block");
+        }
+    }
+
+    uint32_t length(uint32_t constantId) const {
+        auto itr = constants.find(constantId);
+        if (itr == constants.end()) {
+            // Specialization constant array lengths aren't known until the pipeline is created
+            throw std::runtime_error("SPIR-V array length isn't a constant");
+        }
+        return itr->second;
+    }
+
+private:
+    void parse(uint32_t op, const std::vector<uint32_t>& operands) {
+        switch (spv::Op(op)) {
+            case spv::Op::OpName:
+                names[operands[0]] = reinterpret_cast<const char*>(&operands[1]);
+                break;
+            case spv::Op::OpDecorate: {
+                auto& target = decorations[operands[0]];
+                switch (spv::Decoration(operands[1])) {
+                    case spv::Decoration::Binding:
+                        target.binding = operands[2];
+                        target.hasBinding = true;
+                        break;
+                    case spv::Decoration::DescriptorSet:
+                        target.set = operands[2];
+                        break;
+                    case spv::Decoration::Block:
+                        target.block = true;
+                        break;
+                    case spv::Decoration::BufferBlock:
+                        target.bufferBlock = true;
+                        break;
+                    case spv::Decoration::ArrayStride:
+                        target.arrayStride = operands[2];
+                        break;
+                    default:
+                        break;
+                }
+                break;
+            }
+            case spv::Op::OpMemberDecorate: {
+                auto& target = decorations[operands[0]];
+                if (spv::Decoration(operands[2]) == spv::Decoration::Offset) {
+                    target.offsets[operands[1]] = operands[3];
+                } else if (spv::Decoration(operands[2]) == spv::Decoration::MatrixStride) {
+                    target.matrixStrides[operands[1]] = operands[3];
+                }
+                break;
+            }
+            case spv::Op::OpTypeBool:
+            case spv::Op::OpTypeInt:
+            case spv::Op::OpTypeFloat:
+            case spv::Op::OpTypeVector:
+            case spv::Op::OpTypeMatrix:
+            case spv::Op::OpTypeImage:
+            case spv::Op::OpTypeSampler:
+            case spv::Op::OpTypeSampledImage:
+            case spv::Op::OpTypeArray:
+            case spv::Op::OpTypeRuntimeArray:
+            case spv::Op::OpTypeStruct:
+                types[operands[0]] = { op, operands };
+                break;
+            case spv::Op::OpTypePointer:
+                // Result, storage class, pointee
+                types[operands[0]] = { op, operands };
+                break;
+            case spv::Op::OpConstant:
+                // Result type, result, value.  Array lengths are 32 bit integers
+                constants[operands[1]] = operands[2];
+                break;
+            case spv::Op::OpVariable:
+                variables.push_back({ operands[1], operands[0], spv::StorageClass(operands[2]) });
+                break;
+            default:
+                if (op == OP_TYPE_ACCELERATION_STRUCTURE) {
+                    types[operands[0]] = { op, operands };
+                }
+                break;
+        }
+    }
+};
+
+vk::DescriptorType descriptorType(const Module& module, uint32_t typeId, spv::StorageClass storageClass) {
+    const auto& t = module.type(typeId);
+    if (t.op == OP_TYPE_ACCELERATION_STRUCTURE) {
+        return vk::DescriptorType::eAccelerationStructureKHR;
+    }
+    switch (spv::Op(t.op)) {
+        case spv::Op::OpTypeStruct: {
+            const auto decorations = module.decorationsOf(typeId);
+            if (storageClass == spv::StorageClass::StorageBuffer || decorations.bufferBlock) {
+                return vk::DescriptorType::eStorageBuffer;
+            }
+            return vk::DescriptorType::eUniformBuffer;
+        }
+        case spv::Op::OpTypeSampler:
+            return vk::DescriptorType::eSampler;
+        case spv::Op::OpTypeSampledImage:
+            return vk::DescriptorType::eCombinedImageSampler;
+        case spv::Op::OpTypeImage: {
+            // Sampled type, dim, depth, arrayed, multisampled, sampled, format
+            const auto dim = spv::Dim(t.operands[2]);
+            const bool storage = t.operands[6] == 2;
+            if (dim == spv::Dim::Buffer) {
+                return storage ? vk::DescriptorType::eStorageTexelBuffer : vk::DescriptorType::eUniformTexelBuffer;
+            }
+            if (dim == spv::Dim::SubpassData) {
+                return vk::DescriptorType::eInputAttachment;
+            }
+            return storage ? vk::DescriptorType::eStorageImage : vk::DescriptorType::eSampledImage;
+        }
+        default:
+            throw std::runtime_error("Unsupported SPIR-V descriptor type");
+    }
+}
+
+}  // namespace
+
+ShaderLayout ShaderLayout::reflect(const std::vector<uint32_t>& spirv, vk::ShaderStageFlagBits stage) {
+    const Module module(spirv);
+    ShaderLayout result;
+    for (const auto& variable : module.variables) {
+        const auto storageClass = variable.storageClass;
+        const bool resource = storageClass == spv::StorageClass::UniformConstant || storageClass == spv::StorageClass::Uniform ||
+                              storageClass == spv::StorageClass::StorageBuffer;
+        if (!resource && storageClass != spv::StorageClass::PushConstant) {
+            continue;
+        }
+        uint32_t typeId = module.type(variable.pointerType).operands[2];
+
+        if (storageClass == spv::StorageClass::PushConstant) {
+            const auto& block = module.type(typeId);
+            const auto members = module.decorationsOf(typeId);
+            uint32_t begin = UINT32_MAX;
+            for (uint32_t member = 0; member + 1 < block.operands.size(); ++member) {
+                begin = std::min(begin, members.offsets.count(member) ? members.offsets.at(member) : 0);
+            }
+            const uint32_t end = module.sizeOf(typeId);
+            if (begin < end) {
+                // Offsets and sizes of ranges are multiples of 4, as block members are
+                result.pushConstantRanges.push_back({ stage, begin, ((end + 3) & ~3u) - begin });
+            }
+            continue;
+        }
+
+        const auto decorations = module.decorationsOf(variable.id);
+        if (!decorations.hasBinding) {
+            continue;
+        }
+        uint32_t count = 1;
+        while (true) {
+            const auto& t = module.type(typeId);
+            if (spv::Op(t.op) == spv::Op::OpTypeArray) {
+                count *= module.length(t.operands[2]);
+            } else if (spv::Op(t.op) == spv::Op::OpTypeRuntimeArray) {
+                throw std::runtime_error("Runtime sized descriptor array " + module.nameOf(variable.id) + " needs a layout written by hand");
+            } else {
+                break;
+            }
+            typeId = t.operands[1];
+        }
+        vk::DescriptorSetLayoutBinding binding{ decorations.binding, descriptorType(module, typeId, storageClass), count, stage };
+        result.sets[decorations.set][decorations.binding] = binding;
+    }
+    return result;
+}
+
+ShaderLayout& ShaderLayout::merge(const ShaderLayout& other) {
+    for (const auto& set : other.sets) {
+        auto& bindings = sets[set.first];
+        for (const auto& binding : set.second) {
+            auto itr = bindings.find(binding.first);
+            if (itr == bindings.end()) {
+                bindings[binding.first] = binding.second;
+                continue;
+            }
+            if (itr->second.descriptorType != binding.second.descriptorType || itr->second.descriptorCount != binding.second.descriptorCount) {
+                throw std::runtime_error("Shaders disagree on set " + std::to_string(set.first) + " binding " + std::to_string(binding.first));
+            }
+            itr->second.stageFlags |= binding.second.stageFlags;
+        }
+    }
+    for (const auto& range : other.pushConstantRanges) {
+        auto itr = std::find_if(pushConstantRanges.begin(), pushConstantRanges.end(),
+                                [&](const vk::PushConstantRange& existing) { return existing.stageFlags == range.stageFlags; });
+        if (itr == pushConstantRanges.end()) {
+            pushConstantRanges.push_back(range);
+            continue;
+        }
+        // The same stage from different modules, like the shaders of several pipelines sharing a layout
+        const uint32_t end = std::max(itr->offset + itr->size, range.offset + range.size);
+        itr->offset = std::min(itr->offset, range.offset);
+        itr->size = end - itr->offset;
+    }
+    return *this;
+}
+
+ShaderLayout& ShaderLayout::setDescriptorType(uint32_t set, uint32_t binding, vk::DescriptorType type) {
+    auto setItr = sets.find(set);
+    if (setItr == sets.end() || setItr->second.count(binding) == 0) {
+        throw std::runtime_error("No binding " + std::to_string(binding) + " in set " + std::to_string(set));
+    }
+    setItr->second[binding].descriptorType = type;
+    return *this;
+}
+
+ShaderLayout& ShaderLayout::addStages(const vk::ShaderStageFlags& stages) {
+    for (auto& set : sets) {
+        for (auto& binding : set.second) {
+            binding.second.stageFlags |= stages;
+        }
+    }
+    return *this;
+}
+
+std::vector<vk::DescriptorSetLayoutBinding> ShaderLayout::getBindings(uint32_t set) const {
+    std::vector<vk::DescriptorSetLayoutBinding> result;
+    auto itr = sets.find(set);
+    if (itr != sets.end()) {
+        for (const auto& binding : itr->second) {
+            result.push_back(binding.second);
+        }
+    }
+    return result;
+}
+
+ShaderLayout vks::shaders::reflectShader(const vk::Device& device, const std::string& filename, vk::ShaderStageFlagBits stage) {
+    try {
+        return ShaderLayout::reflect(readShaderCode(device, filename), stage);
+    } catch (const std::runtime_error& e) {
+        throw std::runtime_error(filename + ": " + e.what());
+    }
+}
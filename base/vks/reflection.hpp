@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+namespace vks { namespace shaders {
+
+// The descriptor bindings and push constants of one or more shader stages, read from their SPIR-V.  Layouts of the
+// stages of a pipeline, or of every pipeline binding the same descriptor sets, are merged into one, from which
+// vks::LayoutCache creates the set and pipeline layouts.
+//
+// SPIR-V can't tell dynamic uniform and storage buffers from plain ones, see setDescriptorType.  Runtime sized
+// descriptor arrays take flags a reflected layout doesn't have and are rejected, layouts for them are still written
+// by hand.
+struct ShaderLayout {
+    // Bindings by set, then by binding number, with the stages using them
+    std::map<uint32_t, std::map<uint32_t, vk::DescriptorSetLayoutBinding>> sets;
+    // At most one range per stage, covering the push constant block members the stage declares
+    std::vector<vk::PushConstantRange> pushConstantRanges;
+
+    // Throws std::runtime_error for malformed SPIR-V and unsupported declarations
+    static ShaderLayout reflect(const std::vector<uint32_t>& spirv, vk::ShaderStageFlagBits stage);
+
+    // Bindings used by both must have the same type and count, and are used by the stages of both.  Throws
+    // std::runtime_error otherwise.
+    ShaderLayout& merge(const ShaderLayout& other);
+
+    // For buffers bound with dynamic offsets.  Throws std::runtime_error if there is no such binding.
+    ShaderLayout& setDescriptorType(uint32_t set, uint32_t binding, vk::DescriptorType type);
+
+    // Make every binding visible to `stages` too, so that pipelines whose shaders use a binding in different stages
+    // still share their layouts
+    ShaderLayout& addStages(const vk::ShaderStageFlags& stages);
+
+    // The highest set number plus one, sets in between without bindings are empty
+    uint32_t setCount() const { return sets.empty() ? 0 : sets.rbegin()->first + 1; }
+
+    // The bindings of `set` in binding order, nothing for an empty set
+    std::vector<vk::DescriptorSetLayoutBinding> getBindings(uint32_t set) const;
+};
+
+// Reflect `filename`, loaded the way GraphicsPipelineBuilder loads it
+ShaderLayout reflectShader(const vk::Device& device, const std::string& filename, vk::ShaderStageFlagBits stage);
+
+}}  // namespace vks::shaders
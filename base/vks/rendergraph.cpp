@@ -0,0 +1,754 @@
+#include "rendergraph.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "debug.hpp"
+#include "renderpass.hpp"
+
+using namespace vks;
+using namespace vks::rendergraph;
+
+namespace {
+
+const vk::PipelineStageFlags ATTACHMENT_STAGES{ vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests |
+                                                vk::PipelineStageFlagBits::eColorAttachmentOutput };
+const vk::AccessFlags ATTACHMENT_WRITES{ vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite };
+const vk::AccessFlags ATTACHMENT_ACCESS{ ATTACHMENT_WRITES | vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentRead };
+const vk::AccessFlags WRITE_ACCESS{ ATTACHMENT_WRITES | vk::AccessFlagBits::eShaderWrite };
+
+bool hasDepth(vk::Format format) {
+    switch (format) {
+        case vk::Format::eD16Unorm:
+        case vk::Format::eX8D24UnormPack32:
+        case vk::Format::eD32Sfloat:
+        case vk::Format::eD16UnormS8Uint:
+        case vk::Format::eD24UnormS8Uint:
+        case vk::Format::eD32SfloatS8Uint:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool hasStencil(vk::Format format) {
+    switch (format) {
+        case vk::Format::eS8Uint:
+        case vk::Format::eD16UnormS8Uint:
+        case vk::Format::eD24UnormS8Uint:
+        case vk::Format::eD32SfloatS8Uint:
+            return true;
+        default:
+            return false;
+    }
+}
+
+vk::ImageLayout readOnlyLayout(vk::Format format) {
+    return hasDepth(format) || hasStencil(format) ? vk::ImageLayout::eDepthStencilReadOnlyOptimal : vk::ImageLayout::eShaderReadOnlyOptimal;
+}
+
+bool contains(const std::vector<Resource>& resources, Resource resource) {
+    return std::find(resources.begin(), resources.end(), resource) != resources.end();
+}
+
+bool writes(const PassDescription& pass, Resource resource) {
+    return pass.depthAttachment == resource || contains(pass.colorAttachments, resource);
+}
+
+// As an attachment of the pass' render pass, sampling doesn't count
+bool attaches(const PassDescription& pass, Resource resource) {
+    return writes(pass, resource) || contains(pass.inputAttachments, resource);
+}
+
+bool isStorage(const PassDescription& pass, Resource resource) {
+    return contains(pass.storageReads, resource) || contains(pass.storageWrites, resource);
+}
+
+// Any use at all
+bool touches(const PassDescription& pass, Resource resource) {
+    return attaches(pass, resource) || contains(pass.sampledAttachments, resource) || isStorage(pass, resource);
+}
+
+// The layout of an attachment of a subpass.  Attachments a pass both writes and reads in place have to be in the
+// general layout.
+vk::ImageLayout attachmentLayout(const PassDescription& pass, Resource resource, vk::Format format) {
+    const bool input = contains(pass.inputAttachments, resource);
+    if (pass.depthAttachment == resource) {
+        return input ? vk::ImageLayout::eGeneral : vk::ImageLayout::eDepthStencilAttachmentOptimal;
+    }
+    if (contains(pass.colorAttachments, resource)) {
+        return input ? vk::ImageLayout::eGeneral : vk::ImageLayout::eColorAttachmentOptimal;
+    }
+    return readOnlyLayout(format);
+}
+
+bool overlaps(uint32_t firstA, uint32_t lastA, uint32_t firstB, uint32_t lastB) {
+    return firstA <= lastB && firstB <= lastA;
+}
+
+}  // namespace
+
+Resource RenderGraph::addAttachment(const std::string& name, const AttachmentDescription& description) {
+    Attachment attachment;
+    attachment.name = name;
+    attachment.description = description;
+    attachments.push_back(attachment);
+    return (Resource)(attachments.size() - 1);
+}
+
+Resource RenderGraph::importImage(const std::string& name,
+                                  const Image& image,
+                                  vk::ImageLayout layout,
+                                  const vk::PipelineStageFlags& stages,
+                                  const vk::AccessFlags& access) {
+    Attachment attachment;
+    attachment.name = name;
+    attachment.description.format = image.format;
+    attachment.description.extent = vk::Extent2D{ image.extent.width, image.extent.height };
+    attachment.description.clear = false;
+    attachment.imported = true;
+    attachment.importedLayout = layout;
+    attachment.importedStages = stages;
+    attachment.importedAccess = access;
+    attachment.image = image;
+    attachments.push_back(attachment);
+    return (Resource)(attachments.size() - 1);
+}
+
+uint32_t RenderGraph::addPass(const PassDescription& pass) {
+    Pass result;
+    result.description = pass;
+    passes.push_back(result);
+    return (uint32_t)(passes.size() - 1);
+}
+
+void RenderGraph::addOutput(Resource resource) {
+    attachments[resource].output = true;
+}
+
+void RenderGraph::compile(const Context& context) {
+    destroy();
+    device = context.device;
+    groupPasses();
+    createImages(context);
+    for (auto& step : steps) {
+        if (!step.compute) {
+            createRenderPass(step);
+        }
+    }
+    createBarriers();
+}
+
+void RenderGraph::destroy() {
+    for (auto& step : steps) {
+        if (step.renderPass) {
+            device.destroy(step.framebuffer);
+            device.destroy(step.renderPass);
+        }
+    }
+    steps.clear();
+    for (auto& attachment : attachments) {
+        if (attachment.image && !attachment.imported) {
+            attachment.image.destroy();
+        }
+    }
+    for (auto& block : blocks) {
+        block.allocation.destroy();
+    }
+    blocks.clear();
+    finalBarriers = Barriers();
+    allocatedSize = 0;
+    unaliasedSize = 0;
+}
+
+size_t RenderGraph::renderPassCount() const {
+    return (size_t)std::count_if(steps.begin(), steps.end(), [](const Step& step) { return !step.compute; });
+}
+
+size_t RenderGraph::barrierCount() const {
+    size_t result = finalBarriers.images.empty() ? 0 : 1;
+    for (const auto& step : steps) {
+        result += step.barriers.images.empty() ? 0 : 1;
+    }
+    return result;
+}
+
+void RenderGraph::groupPasses() {
+    for (uint32_t i = 0; i < (uint32_t)passes.size(); ++i) {
+        auto& pass = passes[i];
+        const auto& description = pass.description;
+
+        std::vector<Resource> used = description.colorAttachments;
+        used.insert(used.end(), description.inputAttachments.begin(), description.inputAttachments.end());
+        if (description.depthAttachment != NO_RESOURCE) {
+            used.push_back(description.depthAttachment);
+        }
+        if (description.compute) {
+            if (!used.empty()) {
+                throw std::runtime_error("Render graph compute pass " + description.name + " has attachments");
+            }
+            Step step;
+            step.compute = true;
+            step.firstPass = i;
+            step.passCount = 1;
+            steps.push_back(step);
+            pass.step = (uint32_t)(steps.size() - 1);
+            pass.subpass = 0;
+            continue;
+        }
+        if (used.empty()) {
+            throw std::runtime_error("Render graph pass " + description.name + " has no attachments");
+        }
+        if (!description.storageReads.empty() || !description.storageWrites.empty()) {
+            throw std::runtime_error("Render graph pass " + description.name + " uses storage images, which only compute passes can");
+        }
+        const auto& first = attachments[used[0]].description;
+        for (Resource resource : used) {
+            const auto& other = attachments[resource].description;
+            if (other.extent != first.extent || other.samples != first.samples) {
+                throw std::runtime_error("The attachments of render graph pass " + description.name + " differ in extent or sample count");
+            }
+        }
+
+        bool split = !merge || steps.empty() || steps.back().compute || steps.back().extent != first.extent || steps.back().samples != first.samples;
+        // Sampling may read other pixels than the fragment's own, which only a finished render pass guarantees to be written
+        for (size_t j = 0; !split && j < description.sampledAttachments.size(); ++j) {
+            const auto& current = steps.back();
+            for (uint32_t k = current.firstPass; k < current.firstPass + current.passCount; ++k) {
+                if (writes(passes[k].description, description.sampledAttachments[j])) {
+                    split = true;
+                    break;
+                }
+            }
+        }
+        if (split) {
+            Step step;
+            step.firstPass = i;
+            step.extent = first.extent;
+            step.samples = first.samples;
+            steps.push_back(step);
+        }
+        auto& step = steps.back();
+        pass.step = (uint32_t)(steps.size() - 1);
+        pass.subpass = step.passCount++;
+    }
+
+    // Attachments of the render passes in the order of their first use
+    for (auto& step : steps) {
+        for (uint32_t i = step.firstPass; !step.compute && i < step.firstPass + step.passCount; ++i) {
+            const auto& description = passes[i].description;
+            std::vector<Resource> used = description.colorAttachments;
+            if (description.depthAttachment != NO_RESOURCE) {
+                used.push_back(description.depthAttachment);
+            }
+            used.insert(used.end(), description.inputAttachments.begin(), description.inputAttachments.end());
+            for (Resource resource : used) {
+                if (!contains(step.attachments, resource)) {
+                    step.attachments.push_back(resource);
+                }
+            }
+        }
+    }
+}
+
+std::vector<std::pair<Resource, RenderGraph::Use>> RenderGraph::uses(const Step& step) const {
+    std::vector<std::pair<Resource, Use>> result;
+    auto find = [&](Resource resource) -> Use* {
+        for (auto& entry : result) {
+            if (entry.first == resource) {
+                return &entry.second;
+            }
+        }
+        result.push_back({ resource, Use() });
+        return nullptr;
+    };
+    const uint32_t endPass = step.firstPass + step.passCount;
+
+    if (step.compute) {
+        const auto& description = passes[step.firstPass].description;
+        std::vector<Resource> used = description.storageWrites;
+        used.insert(used.end(), description.storageReads.begin(), description.storageReads.end());
+        used.insert(used.end(), description.sampledAttachments.begin(), description.sampledAttachments.end());
+        for (Resource resource : used) {
+            if (find(resource)) {
+                continue;
+            }
+            auto& use = result.back().second;
+            use.entry = isStorage(description, resource) ? vk::ImageLayout::eGeneral : readOnlyLayout(attachments[resource].description.format);
+            use.exit = use.entry;
+            use.stages = vk::PipelineStageFlagBits::eComputeShader;
+            use.access = vk::AccessFlagBits::eShaderRead;
+            use.write = contains(description.storageWrites, resource);
+            if (use.write) {
+                use.access |= vk::AccessFlagBits::eShaderWrite;
+            }
+        }
+        return result;
+    }
+
+    for (Resource resource : step.attachments) {
+        find(resource);
+        auto& use = result.back().second;
+        const vk::Format format = attachments[resource].description.format;
+        const bool depth = hasDepth(format) || hasStencil(format);
+        bool first = true;
+        for (uint32_t i = step.firstPass; i < endPass; ++i) {
+            const auto& description = passes[i].description;
+            if (!attaches(description, resource)) {
+                continue;
+            }
+            use.exit = attachmentLayout(description, resource, format);
+            if (first) {
+                use.entry = use.exit;
+                first = false;
+            }
+            if (writes(description, resource)) {
+                use.write = true;
+                use.stages |= depth ? vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests
+                                    : vk::PipelineStageFlagBits::eColorAttachmentOutput;
+                use.access |= depth ? vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite
+                                    : vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite;
+            }
+            if (contains(description.inputAttachments, resource)) {
+                use.stages |= vk::PipelineStageFlagBits::eFragmentShader;
+                use.access |= vk::AccessFlagBits::eInputAttachmentRead;
+            }
+        }
+    }
+    for (uint32_t i = step.firstPass; i < endPass; ++i) {
+        for (Resource resource : passes[i].description.sampledAttachments) {
+            if (find(resource)) {
+                continue;
+            }
+            auto& use = result.back().second;
+            use.entry = readOnlyLayout(attachments[resource].description.format);
+            use.exit = use.entry;
+            use.stages = vk::PipelineStageFlagBits::eFragmentShader;
+            use.access = vk::AccessFlagBits::eShaderRead;
+        }
+    }
+    return result;
+}
+
+void RenderGraph::createImages(const Context& context) {
+    for (auto& attachment : attachments) {
+        attachment.firstStep = UINT32_MAX;
+        attachment.lastStep = 0;
+    }
+    for (uint32_t i = 0; i < (uint32_t)steps.size(); ++i) {
+        for (const auto& entry : uses(steps[i])) {
+            auto& attachment = attachments[entry.first];
+            attachment.firstStep = std::min(attachment.firstStep, i);
+            attachment.lastStep = std::max(attachment.lastStep, i);
+        }
+    }
+
+    std::vector<vk::MemoryRequirements> requirements(attachments.size());
+    std::vector<Resource> aliasable;
+    for (Resource resource = 0; resource < (Resource)attachments.size(); ++resource) {
+        auto& attachment = attachments[resource];
+        const auto& description = attachment.description;
+        if (attachment.firstStep == UINT32_MAX) {
+            throw std::runtime_error("Render graph image " + attachment.name + " isn't used by any pass");
+        }
+        if (attachment.imported) {
+            continue;
+        }
+        const bool depth = hasDepth(description.format) || hasStencil(description.format);
+
+        vk::ImageUsageFlags usage;
+        bool sampled = attachment.output;
+        bool storage = false;
+        for (const auto& pass : passes) {
+            const auto& passDescription = pass.description;
+            if (writes(passDescription, resource)) {
+                usage |= depth ? vk::ImageUsageFlagBits::eDepthStencilAttachment : vk::ImageUsageFlagBits::eColorAttachment;
+            }
+            if (contains(passDescription.inputAttachments, resource)) {
+                usage |= vk::ImageUsageFlagBits::eInputAttachment;
+            }
+            sampled |= contains(passDescription.sampledAttachments, resource);
+            storage |= isStorage(passDescription, resource);
+        }
+        if (sampled) {
+            usage |= vk::ImageUsageFlagBits::eSampled;
+        }
+        if (storage) {
+            usage |= vk::ImageUsageFlagBits::eStorage;
+        }
+        // Never stored, so it only ever has to exist on the tile
+        attachment.transient = !sampled && !storage && attachment.firstStep == attachment.lastStep;
+        if (attachment.transient) {
+            usage |= vk::ImageUsageFlagBits::eTransientAttachment;
+        }
+        // Outputs are read after the graph, until its next run writes them again
+        if (attachment.output) {
+            attachment.lastStep = (uint32_t)steps.size();
+        }
+
+        vk::ImageCreateInfo imageCreateInfo;
+        imageCreateInfo.imageType = vk::ImageType::e2D;
+        imageCreateInfo.format = description.format;
+        imageCreateInfo.extent = vk::Extent3D{ description.extent.width, description.extent.height, 1 };
+        imageCreateInfo.mipLevels = 1;
+        imageCreateInfo.arrayLayers = 1;
+        imageCreateInfo.samples = description.samples;
+        imageCreateInfo.usage = usage;
+        attachment.image.device = device;
+        attachment.image.image = device.createImage(imageCreateInfo);
+        attachment.image.format = description.format;
+        attachment.image.extent = imageCreateInfo.extent;
+        requirements[resource] = device.getImageMemoryRequirements(attachment.image.image);
+
+        // Lazily allocated memory, where the device has it, only gets backed by memory if the implementation runs out
+        // of tile memory.  Other devices allocate transient attachments like any other image.
+        uint32_t typeIndex;
+        if (attachment.transient && context.getMemoryType(requirements[resource].memoryTypeBits, vk::MemoryPropertyFlagBits::eLazilyAllocated, &typeIndex)) {
+            static_cast<Allocation&>(attachment.image) =
+                context.allocator->allocate(requirements[resource], vk::MemoryPropertyFlagBits::eLazilyAllocated, Allocator::ResourceKind::Optimal);
+            device.bindImageMemory(attachment.image.image, attachment.image.memory, attachment.image.offset);
+        } else {
+            aliasable.push_back(resource);
+            unaliasedSize += requirements[resource].size;
+        }
+    }
+
+    // Largest first into the first block of a compatible memory type none of whose images is used while it is
+    std::stable_sort(aliasable.begin(), aliasable.end(), [&](Resource a, Resource b) { return requirements[a].size > requirements[b].size; });
+    for (Resource resource : aliasable) {
+        const auto& attachment = attachments[resource];
+        const auto& imageRequirements = requirements[resource];
+        Block* target = nullptr;
+        for (auto& block : blocks) {
+            if (!aliasing || !(block.requirements.memoryTypeBits & imageRequirements.memoryTypeBits)) {
+                continue;
+            }
+            bool free = true;
+            for (Resource other : block.resources) {
+                free &= !overlaps(attachment.firstStep, attachment.lastStep, attachments[other].firstStep, attachments[other].lastStep);
+            }
+            if (free) {
+                target = &block;
+                break;
+            }
+        }
+        if (!target) {
+            blocks.emplace_back();
+            target = &blocks.back();
+            target->requirements = imageRequirements;
+        }
+        target->requirements.size = std::max(target->requirements.size, imageRequirements.size);
+        target->requirements.alignment = std::max(target->requirements.alignment, imageRequirements.alignment);
+        target->requirements.memoryTypeBits &= imageRequirements.memoryTypeBits;
+        target->resources.push_back(resource);
+    }
+    for (auto& block : blocks) {
+        std::sort(block.resources.begin(), block.resources.end(),
+                  [&](Resource a, Resource b) { return attachments[a].firstStep < attachments[b].firstStep; });
+        block.allocation = context.allocator->allocate(block.requirements, vk::MemoryPropertyFlagBits::eDeviceLocal, Allocator::ResourceKind::Optimal);
+        allocatedSize += block.requirements.size;
+        // The images don't own the memory, the block does
+        for (Resource resource : block.resources) {
+            device.bindImageMemory(attachments[resource].image.image, block.allocation.memory, block.allocation.offset);
+        }
+    }
+
+    for (auto& attachment : attachments) {
+        if (attachment.imported) {
+            continue;
+        }
+        // Input attachments and samplers read depth only, even from depth stencil formats
+        const vk::Format format = attachment.description.format;
+        const vk::ImageAspectFlags aspect = hasDepth(format) || hasStencil(format) ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
+        attachment.image.view = device.createImageView({ {}, attachment.image.image, vk::ImageViewType::e2D, format, {}, { aspect, 0, 1, 0, 1 } });
+    }
+}
+
+void RenderGraph::createRenderPass(Step& step) {
+    const uint32_t endPass = step.firstPass + step.passCount;
+    const auto stepUses = uses(step);
+
+    vks::renderpass::RenderPassCreateInfo renderPassInfo;
+    step.clearValues.clear();
+    for (Resource resource : step.attachments) {
+        const auto& attachment = attachments[resource];
+        bool writtenBefore = attachment.imported;
+        for (uint32_t i = 0; i < step.firstPass; ++i) {
+            writtenBefore |= writes(passes[i].description, resource) || contains(passes[i].description.storageWrites, resource);
+        }
+        bool readAfter = attachment.output || attachment.imported;
+        for (uint32_t i = endPass; i < (uint32_t)passes.size(); ++i) {
+            readAfter |= touches(passes[i].description, resource);
+        }
+        const auto& use =
+            std::find_if(stepUses.begin(), stepUses.end(), [&](const std::pair<Resource, Use>& entry) { return entry.first == resource; })->second;
+
+        vk::AttachmentDescription description;
+        description.format = attachment.description.format;
+        description.samples = attachment.description.samples;
+        if (writtenBefore) {
+            description.loadOp = vk::AttachmentLoadOp::eLoad;
+        } else {
+            description.loadOp = attachment.description.clear ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eDontCare;
+        }
+        description.storeOp = readAfter ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
+        if (hasStencil(description.format)) {
+            description.stencilLoadOp = description.loadOp;
+            description.stencilStoreOp = description.storeOp;
+        } else {
+            description.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+            description.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+        }
+        // The barrier before the render pass already has it in the layout of its first subpass, and the one after
+        // takes it from that of its last
+        description.initialLayout = use.entry;
+        description.finalLayout = use.exit;
+        renderPassInfo.attachments.push_back(description);
+        step.clearValues.push_back(attachment.description.clearValue);
+    }
+
+    auto attachmentIndex = [&](Resource resource) {
+        return (uint32_t)(std::find(step.attachments.begin(), step.attachments.end(), resource) - step.attachments.begin());
+    };
+    auto reference = [&](const PassDescription& description, Resource resource) {
+        return vk::AttachmentReference{ attachmentIndex(resource), attachmentLayout(description, resource, attachments[resource].description.format) };
+    };
+    std::vector<vk::AttachmentReference> depthReferences(step.passCount);
+    for (uint32_t i = step.firstPass; i < endPass; ++i) {
+        const auto& description = passes[i].description;
+        vks::renderpass::SubpassDescription subpass;
+        subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+        for (Resource resource : description.colorAttachments) {
+            subpass.colorAttachments.push_back(reference(description, resource));
+        }
+        for (Resource resource : description.inputAttachments) {
+            subpass.inputAttachments.push_back(reference(description, resource));
+        }
+        if (description.depthAttachment != NO_RESOURCE) {
+            auto& depthReference = depthReferences[i - step.firstPass];
+            depthReference = reference(description, description.depthAttachment);
+            subpass.pDepthStencilAttachment = &depthReference;
+        }
+        // Attachments used before and after this subpass keep their contents through it
+        for (Resource resource : step.attachments) {
+            if (attaches(description, resource)) {
+                continue;
+            }
+            bool before = false, after = false;
+            for (uint32_t j = step.firstPass; j < i; ++j) {
+                before |= attaches(passes[j].description, resource);
+            }
+            for (uint32_t j = i + 1; j < endPass; ++j) {
+                after |= attaches(passes[j].description, resource);
+            }
+            if (before && after) {
+                subpass.preserveAttachments.push_back(attachmentIndex(resource));
+            }
+        }
+        renderPassInfo.subpasses.push_back(subpass);
+    }
+    std::vector<vk::SubpassDescription> subpasses;
+    for (auto& subpass : renderPassInfo.subpasses) {
+        subpass.update();
+        subpasses.push_back(subpass);
+    }
+
+    // Everything outside the render pass is synchronized by the graph's barriers, so only the subpasses depend on each
+    // other.  Every fragment only reads its own pixel of the input attachments, so the subpasses can stay on the tile.
+    for (uint32_t subpass = 1; subpass < step.passCount; ++subpass) {
+        const auto& description = passes[step.firstPass + subpass].description;
+        for (uint32_t earlier = 0; earlier < subpass; ++earlier) {
+            const auto& earlierDescription = passes[step.firstPass + earlier].description;
+            bool shared = false;
+            for (Resource resource : step.attachments) {
+                shared |= attaches(description, resource) && attaches(earlierDescription, resource);
+            }
+            if (!shared) {
+                continue;
+            }
+            vk::SubpassDependency dependency;
+            dependency.srcSubpass = earlier;
+            dependency.dstSubpass = subpass;
+            dependency.srcStageMask = ATTACHMENT_STAGES | vk::PipelineStageFlagBits::eFragmentShader;
+            dependency.dstStageMask = ATTACHMENT_STAGES | vk::PipelineStageFlagBits::eFragmentShader;
+            dependency.srcAccessMask = ATTACHMENT_WRITES;
+            dependency.dstAccessMask = ATTACHMENT_ACCESS | vk::AccessFlagBits::eInputAttachmentRead;
+            dependency.dependencyFlags = vk::DependencyFlagBits::eByRegion;
+            renderPassInfo.dependencies.push_back(dependency);
+        }
+    }
+
+    renderPassInfo.update();
+    renderPassInfo.subpassCount = (uint32_t)subpasses.size();
+    renderPassInfo.pSubpasses = subpasses.data();
+    step.renderPass = device.createRenderPass(renderPassInfo);
+
+    std::vector<vk::ImageView> views;
+    for (Resource resource : step.attachments) {
+        views.push_back(attachments[resource].image.view);
+    }
+    step.framebuffer = device.createFramebuffer({ {}, step.renderPass, (uint32_t)views.size(), views.data(), step.extent.width, step.extent.height, 1 });
+}
+
+void RenderGraph::access(Resource resource, const Use& use, bool discard, State& state, Barriers& barriers) const {
+    const vk::Format format = attachments[resource].description.format;
+    vk::ImageAspectFlags aspect;
+    if (hasDepth(format)) {
+        aspect |= vk::ImageAspectFlagBits::eDepth;
+    }
+    if (hasStencil(format)) {
+        aspect |= vk::ImageAspectFlagBits::eStencil;
+    }
+    if (!aspect) {
+        aspect = vk::ImageAspectFlagBits::eColor;
+    }
+
+    vk::ImageMemoryBarrier barrier;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = attachments[resource].image.image;
+    barrier.subresourceRange = { aspect, 0, 1, 0, 1 };
+    barrier.oldLayout = discard ? vk::ImageLayout::eUndefined : state.layout;
+    barrier.newLayout = use.entry;
+    barrier.dstAccessMask = use.access;
+    vk::PipelineStageFlags srcStages;
+    if (barrier.oldLayout != barrier.newLayout || use.write) {
+        // Writes, and layout transitions, which are writes too, have to wait for the reads since the last write as well
+        srcStages = state.writeStages | state.readStages;
+        barrier.srcAccessMask = state.writeAccess;
+        state.writeStages = use.stages;
+        state.writeAccess = use.write ? use.access & WRITE_ACCESS : vk::AccessFlags();
+        state.readStages = use.write ? vk::PipelineStageFlags() : use.stages;
+        state.visibleStages = use.stages;
+    } else {
+        // Reads only wait for the last write, unless something that already waited covers them
+        if (use.stages & ~state.visibleStages) {
+            srcStages = state.writeStages;
+            barrier.srcAccessMask = state.writeAccess;
+            state.visibleStages |= use.stages;
+        }
+        state.readStages |= use.stages;
+    }
+    state.layout = use.exit;
+    if (barrier.oldLayout == barrier.newLayout && !srcStages) {
+        return;
+    }
+    barriers.srcStages |= srcStages;
+    barriers.dstStages |= use.stages;
+    barriers.images.push_back(barrier);
+}
+
+std::vector<RenderGraph::State> RenderGraph::simulate(const std::vector<State>& initialStates, bool recordBarriers) {
+    std::vector<State> states = initialStates;
+    std::vector<bool> used(attachments.size(), false);
+    for (auto& step : steps) {
+        Barriers barriers;
+        for (const auto& entry : uses(step)) {
+            // What the graph creates doesn't outlive a frame, so its first use doesn't care for earlier contents, which
+            // is also what lets images share memory
+            access(entry.first, entry.second, !attachments[entry.first].imported && !used[entry.first], states[entry.first], barriers);
+            used[entry.first] = true;
+        }
+        if (recordBarriers) {
+            step.barriers = barriers;
+        }
+    }
+
+    Barriers barriers;
+    for (Resource resource = 0; resource < (Resource)attachments.size(); ++resource) {
+        const auto& attachment = attachments[resource];
+        Use use;
+        if (attachment.imported) {
+            use.entry = attachment.importedLayout;
+            use.stages = attachment.importedStages;
+            use.access = attachment.importedAccess;
+            use.write = (bool)(attachment.importedAccess & WRITE_ACCESS);
+        } else if (attachment.output) {
+            use.entry = readOnlyLayout(attachment.description.format);
+            use.stages = vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader;
+            use.access = vk::AccessFlagBits::eShaderRead;
+        } else {
+            continue;
+        }
+        use.exit = use.entry;
+        access(resource, use, false, states[resource], barriers);
+    }
+    if (recordBarriers) {
+        finalBarriers = barriers;
+    }
+    return states;
+}
+
+void RenderGraph::createBarriers() {
+    std::vector<State> initialStates(attachments.size());
+    for (Resource resource = 0; resource < (Resource)attachments.size(); ++resource) {
+        const auto& attachment = attachments[resource];
+        if (attachment.imported) {
+            auto& state = initialStates[resource];
+            state.layout = attachment.importedLayout;
+            state.writeStages = attachment.importedStages;
+            state.writeAccess = attachment.importedAccess & WRITE_ACCESS;
+            state.readStages = attachment.importedStages;
+        }
+    }
+    // The first use of an image the graph created waits for the last accesses to its memory, by itself in the
+    // previous frame or by the image that used the memory before it.  Those don't depend on where the images start.
+    const auto finalStates = simulate(initialStates, false);
+    for (Resource resource = 0; resource < (Resource)attachments.size(); ++resource) {
+        if (!attachments[resource].imported) {
+            initialStates[resource] = finalStates[resource];
+        }
+    }
+    for (const auto& block : blocks) {
+        for (size_t i = 0; i < block.resources.size(); ++i) {
+            initialStates[block.resources[i]] = finalStates[block.resources[(i + block.resources.size() - 1) % block.resources.size()]];
+        }
+    }
+    simulate(initialStates, true);
+}
+
+void RenderGraph::Barriers::record(const vk::CommandBuffer& cmdBuffer) const {
+    if (images.empty()) {
+        return;
+    }
+    cmdBuffer.pipelineBarrier(srcStages ? srcStages : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe), dstStages, {}, nullptr, nullptr,
+                              images);
+}
+
+void RenderGraph::record(const vk::CommandBuffer& cmdBuffer) const {
+    for (const auto& step : steps) {
+        step.barriers.record(cmdBuffer);
+        if (step.compute) {
+            const auto& pass = passes[step.firstPass];
+            vks::debug::marker::beginRegion(cmdBuffer, pass.description.name, glm::vec4(0.34f, 0.5f, 0.76f, 1.0f));
+            if (pass.description.record) {
+                pass.description.record(cmdBuffer);
+            }
+            vks::debug::marker::endRegion(cmdBuffer);
+            continue;
+        }
+
+        vk::RenderPassBeginInfo renderPassBeginInfo;
+        renderPassBeginInfo.renderPass = step.renderPass;
+        renderPassBeginInfo.framebuffer = step.framebuffer;
+        renderPassBeginInfo.renderArea.extent = step.extent;
+        renderPassBeginInfo.clearValueCount = (uint32_t)step.clearValues.size();
+        renderPassBeginInfo.pClearValues = step.clearValues.data();
+        cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+        for (uint32_t i = step.firstPass; i < step.firstPass + step.passCount; ++i) {
+            const auto& pass = passes[i];
+            if (pass.subpass) {
+                cmdBuffer.nextSubpass(vk::SubpassContents::eInline);
+            }
+            vks::debug::marker::beginRegion(cmdBuffer, pass.description.name, glm::vec4(0.5f, 0.76f, 0.34f, 1.0f));
+            cmdBuffer.setViewport(0, vks::util::viewport(step.extent));
+            cmdBuffer.setScissor(0, vks::util::rect2D(step.extent));
+            if (pass.description.record) {
+                pass.description.record(cmdBuffer);
+            }
+            vks::debug::marker::endRegion(cmdBuffer);
+        }
+        cmdBuffer.endRenderPass();
+    }
+    finalBarriers.record(cmdBuffer);
+}
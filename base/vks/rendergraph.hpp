@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "context.hpp"
+
+namespace vks { namespace rendergraph {
+
+// Index of an image of a RenderGraph
+using Resource = uint32_t;
+static const Resource NO_RESOURCE = UINT32_MAX;
+
+// An image the graph creates, for use as an attachment or storage image
+struct AttachmentDescription {
+    vk::Format format{ vk::Format::eR8G8B8A8Unorm };
+    vk::Extent2D extent;
+    vk::SampleCountFlagBits samples{ vk::SampleCountFlagBits::e1 };
+    // Cleared by the first pass writing it as an attachment, otherwise its previous contents are discarded
+    bool clear{ true };
+    vk::ClearValue clearValue;
+};
+
+struct PassDescription {
+    std::string name;
+    // Compute passes have no attachments, only storage images and sampled images
+    bool compute{ false };
+    std::vector<Resource> colorAttachments;
+    Resource depthAttachment{ NO_RESOURCE };
+    // Read with subpassLoad at the fragment's own pixel, which lets the pass merge with the ones writing them.  In
+    // the shader read only layouts, ShaderReadOnlyOptimal or DepthStencilReadOnlyOptimal.
+    std::vector<Resource> inputAttachments;
+    // Read through samplers, at any pixel, in the shader read only layouts unless the pass also uses them as storage
+    // images.  The writers of these have to be in an earlier render pass.
+    std::vector<Resource> sampledAttachments;
+    // Storage images, in the general layout
+    std::vector<Resource> storageReads;
+    std::vector<Resource> storageWrites;
+    // Records the pass' commands.  The viewport and scissor of raster passes are already set to the extent of their
+    // attachments.
+    std::function<void(const vk::CommandBuffer&)> record;
+};
+
+// A small render graph of raster and compute passes.  Passes run in the order they're added, and consecutive
+// raster passes with attachments of the same extent and sample count become subpasses of one render pass, unless a
+// pass samples an attachment written within it.  What comes out of compile is what a tiled GPU wants to be told:
+//
+// * attachments are only loaded if an earlier render pass wrote them, cleared or left undefined otherwise, and only
+//   stored if a later pass or whatever comes after the graph, see addOutput, reads them
+// * attachments only used within one render pass and never stored are transient, in lazily allocated memory where
+//   the device has it, so that they only ever live in tile memory
+// * subpasses that read attachments earlier ones wrote depend on them by region
+//
+// The graph also does all the synchronization of its images.  Before every render pass or compute pass it records
+// one pipeline barrier with the layout transitions and the dependencies on earlier accesses the pass needs, and
+// nothing for reads of what is already visible, and after the last pass the outputs and imported images get one
+// more to hand them back.  The images the graph creates don't outlive a frame, so they're discarded on their first
+// use, and the ones whose passes don't overlap share memory.
+class RenderGraph {
+public:
+    // Merge passes into subpasses where possible.  Without it every pass gets a render pass of its own, which
+    // round-trips everything passes share through memory, to compare against.  Must be set before compile.
+    bool merge{ true };
+    // Let images whose passes don't overlap share memory.  Must be set before compile.
+    bool aliasing{ true };
+
+    Resource addAttachment(const std::string& name, const AttachmentDescription& description);
+    // An image made elsewhere, which is in `layout` whenever the graph doesn't run, with `stages` and `access` the
+    // accesses outside the graph that it has to be synchronized with.  Its contents are kept.
+    Resource importImage(const std::string& name,
+                         const Image& image,
+                         vk::ImageLayout layout,
+                         const vk::PipelineStageFlags& stages,
+                         const vk::AccessFlags& access);
+    // Passes are identified by the index this returns
+    uint32_t addPass(const PassDescription& pass);
+    // `resource` is sampled by fragment or compute shaders after the graph, so it's kept and left in its shader read
+    // only layout
+    void addOutput(Resource resource);
+
+    // Creates the images, render passes and framebuffers, after destroying any of an earlier compile
+    void compile(const Context& context);
+    void destroy();
+
+    // Records all passes along with their barriers, beginning and ending their render passes around them
+    void record(const vk::CommandBuffer& cmdBuffer) const;
+
+    // Of a compiled graph.  The image of an output may be given a sampler, which is destroyed with it.
+    Image& image(Resource resource) { return attachments[resource].image; }
+    const Image& image(Resource resource) const { return attachments[resource].image; }
+    bool isTransient(Resource resource) const { return attachments[resource].transient; }
+    // Null for compute passes
+    vk::RenderPass renderPass(uint32_t pass) const { return steps[passes[pass].step].renderPass; }
+    uint32_t subpass(uint32_t pass) const { return passes[pass].subpass; }
+    size_t renderPassCount() const;
+    size_t barrierCount() const;
+    // Device memory of the images the graph created, other than lazily allocated ones, and what they'd take
+    // without aliasing
+    vk::DeviceSize memorySize() const { return allocatedSize; }
+    vk::DeviceSize unaliasedMemorySize() const { return unaliasedSize; }
+
+private:
+    struct Attachment {
+        std::string name;
+        AttachmentDescription description;
+        bool imported{ false };
+        // For imported images, see importImage
+        vk::ImageLayout importedLayout{ vk::ImageLayout::eUndefined };
+        vk::PipelineStageFlags importedStages;
+        vk::AccessFlags importedAccess;
+        bool output{ false };
+        bool transient{ false };
+        // The first and last step using it
+        uint32_t firstStep{ UINT32_MAX };
+        uint32_t lastStep{ 0 };
+        Image image;
+    };
+
+    struct Pass {
+        PassDescription description;
+        uint32_t step{ 0 };
+        uint32_t subpass{ 0 };
+    };
+
+    // One pipeline barrier
+    struct Barriers {
+        vk::PipelineStageFlags srcStages;
+        vk::PipelineStageFlags dstStages;
+        std::vector<vk::ImageMemoryBarrier> images;
+
+        void record(const vk::CommandBuffer& cmdBuffer) const;
+    };
+
+    // A render pass, or a compute pass
+    struct Step {
+        bool compute{ false };
+        // Consecutive passes [firstPass, firstPass + passCount)
+        uint32_t firstPass{ 0 };
+        uint32_t passCount{ 0 };
+        vk::Extent2D extent;
+        vk::SampleCountFlagBits samples{ vk::SampleCountFlagBits::e1 };
+        // The graph's attachments, in the order of the render pass attachments
+        std::vector<Resource> attachments;
+        std::vector<vk::ClearValue> clearValues;
+        vk::RenderPass renderPass;
+        vk::Framebuffer framebuffer;
+        // Recorded before the step
+        Barriers barriers;
+    };
+
+    // How a step uses an image: the layout it needs it in and leaves it in, and the stages and accesses
+    struct Use {
+        vk::ImageLayout entry{ vk::ImageLayout::eUndefined };
+        vk::ImageLayout exit{ vk::ImageLayout::eUndefined };
+        vk::PipelineStageFlags stages;
+        vk::AccessFlags access;
+        bool write{ false };
+    };
+
+    // What of the accesses to an image since its last write a later access has to wait for
+    struct State {
+        vk::ImageLayout layout{ vk::ImageLayout::eUndefined };
+        vk::PipelineStageFlags writeStages;
+        vk::AccessFlags writeAccess;
+        vk::PipelineStageFlags readStages;
+        // The stages the last write has been made visible to
+        vk::PipelineStageFlags visibleStages;
+    };
+
+    // Memory shared by images whose steps don't overlap
+    struct Block {
+        vk::MemoryRequirements requirements;
+        // In the order of their first step
+        std::vector<Resource> resources;
+        Allocation allocation;
+    };
+
+    void groupPasses();
+    void createImages(const Context& context);
+    void createRenderPass(Step& step);
+    void createBarriers();
+    std::vector<std::pair<Resource, Use>> uses(const Step& step) const;
+    void access(Resource resource, const Use& use, bool discard, State& state, Barriers& barriers) const;
+    std::vector<State> simulate(const std::vector<State>& initialStates, bool recordBarriers);
+
+    vk::Device device;
+    std::vector<Attachment> attachments;
+    std::vector<Pass> passes;
+    std::vector<Step> steps;
+    std::vector<Block> blocks;
+    // Recorded after the last step
+    Barriers finalBarriers;
+    vk::DeviceSize allocatedSize{ 0 };
+    vk::DeviceSize unaliasedSize{ 0 };
+};
+
+}}  // namespace vks::rendergraph
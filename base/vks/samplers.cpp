@@ -0,0 +1,129 @@
+#include "samplers.hpp"
+
+#include <vector>
+
+using namespace vks;
+
+namespace {
+
+std::mutex& registryMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::unordered_map<VkDevice, SamplerCache*>& registry() {
+    static std::unordered_map<VkDevice, SamplerCache*> caches;
+    return caches;
+}
+
+// The create info past pNext, which is null for every cached info
+std::string samplerKey(const vk::SamplerCreateInfo& info) {
+    const VkSamplerCreateInfo& raw = info;
+    const char* begin = reinterpret_cast<const char*>(&raw.flags);
+    const char* end = reinterpret_cast<const char*>(&raw) + sizeof(raw);
+    return std::string(begin, end);
+}
+
+}  // namespace
+
+SamplerCache::SamplerCache(const vk::Device& device)
+    : device(device) {
+    std::unique_lock<std::mutex> lock(registryMutex());
+    registry()[static_cast<VkDevice>(device)] = this;
+}
+
+SamplerCache::~SamplerCache() {
+    destroy();
+}
+
+SamplerCache* SamplerCache::find(const vk::Device& device) {
+    std::unique_lock<std::mutex> lock(registryMutex());
+    auto itr = registry().find(static_cast<VkDevice>(device));
+    return itr == registry().end() ? nullptr : itr->second;
+}
+
+vk::Sampler SamplerCache::acquire(const vk::SamplerCreateInfo& info) {
+    if (info.pNext) {
+        return device.createSampler(info);
+    }
+    const auto key = samplerKey(info);
+    std::unique_lock<std::mutex> lock(mutex);
+    auto itr = byKey.find(key);
+    if (itr != byKey.end()) {
+        auto& entry = samplers[itr->second];
+        ++entry.refs;
+        return entry.sampler;
+    }
+    Entry entry;
+    entry.sampler = device.createSampler(info);
+    entry.key = key;
+    entry.refs = 1;
+    const VkSampler handle = entry.sampler;
+    samplers[handle] = entry;
+    byKey[key] = handle;
+    return entry.sampler;
+}
+
+bool SamplerCache::release(const vk::Sampler& sampler) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto itr = samplers.find(static_cast<VkSampler>(sampler));
+    if (itr == samplers.end()) {
+        return false;
+    }
+    if (itr->second.refs > 0) {
+        --itr->second.refs;
+    }
+    return true;
+}
+
+void SamplerCache::purge() {
+    std::unique_lock<std::mutex> lock(mutex);
+    std::vector<VkSampler> unused;
+    for (const auto& entry : samplers) {
+        if (entry.second.refs == 0) {
+            unused.push_back(entry.first);
+        }
+    }
+    for (const auto& sampler : unused) {
+        auto itr = samplers.find(sampler);
+        byKey.erase(itr->second.key);
+        device.destroySampler(itr->second.sampler);
+        samplers.erase(itr);
+    }
+}
+
+void SamplerCache::destroy() {
+    {
+        std::unique_lock<std::mutex> lock(registryMutex());
+        auto itr = registry().find(static_cast<VkDevice>(device));
+        if (itr != registry().end() && itr->second == this) {
+            registry().erase(itr);
+        }
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    for (const auto& entry : samplers) {
+        device.destroySampler(entry.second.sampler);
+    }
+    samplers.clear();
+    byKey.clear();
+}
+
+size_t SamplerCache::size() const {
+    std::unique_lock<std::mutex> lock(mutex);
+    return samplers.size();
+}
+
+vk::Sampler vks::acquireSampler(const vk::Device& device, const vk::SamplerCreateInfo& info) {
+    auto cache = SamplerCache::find(device);
+    return cache ? cache->acquire(info) : device.createSampler(info);
+}
+
+void vks::releaseSampler(const vk::Device& device, const vk::Sampler& sampler) {
+    if (!sampler) {
+        return;
+    }
+    auto cache = SamplerCache::find(device);
+    if (!cache || !cache->release(sampler)) {
+        device.destroySampler(sampler);
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vulkan/vulkan.hpp>
+
+namespace vks {
+
+// Reference counted samplers, keyed by their create info, so that every texture sampled the same way shares one
+// sampler.  Devices only promise maxSamplerAllocationCount (as few as 4000) samplers, and the loaders in texture.hpp
+// otherwise create one per texture.
+//
+// Samplers whose reference count drops to zero are kept for reuse until `purge` or `destroy`.  Cached samplers don't
+// change for as long as the cache lives, which makes them fit to be the immutable samplers of descriptor set layouts
+// in LayoutCache.  Create infos with a pNext chain (Y'CbCr conversion, reduction modes) aren't cached.
+//
+// A cache registers itself against its device, which is how acquireSampler and releaseSampler find it.
+class SamplerCache {
+public:
+    explicit SamplerCache(const vk::Device& device);
+    ~SamplerCache();
+
+    SamplerCache(const SamplerCache&) = delete;
+    SamplerCache& operator=(const SamplerCache&) = delete;
+
+    vk::Sampler acquire(const vk::SamplerCreateInfo& info);
+    // Returns false if `sampler` did not come from this cache
+    bool release(const vk::Sampler& sampler);
+
+    // Destroy all samplers that are not currently referenced
+    void purge();
+    // Destroy all samplers, referenced or not, and unregister from the device
+    void destroy();
+
+    size_t size() const;
+
+    static SamplerCache* find(const vk::Device& device);
+
+private:
+    struct Entry {
+        vk::Sampler sampler;
+        std::string key;
+        uint32_t refs{ 0 };
+    };
+
+    vk::Device device;
+    mutable std::mutex mutex;
+    std::unordered_map<VkSampler, Entry> samplers;
+    std::unordered_map<std::string, VkSampler> byKey;
+};
+
+// Acquire a sampler for `info` from the cache registered for `device`, or create an uncached one if there is none
+vk::Sampler acquireSampler(const vk::Device& device, const vk::SamplerCreateInfo& info);
+
+// Release a sampler from acquireSampler, or destroy it if it did not come from a cache
+void releaseSampler(const vk::Device& device, const vk::Sampler& sampler);
+
+}  // namespace vks
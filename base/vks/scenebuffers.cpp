@@ -0,0 +1,178 @@
+#include "scenebuffers.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+#include "barriers.hpp"
+#include "context.hpp"
+#include "model.hpp"
+
+using namespace vks;
+
+uint32_t SceneBuffers::add(const model::Model& model) {
+    if (context) {
+        throw std::runtime_error("Meshes can only be added to a scene before it is created");
+    }
+    if (model.hostVertices.empty() || model.hostIndices.size() != model.indexCount) {
+        throw std::runtime_error("Scene meshes need the host copy of their model, see ModelCreateInfo::hostCopy");
+    }
+    const uint32_t stride = model.layout.stride();
+    if (vertexStride != 0 && stride != vertexStride) {
+        throw std::runtime_error("All models of a scene must have the same vertex layout");
+    }
+    const uint32_t position = model.layout.componentIndex(model::VERTEX_COMPONENT_POSITION);
+    if (position == static_cast<uint32_t>(-1)) {
+        throw std::runtime_error("Scene meshes need vertex positions for their bounds");
+    }
+    vertexStride = stride;
+    const uint32_t positionOffset = model.layout.offset(position);
+
+    const uint32_t first = (uint32_t)meshes.size();
+    const uint32_t indexBase = (uint32_t)indexData.size();
+    for (const auto& part : model.parts) {
+        // Bounded by the sphere around the center of the part's box
+        glm::vec3 min{ FLT_MAX };
+        glm::vec3 max{ -FLT_MAX };
+        for (uint32_t v = part.vertexBase; v < part.vertexBase + part.vertexCount; ++v) {
+            glm::vec3 pos;
+            memcpy(&pos, model.hostVertices.data() + v * stride + positionOffset, sizeof(pos));
+            min = glm::min(min, pos);
+            max = glm::max(max, pos);
+        }
+        const glm::vec3 center = part.vertexCount ? (min + max) * 0.5f : glm::vec3(0.0f);
+        float radius = 0.0f;
+        for (uint32_t v = part.vertexBase; v < part.vertexBase + part.vertexCount; ++v) {
+            glm::vec3 pos;
+            memcpy(&pos, model.hostVertices.data() + v * stride + positionOffset, sizeof(pos));
+            radius = std::max(radius, glm::length(pos - center));
+        }
+
+        Mesh mesh{};
+        mesh.sphere = glm::vec4(center, radius);
+        mesh.firstIndex = indexBase + part.indexBase;
+        mesh.indexCount = part.indexCount;
+        // The model's indices start at its own first vertex
+        mesh.vertexOffset = (int32_t)vertexCount;
+        meshes.push_back(mesh);
+    }
+    vertexData.insert(vertexData.end(), model.hostVertices.begin(), model.hostVertices.end());
+    indexData.insert(indexData.end(), model.hostIndices.begin(), model.hostIndices.end());
+    vertexCount += (uint32_t)(model.hostVertices.size() / stride);
+    return first;
+}
+
+void SceneBuffers::create(const Context& context, vk::DeviceSize instanceStride, uint32_t instanceCapacity) {
+    if (!context.bufferDeviceAddressEnabled) {
+        throw std::runtime_error("Scene buffers need buffer device addresses, see Context::enableBufferDeviceAddress");
+    }
+    if (meshes.empty()) {
+        throw std::runtime_error("A scene needs at least one mesh");
+    }
+    this->context = &context;
+    this->instanceCapacity = instanceCapacity;
+
+    vertices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertexData);
+    indices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indexData);
+    meshBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, meshes);
+    // Uploaded, and a scene can't take more meshes once created
+    vertexData = {};
+    indexData = {};
+
+    instanceBuffer = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, instanceStride * std::max(instanceCapacity, 1u));
+    visible = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, sizeof(uint32_t) * std::max(instanceCapacity, 1u));
+    const vk::DeviceSize drawsSize = sizeof(vk::DrawIndexedIndirectCommand) * meshes.size();
+    draws = context.createDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer |
+                                           vk::BufferUsageFlagBits::eTransferDst,
+                                       drawsSize);
+    const auto hostMemory = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    drawTemplate = context.createBuffer(vk::BufferUsageFlagBits::eTransferSrc, hostMemory, drawsSize);
+    drawTemplate.map();
+    tableBuffer = context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer, hostMemory, sizeof(Table));
+    tableBuffer.map();
+
+    tableData = {};
+    tableData.meshes = meshBuffer.address;
+    tableData.instances = instanceBuffer.address;
+    tableData.visible = visible.address;
+    tableData.draws = draws.address;
+    tableData.meshCount = (uint32_t)meshes.size();
+    setInstanceCounts(std::vector<uint32_t>(meshes.size(), 0));
+}
+
+void SceneBuffers::destroy() {
+    vertices.destroy();
+    indices.destroy();
+    meshBuffer.destroy();
+    instanceBuffer.destroy();
+    visible.destroy();
+    draws.destroy();
+    drawTemplate.destroy();
+    tableBuffer.destroy();
+    vertexStride = 0;
+    vertexCount = 0;
+    vertexData.clear();
+    indexData.clear();
+    meshes.clear();
+    tableData = {};
+    context = nullptr;
+}
+
+void SceneBuffers::setInstanceCounts(const std::vector<uint32_t>& counts) {
+    if (counts.size() != meshes.size()) {
+        throw std::runtime_error("Scene instance counts must be given for every mesh");
+    }
+    const uint64_t total = std::accumulate(counts.begin(), counts.end(), uint64_t{ 0 });
+    if (total > instanceCapacity) {
+        throw std::runtime_error("More scene instances than the scene was created for");
+    }
+    // Every draw starts out empty, at the first of the slots of `visible` its instances can take
+    std::vector<vk::DrawIndexedIndirectCommand> empty(meshes.size());
+    uint32_t firstInstance = 0;
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        empty[i].indexCount = meshes[i].indexCount;
+        empty[i].instanceCount = 0;
+        empty[i].firstIndex = meshes[i].firstIndex;
+        empty[i].vertexOffset = meshes[i].vertexOffset;
+        empty[i].firstInstance = firstInstance;
+        firstInstance += counts[i];
+    }
+    drawTemplate.copy(empty);
+    tableData.instanceCount = (uint32_t)total;
+    tableBuffer.copy(tableData);
+}
+
+void SceneBuffers::recordReset(const vk::CommandBuffer& commandBuffer) const {
+    Barriers before;
+    before.memory(vk::PipelineStageFlagBits2KHR::eDrawIndirect | vk::PipelineStageFlagBits2KHR::eVertexShader, {},
+                  vk::PipelineStageFlagBits2KHR::eTransfer, vk::AccessFlagBits2KHR::eTransferWrite);
+    before.record(commandBuffer, *context);
+    commandBuffer.copyBuffer(drawTemplate.buffer, draws.buffer, vk::BufferCopy{ 0, 0, draws.size });
+    Barriers after;
+    after.memory(vk::PipelineStageFlagBits2KHR::eTransfer, vk::AccessFlagBits2KHR::eTransferWrite, vk::PipelineStageFlagBits2KHR::eComputeShader,
+                 vk::AccessFlagBits2KHR::eShaderRead | vk::AccessFlagBits2KHR::eShaderWrite);
+    after.record(commandBuffer, *context);
+}
+
+void SceneBuffers::recordCulled(const vk::CommandBuffer& commandBuffer) const {
+    Barriers culled;
+    culled.memory(vk::PipelineStageFlagBits2KHR::eComputeShader, vk::AccessFlagBits2KHR::eShaderWrite,
+                  vk::PipelineStageFlagBits2KHR::eDrawIndirect | vk::PipelineStageFlagBits2KHR::eVertexShader,
+                  vk::AccessFlagBits2KHR::eIndirectCommandRead | vk::AccessFlagBits2KHR::eShaderRead);
+    culled.record(commandBuffer, *context);
+}
+
+void SceneBuffers::draw(const vk::CommandBuffer& commandBuffer) const {
+    commandBuffer.bindVertexBuffers(0, vertices.buffer, { 0 });
+    commandBuffer.bindIndexBuffer(indices.buffer, 0, vk::IndexType::eUint32);
+    const uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+    if (context->enabledFeatures.multiDrawIndirect) {
+        commandBuffer.drawIndexedIndirect(draws.buffer, 0, meshCount(), stride);
+    } else {
+        for (uint32_t i = 0; i < meshCount(); ++i) {
+            commandBuffer.drawIndexedIndirect(draws.buffer, i * stride, 1, stride);
+        }
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "buffer.hpp"
+#include "forward.hpp"
+
+namespace vks {
+namespace model {
+struct Model;
+}
+
+// The geometry of many meshes merged into one vertex and one index buffer, and a table of the scene's buffers that
+// shaders reach through buffer device addresses, for GPU driven rendering of heterogeneous meshes.
+//
+// A culling compute shader reads the instances through the table and appends the ones that survive to the draw of
+// their mesh, one vk::DrawIndexedIndirectCommand per mesh, with the index of the instance going to the slot of
+// `visible` the draw's gl_InstanceIndex reaches.  The vertex shader then finds its instance by
+// instances[visible[gl_InstanceIndex]], so all meshes are drawn with a single multi draw indirect call no matter how
+// many instances of each survive.  data/shaders/base/scene.glsl declares the table and the append for the shaders.
+//
+// The layout of an instance is up to the application, which writes them, as long as the culling shader can tell the
+// mesh of each.  Needs Context::bufferDeviceAddressEnabled.
+class SceneBuffers {
+public:
+    // Must match SceneMesh of scene.glsl.  The bounding sphere is in the space of the mesh's vertices
+    struct Mesh {
+        glm::vec4 sphere;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        int32_t vertexOffset;
+        uint32_t _pad0;
+    };
+
+    // Must match SceneTable of scene.glsl
+    struct Table {
+        vk::DeviceAddress meshes;
+        vk::DeviceAddress instances;
+        vk::DeviceAddress visible;
+        vk::DeviceAddress draws;
+        uint32_t meshCount;
+        uint32_t instanceCount;
+    };
+
+    // Adds a mesh for each part of `model`, which has to have been loaded with ModelCreateInfo::hostCopy and have the
+    // vertex layout of the models added before it.  Returns the index of the first.  Only before create
+    uint32_t add(const vks::model::Model& model);
+
+    // Upload the geometry and meshes added so far and create buffers for `instanceCapacity` instances of
+    // `instanceStride` bytes each
+    void create(const vks::Context& context, vk::DeviceSize instanceStride, uint32_t instanceCapacity);
+    void destroy();
+
+    // The number of instances of each mesh, which the visible instances of its draw are given room for.  Whatever
+    // writes the instances must stick to these.  Nothing may be in flight.
+    void setInstanceCounts(const std::vector<uint32_t>& counts);
+
+    // Empty the draws for the culling shader, after the draws of the previous frame.  Outside of a render pass
+    void recordReset(const vk::CommandBuffer& commandBuffer) const;
+    // Make what the culling shader appended visible to the draws.  Outside of a render pass
+    void recordCulled(const vk::CommandBuffer& commandBuffer) const;
+    // Bind the merged geometry, as vertex binding 0 and 32 bit indices, and draw all meshes
+    void draw(const vk::CommandBuffer& commandBuffer) const;
+
+    // Written by the application, `instanceCount()` of them
+    const vks::Buffer& instances() const { return instanceBuffer; }
+    // For the shaders, usually through a push constant
+    vk::DeviceAddress table() const { return tableBuffer.address; }
+    uint32_t meshCount() const { return (uint32_t)meshes.size(); }
+    uint32_t instanceCount() const { return tableData.instanceCount; }
+
+private:
+    const vks::Context* context{ nullptr };
+    uint32_t vertexStride{ 0 };
+    uint32_t vertexCount{ 0 };
+    std::vector<uint8_t> vertexData;
+    std::vector<uint32_t> indexData;
+    std::vector<Mesh> meshes;
+    uint32_t instanceCapacity{ 0 };
+    Table tableData{};
+
+    vks::Buffer vertices;
+    vks::Buffer indices;
+    vks::Buffer meshBuffer;
+    vks::Buffer instanceBuffer;
+    vks::Buffer visible;
+    vks::Buffer draws;
+    // Host visible, the empty draws and the table are rewritten by setInstanceCounts
+    vks::Buffer drawTemplate;
+    vks::Buffer tableBuffer;
+};
+
+}  // namespace vks
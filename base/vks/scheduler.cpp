@@ -0,0 +1,157 @@
+#include "scheduler.hpp"
+
+#include "trace.hpp"
+
+using namespace vks;
+
+namespace {
+
+// The scheduler the current thread works for, if any, and its queue within that scheduler
+#ifdef WIN32
+__declspec(thread) const TaskScheduler* s_scheduler = nullptr;
+__declspec(thread) size_t s_workerIndex = 0;
+#else
+thread_local const TaskScheduler* s_scheduler = nullptr;
+thread_local size_t s_workerIndex = 0;
+#endif
+
+}  // namespace
+
+TaskScheduler::TaskScheduler(size_t threadCount) {
+    threadCount = threadCount ? threadCount : 1;
+    queues.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        queues.emplace_back(new Queue());
+    }
+    workers.reserve(threadCount - 1);
+    for (size_t i = 1; i < threadCount; ++i) {
+        workers.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+TaskScheduler& TaskScheduler::shared() {
+    static TaskScheduler scheduler;
+    return scheduler;
+}
+
+size_t TaskScheduler::workerIndex() const {
+    return s_scheduler == this ? s_workerIndex : 0;
+}
+
+void TaskScheduler::parallelFor(size_t first, size_t last, size_t grainSize, const RangeFunction& f) {
+    if (first >= last) {
+        return;
+    }
+    Group group;
+    group.function = &f;
+    group.grainSize = grainSize ? grainSize : 1;
+    group.pending = 1;
+
+    const size_t queueIndex = workerIndex();
+    execute(queueIndex, { &group, first, last });
+
+    // Help out until every piece of the range is done.  This may run tasks belonging to other
+    // groups, which is harmless and keeps nested parallelFor calls from deadlocking.
+    Task task;
+    while (group.pending.load() != 0) {
+        if (take(queueIndex, task)) {
+            execute(queueIndex, task);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    if (group.error) {
+        std::rethrow_exception(group.error);
+    }
+}
+
+void TaskScheduler::workerLoop(size_t index) {
+    s_scheduler = this;
+    s_workerIndex = index;
+#if defined(VKS_TRACE)
+    vks::trace::setThreadName("worker " + std::to_string(index));
+#endif
+    Task task;
+    while (true) {
+        if (take(index, task)) {
+            execute(index, task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || queued.load() != 0; });
+        if (stopping && queued.load() == 0) {
+            return;
+        }
+    }
+}
+
+void TaskScheduler::push(size_t queueIndex, const Task& task) {
+    {
+        auto& queue = *queues[queueIndex];
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(task);
+    }
+    {
+        // Taking the lock orders the increment against a worker checking the predicate and going to sleep
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        ++queued;
+    }
+    wake.notify_one();
+}
+
+bool TaskScheduler::take(size_t queueIndex, Task& outTask) {
+    const size_t count = queues.size();
+    for (size_t i = 0; i < count; ++i) {
+        auto& queue = *queues[(queueIndex + i) % count];
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            outTask = queue.tasks.back();
+            queue.tasks.pop_back();
+        } else {
+            outTask = queue.tasks.front();
+            queue.tasks.pop_front();
+        }
+        --queued;
+        return true;
+    }
+    return false;
+}
+
+void TaskScheduler::execute(size_t queueIndex, const Task& task) {
+    Group& group = *task.group;
+    size_t begin = task.begin;
+    size_t end = task.end;
+    // Keep the first half and offer the rest to other threads, splitting on grain boundaries so
+    // that the ranges handed to the function are the same whichever thread ends up running them
+    while (end - begin > group.grainSize) {
+        const size_t grains = (end - begin + group.grainSize - 1) / group.grainSize;
+        const size_t middle = begin + (grains / 2) * group.grainSize;
+        ++group.pending;
+        push(queueIndex, { &group, middle, end });
+        end = middle;
+    }
+    try {
+        (*group.function)(begin, end);
+    } catch (...) {
+        std::unique_lock<std::mutex> lock(group.errorMutex);
+        if (!group.error) {
+            group.error = std::current_exception();
+        }
+    }
+    --group.pending;
+}
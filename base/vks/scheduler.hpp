@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vks {
+
+// A work stealing scheduler for short, CPU bound jobs such as command buffer recording.
+//
+// Every participating thread owns a queue.  Work is split recursively: a thread keeps the first half
+// of a range and pushes the rest onto the back of its own queue, and idle threads steal from the
+// front of other queues, so the largest pending pieces migrate to whoever is free.  Unlike
+// vks::ThreadPool the calling thread takes part in the work instead of blocking.
+//
+// Per thread resources (command pools, scratch memory) can be indexed by workerIndex(): workers are
+// numbered 1 .. workerCount() - 1 and any other thread is 0, so only one non-worker thread should
+// drive the scheduler at a time if it relies on that index being exclusive.
+class TaskScheduler {
+public:
+    // Called with a half open range [begin, end)
+    using RangeFunction = std::function<void(size_t, size_t)>;
+
+    // `threadCount` includes the calling thread, so threadCount - 1 workers are started
+    explicit TaskScheduler(size_t threadCount = defaultThreadCount());
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // Number of distinct values workerIndex can return
+    size_t workerCount() const { return queues.size(); }
+    size_t workerIndex() const;
+
+    // Call `f` over [first, last) in ranges of at most `grainSize` elements and return once all of
+    // them have completed.  Ranges always start at `first + k * grainSize`, so `(begin - first) / grainSize`
+    // identifies a range independently of which thread runs it.  The first exception thrown by `f`
+    // is rethrown once every range has finished.
+    void parallelFor(size_t first, size_t last, size_t grainSize, const RangeFunction& f);
+
+    // Shared by the loaders that don't bring their own scheduler, model packing and texture decoding
+    static TaskScheduler& shared();
+
+    static size_t defaultThreadCount() {
+        const size_t count = std::thread::hardware_concurrency();
+        return count ? count : 1;
+    }
+
+private:
+    struct Group {
+        const RangeFunction* function{ nullptr };
+        size_t grainSize{ 1 };
+        // Tasks pushed or running that haven't completed yet
+        std::atomic<size_t> pending{ 0 };
+        std::mutex errorMutex;
+        std::exception_ptr error;
+    };
+    struct Task {
+        Group* group{ nullptr };
+        size_t begin{ 0 };
+        size_t end{ 0 };
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(size_t index);
+    void push(size_t queueIndex, const Task& task);
+    // Pops from the back of the thread's own queue, otherwise steals from the front of another
+    bool take(size_t queueIndex, Task& outTask);
+    void execute(size_t queueIndex, const Task& task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> queued{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping{ false };
+};
+
+}  // namespace vks
@@ -1,7 +1,50 @@
 #include "shaders.hpp"
 #include "filesystem.hpp"
+#include "glsl.hpp"
 #include "storage.hpp"
 
+#include <cstring>
+
+#include <sys/stat.h>
+
+using namespace vks::shaders;
+
+namespace {
+
+// FNV-1a
+uint64_t hashContents(const void* data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Files that can't be stat'ed (such as Android assets) are re-hashed on every acquire
+bool statFile(const std::string& filename, size_t& outSize, time_t& outTime) {
+    struct stat info;
+    if (0 != stat(filename.c_str(), &info)) {
+        return false;
+    }
+    outSize = static_cast<size_t>(info.st_size);
+    outTime = info.st_mtime;
+    return true;
+}
+
+std::mutex& registryMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::unordered_map<VkDevice, ModuleCache*>& registry() {
+    static std::unordered_map<VkDevice, ModuleCache*> caches;
+    return caches;
+}
+
+}  // namespace
+
 vk::ShaderModule vks::shaders::loadShaderModule(const vk::Device& device, const std::string& filename) {
     vk::ShaderModule result;
     {
@@ -22,3 +65,210 @@ vk::PipelineShaderStageCreateInfo vks::shaders::loadShader(const vk::Device& dev
     shaderStage.pName = entryPoint;
     return shaderStage;
 }
+
+ModuleCache::ModuleCache(const vk::Device& device)
+    : device(device) {
+    std::unique_lock<std::mutex> lock(registryMutex());
+    registry()[static_cast<VkDevice>(device)] = this;
+}
+
+ModuleCache::~ModuleCache() {
+    destroy();
+}
+
+ModuleCache* ModuleCache::find(const vk::Device& device) {
+    std::unique_lock<std::mutex> lock(registryMutex());
+    auto itr = registry().find(static_cast<VkDevice>(device));
+    return itr == registry().end() ? nullptr : itr->second;
+}
+
+vk::ShaderModule ModuleCache::acquire(const std::string& filename) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto stamp = [](const std::string& file, FileStamp& outStamp) {
+        outStamp.filename = file;
+        return statFile(file, outStamp.size, outStamp.mtime);
+    };
+    // Files that can't be stat'ed leave the list empty, which never counts as up to date
+    auto unchanged = [&](const std::vector<FileStamp>& files) {
+        for (const auto& file : files) {
+            FileStamp current;
+            if (!stamp(file.filename, current) || current.size != file.size || current.mtime != file.mtime) {
+                return false;
+            }
+        }
+        return !files.empty();
+    };
+
+    auto pathItr = byPath.find(filename);
+    if (pathItr != byPath.end() && unchanged(pathItr->second.files)) {
+        auto moduleItr = modules.find(pathItr->second.module);
+        if (moduleItr != modules.end()) {
+            ++moduleItr->second.refs;
+            return moduleItr->second.module;
+        }
+    }
+
+    std::vector<FileStamp> files;
+    storage::StoragePointer storage;
+    std::vector<uint32_t> spirv;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    const std::string source = compiler ? GlslCompiler::sourceFile(filename) : std::string();
+    FileStamp sourceStamp;
+    if (!source.empty() && stamp(source, sourceStamp)) {
+        auto result = compiler->compile(source);
+        for (const auto& dependency : result.dependencies) {
+            FileStamp file;
+            if (stamp(dependency, file)) {
+                files.push_back(file);
+            }
+        }
+        if (watcher) {
+            watcher->watch(filename, result.dependencies);
+        }
+        spirv = std::move(result.spirv);
+        data = reinterpret_cast<const uint8_t*>(spirv.data());
+        size = spirv.size() * sizeof(uint32_t);
+    } else {
+        storage = storage::Storage::readFile(filename);
+        data = storage->data();
+        size = storage->size();
+        FileStamp file;
+        if (stamp(filename, file)) {
+            files.push_back(file);
+        }
+    }
+
+    const uint64_t hash = hashContents(data, size);
+    VkShaderModule key = VK_NULL_HANDLE;
+    auto hashItr = byHash.find(hash);
+    if (hashItr != byHash.end() && modules[hashItr->second].size == size) {
+        key = hashItr->second;
+    } else {
+        Entry entry;
+        entry.module = device.createShaderModule({ {}, size, (const uint32_t*)data });
+        entry.hash = hash;
+        entry.size = size;
+        entry.code.assign(reinterpret_cast<const uint32_t*>(data), reinterpret_cast<const uint32_t*>(data) + size / sizeof(uint32_t));
+        key = static_cast<VkShaderModule>(entry.module);
+        modules[key] = entry;
+        byHash[hash] = key;
+    }
+
+    auto& pathInfo = byPath[filename];
+    pathInfo.module = key;
+    pathInfo.files = files;
+
+    auto& entry = modules[key];
+    ++entry.refs;
+    return entry.module;
+}
+
+bool ModuleCache::release(const vk::ShaderModule& module) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto itr = modules.find(static_cast<VkShaderModule>(module));
+    if (itr == modules.end()) {
+        return false;
+    }
+    if (itr->second.refs > 0) {
+        --itr->second.refs;
+    }
+    return true;
+}
+
+void ModuleCache::erase(VkShaderModule module) {
+    auto itr = modules.find(module);
+    auto hashItr = byHash.find(itr->second.hash);
+    if (hashItr != byHash.end() && hashItr->second == module) {
+        byHash.erase(hashItr);
+    }
+    device.destroyShaderModule(itr->second.module);
+    modules.erase(itr);
+}
+
+void ModuleCache::purge() {
+    std::unique_lock<std::mutex> lock(mutex);
+    std::vector<VkShaderModule> unused;
+    for (const auto& entry : modules) {
+        if (entry.second.refs == 0) {
+            unused.push_back(entry.first);
+        }
+    }
+    for (const auto& module : unused) {
+        erase(module);
+    }
+    for (auto itr = byPath.begin(); itr != byPath.end();) {
+        if (modules.count(itr->second.module) == 0) {
+            itr = byPath.erase(itr);
+        } else {
+            ++itr;
+        }
+    }
+}
+
+void ModuleCache::destroy() {
+    {
+        std::unique_lock<std::mutex> lock(registryMutex());
+        auto itr = registry().find(static_cast<VkDevice>(device));
+        if (itr != registry().end() && itr->second == this) {
+            registry().erase(itr);
+        }
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    for (const auto& entry : modules) {
+        device.destroyShaderModule(entry.second.module);
+    }
+    modules.clear();
+    byHash.clear();
+    byPath.clear();
+    compiler.reset();
+    watcher.reset();
+}
+
+void ModuleCache::setCompiler(const std::shared_ptr<GlslCompiler>& glslCompiler, const std::shared_ptr<ShaderWatcher>& shaderWatcher) {
+    std::unique_lock<std::mutex> lock(mutex);
+    compiler = glslCompiler;
+    watcher = shaderWatcher;
+}
+
+size_t ModuleCache::size() const {
+    std::unique_lock<std::mutex> lock(mutex);
+    return modules.size();
+}
+
+bool ModuleCache::getCode(const vk::ShaderModule& module, std::vector<uint32_t>& outCode) const {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto itr = modules.find(static_cast<VkShaderModule>(module));
+    if (itr == modules.end()) {
+        return false;
+    }
+    outCode = itr->second.code;
+    return true;
+}
+
+vk::ShaderModule vks::shaders::acquireShaderModule(const vk::Device& device, const std::string& filename) {
+    auto cache = ModuleCache::find(device);
+    return cache ? cache->acquire(filename) : loadShaderModule(device, filename);
+}
+
+void vks::shaders::releaseShaderModule(const vk::Device& device, const vk::ShaderModule& module) {
+    auto cache = ModuleCache::find(device);
+    if (!cache || !cache->release(module)) {
+        device.destroyShaderModule(module);
+    }
+}
+
+std::vector<uint32_t> vks::shaders::readShaderCode(const vk::Device& device, const std::string& filename) {
+    std::vector<uint32_t> result;
+    auto cache = ModuleCache::find(device);
+    if (cache) {
+        const auto module = cache->acquire(filename);
+        cache->getCode(module, result);
+        cache->release(module);
+        return result;
+    }
+    auto storage = storage::Storage::readFile(filename);
+    result.resize(storage->size() / sizeof(uint32_t));
+    memcpy(result.data(), storage->data(), result.size() * sizeof(uint32_t));
+    return result;
+}
@@ -1,10 +1,19 @@
 #pragma once
 
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <vulkan/vulkan.hpp>
 
 namespace vks { namespace shaders {
 
+class GlslCompiler;
+class ShaderWatcher;
+
 vk::ShaderModule loadShaderModule(const vk::Device& device, const std::string& filename);
 
 // Load a SPIR-V shader
@@ -12,4 +21,85 @@ vk::PipelineShaderStageCreateInfo loadShader(const vk::Device& device,
                                              const std::string& fileName,
                                              vk::ShaderStageFlagBits stage,
                                              const char* entryPoint = "main");
+
+// Reference counted shader modules, keyed by SPIR-V file path and content hash.
+//
+// A path whose size and modification time are unchanged since the last acquire is served
+// without touching the file.  Otherwise the file is re-read and hashed, and a module is only
+// created if no module with the same contents exists, so hot rebuilds that don't change a
+// shader (or that produce an identical binary) reuse the existing module.  Modules whose
+// reference count drops to zero are kept for reuse until `purge` or `destroy`.
+//
+// With a compiler, SPIR-V files next to their GLSL source are compiled from it instead, and are up to date for as
+// long as the source and its includes are.
+//
+// A cache registers itself against its device, which is how GraphicsPipelineBuilder finds it.
+class ModuleCache {
+public:
+    explicit ModuleCache(const vk::Device& device);
+    ~ModuleCache();
+
+    ModuleCache(const ModuleCache&) = delete;
+    ModuleCache& operator=(const ModuleCache&) = delete;
+
+    vk::ShaderModule acquire(const std::string& filename);
+    // Returns false if `module` did not come from this cache
+    bool release(const vk::ShaderModule& module);
+
+    // Destroy all modules that are not currently referenced
+    void purge();
+    // Destroy all modules, referenced or not, and unregister from the device
+    void destroy();
+
+    size_t size() const;
+
+    // The SPIR-V `module` was created from, false if it did not come from this cache
+    bool getCode(const vk::ShaderModule& module, std::vector<uint32_t>& outCode) const;
+
+    // Files acquired from then on are compiled from source where there is one, and watched by `watcher` if given
+    void setCompiler(const std::shared_ptr<GlslCompiler>& compiler, const std::shared_ptr<ShaderWatcher>& watcher = {});
+
+    static ModuleCache* find(const vk::Device& device);
+
+private:
+    struct Entry {
+        vk::ShaderModule module;
+        uint64_t hash{ 0 };
+        size_t size{ 0 };
+        // Kept for reflection
+        std::vector<uint32_t> code;
+        uint32_t refs{ 0 };
+    };
+    struct FileStamp {
+        std::string filename;
+        size_t size{ 0 };
+        time_t mtime{ 0 };
+    };
+    struct PathInfo {
+        VkShaderModule module{ VK_NULL_HANDLE };
+        // The files the module was made from, the SPIR-V file or the source and its includes
+        std::vector<FileStamp> files;
+    };
+
+    void erase(VkShaderModule module);
+
+    vk::Device device;
+    mutable std::mutex mutex;
+    std::unordered_map<VkShaderModule, Entry> modules;
+    std::unordered_map<uint64_t, VkShaderModule> byHash;
+    std::unordered_map<std::string, PathInfo> byPath;
+    std::shared_ptr<GlslCompiler> compiler;
+    std::shared_ptr<ShaderWatcher> watcher;
+};
+
+// Acquire `filename` from the cache registered for `device`, or create an uncached module if there is none
+vk::ShaderModule acquireShaderModule(const vk::Device& device, const std::string& filename);
+
+// Counterpart to acquireShaderModule: releases cached modules and destroys uncached ones
+void releaseShaderModule(const vk::Device& device, const vk::ShaderModule& module);
+
+// The SPIR-V of `filename`, as acquireShaderModule would create a module from it, compiled from source with a
+// shader compiler
+std::vector<uint32_t> readShaderCode(const vk::Device& device, const std::string& filename);
+
 }}  // namespace vks::shaders
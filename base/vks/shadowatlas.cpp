@@ -0,0 +1,170 @@
+#include "shadowatlas.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+using namespace vks;
+
+namespace {
+
+bool isPowerOfTwo(uint32_t value) {
+    return value && !(value & (value - 1));
+}
+
+// Every other bit of `value`, from the lowest, for a coordinate of a Z order index
+uint32_t compactBits(uint64_t value) {
+    uint32_t result = 0;
+    for (uint32_t bit = 0; bit < 32; ++bit) {
+        result |= (uint32_t)((value >> (2 * bit)) & 1) << bit;
+    }
+    return result;
+}
+
+}  // namespace
+
+void ShadowAtlas::create(uint32_t lightCount, uint32_t atlasSize, uint32_t minTileSize, uint32_t maxTileSize) {
+    if (!isPowerOfTwo(atlasSize) || !isPowerOfTwo(minTileSize) || !isPowerOfTwo(maxTileSize) || minTileSize > maxTileSize ||
+        maxTileSize > atlasSize) {
+        throw std::runtime_error("Shadow atlas and tile sizes must be powers of two, with the tiles no larger than the atlas");
+    }
+    if ((uint64_t)lightCount * minTileSize * minTileSize > (uint64_t)atlasSize * atlasSize) {
+        throw std::runtime_error("A shadow atlas of " + std::to_string(atlasSize) + " can't fit " + std::to_string(lightCount) + " lights");
+    }
+    this->atlasSize = atlasSize;
+    minTile = minTileSize;
+    maxTile = maxTileSize;
+    lights.assign(lightCount, Light{});
+}
+
+float ShadowAtlas::screenCoverage(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& center, float radius) {
+    const glm::vec3 viewCenter{ view * glm::vec4(center, 1.0f) };
+    if (glm::length(viewCenter) <= radius) {
+        return 1.0f;
+    }
+    // Looking down -z
+    const float distance = -viewCenter.z;
+    if (distance <= -radius) {
+        return 0.0f;
+    }
+    // The second diagonal element is the cotangent of half the vertical field of view, negative with a flipped y
+    return std::min(radius * std::abs(projection[1][1]) / std::max(distance, radius), 1.0f);
+}
+
+uint32_t ShadowAtlas::tileSize(const Light& light, float importance) const {
+    const float texels = std::min(std::max(importance, 0.0f), 1.0f) * (float)maxTile;
+    uint32_t size = minTile;
+    while (size < maxTile && (float)size < texels) {
+        size *= 2;
+    }
+    // Only shrink once the light needs less than three eighths of its tile rather than half, so that lights close
+    // to the threshold don't lose their cached depth every other frame
+    if (light.tile.size > size && texels > (float)light.tile.size * 0.375f) {
+        size = std::min(light.tile.size, maxTile);
+    }
+    return size;
+}
+
+bool ShadowAtlas::assign(const std::vector<float>& importance) {
+    if (importance.size() != lights.size()) {
+        throw std::runtime_error("Shadow atlas importance must be given for every light");
+    }
+    const uint32_t count = (uint32_t)lights.size();
+    std::vector<uint32_t> sizes(count);
+    uint64_t area = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        lights[i].importance = importance[i];
+        sizes[i] = tileSize(lights[i], importance[i]);
+        area += (uint64_t)sizes[i] * sizes[i];
+    }
+
+    // Halve the tiles of the least important lights until they all fit, create made sure they can
+    std::vector<uint32_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return importance[a] < importance[b]; });
+    const uint64_t capacity = (uint64_t)atlasSize * atlasSize;
+    while (area > capacity) {
+        const auto shrink = std::find_if(order.begin(), order.end(), [&](uint32_t i) { return sizes[i] > minTile; });
+        const uint64_t before = (uint64_t)sizes[*shrink] * sizes[*shrink];
+        sizes[*shrink] /= 2;
+        area -= before - before / 4;
+    }
+
+    // Largest first, each one starts at a multiple of its own area along the Z order curve, and so is aligned to its size
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sizes[a] > sizes[b]; });
+    bool changed = false;
+    uint64_t cursor = 0;
+    for (auto i : order) {
+        const uint32_t size = sizes[i];
+        const uint64_t index = cursor / ((uint64_t)size * size);
+        cursor += (uint64_t)size * size;
+        const Tile tile{ compactBits(index) * size, compactBits(index >> 1) * size, size };
+        auto& light = lights[i];
+        if (tile.x != light.tile.x || tile.y != light.tile.y || tile.size != light.tile.size) {
+            light.tile = tile;
+            light.stale = true;
+            light.moved = true;
+            light.staticCached = false;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void ShadowAtlas::invalidate(uint32_t light, bool staticCasters) {
+    lights[light].stale = true;
+    if (staticCasters) {
+        lights[light].staticCached = false;
+    }
+}
+
+std::vector<uint32_t> ShadowAtlas::schedule(uint32_t budget) {
+    std::vector<uint32_t> scheduled;
+    std::vector<uint32_t> candidates;
+    for (uint32_t i = 0; i < lights.size(); ++i) {
+        if (lights[i].moved) {
+            scheduled.push_back(i);
+        } else if (lights[i].stale) {
+            candidates.push_back(i);
+        }
+    }
+    // Weighted by how long they've waited, so that unimportant lights aren't starved
+    std::stable_sort(candidates.begin(), candidates.end(), [&](uint32_t a, uint32_t b) {
+        return lights[a].importance * (float)(lights[a].age + 1) > lights[b].importance * (float)(lights[b].age + 1);
+    });
+    for (auto i : candidates) {
+        if (scheduled.size() >= budget) {
+            break;
+        }
+        scheduled.push_back(i);
+    }
+    for (auto i : scheduled) {
+        lights[i].stale = false;
+        lights[i].moved = false;
+        lights[i].age = 0;
+    }
+    for (auto& light : lights) {
+        if (light.stale) {
+            ++light.age;
+        }
+    }
+    return scheduled;
+}
+
+glm::vec4 ShadowAtlas::rect(uint32_t light) const {
+    const Tile& t = lights[light].tile;
+    const float scale = 1.0f / (float)atlasSize;
+    return glm::vec4((float)t.size * scale, (float)t.size * scale, (float)t.x * scale, (float)t.y * scale);
+}
+
+vk::Viewport ShadowAtlas::viewport(uint32_t light) const {
+    const Tile& t = lights[light].tile;
+    return vk::Viewport{ (float)t.x, (float)t.y, (float)t.size, (float)t.size, 0.0f, 1.0f };
+}
+
+vk::Rect2D ShadowAtlas::scissor(uint32_t light) const {
+    const Tile& t = lights[light].tile;
+    return vk::Rect2D{ { (int32_t)t.x, (int32_t)t.y }, { t.size, t.size } };
+}
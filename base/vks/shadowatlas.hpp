@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+namespace vks {
+
+// Places the shadow maps of many lights in one texture, each light getting a square power of two tile sized by how
+// much of the screen it affects, and picks which of them to render each frame within a budget.
+//
+// The tiles are packed largest first in Z order, so they always fit while their total area does.  Past that the
+// least important lights get smaller tiles.  A light keeps its tile as long as the tile's size doesn't change, so
+// what was rendered into it stays valid, and sizes only drop once well below the threshold to avoid flip-flopping.
+//
+// A tile is stale after its light or the casters in it changed, see invalidate, and schedule hands out the stale
+// ones to render.  The depth of the static casters can be kept in a second texture with the same layout.  It stays
+// valid until the light moves or its tile changes, so refreshing a light for dynamic casters only copies it back and
+// renders those over it, see staticCached.
+//
+// Only decides, the rendering and the textures are up to the application.
+class ShadowAtlas {
+public:
+    struct Tile {
+        uint32_t x{ 0 };
+        uint32_t y{ 0 };
+        uint32_t size{ 0 };
+    };
+
+    // `lightCount` tiles of `minTileSize` to `maxTileSize` texels, both powers of two, in an atlas of `atlasSize`
+    void create(uint32_t lightCount, uint32_t atlasSize, uint32_t minTileSize, uint32_t maxTileSize);
+
+    // The fraction of the screen's height covered by a sphere at `center` of `radius`, from 0 to 1, as the importance
+    // of a light that reaches that far.  1 if the camera is inside it.
+    static float screenCoverage(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& center, float radius);
+
+    // Size and place the tile of every light for its importance, from 0 to 1.  Returns whether any tile moved, the
+    // lights of which are stale and have lost their cached static depth.
+    bool assign(const std::vector<float>& importance);
+
+    // The shadow of `light` has to be rendered again.  With `staticCasters` the light or its static casters
+    // changed, which also drops the cached static depth, otherwise only its dynamic casters did.
+    void invalidate(uint32_t light, bool staticCasters = true);
+
+    // Up to `budget` of the stale lights to render now, the most important and longest stale first.  Lights whose
+    // tile moved are always included whatever the budget, as their tile has nothing valid in it.  The lights handed
+    // out are taken to be up to date once rendered.
+    std::vector<uint32_t> schedule(uint32_t budget);
+
+    // Whether the static depth of `light` in the cache texture is still valid, and mark it valid once rendered
+    bool staticCached(uint32_t light) const { return lights[light].staticCached; }
+    void setStaticCached(uint32_t light) { lights[light].staticCached = true; }
+    bool stale(uint32_t light) const { return lights[light].stale; }
+
+    const Tile& tile(uint32_t light) const { return lights[light].tile; }
+    // Scale in xy and offset in zw from the light's shadow map coordinates to the atlas's
+    glm::vec4 rect(uint32_t light) const;
+    vk::Viewport viewport(uint32_t light) const;
+    vk::Rect2D scissor(uint32_t light) const;
+
+    uint32_t size() const { return atlasSize; }
+    uint32_t lightCount() const { return (uint32_t)lights.size(); }
+
+private:
+    struct Light {
+        Tile tile;
+        float importance{ 0.0f };
+        // Frames it has been stale for
+        uint32_t age{ 0 };
+        bool stale{ true };
+        // The tile moved since it was last rendered, so there's nothing in it to fall back on
+        bool moved{ true };
+        bool staticCached{ false };
+    };
+
+    uint32_t tileSize(const Light& light, float importance) const;
+
+    std::vector<Light> lights;
+    uint32_t atlasSize{ 0 };
+    uint32_t minTile{ 0 };
+    uint32_t maxTile{ 0 };
+};
+
+}  // namespace vks
@@ -0,0 +1,342 @@
+#include "simplify.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+#include "hash.hpp"
+
+using namespace vks::model;
+
+namespace {
+
+// Area weighted sum of squared distances to the planes of the triangles around a vertex
+struct Quadric {
+    double a00{ 0 }, a11{ 0 }, a22{ 0 }, a01{ 0 }, a02{ 0 }, a12{ 0 };
+    double b0{ 0 }, b1{ 0 }, b2{ 0 };
+    double c{ 0 };
+    // The area, which turns the sum into a mean
+    double weight{ 0 };
+
+    static Quadric plane(const glm::dvec3& normal, double distance, double weight) {
+        Quadric q;
+        q.a00 = weight * normal.x * normal.x;
+        q.a11 = weight * normal.y * normal.y;
+        q.a22 = weight * normal.z * normal.z;
+        q.a01 = weight * normal.x * normal.y;
+        q.a02 = weight * normal.x * normal.z;
+        q.a12 = weight * normal.y * normal.z;
+        q.b0 = weight * normal.x * distance;
+        q.b1 = weight * normal.y * distance;
+        q.b2 = weight * normal.z * distance;
+        q.c = weight * distance * distance;
+        q.weight = weight;
+        return q;
+    }
+
+    Quadric& operator+=(const Quadric& o) {
+        a00 += o.a00, a11 += o.a11, a22 += o.a22, a01 += o.a01, a02 += o.a02, a12 += o.a12;
+        b0 += o.b0, b1 += o.b1, b2 += o.b2;
+        c += o.c;
+        weight += o.weight;
+        return *this;
+    }
+
+    double eval(const glm::dvec3& p) const {
+        const double result = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z + 2 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z) +
+                              2 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+        return std::max(result, 0.0);
+    }
+};
+
+// Area weighted sum of squared distances to the attributes of the vertices collapsed into a vertex
+struct AttributeQuadric {
+    double weight{ 0 };
+    double sum[MAX_SIMPLIFY_ATTRIBUTES]{};
+    double sumSquares{ 0 };
+
+    AttributeQuadric& operator+=(const AttributeQuadric& o) {
+        weight += o.weight;
+        for (uint32_t i = 0; i < MAX_SIMPLIFY_ATTRIBUTES; ++i) {
+            sum[i] += o.sum[i];
+        }
+        sumSquares += o.sumSquares;
+        return *this;
+    }
+
+    double eval(const float* attributes, uint32_t count) const {
+        double result = sumSquares;
+        for (uint32_t i = 0; i < count; ++i) {
+            result += weight * attributes[i] * attributes[i] - 2 * attributes[i] * sum[i];
+        }
+        return std::max(result, 0.0);
+    }
+};
+
+struct Collapse {
+    uint32_t from;
+    uint32_t to;
+    double cost;
+};
+
+glm::vec3 readPosition(const uint8_t* vertices, size_t stride, size_t positionOffset, uint32_t vertex) {
+    glm::vec3 result;
+    memcpy(&result, vertices + vertex * stride + positionOffset, sizeof(result));
+    return result;
+}
+
+// Maps every vertex to the first one with the same `size` bytes at `offset`
+std::vector<uint32_t> weld(const uint8_t* vertices, size_t vertexCount, size_t stride, size_t offset, size_t size) {
+    std::vector<uint32_t> result(vertexCount);
+    std::unordered_map<uint64_t, std::vector<uint32_t>> byHash;
+    for (uint32_t vertex = 0; vertex < vertexCount; ++vertex) {
+        const uint8_t* data = vertices + vertex * stride + offset;
+        vks::KeyHasher hasher;
+        hasher.add(data, size);
+        auto& candidates = byHash[hasher.hash];
+        result[vertex] = vertex;
+        for (const auto candidate : candidates) {
+            if (0 == memcmp(vertices + candidate * stride + offset, data, size)) {
+                result[vertex] = candidate;
+                break;
+            }
+        }
+        if (result[vertex] == vertex) {
+            candidates.push_back(vertex);
+        }
+    }
+    return result;
+}
+
+uint64_t edgeKey(uint32_t a, uint32_t b) {
+    return a < b ? (uint64_t(a) << 32 | b) : (uint64_t(b) << 32 | a);
+}
+
+}  // namespace
+
+size_t vks::model::simplify(uint32_t* destination,
+                            const uint32_t* indices,
+                            size_t indexCount,
+                            const uint8_t* vertices,
+                            size_t vertexCount,
+                            size_t stride,
+                            size_t positionOffset,
+                            const std::vector<SimplifyAttribute>& attributes,
+                            size_t targetIndexCount,
+                            float targetError,
+                            float& outError) {
+    outError = 0.0f;
+    const std::vector<uint32_t> remap = weld(vertices, vertexCount, stride, 0, stride);
+    const std::vector<uint32_t> positionRemap = weld(vertices, vertexCount, stride, positionOffset, sizeof(glm::vec3));
+    std::vector<uint32_t> triangles(indices, indices + indexCount);
+    for (auto& index : triangles) {
+        index = remap[index];
+    }
+
+    // Positions are scaled to the unit cube, so that errors and attribute weights don't depend on the size of the mesh
+    glm::vec3 minimum{ FLT_MAX }, maximum{ -FLT_MAX };
+    for (const auto index : triangles) {
+        const glm::vec3 position = readPosition(vertices, stride, positionOffset, index);
+        minimum = glm::min(minimum, position);
+        maximum = glm::max(maximum, position);
+    }
+    const float extent = indexCount ? std::max(std::max(maximum.x - minimum.x, maximum.y - minimum.y), maximum.z - minimum.z) : 0.0f;
+    const double scale = extent > 0.0f ? 1.0 / extent : 1.0;
+    std::vector<glm::dvec3> positions(vertexCount);
+    for (uint32_t vertex = 0; vertex < vertexCount; ++vertex) {
+        positions[vertex] = glm::dvec3(readPosition(vertices, stride, positionOffset, vertex) - minimum) * scale;
+    }
+
+    // Attributes are scaled by the square root of their weight, so that the quadrics can ignore the weights
+    uint32_t attributeCount = 0;
+    for (const auto& attribute : attributes) {
+        attributeCount += attribute.components;
+    }
+    attributeCount = std::min(attributeCount, MAX_SIMPLIFY_ATTRIBUTES);
+    std::vector<float> attributeValues(vertexCount * attributeCount);
+    for (uint32_t vertex = 0; vertex < vertexCount && attributeCount; ++vertex) {
+        float* out = attributeValues.data() + vertex * attributeCount;
+        uint32_t written = 0;
+        for (const auto& attribute : attributes) {
+            const float factor = sqrtf(attribute.weight);
+            for (uint32_t i = 0; i < attribute.components && written < attributeCount; ++i, ++written) {
+                float value;
+                memcpy(&value, vertices + vertex * stride + attribute.offset + i * sizeof(float), sizeof(value));
+                out[written] = value * factor;
+            }
+        }
+    }
+
+    // Vertices sharing their position with vertices that have other attributes lie on a seam, and edges of only one
+    // triangle, or more than two, on a border
+    std::vector<bool> locked(vertexCount, false);
+    {
+        std::unordered_map<uint32_t, uint32_t> positionOwner;
+        for (const auto index : triangles) {
+            auto inserted = positionOwner.insert({ positionRemap[index], index });
+            if (!inserted.second && inserted.first->second != index) {
+                locked[index] = true;
+                locked[inserted.first->second] = true;
+            }
+        }
+        std::unordered_map<uint64_t, uint32_t> edgeUses;
+        for (size_t i = 0; i < triangles.size(); i += 3) {
+            for (uint32_t e = 0; e < 3; ++e) {
+                ++edgeUses[edgeKey(positionRemap[triangles[i + e]], positionRemap[triangles[i + (e + 1) % 3]])];
+            }
+        }
+        for (size_t i = 0; i < triangles.size(); i += 3) {
+            for (uint32_t e = 0; e < 3; ++e) {
+                const uint32_t a = triangles[i + e], b = triangles[i + (e + 1) % 3];
+                if (edgeUses[edgeKey(positionRemap[a], positionRemap[b])] != 2) {
+                    locked[a] = true;
+                    locked[b] = true;
+                }
+            }
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertexCount);
+    std::vector<AttributeQuadric> attributeQuadrics(vertexCount);
+    for (size_t i = 0; i < triangles.size(); i += 3) {
+        const glm::dvec3& p0 = positions[triangles[i]];
+        const glm::dvec3 cross = glm::cross(positions[triangles[i + 1]] - p0, positions[triangles[i + 2]] - p0);
+        const double length = glm::length(cross);
+        if (length <= 0.0) {
+            continue;
+        }
+        const glm::dvec3 normal = cross / length;
+        const double area = 0.5 * length;
+        const Quadric quadric = Quadric::plane(normal, -glm::dot(normal, p0), area);
+        for (uint32_t corner = 0; corner < 3; ++corner) {
+            const uint32_t vertex = triangles[i + corner];
+            quadrics[vertex] += quadric;
+            auto& attributeQuadric = attributeQuadrics[vertex];
+            const float* values = attributeValues.data() + vertex * attributeCount;
+            const double weight = area / 3.0;
+            attributeQuadric.weight += weight;
+            for (uint32_t a = 0; a < attributeCount; ++a) {
+                attributeQuadric.sum[a] += weight * values[a];
+                attributeQuadric.sumSquares += weight * values[a] * values[a];
+            }
+        }
+    }
+
+    const double errorLimit = double(targetError) * targetError;
+    double largestError = 0.0;
+    std::vector<uint32_t> collapsed(vertexCount);
+    std::vector<bool> touched(vertexCount);
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<Collapse> candidates;
+    while (triangles.size() > targetIndexCount) {
+        // The triangles around each vertex
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (const auto index : triangles) {
+            ++adjacencyOffsets[index + 1];
+        }
+        for (size_t vertex = 0; vertex < vertexCount; ++vertex) {
+            adjacencyOffsets[vertex + 1] += adjacencyOffsets[vertex];
+        }
+        adjacency.resize(triangles.size());
+        {
+            std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (size_t i = 0; i < triangles.size(); ++i) {
+                adjacency[fill[triangles[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+        }
+
+        candidates.clear();
+        for (size_t i = 0; i < triangles.size(); i += 3) {
+            for (uint32_t e = 0; e < 3; ++e) {
+                const uint32_t a = triangles[i + e], b = triangles[i + (e + 1) % 3];
+                for (uint32_t direction = 0; direction < 2; ++direction) {
+                    const uint32_t from = direction ? b : a, to = direction ? a : b;
+                    if (locked[from]) {
+                        continue;
+                    }
+                    Quadric quadric = quadrics[from];
+                    quadric += quadrics[to];
+                    AttributeQuadric attributeQuadric = attributeQuadrics[from];
+                    attributeQuadric += attributeQuadrics[to];
+                    const double weight = std::max(quadric.weight, 1e-12);
+                    const float* toAttributes = attributeValues.data() + to * attributeCount;
+                    const double cost = (quadric.eval(positions[to]) + attributeQuadric.eval(toAttributes, attributeCount)) / weight;
+                    candidates.push_back({ from, to, cost });
+                }
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+        for (uint32_t vertex = 0; vertex < vertexCount; ++vertex) {
+            collapsed[vertex] = vertex;
+        }
+        std::fill(touched.begin(), touched.end(), false);
+        size_t remaining = triangles.size();
+        size_t collapses = 0;
+        for (const auto& candidate : candidates) {
+            if (candidate.cost > errorLimit || remaining <= targetIndexCount) {
+                break;
+            }
+            const uint32_t from = candidate.from, to = candidate.to;
+            if (touched[from] || touched[to]) {
+                continue;
+            }
+            // Moving `from` onto `to` must not flip any of the triangles that remain
+            bool flips = false;
+            size_t removed = 0;
+            for (uint32_t t = adjacencyOffsets[from]; t < adjacencyOffsets[from + 1] && !flips; ++t) {
+                const uint32_t* triangle = triangles.data() + adjacency[t] * 3;
+                if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+                    ++removed;
+                    continue;
+                }
+                glm::dvec3 corners[3], moved[3];
+                for (uint32_t corner = 0; corner < 3; ++corner) {
+                    corners[corner] = positions[triangle[corner]];
+                    moved[corner] = triangle[corner] == from ? positions[to] : corners[corner];
+                }
+                const glm::dvec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                const glm::dvec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                flips = glm::dot(before, after) <= 0.25 * glm::length(before) * glm::length(after);
+            }
+            if (flips) {
+                continue;
+            }
+            collapsed[from] = to;
+            quadrics[to] += quadrics[from];
+            attributeQuadrics[to] += attributeQuadrics[from];
+            // Nothing else around `from` moves this pass, which keeps the flip tests above valid
+            for (uint32_t t = adjacencyOffsets[from]; t < adjacencyOffsets[from + 1]; ++t) {
+                const uint32_t* triangle = triangles.data() + adjacency[t] * 3;
+                touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+            }
+            Quadric positionQuadric = quadrics[to];
+            largestError = std::max(largestError, positionQuadric.eval(positions[to]) / std::max(positionQuadric.weight, 1e-12));
+            remaining -= removed * 3;
+            ++collapses;
+        }
+        if (!collapses) {
+            break;
+        }
+
+        size_t written = 0;
+        for (size_t i = 0; i < triangles.size(); i += 3) {
+            const uint32_t a = collapsed[triangles[i]], b = collapsed[triangles[i + 1]], c = collapsed[triangles[i + 2]];
+            if (a != b && b != c && a != c) {
+                triangles[written++] = a;
+                triangles[written++] = b;
+                triangles[written++] = c;
+            }
+        }
+        triangles.resize(written);
+    }
+
+    std::copy(triangles.begin(), triangles.end(), destination);
+    outError = static_cast<float>(sqrt(largestError) * extent);
+    return triangles.size();
+}
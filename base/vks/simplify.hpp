@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vks { namespace model {
+
+// Float vertex attributes the simplifier tries to keep, next to the positions
+struct SimplifyAttribute {
+    // Byte offset of the attribute within a vertex
+    uint32_t offset;
+    // Number of floats, at most MAX_SIMPLIFY_ATTRIBUTES over all attributes
+    uint32_t components;
+    // How much a change of one unit weighs against moving the surface by the size of the mesh
+    float weight;
+};
+
+const uint32_t MAX_SIMPLIFY_ATTRIBUTES = 8;
+
+// Reduce a triangle list to at most `targetIndexCount` indices by edge collapses in the order of Garland and Heckbert's
+// quadric error metric, extended by a quadric over the attributes of the vertices collapsed into each other.  Edges
+// collapse into one of their vertices, so the result indexes the same vertices as the input and can share its vertex
+// buffer.  Vertices that are bitwise identical are merged first.
+//
+// Vertices on open borders, and vertices whose position is shared by vertices with other attributes (UV and normal
+// seams), never move, which keeps silhouettes and seams intact, and stops short of the target on meshes made mostly of
+// seams.  Simplification also stops once the next collapse would move the surface by more than `targetError` times
+// the size of the mesh.
+//
+// `destination` has space for `indexCount` indices and may be `indices`.  Returns the number of indices written, and
+// the largest distance the surface moved, in the units of the positions, in `outError`.
+size_t simplify(uint32_t* destination,
+                const uint32_t* indices,
+                size_t indexCount,
+                const uint8_t* vertices,
+                size_t vertexCount,
+                size_t stride,
+                size_t positionOffset,
+                const std::vector<SimplifyAttribute>& attributes,
+                size_t targetIndexCount,
+                float targetError,
+                float& outError);
+
+}}  // namespace vks::model
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "buffer.hpp"
+#include "forward.hpp"
+
+namespace vks { namespace model {
+
+// Linear blend skinning in a compute shader, once per frame for any number of instances of one mesh.  The skinned
+// positions and normals of every instance land in one vertex buffer, so every pass that draws the mesh afterwards
+// (depth prepass, shadows, the main pass) reads finished vertices instead of skinning them again, and the number
+// of bones is only limited by the size of the palette buffer.
+//
+// Passes draw instance `i` with `output` bound at outputOffset(i) as a per vertex stream of OUTPUT_STRIDE bytes
+// (vec3 position, vec3 normal), next to the source vertex buffer for the attributes skinning doesn't touch.
+class ComputeSkinning {
+public:
+    // Where the skinning inputs are in the source vertices.  Offsets and the stride are in bytes and must be
+    // multiples of 4, positions and normals are three floats, weights four floats and joints four uint32.
+    struct SourceLayout {
+        uint32_t stride{ 0 };
+        uint32_t position{ 0 };
+        uint32_t normal{ 0 };
+        uint32_t weights{ 0 };
+        uint32_t joints{ 0 };
+    };
+
+    static const uint32_t OUTPUT_STRIDE = 6 * sizeof(float);
+
+    // Skinned vertices, instance after instance
+    Buffer output;
+    // mat4 per bone per instance, host visible, coherent and persistently mapped
+    Buffer palettes;
+
+    // `vertices` needs storage buffer usage, see ModelCreateInfo::vertexUsage
+    void create(const vks::Context& context,
+                const std::string& shaderPath,
+                const vk::Buffer& vertices,
+                uint32_t vertexCount,
+                const SourceLayout& layout,
+                uint32_t bonesPerInstance,
+                uint32_t maxInstances);
+    void destroy();
+
+    uint32_t maxInstances() const { return instanceCapacity; }
+
+    // The bonesPerInstance matrices of `instance`.  The command buffers skinning reads them are usually still
+    // in flight, so like uniform buffers written every frame, writes may show up a frame early.
+    glm::mat4* palette(uint32_t instance) const { return static_cast<glm::mat4*>(palettes.mapped) + instance * bones; }
+
+    vk::DeviceSize outputOffset(uint32_t instance) const { return (vk::DeviceSize)instance * vertexCount * OUTPUT_STRIDE; }
+
+    // Skin the first `instanceCount` instances, ordered after the vertex input of earlier commands and before the
+    // vertex input of later ones.  Must be recorded outside of a render pass.
+    void record(const vk::CommandBuffer& commandBuffer, uint32_t instanceCount) const;
+
+private:
+    vk::Device device;
+    uint32_t vertexCount{ 0 };
+    uint32_t bones{ 0 };
+    uint32_t instanceCapacity{ 0 };
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::DescriptorPool descriptorPool;
+    vk::DescriptorSet descriptorSet;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline pipeline;
+};
+
+}}  // namespace vks::model
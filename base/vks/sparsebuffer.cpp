@@ -0,0 +1,165 @@
+#include "sparsebuffer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+#include "context.hpp"
+
+using namespace vks;
+
+namespace {
+
+vk::BufferCreateInfo sparseCreateInfo(const vk::BufferUsageFlags& usage, vk::DeviceSize size) {
+    vk::BufferCreateInfo createInfo;
+    createInfo.flags = vk::BufferCreateFlagBits::eSparseBinding | vk::BufferCreateFlagBits::eSparseResidency;
+    createInfo.usage = usage;
+    createInfo.size = size;
+    return createInfo;
+}
+
+}  // namespace
+
+bool SparseBuffer::supported(const Context& context, const vk::BufferUsageFlags& usage, const vk::MemoryPropertyFlags& memoryProperties) {
+    if (!context.enabledFeatures.sparseBinding || !context.enabledFeatures.sparseResidencyBuffer ||
+        !(context.queueFamilyProperties[context.queueIndices.graphics].queueFlags & vk::QueueFlagBits::eSparseBinding)) {
+        return false;
+    }
+    // The memory types a sparse buffer can be bound to may differ from those of a regular one
+    const vk::Buffer probe = context.device.createBuffer(sparseCreateInfo(usage, 1));
+    const auto requirements = context.device.getBufferMemoryRequirements(probe);
+    context.device.destroy(probe);
+    uint32_t memoryType = 0;
+    return VK_FALSE != context.getMemoryType(requirements.memoryTypeBits, memoryProperties, &memoryType);
+}
+
+void SparseBuffer::create(const Context& context,
+                          const vk::BufferUsageFlags& usage,
+                          vk::DeviceSize reservedSize,
+                          const vk::MemoryPropertyFlags& memoryProperties) {
+    destroy();
+    if (!supported(context, usage, memoryProperties)) {
+        throw std::runtime_error("The device does not support sparse buffers for " + vk::to_string(usage) + " in " + vk::to_string(memoryProperties));
+    }
+    if (reservedSize > context.deviceProperties.limits.sparseAddressSpaceSize) {
+        throw std::runtime_error("A sparse buffer of " + std::to_string(reservedSize) + " bytes exceeds the sparse address space of the device");
+    }
+    this->context = &context;
+    buffer = context.device.createBuffer(sparseCreateInfo(usage, std::max<vk::DeviceSize>(reservedSize, 1)));
+    // The alignment of a sparse buffer is its block size, and its size is a whole number of them
+    const auto requirements = context.device.getBufferMemoryRequirements(buffer);
+    page = requirements.alignment;
+    reserved = requirements.size;
+    memoryType = context.getMemoryType(requirements.memoryTypeBits, memoryProperties);
+    hostVisible = (bool)(memoryProperties & vk::MemoryPropertyFlagBits::eHostVisible);
+    pages.assign((size_t)(reserved / page), false);
+    committedPages = 0;
+}
+
+void SparseBuffer::destroy() {
+    if (!context) {
+        return;
+    }
+    const auto& device = context->device;
+    device.destroy(buffer);
+    buffer = vk::Buffer();
+    for (const auto& memory : memories) {
+        // Unmapped along with it
+        device.freeMemory(memory);
+    }
+    memories.clear();
+    blocks.clear();
+    pages.clear();
+    committedPages = 0;
+    reserved = 0;
+    page = 0;
+    context = nullptr;
+}
+
+bool SparseBuffer::committed(vk::DeviceSize offset, vk::DeviceSize size) const {
+    if (!size) {
+        return true;
+    }
+    if (offset + size > reserved) {
+        return false;
+    }
+    const size_t first = (size_t)(offset / page);
+    const size_t last = (size_t)((offset + size + page - 1) / page);
+    return std::all_of(pages.begin() + first, pages.begin() + last, [](bool bound) { return bound; });
+}
+
+bool SparseBuffer::commit(vk::DeviceSize offset, vk::DeviceSize size) {
+    if (offset + size > reserved) {
+        throw std::runtime_error("Committing past the end of a sparse buffer's reserved range");
+    }
+    if (committed(offset, size)) {
+        return false;
+    }
+
+    // The runs of unbound pages in the range, all bound to consecutive parts of one allocation
+    const size_t first = (size_t)(offset / page);
+    const size_t last = (size_t)((offset + size + page - 1) / page);
+    std::vector<vk::SparseMemoryBind> binds;
+    vk::DeviceSize memorySize = 0;
+    for (size_t i = first; i < last;) {
+        if (pages[i]) {
+            ++i;
+            continue;
+        }
+        size_t end = i;
+        while (end < last && !pages[end]) {
+            pages[end++] = true;
+        }
+        vk::SparseMemoryBind bind;
+        bind.resourceOffset = i * page;
+        bind.size = (end - i) * page;
+        bind.memoryOffset = memorySize;
+        binds.push_back(bind);
+        memorySize += bind.size;
+        committedPages += end - i;
+        i = end;
+    }
+
+    const auto& device = context->device;
+    const vk::DeviceMemory memory = device.allocateMemory(vk::MemoryAllocateInfo{ memorySize, memoryType });
+    memories.push_back(memory);
+    uint8_t* mapped = hostVisible ? static_cast<uint8_t*>(device.mapMemory(memory, 0, VK_WHOLE_SIZE)) : nullptr;
+    for (auto& bind : binds) {
+        bind.memory = memory;
+        blocks.push_back(Block{ bind.resourceOffset, bind.size, mapped ? mapped + bind.memoryOffset : nullptr });
+    }
+    std::sort(blocks.begin(), blocks.end(), [](const Block& a, const Block& b) { return a.resourceOffset < b.resourceOffset; });
+
+    const vk::SparseBufferMemoryBindInfo bufferBindInfo{ buffer, (uint32_t)binds.size(), binds.data() };
+    vk::BindSparseInfo bindSparseInfo;
+    bindSparseInfo.bufferBindCount = 1;
+    bindSparseInfo.pBufferBinds = &bufferBindInfo;
+    // Growing is rare, so rather than a semaphore every later submission would have to wait on, the host waits
+    const vk::Fence fence = device.createFence(vk::FenceCreateInfo{});
+    context->queue.bindSparse(bindSparseInfo, fence);
+    device.waitForFences(fence, VK_TRUE, UINT64_MAX);
+    device.destroy(fence);
+    return true;
+}
+
+void SparseBuffer::write(vk::DeviceSize offset, const void* data, vk::DeviceSize size) const {
+    assert(hostVisible && committed(offset, size));
+    if (!size) {
+        return;
+    }
+    const uint8_t* source = static_cast<const uint8_t*>(data);
+    // The last block starting at or before the offset, the range continues into the ones after it
+    auto block = std::upper_bound(blocks.begin(), blocks.end(), offset, [](vk::DeviceSize value, const Block& b) { return value < b.resourceOffset; });
+    --block;
+    while (size) {
+        assert(offset >= block->resourceOffset && offset < block->resourceOffset + block->size);
+        const vk::DeviceSize within = offset - block->resourceOffset;
+        const vk::DeviceSize count = std::min(size, block->size - within);
+        memcpy(block->mapped + within, source, (size_t)count);
+        source += count;
+        offset += count;
+        size -= count;
+        ++block;
+    }
+}
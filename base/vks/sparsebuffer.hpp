@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "forward.hpp"
+
+namespace vks {
+
+// A buffer that reserves a large range of addresses up front and backs parts of it with memory as they're needed,
+// through sparse residency.  Growing commits more pages without a copy, and the handle and the offsets into it stay
+// the same, so descriptors and recorded command buffers that refer to it remain valid.
+//
+// Memory is bound in pages of the buffer's sparse block size, each commit allocating one block of memory for the pages
+// of its range that weren't bound yet, so callers should grow geometrically.  Commits bind on the graphics queue and
+// wait for the binding, which doesn't affect the committed pages the device may be using meanwhile.  Reading
+// pages that were never committed is undefined unless the device has residencyNonResidentStrict.
+//
+// Needs the sparseBinding and sparseResidencyBuffer features, and a graphics queue with sparse binding, see supported.
+class SparseBuffer {
+public:
+    SparseBuffer() = default;
+    SparseBuffer(const SparseBuffer& other) = delete;
+    SparseBuffer& operator=(const SparseBuffer& other) = delete;
+    ~SparseBuffer() { destroy(); }
+
+    // Whether buffers of `usage` can be sparse on the device of `context`, backed by memory with `memoryProperties`
+    static bool supported(const vks::Context& context, const vk::BufferUsageFlags& usage, const vk::MemoryPropertyFlags& memoryProperties);
+
+    // Reserve `reservedSize` bytes, rounded up to whole pages, with nothing committed yet
+    void create(const vks::Context& context,
+                const vk::BufferUsageFlags& usage,
+                vk::DeviceSize reservedSize,
+                const vk::MemoryPropertyFlags& memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal);
+    // The buffer must no longer be in use by the device
+    void destroy();
+
+    operator bool() const { return buffer.operator bool(); }
+    const vk::Buffer& handle() const { return buffer; }
+
+    // Back [offset, offset + size) with memory, rounded out to whole pages.  Returns whether anything was bound.
+    // Host visible memory is mapped persistently, for write.
+    bool commit(vk::DeviceSize offset, vk::DeviceSize size);
+    bool committed(vk::DeviceSize offset, vk::DeviceSize size) const;
+
+    // Copy to committed pages of host visible memory, which isn't flushed, so it should be coherent.  The range may
+    // cross from one commit's memory into another's
+    void write(vk::DeviceSize offset, const void* data, vk::DeviceSize size) const;
+
+    vk::DeviceSize reservedSize() const { return reserved; }
+    vk::DeviceSize committedSize() const { return committedPages * page; }
+    // The sparse block size of the buffer
+    vk::DeviceSize pageSize() const { return page; }
+
+private:
+    // Consecutive pages from resourceOffset on, bound to one part of the memory of a commit
+    struct Block {
+        vk::DeviceSize resourceOffset;
+        vk::DeviceSize size;
+        uint8_t* mapped;
+    };
+
+    const vks::Context* context{ nullptr };
+    vk::Buffer buffer;
+    vk::DeviceSize reserved{ 0 };
+    vk::DeviceSize page{ 0 };
+    uint32_t memoryType{ 0 };
+    bool hostVisible{ false };
+    std::vector<bool> pages;
+    size_t committedPages{ 0 };
+    // One allocation per commit, and the blocks bound to them ordered by resourceOffset
+    std::vector<vk::DeviceMemory> memories;
+    std::vector<Block> blocks;
+};
+
+}  // namespace vks
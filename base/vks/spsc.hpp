@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace vks {
+
+// A bounded queue between exactly one producer thread and one consumer thread, without locks.
+//
+// The producer only writes `head` and the consumer only writes `tail`, each publishing its slots to the other with a
+// release store, so push and pop are a couple of loads and a store each and never wait.  A full queue rejects the
+// push rather than blocking the producer, which is the point for producers like the frame loop.
+template <typename T>
+class SpscQueue {
+public:
+    // Rounded up to a power of two
+    explicit SpscQueue(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        if (size < 2) {
+            size = 2;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer only.  Returns false, dropping `value`, when the queue is full.
+    bool push(const T& value) {
+        const size_t position = head.load(std::memory_order_relaxed);
+        if (position - cachedTail > mask) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (position - cachedTail > mask) {
+                return false;
+            }
+        }
+        slots[position & mask] = value;
+        head.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only.  Returns false when the queue is empty.
+    bool pop(T& value) {
+        const size_t position = tail.load(std::memory_order_relaxed);
+        if (position == cachedHead) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (position == cachedHead) {
+                return false;
+            }
+        }
+        value = slots[position & mask];
+        tail.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+private:
+    std::vector<T> slots;
+    size_t mask{ 0 };
+    // Each side's index and its cached copy of the other side's are on a cache line of their own, so the two threads
+    // only share a line when one has to look at the other's progress
+    alignas(64) std::atomic<size_t> head{ 0 };
+    size_t cachedTail{ 0 };
+    alignas(64) std::atomic<size_t> tail{ 0 };
+    size_t cachedHead{ 0 };
+};
+
+}  // namespace vks
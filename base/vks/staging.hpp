@@ -0,0 +1,70 @@
+#pragma once
+
+#include "buffer.hpp"
+
+namespace vks {
+
+// A persistently mapped, host visible buffer used as a circular staging area for uploads.
+//
+// Space is handed out from `head` and given back in the same order it was taken, once the
+// GPU work consuming it has completed.  The ring itself knows nothing about fences; the owner
+// records how many bytes each submission consumed and calls `release` when it retires.
+struct StagingRing {
+    Buffer buffer;
+    vk::DeviceSize capacity{ 0 };
+    vk::DeviceSize head{ 0 };
+    // Bytes reserved but not yet released, including any padding skipped for alignment or wrapping
+    vk::DeviceSize used{ 0 };
+
+    operator bool() const { return buffer.operator bool(); }
+
+    uint8_t* data() const { return static_cast<uint8_t*>(buffer.mapped); }
+
+    // Attempt to reserve `size` bytes aligned to `alignment`.  On success `outOffset` is the
+    // offset of the reservation in the ring buffer and `outReserved` is the number of bytes
+    // that must later be passed to `release`.
+    bool allocate(vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& outOffset, vk::DeviceSize& outReserved) {
+        if (size > capacity) {
+            return false;
+        }
+        if (used == 0) {
+            head = 0;
+        }
+        const vk::DeviceSize tail = (head + capacity - used) % capacity;
+        const vk::DeviceSize aligned = alignUp(head, alignment);
+        // Contiguous free space following the head
+        const vk::DeviceSize limit = (used != 0 && tail > head) ? tail : capacity;
+        if (aligned + size <= limit) {
+            outOffset = aligned;
+            outReserved = (aligned + size) - head;
+        } else if ((used == 0 || tail <= head) && size <= tail) {
+            // Skip the remainder of the buffer and start again from the front
+            outOffset = 0;
+            outReserved = (capacity - head) + size;
+        } else {
+            return false;
+        }
+        if (used + outReserved > capacity) {
+            return false;
+        }
+        used += outReserved;
+        head = (outOffset + size) % capacity;
+        return true;
+    }
+
+    void release(vk::DeviceSize bytes) {
+        assert(bytes <= used);
+        used -= bytes;
+    }
+
+    void destroy() {
+        buffer.destroy();
+        capacity = head = used = 0;
+    }
+
+    static vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment) {
+        return alignment > 1 ? ((value + alignment - 1) / alignment) * alignment : value;
+    }
+};
+
+}  // namespace vks
@@ -0,0 +1,100 @@
+#include "startup.hpp"
+
+#include <atomic>
+#include <chrono>
+
+using namespace vks::startup;
+
+namespace {
+
+const uint32_t PHASE_COUNT = static_cast<uint32_t>(Phase::Count);
+
+std::atomic<bool> s_active{ false };
+std::atomic<int64_t> s_begin{ 0 };
+std::atomic<int64_t> s_end{ 0 };
+std::atomic<int64_t> s_phases[PHASE_COUNT];
+
+// The innermost phase of the calling thread
+thread_local ScopedPhase* s_current = nullptr;
+
+int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void add(Phase phase, int64_t nanoseconds) {
+    s_phases[static_cast<uint32_t>(phase)].fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+const char* vks::startup::phaseName(Phase phase) {
+    switch (phase) {
+        case Phase::Instance:
+            return "instance";
+        case Phase::Device:
+            return "device";
+        case Phase::AssetIo:
+            return "assetIo";
+        case Phase::Decode:
+            return "decode";
+        case Phase::Upload:
+            return "upload";
+        case Phase::Pipelines:
+            return "pipelines";
+        default:
+            return "unknown";
+    }
+}
+
+void vks::startup::begin() {
+    for (auto& phase : s_phases) {
+        phase = 0;
+    }
+    s_begin = now();
+    s_active = true;
+}
+
+void vks::startup::finish() {
+    s_end = now();
+    s_active = false;
+}
+
+bool vks::startup::active() {
+    return s_active.load(std::memory_order_relaxed);
+}
+
+double vks::startup::elapsed() {
+    const int64_t end = active() ? now() : s_end.load();
+    return (double)(end - s_begin.load()) / 1.0e6;
+}
+
+double vks::startup::phaseMilliseconds(Phase phase) {
+    return (double)s_phases[static_cast<uint32_t>(phase)].load() / 1.0e6;
+}
+
+ScopedPhase::ScopedPhase(Phase phase)
+    : phase(phase) {
+    if (!active()) {
+        return;
+    }
+    timing = true;
+    start = now();
+    // The enclosing phase stops counting until this one ends
+    parent = s_current;
+    if (parent) {
+        add(parent->phase, start - parent->start);
+    }
+    s_current = this;
+}
+
+ScopedPhase::~ScopedPhase() {
+    if (!timing) {
+        return;
+    }
+    const int64_t end = now();
+    add(phase, end - start);
+    s_current = parent;
+    if (parent) {
+        parent->start = end;
+    }
+}
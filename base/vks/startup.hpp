@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+
+namespace vks { namespace startup {
+
+// What the time to first frame goes into.  The loaders, uploads and pipeline creation in the base library mark their
+// work with a ScopedPhase, which only costs a flag check once startup timing has finished.
+enum class Phase : uint32_t {
+    Instance,
+    Device,
+    // Reading files, or waiting for a prefetch of one to complete
+    AssetIo,
+    // Turning files into meshes and textures, everything a loader does besides its I/O and uploads
+    Decode,
+    // Copying to staging memory and submitting the copies
+    Upload,
+    // Shader modules and pipelines
+    Pipelines,
+    Count
+};
+
+const char* phaseName(Phase phase);
+
+// Start timing, discarding the previous measurements
+void begin();
+// Stop timing, the phase totals stay as they are
+void finish();
+bool active();
+// Milliseconds since begin, or between begin and finish once finished
+double elapsed();
+// The time spent in `phase` since begin, summed over all the threads doing it
+double phaseMilliseconds(Phase phase);
+
+// Counts the time until it goes out of scope towards `phase`.  Phases nest per thread, and the time spent in a
+// nested phase only counts towards that one, so a model load is split into its I/O, decode and uploads.
+class ScopedPhase {
+public:
+    explicit ScopedPhase(Phase phase);
+    ~ScopedPhase();
+
+    ScopedPhase(const ScopedPhase&) = delete;
+    ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+private:
+    Phase phase;
+    bool timing{ false };
+    int64_t start{ 0 };
+    ScopedPhase* parent{ nullptr };
+};
+
+}}  // namespace vks::startup
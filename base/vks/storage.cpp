@@ -7,16 +7,30 @@
 //
 
 #include "storage.hpp"
+#include "startup.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <chrono>
 #include <string>
 #include <cstring>
-#include <istream>
-#include <fstream>
-#include <iterator>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "pack.hpp"
+#include "threadpool.hpp"
 
 
 #if defined(WIN32)
 #include <Windows.h>
+#elif !defined(__ANDROID__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+#if !defined(WIN32)
+#include <unistd.h>
 #endif
+#include <sys/stat.h>
 
 namespace vks { namespace storage {
 
@@ -72,18 +86,11 @@ private:
     std::vector<uint8_t> _data;
 };
 
-#if defined(__ANDROID__) || defined(WIN32)
-#define MAPPED_FILES 1
-#else
-#define MAPPED_FILES 0
-#endif
-
-#if MAPPED_FILES
-
 class FileStorage : public Storage {
 public:
     static StoragePointer create(const std::string& filename, size_t size, const uint8_t* data);
-    FileStorage(const std::string& filename);
+    // Packs are read at random, everything else front to back
+    FileStorage(const std::string& filename, bool sequential = true);
     ~FileStorage();
     // Prevent copying
     FileStorage(const FileStorage& other) = delete;
@@ -102,11 +109,11 @@ private:
     HANDLE _file{ INVALID_HANDLE_VALUE };
     HANDLE _mapFile{ INVALID_HANDLE_VALUE };
 #else
-    std::vector<uint8_t> _data;
+    int _file{ -1 };
 #endif
 };
 
-FileStorage::FileStorage(const std::string& filename) {
+FileStorage::FileStorage(const std::string& filename, bool sequential) {
 #if defined(__ANDROID__)
     // Load shader from compressed asset
     _asset = AAssetManager_open(assetManager, filename.c_str(), AASSET_MODE_BUFFER);
@@ -129,6 +136,28 @@ FileStorage::FileStorage(const std::string& filename) {
         throw std::runtime_error("Failed to create mapping");
     }
     _mapped = (uint8_t*)MapViewOfFile(_mapFile, FILE_MAP_READ, 0, 0, 0);
+#else
+    _file = open(filename.c_str(), O_RDONLY);
+    if (_file == -1) {
+        throw std::runtime_error("Failed to open file " + filename);
+    }
+    struct stat fileStat;
+    if (fstat(_file, &fileStat) == -1) {
+        close(_file);
+        throw std::runtime_error("Failed to stat file " + filename);
+    }
+    _size = static_cast<size_t>(fileStat.st_size);
+    // mmap rejects zero length mappings, an empty file simply has no data
+    if (_size > 0) {
+        void* mapped = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _file, 0);
+        if (mapped == MAP_FAILED) {
+            close(_file);
+            throw std::runtime_error("Failed to map file " + filename);
+        }
+        // Nearly every consumer reads the file front to back exactly once
+        madvise(mapped, _size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+        _mapped = static_cast<uint8_t*>(mapped);
+    }
 #endif
 }
 
@@ -139,40 +168,211 @@ FileStorage::~FileStorage() {
     UnmapViewOfFile(_mapped);
     CloseHandle(_mapFile);
     CloseHandle(_file);
+#else
+    if (_mapped) {
+        munmap(_mapped, _size);
+    }
+    close(_file);
 #endif
 }
 
-#endif
-
 StoragePointer Storage::create(size_t size, uint8_t* data) {
     return std::make_shared<MemoryStorage>(size, data);
 }
+namespace {
+
+// Reads are I/O bound, so a handful of threads is enough to keep the disk queue full
+// without competing with decode work for CPU time
+const size_t IO_THREAD_COUNT = 4;
+
+// The page size, the distance between the reads that fault in a mapping
+size_t readStride() {
+    static const size_t stride = [] {
+#if defined(WIN32)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return (size_t)info.dwPageSize;
+#else
+        const long pageSize = sysconf(_SC_PAGESIZE);
+        return pageSize > 0 ? (size_t)pageSize : (size_t)4096;
+#endif
+    }();
+    return stride;
+}
+
+ThreadPool& ioPool() {
+    static ThreadPool pool(IO_THREAD_COUNT);
+    return pool;
+}
+
+// Prefetches nobody has read yet are kept at most this many, and while finished, this many bytes.  Past either the
+// oldest ones are dropped, and a later readFile of theirs goes back to the disk.
+const size_t PREFETCH_MAX_ENTRIES = 64;
+const size_t PREFETCH_MAX_BYTES = 256 * 1024 * 1024;
+
+struct Prefetch {
+    std::string filename;
+    std::shared_future<StoragePointer> storage;
+};
+
+// Oldest first, with an index by file name
+std::mutex prefetchMutex;
+std::list<Prefetch> prefetchOrder;
+std::unordered_map<std::string, std::list<Prefetch>::iterator> prefetched;
+
+// What a prefetch holds resident, nothing until its read is done
+size_t prefetchBytes(const Prefetch& prefetch) {
+    if (prefetch.storage.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return 0;
+    }
+    const auto storage = prefetch.storage.get();
+    return storage ? storage->size() : 0;
+}
+
+// Drop the oldest prefetches until the rest fit the limits, with prefetchMutex held.  A pending read carries on but
+// its result is released as soon as it's done.
+void trimPrefetched() {
+    size_t bytes = 0;
+    for (const auto& prefetch : prefetchOrder) {
+        bytes += prefetchBytes(prefetch);
+    }
+    while (!prefetchOrder.empty() && (prefetchOrder.size() > PREFETCH_MAX_ENTRIES || bytes > PREFETCH_MAX_BYTES)) {
+        bytes -= prefetchBytes(prefetchOrder.front());
+        prefetched.erase(prefetchOrder.front().filename);
+        prefetchOrder.pop_front();
+    }
+}
+
+struct MountedPack {
+    std::string root;
+    std::shared_ptr<const Pack> pack;
+};
+
+std::mutex packMutex;
+std::vector<MountedPack> mountedPacks;
+
+std::string normalizePath(std::string path) {
+    std::replace(path.begin(), path.end(), '\\', '/');
+    return path;
+}
+
+// The packed contents of `filename`, or nothing if no mounted pack has it
+StoragePointer findPacked(const std::string& filename) {
+    std::vector<MountedPack> packs;
+    {
+        std::unique_lock<std::mutex> lock(packMutex);
+        if (mountedPacks.empty()) {
+            return StoragePointer();
+        }
+        packs = mountedPacks;
+    }
+    const auto path = normalizePath(filename);
+    for (auto itr = packs.rbegin(); itr != packs.rend(); ++itr) {
+        if (path.compare(0, itr->root.size(), itr->root) != 0) {
+            continue;
+        }
+        auto result = itr->pack->find(path.substr(itr->root.size()));
+        if (result) {
+            return result;
+        }
+    }
+    return StoragePointer();
+}
+
+StoragePointer openFile(const std::string& filename) {
+    auto result = findPacked(filename);
+    return result ? result : std::make_shared<FileStorage>(filename);
+}
+
+StoragePointer readResident(const std::string& filename) {
+    auto result = openFile(filename);
+    // Fault in every page of the mapping here, on the I/O thread, rather than on first access by the consumer
+    const volatile uint8_t* data = result->data();
+    uint8_t sink = 0;
+    const size_t stride = readStride();
+    for (size_t offset = 0; offset < result->size(); offset += stride) {
+        sink ^= data[offset];
+    }
+    (void)sink;
+    return result;
+}
+
+}  // namespace
+
 StoragePointer Storage::readFile(const std::string& filename) {
-#if MAPPED_FILES
-    return std::make_shared<FileStorage>(filename);
+    VKS_TRACE_ZONE("Storage::readFile");
+    startup::ScopedPhase startupPhase(startup::Phase::AssetIo);
+    std::shared_future<StoragePointer> pending;
+    {
+        std::unique_lock<std::mutex> lock(prefetchMutex);
+        auto itr = prefetched.find(filename);
+        if (itr != prefetched.end()) {
+            pending = itr->second->storage;
+            prefetchOrder.erase(itr->second);
+            prefetched.erase(itr);
+        }
+    }
+    if (pending.valid()) {
+        return pending.get();
+    }
+    return openFile(filename);
+}
+
+std::shared_future<StoragePointer> Storage::readFileAsync(const std::string& filename) {
+    return ioPool().submit([filename] { return readResident(filename); }).share();
+}
+
+void Storage::prefetch(const std::vector<std::string>& filenames) {
+    std::unique_lock<std::mutex> lock(prefetchMutex);
+    for (const auto& filename : filenames) {
+        if (prefetched.count(filename) == 0) {
+            prefetched[filename] = prefetchOrder.insert(prefetchOrder.end(), Prefetch{ filename, readFileAsync(filename) });
+        }
+    }
+    trimPrefetched();
+}
+
+bool Storage::exists(const std::string& filename) {
+    if (findPacked(filename)) {
+        return true;
+    }
+#if defined(__ANDROID__)
+    AAsset* asset = AAssetManager_open(assetManager, filename.c_str(), AASSET_MODE_UNKNOWN);
+    if (!asset) {
+        return false;
+    }
+    AAsset_close(asset);
+    return true;
 #else
-    // FIXME move to posix memory mapped files
-    // open the file:
-    std::ifstream file(filename, std::ios::binary);
-    // Stop eating new lines in binary mode!!!
-    file.unsetf(std::ios::skipws);
-
-    // get its size:
-    std::streampos fileSize;
-
-    file.seekg(0, std::ios::end);
-    fileSize = file.tellg();
-    file.seekg(0, std::ios::beg);
-
-
-	std::vector<uint8_t> fileData;
-    // reserve capacity
-    fileData.reserve(fileSize);
-    // read the data:
-    fileData.insert(fileData.begin(), std::istream_iterator<uint8_t>(file), std::istream_iterator<uint8_t>());
-    file.close();
-	return std::make_shared<MemoryStorage>(fileData.size(), fileData.data());
+    struct stat fileStat;
+    return stat(filename.c_str(), &fileStat) == 0;
 #endif
 }
 
+bool Storage::mountPack(const std::string& packFile, const std::string& root) {
+#if defined(__ANDROID__)
+    AAsset* asset = AAssetManager_open(assetManager, packFile.c_str(), AASSET_MODE_UNKNOWN);
+    if (!asset) {
+        return false;
+    }
+    AAsset_close(asset);
+#else
+    struct stat fileStat;
+    if (stat(packFile.c_str(), &fileStat) != 0) {
+        return false;
+    }
+#endif
+    MountedPack mounted;
+    mounted.root = normalizePath(root);
+    mounted.pack = std::make_shared<Pack>(std::make_shared<FileStorage>(packFile, false));
+    std::unique_lock<std::mutex> lock(packMutex);
+    mountedPacks.push_back(mounted);
+    return true;
+}
+
+void Storage::unmountPacks() {
+    std::unique_lock<std::mutex> lock(packMutex);
+    mountedPacks.clear();
+}
+
 }}  // namespace vks::storage
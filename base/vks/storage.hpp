@@ -9,6 +9,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <future>
 #include <vector>
 #include <memory>
 #include <string>
@@ -38,7 +39,22 @@ public:
 
     static StoragePointer create(size_t size, uint8_t* data);
     static StoragePointer readFile(const std::string& filename);
+    // Read a file on the shared I/O worker pool.  The contents are resident in memory by the time the future is ready
+    static std::shared_future<StoragePointer> readFileAsync(const std::string& filename);
+    // Start background reads of files that will be needed soon.  A later readFile of any of these names
+    // returns the prefetched storage (waiting for it if necessary) instead of going back to the disk.  Prefetches
+    // that are never read are capped in count and bytes, past which the oldest are dropped again
+    static void prefetch(const std::vector<std::string>& filenames);
     StoragePointer createView(size_t size = 0, size_t offset = 0) const;
+    // Whether readFile would find `filename`, in a mounted pack or on disk
+    static bool exists(const std::string& filename);
+
+    // Serve files under `root` from the asset pack `packFile` (see pack.hpp) instead of the file system.  readFile of
+    // a packed file returns a view into the mapped pack, or the decompressed contents of a compressed entry, and
+    // files the pack doesn't have are still read from disk.  Packs mounted later are searched first.  False if there
+    // is no `packFile`, throws std::runtime_error if it isn't a pack.
+    static bool mountPack(const std::string& packFile, const std::string& root);
+    static void unmountPacks();
 
     // Aliases to prevent having to re-write a ton of code
     inline size_t getSize() const { return size(); }
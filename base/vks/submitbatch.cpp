@@ -0,0 +1,112 @@
+#include "submitbatch.hpp"
+
+#include <stdexcept>
+
+using namespace vks;
+
+void SubmitBatch::add(const vk::SubmitInfo& submitInfo) {
+    Batch batch;
+    const auto* header = static_cast<const vk::BaseInStructure*>(submitInfo.pNext);
+    if (header) {
+        if (header->sType != vk::StructureType::eTimelineSemaphoreSubmitInfo || header->pNext) {
+            throw std::runtime_error("Only timeline semaphore values can be chained to a batched submission");
+        }
+        const auto& timelineInfo = *static_cast<const vk::TimelineSemaphoreSubmitInfoKHR*>(submitInfo.pNext);
+        batch.timeline = true;
+        batch.waitValues.assign(timelineInfo.pWaitSemaphoreValues, timelineInfo.pWaitSemaphoreValues + timelineInfo.waitSemaphoreValueCount);
+        batch.signalValues.assign(timelineInfo.pSignalSemaphoreValues, timelineInfo.pSignalSemaphoreValues + timelineInfo.signalSemaphoreValueCount);
+    }
+    batch.waits.assign(submitInfo.pWaitSemaphores, submitInfo.pWaitSemaphores + submitInfo.waitSemaphoreCount);
+    batch.waitStages.assign(submitInfo.pWaitDstStageMask, submitInfo.pWaitDstStageMask + submitInfo.waitSemaphoreCount);
+    batch.commandBuffers.assign(submitInfo.pCommandBuffers, submitInfo.pCommandBuffers + submitInfo.commandBufferCount);
+    batch.signals.assign(submitInfo.pSignalSemaphores, submitInfo.pSignalSemaphores + submitInfo.signalSemaphoreCount);
+    // Binary semaphores get no values, or ones that are ignored
+    batch.waitValues.resize(batch.waits.size(), 0);
+    batch.signalValues.resize(batch.signals.size(), 0);
+    batches.push_back(std::move(batch));
+}
+
+void SubmitBatch::flush(const vk::Queue& queue, const vk::Fence& fence, bool synchronization2, const vk::DispatchLoaderDynamic& dispatch) {
+    if (batches.empty()) {
+        if (fence) {
+            // Still signaled once everything submitted before completes
+            queue.submit(nullptr, fence);
+        }
+        return;
+    }
+    if (synchronization2) {
+        flush2(queue, fence, dispatch);
+    } else {
+        flushLegacy(queue, fence);
+    }
+    batches.clear();
+}
+
+void SubmitBatch::flushLegacy(const vk::Queue& queue, const vk::Fence& fence) {
+    std::vector<vk::TimelineSemaphoreSubmitInfoKHR> timelineInfos;
+    // The submit infos point into these, so they mustn't reallocate
+    timelineInfos.reserve(batches.size());
+    std::vector<vk::SubmitInfo> submitInfos;
+    submitInfos.reserve(batches.size());
+    for (const auto& batch : batches) {
+        vk::SubmitInfo info;
+        info.waitSemaphoreCount = (uint32_t)batch.waits.size();
+        info.pWaitSemaphores = batch.waits.data();
+        info.pWaitDstStageMask = batch.waitStages.data();
+        info.commandBufferCount = (uint32_t)batch.commandBuffers.size();
+        info.pCommandBuffers = batch.commandBuffers.data();
+        info.signalSemaphoreCount = (uint32_t)batch.signals.size();
+        info.pSignalSemaphores = batch.signals.data();
+        if (batch.timeline) {
+            vk::TimelineSemaphoreSubmitInfoKHR timelineInfo;
+            timelineInfo.waitSemaphoreValueCount = (uint32_t)batch.waitValues.size();
+            timelineInfo.pWaitSemaphoreValues = batch.waitValues.data();
+            timelineInfo.signalSemaphoreValueCount = (uint32_t)batch.signalValues.size();
+            timelineInfo.pSignalSemaphoreValues = batch.signalValues.data();
+            timelineInfos.push_back(timelineInfo);
+            info.pNext = &timelineInfos.back();
+        }
+        submitInfos.push_back(info);
+    }
+    queue.submit(submitInfos, fence);
+}
+
+void SubmitBatch::flush2(const vk::Queue& queue, const vk::Fence& fence, const vk::DispatchLoaderDynamic& dispatch) {
+    // All of the semaphore and command buffer infos first, since the submit infos point into them
+    std::vector<vk::SemaphoreSubmitInfoKHR> semaphoreInfos;
+    std::vector<vk::CommandBufferSubmitInfoKHR> commandBufferInfos;
+    size_t semaphoreCount = 0;
+    size_t commandBufferCount = 0;
+    for (const auto& batch : batches) {
+        semaphoreCount += batch.waits.size() + batch.signals.size();
+        commandBufferCount += batch.commandBuffers.size();
+    }
+    semaphoreInfos.reserve(semaphoreCount);
+    commandBufferInfos.reserve(commandBufferCount);
+
+    std::vector<vk::SubmitInfo2KHR> submitInfos;
+    submitInfos.reserve(batches.size());
+    for (const auto& batch : batches) {
+        vk::SubmitInfo2KHR info;
+        info.waitSemaphoreInfoCount = (uint32_t)batch.waits.size();
+        info.pWaitSemaphoreInfos = semaphoreInfos.data() + semaphoreInfos.size();
+        for (size_t i = 0; i < batch.waits.size(); ++i) {
+            // The legacy stage bits are the same in the 64 bit flags
+            const vk::PipelineStageFlags2KHR stages(static_cast<VkPipelineStageFlags>(batch.waitStages[i]));
+            semaphoreInfos.push_back(vk::SemaphoreSubmitInfoKHR{ batch.waits[i], batch.waitValues[i], stages });
+        }
+        info.commandBufferInfoCount = (uint32_t)batch.commandBuffers.size();
+        info.pCommandBufferInfos = commandBufferInfos.data() + commandBufferInfos.size();
+        for (const auto& commandBuffer : batch.commandBuffers) {
+            commandBufferInfos.push_back(vk::CommandBufferSubmitInfoKHR{ commandBuffer });
+        }
+        info.signalSemaphoreInfoCount = (uint32_t)batch.signals.size();
+        info.pSignalSemaphoreInfos = semaphoreInfos.data() + semaphoreInfos.size();
+        for (size_t i = 0; i < batch.signals.size(); ++i) {
+            // vkQueueSubmit signals once all commands of the batch are done
+            semaphoreInfos.push_back(vk::SemaphoreSubmitInfoKHR{ batch.signals[i], batch.signalValues[i], vk::PipelineStageFlagBits2KHR::eAllCommands });
+        }
+        submitInfos.push_back(info);
+    }
+    queue.submit2KHR(submitInfos, fence, dispatch);
+}
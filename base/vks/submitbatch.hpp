@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+namespace vks {
+
+// Submissions to one queue that haven't been sent yet, which flush sends with a single vkQueueSubmit, or
+// vkQueueSubmit2KHR where synchronization2 is enabled.  Each added vk::SubmitInfo stays a batch of its own, with its
+// semaphore waits and signals, so merging them changes nothing about their order or dependencies, only the number
+// of calls into the driver.
+//
+// The arrays of the infos are copied, so callers' arrays need only live through add.  The only pNext accepted is a
+// vk::TimelineSemaphoreSubmitInfoKHR, whose values are copied as well.  Not thread safe.
+class SubmitBatch {
+public:
+    void add(const vk::SubmitInfo& submitInfo);
+
+    bool empty() const { return batches.empty(); }
+    size_t size() const { return batches.size(); }
+
+    // Submit everything added since the last flush to `queue`, signaling `fence`, if any, once all of it completes
+    void flush(const vk::Queue& queue, const vk::Fence& fence, bool synchronization2, const vk::DispatchLoaderDynamic& dispatch);
+
+private:
+    struct Batch {
+        std::vector<vk::Semaphore> waits;
+        std::vector<vk::PipelineStageFlags> waitStages;
+        std::vector<uint64_t> waitValues;
+        std::vector<vk::CommandBuffer> commandBuffers;
+        std::vector<vk::Semaphore> signals;
+        std::vector<uint64_t> signalValues;
+        bool timeline{ false };
+    };
+
+    void flushLegacy(const vk::Queue& queue, const vk::Fence& fence);
+    void flush2(const vk::Queue& queue, const vk::Fence& fence, const vk::DispatchLoaderDynamic& dispatch);
+
+    std::vector<Batch> batches;
+};
+
+}  // namespace vks
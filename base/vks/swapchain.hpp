@@ -11,8 +11,14 @@
 
 #pragma once
 
+#include <algorithm>
+#include <functional>
+#include <memory>
+
 #include <vulkan/vulkan.hpp>
 
+#include "fences.hpp"
+
 namespace vks {
 
 struct SwapChainImage {
@@ -34,6 +40,34 @@ struct SwapChain {
     uint32_t imageCount{ 0 };
     uint32_t currentImage{ 0 };
     uint32_t graphicsQueueIndex{ VK_QUEUE_FAMILY_IGNORED };
+    // Source of the fences handed out by getSubmitFence.  Without one they are created and destroyed directly
+    std::shared_ptr<FencePool> fencePool;
+
+    // Explicit configuration, read by create
+    struct Config {
+        // Present modes in order of preference, the first the surface supports is used.  When empty, or when none
+        // of them is supported, the vsync flag of create picks one
+        std::vector<vk::PresentModeKHR> presentModes;
+        // Clamped to what the surface supports, 0 for one more than its minimum
+        uint32_t minImageCount{ 0 };
+        // Render in the orientation of the display panel, rotating the projection by preRotationDegrees, rather
+        // than leave the rotation to an extra pass of the compositor.  Only makes a difference where the surface
+        // reports a rotated current transform, like Android devices held other than in their natural orientation
+        bool preRotate{ false };
+    } config;
+    // The present mode create picked
+    vk::PresentModeKHR presentMode{ vk::PresentModeKHR::eFifo };
+    // The transform create picked, which the presentation engine applies to the images on the way to the display
+    vk::SurfaceTransformFlagBitsKHR preTransform{ vk::SurfaceTransformFlagBitsKHR::eIdentity };
+
+    // Set with setDisplayTiming once VK_GOOGLE_display_timing is enabled on the device
+    const vk::DispatchLoaderDynamic* displayTiming{ nullptr };
+    // Id of the most recent queuePresent, 0 before the first one.  Presentation timings refer to these
+    uint32_t presentId{ 0 };
+
+    // When set, create hands the swap chain it replaces and its image views to this instead of destroying them,
+    // so they can be released once the frames still using them are done
+    std::function<void(const vk::SwapchainKHR&, const std::vector<vk::ImageView>&)> retire;
 
     SwapChain() {
         presentInfo.swapchainCount = 1;
@@ -41,13 +75,21 @@ struct SwapChain {
         presentInfo.pImageIndices = &currentImage;
     }
 
-    void setup(const vk::PhysicalDevice& newPhysicalDevice, const vk::Device& newDevice, const vk::Queue& newQueue, uint32_t newGraphicsQueueIndex) {
+    void setup(const vk::PhysicalDevice& newPhysicalDevice,
+               const vk::Device& newDevice,
+               const vk::Queue& newQueue,
+               uint32_t newGraphicsQueueIndex,
+               const std::shared_ptr<FencePool>& newFencePool = nullptr) {
         physicalDevice = newPhysicalDevice;
         device = newDevice;
         queue = newQueue;
         graphicsQueueIndex = newGraphicsQueueIndex;
+        fencePool = newFencePool;
     }
 
+    // Tag presents with ids and take desired present times, see queuePresent and getPastPresentationTiming
+    void setDisplayTiming(const vk::DispatchLoaderDynamic* dispatch) { displayTiming = dispatch; }
+
     void setSurface(const vk::SurfaceKHR& newSurface) {
         surface = newSurface;
 
@@ -101,7 +143,10 @@ struct SwapChain {
         // Prefer mailbox mode if present, it's the lowest latency non-tearing present  mode
         vk::PresentModeKHR swapchainPresentMode = vk::PresentModeKHR::eFifo;
 
-        if (!vsync) {
+        auto preferred = std::find_first_of(config.presentModes.begin(), config.presentModes.end(), presentModes.begin(), presentModes.end());
+        if (preferred != config.presentModes.end()) {
+            swapchainPresentMode = *preferred;
+        } else if (!vsync) {
             for (size_t i = 0; i < presentModeCount; i++) {
                 if (presentModes[i] == vk::PresentModeKHR::eMailbox) {
                     swapchainPresentMode = vk::PresentModeKHR::eMailbox;
@@ -113,14 +158,22 @@ struct SwapChain {
             }
         }
 
+        presentMode = swapchainPresentMode;
+
         // Determine the number of images
-        uint32_t desiredNumberOfSwapchainImages = surfCaps.minImageCount + 1;
+        uint32_t desiredNumberOfSwapchainImages = config.minImageCount ? std::max(config.minImageCount, surfCaps.minImageCount) : surfCaps.minImageCount + 1;
         if ((surfCaps.maxImageCount > 0) && (desiredNumberOfSwapchainImages > surfCaps.maxImageCount)) {
             desiredNumberOfSwapchainImages = surfCaps.maxImageCount;
         }
 
-        vk::SurfaceTransformFlagBitsKHR preTransform;
-        if (surfCaps.supportedTransforms & vk::SurfaceTransformFlagBitsKHR::eIdentity) {
+        if (config.preRotate && isRotation(surfCaps.currentTransform) && (surfCaps.supportedTransforms & surfCaps.currentTransform)) {
+            preTransform = surfCaps.currentTransform;
+            // The current extent is that of the rotated display, the images are in the panel's orientation
+            if (preRotationSwapsAxes()) {
+                std::swap(swapchainExtent.width, swapchainExtent.height);
+                size = swapchainExtent;
+            }
+        } else if (surfCaps.supportedTransforms & vk::SurfaceTransformFlagBitsKHR::eIdentity) {
             preTransform = vk::SurfaceTransformFlagBitsKHR::eIdentity;
         } else {
             preTransform = surfCaps.currentTransform;
@@ -134,6 +187,8 @@ struct SwapChain {
         swapchainCI.imageColorSpace = colorSpace;
         swapchainCI.imageExtent = vk::Extent2D{ swapchainExtent.width, swapchainExtent.height };
         swapchainCI.imageUsage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferDst;
+        // Lets frames be read back, see vks::Readback
+        swapchainCI.imageUsage |= surfCaps.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferSrc;
         swapchainCI.preTransform = preTransform;
         swapchainCI.imageArrayLayers = 1;
         swapchainCI.imageSharingMode = vk::SharingMode::eExclusive;
@@ -149,10 +204,18 @@ struct SwapChain {
         // If an existing sawp chain is re-created, destroy the old swap chain
         // This also cleans up all the presentable images
         if (oldSwapchain) {
+            std::vector<vk::ImageView> oldViews;
             for (uint32_t i = 0; i < imageCount; i++) {
-                device.destroyImageView(images[i].view);
+                oldViews.push_back(images[i].view);
+            }
+            if (retire) {
+                retire(oldSwapchain, oldViews);
+            } else {
+                for (const auto& view : oldViews) {
+                    device.destroyImageView(view);
+                }
+                device.destroySwapchainKHR(oldSwapchain);
             }
-            device.destroySwapchainKHR(oldSwapchain);
         }
 
         vk::ImageViewCreateInfo colorAttachmentView;
@@ -176,6 +239,36 @@ struct SwapChain {
         }
     }
 
+    // Clockwise degrees the contents of the images are rotated by on the display, which the projection has to
+    // rotate them back by
+    uint32_t preRotationDegrees() const {
+        switch (preTransform) {
+            case vk::SurfaceTransformFlagBitsKHR::eRotate90:
+                return 90;
+            case vk::SurfaceTransformFlagBitsKHR::eRotate180:
+                return 180;
+            case vk::SurfaceTransformFlagBitsKHR::eRotate270:
+                return 270;
+            default:
+                return 0;
+        }
+    }
+
+    // The images are taller than the display is wide, and the other way around
+    bool preRotationSwapsAxes() const {
+        return preTransform == vk::SurfaceTransformFlagBitsKHR::eRotate90 || preTransform == vk::SurfaceTransformFlagBitsKHR::eRotate270;
+    }
+
+    // With preRotate, true once the display was rotated away from the transform the swap chain was created for, and
+    // it has to be created again.  Surfaces keep reporting suboptimal presents until then.
+    bool transformChanged() const {
+        if (!config.preRotate || !swapChain) {
+            return false;
+        }
+        const auto currentTransform = physicalDevice.getSurfaceCapabilitiesKHR(surface).currentTransform;
+        return currentTransform != preTransform && (isRotation(currentTransform) || isRotation(preTransform));
+    }
+
     std::vector<vk::Framebuffer> createFramebuffers(vk::FramebufferCreateInfo framebufferCreateInfo) {
         // Verify that the first attachment is null
         assert(framebufferCreateInfo.pAttachments[0] == vk::ImageView());
@@ -209,27 +302,60 @@ struct SwapChain {
 
     void clearSubmitFence(uint32_t index) { images[index].fence = vk::Fence(); }
 
+    // Wait for the previous submission to the current image, and return a fence for the next one.  With `destroy`
+    // set the previous fence is recycled, otherwise whoever it was handed to is responsible for it.
     vk::Fence getSubmitFence(bool destroy = false) {
         auto& image = images[currentImage];
         while (image.fence) {
             vk::Result fenceRes = device.waitForFences(image.fence, VK_TRUE, UINT64_MAX);
             if (fenceRes == vk::Result::eSuccess) {
                 if (destroy) {
-                    device.destroyFence(image.fence);
+                    releaseFence(image.fence);
                 }
                 image.fence = vk::Fence();
             }
         }
 
-        image.fence = device.createFence({});
+        image.fence = fencePool ? fencePool->acquire() : device.createFence({});
         return image.fence;
     }
 
-    // Present the current image to the queue
-    vk::Result queuePresent(vk::Semaphore waitSemaphore) {
+    // Wait for and recycle the fences of every image, for callers that use getSubmitFence(true)
+    void releaseSubmitFences() {
+        for (auto& image : images) {
+            if (image.fence) {
+                device.waitForFences(image.fence, VK_TRUE, UINT64_MAX);
+                releaseFence(image.fence);
+                image.fence = vk::Fence();
+            }
+        }
+    }
+
+    // Present the current image to the queue.  With display timing the present gets the next presentId, and isn't
+    // shown before `desiredPresentTime` (in nanoseconds, 0 for as soon as possible)
+    vk::Result queuePresent(vk::Semaphore waitSemaphore, uint64_t desiredPresentTime = 0) {
         presentInfo.waitSemaphoreCount = waitSemaphore ? 1 : 0;
         presentInfo.pWaitSemaphores = &waitSemaphore;
-        return queue.presentKHR(presentInfo);
+        vk::PresentTimeGOOGLE time{ ++presentId, desiredPresentTime };
+        vk::PresentTimesInfoGOOGLE times{ 1, &time };
+        presentInfo.pNext = displayTiming ? &times : nullptr;
+        const vk::Result result = queue.presentKHR(presentInfo);
+        presentInfo.pNext = nullptr;
+        return result;
+    }
+
+    // Duration of a display refresh in nanoseconds, 0 without display timing
+    uint64_t getRefreshCycleDuration() const {
+        return displayTiming ? device.getRefreshCycleDurationGOOGLE(swapChain, *displayTiming).refreshDuration : 0;
+    }
+
+    // When the presents since the previous call reached the display.  Results arrive a few frames late, and not
+    // necessarily for every present
+    std::vector<vk::PastPresentationTimingGOOGLE> getPastPresentationTiming() const {
+        if (!displayTiming) {
+            return {};
+        }
+        return device.getPastPresentationTimingGOOGLE(swapChain, *displayTiming);
     }
 
     // Free all Vulkan resources used by the swap chain
@@ -241,6 +367,19 @@ struct SwapChain {
     }
 
 private:
+    static bool isRotation(vk::SurfaceTransformFlagBitsKHR transform) {
+        return transform == vk::SurfaceTransformFlagBitsKHR::eRotate90 || transform == vk::SurfaceTransformFlagBitsKHR::eRotate180 ||
+               transform == vk::SurfaceTransformFlagBitsKHR::eRotate270;
+    }
+
+    void releaseFence(const vk::Fence& fence) {
+        if (fencePool) {
+            fencePool->release(fence);
+        } else {
+            device.destroyFence(fence);
+        }
+    }
+
     uint32_t findQueue(const vk::QueueFlags& flags) const {
         std::vector<vk::QueueFamilyProperties> queueProps = physicalDevice.getQueueFamilyProperties();
         size_t queueCount = queueProps.size();
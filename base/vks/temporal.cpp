@@ -0,0 +1,185 @@
+#include "temporal.hpp"
+
+#include <algorithm>
+
+#include "barriers.hpp"
+#include "context.hpp"
+#include "shaders.hpp"
+
+using namespace vks;
+
+const uint32_t TemporalResolve::JITTER_PHASES;
+
+namespace {
+
+// Must match the local size of temporal.comp
+const uint32_t GROUP_SIZE = 8;
+
+const vk::Format FORMAT = vk::Format::eR16G16B16A16Sfloat;
+
+float halton(uint32_t index, uint32_t base) {
+    float result = 0.0f;
+    float fraction = 1.0f;
+    for (; index; index /= base) {
+        fraction /= (float)base;
+        result += fraction * (float)(index % base);
+    }
+    return result;
+}
+
+}  // namespace
+
+glm::vec2 TemporalResolve::jitter(uint64_t frame) {
+    // The sequence starts at 1, index 0 would be the pixel corner in both dimensions
+    const uint32_t index = (uint32_t)(frame % JITTER_PHASES) + 1;
+    return glm::vec2(halton(index, 2), halton(index, 3)) - 0.5f;
+}
+
+void TemporalResolve::create(const vks::Context& context, const std::string& shaderPath, const vk::Extent2D& outputExtent) {
+    this->context = &context;
+    device = context.device;
+    extent = outputExtent;
+    params = {};
+    historyValid = false;
+    uniform = context.createUniformBuffer(params);
+
+    vk::ImageCreateInfo imageCreateInfo;
+    imageCreateInfo.imageType = vk::ImageType::e2D;
+    imageCreateInfo.format = FORMAT;
+    imageCreateInfo.extent = vk::Extent3D{ extent.width, extent.height, 1 };
+    imageCreateInfo.mipLevels = 1;
+    imageCreateInfo.arrayLayers = 1;
+    vk::ImageViewCreateInfo viewCreateInfo;
+    viewCreateInfo.viewType = vk::ImageViewType::e2D;
+    viewCreateInfo.format = FORMAT;
+    viewCreateInfo.subresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
+    vk::SamplerCreateInfo samplerCreateInfo;
+    samplerCreateInfo.magFilter = vk::Filter::eLinear;
+    samplerCreateInfo.minFilter = vk::Filter::eLinear;
+    samplerCreateInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+    samplerCreateInfo.addressModeV = samplerCreateInfo.addressModeU;
+    samplerCreateInfo.addressModeW = samplerCreateInfo.addressModeU;
+    samplerCreateInfo.maxLod = 1.0f;
+
+    imageCreateInfo.usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc;
+    output = context.createImage(imageCreateInfo);
+    viewCreateInfo.image = output.image;
+    output.view = device.createImageView(viewCreateInfo);
+    output.sampler = acquireSampler(device, samplerCreateInfo);
+
+    imageCreateInfo.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
+    history = context.createImage(imageCreateInfo);
+    viewCreateInfo.image = history.image;
+    history.view = device.createImageView(viewCreateInfo);
+    history.sampler = acquireSampler(device, samplerCreateInfo);
+    // Both are read before they are first written.  Between frames the output is what the fragment shaders read and
+    // the history what the resolve reads, which is where record expects them and leaves them.
+    context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+        Barriers barriers;
+        barriers.image(output, ImageUsage::FragmentSampled, true).image(history, ImageUsage::ComputeSampled, true);
+        barriers.record(commandBuffer, context);
+    });
+
+    std::vector<vk::DescriptorSetLayoutBinding> bindings{
+        { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        { 1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute },
+        { 2, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute },
+        { 3, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute },
+        { 4, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute },
+    };
+    descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)bindings.size(), bindings.data() });
+    pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+
+    std::vector<vk::DescriptorPoolSize> poolSizes{
+        { vk::DescriptorType::eUniformBuffer, 1 },
+        { vk::DescriptorType::eCombinedImageSampler, 3 },
+        { vk::DescriptorType::eStorageImage, 1 },
+    };
+    descriptorPool = device.createDescriptorPool({ {}, 1, (uint32_t)poolSizes.size(), poolSizes.data() });
+    descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+    vk::DescriptorImageInfo historyInfo{ history.sampler, history.view, vk::ImageLayout::eShaderReadOnlyOptimal };
+    vk::DescriptorImageInfo outputInfo{ nullptr, output.view, vk::ImageLayout::eGeneral };
+    std::vector<vk::WriteDescriptorSet> writes{
+        { descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniform.descriptor },
+        { descriptorSet, 3, 0, 1, vk::DescriptorType::eCombinedImageSampler, &historyInfo },
+        { descriptorSet, 4, 0, 1, vk::DescriptorType::eStorageImage, &outputInfo },
+    };
+    device.updateDescriptorSets(writes, nullptr);
+
+    vk::ComputePipelineCreateInfo pipelineCreateInfo;
+    pipelineCreateInfo.layout = pipelineLayout;
+    pipelineCreateInfo.stage = shaders::loadShader(device, shaderPath, vk::ShaderStageFlagBits::eCompute);
+    pipeline = device.createComputePipeline(context.pipelineCache, pipelineCreateInfo);
+    device.destroyShaderModule(pipelineCreateInfo.stage.module);
+}
+
+void TemporalResolve::destroy() {
+    if (!device) {
+        return;
+    }
+    device.destroyPipeline(pipeline);
+    device.destroyPipelineLayout(pipelineLayout);
+    device.destroyDescriptorPool(descriptorPool);
+    device.destroyDescriptorSetLayout(descriptorSetLayout);
+    uniform.destroy();
+    output.destroy();
+    history.destroy();
+    pipeline = nullptr;
+    pipelineLayout = nullptr;
+    descriptorPool = nullptr;
+    descriptorSetLayout = nullptr;
+    descriptorSet = nullptr;
+    device = nullptr;
+    context = nullptr;
+}
+
+void TemporalResolve::setInputs(const vks::Image& color, vk::ImageLayout colorLayout, const vks::Image& depth, vk::ImageLayout depthLayout) {
+    params.inputExtent.z = 1.0f / (float)std::max(1u, color.extent.width);
+    params.inputExtent.w = 1.0f / (float)std::max(1u, color.extent.height);
+    vk::DescriptorImageInfo colorInfo{ color.sampler, color.view, colorLayout };
+    vk::DescriptorImageInfo depthInfo{ depth.sampler, depth.view, depthLayout };
+    std::vector<vk::WriteDescriptorSet> writes{
+        { descriptorSet, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &colorInfo },
+        { descriptorSet, 2, 0, 1, vk::DescriptorType::eCombinedImageSampler, &depthInfo },
+    };
+    device.updateDescriptorSets(writes, nullptr);
+    historyValid = false;
+}
+
+void TemporalResolve::update(const glm::mat4& viewProjection, const glm::vec2& jitter, const vk::Extent2D& inputExtent) {
+    params.reprojection = (historyValid ? previousViewProjection : viewProjection) * glm::inverse(viewProjection);
+    params.inputExtent.x = (float)inputExtent.width;
+    params.inputExtent.y = (float)inputExtent.height;
+    params.jitter = glm::vec4(jitter, feedback, historyValid ? 1.0f : 0.0f);
+    uniform.copy(params);
+    previousViewProjection = viewProjection;
+    historyValid = true;
+}
+
+void TemporalResolve::record(const vk::CommandBuffer& commandBuffer) {
+    using Stage = vk::PipelineStageFlagBits2KHR;
+    using Access = vk::AccessFlagBits2KHR;
+
+    // The render passes writing the inputs come first.  The output is overwritten entirely, so the previous frame's
+    // reads of it are all it waits for, and the history is already visible to the resolve.
+    Barriers barriers;
+    barriers.memory(Stage::eColorAttachmentOutput | Stage::eLateFragmentTests, Access::eColorAttachmentWrite | Access::eDepthStencilAttachmentWrite,
+                    Stage::eComputeShader, Access::eShaderSampledRead);
+    barriers.image(output, ImageUsage::ComputeStorageWrite, true).image(history, ImageUsage::ComputeSampled);
+    barriers.record(commandBuffer, *context);
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
+    commandBuffer.dispatch((extent.width + GROUP_SIZE - 1) / GROUP_SIZE, (extent.height + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+
+    // The output becomes the next frame's history
+    barriers.image(output, ImageUsage::TransferSrc).image(history, ImageUsage::TransferDst, true);
+    barriers.record(commandBuffer, *context);
+    vk::ImageCopy region;
+    region.srcSubresource = vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, 0, 0, 1 };
+    region.dstSubresource = region.srcSubresource;
+    region.extent = vk::Extent3D{ extent.width, extent.height, 1 };
+    commandBuffer.copyImage(output.image, vk::ImageLayout::eTransferSrcOptimal, history.image, vk::ImageLayout::eTransferDstOptimal, region);
+    barriers.image(output, ImageUsage::FragmentSampled).image(history, ImageUsage::ComputeSampled);
+    barriers.record(commandBuffer, *context);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "buffer.hpp"
+#include "image.hpp"
+#include "forward.hpp"
+
+namespace vks {
+
+// Temporal anti-aliasing, and upsampling when the scene is rendered at less than the output resolution, in a compute
+// shader.  The scene is rendered with its projection offset by jitter(frame), a different sub-pixel position every
+// frame, and the resolve accumulates those samples in a history at the output resolution.
+//
+// The history is reprojected with the depth of the scene and the camera's previous view projection, so motion comes
+// from the camera only, and clamped to the range of colors around each pixel in the current frame, which rejects
+// most of what the reprojection gets wrong.  The rendered part of the inputs may change from frame to frame, as with
+// vks::DynamicResolution.
+//
+// The commands are the same every frame, the history is copied rather than swapped, so they can be recorded once.
+// Their barriers come from vks::Barriers, and leave the output and history as they found them.
+class TemporalResolve {
+public:
+    // Frames before the jitter sequence repeats
+    static const uint32_t JITTER_PHASES = 8;
+
+    // The Halton (2, 3) offset of `frame`, in pixels within (-0.5, 0.5).  Offset the projection by twice that over the
+    // rendered extent, see Camera::setJitter.
+    static glm::vec2 jitter(uint64_t frame);
+
+    // The weight of the history when it reprojects into the frame, higher is smoother and slower to respond to changes
+    float feedback{ 0.9f };
+
+    void create(const vks::Context& context, const std::string& shaderPath, const vk::Extent2D& outputExtent);
+    void destroy();
+
+    // The targets the scene is rendered to and the layouts they're left in.  The depth is fetched, not filtered.
+    void setInputs(const vks::Image& color, vk::ImageLayout colorLayout, const vks::Image& depth, vk::ImageLayout depthLayout);
+
+    // The matrix from the scene's space to clip space without the jitter, the jitter in pixels and the rendered part
+    // of the inputs.  Takes effect for the command buffers executed from now on.
+    void update(const glm::mat4& viewProjection, const glm::vec2& jitter, const vk::Extent2D& inputExtent);
+    // Drop the history, for cuts and when it no longer matches the scene
+    void reset() { historyValid = false; }
+
+    // Resolve into resolved(), ordered after the render passes writing the inputs and before the fragment shaders of
+    // later commands.  Must be recorded outside of a render pass.
+    void record(const vk::CommandBuffer& commandBuffer);
+
+    // Left in ShaderReadOnlyOptimal, with a linear sampler
+    const vks::Image& resolved() const { return output; }
+
+private:
+    // Must match the Params block of temporal.comp
+    struct Params {
+        glm::mat4 reprojection;
+        glm::vec4 inputExtent;
+        glm::vec4 jitter;
+    } params;
+
+    const vks::Context* context{ nullptr };
+    vk::Device device;
+    vk::Extent2D extent;
+    glm::mat4 previousViewProjection;
+    bool historyValid{ false };
+    Buffer uniform;
+    vks::Image output;
+    vks::Image history;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::DescriptorPool descriptorPool;
+    vk::DescriptorSet descriptorSet;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline pipeline;
+};
+
+}  // namespace vks
@@ -0,0 +1,191 @@
+#include "terrain.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+#include "context.hpp"
+#include "pipelines.hpp"
+#include "shaders.hpp"
+
+using namespace vks::terrain;
+
+const uint32_t Quadtree::MAX_LEVELS;
+
+namespace {
+
+// Must match the local size of quadtree.comp
+const uint32_t GROUP_SIZE = 64;
+
+// Offset of instanceCount in vk::DrawIndexedIndirectCommand
+const vk::DeviceSize INSTANCE_COUNT_OFFSET = sizeof(uint32_t);
+
+}  // namespace
+
+void Quadtree::create(const vks::Context& context, const std::string& shaderPath, const Settings& settings, const std::vector<glm::vec2>& bounds) {
+    if (settings.levels == 0 || settings.levels > MAX_LEVELS) {
+        throw std::runtime_error("Unsupported quadtree depth");
+    }
+    if (settings.gridSize < 2 || (settings.gridSize & (settings.gridSize - 1))) {
+        throw std::runtime_error("The quadtree grid size must be a power of two");
+    }
+    device = context.device;
+    this->settings = settings;
+    nodes = ((1u << (2 * settings.levels)) - 1) / 3;
+    if (bounds.size() != nodes) {
+        throw std::runtime_error("Quadtree height bounds don't match its depth");
+    }
+
+    // One grid, shared by the nodes of every LOD
+    const uint32_t gridSize = settings.gridSize;
+    std::vector<glm::vec2> vertices;
+    vertices.reserve((gridSize + 1) * (gridSize + 1));
+    for (uint32_t y = 0; y <= gridSize; ++y) {
+        for (uint32_t x = 0; x <= gridSize; ++x) {
+            vertices.emplace_back((float)x / gridSize, (float)y / gridSize);
+        }
+    }
+    std::vector<uint32_t> indices;
+    indices.reserve(gridSize * gridSize * 6);
+    for (uint32_t y = 0; y < gridSize; ++y) {
+        for (uint32_t x = 0; x < gridSize; ++x) {
+            const uint32_t index = x + y * (gridSize + 1);
+            indices.insert(indices.end(), { index, index + gridSize + 1, index + gridSize + 2, index + gridSize + 2, index + 1, index });
+        }
+    }
+    gridIndexCount = (uint32_t)indices.size();
+    gridVertices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertices);
+    gridIndices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indices);
+
+    nodeBounds = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, bounds);
+    instances = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer,
+                                           sizeof(glm::vec4) * maxInstances());
+    // record() resets the instance count before every selection
+    const vk::DrawIndexedIndirectCommand command{ gridIndexCount, 0, 0, 0, 0 };
+    indirect = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+                                           std::vector<vk::DrawIndexedIndirectCommand>{ command });
+
+    Uniforms initial{};
+    initial.origin = settings.origin;
+    initial.size = settings.size;
+    initial.heightScale = settings.heightScale;
+    initial.levels = settings.levels;
+    initial.gridSize = gridSize;
+    initial.nodeCount = nodes;
+    uniforms = context.createUniformBuffer(initial);
+    update(glm::vec3(0.0f), {});
+
+    std::vector<vk::DescriptorSetLayoutBinding> bindings{
+        { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        { 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        { 3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+    };
+    descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)bindings.size(), bindings.data() });
+    pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+
+    std::vector<vk::DescriptorPoolSize> poolSizes{
+        { vk::DescriptorType::eUniformBuffer, 1 },
+        { vk::DescriptorType::eStorageBuffer, 3 },
+    };
+    descriptorPool = device.createDescriptorPool({ {}, 1, (uint32_t)poolSizes.size(), poolSizes.data() });
+    descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+    vk::DescriptorBufferInfo boundsInfo{ nodeBounds.buffer, 0, VK_WHOLE_SIZE };
+    vk::DescriptorBufferInfo instancesInfo{ instances.buffer, 0, VK_WHOLE_SIZE };
+    vk::DescriptorBufferInfo indirectInfo{ indirect.buffer, 0, VK_WHOLE_SIZE };
+    std::vector<vk::WriteDescriptorSet> writes{
+        { descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniforms.descriptor },
+        { descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &boundsInfo },
+        { descriptorSet, 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &instancesInfo },
+        { descriptorSet, 3, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &indirectInfo },
+    };
+    device.updateDescriptorSets(writes, nullptr);
+
+    vk::ComputePipelineCreateInfo pipelineCreateInfo;
+    pipelineCreateInfo.layout = pipelineLayout;
+    pipelineCreateInfo.stage = shaders::loadShader(device, shaderPath, vk::ShaderStageFlagBits::eCompute);
+    pipeline = device.createComputePipeline(context.pipelineCache, pipelineCreateInfo);
+    device.destroyShaderModule(pipelineCreateInfo.stage.module);
+}
+
+void Quadtree::destroy() {
+    if (!device) {
+        return;
+    }
+    device.destroyPipeline(pipeline);
+    device.destroyPipelineLayout(pipelineLayout);
+    device.destroyDescriptorPool(descriptorPool);
+    device.destroyDescriptorSetLayout(descriptorSetLayout);
+    uniforms.destroy();
+    instances.destroy();
+    indirect.destroy();
+    gridVertices.destroy();
+    gridIndices.destroy();
+    nodeBounds.destroy();
+    pipeline = nullptr;
+    pipelineLayout = nullptr;
+    descriptorPool = nullptr;
+    descriptorSetLayout = nullptr;
+    descriptorSet = nullptr;
+    device = nullptr;
+}
+
+void Quadtree::update(const glm::vec3& camera, const std::array<glm::vec4, 6>& frustumPlanes, float lodDistance, float morphRegion) {
+    assert(uniforms.mapped);
+    auto& mapped = *static_cast<Uniforms*>(uniforms.mapped);
+    for (uint32_t i = 0; i < 6; ++i) {
+        mapped.frustumPlanes[i] = frustumPlanes[i];
+    }
+    mapped.camera = glm::vec4(camera, 1.0f);
+    // Node sizes, and with them the ranges, double with every LOD
+    float nodeSize = settings.size / (float)(1u << (settings.levels - 1));
+    for (uint32_t lod = 0; lod < settings.levels; ++lod) {
+        const float range = lodDistance * nodeSize;
+        const float morphStart = range * (1.0f - morphRegion);
+        mapped.ranges[lod] = glm::vec4(range, morphStart, 1.0f / std::max(range - morphStart, 1e-4f), 0.0f);
+        nodeSize *= 2.0f;
+    }
+}
+
+void Quadtree::record(const vk::CommandBuffer& commandBuffer) const {
+    // The previous frame's draws have to be done with the selection before it is overwritten
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput,
+                                  vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, nullptr, nullptr);
+    commandBuffer.fillBuffer(indirect.buffer, INSTANCE_COUNT_OFFSET, sizeof(uint32_t), 0);
+
+    vk::BufferMemoryBarrier barrier;
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = indirect.buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, barrier, nullptr);
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
+    commandBuffer.dispatch((nodes + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+    std::array<vk::BufferMemoryBarrier, 2> barriers{ barrier, barrier };
+    barriers[0].srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+    barriers[0].dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead;
+    barriers[1].srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+    barriers[1].dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead;
+    barriers[1].buffer = instances.buffer;
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput,
+                                  {}, nullptr, barriers, nullptr);
+}
+
+void Quadtree::draw(const vk::CommandBuffer& commandBuffer) const {
+    commandBuffer.bindVertexBuffers(0, { gridVertices.buffer, instances.buffer }, { 0, 0 });
+    commandBuffer.bindIndexBuffer(gridIndices.buffer, 0, vk::IndexType::eUint32);
+    commandBuffer.drawIndexedIndirect(indirect.buffer, 0, 1, sizeof(vk::DrawIndexedIndirectCommand));
+}
+
+void Quadtree::appendVertexInput(pipelines::PipelineVertexInputStateCreateInfo& vertexInputState, uint32_t location) {
+    vertexInputState.bindingDescriptions.emplace_back(0, (uint32_t)sizeof(glm::vec2), vk::VertexInputRate::eVertex);
+    vertexInputState.bindingDescriptions.emplace_back(1, (uint32_t)sizeof(glm::vec4), vk::VertexInputRate::eInstance);
+    vertexInputState.attributeDescriptions.emplace_back(location, 0, vk::Format::eR32G32Sfloat, 0);
+    vertexInputState.attributeDescriptions.emplace_back(location + 1, 1, vk::Format::eR32G32B32A32Sfloat, 0);
+}
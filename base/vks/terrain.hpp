@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "buffer.hpp"
+#include "forward.hpp"
+
+namespace vks {
+namespace pipelines {
+struct PipelineVertexInputStateCreateInfo;
+}
+
+namespace terrain {
+
+// Continuous distance-dependent level of detail (CDLOD) terrain, with the quadtree traversed on the GPU.  A compute
+// shader visits every node of the tree at once, keeps the nodes the camera is far enough from not to need their
+// children, culls them against the view frustum and appends them to an instance buffer, whose count lands in an
+// indexed indirect draw of a single grid mesh.  Nothing is read back and the CPU only writes the camera, so the
+// selection can be recorded once into command buffers that are replayed every frame.
+//
+// Terrain passes draw with the grid's positions (vec2 in [0, 1]) bound at binding 0 per vertex and the instances
+// (vec4: world x and z of the node's corner, node size, LOD) at binding 1 per instance, see appendVertexInput.
+// Vertex shaders place the grid over the node, sample the height and morph the vertices of the far part of a node
+// onto the grid of the next coarser LOD, with the ranges in `uniforms`, see quadtree.glsl.
+class Quadtree {
+public:
+    // Must match MAX_LEVELS in quadtree.glsl
+    static const uint32_t MAX_LEVELS = 12;
+
+    struct Settings {
+        // World space x and z of the corner of the terrain, and the length of its sides
+        glm::vec2 origin{ 0.0f };
+        float size{ 1.0f };
+        // Scales the [0, 1] heights into world space y
+        float heightScale{ 1.0f };
+        // Depth of the tree, LOD 0 is its deepest level
+        uint32_t levels{ 6 };
+        // Quads along each side of the grid drawn per node, a power of two
+        uint32_t gridSize{ 32 };
+    };
+
+    // Matches the UBO of quadtree.glsl
+    struct Uniforms {
+        glm::vec4 frustumPlanes[6];
+        glm::vec4 camera;
+        glm::vec2 origin;
+        float size;
+        float heightScale;
+        uint32_t levels;
+        uint32_t gridSize;
+        uint32_t nodeCount;
+        uint32_t pad;
+        // Per LOD, x: distance up to which its nodes are drawn, y: distance their vertices start morphing at,
+        // z: 1 / (x - y)
+        glm::vec4 ranges[MAX_LEVELS];
+    };
+
+    // Uniforms, host visible, coherent and persistently mapped.  Terrain vertex shaders read them too
+    Buffer uniforms;
+    Buffer instances;
+    Buffer indirect;
+    Buffer gridVertices;
+    Buffer gridIndices;
+
+    // `bounds` holds the lowest and highest height of every node, see HeightMap::heightBounds
+    void create(const vks::Context& context, const std::string& shaderPath, const Settings& settings, const std::vector<glm::vec2>& bounds);
+    void destroy();
+
+    const Settings& getSettings() const { return settings; }
+    uint32_t nodeCount() const { return nodes; }
+    // Every possible selection covers the terrain once, so it never holds more nodes than the deepest level
+    uint32_t maxInstances() const { return 1u << (2 * (settings.levels - 1)); }
+
+    // Nodes of LOD k are drawn up to lodDistance times their size from the camera.  The vertices of a node morph
+    // over the last `morphRegion` of that range.  Neighbours only stay within one LOD of each other, with matching
+    // edges, when lodDistance is about 6 or more.  Takes effect in the next selection to execute.
+    void update(const glm::vec3& camera, const std::array<glm::vec4, 6>& frustumPlanes, float lodDistance = 6.0f, float morphRegion = 0.3f);
+
+    // Select the nodes to draw for the camera of the last update.  Ordered after the draws of earlier commands and
+    // before the indirect draws and vertex input of later ones.  Must be recorded outside of a render pass.
+    void record(const vk::CommandBuffer& commandBuffer) const;
+
+    // Draw the last selection with the bound pipeline
+    void draw(const vk::CommandBuffer& commandBuffer) const;
+
+    // The bindings and attributes of the grid and instance streams, at `location` and location + 1
+    static void appendVertexInput(pipelines::PipelineVertexInputStateCreateInfo& vertexInputState, uint32_t location = 0);
+
+private:
+    vk::Device device;
+    Settings settings;
+    uint32_t nodes{ 0 };
+    uint32_t gridIndexCount{ 0 };
+    Buffer nodeBounds;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::DescriptorPool descriptorPool;
+    vk::DescriptorSet descriptorSet;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline pipeline;
+};
+
+}}  // namespace vks::terrain
@@ -0,0 +1,61 @@
+#include "tessellation.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vks;
+
+namespace {
+
+// About the triangles of a triangle patch with all its levels at `level`, which the rings of the tessellator give
+// half again as many as a uniform subdivision
+float patchTriangles(float level) {
+    return 1.5f * level * level;
+}
+
+// Budget scales are kept above the point where every edge is at level 1 anyway
+const float MIN_SCALE = 1.0f / 64.0f;
+// How much the levels may grow per measurement once the frames fit again
+const float GROWTH = 1.02f;
+
+}  // namespace
+
+AdaptiveTessellation::Params AdaptiveTessellation::params(const vk::Extent2D& viewport) const {
+    Params result{};
+    result.viewport = glm::vec2((float)viewport.width, (float)viewport.height);
+    result.maxLevel = maxLevel;
+    if (edgePixels > 0.0f) {
+        result.edgePixels = edgePixels / scale;
+        if (!measured && patchCount) {
+            // The level at which every patch together makes maxTriangles
+            const float fitting = std::sqrt((float)maxTriangles / ((float)patchCount * patchTriangles(1.0f)));
+            result.maxLevel = std::max(1.0f, std::min(maxLevel, fitting));
+        }
+    }
+    result.displacement = displacement;
+    result.backfaceCosine = backfaceCosine;
+    result.cull = cull ? 1 : 0;
+    return result;
+}
+
+bool AdaptiveTessellation::update(uint64_t triangles) {
+    const bool wasMeasured = measured;
+    const float previous = scale;
+    measured = true;
+    if (edgePixels <= 0.0f) {
+        return !wasMeasured;
+    }
+    const float ratio = std::sqrt((float)maxTriangles / (float)std::max<uint64_t>(triangles, 1));
+    if (ratio < 1.0f) {
+        scale *= ratio;
+    } else if (scale < 1.0f) {
+        scale *= std::min(ratio, GROWTH);
+    }
+    scale = std::max(MIN_SCALE, std::min(scale, 1.0f));
+    return scale != previous || !wasMeasured;
+}
+
+void AdaptiveTessellation::reset() {
+    scale = 1.0f;
+    measured = false;
+}
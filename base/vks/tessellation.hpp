@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+namespace vks {
+
+// The CPU side of data/shaders/base/tessellation.glsl, screen space adaptive tessellation of triangle patches.
+//
+// Every edge is split into segments about `edgePixels` long on screen, from the edge's own end points, so the patches
+// sharing it agree on its level and don't crack.  Patches outside the frustum, or whose corner normals all face away
+// from the viewer, get zero levels and are dropped before any evaluation shader runs.
+//
+// The triangle budget is kept with the triangles the frames actually produce, the clipping invocations of the pipeline
+// statistics: the levels shrink by the square root of the overshoot, as the triangles of a patch grow with the square
+// of its levels, and grow back slowly once there is room again.  Until the first count arrives, or without pipeline
+// statistics, the levels are capped so that all `patchCount` patches fit at the cap, which is conservative once some
+// are culled.
+class AdaptiveTessellation {
+public:
+    // Must match the TessellationParams block of tessellation.glsl
+    struct Params {
+        glm::vec2 viewport;
+        float edgePixels;
+        float maxLevel;
+        float displacement;
+        float backfaceCosine;
+        uint32_t cull;
+        float padding;
+    };
+
+    // Target on screen length of the tessellated edges, 0 to tessellate every edge at `maxLevel`
+    float edgePixels{ 12.0f };
+    // The largest level of any edge, at most maxTessellationGenerationLevel
+    float maxLevel{ 64.0f };
+    uint32_t maxTriangles{ 1u << 20 };
+    uint32_t patchCount{ 0 };
+    bool cull{ true };
+    // How far the surface may move off the flat patch, like the strength of a displacement map, for the culling tests
+    float displacement{ 0.0f };
+    // Patches are only dropped as facing away when all corner normals are further from the viewer than this cosine,
+    // for surfaces that bend away from their corners' normals
+    float backfaceCosine{ 0.25f };
+
+    Params params(const vk::Extent2D& viewport) const;
+
+    // Hand over the triangles tessellated by the most recent frame.  Returns true if the params changed.
+    bool update(uint64_t triangles);
+    // Reset the budget once its settings changed
+    void reset();
+
+    // The factor the budget scaled the levels by, 1 when the frames fit
+    float budgetScale() const { return scale; }
+
+private:
+    float scale{ 1.0f };
+    bool measured{ false };
+};
+
+}  // namespace vks
@@ -0,0 +1,259 @@
+#include "text.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "filesystem.hpp"
+#include "pipelines.hpp"
+
+using namespace vks;
+
+const uint32_t TextRenderer::DEFAULT_MAX_GLYPHS;
+
+namespace {
+
+// The key=value pairs following the tag of a .fnt line, as integers.  Quoted values (names and file names) are of
+// no use for layout and are skipped.
+template <typename F>
+void forEachValue(std::istringstream& line, const F& f) {
+    std::string pair;
+    while (line >> pair) {
+        const size_t separator = pair.find('=');
+        if (separator == std::string::npos || separator + 1 == pair.size() || pair[separator + 1] == '"') {
+            continue;
+        }
+        f(pair.substr(0, separator), std::stoi(pair.substr(separator + 1)));
+    }
+}
+
+uint16_t unorm16(float value) {
+    return (uint16_t)(glm::clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+uint32_t rgba8(const glm::vec4& color) {
+    const glm::uvec4 c{ glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f };
+    return c.r | (c.g << 8) | (c.b << 16) | (c.a << 24);
+}
+
+}  // namespace
+
+void Font::loadFromFile(const std::string& filename) {
+    glyphs = {};
+    lineHeight = base = scaleW = scaleH = 0;
+    vks::file::withBinaryFileContents(filename, [&](size_t size, const void* data) {
+        std::istringstream stream(std::string((const char*)data, size));
+        std::string text;
+        while (std::getline(stream, text)) {
+            std::istringstream line(text);
+            std::string tag;
+            line >> tag;
+            if (tag == "common") {
+                forEachValue(line, [&](const std::string& key, int32_t value) {
+                    if (key == "lineHeight") {
+                        lineHeight = value;
+                    } else if (key == "base") {
+                        base = value;
+                    } else if (key == "scaleW") {
+                        scaleW = value;
+                    } else if (key == "scaleH") {
+                        scaleH = value;
+                    }
+                });
+            } else if (tag == "char") {
+                Glyph glyph;
+                int32_t id = -1;
+                forEachValue(line, [&](const std::string& key, int32_t value) {
+                    if (key == "id") {
+                        id = value;
+                    } else if (key == "x") {
+                        glyph.x = value;
+                    } else if (key == "y") {
+                        glyph.y = value;
+                    } else if (key == "width") {
+                        glyph.width = value;
+                    } else if (key == "height") {
+                        glyph.height = value;
+                    } else if (key == "xoffset") {
+                        glyph.xoffset = value;
+                    } else if (key == "yoffset") {
+                        glyph.yoffset = value;
+                    } else if (key == "xadvance") {
+                        glyph.xadvance = value;
+                    }
+                });
+                if (id >= 0 && id < (int32_t)glyphs.size()) {
+                    glyphs[id] = glyph;
+                }
+            }
+        }
+    });
+    if (!lineHeight || !scaleW || !scaleH) {
+        throw std::runtime_error("Invalid font file " + filename);
+    }
+}
+
+void TextRenderer::create(const Context& context,
+                          const std::string& assetPath,
+                          const vk::RenderPass& renderPass,
+                          uint32_t frameCount,
+                          uint32_t maxGlyphs,
+                          vk::SampleCountFlagBits samples,
+                          uint32_t subpass) {
+    device = context.device;
+    font.loadFromFile(assetPath + "font.fnt");
+    texture.loadFromFile(context, assetPath + "textures/font_sdf_rgba.ktx", vk::Format::eR8G8B8A8Unorm);
+    // The glyphs are bound as a vertex buffer at the start of the frame's region, the padding dynamic descriptors
+    // would need is of no use
+    glyphs.create(context, (vk::DeviceSize)sizeof(GlyphInstance) * std::max(maxGlyphs, 1u), frameCount, vk::BufferUsageFlagBits::eVertexBuffer,
+                  sizeof(GlyphInstance));
+
+    vk::DescriptorSetLayoutBinding binding{ 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment };
+    descriptorSetLayout = device.createDescriptorSetLayout({ {}, 1, &binding });
+    vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, sizeof(PushConsts) };
+    pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout, 1, &pushConstantRange });
+
+    vk::DescriptorPoolSize poolSize{ vk::DescriptorType::eCombinedImageSampler, 1 };
+    descriptorPool = device.createDescriptorPool({ {}, 1, 1, &poolSize });
+    descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+    vk::WriteDescriptorSet write{ descriptorSet, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texture.descriptor };
+    device.updateDescriptorSets(write, nullptr);
+
+    using BF = vk::BlendFactor;
+    using BO = vk::BlendOp;
+    pipelines::GraphicsPipelineBuilder builder{ device, pipelineLayout, renderPass };
+    builder.subpass = subpass;
+    builder.multisampleState.rasterizationSamples = samples;
+    builder.inputAssemblyState.topology = vk::PrimitiveTopology::eTriangleStrip;
+    builder.rasterizationState.cullMode = vk::CullModeFlagBits::eNone;
+    builder.depthStencilState = false;
+    // Premultiplied alpha
+    builder.colorBlendState.blendAttachmentStates[0] = { VK_TRUE, BF::eOne, BF::eOneMinusSrcAlpha, BO::eAdd, BF::eOne, BF::eOneMinusSrcAlpha, BO::eAdd };
+    builder.vertexInputState.bindingDescriptions = {
+        { 0, sizeof(GlyphInstance), vk::VertexInputRate::eInstance },
+    };
+    builder.vertexInputState.attributeDescriptions = {
+        { 0, 0, vk::Format::eR32G32B32A32Sfloat, offsetof(GlyphInstance, rect) },
+        { 1, 0, vk::Format::eR16G16B16A16Unorm, offsetof(GlyphInstance, uv) },
+        { 2, 0, vk::Format::eR8G8B8A8Unorm, offsetof(GlyphInstance, color) },
+    };
+    builder.loadShader(assetPath + "shaders/base/sdftext.vert.spv", vk::ShaderStageFlagBits::eVertex);
+    builder.loadShader(assetPath + "shaders/base/sdftext.frag.spv", vk::ShaderStageFlagBits::eFragment);
+    pipeline = builder.create(context.pipelineCache);
+}
+
+void TextRenderer::destroy() {
+    if (!device) {
+        return;
+    }
+    device.destroyPipeline(pipeline);
+    device.destroyPipelineLayout(pipelineLayout);
+    device.destroyDescriptorPool(descriptorPool);
+    device.destroyDescriptorSetLayout(descriptorSetLayout);
+    glyphs.destroy();
+    texture.destroy();
+    pipeline = nullptr;
+    pipelineLayout = nullptr;
+    descriptorPool = nullptr;
+    descriptorSetLayout = nullptr;
+    descriptorSet = nullptr;
+    device = nullptr;
+}
+
+void TextRenderer::begin(uint32_t frame) {
+    glyphs.begin(frame);
+}
+
+float TextRenderer::lineWidth(const char* begin, const char* end, float scale) const {
+    int32_t width = 0;
+    for (const char* c = begin; c != end; ++c) {
+        width += font.glyph(*c).xadvance;
+    }
+    return (float)width * scale;
+}
+
+glm::vec2 TextRenderer::measure(const std::string& text, float size) const {
+    const float scale = size / (float)font.lineHeight;
+    glm::vec2 result{ 0.0f, size };
+    const char* line = text.c_str();
+    const char* const end = line + text.size();
+    while (true) {
+        const char* lineEnd = std::find(line, end, '\n');
+        result.x = std::max(result.x, lineWidth(line, lineEnd, scale));
+        if (lineEnd == end) {
+            break;
+        }
+        result.y += size;
+        line = lineEnd + 1;
+    }
+    return result;
+}
+
+glm::vec2 TextRenderer::add(const std::string& text, const glm::vec2& position, float size, const glm::vec4& color, Align align) {
+    // Characters without a glyph, like spaces, only advance the pen
+    size_t count = 0;
+    for (const char c : text) {
+        count += font.glyph(c).width ? 1 : 0;
+    }
+    GlyphInstance* out = nullptr;
+    if (count) {
+        out = static_cast<GlyphInstance*>(glyphs.allocate(count * sizeof(GlyphInstance)).mapped);
+    }
+
+    const float scale = size / (float)font.lineHeight;
+    const glm::vec2 texelSize{ 1.0f / (float)font.scaleW, 1.0f / (float)font.scaleH };
+    const uint32_t packedColor = rgba8(color);
+    glm::vec2 result{ 0.0f, size };
+    glm::vec2 pen = position;
+    const char* line = text.c_str();
+    const char* const end = line + text.size();
+    while (true) {
+        const char* lineEnd = std::find(line, end, '\n');
+        const float width = lineWidth(line, lineEnd, scale);
+        result.x = std::max(result.x, width);
+        pen.x = position.x;
+        if (align == Align::Center) {
+            pen.x -= width * 0.5f;
+        } else if (align == Align::Right) {
+            pen.x -= width;
+        }
+        for (const char* c = line; c != lineEnd; ++c) {
+            const Font::Glyph& glyph = font.glyph(*c);
+            if (glyph.width) {
+                GlyphInstance& instance = *out++;
+                instance.rect = { pen.x + (float)glyph.xoffset * scale, pen.y + (float)glyph.yoffset * scale, (float)glyph.width * scale,
+                                  (float)glyph.height * scale };
+                instance.uv[0] = unorm16((float)glyph.x * texelSize.x);
+                instance.uv[1] = unorm16((float)glyph.y * texelSize.y);
+                instance.uv[2] = unorm16((float)(glyph.x + glyph.width) * texelSize.x);
+                instance.uv[3] = unorm16((float)(glyph.y + glyph.height) * texelSize.y);
+                instance.color = packedColor;
+            }
+            pen.x += (float)glyph.xadvance * scale;
+        }
+        if (lineEnd == end) {
+            break;
+        }
+        pen.y += size;
+        result.y += size;
+        line = lineEnd + 1;
+    }
+    return result;
+}
+
+void TextRenderer::draw(const vk::CommandBuffer& commandBuffer, const glm::mat4& transform) const {
+    const uint32_t count = glyphCount();
+    if (!count) {
+        return;
+    }
+    PushConsts pushConsts;
+    pushConsts.transform = transform;
+    pushConsts.outlineColor = outlineColor;
+    pushConsts.outlineWidth = outlineWidth;
+    pushConsts.outline = outline ? 1.0f : 0.0f;
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
+    commandBuffer.pushConstants<PushConsts>(pipelineLayout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, pushConsts);
+    commandBuffer.bindVertexBuffers(0, glyphs.handle(), glyphs.regionOffset());
+    commandBuffer.draw(4, count, 0, 0);
+}
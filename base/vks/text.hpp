@@ -0,0 +1,130 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "frameallocator.hpp"
+#include "texture.hpp"
+
+namespace vks {
+
+// Glyph metrics of an AngelCode bitmap font, from the text variant of the .fnt format.  All values are in texels of
+// the font texture.  See http://www.angelcode.com/products/bmfont/doc/file_format.html
+struct Font {
+    struct Glyph {
+        uint32_t x{ 0 }, y{ 0 };
+        uint32_t width{ 0 }, height{ 0 };
+        int32_t xoffset{ 0 }, yoffset{ 0 };
+        int32_t xadvance{ 0 };
+    };
+
+    // Indexed by character, only the ones in the file are filled in
+    std::array<Glyph, 256> glyphs;
+    // Distance between lines, and from the top of a line to the baseline
+    uint32_t lineHeight{ 0 };
+    uint32_t base{ 0 };
+    // Size of the texture the glyphs are in
+    uint32_t scaleW{ 0 }, scaleH{ 0 };
+
+    void loadFromFile(const std::string& filename);
+
+    const Glyph& glyph(char c) const { return glyphs[(uint8_t)c]; }
+};
+
+// Signed distance field text, batched into a single instanced draw.
+//
+// `add` lays strings out into glyph instances of a few bytes each, written straight into a persistently mapped
+// buffer with a region per frame in flight, and `draw` renders everything added since `begin` with one strip of four
+// vertices per glyph.  Changing text therefore costs nothing beyond writing its glyphs, there is no mesh to rebuild.
+//
+// Text is laid out in a space with x to the right and y down, like pixels.  `draw` maps it to clip space with the
+// transform it is given, e.g. glm::ortho(0, width, 0, height) for screen space labels.  Glyph instances are only
+// valid for the frame they were added in, so the renderer needs the command buffers to be recorded every frame, see
+// ExampleBase::recordPerFrame.
+class TextRenderer {
+public:
+    enum class Align
+    {
+        Left,
+        Center,
+        Right
+    };
+
+    static const uint32_t DEFAULT_MAX_GLYPHS = 16384;
+
+    Font font;
+    vks::texture::Texture2D texture;
+
+    // Outline around every glyph drawn, out to `outlineWidth` of the distance field range
+    bool outline{ false };
+    glm::vec4 outlineColor{ 0.0f, 0.0f, 0.0f, 1.0f };
+    float outlineWidth{ 0.6f };
+
+    // Loads font.fnt and the matching distance field from `assetPath`, for drawing in `subpass` of `renderPass`.
+    // Up to `maxGlyphs` glyphs can be added per frame.
+    void create(const Context& context,
+                const std::string& assetPath,
+                const vk::RenderPass& renderPass,
+                uint32_t frameCount,
+                uint32_t maxGlyphs = DEFAULT_MAX_GLYPHS,
+                vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1,
+                uint32_t subpass = 0);
+    void destroy();
+
+    operator bool() const { return pipeline.operator bool(); }
+
+    // Start adding text for frame slot `frame`, whose previous glyphs must no longer be in use by the device
+    void begin(uint32_t frame);
+
+    // Lays out `text` with lines `size` units apart, starting at the top left (or top center or right, depending on
+    // `align`) corner `position`.  Lines are separated by '\n' and aligned individually.  Returns the size of the
+    // block of text.  Safe to call from several recording threads at once.
+    glm::vec2 add(const std::string& text,
+                  const glm::vec2& position,
+                  float size,
+                  const glm::vec4& color = glm::vec4(1.0f),
+                  Align align = Align::Left);
+
+    // Size of the block of text `add` would lay out
+    glm::vec2 measure(const std::string& text, float size) const;
+
+    // Draws everything added for the current frame
+    void draw(const vk::CommandBuffer& commandBuffer, const glm::mat4& transform) const;
+
+    uint32_t glyphCount() const { return (uint32_t)(glyphs.used() / sizeof(GlyphInstance)); }
+
+private:
+    // Must match the vertex inputs of sdftext.vert
+    struct GlyphInstance {
+        // Top left corner and size
+        glm::vec4 rect;
+        // Texture coordinates of the top left and bottom right corners, normalized
+        uint16_t uv[4];
+        // RGBA8
+        uint32_t color;
+    };
+
+    // Must match sdftext.vert and sdftext.frag
+    struct PushConsts {
+        glm::mat4 transform;
+        glm::vec4 outlineColor;
+        float outlineWidth;
+        float outline;
+    };
+
+    float lineWidth(const char* begin, const char* end, float scale) const;
+
+    vk::Device device;
+    FrameAllocator glyphs;
+    vk::DescriptorPool descriptorPool;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::DescriptorSet descriptorSet;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline pipeline;
+};
+
+}  // namespace vks
@@ -8,17 +8,30 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
 #include <string>
 #include <fstream>
+#include <functional>
+#include <memory>
 #include <vector>
 
 #include <vulkan/vulkan.hpp>
 
 #include <gli/gli.hpp>
 
+#include "bindless.hpp"
 #include "buffer.hpp"
 #include "image.hpp"
 #include "filesystem.hpp"
+#include "basis.hpp"
+#include "ktx.hpp"
+#include "scheduler.hpp"
+#include "startup.hpp"
+#include "storage.hpp"
+#include "trace.hpp"
 
 namespace vks { namespace texture {
 
@@ -32,6 +45,10 @@ public:
     uint32_t mipLevels;
     uint32_t layerCount{ 1 };
     vk::DescriptorImageInfo descriptor;
+    /** @brief Non-zero if the image data is still in flight on the transfer queue, see Context::isUploadComplete */
+    UploadTicket uploadTicket{ 0 };
+    /** @brief Entry of the texture in Context::bindless, kept up to date by updateDescriptor.  INVALID_INDEX without one */
+    uint32_t bindlessIndex{ BindlessTable::INVALID_INDEX };
 
     Texture& operator=(const vks::Image& image) {
         destroy();
@@ -44,10 +61,128 @@ public:
         descriptor.sampler = sampler;
         descriptor.imageView = view;
         descriptor.imageLayout = imageLayout;
+        if (!bindless) {
+            return;
+        }
+        if (bindlessIndex == BindlessTable::INVALID_INDEX) {
+            bindlessIndex = bindless->addTexture(descriptor);
+        } else {
+            bindless->updateTexture(bindlessIndex, descriptor);
+        }
     }
 
     /** @brief Release all Vulkan resources held by this texture */
-    void destroy() override { Parent::destroy(); }
+    void destroy() override {
+        if (bindless) {
+            bindless->releaseTexture(bindlessIndex);
+            bindless.reset();
+        }
+        bindlessIndex = BindlessTable::INVALID_INDEX;
+        Parent::destroy();
+    }
+
+protected:
+    /** @brief The table the loaders register the texture in, Context::bindless when it was loaded */
+    std::shared_ptr<BindlessTable> bindless;
+
+    /** @brief Writes the image of one level, layer and face of a texture to `destination` */
+    using ImageWriter = std::function<void(uint32_t level, uint32_t layer, uint32_t face, uint8_t* destination)>;
+
+    /**
+        * Record the upload of a texture's images from one staging allocation with one copy, and the transition of
+        * `subresourceRange` from undefined to imageLayout around it
+        *
+        * @param layout Where the images are in the staging allocation, from packedKtxLayout
+        * @param write Fills the staging allocation
+        */
+    void stageImages(const vks::Context& context,
+                     const KtxLayout& layout,
+                     const std::function<void(uint8_t* staging)>& write,
+                     const vk::ImageSubresourceRange& subresourceRange) {
+        context.stageUploadInPlace(layout.end(), write, context.getImageStagingAlignment(),
+                                   [&](const vk::CommandBuffer& copyCmd, const vk::Buffer& stagingBuffer, vk::DeviceSize stagingOffset) {
+                                       // The layers and faces of a level are packed, so one region covers all of them
+                                       std::vector<vk::BufferImageCopy> regions(layout.levels);
+                                       for (uint32_t level = 0; level < layout.levels; ++level) {
+                                           regions[level].bufferOffset = stagingOffset + layout.levelOffsets[level];
+                                           regions[level].imageSubresource = { vk::ImageAspectFlagBits::eColor, level, 0, subresourceRange.layerCount };
+                                           regions[level].imageExtent = layout.extent(level);
+                                       }
+                                       context.setImageLayout(copyCmd, image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+                                                              subresourceRange);
+                                       copyCmd.copyBufferToImage(stagingBuffer, image, vk::ImageLayout::eTransferDstOptimal, regions);
+                                       context.setImageLayout(copyCmd, image, vk::ImageLayout::eTransferDstOptimal, imageLayout, subresourceRange);
+                                   });
+    }
+
+    /** @brief stageImages with every image written separately by `write`, spread over TaskScheduler::shared */
+    void stageEachImage(const vks::Context& context, const KtxLayout& layout, const ImageWriter& write, const vk::ImageSubresourceRange& subresourceRange) {
+        const uint32_t images = layout.layers * layout.faces;
+        stageImages(
+            context, layout,
+            [&](uint8_t* staging) {
+                // Largest levels first, so the scheduler isn't left waiting on one big image at the end
+                TaskScheduler::shared().parallelFor(0, images * layout.levels, 1, [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; ++i) {
+                        const uint32_t level = (uint32_t)(i / images);
+                        const uint32_t layer = (uint32_t)(i % images) / layout.faces;
+                        const uint32_t face = (uint32_t)(i % images) % layout.faces;
+                        write(level, layer, face, staging + layout.offset(level, layer, face));
+                    }
+                });
+            },
+            subresourceRange);
+    }
+
+    /**
+        * Read `filename` for one of the loaders and record the upload of all its images with stageImages.  KTX files
+        * are copied straight out of the mapped file and Basis files transcoded straight into staging memory, everything
+        * else is decoded by gli first.  The images are written to staging memory in parallel either way.
+        *
+        * @param format Replaced by basisTranscodeFormat for Basis files
+        * @param direct Whether the images of a KTX file of `ktx` can be copied without gli
+        * @param create Create the image for images of `layout`, returning the range they cover
+        */
+    void stageFile(const vks::Context& context,
+                   const std::string& filename,
+                   vk::Format& format,
+                   const std::function<bool(const KtxLayout& ktx)>& direct,
+                   const std::function<vk::ImageSubresourceRange(const KtxLayout& layout)>& create) {
+        const size_t alignment = (size_t)context.getImageStagingAlignment();
+        if (isBasisFile(filename)) {
+            format = basisTranscodeFormat(context);
+            transcodeBasis(filename, format, alignment, [&](const KtxLayout& layout, const BasisTranscode& transcode) {
+                stageImages(context, layout, transcode, create(layout));
+            });
+            return;
+        }
+
+        auto storage = vks::storage::Storage::readFile(filename);
+        KtxLayout ktx;
+        if (parseKtx(storage->data(), storage->size(), ktx) && direct(ktx)) {
+            const uint8_t* data = storage->data();
+            const KtxLayout layout = packedKtxLayout(ktx.format, ktx.width, ktx.height, ktx.layers, ktx.faces, ktx.levels, alignment);
+            const auto copy = [&](uint32_t level, uint32_t layer, uint32_t face, uint8_t* destination) {
+                memcpy(destination, data + ktx.offset(level, layer, face), ktx.imageSizes[level]);
+            };
+            stageEachImage(context, layout, copy, create(layout));
+            return;
+        }
+
+        storage.reset();
+        const gli::texture texture = loadTexture(context, filename, format);
+        if (texture.empty()) {
+            throw std::runtime_error("Unable to load texture " + filename);
+        }
+        const KtxLayout layout = packedKtxLayout(texture.format(), static_cast<uint32_t>(texture.extent().x), static_cast<uint32_t>(texture.extent().y),
+                                                 static_cast<uint32_t>(texture.layers()), static_cast<uint32_t>(texture.faces()),
+                                                 static_cast<uint32_t>(texture.levels()), alignment);
+        const auto copy = [&](uint32_t level, uint32_t layer, uint32_t face, uint8_t* destination) {
+            assert(texture.size(level) == layout.imageSizes[level]);
+            memcpy(destination, texture.data(layer, face, level), layout.imageSizes[level]);
+        };
+        stageEachImage(context, layout, copy, create(layout));
+    }
 };
 
 /** @brief 2D texture */
@@ -58,8 +193,8 @@ public:
     /**
         * Load a 2D texture including all mip levels
         *
-        * @param filename File to load (supports .ktx and .dds)
-        * @param format Vulkan format of the image data stored in the file
+        * @param filename File to load (supports .ktx, .dds and the supercompressed .ktx2 and .basis)
+        * @param format Vulkan format of the image data stored in the file, ignored for .ktx2 and .basis files, which are transcoded to basisTranscodeFormat
         * @param device Vulkan device to create the texture on
         * @param copyQueue Queue used for the texture staging copy commands (must support transfer)
         * @param (Optional) imageUsageFlags Usage flags for the texture's image (defaults to VK_IMAGE_USAGE_SAMPLED_BIT)
@@ -73,16 +208,17 @@ public:
                       vk::ImageUsageFlags imageUsageFlags = vk::ImageUsageFlagBits::eSampled,
                       vk::ImageLayout imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
                       bool forceLinear = false) {
+        VKS_TRACE_ZONE("Texture2D::loadFromFile");
+        startup::ScopedPhase startupPhase(startup::Phase::Decode);
+        Allocator::ScopedTag tag("textures");
         this->imageLayout = imageLayout;
         descriptor.imageLayout = imageLayout;
-        std::shared_ptr<gli::texture2d> tex2Dptr;
-        vks::file::withBinaryFileContents(filename, [&](size_t size, const void* data) {
-            tex2Dptr = std::make_shared<gli::texture2d>(gli::load((const char*)data, size));
-        });
+        auto tex2Dptr = std::make_shared<gli::texture2d>(loadTexture(context, filename, format));
         const auto& tex2D = *tex2Dptr;
         assert(!tex2D.empty());
 
         device = context.device;
+        bindless = context.bindless;
         extent.width = static_cast<uint32_t>(tex2D[0].extent().x);
         extent.height = static_cast<uint32_t>(tex2D[0].extent().y);
         extent.depth = 1;
@@ -98,7 +234,8 @@ public:
         imageCreateInfo.extent = extent;
         imageCreateInfo.usage = imageUsageFlags | vk::ImageUsageFlagBits::eTransferDst;
 
-        static_cast<vks::Image&>(*this) = context.stageToDeviceImage(imageCreateInfo, vk::MemoryPropertyFlagBits::eDeviceLocal, tex2D, imageLayout);
+        static_cast<vks::Image&>(*this) = context.stageToDeviceImage(imageCreateInfo, vk::MemoryPropertyFlagBits::eDeviceLocal, tex2D, imageLayout,
+                                                                     context.asyncUploads ? &uploadTicket : nullptr);
 
         // Create sampler
         vk::SamplerCreateInfo samplerCreateInfo;
@@ -111,7 +248,7 @@ public:
         samplerCreateInfo.maxAnisotropy = context.deviceFeatures.samplerAnisotropy ? context.deviceProperties.limits.maxSamplerAnisotropy : 1.0f;
         samplerCreateInfo.anisotropyEnable = context.deviceFeatures.samplerAnisotropy;
         samplerCreateInfo.borderColor = vk::BorderColor::eFloatOpaqueWhite;
-        sampler = device.createSampler(samplerCreateInfo);
+        sampler = vks::acquireSampler(device, samplerCreateInfo);
 
         // Create image view
         static const vk::ImageUsageFlags VIEW_USAGE_FLAGS =
@@ -147,6 +284,7 @@ public:
         * @param (Optional) filter Texture filtering for the sampler (defaults to VK_FILTER_LINEAR)
         * @param (Optional) imageUsageFlags Usage flags for the texture's image (defaults to VK_IMAGE_USAGE_SAMPLED_BIT)
         * @param (Optional) imageLayout Usage layout for the texture (defaults VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+        * @param (Optional) generateMipmaps Fill a full mip chain from the buffer's contents on the GPU, if the format allows it
         */
     void fromBuffer(const vks::Context& context,
                     void* buffer,
@@ -155,10 +293,13 @@ public:
                     const vk::Extent2D& extent,
                     vk::Filter filter = vk::Filter::eLinear,
                     vk::ImageUsageFlags imageUsageFlags = vk::ImageUsageFlagBits::eSampled,
-                    vk::ImageLayout imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal) {
+                    vk::ImageLayout imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+                    bool generateMipmaps = false) {
         assert(buffer);
+        Allocator::ScopedTag tag("textures");
 
         device = context.device;
+        bindless = context.bindless;
         this->format = format;
         this->imageLayout = imageLayout;
         this->extent.width = extent.width;
@@ -175,27 +316,40 @@ public:
         imageCreateInfo.extent = this->extent;
         // Ensure that the TRANSFER_DST bit is set for staging
         imageCreateInfo.usage = imageUsageFlags | vk::ImageUsageFlagBits::eTransferDst;
+        if (generateMipmaps) {
+            imageCreateInfo.mipLevels = vks::util::mipLevelCount(this->extent);
+            imageCreateInfo.usage |= vk::ImageUsageFlagBits::eTransferSrc;
+            // Formats without linear blits are downsampled in a compute shader, which writes the levels as storage images
+            const vk::FormatFeatureFlags features = context.getFormatProperties(format).optimalTilingFeatures;
+            if (!(features & vk::FormatFeatureFlagBits::eSampledImageFilterLinear) && (features & vk::FormatFeatureFlagBits::eStorageImage)) {
+                imageCreateInfo.usage |= vk::ImageUsageFlagBits::eStorage;
+            }
+            // Without any way to downsample the format the texture keeps its single level
+            if (context.getMipmapMethod(imageCreateInfo) == vks::Context::MipmapMethod::None) {
+                imageCreateInfo.mipLevels = 1;
+            }
+            mipLevels = imageCreateInfo.mipLevels;
+        }
         static_cast<vks::Image&>(*this) = context.createImage(imageCreateInfo);
 
         {
-            // Create a host-visible staging buffer that contains the raw image data
-            vks::Buffer stagingBuffer = context.createStagingBuffer(bufferSize, buffer);
-
-            // Copy mip levels from staging buffer
-            context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+            // Copy the raw image data through the context staging ring
+            context.stageUpload(bufferSize, buffer, context.getImageStagingAlignment(),
+                                [&](const vk::CommandBuffer& commandBuffer, const vk::Buffer& stagingBuffer, vk::DeviceSize stagingOffset) {
                 context.setImageLayout(commandBuffer, this->image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined,
                                        vk::ImageLayout::eTransferDstOptimal);
                 vk::BufferImageCopy bufferCopyRegion;
+                bufferCopyRegion.bufferOffset = stagingOffset;
                 bufferCopyRegion.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
                 bufferCopyRegion.imageSubresource.layerCount = 1;
                 bufferCopyRegion.imageExtent.width = extent.width;
                 bufferCopyRegion.imageExtent.height = extent.height;
                 bufferCopyRegion.imageExtent.depth = 1;
 
-                commandBuffer.copyBufferToImage(stagingBuffer.buffer, image, vk::ImageLayout::eTransferDstOptimal, bufferCopyRegion);
-                context.setImageLayout(commandBuffer, this->image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eTransferDstOptimal, imageLayout);
+                commandBuffer.copyBufferToImage(stagingBuffer, image, vk::ImageLayout::eTransferDstOptimal, bufferCopyRegion);
+                // Also transitions the single level case to imageLayout
+                context.generateMipmaps(commandBuffer, this->image, imageCreateInfo, imageLayout);
             });
-            stagingBuffer.destroy();
         }
 
         // Create sampler
@@ -204,14 +358,15 @@ public:
         samplerCreateInfo.minFilter = filter;
         samplerCreateInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
         samplerCreateInfo.maxAnisotropy = 1.0f;
-        sampler = device.createSampler(samplerCreateInfo);
+        samplerCreateInfo.maxLod = (float)mipLevels;
+        sampler = vks::acquireSampler(device, samplerCreateInfo);
 
         // Create image view
         vk::ImageViewCreateInfo viewCreateInfo;
         viewCreateInfo.image = image;
         viewCreateInfo.viewType = vk::ImageViewType::e2D;
         viewCreateInfo.format = format;
-        viewCreateInfo.subresourceRange = { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
+        viewCreateInfo.subresourceRange = { vk::ImageAspectFlagBits::eColor, 0, mipLevels, 0, 1 };
         view = device.createImageView(viewCreateInfo);
 
         // Update descriptor image info member that can be used for setting up descriptor sets
@@ -219,94 +374,379 @@ public:
     }
 };
 
-/** @brief 2D array texture */
-class Texture2DArray : public Texture {
+/**
+* 2D texture whose mip levels are streamed in over several frames, coarsest first.
+*
+* loadFromFile only uploads the mip tail, the smallest levels that fit in one frame's budget, so it returns almost
+* immediately.  Every update() call then streams part of the next finer level, at most `budgetMB` of it, into a
+* larger image that the resident levels have been copied into.  Once the level is complete the new image is swapped
+* in.  The view starts at the finest resident level, which clamps the sampled LOD to what has been uploaded without
+* any of the missing levels being part of the view, and device memory only holds the resident levels plus the one
+* being streamed.  request() lowers the target resolution again, which evicts the finer levels.
+*
+* requestForScreenSize() drives the requested level from the screen space size the texture is drawn at, once per
+* frame.  That size is the caller's estimate, there is no feedback from the GPU of which levels were actually
+* sampled, so a texture that's partly occluded or seen at a grazing angle may keep levels finer or coarser than
+* the ones it reads.
+*
+* Whenever update() returns true the image and view have changed and descriptor sets must be pointed at the new
+* `descriptor` before their next use.  The previous image is released through the context's deferred deletion.
+* The decoded file stays on the host, so evicted levels can be streamed back in.
+*
+* Finer levels are only streamed in while their heap has room in the allocator's budget.  When some other allocation
+* would exceed it, the texture's evictor gives up the finest resident level on the next update().
+*
+* Uploads always go through the graphics queue upload batch, regardless of Context::asyncUploads.
+*/
+class StreamingTexture2D : public Texture {
+    using Parent = Texture;
+
 public:
+    /** @brief Upper bound of the image data uploaded by loadFromFile and each update(), in megabytes */
+    float budgetMB{ 4.0f };
+
     /**
-        * Load a 2D texture array including all mip levels
+        * Load a 2D texture and upload its mip tail.  `mipLevels` is the level count of the file, the image only
+        * holds `mipLevels - residentLevel()` of them.
         *
-        * @param filename File to load (supports .ktx and .dds)
-        * @param format Vulkan format of the image data stored in the file
-        * @param device Vulkan device to create the texture on
-        * @param copyQueue Queue used for the texture staging copy commands (must support transfer)
+        * @param filename File to load (supports .ktx, .dds and the supercompressed .ktx2 and .basis)
+        * @param format Vulkan format of the image data stored in the file, ignored for .ktx2 and .basis files, which are transcoded to basisTranscodeFormat
         * @param (Optional) imageUsageFlags Usage flags for the texture's image (defaults to VK_IMAGE_USAGE_SAMPLED_BIT)
         * @param (Optional) imageLayout Usage layout for the texture (defaults VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-        *
         */
     void loadFromFile(const vks::Context& context,
-                      std::string filename,
-                      vk::Format format,
+                      const std::string& filename,
+                      vk::Format format = vk::Format::eR8G8B8A8Unorm,
                       vk::ImageUsageFlags imageUsageFlags = vk::ImageUsageFlagBits::eSampled,
                       vk::ImageLayout imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal) {
-        this->device = device;
+        VKS_TRACE_ZONE("StreamingTexture2D::loadFromFile");
+        startup::ScopedPhase startupPhase(startup::Phase::Decode);
+        this->context = &context;
         this->imageLayout = imageLayout;
         descriptor.imageLayout = imageLayout;
+        source = std::make_shared<const gli::texture2d>(loadTexture(context, filename, format));
+        const auto& tex2D = *source;
+        assert(!tex2D.empty());
 
-        std::shared_ptr<gli::texture2d_array> texPtr;
-        vks::file::withBinaryFileContents(filename, [&](size_t size, const void* data) {
-            texPtr = std::make_shared<gli::texture2d_array>(gli::load((const char*)data, size));
+        device = context.device;
+        bindless = context.bindless;
+        extent.width = static_cast<uint32_t>(tex2D[0].extent().x);
+        extent.height = static_cast<uint32_t>(tex2D[0].extent().y);
+        extent.depth = 1;
+        mipLevels = static_cast<uint32_t>(tex2D.levels());
+        layerCount = 1;
+        requestedLevel = 0;
+
+        imageCreateInfo = vk::ImageCreateInfo{};
+        imageCreateInfo.imageType = vk::ImageType::e2D;
+        imageCreateInfo.format = format;
+        imageCreateInfo.arrayLayers = 1;
+        // Resident levels are copied from one image to the next as finer levels arrive or get evicted
+        imageCreateInfo.usage = imageUsageFlags | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc;
+
+        // The mip tail is the coarsest levels whose total fits in the budget, but at least the smallest one.  The
+        // levels of a single layer texture are adjacent in gli's storage, so the tail is a single upload.
+        uint32_t tail = mipLevels - 1;
+        vk::DeviceSize tailSize = tex2D[tail].size();
+        while (tail > 0 && tailSize + tex2D[tail - 1].size() <= budget()) {
+            --tail;
+            tailSize += tex2D[tail].size();
+        }
+        vks::Image tailImage = createLevels(tail);
+        context.stageUpload(tailSize, tex2D[tail].data(), context.getImageStagingAlignment(),
+                            [&](const vk::CommandBuffer& copyCmd, const vk::Buffer& staging, vk::DeviceSize stagingOffset) {
+                                const vk::ImageSubresourceRange range{ vk::ImageAspectFlagBits::eColor, 0, mipLevels - tail, 0, 1 };
+                                std::vector<vk::BufferImageCopy> regions;
+                                vk::DeviceSize offset = stagingOffset;
+                                for (uint32_t level = tail; level < mipLevels; ++level) {
+                                    vk::BufferImageCopy region;
+                                    region.bufferOffset = offset;
+                                    region.imageSubresource = { vk::ImageAspectFlagBits::eColor, level - tail, 0, 1 };
+                                    region.imageExtent = levelExtent(level);
+                                    regions.push_back(region);
+                                    offset += tex2D[level].size();
+                                }
+                                context.setImageLayout(copyCmd, tailImage.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, range);
+                                copyCmd.copyBufferToImage(staging, tailImage.image, vk::ImageLayout::eTransferDstOptimal, regions);
+                                context.setImageLayout(copyCmd, tailImage.image, vk::ImageLayout::eTransferDstOptimal, imageLayout, range);
+                            });
+
+        // Create sampler.  The view takes care of the LOD clamping, so the sampler covers the whole mip chain.
+        vk::SamplerCreateInfo samplerCreateInfo;
+        samplerCreateInfo.magFilter = vk::Filter::eLinear;
+        samplerCreateInfo.minFilter = vk::Filter::eLinear;
+        samplerCreateInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
+        samplerCreateInfo.maxLod = static_cast<float>(mipLevels);
+        // Only enable anisotropic filtering if enabled on the devicec
+        samplerCreateInfo.maxAnisotropy = context.deviceFeatures.samplerAnisotropy ? context.deviceProperties.limits.maxSamplerAnisotropy : 1.0f;
+        samplerCreateInfo.anisotropyEnable = context.deviceFeatures.samplerAnisotropy;
+        samplerCreateInfo.borderColor = vk::BorderColor::eFloatOpaqueWhite;
+        vk::Sampler textureSampler = vks::acquireSampler(device, samplerCreateInfo);
+
+        static_cast<vks::Image&>(*this) = tailImage;
+        sampler = textureSampler;
+        residentBase = tail;
+        createView();
+
+        // The evictor only shares the eviction state, it may run on any thread allocating memory
+        eviction = std::make_shared<Eviction>();
+        eviction->heapIndex = context.allocator->getHeapIndex(*this);
+        eviction->finestLevelBytes = finestLevelBytes();
+        if (evictorId) {
+            context.allocator->removeEvictor(evictorId);
+        }
+        evictorId = context.allocator->addEvictor([state = eviction](uint32_t heapIndex, vk::DeviceSize) -> vk::DeviceSize {
+            if (heapIndex != state->heapIndex) {
+                return 0;
+            }
+            ++state->levels;
+            // The level after that is a quarter of the size
+            return state->finestLevelBytes.exchange(state->finestLevelBytes / 4);
         });
+    }
 
-        const gli::texture2d_array& tex2DArray = *texPtr;
+    /** @brief Finest mip level that should be resident, 0 for the full resolution.  Coarser requests evict levels on the next update() */
+    void request(uint32_t level) { requestedLevel = std::min(level, mipLevels - 1); }
 
-        extent.width = static_cast<uint32_t>(tex2DArray.extent().x);
-        extent.height = static_cast<uint32_t>(tex2DArray.extent().y);
-        extent.depth = 1;
-        layerCount = static_cast<uint32_t>(tex2DArray.layers());
-        mipLevels = static_cast<uint32_t>(tex2DArray.levels());
-
-        auto stagingBuffer = context.createStagingBuffer(tex2DArray);
-
-        // Setup buffer copy regions for each layer including all of it's miplevels
-        std::vector<vk::BufferImageCopy> bufferCopyRegions;
-        size_t offset = 0;
-        vk::BufferImageCopy bufferCopyRegion;
-        bufferCopyRegion.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-        bufferCopyRegion.imageSubresource.layerCount = 1;
-        bufferCopyRegion.imageExtent.depth = 1;
-        for (uint32_t layer = 0; layer < layerCount; layer++) {
-            for (uint32_t level = 0; level < mipLevels; level++) {
-                auto image = tex2DArray[layer][level];
-                auto imageExtent = image.extent();
-                bufferCopyRegion.imageSubresource.mipLevel = level;
-                bufferCopyRegion.imageSubresource.baseArrayLayer = layer;
-                bufferCopyRegion.imageExtent.width = static_cast<uint32_t>(imageExtent.x);
-                bufferCopyRegion.imageExtent.height = static_cast<uint32_t>(imageExtent.y);
-                bufferCopyRegion.bufferOffset = offset;
-                bufferCopyRegions.push_back(bufferCopyRegion);
-                // Increase offset into staging buffer for next level / face
-                offset += image.size();
+    /**
+        * Request the finest level that sampling reads with the whole texture covering `width` by `height` pixels on
+        * screen, the level at which a texel is no smaller than a pixel, shifted by `lodBias` if the shader adds one
+        * to the sampled LOD.  Magnified textures request level 0.
+        */
+    void requestForScreenSize(float width, float height, float lodBias = 0.0f) {
+        const float texelsPerPixel = std::max(extent.width / std::max(width, 1.0f), extent.height / std::max(height, 1.0f));
+        const float lod = std::log2(std::max(texelsPerPixel, 1.0f)) + lodBias;
+        request(static_cast<uint32_t>(std::max(0.0f, std::floor(lod))));
+    }
+
+    /** @brief Finest mip level in the image, which is level 0 of the view */
+    uint32_t residentLevel() const { return residentBase; }
+
+    bool isFullyResident() const { return residentBase == requestedLevel; }
+
+    /**
+        * Stream in the next part of the mip chain, or evict levels coarser than the requested one.  Call once per
+        * frame, before recording or submitting the frame's commands.
+        *
+        * @return true if the image and view were replaced, in which case `descriptor` must be rewritten into any
+        * descriptor sets using the texture
+        */
+    bool update() {
+        if (!source) {
+            return false;
+        }
+        const uint32_t evicted = eviction->levels.exchange(0);
+        if (evicted) {
+            requestedLevel = std::min(mipLevels - 1, std::max(requestedLevel, residentBase + evicted));
+        }
+        if (requestedLevel >= residentBase) {
+            // Whatever was being streamed is no longer wanted
+            if (next) {
+                context->trash(next);
+                next = vks::Image();
             }
+            if (requestedLevel == residentBase) {
+                return false;
+            }
+            vks::Image smaller = createLevels(requestedLevel);
+            context->recordUpload([&](const vk::CommandBuffer& copyCmd) {
+                const vk::ImageSubresourceRange range{ vk::ImageAspectFlagBits::eColor, 0, mipLevels - requestedLevel, 0, 1 };
+                context->setImageLayout(copyCmd, smaller.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, range);
+                copyResidentLevels(copyCmd, smaller, requestedLevel);
+                context->setImageLayout(copyCmd, smaller.image, vk::ImageLayout::eTransferDstOptimal, imageLayout, range);
+            });
+            replaceImage(smaller, requestedLevel);
+            return true;
         }
 
-        // Create optimal tiled target image
-        vk::ImageCreateInfo imageCreateInfo;
-        imageCreateInfo.imageType = vk::ImageType::e2D;
-        imageCreateInfo.format = format;
-        imageCreateInfo.extent = extent;
-        imageCreateInfo.usage = imageUsageFlags | vk::ImageUsageFlagBits::eTransferDst;
-        imageCreateInfo.arrayLayers = layerCount;
-        imageCreateInfo.mipLevels = mipLevels;
-        static_cast<vks::Image&>(*this) = context.createImage(imageCreateInfo);
+        const uint32_t level = residentBase - 1;
+        if (!next) {
+            vk::DeviceSize levelsBytes = 0;
+            for (uint32_t l = level; l < mipLevels; ++l) {
+                levelsBytes += (*source)[l].size();
+            }
+            if (!context->allocator->withinBudget(vk::MemoryPropertyFlagBits::eDeviceLocal, levelsBytes)) {
+                return false;
+            }
+            next = createLevels(level);
+            nextRows = 0;
+            // The resident levels won't change while the new level streams in, so they can be copied right away
+            context->recordUpload([&](const vk::CommandBuffer& copyCmd) {
+                const vk::ImageSubresourceRange range{ vk::ImageAspectFlagBits::eColor, 0, mipLevels - level, 0, 1 };
+                context->setImageLayout(copyCmd, next.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, range);
+                copyResidentLevels(copyCmd, next, level);
+            });
+        }
+
+        // Levels are streamed in rows of blocks, as many as the budget allows but at least one
+        const auto& mip = (*source)[level];
+        const vk::Extent3D mipExtent = levelExtent(level);
+        const uint32_t blockHeight = static_cast<uint32_t>(gli::block_extent(source->format()).y);
+        const uint32_t rowCount = (mipExtent.height + blockHeight - 1) / blockHeight;
+        const vk::DeviceSize rowSize = mip.size() / rowCount;
+        const uint32_t rows = std::min(rowCount - nextRows, std::max(1u, static_cast<uint32_t>(budget() / rowSize)));
+        context->stageUpload(rows * rowSize, static_cast<const uint8_t*>(mip.data()) + nextRows * rowSize, context->getImageStagingAlignment(),
+                             [&](const vk::CommandBuffer& copyCmd, const vk::Buffer& staging, vk::DeviceSize stagingOffset) {
+                                 const uint32_t top = nextRows * blockHeight;
+                                 vk::BufferImageCopy region;
+                                 region.bufferOffset = stagingOffset;
+                                 region.imageSubresource = { vk::ImageAspectFlagBits::eColor, 0, 0, 1 };
+                                 region.imageOffset = vk::Offset3D{ 0, (int32_t)top, 0 };
+                                 region.imageExtent = vk::Extent3D{ mipExtent.width, std::min(rows * blockHeight, mipExtent.height - top), 1 };
+                                 copyCmd.copyBufferToImage(staging, next.image, vk::ImageLayout::eTransferDstOptimal, region);
+                             });
+        nextRows += rows;
+        if (nextRows < rowCount) {
+            return false;
+        }
 
-        vk::ImageSubresourceRange subresourceRange;
-        subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-        subresourceRange.levelCount = mipLevels;
-        subresourceRange.layerCount = layerCount;
-
-        // Use a separate command buffer for texture loading
-        context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& copyCmd) {
-            // Image barrier for optimal image (target)
-            // Set initial layout for all array layers (faces) of the optimal (target) tiled texture
-            context.setImageLayout(copyCmd, image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, subresourceRange);
-            // Copy the layers and mip levels from the staging buffer to the optimal tiled image
-            copyCmd.copyBufferToImage(stagingBuffer.buffer, image, vk::ImageLayout::eTransferDstOptimal, bufferCopyRegions);
-            // Change texture image layout to shader read after all faces have been copied
-            context.setImageLayout(copyCmd, image, vk::ImageLayout::eTransferDstOptimal, imageLayout, subresourceRange);
+        context->recordUpload([&](const vk::CommandBuffer& copyCmd) {
+            const vk::ImageSubresourceRange range{ vk::ImageAspectFlagBits::eColor, 0, mipLevels - level, 0, 1 };
+            context->setImageLayout(copyCmd, next.image, vk::ImageLayout::eTransferDstOptimal, imageLayout, range);
         });
+        replaceImage(next, level);
+        next = vks::Image();
+        return true;
+    }
+
+    /** @brief Release all Vulkan resources held by this texture */
+    void destroy() override {
+        if (evictorId) {
+            context->allocator->removeEvictor(evictorId);
+            evictorId = 0;
+        }
+        eviction.reset();
+        next.destroy();
+        source.reset();
+        Parent::destroy();
+    }
+
+private:
+    vk::DeviceSize budget() const { return static_cast<vk::DeviceSize>(budgetMB * 1024.0f * 1024.0f); }
+
+    vk::Extent3D levelExtent(uint32_t level) const {
+        const auto dims = (*source)[level].extent();
+        return vk::Extent3D{ (uint32_t)dims.x, (uint32_t)dims.y, 1 };
+    }
+
+    // What giving up the finest resident level would release, nothing once only the coarsest level is left
+    vk::DeviceSize finestLevelBytes() const { return residentBase + 1 < mipLevels ? (*source)[residentBase].size() : 0; }
+
+    // An image holding mip `level` and everything coarser
+    vks::Image createLevels(uint32_t level) const {
+        Allocator::ScopedTag tag("textures");
+        vk::ImageCreateInfo createInfo = imageCreateInfo;
+        createInfo.extent = levelExtent(level);
+        createInfo.mipLevels = mipLevels - level;
+        return context->createImage(createInfo);
+    }
+
+    // Copy every resident level that `target`, starting at mip `targetLevel`, also holds.  `target` must be in
+    // transfer destination layout.
+    void copyResidentLevels(const vk::CommandBuffer& copyCmd, const vks::Image& target, uint32_t targetLevel) const {
+        const uint32_t first = std::max(residentBase, targetLevel);
+        std::vector<vk::ImageCopy> regions;
+        for (uint32_t level = first; level < mipLevels; ++level) {
+            vk::ImageCopy region;
+            region.srcSubresource = { vk::ImageAspectFlagBits::eColor, level - residentBase, 0, 1 };
+            region.dstSubresource = { vk::ImageAspectFlagBits::eColor, level - targetLevel, 0, 1 };
+            region.extent = levelExtent(level);
+            regions.push_back(region);
+        }
+        const vk::ImageSubresourceRange range{ vk::ImageAspectFlagBits::eColor, first - residentBase, mipLevels - first, 0, 1 };
+        context->setImageLayout(copyCmd, image, imageLayout, vk::ImageLayout::eTransferSrcOptimal, range);
+        copyCmd.copyImage(image, vk::ImageLayout::eTransferSrcOptimal, target.image, vk::ImageLayout::eTransferDstOptimal, regions);
+        context->setImageLayout(copyCmd, image, vk::ImageLayout::eTransferSrcOptimal, imageLayout, range);
+    }
+
+    // Frames still in flight may sample the old image, so it goes through the deferred deletion.  The sampler is kept.
+    void replaceImage(const vks::Image& replacement, uint32_t level) {
+        vks::Image previous = static_cast<vks::Image&>(*this);
+        previous.sampler = vk::Sampler();
+        context->trash(previous);
+        const vk::Sampler textureSampler = sampler;
+        static_cast<vks::Image&>(*this) = replacement;
+        sampler = textureSampler;
+        residentBase = level;
+        eviction->finestLevelBytes = finestLevelBytes();
+        createView();
+    }
+
+    void createView() {
+        vk::ImageViewCreateInfo viewCreateInfo;
+        viewCreateInfo.viewType = vk::ImageViewType::e2D;
+        viewCreateInfo.image = image;
+        viewCreateInfo.format = imageCreateInfo.format;
+        viewCreateInfo.subresourceRange = { vk::ImageAspectFlagBits::eColor, 0, mipLevels - residentBase, 0, 1 };
+        view = device.createImageView(viewCreateInfo);
+        updateDescriptor();
+    }
 
-        // Clean up staging resources
-        stagingBuffer.destroy();
+    const vks::Context* context{ nullptr };
+    std::shared_ptr<const gli::texture2d> source;
+    vk::ImageCreateInfo imageCreateInfo;
+    // Mip level of the file that is level 0 of `image`
+    uint32_t residentBase{ 0 };
+    uint32_t requestedLevel{ 0 };
+    // The image the next finer level is being streamed into, and how many block rows of it have been uploaded
+    vks::Image next;
+    uint32_t nextRows{ 0 };
+
+    // Set by the evictor, levels to give up on the next update()
+    struct Eviction {
+        uint32_t heapIndex{ 0 };
+        std::atomic<uint32_t> levels{ 0 };
+        std::atomic<vk::DeviceSize> finestLevelBytes{ 0 };
+    };
+    std::shared_ptr<Eviction> eviction;
+    uint32_t evictorId{ 0 };
+};
+
+/** @brief 2D array texture */
+class Texture2DArray : public Texture {
+public:
+    /**
+        * Load a 2D texture array including all mip levels
+        *
+        * @param filename File to load (supports .ktx, .dds and the supercompressed .ktx2 and .basis)
+        * @param format Vulkan format of the image data stored in the file, ignored for .ktx2 and .basis files, which are transcoded to basisTranscodeFormat
+        * @param device Vulkan device to create the texture on
+        * @param copyQueue Queue used for the texture staging copy commands (must support transfer)
+        * @param (Optional) imageUsageFlags Usage flags for the texture's image (defaults to VK_IMAGE_USAGE_SAMPLED_BIT)
+        * @param (Optional) imageLayout Usage layout for the texture (defaults VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+        *
+        */
+    void loadFromFile(const vks::Context& context,
+                      std::string filename,
+                      vk::Format format,
+                      vk::ImageUsageFlags imageUsageFlags = vk::ImageUsageFlagBits::eSampled,
+                      vk::ImageLayout imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal) {
+        VKS_TRACE_ZONE("Texture2DArray::loadFromFile");
+        startup::ScopedPhase startupPhase(startup::Phase::Decode);
+        Allocator::ScopedTag tag("textures");
+        device = context.device;
+        bindless = context.bindless;
+        this->imageLayout = imageLayout;
+        descriptor.imageLayout = imageLayout;
+
+        // Every file is uploaded with one copy, staging its layers in parallel
+        const auto direct = [](const KtxLayout& ktx) { return ktx.faces == 1; };
+        stageFile(context, filename, format, direct, [&](const KtxLayout& layout) {
+            extent = layout.extent(0);
+            layerCount = layout.layers * layout.faces;
+            mipLevels = layout.levels;
+
+            // Create optimal tiled target image
+            vk::ImageCreateInfo imageCreateInfo;
+            imageCreateInfo.imageType = vk::ImageType::e2D;
+            imageCreateInfo.format = format;
+            imageCreateInfo.extent = extent;
+            imageCreateInfo.usage = imageUsageFlags | vk::ImageUsageFlagBits::eTransferDst;
+            imageCreateInfo.arrayLayers = layerCount;
+            imageCreateInfo.mipLevels = mipLevels;
+            static_cast<vks::Image&>(*this) = context.createImage(imageCreateInfo);
+            return vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, mipLevels, 0, layerCount };
+        });
 
         // Create sampler
         vk::SamplerCreateInfo samplerCreateInfo;
@@ -319,7 +759,7 @@ public:
         samplerCreateInfo.maxAnisotropy = context.deviceFeatures.samplerAnisotropy ? context.deviceProperties.limits.maxSamplerAnisotropy : 1.0f;
         samplerCreateInfo.maxLod = static_cast<float>(mipLevels);
         samplerCreateInfo.borderColor = vk::BorderColor::eFloatOpaqueWhite;
-        sampler = context.device.createSampler(samplerCreateInfo);
+        sampler = vks::acquireSampler(context.device, samplerCreateInfo);
 
         // Create image view
         vk::ImageViewCreateInfo viewCreateInfo;
@@ -340,8 +780,8 @@ public:
     /**
         * Load a cubemap texture including all mip levels from a single file
         *
-        * @param filename File to load (supports .ktx and .dds)
-        * @param format Vulkan format of the image data stored in the file
+        * @param filename File to load (supports .ktx, .dds and the supercompressed .ktx2 and .basis)
+        * @param format Vulkan format of the image data stored in the file, ignored for .ktx2 and .basis files, which are transcoded to basisTranscodeFormat
         * @param device Vulkan device to create the texture on
         * @param copyQueue Queue used for the texture staging copy commands (must support transfer)
         * @param (Optional) imageUsageFlags Usage flags for the texture's image (defaults to VK_IMAGE_USAGE_SAMPLED_BIT)
@@ -353,69 +793,37 @@ public:
                       vk::Format format,
                       vk::ImageUsageFlags imageUsageFlags = vk::ImageUsageFlagBits::eSampled,
                       vk::ImageLayout imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal) {
+        VKS_TRACE_ZONE("TextureCubeMap::loadFromFile");
+        startup::ScopedPhase startupPhase(startup::Phase::Decode);
+        Allocator::ScopedTag tag("textures");
         device = context.device;
+        bindless = context.bindless;
         this->imageLayout = imageLayout;
         descriptor.imageLayout = imageLayout;
 
-        std::shared_ptr<const gli::texture_cube> texPtr;
-        vks::file::withBinaryFileContents(filename, [&](size_t size, const void* data) {
-            texPtr = std::make_shared<const gli::texture_cube>(gli::load(static_cast<const char*>(data), size));
-        });
-        const auto& texCube = *texPtr;
-        assert(!texCube.empty());
-
-        extent.width = static_cast<uint32_t>(texCube.extent().x);
-        extent.height = static_cast<uint32_t>(texCube.extent().y);
-        extent.depth = 1;
-        mipLevels = static_cast<uint32_t>(texCube.levels());
-        auto stagingBuffer = context.createStagingBuffer(texCube);
-
-        // Setup buffer copy regions for each face including all of it's miplevels
-        std::vector<vk::BufferImageCopy> bufferCopyRegions;
-        size_t offset = 0;
-        vk::BufferImageCopy bufferImageCopy;
-        bufferImageCopy.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-        bufferImageCopy.imageSubresource.layerCount = 1;
-        bufferImageCopy.imageExtent.depth = 1;
-        for (uint32_t face = 0; face < 6; face++) {
-            for (uint32_t level = 0; level < mipLevels; level++) {
-                auto image = (texCube)[face][level];
-                auto imageExtent = image.extent();
-                bufferImageCopy.bufferOffset = offset;
-                bufferImageCopy.imageSubresource.mipLevel = level;
-                bufferImageCopy.imageSubresource.baseArrayLayer = face;
-                bufferImageCopy.imageExtent.width = static_cast<uint32_t>(imageExtent.x);
-                bufferImageCopy.imageExtent.height = static_cast<uint32_t>(imageExtent.y);
-                bufferCopyRegions.push_back(bufferImageCopy);
-                // Increase offset into staging buffer for next level / face
-                offset += image.size();
+        // Every file is uploaded with one copy, staging its faces in parallel
+        const auto direct = [](const KtxLayout& ktx) { return ktx.faces == 6 && ktx.layers == 1; };
+        stageFile(context, filename, format, direct, [&](const KtxLayout& layout) {
+            if (layout.faces != 6 || layout.layers != 1) {
+                throw std::runtime_error(filename + " is not a cube map");
             }
-        }
-
-        // Create optimal tiled target image
-        vk::ImageCreateInfo imageCreateInfo;
-        imageCreateInfo.imageType = vk::ImageType::e2D;
-        imageCreateInfo.format = format;
-        imageCreateInfo.mipLevels = mipLevels;
-        imageCreateInfo.extent = extent;
-        // Cube faces count as array layers in Vulkan
-        imageCreateInfo.arrayLayers = 6;
-        // Ensure that the TRANSFER_DST bit is set for staging
-        imageCreateInfo.usage = imageUsageFlags | vk::ImageUsageFlagBits::eTransferDst;
-        // This flag is required for cube map images
-        imageCreateInfo.flags = vk::ImageCreateFlagBits::eCubeCompatible;
-        static_cast<vks::Image&>(*this) = context.createImage(imageCreateInfo);
-
-        context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& copyCmd) {
-            // Image barrier for optimal image (target)
-            // Set initial layout for all array layers (faces) of the optimal (target) tiled texture
-            vk::ImageSubresourceRange subresourceRange{ vk::ImageAspectFlagBits::eColor, 0, mipLevels, 0, 6 };
-            context.setImageLayout(copyCmd, image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, subresourceRange);
-            // Copy the cube map faces from the staging buffer to the optimal tiled image
-            copyCmd.copyBufferToImage(stagingBuffer.buffer, image, vk::ImageLayout::eTransferDstOptimal, bufferCopyRegions);
-            // Change texture image layout to shader read after all faces have been copied
-            this->imageLayout = imageLayout;
-            context.setImageLayout(copyCmd, image, vk::ImageLayout::eTransferDstOptimal, imageLayout, subresourceRange);
+            extent = layout.extent(0);
+            mipLevels = layout.levels;
+
+            // Create optimal tiled target image
+            vk::ImageCreateInfo imageCreateInfo;
+            imageCreateInfo.imageType = vk::ImageType::e2D;
+            imageCreateInfo.format = format;
+            imageCreateInfo.mipLevels = mipLevels;
+            imageCreateInfo.extent = extent;
+            // Cube faces count as array layers in Vulkan
+            imageCreateInfo.arrayLayers = 6;
+            // Ensure that the TRANSFER_DST bit is set for staging
+            imageCreateInfo.usage = imageUsageFlags | vk::ImageUsageFlagBits::eTransferDst;
+            // This flag is required for cube map images
+            imageCreateInfo.flags = vk::ImageCreateFlagBits::eCubeCompatible;
+            static_cast<vks::Image&>(*this) = context.createImage(imageCreateInfo);
+            return vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, mipLevels, 0, 6 };
         });
 
         // Create sampler
@@ -433,7 +841,7 @@ public:
         samplerCreateInfo.maxAnisotropy = context.deviceFeatures.samplerAnisotropy ? context.deviceProperties.limits.maxSamplerAnisotropy : 1.0f;
         samplerCreateInfo.anisotropyEnable = context.deviceFeatures.samplerAnisotropy;
         samplerCreateInfo.borderColor = vk::BorderColor::eFloatOpaqueWhite;
-        sampler = device.createSampler(samplerCreateInfo);
+        sampler = vks::acquireSampler(device, samplerCreateInfo);
 
         // Create image view
         // Textures are not directly accessed by the shaders and
@@ -445,7 +853,6 @@ public:
                                                                format,
                                                                {},
                                                                vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, mipLevels, 0, 6 } });
-        stagingBuffer.destroy();
 
         // Update descriptor image info member that can be used for setting up descriptor sets
         updateDescriptor();
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace vks {
+
+// A fixed size pool of worker threads servicing a single FIFO queue of jobs.
+//
+// Intended for coarse grained, mostly blocking work such as file I/O, where the
+// number of threads should be bounded independently of the number of requests.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threadCount = defaultThreadCount()) {
+        threadCount = std::max<size_t>(1, threadCount);
+        workers.reserve(threadCount);
+        for (size_t i = 0; i < threadCount; ++i) {
+            workers.emplace_back([this] { run(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Queue `f` for execution on a worker and return a future for its result.  Exceptions
+    // thrown by `f` are rethrown from the future.
+    template <typename F>
+    auto submit(F&& f) -> std::future<decltype(f())> {
+        using Result = decltype(f());
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(f));
+        auto result = task->get_future();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobs.push([task] { (*task)(); });
+        }
+        condition.notify_one();
+        return result;
+    }
+
+    size_t size() const { return workers.size(); }
+
+    static size_t defaultThreadCount() { return std::max<size_t>(1, std::thread::hardware_concurrency()); }
+
+private:
+    void run() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty()) {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop();
+            }
+            job();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping{ false };
+};
+
+}  // namespace vks
@@ -0,0 +1,166 @@
+#include "trace.hpp"
+
+#if defined(VKS_TRACE)
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// Bounds the memory of long captures, zones past it are dropped
+const size_t MAX_EVENTS = 1 << 22;
+// The thread id of the GPU track, out of the way of the small ids given to threads
+const uint32_t GPU_THREAD = 1000000;
+
+struct Event {
+    // Either a name from the zone, or for GPU zones an index into Capture::gpuNames
+    const char* name;
+    uint32_t gpuName;
+    uint32_t thread;
+    int64_t begin;
+    int64_t end;
+};
+
+struct Capture {
+    std::mutex mutex;
+    std::atomic<bool> active{ false };
+    std::vector<Event> events;
+    std::vector<std::string> gpuNames;
+    std::vector<std::pair<uint32_t, std::string>> threadNames;
+    std::vector<int64_t> frames;
+};
+
+Capture& capture() {
+    static Capture instance;
+    return instance;
+}
+
+uint32_t threadId() {
+    static std::atomic<uint32_t> nextId{ 1 };
+    static thread_local uint32_t id = nextId++;
+    return id;
+}
+
+void writeString(std::ostream& out, const char* value) {
+    out << '"';
+    for (const char* c = value; *c; ++c) {
+        switch (*c) {
+            case '"':
+                out << "\\\"";
+                break;
+            case '\\':
+                out << "\\\\";
+                break;
+            default:
+                if ((unsigned char)*c < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned)*c);
+                    out << escaped;
+                } else {
+                    out << *c;
+                }
+        }
+    }
+    out << '"';
+}
+
+// trace_event times are microseconds
+void writeMicroseconds(std::ostream& out, int64_t nanoseconds) {
+    char value[32];
+    snprintf(value, sizeof(value), "%.3f", (double)nanoseconds / 1000.0);
+    out << value;
+}
+
+}  // namespace
+
+void vks::trace::beginCapture() {
+    auto& state = capture();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.events.clear();
+    state.gpuNames.clear();
+    state.frames.clear();
+    state.active = true;
+}
+
+bool vks::trace::capturing() {
+    return capture().active.load(std::memory_order_relaxed);
+}
+
+void vks::trace::recordZone(const char* name, int64_t begin, int64_t end) {
+    auto& state = capture();
+    const uint32_t thread = threadId();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.active && state.events.size() < MAX_EVENTS) {
+        state.events.push_back({ name, 0, thread, begin, end });
+    }
+}
+
+void vks::trace::recordGpuZone(const std::string& name, int64_t begin, int64_t end) {
+    auto& state = capture();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.active && state.events.size() < MAX_EVENTS) {
+        state.events.push_back({ nullptr, (uint32_t)state.gpuNames.size(), GPU_THREAD, begin, end });
+        state.gpuNames.push_back(name);
+    }
+}
+
+void vks::trace::setThreadName(const std::string& name) {
+    auto& state = capture();
+    const uint32_t thread = threadId();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.threadNames.emplace_back(thread, name);
+}
+
+void vks::trace::markFrame() {
+    auto& state = capture();
+    if (!state.active) {
+        return;
+    }
+    const int64_t time = now();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.frames.size() < MAX_EVENTS) {
+        state.frames.push_back(time);
+    }
+}
+
+bool vks::trace::endCapture(const std::string& filename) {
+    auto& state = capture();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.active = false;
+
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << GPU_THREAD << ",\"name\":\"thread_name\",\"args\":{\"name\":\"GPU\"}}";
+    for (const auto& thread : state.threadNames) {
+        out << ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":" << thread.first << ",\"name\":\"thread_name\",\"args\":{\"name\":";
+        writeString(out, thread.second.c_str());
+        out << "}}";
+    }
+    for (const auto& event : state.events) {
+        out << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread << ",\"name\":";
+        writeString(out, event.name ? event.name : state.gpuNames[event.gpuName].c_str());
+        out << ",\"ts\":";
+        writeMicroseconds(out, event.begin);
+        out << ",\"dur\":";
+        writeMicroseconds(out, event.end - event.begin);
+        out << "}";
+    }
+    for (int64_t frame : state.frames) {
+        out << ",\n{\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"name\":\"frame\",\"ts\":";
+        writeMicroseconds(out, frame);
+        out << "}";
+    }
+    out << "\n]}\n";
+    state.events.clear();
+    state.gpuNames.clear();
+    state.frames.clear();
+    return (bool)out;
+}
+
+#endif
@@ -0,0 +1,89 @@
+/*
+* CPU trace zones
+*
+* Scoped zones for telling where the CPU time of a frame goes, compiled out entirely unless the build defines
+* VKS_TRACE (the VKS_TRACE CMake option).  With VKS_TRACE_TRACY as well, zones are Tracy zones; otherwise they are
+* collected between beginCapture and endCapture and written as a Chrome trace_event JSON file, which chrome://tracing
+* and Perfetto open.
+*
+*   void load() {
+*       VKS_TRACE_ZONE("load");
+*       ...
+*   }
+*
+* Zone names must be string literals.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(VKS_TRACE_TRACY)
+#include <tracy/Tracy.hpp>
+#endif
+
+namespace vks { namespace trace {
+
+// Nanoseconds on the clock zones are timed with.  std::chrono::steady_clock is CLOCK_MONOTONIC on Linux and Android
+// and QueryPerformanceCounter on Windows, which are the CPU time domains of VK_EXT_calibrated_timestamps, so GPU
+// timestamps can be placed on the same timeline, see vks::debug::TimestampCalibration.
+inline int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#if defined(VKS_TRACE)
+// Start collecting zones for a Chrome trace, dropping any collected before
+void beginCapture();
+bool capturing();
+// Write the zones collected since beginCapture to `filename` and stop collecting.  Returns false if the file
+// couldn't be written.
+bool endCapture(const std::string& filename);
+
+// Zones run from `begin` to `end` on the clock of now().  CPU zones are on the thread recording them, `name` must
+// outlive the capture.
+void recordZone(const char* name, int64_t begin, int64_t end);
+// A zone on the track of the GPU queue, with the times already mapped to the CPU clock
+void recordGpuZone(const std::string& name, int64_t begin, int64_t end);
+// Named in the trace, for the calling thread
+void setThreadName(const std::string& name);
+// An instant event at the start of every frame
+void markFrame();
+
+class Zone {
+public:
+    explicit Zone(const char* name)
+        : name(name)
+        , begin(capturing() ? now() : -1) {}
+    ~Zone() {
+        if (begin >= 0) {
+            recordZone(name, begin, now());
+        }
+    }
+
+    Zone(const Zone&) = delete;
+    Zone& operator=(const Zone&) = delete;
+
+private:
+    const char* name;
+    int64_t begin;
+};
+#endif
+
+}}  // namespace vks::trace
+
+#if defined(VKS_TRACE) && defined(VKS_TRACE_TRACY)
+#define VKS_TRACE_ZONE(name) ZoneScopedN(name)
+#define VKS_TRACE_FRAME() FrameMark
+#elif defined(VKS_TRACE)
+#define VKS_TRACE_CONCAT_(a, b) a##b
+#define VKS_TRACE_CONCAT(a, b) VKS_TRACE_CONCAT_(a, b)
+#define VKS_TRACE_ZONE(name) ::vks::trace::Zone VKS_TRACE_CONCAT(vksTraceZone, __LINE__)(name)
+#define VKS_TRACE_FRAME() ::vks::trace::markFrame()
+#else
+#define VKS_TRACE_ZONE(name) ((void)0)
+#define VKS_TRACE_FRAME() ((void)0)
+#endif
@@ -0,0 +1,167 @@
+#include "transforms.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "scheduler.hpp"
+
+using namespace vks;
+
+namespace {
+
+glm::mat4 compose(const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale) {
+    const glm::mat3 basis = glm::mat3_cast(rotation);
+    glm::mat4 result;
+    result[0] = glm::vec4(basis[0] * scale.x, 0.0f);
+    result[1] = glm::vec4(basis[1] * scale.y, 0.0f);
+    result[2] = glm::vec4(basis[2] * scale.z, 0.0f);
+    result[3] = glm::vec4(translation, 1.0f);
+    return result;
+}
+
+}  // namespace
+
+uint32_t TransformHierarchy::add(int32_t parent, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale) {
+    const uint32_t node = static_cast<uint32_t>(parents.size());
+    if (parent >= static_cast<int32_t>(node) || parent < -1) {
+        throw std::runtime_error("Transform parent must be added before its children");
+    }
+    parents.push_back(parent);
+    translations.push_back(translation);
+    rotations.push_back(rotation);
+    scales.push_back(scale);
+    worlds.emplace_back(1.0f);
+    dirty.push_back(1);
+    anyDirty = true;
+    levelsValid = false;
+    return node;
+}
+
+void TransformHierarchy::clear() {
+    parents.clear();
+    translations.clear();
+    rotations.clear();
+    scales.clear();
+    worlds.clear();
+    dirty.clear();
+    levelOrder.clear();
+    levelStarts.clear();
+    anyDirty = false;
+    levelsValid = true;
+}
+
+void TransformHierarchy::reserve(size_t count) {
+    parents.reserve(count);
+    translations.reserve(count);
+    rotations.reserve(count);
+    scales.reserve(count);
+    worlds.reserve(count);
+    dirty.reserve(count);
+}
+
+void TransformHierarchy::markDirty(uint32_t node) {
+    dirty[node] = 1;
+    anyDirty = true;
+}
+
+void TransformHierarchy::setTranslation(uint32_t node, const glm::vec3& translation) {
+    translations[node] = translation;
+    markDirty(node);
+}
+
+void TransformHierarchy::setRotation(uint32_t node, const glm::quat& rotation) {
+    rotations[node] = rotation;
+    markDirty(node);
+}
+
+void TransformHierarchy::setScale(uint32_t node, const glm::vec3& scale) {
+    scales[node] = scale;
+    markDirty(node);
+}
+
+void TransformHierarchy::setLocal(uint32_t node, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale) {
+    translations[node] = translation;
+    rotations[node] = rotation;
+    scales[node] = scale;
+    markDirty(node);
+}
+
+void TransformHierarchy::buildLevels() {
+    // Counting sort of the nodes by depth, which keeps them in index order within a depth
+    const size_t count = parents.size();
+    std::vector<uint32_t> depths(count);
+    uint32_t maxDepth = 0;
+    for (size_t i = 0; i < count; ++i) {
+        depths[i] = parents[i] < 0 ? 0 : depths[parents[i]] + 1;
+        maxDepth = std::max(maxDepth, depths[i]);
+    }
+    levelStarts.assign(count ? maxDepth + 2 : 1, 0);
+    for (size_t i = 0; i < count; ++i) {
+        ++levelStarts[depths[i] + 1];
+    }
+    for (size_t level = 1; level < levelStarts.size(); ++level) {
+        levelStarts[level] += levelStarts[level - 1];
+    }
+    std::vector<uint32_t> heads(levelStarts.begin(), levelStarts.end() - 1);
+    levelOrder.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        levelOrder[heads[depths[i]]++] = static_cast<uint32_t>(i);
+    }
+    levelsValid = true;
+}
+
+size_t TransformHierarchy::update(TaskScheduler* scheduler, size_t grainSize) {
+    return update(scheduler, nullptr, 0, grainSize);
+}
+
+size_t TransformHierarchy::update(TaskScheduler* scheduler, void* destination, size_t stride, size_t grainSize) {
+    const size_t count = parents.size();
+    if (!anyDirty && !destination) {
+        return 0;
+    }
+    if (!levelsValid) {
+        buildLevels();
+    }
+
+    // Parents come first, so one pass carries their dirty flags down to every descendant
+    size_t recomputed = 0;
+    if (anyDirty) {
+        for (size_t i = 0; i < count; ++i) {
+            const int32_t parent = parents[i];
+            if (parent >= 0) {
+                dirty[i] |= dirty[parent];
+            }
+            recomputed += dirty[i];
+        }
+    }
+
+    uint8_t* output = static_cast<uint8_t*>(destination);
+    auto updateRange = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const uint32_t node = levelOrder[i];
+            if (dirty[node]) {
+                const glm::mat4 local = compose(translations[node], rotations[node], scales[node]);
+                const int32_t parent = parents[node];
+                worlds[node] = parent < 0 ? local : worlds[parent] * local;
+                dirty[node] = 0;
+            }
+            if (output) {
+                memcpy(output + node * stride, &worlds[node], sizeof(glm::mat4));
+            }
+        }
+    };
+
+    grainSize = std::max<size_t>(grainSize, 1);
+    for (size_t level = 0; level + 1 < levelStarts.size(); ++level) {
+        const size_t begin = levelStarts[level];
+        const size_t end = levelStarts[level + 1];
+        if (scheduler && end - begin > grainSize) {
+            scheduler->parallelFor(begin, end, grainSize, updateRange);
+        } else {
+            updateRange(begin, end);
+        }
+    }
+    anyDirty = false;
+    return recomputed;
+}
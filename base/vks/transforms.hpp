@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace vks {
+class TaskScheduler;
+
+// Object transforms kept as parallel arrays of the translation, rotation and scale of every node, with the index of
+// its parent, rather than a matrix per object rebuilt from scratch every frame.
+//
+// Nodes are added after their parent, so the indices are a topological order and marking the descendants of changed
+// nodes dirty is a single pass.  World matrices are then only recomputed for dirty nodes, one depth of the hierarchy
+// at a time, each depth split into batches over a scheduler, and can be written straight into mapped memory such as
+// a region of the frame allocator.
+class TransformHierarchy {
+public:
+    // -1 for a root
+    uint32_t add(int32_t parent = -1,
+                 const glm::vec3& translation = glm::vec3(0.0f),
+                 const glm::quat& rotation = glm::quat(),
+                 const glm::vec3& scale = glm::vec3(1.0f));
+    void clear();
+    void reserve(size_t count);
+
+    void setTranslation(uint32_t node, const glm::vec3& translation);
+    void setRotation(uint32_t node, const glm::quat& rotation);
+    void setScale(uint32_t node, const glm::vec3& scale);
+    void setLocal(uint32_t node, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale);
+
+    int32_t parent(uint32_t node) const { return parents[node]; }
+    const glm::vec3& translation(uint32_t node) const { return translations[node]; }
+    const glm::quat& rotation(uint32_t node) const { return rotations[node]; }
+    const glm::vec3& scale(uint32_t node) const { return scales[node]; }
+
+    // Recompute the world matrices of the nodes changed since the last update and of their descendants.  Without a
+    // scheduler, or for depths of fewer than `grainSize` nodes, this runs on the calling thread.  Returns the number of
+    // matrices recomputed.
+    size_t update(TaskScheduler* scheduler = nullptr, size_t grainSize = 256);
+    // The same, also writing the world matrix of every node, changed or not, to `destination` + node * `stride`
+    size_t update(TaskScheduler* scheduler, void* destination, size_t stride, size_t grainSize = 256);
+
+    // As of the last update
+    const glm::mat4& world(uint32_t node) const { return worlds[node]; }
+    const std::vector<glm::mat4>& worldMatrices() const { return worlds; }
+
+    size_t size() const { return parents.size(); }
+    bool empty() const { return parents.empty(); }
+
+private:
+    void markDirty(uint32_t node);
+    void buildLevels();
+
+    std::vector<int32_t> parents;
+    std::vector<glm::vec3> translations;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+    std::vector<glm::mat4> worlds;
+    // Bytes rather than std::vector<bool>, so that batches can clear them from several threads
+    std::vector<uint8_t> dirty;
+    bool anyDirty{ false };
+    // Nodes by depth, in index order within a depth, and where each depth starts in levelOrder
+    std::vector<uint32_t> levelOrder;
+    std::vector<uint32_t> levelStarts;
+    bool levelsValid{ true };
+};
+
+}  // namespace vks
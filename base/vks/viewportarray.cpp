@@ -0,0 +1,154 @@
+#include "viewportarray.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "context.hpp"
+
+using namespace vks;
+
+bool ViewportArray::layeredSupported(const vks::Context& context) {
+    return context.shaderViewportIndexLayerEnabled && context.enabledFeatures.multiViewport;
+}
+
+void ViewportArray::create(const vks::Context& context,
+                           uint32_t maxInstances,
+                           uint32_t indexCount,
+                           uint32_t firstIndex,
+                           int32_t vertexOffset,
+                           bool layered) {
+    if (layered && !layeredSupported(context)) {
+        throw std::runtime_error("Layered viewport draws need VK_EXT_shader_viewport_index_layer and the multiViewport feature");
+    }
+    device = context.device;
+    capacity = std::max(maxInstances, 1u);
+    layeredDraws = layered;
+    mesh = vk::DrawIndexedIndirectCommand{ indexCount, 0, firstIndex, vertexOffset, 0 };
+
+    const vk::MemoryPropertyFlags hostMemory = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    viewBuffer = context.createBuffer(vk::BufferUsageFlagBits::eUniformBuffer, hostMemory, sizeof(ViewData) * MAX_VIEWS);
+    modelBuffer = context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer, hostMemory, sizeof(glm::mat4) * capacity);
+    // Every view can see every instance
+    entryBuffer = context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer, hostMemory, sizeof(glm::uvec2) * capacity * MAX_VIEWS);
+    commands = context.createBuffer(vk::BufferUsageFlagBits::eIndirectBuffer, hostMemory, sizeof(vk::DrawIndexedIndirectCommand) * MAX_VIEWS);
+    for (auto* buffer : { &viewBuffer, &modelBuffer, &entryBuffer, &commands }) {
+        buffer->map();
+        memset(buffer->mapped, 0, buffer->size);
+    }
+
+    std::vector<vk::DescriptorSetLayoutBinding> bindings{
+        { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+        { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+        { 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+    };
+    setLayout = device.createDescriptorSetLayout({ {}, (uint32_t)bindings.size(), bindings.data() });
+    std::vector<vk::DescriptorPoolSize> poolSizes{
+        { vk::DescriptorType::eUniformBuffer, 1 },
+        { vk::DescriptorType::eStorageBuffer, 2 },
+    };
+    descriptorPool = device.createDescriptorPool({ {}, 1, (uint32_t)poolSizes.size(), poolSizes.data() });
+    set = device.allocateDescriptorSets({ descriptorPool, 1, &setLayout })[0];
+    std::vector<vk::WriteDescriptorSet> writes{
+        { set, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &viewBuffer.descriptor },
+        { set, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &modelBuffer.descriptor },
+        { set, 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &entryBuffer.descriptor },
+    };
+    device.updateDescriptorSets(writes, nullptr);
+}
+
+void ViewportArray::destroy() {
+    if (!device) {
+        return;
+    }
+    device.destroyDescriptorPool(descriptorPool);
+    device.destroyDescriptorSetLayout(setLayout);
+    viewBuffer.destroy();
+    modelBuffer.destroy();
+    entryBuffer.destroy();
+    commands.destroy();
+    counts.clear();
+    visible.clear();
+    descriptorPool = nullptr;
+    setLayout = nullptr;
+    set = nullptr;
+    capacity = 0;
+    device = nullptr;
+}
+
+vk::PushConstantRange ViewportArray::pushConstantRange() const {
+    return vk::PushConstantRange{ vk::ShaderStageFlagBits::eVertex, 0, sizeof(PushConsts) };
+}
+
+void ViewportArray::setupPipeline(pipelines::GraphicsPipelineBuilder& builder) const {
+    const size_t viewportCount = layeredDraws ? std::max<size_t>(views.size(), 1) : 1;
+    builder.viewportState.viewports.resize(viewportCount);
+    builder.viewportState.scissors.resize(viewportCount);
+}
+
+void ViewportArray::update() {
+    if (views.size() > MAX_VIEWS) {
+        throw std::runtime_error("A viewport array draws at most " + std::to_string(MAX_VIEWS) + " views");
+    }
+    if (models.size() > capacity || bounds.size() != models.size()) {
+        throw std::runtime_error("Viewport array instances need a bounding sphere each, and must fit the capacity");
+    }
+    auto* viewData = static_cast<ViewData*>(viewBuffer.mapped);
+    auto* entries = static_cast<glm::uvec2*>(entryBuffer.mapped);
+    auto* drawCommands = static_cast<vk::DrawIndexedIndirectCommand*>(commands.mapped);
+    memcpy(modelBuffer.mapped, models.data(), sizeof(glm::mat4) * models.size());
+
+    const uint32_t viewCount = (uint32_t)views.size();
+    counts.assign(viewCount, 0);
+    uint32_t entryCount = 0;
+    Frustum frustum;
+    for (uint32_t v = 0; v < viewCount; ++v) {
+        const auto& view = views[v];
+        viewData[v] = ViewData{ view.view, view.projection };
+        frustum.update(view.projection * view.view);
+        visible.clear();
+        counts[v] = (uint32_t)frustum.cullSpheres(bounds, visible);
+        if (!layeredDraws) {
+            entryCount = firstEntry(v);
+            drawCommands[v] = mesh;
+            drawCommands[v].instanceCount = counts[v];
+        }
+        for (const auto instance : visible) {
+            entries[entryCount++] = glm::uvec2{ instance, v };
+        }
+    }
+    if (layeredDraws) {
+        drawCommands[0] = mesh;
+        drawCommands[0].instanceCount = entryCount;
+    }
+}
+
+void ViewportArray::draw(const vk::CommandBuffer& commandBuffer, const vk::PipelineLayout& pipelineLayout, uint32_t setIndex) const {
+    const uint32_t viewCount = (uint32_t)views.size();
+    if (!viewCount) {
+        return;
+    }
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, setIndex, set, nullptr);
+    if (layeredDraws) {
+        std::vector<vk::Viewport> viewports;
+        std::vector<vk::Rect2D> scissors;
+        for (const auto& view : views) {
+            viewports.push_back(view.viewport);
+            scissors.push_back(view.scissor);
+        }
+        commandBuffer.setViewport(0, viewports);
+        commandBuffer.setScissor(0, scissors);
+        const PushConsts pushConsts{ 0 };
+        commandBuffer.pushConstants<PushConsts>(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, pushConsts);
+        commandBuffer.drawIndexedIndirect(commands.buffer, 0, 1, sizeof(vk::DrawIndexedIndirectCommand));
+        return;
+    }
+    for (uint32_t v = 0; v < viewCount; ++v) {
+        commandBuffer.setViewport(0, views[v].viewport);
+        commandBuffer.setScissor(0, views[v].scissor);
+        const PushConsts pushConsts{ firstEntry(v) };
+        commandBuffer.pushConstants<PushConsts>(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, pushConsts);
+        commandBuffer.drawIndexedIndirect(commands.buffer, sizeof(vk::DrawIndexedIndirectCommand) * v, 1, sizeof(vk::DrawIndexedIndirectCommand));
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "buffer.hpp"
+#include "forward.hpp"
+#include "frustum.hpp"
+#include "pipelines.hpp"
+
+namespace vks {
+
+// Renders the instances of a mesh into several views of one framebuffer, like split screen players, the views of a
+// CAD viewer or the faces of a cube map atlas, culling the instances against every view apart.
+//
+// update culls `bounds` against the frustum of every view and writes, for each view, the list of the instances it
+// sees, as pairs of instance and view index.  The vertex shaders include data/shaders/base/viewports.glsl and fetch
+// their pair, the matrices of their view and the model matrix of their instance through viewportInstance.
+//
+//   Layered   With Context::shaderViewportIndexLayerEnabled and the multiViewport feature, see layeredSupported, the
+//             lists of all views are drawn as the instances of a single indirect draw.  The vertex shader writes the
+//             viewport index of each instance, so every view is rasterized into its own viewport and scissor
+//             without a geometry shader.  The pipelines define VIEWPORTS_LAYERED before including viewports.glsl.
+//   Per view  Otherwise the list of each view is drawn by an indirect draw of its own, in the view's viewport.
+//
+// The instance counts are read by the indirect draws, so command buffers don't have to be recorded again when the
+// culling changes.  They do when the number of views or their viewports change, and layered pipelines have to be
+// created again, see setupPipeline, when the number of views does.
+class ViewportArray {
+public:
+    // Must match VIEWPORTS_MAX_VIEWS of viewports.glsl, and the smallest maxViewports of devices with multiViewport
+    static const uint32_t MAX_VIEWS = 16;
+
+    struct View {
+        glm::mat4 view{ 1.0f };
+        glm::mat4 projection{ 1.0f };
+        vk::Viewport viewport;
+        vk::Rect2D scissor;
+    };
+
+    // The extension and device features layered draws need have to be enabled
+    static bool layeredSupported(const vks::Context& context);
+
+    // At most MAX_VIEWS
+    std::vector<View> views;
+    // Model matrix and bounding sphere, in the space the views look at, of every instance
+    std::vector<glm::mat4> models;
+    SphereArray bounds;
+
+    // Room for `maxInstances` instances of the mesh of `indexCount` indices starting at `firstIndex`.  `layered`
+    // selects the layered draws, which have to be supported.
+    void create(const vks::Context& context,
+                uint32_t maxInstances,
+                uint32_t indexCount,
+                uint32_t firstIndex = 0,
+                int32_t vertexOffset = 0,
+                bool layered = false);
+    void destroy();
+
+    operator bool() const { return descriptorPool.operator bool(); }
+    bool layered() const { return layeredDraws; }
+
+    // Views, models, instance lists and instance counts, for the draws of frames submitted after it.  Must be
+    // called again whenever views, models or bounds change.
+    void update();
+
+    // The set of viewports.glsl and its push constants, for the pipeline layouts of the draws
+    const vk::DescriptorSetLayout& descriptorSetLayout() const { return setLayout; }
+    const vk::DescriptorSet& descriptorSet() const { return set; }
+    vk::PushConstantRange pushConstantRange() const;
+    // The viewport and scissor counts of the draws' pipelines, which layered pipelines take from the number of views
+    void setupPipeline(pipelines::GraphicsPipelineBuilder& builder) const;
+
+    // Sets the viewports and scissors of the views and draws the instances visible in each, with the pipeline, vertex
+    // and index buffers bound by the caller.  The set is bound at `setIndex` of `pipelineLayout`.
+    void draw(const vk::CommandBuffer& commandBuffer, const vk::PipelineLayout& pipelineLayout, uint32_t setIndex = 0) const;
+
+    // Instances visible in `view` as of the last update
+    uint32_t visibleCount(uint32_t view) const { return view < counts.size() ? counts[view] : 0; }
+
+private:
+    // Must match the ViewportView struct of viewports.glsl
+    struct ViewData {
+        glm::mat4 view;
+        glm::mat4 projection;
+    };
+
+    // Must match the ViewportPushConsts block of viewports.glsl
+    struct PushConsts {
+        uint32_t firstEntry;
+    };
+
+    // The entries of `view` start here, per view draws keep every list at a fixed place so the recorded push
+    // constants stay valid
+    uint32_t firstEntry(uint32_t view) const { return layeredDraws ? 0 : view * capacity; }
+
+    vk::Device device;
+    uint32_t capacity{ 0 };
+    bool layeredDraws{ false };
+    vk::DrawIndexedIndirectCommand mesh;
+
+    vks::Buffer viewBuffer;
+    vks::Buffer modelBuffer;
+    // Pairs of instance and view index, the lists of the views one after the other when layered
+    vks::Buffer entryBuffer;
+    // The command of the layered draw, or one per view
+    vks::Buffer commands;
+    std::vector<uint32_t> counts;
+    std::vector<uint32_t> visible;
+
+    vk::DescriptorSetLayout setLayout;
+    vk::DescriptorPool descriptorPool;
+    vk::DescriptorSet set;
+};
+
+}  // namespace vks
@@ -0,0 +1,493 @@
+#include "virtualtexture.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "context.hpp"
+#include "helpers.hpp"
+#include "threadpool.hpp"
+
+using namespace vks;
+using namespace vks::texture;
+
+namespace {
+
+const uint32_t VERSION = 1;
+
+// Page reads fault the mapped file in, so they run on their own threads rather than the frame
+ThreadPool& pageLoader() {
+    static ThreadPool pool;
+    return pool;
+}
+
+bool isValid(const VirtualTextureHeader& header) {
+    if (memcmp(header.magic, "VTEX", 4) != 0 || header.version != VERSION) {
+        return false;
+    }
+    if (header.width == 0 || header.height == 0 || header.levels == 0 || header.blockSize == 0) {
+        return false;
+    }
+    if (header.blockWidth == 0 || header.blockHeight == 0 || header.pageWidth == 0 || header.pageHeight == 0) {
+        return false;
+    }
+    if (header.pageWidth % header.blockWidth != 0 || header.pageHeight % header.blockHeight != 0) {
+        return false;
+    }
+    return header.levels <= vks::util::mipLevelCount(vk::Extent3D{ header.width, header.height, 1 });
+}
+
+}  // namespace
+
+const uint32_t VirtualTexture::INVALID;
+
+void VirtualTextureFile::open(const std::string& filename) {
+    storage = storage::Storage::readFile(filename);
+    if (storage->size() < sizeof(header)) {
+        throw std::runtime_error(filename + " is not a tiled texture file");
+    }
+    memcpy(&header, storage->data(), sizeof(header));
+    if (!isValid(header)) {
+        throw std::runtime_error(filename + " is not a tiled texture file");
+    }
+    layout();
+    if (storage->size() < sizeof(header) + pageCount() * pageSize()) {
+        throw std::runtime_error(filename + " is truncated");
+    }
+}
+
+void VirtualTextureFile::close() {
+    storage.reset();
+    firstPages.clear();
+}
+
+void VirtualTextureFile::layout() {
+    firstPages.resize(header.levels + 1);
+    firstPages[0] = 0;
+    for (uint32_t level = 0; level < header.levels; ++level) {
+        const auto pages = levelPages(level);
+        firstPages[level + 1] = firstPages[level] + pages.width * pages.height;
+    }
+}
+
+vk::Extent3D VirtualTextureFile::levelExtent(uint32_t level) const {
+    return vk::Extent3D{ std::max(header.width >> level, 1u), std::max(header.height >> level, 1u), 1 };
+}
+
+vk::Extent2D VirtualTextureFile::levelPages(uint32_t level) const {
+    const auto extent = levelExtent(level);
+    return vk::Extent2D{ (extent.width + header.pageWidth - 1) / header.pageWidth, (extent.height + header.pageHeight - 1) / header.pageHeight };
+}
+
+size_t VirtualTextureFile::pageSize() const {
+    return (size_t)(header.pageWidth / header.blockWidth) * (header.pageHeight / header.blockHeight) * header.blockSize;
+}
+
+const uint8_t* VirtualTextureFile::pageData(uint32_t page) const {
+    return storage->data() + sizeof(header) + page * pageSize();
+}
+
+void VirtualTextureFile::write(const std::string& filename, const VirtualTextureHeader& header, const PageWriter& writer) {
+    if (!isValid(header)) {
+        throw std::runtime_error("Invalid tiled texture header for " + filename);
+    }
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) {
+        throw std::runtime_error("Failed to create " + filename);
+    }
+    VirtualTextureFile file;
+    file.header = header;
+    file.layout();
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    std::vector<uint8_t> page(file.pageSize());
+    for (uint32_t level = 0; level < header.levels; ++level) {
+        const auto pages = file.levelPages(level);
+        for (uint32_t y = 0; y < pages.height; ++y) {
+            for (uint32_t x = 0; x < pages.width; ++x) {
+                std::fill(page.begin(), page.end(), 0);
+                writer(level, x, y, page.data());
+                out.write(reinterpret_cast<const char*>(page.data()), page.size());
+            }
+        }
+    }
+    if (!out) {
+        throw std::runtime_error("Failed to write " + filename);
+    }
+}
+
+void VirtualTexture::create(const vks::Context& context, const std::string& filename, uint32_t feedbackSlots) {
+    this->context = &context;
+    const auto& device = context.device;
+    file.open(filename);
+    const auto& header = file.header;
+    const auto format = static_cast<vk::Format>(header.format);
+
+    if (!(context.queueFamilyProperties[context.queueIndices.graphics].queueFlags & vk::QueueFlagBits::eSparseBinding)) {
+        throw std::runtime_error("The graphics queue does not support sparse binding");
+    }
+
+    imageCreateInfo.imageType = vk::ImageType::e2D;
+    imageCreateInfo.format = format;
+    imageCreateInfo.extent = file.levelExtent(0);
+    imageCreateInfo.mipLevels = header.levels;
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
+    imageCreateInfo.flags = vk::ImageCreateFlagBits::eSparseBinding | vk::ImageCreateFlagBits::eSparseResidency;
+
+    const auto sparseProperties = context.physicalDevice.getSparseImageFormatProperties(format, imageCreateInfo.imageType, vk::SampleCountFlagBits::e1,
+                                                                                        imageCreateInfo.usage, vk::ImageTiling::eOptimal);
+    if (sparseProperties.empty()) {
+        throw std::runtime_error("The device does not support sparse residency for " + vk::to_string(format));
+    }
+    // Pages are bound whole, so a file page has to be exactly one sparse block
+    const auto& granularity = sparseProperties[0].imageGranularity;
+    if (granularity.width != header.pageWidth || granularity.height != header.pageHeight) {
+        throw std::runtime_error("The page size of " + filename + " does not match the sparse block size of " + vk::to_string(format));
+    }
+
+    image = device.createImage(imageCreateInfo);
+    const auto memoryRequirements = device.getImageMemoryRequirements(image);
+    if (memoryRequirements.size > context.deviceProperties.limits.sparseAddressSpaceSize) {
+        throw std::runtime_error(filename + " exceeds the sparse address space of the device");
+    }
+    vk::SparseImageMemoryRequirements sparseRequirements;
+    bool found = false;
+    for (const auto& requirements : device.getImageSparseMemoryRequirements(image)) {
+        if (requirements.formatProperties.aspectMask & vk::ImageAspectFlagBits::eColor) {
+            sparseRequirements = requirements;
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        throw std::runtime_error("No sparse memory requirements for the color aspect of " + filename);
+    }
+    tailStart = sparseRequirements.imageMipTailFirstLod;
+    if (tailStart >= header.levels) {
+        throw std::runtime_error(filename + " has no mip tail to keep resident");
+    }
+
+    // The sparse block size is the memory alignment, so physical pages are consecutive alignment sized slots
+    createPages();
+    residentPageBudget = std::min(residentPageBudget, pageCount());
+    pageMemorySize = memoryRequirements.alignment;
+    const uint32_t memoryType = context.getMemoryType(memoryRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
+    pageMemory = device.allocateMemory(vk::MemoryAllocateInfo{ residentPageBudget * pageMemorySize, memoryType });
+    tailMemory = device.allocateMemory(vk::MemoryAllocateInfo{ sparseRequirements.imageMipTailSize, memoryType });
+    physicalPages.assign(residentPageBudget, INVALID);
+    freePhysical.resize(residentPageBudget);
+    for (uint32_t physical = 0; physical < residentPageBudget; ++physical) {
+        freePhysical[physical] = residentPageBudget - 1 - physical;
+    }
+    residentPages = 0;
+
+    vk::SparseMemoryBind tailBind;
+    tailBind.resourceOffset = sparseRequirements.imageMipTailOffset;
+    tailBind.size = sparseRequirements.imageMipTailSize;
+    tailBind.memory = tailMemory;
+    vk::SparseImageOpaqueMemoryBindInfo tailBindInfo{ image, 1, &tailBind };
+    vk::BindSparseInfo bindSparseInfo;
+    bindSparseInfo.imageOpaqueBindCount = 1;
+    bindSparseInfo.pImageOpaqueBinds = &tailBindInfo;
+    vk::Fence fence = device.createFence(vk::FenceCreateInfo{});
+    context.queue.bindSparse(bindSparseInfo, fence);
+    device.waitForFences(fence, VK_TRUE, UINT64_MAX);
+    device.destroy(fence);
+
+    // The tail goes up with the other pending uploads, the streamed levels start out unbound
+    const vk::ImageSubresourceRange range{ vk::ImageAspectFlagBits::eColor, 0, header.levels, 0, 1 };
+    context.recordUpload([&](const vk::CommandBuffer& commandBuffer) {
+        vk::ImageMemoryBarrier barrier{ {}, vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral,
+                                        VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, image, range };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, barrier);
+    });
+    for (uint32_t level = tailStart; level < header.levels; ++level) {
+        const auto extent = file.levelExtent(level);
+        const auto levelPages = file.levelPages(level);
+        const uint32_t levelPageCount = levelPages.width * levelPages.height;
+        std::vector<vk::BufferImageCopy> regions;
+        for (uint32_t y = 0; y < levelPages.height; ++y) {
+            for (uint32_t x = 0; x < levelPages.width; ++x) {
+                vk::BufferImageCopy region;
+                region.bufferOffset = (y * levelPages.width + x) * file.pageSize();
+                region.bufferRowLength = header.pageWidth;
+                region.bufferImageHeight = header.pageHeight;
+                region.imageSubresource = vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, level, 0, 1 };
+                region.imageOffset = vk::Offset3D{ (int32_t)(x * header.pageWidth), (int32_t)(y * header.pageHeight), 0 };
+                region.imageExtent = vk::Extent3D{ std::min(header.pageWidth, extent.width - x * header.pageWidth),
+                                                   std::min(header.pageHeight, extent.height - y * header.pageHeight), 1 };
+                regions.push_back(region);
+            }
+        }
+        context.stageUpload(levelPageCount * file.pageSize(), file.pageData(file.firstPage(level)), context.getImageStagingAlignment(),
+                            [&](const vk::CommandBuffer& commandBuffer, const vk::Buffer& staging, vk::DeviceSize stagingOffset) {
+                                for (auto& region : regions) {
+                                    region.bufferOffset += stagingOffset;
+                                }
+                                commandBuffer.copyBufferToImage(staging, image, vk::ImageLayout::eGeneral, regions);
+                            });
+    }
+    context.recordUpload([&](const vk::CommandBuffer& commandBuffer) {
+        vk::MemoryBarrier barrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, barrier, nullptr, nullptr);
+    });
+
+    vk::ImageViewCreateInfo viewCreateInfo;
+    viewCreateInfo.image = image;
+    viewCreateInfo.viewType = vk::ImageViewType::e2D;
+    viewCreateInfo.format = format;
+    viewCreateInfo.subresourceRange = range;
+    view = device.createImageView(viewCreateInfo);
+
+    vk::SamplerCreateInfo samplerCreateInfo;
+    samplerCreateInfo.magFilter = vk::Filter::eLinear;
+    samplerCreateInfo.minFilter = vk::Filter::eLinear;
+    samplerCreateInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
+    samplerCreateInfo.addressModeU = vk::SamplerAddressMode::eRepeat;
+    samplerCreateInfo.addressModeV = vk::SamplerAddressMode::eRepeat;
+    samplerCreateInfo.addressModeW = vk::SamplerAddressMode::eRepeat;
+    samplerCreateInfo.maxLod = (float)header.levels;
+    samplerCreateInfo.borderColor = vk::BorderColor::eFloatOpaqueWhite;
+    sampler = vks::acquireSampler(device, samplerCreateInfo);
+
+    descriptor.sampler = sampler;
+    descriptor.imageView = view;
+    descriptor.imageLayout = vk::ImageLayout::eGeneral;
+
+    std::vector<uint32_t> levelsData{ tailStart, header.pageWidth, header.pageHeight, maxRequests };
+    for (uint32_t level = 0; level < tailStart; ++level) {
+        const auto levelPages = file.levelPages(level);
+        levelsData.insert(levelsData.end(), { file.firstPage(level), levelPages.width, levelPages.height, 0 });
+    }
+    levelsBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, levelsData);
+
+    feedback.resize(feedbackSlots);
+    for (auto& slot : feedback) {
+        slot.flags = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, pageCount() * sizeof(uint32_t));
+        slot.requests = context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                             vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                             (1 + maxRequests) * sizeof(uint32_t));
+        // Slots are read before their first frame has written them
+        memset(slot.requests.map(), 0, sizeof(uint32_t));
+    }
+
+    bindSemaphore = device.createSemaphore(vk::SemaphoreCreateInfo{});
+}
+
+void VirtualTexture::createPages() {
+    pages.clear();
+    for (uint32_t level = 0; level < tailStart; ++level) {
+        const auto levelPages = file.levelPages(level);
+        for (uint32_t y = 0; y < levelPages.height; ++y) {
+            for (uint32_t x = 0; x < levelPages.width; ++x) {
+                Page page;
+                page.level = level;
+                page.x = x;
+                page.y = y;
+                pages.push_back(page);
+            }
+        }
+    }
+}
+
+void VirtualTexture::destroy() {
+    if (!context) {
+        return;
+    }
+    // The loaders read from the mapped file
+    for (auto& load : loads) {
+        load.data.wait();
+    }
+    loads.clear();
+    const auto& device = context->device;
+    for (auto& slot : feedback) {
+        slot.flags.destroy();
+        slot.requests.destroy();
+    }
+    feedback.clear();
+    levelsBuffer.destroy();
+    device.destroy(bindSemaphore);
+    vks::releaseSampler(device, sampler);
+    device.destroy(view);
+    device.destroy(image);
+    device.freeMemory(pageMemory);
+    device.freeMemory(tailMemory);
+    bindSemaphore = nullptr;
+    sampler = nullptr;
+    view = nullptr;
+    image = nullptr;
+    pageMemory = nullptr;
+    tailMemory = nullptr;
+    pages.clear();
+    physicalPages.clear();
+    freePhysical.clear();
+    residentPages = 0;
+    file.close();
+    context = nullptr;
+}
+
+void VirtualTexture::recordFeedbackReset(const vk::CommandBuffer& commandBuffer, uint32_t slot) const {
+    const auto& slotFeedback = feedback[slot];
+    commandBuffer.fillBuffer(slotFeedback.flags.buffer, 0, VK_WHOLE_SIZE, 0);
+    commandBuffer.fillBuffer(slotFeedback.requests.buffer, 0, sizeof(uint32_t), 0);
+    vk::MemoryBarrier barrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, barrier, nullptr, nullptr);
+}
+
+void VirtualTexture::recordFeedbackResolve(const vk::CommandBuffer& commandBuffer) const {
+    vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eHost, {}, barrier, nullptr, nullptr);
+}
+
+void VirtualTexture::requestPage(uint32_t page, std::vector<uint32_t>& missing) {
+    // The coarser pages covering the same area are what sampling falls back to, so they count as requested too
+    while (page < pages.size()) {
+        Page& entry = pages[page];
+        if (entry.lastRequested == updateCount) {
+            // Reached through another request already, and so have all its parents
+            return;
+        }
+        entry.lastRequested = updateCount;
+        if (entry.physical == INVALID && !entry.loading) {
+            missing.push_back(page);
+        }
+        const uint32_t parentLevel = entry.level + 1;
+        if (parentLevel >= tailStart) {
+            return;
+        }
+        const auto parentPages = file.levelPages(parentLevel);
+        page = file.firstPage(parentLevel) + std::min(entry.y / 2, parentPages.height - 1) * parentPages.width + std::min(entry.x / 2, parentPages.width - 1);
+    }
+}
+
+uint32_t VirtualTexture::allocatePhysical(std::vector<vk::SparseImageMemoryBind>& binds) {
+    if (!freePhysical.empty()) {
+        const uint32_t physical = freePhysical.back();
+        freePhysical.pop_back();
+        return physical;
+    }
+    // Evict the least recently requested page, unless a frame whose feedback hasn't been read yet may still sample it
+    uint32_t victim = INVALID;
+    uint64_t oldest = updateCount;
+    for (uint32_t physical = 0; physical < physicalPages.size(); ++physical) {
+        const Page& page = pages[physicalPages[physical]];
+        if (page.lastRequested < oldest) {
+            oldest = page.lastRequested;
+            victim = physical;
+        }
+    }
+    if (victim == INVALID || oldest + feedback.size() >= updateCount) {
+        return INVALID;
+    }
+    pages[physicalPages[victim]].physical = INVALID;
+    binds.push_back(pageBind(physicalPages[victim], nullptr, 0));
+    physicalPages[victim] = INVALID;
+    --residentPages;
+    return victim;
+}
+
+vk::SparseImageMemoryBind VirtualTexture::pageBind(uint32_t page, vk::DeviceMemory memory, vk::DeviceSize memoryOffset) const {
+    const Page& entry = pages[page];
+    const auto& header = file.header;
+    const auto extent = file.levelExtent(entry.level);
+    vk::SparseImageMemoryBind bind;
+    bind.subresource = vk::ImageSubresource{ vk::ImageAspectFlagBits::eColor, entry.level, 0 };
+    bind.offset = vk::Offset3D{ (int32_t)(entry.x * header.pageWidth), (int32_t)(entry.y * header.pageHeight), 0 };
+    // Pages at the edges only cover what is left of the level
+    bind.extent = vk::Extent3D{ std::min(header.pageWidth, extent.width - entry.x * header.pageWidth),
+                                std::min(header.pageHeight, extent.height - entry.y * header.pageHeight), 1 };
+    bind.memory = memory;
+    bind.memoryOffset = memoryOffset;
+    return bind;
+}
+
+void VirtualTexture::update(uint32_t slot) {
+    ++updateCount;
+
+    const uint32_t* requests = static_cast<const uint32_t*>(feedback[slot].requests.mapped);
+    requestCount = std::min(requests[0], maxRequests);
+    std::vector<uint32_t> missing;
+    for (uint32_t i = 0; i < requestCount; ++i) {
+        requestPage(requests[1 + i], missing);
+    }
+
+    // Coarse pages cover more of the screen and are the fallback for the finer ones, so they load first
+    std::stable_sort(missing.begin(), missing.end(), [&](uint32_t a, uint32_t b) { return pages[a].level > pages[b].level; });
+    const size_t pageSize = file.pageSize();
+    for (const auto& page : missing) {
+        if (loads.size() >= maxPendingLoads) {
+            break;
+        }
+        pages[page].loading = true;
+        const uint8_t* data = file.pageData(page);
+        loads.push_back(Load{ page, pageLoader().submit([data, pageSize] { return std::vector<uint8_t>(data, data + pageSize); }) });
+    }
+
+    std::vector<vk::SparseImageMemoryBind> binds;
+    std::vector<std::pair<uint32_t, std::vector<uint8_t>>> uploads;
+    for (auto itr = loads.begin(); itr != loads.end() && uploads.size() < maxUploadsPerUpdate;) {
+        if (itr->data.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++itr;
+            continue;
+        }
+        Page& page = pages[itr->page];
+        page.loading = false;
+        const uint32_t physical = allocatePhysical(binds);
+        if (physical == INVALID) {
+            // Every resident page is still in use, the page gets requested again if it is still needed
+            itr = loads.erase(itr);
+            continue;
+        }
+        // Fresh pages mustn't be picked for eviction before the copy into them has run
+        page.lastRequested = updateCount;
+        page.physical = physical;
+        physicalPages[physical] = itr->page;
+        ++residentPages;
+        binds.push_back(pageBind(itr->page, pageMemory, physical * pageMemorySize));
+        uploads.emplace_back(itr->page, itr->data.get());
+        itr = loads.erase(itr);
+    }
+    if (uploads.empty()) {
+        return;
+    }
+
+    vk::SparseImageMemoryBindInfo imageBindInfo{ image, (uint32_t)binds.size(), binds.data() };
+    vk::BindSparseInfo bindSparseInfo;
+    bindSparseInfo.imageBindCount = 1;
+    bindSparseInfo.pImageBinds = &imageBindInfo;
+    bindSparseInfo.signalSemaphoreCount = 1;
+    bindSparseInfo.pSignalSemaphores = &bindSemaphore;
+    context->queue.bindSparse(bindSparseInfo, nullptr);
+
+    auto staging = context->createStagingBuffer(uploads.size() * pageSize);
+    staging.map();
+    std::vector<vk::BufferImageCopy> regions;
+    regions.reserve(uploads.size());
+    for (size_t i = 0; i < uploads.size(); ++i) {
+        staging.copy(pageSize, uploads[i].second.data(), i * pageSize);
+        const auto bind = pageBind(uploads[i].first, nullptr, 0);
+        vk::BufferImageCopy region;
+        region.bufferOffset = i * pageSize;
+        region.bufferRowLength = file.header.pageWidth;
+        region.bufferImageHeight = file.header.pageHeight;
+        region.imageSubresource = vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, bind.subresource.mipLevel, 0, 1 };
+        region.imageOffset = bind.offset;
+        region.imageExtent = bind.extent;
+        regions.push_back(region);
+    }
+    staging.unmap();
+
+    vk::CommandBuffer commandBuffer = context->createCommandBuffer();
+    commandBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    // Frames submitted earlier may still be sampling memory that was just rebound
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, nullptr);
+    commandBuffer.copyBufferToImage(staging.buffer, image, vk::ImageLayout::eGeneral, regions);
+    vk::MemoryBarrier barrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, barrier, nullptr, nullptr);
+    commandBuffer.end();
+    context->submit(commandBuffer, Context::SemaphoreStagePair{ bindSemaphore, vk::PipelineStageFlagBits::eTransfer });
+    context->trash(commandBuffer);
+    context->trash(staging);
+}
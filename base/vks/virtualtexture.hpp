@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "buffer.hpp"
+#include "forward.hpp"
+#include "storage.hpp"
+
+namespace vks { namespace texture {
+
+// Feedback driven streaming of a texture too large to keep resident, on top of sparse residency.  The image is
+// bound page by page from a fixed pool of physical memory, and the shader sampling it reports which pages it
+// needed, so only those get read from disk and bound, with the least recently requested ones making room.
+
+// Header of a tiled texture file (.vtex).  It is followed by the pages of every level, finest level first and
+// row major within a level.  Every page holds the blocks of a full pageWidth x pageHeight region, pages at the
+// right and bottom edges and levels smaller than a page are padded, so any page can be read with a single seek.
+struct VirtualTextureHeader {
+    char magic[4]{ 'V', 'T', 'E', 'X' };
+    uint32_t version{ 1 };
+    // A VkFormat
+    uint32_t format{ 0 };
+    uint32_t width{ 0 };
+    uint32_t height{ 0 };
+    uint32_t levels{ 0 };
+    // In texels, multiples of the block extent
+    uint32_t pageWidth{ 0 };
+    uint32_t pageHeight{ 0 };
+    // Texel extent and byte size of one block, 1 x 1 and the texel size for uncompressed formats
+    uint32_t blockWidth{ 1 };
+    uint32_t blockHeight{ 1 };
+    uint32_t blockSize{ 0 };
+};
+
+class VirtualTextureFile {
+public:
+    using PageWriter = std::function<void(uint32_t level, uint32_t x, uint32_t y, uint8_t* data)>;
+
+    VirtualTextureHeader header;
+
+    // Map `filename`, throws std::runtime_error if it isn't a complete tiled texture file
+    void open(const std::string& filename);
+    void close();
+
+    vk::Extent3D levelExtent(uint32_t level) const;
+    // Pages along each axis of `level`
+    vk::Extent2D levelPages(uint32_t level) const;
+    // Index of the first page of `level`, pages are numbered across all levels in file order
+    uint32_t firstPage(uint32_t level) const { return firstPages[level]; }
+    uint32_t pageCount() const { return firstPages.back(); }
+    size_t pageSize() const;
+    const uint8_t* pageData(uint32_t page) const;
+
+    // Write a file with `header`, calling `writer` to fill in each page buffer of pageSize() zeroed bytes
+    static void write(const std::string& filename, const VirtualTextureHeader& header, const PageWriter& writer);
+
+private:
+    void layout();
+
+    storage::StoragePointer storage;
+    // One entry per level plus the total page count
+    std::vector<uint32_t> firstPages;
+};
+
+class VirtualTexture {
+public:
+    // Physical pages the streamed levels share, the memory budget of the texture.  Set before create
+    uint32_t residentPageBudget{ 256 };
+    // Pages bound and uploaded per update, to bound the per frame cost
+    uint32_t maxUploadsPerUpdate{ 32 };
+    // Page reads in flight on the loader threads
+    uint32_t maxPendingLoads{ 64 };
+    // Distinct pages one frame of feedback can report.  Set before create
+    uint32_t maxRequests{ 4096 };
+
+    vk::Image image;
+    vk::ImageView view;
+    vk::Sampler sampler;
+    // The image stays in eGeneral, so pages can be uploaded while other pages are sampled
+    vk::DescriptorImageInfo descriptor;
+    vk::ImageCreateInfo imageCreateInfo;
+
+    // Read by the feedback shader code: a uvec4 {paged levels, page width, page height, max requests} followed by
+    // a uvec4 {first page, pages x, pages y, 0} per paged level
+    vks::Buffer levelsBuffer;
+    struct Feedback {
+        // One uint per page, set by the first pixel requesting it so every page is reported once
+        vks::Buffer flags;
+        // Host visible {uint count; uint pages[maxRequests];}
+        vks::Buffer requests;
+    };
+    // One slot per frame whose feedback can be in flight at once
+    std::vector<Feedback> feedback;
+
+    // Create the sparse image for the tiled texture `filename`, whose page extent must match the sparse block
+    // extent of its format.  The mip tail is bound and uploaded here and stays resident, so sampling always has
+    // something to fall back to.  Throws std::runtime_error if the device can't page the file's format.
+    void create(const vks::Context& context, const std::string& filename, uint32_t feedbackSlots);
+    void destroy();
+
+    // Clear the feedback of `slot`, record before the pass that samples the texture
+    void recordFeedbackReset(const vk::CommandBuffer& commandBuffer, uint32_t slot) const;
+    // Make the feedback written by the pass visible to update, record after it
+    void recordFeedbackResolve(const vk::CommandBuffer& commandBuffer) const;
+
+    // Process the feedback of `slot`, whose commands must have completed: queue loads for the requested pages
+    // that aren't resident, coarsest levels first, and bind and upload the pages that finished loading, evicting
+    // the least recently requested ones once the budget is used up.
+    void update(uint32_t slot);
+
+    uint32_t levels() const { return imageCreateInfo.mipLevels; }
+    // Levels from here on are in the mip tail
+    uint32_t mipTailStart() const { return tailStart; }
+    uint32_t pageCount() const { return static_cast<uint32_t>(pages.size()); }
+    uint32_t residentPageCount() const { return residentPages; }
+    uint32_t pendingLoadCount() const { return static_cast<uint32_t>(loads.size()); }
+    uint32_t lastRequestCount() const { return requestCount; }
+
+private:
+    static const uint32_t INVALID = static_cast<uint32_t>(-1);
+
+    struct Page {
+        uint32_t level;
+        uint32_t x;
+        uint32_t y;
+        uint32_t physical{ INVALID };
+        uint64_t lastRequested{ 0 };
+        bool loading{ false };
+    };
+
+    struct Load {
+        uint32_t page;
+        std::future<std::vector<uint8_t>> data;
+    };
+
+    void createPages();
+    void bindMipTail();
+    void requestPage(uint32_t page, std::vector<uint32_t>& missing);
+    uint32_t allocatePhysical(std::vector<vk::SparseImageMemoryBind>& binds);
+    vk::SparseImageMemoryBind pageBind(uint32_t page, vk::DeviceMemory memory, vk::DeviceSize memoryOffset) const;
+
+    const vks::Context* context{ nullptr };
+    VirtualTextureFile file;
+    uint32_t tailStart{ 0 };
+    vk::DeviceMemory pageMemory;
+    vk::DeviceMemory tailMemory;
+    vk::DeviceSize pageMemorySize{ 0 };
+    std::vector<Page> pages;
+    // The page bound to each physical page
+    std::vector<uint32_t> physicalPages;
+    std::vector<uint32_t> freePhysical;
+    uint32_t residentPages{ 0 };
+    std::list<Load> loads;
+    uint64_t updateCount{ 0 };
+    uint32_t requestCount{ 0 };
+    vk::Semaphore bindSemaphore;
+};
+
+}}  // namespace vks::texture
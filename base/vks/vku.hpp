@@ -27,10 +27,15 @@
 #include <chrono>
 #include <functional>
 #include <cstddef>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
 
 #include <vulkan/spirv.hpp11>
 #include <vulkan/vulkan.hpp>
 
+#include "context.hpp"
+
 namespace vku {
 
 /// Printf-style formatting function.
@@ -1151,8 +1156,69 @@ private:
     vk::PipelineShaderStageCreateInfo stage_;
 };
 
+/// Owns a vks::Buffer or vks::Image and destroys it along with the wrapper.  Resources made through a vks::Context
+/// are sub-allocated from its allocator just like the ones of the rest of the framework, the constructors taking a
+/// device and its memory properties fall back to a dedicated allocation each.
+template <class Type>
+class UniqueAllocation {
+public:
+    UniqueAllocation() {}
+    UniqueAllocation(const UniqueAllocation&) = delete;
+    UniqueAllocation& operator=(const UniqueAllocation&) = delete;
+
+    UniqueAllocation(UniqueAllocation&& other)
+        : value_(other.value_) {
+        other.value_ = Type{};
+    }
+
+    UniqueAllocation& operator=(UniqueAllocation&& other) {
+        if (this != &other) {
+            reset(other.value_);
+            other.value_ = Type{};
+        }
+        return *this;
+    }
+
+    ~UniqueAllocation() { value_.destroy(); }
+
+    void reset(const Type& value = Type{}) {
+        value_.destroy();
+        value_ = value;
+    }
+
+    Type& operator*() { return value_; }
+    const Type& operator*() const { return value_; }
+    Type* operator->() { return &value_; }
+    const Type* operator->() const { return &value_; }
+
+private:
+    Type value_;
+};
+
+/// Dedicated memory for a resource created without a vks::Context.
+inline vks::Allocation allocateDedicated(vk::Device device,
+                                         const vk::PhysicalDeviceMemoryProperties& memprops,
+                                         const vk::MemoryRequirements& memreq,
+                                         vk::MemoryPropertyFlags search) {
+    int memoryTypeIndex = vku::findMemoryTypeIndex(memprops, memreq.memoryTypeBits, search);
+    if (memoryTypeIndex < 0) {
+        throw std::runtime_error("No memory type with the requested properties");
+    }
+    vks::Allocation result;
+    result.device = device;
+    result.memory = device.allocateMemory(vk::MemoryAllocateInfo{ memreq.size, (uint32_t)memoryTypeIndex });
+    result.size = result.allocSize = memreq.size;
+    result.alignment = memreq.alignment;
+    result.memoryPropertyFlags = memprops.memoryTypes[memoryTypeIndex].propertyFlags;
+    return result;
+}
+
 /// A generic buffer that may be used as a vertex buffer, uniform buffer or other kinds of memory resident data.
 /// Buffers require memory objects which represent GPU and CPU resources.
+///
+/// Host visible buffers stay mapped for their whole lifetime, so updateLocal is just a copy (and a flush for memory
+/// that isn't host coherent).  Uploads to device local buffers through a vks::Context go through its staging ring
+/// and pending upload batch instead of a submission of their own, see vks::Context::stageUpload.
 class GenericBuffer {
 public:
     GenericBuffer() {}
@@ -1164,33 +1230,65 @@ public:
                   vk::MemoryPropertyFlags memflags = vk::MemoryPropertyFlagBits::eDeviceLocal) {
         // Create the buffer object without memory.
         vk::BufferCreateInfo ci{};
-        ci.size = size_ = size;
+        ci.size = size;
         ci.usage = usage;
         ci.sharingMode = vk::SharingMode::eExclusive;
-        buffer_ = device.createBufferUnique(ci);
-
-        // Find out how much memory and which heap to allocate from.
-        auto memreq = device.getBufferMemoryRequirements(*buffer_);
+        vks::Buffer buffer;
+        buffer.buffer = device.createBuffer(ci);
 
-        // Create a memory object to bind to the buffer.
-        vk::MemoryAllocateInfo mai{};
-        mai.allocationSize = memreq.size;
-        mai.memoryTypeIndex = vku::findMemoryTypeIndex(memprops, memreq.memoryTypeBits, memflags);
-        mem_ = device.allocateMemoryUnique(mai);
+        // Find out how much memory and which heap to allocate from, and bind it to the buffer.
+        auto memreq = device.getBufferMemoryRequirements(buffer.buffer);
+        static_cast<vks::Allocation&>(buffer) = vku::allocateDedicated(device, memprops, memreq, memflags);
+        buffer.size = size;
+        buffer.usageFlags = usage;
+        buffer.setupDescriptor();
+        buffer.bind();
+        init(buffer);
+    }
 
-        device.bindBufferMemory(*buffer_, *mem_, 0);
+    /// A buffer sub-allocated from the context's allocator.
+    GenericBuffer(const vks::Context& context,
+                  vk::BufferUsageFlags usage,
+                  vk::DeviceSize size,
+                  vk::MemoryPropertyFlags memflags = vk::MemoryPropertyFlagBits::eDeviceLocal) {
+        init(context.createBuffer(usage, memflags, size));
     }
 
     /// For a host buffer, copy memory to the buffer object.
-    void updateLocal(const vk::Device& device, const void* value, vk::DeviceSize size) const {
-        void* ptr = device.mapMemory(*mem_, 0, size_, vk::MemoryMapFlags{});
-        memcpy(ptr, value, (size_t)size);
-        flush(device);
-        device.unmapMemory(*mem_);
+    void updateLocal(const void* value, vk::DeviceSize size) const {
+        assert(buffer_->mapped);
+        memcpy(buffer_->mapped, value, (size_t)size);
+        if (!(buffer_->memoryPropertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent)) {
+            buffer_->flush();
+        }
+    }
+
+    void updateLocal(const vk::Device&, const void* value, vk::DeviceSize size) const { updateLocal(value, size); }
+
+    /// For a device local buffer, copy memory to the buffer object through the context's staging ring.  The copy is
+    /// recorded into the pending upload batch, which is submitted ahead of the next submission made through the
+    /// context, so nothing waits for it here.  Requires the buffer to have been created with eTransferDst usage.
+    void upload(const vks::Context& context, const void* value, vk::DeviceSize size) const {
+        if (size == 0)
+            return;
+        vk::Buffer dst = buffer_->buffer;
+        context.stageUpload(size, value, 4, [&](const vk::CommandBuffer& cb, const vk::Buffer& staging, vk::DeviceSize stagingOffset) {
+            cb.copyBuffer(staging, dst, vk::BufferCopy{ stagingOffset, 0, size });
+        });
+    }
+
+    template <typename T>
+    void upload(const vks::Context& context, const std::vector<T>& value) const {
+        upload(context, value.data(), value.size() * sizeof(T));
+    }
+
+    template <typename T>
+    void upload(const vks::Context& context, const T& value) const {
+        upload(context, &value, sizeof(value));
     }
 
     /// For a device local buffer, copy memory to the buffer object immediately.
-    /// Note that this will stall the pipeline!
+    /// Note that this will stall the pipeline!  Prefer the overloads taking a vks::Context where there is one.
     void upload(vk::Device device,
                 const vk::PhysicalDeviceMemoryProperties& memprops,
                 vk::CommandPool commandPool,
@@ -1202,11 +1300,11 @@ public:
         using buf = vk::BufferUsageFlagBits;
         using pfb = vk::MemoryPropertyFlagBits;
         auto tmp = vku::GenericBuffer(device, memprops, buf::eTransferSrc, size, pfb::eHostVisible);
-        tmp.updateLocal(device, value, size);
+        tmp.updateLocal(value, size);
 
         vku::executeImmediately(device, commandPool, queue, [&](vk::CommandBuffer cb) {
             vk::BufferCopy bc{ 0, 0, size };
-            cb.copyBuffer(tmp.buffer(), *buffer_, bc);
+            cb.copyBuffer(tmp.buffer(), buffer_->buffer, bc);
         });
     }
 
@@ -1232,41 +1330,43 @@ public:
                  vk::AccessFlags dstAccessMask,
                  uint32_t srcQueueFamilyIndex,
                  uint32_t dstQueueFamilyIndex) const {
-        vk::BufferMemoryBarrier bmb{ srcAccessMask, dstAccessMask, srcQueueFamilyIndex, dstQueueFamilyIndex, *buffer_, 0, size_ };
+        vk::BufferMemoryBarrier bmb{ srcAccessMask, dstAccessMask, srcQueueFamilyIndex, dstQueueFamilyIndex, buffer_->buffer, 0, size() };
         cb.pipelineBarrier(srcStageMask, dstStageMask, dependencyFlags, nullptr, bmb, nullptr);
     }
 
     template <class Type, class Allocator>
     void updateLocal(const vk::Device& device, const std::vector<Type, Allocator>& value) const {
-        updateLocal(device, (void*)value.data(), vk::DeviceSize(value.size() * sizeof(Type)));
+        updateLocal((void*)value.data(), vk::DeviceSize(value.size() * sizeof(Type)));
     }
 
     template <class Type>
     void updateLocal(const vk::Device& device, const Type& value) const {
-        updateLocal(device, (void*)&value, vk::DeviceSize(sizeof(Type)));
+        updateLocal((void*)&value, vk::DeviceSize(sizeof(Type)));
     }
 
-    void* map(const vk::Device& device) const { return device.mapMemory(*mem_, 0, size_, vk::MemoryMapFlags{}); };
-    void unmap(const vk::Device& device) const { return device.unmapMemory(*mem_); };
+    /// Host visible buffers are mapped persistently, these only hand out (and take back) the mapping.
+    void* map(const vk::Device&) const { return buffer_->mapped; };
+    void unmap(const vk::Device&) const {};
 
-    void flush(const vk::Device& device) const {
-        vk::MappedMemoryRange mr{ *mem_, 0, size_ };
-        return device.flushMappedMemoryRanges(mr);
-    }
-
-    void invalidate(const vk::Device& device) const {
-        vk::MappedMemoryRange mr{ *mem_, 0, size_ };
-        return device.invalidateMappedMemoryRanges(mr);
-    }
+    void flush(const vk::Device&) const { buffer_->flush(); }
+    void invalidate(const vk::Device&) const { buffer_->invalidate(); }
 
-    vk::Buffer buffer() const { return *buffer_; }
-    vk::DeviceMemory mem() const { return *mem_; }
-    vk::DeviceSize size() const { return size_; }
+    vk::Buffer buffer() const { return buffer_->buffer; }
+    /// The memory object may be shared with other resources, starting at memOffset().
+    vk::DeviceMemory mem() const { return buffer_->memory; }
+    vk::DeviceSize memOffset() const { return buffer_->offset; }
+    vk::DeviceSize size() const { return buffer_->size; }
+    const vk::DescriptorBufferInfo& descriptor() const { return buffer_->descriptor; }
 
 private:
-    vk::UniqueBuffer buffer_;
-    vk::UniqueDeviceMemory mem_;
-    vk::DeviceSize size_;
+    void init(const vks::Buffer& buffer) {
+        buffer_.reset(buffer);
+        if (buffer_->memoryPropertyFlags & vk::MemoryPropertyFlagBits::eHostVisible) {
+            buffer_->map();
+        }
+    }
+
+    UniqueAllocation<vks::Buffer> buffer_;
 };
 
 /// This class is a specialisation of GenericBuffer for high performance vertex buffers on the GPU.
@@ -1277,6 +1377,9 @@ public:
 
     VertexBuffer(const vk::Device& device, const vk::PhysicalDeviceMemoryProperties& memprops, size_t size)
         : GenericBuffer(device, memprops, vk::BufferUsageFlagBits::eVertexBuffer, size, vk::MemoryPropertyFlagBits::eDeviceLocal) {}
+
+    VertexBuffer(const vks::Context& context, size_t size)
+        : GenericBuffer(context, vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst, size) {}
 };
 
 /// This class is a specialisation of GenericBuffer for low performance vertex buffers on the host.
@@ -1289,6 +1392,15 @@ public:
         : GenericBuffer(device, memprops, vk::BufferUsageFlagBits::eVertexBuffer, value.size() * sizeof(Type), vk::MemoryPropertyFlagBits::eHostVisible) {
         updateLocal(device, value);
     }
+
+    template <class Type, class Allocator>
+    HostVertexBuffer(const vks::Context& context, const std::vector<Type, Allocator>& value)
+        : GenericBuffer(context,
+                        vk::BufferUsageFlagBits::eVertexBuffer,
+                        value.size() * sizeof(Type),
+                        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent) {
+        updateLocal(value.data(), value.size() * sizeof(Type));
+    }
 };
 
 /// This class is a specialisation of GenericBuffer for high performance index buffers.
@@ -1299,6 +1411,9 @@ public:
 
     IndexBuffer(const vk::Device& device, const vk::PhysicalDeviceMemoryProperties& memprops, vk::DeviceSize size)
         : GenericBuffer(device, memprops, vk::BufferUsageFlagBits::eIndexBuffer, size, vk::MemoryPropertyFlagBits::eDeviceLocal) {}
+
+    IndexBuffer(const vks::Context& context, vk::DeviceSize size)
+        : GenericBuffer(context, vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst, size) {}
 };
 
 /// This class is a specialisation of GenericBuffer for low performance vertex buffers in CPU memory.
@@ -1311,6 +1426,15 @@ public:
         : GenericBuffer(device, memprops, vk::BufferUsageFlagBits::eIndexBuffer, value.size() * sizeof(Type), vk::MemoryPropertyFlagBits::eHostVisible) {
         updateLocal(device, value);
     }
+
+    template <class Type, class Allocator>
+    HostIndexBuffer(const vks::Context& context, const std::vector<Type, Allocator>& value)
+        : GenericBuffer(context,
+                        vk::BufferUsageFlagBits::eIndexBuffer,
+                        value.size() * sizeof(Type),
+                        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent) {
+        updateLocal(value.data(), value.size() * sizeof(Type));
+    }
 };
 
 /// This class is a specialisation of GenericBuffer for uniform buffers.
@@ -1325,16 +1449,24 @@ public:
                         vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst,
                         (vk::DeviceSize)size,
                         vk::MemoryPropertyFlagBits::eDeviceLocal) {}
+
+    /// Device local uniform buffer, sub-allocated from the context's allocator.
+    UniformBuffer(const vks::Context& context, size_t size)
+        : GenericBuffer(context, vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst, (vk::DeviceSize)size) {}
 };
 
 /// Convenience class for updating descriptor sets (uniforms)
 class DescriptorSetUpdater {
 public:
     DescriptorSetUpdater(int maxBuffers = 10, int maxImages = 10, int maxBufferViews = 0) {
-        // we must pre-size these buffers as we take pointers to their members.
-        bufferInfo_.resize(maxBuffers);
-        imageInfo_.resize(maxImages);
-        bufferViews_.resize(maxBufferViews);
+        // we must pre-size the storage as we take pointers into it.  Images, buffers and buffer views share one block,
+        // so that update templates can address all of them from a single pointer
+        maxBuffers_ = maxBuffers;
+        maxImages_ = maxImages;
+        maxBufferViews_ = maxBufferViews;
+        bufferOffset_ = sizeof(vk::DescriptorImageInfo) * maxImages;
+        bufferViewOffset_ = bufferOffset_ + sizeof(vk::DescriptorBufferInfo) * maxBuffers;
+        storage_.resize((bufferViewOffset_ + sizeof(vk::BufferView) * maxBufferViews + sizeof(uint64_t) - 1) / sizeof(uint64_t));
     }
 
     /// Call this to begin a new descriptor set.
@@ -1348,15 +1480,15 @@ public:
         wdesc.dstArrayElement = dstArrayElement;
         wdesc.descriptorCount = 0;
         wdesc.descriptorType = descriptorType;
-        wdesc.pImageInfo = imageInfo_.data() + numImages_;
+        wdesc.pImageInfo = imageInfo() + numImages_;
         descriptorWrites_.push_back(wdesc);
     }
 
     /// Call this to add a combined image sampler.
     void image(vk::Sampler sampler, vk::ImageView imageView, vk::ImageLayout imageLayout) {
-        if (!descriptorWrites_.empty() && numImages_ != imageInfo_.size() && descriptorWrites_.back().pImageInfo) {
+        if (!descriptorWrites_.empty() && numImages_ != maxImages_ && descriptorWrites_.back().pImageInfo) {
             descriptorWrites_.back().descriptorCount++;
-            imageInfo_[numImages_++] = vk::DescriptorImageInfo{ sampler, imageView, imageLayout };
+            imageInfo()[numImages_++] = vk::DescriptorImageInfo{ sampler, imageView, imageLayout };
         } else {
             ok_ = false;
         }
@@ -1370,15 +1502,15 @@ public:
         wdesc.dstArrayElement = dstArrayElement;
         wdesc.descriptorCount = 0;
         wdesc.descriptorType = descriptorType;
-        wdesc.pBufferInfo = bufferInfo_.data() + numBuffers_;
+        wdesc.pBufferInfo = bufferInfo() + numBuffers_;
         descriptorWrites_.push_back(wdesc);
     }
 
     /// Call this to add a new buffer.
     void buffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize range) {
-        if (!descriptorWrites_.empty() && numBuffers_ != bufferInfo_.size() && descriptorWrites_.back().pBufferInfo) {
+        if (!descriptorWrites_.empty() && numBuffers_ != maxBuffers_ && descriptorWrites_.back().pBufferInfo) {
             descriptorWrites_.back().descriptorCount++;
-            bufferInfo_[numBuffers_++] = vk::DescriptorBufferInfo{ buffer, offset, range };
+            bufferInfo()[numBuffers_++] = vk::DescriptorBufferInfo{ buffer, offset, range };
         } else {
             ok_ = false;
         }
@@ -1392,20 +1524,26 @@ public:
         wdesc.dstArrayElement = dstArrayElement;
         wdesc.descriptorCount = 0;
         wdesc.descriptorType = descriptorType;
-        wdesc.pTexelBufferView = bufferViews_.data() + numBufferViews_;
+        wdesc.pTexelBufferView = bufferViews() + numBufferViews_;
         descriptorWrites_.push_back(wdesc);
     }
 
     /// Call this to add a buffer view. (Texel images)
     void bufferView(vk::BufferView view) {
-        if (!descriptorWrites_.empty() && numBufferViews_ != bufferViews_.size() && descriptorWrites_.back().pImageInfo) {
+        if (!descriptorWrites_.empty() && numBufferViews_ != maxBufferViews_ && descriptorWrites_.back().pTexelBufferView) {
             descriptorWrites_.back().descriptorCount++;
-            bufferViews_[numBufferViews_++] = view;
+            bufferViews()[numBufferViews_++] = view;
         } else {
             ok_ = false;
         }
     }
 
+    /// Replace the `index`th image, buffer or buffer view added so far, counted across all bindings, without
+    /// redoing the writes.  With a template from createTemplate this is all the work left per update.
+    void setImage(int index, const vk::DescriptorImageInfo& info) { imageInfo()[index] = info; }
+    void setBuffer(int index, const vk::DescriptorBufferInfo& info) { bufferInfo()[index] = info; }
+    void setBufferView(int index, vk::BufferView view) { bufferViews()[index] = view; }
+
     /// Copy an existing descriptor.
     void copy(vk::DescriptorSet srcSet,
               uint32_t srcBinding,
@@ -1420,16 +1558,84 @@ public:
     /// Call this to update the descriptor sets with their pointers (but not data).
     void update(const vk::Device& device) const { device.updateDescriptorSets(descriptorWrites_, descriptorCopies_); }
 
+    /// Compile the writes added so far into an update template for sets of `layout`.  The template reads the
+    /// updater's storage, so it can be applied by any updater built with the same sizes and the same sequence of
+    /// begin and add calls.  Copies are not part of the template.  Needs Vulkan 1.1.
+    vk::DescriptorUpdateTemplate createTemplate(const vk::Device& device, vk::DescriptorSetLayout layout, const vk::DispatchLoaderDynamic& dispatch) const {
+        return createTemplate(device, { {}, 0, nullptr, vk::DescriptorUpdateTemplateType::eDescriptorSet, layout }, dispatch);
+    }
+
+    /// The same for vkCmdPushDescriptorSetWithTemplateKHR, for set `set` of `pipelineLayout`, whose layout was
+    /// created with vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptorKHR.  Needs VK_KHR_push_descriptor.
+    vk::DescriptorUpdateTemplate createPushTemplate(const vk::Device& device,
+                                                    vk::PipelineBindPoint bindPoint,
+                                                    vk::PipelineLayout pipelineLayout,
+                                                    uint32_t set,
+                                                    const vk::DispatchLoaderDynamic& dispatch) const {
+        return createTemplate(device, { {}, 0, nullptr, vk::DescriptorUpdateTemplateType::ePushDescriptorsKHR, nullptr, bindPoint, pipelineLayout, set },
+                              dispatch);
+    }
+
+    /// Write the current contents to the set passed to beginDescriptorSet, through a template from createTemplate
+    void update(const vk::Device& device, vk::DescriptorUpdateTemplate updateTemplate, const vk::DispatchLoaderDynamic& dispatch) const {
+        device.updateDescriptorSetWithTemplate(dstSet_, updateTemplate, storage_.data(), dispatch);
+    }
+
+    /// Push the current contents into `commandBuffer`, through a template from createPushTemplate
+    void push(const vk::CommandBuffer& commandBuffer,
+              vk::DescriptorUpdateTemplate updateTemplate,
+              vk::PipelineLayout pipelineLayout,
+              uint32_t set,
+              const vk::DispatchLoaderDynamic& dispatch) const {
+        commandBuffer.pushDescriptorSetWithTemplateKHR(updateTemplate, pipelineLayout, set, storage_.data(), dispatch);
+    }
+
     /// Returns true if the updater is error free.
     bool ok() const { return ok_; }
 
 private:
-    std::vector<vk::DescriptorBufferInfo> bufferInfo_;
-    std::vector<vk::DescriptorImageInfo> imageInfo_;
+    vk::DescriptorUpdateTemplate createTemplate(const vk::Device& device,
+                                                vk::DescriptorUpdateTemplateCreateInfo createInfo,
+                                                const vk::DispatchLoaderDynamic& dispatch) const {
+        const uint8_t* base = reinterpret_cast<const uint8_t*>(storage_.data());
+        std::vector<vk::DescriptorUpdateTemplateEntry> entries;
+        entries.reserve(descriptorWrites_.size());
+        for (const auto& write : descriptorWrites_) {
+            if (!write.descriptorCount) {
+                continue;
+            }
+            const void* first = write.pTexelBufferView;
+            size_t stride = sizeof(vk::BufferView);
+            if (write.pImageInfo) {
+                first = write.pImageInfo;
+                stride = sizeof(vk::DescriptorImageInfo);
+            } else if (write.pBufferInfo) {
+                first = write.pBufferInfo;
+                stride = sizeof(vk::DescriptorBufferInfo);
+            }
+            entries.emplace_back(write.dstBinding, write.dstArrayElement, write.descriptorCount, write.descriptorType,
+                                 (size_t)(static_cast<const uint8_t*>(first) - base), stride);
+        }
+        createInfo.descriptorUpdateEntryCount = (uint32_t)entries.size();
+        createInfo.pDescriptorUpdateEntries = entries.data();
+        return device.createDescriptorUpdateTemplate(createInfo, nullptr, dispatch);
+    }
+
+    uint8_t* bytes() { return reinterpret_cast<uint8_t*>(storage_.data()); }
+    vk::DescriptorImageInfo* imageInfo() { return reinterpret_cast<vk::DescriptorImageInfo*>(bytes()); }
+    vk::DescriptorBufferInfo* bufferInfo() { return reinterpret_cast<vk::DescriptorBufferInfo*>(bytes() + bufferOffset_); }
+    vk::BufferView* bufferViews() { return reinterpret_cast<vk::BufferView*>(bytes() + bufferViewOffset_); }
+
+    // Images, then buffers, then buffer views, in 8 byte words to keep every entry aligned
+    std::vector<uint64_t> storage_;
+    size_t bufferOffset_ = 0;
+    size_t bufferViewOffset_ = 0;
     std::vector<vk::WriteDescriptorSet> descriptorWrites_;
     std::vector<vk::CopyDescriptorSet> descriptorCopies_;
-    std::vector<vk::BufferView> bufferViews_;
     vk::DescriptorSet dstSet_;
+    int maxBuffers_ = 0;
+    int maxImages_ = 0;
+    int maxBufferViews_ = 0;
     int numBuffers_ = 0;
     int numImages_ = 0;
     int numBufferViews_ = 0;
@@ -1515,6 +1721,9 @@ private:
 
 /// Generic image with a view and memory object.
 /// Vulkan images need a memory object to hold the data and a view object for the GPU to access the data.
+///
+/// Host images stay mapped for their whole lifetime.  Uploads through a vks::Context are recorded into its pending
+/// upload batch rather than submitted and waited for on the spot.
 class GenericImage {
 public:
     GenericImage() {}
@@ -1528,27 +1737,39 @@ public:
         create(device, memprops, info, viewType, aspectMask, makeHostImage);
     }
 
-    vk::Image image() const { return *s.image; }
-    vk::ImageView imageView() const { return *s.imageView; }
-    vk::DeviceMemory mem() const { return *s.mem; }
+    /// An image sub-allocated from the context's allocator.
+    GenericImage(const vks::Context& context,
+                 const vk::ImageCreateInfo& info,
+                 vk::ImageViewType viewType,
+                 vk::ImageAspectFlags aspectMask,
+                 bool makeHostImage) {
+        create(context, info, viewType, aspectMask, makeHostImage);
+    }
+
+    vk::Image image() const { return s.image->image; }
+    vk::ImageView imageView() const { return s.image->view; }
+    /// The memory object may be shared with other resources, starting at memOffset().
+    vk::DeviceMemory mem() const { return s.image->memory; }
+    vk::DeviceSize memOffset() const { return s.image->offset; }
 
     /// Clear the colour of an image.
     void clear(vk::CommandBuffer cb, const std::array<float, 4> colour = { 1, 1, 1, 1 }) {
         setLayout(cb, vk::ImageLayout::eTransferDstOptimal);
         vk::ClearColorValue ccv(colour);
         vk::ImageSubresourceRange range{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
-        cb.clearColorImage(*s.image, vk::ImageLayout::eTransferDstOptimal, ccv, range);
+        cb.clearColorImage(s.image->image, vk::ImageLayout::eTransferDstOptimal, ccv, range);
     }
 
-    /// Update the image with an array of pixels. (Currently 2D only)
+    /// Update a host image with an array of pixels. (Currently 2D only)
     void update(vk::Device device, const void* data, vk::DeviceSize bytesPerPixel) {
+        assert(s.image->mapped);
         const uint8_t* src = (const uint8_t*)data;
         for (uint32_t mipLevel = 0; mipLevel != info().mipLevels; ++mipLevel) {
             // Array images are layed out horizontally. eg. [left][front][right] etc.
             for (uint32_t arrayLayer = 0; arrayLayer != info().arrayLayers; ++arrayLayer) {
                 vk::ImageSubresource subresource{ vk::ImageAspectFlagBits::eColor, mipLevel, arrayLayer };
-                auto srlayout = device.getImageSubresourceLayout(*s.image, subresource);
-                uint8_t* dest = (uint8_t*)device.mapMemory(*s.mem, 0, s.size, vk::MemoryMapFlags{}) + srlayout.offset;
+                auto srlayout = device.getImageSubresourceLayout(s.image->image, subresource);
+                uint8_t* dest = (uint8_t*)s.image->mapped + srlayout.offset;
                 size_t bytesPerLine = s.info.extent.width * bytesPerPixel;
                 size_t srcStride = bytesPerLine * info().arrayLayers;
                 for (int y = 0; y != s.info.extent.height; ++y) {
@@ -1558,7 +1779,6 @@ public:
                 }
             }
         }
-        device.unmapMemory(*s.mem);
     }
 
     /// Copy another image to this one. This also changes the layout.
@@ -1570,7 +1790,7 @@ public:
             region.srcSubresource = { vk::ImageAspectFlagBits::eColor, mipLevel, 0, 1 };
             region.dstSubresource = { vk::ImageAspectFlagBits::eColor, mipLevel, 0, 1 };
             region.extent = s.info.extent;
-            cb.copyImage(srcImage.image(), vk::ImageLayout::eTransferSrcOptimal, *s.image, vk::ImageLayout::eTransferDstOptimal, region);
+            cb.copyImage(srcImage.image(), vk::ImageLayout::eTransferSrcOptimal, s.image->image, vk::ImageLayout::eTransferDstOptimal, region);
         }
     }
 
@@ -1592,30 +1812,27 @@ public:
         extent.depth = depth;
         region.imageSubresource = { vk::ImageAspectFlagBits::eColor, mipLevel, arrayLayer, 1 };
         region.imageExtent = extent;
-        cb.copyBufferToImage(buffer, *s.image, vk::ImageLayout::eTransferDstOptimal, region);
+        cb.copyBufferToImage(buffer, s.image->image, vk::ImageLayout::eTransferDstOptimal, region);
+    }
+
+    /// Upload all mips and layers, tightly packed, through the context's staging ring and leave the image
+    /// ready for shader reads.  The commands are recorded into the context's pending upload batch.
+    void upload(const vks::Context& context, const std::vector<uint8_t>& bytes) {
+        context.stageUpload(bytes.size(), bytes.data(), context.getImageStagingAlignment(),
+                            [&](const vk::CommandBuffer& cb, const vk::Buffer& staging, vk::DeviceSize stagingOffset) {
+                                recordUpload(cb, staging, (uint32_t)stagingOffset);
+                            });
     }
 
+    /// As above, but submitted on its own and waited for.
+    /// Note that this will stall the pipeline!
     void upload(vk::Device device, std::vector<uint8_t>& bytes, vk::CommandPool commandPool, vk::PhysicalDeviceMemoryProperties memprops, vk::Queue queue) {
         vku::GenericBuffer stagingBuffer(device, memprops, (vk::BufferUsageFlags)vk::BufferUsageFlagBits::eTransferSrc, (vk::DeviceSize)bytes.size(),
                                          vk::MemoryPropertyFlagBits::eHostVisible);
-        stagingBuffer.updateLocal(device, (const void*)bytes.data(), bytes.size());
+        stagingBuffer.updateLocal((const void*)bytes.data(), bytes.size());
 
         // Copy the staging buffer to the GPU texture and set the layout.
-        vku::executeImmediately(device, commandPool, queue, [&](vk::CommandBuffer cb) {
-            auto bp = getBlockParams(s.info.format);
-            vk::Buffer buf = stagingBuffer.buffer();
-            uint32_t offset = 0;
-            for (uint32_t mipLevel = 0; mipLevel != s.info.mipLevels; ++mipLevel) {
-                auto width = mipScale(s.info.extent.width, mipLevel);
-                auto height = mipScale(s.info.extent.height, mipLevel);
-                auto depth = mipScale(s.info.extent.depth, mipLevel);
-                for (uint32_t face = 0; face != s.info.arrayLayers; ++face) {
-                    copy(cb, buf, mipLevel, face, width, height, depth, offset);
-                    offset += ((bp.bytesPerBlock + 3) & ~3) * (width * height);
-                }
-            }
-            setLayout(cb, vk::ImageLayout::eShaderReadOnlyOptimal);
-        });
+        vku::executeImmediately(device, commandPool, queue, [&](vk::CommandBuffer cb) { recordUpload(cb, stagingBuffer.buffer(), 0); });
     }
 
     /// Change the layout of this image using a memory barrier.
@@ -1630,7 +1847,7 @@ public:
         imageMemoryBarriers.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
         imageMemoryBarriers.oldLayout = oldLayout;
         imageMemoryBarriers.newLayout = newLayout;
-        imageMemoryBarriers.image = *s.image;
+        imageMemoryBarriers.image = s.image->image;
         imageMemoryBarriers.subresourceRange = { aspectMask, 0, s.info.mipLevels, 0, s.info.arrayLayers };
 
         // Put barrier on top
@@ -1729,46 +1946,68 @@ protected:
                 vk::ImageViewType viewType,
                 vk::ImageAspectFlags aspectMask,
                 bool hostImage) {
-        s.currentLayout = info.initialLayout;
-        s.info = info;
-        s.image = device.createImageUnique(info);
+        vks::Image image;
+        image.image = device.createImage(info);
 
-        // Find out how much memory and which heap to allocate from.
-        auto memreq = device.getImageMemoryRequirements(*s.image);
-        vk::MemoryPropertyFlags search{};
-        if (hostImage)
-            search = vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible;
+        // Find out how much memory and which heap to allocate from, and bind it to the image.
+        auto memreq = device.getImageMemoryRequirements(image.image);
+        static_cast<vks::Allocation&>(image) = vku::allocateDedicated(device, memprops, memreq, memoryFlags(hostImage));
+        image.format = info.format;
+        image.extent = info.extent;
+        device.bindImageMemory(image.image, image.memory, image.offset);
+        init(image, info, viewType, aspectMask, hostImage);
+    }
 
-        // Create a memory object to bind to the buffer.
-        // Note: we don't expect to be able to map the buffer.
-        vk::MemoryAllocateInfo mai{};
-        mai.allocationSize = s.size = memreq.size;
-        mai.memoryTypeIndex = vku::findMemoryTypeIndex(memprops, memreq.memoryTypeBits, search);
-        s.mem = device.allocateMemoryUnique(mai);
+    void create(const vks::Context& context, const vk::ImageCreateInfo& info, vk::ImageViewType viewType, vk::ImageAspectFlags aspectMask, bool hostImage) {
+        init(context.createImage(info, memoryFlags(hostImage)), info, viewType, aspectMask, hostImage);
+    }
 
-        device.bindImageMemory(*s.image, *s.mem, 0);
+    struct State {
+        UniqueAllocation<vks::Image> image;
+        vk::ImageLayout currentLayout;
+        vk::ImageCreateInfo info;
+    };
+
+    State s;
 
-        if (!hostImage) {
+private:
+    static vk::MemoryPropertyFlags memoryFlags(bool hostImage) {
+        if (hostImage)
+            return vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible;
+        return vk::MemoryPropertyFlagBits::eDeviceLocal;
+    }
+
+    void init(const vks::Image& image, const vk::ImageCreateInfo& info, vk::ImageViewType viewType, vk::ImageAspectFlags aspectMask, bool hostImage) {
+        s.currentLayout = info.initialLayout;
+        s.info = info;
+        s.image.reset(image);
+        if (hostImage) {
+            s.image->map();
+        } else {
             vk::ImageViewCreateInfo viewInfo{};
-            viewInfo.image = *s.image;
+            viewInfo.image = s.image->image;
             viewInfo.viewType = viewType;
             viewInfo.format = info.format;
             viewInfo.components = { vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eB, vk::ComponentSwizzle::eA };
             viewInfo.subresourceRange = vk::ImageSubresourceRange{ aspectMask, 0, info.mipLevels, 0, info.arrayLayers };
-            s.imageView = device.createImageViewUnique(viewInfo);
+            s.image->view = s.image->device.createImageView(viewInfo);
         }
     }
 
-    struct State {
-        vk::UniqueImage image;
-        vk::UniqueImageView imageView;
-        vk::UniqueDeviceMemory mem;
-        vk::DeviceSize size;
-        vk::ImageLayout currentLayout;
-        vk::ImageCreateInfo info;
-    };
-
-    State s;
+    /// Copy tightly packed mips and layers starting at `offset` of `buffer` to the image and set the layout.
+    void recordUpload(vk::CommandBuffer cb, vk::Buffer buffer, uint32_t offset) {
+        auto bp = getBlockParams(s.info.format);
+        for (uint32_t mipLevel = 0; mipLevel != s.info.mipLevels; ++mipLevel) {
+            auto width = mipScale(s.info.extent.width, mipLevel);
+            auto height = mipScale(s.info.extent.height, mipLevel);
+            auto depth = mipScale(s.info.extent.depth, mipLevel);
+            for (uint32_t face = 0; face != s.info.arrayLayers; ++face) {
+                copy(cb, buffer, mipLevel, face, width, height, depth, offset);
+                offset += ((bp.bytesPerBlock + 3) & ~3) * (width * height);
+            }
+        }
+        setLayout(cb, vk::ImageLayout::eShaderReadOnlyOptimal);
+    }
 };
 
 /// A 2D texture image living on the GPU or a staging buffer visible to the CPU.
@@ -1783,6 +2022,20 @@ public:
                    uint32_t mipLevels = 1,
                    vk::Format format = vk::Format::eR8G8B8A8Unorm,
                    bool hostImage = false) {
+        create(device, memprops, createInfo(width, height, mipLevels, format, hostImage), vk::ImageViewType::e2D, vk::ImageAspectFlagBits::eColor, hostImage);
+    }
+
+    TextureImage2D(const vks::Context& context,
+                   uint32_t width,
+                   uint32_t height,
+                   uint32_t mipLevels = 1,
+                   vk::Format format = vk::Format::eR8G8B8A8Unorm,
+                   bool hostImage = false) {
+        create(context, createInfo(width, height, mipLevels, format, hostImage), vk::ImageViewType::e2D, vk::ImageAspectFlagBits::eColor, hostImage);
+    }
+
+private:
+    static vk::ImageCreateInfo createInfo(uint32_t width, uint32_t height, uint32_t mipLevels, vk::Format format, bool hostImage) {
         vk::ImageCreateInfo info;
         info.flags = {};
         info.imageType = vk::ImageType::e2D;
@@ -1797,10 +2050,8 @@ public:
         info.queueFamilyIndexCount = 0;
         info.pQueueFamilyIndices = nullptr;
         info.initialLayout = hostImage ? vk::ImageLayout::ePreinitialized : vk::ImageLayout::eUndefined;
-        create(device, memprops, info, vk::ImageViewType::e2D, vk::ImageAspectFlagBits::eColor, hostImage);
+        return info;
     }
-
-private:
 };
 
 /// A cube map texture image living on the GPU or a staging buffer visible to the CPU.
@@ -1815,6 +2066,20 @@ public:
                      uint32_t mipLevels = 1,
                      vk::Format format = vk::Format::eR8G8B8A8Unorm,
                      bool hostImage = false) {
+        create(device, memprops, createInfo(width, height, mipLevels, format, hostImage), vk::ImageViewType::eCube, vk::ImageAspectFlagBits::eColor, hostImage);
+    }
+
+    TextureImageCube(const vks::Context& context,
+                     uint32_t width,
+                     uint32_t height,
+                     uint32_t mipLevels = 1,
+                     vk::Format format = vk::Format::eR8G8B8A8Unorm,
+                     bool hostImage = false) {
+        create(context, createInfo(width, height, mipLevels, format, hostImage), vk::ImageViewType::eCube, vk::ImageAspectFlagBits::eColor, hostImage);
+    }
+
+private:
+    static vk::ImageCreateInfo createInfo(uint32_t width, uint32_t height, uint32_t mipLevels, vk::Format format, bool hostImage) {
         vk::ImageCreateInfo info;
         info.flags = {};
         info.imageType = vk::ImageType::e2D;
@@ -1830,10 +2095,8 @@ public:
         info.pQueueFamilyIndices = nullptr;
         //info.initialLayout = hostImage ? vk::ImageLayout::ePreinitialized : vk::ImageLayout::eUndefined;
         info.initialLayout = vk::ImageLayout::ePreinitialized;
-        create(device, memprops, info, vk::ImageViewType::eCube, vk::ImageAspectFlagBits::eColor, hostImage);
+        return info;
     }
-
-private:
 };
 
 /// An image to use as a depth buffer on a renderpass.
@@ -1846,6 +2109,18 @@ public:
                       uint32_t width,
                       uint32_t height,
                       vk::Format format = vk::Format::eD24UnormS8Uint) {
+        create(device, memprops, createInfo(width, height, format), vk::ImageViewType::e2D, vk::ImageAspectFlagBits::eDepth, false);
+    }
+
+    DepthStencilImage(const vks::Context& context,
+                      uint32_t width,
+                      uint32_t height,
+                      vk::Format format = vk::Format::eD24UnormS8Uint) {
+        create(context, createInfo(width, height, format), vk::ImageViewType::e2D, vk::ImageAspectFlagBits::eDepth, false);
+    }
+
+private:
+    static vk::ImageCreateInfo createInfo(uint32_t width, uint32_t height, vk::Format format) {
         vk::ImageCreateInfo info;
         info.flags = {};
 
@@ -1861,11 +2136,8 @@ public:
         info.queueFamilyIndexCount = 0;
         info.pQueueFamilyIndices = nullptr;
         info.initialLayout = vk::ImageLayout::eUndefined;
-        typedef vk::ImageAspectFlagBits iafb;
-        create(device, memprops, info, vk::ImageViewType::e2D, iafb::eDepth, false);
+        return info;
     }
-
-private:
 };
 
 /// An image to use as a colour buffer on a renderpass.
@@ -1878,6 +2150,18 @@ public:
                          uint32_t width,
                          uint32_t height,
                          vk::Format format = vk::Format::eR8G8B8A8Unorm) {
+        create(device, memprops, createInfo(width, height, format), vk::ImageViewType::e2D, vk::ImageAspectFlagBits::eColor, false);
+    }
+
+    ColorAttachmentImage(const vks::Context& context,
+                         uint32_t width,
+                         uint32_t height,
+                         vk::Format format = vk::Format::eR8G8B8A8Unorm) {
+        create(context, createInfo(width, height, format), vk::ImageViewType::e2D, vk::ImageAspectFlagBits::eColor, false);
+    }
+
+private:
+    static vk::ImageCreateInfo createInfo(uint32_t width, uint32_t height, vk::Format format) {
         vk::ImageCreateInfo info;
         info.flags = {};
 
@@ -1893,11 +2177,8 @@ public:
         info.queueFamilyIndexCount = 0;
         info.pQueueFamilyIndices = nullptr;
         info.initialLayout = vk::ImageLayout::eUndefined;
-        typedef vk::ImageAspectFlagBits iafb;
-        create(device, memprops, info, vk::ImageViewType::e2D, iafb::eColor, false);
+        return info;
     }
-
-private:
 };
 
 /// A class to help build samplers.
@@ -2131,6 +2412,16 @@ public:
     uint32_t height(uint32_t mipLevel) const { return mipScale(header.pixelHeight, mipLevel); }
     uint32_t depth(uint32_t mipLevel) const { return mipScale(header.pixelDepth, mipLevel); }
 
+    /// Copy the file to `image` through the context's staging ring, recorded into the pending upload batch.
+    void upload(const vks::Context& context, vku::GenericImage& image, const std::vector<uint8_t>& bytes) {
+        context.stageUpload(bytes.size(), bytes.data(), context.getImageStagingAlignment(),
+                            [&](const vk::CommandBuffer& cb, const vk::Buffer& staging, vk::DeviceSize stagingOffset) {
+                                recordUpload(cb, image, staging, (uint32_t)stagingOffset);
+                            });
+    }
+
+    /// As above, but submitted on its own and waited for.
+    /// Note that this will stall the pipeline!
     void upload(vk::Device device,
                 vku::GenericImage& image,
                 std::vector<uint8_t>& bytes,
@@ -2139,24 +2430,25 @@ public:
                 vk::Queue queue) {
         vku::GenericBuffer stagingBuffer(device, memprops, (vk::BufferUsageFlags)vk::BufferUsageFlagBits::eTransferSrc, (vk::DeviceSize)bytes.size(),
                                          vk::MemoryPropertyFlagBits::eHostVisible);
-        stagingBuffer.updateLocal(device, (const void*)bytes.data(), bytes.size());
+        stagingBuffer.updateLocal((const void*)bytes.data(), bytes.size());
 
         // Copy the staging buffer to the GPU texture and set the layout.
-        vku::executeImmediately(device, commandPool, queue, [&](vk::CommandBuffer cb) {
-            vk::Buffer buf = stagingBuffer.buffer();
-            for (uint32_t mipLevel = 0; mipLevel != mipLevels(); ++mipLevel) {
-                auto width = this->width(mipLevel);
-                auto height = this->height(mipLevel);
-                auto depth = this->depth(mipLevel);
-                for (uint32_t face = 0; face != faces(); ++face) {
-                    image.copy(cb, buf, mipLevel, face, width, height, depth, offset(mipLevel, 0, face));
-                }
-            }
-            image.setLayout(cb, vk::ImageLayout::eShaderReadOnlyOptimal);
-        });
+        vku::executeImmediately(device, commandPool, queue, [&](vk::CommandBuffer cb) { recordUpload(cb, image, stagingBuffer.buffer(), 0); });
     }
 
 private:
+    void recordUpload(vk::CommandBuffer cb, vku::GenericImage& image, vk::Buffer buffer, uint32_t bufferOffset) {
+        for (uint32_t mipLevel = 0; mipLevel != mipLevels(); ++mipLevel) {
+            auto width = this->width(mipLevel);
+            auto height = this->height(mipLevel);
+            auto depth = this->depth(mipLevel);
+            for (uint32_t face = 0; face != faces(); ++face) {
+                image.copy(cb, buffer, mipLevel, face, width, height, depth, bufferOffset + offset(mipLevel, 0, face));
+            }
+        }
+        image.setLayout(cb, vk::ImageLayout::eShaderReadOnlyOptimal);
+    }
+
     static void swap(uint32_t& value) { value = value >> 24 | (value & 0xff0000) >> 8 | (value & 0xff00) << 8 | value << 24; }
 
     struct Header {
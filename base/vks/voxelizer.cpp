@@ -0,0 +1,255 @@
+#include "voxelizer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "barriers.hpp"
+#include "context.hpp"
+#include "pipelines.hpp"
+#include "shaders.hpp"
+
+using namespace vks;
+
+namespace {
+
+// Must match the local size of voxel_resolve.comp and voxel_mip.comp
+const uint32_t GROUP_SIZE = 4;
+
+const vk::Format FORMAT = vk::Format::eR8G8B8A8Unorm;
+
+bool isPowerOfTwo(uint32_t value) {
+    return value && !(value & (value - 1));
+}
+
+}  // namespace
+
+bool Voxelizer::supported(const vks::Context& context) {
+    return context.enabledFeatures.geometryShader && context.enabledFeatures.fragmentStoresAndAtomics;
+}
+
+void Voxelizer::create(const vks::Context& context, const std::string& assetPath, uint32_t resolution, const model::VertexLayout& vertexLayout) {
+    if (!supported(context)) {
+        throw std::runtime_error("Voxelization needs the geometryShader and fragmentStoresAndAtomics features");
+    }
+    if (!isPowerOfTwo(resolution)) {
+        throw std::runtime_error("The voxel grid resolution must be a power of two");
+    }
+    if (vertexLayout.componentIndex(model::VERTEX_COMPONENT_POSITION) != 0) {
+        throw std::runtime_error("The vertex layout of voxelized models must start with the position");
+    }
+    this->context = &context;
+    device = context.device;
+    size = resolution;
+    setBounds(glm::vec3(-1.0f), glm::vec3(1.0f));
+
+    uint32_t levelCount = 1;
+    while ((resolution >> levelCount) != 0) {
+        ++levelCount;
+    }
+    vk::ImageCreateInfo imageCreateInfo;
+    imageCreateInfo.imageType = vk::ImageType::e3D;
+    imageCreateInfo.extent = vk::Extent3D{ size, size, size };
+    imageCreateInfo.mipLevels = 1;
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.format = vk::Format::eR32Uint;
+    imageCreateInfo.usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferDst;
+    grid = context.createImage(imageCreateInfo);
+    imageCreateInfo.mipLevels = levelCount;
+    imageCreateInfo.format = FORMAT;
+    imageCreateInfo.usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled;
+    voxels = context.createImage(imageCreateInfo);
+
+    vk::ImageViewCreateInfo viewCreateInfo;
+    viewCreateInfo.viewType = vk::ImageViewType::e3D;
+    viewCreateInfo.image = grid.image;
+    viewCreateInfo.format = vk::Format::eR32Uint;
+    viewCreateInfo.subresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
+    grid.view = device.createImageView(viewCreateInfo);
+    viewCreateInfo.image = voxels.image;
+    viewCreateInfo.format = FORMAT;
+    viewCreateInfo.subresourceRange.levelCount = levelCount;
+    voxels.view = device.createImageView(viewCreateInfo);
+    // Storage images can only be bound one level at a time
+    viewCreateInfo.subresourceRange.levelCount = 1;
+    for (uint32_t level = 0; level < levelCount; ++level) {
+        viewCreateInfo.subresourceRange.baseMipLevel = level;
+        levelViews.push_back(device.createImageView(viewCreateInfo));
+    }
+    vk::SamplerCreateInfo samplerCreateInfo;
+    samplerCreateInfo.magFilter = vk::Filter::eLinear;
+    samplerCreateInfo.minFilter = vk::Filter::eLinear;
+    samplerCreateInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
+    samplerCreateInfo.addressModeU = vk::SamplerAddressMode::eClampToBorder;
+    samplerCreateInfo.addressModeV = samplerCreateInfo.addressModeU;
+    samplerCreateInfo.addressModeW = samplerCreateInfo.addressModeU;
+    samplerCreateInfo.borderColor = vk::BorderColor::eFloatTransparentBlack;
+    samplerCreateInfo.maxLod = (float)levelCount;
+    voxels.sampler = acquireSampler(device, samplerCreateInfo);
+    // Both stay in General, they're written by shaders every time and the grid is cleared
+    context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+        context.setImageLayout(commandBuffer, grid.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral,
+                               vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
+        context.setImageLayout(commandBuffer, voxels.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral,
+                               vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, levelCount, 0, 1 });
+    });
+
+    // Nothing but the grid is written, so the render pass has no attachments, only the extent of a face of the grid
+    vk::SubpassDescription subpass;
+    subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+    renderPass = device.createRenderPass({ {}, 0, nullptr, 1, &subpass });
+    framebuffer = device.createFramebuffer({ {}, renderPass, 0, nullptr, size, size, 1 });
+
+    vk::DescriptorSetLayoutBinding binding{ 0, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eFragment };
+    drawSetLayout = device.createDescriptorSetLayout({ {}, 1, &binding });
+    const vk::DescriptorSetLayoutBinding mipBindings[2]{
+        { 0, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute },
+        { 1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute },
+    };
+    mipSetLayout = device.createDescriptorSetLayout({ {}, 2, mipBindings });
+    vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, sizeof(PushConsts) };
+    pipelineLayout = device.createPipelineLayout({ {}, 1, &drawSetLayout, 1, &pushConstantRange });
+    mipPipelineLayout = device.createPipelineLayout({ {}, 1, &mipSetLayout });
+
+    vk::DescriptorPoolSize poolSize{ vk::DescriptorType::eStorageImage, 1 + 2 * levelCount };
+    descriptorPool = device.createDescriptorPool({ {}, 1 + levelCount, 1, &poolSize });
+    drawSet = device.allocateDescriptorSets({ descriptorPool, 1, &drawSetLayout })[0];
+    const std::vector<vk::DescriptorSetLayout> mipSetLayouts(levelCount, mipSetLayout);
+    mipSets = device.allocateDescriptorSets({ descriptorPool, levelCount, mipSetLayouts.data() });
+    std::vector<vk::DescriptorImageInfo> imageInfos;
+    imageInfos.reserve(1 + levelCount);
+    imageInfos.push_back({ nullptr, grid.view, vk::ImageLayout::eGeneral });
+    for (const auto& view : levelViews) {
+        imageInfos.push_back({ nullptr, view, vk::ImageLayout::eGeneral });
+    }
+    std::vector<vk::WriteDescriptorSet> writes{ { drawSet, 0, 0, 1, vk::DescriptorType::eStorageImage, &imageInfos[0] } };
+    for (uint32_t level = 0; level < levelCount; ++level) {
+        writes.push_back({ mipSets[level], 0, 0, 1, vk::DescriptorType::eStorageImage, &imageInfos[level] });
+        writes.push_back({ mipSets[level], 1, 0, 1, vk::DescriptorType::eStorageImage, &imageInfos[level + 1] });
+    }
+    device.updateDescriptorSets(writes, nullptr);
+
+    pipelines::GraphicsPipelineBuilder builder{ device, pipelineLayout, renderPass };
+    builder.rasterizationState.cullMode = vk::CullModeFlagBits::eNone;
+    builder.depthStencilState = false;
+    builder.colorBlendState.blendAttachmentStates.clear();
+    builder.vertexInputState.appendVertexLayout(vertexLayout);
+    vk::PipelineRasterizationConservativeStateCreateInfoEXT conservativeState;
+    if (context.conservativeRasterizationEnabled) {
+        conservativeState.conservativeRasterizationMode = vk::ConservativeRasterizationModeEXT::eOverestimate;
+        builder.rasterizationState.pNext = &conservativeState;
+    }
+    builder.loadShader(assetPath + "shaders/base/voxelize.vert.spv", vk::ShaderStageFlagBits::eVertex);
+    builder.loadShader(assetPath + "shaders/base/voxelize.geom.spv", vk::ShaderStageFlagBits::eGeometry);
+    builder.loadShader(assetPath + "shaders/base/voxelize.frag.spv", vk::ShaderStageFlagBits::eFragment);
+    pipeline = builder.create(context.pipelineCache);
+
+    vk::ComputePipelineCreateInfo pipelineCreateInfo;
+    pipelineCreateInfo.layout = mipPipelineLayout;
+    pipelineCreateInfo.stage = shaders::loadShader(device, assetPath + "shaders/base/voxel_resolve.comp.spv", vk::ShaderStageFlagBits::eCompute);
+    resolvePipeline = device.createComputePipeline(context.pipelineCache, pipelineCreateInfo);
+    device.destroyShaderModule(pipelineCreateInfo.stage.module);
+    pipelineCreateInfo.stage = shaders::loadShader(device, assetPath + "shaders/base/voxel_mip.comp.spv", vk::ShaderStageFlagBits::eCompute);
+    mipPipeline = device.createComputePipeline(context.pipelineCache, pipelineCreateInfo);
+    device.destroyShaderModule(pipelineCreateInfo.stage.module);
+}
+
+void Voxelizer::destroy() {
+    if (!device) {
+        return;
+    }
+    device.destroyPipeline(pipeline);
+    device.destroyPipeline(resolvePipeline);
+    device.destroyPipeline(mipPipeline);
+    device.destroyPipelineLayout(pipelineLayout);
+    device.destroyPipelineLayout(mipPipelineLayout);
+    device.destroyDescriptorPool(descriptorPool);
+    device.destroyDescriptorSetLayout(drawSetLayout);
+    device.destroyDescriptorSetLayout(mipSetLayout);
+    device.destroyFramebuffer(framebuffer);
+    device.destroyRenderPass(renderPass);
+    for (const auto& view : levelViews) {
+        device.destroyImageView(view);
+    }
+    levelViews.clear();
+    mipSets.clear();
+    grid.destroy();
+    voxels.destroy();
+    pipeline = nullptr;
+    resolvePipeline = nullptr;
+    mipPipeline = nullptr;
+    pipelineLayout = nullptr;
+    mipPipelineLayout = nullptr;
+    descriptorPool = nullptr;
+    drawSetLayout = nullptr;
+    mipSetLayout = nullptr;
+    drawSet = nullptr;
+    framebuffer = nullptr;
+    renderPass = nullptr;
+    device = nullptr;
+    context = nullptr;
+}
+
+void Voxelizer::setBounds(const glm::vec3& min, const glm::vec3& max) {
+    const glm::vec3 extent = max - min;
+    const float side = std::max(std::max(extent.x, std::max(extent.y, extent.z)), 1e-6f);
+    const glm::vec3 corner = (min + max) * 0.5f - glm::vec3(side * 0.5f);
+    toVolume = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f / side)) * glm::translate(glm::mat4(1.0f), -corner);
+    voxel = side / (float)std::max(size, 1u);
+}
+
+void Voxelizer::begin(const vk::CommandBuffer& commandBuffer) {
+    using Stage = vk::PipelineStageFlagBits2KHR;
+    using Access = vk::AccessFlagBits2KHR;
+    // The previous resolve is done with the grid before it's cleared
+    Barriers barriers;
+    barriers.memory(Stage::eComputeShader, Access::eShaderStorageRead, Stage::eTransfer, Access::eTransferWrite);
+    barriers.record(commandBuffer, *context);
+    commandBuffer.clearColorImage(grid.image, vk::ImageLayout::eGeneral, vk::ClearColorValue{ std::array<uint32_t, 4>{ 0, 0, 0, 0 } },
+                                  vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
+    barriers.memory(Stage::eTransfer, Access::eTransferWrite, Stage::eFragmentShader, Access::eShaderStorageRead | Access::eShaderStorageWrite);
+    barriers.record(commandBuffer, *context);
+
+    commandBuffer.beginRenderPass(vk::RenderPassBeginInfo{ renderPass, framebuffer, vk::Rect2D{ {}, { size, size } } }, vk::SubpassContents::eInline);
+    commandBuffer.setViewport(0, vk::Viewport{ 0.0f, 0.0f, (float)size, (float)size, 0.0f, 1.0f });
+    commandBuffer.setScissor(0, vk::Rect2D{ {}, { size, size } });
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, drawSet, nullptr);
+}
+
+void Voxelizer::draw(const vk::CommandBuffer& commandBuffer, const model::Model& model, const glm::mat4& transform, const glm::vec4& color) const {
+    const PushConsts pushConsts{ toVolume * transform, color };
+    commandBuffer.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, sizeof(pushConsts), &pushConsts);
+    commandBuffer.bindVertexBuffers(0, model.vertices.buffer, { 0 });
+    commandBuffer.bindIndexBuffer(model.indices.buffer, 0, model.indexType);
+    commandBuffer.drawIndexed(model.indexCount, 1, 0, 0, 0);
+}
+
+void Voxelizer::dispatch(const vk::CommandBuffer& commandBuffer, const vk::Pipeline& pipeline, uint32_t level) const {
+    const uint32_t groups = std::max((size >> level) / GROUP_SIZE, 1u);
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, mipPipelineLayout, 0, mipSets[level], nullptr);
+    commandBuffer.dispatch(groups, groups, groups);
+}
+
+void Voxelizer::end(const vk::CommandBuffer& commandBuffer) const {
+    using Stage = vk::PipelineStageFlagBits2KHR;
+    using Access = vk::AccessFlagBits2KHR;
+    commandBuffer.endRenderPass();
+
+    // The volume is overwritten entirely, so the previous reads of it are all that has to finish first
+    Barriers barriers;
+    barriers.memory(Stage::eFragmentShader, Access::eShaderStorageWrite, Stage::eComputeShader, Access::eShaderStorageRead);
+    barriers.memory(Stage::eFragmentShader | Stage::eComputeShader, Access::eShaderSampledRead, Stage::eComputeShader, Access::eShaderStorageWrite);
+    barriers.record(commandBuffer, *context);
+    dispatch(commandBuffer, resolvePipeline, 0);
+    for (uint32_t level = 1; level < levels(); ++level) {
+        barriers.memory(Stage::eComputeShader, Access::eShaderStorageWrite, Stage::eComputeShader, Access::eShaderStorageRead);
+        barriers.record(commandBuffer, *context);
+        dispatch(commandBuffer, mipPipeline, level);
+    }
+    barriers.memory(Stage::eComputeShader, Access::eShaderStorageWrite, Stage::eFragmentShader | Stage::eComputeShader, Access::eShaderSampledRead);
+    barriers.record(commandBuffer, *context);
+}
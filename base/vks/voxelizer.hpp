@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "image.hpp"
+#include "forward.hpp"
+#include "model.hpp"
+
+namespace vks {
+
+// Renders models into a cubic grid of voxels, and filters the grid into a mip chain for cone traced GI or AO.
+//
+// Every triangle is rasterized once, by a geometry shader, onto the face of the grid its normal points at most, so
+// it covers as many voxels as it can, and the fragment shader marks the voxel of every fragment with an atomic max
+// of its packed color.  With Context::conservativeRasterizationEnabled the triangles are rasterized conservatively,
+// so thin and steep triangles don't leave gaps in the surfaces.
+//
+// The result is an RGBA8 3D texture, the color in RGB and the fraction of the voxel covered in alpha, which every
+// mip level averages weighted by coverage.  Needs the geometryShader and fragmentStoresAndAtomics features, see
+// supported.
+class Voxelizer {
+public:
+    static bool supported(const vks::Context& context);
+
+    // A grid of `resolution` voxels along each axis, a power of two, for models of `vertexLayout`, which must start
+    // with the position.  The shaders are loaded from `assetPath`.
+    void create(const vks::Context& context, const std::string& assetPath, uint32_t resolution, const model::VertexLayout& vertexLayout);
+    void destroy();
+
+    operator bool() const { return pipeline.operator bool(); }
+
+    // The box the grid covers, extended to a cube around its center, in the space the models are drawn in
+    void setBounds(const glm::vec3& min, const glm::vec3& max);
+    // From that space to the texture coordinates of the volume
+    const glm::mat4& worldToVolume() const { return toVolume; }
+    // The size of a voxel of level 0 in that space
+    float voxelSize() const { return voxel; }
+
+    // Clears the grid and starts the render pass the models are drawn in.  Must be recorded outside of a render pass.
+    void begin(const vk::CommandBuffer& commandBuffer);
+    // Voxelize all of `model`, transformed by `transform` into the space of the bounds, in `color`
+    void draw(const vk::CommandBuffer& commandBuffer,
+              const model::Model& model,
+              const glm::mat4& transform = glm::mat4(1.0f),
+              const glm::vec4& color = glm::vec4(1.0f)) const;
+    // Ends the render pass and builds the mip chain, ordered before the fragment and compute shaders of later commands
+    void end(const vk::CommandBuffer& commandBuffer) const;
+
+    // In General layout, with a trilinear sampler clamping to transparent black
+    const vks::Image& volume() const { return voxels; }
+    uint32_t resolution() const { return size; }
+    uint32_t levels() const { return (uint32_t)levelViews.size(); }
+
+private:
+    // Must match the PushConsts block of voxelize.vert and voxelize.frag
+    struct PushConsts {
+        glm::mat4 transform;
+        glm::vec4 color;
+    };
+
+    void dispatch(const vk::CommandBuffer& commandBuffer, const vk::Pipeline& pipeline, uint32_t level) const;
+
+    const vks::Context* context{ nullptr };
+    vk::Device device;
+    uint32_t size{ 0 };
+    glm::mat4 toVolume{ 1.0f };
+    float voxel{ 1.0f };
+
+    // The packed colors the fragment shader writes, resolved into level 0 of the volume
+    vks::Image grid;
+    vks::Image voxels;
+    std::vector<vk::ImageView> levelViews;
+
+    vk::RenderPass renderPass;
+    vk::Framebuffer framebuffer;
+    vk::DescriptorPool descriptorPool;
+    vk::DescriptorSetLayout drawSetLayout;
+    vk::DescriptorSet drawSet;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline pipeline;
+    // Set `level` reads level - 1, or the grid, and writes `level`
+    vk::DescriptorSetLayout mipSetLayout;
+    std::vector<vk::DescriptorSet> mipSets;
+    vk::PipelineLayout mipPipelineLayout;
+    vk::Pipeline resolvePipeline;
+    vk::Pipeline mipPipeline;
+};
+
+}  // namespace vks
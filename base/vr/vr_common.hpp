@@ -20,6 +20,18 @@ public:
     std::array<glm::mat4, 2> eyeViews;
     std::array<glm::mat4, 2> eyeProjections;
 
+    // Shade the periphery of the eyes at lower rates, see OffscreenRenderer::Foveation.  Without shading rate images
+    // the eyes are rendered at foveationFallbackScale of their resolution instead, which the compositors scale up.
+    bool foveated{ true };
+    float foveationFallbackScale{ 0.8f };
+
+    // Motion to photon latency of the drawn poses, from sampling them to their predicted display time, and the part
+    // of it sampling them again right before the submission saved, in milliseconds averaged over recent frames
+    struct {
+        float motionToPhoton{ 0.0f };
+        float latchSaving{ 0.0f };
+    } latency;
+
     ~VrExample() {
         shapesRenderer.reset();
         // Shut down Vulkan
@@ -40,23 +52,58 @@ public:
     }
 
     void prepareVulkan() {
+        // Both eyes are rendered in a single multiview pass where the device supports it
+        context.enableMultiview = true;
+        // The scene and blit submissions of a frame go out together, with the one signalling the frame's fence
+        context.batchSubmits = true;
+        context.enableShadingRateImage = foveated;
         context.createInstance();
         surface = createSurface(context.instance);
         context.createDevice(surface);
     }
 
     void prepareSwapchain() {
-        swapchain.setup(context.physicalDevice, context.device, context.queue, context.queueIndices.graphics);
+        swapchain.setup(context.physicalDevice, context.device, context.queue, context.queueIndices.graphics, context.fencePool);
         swapchain.setSurface(surface);
         swapchain.create(vk::Extent2D{ size.x, size.y });
     }
 
     void prepareRenderer() {
-        shapesRenderer->framebufferSize = renderTargetSize;
+        shapesRenderer->multiview = context.multiviewEnabled && context.multiviewProperties.maxMultiviewViewCount >= 2;
+        // With multiview every eye is a layer of its own, instead of half of a side by side target
+        shapesRenderer->framebufferSize = shapesRenderer->multiview ? glm::uvec2{ renderTargetSize.x / 2, renderTargetSize.y } : renderTargetSize;
+        shapesRenderer->foveation.enabled = foveated;
+        if (foveated && !context.shadingRateImageEnabled) {
+            shapesRenderer->framebufferSize = glm::uvec2(glm::vec2(shapesRenderer->framebufferSize) * foveationFallbackScale);
+        }
         shapesRenderer->colorFormats = { vk::Format::eR8G8B8A8Srgb };
+        // Examples latch the eye poses sampled once more right before the submission, see latchPoses()
+        shapesRenderer->lateLatch = true;
         shapesRenderer->prepare();
     }
 
+    // Regions blitting the eyes of the render target side by side into the `dstSize` corner of another image, one per
+    // layer with multiview
+    std::vector<vk::ImageBlit> eyeBlits(const glm::uvec2& dstSize) const {
+        vk::ImageBlit blit;
+        blit.dstSubresource.aspectMask = blit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+        blit.dstSubresource.layerCount = blit.srcSubresource.layerCount = 1;
+        const auto& srcSize = shapesRenderer->framebufferSize;
+        blit.srcOffsets[1] = vk::Offset3D{ (int32_t)srcSize.x, (int32_t)srcSize.y, 1 };
+        blit.dstOffsets[1] = vk::Offset3D{ (int32_t)dstSize.x, (int32_t)dstSize.y, 1 };
+        if (!shapesRenderer->multiview) {
+            return { blit };
+        }
+        std::vector<vk::ImageBlit> result;
+        for (uint32_t eye = 0; eye < 2; ++eye) {
+            blit.srcSubresource.baseArrayLayer = eye;
+            blit.dstOffsets[0].x = (int32_t)(dstSize.x * eye / 2);
+            blit.dstOffsets[1].x = (int32_t)(dstSize.x * (eye + 1) / 2);
+            result.push_back(blit);
+        }
+        return result;
+    }
+
     virtual void recenter() = 0;
 
     void onKeyEvent(int key, int scancode, int action, int mods) override {
@@ -77,6 +124,19 @@ public:
 
     virtual void update(float delta) { shapesRenderer->update(delta, eyeProjections, eyeViews); }
 
+    // Hand the current eyeViews to the renderer for the next submission, once they were sampled `secondsToPhotons`
+    // ahead of their display, and `secondsSinceUpdate` after the poses update() drew with
+    void latchPoses(float secondsToPhotons, float secondsSinceUpdate) {
+        shapesRenderer->latch(eyeProjections, eyeViews);
+        static const float SMOOTHING = 0.05f;
+        latency.motionToPhoton += (secondsToPhotons * 1000.0f - latency.motionToPhoton) * SMOOTHING;
+        latency.latchSaving += (secondsSinceUpdate * 1000.0f - latency.latchSaving) * SMOOTHING;
+    }
+
+    std::string getLatencyText() const {
+        return std::to_string((int)latency.motionToPhoton) + " ms motion to photon, " + std::to_string((int)latency.latchSaving) + " ms saved by late latching";
+    }
+
     virtual void render() = 0;
 
     virtual std::string getWindowTitle() = 0;
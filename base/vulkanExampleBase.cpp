@@ -14,6 +14,7 @@
 #include "keycodes.hpp"
 #include "vks/storage.hpp"
 #include "vks/filesystem.hpp"
+#include "vks/trace.hpp"
 
 using namespace vkx;
 
@@ -25,7 +26,11 @@ ExampleBase::ExampleBase() {
     vkx::android::androidApp->userData = this;
     vkx::android::androidApp->onInputEvent = ExampleBase::handle_input_event;
     vkx::android::androidApp->onAppCmd = ExampleBase::handle_app_cmd;
+    framePacing = true;
+    preRotate = true;
 #endif
+    // Built by the assets_pack target, loose files are read as before without one
+    vks::storage::Storage::mountPack(getAssetPath() + "data.pack", getAssetPath());
     camera.setPerspective(60.0f, size, 0.1f, 256.0f);
 }
 
@@ -38,6 +43,8 @@ ExampleBase::~ExampleBase() {
     // FIXME destroy surface
     if (descriptorPool) {
         device.destroyDescriptorPool(descriptorPool);
+        // Sets still waiting in the frame trash check this before freeing themselves
+        descriptorPool = vk::DescriptorPool();
     }
     if (!commandBuffers.empty()) {
         device.freeCommandBuffers(cmdPool, commandBuffers);
@@ -50,16 +57,24 @@ ExampleBase::~ExampleBase() {
 
     depthStencil.destroy();
 
-    device.destroySemaphore(semaphores.acquireComplete);
-    device.destroySemaphore(semaphores.renderComplete);
-    device.destroySemaphore(semaphores.overlayComplete);
+    readback.destroy();
+    assets.destroy();
+    frameAllocator.destroy();
+    frameDescriptors.destroy();
+    descriptorAllocator.destroy();
+    destroyFrameSync();
+    // After the frame trash, which may still hold swap chains retired from their surfaces
+    destroyDisplays();
+    scheduler.reset();
+    vks::debug::marker::setProfiler(nullptr);
+    profiler.destroy();
 
     ui.destroy();
 
     context.destroy();
 
 #if defined(__ANDROID__)
-    // todo : android cleanup (if required)
+    vkx::android::stopFrameTiming();
 #else
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -67,21 +82,50 @@ ExampleBase::~ExampleBase() {
 }
 
 void ExampleBase::run() {
+    vks::startup::begin();
     try {
+        parseCommandLine();
 // Android initialization is handled in APP_CMD_INIT_WINDOW event
 #if !defined(__ANDROID__)
         glfwInit();
         setupWindow();
         initVulkan();
         setupSwapchain();
-        prepare();
+        {
+            VKS_TRACE_ZONE("ExampleBase::prepare");
+            auto prepareStart = std::chrono::high_resolution_clock::now();
+            prepare();
+            // Everything loaded during setup goes out in as few batches as possible.  Wait for it once here so that
+            // resources are also safe to use from queues other than the one they were uploaded on
+            context.flushUploads(true);
+            startupTimes.prepareMs = vks::startup::elapsed();
+            auto prepareTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - prepareStart).count();
+            vkx::logMessage(vkx::LogLevel::LOG_INFO, "prepare() took %.1f ms (%s pipeline cache)", prepareTime, context.pipelineCacheWarm ? "warm" : "cold");
+        }
 #endif
 
-        renderLoop();
+        if (benchmark.active) {
+            benchmarkLoop();
+        } else {
+            renderLoop();
+        }
 
         // Once we exit the render loop, wait for everything to become idle before proceeding to the descructor.
         context.queue.waitIdle();
         context.device.waitIdle();
+        if (!inputCapturePath.empty()) {
+            inputRecording.save(inputCapturePath);
+            vkx::logMessage(vkx::LogLevel::LOG_INFO, "%zu frames of input written to %s", inputRecording.frames.size(), inputCapturePath.c_str());
+        }
+#if defined(VKS_TRACE)
+        if (!tracePath.empty()) {
+            if (vks::trace::endCapture(tracePath)) {
+                vkx::logMessage(vkx::LogLevel::LOG_INFO, "Trace written to %s", tracePath.c_str());
+            } else {
+                vkx::logMessage(vkx::LogLevel::LOG_ERROR, "Failed to write trace %s", tracePath.c_str());
+            }
+        }
+#endif
     } catch(const std::system_error& err) {
         std::cerr << err.what() << std::endl;
     }
@@ -103,6 +147,19 @@ void ExampleBase::initVulkan() {
         if (deviceFeatures.samplerAnisotropy) {
             enabledFeatures.samplerAnisotropy = VK_TRUE;
         }
+        // Lets Context::generateMipmaps fall back to a compute downsample for formats it can't blit
+        if (deviceFeatures.shaderStorageImageWriteWithoutFormat) {
+            enabledFeatures.shaderStorageImageWriteWithoutFormat = VK_TRUE;
+        }
+        // Per pass counters for the GPU timings
+        if (deviceFeatures.pipelineStatisticsQuery) {
+            enabledFeatures.pipelineStatisticsQuery = VK_TRUE;
+        }
+        // Lets the UI overlay's geometry grow in place, see vks::SparseBuffer
+        if (deviceFeatures.sparseBinding && deviceFeatures.sparseResidencyBuffer) {
+            enabledFeatures.sparseBinding = VK_TRUE;
+            enabledFeatures.sparseResidencyBuffer = VK_TRUE;
+        }
         getEnabledFeatures();
     });
 
@@ -112,38 +169,270 @@ void ExampleBase::initVulkan() {
     context.requireExtensions(glfw::Window::getRequiredInstanceExtensions());
 #endif
     context.requireDeviceExtensions({ VK_KHR_SWAPCHAIN_EXTENSION_NAME });
-    context.createInstance(version);
+    {
+        vks::startup::ScopedPhase startupPhase(vks::startup::Phase::Instance);
+        context.createInstance(version);
+    }
+#if defined(__ANDROID__)
+    context.pipelineCachePath = std::string(vkx::android::androidApp->activity->internalDataPath) + "/" + name + ".pipelinecache";
+#else
+    context.pipelineCachePath = name + ".pipelinecache";
+    // Android reads every file through the asset manager, so cached meshes and textures couldn't be read back from
+    // internal storage
+    context.modelCachePath = name + ".modelcache";
+    context.textureCachePath = name + ".texturecache";
+    context.shaderCachePath = name + ".shadercache";
+#endif
+    context.mipmapShaderPath = getAssetPath() + "shaders/base/mipmap.comp.spv";
 
+    vks::startup::ScopedPhase devicePhase(vks::startup::Phase::Device);
 #if defined(__ANDROID__)
     surface = context.instance.createAndroidSurfaceKHR({ {}, window });
 #else
     surface = glfw::Window::createWindowSurface(window, context.instance);
 #endif
 
+    // Presentation timings for frame pacing and latency measurements, where available
+    context.enableDisplayTiming = true;
+    context.enableShaderFloat16 = supportsHalfPrecision();
     context.createDevice(surface);
+    dynamicRendering = context.dynamicRenderingEnabled;
 
     // Find a suitable depth format
     depthFormat = context.getSupportedDepthFormat();
 
     // Create synchronization objects
-
-    // A semaphore used to synchronize image presentation
-    // Ensures that the image is displayed before we start submitting new commands to the queu
-    semaphores.acquireComplete = device.createSemaphore({});
-    // A semaphore used to synchronize command submission
-    // Ensures that the image is not presented until all commands have been sumbitted and executed
-    semaphores.renderComplete = device.createSemaphore({});
-
-    semaphores.overlayComplete = device.createSemaphore({});
+    setupFrameSync();
+    descriptorAllocator.create(device);
+    frameDescriptors.create(device, (uint32_t)frames.size());
 
     renderWaitSemaphores.push_back(semaphores.acquireComplete);
     renderWaitStages.push_back(vk::PipelineStageFlagBits::eBottomOfPipe);
     renderSignalSemaphores.push_back(semaphores.renderComplete);
+    startupTimes.initVulkanMs = vks::startup::elapsed();
+}
+
+void ExampleBase::setupFrameSync() {
+    frames.resize(std::max<uint32_t>(1, framesInFlight));
+    for (auto& frame : frames) {
+        // Signaled, so that the first wait on each frame slot returns immediately
+        frame.fence = device.createFence({ vk::FenceCreateFlagBits::eSignaled });
+        // Signaled when the swap chain image is available to render to
+        frame.acquireComplete = device.createSemaphore({});
+    }
+    context.frameCommandPools.create(device, context.queueIndices.graphics, (uint32_t)frames.size());
+    currentFrame = 0;
+    semaphores.acquireComplete = frames[0].acquireComplete;
+}
+
+void ExampleBase::destroyFrameSync() {
+    for (auto& frame : frames) {
+        for (const auto& trash : frame.trash) {
+            trash();
+        }
+        context.completeDeletions(frame.deletions);
+        device.destroyFence(frame.fence);
+        device.destroySemaphore(frame.acquireComplete);
+    }
+    for (const auto& semaphore : presentSemaphores) {
+        device.destroySemaphore(semaphore);
+    }
+    presentSemaphores.clear();
+    presentSemaphoresSwapChain = vk::SwapchainKHR();
+    context.frameCommandPools.destroy();
+    frames.clear();
+    imageFences.clear();
+    semaphores.acquireComplete = semaphores.renderComplete = vk::Semaphore();
+}
+
+uint32_t ExampleBase::addDisplay(const vk::Extent2D& displaySize, const glm::ivec2& position) {
+#if defined(__ANDROID__)
+    throw std::runtime_error("Additional displays need a windowing system with more than one window");
+#else
+    if (dynamicRendering) {
+        throw std::runtime_error("Additional displays draw with the default render pass, which dynamicRendering replaces");
+    }
+    const uint32_t index = (uint32_t)displays.size();
+    // Added first, so that destroyDisplays releases whatever was made of it if the surface turns out to be unusable
+    displays.emplace_back(new Display);
+    Display& display = *displays.back();
+    display.size = displaySize;
+
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    const std::string displayTitle = title + " - " + std::to_string(index + 2);
+    display.window = glfwCreateWindow(displaySize.width, displaySize.height, displayTitle.c_str(), nullptr, nullptr);
+    if (!display.window) {
+        throw std::runtime_error("Could not create window");
+    }
+    if (position.x >= 0 && position.y >= 0) {
+        glfwSetWindowPos(display.window, position.x, position.y);
+    }
+    // Input goes to the example whichever window has the focus
+    glfwSetWindowUserPointer(display.window, this);
+    glfwSetKeyCallback(display.window, KeyboardHandler);
+    glfwSetMouseButtonCallback(display.window, MouseHandler);
+    glfwSetCursorPosCallback(display.window, MouseMoveHandler);
+    glfwSetWindowCloseCallback(display.window, CloseHandler);
+    glfwSetFramebufferSizeCallback(display.window, DisplaySizeHandler);
+    glfwSetScrollCallback(display.window, MouseScrollHandler);
+
+    display.surface = glfw::Window::createWindowSurface(display.window, context.instance);
+    if (!physicalDevice.getSurfaceSupportKHR(context.queueIndices.graphics, display.surface)) {
+        throw std::runtime_error("The graphics queue can't present to the surface of display " + std::to_string(index));
+    }
+    display.swapChain.setup(physicalDevice, device, queue, context.queueIndices.graphics, context.fencePool);
+    display.swapChain.setSurface(display.surface);
+    // The default render pass and the pipelines drawn in it were made for the main swap chain's format
+    const auto surfaceFormats = physicalDevice.getSurfaceFormatsKHR(display.surface);
+    const auto format = std::find_if(surfaceFormats.begin(), surfaceFormats.end(), [&](const vk::SurfaceFormatKHR& surfaceFormat) {
+        return surfaceFormat.format == swapChain.colorFormat || surfaceFormat.format == vk::Format::eUndefined;
+    });
+    if (format == surfaceFormats.end()) {
+        throw std::runtime_error("The surface of display " + std::to_string(index) + " doesn't support " + vk::to_string(swapChain.colorFormat));
+    }
+    display.swapChain.colorFormat = swapChain.colorFormat;
+    if (format->format != vk::Format::eUndefined) {
+        display.swapChain.colorSpace = format->colorSpace;
+    }
+    display.swapChain.config = swapChain.config;
+    display.swapChain.config.preRotate = false;
+    display.swapChain.setDisplayTiming(swapChain.displayTiming);
+    display.swapChain.retire = swapChain.retire;
+    display.framePacer.config = framePacer.config;
+    display.framePacer.setEnabled(framePacing);
+    for (size_t i = 0; i < frames.size(); ++i) {
+        display.acquireComplete.push_back(device.createSemaphore({}));
+    }
+    setupDisplay(display);
+    return index;
+#endif
+}
+
+void ExampleBase::setupDisplay(Display& display) {
+    // Frames in flight may still be rendering to the previous ones
+    for (const auto& framebuffer : display.framebuffers) {
+        context.trash(framebuffer);
+    }
+    display.framebuffers.clear();
+    if (display.depthStencil.image) {
+        context.trash(display.depthStencil);
+        display.depthStencil = vks::Image{};
+    }
+
+    display.swapChain.create(display.size, enableVsync);
+    // Presents to the old swap chain may still wait on them
+    for (const auto& semaphore : display.renderComplete) {
+        context.trash(semaphore);
+    }
+    display.renderComplete.resize(display.swapChain.imageCount);
+    for (auto& semaphore : display.renderComplete) {
+        semaphore = device.createSemaphore({});
+    }
+    display.depthStencil = createDepthStencil(display.size);
+
+    vk::ImageView attachments[2];
+    attachments[1] = display.depthStencil.view;
+    vk::FramebufferCreateInfo framebufferCreateInfo;
+    framebufferCreateInfo.renderPass = renderPass;
+    framebufferCreateInfo.attachmentCount = 2;
+    framebufferCreateInfo.pAttachments = attachments;
+    framebufferCreateInfo.width = display.size.width;
+    framebufferCreateInfo.height = display.size.height;
+    framebufferCreateInfo.layers = 1;
+    display.framebuffers = display.swapChain.createFramebuffers(framebufferCreateInfo);
+
+    // The window may have moved to a monitor with another refresh rate, and the timings refer to the old swap chain
+    display.refreshDuration = 0;
+    display.lastPresentTime = 0;
+    display.resized = false;
+}
+
+void ExampleBase::prepareDisplays() {
+#if !defined(__ANDROID__)
+    for (uint32_t i = 0; i < (uint32_t)displays.size(); ++i) {
+        auto& display = *displays[i];
+        display.active = false;
+        int width = 0;
+        int height = 0;
+        glfwGetFramebufferSize(display.window, &width, &height);
+        // Minimized, and there are no swap chains of zero size
+        if (!width || !height) {
+            continue;
+        }
+        if (display.resized) {
+            display.size = vk::Extent2D{ (uint32_t)width, (uint32_t)height };
+            setupDisplay(display);
+        }
+        const vk::Semaphore& acquireComplete = display.acquireComplete[currentFrame];
+        vk::ResultValue<uint32_t> acquired{ vk::Result::eSuccess, 0 };
+        const auto waitStart = std::chrono::high_resolution_clock::now();
+        try {
+            acquired = display.swapChain.acquireNextImage(acquireComplete);
+        } catch (const vk::OutOfDateKHRError&) {
+            // Resized before the size callback came in
+            display.size = vk::Extent2D{ (uint32_t)width, (uint32_t)height };
+            setupDisplay(display);
+            acquired = display.swapChain.acquireNextImage(acquireComplete);
+        }
+        frameWaitMilliseconds += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - waitStart).count();
+        // Still presentable, it's recreated for the next frame
+        display.resized = acquired.result == vk::Result::eSuboptimalKHR;
+
+        display.commandBuffer = context.frameCommandPools.allocate();
+        const vk::CommandBuffer& commandBuffer = display.commandBuffer;
+        commandBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+        vk::RenderPassBeginInfo beginInfo = renderPassBeginInfo;
+        beginInfo.framebuffer = display.framebuffers[acquired.value];
+        beginInfo.renderArea = vks::util::rect2D(display.size);
+        commandBuffer.beginRenderPass(beginInfo, vk::SubpassContents::eInline);
+        commandBuffer.setViewport(0, vks::util::viewport(display.size));
+        commandBuffer.setScissor(0, vks::util::rect2D(display.size));
+        updateDisplayCommandBuffer(commandBuffer, i);
+        commandBuffer.endRenderPass();
+        commandBuffer.end();
+        display.active = true;
+    }
+#endif
+}
+
+void ExampleBase::destroyDisplays() {
+    for (auto& display : displays) {
+        for (const auto& framebuffer : display->framebuffers) {
+            device.destroyFramebuffer(framebuffer);
+        }
+        display->depthStencil.destroy();
+        if (display->swapChain.swapChain) {
+            display->swapChain.destroy();
+        }
+        for (const auto& semaphore : display->acquireComplete) {
+            device.destroySemaphore(semaphore);
+        }
+        for (const auto& semaphore : display->renderComplete) {
+            device.destroySemaphore(semaphore);
+        }
+        if (display->surface) {
+            context.instance.destroySurfaceKHR(display->surface);
+        }
+#if !defined(__ANDROID__)
+        if (display->window) {
+            glfwDestroyWindow(display->window);
+        }
+#endif
+    }
+    displays.clear();
 }
 
 void ExampleBase::setupSwapchain() {
-    swapChain.setup(context.physicalDevice, context.device, context.queue, context.queueIndices.graphics);
+    swapChain.setup(context.physicalDevice, context.device, context.queue, context.queueIndices.graphics, context.fencePool);
     swapChain.setSurface(surface);
+    swapChain.setDisplayTiming(context.displayTimingEnabled ? &context.dynamicDispatch : nullptr);
+    swapChain.retire = [this](const vk::SwapchainKHR& oldSwapChain, const std::vector<vk::ImageView>& views) {
+        for (const auto& view : views) {
+            context.trash(view);
+        }
+        const vk::Device device = this->device;
+        context.trash<vk::SwapchainKHR>(oldSwapChain, [device](vk::SwapchainKHR swapChain) { device.destroySwapchainKHR(swapChain); });
+    };
 }
 
 bool ExampleBase::platformLoopCondition() {
@@ -228,6 +517,7 @@ void ExampleBase::renderLoop() {
     auto tStart = std::chrono::high_resolution_clock::now();
 
     while (platformLoopCondition()) {
+        VKS_TRACE_FRAME();
         auto tEnd = std::chrono::high_resolution_clock::now();
         auto tDiff = std::chrono::duration<float, std::milli>(tEnd - tStart).count();
         auto tDiffSeconds = tDiff / 1000.0f;
@@ -235,10 +525,401 @@ void ExampleBase::renderLoop() {
 
         // Render frame
         if (prepared) {
-            render();
-            update(tDiffSeconds);
+            if (!applyFrameInputs(tDiffSeconds)) {
+                break;
+            }
+            {
+                vks::FrameHistory::ScopedZone zone(frameHistory, "render");
+                render();
+            }
+            {
+                vks::FrameHistory::ScopedZone zone(frameHistory, "update");
+                update(tDiffSeconds);
+            }
+            endFrameHistory();
+        }
+    }
+}
+
+void ExampleBase::parseCommandLine() {
+    const auto& args = vkx::getCommandLine();
+    std::string metricsBackend;
+    vks::metrics::MetricsSink::Config metricsConfig;
+    // A frame's submissions go out in one call along with the one signalling its fence, unless --no-batch-submits
+    context.batchSubmits = true;
+    for (size_t i = 1; i < args.size(); ++i) {
+        const auto& arg = args[i];
+        const bool hasValue = i + 1 < args.size();
+        if (arg == "--benchmark") {
+            benchmark.active = true;
+        } else if (arg == "--benchmark-warmup" && hasValue) {
+            benchmark.warmupFrames = (uint32_t)std::stoul(args[++i]);
+        } else if (arg == "--benchmark-frames" && hasValue) {
+            benchmark.frameCount = (uint32_t)std::stoul(args[++i]);
+        } else if (arg == "--benchmark-timestep" && hasValue) {
+            benchmark.timestep = std::stof(args[++i]);
+        } else if (arg == "--benchmark-output" && hasValue) {
+            benchmark.outputPath = args[++i];
+        } else if (arg == "--benchmark-sweep" && hasValue) {
+            benchmark.active = true;
+            std::stringstream values(args[++i]);
+            std::string value;
+            while (std::getline(values, value, ',')) {
+                benchmark.sweep.push_back((uint32_t)std::stoul(value));
+            }
+        } else if (arg == "--present-mode" && hasValue) {
+            static const std::map<std::string, vk::PresentModeKHR> modes{
+                { "mailbox", vk::PresentModeKHR::eMailbox },
+                { "fifo", vk::PresentModeKHR::eFifo },
+                { "fifo-relaxed", vk::PresentModeKHR::eFifoRelaxed },
+                { "immediate", vk::PresentModeKHR::eImmediate },
+            };
+            auto itr = modes.find(args[++i]);
+            if (itr == modes.end()) {
+                throw std::runtime_error("Unknown present mode " + args[i]);
+            }
+            swapChain.config.presentModes = { itr->second };
+        } else if (arg == "--swapchain-images" && hasValue) {
+            swapChain.config.minImageCount = (uint32_t)std::stoul(args[++i]);
+        } else if (arg == "--frames-in-flight" && hasValue) {
+            framesInFlight = std::max(1u, (uint32_t)std::stoul(args[++i]));
+        } else if (arg == "--present-interval" && hasValue) {
+            presentTiming.interval = (uint32_t)std::stoul(args[++i]);
+            framePacing = false;
+        } else if (arg == "--frame-pacing") {
+            framePacing = true;
+        } else if (arg == "--no-frame-pacing") {
+            framePacing = false;
+        } else if (arg == "--no-pre-rotate") {
+            preRotate = false;
+        } else if (arg == "--record-per-frame") {
+            recordPerFrame = true;
+        } else if (arg == "--depth-prepass") {
+            depthPrepass = true;
+        } else if (arg == "--shader-precision" && hasValue) {
+            const std::string precision = args[++i];
+            if (precision == "full") {
+                shaderPrecision = ShaderPrecision::Full;
+            } else if (precision == "half") {
+                shaderPrecision = ShaderPrecision::Half;
+            } else if (precision == "compare") {
+                shaderPrecision = ShaderPrecision::Compare;
+            } else {
+                throw std::runtime_error("Unknown shader precision " + precision);
+            }
+        } else if (arg == "--hot-reload") {
+            context.enableShaderHotReload = true;
+        } else if (arg == "--command-stats") {
+            settings.commandStats = true;
+        } else if (arg == "--metrics" && hasValue) {
+            metricsBackend = args[++i];
+        } else if (arg == "--metrics-interval" && hasValue) {
+            metricsConfig.interval = std::stod(args[++i]);
+        } else if (arg == "--dynamic-resolution" && hasValue) {
+            dynamicResolution.config.targetMilliseconds = std::stof(args[++i]);
+            dynamicResolution.setEnabled(true);
+        } else if (arg == "--no-batch-submits") {
+            context.batchSubmits = false;
+        } else if (arg == "--dynamic-rendering") {
+            context.enableDynamicRendering = supportsDynamicRendering();
+        } else if (arg == "--dynamic-resolution-min" && hasValue) {
+            dynamicResolution.config.minScale = std::min(1.0f, std::max(0.1f, std::stof(args[++i])));
+        } else if (arg == "--capture-inputs" && hasValue) {
+            inputCapturePath = args[++i];
+        } else if (arg == "--replay-inputs" && hasValue) {
+            inputRecording.load(args[++i]);
+            replayingInputs = true;
+        } else if (arg == "--replay-timestep" && hasValue) {
+            replayTimestep = std::stof(args[++i]);
+        } else if (arg == "--trace" && hasValue) {
+            tracePath = args[++i];
+#if defined(VKS_TRACE)
+            vks::trace::setThreadName("main");
+            vks::trace::beginCapture();
+#else
+            vkx::logMessage(vkx::LogLevel::LOG_WARN, "--trace ignored, tracing is not compiled in (VKS_TRACE)");
+            tracePath.clear();
+#endif
+        }
+    }
+    if (settings.commandStats && !vks::commandstats::available()) {
+        vkx::logMessage(vkx::LogLevel::LOG_WARN, "--command-stats ignored, command counting is not compiled in (VKS_COMMAND_STATS)");
+        settings.commandStats = false;
+    }
+    vks::commandstats::setEnabled(settings.commandStats);
+    if (replayingInputs) {
+        if (!inputCapturePath.empty()) {
+            throw std::runtime_error("--capture-inputs and --replay-inputs can't be combined");
+        }
+        if (inputRecording.example != name) {
+            vkx::logMessage(vkx::LogLevel::LOG_WARN, "Replaying inputs recorded with %s in %s", inputRecording.example.c_str(), name.c_str());
+        }
+        // The camera projections and the UI layout depend on it
+        size = vk::Extent2D{ inputRecording.width, inputRecording.height };
+    } else if (!inputCapturePath.empty()) {
+        inputRecording = vks::InputRecording{};
+        inputRecording.example = name;
+    }
+    if (!metricsBackend.empty()) {
+        metrics.reset(new vks::metrics::MetricsSink(vks::metrics::createBackend(metricsBackend), metricsConfig));
+    }
+    if (benchmark.active) {
+        // Presentation must not throttle the measurements
+        enableVsync = false;
+        if (benchmark.outputPath.empty()) {
+            benchmark.outputPath = name + ".benchmark.json";
+        }
+    }
+}
+
+void ExampleBase::benchmarkLoop() {
+    benchmark.runs.clear();
+    // Without a sweep there is a single run of whatever the example was started with
+    const std::vector<uint32_t> values = benchmark.sweep.empty() ? std::vector<uint32_t>{ 0 } : benchmark.sweep;
+    const uint32_t totalFrames = benchmark.warmupFrames + benchmark.frameCount;
+    for (const auto value : values) {
+        if (!benchmark.sweep.empty()) {
+            context.queue.waitIdle();
+            if (!applyBenchmarkSweep(value)) {
+                vkx::logMessage(vkx::LogLevel::LOG_ERROR, "%s doesn't support --benchmark-sweep", name.c_str());
+                break;
+            }
+        }
+        benchmark.runs.emplace_back();
+        auto& run = benchmark.runs.back();
+        run.value = value;
+        run.cpuFrameTimes.reserve(benchmark.frameCount);
+        uint64_t lastCollection = profiler.getCollectionCount();
+        // Every run replays the recording from its start
+        replayFrame = 0;
+        for (uint32_t i = 0; i < totalFrames && platformLoopCondition(); ++i) {
+            if (!prepared) {
+                continue;
+            }
+            auto frameStart = std::chrono::high_resolution_clock::now();
+            // A fixed timestep keeps timers and animations identical from run to run
+            float deltaTime = benchmark.timestep;
+            if (!applyFrameInputs(deltaTime)) {
+                break;
+            }
+            {
+                vks::FrameHistory::ScopedZone zone(frameHistory, "render");
+                render();
+            }
+            {
+                vks::FrameHistory::ScopedZone zone(frameHistory, "update");
+                update(deltaTime);
+            }
+            endFrameHistory();
+            auto cpuTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frameStart).count();
+            if (i < benchmark.warmupFrames) {
+                lastCollection = profiler.getCollectionCount();
+                continue;
+            }
+            run.cpuFrameTimes.push_back(cpuTime);
+            run.presentLatencies.insert(run.presentLatencies.end(), presentTiming.samples.begin(), presentTiming.samples.end());
+            run.recordTimes.insert(run.recordTimes.end(), recordingCost.samples.begin(), recordingCost.samples.end());
+            if (settings.commandStats) {
+                run.commandCounts.resize((size_t)vks::commandstats::Counter::Count);
+                for (size_t c = 0; c < run.commandCounts.size(); ++c) {
+                    run.commandCounts[c].push_back((double)commandStats.commands.values[c]);
+                }
+            }
+            if (profiler.getCollectionCount() != lastCollection) {
+                lastCollection = profiler.getCollectionCount();
+                double gpuTime = 0.0;
+                for (const auto& scope : profiler.getScopes()) {
+                    if (scope.depth == 0) {
+                        gpuTime += scope.lastMilliseconds;
+                    }
+                }
+                run.gpuFrameTimes.push_back(gpuTime);
+                auto sample = [&](const vks::debug::GpuProfiler::Scope& scope) {
+                    auto itr = std::find_if(run.scopeTimes.begin(), run.scopeTimes.end(), [&](const auto& entry) { return entry.first == scope.name; });
+                    if (itr == run.scopeTimes.end()) {
+                        run.scopeTimes.emplace_back(scope.name, std::vector<double>{});
+                        itr = std::prev(run.scopeTimes.end());
+                    }
+                    itr->second.push_back(scope.lastMilliseconds);
+                };
+                std::for_each(profiler.getScopes().begin(), profiler.getScopes().end(), sample);
+                std::for_each(profiler.getReports().begin(), profiler.getReports().end(), sample);
+                for (const auto& scope : profiler.getScopes()) {
+                    if (scope.statistics.empty()) {
+                        continue;
+                    }
+                    auto itr = std::find_if(run.scopeStatistics.begin(), run.scopeStatistics.end(),
+                                            [&](const auto& entry) { return entry.first == scope.name; });
+                    if (itr == run.scopeStatistics.end()) {
+                        run.scopeStatistics.emplace_back(scope.name, std::vector<std::vector<double>>(scope.statistics.size()));
+                        itr = std::prev(run.scopeStatistics.end());
+                    }
+                    for (size_t c = 0; c < scope.statistics.size(); ++c) {
+                        itr->second[c].push_back((double)scope.statistics[c]);
+                    }
+                }
+            }
+        }
+    }
+    context.queue.waitIdle();
+    writeBenchmarkReport();
+}
+
+namespace {
+
+struct FrameTimeStats {
+    size_t count{ 0 };
+    double mean{ 0 }, min{ 0 }, max{ 0 }, p50{ 0 }, p90{ 0 }, p95{ 0 }, p99{ 0 };
+
+    FrameTimeStats(std::vector<double> samples) {
+        count = samples.size();
+        if (samples.empty()) {
+            return;
+        }
+        std::sort(samples.begin(), samples.end());
+        double sum = 0;
+        for (const auto& sample : samples) {
+            sum += sample;
+        }
+        mean = sum / count;
+        min = samples.front();
+        max = samples.back();
+        // Nearest rank
+        auto percentile = [&](double p) { return samples[std::min(count - 1, (size_t)std::ceil(p * count) - 1)]; };
+        p50 = percentile(0.50);
+        p90 = percentile(0.90);
+        p95 = percentile(0.95);
+        p99 = percentile(0.99);
+    }
+
+    void write(std::ostream& out) const {
+        out << "{ \"count\": " << count << ", \"mean\": " << mean << ", \"min\": " << min << ", \"max\": " << max << ", \"p50\": " << p50
+            << ", \"p90\": " << p90 << ", \"p95\": " << p95 << ", \"p99\": " << p99 << " }";
+    }
+};
+
+}  // namespace
+
+void ExampleBase::writeBenchmarkReport() const {
+    const bool sweep = !benchmark.sweep.empty();
+    for (const auto& run : benchmark.runs) {
+        const FrameTimeStats cpu(run.cpuFrameTimes);
+        const FrameTimeStats gpu(run.gpuFrameTimes);
+        std::string prefix = sweep ? "Benchmark " + std::to_string(run.value) : "Benchmark";
+        vkx::logMessage(vkx::LogLevel::LOG_INFO, "%s: %zu frames, CPU %.3f ms mean / %.3f ms p99, GPU %.3f ms mean / %.3f ms p99", prefix.c_str(), cpu.count,
+                        cpu.mean, cpu.p99, gpu.mean, gpu.p99);
+        if (sweep) {
+            for (const auto& scope : run.scopeTimes) {
+                vkx::logMessage(vkx::LogLevel::LOG_INFO, "%s: %s %.3f ms mean", prefix.c_str(), scope.first.c_str(), FrameTimeStats(scope.second).mean);
+            }
+        }
+    }
+
+    const auto& path = benchmark.outputPath;
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        vkx::logMessage(vkx::LogLevel::LOG_ERROR, "Unable to write benchmark report %s", path.c_str());
+        return;
+    }
+    out << std::fixed << std::setprecision(4);
+    const bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+    if (csv) {
+        // GPU times lag the CPU times and may be missing for some frames, so they get their own column of samples
+        out << (sweep ? "value," : "") << "frame,cpu_ms,gpu_ms\n";
+        for (const auto& run : benchmark.runs) {
+            for (size_t i = 0; i < run.cpuFrameTimes.size(); ++i) {
+                if (sweep) {
+                    out << run.value << ",";
+                }
+                out << i << "," << run.cpuFrameTimes[i] << ",";
+                if (i < run.gpuFrameTimes.size()) {
+                    out << run.gpuFrameTimes[i];
+                }
+                out << "\n";
+            }
+        }
+        return;
+    }
+    std::string device = context.deviceProperties.deviceName;
+    std::replace(device.begin(), device.end(), '"', '\'');
+    auto quoted = [](std::string text) {
+        std::replace(text.begin(), text.end(), '"', '\'');
+        return "\"" + text + "\"";
+    };
+    // Along with the frame times, the timings of every profiler scope so that passes can be told apart, and their counters
+    auto writeTimes = [&](const BenchmarkRun& run, const std::string& indent) {
+        out << indent << "\"cpuFrameTimeMs\": ";
+        FrameTimeStats(run.cpuFrameTimes).write(out);
+        out << ",\n" << indent << "\"gpuFrameTimeMs\": ";
+        FrameTimeStats(run.gpuFrameTimes).write(out);
+        out << ",\n" << indent << "\"presentLatencyMs\": ";
+        FrameTimeStats(run.presentLatencies).write(out);
+        out << ",\n" << indent << "\"recordCpuMs\": ";
+        FrameTimeStats(run.recordTimes).write(out);
+        if (!run.commandCounts.empty()) {
+            out << ",\n" << indent << "\"commandCounts\": {";
+            for (size_t c = 0; c < run.commandCounts.size(); ++c) {
+                out << (c ? "," : "") << "\n" << indent << "  " << quoted(vks::commandstats::counterName((vks::commandstats::Counter)c)) << ": ";
+                FrameTimeStats(run.commandCounts[c]).write(out);
+            }
+            out << "\n" << indent << "}";
         }
+        out << ",\n" << indent << "\"scopeTimeMs\": {";
+        for (size_t s = 0; s < run.scopeTimes.size(); ++s) {
+            out << (s ? "," : "") << "\n" << indent << "  " << quoted(run.scopeTimes[s].first) << ": ";
+            FrameTimeStats(run.scopeTimes[s].second).write(out);
+        }
+        out << "\n" << indent << "}";
+        const auto& counters = profiler.getStatisticNames();
+        out << ",\n" << indent << "\"scopeStatistics\": {";
+        for (size_t s = 0; s < run.scopeStatistics.size(); ++s) {
+            const auto& samples = run.scopeStatistics[s].second;
+            out << (s ? "," : "") << "\n" << indent << "  " << quoted(run.scopeStatistics[s].first) << ": {";
+            for (size_t c = 0; c < samples.size() && c < counters.size(); ++c) {
+                out << (c ? "," : "") << "\n" << indent << "    " << quoted(counters[c]) << ": ";
+                FrameTimeStats(samples[c]).write(out);
+            }
+            out << "\n" << indent << "  }";
+        }
+        out << "\n" << indent << "}";
+    };
+    out << "{\n";
+    out << "  \"example\": \"" << name << "\",\n";
+    out << "  \"device\": \"" << device << "\",\n";
+    out << "  \"warmupFrames\": " << benchmark.warmupFrames << ",\n";
+    out << "  \"frames\": " << benchmark.frameCount << ",\n";
+    out << "  \"timestep\": " << benchmark.timestep << ",\n";
+    out << "  \"presentMode\": " << quoted(vk::to_string(swapChain.presentMode)) << ",\n";
+    out << "  \"swapchainImages\": " << swapChain.imageCount << ",\n";
+    out << "  \"framesInFlight\": " << frames.size() << ",\n";
+    out << "  \"recordPerFrame\": " << (recordPerFrame ? "true" : "false") << ",\n";
+    out << "  \"depthPrepass\": " << (depthPrepass && supportsDepthPrepass() ? "true" : "false") << ",\n";
+    out << "  \"halfPrecision\": " << (shaderPrecision == ShaderPrecision::Half && context.shaderFloat16Enabled ? "true" : "false") << ",\n";
+    if (startupTimes.complete) {
+        out << "  \"startupMs\": {\n";
+        out << "    \"initVulkan\": " << startupTimes.initVulkanMs << ",\n";
+        out << "    \"prepare\": " << startupTimes.prepareMs << ",\n";
+        out << "    \"firstPresent\": " << startupTimes.firstPresentMs << ",\n";
+        out << "    \"phases\": {";
+        for (uint32_t i = 0; i < (uint32_t)vks::startup::Phase::Count; ++i) {
+            out << (i ? "," : "") << "\n      " << quoted(vks::startup::phaseName((vks::startup::Phase)i)) << ": " << startupTimes.phaseMs[i];
+        }
+        out << "\n    }\n  },\n";
+    }
+    if (!sweep) {
+        writeTimes(benchmark.runs.empty() ? BenchmarkRun{} : benchmark.runs.front(), "  ");
+        out << "\n}\n";
+        return;
     }
+    // One entry per value
+    out << "  \"sweep\": [";
+    for (size_t r = 0; r < benchmark.runs.size(); ++r) {
+        const auto& run = benchmark.runs[r];
+        out << (r ? "," : "") << "\n    {\n      \"value\": " << run.value << ",\n";
+        writeTimes(run, "      ");
+        out << "\n    }";
+    }
+    out << "\n  ]\n}\n";
 }
 
 std::string ExampleBase::getWindowTitle() {
@@ -258,9 +939,16 @@ void ExampleBase::setupUi() {
     // Setup default overlay creation info
     overlayCreateInfo.copyQueue = queue;
     overlayCreateInfo.framebuffers = framebuffers;
+    if (dynamicRendering) {
+        for (const auto& image : swapChain.images) {
+            overlayCreateInfo.colorImages.push_back(image.image);
+            overlayCreateInfo.colorViews.push_back(image.view);
+        }
+    }
     overlayCreateInfo.colorformat = swapChain.colorFormat;
     overlayCreateInfo.depthformat = depthFormat;
     overlayCreateInfo.size = size;
+    overlayCreateInfo.framesInFlight = (uint32_t)frames.size();
 
     ImGui::SetCurrentContext(ImGui::CreateContext());
 
@@ -278,12 +966,17 @@ void ExampleBase::setupUi() {
 void ExampleBase::prepare() {
     cmdPool = context.getCommandPool();
 
+    swapChain.config.preRotate = preRotate && supportsPreRotation();
     swapChain.create(size, enableVsync);
+    camera.setPreRotation(swapChain.preRotationDegrees());
+    ui.preRotation = swapChain.preRotationDegrees();
+    framePacer.setEnabled(framePacing);
     setupDepthStencil();
     setupRenderPass();
     setupRenderPassBeginInfo();
     setupFrameBuffer();
     setupUi();
+    assets.create(context);
     loadAssets();
 }
 
@@ -322,75 +1015,559 @@ void ExampleBase::clearCommandBuffers() {
 }
 
 void ExampleBase::buildCommandBuffers() {
-    // Destroy and recreate command buffers if already present
-    allocateCommandBuffers();
+    VKS_TRACE_ZONE("ExampleBase::buildCommandBuffers");
+    if (deferCommandBuffers) {
+        staleCommandBuffers.assign(commandBuffers.size(), true);
+        return;
+    }
+    staleCommandBuffers.clear();
+
+    // Destroy and recreate command buffers if already present, with recordPerFrame there are none
+    if (recordPerFrame) {
+        clearCommandBuffers();
+    } else {
+        allocateCommandBuffers();
+    }
+
+    // One query pool per swap chain image, matching the pre-recorded command buffers, or per frame in flight
+    const uint32_t profilerSlots = recordPerFrame ? (uint32_t)frames.size() : swapChain.imageCount;
+    if (settings.gpuTimings && profiler.slotCount() != profilerSlots) {
+        // The passes directly inside the frame also count their primitives and shader invocations
+        vk::QueryPipelineStatisticFlags statistics;
+        if (enabledFeatures.pipelineStatisticsQuery) {
+            using Statistic = vk::QueryPipelineStatisticFlagBits;
+            statistics = Statistic::eInputAssemblyVertices | Statistic::eInputAssemblyPrimitives | Statistic::eVertexShaderInvocations |
+                         Statistic::eClippingInvocations | Statistic::eClippingPrimitives | Statistic::eFragmentShaderInvocations |
+                         Statistic::eComputeShaderInvocations;
+            if (enabledFeatures.geometryShader) {
+                statistics |= Statistic::eGeometryShaderInvocations | Statistic::eGeometryShaderPrimitives;
+            }
+            if (enabledFeatures.tessellationShader) {
+                statistics |= Statistic::eTessellationControlShaderPatches | Statistic::eTessellationEvaluationShaderInvocations;
+            }
+        }
+        profiler.create(physicalDevice, device, context.queueIndices.graphics, profilerSlots, 64, statistics, 1);
+        vks::debug::marker::setProfiler(profiler.enabled() ? &profiler : nullptr);
+    }
 
-    vk::CommandBufferBeginInfo cmdBufInfo{ vk::CommandBufferUsageFlagBits::eSimultaneousUse };
-    for (size_t i = 0; i < swapChain.imageCount; ++i) {
-        const auto& cmdBuffer = commandBuffers[i];
+    recordDrawSlices();
+    if (recordPerFrame) {
+        return;
+    }
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < swapChain.imageCount; ++i) {
+        recordCommandBuffer(i);
+    }
+    recordingCost.add(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+}
+
+void ExampleBase::recordWithPrecision(const vk::CommandBuffer& commandBuffer,
+                                      const vk::Extent2D& extent,
+                                      const std::function<void(bool half)>& draw) const {
+    if (shaderPrecision != ShaderPrecision::Compare || !context.shaderFloat16Enabled) {
+        draw(shaderPrecision == ShaderPrecision::Half && context.shaderFloat16Enabled);
+        return;
+    }
+    const uint32_t left = extent.width / 2;
+    commandBuffer.setScissor(0, vks::util::rect2D(left, extent.height));
+    draw(false);
+    commandBuffer.setScissor(0, vks::util::rect2D(extent.width - left, extent.height, (int32_t)left));
+    draw(true);
+    commandBuffer.setScissor(0, vks::util::rect2D(extent));
+}
+
+void ExampleBase::recordCommandBuffer(uint32_t image) {
+    VKS_TRACE_ZONE("ExampleBase::recordCommandBuffer");
+    vks::FrameHistory::ScopedZone zone(frameHistory, "record");
+    vk::CommandBuffer cmdBuffer;
+    if (recordPerFrame) {
+        // Recycled along with the rest of the frame slot's command buffers, see prepareFrame
+        cmdBuffer = frameCommandBuffer = context.frameCommandPools.allocate();
+        cmdBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+        profiler.beginCommandBuffer(cmdBuffer, currentFrame);
+    } else {
+        cmdBuffer = commandBuffers[image];
         cmdBuffer.reset(vk::CommandBufferResetFlagBits::eReleaseResources);
-        cmdBuffer.begin(cmdBufInfo);
-        updateCommandBufferPreDraw(cmdBuffer);
-        // Let child classes execute operations outside the renderpass, like buffer barriers or query pool operations
-        renderPassBeginInfo.framebuffer = framebuffers[i];
-        cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-        updateDrawCommandBuffer(cmdBuffer);
+        cmdBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
+        profiler.beginCommandBuffer(cmdBuffer, image);
+    }
+    vks::debug::marker::beginRegion(cmdBuffer, "Frame", glm::vec4(0.8f));
+    updateCommandBufferPreDraw(cmdBuffer);
+    // Let child classes execute operations outside the renderpass, like buffer barriers or query pool operations
+    if (drawSliceCount) {
+        beginFrameRendering(cmdBuffer, image, vk::SubpassContents::eSecondaryCommandBuffers);
+        std::vector<vk::CommandBuffer> slices;
+        slices.reserve(drawSliceCount);
+        for (uint32_t slice = 0; slice < drawSliceCount; ++slice) {
+            slices.push_back(sliceCommandBuffers[image * drawSliceCount + slice].second);
+        }
+        cmdBuffer.executeCommands(slices);
+    } else {
+        beginFrameRendering(cmdBuffer, image, vk::SubpassContents::eInline);
+        if (supportsDepthPrepass()) {
+            // Separate scopes, so that the pipeline statistics count the fragments shaded by the main pass alone
+            if (depthPrepass) {
+                vks::debug::marker::beginRegion(cmdBuffer, "Depth pre-pass", glm::vec4(0.4f));
+                updateDepthPrepassCommandBuffer(cmdBuffer);
+                vks::debug::marker::endRegion(cmdBuffer);
+            }
+            vks::debug::marker::beginRegion(cmdBuffer, "Shading", glm::vec4(0.6f));
+            updateDrawCommandBuffer(cmdBuffer);
+            vks::debug::marker::endRegion(cmdBuffer);
+        } else {
+            updateDrawCommandBuffer(cmdBuffer);
+        }
+    }
+    endFrameRendering(cmdBuffer, image);
+    updateCommandBufferPostDraw(cmdBuffer);
+    vks::debug::marker::endRegion(cmdBuffer);
+    profiler.endCommandBuffer(cmdBuffer);
+    cmdBuffer.end();
+}
+
+namespace {
+bool hasStencil(vk::Format format) {
+    switch (format) {
+        case vk::Format::eS8Uint:
+        case vk::Format::eD16UnormS8Uint:
+        case vk::Format::eD24UnormS8Uint:
+        case vk::Format::eD32SfloatS8Uint:
+            return true;
+        default:
+            return false;
+    }
+}
+}  // namespace
+
+void ExampleBase::beginFrameRendering(const vk::CommandBuffer& cmdBuffer, uint32_t image, vk::SubpassContents contents) {
+    if (!dynamicRendering) {
+        renderPassBeginInfo.framebuffer = framebuffers[image];
+        cmdBuffer.beginRenderPass(renderPassBeginInfo, contents);
+        return;
+    }
+
+    // The layout transitions and dependencies of the default render pass
+    const vk::ImageAspectFlags depthAspect = vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+    const std::array<vk::ImageMemoryBarrier, 2> barriers{
+        vk::ImageMemoryBarrier{ {}, vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite, vk::ImageLayout::eUndefined,
+                                vk::ImageLayout::eColorAttachmentOptimal, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                                swapChain.images[image].image, vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 } },
+        vk::ImageMemoryBarrier{ vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                                vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                                vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal, VK_QUEUE_FAMILY_IGNORED,
+                                VK_QUEUE_FAMILY_IGNORED, depthStencil.image, vk::ImageSubresourceRange{ depthAspect, 0, 1, 0, 1 } },
+    };
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eBottomOfPipe | vk::PipelineStageFlagBits::eLateFragmentTests,
+                              vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests |
+                                  vk::PipelineStageFlagBits::eLateFragmentTests,
+                              vk::DependencyFlagBits::eByRegion, nullptr, nullptr, barriers);
+
+    vk::RenderingAttachmentInfoKHR colorAttachment;
+    colorAttachment.imageView = swapChain.images[image].view;
+    colorAttachment.imageLayout = vk::ImageLayout::eColorAttachmentOptimal;
+    colorAttachment.loadOp = vk::AttachmentLoadOp::eClear;
+    colorAttachment.storeOp = vk::AttachmentStoreOp::eStore;
+    if (!clearValues.empty()) {
+        colorAttachment.clearValue = clearValues[0];
+    }
+    vk::RenderingAttachmentInfoKHR depthAttachment;
+    depthAttachment.imageView = depthStencil.view;
+    depthAttachment.imageLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+    depthAttachment.loadOp = vk::AttachmentLoadOp::eClear;
+    depthAttachment.storeOp = vk::AttachmentStoreOp::eDontCare;
+    if (clearValues.size() > 1) {
+        depthAttachment.clearValue = clearValues[1];
+    }
+
+    vk::RenderingInfoKHR renderingInfo;
+    if (contents == vk::SubpassContents::eSecondaryCommandBuffers) {
+        renderingInfo.flags = vk::RenderingFlagBitsKHR::eContentsSecondaryCommandBuffers;
+    }
+    renderingInfo.renderArea = renderPassBeginInfo.renderArea;
+    renderingInfo.layerCount = 1;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachments = &colorAttachment;
+    renderingInfo.pDepthAttachment = &depthAttachment;
+    renderingInfo.pStencilAttachment = hasStencil(depthFormat) ? &depthAttachment : nullptr;
+    cmdBuffer.beginRenderingKHR(renderingInfo, context.dynamicDispatch);
+}
+
+void ExampleBase::endFrameRendering(const vk::CommandBuffer& cmdBuffer, uint32_t image) {
+    if (!dynamicRendering) {
         cmdBuffer.endRenderPass();
-        updateCommandBufferPostDraw(cmdBuffer);
-        cmdBuffer.end();
+        return;
+    }
+    cmdBuffer.endRenderingKHR(context.dynamicDispatch);
+    const vk::ImageMemoryBarrier toPresent{ vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
+                                            vk::AccessFlagBits::eMemoryRead,
+                                            vk::ImageLayout::eColorAttachmentOptimal,
+                                            vk::ImageLayout::ePresentSrcKHR,
+                                            VK_QUEUE_FAMILY_IGNORED,
+                                            VK_QUEUE_FAMILY_IGNORED,
+                                            swapChain.images[image].image,
+                                            vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 } };
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eBottomOfPipe,
+                              vk::DependencyFlagBits::eByRegion, nullptr, nullptr, toPresent);
+}
+
+uint32_t ExampleBase::commandBufferImage(const vk::CommandBuffer& commandBuffer) const {
+    if (recordPerFrame && commandBuffer == frameCommandBuffer) {
+        return currentBuffer;
+    }
+    auto itr = std::find(commandBuffers.begin(), commandBuffers.end(), commandBuffer);
+    if (itr == commandBuffers.end()) {
+        throw std::runtime_error("Not one of the swap chain image command buffers");
+    }
+    return (uint32_t)(itr - commandBuffers.begin());
+}
+
+void ExampleBase::recordDrawSlices() {
+    // The previous slices may still be referenced by in flight primaries, so their release is deferred
+    for (const auto& slice : sliceCommandBuffers) {
+        context.deletions.push(slice.first, slice.second);
+    }
+    sliceCommandBuffers.clear();
+    if (!drawSliceCount) {
+        return;
+    }
+    sliceCommandBuffers.resize(swapChain.imageCount * drawSliceCount);
+    recordDrawSlices(0, sliceCommandBuffers.size());
+}
+
+void ExampleBase::recordDrawSlices(size_t first, size_t last) {
+    for (size_t index = first; index < last; ++index) {
+        const auto& slice = sliceCommandBuffers[index];
+        if (slice.second) {
+            context.deletions.push(slice.first, slice.second);
+        }
+    }
+
+    // One range per (image, slice).  Each range allocates from the command pool of whichever thread runs it, so the
+    // pools never need locking and idle threads steal whatever is left.
+    getScheduler().parallelFor(first, last, 1, [this](size_t begin, size_t end) {
+        for (size_t index = begin; index < end; ++index) {
+            const uint32_t image = (uint32_t)(index / drawSliceCount);
+            const uint32_t slice = (uint32_t)(index % drawSliceCount);
+            const vk::CommandPool pool = context.getCommandPool();
+            const vk::CommandBuffer cmdBuffer = device.allocateCommandBuffers({ pool, vk::CommandBufferLevel::eSecondary, 1 })[0];
+            vk::CommandBufferInheritanceInfo inheritanceInfo;
+            vk::CommandBufferInheritanceRenderingInfoKHR inheritanceRendering;
+            if (dynamicRendering) {
+                inheritanceRendering.colorAttachmentCount = (uint32_t)renderingFormats.colorAttachmentFormats.size();
+                inheritanceRendering.pColorAttachmentFormats = renderingFormats.colorAttachmentFormats.data();
+                inheritanceRendering.depthAttachmentFormat = renderingFormats.depthAttachmentFormat;
+                inheritanceRendering.stencilAttachmentFormat = renderingFormats.stencilAttachmentFormat;
+                inheritanceRendering.rasterizationSamples = vk::SampleCountFlagBits::e1;
+                inheritanceInfo.pNext = &inheritanceRendering;
+            } else {
+                inheritanceInfo = vk::CommandBufferInheritanceInfo{ renderPass, 0, framebuffers[image] };
+            }
+            cmdBuffer.begin({ vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eSimultaneousUse,
+                              &inheritanceInfo });
+            updateDrawCommandBufferSlice(cmdBuffer, slice, drawSliceCount);
+            cmdBuffer.end();
+            sliceCommandBuffers[index] = { pool, cmdBuffer };
+        }
+    });
+}
+
+vks::TaskScheduler& ExampleBase::getScheduler() {
+    if (!scheduler) {
+        scheduler.reset(new vks::TaskScheduler());
     }
+    return *scheduler;
 }
 
 void ExampleBase::prepareFrame() {
+    VKS_TRACE_ZONE("ExampleBase::prepareFrame");
+    // Input has just been polled, anything from here on counts towards the latency
+    presentTiming.inputTime = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    collectPresentTiming();
+    commandStats = vks::commandstats::endFrame();
+    recordingCost.samples.clear();
+
+    // Streamed assets only change between frames, and whatever still refers to their placeholders is updated with
+    // the device idle
+    if (assets.update()) {
+        context.queue.waitIdle();
+        assetsLoaded();
+    }
+
+    auto& frame = frames[currentFrame];
+    auto waitStart = std::chrono::high_resolution_clock::now();
+    {
+        vks::FrameHistory::ScopedZone zone(frameHistory, "wait for frame");
+        // Only blocks if the CPU is a full `framesInFlight` frames ahead of the GPU
+        device.waitForFences(frame.fence, VK_TRUE, UINT64_MAX);
+    }
+    frameWaitMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - waitStart).count();
+    if (recordPerFrame) {
+        profiler.collect(currentFrame);
+        traceGpuScopes();
+    }
+    if (frameAllocator) {
+        frameAllocator.begin(currentFrame);
+    }
+    frameDescriptors.begin(currentFrame);
+    // The frame slot's previous submissions are complete, so everything from its command pools can go at once
+    context.frameCommandPools.begin(currentFrame);
+    for (const auto& trash : frame.trash) {
+        trash();
+    }
+    frame.trash.clear();
+    context.completeDeletions(frame.deletions);
+    frame.deletions = 0;
+    // Before the fence is reset, while it still tells whether the captures submitted with it are complete
+    readback.poll();
+
+    // Point the default wait and signal semaphores at this frame's semaphores
+    for (auto& semaphore : renderWaitSemaphores) {
+        if (semaphore == semaphores.acquireComplete) {
+            semaphore = frame.acquireComplete;
+        }
+    }
+    semaphores.acquireComplete = frame.acquireComplete;
+
     // Acquire the next image from the swap chaing
+    vks::FrameHistory::ScopedZone acquireZone(frameHistory, "acquire");
+    waitStart = std::chrono::high_resolution_clock::now();
     auto resultValue = swapChain.acquireNextImage(semaphores.acquireComplete);
+    frameWaitMilliseconds += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - waitStart).count();
     if (resultValue.result == vk::Result::eSuboptimalKHR) {
 #if !defined(__ANDROID__)
         ivec2 newSize;
         glfwGetWindowSize(window, &newSize.x, &newSize.y);
         windowResize(newSize);
         resultValue = swapChain.acquireNextImage(semaphores.acquireComplete);
+#else
+        // Presents stay suboptimal while the display is rotated away from the pre-rotation
+        if (swapChain.transformChanged()) {
+            windowResize(glm::uvec2(ANativeWindow_getWidth(window), ANativeWindow_getHeight(window)));
+            resultValue = swapChain.acquireNextImage(semaphores.acquireComplete);
+        }
 #endif
     }
     currentBuffer = resultValue.value;
+
+    // Ensures that the image is not presented until all commands have been sumbitted and executed
+    if (presentSemaphoresSwapChain != swapChain.swapChain) {
+        // Presents to the old swap chain may still wait on them
+        for (const auto& semaphore : presentSemaphores) {
+            context.trash(semaphore);
+        }
+        presentSemaphores.resize(swapChain.imageCount);
+        for (auto& semaphore : presentSemaphores) {
+            semaphore = device.createSemaphore({});
+        }
+        presentSemaphoresSwapChain = swapChain.swapChain;
+    }
+    for (auto& semaphore : renderSignalSemaphores) {
+        if (semaphore == semaphores.renderComplete) {
+            semaphore = presentSemaphores[currentBuffer];
+        }
+    }
+    semaphores.renderComplete = presentSemaphores[currentBuffer];
+
+    // With more swap chain images than frames in flight, the image may still be in use by an older
+    // frame than the one that last used this slot
+    if (imageFences.size() != swapChain.imageCount) {
+        imageFences.assign(swapChain.imageCount, vk::Fence());
+    }
+    auto& imageFence = imageFences[currentBuffer];
+    if (imageFence && imageFence != frame.fence) {
+        device.waitForFences(imageFence, VK_TRUE, UINT64_MAX);
+    }
+    // The last submission of this image's command buffer is complete, so its timestamps can be read without stalling
+    if (imageFence && !recordPerFrame) {
+        profiler.collect(currentBuffer);
+        traceGpuScopes();
+    }
+    // and it can be re-recorded if a resize left it stale
+    if (currentBuffer < staleCommandBuffers.size() && staleCommandBuffers[currentBuffer]) {
+        if (drawSliceCount) {
+            recordDrawSlices(currentBuffer * drawSliceCount, (currentBuffer + 1) * drawSliceCount);
+        }
+        recordCommandBuffer(currentBuffer);
+        staleCommandBuffers[currentBuffer] = false;
+    }
+    imageFence = frame.fence;
+
+    prepareDisplays();
 }
 
+namespace {
+// Paced presents are aimed at the refresh `interval` cycles after the previous one, given the last known present.
+// Half a refresh early, as the image is shown at the first refresh after the desired time
+uint64_t desiredPresentTime(uint32_t presentId, uint32_t interval, uint64_t refreshDuration, uint32_t lastId, uint64_t lastTime) {
+    if (!interval || !refreshDuration || !lastTime) {
+        return 0;
+    }
+    const uint64_t cycles = (uint64_t)(presentId - lastId) * interval;
+    return lastTime + cycles * refreshDuration - refreshDuration / 2;
+}
+}  // namespace
+
 void ExampleBase::submitFrame() {
-    bool submitOverlay = settings.overlay && ui.visible && (ui.cmdBuffers.size() > currentBuffer);
-    if (submitOverlay) {
-        vk::SubmitInfo submitInfo;
-        // Wait for color attachment output to finish before rendering the text overlay
-        vk::PipelineStageFlags stageFlags = vk::PipelineStageFlagBits::eBottomOfPipe;
-        submitInfo.pWaitDstStageMask = &stageFlags;
-        // Wait for render complete semaphore
-        submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = &semaphores.renderComplete;
-        // Signal ready with UI overlay complete semaphpre
-        submitInfo.signalSemaphoreCount = 1;
-        submitInfo.pSignalSemaphores = &semaphores.overlayComplete;
+    VKS_TRACE_ZONE("ExampleBase::submitFrame");
+    vks::FrameHistory::ScopedZone zone(frameHistory, "present");
+    const uint64_t desiredTime = desiredPresentTime(swapChain.presentId + 1, presentTiming.interval, presentTiming.refreshDuration,
+                                                    presentTiming.lastId, presentTiming.lastTime);
+#if defined(__ANDROID__)
+    // Without display timing the present is held back on the CPU until shortly before its refresh
+    if (presentTiming.interval > 1 && !swapChain.displayTiming) {
+        const auto waitStart = std::chrono::high_resolution_clock::now();
+        vkx::android::waitForPresentSlot(presentTiming.interval);
+        frameWaitMilliseconds += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - waitStart).count();
+    }
+#endif
+    // All the swap chains in one present, each display at its own cadence
+    presentBatch.add(swapChain, semaphores.renderComplete, desiredTime);
+    for (auto& display : displays) {
+        if (display->active) {
+            presentBatch.add(display->swapChain, display->renderComplete[display->swapChain.currentImage],
+                             desiredPresentTime(display->swapChain.presentId + 1, display->interval, display->refreshDuration,
+                                                display->lastPresentId, display->lastPresentTime));
+        }
+    }
+    const auto& presentResults = presentBatch.present(queue);
+    size_t presentIndex = 1;
+    for (auto& display : displays) {
+        if (display->active) {
+            const vk::Result result = presentResults[presentIndex++];
+            display->resized = display->resized || result == vk::Result::eSuboptimalKHR || result == vk::Result::eErrorOutOfDateKHR;
+        }
+    }
+#if !defined(__ANDROID__)
+    // The present doesn't throw for it, so that the displays' presents go ahead
+    if (presentResults[0] == vk::Result::eErrorOutOfDateKHR) {
+        ivec2 newSize;
+        glfwGetWindowSize(window, &newSize.x, &newSize.y);
+        windowResize(newSize);
+    }
+#endif
+    if (vks::startup::active()) {
+        finishStartupTimes();
+    }
+    if (swapChain.displayTiming) {
+        presentTiming.pending.emplace_back(swapChain.presentId, presentTiming.inputTime);
+        // Not every present gets a timing
+        while (presentTiming.pending.size() > 64) {
+            presentTiming.pending.pop_front();
+        }
+    }
+    currentFrame = (currentFrame + 1) % (uint32_t)frames.size();
+}
+
+void ExampleBase::traceGpuScopes() {
+#if defined(VKS_TRACE)
+    if (profiler.getCollectionCount() == tracedCollections) {
+        return;
+    }
+    tracedCollections = profiler.getCollectionCount();
+    if (!vks::trace::capturing() || !context.calibratedTimestampsEnabled) {
+        return;
+    }
+    // Recalibrated every second, the clocks drift apart by far less than a zone in that time
+    if (!timestampCalibration.valid() || vks::trace::now() - timestampCalibration.time() > 1000000000) {
+        timestampCalibration.calibrate(physicalDevice, device, context.dynamicDispatch);
+    }
+    if (timestampCalibration.valid()) {
+        for (const auto& scope : profiler.getScopes()) {
+            vks::trace::recordGpuZone(scope.name, timestampCalibration.toCpu(scope.begin), timestampCalibration.toCpu(scope.end));
+        }
+    }
+#endif
+}
 
-        // Submit current UI overlay command buffer
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &ui.cmdBuffers[currentBuffer];
-        queue.submit({ submitInfo }, {});
+void ExampleBase::finishStartupTimes() {
+    vks::startup::finish();
+    startupTimes.firstPresentMs = vks::startup::elapsed();
+    std::string phases;
+    for (uint32_t i = 0; i < (uint32_t)vks::startup::Phase::Count; ++i) {
+        const auto phase = (vks::startup::Phase)i;
+        startupTimes.phaseMs[i] = vks::startup::phaseMilliseconds(phase);
+        char entry[64];
+        snprintf(entry, sizeof(entry), "%s%s %.1f", i ? ", " : "", vks::startup::phaseName(phase), startupTimes.phaseMs[i]);
+        phases += entry;
+    }
+    startupTimes.complete = true;
+    vkx::logMessage(vkx::LogLevel::LOG_INFO, "Startup: first present at %.1f ms, initVulkan done at %.1f ms, prepare at %.1f ms",
+                    startupTimes.firstPresentMs, startupTimes.initVulkanMs, startupTimes.prepareMs);
+    // Summed over threads, so with loads spread over workers the phases can add up to more than the wall time
+    vkx::logMessage(vkx::LogLevel::LOG_INFO, "Startup phases (ms): %s", phases.c_str());
+}
+
+void ExampleBase::collectPresentTiming() {
+    presentTiming.samples.clear();
+    // The displays only need the last present for their pacing
+    for (auto& display : displays) {
+        if (!display->swapChain.displayTiming || !display->swapChain.presentId) {
+            continue;
+        }
+        if (!display->refreshDuration) {
+            display->refreshDuration = display->swapChain.getRefreshCycleDuration();
+        }
+        for (const auto& timing : display->swapChain.getPastPresentationTiming()) {
+            if (timing.presentID > display->lastPresentId) {
+                display->lastPresentId = timing.presentID;
+                display->lastPresentTime = timing.actualPresentTime;
+            }
+        }
+    }
+    if (!swapChain.displayTiming || !swapChain.presentId) {
+        return;
+    }
+    if (!presentTiming.refreshDuration) {
+        presentTiming.refreshDuration = swapChain.getRefreshCycleDuration();
+    }
+    for (const auto& timing : swapChain.getPastPresentationTiming()) {
+        while (!presentTiming.pending.empty() && presentTiming.pending.front().first < timing.presentID) {
+            presentTiming.pending.pop_front();
+        }
+        if (presentTiming.pending.empty() || presentTiming.pending.front().first != timing.presentID) {
+            continue;
+        }
+        const uint64_t inputTime = presentTiming.pending.front().second;
+        presentTiming.pending.pop_front();
+        presentTiming.lastId = timing.presentID;
+        presentTiming.lastTime = timing.actualPresentTime;
+        // The present times are in the monotonic clock domain on Linux and Android, which steady_clock uses.
+        // Elsewhere the domains may not match, and implausible values are dropped
+        if (timing.actualPresentTime <= inputTime || timing.actualPresentTime - inputTime > 1000000000ull) {
+            continue;
+        }
+        const double latency = (double)(timing.actualPresentTime - inputTime) / 1.0e6;
+        presentTiming.latency = presentTiming.latency == 0.0 ? latency : presentTiming.latency * 0.9 + latency * 0.1;
+        presentTiming.samples.push_back(latency);
     }
-    swapChain.queuePresent(submitOverlay ? semaphores.overlayComplete : semaphores.renderComplete);
 }
 
 void ExampleBase::setupDepthStencil() {
-    depthStencil.destroy();
+    // Frames in flight may still be rendering to the previous one
+    if (depthStencil.image) {
+        context.trash(depthStencil);
+        depthStencil = vks::Image{};
+    }
+    depthStencil = createDepthStencil(size);
+}
 
+vks::Image ExampleBase::createDepthStencil(const vk::Extent2D& extent) {
     vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
     vk::ImageCreateInfo depthStencilCreateInfo;
     depthStencilCreateInfo.imageType = vk::ImageType::e2D;
-    depthStencilCreateInfo.extent = vk::Extent3D{ size.width, size.height, 1 };
+    depthStencilCreateInfo.extent = vk::Extent3D{ extent.width, extent.height, 1 };
     depthStencilCreateInfo.format = depthFormat;
     depthStencilCreateInfo.mipLevels = 1;
     depthStencilCreateInfo.arrayLayers = 1;
-    depthStencilCreateInfo.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransferSrc;
-    depthStencil = context.createImage(depthStencilCreateInfo);
+    depthStencilCreateInfo.usage = depthStencilUsage;
+    vks::Image result = context.createImage(depthStencilCreateInfo);
 
-    context.setImageLayout(depthStencil.image, aspect, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+    // Submitted ahead of the next frame along with the other pending uploads
+    const vk::Image image = result.image;
+    context.recordUpload([&](const vk::CommandBuffer& commandBuffer) {
+        context.setImageLayout(commandBuffer, image, aspect, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+    });
 
     vk::ImageViewCreateInfo depthStencilView;
     depthStencilView.viewType = vk::ImageViewType::e2D;
@@ -398,18 +1575,23 @@ void ExampleBase::setupDepthStencil() {
     depthStencilView.subresourceRange.aspectMask = aspect;
     depthStencilView.subresourceRange.levelCount = 1;
     depthStencilView.subresourceRange.layerCount = 1;
-    depthStencilView.image = depthStencil.image;
-    depthStencil.view = device.createImageView(depthStencilView);
+    depthStencilView.image = result.image;
+    result.view = device.createImageView(depthStencilView);
+    return result;
 }
 
 void ExampleBase::setupFrameBuffer() {
     // Recreate the frame buffers
     if (!framebuffers.empty()) {
         for (uint32_t i = 0; i < framebuffers.size(); i++) {
-            device.destroyFramebuffer(framebuffers[i]);
+            context.trash(framebuffers[i]);
         }
         framebuffers.clear();
     }
+    // Rendering takes the swap chain image views directly
+    if (dynamicRendering) {
+        return;
+    }
 
     vk::ImageView attachments[2];
 
@@ -431,6 +1613,11 @@ void ExampleBase::setupFrameBuffer() {
 void ExampleBase::setupRenderPass() {
     if (renderPass) {
         device.destroyRenderPass(renderPass);
+        renderPass = nullptr;
+    }
+    if (dynamicRendering) {
+        renderingFormats = { { swapChain.colorFormat }, depthFormat, hasStencil(depthFormat) ? depthFormat : vk::Format::eUndefined };
+        return;
     }
 
     std::vector<vk::AttachmentDescription> attachments;
@@ -511,33 +1698,93 @@ void ExampleBase::addRenderWaitSemaphore(const vk::Semaphore& semaphore, const v
     renderWaitStages.push_back(waitStages);
 }
 
+void ExampleBase::addRenderWaitQueue(const vk::Queue& queue, const vk::PipelineStageFlags& waitStages) {
+    renderWaitQueues.push_back({ queue, waitStages });
+}
+
 void ExampleBase::drawCurrentCommandBuffer() {
-    vk::Fence fence = swapChain.getSubmitFence();
-    {
-        uint32_t fenceIndex = currentBuffer;
-        context.dumpster.push_back([fenceIndex, this] { swapChain.clearSubmitFence(fenceIndex); });
+    auto& frame = frames[currentFrame];
+    const vk::Fence fence = frame.fence;
+
+    // Recorded first, so that whatever the hooks upload or release goes out with this frame
+    if (recordPerFrame) {
+        const auto start = std::chrono::high_resolution_clock::now();
+        if (drawSliceCount) {
+            recordDrawSlices(currentBuffer * drawSliceCount, (currentBuffer + 1) * drawSliceCount);
+        }
+        recordCommandBuffer(currentBuffer);
+        recordingCost.add(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
     }
 
+    // Any uploads recorded since the last frame must be submitted ahead of the frame that uses them
+    context.flushUploads();
+
+    // Anything released while recording this frame is destroyed when the frame slot is next reused
+    frame.trash.splice(frame.trash.end(), context.dumpster);
+    frame.deletions = context.closeDeletions();
+    device.resetFences(fence);
     // Command buffer(s) to be sumitted to the queue
-    context.emptyDumpster(fence);
     {
+        std::vector<vk::Semaphore> waitSemaphores{ renderWaitSemaphores };
+        std::vector<vk::PipelineStageFlags> waitStages{ renderWaitStages };
+        std::vector<vk::Semaphore> signalSemaphores{ renderSignalSemaphores };
+        // The overlay goes in the same batch as the scene, ordered after it by the overlay render pass dependencies
+        std::vector<vk::CommandBuffer> submitCommandBuffers{ recordPerFrame ? frameCommandBuffer : commandBuffers[currentBuffer] };
+        if (settings.overlay && ui.hasCommandBuffer(currentBuffer)) {
+            submitCommandBuffers.push_back(ui.getSubmitCommandBuffer(currentBuffer));
+        }
+        // The capture copies the finished image before it's presented
+        if (captureRequest) {
+            const vk::CommandBuffer capture = readback.record(swapChain.images[currentBuffer].image, vk::ImageLayout::ePresentSrcKHR, size,
+                                                              swapChain.colorFormat, captureRequest);
+            captureRequest = nullptr;
+            if (capture) {
+                submitCommandBuffers.push_back(capture);
+            }
+        }
+        // The displays go in the same batch too, so the frame's fence covers them
+        for (const auto& display : displays) {
+            if (display->active) {
+                submitCommandBuffers.push_back(display->commandBuffer);
+                waitSemaphores.push_back(display->acquireComplete[currentFrame]);
+                waitStages.push_back(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+                signalSemaphores.push_back(display->renderComplete[display->swapChain.currentImage]);
+            }
+        }
+
         vk::SubmitInfo submitInfo;
-        submitInfo.waitSemaphoreCount = (uint32_t)renderWaitSemaphores.size();
-        submitInfo.pWaitSemaphores = renderWaitSemaphores.data();
-        submitInfo.pWaitDstStageMask = renderWaitStages.data();
-
-        submitInfo.signalSemaphoreCount = (uint32_t)renderSignalSemaphores.size();
-        submitInfo.pSignalSemaphores = renderSignalSemaphores.data();
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = commandBuffers.data() + currentBuffer;
+        submitInfo.waitSemaphoreCount = (uint32_t)waitSemaphores.size();
+        submitInfo.pWaitSemaphores = waitSemaphores.data();
+        submitInfo.pWaitDstStageMask = waitStages.data();
+        submitInfo.signalSemaphoreCount = (uint32_t)signalSemaphores.size();
+        submitInfo.pSignalSemaphores = signalSemaphores.data();
+        submitInfo.commandBufferCount = (uint32_t)submitCommandBuffers.size();
+        submitInfo.pCommandBuffers = submitCommandBuffers.data();
         // Submit to queue
-        context.queue.submit(submitInfo, fence);
+        if (context.timelineSemaphoresEnabled) {
+            std::vector<vks::TimelineWait> timelineWaits;
+            for (const auto& waitQueue : renderWaitQueues) {
+                timelineWaits.push_back({ context.getTimeline(waitQueue.first), waitQueue.second });
+            }
+            context.submitTimeline(context.queue, submitInfo, timelineWaits, fence);
+        } else {
+            context.submitBatched(context.queue, submitInfo, fence);
+        }
+        readback.submitted(fence);
     }
 
     context.recycle();
 }
 
+void ExampleBase::requestCapture(const vks::Readback::Callback& onComplete) {
+    if (!readback) {
+        readback.create(context);
+    }
+    captureRequest = onComplete;
+}
+
 void ExampleBase::draw() {
+    VKS_TRACE_ZONE("ExampleBase::draw");
     // Get next image in the swap chain (back/front buffer)
     prepareFrame();
     // Execute the compiled command buffer for the current swap chain image
@@ -554,8 +1801,12 @@ void ExampleBase::render() {
 }
 
 void ExampleBase::update(float deltaTime) {
+    VKS_TRACE_ZONE("ExampleBase::update");
     frameTimer = deltaTime;
     ++frameCounter;
+    pushMetrics(deltaTime);
+    updateRenderScale();
+    updateFramePacing(deltaTime);
 
     camera.update(deltaTime);
     if (camera.moving()) {
@@ -582,6 +1833,13 @@ void ExampleBase::update(float deltaTime) {
 
     updateOverlay();
 
+    if (context.shaderWatcher) {
+        const auto changed = context.shaderWatcher->changed();
+        if (!changed.empty()) {
+            shadersChanged(changed);
+        }
+    }
+
     // Check gamepad state
     const float deadZone = 0.0015f;
     // todo : check if gamepad is present
@@ -611,36 +1869,257 @@ void ExampleBase::update(float deltaTime) {
     }
 }
 
+bool ExampleBase::applyFrameInputs(float& deltaTime) {
+    if (replayingInputs) {
+        if (replayFrame >= inputRecording.frames.size()) {
+            return false;
+        }
+        const auto& frame = inputRecording.frames[replayFrame++];
+        for (const auto& event : frame.events) {
+            onInputEvent(event);
+        }
+        // The handlers should have arrived at the same state, restoring it covers whatever they derive from timing
+        const glm::vec3 rotation(frame.cameraRotation[0], frame.cameraRotation[1], frame.cameraRotation[2]);
+        const glm::vec3 position(frame.cameraPosition[0], frame.cameraPosition[1], frame.cameraPosition[2]);
+        if (rotation != camera.rotation || position != camera.position) {
+            camera.rotation = rotation;
+            camera.setPosition(position);
+            viewUpdated = true;
+        }
+        camera.keys.left = (frame.cameraKeys & 1) != 0;
+        camera.keys.right = (frame.cameraKeys & 2) != 0;
+        camera.keys.up = (frame.cameraKeys & 4) != 0;
+        camera.keys.down = (frame.cameraKeys & 8) != 0;
+        timer = frame.timer;
+        paused = frame.paused != 0;
+        mousePos = glm::vec2(frame.mousePosition[0], frame.mousePosition[1]);
+        mouseButtons.left = (frame.mouseButtons & 1) != 0;
+        mouseButtons.right = (frame.mouseButtons & 2) != 0;
+        mouseButtons.middle = (frame.mouseButtons & 4) != 0;
+        // A connected gamepad isn't part of the recording
+        gamePadState.axisLeft = glm::vec2(0.0f);
+        gamePadState.axisRight = glm::vec2(0.0f);
+        deltaTime = replayTimestep > 0.0f ? replayTimestep : frame.deltaTime;
+        return true;
+    }
+
+    if (!inputCapturePath.empty()) {
+        inputRecording.width = size.width;
+        inputRecording.height = size.height;
+        vks::FrameInputs frame;
+        frame.deltaTime = deltaTime;
+        frame.timer = timer;
+        frame.paused = paused ? 1 : 0;
+        for (int i = 0; i < 3; ++i) {
+            frame.cameraRotation[i] = camera.rotation[i];
+            frame.cameraPosition[i] = camera.position[i];
+        }
+        frame.cameraKeys = (camera.keys.left ? 1 : 0) | (camera.keys.right ? 2 : 0) | (camera.keys.up ? 4 : 0) | (camera.keys.down ? 8 : 0);
+        frame.mousePosition[0] = mousePos.x;
+        frame.mousePosition[1] = mousePos.y;
+        frame.mouseButtons = (mouseButtons.left ? 1 : 0) | (mouseButtons.right ? 2 : 0) | (mouseButtons.middle ? 4 : 0);
+        frame.events.swap(pendingInputs);
+        inputRecording.frames.push_back(std::move(frame));
+    }
+    return true;
+}
+
+void ExampleBase::onInputEvent(const vks::InputEvent& event) {
+    if (!inputCapturePath.empty()) {
+        pendingInputs.push_back(event);
+    }
+    switch (event.type) {
+        case vks::InputEvent::Type::KeyPress:
+            keyPressed((uint32_t)event.code);
+            break;
+        case vks::InputEvent::Type::KeyRelease:
+            keyReleased((uint32_t)event.code);
+            break;
+        case vks::InputEvent::Type::MouseButton:
+            mouseAction(event.code, event.action, event.mods);
+            break;
+        case vks::InputEvent::Type::MouseMove:
+            mouseMoved(glm::vec2(event.x, event.y));
+            break;
+        case vks::InputEvent::Type::MouseScroll:
+            mouseScrolled(event.y);
+            break;
+    }
+}
+
+void ExampleBase::endFrameHistory() {
+    if (profiler.getCollectionCount() != historyCollections) {
+        historyCollections = profiler.getCollectionCount();
+        double gpuTime = 0.0;
+        for (const auto& scope : profiler.getScopes()) {
+            if (scope.depth == 0) {
+                gpuTime += scope.lastMilliseconds;
+            }
+        }
+        frameHistory.addGpuTime((float)gpuTime, [&](std::vector<std::pair<std::string, float>>& zones) {
+            for (const auto& scope : profiler.getScopes()) {
+                zones.emplace_back(std::string(scope.depth * 2, ' ') + scope.name, (float)scope.lastMilliseconds);
+            }
+        });
+    }
+    frameHistory.endFrame();
+}
+
+void ExampleBase::updateRenderScale() {
+    if (!dynamicResolution.enabled() || profiler.getCollectionCount() == resolutionCollections || !supportsDynamicResolution()) {
+        return;
+    }
+    resolutionCollections = profiler.getCollectionCount();
+    // Passes outside the profiled command buffers come in as reports
+    double gpuTime = 0.0;
+    for (const auto& scope : profiler.getScopes()) {
+        if (scope.depth == 0) {
+            gpuTime += scope.lastMilliseconds;
+        }
+    }
+    for (const auto& report : profiler.getReports()) {
+        gpuTime += report.lastMilliseconds;
+    }
+    if (dynamicResolution.update((float)gpuTime)) {
+        renderScaleChanged();
+    }
+}
+
+void ExampleBase::updateFramePacing(float deltaTime) {
+    if (!framePacer.enabled()) {
+        // A fixed --present-interval applies to every display
+        for (auto& display : displays) {
+            display->interval = presentTiming.interval;
+        }
+        return;
+    }
+    uint64_t refreshDuration = presentTiming.refreshDuration;
+#if defined(__ANDROID__)
+    thermalPollTimer -= deltaTime;
+    if (thermalPollTimer <= 0.0f) {
+        // A call into the thermal service, so only once a second
+        framePacer.setThermalStatus((vks::FramePacer::ThermalStatus)vkx::android::thermalStatus());
+        thermalPollTimer = 1.0f;
+    }
+    if (!refreshDuration) {
+        refreshDuration = (uint64_t)vkx::android::vsyncPeriod();
+    }
+#endif
+    if (profiler.getCollectionCount() != pacingCollections) {
+        pacingCollections = profiler.getCollectionCount();
+        double gpuTime = 0.0;
+        for (const auto& scope : profiler.getScopes()) {
+            if (scope.depth == 0) {
+                gpuTime += scope.lastMilliseconds;
+            }
+        }
+        for (const auto& report : profiler.getReports()) {
+            gpuTime += report.lastMilliseconds;
+        }
+        pacingGpuMilliseconds = (float)gpuTime;
+    }
+    // The CPU and GPU work overlap, so a frame takes as long as the slower of the two
+    const float cpuTime = std::max(deltaTime * 1000.0f - frameWaitMilliseconds, 0.0f);
+    const float workTime = std::max(cpuTime, pacingGpuMilliseconds);
+    // The same work, but each display picks the cadence that divides its own refresh rate
+    for (auto& display : displays) {
+        if (display->refreshDuration) {
+            display->framePacer.setRefreshDuration(display->refreshDuration);
+            display->framePacer.update(workTime, deltaTime);
+        }
+        display->interval = display->framePacer.interval();
+    }
+    if (!refreshDuration) {
+        return;
+    }
+    framePacer.setRefreshDuration(refreshDuration);
+    framePacer.update(workTime, deltaTime);
+    presentTiming.interval = framePacer.interval();
+}
+
+void ExampleBase::pushMetrics(float deltaTime) {
+    if (!metrics) {
+        return;
+    }
+    vks::metrics::FrameSample sample;
+    sample.cpuMilliseconds = deltaTime * 1000.0f;
+    if (profiler.getCollectionCount() != metricsCollections) {
+        metricsCollections = profiler.getCollectionCount();
+        double gpuTime = 0.0;
+        for (const auto& scope : profiler.getScopes()) {
+            if (scope.depth == 0) {
+                gpuTime += scope.lastMilliseconds;
+            }
+        }
+        sample.gpuMilliseconds = (float)gpuTime;
+    }
+    // The budgets query the driver, which is too much for every frame
+    metricsMemoryTimer -= deltaTime;
+    if (context.allocator && metricsMemoryTimer <= 0.0f) {
+        metricsMemoryTimer = 0.5f;
+        for (const auto& heap : context.allocator->getHeapBudgets()) {
+            if (heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal) {
+                sample.deviceMemoryBytes += heap.usage;
+            }
+        }
+    }
+    metrics->push(sample);
+}
+
 void ExampleBase::windowResize(const glm::uvec2& newSize) {
     if (!prepared) {
         return;
     }
     prepared = false;
 
-    queue.waitIdle();
-    device.waitIdle();
+    if (!deferredResize) {
+        queue.waitIdle();
+        device.waitIdle();
+    }
 
-    // Recreate swap chain
+    // Recreate swap chain, the old one is handed to the new one and retired along with the frames after it
     size.width = newSize.x;
     size.height = newSize.y;
+    const uint32_t oldImageCount = swapChain.imageCount;
     swapChain.create(size, enableVsync);
+    // The display may have been rotated rather than resized
+    camera.setPreRotation(swapChain.preRotationDegrees());
+    ui.preRotation = swapChain.preRotationDegrees();
+    // Per image resources like the command buffers and query pools are only recreated when the count changes
+    const bool deferred = deferredResize && swapChain.imageCount == oldImageCount;
+    if (!deferred) {
+        queue.waitIdle();
+        imageFences.clear();
+    }
 
     setupDepthStencil();
     setupFrameBuffer();
     setupRenderPassBeginInfo();
 
     if (settings.overlay) {
-        ui.resize(size, framebuffers);
+        std::vector<vk::Image> colorImages;
+        std::vector<vk::ImageView> colorViews;
+        if (dynamicRendering) {
+            for (const auto& image : swapChain.images) {
+                colorImages.push_back(image.image);
+                colorViews.push_back(image.view);
+            }
+        }
+        ui.resize(size, framebuffers, colorImages, colorViews);
     }
 
     // Notify derived class
     windowResized();
 
-    // Command buffers need to be recreated as they may store
-    // references to the recreated frame buffer
-    clearCommandBuffers();
-    allocateCommandBuffers();
+    // Command buffers need to be recreated as they may store references to the recreated frame buffer.  Deferred,
+    // the base class command buffers are re-recorded by prepareFrame once each image's previous frame is done
+    deferCommandBuffers = deferred;
+    if (!deferred) {
+        clearCommandBuffers();
+        allocateCommandBuffers();
+    }
     buildCommandBuffers();
+    deferCommandBuffers = false;
 
     viewChanged();
 
@@ -648,13 +2127,15 @@ void ExampleBase::windowResize(const glm::uvec2& newSize) {
 }
 
 void ExampleBase::updateOverlay() {
+    VKS_TRACE_ZONE("ExampleBase::updateOverlay");
     if (!settings.overlay) {
         return;
     }
+    vks::FrameHistory::ScopedZone zone(frameHistory, "overlay");
 
     ImGuiIO& io = ImGui::GetIO();
 
-    io.DisplaySize = ImVec2((float)size.width, (float)size.height);
+    io.DisplaySize = ImVec2((float)ui.displaySize().width, (float)ui.displaySize().height);
     io.DeltaTime = frameTimer;
 
     io.MousePos = ImVec2(mousePos.x, mousePos.y);
@@ -670,6 +2151,141 @@ void ExampleBase::updateOverlay() {
     ImGui::TextUnformatted(title.c_str());
     ImGui::TextUnformatted(context.deviceProperties.deviceName);
     ImGui::Text("%.2f ms/frame (%.1d fps)", (1000.0f / lastFPS), lastFPS);
+    if (presentTiming.latency > 0.0) {
+        ImGui::Text("%.2f ms input to present", presentTiming.latency);
+    }
+    if (recordPerFrame) {
+        ImGui::Text("%.3f ms recording per frame", recordingCost.milliseconds);
+    } else if (recordingCost.rebuilds) {
+        ImGui::Text("%.3f ms last rebuild (%u rebuilds)", recordingCost.lastMilliseconds, recordingCost.rebuilds);
+    }
+    if (frameHistory.frameCount() && ui.header("Frame times")) {
+        const auto cpu = frameHistory.cpuPercentiles();
+        ImGui::Text("CPU p50 %.2f p95 %.2f p99 %.2f max %.2f ms", cpu.p50, cpu.p95, cpu.p99, cpu.max);
+        if (historyCollections) {
+            const auto gpu = frameHistory.gpuPercentiles();
+            ImGui::Text("GPU p50 %.2f p95 %.2f p99 %.2f max %.2f ms", gpu.p50, gpu.p95, gpu.p99, gpu.max);
+        }
+        const float scale = std::max(cpu.p99 * 1.5f, 1.0f);
+        ImGui::PlotLines("##cputimes", frameHistory.cpuValues(), (int)frameHistory.cpuValueCount(), (int)frameHistory.cpuValueOffset(), "CPU ms", 0.0f,
+                         scale, ImVec2(0.0f, 50.0f * ui.scale));
+        const auto histogram = frameHistory.cpuHistogram(32, scale);
+        ImGui::PlotHistogram("##cpuhistogram", histogram.data(), (int)histogram.size(), 0, "0 to p99 x 1.5", 0.0f, FLT_MAX, ImVec2(0.0f, 50.0f * ui.scale));
+        ImGui::Text("%llu hitches", (unsigned long long)frameHistory.hitchCount());
+        // Newest first
+        const auto& hitches = frameHistory.getHitches();
+        for (auto itr = hitches.rbegin(); itr != hitches.rend(); ++itr) {
+            if (ImGui::TreeNode((void*)(uintptr_t)itr->frame, "Frame %llu: %.2f ms (median %.2f)", (unsigned long long)itr->frame, itr->cpuMilliseconds,
+                                itr->medianMilliseconds)) {
+                for (const auto& zone : itr->cpuZones) {
+                    ImGui::Text("CPU %s: %.3f ms", zone.name, zone.milliseconds);
+                }
+                for (const auto& zone : itr->gpuZones) {
+                    ImGui::Text("GPU %s: %.3f ms", zone.first.c_str(), zone.second);
+                }
+                ImGui::TreePop();
+            }
+        }
+    }
+    if (supportsDynamicResolution() && ui.header("Dynamic resolution")) {
+        bool enabled = dynamicResolution.enabled();
+        if (ui.checkBox("Enabled", &enabled)) {
+            dynamicResolution.setEnabled(enabled);
+            renderScaleChanged();
+        }
+        ui.sliderFloat("GPU budget (ms)", &dynamicResolution.config.targetMilliseconds, 2.0f, 50.0f);
+        ImGui::Text("Render scale: %.0f%%", dynamicResolution.scale() * 100.0f);
+    }
+    if (supportsDepthPrepass() && !drawSliceCount && ui.header("Depth pre-pass")) {
+        if (ui.checkBox("Enabled", &depthPrepass)) {
+            depthPrepassChanged();
+            buildCommandBuffers();
+        }
+        const uint64_t fragments = profiler.getStatistic("Shading", "fragmentShaderInvocations");
+        if (fragments && size.width && size.height) {
+            const double perPixel = (double)fragments / ((double)size.width * size.height);
+            ImGui::Text("Fragments shaded per pixel: %.2f", perPixel);
+            if (!depthPrepass) {
+                depthPrepassBaseline = perPixel;
+            } else if (depthPrepassBaseline > 0.0) {
+                ImGui::Text("Overdraw saved: %.0f%% of %.2f", (1.0 - perPixel / depthPrepassBaseline) * 100.0, depthPrepassBaseline);
+            }
+        } else {
+            ImGui::TextUnformatted("Overdraw needs GPU timings with pipeline statistics");
+        }
+    }
+    if (supportsHalfPrecision() && ui.header("Shader precision")) {
+        if (!context.shaderFloat16Enabled) {
+            ImGui::TextUnformatted("The device has no shaderFloat16");
+        } else {
+            int32_t precision = (int32_t)shaderPrecision;
+            if (ui.comboBox("Arithmetic", &precision, { "32 bit", "16 bit", "Compare" })) {
+                shaderPrecision = (ShaderPrecision)precision;
+                shaderPrecisionChanged();
+            }
+            if (shaderPrecision == ShaderPrecision::Compare) {
+                ImGui::TextUnformatted("Left 32 bit, right 16 bit");
+            }
+        }
+    }
+    if ((!profiler.getScopes().empty() || !profiler.getReports().empty()) && ui.header("GPU timings")) {
+        for (const auto& scope : profiler.getScopes()) {
+            ImGui::Text("%*s%s: %.3f ms", (int)(scope.depth * 2), "", scope.name.c_str(), scope.milliseconds);
+        }
+        for (const auto& report : profiler.getReports()) {
+            ImGui::Text("%s: %.3f ms", report.name.c_str(), report.milliseconds);
+        }
+    }
+    const auto& scopes = profiler.getScopes();
+    const bool statistics = std::any_of(scopes.begin(), scopes.end(), [](const auto& scope) { return !scope.statistics.empty(); });
+    if (statistics && ui.header("Pipeline statistics")) {
+        const auto& counters = profiler.getStatisticNames();
+        for (const auto& scope : scopes) {
+            if (scope.statistics.empty()) {
+                continue;
+            }
+            ImGui::Text("%s: %.3f ms", scope.name.c_str(), scope.milliseconds);
+            for (size_t c = 0; c < counters.size(); ++c) {
+                ImGui::Text("  %s: %llu", counters[c].c_str(), (unsigned long long)scope.statistics[c]);
+            }
+        }
+    }
+
+    if (vks::commandstats::available() && ui.header("Command statistics")) {
+        // Pre-recorded command buffers only have counts once recorded again
+        if (ui.checkBox("Count commands", &settings.commandStats)) {
+            vks::commandstats::setEnabled(settings.commandStats);
+            buildCommandBuffers();
+        }
+        if (settings.commandStats) {
+            for (uint32_t c = 0; c < (uint32_t)vks::commandstats::Counter::Count; ++c) {
+                const auto counter = (vks::commandstats::Counter)c;
+                ImGui::Text("%s: %u", vks::commandstats::counterName(counter), commandStats.commands[counter]);
+            }
+            using Counter = vks::commandstats::Counter;
+            for (size_t i = 0; i < commandStats.commandBuffers.size(); ++i) {
+                const auto& counts = commandStats.commandBuffers[i];
+                ImGui::Text("  #%u: %u draws, %u dispatches, %u pipelines, %u descriptor binds, %u barriers", (uint32_t)i, counts[Counter::Draws],
+                            counts[Counter::Dispatches], counts[Counter::PipelineBinds], counts[Counter::DescriptorBinds], counts[Counter::Barriers]);
+            }
+        }
+    }
+
+    if (context.allocator && ui.header("Device memory")) {
+        const double MiB = 1024.0 * 1024.0;
+        const auto heaps = context.allocator->getHeapBudgets();
+        for (size_t heap = 0; heap < heaps.size(); ++heap) {
+            const auto& entry = heaps[heap];
+            ImGui::Text("Heap %u%s: %.0f / %.0f MiB%s", (uint32_t)heap, (entry.flags & vk::MemoryHeapFlagBits::eDeviceLocal) ? " (device local)" : "",
+                        entry.usage / MiB, entry.budget / MiB, context.memoryBudgetEnabled ? "" : " (estimated)");
+            ImGui::Text("  %.1f of %.1f MiB in blocks in use", entry.usedBytes / MiB, entry.reservedBytes / MiB);
+        }
+        for (const auto& tag : context.allocator->getTagStats()) {
+            if (tag.allocationCount) {
+                ImGui::Text("%s: %.1f MiB in %u allocations", tag.name.c_str(), tag.bytes / MiB, tag.allocationCount);
+            }
+        }
+    }
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
     ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0.0f, 5.0f * ui.scale));
@@ -882,6 +2498,9 @@ void ExampleBase::onAppCmd(int32_t cmd) {
                 initVulkan();
                 setupSwapchain();
                 prepare();
+                context.flushUploads(true);
+                startupTimes.prepareMs = vks::startup::elapsed();
+                vkx::android::startFrameTiming();
             }
             break;
         case APP_CMD_LOST_FOCUS:
@@ -958,39 +2577,68 @@ void ExampleBase::mouseAction(int button, int action, int mods) {
 
 void ExampleBase::KeyboardHandler(GLFWwindow* window, int key, int scancode, int action, int mods) {
     auto example = (ExampleBase*)glfwGetWindowUserPointer(window);
+    if (example->replayingInputs) {
+        return;
+    }
+    vks::InputEvent event;
     switch (action) {
         case GLFW_PRESS:
-            example->keyPressed(key);
+            event.type = vks::InputEvent::Type::KeyPress;
             break;
 
         case GLFW_RELEASE:
-            example->keyReleased(key);
+            event.type = vks::InputEvent::Type::KeyRelease;
             break;
 
         default:
-            break;
+            return;
     }
+    event.code = key;
+    example->onInputEvent(event);
 }
 
 void ExampleBase::MouseHandler(GLFWwindow* window, int button, int action, int mods) {
     auto example = (ExampleBase*)glfwGetWindowUserPointer(window);
-    example->mouseAction(button, action, mods);
+    if (example->replayingInputs) {
+        return;
+    }
+    vks::InputEvent event;
+    event.type = vks::InputEvent::Type::MouseButton;
+    event.code = button;
+    event.action = action;
+    event.mods = mods;
+    example->onInputEvent(event);
 }
 
 void ExampleBase::MouseMoveHandler(GLFWwindow* window, double posx, double posy) {
     auto example = (ExampleBase*)glfwGetWindowUserPointer(window);
-    example->mouseMoved(glm::vec2(posx, posy));
+    if (example->replayingInputs) {
+        return;
+    }
+    vks::InputEvent event;
+    event.type = vks::InputEvent::Type::MouseMove;
+    event.x = (float)posx;
+    event.y = (float)posy;
+    example->onInputEvent(event);
 }
 
 void ExampleBase::MouseScrollHandler(GLFWwindow* window, double xoffset, double yoffset) {
     auto example = (ExampleBase*)glfwGetWindowUserPointer(window);
-    example->mouseScrolled((float)yoffset);
+    if (example->replayingInputs) {
+        return;
+    }
+    vks::InputEvent event;
+    event.type = vks::InputEvent::Type::MouseScroll;
+    event.x = (float)xoffset;
+    event.y = (float)yoffset;
+    example->onInputEvent(event);
 }
 
 void ExampleBase::CloseHandler(GLFWwindow* window) {
     auto example = (ExampleBase*)glfwGetWindowUserPointer(window);
     example->prepared = false;
-    glfwSetWindowShouldClose(window, 1);
+    // Closing any of the displays ends the example too
+    glfwSetWindowShouldClose(example->window, 1);
 }
 
 void ExampleBase::FramebufferSizeHandler(GLFWwindow* window, int width, int height) {
@@ -998,4 +2646,13 @@ void ExampleBase::FramebufferSizeHandler(GLFWwindow* window, int width, int heig
     example->windowResize(glm::uvec2(width, height));
 }
 
+void ExampleBase::DisplaySizeHandler(GLFWwindow* window, int width, int height) {
+    auto example = (ExampleBase*)glfwGetWindowUserPointer(window);
+    for (auto& display : example->displays) {
+        if (display->window == window) {
+            display->resized = true;
+        }
+    }
+}
+
 #endif
@@ -17,6 +17,19 @@
 #include "vks/shaders.hpp"
 #include "vks/pipelines.hpp"
 #include "vks/texture.hpp"
+#include "vks/profiler.hpp"
+#include "vks/scheduler.hpp"
+#include "vks/startup.hpp"
+#include "vks/readback.hpp"
+#include "vks/assets.hpp"
+#include "vks/frameallocator.hpp"
+#include "vks/framehistory.hpp"
+#include "vks/metrics.hpp"
+#include "vks/inputrecording.hpp"
+#include "vks/dynamicresolution.hpp"
+#include "vks/framepacer.hpp"
+#include "vks/presentbatch.hpp"
+#include "vks/descriptors.hpp"
 
 #include "ui.hpp"
 #include "utils.hpp"
@@ -89,6 +102,49 @@ protected:
     bool enableVsync{ false };
     // Command buffers used for rendering
     std::vector<vk::CommandBuffer> commandBuffers;
+    // Secondary command buffers executed by commandBuffers when drawSliceCount is set, indexed by image * drawSliceCount + slice
+    std::vector<std::pair<vk::CommandPool, vk::CommandBuffer>> sliceCommandBuffers;
+    void recordDrawSlices();
+    // (Re-)record the slices in [begin, end) of sliceCommandBuffers
+    void recordDrawSlices(size_t begin, size_t end);
+    // Images whose command buffer refers to resources replaced by a resize, re-recorded by prepareFrame as they come up
+    std::vector<bool> staleCommandBuffers;
+    // Set while windowResize calls buildCommandBuffers, which then only marks the command buffers as stale
+    bool deferCommandBuffers{ false };
+    // Record the command buffer of swap chain image `image`, see buildCommandBuffers.  With recordPerFrame it is the
+    // command buffer of the current frame instead
+    void recordCommandBuffer(uint32_t image);
+    // Begin and end the default render pass on swap chain image `image`, or with dynamicRendering the equivalent
+    // rendering with its layout transitions
+    void beginFrameRendering(const vk::CommandBuffer& cmdBuffer, uint32_t image, vk::SubpassContents contents);
+    void endFrameRendering(const vk::CommandBuffer& cmdBuffer, uint32_t image);
+
+    // Record a fresh command buffer every frame, from a command pool of the frame slot that is reset as a whole,
+    // instead of pre-recording one per swap chain image.  buildCommandBuffers then only has to be called once, and the
+    // hooks like updateDrawCommandBuffer see the current state each frame.  Must be set before prepare(), or with
+    // --record-per-frame
+    bool recordPerFrame{ false };
+    // The command buffer recorded for the current frame, with recordPerFrame
+    vk::CommandBuffer frameCommandBuffer;
+
+    // CPU cost of recording the frame command buffers: every frame with recordPerFrame, otherwise every rebuild of all
+    // of them by buildCommandBuffers
+    struct RecordingCost {
+        // Smoothed and most recent recording time in milliseconds
+        double milliseconds{ 0.0 };
+        double lastMilliseconds{ 0.0 };
+        uint32_t rebuilds{ 0 };
+        // Recording times since the start of the last prepareFrame
+        std::vector<double> samples;
+
+        void add(double cost) {
+            milliseconds = rebuilds++ ? milliseconds * 0.9 + cost * 0.1 : cost;
+            lastMilliseconds = cost;
+            samples.push_back(cost);
+        }
+    } recordingCost;
+    // Shared by everything in the example that records or prepares work in parallel
+    vks::TaskScheduler& getScheduler();
     std::vector<vk::ClearValue> clearValues;
     vk::RenderPassBeginInfo renderPassBeginInfo;
     vk::Viewport viewport() { return vks::util::viewport(size); }
@@ -117,10 +173,21 @@ protected:
 
     // List of available frame buffers (same as number of swap chain images)
     std::vector<vk::Framebuffer> framebuffers;
+    // Set by initVulkan for examples that support it, with --dynamic-rendering and a device that has it.  The frame is
+    // then drawn with cmdBeginRenderingKHR straight into the swap chain image and depth buffer, renderPass and
+    // framebuffers stay empty and resizes recreate neither.
+    bool dynamicRendering{ false };
+    // The swap chain and depth buffer formats with dynamicRendering, for the pipelines of updateDrawCommandBuffer, see
+    // GraphicsPipelineBuilder::renderingState.  Empty otherwise.
+    vks::pipelines::PipelineRenderingCreateInfo renderingFormats;
     // Active frame buffer index
     uint32_t currentBuffer = 0;
     // Descriptor set pool
     vk::DescriptorPool descriptorPool;
+    // Sets from pools that grow on demand, for examples that don't size `descriptorPool` themselves.  Sets from
+    // `frameDescriptors` are recycled once their frame slot comes around again, so they go with recordPerFrame
+    vks::DescriptorAllocator descriptorAllocator;
+    vks::FrameDescriptorAllocator frameDescriptors;
 
     void addRenderWaitSemaphore(const vk::Semaphore& semaphore, const vk::PipelineStageFlags& waitStages = vk::PipelineStageFlagBits::eBottomOfPipe);
 
@@ -128,6 +195,12 @@ protected:
     std::vector<vk::PipelineStageFlags> renderWaitStages;
     std::vector<vk::Semaphore> renderSignalSemaphores;
 
+    // With timeline semaphores enabled, make every frame wait for all work submitted so far to `queue`, instead of
+    // pairing binary semaphores with the other queue.  Frames then also signal the graphics queue's timeline.
+    void addRenderWaitQueue(const vk::Queue& queue, const vk::PipelineStageFlags& waitStages);
+
+    std::vector<std::pair<vk::Queue, vk::PipelineStageFlags>> renderWaitQueues;
+
     vks::Context context;
     const vk::PhysicalDevice& physicalDevice{ context.physicalDevice };
     const vk::Device& device{ context.device };
@@ -140,19 +213,112 @@ protected:
     // Wraps the swap chain to present images (framebuffers) to the windowing system
     vks::SwapChain swapChain;
 
-    // Synchronization semaphores
+    // Number of frames the CPU may record and submit ahead of the GPU.  Must be set before run(), or with --frames-in-flight
+    uint32_t framesInFlight{ 2 };
+
+    // Frame pacing and input to present latency, measured with VK_GOOGLE_display_timing where the device supports it.
+    // The present mode and image count are set with --present-mode <mailbox|fifo|fifo-relaxed|immediate> and
+    // --swapchain-images <count>, see vks::SwapChain::config.
+    struct PresentTiming {
+        // Refresh cycles from one present to the next, 0 to present as soon as possible.  Set with --present-interval
+        uint32_t interval{ 0 };
+        // Duration of a display refresh in nanoseconds, 0 without display timing
+        uint64_t refreshDuration{ 0 };
+        // When input was sampled for the frame being recorded, in steady clock nanoseconds
+        uint64_t inputTime{ 0 };
+        // Input times of the presents still waiting for their timing, by present id
+        std::deque<std::pair<uint32_t, uint64_t>> pending;
+        // The most recent present known to have reached the display
+        uint32_t lastId{ 0 };
+        uint64_t lastTime{ 0 };
+        // Smoothed input to present latency in milliseconds, 0 until the first timing arrived
+        double latency{ 0.0 };
+        // Latencies in milliseconds of the timings that arrived during the last prepareFrame
+        std::vector<double> samples;
+    } presentTiming;
+
+    // Synchronization objects owned by one frame in flight.  The fence is created signaled and is
+    // waited on before the frame slot is reused, so nothing in it is touched while the GPU may still
+    // be processing the previous submission from the same slot.
+    struct FrameSync {
+        vk::Fence fence;
+        vk::Semaphore acquireComplete;
+        // Context dumpster contents from this frame, executed once the fence signals
+        vks::VoidLambdaList trash;
+        // The batch of typed context deletions closed by this frame, completed once the fence signals
+        uint64_t deletions{ 0 };
+    };
+    std::vector<FrameSync> frames;
+    // Index into `frames` of the frame currently being recorded
+    uint32_t currentFrame{ 0 };
+    // The fence of the last frame that rendered to each swap chain image
+    std::vector<vk::Fence> imageFences;
+    // Signaled by the frame that renders to each swap chain image and waited on by its present.  By image rather
+    // than by frame slot: a slot comes around again once its fence signals, which says nothing about the present,
+    // while an image is only acquired again once its present no longer waits.
+    std::vector<vk::Semaphore> presentSemaphores;
+    // The swap chain they were made for, they're replaced along with it
+    vk::SwapchainKHR presentSemaphoresSwapChain;
+    // Per frame constants, with a region per frame in flight.  Created by the examples that use it, with
+    // `frames.size()` regions, and moved to the current frame's region by prepareFrame.  Allocations are only valid
+    // for the frame they were made in, so they go with recordPerFrame
+    vks::FrameAllocator frameAllocator;
+
+    // Synchronization semaphores of the current frame.  These change every frame, so they should be
+    // read after prepareFrame rather than cached.
     struct {
         // Swap chain image presentation
         vk::Semaphore acquireComplete;
-        // Command buffer submission and execution
+        // Command buffer submission and execution, including the UI overlay.  One of presentSemaphores, set once the
+        // image is acquired
         vk::Semaphore renderComplete;
-        // UI buffer submission and execution
-        vk::Semaphore overlayComplete;
 #if 0
         vk::Semaphore transferComplete;
 #endif
     } semaphores;
 
+    // A further window with a swap chain of its own on `context`, see addDisplay.  Drawn with the default render pass,
+    // so the pipelines of the main window draw in it too, into a depth buffer and framebuffers of its own.
+    struct Display {
+#if !defined(__ANDROID__)
+        GLFWwindow* window{ nullptr };
+#endif
+        vk::SurfaceKHR surface;
+        vks::SwapChain swapChain;
+        vk::Extent2D size;
+        vks::Image depthStencil;
+        std::vector<vk::Framebuffer> framebuffers;
+        // Per frame in flight, like the semaphore of FrameSync
+        std::vector<vk::Semaphore> acquireComplete;
+        // Per swap chain image, like presentSemaphores, and made along with the swap chain
+        std::vector<vk::Semaphore> renderComplete;
+        // Recorded by prepareFrame from the frame slot's command pools, and submitted along with the frame
+        vk::CommandBuffer commandBuffer;
+        // Cleared by prepareFrame while the window is minimized, the display then skips the frame
+        bool active{ false };
+        // Set when the window was resized or a present found the swap chain out of date, recreated by prepareFrame
+        bool resized{ false };
+        // The display's own cadence, set by updateFramePacing from its refresh rate, and its present timing
+        vks::FramePacer framePacer;
+        uint32_t interval{ 0 };
+        uint64_t refreshDuration{ 0 };
+        uint32_t lastPresentId{ 0 };
+        uint64_t lastPresentTime{ 0 };
+    };
+    // Drawn and presented by every frame that goes through drawCurrentCommandBuffer and submitFrame.  The frame loop
+    // runs at the pace of the slowest of them, with vsync it blocks in the acquire of each.
+    std::vector<std::unique_ptr<Display>> displays;
+    // The presents of the main swap chain and the displays, sent by submitFrame in one vkQueuePresentKHR
+    vks::PresentBatch presentBatch;
+
+    // Open another window of `displaySize` on the main window's device, returning its index for
+    // updateDisplayCommandBuffer.  Call from prepare(), after ExampleBase::prepare.  Needs a surface that supports the
+    // main swap chain's format, and isn't available on Android or with dynamicRendering.
+    uint32_t addDisplay(const vk::Extent2D& displaySize, const glm::ivec2& position = glm::ivec2(-1));
+    // Record what display `index` shows into the default render pass on its framebuffer, with the viewport and
+    // scissor already set to cover it.  Called by prepareFrame every frame that the display is active.
+    virtual void updateDisplayCommandBuffer(const vk::CommandBuffer& commandBuffer, uint32_t index) {}
+
     // Returns the base asset path (for shaders, models, textures) depending on the os
     const std::string& getAssetPath() { return ::vkx::getAssetPath(); }
 
@@ -167,18 +333,146 @@ protected:
         bool vsync = false;
         /** @brief Enable UI overlay */
         bool overlay = true;
+        /** @brief Time debug marker regions with GPU timestamps and show the results in the UI overlay */
+        bool gpuTimings = true;
+        /** @brief Count the commands recorded and submitted every frame, see vks/commandstats.hpp (--command-stats) */
+        bool commandStats = false;
     } settings;
 
+    // The command counts of the previous frame, with settings.commandStats
+    vks::commandstats::FrameStats commandStats;
+
+    // Per frame CPU and GPU times and hitches, shown in the UI overlay
+    vks::FrameHistory frameHistory;
+    uint64_t historyCollections{ 0 };
+
+    // Frame statistics exported continuously with --metrics <backend>, see vks::metrics::createBackend, every
+    // --metrics-interval <seconds>
+    std::unique_ptr<vks::metrics::MetricsSink> metrics;
+    uint64_t metricsCollections{ 0 };
+    float metricsMemoryTimer{ 0.0f };
+
+    // The render scale of examples that support it, driven by the GPU time of the profiler scopes and reports.
+    // --dynamic-resolution <target milliseconds> enables it, --dynamic-resolution-min <scale> bounds it.
+    vks::DynamicResolution dynamicResolution;
+    uint64_t resolutionCollections{ 0 };
+
+    // Draw the examples that support it in two passes, depth first, see supportsDepthPrepass.  --depth-prepass sets it.
+    // The overlay compares the fragments shaded by the main pass with the last ones counted without the pre-pass.
+    bool depthPrepass{ false };
+    double depthPrepassBaseline{ 0.0 };
+
+    // The arithmetic of the shaders with _fp16 variants, see supportsHalfPrecision.  Compare draws the left half of the
+    // frame with the 32 bit shaders and the right half with the 16 bit ones.  --shader-precision full|half|compare
+    // sets it.
+    enum class ShaderPrecision : int32_t
+    {
+        Full,
+        Half,
+        Compare,
+    };
+    ShaderPrecision shaderPrecision{ ShaderPrecision::Full };
+
+    // Holds presents to a steady cadence, see vks::FramePacer, which sets presentTiming.interval.  On by default on
+    // Android, where the choreographer times the refreshes and the thermal API caps the cadence, and elsewhere with
+    // --frame-pacing, which needs VK_GOOGLE_display_timing.  --no-frame-pacing turns it off.
+    vks::FramePacer framePacer;
+    bool framePacing{ false };
+    // Time the current frame spent waiting for its frame slot and swap chain image, which isn't work for the pacer
+    float frameWaitMilliseconds{ 0.0f };
+    uint64_t pacingCollections{ 0 };
+    float pacingGpuMilliseconds{ 0.0f };
+    float thermalPollTimer{ 0.0f };
+    // Render in the display panel's orientation and rotate the projection instead, see vks::SwapChain::Config::preRotate.
+    // On by default on Android for the examples that support it, --no-pre-rotate turns it off.
+    bool preRotate{ false };
+
+    // Timestamp scopes for the debug marker regions recorded by buildCommandBuffers
+    vks::debug::GpuProfiler profiler;
+
+    // With VKS_TRACE, --trace <file> captures CPU zones, and the profiler scopes on a GPU track, to a Chrome trace
+    // written to `tracePath` on exit, see vks/trace.hpp
+    std::string tracePath;
+    vks::debug::TimestampCalibration timestampCalibration;
+    uint64_t tracedCollections{ 0 };
+
+    // --capture-inputs <file> records the window events and the state every frame starts from, written to the file on
+    // exit.  --replay-inputs <file> plays such a recording back instead of the window's events, at the recorded window
+    // size and timesteps, or at a fixed --replay-timestep <seconds>, and exits at its end.  See vks/inputrecording.hpp
+    std::string inputCapturePath;
+    vks::InputRecording inputRecording;
+    bool replayingInputs{ false };
+    size_t replayFrame{ 0 };
+    float replayTimestep{ 0.0f };
+    // The events since the last captured frame
+    std::vector<vks::InputEvent> pendingInputs;
+
+    // Created on the first call to getScheduler
+    std::unique_ptr<vks::TaskScheduler> scheduler;
+
+    // Textures and models loaded in the background, see vks::AssetManager.  Created by prepare() before loadAssets,
+    // and swapped in by prepareFrame
+    vks::AssetManager assets;
+
+    // Copies of presented frames, created on the first requestCapture
+    vks::Readback readback;
+    vks::Readback::Callback captureRequest;
+
+    // Copy the next frame drawn, including the UI overlay, to host memory and call `onComplete` with it on a worker
+    // thread, without waiting for it.  Captures are dropped when the readback ring is full, see vks::Readback.
+    void requestCapture(const vks::Readback::Callback& onComplete);
+
     struct {
         bool left = false;
         bool right = false;
         bool middle = false;
     } mouseButtons;
 
+    // The measurements of one benchmark run
+    struct BenchmarkRun {
+        // The --benchmark-sweep value the run measured, 0 without a sweep
+        uint32_t value{ 0 };
+        std::vector<double> cpuFrameTimes;
+        // Only frames for which GPU timestamps had been collected have an entry
+        std::vector<double> gpuFrameTimes;
+        // Every profiler scope and report by name, sampled along with the GPU frame times
+        std::vector<std::pair<std::string, std::vector<double>>> scopeTimes;
+        // The pipeline statistics of the scopes that have them, per counter of GpuProfiler::getStatisticNames()
+        std::vector<std::pair<std::string, std::vector<std::vector<double>>>> scopeStatistics;
+        // Input to present latencies, only measured with display timing
+        std::vector<double> presentLatencies;
+        // Command buffer recording times, see RecordingCost
+        std::vector<double> recordTimes;
+        // Per vks::commandstats::Counter, with settings.commandStats
+        std::vector<std::vector<double>> commandCounts;
+    };
+
+    // Fixed length, fixed timestep run enabled with --benchmark.  The remaining fields can be set with
+    // --benchmark-warmup <frames>, --benchmark-frames <frames>, --benchmark-timestep <seconds> and
+    // --benchmark-output <file>, where a .csv extension selects a per frame CSV report instead of JSON.
+    // --benchmark-sweep <value,value,...> repeats the run once per value, see applyBenchmarkSweep.
     struct {
         bool active = false;
+        uint32_t warmupFrames = 100;
+        uint32_t frameCount = 1000;
+        float timestep = 1.0f / 60.0f;
+        // Defaults to <name>.benchmark.json
+        std::string outputPath;
+        std::vector<uint32_t> sweep;
+        std::vector<BenchmarkRun> runs;
     } benchmark;
 
+    // Time to first frame, measured from the start of run, see vks/startup.hpp for the phases.  Logged after the
+    // first present and included in the benchmark report.
+    struct {
+        // When initVulkan and prepare (with its uploads flushed) completed, and the first present was queued
+        double initVulkanMs{ 0.0 };
+        double prepareMs{ 0.0 };
+        double firstPresentMs{ 0.0 };
+        double phaseMs[(size_t)vks::startup::Phase::Count]{};
+        bool complete{ false };
+    } startupTimes;
+
     // Command buffer pool
     vk::CommandPool cmdPool;
 
@@ -211,6 +505,8 @@ protected:
     std::string title = "Vulkan Example";
     std::string name = "vulkanExample";
     vks::Image depthStencil;
+    // Examples that read the depth buffer in shaders add eSampled before prepare()
+    vk::ImageUsageFlags depthStencilUsage{ vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransferSrc };
 
     // Gamepad state (only one pad supported)
     struct {
@@ -243,8 +539,19 @@ protected:
     // Can be overriden in derived class to recreate or rebuild resources attached to the frame buffer / swapchain
     virtual void windowResized() {}
 
+    // With --hot-reload, called from update with the SPIR-V files whose GLSL sources changed and compiled.  Loading
+    // them again through the shader module cache picks up the new code, see GraphicsPipelineVariants::reload.
+    virtual void shadersChanged(const std::vector<std::string>& files) {}
+
+    // When set, windowResize doesn't wait for the device.  The old swap chain, framebuffers and depth buffer are
+    // released through the context once the frames using them are done, so examples that destroy resources directly
+    // in windowResized or setupFrameBuffer must clear it.  Changes in the number of swap chain images always wait.
+    bool deferredResize{ true };
+
     // Setup default depth and stencil views
     void setupDepthStencil();
+    // A depth buffer of `extent`, with the transition to its attachment layout recorded as an upload
+    vks::Image createDepthStencil(const vk::Extent2D& extent);
     // Create framebuffers for all requested swap chain images
     // Can be overriden in derived class to setup a custom framebuffer (e.g. for MSAA)
     virtual void setupFrameBuffer();
@@ -259,8 +566,25 @@ protected:
 
     virtual void updateDrawCommandBuffer(const vk::CommandBuffer& commandBuffer) {}
 
+    // With depthPrepass, recorded into the default render pass ahead of updateDrawCommandBuffer to lay down the depth
+    // of the opaque geometry, so that the main pass shades each pixel about once.  See supportsDepthPrepass
+    virtual void updateDepthPrepassCommandBuffer(const vk::CommandBuffer& commandBuffer) {}
+
+    // When non-zero, buildCommandBuffers records the render pass contents as this many secondary command buffers
+    // per swap chain image, on worker threads, by calling updateDrawCommandBufferSlice instead of
+    // updateDrawCommandBuffer.  Only usable with single subpass render passes.
+    uint32_t drawSliceCount{ 0 };
+
+    // Record slice `slice` of `sliceCount` of the scene into a secondary command buffer that continues the default
+    // render pass.  Called concurrently from several threads, so it must not modify shared state.  Dynamic state
+    // is not inherited from the primary, so each slice must set its own viewport and scissor.
+    virtual void updateDrawCommandBufferSlice(const vk::CommandBuffer& commandBuffer, uint32_t slice, uint32_t sliceCount) {}
+
     virtual void updateCommandBufferPostDraw(const vk::CommandBuffer& commandBuffer) {}
 
+    // The swap chain image that `commandBuffer`, one of the primaries passed to the hooks above, renders to
+    uint32_t commandBufferImage(const vk::CommandBuffer& commandBuffer) const;
+
     void drawCurrentCommandBuffer();
 
     // Prepare commonly used Vulkan functions
@@ -268,20 +592,87 @@ protected:
 
     virtual void loadAssets() {}
 
+    // Called by prepareFrame once `assets` swapped in assets, with the device idle, so that descriptor sets referring
+    // to the placeholders can be written again.  Re-records the command buffers by default
+    virtual void assetsLoaded() { buildCommandBuffers(); }
+
     bool platformLoopCondition();
 
     // Start the main render loop
     void renderLoop();
 
+    // Apply command line options to `settings` and `benchmark`
+    void parseCommandLine();
+    // Render the configured number of benchmark frames, once per sweep value if there are any, then write the report
+    void benchmarkLoop();
+    void writeBenchmarkReport() const;
+    // Rebuild whatever depends on the --benchmark-sweep `value`, like the number of instances drawn, before the run
+    // measuring it.  Examples without a notion of scale return false, which ends the benchmark.
+    virtual bool applyBenchmarkSweep(uint32_t value) { return false; }
+
     // Prepare the frame for workload submission
+    // - Waits until the GPU has finished with the submission that last used this frame slot
     // - Acquires the next image from the swap chain
     // - Submits a post present barrier
     // - Sets the default wait and signal semaphores
     void prepareFrame();
+    // Turn the presentation timings that arrived since the last call into latencies
+    void collectPresentTiming();
+    // Add the profiler scopes of a new collection to the trace capture, if there is one
+    void traceGpuScopes();
+    // Stop the startup timing at the first present and log it
+    void finishStartupTimes();
+    // Hand the frame's statistics to `metrics`, if exporting
+    void pushMetrics(float deltaTime);
+    // Close the frame in `frameHistory`, after render and update
+    void endFrameHistory();
+    // Feed a new profiler collection to `dynamicResolution`, calling renderScaleChanged if it picks another scale
+    void updateRenderScale();
+    // Examples that render at dynamicResolution.extent() of their targets and upscale the result return true
+    virtual bool supportsDynamicResolution() const { return false; }
+    // Called when dynamicResolution.scale() changed, to re-record the viewports and update the composition
+    virtual void renderScaleChanged() {}
+    // Examples that implement updateDepthPrepassCommandBuffer return true.  While depthPrepass is set their opaque
+    // pipelines test depth with eEqual and don't write it, and the vertex shaders of both passes declare gl_Position
+    // invariant.  Not used with drawSliceCount.
+    virtual bool supportsDepthPrepass() const { return false; }
+    // Called when depthPrepass changed, to rebuild the pipelines, trashing the old ones, which frames in flight
+    // may still use.  The command buffers are rebuilt after it
+    virtual void depthPrepassChanged() {}
+    // Examples with _fp16 variants of their shaders, see data/shaders/base/precision.glsl, return true, so that
+    // the device is created with shaderFloat16 where it's supported, and draw through recordWithPrecision
+    virtual bool supportsHalfPrecision() const { return false; }
+    // Called when shaderPrecision changed, to rebuild the command buffers that draw through recordWithPrecision
+    virtual void shaderPrecisionChanged() { buildCommandBuffers(); }
+    // Call `draw` with whether to bind the 16 bit pipelines, for shaderPrecision: once, or twice with Compare, each
+    // time scissored to its half of `extent`.  The scissor is left at the whole of `extent`
+    void recordWithPrecision(const vk::CommandBuffer& commandBuffer, const vk::Extent2D& extent, const std::function<void(bool half)>& draw) const;
+    // Feed the frame's work time and the device's refresh timing and thermal status to `framePacer`
+    void updateFramePacing(float deltaTime);
+    // Examples whose projections all come from `camera`, which rotates them with the swap chain's pre-rotation, or
+    // that apply swapChain.preRotationDegrees() themselves.  Examples that override it with false leave the
+    // rotation to the compositor.
+    virtual bool supportsPreRotation() const { return true; }
+    // Examples that build the pipelines they draw in the default render pass with renderingFormats, and use neither
+    // renderPass nor framebuffers otherwise, return true
+    virtual bool supportsDynamicRendering() const { return false; }
+    // Before rendering a frame, capture its inputs or replay the next recorded ones, and return the timestep to update
+    // it with, `deltaTime` unless it's replayed.  False at the end of a replay.
+    bool applyFrameInputs(float& deltaTime);
+    // Pass a window event on to keyPressed, mouseAction and the other handlers, recording it when capturing
+    void onInputEvent(const vks::InputEvent& event);
+
+    // Create / destroy the `framesInFlight` sets of frame synchronization objects
+    void setupFrameSync();
+    void destroyFrameSync();
+    // (Re)create the swap chain, depth buffer and framebuffers of `display`, releasing the old ones through the context
+    void setupDisplay(Display& display);
+    // Acquire the next image of every display and record its command buffer, for prepareFrame
+    void prepareDisplays();
+    void destroyDisplays();
 
     // Submit the frames' workload
-    // - Submits the text overlay (if enabled)
-    // -
+    // - Presents the current image once rendering (including the UI overlay) has completed
     void submitFrame();
 
     virtual const glm::mat4& getProjection() const { return camera.matrices.perspective; }
@@ -315,6 +706,7 @@ private:
     static void MouseMoveHandler(GLFWwindow* window, double posx, double posy);
     static void MouseScrollHandler(GLFWwindow* window, double xoffset, double yoffset);
     static void FramebufferSizeHandler(GLFWwindow* window, int width, int height);
+    static void DisplaySizeHandler(GLFWwindow* window, int width, int height);
     static void CloseHandler(GLFWwindow* window);
 #endif
 };
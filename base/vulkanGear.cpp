@@ -9,45 +9,35 @@
 */
 
 #include "vulkanGear.h"
+
+#include <algorithm>
+
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/matrix_inverse.hpp>
 
-int32_t VulkanGear::newVertex(std::vector<Vertex>* vBuffer, float x, float y, float z, const glm::vec3& normal) {
+namespace {
+
+int32_t newVertex(std::vector<Vertex>* vBuffer, float x, float y, float z, const glm::vec3& normal, const glm::vec3& color) {
     Vertex v(glm::vec3(x, y, z), normal, color);
     vBuffer->push_back(v);
     return (uint32_t)vBuffer->size() - 1;
 }
 
-void VulkanGear::newFace(std::vector<uint32_t>* iBuffer, int a, int b, int c) {
+void newFace(std::vector<uint32_t>* iBuffer, int a, int b, int c) {
     iBuffer->push_back(a);
     iBuffer->push_back(b);
     iBuffer->push_back(c);
 }
 
-VulkanGear::~VulkanGear() {
-    // Clean up vulkan resources
-    uniformData.destroy();
-    meshInfo.destroy();
+glm::vec3 lightPosition(float timer) {
+    return glm::vec3(sin(glm::radians(timer)) * 8.0f, 0.0f, cos(glm::radians(timer)) * 8.0f);
 }
 
-void VulkanGear::generate(const vks::Context& context,
-                          float inner_radius,
-                          float outer_radius,
-                          float width,
-                          int teeth,
-                          float tooth_depth,
-                          glm::vec3 color,
-                          glm::vec3 pos,
-                          float rotSpeed,
-                          float rotOffset) {
-    device = context.device;
-    this->color = color;
-    this->pos = pos;
-    this->rotOffset = rotOffset;
-    this->rotSpeed = rotSpeed;
+}  // namespace
 
-    std::vector<Vertex> vBuffer;
-    std::vector<uint32_t> iBuffer;
+void GearDefinition::generateMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) const {
+    std::vector<Vertex>* vBuffer = &vertices;
+    std::vector<uint32_t>* iBuffer = &indices;
 
     int i;
     float r0, r1, r2;
@@ -57,9 +47,9 @@ void VulkanGear::generate(const vks::Context& context,
     float sin_ta, sin_ta_1da, sin_ta_2da, sin_ta_3da, sin_ta_4da;
     int32_t ix0, ix1, ix2, ix3, ix4, ix5;
 
-    r0 = inner_radius;
-    r1 = outer_radius - tooth_depth / 2.0f;
-    r2 = outer_radius + tooth_depth / 2.0f;
+    r0 = innerRadius;
+    r1 = outerRadius - toothDepth / 2.0f;
+    r2 = outerRadius + toothDepth / 2.0f;
     da = 2.0f * (float)M_PI / teeth / 4.0f;
 
     glm::vec3 normal;
@@ -88,90 +78,123 @@ void VulkanGear::generate(const vks::Context& context,
 
         // front face
         normal = glm::vec3(0.0, 0.0, 1.0);
-        ix0 = newVertex(&vBuffer, r0 * cos_ta, r0 * sin_ta, width * 0.5f, normal);
-        ix1 = newVertex(&vBuffer, r1 * cos_ta, r1 * sin_ta, width * 0.5f, normal);
-        ix2 = newVertex(&vBuffer, r0 * cos_ta, r0 * sin_ta, width * 0.5f, normal);
-        ix3 = newVertex(&vBuffer, r1 * cos_ta_3da, r1 * sin_ta_3da, width * 0.5f, normal);
-        ix4 = newVertex(&vBuffer, r0 * cos_ta_4da, r0 * sin_ta_4da, width * 0.5f, normal);
-        ix5 = newVertex(&vBuffer, r1 * cos_ta_4da, r1 * sin_ta_4da, width * 0.5f, normal);
-        newFace(&iBuffer, ix0, ix1, ix2);
-        newFace(&iBuffer, ix1, ix3, ix2);
-        newFace(&iBuffer, ix2, ix3, ix4);
-        newFace(&iBuffer, ix3, ix5, ix4);
+        ix0 = newVertex(vBuffer, r0 * cos_ta, r0 * sin_ta, width * 0.5f, normal, color);
+        ix1 = newVertex(vBuffer, r1 * cos_ta, r1 * sin_ta, width * 0.5f, normal, color);
+        ix2 = newVertex(vBuffer, r0 * cos_ta, r0 * sin_ta, width * 0.5f, normal, color);
+        ix3 = newVertex(vBuffer, r1 * cos_ta_3da, r1 * sin_ta_3da, width * 0.5f, normal, color);
+        ix4 = newVertex(vBuffer, r0 * cos_ta_4da, r0 * sin_ta_4da, width * 0.5f, normal, color);
+        ix5 = newVertex(vBuffer, r1 * cos_ta_4da, r1 * sin_ta_4da, width * 0.5f, normal, color);
+        newFace(iBuffer, ix0, ix1, ix2);
+        newFace(iBuffer, ix1, ix3, ix2);
+        newFace(iBuffer, ix2, ix3, ix4);
+        newFace(iBuffer, ix3, ix5, ix4);
 
         // front sides of teeth
         normal = glm::vec3(0.0, 0.0, 1.0);
-        ix0 = newVertex(&vBuffer, r1 * cos_ta, r1 * sin_ta, width * 0.5f, normal);
-        ix1 = newVertex(&vBuffer, r2 * cos_ta_1da, r2 * sin_ta_1da, width * 0.5f, normal);
-        ix2 = newVertex(&vBuffer, r1 * cos_ta_3da, r1 * sin_ta_3da, width * 0.5f, normal);
-        ix3 = newVertex(&vBuffer, r2 * cos_ta_2da, r2 * sin_ta_2da, width * 0.5f, normal);
-        newFace(&iBuffer, ix0, ix1, ix2);
-        newFace(&iBuffer, ix1, ix3, ix2);
+        ix0 = newVertex(vBuffer, r1 * cos_ta, r1 * sin_ta, width * 0.5f, normal, color);
+        ix1 = newVertex(vBuffer, r2 * cos_ta_1da, r2 * sin_ta_1da, width * 0.5f, normal, color);
+        ix2 = newVertex(vBuffer, r1 * cos_ta_3da, r1 * sin_ta_3da, width * 0.5f, normal, color);
+        ix3 = newVertex(vBuffer, r2 * cos_ta_2da, r2 * sin_ta_2da, width * 0.5f, normal, color);
+        newFace(iBuffer, ix0, ix1, ix2);
+        newFace(iBuffer, ix1, ix3, ix2);
 
         // back face
         normal = glm::vec3(0.0, 0.0, -1.0);
-        ix0 = newVertex(&vBuffer, r1 * cos_ta, r1 * sin_ta, -width * 0.5f, normal);
-        ix1 = newVertex(&vBuffer, r0 * cos_ta, r0 * sin_ta, -width * 0.5f, normal);
-        ix2 = newVertex(&vBuffer, r1 * cos_ta_3da, r1 * sin_ta_3da, -width * 0.5f, normal);
-        ix3 = newVertex(&vBuffer, r0 * cos_ta, r0 * sin_ta, -width * 0.5f, normal);
-        ix4 = newVertex(&vBuffer, r1 * cos_ta_4da, r1 * sin_ta_4da, -width * 0.5f, normal);
-        ix5 = newVertex(&vBuffer, r0 * cos_ta_4da, r0 * sin_ta_4da, -width * 0.5f, normal);
-        newFace(&iBuffer, ix0, ix1, ix2);
-        newFace(&iBuffer, ix1, ix3, ix2);
-        newFace(&iBuffer, ix2, ix3, ix4);
-        newFace(&iBuffer, ix3, ix5, ix4);
+        ix0 = newVertex(vBuffer, r1 * cos_ta, r1 * sin_ta, -width * 0.5f, normal, color);
+        ix1 = newVertex(vBuffer, r0 * cos_ta, r0 * sin_ta, -width * 0.5f, normal, color);
+        ix2 = newVertex(vBuffer, r1 * cos_ta_3da, r1 * sin_ta_3da, -width * 0.5f, normal, color);
+        ix3 = newVertex(vBuffer, r0 * cos_ta, r0 * sin_ta, -width * 0.5f, normal, color);
+        ix4 = newVertex(vBuffer, r1 * cos_ta_4da, r1 * sin_ta_4da, -width * 0.5f, normal, color);
+        ix5 = newVertex(vBuffer, r0 * cos_ta_4da, r0 * sin_ta_4da, -width * 0.5f, normal, color);
+        newFace(iBuffer, ix0, ix1, ix2);
+        newFace(iBuffer, ix1, ix3, ix2);
+        newFace(iBuffer, ix2, ix3, ix4);
+        newFace(iBuffer, ix3, ix5, ix4);
 
         // back sides of teeth
         normal = glm::vec3(0.0, 0.0, -1.0);
-        ix0 = newVertex(&vBuffer, r1 * cos_ta_3da, r1 * sin_ta_3da, -width * 0.5f, normal);
-        ix1 = newVertex(&vBuffer, r2 * cos_ta_2da, r2 * sin_ta_2da, -width * 0.5f, normal);
-        ix2 = newVertex(&vBuffer, r1 * cos_ta, r1 * sin_ta, -width * 0.5f, normal);
-        ix3 = newVertex(&vBuffer, r2 * cos_ta_1da, r2 * sin_ta_1da, -width * 0.5f, normal);
-        newFace(&iBuffer, ix0, ix1, ix2);
-        newFace(&iBuffer, ix1, ix3, ix2);
+        ix0 = newVertex(vBuffer, r1 * cos_ta_3da, r1 * sin_ta_3da, -width * 0.5f, normal, color);
+        ix1 = newVertex(vBuffer, r2 * cos_ta_2da, r2 * sin_ta_2da, -width * 0.5f, normal, color);
+        ix2 = newVertex(vBuffer, r1 * cos_ta, r1 * sin_ta, -width * 0.5f, normal, color);
+        ix3 = newVertex(vBuffer, r2 * cos_ta_1da, r2 * sin_ta_1da, -width * 0.5f, normal, color);
+        newFace(iBuffer, ix0, ix1, ix2);
+        newFace(iBuffer, ix1, ix3, ix2);
 
         // draw outward faces of teeth
         normal = glm::vec3(v1, -u1, 0.0);
-        ix0 = newVertex(&vBuffer, r1 * cos_ta, r1 * sin_ta, width * 0.5f, normal);
-        ix1 = newVertex(&vBuffer, r1 * cos_ta, r1 * sin_ta, -width * 0.5f, normal);
-        ix2 = newVertex(&vBuffer, r2 * cos_ta_1da, r2 * sin_ta_1da, width * 0.5f, normal);
-        ix3 = newVertex(&vBuffer, r2 * cos_ta_1da, r2 * sin_ta_1da, -width * 0.5f, normal);
-        newFace(&iBuffer, ix0, ix1, ix2);
-        newFace(&iBuffer, ix1, ix3, ix2);
+        ix0 = newVertex(vBuffer, r1 * cos_ta, r1 * sin_ta, width * 0.5f, normal, color);
+        ix1 = newVertex(vBuffer, r1 * cos_ta, r1 * sin_ta, -width * 0.5f, normal, color);
+        ix2 = newVertex(vBuffer, r2 * cos_ta_1da, r2 * sin_ta_1da, width * 0.5f, normal, color);
+        ix3 = newVertex(vBuffer, r2 * cos_ta_1da, r2 * sin_ta_1da, -width * 0.5f, normal, color);
+        newFace(iBuffer, ix0, ix1, ix2);
+        newFace(iBuffer, ix1, ix3, ix2);
 
         normal = glm::vec3(cos_ta, sin_ta, 0.0);
-        ix0 = newVertex(&vBuffer, r2 * cos_ta_1da, r2 * sin_ta_1da, width * 0.5f, normal);
-        ix1 = newVertex(&vBuffer, r2 * cos_ta_1da, r2 * sin_ta_1da, -width * 0.5f, normal);
-        ix2 = newVertex(&vBuffer, r2 * cos_ta_2da, r2 * sin_ta_2da, width * 0.5f, normal);
-        ix3 = newVertex(&vBuffer, r2 * cos_ta_2da, r2 * sin_ta_2da, -width * 0.5f, normal);
-        newFace(&iBuffer, ix0, ix1, ix2);
-        newFace(&iBuffer, ix1, ix3, ix2);
+        ix0 = newVertex(vBuffer, r2 * cos_ta_1da, r2 * sin_ta_1da, width * 0.5f, normal, color);
+        ix1 = newVertex(vBuffer, r2 * cos_ta_1da, r2 * sin_ta_1da, -width * 0.5f, normal, color);
+        ix2 = newVertex(vBuffer, r2 * cos_ta_2da, r2 * sin_ta_2da, width * 0.5f, normal, color);
+        ix3 = newVertex(vBuffer, r2 * cos_ta_2da, r2 * sin_ta_2da, -width * 0.5f, normal, color);
+        newFace(iBuffer, ix0, ix1, ix2);
+        newFace(iBuffer, ix1, ix3, ix2);
 
         normal = glm::vec3(v2, -u2, 0.0);
-        ix0 = newVertex(&vBuffer, r2 * cos_ta_2da, r2 * sin_ta_2da, width * 0.5f, normal);
-        ix1 = newVertex(&vBuffer, r2 * cos_ta_2da, r2 * sin_ta_2da, -width * 0.5f, normal);
-        ix2 = newVertex(&vBuffer, r1 * cos_ta_3da, r1 * sin_ta_3da, width * 0.5f, normal);
-        ix3 = newVertex(&vBuffer, r1 * cos_ta_3da, r1 * sin_ta_3da, -width * 0.5f, normal);
-        newFace(&iBuffer, ix0, ix1, ix2);
-        newFace(&iBuffer, ix1, ix3, ix2);
+        ix0 = newVertex(vBuffer, r2 * cos_ta_2da, r2 * sin_ta_2da, width * 0.5f, normal, color);
+        ix1 = newVertex(vBuffer, r2 * cos_ta_2da, r2 * sin_ta_2da, -width * 0.5f, normal, color);
+        ix2 = newVertex(vBuffer, r1 * cos_ta_3da, r1 * sin_ta_3da, width * 0.5f, normal, color);
+        ix3 = newVertex(vBuffer, r1 * cos_ta_3da, r1 * sin_ta_3da, -width * 0.5f, normal, color);
+        newFace(iBuffer, ix0, ix1, ix2);
+        newFace(iBuffer, ix1, ix3, ix2);
 
         normal = glm::vec3(cos_ta, sin_ta, 0.0);
-        ix0 = newVertex(&vBuffer, r1 * cos_ta_3da, r1 * sin_ta_3da, width * 0.5f, normal);
-        ix1 = newVertex(&vBuffer, r1 * cos_ta_3da, r1 * sin_ta_3da, -width * 0.5f, normal);
-        ix2 = newVertex(&vBuffer, r1 * cos_ta_4da, r1 * sin_ta_4da, width * 0.5f, normal);
-        ix3 = newVertex(&vBuffer, r1 * cos_ta_4da, r1 * sin_ta_4da, -width * 0.5f, normal);
-        newFace(&iBuffer, ix0, ix1, ix2);
-        newFace(&iBuffer, ix1, ix3, ix2);
+        ix0 = newVertex(vBuffer, r1 * cos_ta_3da, r1 * sin_ta_3da, width * 0.5f, normal, color);
+        ix1 = newVertex(vBuffer, r1 * cos_ta_3da, r1 * sin_ta_3da, -width * 0.5f, normal, color);
+        ix2 = newVertex(vBuffer, r1 * cos_ta_4da, r1 * sin_ta_4da, width * 0.5f, normal, color);
+        ix3 = newVertex(vBuffer, r1 * cos_ta_4da, r1 * sin_ta_4da, -width * 0.5f, normal, color);
+        newFace(iBuffer, ix0, ix1, ix2);
+        newFace(iBuffer, ix1, ix3, ix2);
 
         // draw inside radius cylinder
-        ix0 = newVertex(&vBuffer, r0 * cos_ta, r0 * sin_ta, -width * 0.5f, glm::vec3(-cos_ta, -sin_ta, 0.0));
-        ix1 = newVertex(&vBuffer, r0 * cos_ta, r0 * sin_ta, width * 0.5f, glm::vec3(-cos_ta, -sin_ta, 0.0));
-        ix2 = newVertex(&vBuffer, r0 * cos_ta_4da, r0 * sin_ta_4da, -width * 0.5f, glm::vec3(-cos_ta_4da, -sin_ta_4da, 0.0));
-        ix3 = newVertex(&vBuffer, r0 * cos_ta_4da, r0 * sin_ta_4da, width * 0.5f, glm::vec3(-cos_ta_4da, -sin_ta_4da, 0.0));
-        newFace(&iBuffer, ix0, ix1, ix2);
-        newFace(&iBuffer, ix1, ix3, ix2);
+        ix0 = newVertex(vBuffer, r0 * cos_ta, r0 * sin_ta, -width * 0.5f, glm::vec3(-cos_ta, -sin_ta, 0.0), color);
+        ix1 = newVertex(vBuffer, r0 * cos_ta, r0 * sin_ta, width * 0.5f, glm::vec3(-cos_ta, -sin_ta, 0.0), color);
+        ix2 = newVertex(vBuffer, r0 * cos_ta_4da, r0 * sin_ta_4da, -width * 0.5f, glm::vec3(-cos_ta_4da, -sin_ta_4da, 0.0), color);
+        ix3 = newVertex(vBuffer, r0 * cos_ta_4da, r0 * sin_ta_4da, width * 0.5f, glm::vec3(-cos_ta_4da, -sin_ta_4da, 0.0), color);
+        newFace(iBuffer, ix0, ix1, ix2);
+        newFace(iBuffer, ix1, ix3, ix2);
     }
 
+}
+
+glm::mat4 GearDefinition::modelMatrix(float timer) const {
+    return glm::translate(glm::mat4(), pos) * glm::mat4_cast(glm::angleAxis(glm::radians((rotSpeed * timer) + rotOffset), glm::vec3(0, 0, 1)));
+}
+
+VulkanGear::~VulkanGear() {
+    // Clean up vulkan resources
+    uniformData.destroy();
+    meshInfo.destroy();
+}
+
+void VulkanGear::generate(const vks::Context& context,
+                          float inner_radius,
+                          float outer_radius,
+                          float width,
+                          int teeth,
+                          float tooth_depth,
+                          glm::vec3 color,
+                          glm::vec3 pos,
+                          float rotSpeed,
+                          float rotOffset) {
+    generate(context, GearDefinition{ inner_radius, outer_radius, width, teeth, tooth_depth, color, pos, rotSpeed, rotOffset });
+}
+
+void VulkanGear::generate(const vks::Context& context, const GearDefinition& definition) {
+    device = context.device;
+    this->definition = definition;
+
+    std::vector<Vertex> vBuffer;
+    std::vector<uint32_t> iBuffer;
+    definition.generateMesh(vBuffer, iBuffer);
+
     // Generate vertex & index buffers
     meshInfo.vertices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vBuffer);
     meshInfo.indices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, iBuffer);
@@ -192,13 +215,9 @@ void VulkanGear::draw(vk::CommandBuffer cmdbuffer, vk::PipelineLayout pipelineLa
 void VulkanGear::updateUniformBuffer(const glm::mat4& perspective, const glm::mat4& view, float timer) {
     ubo.projection = perspective;
     ubo.view = view;  // glm::lookAt(glm::vec3(0, 0, -zoom), glm::vec3(-1.0, -1.5, 0), glm::vec3(0, 1, 0)) * glm::mat4_cast(orientation);
-    ubo.model = glm::translate(glm::mat4(), pos) * glm::mat4_cast(glm::angleAxis(glm::radians((rotSpeed * timer) + rotOffset), glm::vec3(0, 0, 1)));
+    ubo.model = definition.modelMatrix(timer);
     ubo.normal = glm::inverseTranspose(ubo.view * ubo.model);
-
-    //ubo.lightPos = lightPos;
-    ubo.lightPos = glm::vec3(0.0f, 0.0f, 2.5f);
-    ubo.lightPos.x = sin(glm::radians(timer)) * 8.0f;
-    ubo.lightPos.z = cos(glm::radians(timer)) * 8.0f;
+    ubo.lightPos = lightPosition(timer);
 
     uniformData.copy(ubo);
 }
@@ -209,3 +228,82 @@ void VulkanGear::setupDescriptorSet(vk::DescriptorPool pool, vk::DescriptorSetLa
     // Binding 0 : Vertex shader uniform buffer
     device.updateDescriptorSets({ { descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.descriptor } }, nullptr);
 }
+
+void GearBatch::create(const vks::Context& context, const std::vector<GearDefinition>& definitions) {
+    device = context.device;
+    this->definitions = definitions;
+
+    std::vector<Vertex> vBuffer;
+    std::vector<uint32_t> iBuffer;
+    draws.clear();
+    for (uint32_t i = 0; i < (uint32_t)definitions.size(); ++i) {
+        const uint32_t firstIndex = (uint32_t)iBuffer.size();
+        definitions[i].generateMesh(vBuffer, iBuffer);
+        draws.push_back({ (uint32_t)iBuffer.size() - firstIndex, 1, firstIndex, 0, i });
+    }
+
+    vertices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vBuffer);
+    indices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, iBuffer);
+    indirect = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer, draws);
+    uniformData = context.createUniformBuffer(UBO{});
+    gearMatrices = context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer,
+                                        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                        sizeof(GearMatrices) * std::max<size_t>(definitions.size(), 1));
+    gearMatrices.map();
+}
+
+void GearBatch::destroy() {
+    vertices.destroy();
+    indices.destroy();
+    indirect.destroy();
+    uniformData.destroy();
+    gearMatrices.destroy();
+    draws.clear();
+    definitions.clear();
+    descriptorSet = nullptr;
+}
+
+void GearBatch::setupDescriptorSet(vk::DescriptorPool pool, vk::DescriptorSetLayout descriptorSetLayout) {
+    descriptorSet = device.allocateDescriptorSets({ pool, 1, &descriptorSetLayout })[0];
+    vk::DescriptorBufferInfo matricesDescriptor{ gearMatrices.buffer, 0, VK_WHOLE_SIZE };
+    device.updateDescriptorSets(
+        {
+            // Binding 0 : Vertex shader uniform buffer
+            { descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.descriptor },
+            // Binding 1 : Gear matrices
+            { descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &matricesDescriptor },
+        },
+        nullptr);
+}
+
+void GearBatch::updateUniformBuffer(const glm::mat4& perspective, const glm::mat4& view, float timer) {
+    UBO ubo;
+    ubo.projection = perspective;
+    ubo.view = view;
+    ubo.lightPos = glm::vec4(lightPosition(timer), 1.0f);
+    uniformData.copy(ubo);
+
+    auto* matrices = static_cast<GearMatrices*>(gearMatrices.mapped);
+    for (size_t i = 0; i < definitions.size(); ++i) {
+        matrices[i].model = definitions[i].modelMatrix(timer);
+        matrices[i].normal = glm::inverseTranspose(view * matrices[i].model);
+    }
+}
+
+void GearBatch::draw(vk::CommandBuffer cmdbuffer, vk::PipelineLayout pipelineLayout, bool multiDrawIndirect) const {
+    vk::DeviceSize offsets = 0;
+    cmdbuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
+    cmdbuffer.bindVertexBuffers(0, vertices.buffer, offsets);
+    cmdbuffer.bindIndexBuffer(indices.buffer, 0, vk::IndexType::eUint32);
+    if (multiDrawIndirect) {
+        // The draws pick their gear with their first instance
+        cmdbuffer.pushConstants<uint32_t>(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, 0u);
+        cmdbuffer.drawIndexedIndirect(indirect.buffer, 0, gearCount(), sizeof(vk::DrawIndexedIndirectCommand));
+        return;
+    }
+    for (uint32_t i = 0; i < gearCount(); ++i) {
+        const auto& draw = draws[i];
+        cmdbuffer.pushConstants<uint32_t>(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, i);
+        cmdbuffer.drawIndexed(draw.indexCount, 1, draw.firstIndex, draw.vertexOffset, 0);
+    }
+}
@@ -10,6 +10,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include <glm/glm.hpp>
 #include "vks/context.hpp"
 
@@ -31,6 +33,24 @@ struct Vertex {
     }
 };
 
+// Shape, color and animation of a gear
+struct GearDefinition {
+    float innerRadius;
+    float outerRadius;
+    float width;
+    int teeth;
+    float toothDepth;
+    glm::vec3 color;
+    glm::vec3 pos;
+    float rotSpeed;
+    float rotOffset;
+
+    // Append the gear's triangles to `vertices` and `indices`, with indices into all of `vertices`
+    void generateMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) const;
+    glm::mat4 modelMatrix(float timer) const;
+};
+
+// A gear with its own vertex, index and uniform buffer and descriptor set, drawn on its own
 class VulkanGear {
 private:
     struct UBO {
@@ -42,10 +62,7 @@ private:
     };
 
     vk::Device device;
-    glm::vec3 color;
-    glm::vec3 pos;
-    float rotSpeed;
-    float rotOffset;
+    GearDefinition definition;
 
     struct MeshInfo {
         vks::Buffer vertices;
@@ -61,9 +78,6 @@ private:
     UBO ubo;
     vks::Buffer uniformData;
 
-    int32_t newVertex(std::vector<Vertex>* vBuffer, float x, float y, float z, const glm::vec3& normal);
-    void newFace(std::vector<uint32_t>* iBuffer, int a, int b, int c);
-
 public:
     vk::DescriptorSet descriptorSet;
 
@@ -84,4 +98,48 @@ public:
                   glm::vec3 pos,
                   float rotSpeed,
                   float rotOffset);
+    void generate(const vks::Context& context, const GearDefinition& definition);
+};
+
+// Many gears merged into one vertex and index buffer, with the matrices of all of them in one storage buffer that
+// the vertex shader indexes with gl_InstanceIndex.  Drawing them takes one set of binds, and then either one draw
+// per gear that only differs in a push constant, or a single multi draw indirect.
+class GearBatch {
+public:
+    // Must match gearsbatch.vert
+    struct UBO {
+        glm::mat4 projection;
+        glm::mat4 view;
+        glm::vec4 lightPos;
+    };
+    struct GearMatrices {
+        glm::mat4 model;
+        glm::mat4 normal;
+    };
+
+    vk::DescriptorSet descriptorSet;
+
+    void create(const vks::Context& context, const std::vector<GearDefinition>& definitions);
+    void destroy();
+
+    // Binding 0 : uniform buffer, binding 1 : gear matrices
+    void setupDescriptorSet(vk::DescriptorPool pool, vk::DescriptorSetLayout descriptorSetLayout);
+    void updateUniformBuffer(const glm::mat4& perspective, const glm::mat4& view, float timer);
+
+    // `pipelineLayout` has a uint32_t vertex shader push constant, added to the instance index to pick the gear.
+    // Multi draw indirect takes the multiDrawIndirect and drawIndirectFirstInstance features.
+    void draw(vk::CommandBuffer cmdbuffer, vk::PipelineLayout pipelineLayout, bool multiDrawIndirect) const;
+
+    uint32_t gearCount() const { return (uint32_t)draws.size(); }
+
+private:
+    vk::Device device;
+    std::vector<GearDefinition> definitions;
+    // One draw per gear, each starting at its gear's index as first instance
+    std::vector<vk::DrawIndexedIndirectCommand> draws;
+    vks::Buffer vertices;
+    vks::Buffer indices;
+    vks::Buffer indirect;
+    vks::Buffer uniformData;
+    vks::Buffer gearMatrices;
 };
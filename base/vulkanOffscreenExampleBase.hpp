@@ -87,11 +87,11 @@ protected:
             for (auto& framebuffer : framebuffers) {
                 if (attachmentUsage | vk::ImageUsageFlagBits::eSampled) {
                     for (auto& color : framebuffer.colors) {
-                        color.sampler = context.device.createSampler(sampler);
+                        color.sampler = vks::acquireSampler(context.device, sampler);
                     }
                 }
                 if (depthAttachmentUsage | vk::ImageUsageFlagBits::eSampled) {
-                    framebuffer.depth.sampler = context.device.createSampler(sampler);
+                    framebuffer.depth.sampler = vks::acquireSampler(context.device, sampler);
                 }
             }
         }
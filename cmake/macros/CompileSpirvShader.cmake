@@ -17,9 +17,18 @@ function(COMPILE_SPIRV_SHADER SHADER_FILE)
     get_filename_component(SHADER_EXT ${SHADER_FILE} EXT)
     set(COMPILE_OUTPUT "${SHADER_FILE}.debug.spv")
     set(OPTIMIZE_OUTPUT "${SHADER_FILE}.spv")
+    # Subgroup operations need SPIR-V 1.3, everything else stays loadable on Vulkan 1.0 devices
+    set(TARGET_ENV_ARGS "")
+    if (SHADER_TARGET MATCHES "_subgroup$")
+        set(TARGET_ENV_ARGS --target-env vulkan1.1)
+    endif()
+    # Ray tracing stages, ray queries and mesh shading stages need SPIR-V 1.4, which VK_KHR_spirv_1_4 allows on Vulkan 1.1
+    if (SHADER_EXT MATCHES "\\.(rgen|rmiss|rchit|rahit|task|mesh)$" OR SHADER_TARGET MATCHES "_rayquery$")
+        set(TARGET_ENV_ARGS --target-env spirv1.4)
+    endif()
     add_custom_command(
         OUTPUT ${COMPILE_OUTPUT} 
-        COMMAND ${GLSLANG_EXECUTABLE} -V ${SHADER_FILE} -o ${COMPILE_OUTPUT} 
+        COMMAND ${GLSLANG_EXECUTABLE} -V ${TARGET_ENV_ARGS} ${SHADER_FILE} -o ${COMPILE_OUTPUT} 
         DEPENDS ${SHADER_FILE})
     add_custom_command(
         OUTPUT ${OPTIMIZE_OUTPUT} 
@@ -6,4 +6,6 @@
 #  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
 # 
 macro(TARGET_BASISU)
+    find_package(basisu CONFIG REQUIRED)
+    target_link_libraries(${TARGET_NAME} PRIVATE basisu::basisu_lib)
 endmacro()
@@ -6,11 +6,6 @@
 #  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
 # 
 macro(TARGET_GLSLANG)
-    add_dependency_external_projects(glslang)
-    list(APPEND EXTERNALS glslang)
-    include_directories(${GLSLANG_INCLUDE_DIRS})
-    link_libraries(${GLSLANG_LIBRARIES})
+    find_package(glslang CONFIG REQUIRED)
+    target_link_libraries(${TARGET_NAME} PRIVATE glslang::glslang glslang::SPIRV glslang::glslang-default-resource-limits)
 endmacro()
-
-
-
@@ -0,0 +1,58 @@
+// Cluster grid of vks::ClusteredLights.  Shaders reading the light lists define CLUSTER_UNIFORM_BINDING and
+// CLUSTER_GRID_BINDING before including this, the culling shader defines CLUSTER_CULLING.
+
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+#define CLUSTER_COUNT (CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES)
+#define MAX_LIGHTS_PER_CLUSTER 128
+
+layout (binding = CLUSTER_UNIFORM_BINDING) uniform Clusters
+{
+	mat4 view;
+	mat4 projection;
+	mat4 inverseProjection;
+	float zNear;
+	float zFar;
+	uint lightCount;
+} clusters;
+
+#ifdef CLUSTER_CULLING
+layout (binding = CLUSTER_GRID_BINDING) writeonly buffer ClusterGrid
+#else
+layout (binding = CLUSTER_GRID_BINDING) readonly buffer ClusterGrid
+#endif
+{
+	uint clusterLightCounts[CLUSTER_COUNT];
+	uint clusterLightIndices[];
+};
+
+// Depth of slice boundary `slice`, slices are exponentially spaced so they are roughly as deep as they are wide
+float clusterSliceDepth(uint slice)
+{
+	return clusters.zNear * pow(clusters.zFar / clusters.zNear, float(slice) / float(CLUSTER_SLICES));
+}
+
+// The cluster `position` (in the space of the light bounds) falls into
+uint clusterIndex(vec3 position)
+{
+	vec4 viewPos = clusters.view * vec4(position, 1.0);
+	vec4 clip = clusters.projection * viewPos;
+	vec2 tile = clamp((clip.xy / clip.w) * 0.5 + 0.5, 0.0, 0.9999) * vec2(CLUSTER_TILES_X, CLUSTER_TILES_Y);
+	float slice = log(max(-viewPos.z, clusters.zNear) / clusters.zNear) / log(clusters.zFar / clusters.zNear) * float(CLUSTER_SLICES);
+	uint z = min(uint(slice), uint(CLUSTER_SLICES - 1));
+	return (z * CLUSTER_TILES_Y + uint(tile.y)) * CLUSTER_TILES_X + uint(tile.x);
+}
+
+#ifndef CLUSTER_CULLING
+uint clusterLightCount(uint cluster)
+{
+	return min(clusterLightCounts[cluster], uint(MAX_LIGHTS_PER_CLUSTER));
+}
+
+// Index of the i-th light of `cluster`, in the light bounds and in the shader's own light data
+uint clusterLight(uint cluster, uint i)
+{
+	return clusterLightIndices[cluster * MAX_LIGHTS_PER_CLUSTER + i];
+}
+#endif
@@ -0,0 +1,27 @@
+// Helpers for compact G-buffers, which store what they can't derive from the depth buffer in as few bits as possible
+
+// Octahedral encoding of a unit vector in two components in [-1, 1].  The sphere is projected onto an octahedron
+// and the lower half folded over the upper one, which keeps the error nearly uniform over all directions.
+vec2 octEncode(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 folded = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return n.z >= 0.0 ? n.xy : folded;
+}
+
+vec3 octDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+// The position a fragment at `uv` (0 to 1 across the render target) with depth buffer value `depth` was rasterized
+// from, in the space `inverseViewProjection` maps clip space back to
+vec3 reconstructPosition(mat4 inverseViewProjection, vec2 uv, float depth)
+{
+	vec4 position = inverseViewProjection * vec4(uv * 2.0 - 1.0, depth, 1.0);
+	return position.xyz / position.w;
+}
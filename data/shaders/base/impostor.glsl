@@ -0,0 +1,97 @@
+// Billboards and atlas lookups of vks::model::Impostor.  Directions and normals are in the space of the model the
+// impostor was baked from, the vertex shader transforms the billboard like it would the model's vertices.
+
+// The octahedral mapping of the sphere around y, the lower half folded out over the corners of [-1, 1]
+vec2 impostorSignNotZero(vec2 v)
+{
+	return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec3 impostorDirection(vec2 uv)
+{
+	vec3 direction = vec3(uv.x, 1.0 - abs(uv.x) - abs(uv.y), uv.y);
+	if (direction.y < 0.0) {
+		direction.xz = (1.0 - abs(direction.zx)) * impostorSignNotZero(direction.xz);
+	}
+	return normalize(direction);
+}
+
+vec2 impostorOctahedral(vec3 direction)
+{
+	direction /= abs(direction.x) + abs(direction.y) + abs(direction.z);
+	vec2 uv = direction.xz;
+	if (direction.y < 0.0) {
+		uv = (1.0 - abs(direction.zx)) * impostorSignNotZero(direction.xz);
+	}
+	return uv;
+}
+
+// The view whose direction is closest to `toCamera`, of `frames` x `frames`
+uvec2 impostorFrame(vec3 toCamera, uint frames)
+{
+	vec2 cell = (impostorOctahedral(normalize(toCamera)) * 0.5 + 0.5) * float(frames);
+	return uvec2(clamp(ivec2(cell), ivec2(0), ivec2(frames - 1)));
+}
+
+// Same as vks::model::Impostor::frameDirection
+vec3 impostorFrameDirection(uvec2 frame, uint frames)
+{
+	return impostorDirection((vec2(frame) + 0.5) / float(frames) * 2.0 - 1.0);
+}
+
+// The axes of the view along `direction`, as glm::lookAt made them for the bake
+void impostorBasis(vec3 direction, out vec3 right, out vec3 up)
+{
+	vec3 upHint = abs(direction.y) > 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+	right = normalize(cross(upHint, direction));
+	up = cross(direction, right);
+}
+
+// Two triangles over [-1, 1], for gl_VertexIndex of QUAD_VERTEX_COUNT vertices per impostor
+vec2 impostorCorner(uint vertex)
+{
+	const vec2 corners[6] = vec2[](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0), vec2(-1.0, -1.0));
+	return corners[vertex % 6];
+}
+
+struct ImpostorVertex
+{
+	// Model space position of the corner
+	vec3 position;
+	vec2 uv;
+	// Towards the camera the view was taken from
+	vec3 direction;
+};
+
+// The corner `vertex` of the billboard, facing the view of the impostor closest to `toCamera`, the direction from
+// the center of `sphere` to the camera.  The billboard faces that view rather than the camera itself, so the view
+// isn't distorted, and keeps its size at any angle.
+ImpostorVertex impostorVertex(vec4 sphere, uint frames, vec3 toCamera, uint vertex)
+{
+	uvec2 frame = impostorFrame(toCamera, frames);
+	ImpostorVertex result;
+	result.direction = impostorFrameDirection(frame, frames);
+	vec3 right, up;
+	impostorBasis(result.direction, right, up);
+	vec2 corner = impostorCorner(vertex);
+	result.position = sphere.xyz + (right * corner.x + up * corner.y) * sphere.w;
+	result.uv = (vec2(frame) + corner * 0.5 + 0.5) / float(frames);
+	return result;
+}
+
+// The albedo, model space normal, and the distance behind the billboard in units of the radius at `uv`.  False where
+// the model doesn't cover the view
+bool impostorSample(sampler2D albedoMap, sampler2D normalDepthMap, vec2 uv, out vec3 color, out vec3 normal, out float depthOffset)
+{
+	vec4 albedo = texture(albedoMap, uv);
+	if (albedo.a < 0.5) {
+		return false;
+	}
+	// Both are premultiplied by coverage
+	vec4 normalDepth = texture(normalDepthMap, uv) / albedo.a;
+	color = albedo.rgb / albedo.a;
+	normal = normalize(normalDepth.xyz * 2.0 - 1.0);
+	// The views span the sphere's diameter, the billboard goes through its center
+	depthOffset = normalDepth.a * 2.0 - 1.0;
+	return true;
+}
@@ -0,0 +1,16 @@
+#version 450
+
+// Albedo and coverage, and the model space normal and the depth through the bounding sphere, see vks::model::Impostor
+
+layout (location = 0) in vec3 inNormal;
+layout (location = 1) in vec3 inColor;
+
+layout (location = 0) out vec4 outAlbedo;
+layout (location = 1) out vec4 outNormalDepth;
+
+void main()
+{
+	outAlbedo = vec4(inColor, 1.0);
+	// The projection is orthographic, so the depth is linear from the near side of the sphere to the far one
+	outNormalDepth = vec4(normalize(inNormal) * 0.5 + 0.5, gl_FragCoord.z);
+}
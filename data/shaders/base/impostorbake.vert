@@ -0,0 +1,27 @@
+#version 450
+
+// The views of vks::model::Impostor, one orthographic view of the model's bounding sphere per viewport of the atlas
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec3 inColor;
+
+layout (push_constant) uniform PushConsts
+{
+	mat4 viewProjection;
+} pushConsts;
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+void main()
+{
+	outNormal = inNormal;
+	outColor = inColor;
+	gl_Position = pushConsts.viewProjection * vec4(inPos, 1.0);
+}
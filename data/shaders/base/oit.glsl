@@ -0,0 +1,67 @@
+// Order independent transparency, see vks::OrderIndependentTransparency.  The fragment shaders of the transparent
+// draws define one of
+//
+//   OIT_WEIGHTED_BLENDED  writes the weighted sums to color attachments 0 and 1
+//   OIT_LINKED_LIST       appends to the fragment lists of set OIT_SET, and writes no color
+//
+// before including this, and hand every fragment to oitOutput.
+
+#ifndef OIT_SET
+#define OIT_SET 1
+#endif
+
+#if defined(OIT_LINKED_LIST)
+
+// Fragments behind the occluders must not be appended
+layout (early_fragment_tests) in;
+
+// ~0 terminates a list
+#define OIT_END 0xffffffffu
+
+layout (set = OIT_SET, binding = 0, r32ui) uniform coherent uimage2D oitHeads;
+
+// One fragment: the color as four halfs, the depth and the index of the next node
+layout (std430, set = OIT_SET, binding = 1) buffer OitNodes
+{
+	uint count;
+	uint capacity;
+	uint pad0;
+	uint pad1;
+	uvec4 nodes[];
+} oitNodes;
+
+void oitOutput(vec4 color, vec3 emission)
+{
+	// Emission is blended like premultiplied color without coverage
+	color.rgb += emission;
+	if (color == vec4(0.0)) {
+		return;
+	}
+	uint index = atomicAdd(oitNodes.count, 1u);
+	if (index >= oitNodes.capacity) {
+		return;
+	}
+	uint next = imageAtomicExchange(oitHeads, ivec2(gl_FragCoord.xy), index);
+	oitNodes.nodes[index] = uvec4(packHalf2x16(color.rg), packHalf2x16(color.ba), floatBitsToUint(gl_FragCoord.z), next);
+}
+
+#elif defined(OIT_WEIGHTED_BLENDED)
+
+layout (location = 0) out vec4 outOitAccumulation;
+layout (location = 1) out vec4 outOitRevealage;
+
+// Equation 10 of McGuire and Bavoil, "Weighted Blended Order-Independent Transparency", which favors the nearer and
+// more opaque fragments of a pixel over a wide range of depths
+float oitWeight(float alpha, float depth)
+{
+	return clamp(pow(min(1.0, alpha * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - depth * 0.9, 3.0), 1e-2, 3e3);
+}
+
+// `color` is premultiplied by its coverage in alpha, `emission` is added over whatever is behind
+void oitOutput(vec4 color, vec3 emission)
+{
+	outOitAccumulation = color * oitWeight(color.a, gl_FragCoord.z);
+	outOitRevealage = vec4(emission, color.a);
+}
+
+#endif
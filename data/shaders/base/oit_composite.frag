@@ -0,0 +1,19 @@
+#version 450
+
+// Resolves the weighted sums of vks::OrderIndependentTransparency in WeightedBlended mode.  Blended with ONE,
+// SRC_ALPHA over the scene, alpha being the transmittance.
+
+layout (set = 0, binding = 0) uniform sampler2D samplerAccumulation;
+layout (set = 0, binding = 1) uniform sampler2D samplerRevealage;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	vec4 accumulation = texelFetch(samplerAccumulation, pixel, 0);
+	vec4 revealage = texelFetch(samplerRevealage, pixel, 0);
+	// The weighted average of the covering colors, over the coverage of all of them together
+	vec3 average = accumulation.rgb / max(accumulation.a, 1e-5);
+	outFragColor = vec4(average * (1.0 - revealage.a) + revealage.rgb, revealage.a);
+}
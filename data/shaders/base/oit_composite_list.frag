@@ -0,0 +1,58 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : require
+
+// Resolves the fragment lists of vks::OrderIndependentTransparency in LinkedList mode: the nearest
+// OIT_MAX_FRAGMENTS fragments of the pixel are sorted and blended back to front.  Blended with ONE, SRC_ALPHA over
+// the scene, alpha being the transmittance.
+
+#define OIT_LINKED_LIST
+#include "oit.glsl"
+
+// Must match OrderIndependentTransparency::MAX_FRAGMENTS
+#define OIT_MAX_FRAGMENTS 16
+
+layout (location = 0) out vec4 outFragColor;
+
+void main()
+{
+	uvec4 fragments[OIT_MAX_FRAGMENTS];
+	uint count = 0;
+	uint index = imageLoad(oitHeads, ivec2(gl_FragCoord.xy)).r;
+	// Keep the nearest once the list is longer than the array, by replacing the farthest kept so far
+	for (; index != OIT_END; index = oitNodes.nodes[index].w) {
+		uvec4 fragment = oitNodes.nodes[index];
+		if (count < OIT_MAX_FRAGMENTS) {
+			fragments[count++] = fragment;
+			continue;
+		}
+		uint farthest = 0;
+		for (uint i = 1; i < OIT_MAX_FRAGMENTS; ++i) {
+			if (uintBitsToFloat(fragments[i].z) > uintBitsToFloat(fragments[farthest].z)) {
+				farthest = i;
+			}
+		}
+		if (uintBitsToFloat(fragment.z) < uintBitsToFloat(fragments[farthest].z)) {
+			fragments[farthest] = fragment;
+		}
+	}
+
+	// Insertion sort, farthest first
+	for (uint i = 1; i < count; ++i) {
+		uvec4 fragment = fragments[i];
+		uint j = i;
+		for (; j > 0 && uintBitsToFloat(fragments[j - 1].z) < uintBitsToFloat(fragment.z); --j) {
+			fragments[j] = fragments[j - 1];
+		}
+		fragments[j] = fragment;
+	}
+
+	vec3 color = vec3(0.0);
+	float transmittance = 1.0;
+	for (uint i = 0; i < count; ++i) {
+		vec4 fragment = vec4(unpackHalf2x16(fragments[i].x), unpackHalf2x16(fragments[i].y));
+		color = fragment.rgb + color * (1.0 - fragment.a);
+		transmittance *= 1.0 - fragment.a;
+	}
+	outFragColor = vec4(color, transmittance);
+}
@@ -0,0 +1,39 @@
+// Types for the arithmetic that holds up in 16 bits.  With HALF_PRECISION defined before the include they are
+// float16_t and f16vecN, which needs the shaderFloat16 feature, see vks::Context::enableShaderFloat16, otherwise plain
+// floats.  16 bit values don't convert implicitly from 32 bit ones, so literals and inputs have to be wrapped, as in
+// mfloat(0.5).  Positions, texture coordinates and depths need the full 32 bits and should stay float.
+//
+// Include this right after the #extension lines, before any declarations.
+
+#if defined(HALF_PRECISION)
+
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+
+#define mfloat float16_t
+#define mvec2 f16vec2
+#define mvec3 f16vec3
+#define mvec4 f16vec4
+#define mmat3 f16mat3
+#define MFLOAT_MAX 65504.0
+
+// Colors from HDR targets may exceed the 16 bit range, clamp them rather than let them turn into infinities
+mvec3 narrowColor(vec3 c)
+{
+	return mvec3(min(c, vec3(MFLOAT_MAX)));
+}
+
+#else
+
+#define mfloat float
+#define mvec2 vec2
+#define mvec3 vec3
+#define mvec4 vec4
+#define mmat3 mat3
+#define MFLOAT_MAX 3.402823466e+38
+
+vec3 narrowColor(vec3 c)
+{
+	return c;
+}
+
+#endif
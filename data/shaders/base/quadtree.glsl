@@ -0,0 +1,35 @@
+// Uniforms of vks::terrain::Quadtree.  Shaders define QUADTREE_UNIFORM_BINDING before including this.
+
+#define MAX_LEVELS 12
+
+layout (binding = QUADTREE_UNIFORM_BINDING) uniform Quadtree
+{
+	vec4 frustumPlanes[6];
+	vec4 camera;
+	vec2 origin;
+	float size;
+	float heightScale;
+	uint levels;
+	uint gridSize;
+	uint nodeCount;
+	// Per LOD, x: distance up to which its nodes are drawn, y: distance their vertices start morphing at, z: 1 / (x - y)
+	vec4 ranges[MAX_LEVELS];
+} quadtree;
+
+// Position on the terrain, in world space x and z, of `gridPos` in [0, 1] on a node drawn as `node` (corner,
+// size, LOD).  Vertices on the odd rows and columns of the grid slide onto the even ones, the grid of the next
+// coarser LOD, as the distance `cameraDistance` to the camera approaches the end of the node's range.
+vec2 quadtreeMorph(vec2 gridPos, vec4 node, float cameraDistance)
+{
+	vec4 range = quadtree.ranges[uint(node.w)];
+	float morph = clamp((cameraDistance - range.y) * range.z, 0.0, 1.0);
+	float gridSize = float(quadtree.gridSize);
+	vec2 offset = fract(gridPos * gridSize * 0.5) * 2.0 / gridSize;
+	return node.xy + (gridPos - offset * morph) * node.z;
+}
+
+// Texture coordinates of a position in world space x and z
+vec2 quadtreeUV(vec2 position)
+{
+	return (position - quadtree.origin) / quadtree.size;
+}
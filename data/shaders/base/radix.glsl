@@ -0,0 +1,64 @@
+// Bindings of the passes of vks::parallel::RadixSort, an LSD radix sort of uint keys, and their values, by 8 bits
+// per pass:
+//   radix_histogram          the digit counts of every pass, from a single read of the keys
+//   radix_offsets            their exclusive scans, where the keys of each digit start in the output of each pass
+//   radix_onesweep_subgroup  one pass per dispatch, ranking and scattering each tile in a single read of it, with
+//                            the tiles chained by decoupled look-back
+
+// One invocation per digit
+layout (local_size_x = 256) in;
+
+#define RADIX_BITS 8
+#define RADIX 256
+// Must match RadixSort::ITEMS, keys per invocation in a tile
+#define ITEMS 4
+#define TILE (RADIX * ITEMS)
+#define MAX_PASSES 4
+
+layout (binding = 0) readonly buffer KeysIn
+{
+	uint keysIn[ ];
+};
+
+layout (binding = 1) readonly buffer ValuesIn
+{
+	uint valuesIn[ ];
+};
+
+layout (binding = 2) writeonly buffer KeysOut
+{
+	uint keysOut[ ];
+};
+
+layout (binding = 3) writeonly buffer ValuesOut
+{
+	uint valuesOut[ ];
+};
+
+layout (binding = 4) buffer Globals
+{
+	// Digit counts of each pass, scanned in place by radix_offsets
+	uint histograms[MAX_PASSES * RADIX];
+	// Tiles of each pass started so far, which hands out tiles in the order they start
+	uint tileCounters[MAX_PASSES];
+};
+
+// Per tile and digit, the digit count of the tile, or of all tiles up to it, in the low 30 bits; see radix_onesweep
+layout (binding = 5) coherent buffer Status
+{
+	uint status[ ];
+};
+
+layout (push_constant) uniform PushConstants
+{
+	uint count;
+	// Of the digit of this pass
+	uint shift;
+	uint passCount;
+	uint hasValues;
+} params;
+
+uint digitOf(uint key, uint shift)
+{
+	return (key >> shift) & (RADIX - 1);
+}
@@ -0,0 +1,114 @@
+// Exclusive prefix sums of uints in blocks of gl_WorkGroupSize.x * ITEMS elements, ITEMS consecutive ones per
+// invocation, with the total of every block written to `sums` for the next level.  See vks::parallel::Scan.
+//
+// Included by scan.comp, and by scan_subgroup.comp with SCAN_WITH_SUBGROUPS, which sums within subgroups first.
+
+layout (local_size_x_id = 0) in;
+
+// Must match Scan::ITEMS
+#define ITEMS 4
+
+layout (binding = 0) readonly buffer Input
+{
+	uint inputs[ ];
+};
+
+// May be the same memory as the input
+layout (binding = 1) writeonly buffer Output
+{
+	uint outputs[ ];
+};
+
+layout (binding = 2) writeonly buffer Sums
+{
+	uint sums[ ];
+};
+
+layout (push_constant) uniform PushConstants
+{
+	uint count;
+	// Whether the block totals are needed
+	uint writeSums;
+} params;
+
+// Per invocation, or per subgroup
+shared uint partials[gl_WorkGroupSize.x];
+shared uint groupTotal;
+
+// Exclusive prefix sum of `value` over the workgroup, and the sum of all of them
+uint workgroupExclusiveAdd(uint value, out uint total)
+{
+#ifdef SCAN_WITH_SUBGROUPS
+	uint prefix = subgroupExclusiveAdd(value);
+	if (gl_SubgroupInvocationID == gl_SubgroupSize - 1)
+	{
+		partials[gl_SubgroupID] = prefix + value;
+	}
+	barrier();
+
+	// The first subgroup scans the subgroup totals, a subgroup sized chunk at a time if there are more of them
+	if (gl_SubgroupID == 0)
+	{
+		uint carry = 0;
+		for (uint first = 0; first < gl_NumSubgroups; first += gl_SubgroupSize)
+		{
+			uint index = first + gl_SubgroupInvocationID;
+			uint sum = index < gl_NumSubgroups ? partials[index] : 0;
+			uint scanned = subgroupExclusiveAdd(sum);
+			if (index < gl_NumSubgroups)
+			{
+				partials[index] = carry + scanned;
+			}
+			carry += subgroupAdd(sum);
+		}
+		if (subgroupElect())
+		{
+			groupTotal = carry;
+		}
+	}
+	barrier();
+	total = groupTotal;
+	return partials[gl_SubgroupID] + prefix;
+#else
+	uint local = gl_LocalInvocationID.x;
+	partials[local] = value;
+	barrier();
+	for (uint offset = 1; offset < gl_WorkGroupSize.x; offset <<= 1)
+	{
+		uint previous = local >= offset ? partials[local - offset] : 0;
+		barrier();
+		partials[local] += previous;
+		barrier();
+	}
+	total = partials[gl_WorkGroupSize.x - 1];
+	return partials[local] - value;
+#endif
+}
+
+void main()
+{
+	uint first = (gl_WorkGroupID.x * gl_WorkGroupSize.x + gl_LocalInvocationID.x) * ITEMS;
+	uint values[ITEMS];
+	uint sum = 0;
+	for (uint i = 0; i < ITEMS; ++i)
+	{
+		values[i] = first + i < params.count ? inputs[first + i] : 0;
+		sum += values[i];
+	}
+
+	uint total;
+	uint prefix = workgroupExclusiveAdd(sum, total);
+	for (uint i = 0; i < ITEMS; ++i)
+	{
+		if (first + i < params.count)
+		{
+			outputs[first + i] = prefix;
+		}
+		prefix += values[i];
+	}
+
+	if (params.writeSums != 0 && gl_LocalInvocationID.x == 0)
+	{
+		sums[gl_WorkGroupID.x] = total;
+	}
+}
@@ -0,0 +1,68 @@
+// Buffer table of vks::SceneBuffers, reached through buffer device addresses.  Shaders including this declare the
+// layout of their instances as SceneInstance first, and get the table as a SceneTable from a push constant.
+
+#extension GL_EXT_buffer_reference : require
+
+// Same layout as vks::SceneBuffers::Mesh
+struct SceneMesh
+{
+	vec4 sphere;
+	uint firstIndex;
+	uint indexCount;
+	int vertexOffset;
+	uint _pad0;
+};
+
+// Same layout as VkDrawIndexedIndirectCommand
+struct SceneDraw
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+layout (buffer_reference, std430, buffer_reference_align = 16) readonly buffer SceneMeshes
+{
+	SceneMesh meshes[];
+};
+
+layout (buffer_reference, std430, buffer_reference_align = 4) buffer SceneInstances
+{
+	SceneInstance instances[];
+};
+
+layout (buffer_reference, std430, buffer_reference_align = 4) buffer SceneVisible
+{
+	uint visible[];
+};
+
+layout (buffer_reference, std430, buffer_reference_align = 4) buffer SceneDraws
+{
+	SceneDraw draws[];
+};
+
+// Same layout as vks::SceneBuffers::Table
+layout (buffer_reference, std430, buffer_reference_align = 8) readonly buffer SceneTable
+{
+	SceneMeshes meshes;
+	SceneInstances instances;
+	SceneVisible visible;
+	SceneDraws draws;
+	uint meshCount;
+	uint instanceCount;
+};
+
+// Add `instance` to the draw of `mesh`, from a culling shader
+void sceneAppend(SceneTable table, uint mesh, uint instance)
+{
+	uint slot = atomicAdd(table.draws.draws[mesh].instanceCount, 1);
+	table.visible.visible[table.draws.draws[mesh].firstInstance + slot] = instance;
+}
+
+// The instance a vertex shader draws, gl_InstanceIndex of a draw of the scene's
+SceneInstance sceneInstance(SceneTable table, uint instanceIndex)
+{
+	return table.instances.instances[table.visible.visible[instanceIndex]];
+}
@@ -0,0 +1,36 @@
+#version 450
+
+layout (binding = 0) uniform sampler2D samplerFont;
+
+layout (push_constant) uniform PushConsts
+{
+	mat4 transform;
+	vec4 outlineColor;
+	float outlineWidth;
+	float outline;
+} pushConsts;
+
+layout (location = 0) in vec2 inUV;
+layout (location = 1) in vec4 inColor;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main()
+{
+	float distance = texture(samplerFont, inUV).a;
+	float smoothWidth = fwidth(distance);
+	float alpha = smoothstep(0.5 - smoothWidth, 0.5 + smoothWidth, distance);
+	vec3 rgb = inColor.rgb;
+
+	if (pushConsts.outline > 0.0) {
+		// The outline reaches further out, the glyph itself is drawn over it
+		float w = 1.0 - pushConsts.outlineWidth;
+		float outlineAlpha = smoothstep(w - smoothWidth, w + smoothWidth, distance);
+		rgb = mix(pushConsts.outlineColor.rgb, rgb, outlineAlpha > 0.0 ? alpha / outlineAlpha : 0.0);
+		alpha = outlineAlpha;
+	}
+
+	// Premultiplied
+	alpha *= inColor.a;
+	outFragColor = vec4(rgb * alpha, alpha);
+}
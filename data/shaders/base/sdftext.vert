@@ -0,0 +1,31 @@
+#version 450
+
+// One glyph of vks::TextRenderer per instance, drawn as a strip of four vertices
+
+layout (location = 0) in vec4 inRect;
+layout (location = 1) in vec4 inUV;
+layout (location = 2) in vec4 inColor;
+
+layout (push_constant) uniform PushConsts
+{
+	mat4 transform;
+	vec4 outlineColor;
+	float outlineWidth;
+	float outline;
+} pushConsts;
+
+layout (location = 0) out vec2 outUV;
+layout (location = 1) out vec4 outColor;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+void main()
+{
+	vec2 corner = vec2(gl_VertexIndex & 1, (gl_VertexIndex >> 1) & 1);
+	outUV = mix(inUV.xy, inUV.zw, corner);
+	outColor = inColor;
+	gl_Position = pushConsts.transform * vec4(inRect.xy + corner * inRect.zw, 0.0, 1.0);
+}
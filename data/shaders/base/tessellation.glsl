@@ -0,0 +1,68 @@
+// Screen space adaptive tessellation and patch culling for tessellation control shaders of triangle patches, the GPU
+// side of vks::AdaptiveTessellation.  Points and normals are in view space, and the projection is that of the draw.
+
+#ifndef TESSELLATION_SET
+#define TESSELLATION_SET 0
+#endif
+#ifndef TESSELLATION_BINDING
+#define TESSELLATION_BINDING 0
+#endif
+
+// Must match vks::AdaptiveTessellation::Params
+layout (set = TESSELLATION_SET, binding = TESSELLATION_BINDING) uniform TessellationParams
+{
+	vec2 viewport;
+	float edgePixels;
+	float maxLevel;
+	float displacement;
+	float backfaceCosine;
+	uint cull;
+} tessellation;
+
+// The level of the edge from p0 to p1, as the number of edgePixels long segments the edge covers on screen.  The edge
+// is measured as the sphere around it, the way terraintessellation does, so edges pointing at the viewer aren't left
+// coarse.  Symmetric in p0 and p1, so the patches on both sides of an edge get the same level.
+float tessellationEdgeLevel(mat4 projection, vec3 p0, vec3 p1)
+{
+	if (tessellation.edgePixels <= 0.0) {
+		return tessellation.maxLevel;
+	}
+	vec3 midPoint = 0.5 * (p0 + p1);
+	float radius = 0.5 * distance(p0, p1);
+	vec4 clip0 = projection * vec4(midPoint - vec3(radius, 0.0, 0.0), 1.0);
+	vec4 clip1 = projection * vec4(midPoint + vec3(radius, 0.0, 0.0), 1.0);
+	// Edges at or behind the eye are as large as they get
+	float w = max(min(clip0.w, clip1.w), 1.0e-3);
+	vec2 pixels = (clip1.xy / w - clip0.xy / w) * 0.5 * tessellation.viewport;
+	return clamp(length(pixels) / tessellation.edgePixels, 1.0, tessellation.maxLevel);
+}
+
+// Patches outside the frustum, with the surface allowed to move `displacement` off the flat triangle, and to bow out
+// of it by `bulge` times its bounding radius, or whose corner normals all face away from the viewer
+bool tessellationCulled(mat4 projection, vec3 p0, vec3 p1, vec3 p2, vec3 n0, vec3 n1, vec3 n2, float bulge)
+{
+	if (tessellation.cull == 0u) {
+		return false;
+	}
+
+	// The bounding sphere of the corners against the planes of the projection's frustum, from its rows
+	vec3 center = (p0 + p1 + p2) / 3.0;
+	float radius = sqrt(max(max(dot(p0 - center, p0 - center), dot(p1 - center, p1 - center)), dot(p2 - center, p2 - center)));
+	radius = radius * (1.0 + bulge) + tessellation.displacement;
+	vec4 rows[4];
+	for (int i = 0; i < 4; i++) {
+		rows[i] = vec4(projection[0][i], projection[1][i], projection[2][i], projection[3][i]);
+	}
+	// Left, right, bottom, top, and the near and far planes of a [0, 1] depth range
+	vec4 planes[6] = vec4[](rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[2], rows[3] - rows[2]);
+	for (int i = 0; i < 6; i++) {
+		if (dot(planes[i].xyz, center) + planes[i].w < -radius * length(planes[i].xyz)) {
+			return true;
+		}
+	}
+
+	// The directions to the eye, which sits at the origin of view space
+	return dot(normalize(-p0), normalize(n0)) < -tessellation.backfaceCosine &&
+		dot(normalize(-p1), normalize(n1)) < -tessellation.backfaceCosine &&
+		dot(normalize(-p2), normalize(n2)) < -tessellation.backfaceCosine;
+}
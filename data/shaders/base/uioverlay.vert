@@ -7,6 +7,8 @@ layout (location = 2) in vec4 inColor;
 layout (push_constant) uniform PushConstants {
 	vec2 scale;
 	vec2 translate;
+	// Cosine and sine of the rotation from the display's orientation to the framebuffer's
+	vec2 rotation;
 } pushConstants;
 
 layout (location = 0) out vec2 outUV;
@@ -21,5 +23,7 @@ void main()
 {
 	outUV = inUV;
 	outColor = inColor;
-	gl_Position = vec4(inPos * pushConstants.scale + pushConstants.translate, 0.0, 1.0);
+	vec2 pos = inPos * pushConstants.scale + pushConstants.translate;
+	vec2 rotation = pushConstants.rotation;
+	gl_Position = vec4(pos.x * rotation.x - pos.y * rotation.y, pos.x * rotation.y + pos.y * rotation.x, 0.0, 1.0);
 }
\ No newline at end of file
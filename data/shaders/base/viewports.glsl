@@ -0,0 +1,47 @@
+// Views and per view instance lists of vks::ViewportArray, for its vertex shaders.  Pipelines of layered draws
+// enable GL_ARB_shader_viewport_layer_array and define VIEWPORTS_LAYERED before including this, so that every
+// instance is rasterized into the viewport of its view.
+
+#ifndef VIEWPORTS_SET
+#define VIEWPORTS_SET 0
+#endif
+
+// Must match vks::ViewportArray::MAX_VIEWS
+#define VIEWPORTS_MAX_VIEWS 16
+
+struct ViewportView
+{
+	mat4 view;
+	mat4 projection;
+};
+
+layout (set = VIEWPORTS_SET, binding = 0) uniform ViewportViews
+{
+	ViewportView views[VIEWPORTS_MAX_VIEWS];
+} viewports;
+
+layout (std430, set = VIEWPORTS_SET, binding = 1) readonly buffer ViewportModels
+{
+	mat4 models[];
+} viewportModels;
+
+// The instance and view index of every instance drawn
+layout (std430, set = VIEWPORTS_SET, binding = 2) readonly buffer ViewportEntries
+{
+	uvec2 entries[];
+} viewportEntries;
+
+layout (push_constant) uniform ViewportPushConsts
+{
+	uint firstEntry;
+} viewportPushConsts;
+
+// The instance and view index of the current instance
+uvec2 viewportInstance()
+{
+	uvec2 entry = viewportEntries.entries[viewportPushConsts.firstEntry + gl_InstanceIndex];
+#ifdef VIEWPORTS_LAYERED
+	gl_ViewportIndex = int(entry.y);
+#endif
+	return entry;
+}
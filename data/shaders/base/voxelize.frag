@@ -0,0 +1,25 @@
+#version 450
+
+// Marks the voxel of every fragment of vks::Voxelizer.  The largest packed color wins, which makes the result
+// independent of the order of the fragments.
+
+layout (location = 0) in vec3 inPos;
+
+layout (push_constant) uniform PushConsts
+{
+	mat4 transform;
+	vec4 color;
+} pushConsts;
+
+layout (set = 0, binding = 0, r32ui) uniform coherent uimage3D voxels;
+
+void main()
+{
+	ivec3 size = imageSize(voxels);
+	// Fragments of conservative rasterization can be just outside the triangle, and so outside the cube
+	if (any(lessThan(inPos, vec3(0.0))) || any(greaterThan(inPos, vec3(1.0)))) {
+		return;
+	}
+	ivec3 voxel = min(ivec3(inPos * vec3(size)), size - 1);
+	imageAtomicMax(voxels, voxel, packUnorm4x8(vec4(pushConsts.color.rgb, 1.0)));
+}
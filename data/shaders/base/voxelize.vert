@@ -0,0 +1,18 @@
+#version 450
+
+// Vertices of vks::Voxelizer, into the unit cube of the grid
+
+layout (location = 0) in vec3 inPos;
+
+layout (push_constant) uniform PushConsts
+{
+	mat4 transform;
+	vec4 color;
+} pushConsts;
+
+layout (location = 0) out vec3 outPos;
+
+void main()
+{
+	outPos = (pushConsts.transform * vec4(inPos, 1.0)).xyz;
+}
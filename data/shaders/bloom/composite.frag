@@ -0,0 +1,25 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Adds the first level of the bloom chain, which holds the sum of all levels after upsampling, to the scene
+
+#define LEVELS 6
+
+layout (binding = 1) uniform sampler2D samplerBloom;
+
+layout (binding = 0) uniform UBO 
+{
+	float blurScale;
+	float blurStrength;
+} ubo;
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main() 
+{
+	outFragColor = vec4(texture(samplerBloom, inUV).rgb * ubo.blurStrength / float(LEVELS), 1.0);
+}
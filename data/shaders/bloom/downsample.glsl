@@ -0,0 +1,86 @@
+// Reduces the glow target to every level of the bloom chain in a single dispatch.  Every workgroup owns a 32x32 tile
+// of level 0 and each of its 256 invocations a 2x2 block of that, so the tile's texels of levels 1 to 5 can be
+// averaged inside the workgroup without waiting for another dispatch.  Invocations are laid out along a Z order curve,
+// which puts every 2x2 block of a level in four consecutive invocations for reduceQuad to average.
+//
+// Defining REDUCE_WITH_SUBGROUPS averages them with subgroup quad operations instead of a round trip through shared
+// memory.  That relies on consecutive invocations of the one dimensional workgroup being consecutive subgroup
+// invocations, which is how current implementations fill subgroups.
+
+// The format of the chain's levels, defined as r11f_g11f_b10f by the _compact variants
+#ifndef CHAIN_FORMAT
+#define CHAIN_FORMAT rgba16f
+#endif
+
+#define LEVELS 6
+#define TILE_SIZE 32
+
+layout (local_size_x = 256) in;
+
+layout (binding = 0) uniform sampler2D samplerGlow;
+layout (binding = 1, CHAIN_FORMAT) uniform writeonly image2D levels[LEVELS];
+
+// The texels of the last level written, in Z order, for the next one
+shared vec4 staged[64];
+#ifndef REDUCE_WITH_SUBGROUPS
+shared vec4 quads[256];
+#endif
+
+// Position of the invocation within a 16x16 block, the even bits of the index are x and the odd ones y
+uvec2 zOrder(uint index)
+{
+	uvec2 v = uvec2(index, index >> 1) & 0x55u;
+	v = (v | (v >> 1)) & 0x33u;
+	v = (v | (v >> 2)) & 0x0fu;
+	return v;
+}
+
+// Average of `value` over the quad of invocations `index` belongs to.  Must be reached by the whole workgroup
+vec4 reduceQuad(vec4 value, uint index)
+{
+#ifdef REDUCE_WITH_SUBGROUPS
+	value += subgroupQuadSwapHorizontal(value);
+	value += subgroupQuadSwapVertical(value);
+	return value * 0.25;
+#else
+	quads[index] = value;
+	barrier();
+	uint first = index & ~3u;
+	value = (quads[first] + quads[first + 1] + quads[first + 2] + quads[first + 3]) * 0.25;
+	barrier();
+	return value;
+#endif
+}
+
+void main() 
+{
+	uint index = gl_LocalInvocationIndex;
+	ivec2 tile = ivec2(gl_WorkGroupID.xy);
+	vec2 texelSize = 1.0 / vec2(imageSize(levels[0]));
+
+	// Level 0 texel centers fall on the corners of four glow texels, one bilinear tap averages them
+	ivec2 block = tile * TILE_SIZE + ivec2(zOrder(index)) * 2;
+	vec4 value = vec4(0.0);
+	for (int i = 0; i < 4; ++i) {
+		ivec2 texel = block + ivec2(i & 1, i >> 1);
+		vec4 color = textureLod(samplerGlow, (vec2(texel) + 0.5) * texelSize, 0.0);
+		imageStore(levels[0], texel, color);
+		value += color;
+	}
+	// Level 1 is the average of the block this invocation wrote
+	value *= 0.25;
+	imageStore(levels[1], tile * (TILE_SIZE >> 1) + ivec2(zOrder(index)), value);
+
+	for (int level = 2; level < LEVELS; ++level) {
+		// Invocations holding a texel of the level below
+		uint holders = 256u >> (2 * (level - 2));
+		value = reduceQuad(value, index);
+		if (index < holders && (index & 3u) == 0) {
+			imageStore(levels[level], tile * (TILE_SIZE >> level) + ivec2(zOrder(index >> 2)), value);
+			staged[index >> 2] = value;
+		}
+		barrier();
+		value = staged[index & 63u];
+		barrier();
+	}
+}
@@ -2,46 +2,7 @@
 
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
+#extension GL_GOOGLE_include_directive : require
 
-layout (binding = 1) uniform sampler2D samplerColor;
-
-layout (binding = 0) uniform UBO 
-{
-	float blurScale;
-	float blurStrength;
-} ubo;
-
-layout (constant_id = 0) const int blurdirection = 0;
-
-layout (location = 0) in vec2 inUV;
-
-layout (location = 0) out vec4 outFragColor;
-
-void main() 
-{
-	float weight[5];
-	weight[0] = 0.227027;
-	weight[1] = 0.1945946;
-	weight[2] = 0.1216216;
-	weight[3] = 0.054054;
-	weight[4] = 0.016216;
-
-	vec2 tex_offset = 1.0 / textureSize(samplerColor, 0) * ubo.blurScale; // gets size of single texel
-	vec3 result = texture(samplerColor, inUV).rgb * weight[0]; // current fragment's contribution
-	for(int i = 1; i < 5; ++i)
-	{
-		if (blurdirection == 1)
-		{
-			// H
-			result += texture(samplerColor, inUV + vec2(tex_offset.x * i, 0.0)).rgb * weight[i] * ubo.blurStrength;
-			result += texture(samplerColor, inUV - vec2(tex_offset.x * i, 0.0)).rgb * weight[i] * ubo.blurStrength;
-		}
-		else
-		{
-			// V
-			result += texture(samplerColor, inUV + vec2(0.0, tex_offset.y * i)).rgb * weight[i] * ubo.blurStrength;
-			result += texture(samplerColor, inUV - vec2(0.0, tex_offset.y * i)).rgb * weight[i] * ubo.blurStrength;
-		}
-	}
-	outFragColor = vec4(result, 1.0);
-}
\ No newline at end of file
+#include "../base/precision.glsl"
+#include "gaussblur.glsl"
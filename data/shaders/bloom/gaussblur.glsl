@@ -0,0 +1,46 @@
+// Separable gaussian blur, along the direction of the blurdirection specialization constant.  The weights and the sum
+// are in the types of ../base/precision.glsl, which the stub includes first, the texture coordinates stay 32 bit.
+
+layout (binding = 1) uniform sampler2D samplerColor;
+
+layout (binding = 0) uniform UBO 
+{
+	float blurScale;
+	float blurStrength;
+} ubo;
+
+layout (constant_id = 0) const int blurdirection = 0;
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main() 
+{
+	mfloat weight[5];
+	weight[0] = mfloat(0.227027);
+	weight[1] = mfloat(0.1945946);
+	weight[2] = mfloat(0.1216216);
+	weight[3] = mfloat(0.054054);
+	weight[4] = mfloat(0.016216);
+
+	mfloat strength = mfloat(ubo.blurStrength);
+	vec2 tex_offset = 1.0 / textureSize(samplerColor, 0) * ubo.blurScale; // gets size of single texel
+	mvec3 result = narrowColor(texture(samplerColor, inUV).rgb) * weight[0]; // current fragment's contribution
+	for(int i = 1; i < 5; ++i)
+	{
+		if (blurdirection == 1)
+		{
+			// H
+			result += narrowColor(texture(samplerColor, inUV + vec2(tex_offset.x * i, 0.0)).rgb) * weight[i] * strength;
+			result += narrowColor(texture(samplerColor, inUV - vec2(tex_offset.x * i, 0.0)).rgb) * weight[i] * strength;
+		}
+		else
+		{
+			// V
+			result += narrowColor(texture(samplerColor, inUV + vec2(0.0, tex_offset.y * i)).rgb) * weight[i] * strength;
+			result += narrowColor(texture(samplerColor, inUV - vec2(0.0, tex_offset.y * i)).rgb) * weight[i] * strength;
+		}
+	}
+	outFragColor = vec4(result, 1.0);
+}
@@ -0,0 +1,9 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_GOOGLE_include_directive : require
+
+#define HALF_PRECISION
+#include "../base/precision.glsl"
+#include "gaussblur.glsl"
@@ -0,0 +1,36 @@
+// One step of the bloom chain's upsampling: the level above, already holding the upsampled levels above it, is
+// filtered with a 3x3 tent and added to this level, which the next dispatch upsamples in turn.
+
+// The format of the chain's levels, defined as r11f_g11f_b10f by the _compact variants
+#ifndef CHAIN_FORMAT
+#define CHAIN_FORMAT rgba16f
+#endif
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (binding = 0) uniform UBO 
+{
+	float blurScale;
+	float blurStrength;
+} ubo;
+layout (binding = 1) uniform sampler2D samplerCoarse;
+layout (binding = 2, CHAIN_FORMAT) uniform image2D level;
+
+void main() 
+{
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 size = imageSize(level);
+	if (any(greaterThanEqual(texel, size))) {
+		return;
+	}
+	vec2 uv = (vec2(texel) + 0.5) / vec2(size);
+	// Tent radius in texels of this level
+	vec3 d = vec3(ubo.blurScale / vec2(size), 0.0);
+
+	vec4 sum = textureLod(samplerCoarse, uv, 0.0) * 4.0;
+	sum += (textureLod(samplerCoarse, uv - d.xz, 0.0) + textureLod(samplerCoarse, uv + d.xz, 0.0) +
+	        textureLod(samplerCoarse, uv - d.zy, 0.0) + textureLod(samplerCoarse, uv + d.zy, 0.0)) * 2.0;
+	sum += textureLod(samplerCoarse, uv - d.xy, 0.0) + textureLod(samplerCoarse, uv + d.xy, 0.0) +
+	       textureLod(samplerCoarse, uv + vec2(d.x, -d.y), 0.0) + textureLod(samplerCoarse, uv + vec2(-d.x, d.y), 0.0);
+	imageStore(level, texel, imageLoad(level, texel) + sum / 16.0);
+}
@@ -0,0 +1,60 @@
+// Declarations shared by the cloth compute shaders, see Compute in computecloth.cpp.  Every dispatch reads the
+// particles from particleIn and writes them advanced to particleOut.
+
+struct Particle {
+	vec4 pos;
+	vec4 vel;
+	vec4 uv;
+	vec4 normal;
+	float pinned;
+};
+
+layout(std430, binding = 0) buffer ParticleIn {
+	Particle particleIn[ ];
+};
+
+layout(std430, binding = 1) buffer ParticleOut {
+	Particle particleOut[ ];
+};
+
+// Must match Compute::MAX_COLLIDERS
+#define MAX_COLLIDERS 16
+
+layout (binding = 2) uniform UBO 
+{
+	float deltaT;
+	float particleMass;
+	float springStiffness;
+	float damping;
+	float restDistH;
+	float restDistV;
+	float restDistD;
+	int colliderCount;
+	vec4 gravity;
+	ivec2 particleCount;
+	// xyz: center, w: radius
+	vec4 colliders[MAX_COLLIDERS];
+} params;
+
+layout (push_constant) uniform PushConsts {
+	uint calculateNormals;
+} pushConsts;
+
+vec3 springForce(vec3 p0, vec3 p1, float restDist) 
+{
+	vec3 dist = p0 - p1;
+	return normalize(dist) * params.springStiffness * (length(dist) - restDist);
+}
+
+// Push particles inside a collider to its surface and stop them
+void collide(inout vec3 pos, inout vec3 vel)
+{
+	for (int i = 0; i < params.colliderCount; i++) {
+		vec3 sphereDist = pos - params.colliders[i].xyz;
+		float radius = params.colliders[i].w + 0.01;
+		if (length(sphereDist) < radius) {
+			pos = params.colliders[i].xyz + normalize(sphereDist) * radius;
+			vel = vec3(0.0);
+		}
+	}
+}
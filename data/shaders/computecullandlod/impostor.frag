@@ -0,0 +1,38 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : require
+
+#include "../base/impostor.glsl"
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 projection;
+} ubo;
+
+layout (binding = 3) uniform sampler2D albedoMap;
+layout (binding = 4) uniform sampler2D normalDepthMap;
+
+layout (location = 0) in vec2 inUV;
+layout (location = 1) in vec3 inViewPos;
+layout (location = 2) in vec3 inViewDepth;
+layout (location = 3) in vec3 inLightVec;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main()
+{
+	vec3 color, normal;
+	float depthOffset;
+	if (!impostorSample(albedoMap, normalDepthMap, inUV, color, normal, depthOffset)) {
+		discard;
+	}
+	// Where the surface was in the view, so that impostors intersect each other and the meshes like the meshes would
+	vec4 clipPos = ubo.projection * vec4(inViewPos + inViewDepth * depthOffset, 1.0);
+	gl_FragDepth = clipPos.z / clipPos.w;
+
+	// Same lighting as indirectdraw.frag, the instances aren't rotated so the normal is in world space already
+	vec3 L = normalize(inLightVec);
+	vec3 ambient = vec3(0.25);
+	vec3 diffuse = vec3(max(dot(normal, L), 0.0));
+	outFragColor = vec4((ambient + diffuse) * color, 1.0);
+}
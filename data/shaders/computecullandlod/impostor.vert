@@ -0,0 +1,69 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : require
+
+#include "../base/impostor.glsl"
+
+// The objects cull.comp or clustercull.comp found beyond the impostor distance, one billboard per instance
+
+struct InstanceData 
+{
+	vec3 pos;
+	float scale;
+};
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 modelview;
+	vec4 cameraPos;
+} ubo;
+
+layout (binding = 1, std140) readonly buffer Instances 
+{
+	InstanceData instances[ ];
+};
+
+// The indirect draw, then the objects it draws
+layout (binding = 2, std430) readonly buffer Impostors
+{
+	uint vertexCount;
+	uint instanceCount;
+	uint firstVertex;
+	uint firstInstance;
+	uint indices[ ];
+} impostors;
+
+layout (push_constant) uniform PushConsts
+{
+	vec4 sphere;
+	uint frames;
+} pushConsts;
+
+layout (location = 0) out vec2 outUV;
+layout (location = 1) out vec3 outViewPos;
+// From the billboard to the far side of the sphere, in view space
+layout (location = 2) out vec3 outViewDepth;
+layout (location = 3) out vec3 outLightVec;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+void main() 
+{
+	InstanceData instance = instances[impostors.indices[gl_InstanceIndex]];
+	// Instances only translate and uniformly scale
+	vec3 toCamera = (ubo.cameraPos.xyz - instance.pos) / instance.scale - pushConsts.sphere.xyz;
+	ImpostorVertex impostor = impostorVertex(pushConsts.sphere, pushConsts.frames, toCamera, gl_VertexIndex);
+	outUV = impostor.uv;
+
+	vec3 pos = impostor.position * instance.scale + instance.pos;
+	vec4 viewPos = ubo.modelview * vec4(pos, 1.0);
+	gl_Position = ubo.projection * viewPos;
+	outViewPos = viewPos.xyz;
+	outViewDepth = mat3(ubo.modelview) * -impostor.direction * pushConsts.sphere.w * instance.scale;
+	// As in indirectdraw.vert
+	outLightVec = vec3(0.0, 10.0, 50.0) - pos;
+}
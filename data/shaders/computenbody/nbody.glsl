@@ -0,0 +1,114 @@
+// Declarations shared by the N-body compute shaders, see ComputeNBody in computenbody.cpp for the passes.
+// Particles are double buffered: every frame reads the positions of the last one from particlesIn and writes the
+// advanced particles to particlesOut, so the force calculation and the integration can happen in one pass.
+
+struct Particle
+{
+	vec4 pos;	// xyz = position, w = mass
+	vec4 vel;	// xyz = velocity, w = gradient texture position
+};
+
+// Barnes-Hut tree node.  Internal nodes come first, followed by one leaf per particle
+struct Node
+{
+	vec4 mass;	// xyz = centre of mass, w = mass
+	int left;	// -1 for leaves
+	int right;
+	int parent;	// -1 for the root
+	float size;	// Edge length of the octree cell, zero for leaves
+};
+
+layout (local_size_x_id = 0) in;
+
+layout (constant_id = 1) const float GRAVITY = 0.002;
+layout (constant_id = 2) const float POWER = 0.75;
+layout (constant_id = 3) const float SOFTEN = 0.0075;
+
+layout (std430, binding = 0) readonly buffer ParticlesIn
+{
+	Particle particlesIn[ ];
+};
+
+layout (binding = 1) uniform UBO
+{
+	float deltaT;
+	float destX;
+	float destY;
+	int particleCount;
+	// Barnes-Hut opening angle, cells are opened while size / distance is at least theta
+	float theta;
+} ubo;
+
+layout (std430, binding = 2) writeonly buffer ParticlesOut
+{
+	Particle particlesOut[ ];
+};
+
+// Morton code and particle index, sorted by code
+layout (std430, binding = 3) buffer Keys
+{
+	uvec2 keys[ ];
+};
+
+layout (std430, binding = 4) coherent buffer Nodes
+{
+	Node nodes[ ];
+};
+
+layout (std430, binding = 5) coherent buffer Tree
+{
+	// Scene bounds as orderedBits, reset to the largest and smallest value before the bounds pass
+	uvec4 boundsMin;
+	uvec4 boundsMax;
+	// Children that have reached each internal node during the bottom up pass, reset to zero
+	uint visits[ ];
+};
+
+layout (push_constant) uniform PushConstants
+{
+	// Number of sort keys, the particle count rounded up to a power of two
+	uint sortCount;
+	uint blockSize;
+	uint distance;
+} push;
+
+// Order preserving mapping of floats to uints, so that atomicMin and atomicMax work on them
+uint orderedBits(float value)
+{
+	uint bits = floatBitsToUint(value);
+	return (bits & 0x80000000u) != 0 ? ~bits : bits | 0x80000000u;
+}
+
+float orderedFloat(uint bits)
+{
+	return uintBitsToFloat((bits & 0x80000000u) != 0 ? bits & 0x7FFFFFFFu : ~bits);
+}
+
+// The cube the Morton codes and octree cells subdivide, enclosing the bounds found by the bounds pass
+void sceneCube(out vec3 origin, out float size)
+{
+	origin = vec3(orderedFloat(boundsMin.x), orderedFloat(boundsMin.y), orderedFloat(boundsMin.z));
+	vec3 extent = vec3(orderedFloat(boundsMax.x), orderedFloat(boundsMax.y), orderedFloat(boundsMax.z)) - origin;
+	size = max(max(extent.x, extent.y), max(extent.z, 1e-6)) * 1.0001;
+}
+
+vec3 attraction(vec3 position, vec4 other)
+{
+	vec3 len = other.xyz - position;
+	return GRAVITY * len * other.w / pow(dot(len, len) + SOFTEN, POWER);
+}
+
+// Semi-implicit Euler step of particle `index` and the write of its new state
+void integrate(uint index, vec4 position, vec3 acceleration)
+{
+	vec4 velocity = particlesIn[index].vel;
+	velocity.xyz += ubo.deltaT * acceleration;
+	position.xyz += ubo.deltaT * velocity.xyz;
+
+	// Gradient texture position
+	velocity.w += 0.1 * ubo.deltaT;
+	if (velocity.w > 1.0)
+		velocity.w -= 1.0;
+
+	particlesOut[index] = Particle(position, velocity);
+}
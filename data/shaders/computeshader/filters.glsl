@@ -0,0 +1,73 @@
+// The filters of sharpen.comp, edgedetect.comp and emboss.comp, for the tiled, separable and fused chain variants.
+// Neighbourhoods hold the 3x3 texels around the filtered one with x in the outer loop, so texel (x + i, y + j) is at
+// (i + 1) * 3 + (j + 1).
+
+#define FILTER_SHARPEN 0
+#define FILTER_EDGEDETECT 1
+#define FILTER_EMBOSS 2
+
+float conv(in float[9] kernel, in float[9] data, in float denom, in float offset)
+{
+	float res = 0.0;
+	for (int i = 0; i < 9; ++i)
+	{
+		res += kernel[i] * data[i];
+	}
+	return clamp(res / denom + offset, 0.0, 1.0);
+}
+
+float luminance(vec3 rgb)
+{
+	return (rgb.r + rgb.g + rgb.b) / 3.0;
+}
+
+vec3 applyFilter(uint filterIndex, vec3 texels[9])
+{
+	float[9] data;
+	if (filterIndex == FILTER_SHARPEN)
+	{
+		const float[9] kernel = float[9](
+			-1.0, -1.0, -1.0,
+			-1.0,  9.0, -1.0,
+			-1.0, -1.0, -1.0);
+		vec3 result;
+		for (int c = 0; c < 3; ++c)
+		{
+			for (int i = 0; i < 9; ++i)
+			{
+				data[i] = texels[i][c];
+			}
+			result[c] = conv(kernel, data, 1.0, 0.0);
+		}
+		return result;
+	}
+
+	for (int i = 0; i < 9; ++i)
+	{
+		data[i] = luminance(texels[i]);
+	}
+	if (filterIndex == FILTER_EDGEDETECT)
+	{
+		const float[9] kernel = float[9](
+			-1.0 / 8.0, -1.0 / 8.0, -1.0 / 8.0,
+			-1.0 / 8.0,  1.0,       -1.0 / 8.0,
+			-1.0 / 8.0, -1.0 / 8.0, -1.0 / 8.0);
+		return vec3(conv(kernel, data, 0.1, 0.0));
+	}
+	const float[9] kernel = float[9](
+		-1.0, 0.0,  0.0,
+		 0.0, -1.0, 0.0,
+		 0.0, 0.0,  2.0);
+	return vec3(conv(kernel, data, 1.0, 0.5));
+}
+
+// Sharpen and edge detect weigh the filtered texel and the sum of its 3x3 neighbourhood, which is the sum of the
+// three row sums around it.  Emboss isn't separable.
+vec3 applySeparable(uint filterIndex, vec3 center, vec3 box)
+{
+	if (filterIndex == FILTER_SHARPEN)
+	{
+		return clamp(10.0 * center - box, 0.0, 1.0);
+	}
+	return vec3(clamp((9.0 / 8.0 * luminance(center) - luminance(box) / 8.0) / 0.1, 0.0, 1.0));
+}
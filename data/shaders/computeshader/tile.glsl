@@ -0,0 +1,31 @@
+// Workgroups filter a TILE x TILE tile of the image, loading the texels they read into shared memory first
+
+#define TILE 16
+
+layout (local_size_x = TILE, local_size_y = TILE) in;
+layout (binding = 0, rgba8) uniform readonly image2D inputImage;
+layout (binding = 1, rgba8) uniform image2D resultImage;
+
+#include "filters.glsl"
+
+// The first texel of the tile of the workgroup, less the apron read around it
+ivec2 tileOrigin(int apron)
+{
+	return ivec2(gl_WorkGroupID.xy) * TILE - apron;
+}
+
+// Texels outside of the image are black
+vec3 fetch(ivec2 position)
+{
+	if (any(lessThan(position, ivec2(0))) || any(greaterThanEqual(position, imageSize(inputImage))))
+	{
+		return vec3(0.0);
+	}
+	return imageLoad(inputImage, position).rgb;
+}
+
+// The last tiles of images that aren't a multiple of TILE stick out
+bool insideResult(ivec2 position)
+{
+	return all(lessThan(position, imageSize(resultImage)));
+}
@@ -0,0 +1,43 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "../base/gbuffer.glsl"
+
+// Written by the G-buffer subpass, read from tile memory on tiled GPUs
+layout (input_attachment_index = 0, binding = 0) uniform subpassInput samplerNormal;
+layout (input_attachment_index = 1, binding = 1) uniform subpassInput samplerAlbedo;
+layout (input_attachment_index = 2, binding = 2) uniform subpassInput samplerDepth;
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragcolor;
+
+layout (binding = 3) uniform UBO 
+{
+	vec4 viewPos;
+	// Clip space to the G-buffer space of mrt.vert
+	mat4 inverseViewProjection;
+} ubo;
+
+#define LIGHTS_BINDING 4
+#define CLUSTER_UNIFORM_BINDING 5
+#define CLUSTER_GRID_BINDING 6
+#include "lighting.glsl"
+
+void main() 
+{
+	vec4 albedo = subpassLoad(samplerAlbedo);
+	float depth = subpassLoad(samplerDepth).r;
+	// Nothing was drawn here, there is no position to light
+	if (depth == 1.0) {
+		outFragcolor = vec4(albedo.rgb * ambient, 1.0);
+		return;
+	}
+	vec3 fragPos = reconstructPosition(ubo.inverseViewProjection, inUV, depth);
+	vec3 normal = octDecode(subpassLoad(samplerNormal).rg);
+
+	outFragcolor = vec4(shade(fragPos, normal, albedo, ubo.viewPos.xyz), 1.0);
+}
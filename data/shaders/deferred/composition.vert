@@ -0,0 +1,27 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 model;
+	// The part of the G-buffer that is rendered to
+	vec4 uvScale;
+} ubo;
+
+layout (location = 0) out vec2 outUV;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+// Full screen triangle over the rendered part of the lit target, for the temporal resolve
+void main() 
+{
+	vec2 uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+	outUV = uv * ubo.uvScale.xy;
+	gl_Position = vec4(uv * 2.0f - 1.0f, 0.0f, 1.0f);
+}
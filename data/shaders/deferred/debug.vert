@@ -11,12 +11,14 @@ layout (binding = 0) uniform UBO
 {
 	mat4 projection;
 	mat4 model;
+	// The part of the G-buffer that is rendered to
+	vec4 uvScale;
 } ubo;
 
 layout (location = 0) out vec3 outUV;
 
 void main() 
 {
-	outUV = vec3(inUV.st, inNormal.z);
+	outUV = vec3(inUV.st * ubo.uvScale.xy, inNormal.z);
 	gl_Position = ubo.projection * ubo.model * vec4(inPos.xyz, 1.0);
 }
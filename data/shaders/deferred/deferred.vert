@@ -10,12 +10,14 @@ layout (binding = 0) uniform UBO
 {
 	mat4 projection;
 	mat4 model;
+	// The part of the G-buffer that is rendered to
+	vec4 uvScale;
 } ubo;
 
 layout (location = 0) out vec2 outUV;
 
 void main() 
 {
-	outUV = inUV;
+	outUV = inUV * ubo.uvScale.xy;
 	gl_Position = ubo.projection * ubo.model * vec4(inPos.xyz, 1.0);
 }
@@ -0,0 +1,53 @@
+// Clustered point light shading shared by the composition passes.  Define LIGHTS_BINDING, CLUSTER_UNIFORM_BINDING
+// and CLUSTER_GRID_BINDING before including this.
+
+struct Light {
+    vec4 position;
+    vec4 color;
+	float radius;
+	float quadraticFalloff;
+	float linearFalloff;
+	float _pad;
+};
+
+layout (binding = LIGHTS_BINDING) readonly buffer Lights { Light lights[]; };
+
+#include "../base/clusters.glsl"
+
+#define ambient 0.05
+#define specularStrength 0.15
+
+// Lighting of a G-buffer sample, positions are in the (y flipped) world space of mrt.vert
+vec3 shade(vec3 fragPos, vec3 normal, vec4 albedo, vec3 viewPos)
+{
+	// Ambient part
+    vec3 fragcolor  = albedo.rgb * ambient;
+	
+    vec3 viewVec = normalize(viewPos - fragPos);
+
+	// Only the lights binned into the fragment's cluster can reach it
+	uint cluster = clusterIndex(fragPos);
+	uint lightCount = clusterLightCount(cluster);
+    for(uint i = 0; i < lightCount; ++i)
+    {
+		Light light = lights[clusterLight(cluster, i)];
+        // Distance from light to fragment position
+        float dist = length(light.position.xyz - fragPos);
+		
+        if(dist < light.radius)
+        {
+			// Get vector from current light source to fragment position
+            vec3 lightVec = normalize(light.position.xyz - fragPos);
+            // Diffuse part
+            vec3 diffuse = max(dot(normal, lightVec), 0.0) * albedo.rgb * light.color.rgb;
+            // Specular part (specular texture part stored in albedo alpha channel)
+            vec3 halfVec = normalize(lightVec + viewVec);  
+            vec3 specular = light.color.rgb * pow(max(dot(normal, halfVec), 0.0), 16.0) * albedo.a * specularStrength;
+            // Attenuation with linearFalloff and quadraticFalloff falloff
+            float attenuation = 1.0 / (1.0 + light.linearFalloff * dist + light.quadraticFalloff * dist * dist);
+            fragcolor += (diffuse + specular) * attenuation;
+        }
+		
+    }
+	return fragcolor;
+}
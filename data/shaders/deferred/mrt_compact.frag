@@ -0,0 +1,25 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "../base/gbuffer.glsl"
+
+layout (binding = 1) uniform sampler2D samplerColor;
+
+layout (location = 0) in vec3 inNormal;
+layout (location = 1) in vec2 inUV;
+layout (location = 2) in vec3 inColor;
+layout (location = 3) in vec3 inWorldPos;
+
+// No position target, compact.frag reconstructs it from depth
+layout (location = 0) out vec2 outNormal;
+// Albedo in rgb, specular intensity in alpha
+layout (location = 1) out vec4 outAlbedo;
+
+void main() 
+{
+	outNormal = octEncode(normalize(inNormal));
+	outAlbedo = texture(samplerColor, inUV);
+}
@@ -2,6 +2,7 @@
 
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
+#extension GL_GOOGLE_include_directive : require
 
 layout (binding = 1) uniform sampler2DMS samplerPosition;
 layout (binding = 2) uniform sampler2DMS samplerNormal;
@@ -19,14 +20,19 @@ struct Light {
 
 layout (binding = 4) uniform UBO 
 {
-	Light lights[6];
 	vec4 viewPos;
 	ivec2 windowSize;
 } ubo;
 
-layout (constant_id = 0) const int NUM_SAMPLES = 8;
+layout (binding = 5) readonly buffer Lights { Light lights[]; };
+
+#define CLUSTER_UNIFORM_BINDING 6
+#define CLUSTER_GRID_BINDING 7
+#include "../base/clusters.glsl"
 
-#define NUM_LIGHTS 6
+layout (constant_id = 0) const int NUM_SAMPLES = 8;
+// Light every sample only where they cover more than one surface
+layout (constant_id = 1) const bool EDGES_ONLY = false;
 
 // Manual resolve for MSAA samples 
 vec4 resolve(sampler2DMS tex, ivec2 uv)
@@ -41,14 +47,35 @@ vec4 resolve(sampler2DMS tex, ivec2 uv)
 	return result / float(NUM_SAMPLES);
 }
 
+// Whether the samples of a pixel differ in coverage, depth or orientation, against the plane of the first sample
+bool isEdge(ivec2 uv)
+{
+	vec4 pos0 = texelFetch(samplerPosition, uv, 0);
+	vec3 normal0 = normalize(texelFetch(samplerNormal, uv, 0).rgb);
+	for (int i = 1; i < NUM_SAMPLES; i++)
+	{
+		vec4 pos = texelFetch(samplerPosition, uv, i);
+		vec3 normal = normalize(texelFetch(samplerNormal, uv, i).rgb);
+		if (pos.w != pos0.w || abs(dot(pos.xyz - pos0.xyz, normal0)) > 0.01 || dot(normal, normal0) < 0.95)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
 vec3 calculateLighting(vec3 pos, vec3 normal, vec4 albedo)
 {
 	vec3 result = vec3(0.0);
 
-	for(int i = 0; i < NUM_LIGHTS; ++i)
+	// Only the lights binned into the sample's cluster can reach it
+	uint cluster = clusterIndex(pos);
+	uint lightCount = clusterLightCount(cluster);
+	for(uint i = 0; i < lightCount; ++i)
 	{
+		Light light = lights[clusterLight(cluster, i)];
 		// Vector to light
-		vec3 L = ubo.lights[i].position.xyz - pos;
+		vec3 L = light.position.xyz - pos;
 		// Distance from light to fragment position
 		float dist = length(L);
 
@@ -60,17 +87,17 @@ vec3 calculateLighting(vec3 pos, vec3 normal, vec4 albedo)
 		L = normalize(L);
 
 		// Attenuation
-		float atten = ubo.lights[i].radius / (pow(dist, 2.0) + 1.0);
+		float atten = light.radius / (pow(dist, 2.0) + 1.0);
 
 		// Diffuse part
 		vec3 N = normalize(normal);
 		float NdotL = max(0.0, dot(N, L));
-		vec3 diff = ubo.lights[i].color * albedo.rgb * NdotL * atten;
+		vec3 diff = light.color * albedo.rgb * NdotL * atten;
 
 		// Specular part
 		vec3 R = reflect(-L, N);
 		float NdotR = max(0.0, dot(R, V));
-		vec3 spec = ubo.lights[i].color * albedo.a * pow(NdotR, 8.0) * atten;
+		vec3 spec = light.color * albedo.a * pow(NdotR, 8.0) * atten;
 
 		result += diff + spec;	
 	}
@@ -88,16 +115,25 @@ void main()
 	vec4 alb = resolve(samplerAlbedo, UV);
 	vec3 fragColor = vec3(0.0);
 	
-	// Calualte lighting for every MSAA sample
-	for (int i = 0; i < NUM_SAMPLES; i++)
-	{ 
-		vec3 pos = texelFetch(samplerPosition, UV, i).rgb;
-		vec3 normal = texelFetch(samplerNormal, UV, i).rgb;
-		vec4 albedo = texelFetch(samplerAlbedo, UV, i);
-		fragColor += calculateLighting(pos, normal, albedo);
+	if (EDGES_ONLY && !isEdge(UV))
+	{
+		// One surface covers the whole pixel, so lighting it once with the resolved albedo is as good as every sample
+		vec3 pos = texelFetch(samplerPosition, UV, 0).rgb;
+		vec3 normal = texelFetch(samplerNormal, UV, 0).rgb;
+		fragColor = (alb.rgb * ambient) + calculateLighting(pos, normal, alb);
+	}
+	else
+	{
+		// Calualte lighting for every MSAA sample
+		for (int i = 0; i < NUM_SAMPLES; i++)
+		{ 
+			vec3 pos = texelFetch(samplerPosition, UV, i).rgb;
+			vec3 normal = texelFetch(samplerNormal, UV, i).rgb;
+			vec4 albedo = texelFetch(samplerAlbedo, UV, i);
+			fragColor += calculateLighting(pos, normal, albedo);
+		}
+		fragColor = (alb.rgb * ambient) + fragColor / float(NUM_SAMPLES);
 	}
-
-	fragColor = (alb.rgb * ambient) + fragColor / float(NUM_SAMPLES);
    
 	outFragcolor = vec4(fragColor, 1.0);	
 }
\ No newline at end of file
@@ -6,7 +6,25 @@
 layout (binding = 1) uniform sampler2D samplerPosition;
 layout (binding = 2) uniform sampler2D samplerNormal;
 layout (binding = 3) uniform sampler2D samplerAlbedo;
-layout (binding = 5) uniform sampler2DArray samplerDepth;
+layout (binding = 5) uniform sampler2D samplerDepth;
+
+#define LIGHT_COUNT 3
+
+struct Light 
+{
+	vec4 position;
+	vec4 target;
+	vec4 color;
+	mat4 viewMatrix;
+	vec4 atlasRect;
+};
+
+layout (binding = 4) uniform UBO 
+{
+	vec4 viewPos;
+	Light lights[LIGHT_COUNT];
+	int useShadows;
+} ubo;
 
 layout (location = 0) in vec3 inUV;
 
@@ -23,7 +41,8 @@ float LinearizeDepth(float depth)
 void main() 
 {
 	// Display depth from light's point-of-view 
-	// inUV.w = number of light source
-	float depth = texture(samplerDepth, vec3(inUV)).r;
+	// inUV.z = number of light source, whose tile of the atlas is shown
+	vec4 rect = ubo.lights[int(inUV.z)].atlasRect;
+	float depth = texture(samplerDepth, inUV.st * rect.xy + rect.zw).r;
 	outFragColor = vec4(vec3(1.0 - LinearizeDepth(depth)), 0.0);
 }
\ No newline at end of file
@@ -0,0 +1,207 @@
+// Composition of the G-buffer, see deferred.frag and deferred_rayquery.frag
+
+layout (binding = 1) uniform sampler2D samplerposition;
+layout (binding = 2) uniform sampler2D samplerNormal;
+layout (binding = 3) uniform sampler2D samplerAlbedo;
+// Depth from the light's point of view, each light in its tile of the atlas
+//layout (binding = 5) uniform sampler2DShadow samplerShadowMap;
+layout (binding = 5) uniform sampler2D samplerShadowMap;
+
+#ifdef RAY_QUERY_SHADOWS
+// The static scene, in place of the shadow map
+layout (binding = 9) uniform accelerationStructureEXT topLevelAS;
+#endif
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragColor;
+
+#define LIGHT_COUNT 3
+#define SHADOW_FACTOR 0.25
+#define AMBIENT_LIGHT 0.1
+#define USE_PCF
+
+struct Light 
+{
+	vec4 position;
+	vec4 target;
+	vec4 color;
+	mat4 viewMatrix;
+	// Scale in xy and offset in zw to the light's tile of the atlas
+	vec4 atlasRect;
+};
+
+layout (binding = 4) uniform UBO 
+{
+	vec4 viewPos;
+	Light lights[LIGHT_COUNT];
+	int useShadows;
+} ubo;
+
+struct PointLight
+{
+	vec4 position; // w = radius
+	vec4 color;
+};
+
+layout (binding = 6) readonly buffer PointLights { PointLight pointLights[]; };
+
+#define CLUSTER_UNIFORM_BINDING 7
+#define CLUSTER_GRID_BINDING 8
+#include "../base/clusters.glsl"
+
+#ifdef RAY_QUERY_SHADOWS
+// Whether anything is between the fragment and the light.  Unlike the shadow maps this isn't limited to the light's
+// frustum, and there's no filtering to soften the edges.
+float traceShadow(vec3 fragPos, vec3 N, vec3 lightPos)
+{
+	// Offset along the normal so that the ray doesn't hit the surface it starts on
+	vec3 origin = fragPos + N * 0.01;
+	vec3 L = lightPos - origin;
+	float dist = length(L);
+	rayQueryEXT rayQuery;
+	rayQueryInitializeEXT(rayQuery, topLevelAS, gl_RayFlagsOpaqueEXT | gl_RayFlagsTerminateOnFirstHitEXT, 0xFF, origin, 0.0, L / dist, dist);
+	while (rayQueryProceedEXT(rayQuery))
+	{
+	}
+	return rayQueryGetIntersectionTypeEXT(rayQuery, true) != gl_RayQueryCommittedIntersectionNoneEXT ? SHADOW_FACTOR : 1.0;
+}
+#endif
+
+float textureProj(vec4 P, int light, vec2 offset)
+{
+	float shadow = 1.0;
+	vec4 shadowCoord = P / P.w;
+	shadowCoord.st = shadowCoord.st * 0.5 + 0.5;
+	
+	if (shadowCoord.z > -1.0 && shadowCoord.z < 1.0) 
+	{
+		// Kept half a texel inside the tile, so that filtering doesn't reach into the neighbouring ones
+		vec4 rect = ubo.lights[light].atlasRect;
+		vec2 halfTexel = 0.5 / vec2(textureSize(samplerShadowMap, 0));
+		vec2 st = clamp((shadowCoord.st + offset) * rect.xy + rect.zw, rect.zw + halfTexel, rect.zw + rect.xy - halfTexel);
+		float dist = texture(samplerShadowMap, st).r;
+		if (shadowCoord.w > 0.0 && dist < shadowCoord.z) 
+		{
+			shadow = SHADOW_FACTOR;
+		}
+	}
+	return shadow;
+}
+
+float filterPCF(vec4 sc, int light)
+{
+	// The size of a texel of the atlas within the light's tile
+	vec2 texDim = vec2(textureSize(samplerShadowMap, 0)) * ubo.lights[light].atlasRect.xy;
+	float scale = 1.5;
+	float dx = scale * 1.0 / float(texDim.x);
+	float dy = scale * 1.0 / float(texDim.y);
+
+	float shadowFactor = 0.0;
+	int count = 0;
+	int range = 1;
+	
+	for (int x = -range; x <= range; x++)
+	{
+		for (int y = -range; y <= range; y++)
+		{
+			shadowFactor += textureProj(sc, light, vec2(dx*x, dy*y));
+			count++;
+		}
+	
+	}
+	return shadowFactor / count;
+}
+
+void main() 
+{
+	// Get G-Buffer values
+	vec3 fragPos = texture(samplerposition, inUV).rgb;
+	vec3 normal = texture(samplerNormal, inUV).rgb;
+	vec4 albedo = texture(samplerAlbedo, inUV);
+
+	// Ambient part
+	vec3 fragcolor  = albedo.rgb * AMBIENT_LIGHT;
+
+	vec3 N = normalize(normal);
+		
+	float shadow = 0.0;
+
+	for(int i = 0; i < LIGHT_COUNT; ++i)
+	{
+		// Vector to light
+		vec3 L = ubo.lights[i].position.xyz - fragPos;
+		// Distance from light to fragment position
+		float dist = length(L);
+		L = normalize(L);
+
+		// Viewer to fragment
+		vec3 V = ubo.viewPos.xyz - fragPos;
+		V = normalize(V);
+
+		float lightCosInnerAngle = cos(radians(15.0));
+		float lightCosOuterAngle = cos(radians(25.0));
+		float lightRange = 100.0;
+
+		// Direction vector from source to target
+		vec3 dir = normalize(ubo.lights[i].position.xyz - ubo.lights[i].target.xyz);
+
+		// Dual cone spot light with smooth transition between inner and outer angle
+		float cosDir = dot(L, dir);
+		float spotEffect = smoothstep(lightCosOuterAngle, lightCosInnerAngle, cosDir);
+		float heightAttenuation = smoothstep(lightRange, 0.0f, dist);
+
+		// Diffuse lighting
+		float NdotL = max(0.0, dot(N, L));
+		vec3 diff = vec3(NdotL);
+
+		// Specular lighting
+		vec3 R = reflect(-L, N);
+		float NdotR = max(0.0, dot(R, V));
+		vec3 spec = vec3(pow(NdotR, 16.0) * albedo.a * 2.5);
+
+		fragcolor += vec3((diff + spec) * spotEffect * heightAttenuation) * ubo.lights[i].color.rgb * albedo.rgb;
+	}    	
+
+	// Shadow calculations in a separate pass
+	if (ubo.useShadows > 0)
+	{
+		for(int i = 0; i < LIGHT_COUNT; ++i)
+		{
+			float shadowFactor;
+			#ifdef RAY_QUERY_SHADOWS
+				shadowFactor = traceShadow(fragPos, N, ubo.lights[i].position.xyz);
+			#else
+			vec4 shadowClip	= ubo.lights[i].viewMatrix * vec4(fragPos, 1.0);
+
+			#ifdef USE_PCF
+				shadowFactor= filterPCF(shadowClip, i);
+			#else
+				shadowFactor = textureProj(shadowClip, i, vec2(0.0));
+			#endif
+			#endif
+
+			fragcolor *= shadowFactor;
+		}
+	}
+
+	// Unshadowed point lights, only the ones binned into the fragment's cluster can reach it
+	uint cluster = clusterIndex(fragPos);
+	uint pointLightCount = clusterLightCount(cluster);
+	for (uint i = 0; i < pointLightCount; ++i)
+	{
+		PointLight light = pointLights[clusterLight(cluster, i)];
+		vec3 L = light.position.xyz - fragPos;
+		float dist = length(L);
+		L = normalize(L);
+		// Smooth falloff reaching zero at the radius
+		float falloff = clamp(1.0 - dist / light.position.w, 0.0, 1.0);
+		vec3 V = normalize(ubo.viewPos.xyz - fragPos);
+		vec3 R = reflect(-L, N);
+		float diff = max(0.0, dot(N, L));
+		float spec = pow(max(0.0, dot(R, V)), 16.0) * albedo.a;
+		fragcolor += (diff + spec) * falloff * falloff * light.color.rgb * albedo.rgb;
+	}
+
+	outFragColor.rgb = fragcolor;
+}
\ No newline at end of file
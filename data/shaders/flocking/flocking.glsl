@@ -0,0 +1,88 @@
+// Declarations shared by the flocking compute shaders, see ComputeFlocking in flocking.cpp for the passes.
+// Boids live in a periodic box of gridDim^3 cells whose edge is the neighbourhood radius, so every boid's
+// neighbours are in the 27 cells around its own.  Every frame the boids are counting sorted by cell into
+// sortedBoids, and the update reads them from there and writes boidsOut in the same, sorted, order.
+
+struct Boid
+{
+	vec4 pos;	// xyz = position in [0, gridDim * cellSize)
+	vec4 vel;	// xyz = velocity
+};
+
+layout (local_size_x_id = 0) in;
+
+layout (binding = 0) uniform UBO
+{
+	float deltaT;
+	uint boidCount;
+	uint gridDim;
+	float cellSize;
+	float separation;
+	float alignment;
+	float cohesion;
+	float minSpeed;
+	float maxSpeed;
+} ubo;
+
+layout (std430, binding = 1) readonly buffer BoidsIn
+{
+	Boid boidsIn[ ];
+};
+
+layout (std430, binding = 2) writeonly buffer BoidsOut
+{
+	Boid boidsOut[ ];
+};
+
+layout (std430, binding = 3) buffer SortedBoids
+{
+	Boid sortedBoids[ ];
+};
+
+// Boids per cell
+layout (std430, binding = 4) buffer CellCounts
+{
+	uint cellCounts[ ];
+};
+
+// Exclusive prefix sum of cellCounts within each workgroup sized block of cells
+layout (std430, binding = 5) buffer CellStarts
+{
+	uint cellStarts[ ];
+};
+
+// Per boid of boidsIn its cell and its rank among the boids of the cell
+layout (std430, binding = 6) buffer BoidCells
+{
+	uvec2 boidCells[ ];
+};
+
+// Totals of the blocks of cellStarts, turned into the blocks' offsets by scan_groups
+layout (std430, binding = 7) buffer BlockSums
+{
+	uint blockSums[ ];
+};
+
+uint cellCount()
+{
+	return ubo.gridDim * ubo.gridDim * ubo.gridDim;
+}
+
+ivec3 cellOf(vec3 pos)
+{
+	return clamp(ivec3(floor(pos / ubo.cellSize)), ivec3(0), ivec3(ubo.gridDim - 1));
+}
+
+// Wraps around the edges of the box
+uint cellIndex(ivec3 cell)
+{
+	int dim = int(ubo.gridDim);
+	uvec3 wrapped = uvec3((cell + dim) % dim);
+	return wrapped.x + ubo.gridDim * (wrapped.y + ubo.gridDim * wrapped.z);
+}
+
+// Index of the first boid of `cell` in sortedBoids, once scan_groups has run
+uint cellStart(uint cell)
+{
+	return blockSums[cell / gl_WorkGroupSize.x] + cellStarts[cell];
+}
@@ -3,10 +3,17 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
+// Lines generated by base/normallines.comp, the base of each line red and its tip blue
+
 layout (location = 0) in vec3 inPos;
-layout (location = 1) in vec3 inNormal;
 
-layout (location = 0) out vec3 outNormal;
+layout (set = 0, binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 model;
+} ubo;
+
+layout (location = 0) out vec3 outColor;
 
 out gl_PerVertex
 {
@@ -15,6 +22,6 @@ out gl_PerVertex
 
 void main(void)
 {
-	outNormal = inNormal;
-	gl_Position = vec4(inPos.xyz, 1.0);
-}
\ No newline at end of file
+	outColor = (gl_VertexIndex & 1) == 0 ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 0.0, 1.0);
+	gl_Position = ubo.projection * (ubo.model * vec4(inPos, 1.0));
+}
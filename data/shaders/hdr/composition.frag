@@ -5,6 +5,11 @@
 
 layout (binding = 0) uniform sampler2D samplerColor0;
 layout (binding = 1) uniform sampler2D samplerColor1;
+// The bright pass target, which then holds the whole scene too
+layout (binding = 2) uniform sampler2D samplerBright;
+
+// Show the difference between the two offscreen targets, that is what the format of the second loses
+layout (constant_id = 0) const int formatError = 0;
 
 layout (location = 0) in vec2 inUV;
 
@@ -12,5 +17,11 @@ layout (location = 0) out vec4 outColor;
 
 void main() 
 {
-	outColor = texture(samplerColor0, inUV);
+	// Alpha holds the linear luminance for the exposure histogram
+	vec3 color = texture(samplerColor0, inUV).rgb;
+	if (formatError == 1)
+	{
+		color = abs(texture(samplerBright, inUV).rgb - color) * 64.0;
+	}
+	outColor = vec4(color, 1.0);
 }
\ No newline at end of file
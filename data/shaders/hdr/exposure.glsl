@@ -0,0 +1,14 @@
+// Luminance histogram and the exposure adapted from it, written by histogram.comp and exposure.comp and read by the
+// tonemapping in gbuffer.frag, so the exposure never leaves the GPU.  Must match VulkanExample::ExposureState.
+//
+// Bin 0 counts the pixels too dark to matter, the other bins split log2 luminance between minLogLuminance and
+// minLogLuminance + logLuminanceRange evenly.
+
+#define HISTOGRAM_BINS 256
+
+layout (binding = EXPOSURE_BINDING) EXPOSURE_QUALIFIER buffer ExposureState
+{
+	float exposure;
+	float averageLuminance;
+	uint histogram[HISTOGRAM_BINS];
+} exposureState;
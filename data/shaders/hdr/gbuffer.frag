@@ -2,6 +2,7 @@
 
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
+#extension GL_GOOGLE_include_directive : require
 
 layout (binding = 1) uniform samplerCube samplerEnvMap;
 
@@ -22,8 +23,14 @@ layout (constant_id = 0) const int type = 0;
 
 layout (binding = 2) uniform UBO {
 	float exposure;
+	int autoExposure;
+	int formatError;
 } ubo;
 
+#define EXPOSURE_BINDING 3
+#define EXPOSURE_QUALIFIER readonly
+#include "exposure.glsl"
+
 void main() 
 {
 	vec4 color;
@@ -83,12 +90,14 @@ void main()
 	}
 
 
-	// Color with manual exposure into attachment 0
-	outColor0.rgb = vec3(1.0) - exp(-color.rgb * ubo.exposure);
+	// Color with manual or adapted exposure into attachment 0, and the linear luminance histogram.comp bins
+	float exposure = ubo.autoExposure == 1 ? exposureState.exposure : ubo.exposure;
+	outColor0.rgb = vec3(1.0) - exp(-color.rgb * exposure);
+	outColor0.a = dot(color.rgb, vec3(0.2126, 0.7152, 0.0722));
 
 	// Bright parts for bloom into attachment 1
 	float l = dot(outColor0.rgb, vec3(0.2126, 0.7152, 0.0722));
 	float threshold = 0.75;
-	outColor1.rgb = (l > threshold) ? outColor0.rgb : vec3(0.0);
+	outColor1.rgb = (l > threshold || ubo.formatError == 1) ? outColor0.rgb : vec3(0.0);
 	outColor1.a = 1.0;
 }
\ No newline at end of file
@@ -0,0 +1,45 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Vertex attributes
+layout (location = 0) in vec4 inPos;
+layout (location = 1) in vec3 inColor;
+layout (location = 2) in vec3 inNormal;
+
+// Instanced attributes, animated by shapes.comp
+layout (location = 3) in vec4 instanceRotation;
+layout (location = 4) in vec4 instanceOffset;
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 view;
+	float time;
+} ubo;
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec3 outEyePos;
+layout (location = 3) out vec3 outLightVec;
+
+vec3 rotate_vertex_position(vec3 v, vec4 q)
+{ 
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main() 
+{
+	outColor = inColor;
+	outNormal = rotate_vertex_position(inNormal, instanceRotation);
+
+	vec3 v = rotate_vertex_position(inPos.xyz, instanceRotation) * instanceOffset.w;
+	vec4 pos = vec4(v + instanceOffset.xyz, 1.0);
+	outEyePos = vec3(ubo.view * pos);
+	
+	gl_Position = ubo.projection * ubo.view * pos;
+	
+	vec4 lightPos = vec4(0.0, 0.0, 0.0, 1.0) * ubo.view;
+	outLightVec = normalize(lightPos.xyz - outEyePos);
+}
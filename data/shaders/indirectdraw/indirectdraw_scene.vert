@@ -0,0 +1,97 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_GOOGLE_include_directive : require
+
+// Vertex attributes, from the scene's merged geometry
+layout (location = 0) in vec4 inPos;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec2 inUV;
+layout (location = 3) in vec3 inColor;
+
+// Same layout as the instances written by generate.comp
+struct SceneInstance
+{
+	float posX, posY, posZ;
+	float rotX, rotY, rotZ;
+	float scale;
+	uint texIndex;
+};
+
+#include "../base/scene.glsl"
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 modelview;
+} ubo;
+
+layout (push_constant) uniform PushConstants
+{
+	SceneTable table;
+} push;
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec3 outUV;
+layout (location = 3) out vec3 outViewVec;
+layout (location = 4) out vec3 outLightVec;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+void main() 
+{
+	// The instance the culling appended to this draw
+	SceneInstance instance = sceneInstance(push.table, gl_InstanceIndex);
+	vec3 instancePos = vec3(instance.posX, instance.posY, instance.posZ);
+	vec3 instanceRot = vec3(instance.rotX, instance.rotY, instance.rotZ);
+
+	outColor = inColor;
+	outUV = vec3(inUV, instance.texIndex);
+	outUV.t = 1.0 - outUV.t;
+
+	mat4 mx, my, mz;
+	
+	// rotate around x
+	float s = sin(instanceRot.x);
+	float c = cos(instanceRot.x);
+
+	mx[0] = vec4(c, s, 0.0, 0.0);
+	mx[1] = vec4(-s, c, 0.0, 0.0);
+	mx[2] = vec4(0.0, 0.0, 1.0, 0.0);
+	mx[3] = vec4(0.0, 0.0, 0.0, 1.0);	
+	
+	// rotate around y
+	s = sin(instanceRot.y);
+	c = cos(instanceRot.y);
+
+	my[0] = vec4(c, 0.0, s, 0.0);
+	my[1] = vec4(0.0, 1.0, 0.0, 0.0);
+	my[2] = vec4(-s, 0.0, c, 0.0);
+	my[3] = vec4(0.0, 0.0, 0.0, 1.0);	
+	
+	// rot around z
+	s = sin(instanceRot.z);
+	c = cos(instanceRot.z);	
+	
+	mz[0] = vec4(1.0, 0.0, 0.0, 0.0);
+	mz[1] = vec4(0.0, c, s, 0.0);
+	mz[2] = vec4(0.0, -s, c, 0.0);
+	mz[3] = vec4(0.0, 0.0, 0.0, 1.0);	
+	
+	mat4 rotMat = mz * my * mx;
+		
+	outNormal = inNormal * mat3(rotMat);
+	
+	vec4 pos = vec4((inPos.xyz * instance.scale) + instancePos, 1.0) * rotMat;
+
+	gl_Position = ubo.projection * ubo.modelview * pos;
+	
+	vec4 lPos = vec4(0.0, -5.0, 0.0, 1.0);
+	outLightVec = lPos.xyz - pos.xyz;
+	outViewVec = -pos.xyz;	
+}
@@ -0,0 +1,51 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : require
+
+#include "../base/impostor.glsl"
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 modelview;
+} ubo;
+
+layout (binding = 1) uniform sampler2DArray samplerArray;
+layout (binding = 2) uniform sampler2D albedoMap;
+layout (binding = 3) uniform sampler2D normalDepthMap;
+
+layout (location = 0) in vec2 inUV;
+layout (location = 1) flat in uint inTexIndex;
+layout (location = 2) flat in vec4 inRotation;
+layout (location = 3) in vec3 inViewPos;
+layout (location = 4) in vec3 inViewDepth;
+layout (location = 5) in vec3 inLightVec;
+
+layout (location = 0) out vec4 outFragColor;
+
+// Rotate v by the unit quaternion q
+vec3 rotate(vec4 q, vec3 v)
+{
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main() 
+{
+	vec3 albedo, normal;
+	float depthOffset;
+	if (!impostorSample(albedoMap, normalDepthMap, inUV, albedo, normal, depthOffset)) {
+		discard;
+	}
+	// Where the surface was in the view, so that impostors intersect each other and the rocks like the rocks would
+	vec4 clipPos = ubo.projection * vec4(inViewPos + inViewDepth * depthOffset, 1.0);
+	gl_FragDepth = clipPos.z / clipPos.w;
+
+	// The views only have the vertex colors, the layer's average texel stands in for its texture at this distance
+	float lastLevel = float(textureQueryLevels(samplerArray) - 1);
+	vec3 color = textureLod(samplerArray, vec3(0.5, 0.5, float(inTexIndex)), lastLevel).rgb * albedo;
+	// The diffuse part of instancing.frag, the highlights are too small to see
+	vec3 N = normalize(mat3(ubo.modelview) * rotate(inRotation, normal));
+	vec3 L = normalize(inLightVec);
+	vec3 diffuse = max(dot(N, L), 0.1) * albedo;
+	outFragColor = vec4(diffuse * color, 1.0);
+}
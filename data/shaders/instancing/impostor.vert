@@ -0,0 +1,66 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : require
+
+#include "../base/impostor.glsl"
+
+// The low detail rocks, one billboard per instance.  The vertices are only indices, see VulkanExample::impostorIndices
+
+// Instanced attributes, written by instances.comp
+layout (location = 4) in vec4 instancePosScale;
+layout (location = 5) in vec4 instanceRotation;
+layout (location = 6) in uint instanceTexIndex;
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 modelview;
+	vec4 lightPos;
+	vec4 frustumPlanes[6];
+	vec4 cameraPos;
+} ubo;
+
+layout (push_constant) uniform PushConsts
+{
+	vec4 sphere;
+	uint frames;
+} pushConsts;
+
+layout (location = 0) out vec2 outUV;
+layout (location = 1) flat out uint outTexIndex;
+layout (location = 2) flat out vec4 outRotation;
+layout (location = 3) out vec3 outViewPos;
+// From the billboard to the far side of the sphere, in view space
+layout (location = 4) out vec3 outViewDepth;
+layout (location = 5) out vec3 outLightVec;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+// Rotate v by the unit quaternion q
+vec3 rotate(vec4 q, vec3 v)
+{
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main() 
+{
+	vec4 rotation = normalize(instanceRotation);
+	float scale = instancePosScale.w;
+	// The camera in the rock's own space, which the views were taken in
+	vec4 inverseRotation = vec4(-rotation.xyz, rotation.w);
+	vec3 toCamera = rotate(inverseRotation, (ubo.cameraPos.xyz - instancePosScale.xyz) / scale) - pushConsts.sphere.xyz;
+	ImpostorVertex impostor = impostorVertex(pushConsts.sphere, pushConsts.frames, toCamera, gl_VertexIndex);
+	outUV = impostor.uv;
+	outTexIndex = instanceTexIndex;
+	outRotation = rotation;
+
+	// Placed like the vertices of the high detail rock
+	vec4 pos = ubo.modelview * vec4(rotate(rotation, impostor.position) * scale + instancePosScale.xyz, 1.0);
+	gl_Position = ubo.projection * pos;
+	outViewPos = pos.xyz;
+	outViewDepth = mat3(ubo.modelview) * rotate(rotation, -impostor.direction) * pushConsts.sphere.w * scale;
+	outLightVec = mat3(ubo.modelview) * ubo.lightPos.xyz - pos.xyz;
+}
@@ -9,19 +9,16 @@ layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inUV;
 layout (location = 3) in vec3 inColor;
 
-// Instanced attributes
-layout (location = 4) in vec3 instancePos;
-layout (location = 5) in vec3 instanceRot;
-layout (location = 6) in float instanceScale;
-layout (location = 7) in int instanceTexIndex;
+// Instanced attributes, written by instances.comp
+layout (location = 4) in vec4 instancePosScale;
+layout (location = 5) in vec4 instanceRotation;
+layout (location = 6) in uint instanceTexIndex;
 
 layout (binding = 0) uniform UBO 
 {
 	mat4 projection;
 	mat4 modelview;
 	vec4 lightPos;
-	float locSpeed;
-	float globSpeed;
 } ubo;
 
 layout (location = 0) out vec3 outNormal;
@@ -30,54 +27,25 @@ layout (location = 2) out vec3 outUV;
 layout (location = 3) out vec3 outViewVec;
 layout (location = 4) out vec3 outLightVec;
 
+// Rotate v by the unit quaternion q
+vec3 rotate(vec4 q, vec3 v)
+{
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
 void main() 
 {
 	outColor = inColor;
 	outUV = vec3(inUV, instanceTexIndex);
 
-	mat3 mx, my, mz;
-	
-	// rotate around x
-	float s = sin(instanceRot.x + ubo.locSpeed);
-	float c = cos(instanceRot.x + ubo.locSpeed);
-
-	mx[0] = vec3(c, s, 0.0);
-	mx[1] = vec3(-s, c, 0.0);
-	mx[2] = vec3(0.0, 0.0, 1.0);
-	
-	// rotate around y
-	s = sin(instanceRot.y + ubo.locSpeed);
-	c = cos(instanceRot.y + ubo.locSpeed);
-
-	my[0] = vec3(c, 0.0, s);
-	my[1] = vec3(0.0, 1.0, 0.0);
-	my[2] = vec3(-s, 0.0, c);
-	
-	// rot around z
-	s = sin(instanceRot.z + ubo.locSpeed);
-	c = cos(instanceRot.z + ubo.locSpeed);	
-	
-	mz[0] = vec3(1.0, 0.0, 0.0);
-	mz[1] = vec3(0.0, c, s);
-	mz[2] = vec3(0.0, -s, c);
-	
-	mat3 rotMat = mz * my * mx;
-
-	mat4 gRotMat;
-	s = sin(instanceRot.y + ubo.globSpeed);
-	c = cos(instanceRot.y + ubo.globSpeed);
-	gRotMat[0] = vec4(c, 0.0, s, 0.0);
-	gRotMat[1] = vec4(0.0, 1.0, 0.0, 0.0);
-	gRotMat[2] = vec4(-s, 0.0, c, 0.0);
-	gRotMat[3] = vec4(0.0, 0.0, 0.0, 1.0);	
-	
-	vec4 locPos = vec4(inPos.xyz * rotMat, 1.0);
-	vec4 pos = vec4((locPos.xyz * instanceScale) + instancePos, 1.0);
+	// The orientation is already animated and only lost precision in packing
+	vec4 rotation = normalize(instanceRotation);
+	vec4 pos = vec4(rotate(rotation, inPos) * instancePosScale.w + instancePosScale.xyz, 1.0);
 
-	gl_Position = ubo.projection * ubo.modelview * gRotMat * pos;
-	outNormal = mat3(ubo.modelview * gRotMat) * inverse(rotMat) * inNormal;
+	gl_Position = ubo.projection * ubo.modelview * pos;
+	outNormal = mat3(ubo.modelview) * rotate(rotation, inNormal);
 
-	pos = ubo.modelview * vec4(inPos.xyz + instancePos, 1.0);
+	pos = ubo.modelview * pos;
 	vec3 lPos = mat3(ubo.modelview) * ubo.lightPos.xyz;
 	outLightVec = lPos - pos.xyz;
 	outViewVec = -pos.xyz;		
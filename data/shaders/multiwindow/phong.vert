@@ -0,0 +1,37 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec3 inColor;
+
+// One per window, the model and pipeline are shared
+layout (binding = 0) uniform UBO
+{
+	mat4 projection;
+	mat4 modelView;
+	vec4 lightPos;
+	vec4 tint;
+} ubo;
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec3 outViewVec;
+layout (location = 3) out vec3 outLightVec;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+void main()
+{
+	outColor = inColor * ubo.tint.rgb;
+	vec4 pos = ubo.modelView * vec4(inPos, 1.0);
+	gl_Position = ubo.projection * pos;
+	outNormal = mat3(ubo.modelView) * inNormal;
+	outLightVec = mat3(ubo.modelView) * ubo.lightPos.xyz - pos.xyz;
+	outViewVec = -pos.xyz;
+}
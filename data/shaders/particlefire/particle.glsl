@@ -0,0 +1,78 @@
+// Shared by the particle simulation kernels, must match Particle and SimulationParams in particlefire.cpp
+
+#define PARTICLE_TYPE_FLAME 0
+#define PARTICLE_TYPE_SMOKE 1
+// Free slot, on the dead list
+#define PARTICLE_TYPE_DEAD 2
+
+#define FLAME_RADIUS 8.0
+#define PI 3.14159265358979
+
+// Scalars only, so the std430 layout is the tightly packed C++ struct
+struct Particle {
+	float posX, posY, posZ;
+	float colorR, colorG, colorB;
+	float alpha;
+	float size;
+	float rotation;
+	uint type;
+	float velX, velY, velZ;
+	float rotationSpeed;
+};
+
+layout (binding = 0) uniform SimulationParams {
+	mat4 modelview;
+	vec4 emitterPos;
+	vec4 minVel;
+	vec4 maxVel;
+	float frameTimer;
+	uint seed;
+	uint particleCount;
+	uint emitBudget;
+} params;
+
+layout (std430, binding = 1) buffer Particles { Particle particles[]; };
+
+// Indices of the free slots
+layout (std430, binding = 2) buffer DeadList {
+	uint deadCount;
+	uint deadIndices[];
+};
+
+struct SortKey {
+	// View space depth, +infinity for free slots so they sort last
+	float depth;
+	uint index;
+};
+layout (std430, binding = 3) buffer SortKeys { SortKey keys[]; };
+
+// What gets drawn: the live particles, packed to the front
+layout (std430, binding = 4) buffer RenderParticles { Particle renderParticles[]; };
+
+// VkDrawIndirectCommand of the particle draw
+layout (std430, binding = 5) buffer DrawCommand {
+	uint vertexCount;
+	uint instanceCount;
+	uint firstVertex;
+	uint firstInstance;
+};
+
+// PCG hash, good enough for decorrelating particles from one frame to the next
+uint hash(uint value)
+{
+	uint state = value * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+// [0, range]
+float rnd(inout uint state, float range)
+{
+	state = hash(state);
+	return range * (float(state) / 4294967295.0);
+}
+
+vec3 particlePos(Particle particle)
+{
+	return vec3(particle.posX, particle.posY, particle.posZ);
+}
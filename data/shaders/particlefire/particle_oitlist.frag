@@ -0,0 +1,19 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_GOOGLE_include_directive : require
+
+// Particles drawn in any order, through linked list order independent transparency
+
+#define OIT_LINKED_LIST
+#include "sprite.glsl"
+#include "../base/oit.glsl"
+
+void main () 
+{
+	vec4 color;
+	vec3 emission;
+	shadeParticle(color, emission);
+	oitOutput(color, emission);
+}
@@ -0,0 +1,38 @@
+// Shading of a particle sprite, shared by the blended and the order independent particle passes
+
+layout (binding = 1) uniform sampler2D samplerSmoke;
+layout (binding = 2) uniform sampler2D samplerFire;
+
+layout (location = 0) in vec4 inColor;
+layout (location = 1) in float inPointSize;
+layout (location = 2) in float inAlpha;
+layout (location = 3) in flat int inType;
+layout (location = 4) in float inRotation;
+
+// The premultiplied color of the smoke, and the light of the flames, which cover nothing
+void shadeParticle(out vec4 color, out vec3 emission)
+{
+	float alpha = (inAlpha <= 1.0) ? inAlpha : 2.0 - inAlpha;
+
+	// Rotate texture coordinates
+	float rotCenter = 0.5;
+	float rotCos = cos(inRotation);
+	float rotSin = sin(inRotation);
+	vec2 rotUV = vec2(
+		rotCos * (gl_PointCoord.x - rotCenter) + rotSin * (gl_PointCoord.y - rotCenter) + rotCenter,
+		rotCos * (gl_PointCoord.y - rotCenter) - rotSin * (gl_PointCoord.x - rotCenter) + rotCenter);
+
+	if (inType == 0)
+	{
+		// Flame
+		emission = texture(samplerFire, rotUV).rgb * inColor.rgb * alpha;
+		color = vec4(0.0);
+	}
+	else
+	{
+		// Smoke
+		vec4 smoke = texture(samplerSmoke, rotUV);
+		emission = vec3(0.0);
+		color = vec4(smoke.rgb * inColor.rgb * alpha, smoke.a * alpha);
+	}
+}
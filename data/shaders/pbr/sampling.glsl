@@ -1,8 +1,4 @@
-#version 450
-
-layout (location = 0) in vec2 inUV;
-layout (location = 0) out vec4 outColor;
-layout (constant_id = 0) const uint NUM_SAMPLES = 1024u;
+// Sampling functions shared by the compute shaders precomputing the image based lighting maps
 
 const float PI = 3.1415926536;
 
@@ -48,43 +44,19 @@ vec3 importanceSample_GGX(vec2 Xi, float roughness, vec3 normal)
 	return normalize(tangentX * H.x + tangentY * H.y + normal * H.z);
 }
 
-// Geometric Shadowing function
-float G_SchlicksmithGGX(float dotNL, float dotNV, float roughness)
+// Direction through the center of texel `texel` of face `face` of a cube map level `size` texels wide, following the
+// face orientations of the cube map sampling rules in the Vulkan specification
+vec3 cubeDirection(uvec2 texel, uint face, uint size)
 {
-	float k = (roughness * roughness) / 2.0;
-	float GL = dotNL / (dotNL * (1.0 - k) + k);
-	float GV = dotNV / (dotNV * (1.0 - k) + k);
-	return GL * GV;
-}
-
-vec2 BRDF(float NoV, float roughness)
-{
-	// Normal always points along z-axis for the 2D lookup 
-	const vec3 N = vec3(0.0, 0.0, 1.0);
-	vec3 V = vec3(sqrt(1.0 - NoV*NoV), 0.0, NoV);
-
-	vec2 LUT = vec2(0.0);
-	for(uint i = 0u; i < NUM_SAMPLES; i++) {
-		vec2 Xi = hammersley2d(i, NUM_SAMPLES);
-		vec3 H = importanceSample_GGX(Xi, roughness, N);
-		vec3 L = 2.0 * dot(V, H) * H - V;
-
-		float dotNL = max(dot(N, L), 0.0);
-		float dotNV = max(dot(N, V), 0.0);
-		float dotVH = max(dot(V, H), 0.0); 
-		float dotNH = max(dot(H, N), 0.0);
-
-		if (dotNL > 0.0) {
-			float G = G_SchlicksmithGGX(dotNL, dotNV, roughness);
-			float G_Vis = (G * dotVH) / (dotNH * dotNV);
-			float Fc = pow(1.0 - dotVH, 5.0);
-			LUT += vec2((1.0 - Fc) * G_Vis, Fc * G_Vis);
-		}
+	vec2 st = (vec2(texel) + 0.5) / float(size) * 2.0 - 1.0;
+	vec3 direction;
+	switch (face) {
+		case 0: direction = vec3(1.0, -st.y, -st.x); break;
+		case 1: direction = vec3(-1.0, -st.y, st.x); break;
+		case 2: direction = vec3(st.x, 1.0, st.y); break;
+		case 3: direction = vec3(st.x, -1.0, -st.y); break;
+		case 4: direction = vec3(st.x, -st.y, 1.0); break;
+		default: direction = vec3(-st.x, -st.y, -1.0); break;
 	}
-	return LUT / float(NUM_SAMPLES);
+	return normalize(direction);
 }
-
-void main() 
-{
-	outColor = vec4(BRDF(inUV.s, 1.0-inUV.t), 0.0, 1.0);
-}
\ No newline at end of file
@@ -0,0 +1,31 @@
+// Irradiance from the nine coefficients of the order 2 spherical harmonics, shared by the projection in
+// irradiancesh.comp and the shaders evaluating it
+//
+// The coefficients are in the order of shBasis below, and already scaled by the clamped cosine lobe of their band
+// over pi, so that evaluating them gives E / pi like the irradiance cube does.
+// See https://cseweb.ucsd.edu/~ravir/papers/envmap/envmap.pdf
+
+void shBasis(vec3 n, out float basis[9])
+{
+	basis[0] = 0.282095;
+	basis[1] = 0.488603 * n.y;
+	basis[2] = 0.488603 * n.z;
+	basis[3] = 0.488603 * n.x;
+	basis[4] = 1.092548 * n.x * n.y;
+	basis[5] = 1.092548 * n.y * n.z;
+	basis[6] = 0.315392 * (3.0 * n.z * n.z - 1.0);
+	basis[7] = 1.092548 * n.x * n.z;
+	basis[8] = 0.546274 * (n.x * n.x - n.y * n.y);
+}
+
+vec3 shIrradiance(vec4 coefficients[9], vec3 n)
+{
+	float basis[9];
+	shBasis(n, basis);
+	vec3 result = vec3(0.0);
+	for (int i = 0; i < 9; i++) {
+		result += coefficients[i].rgb * basis[i];
+	}
+	// The truncated series rings slightly below zero opposite very bright lights
+	return max(result, vec3(0.0));
+}
@@ -1,5 +1,9 @@
 #version 450
 
+#extension GL_GOOGLE_include_directive : require
+
+#include "../pbr/sh.glsl"
+
 layout (location = 0) in vec3 inWorldPos;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inUV;
@@ -15,6 +19,7 @@ layout (binding = 1) uniform UBOParams {
 	vec4 lights[4];
 	float exposure;
 	float gamma;
+	int irradianceFromSH;
 } uboParams;
 
 layout(push_constant) uniform PushConsts {
@@ -29,9 +34,15 @@ layout(push_constant) uniform PushConsts {
 layout (binding = 2) uniform samplerCube samplerIrradiance;
 layout (binding = 3) uniform sampler2D samplerBRDFLUT;
 layout (binding = 4) uniform samplerCube prefilteredMap;
+layout (binding = 5) uniform IrradianceSH {
+	vec4 coefficients[9];
+} irradianceSH;
 
 layout (location = 0) out vec4 outColor;
 
+// Reflection probe faces stay linear, they are tone mapped where they are reflected
+layout (constant_id = 0) const bool LINEAR_OUTPUT = false;
+
 #define PI 3.1415926535897932384626433832795
 #define ALBEDO vec3(material.r, material.g, material.b)
 
@@ -78,8 +89,9 @@ vec3 F_SchlickR(float cosTheta, vec3 F0, float roughness)
 
 vec3 prefilteredReflection(vec3 R, float roughness)
 {
-	const float MAX_REFLECTION_LOD = 9.0; // todo: param/const
-	float lod = roughness * MAX_REFLECTION_LOD;
+	// The static cube and the reflection probe have different sizes
+	float maxReflectionLod = float(textureQueryLevels(prefilteredMap) - 1);
+	float lod = roughness * maxReflectionLod;
 	float lodf = floor(lod);
 	float lodc = ceil(lod);
 	vec3 a = textureLod(prefilteredMap, R, lodf).rgb;
@@ -135,7 +147,7 @@ void main()
 	
 	vec2 brdf = texture(samplerBRDFLUT, vec2(max(dot(N, V), 0.0), roughness)).rg;
 	vec3 reflection = prefilteredReflection(R, roughness).rgb;	
-	vec3 irradiance = texture(samplerIrradiance, N).rgb;
+	vec3 irradiance = uboParams.irradianceFromSH != 0 ? shIrradiance(irradianceSH.coefficients, N) : texture(samplerIrradiance, N).rgb;
 
 	// Diffuse based on irradiance
 	vec3 diffuse = irradiance * ALBEDO;	
@@ -152,11 +164,13 @@ void main()
 	
 	vec3 color = ambient + Lo;
 
-	// Tone mapping
-	color = Uncharted2Tonemap(color * uboParams.exposure);
-	color = color * (1.0f / Uncharted2Tonemap(vec3(11.2f)));	
-	// Gamma correction
-	color = pow(color, vec3(1.0f / uboParams.gamma));
+	if (!LINEAR_OUTPUT) {
+		// Tone mapping
+		color = Uncharted2Tonemap(color * uboParams.exposure);
+		color = color * (1.0f / Uncharted2Tonemap(vec3(11.2f)));
+		// Gamma correction
+		color = pow(color, vec3(1.0f / uboParams.gamma));
+	}
 
 	outColor = vec4(color, 1.0);
 }
\ No newline at end of file
@@ -6,6 +6,9 @@ layout (location = 0) in vec3 inUVW;
 
 layout (location = 0) out vec4 outColor;
 
+// Reflection probe faces stay linear, they are tone mapped where they are reflected
+layout (constant_id = 0) const bool LINEAR_OUTPUT = false;
+
 layout (binding = 1) uniform UBOParams {
 	vec4 lights[4];
 	float exposure;
@@ -29,11 +32,13 @@ void main()
 {
 	vec3 color = texture(samplerEnv, inUVW).rgb;
 
-	// Tone mapping
-	color = Uncharted2Tonemap(color * uboParams.exposure);
-	color = color * (1.0f / Uncharted2Tonemap(vec3(11.2f)));	
-	// Gamma correction
-	color = pow(color, vec3(1.0f / uboParams.gamma));
+	if (!LINEAR_OUTPUT) {
+		// Tone mapping
+		color = Uncharted2Tonemap(color * uboParams.exposure);
+		color = color * (1.0f / Uncharted2Tonemap(vec3(11.2f)));
+		// Gamma correction
+		color = pow(color, vec3(1.0f / uboParams.gamma));
+	}
 	
 	outColor = vec4(color, 1.0);
 }
\ No newline at end of file
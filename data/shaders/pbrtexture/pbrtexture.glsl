@@ -0,0 +1,195 @@
+// Textured metal/roughness shading shared by the material layouts.  Define the samplers of the material's normal,
+// ambient occlusion, roughness and metallic maps, at bindings 6 to 9, and these functions before including this:
+//
+//   vec3 sampleTangentNormal(vec2 uv)  the tangent space normal at uv
+//   vec3 sampleORM(vec2 uv)            ambient occlusion, roughness and metallic at uv
+//
+// The shading is in the types of ../base/precision.glsl, which the stub includes first.  The inputs, reflection lookups
+// and the normal's derivatives stay 32 bit.
+
+#include "../pbr/sh.glsl"
+
+layout (location = 0) in vec3 inWorldPos;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec2 inUV;
+
+layout (binding = 0) uniform UBO {
+	mat4 projection;
+	mat4 model;
+	mat4 view;
+	vec3 camPos;
+} ubo;
+
+layout (binding = 1) uniform UBOParams {
+	vec4 lights[4];
+	float exposure;
+	float gamma;
+	int irradianceFromSH;
+} uboParams;
+
+layout (binding = 2) uniform samplerCube samplerIrradiance;
+layout (binding = 3) uniform sampler2D samplerBRDFLUT;
+layout (binding = 4) uniform samplerCube prefilteredMap;
+
+layout (binding = 5) uniform sampler2D albedoMap;
+
+layout (binding = 10) uniform IrradianceSH {
+	vec4 coefficients[9];
+} irradianceSH;
+
+layout (location = 0) out vec4 outColor;
+
+#define PI 3.1415926535897932384626433832795
+#define ALBEDO mvec3(pow(texture(albedoMap, inUV).rgb, vec3(2.2)))
+
+// From http://filmicgames.com/archives/75
+mvec3 Uncharted2Tonemap(mvec3 x)
+{
+	mfloat A = mfloat(0.15);
+	mfloat B = mfloat(0.50);
+	mfloat C = mfloat(0.10);
+	mfloat D = mfloat(0.20);
+	mfloat E = mfloat(0.02);
+	mfloat F = mfloat(0.30);
+	// Far into the shoulder, where the curve is flat, and small enough that x * A * x can't overflow 16 bits
+	x = min(x, mvec3(mfloat(512.0)));
+	return ((x*(A*x+C*B)+D*E)/(x*(A*x+B)+D*F))-E/F;
+}
+
+// Normal Distribution function --------------------------------------
+// 1 - dotNH * dotNH written as the squared length of cross(N, H), which doesn't cancel out to 0 in 16 bits for
+// highlights of smooth surfaces
+mfloat D_GGX(mvec3 N, mvec3 H, mfloat dotNH, mfloat roughness)
+{
+	mfloat alpha = roughness * roughness;
+	mvec3 NxH = cross(N, H);
+	mfloat a = dotNH * alpha;
+	mfloat k = alpha / (dot(NxH, NxH) + a * a);
+	return min(k * k * mfloat(1.0 / PI), mfloat(MFLOAT_MAX));
+}
+
+// Geometric Shadowing function --------------------------------------
+mfloat G_SchlicksmithGGX(mfloat dotNL, mfloat dotNV, mfloat roughness)
+{
+	mfloat r = (roughness + mfloat(1.0));
+	mfloat k = (r*r) / mfloat(8.0);
+	mfloat GL = dotNL / (dotNL * (mfloat(1.0) - k) + k);
+	mfloat GV = dotNV / (dotNV * (mfloat(1.0) - k) + k);
+	return GL * GV;
+}
+
+// Fresnel function ----------------------------------------------------
+mvec3 F_Schlick(mfloat cosTheta, mvec3 F0)
+{
+	return F0 + (mfloat(1.0) - F0) * pow(mfloat(1.0) - cosTheta, mfloat(5.0));
+}
+mvec3 F_SchlickR(mfloat cosTheta, mvec3 F0, mfloat roughness)
+{
+	return F0 + (max(mvec3(mfloat(1.0) - roughness), F0) - F0) * pow(mfloat(1.0) - cosTheta, mfloat(5.0));
+}
+
+vec3 prefilteredReflection(vec3 R, float roughness)
+{
+	const float MAX_REFLECTION_LOD = 9.0; // todo: param/const
+	float lod = roughness * MAX_REFLECTION_LOD;
+	float lodf = floor(lod);
+	float lodc = ceil(lod);
+	vec3 a = textureLod(prefilteredMap, R, lodf).rgb;
+	vec3 b = textureLod(prefilteredMap, R, lodc).rgb;
+	return mix(a, b, lod - lodf);
+}
+
+mvec3 specularContribution(vec3 L, vec3 V, vec3 N, mvec3 F0, mfloat metallic, mfloat roughness)
+{
+	// Precalculate vectors and dot products	
+	mvec3 H = mvec3(normalize (V + L));
+	mvec3 halfN = mvec3(N);
+	mfloat dotNH = clamp(dot(halfN, H), mfloat(0.0), mfloat(1.0));
+	mfloat dotNV = mfloat(clamp(dot(N, V), 0.0, 1.0));
+	mfloat dotNL = mfloat(clamp(dot(N, L), 0.0, 1.0));
+
+	// Light color fixed
+	mvec3 lightColor = mvec3(mfloat(1.0));
+
+	mvec3 color = mvec3(mfloat(0.0));
+
+	if (dotNL > mfloat(0.0)) {
+		// D = Normal distribution (Distribution of the microfacets)
+		mfloat D = D_GGX(halfN, H, dotNH, roughness); 
+		// G = Geometric shadowing term (Microfacets shadowing)
+		mfloat G = G_SchlicksmithGGX(dotNL, dotNV, roughness);
+		// F = Fresnel factor (Reflectance depending on angle of incidence)
+		mvec3 F = F_Schlick(dotNV, F0);		
+		mvec3 spec = min(D * F * G / (mfloat(4.0) * dotNL * dotNV + mfloat(0.001)), mvec3(mfloat(MFLOAT_MAX)));
+		mvec3 kD = (mvec3(mfloat(1.0)) - F) * (mfloat(1.0) - metallic);			
+		color += (kD * ALBEDO / mfloat(PI) + spec) * dotNL;
+	}
+
+	return color;
+}
+
+// See http://www.thetenthplanet.de/archives/1180
+vec3 perturbNormal()
+{
+	vec3 tangentNormal = sampleTangentNormal(inUV);
+
+	vec3 q1 = dFdx(inWorldPos);
+	vec3 q2 = dFdy(inWorldPos);
+	vec2 st1 = dFdx(inUV);
+	vec2 st2 = dFdy(inUV);
+
+	vec3 N = normalize(inNormal);
+	vec3 T = normalize(q1 * st2.t - q2 * st1.t);
+	vec3 B = -normalize(cross(N, T));
+	mat3 TBN = mat3(T, B, N);
+
+	return normalize(TBN * tangentNormal);
+}
+
+void main()
+{		
+	vec3 N = perturbNormal();
+	vec3 V = normalize(ubo.camPos - inWorldPos);
+	vec3 R = reflect(-V, N); 
+
+	vec3 orm = sampleORM(inUV);
+	mfloat metallic = mfloat(orm.b);
+	mfloat roughness = mfloat(orm.g);
+
+	mvec3 F0 = mvec3(mfloat(0.04)); 
+	F0 = mix(F0, ALBEDO, metallic);
+
+	mvec3 Lo = mvec3(mfloat(0.0));
+	for(int i = 0; i < uboParams.lights[i].length(); i++) {
+		vec3 L = normalize(uboParams.lights[i].xyz - inWorldPos);
+		Lo += specularContribution(L, V, N, F0, metallic, roughness);
+	}   
+	
+	mfloat dotNV = mfloat(max(dot(N, V), 0.0));
+	vec2 brdf = texture(samplerBRDFLUT, vec2(dotNV, roughness)).rg;
+	mvec3 reflection = narrowColor(prefilteredReflection(R, roughness).rgb);	
+	mvec3 irradiance = narrowColor(uboParams.irradianceFromSH != 0 ? shIrradiance(irradianceSH.coefficients, N) : texture(samplerIrradiance, N).rgb);
+
+	// Diffuse based on irradiance
+	mvec3 diffuse = irradiance * ALBEDO;	
+
+	mvec3 F = F_SchlickR(dotNV, F0, roughness);
+
+	// Specular reflectance
+	mvec3 specular = reflection * (F * mfloat(brdf.x) + mfloat(brdf.y));
+
+	// Ambient part
+	mvec3 kD = mfloat(1.0) - F;
+	kD *= mfloat(1.0) - metallic;	  
+	mvec3 ambient = (kD * diffuse + specular) * mfloat(orm.r);
+	
+	mvec3 color = ambient + Lo;
+
+	// Tone mapping
+	color = Uncharted2Tonemap(color * mfloat(uboParams.exposure));
+	color = color * (mfloat(1.0) / Uncharted2Tonemap(mvec3(mfloat(11.2))));	
+	// Gamma correction
+	color = pow(color, mvec3(mfloat(1.0) / mfloat(uboParams.gamma)));
+
+	outColor = vec4(color, 1.0);
+}
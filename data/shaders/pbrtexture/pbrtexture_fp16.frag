@@ -0,0 +1,24 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : require
+
+#define HALF_PRECISION
+#include "../base/precision.glsl"
+
+// Every map in a texture of its own
+layout (binding = 6) uniform sampler2D normalMap;
+layout (binding = 7) uniform sampler2D aoMap;
+layout (binding = 8) uniform sampler2D metallicMap;
+layout (binding = 9) uniform sampler2D roughnessMap;
+
+vec3 sampleTangentNormal(vec2 uv)
+{
+	return texture(normalMap, uv).xyz * 2.0 - 1.0;
+}
+
+vec3 sampleORM(vec2 uv)
+{
+	return vec3(texture(aoMap, uv).r, texture(roughnessMap, uv).r, texture(metallicMap, uv).r);
+}
+
+#include "pbrtexture.glsl"
@@ -0,0 +1,24 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : require
+
+#define HALF_PRECISION
+#include "../base/precision.glsl"
+
+// The maps packed by tools/vkmaterial: ambient occlusion, roughness and metallic in the channels of one texture, and
+// only x and y of the normals, in BC5
+layout (binding = 6) uniform sampler2D normalMap;
+layout (binding = 7) uniform sampler2D ormMap;
+
+vec3 sampleTangentNormal(vec2 uv)
+{
+	vec2 xy = texture(normalMap, uv).rg * 2.0 - 1.0;
+	return vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+}
+
+vec3 sampleORM(vec2 uv)
+{
+	return texture(ormMap, uv).rgb;
+}
+
+#include "pbrtexture.glsl"
@@ -0,0 +1,25 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// The result of the radialblur.comp passes, upsampled by the bilinear filter of the sampler
+layout (binding = 1) uniform sampler2D samplerColor;
+
+layout (binding = 2) uniform UBO 
+{
+	int texWidth;
+	int texHeight;
+	float radialBlurScale;
+	float radialBlurStrength;
+	vec2 radialOrigin;
+} ubo;
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main() 
+{
+	outFragColor = texture(samplerColor, inUV) * ubo.radialBlurStrength;
+}
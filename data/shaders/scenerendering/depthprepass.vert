@@ -0,0 +1,23 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout (location = 0) in vec3 inPos;
+
+layout (set = 0, binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 view;
+	mat4 model;
+	vec4 lightPos;
+} ubo;
+
+// Computed exactly like scene.vert, so that the main pass passes its eEqual depth test
+invariant gl_Position;
+
+void main() 
+{
+	mat4 modelView = ubo.view * ubo.model;
+	gl_Position = ubo.projection * modelView * vec4(inPos.xyz, 1.0);
+}
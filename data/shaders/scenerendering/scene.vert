@@ -22,6 +22,9 @@ layout (location = 2) out vec2 outUV;
 layout (location = 3) out vec3 outViewVec;
 layout (location = 4) out vec3 outLightVec;
 
+// Matches depthprepass.vert
+invariant gl_Position;
+
 void main() 
 {
 	outNormal = inNormal;
@@ -0,0 +1,38 @@
+#version 450
+
+#extension GL_EXT_multiview : enable
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec2 inUV;
+
+#define SHADOW_MAP_CASCADE_COUNT 4
+
+layout(push_constant) uniform PushConsts {
+	vec4 position;
+	uint cascadeIndex;
+	// Cascades the draw has not been culled from
+	uint cascadeMask;
+} pushConsts;
+
+layout (binding = 0) uniform UBO {
+	mat4[SHADOW_MAP_CASCADE_COUNT] cascadeViewProjMat;
+} ubo;
+
+layout (location = 0) out vec2 outUV;
+
+out gl_PerVertex {
+	vec4 gl_Position;
+};
+
+// One view per cascade, gl_ViewIndex selects the cascade
+void main()
+{
+	outUV = inUV;
+	if ((pushConsts.cascadeMask & (1u << gl_ViewIndex)) == 0u) {
+		// Outside of the clip volume in x, so the whole triangle is clipped
+		gl_Position = vec4(2.0, 2.0, 0.0, 1.0);
+		return;
+	}
+	vec3 pos = inPos + pushConsts.position.xyz;
+	gl_Position = ubo.cascadeViewProjMat[gl_ViewIndex] * vec4(pos, 1.0);
+}
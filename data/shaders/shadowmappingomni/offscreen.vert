@@ -3,6 +3,9 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
+// Must match LIGHT_COUNT of shadowmappingomni.cpp
+#define LIGHT_COUNT 2
+
 layout (location = 0) in vec3 inPos;
 
 layout (location = 0) out vec4 outPos;
@@ -11,20 +14,21 @@ layout (location = 1) out vec3 outLightPos;
 layout (binding = 0) uniform UBO 
 {
 	mat4 projection;
-	mat4 view; 
-	mat4 model;
-	vec4 lightPos;
+	vec4 lights[LIGHT_COUNT];
+	mat4 faceViews[6];
 } ubo;
 
 layout(push_constant) uniform PushConsts 
 {
 	mat4 view;
+	uint light;
 } pushConsts;
  
 void main()
 {
-	gl_Position = ubo.projection * pushConsts.view * ubo.model * vec4(inPos, 1.0);
+	vec3 lightPos = ubo.lights[pushConsts.light].xyz;
+	gl_Position = ubo.projection * pushConsts.view * vec4(inPos - lightPos, 1.0);
 
 	outPos = vec4(inPos, 1.0);	
-	outLightPos = ubo.lightPos.xyz; 
+	outLightPos = lightPos; 
 }
\ No newline at end of file
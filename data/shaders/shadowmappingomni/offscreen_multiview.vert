@@ -0,0 +1,28 @@
+#version 450
+
+#extension GL_EXT_multiview : enable
+
+// Must match LIGHT_COUNT of shadowmappingomni.cpp
+#define LIGHT_COUNT 2
+
+layout (location = 0) in vec3 inPos;
+
+layout (location = 0) out vec4 outPos;
+layout (location = 1) out vec3 outLightPos;
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 projection;
+	vec4 lights[LIGHT_COUNT];
+	mat4 faceViews[6];
+} ubo;
+
+// One view per cube map face of the first light, gl_ViewIndex selects the face
+void main()
+{
+	vec3 lightPos = ubo.lights[0].xyz;
+	gl_Position = ubo.projection * ubo.faceViews[gl_ViewIndex] * vec4(inPos - lightPos, 1.0);
+
+	outPos = vec4(inPos, 1.0);
+	outLightPos = lightPos;
+}
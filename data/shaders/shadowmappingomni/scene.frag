@@ -3,14 +3,25 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
-layout (binding = 1) uniform samplerCube shadowCubeMap;
+// Must match LIGHT_COUNT of shadowmappingomni.cpp
+#define LIGHT_COUNT 2
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 view;
+	mat4 model;
+	// xyz position, w intensity
+	vec4 lights[LIGHT_COUNT];
+} ubo;
+
+// One cube of distances per light
+layout (binding = 1) uniform samplerCubeArray shadowCubeMap;
 
 layout (location = 0) in vec3 inNormal;
 layout (location = 1) in vec3 inColor;
 layout (location = 2) in vec3 inEyePos;
-layout (location = 3) in vec3 inLightVec;
-layout (location = 4) in vec3 inWorldPos;
-layout (location = 5) in vec3 inLightPos;
+layout (location = 3) in vec3 inWorldPos;
 
 layout (location = 0) out vec4 outFragColor;
 
@@ -19,25 +30,22 @@ layout (location = 0) out vec4 outFragColor;
 
 void main() 
 {
-	// Lighting
 	vec3 N = normalize(inNormal);
-	vec3 L = normalize(vec3(1.0));	
-	
-	vec3 Eye = normalize(-inEyePos);
-	vec3 Reflected = normalize(reflect(-inLightVec, inNormal)); 
-
 	vec4 IAmbient = vec4(vec3(0.05), 1.0);
-	vec4 IDiffuse = vec4(1.0) * max(dot(inNormal, inLightVec), 0.0);
-
-	outFragColor = vec4(IAmbient + IDiffuse * vec4(inColor, 1.0));		
-		
-	// Shadow
-	vec3 lightVec = inWorldPos - inLightPos;
-    float sampledDist = texture(shadowCubeMap, lightVec).r;
-    float dist = length(lightVec);
-
-	// Check if fragment is in shadow
-    float shadow = (dist <= sampledDist + EPSILON) ? 1.0 : SHADOW_OPACITY;
-    		
-	outFragColor.rgb *= shadow;
+	outFragColor = IAmbient;
+
+	for (int i = 0; i < LIGHT_COUNT; ++i)
+	{
+		// Shadow
+		vec3 lightVec = inWorldPos - ubo.lights[i].xyz;
+		float sampledDist = texture(shadowCubeMap, vec4(lightVec, i)).r;
+		float dist = length(lightVec);
+
+		// Check if fragment is in shadow
+		float shadow = (dist <= sampledDist + EPSILON) ? 1.0 : SHADOW_OPACITY;
+
+		// Lighting
+		float IDiffuse = max(dot(N, -lightVec / dist), 0.0) * ubo.lights[i].w;
+		outFragColor.rgb += IDiffuse * inColor * shadow;
+	}
 }
\ No newline at end of file
@@ -0,0 +1,70 @@
+// Screen space ambient occlusion from the view space positions and normals of the G-Buffer.  The kernel directions and
+// the occlusion sum are in the types of ../base/precision.glsl, which the stub includes first, the positions and depths
+// they're compared against stay 32 bit.
+
+layout (binding = 0) uniform sampler2D samplerPositionDepth;
+layout (binding = 1) uniform sampler2D samplerNormal;
+layout (binding = 2) uniform sampler2D ssaoNoise;
+
+layout (constant_id = 0) const int SSAO_KERNEL_SIZE = 64;
+layout (constant_id = 1) const float SSAO_RADIUS = 0.5;
+
+layout (binding = 3) uniform UBOSSAOKernel
+{
+	vec4 samples[SSAO_KERNEL_SIZE];
+} uboSSAOKernel;
+
+layout (binding = 4) uniform UBO 
+{
+	mat4 projection;
+} ubo;
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out float outFragColor;
+
+void main() 
+{
+	// Get G-Buffer values
+	vec3 fragPos = texture(samplerPositionDepth, inUV).rgb;
+	mvec3 normal = mvec3(normalize(texture(samplerNormal, inUV).rgb * 2.0 - 1.0));
+
+	// Get a random vector using a noise lookup
+	ivec2 texDim = textureSize(samplerPositionDepth, 0); 
+	ivec2 noiseDim = textureSize(ssaoNoise, 0);
+	const vec2 noiseUV = vec2(float(texDim.x)/float(noiseDim.x), float(texDim.y)/(noiseDim.y)) * inUV;  
+	mvec3 randomVec = mvec3(texture(ssaoNoise, noiseUV).xyz * 2.0 - 1.0);
+	
+	// Create TBN matrix
+	mvec3 tangent = normalize(randomVec - normal * dot(randomVec, normal));
+	mvec3 bitangent = cross(tangent, normal);
+	mmat3 TBN = mmat3(tangent, bitangent, normal);
+
+	// Calculate occlusion value
+	mfloat occlusion = mfloat(0.0);
+	for(int i = 0; i < SSAO_KERNEL_SIZE; i++)
+	{		
+		vec3 samplePos = vec3(TBN * mvec3(uboSSAOKernel.samples[i].xyz)); 
+		samplePos = fragPos + samplePos * SSAO_RADIUS; 
+		
+		// project
+		vec4 offset = vec4(samplePos, 1.0f);
+		offset = ubo.projection * offset; 
+		offset.xyz /= offset.w; 
+		offset.xyz = offset.xyz * 0.5f + 0.5f; 
+		
+		float sampleDepth = -texture(samplerPositionDepth, offset.xy).w; 
+
+#define RANGE_CHECK 1
+#ifdef RANGE_CHECK
+		// Range check
+		mfloat rangeCheck = mfloat(smoothstep(0.0f, 1.0f, SSAO_RADIUS / abs(fragPos.z - sampleDepth)));
+		occlusion += (sampleDepth >= samplePos.z ? mfloat(1.0) : mfloat(0.0)) * rangeCheck;           
+#else
+		occlusion += (sampleDepth >= samplePos.z ? mfloat(1.0) : mfloat(0.0));  
+#endif
+	}
+	occlusion = mfloat(1.0) - (occlusion / mfloat(SSAO_KERNEL_SIZE));
+	
+	outFragColor = occlusion;
+}
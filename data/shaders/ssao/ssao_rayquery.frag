@@ -0,0 +1,83 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_EXT_ray_query : require
+
+// ssao.frag with the kernel samples traced as rays against the scene's acceleration structure, rather than compared
+// against the depth buffer.  Occluders that are hidden or off screen count as well, and there are no halos at depth
+// discontinuities.
+
+layout (binding = 0) uniform sampler2D samplerPositionDepth;
+layout (binding = 1) uniform sampler2D samplerNormal;
+layout (binding = 2) uniform sampler2D ssaoNoise;
+
+layout (constant_id = 0) const int SSAO_KERNEL_SIZE = 64;
+layout (constant_id = 1) const float SSAO_RADIUS = 0.5;
+
+layout (binding = 3) uniform UBOSSAOKernel
+{
+	vec4 samples[SSAO_KERNEL_SIZE];
+} uboSSAOKernel;
+
+layout (binding = 4) uniform UBO 
+{
+	mat4 projection;
+	int ssao;
+	int ssaoOnly;
+	int ssaoBlur;
+	// The G-buffer is in view space, the acceleration structure in world space
+	mat4 invView;
+} ubo;
+
+layout (binding = 5) uniform accelerationStructureEXT topLevelAS;
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out float outFragColor;
+
+void main() 
+{
+	// Get G-Buffer values
+	vec3 fragPos = texture(samplerPositionDepth, inUV).rgb;
+	vec3 normal = normalize(texture(samplerNormal, inUV).rgb * 2.0 - 1.0);
+
+	// Get a random vector using a noise lookup
+	ivec2 texDim = textureSize(samplerPositionDepth, 0); 
+	ivec2 noiseDim = textureSize(ssaoNoise, 0);
+	const vec2 noiseUV = vec2(float(texDim.x)/float(noiseDim.x), float(texDim.y)/(noiseDim.y)) * inUV;  
+	vec3 randomVec = texture(ssaoNoise, noiseUV).xyz * 2.0 - 1.0;
+	
+	// Create TBN matrix, straight to world space
+	vec3 tangent = normalize(randomVec - normal * dot(randomVec, normal));
+	vec3 bitangent = cross(tangent, normal);
+	mat3 TBN = mat3(ubo.invView) * mat3(tangent, bitangent, normal);
+
+	// Offset along the normal so that the rays don't hit the surface they start on
+	vec3 origin = (ubo.invView * vec4(fragPos, 1.0)).xyz + TBN[2] * 0.01;
+
+	// Each sample is a ray as long as the sample's distance from the fragment
+	float occlusion = 0.0f;
+	for(int i = 0; i < SSAO_KERNEL_SIZE; i++)
+	{
+		vec3 sampleDir = TBN * uboSSAOKernel.samples[i].xyz;
+		float sampleLength = length(sampleDir);
+		if (sampleLength <= 0.0)
+		{
+			continue;
+		}
+		rayQueryEXT rayQuery;
+		rayQueryInitializeEXT(rayQuery, topLevelAS, gl_RayFlagsOpaqueEXT | gl_RayFlagsTerminateOnFirstHitEXT, 0xFF, origin, 0.0,
+			sampleDir / sampleLength, sampleLength * SSAO_RADIUS);
+		while (rayQueryProceedEXT(rayQuery))
+		{
+		}
+		if (rayQueryGetIntersectionTypeEXT(rayQuery, true) != gl_RayQueryCommittedIntersectionNoneEXT)
+		{
+			occlusion += 1.0;
+		}
+	}
+	occlusion = 1.0 - (occlusion / float(SSAO_KERNEL_SIZE));
+	
+	outFragColor = occlusion;
+}
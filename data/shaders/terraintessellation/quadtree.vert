@@ -0,0 +1,66 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_GOOGLE_include_directive : require
+
+// The grid of a node selected by the compute quadtree, displaced by the height map in the vertex shader
+
+layout (location = 0) in vec2 inGridPos;
+// Corner, size and LOD of the node
+layout (location = 1) in vec4 inNode;
+
+layout (set = 0, binding = 0) uniform UBO
+{
+	mat4 projection;
+	mat4 modelview;
+	vec4 lightPos;
+	vec4 frustumPlanes[6];
+	float displacementFactor;
+	float tessellationFactor;
+	vec2 viewportDim;
+	float tessellatedEdgeSize;
+} ubo;
+
+layout (set = 0, binding = 1) uniform sampler2D displacementMap;
+
+#define QUADTREE_UNIFORM_BINDING 3
+#include "../base/quadtree.glsl"
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec2 outUV;
+layout (location = 2) out vec3 outEyePos;
+layout (location = 3) out vec3 outLightVec;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+float terrainHeight(vec2 uv)
+{
+	return textureLod(displacementMap, uv, 0.0).r * quadtree.heightScale;
+}
+
+void main()
+{
+	// Morph by the distance to the unmorphed vertex, as the selection measured the distance to the node
+	vec2 position = inNode.xy + inGridPos * inNode.z;
+	float cameraDistance = distance(vec3(position.x, terrainHeight(quadtreeUV(position)), position.y), quadtree.camera.xyz);
+	position = quadtreeMorph(inGridPos, inNode, cameraDistance);
+	outUV = quadtreeUV(position);
+	vec4 pos = vec4(position.x, terrainHeight(outUV), position.y, 1.0);
+
+	// Central differences over the finest resident level
+	vec2 texel = 1.0 / vec2(textureSize(displacementMap, 0));
+	float dx = terrainHeight(outUV + vec2(texel.x, 0.0)) - terrainHeight(outUV - vec2(texel.x, 0.0));
+	float dz = terrainHeight(outUV + vec2(0.0, texel.y)) - terrainHeight(outUV - vec2(0.0, texel.y));
+	vec2 spacing = 2.0 * texel * quadtree.size;
+	outNormal = normalize(vec3(dx / spacing.x, -1.0, dz / spacing.y));
+
+	gl_Position = ubo.projection * ubo.modelview * pos;
+
+	// Calculate vectors for lighting based on the displaced position
+	outEyePos = -pos.xyz;
+	outLightVec = normalize(ubo.lightPos.xyz + outEyePos);
+}
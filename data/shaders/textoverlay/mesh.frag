@@ -9,7 +9,6 @@ layout (location = 0) in vec3 inNormal;
 layout (location = 1) in vec2 inUV;
 layout (location = 2) in vec3 inViewVec;
 layout (location = 3) in vec3 inLightVec;
-layout (location = 4) in vec3 inEyeNormal;
 
 layout (location = 0) out vec4 outFragColor;
 
@@ -5,6 +5,29 @@
 
 layout (binding = 1) uniform sampler2D samplerColor;
 
+// Page feedback, see vks::texture::VirtualTexture
+layout (binding = 2) readonly buffer Levels
+{
+	// Paged levels, page width, page height, max requests
+	uvec4 header;
+	// First page, pages x, pages y
+	uvec4 levels[];
+} vtLevels;
+
+layout (binding = 3) buffer Flags
+{
+	uint flags[];
+} vtFlags;
+
+layout (binding = 4) buffer Requests
+{
+	uint count;
+	uint pages[];
+} vtRequests;
+
+// Only one pixel in FEEDBACK_STRIDE x FEEDBACK_STRIDE reports, pages span far more pixels than that
+#define FEEDBACK_STRIDE 8
+
 layout (location = 0) in vec2 inUV;
 layout (location = 1) in float inLodBias;
 layout (location = 2) in vec3 inNormal;
@@ -13,8 +36,37 @@ layout (location = 4) in vec3 inLightVec;
 
 layout (location = 0) out vec4 outFragColor;
 
+void writeFeedback()
+{
+	if (any(notEqual(ivec2(gl_FragCoord.xy) % FEEDBACK_STRIDE, ivec2(0)))) 
+	{
+		return;
+	}
+	uint level = uint(max(textureQueryLod(samplerColor, inUV).y + inLodBias, 0.0));
+	// The mip tail is always resident
+	if (level >= vtLevels.header.x) 
+	{
+		return;
+	}
+	uvec4 info = vtLevels.levels[level];
+	vec2 texel = fract(inUV) * vec2(textureSize(samplerColor, int(level)));
+	uvec2 page = min(uvec2(texel) / vtLevels.header.yz, info.yz - 1);
+	uint index = info.x + page.y * info.y + page.x;
+	// The first pixel to need a page appends it, which leaves a compact list for the host to read
+	if (atomicExchange(vtFlags.flags[index], 1) == 0) 
+	{
+		uint request = atomicAdd(vtRequests.count, 1);
+		if (request < vtLevels.header.w) 
+		{
+			vtRequests.pages[request] = index;
+		}
+	}
+}
+
 void main() 
 {
+	writeFeedback();
+
 	vec4 color = vec4(0.0);
 
 	// Get residency code for current texel
@@ -0,0 +1,31 @@
+#include "../base/viewports.glsl"
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec3 inColor;
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec3 outViewVec;
+layout (location = 3) out vec3 outLightVec;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+const vec4 lightPos = vec4(-2.5, -3.5, 0.0, 1.0);
+
+void main() 
+{
+	uvec2 instance = viewportInstance();
+	ViewportView view = viewports.views[instance.y];
+	mat4 modelView = view.view * viewportModels.models[instance.x];
+
+	vec4 pos = modelView * vec4(inPos, 1.0);
+	outNormal = mat3(modelView) * inNormal;
+	outColor = inColor;
+	outLightVec = vec3(view.view * lightPos) - pos.xyz;
+	outViewVec = -pos.xyz;
+	gl_Position = view.projection * pos;
+}
@@ -1,20 +1,9 @@
 #version 450
 
-layout (location = 0) in vec3 inPos;
-layout (location = 1) in vec3 inNormal;
-layout (location = 2) in vec3 inColor;
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_GOOGLE_include_directive : require
 
-layout (location = 0) out vec3 outNormal;
-layout (location = 1) out vec3 outColor;
+// One draw per view, in the viewport set for it
 
-out gl_PerVertex
-{
-	vec4 gl_Position;
-};
-
-void main() 
-{
-	outColor = inColor;
-	outNormal = inNormal;
-	gl_Position = vec4(inPos.xyz, 1.0);	
-}
+#include "scene.glsl"
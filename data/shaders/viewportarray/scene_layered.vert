@@ -0,0 +1,11 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_ARB_shader_viewport_layer_array : require
+#extension GL_GOOGLE_include_directive : require
+
+// All views in one draw, every instance picks the viewport of its view
+
+#define VIEWPORTS_LAYERED
+#include "scene.glsl"
@@ -17,6 +17,13 @@
 #define FB_DIM TEX_DIM
 #define FB_COLOR_FORMAT TEX_FORMAT
 
+// Mip chain bloom, the first level is half the size of the glow target.  Must match downsample.glsl, whose workgroups
+// reduce a tile of the first level to a single texel of the last one
+#define CHAIN_DIM (TEX_DIM / 2)
+#define CHAIN_LEVELS 6
+#define CHAIN_TILE_SIZE 32
+static_assert(CHAIN_DIM % CHAIN_TILE_SIZE == 0 && (CHAIN_TILE_SIZE >> (CHAIN_LEVELS - 1)) == 1, "Bloom chain tiles must cover every level");
+
 // Vertex layout for this example
 vks::model::VertexLayout vertexLayout{ {
     vks::model::Component::VERTEX_COMPONENT_POSITION,
@@ -30,6 +37,10 @@ class VulkanExample : public vkx::OffscreenExampleBase {
 
 public:
     bool bloom = true;
+    // Bloom from a mip chain built in compute instead of the separable blur, see prepareChain
+    bool mipChain = false;
+    // Keep the mip chain in B10G11R11 where the device can store to it, rather than 16 bit RGBA
+    bool compactTargets = true;
 
     struct {
         vks::texture::TextureCubeMap cubemap;
@@ -66,9 +77,13 @@ public:
     struct {
         vk::Pipeline blurVert;
         vk::Pipeline blurHorz;
+        // gaussblur.frag's _fp16 variant, with shaderFloat16
+        vk::Pipeline blurVertHalf;
+        vk::Pipeline blurHorzHalf;
         vk::Pipeline glowPass;
         vk::Pipeline phongPass;
         vk::Pipeline skyBox;
+        vk::Pipeline chainComposite;
     } pipelines;
 
     struct {
@@ -81,6 +96,7 @@ public:
         vk::DescriptorSet blurHorz;
         vk::DescriptorSet scene;
         vk::DescriptorSet skyBox;
+        vk::DescriptorSet chainComposite;
     } descriptorSets;
 
     // Descriptor set layout is shared amongst
@@ -90,6 +106,26 @@ public:
         vk::DescriptorSetLayout scene;
     } descriptorSetLayouts;
 
+    struct {
+        vks::Image image;
+        // One per level, both for storage and for sampling by the next step
+        std::array<vk::ImageView, CHAIN_LEVELS> views;
+        vk::Sampler sampler;
+        vk::DescriptorSetLayout downsampleSetLayout;
+        vk::DescriptorSetLayout upsampleSetLayout;
+        vk::PipelineLayout downsampleLayout;
+        vk::PipelineLayout upsampleLayout;
+        vk::Pipeline downsample;
+        vk::Pipeline upsample;
+        vk::DescriptorSet downsampleSet;
+        // Set i upsamples level i + 1 into level i
+        std::array<vk::DescriptorSet, CHAIN_LEVELS - 1> upsampleSets;
+        // Set by prepareChain if the downsample reduces with subgroup quad operations
+        bool subgroups{ false };
+        // Set by prepareChain if the levels are B10G11R11, which the _compact shaders store
+        bool compact{ false };
+    } chain;
+
     VulkanExample()
         : vkx::OffscreenExampleBase() {
         timerSpeed *= 0.5f;
@@ -98,6 +134,15 @@ public:
         camera.setPosition(glm::vec3(0.0f, 0.0f, -10.25f));
         camera.setRotation(glm::vec3(7.5f, -343.0f, 0.0f));
         camera.setPerspective(45.0f, (float)width / (float)height, 0.1f, 256.0f);
+
+        const auto& args = vkx::getCommandLine();
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (args[i] == "--mip-chain") {
+                mipChain = true;
+            } else if (args[i] == "--wide-targets") {
+                compactTargets = false;
+            }
+        }
     }
 
     ~VulkanExample() {
@@ -106,9 +151,24 @@ public:
 
         device.destroyPipeline(pipelines.blurVert);
         device.destroyPipeline(pipelines.blurHorz);
+        device.destroyPipeline(pipelines.blurVertHalf);
+        device.destroyPipeline(pipelines.blurHorzHalf);
         device.destroyPipeline(pipelines.phongPass);
         device.destroyPipeline(pipelines.glowPass);
         device.destroyPipeline(pipelines.skyBox);
+        device.destroyPipeline(pipelines.chainComposite);
+
+        device.destroyPipeline(chain.downsample);
+        device.destroyPipeline(chain.upsample);
+        device.destroyPipelineLayout(chain.downsampleLayout);
+        device.destroyPipelineLayout(chain.upsampleLayout);
+        device.destroyDescriptorSetLayout(chain.downsampleSetLayout);
+        device.destroyDescriptorSetLayout(chain.upsampleSetLayout);
+        device.destroySampler(chain.sampler);
+        for (const auto& view : chain.views) {
+            device.destroyImageView(view);
+        }
+        chain.image.destroy();
 
         device.destroyPipelineLayout(pipelineLayouts.blur);
         device.destroyPipelineLayout(pipelineLayouts.scene);
@@ -161,7 +221,7 @@ public:
             offscreen.cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.scene, 0, descriptorSets.scene, nullptr);
             offscreen.cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.glowPass);
             offscreen.cmdBuffer.bindVertexBuffers(0, meshes.ufoGlow.vertices.buffer, offset);
-            offscreen.cmdBuffer.bindIndexBuffer(meshes.ufoGlow.indices.buffer, 0, vk::IndexType::eUint32);
+            offscreen.cmdBuffer.bindIndexBuffer(meshes.ufoGlow.indices.buffer, 0, meshes.ufoGlow.indexType);
 
             for (const auto& part : meshes.ufoGlow.parts) {
                 offscreen.cmdBuffer.drawIndexed(part.indexCount, 1, part.indexBase, 0, 0);
@@ -169,6 +229,12 @@ public:
             offscreen.cmdBuffer.endRenderPass();
         }
 
+        if (mipChain) {
+            buildChainCommands(offscreen.cmdBuffer);
+            offscreen.cmdBuffer.end();
+            return;
+        }
+
         {
             vk::RenderPassBeginInfo renderPassBeginInfo;
             renderPassBeginInfo.renderPass = offscreen.renderPass;
@@ -180,13 +246,42 @@ public:
             // Draw a vertical blur pass from framebuffer 1's texture into framebuffer 2
             offscreen.cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
             offscreen.cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.blur, 0, descriptorSets.blurVert, nullptr);
-            offscreen.cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.blurVert);
-            offscreen.cmdBuffer.draw(3, 1, 0, 0);
+            recordWithPrecision(offscreen.cmdBuffer, scissor.extent, [&](bool half) {
+                offscreen.cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, half ? pipelines.blurVertHalf : pipelines.blurVert);
+                offscreen.cmdBuffer.draw(3, 1, 0, 0);
+            });
             offscreen.cmdBuffer.endRenderPass();
         }
         offscreen.cmdBuffer.end();
     }
 
+    static void chainBarrier(const vk::CommandBuffer& cmdBuffer, vk::PipelineStageFlags dstStage) {
+        vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, dstStage, {}, barrier, nullptr, nullptr);
+    }
+
+    // Downsample the glow target into every level of the chain, then upsample from the smallest level back up to the
+    // first one, which the main pass adds to the scene
+    void buildChainCommands(const vk::CommandBuffer& cmdBuffer) {
+        // The glow pass has to be written, and the previous frame's composition done reading the first level
+        vk::MemoryBarrier glowBarrier{ vk::AccessFlagBits::eColorAttachmentWrite, vk::AccessFlagBits::eShaderRead };
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eFragmentShader,
+                                  vk::PipelineStageFlagBits::eComputeShader, {}, glowBarrier, nullptr, nullptr);
+
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, chain.downsample);
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, chain.downsampleLayout, 0, chain.downsampleSet, nullptr);
+        cmdBuffer.dispatch(CHAIN_DIM / CHAIN_TILE_SIZE, CHAIN_DIM / CHAIN_TILE_SIZE, 1);
+        chainBarrier(cmdBuffer, vk::PipelineStageFlagBits::eComputeShader);
+
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, chain.upsample);
+        for (uint32_t level = CHAIN_LEVELS - 1; level-- > 0;) {
+            const uint32_t levelSize = CHAIN_DIM >> level;
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, chain.upsampleLayout, 0, chain.upsampleSets[level], nullptr);
+            cmdBuffer.dispatch((levelSize + 7) / 8, (levelSize + 7) / 8, 1);
+            chainBarrier(cmdBuffer, level ? vk::PipelineStageFlagBits::eComputeShader : vk::PipelineStageFlagBits::eFragmentShader);
+        }
+    }
+
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
         vk::DeviceSize offset = 0;
         cmdBuffer.setViewport(0, vks::util::viewport(size));
@@ -196,31 +291,41 @@ public:
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.scene, 0, descriptorSets.skyBox, nullptr);
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.skyBox);
         cmdBuffer.bindVertexBuffers(0, meshes.skyBox.vertices.buffer, offset);
-        cmdBuffer.bindIndexBuffer(meshes.skyBox.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.skyBox.indices.buffer, 0, meshes.skyBox.indexType);
         cmdBuffer.drawIndexed(meshes.skyBox.indexCount, 1, 0, 0, 0);
 
         // 3D scene
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.scene, 0, descriptorSets.scene, nullptr);
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.phongPass);
         cmdBuffer.bindVertexBuffers(0, meshes.ufo.vertices.buffer, offset);
-        cmdBuffer.bindIndexBuffer(meshes.ufo.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.ufo.indices.buffer, 0, meshes.ufo.indexType);
         cmdBuffer.drawIndexed(meshes.ufo.indexCount, 1, 0, 0, 0);
 
         // Render vertical blurred scene applying a horizontal blur
-        if (bloom) {
-            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.blur, 0, descriptorSets.blurHorz, nullptr);
-            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.blurHorz);
+        if (bloom && mipChain) {
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.blur, 0, descriptorSets.chainComposite, nullptr);
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.chainComposite);
             cmdBuffer.draw(3, 1, 0, 0);
+        } else if (bloom) {
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.blur, 0, descriptorSets.blurHorz, nullptr);
+            recordWithPrecision(cmdBuffer, size, [&](bool half) {
+                cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, half ? pipelines.blurHorzHalf : pipelines.blurHorz);
+                cmdBuffer.draw(3, 1, 0, 0);
+            });
         }
     }
 
     void setupDescriptorPool() {
         std::vector<vk::DescriptorPoolSize> poolSizes{
-            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 8 },
-            vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 6 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 8 + CHAIN_LEVELS },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 6 + 1 + CHAIN_LEVELS },
+            // Every level in the downsample set, and one per upsample set
+            vk::DescriptorPoolSize{ vk::DescriptorType::eStorageImage, CHAIN_LEVELS + CHAIN_LEVELS - 1 },
         };
 
-        descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 5, (uint32_t)poolSizes.size(), poolSizes.data() });
+        // The chain's downsample set, an upsample set per level but the last and the composition
+        const uint32_t chainSets = 1 + (CHAIN_LEVELS - 1) + 1;
+        descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 5 + chainSets, (uint32_t)poolSizes.size(), poolSizes.data() });
     }
 
     void setupDescriptorSetLayout() {
@@ -270,6 +375,96 @@ public:
                 { descriptorSets.skyBox, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &cubeMapDescriptor },
             },
             nullptr);
+
+        // Mip chain
+        descriptorSets.chainComposite = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.blur })[0];
+        chain.downsampleSet = device.allocateDescriptorSets({ descriptorPool, 1, &chain.downsampleSetLayout })[0];
+        vk::DescriptorImageInfo glowDescriptor{ offscreen.framebuffers[0].colors[0].sampler, offscreen.framebuffers[0].colors[0].view,
+                                                vk::ImageLayout::eShaderReadOnlyOptimal };
+        std::array<vk::DescriptorImageInfo, CHAIN_LEVELS> levelDescriptors;
+        for (uint32_t level = 0; level < CHAIN_LEVELS; ++level) {
+            levelDescriptors[level] = vk::DescriptorImageInfo{ chain.sampler, chain.views[level], vk::ImageLayout::eGeneral };
+        }
+        std::vector<vk::WriteDescriptorSet> chainWrites{
+            { descriptorSets.chainComposite, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.blurParams.descriptor },
+            { descriptorSets.chainComposite, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &levelDescriptors[0] },
+            { chain.downsampleSet, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &glowDescriptor },
+            { chain.downsampleSet, 1, 0, CHAIN_LEVELS, vk::DescriptorType::eStorageImage, levelDescriptors.data() },
+        };
+        for (uint32_t level = 0; level < CHAIN_LEVELS - 1; ++level) {
+            const vk::DescriptorSet set = device.allocateDescriptorSets({ descriptorPool, 1, &chain.upsampleSetLayout })[0];
+            chain.upsampleSets[level] = set;
+            chainWrites.push_back({ set, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.blurParams.descriptor });
+            chainWrites.push_back({ set, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &levelDescriptors[level + 1] });
+            chainWrites.push_back({ set, 2, 0, 1, vk::DescriptorType::eStorageImage, &levelDescriptors[level] });
+        }
+        device.updateDescriptorSets(chainWrites, nullptr);
+    }
+
+    // The glow target is reduced to CHAIN_LEVELS levels of half the size each in a single dispatch, and then upsampled
+    // back to the first level, a dispatch per level adding the tent filtered level above to the one below.  Every level
+    // widens the blur, so the chain reaches much further than the separable blur for fewer taps per pixel.
+    // The chain needs no alpha, so where the device has storage images of B10G11R11 that halves its size, and the
+    // bandwidth of every step.
+    void prepareChain() {
+        const vk::FormatFeatureFlags features = vk::FormatFeatureFlagBits::eStorageImage | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+        chain.compact = compactTargets && context.getSupportedHdrColorFormat(false, features) == vk::Format::eB10G11R11UfloatPack32;
+        const vk::Format format = chain.compact ? vk::Format::eB10G11R11UfloatPack32 : vk::Format::eR16G16B16A16Sfloat;
+        vk::ImageCreateInfo imageCreateInfo;
+        imageCreateInfo.imageType = vk::ImageType::e2D;
+        imageCreateInfo.format = format;
+        imageCreateInfo.extent = vk::Extent3D{ CHAIN_DIM, CHAIN_DIM, 1 };
+        imageCreateInfo.mipLevels = CHAIN_LEVELS;
+        imageCreateInfo.arrayLayers = 1;
+        imageCreateInfo.usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled;
+        chain.image = context.createImage(imageCreateInfo);
+        // Written as storage and sampled by the next step, so the chain stays in the general layout
+        context.setImageLayout(chain.image.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral,
+                               vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, CHAIN_LEVELS, 0, 1 });
+        for (uint32_t level = 0; level < CHAIN_LEVELS; ++level) {
+            chain.views[level] =
+                device.createImageView({ {}, chain.image.image, vk::ImageViewType::e2D, format, {}, { vk::ImageAspectFlagBits::eColor, level, 1, 0, 1 } });
+        }
+
+        vk::SamplerCreateInfo sampler;
+        sampler.magFilter = vk::Filter::eLinear;
+        sampler.minFilter = vk::Filter::eLinear;
+        sampler.addressModeU = sampler.addressModeV = sampler.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+        sampler.maxAnisotropy = 1.0f;
+        sampler.borderColor = vk::BorderColor::eFloatOpaqueWhite;
+        chain.sampler = device.createSampler(sampler);
+
+        const auto stage = vk::ShaderStageFlagBits::eCompute;
+        std::vector<vk::DescriptorSetLayoutBinding> bindings{
+            { 0, vk::DescriptorType::eCombinedImageSampler, 1, stage },
+            { 1, vk::DescriptorType::eStorageImage, CHAIN_LEVELS, stage },
+        };
+        chain.downsampleSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)bindings.size(), bindings.data() });
+        chain.downsampleLayout = device.createPipelineLayout({ {}, 1, &chain.downsampleSetLayout });
+        bindings = {
+            { 0, vk::DescriptorType::eUniformBuffer, 1, stage },
+            { 1, vk::DescriptorType::eCombinedImageSampler, 1, stage },
+            { 2, vk::DescriptorType::eStorageImage, 1, stage },
+        };
+        chain.upsampleSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)bindings.size(), bindings.data() });
+        chain.upsampleLayout = device.createPipelineLayout({ {}, 1, &chain.upsampleSetLayout });
+
+        // Quad operations average the 2x2 blocks of a level in registers, instead of going through shared memory
+        // with two workgroup barriers per level
+        chain.subgroups = context.supportsSubgroupOperations(vk::ShaderStageFlagBits::eCompute, vk::SubgroupFeatureFlagBits::eQuad);
+        // _subgroup goes last, where CompileSpirvShader.cmake and vks::glsl look for it to target SPIR-V 1.3
+        const std::string variant = chain.compact ? "_compact" : "";
+        chain.downsample = createChainPipeline("downsample" + variant + (chain.subgroups ? "_subgroup" : "") + ".comp.spv", chain.downsampleLayout);
+        chain.upsample = createChainPipeline("upsample" + variant + ".comp.spv", chain.upsampleLayout);
+    }
+
+    vk::Pipeline createChainPipeline(const std::string& shader, const vk::PipelineLayout& layout) {
+        vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+        computePipelineCreateInfo.layout = layout;
+        computePipelineCreateInfo.stage = vks::shaders::loadShader(device, getAssetPath() + "shaders/bloom/" + shader, vk::ShaderStageFlagBits::eCompute);
+        vk::Pipeline pipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+        return pipeline;
     }
 
     void preparePipelines() {
@@ -307,6 +502,26 @@ public:
             blurdirection = 1;
             pipelineBuilder.renderPass = renderPass;
             pipelines.blurHorz = pipelineBuilder.create(context.pipelineCache);
+
+            // Both directions again, summing in 16 bit arithmetic
+            if (context.shaderFloat16Enabled) {
+                pipelineBuilder.destroyShaderModules();
+                pipelineBuilder.loadShader(getAssetPath() + "shaders/bloom/gaussblur.vert.spv", vk::ShaderStageFlagBits::eVertex);
+                pipelineBuilder.loadShader(getAssetPath() + "shaders/bloom/gaussblur_fp16.frag.spv", vk::ShaderStageFlagBits::eFragment);
+                pipelineBuilder.shaderStages[1].pSpecializationInfo = &specializationInfo;
+                blurdirection = 0;
+                pipelineBuilder.renderPass = offscreen.renderPass;
+                pipelines.blurVertHalf = pipelineBuilder.create(context.pipelineCache);
+                blurdirection = 1;
+                pipelineBuilder.renderPass = renderPass;
+                pipelines.blurHorzHalf = pipelineBuilder.create(context.pipelineCache);
+            }
+
+            // Composition of the mip chain, blended the same way
+            pipelineBuilder.destroyShaderModules();
+            pipelineBuilder.loadShader(getAssetPath() + "shaders/bloom/gaussblur.vert.spv", vk::ShaderStageFlagBits::eVertex);
+            pipelineBuilder.loadShader(getAssetPath() + "shaders/bloom/composite.frag.spv", vk::ShaderStageFlagBits::eFragment);
+            pipelines.chainComposite = pipelineBuilder.create(context.pipelineCache);
         }
 
         // Vertical gauss blur
@@ -408,6 +623,7 @@ public:
         Parent::prepare();
         prepareUniformBuffers();
         setupDescriptorSetLayout();
+        prepareChain();
         preparePipelines();
         setupDescriptorPool();
         setupDescriptorSet();
@@ -427,11 +643,34 @@ public:
         updateUniformBuffersScene();
     }
 
+    void getEnabledFeatures() override {
+        // For storing to a B10G11R11 mip chain
+        if (context.deviceFeatures.shaderStorageImageExtendedFormats) {
+            context.enabledFeatures.shaderStorageImageExtendedFormats = VK_TRUE;
+        }
+    }
+
+    bool supportsHalfPrecision() const override { return true; }
+
+    void shaderPrecisionChanged() override {
+        device.waitIdle();
+        buildCommandBuffers();
+        buildOffscreenCommandBuffer();
+    }
+
     void OnUpdateUIOverlay() override {
         if (ui.header("Settings")) {
             if (ui.checkBox("Bloom", &bloom)) {
                 buildCommandBuffers();
             }
+            if (ui.checkBox(chain.subgroups ? "Mip chain (compute, subgroups)" : "Mip chain (compute)", &mipChain)) {
+                device.waitIdle();
+                buildCommandBuffers();
+                buildOffscreenCommandBuffer();
+            }
+            if (mipChain) {
+                ui.text("Chain format: %s", chain.compact ? "B10G11R11 ufloat" : "R16G16B16A16 sfloat");
+            }
             if (ui.inputFloat("Scale", &ubos.blurParams.blurScale, 0.1f, 2)) {
                 updateUniformBuffersBlur();
             }
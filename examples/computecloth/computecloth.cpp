@@ -10,8 +10,13 @@
 
 #include <vulkanExampleBase.h>
 
+// Defaults of the settings --cloth-resolution <particles per side>, --substeps <count> and --colliders <count>
+// change at startup
+static const uint32_t DEFAULT_RESOLUTION = 60;
+static const uint32_t DEFAULT_SUBSTEPS = 64;
+
 struct Cloth {
-    glm::uvec2 gridsize = glm::uvec2(60, 60);
+    glm::uvec2 gridsize = glm::uvec2(DEFAULT_RESOLUTION, DEFAULT_RESOLUTION);
     glm::vec2 size = glm::vec2(2.5f, 2.5f);
 } cloth;
 
@@ -21,19 +26,45 @@ struct Compute : public vkx::Compute {
     Compute(const vks::Context& context)
         : vkx::Compute(context) {}
 
-    uint32_t readSet = 0;
+    // Must match cloth.glsl
+    static const uint32_t MAX_COLLIDERS = 16;
+    // Must match the tile size of cloth_tiled.comp
+    static const uint32_t TILE_SIZE = 16;
+    // Substeps per dispatch of the tiled solver.  Every tile computes TILE_SIZE^2 particles to write
+    // (TILE_SIZE - 2 * TILE_SUBSTEPS)^2 of them, in exchange for a TILE_SUBSTEPS-th of the dispatches, barriers and
+    // storage buffer traffic.
+    static const uint32_t TILE_SUBSTEPS = 4;
+
+    enum class Solver : int32_t
+    {
+        // One substep per dispatch
+        Global,
+        // TILE_SUBSTEPS substeps per dispatch in shared memory
+        Tiled,
+    };
+    Solver solver{ Solver::Tiled };
+    // Substeps per submission, the tiled solver rounds them up to whole dispatches
+    uint32_t substeps{ DEFAULT_SUBSTEPS };
+
     struct StorageBuffers {
-        vks::Buffer input;
-        vks::Buffer output;
+        // The simulation ping-pongs between slot 0 (input) and slot 1 (output) once per dispatch
+        SlotBuffer state;
+        // The output of every submission is copied to its slot here for drawing, so the next submission can run
+        // while it is drawn
+        SlotBuffer vertices;
     } storageBuffers;
+    uint32_t particleCount{ 0 };
 
     vks::Buffer uniformBuffer;
+    // One per slot of storageBuffers.vertices written
     std::vector<vk::CommandBuffer> commandBuffers;
     vk::DescriptorPool descriptorPool;
     vk::DescriptorSetLayout descriptorSetLayout;
+    // Reading input and writing output, and the other way around
     std::array<vk::DescriptorSet, 2> descriptorSets;
     vk::PipelineLayout pipelineLayout;
     vk::Pipeline pipeline;
+    vk::Pipeline tiledPipeline;
 
     struct UBO {
         float deltaT = 0.0f;
@@ -43,28 +74,31 @@ struct Compute : public vkx::Compute {
         float restDistH{ 0 };
         float restDistV{ 0 };
         float restDistD{ 0 };
-        float sphereRadius = 0.5f;
-        glm::vec4 spherePos = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
+        int32_t colliderCount{ 1 };
         glm::vec4 gravity = glm::vec4(0.0f, 9.8f, 0.0f, 0.0f);
         glm::ivec2 particleCount;
+        glm::ivec2 _pad0;
+        // xyz: center, w: radius
+        glm::vec4 colliders[MAX_COLLIDERS];
     } ubo;
 
     void prepare() override {
         Parent::prepare();
         // Create a command buffer for compute operations
-        commandBuffers = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo{ commandPool, vk::CommandBufferLevel::ePrimary, 2 });
+        commandBuffers = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo{ commandPool, vk::CommandBufferLevel::ePrimary, SLOT_COUNT });
         prepareDescriptors();
         preparePipeline();
         buildCommandBuffer();
     }
 
     void destroy() override {
-        storageBuffers.input.destroy();
-        storageBuffers.output.destroy();
+        storageBuffers.state.destroy();
+        storageBuffers.vertices.destroy();
         uniformBuffer.destroy();
         context.device.destroyPipelineLayout(pipelineLayout, nullptr);
         context.device.destroyDescriptorSetLayout(descriptorSetLayout, nullptr);
         context.device.destroyPipeline(pipeline);
+        context.device.destroyPipeline(tiledPipeline);
         context.device.destroyDescriptorPool(descriptorPool);
         context.device.freeCommandBuffers(commandPool, commandBuffers);
         Parent::destroy();
@@ -93,13 +127,15 @@ struct Compute : public vkx::Compute {
         descriptorSets[0] = device.allocateDescriptorSets(allocInfo)[0];
         descriptorSets[1] = device.allocateDescriptorSets(allocInfo)[0];
 
+        const vk::DescriptorBufferInfo input = storageBuffers.state.descriptor(0);
+        const vk::DescriptorBufferInfo output = storageBuffers.state.descriptor(1);
         std::vector<vk::WriteDescriptorSet> computeWriteDescriptorSets{
-            { descriptorSets[0], 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &storageBuffers.input.descriptor },
-            { descriptorSets[0], 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &storageBuffers.output.descriptor },
+            { descriptorSets[0], 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &input },
+            { descriptorSets[0], 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &output },
             { descriptorSets[0], 2, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffer.descriptor },
 
-            { descriptorSets[1], 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &storageBuffers.output.descriptor },
-            { descriptorSets[1], 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &storageBuffers.input.descriptor },
+            { descriptorSets[1], 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &output },
+            { descriptorSets[1], 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &input },
             { descriptorSets[1], 2, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffer.descriptor },
         };
 
@@ -118,49 +154,76 @@ struct Compute : public vkx::Compute {
             vks::shaders::loadShader(context.device, vkx::getAssetPath() + "shaders/computecloth/cloth.comp.spv", vk::ShaderStageFlagBits::eCompute);
         pipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
         device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+
+        // The substeps per dispatch size the halo of the tiles, so they are baked into the shader
+        const vk::SpecializationMapEntry specializationEntry{ 0, 0, sizeof(uint32_t) };
+        const uint32_t tileSubsteps = TILE_SUBSTEPS;
+        const vk::SpecializationInfo specializationInfo{ 1, &specializationEntry, sizeof(uint32_t), &tileSubsteps };
+        computePipelineCreateInfo.stage =
+            vks::shaders::loadShader(context.device, vkx::getAssetPath() + "shaders/computecloth/cloth_tiled.comp.spv", vk::ShaderStageFlagBits::eCompute);
+        computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+        tiledPipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+    }
+
+    // Dispatches per submission, an even number so the last one writes the output
+    uint32_t dispatchCount() const {
+        const uint32_t perDispatch = solver == Solver::Tiled ? TILE_SUBSTEPS : 1;
+        const uint32_t dispatches = std::max(1u, (substeps + perDispatch - 1) / perDispatch);
+        return dispatches + dispatches % 2;
+    }
+
+    // Re-record the command buffers after changing the solver or the substeps
+    void rebuildCommandBuffers() {
+        queue.waitIdle();
+        buildCommandBuffer();
     }
 
     void buildCommandBuffer() {
-        for (const auto& cmdBuf : commandBuffers) {
-            cmdBuf.begin({ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
-
-            std::vector<vk::BufferMemoryBarrier> bufferBarriers;
-            {
-                vk::BufferMemoryBarrier bufferBarrier;
-                bufferBarrier.srcAccessMask = vk::AccessFlagBits::eShaderRead;
-                bufferBarrier.dstAccessMask = vk::AccessFlagBits::eShaderWrite;
-                bufferBarrier.srcQueueFamilyIndex = context.queueIndices.graphics;
-                bufferBarrier.dstQueueFamilyIndex = context.queueIndices.compute;
-                bufferBarrier.size = VK_WHOLE_SIZE;
-
-                bufferBarrier.buffer = storageBuffers.input.buffer;
-                bufferBarriers.push_back(bufferBarrier);
-                bufferBarrier.buffer = storageBuffers.output.buffer;
-                bufferBarriers.push_back(bufferBarrier);
-            }
-            cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, bufferBarriers, nullptr);
-            cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        // Only this queue touches the simulation state, so plain memory barriers order the iterations
+        const vk::MemoryBarrier computeBarrier{ vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eShaderRead,
+                                                vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eShaderRead };
+        const vk::MemoryBarrier copyBarrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eTransferRead };
+        for (uint32_t slot = 0; slot < SLOT_COUNT; ++slot) {
+            const auto& cmdBuf = commandBuffers[slot];
+            beginCommandBuffer(cmdBuf, slot);
+
+            // The previous submission's iterations are done with the state
+            cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, computeBarrier, nullptr, nullptr);
+            const bool tiled = solver == Solver::Tiled;
+            cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, tiled ? tiledPipeline : pipeline);
             uint32_t calculateNormals = 0;
             cmdBuf.pushConstants<uint32_t>(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, calculateNormals);
 
+            // Tiles overlap, every one of them writes its interior
+            const uint32_t groupSize = tiled ? TILE_SIZE - 2 * TILE_SUBSTEPS : 10;
+            const uint32_t groupsX = (cloth.gridsize.x + groupSize - 1) / groupSize;
+            const uint32_t groupsY = (cloth.gridsize.y + groupSize - 1) / groupSize;
+
             // Dispatch the compute job
-            const uint32_t iterations = 64;
+            const uint32_t iterations = dispatchCount();
             for (uint32_t j = 0; j < iterations; j++) {
-                readSet = 1 - readSet;
-                cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSets[readSet], nullptr);
+                cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSets[1 - j % 2], nullptr);
                 if (j == iterations - 1) {
                     calculateNormals = 1;
                     cmdBuf.pushConstants<uint32_t>(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, calculateNormals);
                 }
-                cmdBuf.dispatch(cloth.gridsize.x / 10, cloth.gridsize.y / 10, 1);
-                cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, bufferBarriers,
-                                       nullptr);
+                cmdBuf.dispatch(groupsX, groupsY, 1);
+                if (j + 1 < iterations) {
+                    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, computeBarrier, nullptr,
+                                           nullptr);
+                }
             }
-            cmdBuf.end();
+
+            // Publish the output for drawing
+            cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer, {}, copyBarrier, nullptr, nullptr);
+            const vk::BufferCopy copy{ storageBuffers.state.offset(1), storageBuffers.vertices.offset(slot), storageBuffers.vertices.slotSize };
+            cmdBuf.copyBuffer(storageBuffers.state.buffer.buffer, storageBuffers.vertices.buffer.buffer, copy);
+            endCommandBuffer(cmdBuf);
         }
     }
 
-    void submit() { Parent::submit(commandBuffers[readSet]); }
+    void submit() { Parent::submit(commandBuffers[writeSlot()]); }
 };
 
 class VulkanExample : public vkx::ExampleBase {
@@ -170,6 +233,8 @@ public:
     uint32_t sceneSetup = 0;
     uint32_t indexCount;
     bool simulateWind = false;
+    // Radius of the collider in the middle, the others are smaller and around it
+    const float colliderRadius = 0.5f;
 
     vks::texture::Texture2D textureCloth;
     vks::model::VertexLayout vertexLayout{ {
@@ -198,6 +263,8 @@ public:
     } graphics;
 
     Compute compute{ context };
+    // Draws of the cloth slot the last compute submission wrote, per swap chain image
+    vkx::SlotDraws<vk::DrawIndexedIndirectCommand> slotDraws;
 
     // SSBO cloth grid particle declaration
     struct Particle {
@@ -216,7 +283,20 @@ public:
         camera.setRotation(glm::vec3(-30.0f, -45.0f, 0.0f));
         camera.setTranslation(glm::vec3(0.0f, 0.0f, -3.5f));
         settings.overlay = true;
+        // Synchronize with the compute queue through queue timelines where the device supports them
+        context.enableTimelineSemaphores = true;
         srand((unsigned int)time(NULL));
+
+        const auto& args = vkx::getCommandLine();
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (args[i] == "--cloth-resolution" && i + 1 < args.size()) {
+                cloth.gridsize = glm::uvec2(std::max(2u, (uint32_t)std::stoul(args[++i])));
+            } else if (args[i] == "--substeps" && i + 1 < args.size()) {
+                compute.substeps = std::max(1u, (uint32_t)std::stoul(args[++i]));
+            } else if (args[i] == "--colliders" && i + 1 < args.size()) {
+                compute.ubo.colliderCount = (int32_t)std::min(Compute::MAX_COLLIDERS, (uint32_t)std::stoul(args[++i]));
+            }
+        }
     }
 
     ~VulkanExample() {
@@ -232,6 +312,7 @@ public:
 
         // Compute
         compute.destroy();
+        slotDraws.destroy();
     }
 
     // Enable physical device features required for this example
@@ -243,28 +324,34 @@ public:
 
     void loadAssets() override {
         textureCloth.loadFromFile(context, getAssetPath() + "textures/vulkan_cloth_rgba.ktx", vF::eR8G8B8A8Unorm);
-        modelSphere.loadFromFile(context, getAssetPath() + "models/geosphere.obj", vertexLayout, compute.ubo.sphereRadius * 0.05f);
+        // Scaled to a unit sphere, the colliders scale it to their radius
+        modelSphere.loadFromFile(context, getAssetPath() + "models/geosphere.obj", vertexLayout, 0.05f);
     }
 
     void updateDrawCommandBuffer(const vk::CommandBuffer& commandBuffer) override {
         commandBuffer.setViewport(0, viewport());
         commandBuffer.setScissor(0, scissor());
 
-        // Render sphere
-        if (sceneSetup == 0) {
+        // Render colliders
+        if (compute.ubo.colliderCount > 0) {
             commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, graphics.pipelines.sphere);
             commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, graphics.pipelineLayout, 0, graphics.descriptorSet, nullptr);
-            commandBuffer.bindIndexBuffer(modelSphere.indices.buffer, 0, vk::IndexType::eUint32);
+            commandBuffer.bindIndexBuffer(modelSphere.indices.buffer, 0, modelSphere.indexType);
             commandBuffer.bindVertexBuffers(0, modelSphere.vertices.buffer, { 0 });
-            commandBuffer.drawIndexed(modelSphere.indexCount, 1, 0, 0, 0);
+            for (int32_t i = 0; i < compute.ubo.colliderCount; ++i) {
+                commandBuffer.pushConstants<glm::vec4>(graphics.pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, compute.ubo.colliders[i]);
+                commandBuffer.drawIndexed(modelSphere.indexCount, 1, 0, 0, 0);
+            }
         }
 
         // Render cloth
         commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, graphics.pipelines.cloth);
         commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, graphics.pipelineLayout, 0, graphics.descriptorSet, nullptr);
         commandBuffer.bindIndexBuffer(graphics.indices.buffer, 0, vk::IndexType::eUint32);
-        commandBuffer.bindVertexBuffers(0, compute.storageBuffers.output.buffer, { 0 });
-        commandBuffer.drawIndexed(indexCount, 1, 0, 0, 0);
+        commandBuffer.bindVertexBuffers(0, compute.storageBuffers.vertices.buffer.buffer, { 0 });
+        // The vertex offset is the slot the last compute submission wrote
+        commandBuffer.drawIndexedIndirect(slotDraws.buffer.buffer, slotDraws.offset(commandBufferImage(commandBuffer)), 1,
+                                          sizeof(vk::DrawIndexedIndirectCommand));
     }
 
     // Setup and fill the compute shader storage buffers containing the particles
@@ -301,19 +388,18 @@ public:
                         particleBuffer[i + j * cloth.gridsize.y].pinned =
                             (i == 0) &&
                             ((j == 0) || (j == cloth.gridsize.x / 3) || (j == cloth.gridsize.x - cloth.gridsize.x / 3) || (j == cloth.gridsize.x - 1));
-                        // Remove sphere
-                        compute.ubo.spherePos.z = -10.0f;
                     }
                 }
+                // No colliders
+                compute.ubo.colliderCount = 0;
                 break;
             }
         }
 
-        vk::DeviceSize storageBufferSize = particleBuffer.size() * sizeof(Particle);
-
         // SSBO won't be changed on the host after upload so copy to device local memory
-        compute.storageBuffers.input = context.stageToDeviceBuffer(vBU::eVertexBuffer | vBU::eStorageBuffer, particleBuffer);
-        compute.storageBuffers.output = context.stageToDeviceBuffer(vBU::eVertexBuffer | vBU::eStorageBuffer, particleBuffer);
+        compute.particleCount = (uint32_t)particleBuffer.size();
+        compute.storageBuffers.state = compute.createSlotBuffer(vBU::eStorageBuffer | vBU::eTransferSrc, particleBuffer);
+        compute.storageBuffers.vertices = compute.createSlotBuffer(vBU::eVertexBuffer, particleBuffer);
 
         // Indices
         std::vector<uint32_t> indices;
@@ -346,7 +432,9 @@ public:
         };
 
         graphics.descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
-        graphics.pipelineLayout = device.createPipelineLayout(vk::PipelineLayoutCreateInfo{ {}, 1, &graphics.descriptorSetLayout });
+        // The collider drawn by the sphere pipeline
+        vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::vec4) };
+        graphics.pipelineLayout = device.createPipelineLayout(vk::PipelineLayoutCreateInfo{ {}, 1, &graphics.descriptorSetLayout, 1, &pushConstantRange });
 
         // Set
         graphics.descriptorSet = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{ descriptorPool, 1, &graphics.descriptorSetLayout })[0];
@@ -398,6 +486,7 @@ public:
         compute.ubo.restDistV = dy;
         compute.ubo.restDistD = sqrtf(dx * dx + dy * dy);
         compute.ubo.particleCount = cloth.gridsize;
+        setupColliders();
 
         updateComputeUBO();
 
@@ -406,6 +495,16 @@ public:
         updateGraphicsUBO();
     }
 
+    // One collider in the middle, the rest in a ring around it
+    void setupColliders() {
+        compute.ubo.colliders[0] = glm::vec4(0.0f, 0.0f, 0.0f, colliderRadius);
+        const uint32_t ringCount = Compute::MAX_COLLIDERS - 1;
+        for (uint32_t i = 0; i < ringCount; ++i) {
+            const float angle = 2.0f * (float)M_PI * i / ringCount;
+            compute.ubo.colliders[i + 1] = glm::vec4(cos(angle) * 0.9f, 0.1f, sin(angle) * 0.9f, colliderRadius * 0.4f);
+        }
+    }
+
     void updateComputeUBO() {
         if (!paused) {
             compute.ubo.deltaT = 0.000005f;
@@ -435,13 +534,21 @@ public:
     }
 
     void draw() override {
+        prepareFrame();
+        // The image's previous frame is done with its draw command, point it at the latest cloth
+        slotDraws.select(currentBuffer, compute.readSlot());
         // Submit graphics commands
-        ExampleBase::draw();
+        drawCurrentCommandBuffer();
+        submitFrame();
 
         static std::once_flag once;
-        std::call_once(once, [&] { addRenderWaitSemaphore(compute.semaphores.complete, vk::PipelineStageFlagBits::eComputeShader); });
+        if (!context.timelineSemaphoresEnabled) {
+            std::call_once(once, [&] { addRenderWaitSemaphore(compute.semaphores.complete, vk::PipelineStageFlagBits::eVertexInput); });
+        }
 
+        // Simulate the next frame while this one is drawn
         compute.submit();
+        compute.reportTimings(profiler);
     }
 
     void prepare() override {
@@ -451,9 +558,17 @@ public:
         setupDescriptorPool();
         setupLayoutsAndDescriptors();
         preparePipelines();
+        // The simulation of the next frame runs while the current one is drawn
+        compute.overlap = true;
         compute.prepare();
+        slotDraws.create(context, swapChain.imageCount, { indexCount, 1, 0, 0, 0 }, compute.particleCount);
         updateComputeUBO();
-        renderSignalSemaphores.push_back(compute.semaphores.ready);
+        if (context.timelineSemaphoresEnabled) {
+            // The draw reads the vertices the compute submission copied
+            addRenderWaitQueue(compute.queue, vk::PipelineStageFlagBits::eVertexInput);
+        } else {
+            renderSignalSemaphores.push_back(compute.semaphores.ready);
+        }
         buildCommandBuffers();
         prepared = true;
     }
@@ -465,9 +580,30 @@ public:
 
     void viewChanged() override { updateGraphicsUBO(); }
 
+    bool applyBenchmarkSweep(uint32_t value) override {
+        compute.substeps = std::max(1u, value);
+        compute.rebuildCommandBuffers();
+        return true;
+    }
+
     void OnUpdateUIOverlay() override {
         if (ui.header("Settings")) {
             ui.checkBox("Simulate wind", &simulateWind);
+            int32_t solver = (int32_t)compute.solver;
+            if (ui.comboBox("Solver", &solver, { "Global", "Tiled" })) {
+                compute.solver = (Compute::Solver)solver;
+                compute.rebuildCommandBuffers();
+            }
+            int32_t substeps = (int32_t)compute.substeps;
+            if (ui.sliderInt("Substeps", &substeps, 1, 256)) {
+                compute.substeps = (uint32_t)substeps;
+                compute.rebuildCommandBuffers();
+            }
+            // The collider draws are recorded in the command buffers
+            if (ui.sliderInt("Colliders", &compute.ubo.colliderCount, 0, (int32_t)Compute::MAX_COLLIDERS)) {
+                buildCommandBuffers();
+            }
+            ui.text("%u x %u particles", cloth.gridsize.x, cloth.gridsize.y);
         }
     }
 };
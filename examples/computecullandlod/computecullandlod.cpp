@@ -9,23 +9,46 @@
 
 #include <vulkanExampleBase.h>
 #include <vks/frustum.hpp>
+#include <vks/impostor.hpp>
+#include <vks/meshshading.hpp>
 
-// Total number of objects (^3) in the scene
+// Default number of objects in the scene, --instances <count> overrides it
 #if defined(__ANDROID__)
-#define OBJECT_COUNT 32
+#define DEFAULT_OBJECT_COUNT (32 * 32 * 32)
 #else
-#define OBJECT_COUNT 64
+#define DEFAULT_OBJECT_COUNT (64 * 64 * 64)
 #endif
 
 #define MAX_LOD_LEVEL 5
 
+// Objects at least this far from the camera are drawn as impostors instead of their last LOD, if enabled
+#define IMPOSTOR_DISTANCE 30.0f
+
+// Capacity of the compacted per-cluster draw list, further visible clusters are dropped
+#define MAX_CLUSTER_DRAWS (1024 * 1024)
+
+// Must match the local sizes of the shaders
+#define GENERATE_GROUP_SIZE 64
+#define CULL_GROUP_SIZE 16
+#define CLUSTER_CULL_GROUP_SIZE 64
+
+// Per-instance data block, written by generate.comp
+struct InstanceData {
+    glm::vec3 pos;
+    float scale;
+};
+
 // Resources for the compute part of the example
 struct Compute : public vkx::Compute {
     using Parent = vkx::Compute;
     Compute(const vks::Context& context)
         : vkx::Compute(context) {}
 
+    // Instances culled and drawn, up to the capacity the buffers were created with
     uint32_t objectCount = 0;
+    uint32_t objectCapacity = 0;
+    // Largest number of meshlets in any LOD, the cluster culling dispatch covers this many per instance
+    uint32_t maxMeshletCount = 0;
 
     struct {
         vks::model::Model lodObject;
@@ -41,22 +64,63 @@ struct Compute : public vkx::Compute {
     // Contains the indirect drawing commands
     vks::Buffer indirectCommandsBuffer;
     vks::Buffer indirectDrawCountBuffer;
+    // Cluster culling only, the meshlets of all LODs and the compacted draws for the visible ones
+    vks::Buffer meshletsBuffer;
+    vks::Buffer clusterDrawsBuffer;
+    // The indirect draw of the impostors, a VkDrawIndirectCommand, followed by the indices of the instances it draws
+    vks::Buffer impostorBuffer;
+
+    // Culling alternates between SLOT_COUNT copies of its command buffers, each with a profiler slot and a fence, so
+    // the timings of one can be collected while the other is in flight
+    struct Slot {
+        vk::CommandBuffer commandBuffer;
+        vk::CommandBuffer clusterCommandBuffer;
+        vk::Fence fence;
+        bool pending{ false };
+    };
+    std::array<Slot, SLOT_COUNT> slots;
+    uint32_t nextSlot{ 0 };
 
-    //vk::Fence fence;
-    vk::CommandBuffer commandBuffer;
     vk::DescriptorPool descriptorPool;
     vk::DescriptorSetLayout descriptorSetLayout;
     vk::DescriptorSet descriptorSet;
     vk::PipelineLayout pipelineLayout;
     vk::Pipeline pipeline;
 
+    // Per cluster culling, used instead of the above when the example's cluster culling is enabled
+    vk::DescriptorSet clusterDescriptorSet;
+    vk::Pipeline clusterPipeline;
+
+    // Fills the instance and indirect command buffers for the current object count
+    vk::DescriptorSetLayout generateSetLayout;
+    vk::DescriptorSet generateDescriptorSet;
+    vk::PipelineLayout generatePipelineLayout;
+    vk::Pipeline generatePipeline;
+
+    // Cluster culling needs clusterDrawsBuffer, which the example only creates if the device can consume it
+    bool hasClusterCulling() const { return (bool)clusterDrawsBuffer.buffer; }
+
+    // The first `objectCount` instances, which the shaders take the number of instances from
+    vk::DescriptorBufferInfo instanceDescriptor() const { return { instanceBuffer.buffer, 0, sizeof(InstanceData) * objectCount }; }
+    vk::DescriptorBufferInfo indirectCommandsDescriptor() const {
+        return { indirectCommandsBuffer.buffer, 0, sizeof(vk::DrawIndexedIndirectCommand) * objectCount };
+    }
+
     void prepare() override {
         Parent::prepare();
-        // Create a command buffer for compute operations
-        commandBuffer = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo{ commandPool, vk::CommandBufferLevel::ePrimary, 1 })[0];
+        // The parent only creates its profiler for timeline semaphores, culling collects it behind the slot fences
+        if (!profiler.enabled()) {
+            profiler.create(context.physicalDevice, device, context.queueIndices.compute, SLOT_COUNT, 4);
+        }
+        // Create command buffers for compute operations
+        auto commandBuffers = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo{ commandPool, vk::CommandBufferLevel::ePrimary, SLOT_COUNT * 2 });
+        for (uint32_t i = 0; i < SLOT_COUNT; ++i) {
+            slots[i].commandBuffer = commandBuffers[i * 2];
+            slots[i].clusterCommandBuffer = commandBuffers[i * 2 + 1];
+            slots[i].fence = device.createFence({});
+        }
         prepareDescriptors();
         preparePipeline();
-        buildCommandBuffer();
     }
 
     void destroy() override {
@@ -66,21 +130,31 @@ struct Compute : public vkx::Compute {
         uniformData.scene.destroy();
         indirectDrawCountBuffer.destroy();
         lodLevelsBuffers.destroy();
+        meshletsBuffer.destroy();
+        clusterDrawsBuffer.destroy();
+        impostorBuffer.destroy();
 
         device.destroy(pipelineLayout);
         device.destroy(descriptorSetLayout);
         device.destroy(pipeline);
+        device.destroy(clusterPipeline);
+        device.destroy(generatePipeline);
+        device.destroy(generatePipelineLayout);
+        device.destroy(generateSetLayout);
         device.destroy(descriptorPool);
-        device.freeCommandBuffers(commandPool, commandBuffer);
+        for (const auto& slot : slots) {
+            device.freeCommandBuffers(commandPool, { slot.commandBuffer, slot.clusterCommandBuffer });
+            device.destroy(slot.fence);
+        }
         Parent::destroy();
     }
 
     void prepareDescriptors() {
         std::vector<vk::DescriptorPoolSize> poolSizes = {
-            { vk::DescriptorType::eUniformBuffer, 1 },
-            { vk::DescriptorType::eStorageBuffer, 4 },
+            { vk::DescriptorType::eUniformBuffer, 2 },
+            { vk::DescriptorType::eStorageBuffer, 16 },
         };
-        descriptorPool = device.createDescriptorPool({ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
+        descriptorPool = device.createDescriptorPool({ {}, 3, (uint32_t)poolSizes.size(), poolSizes.data() });
 
         std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
             // Binding 0: Instance input data buffer
@@ -93,6 +167,10 @@ struct Compute : public vkx::Compute {
             { 3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
             // Binding 4: LOD info (input)
             { 4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 5: Meshlets (input, cluster culling only)
+            { 5, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 6: Impostor draw (output)
+            { 6, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
         };
 
         descriptorSetLayout =
@@ -103,21 +181,59 @@ struct Compute : public vkx::Compute {
 
         //// Create two descriptor sets with input and output buffers switched
         descriptorSet = device.allocateDescriptorSets(allocInfo)[0];
+        if (hasClusterCulling()) {
+            clusterDescriptorSet = device.allocateDescriptorSets(allocInfo)[0];
+        }
 
+        // Binding 0: Instance data (output), Binding 1: Indirect draw commands (output)
+        std::vector<vk::DescriptorSetLayoutBinding> generateBindings{
+            { 0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        };
+        generateSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)generateBindings.size(), generateBindings.data() });
+        vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(uint32_t) };
+        generatePipelineLayout = device.createPipelineLayout({ {}, 1, &generateSetLayout, 1, &pushConstantRange });
+        generateDescriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &generateSetLayout })[0];
+
+        updateDescriptors();
+    }
+
+    // The instance and draw ranges depend on the object count
+    void updateDescriptors() {
+        const vk::DescriptorBufferInfo instances = instanceDescriptor();
+        const vk::DescriptorBufferInfo indirectCommands = indirectCommandsDescriptor();
         std::vector<vk::WriteDescriptorSet> computeWriteDescriptorSets{
             // Binding 0: Instance input data buffer
-            { descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &instanceBuffer.descriptor },
+            { descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &instances },
             // Binding 1: Indirect draw command output buffer
-            { descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &indirectCommandsBuffer.descriptor },
+            { descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &indirectCommands },
             // Binding 2: Uniform buffer with global matrices
             { descriptorSet, 2, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.scene.descriptor },
             // Binding 3: Atomic counter (written in shader)
             { descriptorSet, 3, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &indirectDrawCountBuffer.descriptor },
             // Binding 4: LOD info
             { descriptorSet, 4, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &lodLevelsBuffers.descriptor },
+            // Binding 6: Impostor draw
+            { descriptorSet, 6, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &impostorBuffer.descriptor },
         };
 
         device.updateDescriptorSets(computeWriteDescriptorSets, nullptr);
+
+        if (hasClusterCulling()) {
+            // Same inputs, but the draws go to the compacted per-cluster list
+            for (auto& write : computeWriteDescriptorSets) {
+                write.dstSet = clusterDescriptorSet;
+            }
+            computeWriteDescriptorSets[1].pBufferInfo = &clusterDrawsBuffer.descriptor;
+            computeWriteDescriptorSets.push_back({ clusterDescriptorSet, 5, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &meshletsBuffer.descriptor });
+            device.updateDescriptorSets(computeWriteDescriptorSets, nullptr);
+        }
+
+        std::vector<vk::WriteDescriptorSet> generateWrites{
+            { generateDescriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &instances },
+            { generateDescriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &indirectCommands },
+        };
+        device.updateDescriptorSets(generateWrites, nullptr);
     }
 
     void preparePipeline() {
@@ -143,7 +259,7 @@ struct Compute : public vkx::Compute {
         specializationEntry.offset = 0;
         specializationEntry.size = sizeof(uint32_t);
 
-        uint32_t specializationData = static_cast<uint32_t>(models.lodObject.parts.size()) - 1;
+        uint32_t specializationData = models.lodObject.parts[0].lodCount - 1;
 
         vk::SpecializationInfo specializationInfo;
         specializationInfo.mapEntryCount = 1;
@@ -154,43 +270,796 @@ struct Compute : public vkx::Compute {
         computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
         pipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
         device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+
+        if (hasClusterCulling()) {
+            computePipelineCreateInfo.stage = vks::shaders::loadShader(context.device, vkx::getAssetPath() + "shaders/computecullandlod/clustercull.comp.spv",
+                                                                       vk::ShaderStageFlagBits::eCompute);
+            computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+            clusterPipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+            device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+        }
+
+        computePipelineCreateInfo.layout = generatePipelineLayout;
+        computePipelineCreateInfo.stage =
+            vks::shaders::loadShader(context.device, vkx::getAssetPath() + "shaders/computecullandlod/generate.comp.spv", vk::ShaderStageFlagBits::eCompute);
+        generatePipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
     }
 
-    void buildCommandBuffer() {
+    // Lay out `count` objects on the device and (re)record the culling for them.  Nothing may be in flight
+    void setObjectCount(uint32_t count) {
+        objectCount = std::max(1u, std::min(count, objectCapacity));
+        updateDescriptors();
+        // The instances fill a cube of side^3 cells centered on the origin, completely for cubic counts
+        uint32_t side = (uint32_t)std::ceil(std::cbrt((double)objectCount));
+        while ((uint64_t)side * side * side < objectCount) {
+            ++side;
+        }
+        context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+            commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, generatePipeline);
+            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, generatePipelineLayout, 0, generateDescriptorSet, nullptr);
+            commandBuffer.pushConstants<uint32_t>(generatePipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, side);
+            const auto groups = vkx::workGroupCounts(context, objectCount, GENERATE_GROUP_SIZE);
+            commandBuffer.dispatch(groups[0], groups[1], 1);
+            const vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite,
+                                             vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndirectCommandRead };
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                          vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eDrawIndirect,
+                                          {}, barrier, nullptr, nullptr);
+        });
+        for (uint32_t slot = 0; slot < SLOT_COUNT; ++slot) {
+            buildCommandBuffer(slot);
+            if (hasClusterCulling()) {
+                buildClusterCommandBuffer(slot);
+            }
+        }
+    }
+
+    void buildCommandBuffer(uint32_t slot) {
+        const auto& commandBuffer = slots[slot].commandBuffer;
         commandBuffer.begin({ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
+        profiler.beginCommandBuffer(commandBuffer, slot);
+        profiler.beginScope(commandBuffer, "Cull");
 
         // Add memory barrier to ensure that the indirect commands have been consumed before the compute shader updates them
         vk::BufferMemoryBarrier bufferBarrier;
         bufferBarrier.buffer = indirectCommandsBuffer.buffer;
-        bufferBarrier.size = indirectCommandsBuffer.descriptor.range;
+        bufferBarrier.size = indirectCommandsDescriptor().range;
         bufferBarrier.srcAccessMask = vk::AccessFlagBits::eIndirectCommandRead;
         bufferBarrier.dstAccessMask = vk::AccessFlagBits::eShaderWrite;
         bufferBarrier.srcQueueFamilyIndex = context.queueIndices.graphics;
         bufferBarrier.dstQueueFamilyIndex = context.queueIndices.compute;
         commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, bufferBarrier, nullptr);
+        recordImpostorReset(commandBuffer);
         commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
         commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
 
         // Dispatch the compute job
         // The compute shader will do the frustum culling and adjust the indirect draw calls depending on object visibility.
         // It also determines the lod to use depending on distance to the viewer.
-        commandBuffer.dispatch(objectCount / 16, 1, 1);
+        const auto groups = vkx::workGroupCounts(context, objectCount, CULL_GROUP_SIZE);
+        commandBuffer.dispatch(groups[0], groups[1], 1);
 
         // Add memory barrier to ensure that the compute shader has finished writing the indirect command buffer before it's consumed
         std::swap(bufferBarrier.srcAccessMask, bufferBarrier.dstAccessMask);
         std::swap(bufferBarrier.srcQueueFamilyIndex, bufferBarrier.dstQueueFamilyIndex);
         commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect, {}, nullptr, bufferBarrier, nullptr);
+        recordImpostorRelease(commandBuffer);
 
         // todo: barrier for indirect stats buffer?
+        profiler.endScope(commandBuffer);
+        profiler.endCommandBuffer(commandBuffer);
         commandBuffer.end();
     }
 
-    void submit() { Parent::submit(commandBuffer); }
+    void buildClusterCommandBuffer(uint32_t slot) {
+        const auto& clusterCommandBuffer = slots[slot].clusterCommandBuffer;
+        clusterCommandBuffer.begin({ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
+        profiler.beginCommandBuffer(clusterCommandBuffer, slot);
+        profiler.beginScope(clusterCommandBuffer, "Cull");
+        // Both the draws and their count are consumed by the previous frame's vkCmdDrawIndexedIndirectCountKHR
+        std::array<vk::BufferMemoryBarrier, 2> bufferBarriers;
+        bufferBarriers[0].buffer = clusterDrawsBuffer.buffer;
+        bufferBarriers[0].size = clusterDrawsBuffer.descriptor.range;
+        bufferBarriers[0].srcAccessMask = vk::AccessFlagBits::eIndirectCommandRead;
+        bufferBarriers[0].dstAccessMask = vk::AccessFlagBits::eShaderWrite;
+        bufferBarriers[1] = bufferBarriers[0];
+        bufferBarriers[1].buffer = indirectDrawCountBuffer.buffer;
+        bufferBarriers[1].size = indirectDrawCountBuffer.descriptor.range;
+        bufferBarriers[1].dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+        for (auto& barrier : bufferBarriers) {
+            barrier.srcQueueFamilyIndex = context.queueIndices.graphics;
+            barrier.dstQueueFamilyIndex = context.queueIndices.compute;
+        }
+        clusterCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect, vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer,
+                                             {}, nullptr, bufferBarriers, nullptr);
+
+        // The draws are appended through an atomic counter, so it has to start at zero
+        clusterCommandBuffer.fillBuffer(indirectDrawCountBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+        vk::BufferMemoryBarrier clearBarrier;
+        clearBarrier.buffer = indirectDrawCountBuffer.buffer;
+        clearBarrier.size = indirectDrawCountBuffer.descriptor.range;
+        clearBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        clearBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+        clusterCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, clearBarrier, nullptr);
+        recordImpostorReset(clusterCommandBuffer);
+
+        clusterCommandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, clusterPipeline);
+        clusterCommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, clusterDescriptorSet, nullptr);
+
+        // One invocation per instance and cluster of its LOD.  Each does the object test and LOD selection of cull.comp,
+        // then frustum and backface cone tests the cluster's bounds and appends a draw if it survives.  The instances
+        // continue in z once there are too many workgroups for x.
+        const auto groups = vkx::workGroupCounts(context, objectCount, CLUSTER_CULL_GROUP_SIZE);
+        clusterCommandBuffer.dispatch(groups[0], maxMeshletCount, groups[1]);
+
+        for (auto& barrier : bufferBarriers) {
+            barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+            barrier.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead;
+            std::swap(barrier.srcQueueFamilyIndex, barrier.dstQueueFamilyIndex);
+        }
+        clusterCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect, {}, nullptr, bufferBarriers,
+                                             nullptr);
+        recordImpostorRelease(clusterCommandBuffer);
+        profiler.endScope(clusterCommandBuffer);
+        profiler.endCommandBuffer(clusterCommandBuffer);
+        clusterCommandBuffer.end();
+    }
+
+    // The culling appends the impostors through the instance count of their draw, so it has to start at zero.  The
+    // buffer is taken over from the previous frame's draws first, as the other draw buffers are
+    void recordImpostorReset(const vk::CommandBuffer& commandBuffer) const {
+        vk::BufferMemoryBarrier barrier;
+        barrier.buffer = impostorBuffer.buffer;
+        barrier.size = VK_WHOLE_SIZE;
+        barrier.srcAccessMask = vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eShaderRead;
+        barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+        barrier.srcQueueFamilyIndex = context.queueIndices.graphics;
+        barrier.dstQueueFamilyIndex = context.queueIndices.compute;
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, barrier, nullptr);
+        const vk::DrawIndirectCommand draw{ vks::model::Impostor::QUAD_VERTEX_COUNT, 0, 0, 0 };
+        commandBuffer.updateBuffer(impostorBuffer.buffer, 0, sizeof(draw), &draw);
+        barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, barrier, nullptr);
+    }
+
+    // Hand the impostor draw back to the graphics queue, whose vertex shaders read the instance indices
+    void recordImpostorRelease(const vk::CommandBuffer& commandBuffer) const {
+        vk::BufferMemoryBarrier barrier;
+        barrier.buffer = impostorBuffer.buffer;
+        barrier.size = VK_WHOLE_SIZE;
+        barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+        barrier.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eShaderRead;
+        barrier.srcQueueFamilyIndex = context.queueIndices.compute;
+        barrier.dstQueueFamilyIndex = context.queueIndices.graphics;
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect, {}, nullptr, barrier, nullptr);
+    }
+
+    // Submit the culling for the next frame, which signals semaphores.complete
+    void submit(bool cluster) {
+        const uint32_t index = nextSlot;
+        nextSlot = (nextSlot + 1) % SLOT_COUNT;
+        auto& slot = slots[index];
+        if (slot.pending) {
+            // Usually long done, the frame that waited for it has been drawn since
+            device.waitForFences(slot.fence, VK_TRUE, UINT64_MAX);
+            device.resetFences(slot.fence);
+            profiler.collect(index);
+        }
+        vk::SubmitInfo computeSubmitInfo;
+        computeSubmitInfo.commandBufferCount = 1;
+        computeSubmitInfo.pCommandBuffers = cluster ? &slot.clusterCommandBuffer : &slot.commandBuffer;
+        computeSubmitInfo.signalSemaphoreCount = 1;
+        computeSubmitInfo.pSignalSemaphores = &semaphores.complete;
+        context.submitBatched(queue, computeSubmitInfo, slot.fence);
+        slot.pending = true;
+    }
+
+    // Add the latest culling time to the reports of `graphics`
+    void reportCullTime(vks::debug::GpuProfiler& graphics) {
+        if (profiler.getCollectionCount() != cullCollections && !profiler.getScopes().empty()) {
+            cullCollections = profiler.getCollectionCount();
+            graphics.report("Cull", profiler.getScopes()[0].lastMilliseconds);
+        }
+    }
+
+private:
+    uint64_t cullCollections{ 0 };
+};
+
+// Two phase occlusion culling against a depth pyramid.  Both phases surround draws, so unlike the culling above it
+// is recorded into the draw command buffers: the early phase draws what was visible last frame, the pyramid is
+// reduced from the depth that leaves, and the late phase tests everything in the frustum against it and hands the
+// objects the early phase missed to the main render pass.  Draws are compacted and their counts never leave the
+// device, the statistics are copied back once the frame is done.
+struct OcclusionCulling {
+    OcclusionCulling(const vks::Context& context)
+        : context(context) {}
+
+    // Same layout as the Counts block of occlusioncull.comp
+    struct Counts {
+        uint32_t earlyCount;
+        uint32_t lateCount;
+        uint32_t lodCount[MAX_LOD_LEVEL + 1];
+    };
+
+    struct PushConstants {
+        glm::vec2 depthSize;
+        uint32_t phase;
+        float objectRadius;
+        uint32_t pyramidLevels;
+    };
+
+    const vks::Context& context;
+    const vk::Device& device{ context.device };
+
+    uint32_t objectCount{ 0 };
+    // The draw count limit of both phases
+    uint32_t maxDrawCount{ 0 };
+    // Bounding sphere radius of the model, before the instance scale
+    float objectRadius{ 0.0f };
+
+    // The early pass clears and keeps the depth for the pyramid, the late pass is the example's main render pass
+    vk::RenderPass earlyPass;
+    vk::RenderPass latePass;
+
+    vks::Buffer earlyDraws;
+    vks::Buffer lateDraws;
+    vks::Buffer counts;
+    // One per instance, set by the late phase
+    vks::Buffer visibility;
+    // Counts of the last frame drawn to each swap chain image
+    vks::Buffer readback;
+
+    // Level 0 is half the size of the depth buffer, rounded up, and every texel holds the farthest depth it covers
+    vks::Image pyramid;
+    std::vector<vk::ImageView> levelViews;
+    uint32_t levelCount{ 0 };
+    vk::Extent2D depthSize;
+    // The depth aspect of the depth buffer, for level 0 to read
+    vk::ImageView depthView;
+    vk::Sampler sampler;
+
+    vk::DescriptorSetLayout pyramidSetLayout;
+    vk::PipelineLayout pyramidPipelineLayout;
+    vk::Pipeline pyramidPipeline;
+    vk::DescriptorPool pyramidDescriptorPool;
+    std::vector<vk::DescriptorSet> pyramidSets;
+
+    vk::DescriptorPool descriptorPool;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::DescriptorSet descriptorSet;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline pipeline;
+
+    void createRenderPasses(vk::Format colorFormat, vk::Format depthFormat) {
+        earlyPass = createRenderPass(colorFormat, depthFormat, true);
+        latePass = createRenderPass(colorFormat, depthFormat, false);
+    }
+
+    // Buffers are sized for compute.objectCapacity, see setObjectCount
+    void prepare(const Compute& compute, uint32_t imageCount) {
+        const auto& dim = compute.models.lodObject.dim;
+        objectRadius = std::max(glm::length(dim.min), glm::length(dim.max));
+
+        const vk::DeviceSize drawsSize = sizeof(vk::DrawIndexedIndirectCommand) * compute.objectCapacity;
+        earlyDraws = context.createDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer, drawsSize);
+        lateDraws = context.createDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer, drawsSize);
+        counts = context.createDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer |
+                                                vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+                                            sizeof(Counts));
+        visibility = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                                sizeof(uint32_t) * compute.objectCapacity);
+        readback = context.createBuffer(vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                        sizeof(Counts) * imageCount);
+        readback.map();
+        memset(readback.mapped, 0, sizeof(Counts) * imageCount);
+
+        vk::SamplerCreateInfo samplerCreateInfo;
+        samplerCreateInfo.magFilter = vk::Filter::eNearest;
+        samplerCreateInfo.minFilter = vk::Filter::eNearest;
+        samplerCreateInfo.mipmapMode = vk::SamplerMipmapMode::eNearest;
+        samplerCreateInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+        samplerCreateInfo.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+        samplerCreateInfo.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+        samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
+        sampler = device.createSampler(samplerCreateInfo);
+
+        preparePyramidPipeline();
+        prepareCullPipeline(compute);
+    }
+
+    void destroy() {
+        destroyPyramid();
+        earlyDraws.destroy();
+        lateDraws.destroy();
+        counts.destroy();
+        visibility.destroy();
+        readback.destroy();
+        device.destroy(sampler);
+        device.destroy(pyramidPipeline);
+        device.destroy(pyramidPipelineLayout);
+        device.destroy(pyramidSetLayout);
+        device.destroy(pipeline);
+        device.destroy(pipelineLayout);
+        device.destroy(descriptorSetLayout);
+        device.destroy(descriptorPool);
+        device.destroy(earlyPass);
+        device.destroy(latePass);
+    }
+
+    // Follow compute.objectCount, after Compute::setObjectCount.  Nothing may be in flight
+    void setObjectCount(const Compute& compute) {
+        objectCount = compute.objectCount;
+        maxDrawCount = std::min(objectCount, context.deviceProperties.limits.maxDrawIndirectCount);
+        const vk::DescriptorBufferInfo instances = compute.instanceDescriptor();
+        const vk::DescriptorBufferInfo visible{ visibility.buffer, 0, sizeof(uint32_t) * objectCount };
+        std::vector<vk::WriteDescriptorSet> writes{
+            { descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &instances },
+            { descriptorSet, 6, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &visible },
+        };
+        device.updateDescriptorSets(writes, nullptr);
+        // Nothing is visible before the first frame, which draws everything in the frustum in the late pass
+        context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+            commandBuffer.fillBuffer(visibility.buffer, 0, VK_WHOLE_SIZE, 0);
+            const vk::MemoryBarrier barrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+        });
+    }
+
+    // (Re)create the pyramid for the current depth buffer
+    void resize(const vks::Image& depthStencil, vk::Format depthFormat) {
+        destroyPyramid();
+        depthSize = vk::Extent2D{ depthStencil.extent.width, depthStencil.extent.height };
+        const vk::Extent2D baseSize{ (depthSize.width + 1) / 2, (depthSize.height + 1) / 2 };
+        levelCount = 1;
+        for (vk::Extent2D levelSize = baseSize; levelSize.width > 1 || levelSize.height > 1; ++levelCount) {
+            levelSize = vk::Extent2D{ (levelSize.width + 1) / 2, (levelSize.height + 1) / 2 };
+        }
+
+        vk::ImageCreateInfo imageCreateInfo;
+        imageCreateInfo.imageType = vk::ImageType::e2D;
+        imageCreateInfo.format = vk::Format::eR32Sfloat;
+        imageCreateInfo.extent = vk::Extent3D{ baseSize.width, baseSize.height, 1 };
+        imageCreateInfo.mipLevels = levelCount;
+        imageCreateInfo.arrayLayers = 1;
+        imageCreateInfo.usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled;
+        pyramid = context.createImage(imageCreateInfo);
+        // Written and read in the general layout only
+        const vk::ImageSubresourceRange levels{ vk::ImageAspectFlagBits::eColor, 0, levelCount, 0, 1 };
+        context.setImageLayout(pyramid.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, levels);
+        vk::ImageViewCreateInfo viewCreateInfo{ {}, pyramid.image, vk::ImageViewType::e2D, vk::Format::eR32Sfloat, {}, levels };
+        pyramid.view = device.createImageView(viewCreateInfo);
+        viewCreateInfo.subresourceRange.levelCount = 1;
+        for (uint32_t level = 0; level < levelCount; ++level) {
+            viewCreateInfo.subresourceRange.baseMipLevel = level;
+            levelViews.push_back(device.createImageView(viewCreateInfo));
+        }
+        depthView = device.createImageView(
+            { {}, depthStencil.image, vk::ImageViewType::e2D, depthFormat, {}, { vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1 } });
+
+        // One set per level, reading the level before it
+        std::vector<vk::DescriptorPoolSize> poolSizes{
+            { vk::DescriptorType::eCombinedImageSampler, levelCount },
+            { vk::DescriptorType::eStorageImage, levelCount },
+        };
+        pyramidDescriptorPool = device.createDescriptorPool({ {}, levelCount, (uint32_t)poolSizes.size(), poolSizes.data() });
+        const std::vector<vk::DescriptorSetLayout> layouts(levelCount, pyramidSetLayout);
+        pyramidSets = device.allocateDescriptorSets({ pyramidDescriptorPool, levelCount, layouts.data() });
+
+        std::vector<vk::DescriptorImageInfo> imageInfos;
+        imageInfos.reserve(levelCount * 2 + 1);
+        std::vector<vk::WriteDescriptorSet> writes;
+        for (uint32_t level = 0; level < levelCount; ++level) {
+            if (level == 0) {
+                imageInfos.push_back({ sampler, depthView, vk::ImageLayout::eDepthStencilReadOnlyOptimal });
+            } else {
+                imageInfos.push_back({ sampler, levelViews[level - 1], vk::ImageLayout::eGeneral });
+            }
+            writes.push_back({ pyramidSets[level], 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &imageInfos.back() });
+            imageInfos.push_back({ nullptr, levelViews[level], vk::ImageLayout::eGeneral });
+            writes.push_back({ pyramidSets[level], 1, 0, 1, vk::DescriptorType::eStorageImage, &imageInfos.back() });
+        }
+        // The late phase reads the whole pyramid
+        imageInfos.push_back({ sampler, pyramid.view, vk::ImageLayout::eGeneral });
+        writes.push_back({ descriptorSet, 7, 0, 1, vk::DescriptorType::eCombinedImageSampler, &imageInfos.back() });
+        device.updateDescriptorSets(writes, nullptr);
+    }
+
+    // Start of the frame.  The previous frame's draws, statistics copy and late phase must be done with what is
+    // rewritten here, and the counts start at zero.
+    void recordReset(const vk::CommandBuffer& commandBuffer) const {
+        const vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite,
+                                         vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer,
+                                      vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+        commandBuffer.fillBuffer(counts.buffer, 0, VK_WHOLE_SIZE, 0);
+        const vk::MemoryBarrier clearBarrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, clearBarrier, nullptr, nullptr);
+    }
+
+    // Fill the draws of `phase`, 0 for the early and 1 for the late phase.  The late phase needs the pyramid
+    void recordCull(const vk::CommandBuffer& commandBuffer, uint32_t phase) const {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
+        const PushConstants pushConstants{ glm::vec2(depthSize.width, depthSize.height), phase, objectRadius, levelCount };
+        commandBuffer.pushConstants<PushConstants>(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushConstants);
+        const auto groups = vkx::workGroupCounts(context, objectCount, 64);
+        commandBuffer.dispatch(groups[0], groups[1], 1);
+        // Consumed by the draws of the phase, and the statistics are added to by the next one
+        const vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite,
+                                         vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eComputeShader,
+                                      {}, barrier, nullptr, nullptr);
+    }
+
+    // Draw the objects of a phase, with the plants pipeline and buffers bound
+    void recordDraw(const vk::CommandBuffer& commandBuffer, uint32_t phase) const {
+        const vk::DeviceSize countOffset = phase == 0 ? offsetof(Counts, earlyCount) : offsetof(Counts, lateCount);
+        commandBuffer.drawIndexedIndirectCountKHR(phase == 0 ? earlyDraws.buffer : lateDraws.buffer, 0, counts.buffer, countOffset, maxDrawCount,
+                                                  sizeof(VkDrawIndexedIndirectCommand), context.dynamicDispatch);
+    }
+
+    // Reduce the depth of the early pass, which leaves it in the read only layout
+    void recordPyramid(const vk::CommandBuffer& commandBuffer) const {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pyramidPipeline);
+        const vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead };
+        vk::Extent2D levelSize = depthSize;
+        for (uint32_t level = 0; level < levelCount; ++level) {
+            levelSize = vk::Extent2D{ (levelSize.width + 1) / 2, (levelSize.height + 1) / 2 };
+            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pyramidPipelineLayout, 0, pyramidSets[level], nullptr);
+            commandBuffer.dispatch((levelSize.width + 7) / 8, (levelSize.height + 7) / 8, 1);
+            // Read by the next level, and all of them by the late phase
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+        }
+    }
+
+    // Copy the counts for readbackCounts(image), after the draws of the late pass
+    void recordReadback(const vk::CommandBuffer& commandBuffer, uint32_t image) const {
+        const vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eTransferRead };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer, {}, barrier, nullptr, nullptr);
+        commandBuffer.copyBuffer(counts.buffer, readback.buffer, vk::BufferCopy{ 0, sizeof(Counts) * image, sizeof(Counts) });
+        const vk::MemoryBarrier hostBarrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, hostBarrier, nullptr, nullptr);
+    }
+
+    // Valid once the image has been acquired again, which means its previous frame has completed
+    const Counts& readbackCounts(uint32_t image) const { return static_cast<const Counts*>(readback.mapped)[image]; }
+
+private:
+    vk::RenderPass createRenderPass(vk::Format colorFormat, vk::Format depthFormat, bool early) const {
+        std::array<vk::AttachmentDescription, 2> attachments;
+        attachments[0].format = colorFormat;
+        attachments[0].loadOp = early ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad;
+        attachments[0].storeOp = vk::AttachmentStoreOp::eStore;
+        attachments[0].initialLayout = early ? vk::ImageLayout::eUndefined : vk::ImageLayout::eColorAttachmentOptimal;
+        attachments[0].finalLayout = early ? vk::ImageLayout::eColorAttachmentOptimal : vk::ImageLayout::ePresentSrcKHR;
+        attachments[1].format = depthFormat;
+        attachments[1].loadOp = early ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad;
+        attachments[1].storeOp = early ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
+        attachments[1].stencilLoadOp = early ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eDontCare;
+        attachments[1].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+        // The pyramid reads the depth between the two passes
+        attachments[1].initialLayout = early ? vk::ImageLayout::eUndefined : vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+        attachments[1].finalLayout = early ? vk::ImageLayout::eDepthStencilReadOnlyOptimal : vk::ImageLayout::eDepthStencilAttachmentOptimal;
+
+        const vk::AttachmentReference colorReference{ 0, vk::ImageLayout::eColorAttachmentOptimal };
+        const vk::AttachmentReference depthReference{ 1, vk::ImageLayout::eDepthStencilAttachmentOptimal };
+        vk::SubpassDescription subpass;
+        subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &colorReference;
+        subpass.pDepthStencilAttachment = &depthReference;
+
+        // Against the attachment writes of the pass before, the present wait on the color attachment output, and
+        // the pyramid reading the depth in between
+        using vPSFB = vk::PipelineStageFlagBits;
+        using vAFB = vk::AccessFlagBits;
+        const vk::PipelineStageFlags attachmentStages = vPSFB::eColorAttachmentOutput | vPSFB::eEarlyFragmentTests | vPSFB::eLateFragmentTests;
+        const vk::AccessFlags attachmentWrites = vAFB::eColorAttachmentWrite | vAFB::eDepthStencilAttachmentWrite;
+        const vk::AccessFlags attachmentAccess = attachmentWrites | vAFB::eColorAttachmentRead | vAFB::eDepthStencilAttachmentRead;
+        std::array<vk::SubpassDependency, 2> dependencies{ {
+            { VK_SUBPASS_EXTERNAL, 0, attachmentStages | vPSFB::eComputeShader, attachmentStages, attachmentWrites, attachmentAccess },
+            { 0, VK_SUBPASS_EXTERNAL, attachmentStages, attachmentStages | vPSFB::eComputeShader, attachmentWrites, attachmentAccess | vAFB::eShaderRead },
+        } };
+
+        vk::RenderPassCreateInfo renderPassInfo;
+        renderPassInfo.attachmentCount = (uint32_t)attachments.size();
+        renderPassInfo.pAttachments = attachments.data();
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = (uint32_t)dependencies.size();
+        renderPassInfo.pDependencies = dependencies.data();
+        return device.createRenderPass(renderPassInfo);
+    }
+
+    void preparePyramidPipeline() {
+        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+            // Binding 0: The level before, or the depth buffer
+            { 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 1: The level written
+            { 1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute },
+        };
+        pyramidSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+        pyramidPipelineLayout = device.createPipelineLayout({ {}, 1, &pyramidSetLayout });
+
+        vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+        computePipelineCreateInfo.layout = pyramidPipelineLayout;
+        computePipelineCreateInfo.stage =
+            vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/computecullandlod/depthpyramid.comp.spv", vk::ShaderStageFlagBits::eCompute);
+        pyramidPipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+    }
+
+    void prepareCullPipeline(const Compute& compute) {
+        std::vector<vk::DescriptorPoolSize> poolSizes = {
+            { vk::DescriptorType::eUniformBuffer, 1 },
+            { vk::DescriptorType::eStorageBuffer, 6 },
+            { vk::DescriptorType::eCombinedImageSampler, 1 },
+        };
+        descriptorPool = device.createDescriptorPool({ {}, 1, (uint32_t)poolSizes.size(), poolSizes.data() });
+
+        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+            // Binding 0: Instance input data buffer
+            { 0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 1: Early draws (output)
+            { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 2: Uniform buffer with global matrices (input)
+            { 2, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 3: Draw counts and stats (output)
+            { 3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 4: LOD info (input)
+            { 4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 5: Late draws (output)
+            { 5, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 6: Visibility of the last frame
+            { 6, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 7: Depth pyramid, written by resize()
+            { 7, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute },
+        };
+        descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+        vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants) };
+        pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout, 1, &pushConstantRange });
+        descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+
+        // The instances and visibility are written by setObjectCount
+        std::vector<vk::WriteDescriptorSet> writes{
+            { descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &earlyDraws.descriptor },
+            { descriptorSet, 2, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &compute.uniformData.scene.descriptor },
+            { descriptorSet, 3, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &counts.descriptor },
+            { descriptorSet, 4, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &compute.lodLevelsBuffers.descriptor },
+            { descriptorSet, 5, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &lateDraws.descriptor },
+        };
+        device.updateDescriptorSets(writes, nullptr);
+
+        // Max. level of detail, as for cull.comp
+        uint32_t specializationData = compute.models.lodObject.parts[0].lodCount - 1;
+        vk::SpecializationMapEntry specializationEntry{ 0, 0, sizeof(uint32_t) };
+        vk::SpecializationInfo specializationInfo{ 1, &specializationEntry, sizeof(specializationData), &specializationData };
+        vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+        computePipelineCreateInfo.layout = pipelineLayout;
+        computePipelineCreateInfo.stage =
+            vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/computecullandlod/occlusioncull.comp.spv", vk::ShaderStageFlagBits::eCompute);
+        computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+        pipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+    }
+
+    void destroyPyramid() {
+        for (const auto& view : levelViews) {
+            device.destroy(view);
+        }
+        levelViews.clear();
+        pyramid.destroy();
+        device.destroy(depthView);
+        depthView = nullptr;
+        device.destroy(pyramidDescriptorPool);
+        pyramidDescriptorPool = nullptr;
+        pyramidSets.clear();
+    }
+};
+
+// Task and mesh shader drawing of the meshlets, in place of the indirect draws above.  Each task shader workgroup
+// does the object test and LOD selection of cluster culling for one instance, then tests a run of the LOD's meshlets
+// against the frustum, their normal cones and, in the late pass of occlusion culling, the depth pyramid.  The
+// survivors get a mesh shader workgroup each, which fetches the vertices from the model's vertex buffer itself.
+// Binds the visibility and pyramid of OcclusionCulling, so it needs that to be supported even when it's off.
+struct MeshShading {
+    MeshShading(const vks::Context& context)
+        : context(context) {}
+
+    // Must match TASK_GROUP_SIZE of meshlets.task
+    static const uint32_t TASK_GROUP_SIZE = 32;
+
+    // Same layout as the Stats block of meshlets.task, and as the example's indirectStats
+    struct Stats {
+        uint32_t drawCount;
+        uint32_t lodCount[MAX_LOD_LEVEL + 1];
+    };
+
+    struct PushConstants {
+        uint32_t firstGroup;
+        uint32_t groupsPerInstance;
+        glm::vec2 depthSize;
+        uint32_t phase;
+        float objectRadius;
+        uint32_t pyramidLevels;
+    };
+
+    const vks::Context& context;
+    const vk::Device& device{ context.device };
+
+    vks::model::MeshletGeometry geometry;
+    uint32_t objectCount{ 0 };
+    // Task shader workgroups per instance, enough for the meshlets of the largest LOD
+    uint32_t groupsPerInstance{ 0 };
+    // One Stats per swap chain image, at dynamic offsets of statsStride
+    vks::Buffer stats;
+    vk::DeviceSize statsStride{ 0 };
+
+    vk::DescriptorPool descriptorPool;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::DescriptorSet descriptorSet;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline pipeline;
+
+    // After OcclusionCulling::prepare, whose object radius the instance test uses
+    void prepare(const Compute& compute, const OcclusionCulling& occlusion, const vks::model::VertexLayout& vertexLayout, vk::RenderPass renderPass,
+                 uint32_t imageCount) {
+        const auto& model = compute.models.lodObject;
+        geometry.create(context, model);
+        groupsPerInstance = (compute.maxMeshletCount + TASK_GROUP_SIZE - 1) / TASK_GROUP_SIZE;
+
+        statsStride = vks::StagingRing::alignUp(sizeof(Stats), context.deviceProperties.limits.minStorageBufferOffsetAlignment);
+        stats = context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                     vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, statsStride * imageCount);
+        stats.map();
+        memset(stats.mapped, 0, statsStride * imageCount);
+
+        std::vector<vk::DescriptorPoolSize> poolSizes = {
+            { vk::DescriptorType::eUniformBuffer, 1 },
+            { vk::DescriptorType::eStorageBuffer, 8 },
+            { vk::DescriptorType::eStorageBufferDynamic, 1 },
+            { vk::DescriptorType::eCombinedImageSampler, 1 },
+        };
+        descriptorPool = device.createDescriptorPool({ {}, 1, (uint32_t)poolSizes.size(), poolSizes.data() });
+
+        const vk::ShaderStageFlags stages = vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT;
+        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+            // Binding 0: Instance input data buffer
+            { 0, vk::DescriptorType::eStorageBuffer, 1, stages },
+            // Binding 1: Uniform buffer with global matrices
+            { 1, vk::DescriptorType::eUniformBuffer, 1, stages },
+            // Binding 2: Stats of the swap chain image (output)
+            { 2, vk::DescriptorType::eStorageBufferDynamic, 1, stages },
+            // Binding 3: LOD info
+            { 3, vk::DescriptorType::eStorageBuffer, 1, stages },
+            // Bindings 4 to 7: Meshlets and their vertices and triangles, see vks::model::MeshletGeometry
+            { 4, vk::DescriptorType::eStorageBuffer, 1, stages },
+            { 5, vk::DescriptorType::eStorageBuffer, 1, stages },
+            { 6, vk::DescriptorType::eStorageBuffer, 1, stages },
+            { 7, vk::DescriptorType::eStorageBuffer, 1, stages },
+            // Binding 8: The model's vertices
+            { 8, vk::DescriptorType::eStorageBuffer, 1, stages },
+            // Binding 9: Visibility of occlusion culling
+            { 9, vk::DescriptorType::eStorageBuffer, 1, stages },
+            // Binding 10: Depth pyramid, written by setPyramid()
+            { 10, vk::DescriptorType::eCombinedImageSampler, 1, stages },
+        };
+        descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+        vk::PushConstantRange pushConstantRange{ stages, 0, sizeof(PushConstants) };
+        pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout, 1, &pushConstantRange });
+        descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+
+        // The instances and visibility are written by setObjectCount
+        const vk::DescriptorBufferInfo statsInfo{ stats.buffer, 0, sizeof(Stats) };
+        std::vector<vk::WriteDescriptorSet> writes{
+            { descriptorSet, 1, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &compute.uniformData.scene.descriptor },
+            { descriptorSet, 2, 0, 1, vk::DescriptorType::eStorageBufferDynamic, nullptr, &statsInfo },
+            { descriptorSet, 3, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &compute.lodLevelsBuffers.descriptor },
+            { descriptorSet, 4, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &geometry.meshlets.descriptor },
+            { descriptorSet, 5, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &geometry.ranges.descriptor },
+            { descriptorSet, 6, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &geometry.vertices.descriptor },
+            { descriptorSet, 7, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &geometry.triangles.descriptor },
+            { descriptorSet, 8, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &model.vertices.descriptor },
+        };
+        device.updateDescriptorSets(writes, nullptr);
+
+        // Max. level of detail for the task shader, the vertex layout in floats for the mesh shader
+        const uint32_t taskData = model.parts[0].lodCount - 1;
+        const vk::SpecializationMapEntry taskEntry{ 0, 0, sizeof(uint32_t) };
+        const vk::SpecializationInfo taskSpecialization{ 1, &taskEntry, sizeof(taskData), &taskData };
+        const uint32_t meshData[] = { vertexLayout.stride() / 4, vertexLayout.offset(0) / 4, vertexLayout.offset(1) / 4, vertexLayout.offset(2) / 4 };
+        std::array<vk::SpecializationMapEntry, 4> meshEntries;
+        for (uint32_t i = 0; i < meshEntries.size(); ++i) {
+            meshEntries[i] = vk::SpecializationMapEntry{ i, i * (uint32_t)sizeof(uint32_t), sizeof(uint32_t) };
+        }
+        const vk::SpecializationInfo meshSpecialization{ (uint32_t)meshEntries.size(), meshEntries.data(), sizeof(meshData), meshData };
+
+        vks::pipelines::GraphicsPipelineBuilder builder{ device, pipelineLayout, renderPass };
+        builder.rasterizationState.frontFace = vk::FrontFace::eClockwise;
+        const std::string shaderPath = vkx::getAssetPath() + "shaders/computecullandlod/";
+        builder.loadShader(shaderPath + "meshlets.task.spv", vk::ShaderStageFlagBits::eTaskEXT).pSpecializationInfo = &taskSpecialization;
+        builder.loadShader(shaderPath + "meshlets.mesh.spv", vk::ShaderStageFlagBits::eMeshEXT).pSpecializationInfo = &meshSpecialization;
+        builder.loadShader(shaderPath + "indirectdraw.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipeline = builder.create(context.pipelineCache);
+
+        setPyramid(occlusion);
+    }
+
+    void destroy() {
+        geometry.destroy();
+        stats.destroy();
+        device.destroy(pipeline);
+        device.destroy(pipelineLayout);
+        device.destroy(descriptorSetLayout);
+        device.destroy(descriptorPool);
+    }
+
+    // Follow compute.objectCount, after OcclusionCulling::setObjectCount.  Nothing may be in flight
+    void setObjectCount(const Compute& compute, const OcclusionCulling& occlusion) {
+        objectCount = compute.objectCount;
+        const vk::DescriptorBufferInfo instances = compute.instanceDescriptor();
+        const vk::DescriptorBufferInfo visible{ occlusion.visibility.buffer, 0, sizeof(uint32_t) * objectCount };
+        std::vector<vk::WriteDescriptorSet> writes{
+            { descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &instances },
+            { descriptorSet, 9, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &visible },
+        };
+        device.updateDescriptorSets(writes, nullptr);
+    }
+
+    // After OcclusionCulling::resize.  Nothing may be in flight
+    void setPyramid(const OcclusionCulling& occlusion) {
+        const vk::DescriptorImageInfo pyramidInfo{ occlusion.sampler, occlusion.pyramid.view, vk::ImageLayout::eGeneral };
+        device.updateDescriptorSets(vk::WriteDescriptorSet{ descriptorSet, 10, 0, 1, vk::DescriptorType::eCombinedImageSampler, &pyramidInfo }, nullptr);
+    }
+
+    // Start of the frame, outside of any render pass.  The stats of `image` start at zero
+    void recordReset(const vk::CommandBuffer& commandBuffer, uint32_t image) const {
+        commandBuffer.fillBuffer(stats.buffer, statsStride * image, sizeof(Stats), 0);
+        const vk::MemoryBarrier barrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTaskShaderEXT, {}, barrier, nullptr, nullptr);
+    }
+
+    // Draw all instances in a render pass, `phase` as in meshlets.task.  The late pass needs the pyramid
+    void recordDraw(const vk::CommandBuffer& commandBuffer, uint32_t image, uint32_t phase, const OcclusionCulling& occlusion) const {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, (uint32_t)(statsStride * image));
+        const PushConstants pushConstants{ 0,     groupsPerInstance,     glm::vec2(occlusion.depthSize.width, occlusion.depthSize.height),
+                                           phase, occlusion.objectRadius, occlusion.levelCount };
+        const vk::ShaderStageFlags stages = vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT;
+        commandBuffer.pushConstants<PushConstants>(pipelineLayout, stages, 0, pushConstants);
+        geometry.drawTasks(commandBuffer, pipelineLayout, offsetof(PushConstants, firstGroup), objectCount * groupsPerInstance);
+    }
+
+    // After the draws of the frame, for readbackStats(image)
+    void recordReadback(const vk::CommandBuffer& commandBuffer) const {
+        const vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTaskShaderEXT, vk::PipelineStageFlagBits::eHost, {}, barrier, nullptr, nullptr);
+    }
+
+    // Valid once the image has been acquired again, as OcclusionCulling::readbackCounts
+    const Stats& readbackStats(uint32_t image) const {
+        return *reinterpret_cast<const Stats*>(static_cast<const uint8_t*>(stats.mapped) + statsStride * image);
+    }
 };
 
 class VulkanExample : public vkx::ExampleBase {
 public:
     bool fixedFrustum = false;
+    // Cull and draw per meshlet instead of per object.  Needs VK_KHR_draw_indirect_count and multiDrawIndirect
+    bool clusterCullingSupported = false;
+    bool clusterCulling = false;
+    // Two phase occlusion culling, takes precedence over the above.  Also needs a depth format that can be sampled
+    bool occlusionCullingSupported = false;
+    bool occlusionCulling = false;
+    // Draw the meshlets with task and mesh shaders, with or without occlusion culling.  Needs VK_EXT_mesh_shader and
+    // occlusion culling to be supported, --mesh-shaders starts with it on
+    bool meshShadingSupported = false;
+    bool meshShading = false;
 
     // Vertex layout for the models
     vks::model::VertexLayout vertexLayout = vks::model::VertexLayout({
@@ -199,37 +1068,61 @@ public:
         vks::model::VERTEX_COMPONENT_COLOR,
     });
 
-    // Per-instance data block
-    struct InstanceData {
-        glm::vec3 pos;
-        float scale;
-    };
-
     // Indirect draw statistics (updated via compute)
     struct {
         uint32_t drawCount;                    // Total number of indirect draw counts to be issued
         uint32_t lodCount[MAX_LOD_LEVEL + 1];  // Statistics for number of draws per LOD level (written by compute shader)
+        uint32_t impostorCount;                // Objects drawn as impostors instead
     } indirectStats;
 
-    // Store the indirect draw commands containing index offsets and instance count per object
-    std::vector<vk::DrawIndexedIndirectCommand> indirectCommands;
+    // Meshlets drawn by the task shaders
+    uint32_t meshletDrawCount = 0;
+    // Triangles rasterized by the draw regions of the most recent profiler collection, 0 without pipeline statistics
+    uint64_t drawnTriangles = 0;
+    double drawMilliseconds = 0.0;
+    uint64_t statisticsCollections = 0;
+
+    // Size of compute.clusterDrawsBuffer in draws
+    uint32_t clusterDrawCapacity = 0;
+
+    // Number of objects, set with --instances <count>.  Buffers are sized for the largest of it and the
+    // --benchmark-sweep values, which are object counts here
+    uint32_t instanceCount = DEFAULT_OBJECT_COUNT;
 
     struct {
         glm::mat4 projection;
         glm::mat4 modelview;
         glm::vec4 cameraPos;
         glm::vec4 frustumPlanes[6];
+        float impostorDistance;
     } uboScene;
 
     struct {
         vk::Pipeline plants;
+        vk::Pipeline impostors;
     } pipelines;
 
+    // Billboards for the objects beyond IMPOSTOR_DISTANCE, baked from the full detail mesh.  Only the compute culling
+    // paths select them, occlusion culling and mesh shading keep drawing the last LOD
+    vks::model::Impostor impostor;
+    bool impostors = true;
+    vk::PipelineLayout impostorPipelineLayout;
+    vk::DescriptorSet impostorDescriptorSet;
+    vk::DescriptorSetLayout impostorDescriptorSetLayout;
+
+    // Must match impostor.vert
+    struct ImpostorPushConsts {
+        glm::vec4 sphere;
+        uint32_t frames;
+    };
+
     vk::PipelineLayout pipelineLayout;
     vk::DescriptorSet descriptorSet;
     vk::DescriptorSetLayout descriptorSetLayout;
 
     Compute compute{ context };
+    OcclusionCulling occlusion{ context };
+    MeshShading meshes{ context };
 
     //// Resources for the compute part of the example
     //struct {
@@ -254,14 +1147,34 @@ public:
         camera.setTranslation(glm::vec3(0.5f, 0.0f, 0.0f));
         camera.movementSpeed = 5.0f;
         settings.overlay = true;
+        // The depth pyramid is destroyed and recreated directly on resize
+        deferredResize = false;
+        // Toggling the culling modes and changing the object count take effect with the next frame
+        recordPerFrame = true;
+        context.enableMeshShader = true;
         memset(&indirectStats, 0, sizeof(indirectStats));
+
+        const auto& args = vkx::getCommandLine();
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (args[i] == "--instances" && i + 1 < args.size()) {
+                instanceCount = std::max(1u, (uint32_t)std::stoul(args[++i]));
+            } else if (args[i] == "--mesh-shaders") {
+                meshShading = true;
+            }
+        }
     }
 
     ~VulkanExample() {
         device.destroy(pipelines.plants);
+        device.destroy(pipelines.impostors);
         device.destroy(pipelineLayout);
         device.destroy(descriptorSetLayout);
+        device.destroy(impostorPipelineLayout);
+        device.destroy(impostorDescriptorSetLayout);
+        impostor.destroy();
 
+        meshes.destroy();
+        occlusion.destroy();
         compute.destroy();
     }
 
@@ -269,10 +1182,39 @@ public:
         // Enable multi draw indirect if supported
         if (context.deviceFeatures.multiDrawIndirect) {
             context.enabledFeatures.multiDrawIndirect = VK_TRUE;
+            // The number of cluster draws is only known on the device
+            if (vks::Context::isDeviceExtensionPresent(context.physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+                context.requireDeviceExtensions({ VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME });
+                clusterCullingSupported = true;
+            }
         }
     }
 
-    void updateDrawCommandBuffer(const vk::CommandBuffer& drawCommandBuffer) {
+    void setupRenderPass() override {
+        ExampleBase::setupRenderPass();
+        if (occlusionCullingSupported) {
+            occlusion.createRenderPasses(colorformat, depthFormat);
+        }
+    }
+
+    void setupRenderPassBeginInfo() override {
+        ExampleBase::setupRenderPassBeginInfo();
+        // The early pass clears, the main pass adds the late draws to it
+        if (occlusionCulling) {
+            renderPassBeginInfo.renderPass = occlusion.latePass;
+        }
+    }
+
+    void windowResized() override {
+        if (occlusionCullingSupported) {
+            occlusion.resize(depthStencil, depthFormat);
+        }
+        if (meshShadingSupported) {
+            meshes.setPyramid(occlusion);
+        }
+    }
+
+    void bindPlants(const vk::CommandBuffer& drawCommandBuffer) {
         drawCommandBuffer.setViewport(0, viewport());
         drawCommandBuffer.setScissor(0, scissor());
         drawCommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
@@ -281,17 +1223,84 @@ public:
         drawCommandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.plants);
         drawCommandBuffer.bindVertexBuffers(0, compute.models.lodObject.vertices.buffer, { 0 });
         drawCommandBuffer.bindVertexBuffers(1, compute.instanceBuffer.buffer, { 0 });
-        drawCommandBuffer.bindIndexBuffer(compute.models.lodObject.indices.buffer, 0, vk::IndexType::eUint32);
+        drawCommandBuffer.bindIndexBuffer(compute.models.lodObject.indices.buffer, 0, compute.models.lodObject.indexType);
+    }
 
-        if (context.deviceFeatures.multiDrawIndirect) {
-            drawCommandBuffer.drawIndexedIndirect(compute.indirectCommandsBuffer.buffer, 0, indirectStats.drawCount, sizeof(VkDrawIndexedIndirectCommand));
+    void updateCommandBufferPreDraw(const vk::CommandBuffer& commandBuffer) override {
+        const uint32_t image = commandBufferImage(commandBuffer);
+        if (meshShading) {
+            meshes.recordReset(commandBuffer, image);
+        }
+        if (!occlusionCulling) {
+            return;
+        }
+        occlusion.recordReset(commandBuffer);
+
+        vks::debug::marker::beginRegion(commandBuffer, "Early pass", glm::vec4(0.5f, 0.76f, 0.34f, 1.0f));
+        occlusion.recordCull(commandBuffer, 0);
+        vk::RenderPassBeginInfo earlyPassBeginInfo = renderPassBeginInfo;
+        earlyPassBeginInfo.renderPass = occlusion.earlyPass;
+        earlyPassBeginInfo.framebuffer = framebuffers[image];
+        commandBuffer.beginRenderPass(earlyPassBeginInfo, vk::SubpassContents::eInline);
+        bindPlants(commandBuffer);
+        if (meshShading) {
+            meshes.recordDraw(commandBuffer, image, 1, occlusion);
+        } else {
+            occlusion.recordDraw(commandBuffer, 0);
+        }
+        commandBuffer.endRenderPass();
+        vks::debug::marker::endRegion(commandBuffer);
+
+        vks::debug::marker::beginRegion(commandBuffer, "Depth pyramid", glm::vec4(0.84f, 0.63f, 0.34f, 1.0f));
+        occlusion.recordPyramid(commandBuffer);
+        vks::debug::marker::endRegion(commandBuffer);
+
+        vks::debug::marker::beginRegion(commandBuffer, "Late cull", glm::vec4(0.34f, 0.63f, 0.84f, 1.0f));
+        occlusion.recordCull(commandBuffer, 1);
+        vks::debug::marker::endRegion(commandBuffer);
+    }
+
+    void updateCommandBufferPostDraw(const vk::CommandBuffer& commandBuffer) override {
+        if (occlusionCulling) {
+            occlusion.recordReadback(commandBuffer, commandBufferImage(commandBuffer));
+        }
+        if (meshShading) {
+            meshes.recordReadback(commandBuffer);
+        }
+    }
+
+    void updateDrawCommandBuffer(const vk::CommandBuffer& drawCommandBuffer) override {
+        bindPlants(drawCommandBuffer);
+
+        vks::debug::marker::beginRegion(drawCommandBuffer, "Draw", glm::vec4(0.76f, 0.5f, 0.34f, 1.0f));
+        if (meshShading) {
+            meshes.recordDraw(drawCommandBuffer, commandBufferImage(drawCommandBuffer), occlusionCulling ? 2 : 0, occlusion);
+        } else if (occlusionCulling) {
+            occlusion.recordDraw(drawCommandBuffer, 1);
+        } else if (clusterCulling) {
+            // The draw count is the first member of the stats written by the cluster culling pass
+            drawCommandBuffer.drawIndexedIndirectCountKHR(compute.clusterDrawsBuffer.buffer, 0, compute.indirectDrawCountBuffer.buffer, 0, clusterDrawCapacity,
+                                                          sizeof(VkDrawIndexedIndirectCommand), context.dynamicDispatch);
+        } else if (context.deviceFeatures.multiDrawIndirect) {
+            // One draw per object, culled ones have no instances
+            const uint32_t drawCount = std::min(compute.objectCount, context.deviceProperties.limits.maxDrawIndirectCount);
+            drawCommandBuffer.drawIndexedIndirect(compute.indirectCommandsBuffer.buffer, 0, drawCount, sizeof(VkDrawIndexedIndirectCommand));
         } else {
             // If multi draw is not available, we must issue separate draw commands
-            for (auto j = 0; j < indirectCommands.size(); j++) {
+            for (uint32_t j = 0; j < compute.objectCount; j++) {
                 drawCommandBuffer.drawIndexedIndirect(compute.indirectCommandsBuffer.buffer, j * sizeof(VkDrawIndexedIndirectCommand), 1,
                                                       sizeof(VkDrawIndexedIndirectCommand));
             }
         }
+        if (impostors && !meshShading && !occlusionCulling) {
+            // One quad per object the culling found beyond the impostor distance
+            drawCommandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.impostors);
+            drawCommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, impostorPipelineLayout, 0, impostorDescriptorSet, nullptr);
+            const ImpostorPushConsts pushConsts{ impostor.sphere(), impostor.frames() };
+            drawCommandBuffer.pushConstants<ImpostorPushConsts>(impostorPipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, pushConsts);
+            drawCommandBuffer.drawIndirect(compute.impostorBuffer.buffer, 0, 1, sizeof(vk::DrawIndirectCommand));
+        }
+        vks::debug::marker::endRegion(drawCommandBuffer);
     }
 #if 0
     void buildCommandBuffers() {
@@ -325,11 +1334,30 @@ public:
     }
 #endif
 
-    void loadAssets() override { compute.models.lodObject.loadFromFile(context, getAssetPath() + "models/suzanne_lods.dae", vertexLayout, 0.1f); }
+    void loadAssets() override {
+        vks::model::ModelCreateInfo modelCreateInfo{ 0.1f, 1.0f, 0.0f };
+        // The cache optimized triangle order keeps the meshlets compact.  They're only used by cluster culling and
+        // mesh shading, but are cheap enough to always build
+        modelCreateInfo.optimize = true;
+        modelCreateInfo.meshlets = true;
+        if (context.meshShaderEnabled) {
+            // The meshlets' vertices and triangles are built from the host copy of the indices, and the mesh shader reads
+            // the vertices as a storage buffer
+            modelCreateInfo.hostCopy = true;
+            modelCreateInfo.vertexUsage = vk::BufferUsageFlagBits::eStorageBuffer;
+        }
+        // The levels are simplified from the full detail mesh at load time, rather than taken from the hand made
+        // ones in the file
+        modelCreateInfo.lodCount = MAX_LOD_LEVEL + 1;
+        compute.models.lodObject.loadFromFile(context, getAssetPath() + "models/suzanne_lods.dae", vertexLayout, modelCreateInfo);
+        impostor.bake(context, getAssetPath(), compute.models.lodObject);
+    }
 
     void setupDescriptorPool() {
         std::vector<vk::DescriptorPoolSize> poolSizes = {
-            { vk::DescriptorType::eUniformBuffer, 1 },
+            { vk::DescriptorType::eUniformBuffer, 2 },
+            { vk::DescriptorType::eStorageBuffer, 2 },
+            { vk::DescriptorType::eCombinedImageSampler, 2 },
         };
 
         descriptorPool = device.createDescriptorPool({ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
@@ -343,6 +1371,22 @@ public:
 
         descriptorSetLayout = context.device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
         pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+
+        std::vector<vk::DescriptorSetLayoutBinding> impostorBindings{
+            // Binding 0: Uniform buffer, the fragment shader moves the depth to the baked surface
+            { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment },
+            // Binding 1: Instances
+            { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+            // Binding 2: Impostor draw and its instance indices
+            { 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+            // Binding 3: Impostor albedo
+            { 3, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 4: Impostor normals and depth
+            { 4, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
+        };
+        impostorDescriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)impostorBindings.size(), impostorBindings.data() });
+        const vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eVertex, 0, sizeof(ImpostorPushConsts) };
+        impostorPipelineLayout = device.createPipelineLayout({ {}, 1, &impostorDescriptorSetLayout, 1, &pushConstantRange });
     }
 
     void setupDescriptorSet() {
@@ -353,6 +1397,19 @@ public:
             { descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &compute.uniformData.scene.descriptor },
         };
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
+
+        impostorDescriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &impostorDescriptorSetLayout })[0];
+        const vk::DescriptorImageInfo albedoDescriptor = impostor.albedoDescriptor();
+        const vk::DescriptorImageInfo normalDepthDescriptor = impostor.normalDepthDescriptor();
+        // The indices address any instance, not only the first objectCount
+        writeDescriptorSets = {
+            { impostorDescriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &compute.uniformData.scene.descriptor },
+            { impostorDescriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &compute.instanceBuffer.descriptor },
+            { impostorDescriptorSet, 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &compute.impostorBuffer.descriptor },
+            { impostorDescriptorSet, 3, 0, 1, vk::DescriptorType::eCombinedImageSampler, &albedoDescriptor },
+            { impostorDescriptorSet, 4, 0, 1, vk::DescriptorType::eCombinedImageSampler, &normalDepthDescriptor },
+        };
+        device.updateDescriptorSets(writeDescriptorSets, nullptr);
     }
 
     void preparePipelines() {
@@ -372,66 +1429,83 @@ public:
         builder.vertexInputState.attributeDescriptions.push_back(
             vk::VertexInputAttributeDescription{ 5, 1, vk::Format::eR32Sfloat, offsetof(InstanceData, scale) });
         pipelines.plants = builder.create(context.pipelineCache);
+
+        // Billboards from the impostor draw, which fetch their instances themselves
+        builder.destroyShaderModules();
+        builder.layout = impostorPipelineLayout;
+        builder.rasterizationState.cullMode = vk::CullModeFlagBits::eNone;
+        builder.vertexInputState = {};
+        builder.loadShader(getAssetPath() + "shaders/computecullandlod/impostor.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        builder.loadShader(getAssetPath() + "shaders/computecullandlod/impostor.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipelines.impostors = builder.create(context.pipelineCache);
     }
 
     void prepareBuffers() {
-        compute.objectCount = OBJECT_COUNT * OBJECT_COUNT * OBJECT_COUNT;
-        indirectCommands.resize(compute.objectCount);
-
-        // Indirect draw commands
-        for (uint32_t x = 0; x < OBJECT_COUNT; x++) {
-            for (uint32_t y = 0; y < OBJECT_COUNT; y++) {
-                for (uint32_t z = 0; z < OBJECT_COUNT; z++) {
-                    uint32_t index = x + y * OBJECT_COUNT + z * OBJECT_COUNT * OBJECT_COUNT;
-                    indirectCommands[index].instanceCount = 1;
-                    indirectCommands[index].firstInstance = index;
-                    // firstIndex and indexCount are written by the compute shader
-                }
-            }
+        compute.objectCapacity = instanceCount;
+        for (const auto value : benchmark.sweep) {
+            compute.objectCapacity = std::max(compute.objectCapacity, value);
         }
-
-        indirectStats.drawCount = static_cast<uint32_t>(indirectCommands.size());
-        compute.indirectCommandsBuffer =
-            context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer, indirectCommands);
+        // The shaders see the draws as one storage buffer
+        const uint32_t maxObjects = context.deviceProperties.limits.maxStorageBufferRange / sizeof(vk::DrawIndexedIndirectCommand);
+        if (compute.objectCapacity > maxObjects) {
+            vkx::logMessage(vkx::LogLevel::LOG_WARN, "Limiting the object count to %u, the device's storage buffer range", maxObjects);
+            compute.objectCapacity = maxObjects;
+        }
+        compute.objectCount = std::min(instanceCount, compute.objectCapacity);
+
+        // Instances and their indirect draw commands are generated on the device, see Compute::setObjectCount
+        compute.instanceBuffer = context.createDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+                                                            sizeof(InstanceData) * compute.objectCapacity);
+        compute.indirectCommandsBuffer = context.createDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+                                                                    sizeof(vk::DrawIndexedIndirectCommand) * compute.objectCapacity);
+        // Also the draw count source for cluster culling, which clears it before every dispatch
         compute.indirectDrawCountBuffer =
-            context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc,
+            context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst |
+                                     vk::BufferUsageFlagBits::eIndirectBuffer,
                                  vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, sizeof(indirectStats));
         // Map for host access
         compute.indirectDrawCountBuffer.map();
-
-        // Instance data
-        std::vector<InstanceData> instanceData(compute.objectCount);
-        for (uint32_t x = 0; x < OBJECT_COUNT; x++) {
-            for (uint32_t y = 0; y < OBJECT_COUNT; y++) {
-                for (uint32_t z = 0; z < OBJECT_COUNT; z++) {
-                    uint32_t index = x + y * OBJECT_COUNT + z * OBJECT_COUNT * OBJECT_COUNT;
-                    instanceData[index].pos = glm::vec3((float)x, (float)y, (float)z) - glm::vec3((float)OBJECT_COUNT / 2.0f);
-                    instanceData[index].scale = 2.0f;
-                }
-            }
-        }
-        compute.instanceBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer, instanceData);
+        // Reset by the culling before every dispatch, up to every object may be an impostor
+        compute.impostorBuffer = context.createDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer |
+                                                                vk::BufferUsageFlagBits::eTransferDst,
+                                                            sizeof(vk::DrawIndirectCommand) + sizeof(uint32_t) * compute.objectCapacity);
 
         // Shader storage buffer containing index offsets and counts for the LODs
         struct LOD {
             uint32_t firstIndex;
             uint32_t indexCount;
+            uint32_t meshletBase;
+            uint32_t meshletCount;
             float distance;
             float _pad0;
+            float _pad1;
+            float _pad2;
         };
         std::vector<LOD> LODLevels;
-        uint32_t n = 0;
-        for (auto modelPart : compute.models.lodObject.parts) {
+        const auto& model = compute.models.lodObject;
+        // The first part is the full detail mesh
+        const auto& modelPart = model.parts[0];
+        for (uint32_t n = 0; n < modelPart.lodCount; ++n) {
+            const auto& modelLod = model.lods[modelPart.lodBase + n];
             LOD lod;
-            lod.firstIndex = modelPart.indexBase;   // First index for this LOD
-            lod.indexCount = modelPart.indexCount;  // Index count for this LOD
-            lod.distance = 5.0f + n * 5.0f;         // Starting distance (to viewer) for this LOD
-            n++;
+            lod.firstIndex = modelLod.indexBase;   // First index for this LOD
+            lod.indexCount = modelLod.indexCount;  // Index count for this LOD
+            lod.meshletBase = modelLod.meshletBase;
+            lod.meshletCount = modelLod.meshletCount;
+            lod.distance = 5.0f + n * 5.0f;  // Starting distance (to viewer) for this LOD
+            compute.maxMeshletCount = std::max(compute.maxMeshletCount, modelLod.meshletCount);
             LODLevels.push_back(lod);
         }
 
         compute.lodLevelsBuffers = context.stageToDeviceBuffer<LOD>(vk::BufferUsageFlagBits::eStorageBuffer, LODLevels);
 
+        if (clusterCullingSupported && compute.maxMeshletCount) {
+            compute.meshletsBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, compute.models.lodObject.meshlets);
+            clusterDrawCapacity = std::min<uint32_t>(MAX_CLUSTER_DRAWS, context.deviceProperties.limits.maxDrawIndirectCount);
+            compute.clusterDrawsBuffer = context.createDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+                                                                    clusterDrawCapacity * sizeof(vk::DrawIndexedIndirectCommand));
+        }
+
         // Scene uniform buffer
         compute.uniformData.scene = context.createUniformBuffer(uboScene);
         updateUniformBuffer(true);
@@ -447,20 +1521,44 @@ public:
                 memcpy(uboScene.frustumPlanes, frustum.planes.data(), sizeof(glm::vec4) * 6);
             }
         }
+        uboScene.impostorDistance = impostors ? IMPOSTOR_DISTANCE : 0.0f;
 
         compute.uniformData.scene.copy(uboScene);
     }
 
-    void draw() {
+    void draw() override {
         ExampleBase::prepareFrame();
 
+        if (occlusionCulling) {
+            // Culling is part of the frame, and the statistics were copied by the image's previous frame
+            renderWaitSemaphores = { semaphores.acquireComplete };
+            renderWaitStages = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
+            const auto& counts = occlusion.readbackCounts(currentBuffer);
+            indirectStats.drawCount = counts.earlyCount + counts.lateCount;
+            memcpy(indirectStats.lodCount, counts.lodCount, sizeof(indirectStats.lodCount));
+            if (meshShading) {
+                meshletDrawCount = meshes.readbackStats(currentBuffer).drawCount;
+            }
+            drawCurrentCommandBuffer();
+            ExampleBase::submitFrame();
+            return;
+        }
+
+        if (meshShading) {
+            // The task shaders cull, there's no compute submission to wait for
+            renderWaitSemaphores = { semaphores.acquireComplete };
+            renderWaitStages = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
+            const auto& stats = meshes.readbackStats(currentBuffer);
+            meshletDrawCount = stats.drawCount;
+            memcpy(indirectStats.lodCount, stats.lodCount, sizeof(indirectStats.lodCount));
+            drawCurrentCommandBuffer();
+            ExampleBase::submitFrame();
+            return;
+        }
+
         // Submit compute shader for frustum culling
-        vk::SubmitInfo computeSubmitInfo;
-        computeSubmitInfo.commandBufferCount = 1;
-        computeSubmitInfo.pCommandBuffers = &compute.commandBuffer;
-        computeSubmitInfo.signalSemaphoreCount = 1;
-        computeSubmitInfo.pSignalSemaphores = &compute.semaphores.complete;
-        compute.queue.submit(computeSubmitInfo, nullptr);
+        compute.submit(clusterCulling);
+        compute.reportCullTime(profiler);
 
         // Wait on present and compute semaphores
         renderWaitSemaphores = {
@@ -481,6 +1579,13 @@ public:
     }
 
     void prepare() override {
+        // The depth buffer is created by ExampleBase::prepare, the pyramid reads it
+        if (clusterCullingSupported && (context.getFormatProperties(depthFormat).optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage)) {
+            occlusionCullingSupported = true;
+            depthStencilUsage |= vk::ImageUsageFlagBits::eSampled;
+        }
+        meshShadingSupported = occlusionCullingSupported && context.meshShaderEnabled;
+        meshShading = meshShading && meshShadingSupported;
         ExampleBase::prepare();
         prepareBuffers();
         setupDescriptorSetLayout();
@@ -488,23 +1593,101 @@ public:
         setupDescriptorPool();
         setupDescriptorSet();
         compute.prepare();
+        if (occlusionCullingSupported) {
+            occlusion.prepare(compute, swapChain.imageCount);
+            occlusion.resize(depthStencil, depthFormat);
+        }
+        if (meshShadingSupported) {
+            meshes.prepare(compute, occlusion, vertexLayout, renderPass, swapChain.imageCount);
+        }
+        setObjectCount(instanceCount);
         buildCommandBuffers();
         prepared = true;
     }
 
+    void setObjectCount(uint32_t count) {
+        compute.setObjectCount(count);
+        if (occlusionCullingSupported) {
+            occlusion.setObjectCount(compute);
+        }
+        if (meshShadingSupported) {
+            meshes.setObjectCount(compute, occlusion);
+        }
+        memset(&indirectStats, 0, sizeof(indirectStats));
+        meshletDrawCount = 0;
+    }
+
+    // Sweep values are object counts, and the reports list the times of the culling and draw scopes for each
+    bool applyBenchmarkSweep(uint32_t value) override {
+        device.waitIdle();
+        setObjectCount(value);
+        return true;
+    }
+
     void viewChanged() override { updateUniformBuffer(true); }
 
+    void update(float deltaTime) override {
+        ExampleBase::update(deltaTime);
+        if (profiler.getCollectionCount() == statisticsCollections) {
+            return;
+        }
+        statisticsCollections = profiler.getCollectionCount();
+        // Both paths rasterize through the same draw regions, so their triangle throughput compares directly
+        drawnTriangles = 0;
+        drawMilliseconds = 0.0;
+        for (const auto& name : { "Early pass", "Draw" }) {
+            const auto* scope = profiler.findScope(name);
+            if (scope && !scope->statistics.empty()) {
+                drawnTriangles += profiler.getStatistic(name, "clippingInvocations");
+                drawMilliseconds += scope->lastMilliseconds;
+            }
+        }
+    }
+
     void OnUpdateUIOverlay() override {
         if (ui.header("Settings")) {
             if (ui.checkBox("Freeze frustum", &fixedFrustum)) {
                 updateUniformBuffer(true);
             }
+            if (occlusionCullingSupported && ui.checkBox("Occlusion culling", &occlusionCulling)) {
+                setupRenderPassBeginInfo();
+            }
+            if (!occlusionCulling && !meshShading && compute.hasClusterCulling()) {
+                ui.checkBox("Cluster culling", &clusterCulling);
+            }
+            if (meshShadingSupported && ui.checkBox("Mesh shaders", &meshShading)) {
+                memset(&indirectStats, 0, sizeof(indirectStats));
+            }
+            if (!occlusionCulling && !meshShading && ui.checkBox("Impostors", &impostors)) {
+                updateUniformBuffer(false);
+            }
         }
         if (ui.header("Statistics")) {
-            ui.text("Visible objects: %d", indirectStats.drawCount);
+            ui.text("Objects: %d", compute.objectCount);
+            if (occlusionCulling) {
+                ui.text("Drawn objects: %d", indirectStats.drawCount);
+            } else if (!meshShading && clusterCulling) {
+                ui.text("Visible clusters: %d", std::min(indirectStats.drawCount, clusterDrawCapacity));
+            } else if (!meshShading) {
+                ui.text("Visible objects: %d", indirectStats.drawCount);
+            }
+            if (meshShading) {
+                ui.text("Drawn clusters: %d", meshletDrawCount);
+            }
             for (uint32_t i = 0; i < MAX_LOD_LEVEL + 1; i++) {
                 ui.text("LOD %d: %d", i, indirectStats.lodCount[i]);
             }
+            if (impostors && !occlusionCulling && !meshShading) {
+                ui.text("Impostors: %d", indirectStats.impostorCount);
+            }
+            if (drawnTriangles) {
+                ui.text("Triangles: %llu", (unsigned long long)drawnTriangles);
+                if (drawMilliseconds > 0.0) {
+                    ui.text("Throughput: %.1f Mtris/s", (double)drawnTriangles / (drawMilliseconds * 1000.0));
+                }
+            } else {
+                ui.text("Triangles need pipeline statistics");
+            }
         }
     }
 };
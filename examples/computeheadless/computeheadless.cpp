@@ -1,5 +1,5 @@
 /*
-* Vulkan Example - Minimal headless compute example 
+* Vulkan Example - Headless compute benchmark
 *
 * Copyright (C) 2017 by Sascha Willems - www.saschawillems.de
 *
@@ -9,18 +9,96 @@
 // TODO: separate transfer queue (if not supported by compute queue) including buffer ownership transfer
 
 #include <common.hpp>
+#include <compute.hpp>
 #include <vks/context.hpp>
+#include <vks/profiler.hpp>
 #include <vks/shaders.hpp>
 #include <utils.hpp>
 
-#define BUFFER_ELEMENTS 32
-
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 #define LOG(...) ((void)__android_log_print(ANDROID_LOG_INFO, "vulkanExample", __VA_ARGS__))
 #else
 #define LOG(...) printf(__VA_ARGS__)
 #endif
 
+/*
+    Kernels read element i of the uint buffer at binding 0 and write element i of the one at binding 1.  The element
+    count is specialization constant 0, the workgroup size in x specialization constant 1 (local_size_x_id = 1), and
+    dispatches spill over into y, see vkx::workGroupCounts.
+*/
+struct Kernel {
+    std::string name;
+    std::string shaderFile;
+    // Bytes read and written per element, for the bandwidth
+    uint32_t bytesPerElement{ 8 };
+    // Initial value of input i
+    std::function<uint32_t(uint32_t)> input;
+    // Expected value of output i for input `value`, if the results are verified
+    std::function<uint32_t(uint32_t)> expected;
+};
+
+uint32_t fibonacci(uint32_t n) {
+    if (n <= 1) {
+        return n;
+    }
+    uint32_t curr = 1;
+    uint32_t prev = 1;
+    for (uint32_t i = 2; i < n; ++i) {
+        uint32_t temp = curr;
+        curr += prev;
+        prev = temp;
+    }
+    return curr;
+}
+
+std::vector<Kernel> builtinKernels() {
+    const std::string path = vkx::getAssetPath() + "shaders/computeheadless/";
+    // Inputs stay small enough for the loop of every invocation to be short and the result to fit
+    return {
+        { "fibonacci", path + "headless.comp.spv", 8, [](uint32_t i) { return i % 48; }, fibonacci },
+        { "copy", path + "copy.comp.spv", 8, [](uint32_t i) { return i; }, [](uint32_t value) { return value; } },
+    };
+}
+
+// Statistics of the GPU times of the timed dispatches of one configuration
+struct Measurement {
+    uint32_t elements{ 0 };
+    uint32_t workgroupSize{ 0 };
+    size_t count{ 0 };
+    double mean{ 0 }, stddev{ 0 }, min{ 0 }, max{ 0 }, median{ 0 };
+    // From the mean time
+    double gigabytesPerSecond{ 0 };
+    double elementsPerSecond{ 0 };
+    bool verified{ false };
+
+    void measure(std::vector<double> milliseconds, uint32_t bytesPerElement) {
+        count = milliseconds.size();
+        if (milliseconds.empty()) {
+            return;
+        }
+        std::sort(milliseconds.begin(), milliseconds.end());
+        double sum = 0;
+        for (const auto& sample : milliseconds) {
+            sum += sample;
+        }
+        mean = sum / count;
+        double squares = 0;
+        for (const auto& sample : milliseconds) {
+            squares += (sample - mean) * (sample - mean);
+        }
+        // Sample standard deviation
+        stddev = count > 1 ? std::sqrt(squares / (count - 1)) : 0.0;
+        min = milliseconds.front();
+        max = milliseconds.back();
+        median = milliseconds[count / 2];
+        const double seconds = mean / 1000.0;
+        if (seconds > 0.0) {
+            elementsPerSecond = elements / seconds;
+            gigabytesPerSecond = (double)elements * bytesPerElement / seconds / 1.0e9;
+        }
+    }
+};
+
 class VulkanExample {
 public:
     vks::Context context;
@@ -28,27 +106,97 @@ public:
     vk::Queue queue;
     vk::CommandPool commandPool;
     vk::CommandBuffer commandBuffer;
+    vk::Fence fence;
     vk::DescriptorPool descriptorPool;
     vk::DescriptorSetLayout descriptorSetLayout;
     vk::DescriptorSet descriptorSet;
     vk::PipelineLayout pipelineLayout;
-    vk::Pipeline pipeline;
-    vk::ShaderModule shaderModule;
+    vks::debug::GpuProfiler profiler;
+
+    /*
+        Benchmark settings, from the command line
+            --kernel <name>               one of builtinKernels(), fibonacci by default
+            --shader <file.spv>           a kernel of your own, see Kernel
+            --bytes-per-element <n>       bytes a kernel of your own reads and writes per element, 8 by default
+            --elements <n,n,...>          element counts to run
+            --workgroup-sizes <n,n,...>   workgroup sizes to run with each element count
+            --iterations <n>              timed dispatches per configuration
+            --warmup <n>                  untimed dispatches before them
+            --output <file.json|file.csv> where to write the measurements
+        Every combination of element count and workgroup size is a configuration.
+    */
+    struct Settings {
+        Kernel kernel;
+        std::vector<uint32_t> elements{ 32 };
+        std::vector<uint32_t> workgroupSizes{ 1 };
+        uint32_t iterations{ 16 };
+        uint32_t warmup{ 2 };
+        std::string outputPath;
+    } settings;
+
+    std::vector<Measurement> measurements;
+
     /*
     Prepare storage buffers
     */
     std::vector<uint32_t> computeInput;
     std::vector<uint32_t> computeOutput;
-    vks::Buffer deviceBuffer, hostBuffer;
-    size_t bufferSize = sizeof(uint32_t) * BUFFER_ELEMENTS;
+    vks::Buffer inputBuffer, outputBuffer, hostBuffer;
 
     VulkanExample() {}
 
+    static std::vector<uint32_t> parseList(const std::string& list) {
+        std::vector<uint32_t> result;
+        std::stringstream values(list);
+        std::string value;
+        while (std::getline(values, value, ',')) {
+            result.push_back(std::max(1u, (uint32_t)std::stoul(value)));
+        }
+        return result;
+    }
+
+    void parseCommandLine() {
+        const auto kernels = builtinKernels();
+        settings.kernel = kernels[0];
+        const auto& args = vkx::getCommandLine();
+        for (size_t i = 1; i < args.size(); ++i) {
+            const auto& arg = args[i];
+            const bool hasValue = i + 1 < args.size();
+            if (arg == "--kernel" && hasValue) {
+                const auto& name = args[++i];
+                auto itr = std::find_if(kernels.begin(), kernels.end(), [&](const Kernel& kernel) { return kernel.name == name; });
+                if (itr == kernels.end()) {
+                    throw std::runtime_error("Unknown kernel " + name);
+                }
+                settings.kernel = *itr;
+            } else if (arg == "--shader" && hasValue) {
+                settings.kernel.shaderFile = args[++i];
+                settings.kernel.name = settings.kernel.shaderFile;
+                settings.kernel.input = [](uint32_t i) { return i; };
+                // Nothing to verify against
+                settings.kernel.expected = nullptr;
+            } else if (arg == "--bytes-per-element" && hasValue) {
+                settings.kernel.bytesPerElement = (uint32_t)std::stoul(args[++i]);
+            } else if (arg == "--elements" && hasValue) {
+                settings.elements = parseList(args[++i]);
+            } else if (arg == "--workgroup-sizes" && hasValue) {
+                settings.workgroupSizes = parseList(args[++i]);
+            } else if (arg == "--iterations" && hasValue) {
+                settings.iterations = std::max(1u, (uint32_t)std::stoul(args[++i]));
+            } else if (arg == "--warmup" && hasValue) {
+                settings.warmup = (uint32_t)std::stoul(args[++i]);
+            } else if (arg == "--output" && hasValue) {
+                settings.outputPath = args[++i];
+            }
+        }
+    }
+
     void prepare() {
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
         LOG("loading vulkan lib");
         vks::android::loadVulkanLibrary();
 #endif
+        parseCommandLine();
         context.createInstance();
         context.createDevice();
         LOG("GPU: %s\n", context.deviceProperties.deviceName);
@@ -62,117 +210,160 @@ public:
         cmdPoolInfo.queueFamilyIndex = context.queueIndices.compute;
         cmdPoolInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
         commandPool = device.createCommandPool(cmdPoolInfo);
+        commandBuffer = device.allocateCommandBuffers({ commandPool, vk::CommandBufferLevel::ePrimary, 1 })[0];
+        fence = device.createFence(vk::FenceCreateInfo{});
+
+        // One scope per timed dispatch
+        profiler.create(context.physicalDevice, device, context.queueIndices.compute, 1, settings.iterations);
+        if (!profiler.enabled()) {
+            throw std::runtime_error("The compute queue doesn't support timestamps");
+        }
 
-        setupBuffers();
         setupDescriptors();
-        setupPipeline();
-        setupCommandBuffer();
     }
 
-    void setupBuffers() {
-        computeInput.resize(BUFFER_ELEMENTS);
-        computeOutput.resize(BUFFER_ELEMENTS);
-        // Fill input data
-        uint32_t n = 0;
-        std::generate(computeInput.begin(), computeInput.end(), [&n] { return n++; });
+    void setupBuffers(uint32_t elements) {
+        inputBuffer.destroy();
+        outputBuffer.destroy();
+        hostBuffer.destroy();
+
+        computeInput.resize(elements);
+        computeOutput.resize(elements);
+        for (uint32_t i = 0; i < elements; ++i) {
+            computeInput[i] = settings.kernel.input(i);
+        }
+        const vk::DeviceSize bufferSize = sizeof(uint32_t) * elements;
         // Copy input data to VRAM using a staging buffer
-        deviceBuffer = context.stageToDeviceBuffer<uint32_t>(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc, computeInput);
+        inputBuffer = context.stageToDeviceBuffer<uint32_t>(vk::BufferUsageFlagBits::eStorageBuffer, computeInput);
+        // Only recorded into the context's upload batch, and measure submits to the queue directly
+        context.flushUploads(true);
+        outputBuffer = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc, bufferSize);
         hostBuffer = context.createBuffer(vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible, bufferSize);
+
+        vk::DescriptorBufferInfo inputDescriptor{ inputBuffer.buffer, 0, VK_WHOLE_SIZE };
+        vk::DescriptorBufferInfo outputDescriptor{ outputBuffer.buffer, 0, VK_WHOLE_SIZE };
+        std::vector<vk::WriteDescriptorSet> computeWriteDescriptorSets = {
+            vk::WriteDescriptorSet{ descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &inputDescriptor },
+            vk::WriteDescriptorSet{ descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &outputDescriptor },
+        };
+        device.updateDescriptorSets(computeWriteDescriptorSets, nullptr);
     }
 
     void setupDescriptors() {
         std::vector<vk::DescriptorPoolSize> poolSizes = {
-            vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 1 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 2 },
         };
 
         descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 1, static_cast<uint32_t>(poolSizes.size()), poolSizes.data() });
 
-        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings {
+        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
             vk::DescriptorSetLayoutBinding{ 0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            vk::DescriptorSetLayoutBinding{ 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
         };
-        descriptorSetLayout = device.createDescriptorSetLayout({ {}, 1, setLayoutBindings.data() });
+        descriptorSetLayout = device.createDescriptorSetLayout({ {}, static_cast<uint32_t>(setLayoutBindings.size()), setLayoutBindings.data() });
 
         pipelineLayout = device.createPipelineLayout(vk::PipelineLayoutCreateInfo{ {}, 1, &descriptorSetLayout });
 
         descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
-
-        vk::DescriptorBufferInfo bufferDescriptor{ deviceBuffer.buffer, 0, VK_WHOLE_SIZE };
-        std::vector<vk::WriteDescriptorSet> computeWriteDescriptorSets = {
-            vk::WriteDescriptorSet{ descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &bufferDescriptor },
-        };
-        device.updateDescriptorSets(computeWriteDescriptorSets, nullptr);
     }
 
-    void setupPipeline() {
+    vk::Pipeline createPipeline(uint32_t elements, uint32_t workgroupSize) {
         // Create pipeline
         vk::ComputePipelineCreateInfo computePipelineCreateInfo;
         computePipelineCreateInfo.layout = pipelineLayout;
-        computePipelineCreateInfo.stage =
-            vks::shaders::loadShader(context.device, vkx::getAssetPath() + "shaders/computeheadless/headless.comp.spv", vk::ShaderStageFlagBits::eCompute);
+        computePipelineCreateInfo.stage = vks::shaders::loadShader(context.device, settings.kernel.shaderFile, vk::ShaderStageFlagBits::eCompute);
 
-        // Pass SSBO size via specialization constant
+        // Pass SSBO size and the workgroup size via specialization constants
         struct SpecializationData {
-            uint32_t BUFFER_ELEMENT_COUNT = BUFFER_ELEMENTS;
-        } specializationData;
-        vk::SpecializationMapEntry specializationMapEntry{ 0, 0, sizeof(uint32_t) };
-        vk::SpecializationInfo specializationInfo{ 1, &specializationMapEntry, sizeof(SpecializationData), &specializationData };
+            uint32_t BUFFER_ELEMENT_COUNT;
+            uint32_t WORKGROUP_SIZE;
+        } specializationData{ elements, workgroupSize };
+        std::array<vk::SpecializationMapEntry, 2> specializationMapEntries{ {
+            { 0, offsetof(SpecializationData, BUFFER_ELEMENT_COUNT), sizeof(uint32_t) },
+            { 1, offsetof(SpecializationData, WORKGROUP_SIZE), sizeof(uint32_t) },
+        } };
+        vk::SpecializationInfo specializationInfo{ (uint32_t)specializationMapEntries.size(), specializationMapEntries.data(), sizeof(SpecializationData),
+                                                   &specializationData };
         computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
-        pipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+        vk::Pipeline pipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
         device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+        return pipeline;
     }
 
-    void setupCommandBuffer() {
-        // Create a command buffer for compute operations
-        commandBuffer = device.allocateCommandBuffers({ commandPool, vk::CommandBufferLevel::ePrimary, 1 })[0];
-        commandBuffer.begin(vk::CommandBufferBeginInfo{});
-        // Barrier to ensure that input buffer transfer is finished before compute shader reads from it
-        vk::BufferMemoryBarrier bufferBarrier;
-        bufferBarrier.buffer = deviceBuffer.buffer;
-        bufferBarrier.size = VK_WHOLE_SIZE;
-        bufferBarrier.srcAccessMask = vk::AccessFlagBits::eHostWrite;
-        bufferBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-        bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-
-        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eHost, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, bufferBarrier, nullptr);
+    void recordCommandBuffer(const vk::Pipeline& pipeline, uint32_t elements, uint32_t workgroupSize) {
+        const auto groups = vkx::workGroupCounts(context, elements, workgroupSize);
+        commandBuffer.reset({});
+        commandBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+        profiler.beginCommandBuffer(commandBuffer, 0);
         commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
         commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
-        commandBuffer.dispatch(BUFFER_ELEMENTS, 1, 1);
+
+        // Dispatches run one after the other, so each is timed on its own rather than overlapping the next
+        vk::MemoryBarrier memoryBarrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderWrite };
+        for (uint32_t i = 0; i < settings.warmup + settings.iterations; ++i) {
+            const bool timed = i >= settings.warmup;
+            if (timed) {
+                profiler.beginScope(commandBuffer, "dispatch");
+            }
+            commandBuffer.dispatch(groups[0], groups[1], 1);
+            if (timed) {
+                profiler.endScope(commandBuffer);
+            }
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, memoryBarrier, nullptr,
+                                          nullptr);
+        }
 
         // Barrier to ensure that shader writes are finished before buffer is read back from GPU
+        vk::BufferMemoryBarrier bufferBarrier;
+        bufferBarrier.buffer = outputBuffer.buffer;
+        bufferBarrier.size = VK_WHOLE_SIZE;
         bufferBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
         bufferBarrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+        bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
         commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, bufferBarrier, nullptr);
 
         // Read back to host visible buffer
-        vk::BufferCopy copyRegion{ 0, 0, bufferSize };
-        commandBuffer.copyBuffer(deviceBuffer.buffer, hostBuffer.buffer, copyRegion);
+        vk::BufferCopy copyRegion{ 0, 0, sizeof(uint32_t) * elements };
+        commandBuffer.copyBuffer(outputBuffer.buffer, hostBuffer.buffer, copyRegion);
 
         // Barrier to ensure that buffer copy is finished before host reading from it
         bufferBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
         bufferBarrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
         bufferBarrier.buffer = hostBuffer.buffer;
         commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, nullptr, bufferBarrier, nullptr);
+        profiler.endCommandBuffer(commandBuffer);
         commandBuffer.end();
     }
 
-    void run() {
-        LOG("Running headless compute example\n");
-        prepare();
+    // Run one configuration, returns false if it can't run on this device
+    bool measure(uint32_t elements, uint32_t workgroupSize, Measurement& measurement) {
+        const auto& limits = context.deviceProperties.limits;
+        if (workgroupSize == 0 || workgroupSize > limits.maxComputeWorkGroupSize[0] || workgroupSize > limits.maxComputeWorkGroupInvocations) {
+            LOG("Skipping workgroup size %u, the device supports up to %u\n", workgroupSize,
+                std::min(limits.maxComputeWorkGroupSize[0], limits.maxComputeWorkGroupInvocations));
+            return false;
+        }
 
-        {
-            // Fence for compute CB sync
-            vk::Fence fence = device.createFence(vk::FenceCreateInfo{});
+        vk::Pipeline pipeline = createPipeline(elements, workgroupSize);
+        recordCommandBuffer(pipeline, elements, workgroupSize);
 
-            // Submit compute work
-            const vk::PipelineStageFlags waitStageMask = vk::PipelineStageFlagBits::eTransfer;
-            vk::SubmitInfo computeSubmitInfo;
-            computeSubmitInfo.pWaitDstStageMask = &waitStageMask;
-            computeSubmitInfo.commandBufferCount = 1;
-            computeSubmitInfo.pCommandBuffers = &commandBuffer;
-            queue.submit(computeSubmitInfo, fence);
-            device.waitForFences(fence, VK_TRUE, UINT64_MAX);
-            device.destroy(fence);
+        // Submit compute work
+        vk::SubmitInfo computeSubmitInfo;
+        computeSubmitInfo.commandBufferCount = 1;
+        computeSubmitInfo.pCommandBuffers = &commandBuffer;
+        queue.submit(computeSubmitInfo, fence);
+        device.waitForFences(fence, VK_TRUE, UINT64_MAX);
+        device.resetFences(fence);
+        device.destroy(pipeline);
+
+        const uint64_t collections = profiler.getCollectionCount();
+        profiler.collect(0);
+        std::vector<double> milliseconds;
+        if (profiler.getCollectionCount() != collections) {
+            for (const auto& scope : profiler.getScopes()) {
+                milliseconds.push_back(scope.lastMilliseconds);
+            }
         }
 
         {
@@ -180,36 +371,124 @@ public:
             hostBuffer.map();
             hostBuffer.invalidate();
             // Copy to output
-            memcpy(computeOutput.data(), hostBuffer.mapped, bufferSize);
+            memcpy(computeOutput.data(), hostBuffer.mapped, sizeof(uint32_t) * elements);
             hostBuffer.unmap();
         }
 
-        // Output buffer contents
-        LOG("Compute input:\n");
-        for (auto v : computeInput) {
-            LOG("%d \t", v);
+        measurement.elements = elements;
+        measurement.workgroupSize = workgroupSize;
+        measurement.measure(milliseconds, settings.kernel.bytesPerElement);
+        measurement.verified = true;
+        if (settings.kernel.expected) {
+            for (uint32_t i = 0; i < elements; ++i) {
+                if (computeOutput[i] != settings.kernel.expected(computeInput[i])) {
+                    LOG("Element %u is %u, expected %u\n", i, computeOutput[i], settings.kernel.expected(computeInput[i]));
+                    measurement.verified = false;
+                    break;
+                }
+            }
+        }
+        return true;
+    }
+
+    void writeReport() const {
+        const auto& path = settings.outputPath;
+        std::ofstream out(path);
+        if (!out.is_open()) {
+            LOG("Unable to write benchmark report %s\n", path.c_str());
+            return;
+        }
+        out << std::fixed << std::setprecision(6);
+        const bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+        if (csv) {
+            out << "kernel,elements,workgroup_size,iterations,mean_ms,stddev_ms,min_ms,max_ms,median_ms,gb_per_s,elements_per_s,verified\n";
+            for (const auto& m : measurements) {
+                out << settings.kernel.name << "," << m.elements << "," << m.workgroupSize << "," << m.count << "," << m.mean << "," << m.stddev << "," << m.min
+                    << "," << m.max << "," << m.median << "," << m.gigabytesPerSecond << "," << m.elementsPerSecond << "," << (m.verified ? 1 : 0) << "\n";
+            }
+            return;
+        }
+        const auto& properties = context.deviceProperties;
+        out << "{\n  \"device\": \"" << properties.deviceName << "\",\n  \"driverVersion\": " << properties.driverVersion << ",\n  \"kernel\": \""
+            << settings.kernel.name << "\",\n  \"runs\": [";
+        for (size_t i = 0; i < measurements.size(); ++i) {
+            const auto& m = measurements[i];
+            out << (i ? "," : "") << "\n    { \"elements\": " << m.elements << ", \"workgroupSize\": " << m.workgroupSize << ", \"iterations\": " << m.count
+                << ", \"mean\": " << m.mean << ", \"stddev\": " << m.stddev << ", \"min\": " << m.min << ", \"max\": " << m.max << ", \"median\": " << m.median
+                << ", \"gbPerSecond\": " << m.gigabytesPerSecond << ", \"elementsPerSecond\": " << m.elementsPerSecond
+                << ", \"verified\": " << (m.verified ? "true" : "false") << " }";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    // Returns false if any configuration produced wrong results
+    bool run() {
+        LOG("Running headless compute benchmark\n");
+        prepare();
+
+        LOG("Kernel %s, %u timed dispatches per configuration\n", settings.kernel.name.c_str(), settings.iterations);
+        bool verified = true;
+        for (const auto elements : settings.elements) {
+            setupBuffers(elements);
+            for (const auto workgroupSize : settings.workgroupSizes) {
+                Measurement measurement;
+                if (!measure(elements, workgroupSize, measurement)) {
+                    continue;
+                }
+                verified = verified && measurement.verified;
+                // The coefficient of variation compares the spread of configurations with different means
+                LOG("%10u elements, workgroup %4u: %9.4f ms mean, %8.4f ms stddev (%5.1f%%), %9.4f ms min, %8.2f GB/s, %.3e elements/s%s\n", elements,
+                    workgroupSize, measurement.mean, measurement.stddev, measurement.mean > 0.0 ? 100.0 * measurement.stddev / measurement.mean : 0.0,
+                    measurement.min, measurement.gigabytesPerSecond, measurement.elementsPerSecond, measurement.verified ? "" : ", WRONG RESULTS");
+                measurements.push_back(measurement);
+            }
+        }
+        if (!settings.outputPath.empty()) {
+            writeReport();
         }
-        std::cout << std::endl;
 
-        LOG("Compute output:\n");
-        for (auto v : computeOutput) {
-            LOG("%d \t", v);
+        // Output buffer contents of small runs, like the original example
+        if (computeInput.size() <= 64) {
+            LOG("Compute input:\n");
+            for (auto v : computeInput) {
+                LOG("%d \t", v);
+            }
+            std::cout << std::endl;
+
+            LOG("Compute output:\n");
+            for (auto v : computeOutput) {
+                LOG("%d \t", v);
+            }
+            std::cout << std::endl;
         }
-        std::cout << std::endl;
+        return verified;
     }
 
     ~VulkanExample() {
-        deviceBuffer.destroy();
+        profiler.destroy();
+        inputBuffer.destroy();
+        outputBuffer.destroy();
         hostBuffer.destroy();
+        device.destroy(fence);
         device.destroy(pipelineLayout);
         device.destroy(descriptorSetLayout);
         device.destroy(descriptorPool);
-        device.destroy(pipeline);
         device.destroy(commandPool);
         context.destroy();
-        std::cout << "Finished. Press enter to terminate...";
-        getchar();
+        // Interactive runs only, benchmarks started with arguments must not wait for input
+        if (vkx::getCommandLine().size() <= 1) {
+            std::cout << "Finished. Press enter to terminate...";
+            getchar();
+        }
     }
 };
 
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
 VULKAN_EXAMPLE_MAIN()
+#else
+// The exit code tells scripts whether the results were right
+int main(const int argc, const char* argv[]) {
+    vkx::setCommandLine(argc, argv);
+    return VulkanExample().run() ? 0 : 1;
+}
+#endif
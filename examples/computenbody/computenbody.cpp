@@ -1,5 +1,5 @@
 /*
-* Vulkan Example - Compute shader N-body simulation using two passes and shared compute shader memory
+* Vulkan Example - Compute shader N-body simulation using shared compute shader memory or a Barnes-Hut tree
 *
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
@@ -15,6 +15,19 @@
 #define PARTICLES_PER_ATTRACTOR 4 * 1024
 #endif
 
+// The simulation runs one of two ways, both ending in the same integration
+//   direct       every particle sums the attraction of every other one, a workgroup sized tile at a time through
+//                shared memory (particle_calculate.comp), O(N^2)
+//   Barnes-Hut   a tree built on the GPU every frame lumps distant particles together, O(N log N):
+//                bh_bounds      scene bounds
+//                bh_morton      Morton code per particle
+//                bh_sort        bitonic sort of the codes, one network step per dispatch
+//                bh_build       radix tree over the sorted codes
+//                bh_summarize   centres of mass, bottom up
+//                bh_force       tree walk and integration
+// Particles are double buffered in the slots of storageBuffer, and each frame's pass reads the slot written last
+// and writes the other one, so there is no separate integration pass and the next frame's simulation can run on
+// the compute queue while the current one is drawn.
 class ComputeNBody : public vkx::Compute {
     using Parent = vkx::Compute;
 
@@ -26,27 +39,56 @@ public:
         glm::vec4 pos;  // xyz = position, w = mass
         glm::vec4 vel;  // xyz = velocity, w = gradient texture position
     };
-    uint32_t numParticles;
-    vks::Buffer storageBuffer;        // (Shader) storage buffer object containing the particles
-    vks::Buffer uniformBuffer;        // Uniform buffer object containing particle system parameters
-    vk::CommandBuffer commandBuffer;  // Command buffer storing the dispatch commands and barriers
+    // Barnes-Hut tree node, see nbody.glsl
+    struct Node {
+        glm::vec4 mass;
+        int32_t left;
+        int32_t right;
+        int32_t parent;
+        float size;
+    };
+    // May be changed before prepare
+    uint32_t numParticles{ 6 * PARTICLES_PER_ATTRACTOR };
+    // Workgroup size of every pass, 0 picks one from the device limits.  Rounded down to a power of two
+    uint32_t groupSize{ 0 };
+    bool barnesHut{ false };
+    // Number of sort keys, the particle count rounded up to a power of two
+    uint32_t sortCount{ 0 };
+    SlotBuffer storageBuffer;   // (Shader) storage buffer object containing both slots of the particles
+    vks::Buffer uniformBuffer;  // Uniform buffer object containing particle system parameters
+    vks::Buffer keys;
+    vks::Buffer nodes;
+    vks::Buffer tree;
+    // One per slot written
+    std::array<vk::CommandBuffer, SLOT_COUNT> commandBuffers;
     vk::DescriptorPool descriptorPool;
-    vk::DescriptorSetLayout descriptorSetLayout;  // Compute shader binding layout
-    vk::DescriptorSet descriptorSet;              // Compute shader bindings
-    vk::PipelineLayout pipelineLayout;            // Layout of the compute pipeline
-    vk::Pipeline pipelineCalculate;               // Compute pipeline for N-Body velocity calculation (1st pass)
-    vk::Pipeline pipelineIntegrate;               // Compute pipeline for euler integration (2nd pass)
-    vk::Pipeline blur;
-    vk::PipelineLayout pipelineLayoutBlur;
-    vk::DescriptorSetLayout descriptorSetLayoutBlur;
-    vk::DescriptorSet descriptorSetBlur;
+    vk::DescriptorSetLayout descriptorSetLayout;       // Compute shader binding layout
+    std::array<vk::DescriptorSet, SLOT_COUNT> descriptorSets;  // Compute shader bindings, per slot written
+    vk::PipelineLayout pipelineLayout;                 // Layout of the compute pipelines
+    vk::Pipeline pipelineCalculate;                    // Direct summation and integration
+    struct {
+        vk::Pipeline bounds;
+        vk::Pipeline morton;
+        vk::Pipeline sort;
+        vk::Pipeline build;
+        vk::Pipeline summarize;
+        vk::Pipeline force;
+    } pipelinesBarnesHut;
     struct computeUBO {     // Compute shader uniform block object
         float deltaT{ 0 };  //		Frame delta time
         float destX{ 0 };   //		x position of the attractor
         float destY{ 0 };   //		y position of the attractor
         int32_t particleCount;
+        float theta{ 0.5f };  //	Barnes-Hut opening angle
     } ubo;
 
+    // Must match nbody.glsl
+    struct PushConstants {
+        uint32_t sortCount;
+        uint32_t blockSize;
+        uint32_t distance;
+    };
+
     void prepare() {
         Parent::prepare();
 
@@ -60,8 +102,16 @@ public:
     void destroy() {
         storageBuffer.destroy();
         uniformBuffer.destroy();
+        keys.destroy();
+        nodes.destroy();
+        tree.destroy();
         device.destroy(pipelineCalculate);
-        device.destroy(pipelineIntegrate);
+        device.destroy(pipelinesBarnesHut.bounds);
+        device.destroy(pipelinesBarnesHut.morton);
+        device.destroy(pipelinesBarnesHut.sort);
+        device.destroy(pipelinesBarnesHut.build);
+        device.destroy(pipelinesBarnesHut.summarize);
+        device.destroy(pipelinesBarnesHut.force);
         device.destroy(pipelineLayout);
         device.destroy(descriptorSetLayout);
         device.destroy(descriptorPool);
@@ -71,78 +121,123 @@ public:
     void prepareDescriptors() {
         std::vector<vk::DescriptorPoolSize> poolSizes = {
             { vk::DescriptorType::eUniformBuffer, 2 },
-            { vk::DescriptorType::eStorageBuffer, 1 },
-            { vk::DescriptorType::eCombinedImageSampler, 2 },
+            { vk::DescriptorType::eStorageBuffer, 10 },
         };
 
         descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
         std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
-            // Binding 0 : Particle position storage buffer
+            // Binding 0 : Particles read
             { 0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
             // Binding 1 : Uniform buffer
             { 1, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 2 : Particles written
+            { 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 3 : Morton keys
+            { 3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 4 : Tree nodes
+            { 4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 5 : Scene bounds and node visit counts
+            { 5, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
         };
 
         descriptorSetLayout =
             device.createDescriptorSetLayout(vk::DescriptorSetLayoutCreateInfo{ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
-        descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
-
-        std::vector<vk::WriteDescriptorSet> computeWriteDescriptorSets{
-            // Binding 0 : Particle position storage buffer
-            { descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &storageBuffer.descriptor },
-            // Binding 1 : Uniform buffer
-            { descriptorSet, 1, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffer.descriptor },
-        };
+        const std::array<vk::DescriptorSetLayout, SLOT_COUNT> layouts{ descriptorSetLayout, descriptorSetLayout };
+        auto sets = device.allocateDescriptorSets({ descriptorPool, (uint32_t)layouts.size(), layouts.data() });
+
+        const vk::DescriptorBufferInfo slots[SLOT_COUNT]{ storageBuffer.descriptor(0), storageBuffer.descriptor(1) };
+        const vk::DescriptorBufferInfo keysInfo{ keys.buffer, 0, VK_WHOLE_SIZE };
+        const vk::DescriptorBufferInfo nodesInfo{ nodes.buffer, 0, VK_WHOLE_SIZE };
+        const vk::DescriptorBufferInfo treeInfo{ tree.buffer, 0, VK_WHOLE_SIZE };
+        std::vector<vk::WriteDescriptorSet> computeWriteDescriptorSets;
+        // Set i writes slot i and reads the other one
+        for (uint32_t i = 0; i < SLOT_COUNT; ++i) {
+            descriptorSets[i] = sets[i];
+            computeWriteDescriptorSets.insert(computeWriteDescriptorSets.end(),
+                                              {
+                                                  { sets[i], 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &slots[1 - i] },
+                                                  { sets[i], 1, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffer.descriptor },
+                                                  { sets[i], 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &slots[i] },
+                                                  { sets[i], 3, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &keysInfo },
+                                                  { sets[i], 4, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &nodesInfo },
+                                                  { sets[i], 5, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &treeInfo },
+                                              });
+        }
 
         device.updateDescriptorSets(computeWriteDescriptorSets, nullptr);
     }
 
-    void preparePipelines() {
-        // Create pipelines
-        pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+    // Largest power of two not above `value`
+    static uint32_t floorPowerOfTwo(uint32_t value) {
+        uint32_t result = 1;
+        while (result <= value / 2) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    void chooseGroupSize() {
+        const auto& limits = context.deviceProperties.limits;
+        // The bounds pass keeps two vec3 per invocation in shared memory
+        const uint32_t maxSize = std::min({ limits.maxComputeWorkGroupSize[0], limits.maxComputeWorkGroupInvocations,
+                                            (uint32_t)(limits.maxComputeSharedMemorySize / (2 * sizeof(glm::vec4))) });
+        groupSize = floorPowerOfTwo(std::min(groupSize ? groupSize : 256u, maxSize));
+    }
+
+    uint32_t groupCount(uint32_t invocations) const { return (invocations + groupSize - 1) / groupSize; }
+
+    vk::Pipeline createPipeline(const std::string& name, const vk::SpecializationInfo& specializationInfo) {
         vk::ComputePipelineCreateInfo computePipelineCreateInfo;
         computePipelineCreateInfo.layout = pipelineLayout;
-        // 1st pass
         computePipelineCreateInfo.stage =
-            vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/computenbody/particle_calculate.comp.spv", vk::ShaderStageFlagBits::eCompute);
+            vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/computenbody/" + name, vk::ShaderStageFlagBits::eCompute);
+        computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+        vk::Pipeline pipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+        return pipeline;
+    }
+
+    void preparePipelines() {
+        // Create pipelines
+        vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants) };
+        pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout, 1, &pushConstantRange });
         // Set shader parameters via specialization constants
         struct SpecializationData {
-            uint32_t sharedDataSize;
+            uint32_t groupSize;
             float gravity;
             float power;
             float soften;
         } specializationData;
 
         std::vector<vk::SpecializationMapEntry> specializationMapEntries{
-            { 0, offsetof(SpecializationData, sharedDataSize), sizeof(uint32_t) },
+            { 0, offsetof(SpecializationData, groupSize), sizeof(uint32_t) },
             { 1, offsetof(SpecializationData, gravity), sizeof(float) },
             { 2, offsetof(SpecializationData, power), sizeof(float) },
             { 3, offsetof(SpecializationData, soften), sizeof(float) },
         };
 
-        specializationData.sharedDataSize =
-            std::min((uint32_t)1024, (uint32_t)(context.deviceProperties.limits.maxComputeSharedMemorySize / sizeof(glm::vec4)));
-
+        // Also the tile size of the direct summation
+        specializationData.groupSize = groupSize;
         specializationData.gravity = 0.002f;
         specializationData.power = 0.75f;
         specializationData.soften = 0.05f;
 
         vk::SpecializationInfo specializationInfo{ static_cast<uint32_t>(specializationMapEntries.size()), specializationMapEntries.data(),
                                                    sizeof(specializationData), &specializationData };
-        computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
-        pipelineCalculate = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
-        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
-        // 2nd pass
-        computePipelineCreateInfo.stage =
-            vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/computenbody/particle_integrate.comp.spv", vk::ShaderStageFlagBits::eCompute);
-        pipelineIntegrate = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
-        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
-
-        // Create a command buffer for compute operations
-        commandBuffer = device.allocateCommandBuffers({ commandPool, vk::CommandBufferLevel::ePrimary, 1 })[0];
-
-        // Build a single command buffer containing the compute dispatch commands
-        buildComputeCommandBuffer();
+        pipelineCalculate = createPipeline("particle_calculate.comp.spv", specializationInfo);
+        pipelinesBarnesHut.bounds = createPipeline("bh_bounds.comp.spv", specializationInfo);
+        pipelinesBarnesHut.morton = createPipeline("bh_morton.comp.spv", specializationInfo);
+        pipelinesBarnesHut.sort = createPipeline("bh_sort.comp.spv", specializationInfo);
+        pipelinesBarnesHut.build = createPipeline("bh_build.comp.spv", specializationInfo);
+        pipelinesBarnesHut.summarize = createPipeline("bh_summarize.comp.spv", specializationInfo);
+        pipelinesBarnesHut.force = createPipeline("bh_force.comp.spv", specializationInfo);
+
+        // Create the command buffers for compute operations
+        auto allocated = device.allocateCommandBuffers({ commandPool, vk::CommandBufferLevel::ePrimary, (uint32_t)commandBuffers.size() });
+        std::copy(allocated.begin(), allocated.end(), commandBuffers.begin());
+
+        // Build the command buffers containing the compute dispatch commands
+        buildComputeCommandBuffers();
     }
 
     // Setup and fill the compute shader storage buffers containing the particles
@@ -159,7 +254,14 @@ public:
         };
 #endif
 
-        numParticles = static_cast<uint32_t>(attractors.size()) * PARTICLES_PER_ATTRACTOR;
+        chooseGroupSize();
+        // The tree needs at least one internal node
+        numParticles = std::max(numParticles, 2u);
+        sortCount = 1;
+        while (sortCount < numParticles) {
+            sortCount <<= 1;
+        }
+        const uint32_t particlesPerAttractor = (numParticles + (uint32_t)attractors.size() - 1) / (uint32_t)attractors.size();
         ubo.particleCount = numParticles;
         // Compute shader uniform buffer block
         uniformBuffer = context.createUniformBuffer(ubo);
@@ -170,69 +272,114 @@ public:
         std::mt19937 rndGen(static_cast<uint32_t>(time(0)));
         std::normal_distribution<float> rndDist(0.0f, 1.0f);
 
-        for (uint32_t i = 0; i < static_cast<uint32_t>(attractors.size()); i++) {
-            for (uint32_t j = 0; j < PARTICLES_PER_ATTRACTOR; j++) {
-                Particle& particle = particleBuffer[i * PARTICLES_PER_ATTRACTOR + j];
-
-                // First particle in group as heavy center of gravity
-                if (j == 0) {
-                    particle.pos = glm::vec4(attractors[i] * 1.5f, 90000.0f);
-                    particle.vel = glm::vec4(glm::vec4(0.0f));
-                } else {
-                    // Position
-                    glm::vec3 position(attractors[i] + glm::vec3(rndDist(rndGen), rndDist(rndGen), rndDist(rndGen)) * 0.75f);
-                    float len = glm::length(glm::normalize(position - attractors[i]));
-                    position.y *= 2.0f - (len * len);
-
-                    // Velocity
-                    glm::vec3 angular = glm::vec3(0.5f, 1.5f, 0.5f) * (((i % 2) == 0) ? 1.0f : -1.0f);
-                    glm::vec3 velocity =
-                        glm::cross((position - attractors[i]), angular) + glm::vec3(rndDist(rndGen), rndDist(rndGen), rndDist(rndGen) * 0.025f);
-
-                    float mass = (rndDist(rndGen) * 0.5f + 0.5f) * 75.0f;
-                    particle.pos = glm::vec4(position, mass);
-                    particle.vel = glm::vec4(velocity, 0.0f);
-                }
-
-                // Color gradient offset
-                particle.vel.w = (float)i * 1.0f / static_cast<uint32_t>(attractors.size());
+        for (uint32_t index = 0; index < numParticles; index++) {
+            const uint32_t i = index / particlesPerAttractor;
+            const uint32_t j = index % particlesPerAttractor;
+            Particle& particle = particleBuffer[index];
+
+            // First particle in group as heavy center of gravity
+            if (j == 0) {
+                particle.pos = glm::vec4(attractors[i] * 1.5f, 90000.0f);
+                particle.vel = glm::vec4(glm::vec4(0.0f));
+            } else {
+                // Position
+                glm::vec3 position(attractors[i] + glm::vec3(rndDist(rndGen), rndDist(rndGen), rndDist(rndGen)) * 0.75f);
+                float len = glm::length(glm::normalize(position - attractors[i]));
+                position.y *= 2.0f - (len * len);
+
+                // Velocity
+                glm::vec3 angular = glm::vec3(0.5f, 1.5f, 0.5f) * (((i % 2) == 0) ? 1.0f : -1.0f);
+                glm::vec3 velocity =
+                    glm::cross((position - attractors[i]), angular) + glm::vec3(rndDist(rndGen), rndDist(rndGen), rndDist(rndGen) * 0.025f);
+
+                float mass = (rndDist(rndGen) * 0.5f + 0.5f) * 75.0f;
+                particle.pos = glm::vec4(position, mass);
+                particle.vel = glm::vec4(velocity, 0.0f);
+            }
+
+            // Color gradient offset
+            particle.vel.w = (float)i * 1.0f / static_cast<uint32_t>(attractors.size());
+        }
+
+        storageBuffer = createSlotBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer, particleBuffer);
+
+        keys = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, sizeof(glm::uvec2) * sortCount);
+        nodes = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, sizeof(Node) * (2 * numParticles - 1));
+        tree = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                          2 * sizeof(glm::uvec4) + sizeof(uint32_t) * (numParticles - 1));
+    }
+
+    // Written by one dispatch, read or written by the next
+    static void computeBarrier(const vk::CommandBuffer& commandBuffer, vk::PipelineStageFlags srcStage = vk::PipelineStageFlagBits::eComputeShader) {
+        vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite,
+                                   vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+        commandBuffer.pipelineBarrier(srcStage, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+    }
+
+    void dispatch(const vk::CommandBuffer& commandBuffer, const vk::Pipeline& pipeline, uint32_t invocations) {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        commandBuffer.dispatch(groupCount(invocations), 1, 1);
+    }
+
+    void recordBarnesHut(const vk::CommandBuffer& commandBuffer, PushConstants& pushConstants) {
+        // Reset the bounds and the visit counts
+        commandBuffer.fillBuffer(tree.buffer, 0, sizeof(glm::uvec4), 0xFFFFFFFF);
+        commandBuffer.fillBuffer(tree.buffer, sizeof(glm::uvec4), VK_WHOLE_SIZE, 0);
+        computeBarrier(commandBuffer, vk::PipelineStageFlagBits::eTransfer);
+
+        dispatch(commandBuffer, pipelinesBarnesHut.bounds, numParticles);
+        computeBarrier(commandBuffer);
+        dispatch(commandBuffer, pipelinesBarnesHut.morton, sortCount);
+        computeBarrier(commandBuffer);
+        for (uint32_t blockSize = 2; blockSize <= sortCount; blockSize <<= 1) {
+            for (uint32_t distance = blockSize >> 1; distance > 0; distance >>= 1) {
+                pushConstants.blockSize = blockSize;
+                pushConstants.distance = distance;
+                commandBuffer.pushConstants<PushConstants>(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushConstants);
+                dispatch(commandBuffer, pipelinesBarnesHut.sort, sortCount);
+                computeBarrier(commandBuffer);
             }
         }
+        dispatch(commandBuffer, pipelinesBarnesHut.build, numParticles);
+        computeBarrier(commandBuffer);
+        dispatch(commandBuffer, pipelinesBarnesHut.summarize, numParticles);
+        computeBarrier(commandBuffer);
+        dispatch(commandBuffer, pipelinesBarnesHut.force, numParticles);
+    }
 
-        storageBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer, particleBuffer);
+    // Must not be called while the command buffers are pending
+    void buildComputeCommandBuffers() {
+        for (uint32_t i = 0; i < SLOT_COUNT; ++i) {
+            const auto& commandBuffer = commandBuffers[i];
+            beginCommandBuffer(commandBuffer, i);
+            vks::debug::marker::beginRegion(commandBuffer, barnesHut ? "N-body Barnes-Hut" : "N-body direct", glm::vec4(0.2f, 0.6f, 1.0f, 1.0f));
+            // The previous submission wrote the half read here and may still be using the tree
+            vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite };
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer,
+                                          {}, barrier, nullptr, nullptr);
+
+            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSets[i], nullptr);
+            PushConstants pushConstants{ sortCount, 0, 0 };
+            commandBuffer.pushConstants<PushConstants>(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushConstants);
+            if (barnesHut) {
+                recordBarnesHut(commandBuffer, pushConstants);
+            } else {
+                dispatch(commandBuffer, pipelineCalculate, numParticles);
+            }
+            vks::debug::marker::endRegion(commandBuffer);
+            endCommandBuffer(commandBuffer);
+        }
     }
 
-    void buildComputeCommandBuffer() {
-        // Compute particle movement
-        commandBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
-
-        // First pass: Calculate particle movement
-        // -------------------------------------------------------------------------------------------------------
-        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelineCalculate);
-        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
-        commandBuffer.dispatch(numParticles / 256, 1, 1);
-
-        // Add memory barrier to ensure that compute shader has finished writing to the buffer
-        vk::BufferMemoryBarrier bufferBarrier{ vk::AccessFlagBits::eShaderWrite,
-                                               vk::AccessFlagBits::eShaderRead,
-                                               VK_QUEUE_FAMILY_IGNORED,
-                                               VK_QUEUE_FAMILY_IGNORED,
-                                               storageBuffer.buffer,
-                                               0,
-                                               VK_WHOLE_SIZE };
-
-        // Second pass: Integrate particles
-        // -------------------------------------------------------------------------------------------------------
-        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, bufferBarrier,
-                                      nullptr);
-        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelineIntegrate);
-        commandBuffer.dispatch(numParticles / 256, 1, 1);
-        commandBuffer.end();
+    void setBarnesHut(bool enabled) {
+        barnesHut = enabled;
+        queue.waitIdle();
+        buildComputeCommandBuffers();
     }
 
     void submit() {
-        // Submit compute commands
-        Parent::submit(commandBuffer);
+        // Submit compute commands, reading the slot written by the previous submission
+        Parent::submit(commandBuffers[writeSlot()]);
     }
 };
 
@@ -259,6 +406,8 @@ public:
 
     // Resources for the compute part of the example
     ComputeNBody compute{ context };
+    // Draws of the particle slot the last compute pass wrote, per swap chain image
+    vkx::SlotDraws<vk::DrawIndirectCommand> slotDraws;
 
     VulkanExample() {
         title = "Compute shader N-body system";
@@ -268,11 +417,26 @@ public:
         camera.setRotation(glm::vec3(-26.0f, 75.0f, 0.0f));
         camera.setTranslation(glm::vec3(0.0f, 0.0f, -14.0f));
         camera.movementSpeed = 2.5f;
+        // Synchronize with the compute queue through queue timelines where the device supports them
+        context.enableTimelineSemaphores = true;
+
+        // --bodies <count>, --group-size <size> and --barnes-hut select what to benchmark
+        const auto& args = vkx::getCommandLine();
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (args[i] == "--bodies" && i + 1 < args.size()) {
+                compute.numParticles = (uint32_t)std::stoul(args[++i]);
+            } else if (args[i] == "--group-size" && i + 1 < args.size()) {
+                compute.groupSize = (uint32_t)std::stoul(args[++i]);
+            } else if (args[i] == "--barnes-hut") {
+                compute.barnesHut = true;
+            }
+        }
     }
 
     ~VulkanExample() {
         // Compute
         compute.destroy();
+        slotDraws.destroy();
 
         // Graphics
         graphics.uniformBuffer.destroy();
@@ -298,8 +462,9 @@ public:
         cmdBuffer.setScissor(0, scissor());
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, graphics.pipeline);
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, graphics.pipelineLayout, 0, graphics.descriptorSet, nullptr);
-        cmdBuffer.bindVertexBuffers(0, compute.storageBuffer.buffer, { 0 });
-        cmdBuffer.draw(compute.numParticles, 1, 0, 0);
+        cmdBuffer.bindVertexBuffers(0, compute.storageBuffer.buffer.buffer, { 0 });
+        // The first vertex is in the slot the last compute pass wrote
+        cmdBuffer.drawIndirect(slotDraws.buffer.buffer, slotDraws.offset(commandBufferImage(cmdBuffer)), 1, sizeof(vk::DrawIndirectCommand));
     }
 
     void setupDescriptorPool() {
@@ -386,19 +551,33 @@ public:
     }
 
     void draw() override {
+        prepareFrame();
+        // The image's previous frame is done with its draw command, point it at the latest particles
+        slotDraws.select(currentBuffer, compute.readSlot());
         // Submit graphics commands
-        ExampleBase::draw();
+        drawCurrentCommandBuffer();
+        submitFrame();
 
         static std::once_flag once;
-        std::call_once(once, [&] { addRenderWaitSemaphore(compute.semaphores.complete, vk::PipelineStageFlagBits::eComputeShader); });
-        static const std::vector<vk::PipelineStageFlags> waitStages{ vk::PipelineStageFlagBits::eComputeShader };
+        if (!context.timelineSemaphoresEnabled) {
+            std::call_once(once, [&] { addRenderWaitSemaphore(compute.semaphores.complete, vk::PipelineStageFlagBits::eVertexInput); });
+        }
+        // Simulate the next frame while this one is drawn
         compute.submit();
+        compute.reportTimings(profiler);
     }
 
     void prepare() override {
         ExampleBase::prepare();
+        compute.overlap = true;
         compute.prepare();
-        renderSignalSemaphores.push_back(compute.semaphores.ready);
+        slotDraws.create(context, swapChain.imageCount, { compute.numParticles, 1, 0, 0 }, compute.numParticles);
+        if (context.timelineSemaphoresEnabled) {
+            // The draw reads the particles the compute pass wrote
+            addRenderWaitQueue(compute.queue, vk::PipelineStageFlagBits::eVertexInput);
+        } else {
+            renderSignalSemaphores.push_back(compute.semaphores.ready);
+        }
 
         prepareUniformBuffers();
         setupDescriptorSetLayout();
@@ -415,6 +594,22 @@ public:
     }
 
     void viewChanged() override { updateGraphicsUniformBuffers(); }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            bool barnesHut = compute.barnesHut;
+            if (ui.checkBox("Barnes-Hut", &barnesHut)) {
+                compute.setBarnesHut(barnesHut);
+            }
+            if (compute.barnesHut) {
+                ui.sliderFloat("Theta", &compute.ubo.theta, 0.0f, 1.5f);
+            }
+        }
+        if (ui.header("Statistics")) {
+            ui.text("Bodies: %u", compute.numParticles);
+            ui.text("Workgroup size: %u", compute.groupSize);
+        }
+    }
 };
 
 VULKAN_EXAMPLE_MAIN()
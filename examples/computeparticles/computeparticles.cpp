@@ -17,6 +17,9 @@
 #define PARTICLE_COUNT 256 * 1024
 #endif
 
+// Must match the local size of particle.comp
+#define GROUP_SIZE 256
+
 struct Particle {
     glm::vec2 pos;
     glm::vec2 vel;
@@ -32,12 +35,14 @@ public:
     vk::Pipeline pipeline;
     vk::PipelineLayout pipelineLayout;
     vk::DescriptorPool descriptorPool;
-    vk::DescriptorSet descriptorSet;
+    // Set i writes slot i and reads the other one
+    std::array<vk::DescriptorSet, SLOT_COUNT> descriptorSets;
     vk::DescriptorSetLayout descriptorSetLayout;
-    vk::CommandBuffer commandBuffer;
+    // One per slot written
+    std::array<vk::CommandBuffer, SLOT_COUNT> commandBuffers;
 
     struct {
-        vks::Buffer storage;
+        SlotBuffer storage;
         vks::Buffer uniform;
     } buffers;
 
@@ -54,9 +59,12 @@ public:
         prepareDescriptors();
         preparePipeline();
 
-        // Create a command buffer for compute operations
-        commandBuffer = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo{ commandPool, vk::CommandBufferLevel::ePrimary, 1 })[0];
-        updateCommandBuffer(commandBuffer);
+        // Create the command buffers for compute operations
+        auto allocated = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo{ commandPool, vk::CommandBufferLevel::ePrimary, SLOT_COUNT });
+        for (uint32_t i = 0; i < SLOT_COUNT; ++i) {
+            commandBuffers[i] = allocated[i];
+            updateCommandBuffer(commandBuffers[i], i);
+        }
         // Create compute pipeline
         // Compute pipelines are created separate from graphics pipelines
         // even if they use the same queue
@@ -74,27 +82,38 @@ public:
 
     void prepareDescriptors() {
         std::vector<vk::DescriptorPoolSize> poolSizes = {
-            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 1 },
-            vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 1 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, SLOT_COUNT },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 2 * SLOT_COUNT },
         };
 
-        descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
+        descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, SLOT_COUNT, (uint32_t)poolSizes.size(), poolSizes.data() });
         std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings = {
-            // Binding 0 : Particle position storage buffer
+            // Binding 0 : Particles read
             vk::DescriptorSetLayoutBinding{ 0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
             // Binding 1 : Uniform buffer
             vk::DescriptorSetLayoutBinding{ 1, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 2 : Particles written
+            vk::DescriptorSetLayoutBinding{ 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
         };
 
         descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
-        descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
-
-        std::vector<vk::WriteDescriptorSet> computeWriteDescriptorSets{
-            // Binding 0 : Particle position storage buffer
-            { descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &buffers.storage.descriptor },
-            // Binding 1 : Uniform buffer
-            { descriptorSet, 1, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &buffers.uniform.descriptor },
-        };
+        const std::array<vk::DescriptorSetLayout, SLOT_COUNT> layouts{ descriptorSetLayout, descriptorSetLayout };
+        auto sets = device.allocateDescriptorSets({ descriptorPool, (uint32_t)layouts.size(), layouts.data() });
+
+        const vk::DescriptorBufferInfo slots[SLOT_COUNT]{ buffers.storage.descriptor(0), buffers.storage.descriptor(1) };
+        std::vector<vk::WriteDescriptorSet> computeWriteDescriptorSets;
+        for (uint32_t i = 0; i < SLOT_COUNT; ++i) {
+            descriptorSets[i] = sets[i];
+            computeWriteDescriptorSets.insert(computeWriteDescriptorSets.end(),
+                                              {
+                                                  // Binding 0 : Particles read
+                                                  { sets[i], 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &slots[1 - i] },
+                                                  // Binding 1 : Uniform buffer
+                                                  { sets[i], 1, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &buffers.uniform.descriptor },
+                                                  // Binding 2 : Particles written
+                                                  { sets[i], 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &slots[i] },
+                                              });
+        }
 
         device.updateDescriptorSets(computeWriteDescriptorSets, {});
     }
@@ -111,16 +130,18 @@ public:
         device.destroyShaderModule(computePipelineCreateInfo.stage.module);
     }
 
-    void updateCommandBuffer(const vk::CommandBuffer& cmdBuffer) {
-        cmdBuffer.begin({ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
+    void updateCommandBuffer(const vk::CommandBuffer& cmdBuffer, uint32_t slot) {
+        beginCommandBuffer(cmdBuffer, slot);
         // Compute particle movement
-        // Add memory barrier to ensure that the (rendering) vertex shader operations have finished
-        // Required as the compute shader will overwrite the vertex buffer data
+        // The previous pass wrote the slot read here.  The draws reading the slot written here are waited for
+        // through the submission
+        vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead };
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
-        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
-        // Dispatch the compute job
-        cmdBuffer.dispatch(PARTICLE_COUNT / 16, 1, 1);
-        cmdBuffer.end();
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSets[slot], nullptr);
+        // Dispatch the compute job, one invocation per particle
+        cmdBuffer.dispatch((PARTICLE_COUNT + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+        endCommandBuffer(cmdBuffer);
     }
 
     void prepareBuffers() {
@@ -139,15 +160,12 @@ public:
             particle.gradientPos.x = particle.pos.x / 2.0f;
         }
 
-        uint32_t storageBufferSize = (uint32_t)(particleBuffer.size() * sizeof(Particle));
-
         // Staging
-        // SSBO is static, copy to device local memory
-        // This results in better performance
-        buffers.storage = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer, particleBuffer);
+        // Both slots start out with the initial particles in device local memory
+        buffers.storage = createSlotBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer, particleBuffer);
     }
 
-    void submit() { Parent::submit(commandBuffer); }
+    void submit() { Parent::submit(commandBuffers[writeSlot()]); }
 };
 
 class VulkanExample : public vkx::ExampleBase {
@@ -157,6 +175,8 @@ public:
     bool animate = true;
 
     ComputeParticles compute{ context };
+    // Draws of the particle slot the last compute pass wrote, per swap chain image
+    vkx::SlotDraws<vk::DrawIndirectCommand> slotDraws;
     struct {
         vk::Pipeline pipeline;
         vk::PipelineLayout pipelineLayout;
@@ -168,13 +188,18 @@ public:
         vks::texture::Texture2D gradient;
     } textures;
 
-    VulkanExample() { title = "Vulkan Example - Compute shader particle system"; }
+    VulkanExample() {
+        title = "Vulkan Example - Compute shader particle system";
+        // Synchronize with the compute queue through queue timelines where the device supports them
+        context.enableTimelineSemaphores = true;
+    }
 
     ~VulkanExample() {
         // Clean up used Vulkan resources
         // Note : Inherited destructor cleans up resources stored in base class
 
         compute.destroy();
+        slotDraws.destroy();
 
         device.destroyPipeline(graphics.pipeline);
 
@@ -196,8 +221,8 @@ public:
         cmdBuffer.setScissor(0, vks::util::rect2D(size));
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, graphics.pipeline);
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, graphics.pipelineLayout, 0, graphics.descriptorSet, nullptr);
-        cmdBuffer.bindVertexBuffers(0, compute.buffers.storage.buffer, { 0 });
-        cmdBuffer.draw(PARTICLE_COUNT, 1, 0, 0);
+        cmdBuffer.bindVertexBuffers(0, compute.buffers.storage.buffer.buffer, { 0 });
+        cmdBuffer.drawIndirect(slotDraws.buffer.buffer, slotDraws.offset(commandBufferImage(cmdBuffer)), 1, sizeof(vk::DrawIndirectCommand));
     }
 
     void updateUniformBuffers() {
@@ -281,22 +306,37 @@ public:
 
     void prepare() override {
         ExampleBase::prepare();
+        compute.overlap = true;
         compute.prepare();
+        slotDraws.create(context, swapChain.imageCount, { PARTICLE_COUNT, 1, 0, 0 }, PARTICLE_COUNT);
         prepareDescriptors();
         preparePipelines();
         buildCommandBuffers();
-        renderSignalSemaphores.push_back(compute.semaphores.ready);
+        if (context.timelineSemaphoresEnabled) {
+            // The draw reads the particles the compute pass wrote
+            addRenderWaitQueue(compute.queue, vk::PipelineStageFlagBits::eVertexInput);
+        } else {
+            renderSignalSemaphores.push_back(compute.semaphores.ready);
+        }
         prepared = true;
     }
 
     void draw() override {
+        prepareFrame();
+        // The image's previous frame is done with its draw command, point it at the latest particles
+        slotDraws.select(currentBuffer, compute.readSlot());
         // Submit graphics commands
-        ExampleBase::draw();
+        drawCurrentCommandBuffer();
+        submitFrame();
 
         static std::once_flag once;
-        std::call_once(once, [&] { addRenderWaitSemaphore(compute.semaphores.complete, vk::PipelineStageFlagBits::eComputeShader); });
+        if (!context.timelineSemaphoresEnabled) {
+            std::call_once(once, [&] { addRenderWaitSemaphore(compute.semaphores.complete, vk::PipelineStageFlagBits::eVertexInput); });
+        }
 
+        // Simulate the next frame while this one is drawn
         compute.submit();
+        compute.reportTimings(profiler);
     }
 
     void update(float deltaTime) override {
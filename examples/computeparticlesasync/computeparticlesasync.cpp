@@ -0,0 +1,490 @@
+/*
+* Vulkan Example - Attraction based compute shader particle system on a dedicated compute queue
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <vulkanExampleBase.h>
+
+#if defined(__ANDROID__)
+// Lower particle count on Android for performance reasons
+#define PARTICLE_COUNT 64 * 1024
+#else
+#define PARTICLE_COUNT 256 * 1024
+#endif
+
+// Must match the local size of particle.comp
+#define GROUP_SIZE 256
+
+struct Particle {
+    glm::vec2 pos;
+    glm::vec2 vel;
+    glm::vec4 gradientPos;
+};
+
+// The particles are simulated in place in `state`, either on the graphics queue right before the frame's render pass
+// (sync), or on the compute queue while the graphics queue draws the previous frame (async).  Async submissions end
+// by copying the particles into one of two render slots, which the frames drawn next read.
+//
+// Unlike a vkx::Compute::SlotBuffer, the render slots are exclusively owned, and cross between the queue families
+// with explicit ownership transfers, once each way per frame:
+//   compute   acquire slot w from graphics, simulate, copy into slot w, release slot w to graphics
+//   graphics  acquire slot w from compute, draw, release slot w to compute
+// The submission writing slot w waits for the frame before the last, the one that released it, see vkx::Compute.
+// `state` itself is only ever used by one queue at a time, which the mode switch waits for, so it is shared
+// concurrently instead.
+class ComputeParticles : public vkx::Compute {
+    using Parent = vkx::Compute;
+
+public:
+    ComputeParticles(const vks::Context& context)
+        : Parent(context) {}
+    vk::Pipeline pipeline;
+    vk::PipelineLayout pipelineLayout;
+    vk::DescriptorPool descriptorPool;
+    vk::DescriptorSet descriptorSet;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    // One per slot written
+    std::array<vk::CommandBuffer, SLOT_COUNT> commandBuffers;
+
+    struct {
+        vks::Buffer state;
+        std::array<vks::Buffer, SLOT_COUNT> slots;
+        vks::Buffer uniform;
+    } buffers;
+
+    struct UBO {
+        float deltaT{ 0 };
+        float destX{ 0 };
+        float destY{ 0 };
+        int32_t particleCount = PARTICLE_COUNT;
+    } ubo;
+
+    void prepare() override {
+        Parent::prepare();
+        prepareBuffers();
+        prepareDescriptors();
+        preparePipeline();
+        auto allocated = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo{ commandPool, vk::CommandBufferLevel::ePrimary, SLOT_COUNT });
+        std::copy(allocated.begin(), allocated.end(), commandBuffers.begin());
+        resetSlots();
+    }
+
+    void destroy() override {
+        buffers.state.destroy();
+        for (auto& slot : buffers.slots) {
+            slot.destroy();
+        }
+        buffers.uniform.destroy();
+        device.destroy(pipelineLayout);
+        device.destroy(descriptorSetLayout);
+        device.destroy(pipeline);
+        device.destroy(descriptorPool);
+        Parent::destroy();
+    }
+
+    void prepareDescriptors() {
+        std::vector<vk::DescriptorPoolSize> poolSizes = {
+            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 1 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 1 },
+        };
+        descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 1, (uint32_t)poolSizes.size(), poolSizes.data() });
+        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings = {
+            // Binding 0 : Particles, updated in place
+            vk::DescriptorSetLayoutBinding{ 0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 1 : Uniform buffer
+            vk::DescriptorSetLayoutBinding{ 1, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        };
+        descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+        descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+
+        const vk::DescriptorBufferInfo stateInfo{ buffers.state.buffer, 0, VK_WHOLE_SIZE };
+        std::vector<vk::WriteDescriptorSet> computeWriteDescriptorSets{
+            { descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &stateInfo },
+            { descriptorSet, 1, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &buffers.uniform.descriptor },
+        };
+        device.updateDescriptorSets(computeWriteDescriptorSets, {});
+    }
+
+    void preparePipeline() {
+        pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+        vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+        computePipelineCreateInfo.layout = pipelineLayout;
+        computePipelineCreateInfo.stage =
+            vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/computeparticlesasync/particle.comp.spv", vk::ShaderStageFlagBits::eCompute);
+        pipeline = device.createComputePipelines(context.pipelineCache, computePipelineCreateInfo)[0];
+        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+    }
+
+    // One step of the simulation, on whichever queue `cmdBuffer` is for.  The caller synchronizes with earlier
+    // accesses to the state.
+    void dispatch(const vk::CommandBuffer& cmdBuffer) const {
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
+        cmdBuffer.dispatch((PARTICLE_COUNT + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+    }
+
+    // Ownership transfer of a whole render slot between the queue families, the release half when recorded on the
+    // `src` family's queue and the acquire half on the `dst` family's.  A plain barrier when both are the same family.
+    vk::BufferMemoryBarrier slotTransfer(uint32_t slot, const vk::AccessFlags& srcAccess, const vk::AccessFlags& dstAccess, uint32_t src, uint32_t dst) const {
+        return { srcAccess, dstAccess, src, dst, buffers.slots[slot].buffer, 0, VK_WHOLE_SIZE };
+    }
+
+    void updateCommandBuffer(const vk::CommandBuffer& cmdBuffer, uint32_t slot) {
+        const uint32_t graphicsFamily = context.queueIndices.graphics;
+        const uint32_t computeFamily = context.queueIndices.compute;
+        beginCommandBuffer(cmdBuffer, slot);
+        // Acquire the slot from the frame that last drew it, whose release the submission waits for
+        auto acquire = slotTransfer(slot, {}, vk::AccessFlagBits::eTransferWrite, graphicsFamily, computeFamily);
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, acquire, nullptr);
+        // The previous submission updated the state and copied it out
+        vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+                                  {}, barrier, nullptr, nullptr);
+        dispatch(cmdBuffer);
+        barrier = vk::MemoryBarrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eTransferRead };
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer, {}, barrier, nullptr, nullptr);
+        cmdBuffer.copyBuffer(buffers.state.buffer, buffers.slots[slot].buffer, vk::BufferCopy{ 0, 0, sizeof(Particle) * PARTICLE_COUNT });
+        // Release it to the frames drawing it
+        auto release = slotTransfer(slot, vk::AccessFlagBits::eTransferWrite, {}, computeFamily, graphicsFamily);
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, release, nullptr);
+        endCommandBuffer(cmdBuffer);
+    }
+
+    void prepareBuffers() {
+        buffers.uniform = context.createUniformBuffer(ubo);
+        std::mt19937 rGenerator;
+        std::uniform_real_distribution<float> rDistribution(-1.0f, 1.0f);
+
+        // Initial particle positions
+        std::vector<Particle> particleBuffer(PARTICLE_COUNT);
+        for (auto& particle : particleBuffer) {
+            particle.pos = glm::vec2(rDistribution(rGenerator), rDistribution(rGenerator));
+            particle.vel = glm::vec2(0.0f);
+            particle.gradientPos.x = particle.pos.x / 2.0f;
+        }
+
+        const vk::DeviceSize size = sizeof(Particle) * particleBuffer.size();
+        buffers.state = context.createBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer |
+                                                 vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+                                             vk::MemoryPropertyFlagBits::eDeviceLocal, size, { context.queueIndices.graphics, context.queueIndices.compute });
+        context.stageUpload(size, particleBuffer.data(), 4, [&](const vk::CommandBuffer& copyCmd, const vk::Buffer& staging, vk::DeviceSize stagingOffset) {
+            copyCmd.copyBuffer(staging, buffers.state.buffer, vk::BufferCopy(stagingOffset, 0, size));
+        });
+    }
+
+    // Fresh render slots, both released to the compute family as if a frame had drawn them, which is what the
+    // command buffers expect.  Neither queue may be using the old ones.
+    void resetSlots() {
+        const uint32_t graphicsFamily = context.queueIndices.graphics;
+        const uint32_t computeFamily = context.queueIndices.compute;
+        for (uint32_t i = 0; i < SLOT_COUNT; ++i) {
+            buffers.slots[i].destroy();
+            buffers.slots[i] = context.createDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                                          sizeof(Particle) * PARTICLE_COUNT);
+        }
+        context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& cmdBuffer) {
+            std::vector<vk::BufferMemoryBarrier> releases;
+            for (uint32_t i = 0; i < SLOT_COUNT; ++i) {
+                releases.push_back(slotTransfer(i, {}, {}, graphicsFamily, computeFamily));
+            }
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, releases, nullptr);
+        });
+        for (uint32_t i = 0; i < SLOT_COUNT; ++i) {
+            updateCommandBuffer(commandBuffers[i], i);
+        }
+    }
+
+    void submit() { Parent::submit(commandBuffers[writeSlot()]); }
+};
+
+class VulkanExample : public vkx::ExampleBase {
+public:
+    float timer = 0.0f;
+    float animStart = 20.0f;
+    bool animate = true;
+    // Simulate on the compute queue, overlapping the previous frame, otherwise on the graphics queue ahead of the
+    // frame's render pass.  Switching takes timeline semaphores, without them the example stays async.
+    bool async = true;
+    // Whether an async submission wrote a render slot since the last resetSlots
+    bool slotWritten = false;
+
+    // Smoothed frame times in milliseconds, sync and async, each kept while its mode runs
+    std::array<double, 2> frameTimes{};
+    // Frames in the current mode, the first few of which still carry the switch
+    uint32_t modeFrames = 0;
+
+    ComputeParticles compute{ context };
+    struct {
+        vk::Pipeline pipeline;
+        vk::PipelineLayout pipelineLayout;
+        vk::DescriptorSet descriptorSet;
+        vk::DescriptorSetLayout descriptorSetLayout;
+    } graphics;
+    struct {
+        vks::texture::Texture2D particle;
+        vks::texture::Texture2D gradient;
+    } textures;
+
+    VulkanExample() {
+        title = "Vulkan Example - Async compute shader particle system";
+        settings.overlay = true;
+        // The frame's commands depend on the mode and on which slot is current
+        recordPerFrame = true;
+        // Synchronize with the compute queue through queue timelines where the device supports them
+        context.enableTimelineSemaphores = true;
+
+        // --sync starts out simulating on the graphics queue
+        const auto& args = vkx::getCommandLine();
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (args[i] == "--sync") {
+                async = false;
+            }
+        }
+    }
+
+    ~VulkanExample() {
+        compute.destroy();
+
+        device.destroyPipeline(graphics.pipeline);
+        device.destroyPipelineLayout(graphics.pipelineLayout);
+        device.destroyDescriptorSetLayout(graphics.descriptorSetLayout);
+
+        textures.particle.destroy();
+        textures.gradient.destroy();
+    }
+
+    void loadAssets() override {
+        textures.particle.loadFromFile(context, getAssetPath() + "textures/particle01_rgba.ktx", vk::Format::eR8G8B8A8Unorm);
+        textures.gradient.loadFromFile(context, getAssetPath() + "textures/particle_gradient_rgba.ktx", vk::Format::eR8G8B8A8Unorm);
+    }
+
+    void updateCommandBufferPreDraw(const vk::CommandBuffer& cmdBuffer) override {
+        const uint32_t slot = compute.readSlot();
+        if (async) {
+            if (slotWritten) {
+                // Acquire the slot the last submission released
+                auto acquire = compute.slotTransfer(slot, {}, vk::AccessFlagBits::eVertexAttributeRead, context.queueIndices.compute,
+                                                    context.queueIndices.graphics);
+                cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eVertexInput, {}, nullptr, acquire, nullptr);
+            }
+            return;
+        }
+        vks::debug::marker::beginRegion(cmdBuffer, "Compute", glm::vec4(0.2f, 0.6f, 1.0f, 1.0f));
+        // The previous frame drew and updated the state
+        vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+        const vk::PipelineStageFlags previous = vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eComputeShader;
+        cmdBuffer.pipelineBarrier(previous, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+        compute.dispatch(cmdBuffer);
+        barrier = vk::MemoryBarrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eVertexAttributeRead };
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eVertexInput, {}, barrier, nullptr, nullptr);
+        vks::debug::marker::endRegion(cmdBuffer);
+    }
+
+    void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        if (async && !slotWritten) {
+            return;
+        }
+        cmdBuffer.setViewport(0, vks::util::viewport(size));
+        cmdBuffer.setScissor(0, vks::util::rect2D(size));
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, graphics.pipeline);
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, graphics.pipelineLayout, 0, graphics.descriptorSet, nullptr);
+        const auto& particles = async ? compute.buffers.slots[compute.readSlot()] : compute.buffers.state;
+        cmdBuffer.bindVertexBuffers(0, particles.buffer, { 0 });
+        cmdBuffer.draw(PARTICLE_COUNT, 1, 0, 0);
+    }
+
+    void updateCommandBufferPostDraw(const vk::CommandBuffer& cmdBuffer) override {
+        if (async && slotWritten) {
+            // Hand the slot back to the submission that overwrites it next
+            auto release = compute.slotTransfer(compute.readSlot(), {}, {}, context.queueIndices.graphics, context.queueIndices.compute);
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eVertexInput, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, release, nullptr);
+        }
+    }
+
+    void updateUniformBuffers() {
+        compute.ubo.deltaT = frameTimer * 2.5f;
+        if (animate) {
+            compute.ubo.destX = sinf(glm::radians(timer * 360.0f)) * 0.75f;
+            compute.ubo.destY = 0.f;
+        } else {
+            float normalizedMx = (mousePos.x - static_cast<float>(size.width / 2)) / static_cast<float>(size.width / 2);
+            float normalizedMy = (mousePos.y - static_cast<float>(size.height / 2)) / static_cast<float>(size.height / 2);
+            compute.ubo.destX = normalizedMx;
+            compute.ubo.destY = normalizedMy;
+        }
+
+        memcpy(compute.buffers.uniform.mapped, &compute.ubo, sizeof(compute.ubo));
+    }
+
+    void prepareDescriptors() {
+        std::vector<vk::DescriptorPoolSize> poolSizes = {
+            vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 2 },
+        };
+        descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
+        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+            // Binding 0 : Particle color map
+            { 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 1 : Particle gradient ramp
+            { 1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
+        };
+        graphics.descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+        graphics.descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &graphics.descriptorSetLayout })[0];
+        std::vector<vk::DescriptorImageInfo> texDescriptors{
+            { textures.particle.sampler, textures.particle.view, vk::ImageLayout::eGeneral },
+            { textures.gradient.sampler, textures.gradient.view, vk::ImageLayout::eGeneral },
+        };
+
+        std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
+            // Binding 0 : Particle color map
+            { graphics.descriptorSet, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texDescriptors[0] },
+            // Binding 1 : Particle gradient ramp
+            { graphics.descriptorSet, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texDescriptors[1] },
+        };
+        device.updateDescriptorSets(writeDescriptorSets, {});
+    }
+
+    void preparePipelines() {
+        graphics.pipelineLayout = device.createPipelineLayout({ {}, 1, &graphics.descriptorSetLayout });
+        vks::pipelines::GraphicsPipelineBuilder pipelineBuilder{ device, graphics.pipelineLayout, renderPass };
+        pipelineBuilder.inputAssemblyState.topology = vk::PrimitiveTopology::ePointList;
+        pipelineBuilder.depthStencilState = { false };
+        auto& blendAttachmentState = pipelineBuilder.colorBlendState.blendAttachmentStates[0];
+        // Additive blending
+        blendAttachmentState.colorWriteMask =
+            vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
+        blendAttachmentState.blendEnable = VK_TRUE;
+        blendAttachmentState.colorBlendOp = vk::BlendOp::eAdd;
+        blendAttachmentState.srcColorBlendFactor = vk::BlendFactor::eOne;
+        blendAttachmentState.dstColorBlendFactor = vk::BlendFactor::eOne;
+        blendAttachmentState.alphaBlendOp = vk::BlendOp::eAdd;
+        blendAttachmentState.srcAlphaBlendFactor = vk::BlendFactor::eSrcAlpha;
+        blendAttachmentState.dstAlphaBlendFactor = vk::BlendFactor::eDstAlpha;
+
+        pipelineBuilder.vertexInputState.bindingDescriptions = { { 0, sizeof(Particle), vk::VertexInputRate::eVertex } };
+        pipelineBuilder.vertexInputState.attributeDescriptions = {
+            // Location 0 : Position
+            vk::VertexInputAttributeDescription{ 0, 0, vk::Format::eR32G32Sfloat, offsetof(Particle, pos) },
+            // Location 1 : Gradient position
+            vk::VertexInputAttributeDescription{ 1, 0, vk::Format::eR32G32B32A32Sfloat, offsetof(Particle, gradientPos) },
+        };
+
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/computeparticlesasync/particle.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/computeparticlesasync/particle.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        graphics.pipeline = pipelineBuilder.create(context.pipelineCache);
+    }
+
+    void prepare() override {
+        ExampleBase::prepare();
+        compute.overlap = true;
+        compute.prepare();
+        prepareDescriptors();
+        preparePipelines();
+        buildCommandBuffers();
+        if (context.timelineSemaphoresEnabled) {
+            // The draw reads the slot the compute pass wrote
+            addRenderWaitQueue(compute.queue, vk::PipelineStageFlagBits::eVertexInput);
+        } else {
+            async = true;
+            renderSignalSemaphores.push_back(compute.semaphores.ready);
+        }
+        prepared = true;
+    }
+
+    void setAsync(bool value) {
+        if (value == async || !context.timelineSemaphoresEnabled) {
+            return;
+        }
+        compute.queue.waitIdle();
+        context.queue.waitIdle();
+        async = value;
+        modeFrames = 0;
+        // A switch may leave a slot released by one queue and never acquired by the other
+        if (async) {
+            compute.resetSlots();
+            slotWritten = false;
+        }
+    }
+
+    void draw() override {
+        prepareFrame();
+        drawCurrentCommandBuffer();
+        submitFrame();
+        if (!async) {
+            return;
+        }
+
+        static std::once_flag once;
+        if (!context.timelineSemaphoresEnabled) {
+            std::call_once(once, [&] { addRenderWaitSemaphore(compute.semaphores.complete, vk::PipelineStageFlagBits::eVertexInput); });
+        }
+
+        // Simulate the next frame while this one is drawn
+        compute.submit();
+        compute.reportTimings(profiler);
+        slotWritten = true;
+    }
+
+    void update(float deltaTime) override {
+        vkx::ExampleBase::update(deltaTime);
+        if (animate) {
+            if (animStart > 0.0f) {
+                animStart -= frameTimer * 5.0f;
+            } else if (animStart <= 0.0f) {
+                timer += frameTimer * 0.04f;
+                if (timer > 1.f)
+                    timer = 0.f;
+            }
+        }
+
+        // Skip the frames that still wait for the switch
+        if (++modeFrames > 8) {
+            auto& frameTime = frameTimes[async ? 1 : 0];
+            const double milliseconds = frameTimer * 1000.0;
+            frameTime = frameTime == 0.0 ? milliseconds : frameTime * 0.95 + milliseconds * 0.05;
+        }
+
+        updateUniformBuffers();
+    }
+
+    bool applyBenchmarkSweep(uint32_t value) override {
+        if (!context.timelineSemaphoresEnabled) {
+            return false;
+        }
+        // --benchmark-sweep 0,1 compares sync against async
+        setAsync(value != 0);
+        return true;
+    }
+
+    void toggleAnimation() { animate = !animate; }
+
+    void keyPressed(uint32_t key) override {
+        switch (key) {
+            case KEY_A:
+                toggleAnimation();
+                break;
+        }
+    }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            ui.checkBox("Moving attractor", &animate);
+            bool value = async;
+            if (context.timelineSemaphoresEnabled && ui.checkBox("Async compute", &value)) {
+                setAsync(value);
+            }
+        }
+        if (ui.header("Statistics")) {
+            if (context.queueIndices.compute == context.queueIndices.graphics) {
+                ui.text("Compute queue shares the graphics family");
+            }
+            ui.text("Sync frame: %.3f ms", frameTimes[0]);
+            ui.text("Async frame: %.3f ms", frameTimes[1]);
+            if (frameTimes[0] > 0.0 && frameTimes[1] > 0.0) {
+                ui.text("Async saves: %.1f %%", (1.0 - frameTimes[1] / frameTimes[0]) * 100.0);
+            }
+        }
+    }
+};
+
+VULKAN_EXAMPLE_MAIN()
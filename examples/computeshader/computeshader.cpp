@@ -8,8 +8,24 @@
 
 #include <vulkanExampleBase.h>
 
+#include <map>
+
 const std::vector<std::string> shaderNames{ "sharpen", "edgedetect", "emboss" };
 
+// Ways of running the filters, see ComputeImage::recordFilters
+enum Variant : int32_t {
+    VARIANT_DIRECT,
+    VARIANT_TILED,
+    VARIANT_SEPARABLE,
+    VARIANT_CHAIN,
+    VARIANT_FUSED_CHAIN,
+};
+const std::vector<std::string> variantNames{ "Direct", "Tiled", "Separable", "Chain", "Fused chain" };
+
+// Must match tile.glsl and chain.comp
+const uint32_t TILE_SIZE = 16;
+const uint32_t MAX_CHAIN = 3;
+
 // Vertex layout for this example
 struct Vertex {
     float pos[3];
@@ -26,25 +42,56 @@ public:
 
     vks::Image& textureColorMap;
     vks::Image textureTarget;
+    // Between the filters of a chain of separate dispatches
+    vks::Image textureIntermediate;
     vk::DescriptorPool descriptorPool;
     vk::PipelineLayout pipelineLayout;
     vk::DescriptorSetLayout descriptorSetLayout;
-    vk::DescriptorSet descriptorSet;
-    std::vector<vk::Pipeline> pipelines;
+    // Every pair of images a dispatch reads and writes
+    struct {
+        vk::DescriptorSet sourceToTarget;
+        vk::DescriptorSet sourceToIntermediate;
+        vk::DescriptorSet intermediateToTarget;
+        vk::DescriptorSet targetToIntermediate;
+    } descriptorSets;
+    struct {
+        // Fetching every texel straight from the image, one per filter
+        std::vector<vk::Pipeline> direct;
+        // Through shared memory, one per filter
+        std::vector<vk::Pipeline> tiled;
+        // Null for filters that aren't separable
+        std::vector<vk::Pipeline> separable;
+        vk::Pipeline fusedChain;
+    } pipelines;
+    // One per slot, recorded again whenever the settings change
     std::vector<vk::CommandBuffer> commandBuffers;
+
+    // Settings, set through setVariant, setFilter and setChain
+    int32_t variant{ VARIANT_DIRECT };
     int32_t pipelineIndex{ 0 };
+    // Which filters the chain variants run, in the order of shaderNames
+    std::array<bool, 3> chainFilters{ { true, false, true } };
+
+    // Most recent GPU time of every variant run so far, by label()
+    std::map<std::string, double> timings;
 
     void destroy() override {
         queue.waitIdle();
         textureTarget.destroy();
+        textureIntermediate.destroy();
         device.freeCommandBuffers(commandPool, commandBuffers);
         device.destroyDescriptorPool(descriptorPool);
-        // Clean up used Vulkan resources
-        device.destroyPipelineLayout(pipelineLayout);
-        device.destroyDescriptorSetLayout(descriptorSetLayout);
-        for (auto& pipeline : pipelines) {
+        // Clean up used Vulkan resources, the layouts belong to the context's layout cache
+        for (auto& pipeline : pipelines.direct) {
             device.destroyPipeline(pipeline);
         }
+        for (auto& pipeline : pipelines.tiled) {
+            device.destroyPipeline(pipeline);
+        }
+        for (auto& pipeline : pipelines.separable) {
+            device.destroyPipeline(pipeline);
+        }
+        device.destroyPipeline(pipelines.fusedChain);
         Parent::destroy();
     }
 
@@ -52,38 +99,19 @@ public:
         Parent::prepare();
 
         textureTarget = prepareTextureTarget(vk::ImageLayout::eGeneral, textureColorMap.extent, vk::Format::eR8G8B8A8Unorm);
+        textureIntermediate = prepareTextureTarget(vk::ImageLayout::eGeneral, textureColorMap.extent, vk::Format::eR8G8B8A8Unorm);
 
         prepareDescriptors();
         preparePipelines();
     }
 
-    void prepareDescriptors() {
-        std::vector<vk::DescriptorPoolSize> poolSizes{
-            // Compute pipelines uses storage images for reading and writing
-            { vk::DescriptorType::eStorageImage, 2 },
-        };
-        descriptorPool = device.createDescriptorPool({ {}, 3, (uint32_t)poolSizes.size(), poolSizes.data() });
-
-        // Create compute pipeline
-        // Compute pipelines are created separate from graphics pipelines
-        // even if they use the same queue
-
-        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
-            // Binding 0 : Sampled image (read)
-            { 0, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute },
-            // Binding 1 : Sampled image (write)
-            { 1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute },
-        };
-
-        descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
-
+    vk::DescriptorSet createDescriptorSet(const vks::Image& input, const vks::Image& output) {
         vk::DescriptorSetAllocateInfo allocInfo{ descriptorPool, 1, &descriptorSetLayout };
-
-        descriptorSet = device.allocateDescriptorSets(allocInfo)[0];
+        vk::DescriptorSet descriptorSet = device.allocateDescriptorSets(allocInfo)[0];
 
         std::vector<vk::DescriptorImageInfo> computeTexDescriptors{
-            { {}, textureColorMap.view, vk::ImageLayout::eGeneral },
-            { {}, textureTarget.view, vk::ImageLayout::eGeneral },
+            { {}, input.view, vk::ImageLayout::eGeneral },
+            { {}, output.view, vk::ImageLayout::eGeneral },
         };
 
         std::vector<vk::WriteDescriptorSet> computeWriteDescriptorSets{
@@ -94,51 +122,210 @@ public:
         };
 
         device.updateDescriptorSets(computeWriteDescriptorSets, nullptr);
+        return descriptorSet;
+    }
+
+    void prepareDescriptors() {
+        std::vector<vk::DescriptorPoolSize> poolSizes{
+            // Compute pipelines uses storage images for reading and writing
+            { vk::DescriptorType::eStorageImage, 8 },
+        };
+        descriptorPool = device.createDescriptorPool({ {}, 4, (uint32_t)poolSizes.size(), poolSizes.data() });
+
+        // Every variant reads binding 0 and writes binding 1, and the fused chain takes its filters as push
+        // constants.  Reflected together, all the pipelines share one layout from the context's cache.
+        vks::shaders::ShaderLayout layout;
+        std::vector<std::string> shaders = shaderNames;
+        shaders.insert(shaders.end(), { "tiled", "separable", "chain" });
+        for (const auto& shader : shaders) {
+            layout.merge(vks::shaders::reflectShader(device, shaderFile(shader), vk::ShaderStageFlagBits::eCompute));
+        }
+        descriptorSetLayout = context.layoutCache->getDescriptorSetLayout(layout, 0);
+        pipelineLayout = context.layoutCache->getPipelineLayout(layout);
+
+        descriptorSets.sourceToTarget = createDescriptorSet(textureColorMap, textureTarget);
+        descriptorSets.sourceToIntermediate = createDescriptorSet(textureColorMap, textureIntermediate);
+        descriptorSets.intermediateToTarget = createDescriptorSet(textureIntermediate, textureTarget);
+        descriptorSets.targetToIntermediate = createDescriptorSet(textureTarget, textureIntermediate);
+    }
+
+    static std::string shaderFile(const std::string& shaderName) { return vkx::getAssetPath() + "shaders/computeshader/" + shaderName + ".comp.spv"; }
+
+    vk::Pipeline createPipeline(const std::string& shaderName, const vk::SpecializationInfo* specializationInfo = nullptr) {
+        vk::ComputePipelineCreateInfo computePipelineCreateInfo{ {}, {}, pipelineLayout };
+        computePipelineCreateInfo.stage = vks::shaders::loadShader(device, shaderFile(shaderName), vk::ShaderStageFlagBits::eCompute);
+        computePipelineCreateInfo.stage.pSpecializationInfo = specializationInfo;
+        vk::Pipeline pipeline = device.createComputePipelines(context.pipelineCache, computePipelineCreateInfo, nullptr)[0];
+        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+        return pipeline;
     }
 
     void preparePipelines() {
         // Create compute shader pipelines
-        pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
-        vk::ComputePipelineCreateInfo computePipelineCreateInfo{ {}, {}, pipelineLayout };
-        // One pipeline for each effect
-        for (auto& shaderName : shaderNames) {
-            std::string fileName = vkx::getAssetPath() + "shaders/computeshader/" + shaderName + ".comp.spv";
-            computePipelineCreateInfo.stage = vks::shaders::loadShader(device, fileName.c_str(), vk::ShaderStageFlagBits::eCompute);
-            pipelines.push_back(device.createComputePipelines(context.pipelineCache, computePipelineCreateInfo, nullptr)[0]);
-            device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+        // The shared memory variants select the filter with specialization constant 0
+        vk::SpecializationMapEntry specializationEntry{ 0, 0, sizeof(uint32_t) };
+        for (uint32_t filter = 0; filter < (uint32_t)shaderNames.size(); ++filter) {
+            vk::SpecializationInfo specializationInfo{ 1, &specializationEntry, sizeof(uint32_t), &filter };
+            pipelines.direct.push_back(createPipeline(shaderNames[filter]));
+            pipelines.tiled.push_back(createPipeline("tiled", &specializationInfo));
+            // Emboss weighs a diagonal, which doesn't split into rows and columns
+            pipelines.separable.push_back(shaderNames[filter] == "emboss" ? vk::Pipeline{} : createPipeline("separable", &specializationInfo));
         }
+        pipelines.fusedChain = createPipeline("chain");
 
-        commandBuffers = device.allocateCommandBuffers({ commandPool, vk::CommandBufferLevel::ePrimary, (uint32_t)shaderNames.size() });
+        commandBuffers = device.allocateCommandBuffers({ commandPool, vk::CommandBufferLevel::ePrimary, SLOT_COUNT });
         buildCommandBuffers();
     }
 
+    // Separable variants of filters that aren't separable run the tiled one
+    bool separableFallback() const { return variant == VARIANT_SEPARABLE && !pipelines.separable[pipelineIndex]; }
+
+    // The filters of the chain variants, never empty
+    std::vector<uint32_t> chain() const {
+        std::vector<uint32_t> result;
+        for (uint32_t filter = 0; filter < (uint32_t)chainFilters.size(); ++filter) {
+            if (chainFilters[filter]) {
+                result.push_back(filter);
+            }
+        }
+        return result;
+    }
+
+    bool chained() const { return variant == VARIANT_CHAIN || variant == VARIANT_FUSED_CHAIN; }
+
+    // What the current settings run, like "Tiled sharpen" or "Fused chain sharpen > emboss"
+    std::string label() const {
+        if (!chained()) {
+            return variantNames[separableFallback() ? VARIANT_TILED : variant] + " " + shaderNames[pipelineIndex];
+        }
+        std::string result = variantNames[variant];
+        const auto filters = chain();
+        for (size_t i = 0; i < filters.size(); ++i) {
+            result += (i ? " > " : " ") + shaderNames[filters[i]];
+        }
+        return result;
+    }
+
+    static void computeBarrier(const vk::CommandBuffer& commandBuffer) {
+        vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+    }
+
+    void dispatch(const vk::CommandBuffer& commandBuffer, const vk::Pipeline& pipeline, const vk::DescriptorSet& descriptorSet) {
+        // Rounded up, the shaders skip the invocations past the edges
+        const auto& extent = textureTarget.extent;
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
+        commandBuffer.dispatch((extent.width + TILE_SIZE - 1) / TILE_SIZE, (extent.height + TILE_SIZE - 1) / TILE_SIZE, 1);
+    }
+
+    void recordFilters(const vk::CommandBuffer& commandBuffer) {
+        switch (variant) {
+            case VARIANT_DIRECT:
+                dispatch(commandBuffer, pipelines.direct[pipelineIndex], descriptorSets.sourceToTarget);
+                break;
+            case VARIANT_TILED:
+            case VARIANT_SEPARABLE: {
+                const auto& pipeline = variant == VARIANT_TILED || separableFallback() ? pipelines.tiled[pipelineIndex] : pipelines.separable[pipelineIndex];
+                dispatch(commandBuffer, pipeline, descriptorSets.sourceToTarget);
+                break;
+            }
+            case VARIANT_CHAIN: {
+                // Tiled dispatches alternating between the target and the intermediate image, so that the last
+                // one writes the target
+                const auto filters = chain();
+                const size_t count = filters.size();
+                for (size_t i = 0; i < count; ++i) {
+                    const bool toTarget = (count - 1 - i) % 2 == 0;
+                    vk::DescriptorSet descriptorSet;
+                    if (i == 0) {
+                        descriptorSet = toTarget ? descriptorSets.sourceToTarget : descriptorSets.sourceToIntermediate;
+                    } else {
+                        descriptorSet = toTarget ? descriptorSets.intermediateToTarget : descriptorSets.targetToIntermediate;
+                    }
+                    if (i > 0) {
+                        computeBarrier(commandBuffer);
+                    }
+                    dispatch(commandBuffer, pipelines.tiled[filters[i]], descriptorSet);
+                }
+                break;
+            }
+            case VARIANT_FUSED_CHAIN: {
+                std::array<uint32_t, 1 + MAX_CHAIN> pushConstants{};
+                const auto filters = chain();
+                pushConstants[0] = (uint32_t)filters.size();
+                std::copy(filters.begin(), filters.end(), pushConstants.begin() + 1);
+                commandBuffer.pushConstants<uint32_t>(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushConstants);
+                dispatch(commandBuffer, pipelines.fusedChain, descriptorSets.sourceToTarget);
+                break;
+            }
+        }
+    }
+
+    // Must not be called while the command buffers are pending
     void buildCommandBuffers() {
-        for (size_t i = 0; i < pipelines.size(); ++i) {
-            const auto& commandBuffer = commandBuffers[i];
-            const auto& pipeline = pipelines[i];
-            // FIXME find a better way to block on re-using the compute command, or build multiple command buffers
-            commandBuffer.begin({ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
-            commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
-            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
-            commandBuffer.dispatch(textureTarget.extent.width / 16, textureTarget.extent.height / 16, 1);
-            commandBuffer.end();
+        for (uint32_t slot = 0; slot < SLOT_COUNT; ++slot) {
+            const auto& commandBuffer = commandBuffers[slot];
+            beginCommandBuffer(commandBuffer, slot);
+            // The previous submission wrote the images written here
+            computeBarrier(commandBuffer);
+            profiler.beginScope(commandBuffer, label());
+            recordFilters(commandBuffer);
+            profiler.endScope(commandBuffer);
+            endCommandBuffer(commandBuffer);
         }
     }
 
+    void rebuild() {
+        queue.waitIdle();
+        buildCommandBuffers();
+    }
+
+    void setVariant(int32_t value) {
+        variant = std::max<int32_t>(0, std::min<int32_t>(value, (int32_t)variantNames.size() - 1));
+        rebuild();
+    }
+
+    void setFilter(int32_t value) {
+        pipelineIndex = std::max<int32_t>(0, std::min<int32_t>(value, (int32_t)shaderNames.size() - 1));
+        rebuild();
+    }
+
+    // Keeps `filter` in the chain if it was the only one
+    void setChain(uint32_t filter, bool enabled) {
+        chainFilters[filter] = enabled;
+        if (chain().empty()) {
+            chainFilters[filter] = true;
+        }
+        rebuild();
+    }
+
     void switchPipeline(int32_t dir) {
         if ((dir < 0) && (pipelineIndex > 0)) {
-            pipelineIndex--;
+            setFilter(pipelineIndex - 1);
         }
-        if ((dir > 0) && (pipelineIndex < pipelines.size() - 1)) {
-            pipelineIndex++;
+        if ((dir > 0) && (pipelineIndex < (int32_t)pipelines.direct.size() - 1)) {
+            setFilter(pipelineIndex + 1);
         }
     }
 
-    vks::Image prepareTextureTarget(vk::ImageLayout targetLayout, const vk::Extent3D& extent, vk::Format format) {
-        vk::FormatProperties formatProperties;
+    // Record the per variant timings, and report them to `graphics`, the profiler timing the frames
+    void collectTimings(vks::debug::GpuProfiler& graphics) {
+        if (profiler.getCollectionCount() == collections) {
+            return;
+        }
+        collections = profiler.getCollectionCount();
+        for (const auto& scope : profiler.getScopes()) {
+            if (scope.depth > 0) {
+                timings[scope.name] = scope.milliseconds;
+                graphics.report(scope.name, scope.lastMilliseconds);
+            }
+        }
+    }
 
+    vks::Image prepareTextureTarget(vk::ImageLayout targetLayout, const vk::Extent3D& extent, vk::Format format) {
         // Get device properties for the requested texture format
-        formatProperties = context.physicalDevice.getFormatProperties(format);
+        const vk::FormatProperties& formatProperties = context.getFormatProperties(format);
         // Check if requested image format supports image storage operations
         assert(formatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eStorageImage);
 
@@ -183,7 +370,10 @@ public:
         return result;
     }
 
-    void submit() { Parent::submit(commandBuffers[pipelineIndex]); }
+    void submit() { Parent::submit(commandBuffers[writeSlot()]); }
+
+private:
+    uint64_t collections{ 0 };
 };
 
 class VulkanExample : public vkx::ExampleBase {
@@ -240,7 +430,7 @@ public:
 
         cmdBuffer.bindVertexBuffers(0, meshes.quad.vertices.buffer, { 0 });
 
-        cmdBuffer.bindIndexBuffer(meshes.quad.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.quad.indices.buffer, 0, meshes.quad.indexType);
         // Left (pre compute)
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, graphics.pipelineLayout, 0, graphics.descriptorSetPreCompute, nullptr);
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, graphics.pipeline);
@@ -387,6 +577,17 @@ public:
         std::call_once(once, [&] { addRenderWaitSemaphore(compute.semaphores.complete, vk::PipelineStageFlagBits::eComputeShader); });
 
         compute.submit();
+        compute.reportTimings(profiler);
+        compute.collectTimings(profiler);
+    }
+
+    // Runs the variant `value`, see Variant
+    bool applyBenchmarkSweep(uint32_t value) override {
+        if (value >= variantNames.size()) {
+            return false;
+        }
+        compute.setVariant((int32_t)value);
+        return true;
     }
 
     void viewChanged() override { updateUniformBuffers(); }
@@ -406,7 +607,36 @@ public:
 
     void OnUpdateUIOverlay() override {
         if (ui.header("Settings")) {
-            ui.comboBox("Shader", &compute.pipelineIndex, shaderNames);
+            int32_t variant = compute.variant;
+            if (ui.comboBox("Variant", &variant, variantNames)) {
+                compute.setVariant(variant);
+            }
+            if (compute.chained()) {
+                for (uint32_t filter = 0; filter < (uint32_t)shaderNames.size(); ++filter) {
+                    bool enabled = compute.chainFilters[filter];
+                    if (ui.checkBox(shaderNames[filter].c_str(), &enabled)) {
+                        compute.setChain(filter, enabled);
+                    }
+                }
+            } else {
+                int32_t filter = compute.pipelineIndex;
+                if (ui.comboBox("Shader", &filter, shaderNames)) {
+                    compute.setFilter(filter);
+                }
+                if (compute.separableFallback()) {
+                    ui.text("Not separable, running the tiled variant");
+                }
+            }
+        }
+        if (ui.header("Timings")) {
+            if (compute.timings.empty()) {
+                ui.text(context.timelineSemaphoresEnabled ? "Waiting for results" : "Needs timeline semaphores");
+            }
+            // Every variant run so far, to compare them
+            const auto current = compute.label();
+            for (const auto& timing : compute.timings) {
+                ui.text("%s%s: %.3f ms", timing.first == current ? "> " : "", timing.first.c_str(), timing.second);
+            }
         }
     }
 };
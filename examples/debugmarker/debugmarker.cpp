@@ -138,7 +138,7 @@ public:
         vk::DeviceSize offsets = 0;
 
         cmdBuffer.bindVertexBuffers(0, vertices.buffer, offsets);
-        cmdBuffer.bindIndexBuffer(indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(indices.buffer, 0, model.indexType);
         for (auto mesh : meshes) {
             // Add debug marker for mesh name
             DebugMarker::insert(cmdBuffer, "Draw \"" + mesh.name + "\"", glm::vec4(0.0f));
@@ -229,10 +229,8 @@ public:
     // Prepare a texture target and framebuffer for offscreen rendering
     void prepareOffscreen() {
         context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& cmdBuffer) {
-            vk::FormatProperties formatProperties;
-
             // Get device properites for the requested texture format
-            formatProperties = context.physicalDevice.getFormatProperties(OFFSCREEN_FORMAT);
+            const vk::FormatProperties& formatProperties = context.getFormatProperties(OFFSCREEN_FORMAT);
             // Check if blit destination is supported for the requested format
             // Only try for optimal tiling, linear tiling usually won't support blit as destination anyway
             assert(formatProperties.optimalTilingFeatures &  vk::FormatFeatureFlagBits::eBlitDst);
@@ -6,11 +6,19 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#include <random>
+
 #include <vulkanOffscreenExampleBase.hpp>
+#include <vks/clusteredLights.hpp>
 #include <vks/model.hpp>
+#include <vks/rendergraph.hpp>
+#include <vks/temporal.hpp>
 
 // Texture properties
 #define TEX_DIM 1024
+// The five lights of the scene, followed by randomly placed fill lights
+#define SCENE_LIGHT_COUNT 5
+#define MAX_LIGHT_COUNT 4096
 
 // Vertex layout for this example
 vks::model::VertexLayout vertexLayout{ {
@@ -25,6 +33,10 @@ class VulkanExample : public vkx::OffscreenExampleBase {
 
 public:
     bool debugDisplay = true;
+    // Render through the compact G-buffer, see prepareCompact
+    bool compactGBuffer = false;
+    // Jitter the G-buffer and resolve the composition temporally, with the classic G-buffer only
+    bool temporalAA = false;
 
     struct {
         vks::texture::Texture2D colorMap;
@@ -39,7 +51,14 @@ public:
         glm::mat4 projection;
         glm::mat4 model;
         glm::mat4 view;
-    } uboVS, uboOffscreenVS;
+    } uboOffscreenVS;
+
+    struct {
+        glm::mat4 projection;
+        glm::mat4 model;
+        // The part of the G-buffer rendered to at the current render scale in xy
+        glm::vec4 uvScale{ 1.0f };
+    } uboVS;
 
     struct Light {
         glm::vec4 position;
@@ -51,35 +70,78 @@ public:
     };
 
     struct {
-        Light lights[5];
         glm::vec4 viewPos;
-    } uboFragmentLights;
+        // Clip space back to the G-buffer space, for the positions the compact G-buffer reconstructs from depth
+        glm::mat4 inverseViewProjection;
+    } uboFragment;
+
+    // Every light, in a storage buffer the composition indexes with the light lists of the clusters
+    std::vector<Light> lights;
+    int32_t lightCount = SCENE_LIGHT_COUNT;
+    vks::ClusteredLights clusters;
 
     struct {
         vks::Buffer vsFullScreen;
         vks::Buffer vsOffscreen;
         vks::Buffer fsLights;
+        vks::Buffer lights;
     } uniformData;
 
     struct {
         vk::Pipeline deferred;
         vk::Pipeline offscreen;
         vk::Pipeline debug;
+        vk::Pipeline compactGeometry;
+        vk::Pipeline compactComposition;
+        vk::Pipeline present;
+        vk::Pipeline temporalComposition;
     } pipelines;
 
     struct {
         vk::PipelineLayout deferred;
         vk::PipelineLayout offscreen;
+        vk::PipelineLayout compact;
     } pipelineLayouts;
 
     struct {
         vk::DescriptorSet offscreen;
+        vk::DescriptorSet compact;
+        vk::DescriptorSet present;
+        vk::DescriptorSet temporal;
     } descriptorSets;
 
     vk::DescriptorSet descriptorSet;
     vk::DescriptorSetLayout descriptorSetLayout;
 
-    VulkanExample() {
+    // Bracket the G-buffer pass in the offscreen command buffer, which the profiler doesn't track.  Null if the queue
+    // has no timestamps.
+    vk::QueryPool gBufferTimestamps;
+
+    // With temporalAA the composition goes to litTarget at the render scale, jittered, and the resolve of it at the
+    // full G-buffer size is what gets drawn to the screen
+    Offscreen litTarget;
+    vks::TemporalResolve temporal;
+    vk::DescriptorSetLayout compactDescriptorSetLayout;
+
+    // The G-buffer and the composition in one render pass.  The G-buffer is an octahedral normal (RG16F) and the
+    // albedo with the specular intensity in alpha (RGBA8) next to the depth buffer, 8 bytes per pixel plus depth
+    // instead of the 20 of the position, normal and albedo targets, and positions are reconstructed from depth.
+    // The composition reads it as input attachments, so the render graph merges both passes into subpasses and none
+    // of it has to be stored: the attachments are transient and, where the device has lazily allocated memory, never
+    // backed by memory on tiled GPUs.  Only the lit result leaves the render pass.  With --no-subpass-merge they're
+    // separate render passes instead, which store the G-buffer and load it again.
+    struct {
+        vks::rendergraph::RenderGraph graph;
+        vks::rendergraph::Resource normal;
+        vks::rendergraph::Resource albedo;
+        vks::rendergraph::Resource depth;
+        vks::rendergraph::Resource lit;
+        uint32_t geometryPass;
+        uint32_t compositionPass;
+    } compact;
+
+    VulkanExample()
+        : litTarget(context) {
         camera.movementSpeed = 5.0f;
 #ifndef __ANDROID__
         camera.rotationSpeed = 0.25f;
@@ -88,6 +150,21 @@ public:
         camera.setRotation(glm::vec3(-0.75f, 12.5f, 0.0f));
         camera.setPerspective(60.0f, size, 0.1f, 256.0f);
         title = "Vulkan Example - Deferred shading";
+        // For the barriers of the temporal resolve
+        context.enableSynchronization2 = true;
+
+        const auto& args = vkx::getCommandLine();
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (args[i] == "--lights" && i + 1 < args.size()) {
+                lightCount = std::max(1, std::min(MAX_LIGHT_COUNT, std::stoi(args[++i])));
+            } else if (args[i] == "--temporal-aa") {
+                temporalAA = true;
+            } else if (args[i] == "--compact-gbuffer") {
+                compactGBuffer = true;
+            } else if (args[i] == "--no-subpass-merge") {
+                compact.graph.merge = false;
+            }
+        }
     }
 
     ~VulkanExample() {
@@ -97,11 +174,22 @@ public:
         device.destroyPipeline(pipelines.deferred);
         device.destroyPipeline(pipelines.offscreen);
         device.destroyPipeline(pipelines.debug);
+        device.destroyPipeline(pipelines.compactGeometry);
+        device.destroyPipeline(pipelines.compactComposition);
+        device.destroyPipeline(pipelines.present);
+        device.destroyPipeline(pipelines.temporalComposition);
 
         device.destroyPipelineLayout(pipelineLayouts.deferred);
         device.destroyPipelineLayout(pipelineLayouts.offscreen);
+        device.destroyPipelineLayout(pipelineLayouts.compact);
 
         device.destroyDescriptorSetLayout(descriptorSetLayout);
+        device.destroyDescriptorSetLayout(compactDescriptorSetLayout);
+
+        compact.graph.destroy();
+        device.destroy(gBufferTimestamps);
+        temporal.destroy();
+        litTarget.destroy();
 
         // Meshes
         meshes.example.destroy();
@@ -111,6 +199,8 @@ public:
         uniformData.vsOffscreen.destroy();
         uniformData.vsFullScreen.destroy();
         uniformData.fsLights.destroy();
+        uniformData.lights.destroy();
+        clusters.destroy();
         textures.colorMap.destroy();
     }
 
@@ -125,6 +215,13 @@ public:
         vk::CommandBufferBeginInfo cmdBufInfo;
         cmdBufInfo.flags = vk::CommandBufferUsageFlagBits::eSimultaneousUse;
 
+        if (compactGBuffer) {
+            offscreen.cmdBuffer.begin(cmdBufInfo);
+            buildCompactCommands(offscreen.cmdBuffer);
+            offscreen.cmdBuffer.end();
+            return;
+        }
+
         // Clear values for all attachments written in the fragment sahder
         std::array<vk::ClearValue, 4> clearValues;
         clearValues[0].color = vks::util::clearColor();
@@ -132,21 +229,27 @@ public:
         clearValues[2].color = vks::util::clearColor();
         clearValues[3].depthStencil = vk::ClearDepthStencilValue{ 1.0f, 0 };
 
+        // Only the corner of the G-buffer at the render scale, the composition samples just that
+        const vk::Extent2D renderExtent = dynamicResolution.extent(vk::Extent2D{ offscreen.size.x, offscreen.size.y });
+
         vk::RenderPassBeginInfo renderPassBeginInfo;
         renderPassBeginInfo.renderPass = offscreen.renderPass;
         renderPassBeginInfo.framebuffer = offscreen.framebuffers[0].framebuffer;
-        renderPassBeginInfo.renderArea.extent.width = offscreen.size.x;
-        renderPassBeginInfo.renderArea.extent.height = offscreen.size.y;
+        renderPassBeginInfo.renderArea.extent = renderExtent;
         renderPassBeginInfo.clearValueCount = (uint32_t)clearValues.size();
         renderPassBeginInfo.pClearValues = clearValues.data();
 
         offscreen.cmdBuffer.begin(cmdBufInfo);
+        if (gBufferTimestamps) {
+            offscreen.cmdBuffer.resetQueryPool(gBufferTimestamps, 0, 2);
+            offscreen.cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, gBufferTimestamps, 0);
+        }
         offscreen.cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
 
-        vk::Viewport viewport = vks::util::viewport(offscreen.size);
+        vk::Viewport viewport = vks::util::viewport(renderExtent);
         offscreen.cmdBuffer.setViewport(0, viewport);
 
-        vk::Rect2D scissor = vks::util::rect2D(offscreen.size);
+        vk::Rect2D scissor = vks::util::rect2D(renderExtent);
         offscreen.cmdBuffer.setScissor(0, scissor);
 
         offscreen.cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.offscreen, 0, descriptorSets.offscreen, nullptr);
@@ -154,12 +257,37 @@ public:
 
         vk::DeviceSize offsets = { 0 };
         offscreen.cmdBuffer.bindVertexBuffers(0, meshes.example.vertices.buffer, { 0 });
-        offscreen.cmdBuffer.bindIndexBuffer(meshes.example.indices.buffer, 0, vk::IndexType::eUint32);
+        offscreen.cmdBuffer.bindIndexBuffer(meshes.example.indices.buffer, 0, meshes.example.indexType);
         offscreen.cmdBuffer.drawIndexed(meshes.example.indexCount, 1, 0, 0, 0);
         offscreen.cmdBuffer.endRenderPass();
+        if (gBufferTimestamps) {
+            offscreen.cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, gBufferTimestamps, 1);
+        }
+        // Bin the lights for the composition
+        clusters.record(offscreen.cmdBuffer);
+        if (temporalAA) {
+            clearValues[0].color = vks::util::clearColor();
+            renderPassBeginInfo.renderPass = litTarget.renderPass;
+            renderPassBeginInfo.framebuffer = litTarget.framebuffers[0].framebuffer;
+            renderPassBeginInfo.clearValueCount = 1;
+            offscreen.cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+            offscreen.cmdBuffer.setViewport(0, viewport);
+            offscreen.cmdBuffer.setScissor(0, scissor);
+            offscreen.cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.deferred, 0, descriptorSet, nullptr);
+            offscreen.cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.temporalComposition);
+            offscreen.cmdBuffer.draw(3, 1, 0, 0);
+            offscreen.cmdBuffer.endRenderPass();
+            temporal.record(offscreen.cmdBuffer);
+        }
         offscreen.cmdBuffer.end();
     }
 
+    // The lights are binned before the render pass, as the composition runs in the same render pass as the G-buffer
+    void buildCompactCommands(const vk::CommandBuffer& cmdBuffer) {
+        clusters.record(cmdBuffer);
+        compact.graph.record(cmdBuffer);
+    }
+
     void loadAssets() override {
         textures.colorMap.loadFromFile(context, getAssetPath() + "models/armor/colormap.ktx", vk::Format::eBc3UnormBlock);
         meshes.example.loadFromFile(context, getAssetPath() + "models/armor/armor.dae", vertexLayout, 1.0f);
@@ -169,11 +297,18 @@ public:
         vk::Viewport viewport = vks::util::viewport(size);
         cmdBuffer.setViewport(0, viewport);
         cmdBuffer.setScissor(0, vks::util::rect2D(size));
+        if (compactGBuffer) {
+            // There are no G-buffer targets to display, only the lit result of the offscreen pass
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.deferred, 0, descriptorSets.present, nullptr);
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.present);
+            cmdBuffer.draw(3, 1, 0, 0);
+            return;
+        }
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.deferred, 0, descriptorSet, nullptr);
         if (debugDisplay) {
             cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.debug);
             cmdBuffer.bindVertexBuffers(0, meshes.quad.vertices.buffer, { 0 });
-            cmdBuffer.bindIndexBuffer(meshes.quad.indices.buffer, 0, vk::IndexType::eUint32);
+            cmdBuffer.bindIndexBuffer(meshes.quad.indices.buffer, 0, meshes.quad.indexType);
             cmdBuffer.drawIndexed(meshes.quad.indexCount, 1, 0, 0, 1);
             // Move viewport to display final composition in lower right corner
             viewport.x = viewport.width * 0.5f;
@@ -181,15 +316,56 @@ public:
         }
 
         cmdBuffer.setViewport(0, viewport);
+        if (temporalAA) {
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.deferred, 0, descriptorSets.temporal, nullptr);
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.present);
+            cmdBuffer.draw(3, 1, 0, 0);
+            return;
+        }
         // Final composition as full screen quad
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.deferred);
         cmdBuffer.bindVertexBuffers(0, meshes.quad.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.quad.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.quad.indices.buffer, 0, meshes.quad.indexType);
         cmdBuffer.drawIndexed(6, 1, 0, 0, 1);
     }
 
+    // A new sub-pixel offset of the G-buffer every frame
+    void updateJitter() {
+        const vk::Extent2D renderExtent = dynamicResolution.extent(vk::Extent2D{ offscreen.size.x, offscreen.size.y });
+        const glm::vec2 jitter = vks::TemporalResolve::jitter(frameCounter);
+        camera.setJitter(jitter * 2.0f / glm::vec2(renderExtent.width, renderExtent.height));
+        updateUniformBufferDeferredMatrices();
+        temporal.update(camera.matrices.unjitteredPerspective * camera.matrices.view * uboOffscreenVS.model, jitter, renderExtent);
+    }
+
+    void setTemporalAA(bool enable) {
+        // The offscreen command buffer may still be executing
+        device.waitIdle();
+        temporalAA = enable;
+        if (!temporalAA) {
+            camera.setJitter(glm::vec2(0.0f));
+            updateUniformBufferDeferredMatrices();
+        }
+        temporal.reset();
+        buildCommandBuffers();
+        buildOffscreenCommandBuffer();
+    }
+
     void draw() override {
         prepareFrame();
+        if (temporalAA) {
+            updateJitter();
+        }
+        // The previous submission of the offscreen command buffer is usually done by now, its timestamps are
+        // unavailable if it isn't
+        if (gBufferTimestamps && !compactGBuffer) {
+            std::array<uint64_t, 2> ticks;
+            const vk::Result result =
+                device.getQueryPoolResults(gBufferTimestamps, 0, 2, sizeof(ticks), ticks.data(), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+            if (result == vk::Result::eSuccess) {
+                profiler.report("G-buffer", (double)(ticks[1] - ticks[0]) * context.deviceProperties.limits.timestampPeriod / 1.0e6);
+            }
+        }
         if (offscreen.active) {
             context.submit(offscreen.cmdBuffer, { { semaphores.acquireComplete, vk::PipelineStageFlagBits::eBottomOfPipe } }, offscreen.renderComplete);
             renderWaitSemaphores = { offscreen.renderComplete };
@@ -242,10 +418,12 @@ public:
 
     void setupDescriptorPool() {
         std::vector<vk::DescriptorPoolSize> poolSizes{
-            { vk::DescriptorType::eUniformBuffer, 8 },
-            { vk::DescriptorType::eCombinedImageSampler, 8 },
+            { vk::DescriptorType::eUniformBuffer, 12 },
+            { vk::DescriptorType::eCombinedImageSampler, 12 },
+            { vk::DescriptorType::eStorageBuffer, 6 },
+            { vk::DescriptorType::eInputAttachment, 3 },
         };
-        descriptorPool = device.createDescriptorPool({ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
+        descriptorPool = device.createDescriptorPool({ {}, 5, (uint32_t)poolSizes.size(), poolSizes.data() });
     }
 
     void setupDescriptorSetLayout() {
@@ -261,12 +439,38 @@ public:
             { 3, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
             // Binding 4 : Fragment shader uniform buffer
             { 4, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 5 : Lights
+            { 5, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 6 : Cluster parameters
+            { 6, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 7 : Light lists of the clusters
+            { 7, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment },
         };
 
         descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
         pipelineLayouts.deferred = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
         // Offscreen (scene) rendering pipeline layout
         pipelineLayouts.offscreen = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+
+        // Compact G-buffer composition layout
+        std::vector<vk::DescriptorSetLayoutBinding> compactBindings = {
+            // Binding 0 : Normals input attachment
+            { 0, vk::DescriptorType::eInputAttachment, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 1 : Albedo input attachment
+            { 1, vk::DescriptorType::eInputAttachment, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 2 : Depth input attachment
+            { 2, vk::DescriptorType::eInputAttachment, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 3 : Fragment shader uniform buffer
+            { 3, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 4 : Lights
+            { 4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 5 : Cluster parameters
+            { 5, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 6 : Light lists of the clusters
+            { 6, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment },
+        };
+        compactDescriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)compactBindings.size(), compactBindings.data() });
+        pipelineLayouts.compact = device.createPipelineLayout({ {}, 1, &compactDescriptorSetLayout });
     }
 
     void setupDescriptorSet() {
@@ -295,6 +499,12 @@ public:
             { descriptorSet, 3, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texDescriptorAlbedo },
             // Binding 4 : Fragment shader uniform buffer
             { descriptorSet, 4, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.fsLights.descriptor },
+            // Binding 5 : Lights
+            { descriptorSet, 5, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &uniformData.lights.descriptor },
+            // Binding 6 : Cluster parameters
+            { descriptorSet, 6, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &clusters.uniformDescriptor() },
+            // Binding 7 : Light lists of the clusters
+            { descriptorSet, 7, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &clusters.gridDescriptor() },
         };
 
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
@@ -311,6 +521,34 @@ public:
             { descriptorSets.offscreen, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texDescriptorSceneColormap },
         };
         device.updateDescriptorSets(offscreenWriteDescriptorSets, nullptr);
+
+        // Compact G-buffer composition
+        descriptorSets.compact = device.allocateDescriptorSets({ descriptorPool, 1, &compactDescriptorSetLayout })[0];
+        vk::DescriptorImageInfo inputNormal{ nullptr, compact.graph.image(compact.normal).view, vk::ImageLayout::eShaderReadOnlyOptimal };
+        vk::DescriptorImageInfo inputAlbedo{ nullptr, compact.graph.image(compact.albedo).view, vk::ImageLayout::eShaderReadOnlyOptimal };
+        vk::DescriptorImageInfo inputDepth{ nullptr, compact.graph.image(compact.depth).view, vk::ImageLayout::eDepthStencilReadOnlyOptimal };
+        std::vector<vk::WriteDescriptorSet> compactWriteDescriptorSets{
+            { descriptorSets.compact, 0, 0, 1, vk::DescriptorType::eInputAttachment, &inputNormal },
+            { descriptorSets.compact, 1, 0, 1, vk::DescriptorType::eInputAttachment, &inputAlbedo },
+            { descriptorSets.compact, 2, 0, 1, vk::DescriptorType::eInputAttachment, &inputDepth },
+            { descriptorSets.compact, 3, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.fsLights.descriptor },
+            { descriptorSets.compact, 4, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &uniformData.lights.descriptor },
+            { descriptorSets.compact, 5, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &clusters.uniformDescriptor() },
+            { descriptorSets.compact, 6, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &clusters.gridDescriptor() },
+        };
+        device.updateDescriptorSets(compactWriteDescriptorSets, nullptr);
+
+        // Lit result of the compact path, drawn to the screen
+        descriptorSets.present = device.allocateDescriptorSets(allocInfo)[0];
+        const auto& lit = compact.graph.image(compact.lit);
+        vk::DescriptorImageInfo texDescriptorLit{ lit.sampler, lit.view, vk::ImageLayout::eShaderReadOnlyOptimal };
+        device.updateDescriptorSets({ { descriptorSets.present, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texDescriptorLit } }, nullptr);
+
+        // Temporally resolved result of the classic path, drawn to the screen
+        descriptorSets.temporal = device.allocateDescriptorSets(allocInfo)[0];
+        const auto& resolved = temporal.resolved();
+        vk::DescriptorImageInfo texDescriptorResolved{ resolved.sampler, resolved.view, vk::ImageLayout::eShaderReadOnlyOptimal };
+        device.updateDescriptorSets({ { descriptorSets.temporal, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texDescriptorResolved } }, nullptr);
     }
 
     void preparePipelines() {
@@ -346,6 +584,96 @@ public:
             {},
         };
         pipelines.offscreen = pipelineBuilder.create(context.pipelineCache);
+        pipelineBuilder.destroyShaderModules();
+
+        // Compact G-buffer
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/deferred/mrt.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/deferred/mrt_compact.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipelineBuilder.renderPass = compact.graph.renderPass(compact.geometryPass);
+        pipelineBuilder.subpass = compact.graph.subpass(compact.geometryPass);
+        pipelineBuilder.colorBlendState.blendAttachmentStates = {
+            {},
+            {},
+        };
+        pipelines.compactGeometry = pipelineBuilder.create(context.pipelineCache);
+
+        // Full screen triangles without vertex input for the compact composition and its presentation
+        vks::pipelines::GraphicsPipelineBuilder fullscreenBuilder{ device, pipelineLayouts.compact, compact.graph.renderPass(compact.compositionPass) };
+        fullscreenBuilder.rasterizationState.cullMode = vk::CullModeFlagBits::eNone;
+        fullscreenBuilder.depthStencilState = { false };
+        fullscreenBuilder.subpass = compact.graph.subpass(compact.compositionPass);
+        fullscreenBuilder.loadShader(getAssetPath() + "shaders/deferred/compact.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        fullscreenBuilder.loadShader(getAssetPath() + "shaders/deferred/compact.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipelines.compactComposition = fullscreenBuilder.create(context.pipelineCache);
+        fullscreenBuilder.destroyShaderModules();
+
+        fullscreenBuilder.layout = pipelineLayouts.deferred;
+        fullscreenBuilder.renderPass = renderPass;
+        fullscreenBuilder.subpass = 0;
+        fullscreenBuilder.loadShader(getAssetPath() + "shaders/deferred/compact.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        fullscreenBuilder.loadShader(getAssetPath() + "shaders/deferred/present.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipelines.present = fullscreenBuilder.create(context.pipelineCache);
+        fullscreenBuilder.destroyShaderModules();
+
+        fullscreenBuilder.renderPass = litTarget.renderPass;
+        fullscreenBuilder.loadShader(getAssetPath() + "shaders/deferred/composition.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        fullscreenBuilder.loadShader(getAssetPath() + "shaders/deferred/deferred.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipelines.temporalComposition = fullscreenBuilder.create(context.pipelineCache);
+    }
+
+    void prepareCompact() {
+        using namespace vks::rendergraph;
+        // Depth is read back for the positions, so there is no stencil to worry about in the views.  D16 is
+        // always supported, but D32 reconstructs far more precise positions.
+        const bool d32 = (bool)(context.getFormatProperties(vk::Format::eD32Sfloat).optimalTilingFeatures & vk::FormatFeatureFlagBits::eDepthStencilAttachment);
+        AttachmentDescription attachment;
+        attachment.extent = vk::Extent2D{ offscreen.size.x, offscreen.size.y };
+        attachment.clearValue.color = vks::util::clearColor();
+        attachment.format = vk::Format::eR16G16Sfloat;
+        compact.normal = compact.graph.addAttachment("Normal", attachment);
+        attachment.format = vk::Format::eR8G8B8A8Unorm;
+        compact.albedo = compact.graph.addAttachment("Albedo", attachment);
+        // Every pixel gets lit, so there's nothing to clear
+        attachment.clear = false;
+        compact.lit = compact.graph.addAttachment("Lit", attachment);
+        attachment.format = d32 ? vk::Format::eD32Sfloat : vk::Format::eD16Unorm;
+        attachment.clear = true;
+        attachment.clearValue.depthStencil = vk::ClearDepthStencilValue{ 1.0f, 0 };
+        compact.depth = compact.graph.addAttachment("Depth", attachment);
+        compact.graph.addOutput(compact.lit);
+
+        PassDescription geometry;
+        geometry.name = "G-buffer";
+        geometry.colorAttachments = { compact.normal, compact.albedo };
+        geometry.depthAttachment = compact.depth;
+        geometry.record = [this](const vk::CommandBuffer& cmdBuffer) {
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.offscreen, 0, descriptorSets.offscreen, nullptr);
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.compactGeometry);
+            cmdBuffer.bindVertexBuffers(0, meshes.example.vertices.buffer, { 0 });
+            cmdBuffer.bindIndexBuffer(meshes.example.indices.buffer, 0, meshes.example.indexType);
+            cmdBuffer.drawIndexed(meshes.example.indexCount, 1, 0, 0, 0);
+        };
+        compact.geometryPass = compact.graph.addPass(geometry);
+
+        PassDescription composition;
+        composition.name = "Composition";
+        composition.colorAttachments = { compact.lit };
+        composition.inputAttachments = { compact.normal, compact.albedo, compact.depth };
+        composition.record = [this](const vk::CommandBuffer& cmdBuffer) {
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.compact, 0, descriptorSets.compact, nullptr);
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.compactComposition);
+            cmdBuffer.draw(3, 1, 0, 0);
+        };
+        compact.compositionPass = compact.graph.addPass(composition);
+        compact.graph.compile(context);
+
+        vk::SamplerCreateInfo sampler;
+        sampler.magFilter = vk::Filter::eLinear;
+        sampler.minFilter = vk::Filter::eLinear;
+        sampler.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+        sampler.addressModeV = sampler.addressModeU;
+        sampler.addressModeW = sampler.addressModeU;
+        compact.graph.image(compact.lit).sampler = device.createSampler(sampler);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
@@ -355,7 +683,12 @@ public:
         // Deferred vertex shader
         uniformData.vsOffscreen = context.createUniformBuffer(uboOffscreenVS);
         // Deferred fragment shader
-        uniformData.fsLights = context.createUniformBuffer(uboFragmentLights);
+        uniformData.fsLights = context.createUniformBuffer(uboFragment);
+        uniformData.lights = context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer,
+                                                  vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                                  sizeof(Light) * MAX_LIGHT_COUNT);
+        uniformData.lights.map();
+        clusters.create(context, getAssetPath() + "shaders/base/clusters.comp.spv", MAX_LIGHT_COUNT);
 
         // Update
         updateUniformBuffersScreen();
@@ -370,6 +703,7 @@ public:
             uboVS.projection = glm::ortho(0.0f, 1.0f, 0.0f, 1.0f, -1.0f, 1.0f);
         }
         uboVS.model = glm::mat4();
+        uboVS.uvScale = glm::vec4(dynamicResolution.uvScale(offscreen.size.x), dynamicResolution.uvScale(offscreen.size.y), 0.0f, 0.0f);
         uniformData.vsFullScreen.copy(uboVS);
     }
 
@@ -378,52 +712,104 @@ public:
         uboOffscreenVS.view = camera.matrices.view;
         uboOffscreenVS.model = glm::translate(glm::mat4(), glm::vec3(0.0f, 0.25f, 0.0f));
         uniformData.vsOffscreen.copy(uboOffscreenVS);
+        uboFragment.inverseViewProjection = glm::inverse(camera.matrices.perspective * camera.matrices.view * flipY());
+        uniformData.fsLights.copy(uboFragment);
+        updateClusters();
+    }
+
+    // The G-buffer holds world space positions with y flipped, see mrt.vert
+    static glm::mat4 flipY() { return glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, -1.0f, 1.0f)); }
+
+    void updateClusters() {
+        clusters.update(camera.matrices.view * flipY(), camera.matrices.perspective, camera.getNearClip(), camera.getFarClip(), lightCount);
+    }
+
+    Light fillLight(std::default_random_engine& rndEngine) {
+        std::uniform_real_distribution<float> position(-4.0f, 4.0f);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        Light light;
+        light.position = glm::vec4(position(rndEngine), position(rndEngine) * 0.5f, position(rndEngine), 0.0f);
+        light.color = glm::vec4(unit(rndEngine), unit(rndEngine), unit(rndEngine), 0.0f) * 1.5f;
+        light.radius = 0.75f + unit(rndEngine) * 1.5f;
+        light.linearFalloff = 2.0f;
+        light.quadraticFalloff = 4.0f;
+        light._pad = 0.0f;
+        return light;
     }
 
     // Update fragment shader light position uniform block
     void updateUniformBufferDeferredLights() {
+        lights.resize(MAX_LIGHT_COUNT);
         // White light from above
-        uboFragmentLights.lights[0].position = glm::vec4(0.0f, 3.0f, 1.0f, 0.0f);
-        uboFragmentLights.lights[0].color = glm::vec4(1.5f);
-        uboFragmentLights.lights[0].radius = 15.0f;
-        uboFragmentLights.lights[0].linearFalloff = 0.3f;
-        uboFragmentLights.lights[0].quadraticFalloff = 0.4f;
+        lights[0].position = glm::vec4(0.0f, 3.0f, 1.0f, 0.0f);
+        lights[0].color = glm::vec4(1.5f);
+        lights[0].radius = 15.0f;
+        lights[0].linearFalloff = 0.3f;
+        lights[0].quadraticFalloff = 0.4f;
         // Red light
-        uboFragmentLights.lights[1].position = glm::vec4(-2.0f, 0.0f, 0.0f, 0.0f);
-        uboFragmentLights.lights[1].color = glm::vec4(1.5f, 0.0f, 0.0f, 0.0f);
-        uboFragmentLights.lights[1].radius = 15.0f;
-        uboFragmentLights.lights[1].linearFalloff = 0.4f;
-        uboFragmentLights.lights[1].quadraticFalloff = 0.3f;
+        lights[1].position = glm::vec4(-2.0f, 0.0f, 0.0f, 0.0f);
+        lights[1].color = glm::vec4(1.5f, 0.0f, 0.0f, 0.0f);
+        lights[1].radius = 15.0f;
+        lights[1].linearFalloff = 0.4f;
+        lights[1].quadraticFalloff = 0.3f;
         // Blue light
-        uboFragmentLights.lights[2].position = glm::vec4(2.0f, 1.0f, 0.0f, 0.0f);
-        uboFragmentLights.lights[2].color = glm::vec4(0.0f, 0.0f, 2.5f, 0.0f);
-        uboFragmentLights.lights[2].radius = 10.0f;
-        uboFragmentLights.lights[2].linearFalloff = 0.45f;
-        uboFragmentLights.lights[2].quadraticFalloff = 0.35f;
+        lights[2].position = glm::vec4(2.0f, 1.0f, 0.0f, 0.0f);
+        lights[2].color = glm::vec4(0.0f, 0.0f, 2.5f, 0.0f);
+        lights[2].radius = 10.0f;
+        lights[2].linearFalloff = 0.45f;
+        lights[2].quadraticFalloff = 0.35f;
         // Belt glow
-        uboFragmentLights.lights[3].position = glm::vec4(0.0f, 0.7f, 0.5f, 0.0f);
-        uboFragmentLights.lights[3].color = glm::vec4(2.5f, 2.5f, 0.0f, 0.0f);
-        uboFragmentLights.lights[3].radius = 5.0f;
-        uboFragmentLights.lights[3].linearFalloff = 8.0f;
-        uboFragmentLights.lights[3].quadraticFalloff = 6.0f;
+        lights[3].position = glm::vec4(0.0f, 0.7f, 0.5f, 0.0f);
+        lights[3].color = glm::vec4(2.5f, 2.5f, 0.0f, 0.0f);
+        lights[3].radius = 5.0f;
+        lights[3].linearFalloff = 8.0f;
+        lights[3].quadraticFalloff = 6.0f;
         // Green light
-        uboFragmentLights.lights[4].position = glm::vec4(3.0f, 2.0f, 1.0f, 0.0f);
-        uboFragmentLights.lights[4].color = glm::vec4(0.0f, 1.5f, 0.0f, 0.0f);
-        uboFragmentLights.lights[4].radius = 10.0f;
-        uboFragmentLights.lights[4].linearFalloff = 0.8f;
-        uboFragmentLights.lights[4].quadraticFalloff = 0.6f;
+        lights[4].position = glm::vec4(3.0f, 2.0f, 1.0f, 0.0f);
+        lights[4].color = glm::vec4(0.0f, 1.5f, 0.0f, 0.0f);
+        lights[4].radius = 10.0f;
+        lights[4].linearFalloff = 0.8f;
+        lights[4].quadraticFalloff = 0.6f;
 
         // Current view position
-        uboFragmentLights.viewPos = glm::vec4(0.0f, 0.0f, -camera.position.z, 0.0f);
+        uboFragment.viewPos = glm::vec4(0.0f, 0.0f, -camera.position.z, 0.0f);
 
-        uniformData.fsLights.copy(uboFragmentLights);
+        // Fixed seed, so runs with the same light count are comparable
+        std::default_random_engine rndEngine(0);
+        for (uint32_t i = SCENE_LIGHT_COUNT; i < MAX_LIGHT_COUNT; ++i) {
+            lights[i] = fillLight(rndEngine);
+        }
+        for (uint32_t i = 0; i < MAX_LIGHT_COUNT; ++i) {
+            clusters.lightBounds()[i] = glm::vec4(glm::vec3(lights[i].position), lights[i].radius);
+        }
+
+        uniformData.fsLights.copy(uboFragment);
+        uniformData.lights.copy(lights);
     }
 
     void prepare() override {
         offscreen.size = glm::uvec2(TEX_DIM);
         offscreen.colorFormats = std::vector<vk::Format>{ { vk::Format::eR16G16B16A16Sfloat, vk::Format::eR16G16B16A16Sfloat, vk::Format::eR8G8B8A8Unorm } };
+        // The temporal resolve reprojects with the depth
+        offscreen.depthAttachmentUsage = vk::ImageUsageFlagBits::eSampled;
+        offscreen.depthFinalLayout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
         Parent::prepare();
+        temporalAA = temporalAA && !compactGBuffer;
+        litTarget.size = offscreen.size;
+        litTarget.colorFormats = { vk::Format::eR16G16B16A16Sfloat };
+        litTarget.depthFormat = vk::Format::eUndefined;
+        litTarget.colorFinalLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+        litTarget.prepare();
+        temporal.create(context, getAssetPath() + "shaders/base/temporal.comp.spv", vk::Extent2D{ offscreen.size.x, offscreen.size.y });
+        temporal.setInputs(litTarget.framebuffers[0].colors[0], vk::ImageLayout::eShaderReadOnlyOptimal, offscreen.framebuffers[0].depth,
+                           vk::ImageLayout::eDepthStencilReadOnlyOptimal);
+        if (context.queueFamilyProperties[context.queueIndices.graphics].timestampValidBits) {
+            gBufferTimestamps = device.createQueryPool({ {}, vk::QueryType::eTimestamp, 2 });
+            // Reset once up front, so that reading them before the first submission finds them unavailable
+            context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& cmdBuffer) { cmdBuffer.resetQueryPool(gBufferTimestamps, 0, 2); });
+        }
         generateQuads();
+        prepareCompact();
         prepareUniformBuffers();
         setupDescriptorSetLayout();
         preparePipelines();
@@ -436,6 +822,35 @@ public:
 
     void viewChanged() override { updateUniformBufferDeferredMatrices(); }
 
+    // The compact G-buffer's render graph renders its attachments in full
+    bool supportsDynamicResolution() const override { return !compactGBuffer; }
+
+    void renderScaleChanged() override {
+        // The offscreen command buffer may still be executing
+        device.waitIdle();
+        updateUniformBuffersScreen();
+        buildOffscreenCommandBuffer();
+    }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            if (ui.sliderInt("Lights", &lightCount, 1, MAX_LIGHT_COUNT)) {
+                updateClusters();
+            }
+            if (ui.checkBox("Compact G-buffer", &compactGBuffer)) {
+                // Temporal AA is built on the classic G-buffer
+                setTemporalAA(temporalAA && !compactGBuffer);
+            }
+            bool temporalChanged = !compactGBuffer && ui.checkBox("Temporal AA", &temporalAA);
+            if (temporalChanged) {
+                setTemporalAA(temporalAA);
+            }
+            if (compactGBuffer) {
+                ui.text("Compact render passes: %u", (uint32_t)compact.graph.renderPassCount());
+            }
+        }
+    }
+
     void toggleDebugDisplay() {
         debugDisplay = !debugDisplay;
         buildCommandBuffers();
@@ -1,21 +1,38 @@
 /*
 * Vulkan Example - Multi sampling with explicit resolve for deferred shading example
 *
+* By default only the pixels whose samples cover more than one surface are lit per sample, all others once, which
+* gets the antialiasing of lighting every sample at a fraction of its cost.
+*
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#include <random>
+
 #include "vulkanExampleBase.h"
+#include <vks/clusteredLights.hpp>
 
 // todo: check if hardware supports sample number (or select max. supported)
 #define SAMPLE_COUNT vk::SampleCountFlagBits::e8;
+// The six animated lights of the scene, followed by randomly placed fill lights
+#define SCENE_LIGHT_COUNT 6
+#define MAX_LIGHT_COUNT 4096
+// Lights are culled where their contribution drops below this
+#define LIGHT_CUTOFF 0.01f
+
+static const std::vector<float> SAMPLE_SHADING_RATES{ 0.25f, 0.5f, 1.0f };
 
 class VulkanExample : public vkx::ExampleBase {
 public:
     bool debugDisplay = false;
     bool useMSAA = true;
+    // Light every sample of the pixels along edges only
+    bool edgeShading = true;
     bool useSampleShading = true;
+    // Index into SAMPLE_SHADING_RATES, the fraction of the samples of every pixel the G-buffer pass shades
+    int32_t sampleShadingRate = 0;
 
     struct Material {
         vks::texture::Texture2D colorMap;
@@ -56,19 +73,25 @@ public:
     };
 
     struct {
-        Light lights[6];
         glm::vec4 viewPos;
         vk::Extent2D windowSize;
     } uboFragmentLights;
 
+    // Every light, in a storage buffer the composition indexes with the light lists of the clusters
+    std::vector<Light> lights;
+    int32_t lightCount = SCENE_LIGHT_COUNT;
+    vks::ClusteredLights clusters;
+
     struct {
         vks::Buffer vsFullScreen;
         vks::Buffer vsOffscreen;
         vks::Buffer fsLights;
+        vks::Buffer lights;
     } uniformBuffers;
 
     struct {
         vk::Pipeline deferred;                // Deferred lighting calculation
+        vk::Pipeline deferredEdges;           // Deferred lighting calculation, per sample along edges only
         vk::Pipeline deferredNoMSAA;          // Deferred lighting calculation with explicit MSAA resolve
         vk::Pipeline offscreen;               // (Offscreen) scene rendering (fill G-Buffers)
         vk::Pipeline offscreenSampleShading;  // (Offscreen) scene rendering (fill G-Buffers) with sample shading rate enabled
@@ -126,11 +149,19 @@ public:
         camera.setPerspective(60.0f, (float)size.width / (float)size.height, 0.1f, 256.0f);
         paused = true;
         settings.overlay = true;
+
+        const auto& args = vkx::getCommandLine();
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (args[i] == "--lights" && i + 1 < args.size()) {
+                lightCount = std::max(1, std::min(MAX_LIGHT_COUNT, std::stoi(args[++i])));
+            }
+        }
     }
 
     ~VulkanExample() {
         // Clean up used Vulkan resources
         device.destroy(pipelines.deferred);
+        device.destroy(pipelines.deferredEdges);
         device.destroy(pipelines.deferredNoMSAA);
         device.destroy(pipelines.offscreen);
         device.destroy(pipelines.offscreenSampleShading);
@@ -149,6 +180,8 @@ public:
         uniformBuffers.vsOffscreen.destroy();
         uniformBuffers.vsFullScreen.destroy();
         uniformBuffers.fsLights.destroy();
+        uniformBuffers.lights.destroy();
+        clusters.destroy();
 
         textures.model.colorMap.destroy();
         textures.model.normalMap.destroy();
@@ -197,8 +230,15 @@ public:
         image.mipLevels = 1;
         image.arrayLayers = 1;
         image.samples = SAMPLE_COUNT;
-        image.usage = usage | vk::ImageUsageFlagBits::eSampled;
-        attachment = context.createImage(image);
+        // The composition resolves the color attachments, depth is only needed within the G-buffer pass and never
+        // leaves tile memory
+        if (usage & vk::ImageUsageFlagBits::eDepthStencilAttachment) {
+            image.usage = usage;
+            attachment = context.createTransientImage(image);
+        } else {
+            image.usage = usage | vk::ImageUsageFlagBits::eSampled;
+            attachment = context.createImage(image);
+        }
 
         vk::ImageViewCreateInfo imageView;
         imageView.viewType = vk::ImageViewType::e2D;
@@ -245,6 +285,7 @@ public:
             attachmentDescs[i].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
             attachmentDescs[i].initialLayout = vk::ImageLayout::eUndefined;
             if (i == 3) {
+                attachmentDescs[i].storeOp = vk::AttachmentStoreOp::eDontCare;
                 attachmentDescs[i].finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
             } else {
                 attachmentDescs[i].finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
@@ -346,16 +387,18 @@ public:
         // Background
         offscreen.commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.offscreen, 0, 1, &descriptorSets.floor, 0, NULL);
         offscreen.commandBuffer.bindVertexBuffers(0, { models.floor.vertices.buffer }, { 0 });
-        offscreen.commandBuffer.bindIndexBuffer(models.floor.indices.buffer, 0, vk::IndexType::eUint32);
+        offscreen.commandBuffer.bindIndexBuffer(models.floor.indices.buffer, 0, models.floor.indexType);
         offscreen.commandBuffer.drawIndexed(models.floor.indexCount, 1, 0, 0, 0);
 
         // Object
         offscreen.commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.offscreen, 0, 1, &descriptorSets.model, 0, NULL);
         offscreen.commandBuffer.bindVertexBuffers(0, { models.model.vertices.buffer }, { 0 });
-        offscreen.commandBuffer.bindIndexBuffer(models.model.indices.buffer, 0, vk::IndexType::eUint32);
+        offscreen.commandBuffer.bindIndexBuffer(models.model.indices.buffer, 0, models.model.indexType);
         offscreen.commandBuffer.drawIndexed(models.model.indexCount, 3, 0, 0, 0);
 
         offscreen.commandBuffer.endRenderPass();
+        // Bin the lights for the composition
+        clusters.record(offscreen.commandBuffer);
         offscreen.commandBuffer.end();
     }
 
@@ -383,7 +426,11 @@ public:
         camera.updateAspectRatio((float)viewport.width / (float)viewport.height);
 
         // Final composition as full screen quad
-        drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, useMSAA ? pipelines.deferred : pipelines.deferredNoMSAA);
+        if (useMSAA) {
+            drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, edgeShading ? pipelines.deferredEdges : pipelines.deferred);
+        } else {
+            drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.deferredNoMSAA);
+        }
         drawCmdBuffer.draw(3, 1, 0, 0);
     }
 
@@ -423,6 +470,7 @@ public:
         std::vector<vk::DescriptorPoolSize> poolSizes{
             vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 8 },
             vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 9 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 2 },
         };
         descriptorPool = device.createDescriptorPool({ {}, 3, static_cast<uint32_t>(poolSizes.size()), poolSizes.data() });
     }
@@ -440,6 +488,12 @@ public:
             vk::DescriptorSetLayoutBinding{ 3, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
             // Binding 4 : Fragment shader uniform buffer
             vk::DescriptorSetLayoutBinding{ 4, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 5 : Lights
+            vk::DescriptorSetLayoutBinding{ 5, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 6 : Cluster parameters
+            vk::DescriptorSetLayoutBinding{ 6, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 7 : Light lists of the clusters
+            vk::DescriptorSetLayoutBinding{ 7, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment },
         };
 
         descriptorSetLayout = device.createDescriptorSetLayout({ {}, static_cast<uint32_t>(setLayoutBindings.size()), setLayoutBindings.data() });
@@ -471,6 +525,12 @@ public:
             { descriptorSet, 3, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texDescriptorAlbedo },
             // Binding 4 : Fragment shader uniform buffer
             { descriptorSet, 4, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.fsLights.descriptor },
+            // Binding 5 : Lights
+            { descriptorSet, 5, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &uniformBuffers.lights.descriptor },
+            // Binding 6 : Cluster parameters
+            { descriptorSet, 6, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &clusters.uniformDescriptor() },
+            // Binding 7 : Light lists of the clusters
+            { descriptorSet, 7, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &clusters.gridDescriptor() },
             // Binding 0: Vertex shader uniform buffer
             { descriptorSets.model, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.vsOffscreen.descriptor },
             // Binding 1: Color map
@@ -496,17 +556,29 @@ public:
 
         // Empty vertex input state, quads are generated by the vertex shader
 
-        // Use specialization constants to pass number of samples to the shader (used for MSAA resolve)
-        uint32_t specializationData = (uint32_t)SAMPLE_COUNT;
-        vk::SpecializationMapEntry specializationEntry{ 0, 0, sizeof(uint32_t) };
-        vk::SpecializationInfo specializationInfo{ 1, &specializationEntry, sizeof(uint32_t), &specializationData };
+        // Use specialization constants to pass number of samples to the shader (used for MSAA resolve), and whether
+        // only edge pixels are lit per sample
+        struct {
+            uint32_t sampleCount = (uint32_t)SAMPLE_COUNT;
+            VkBool32 edgesOnly = VK_FALSE;
+        } specializationData;
+        std::array<vk::SpecializationMapEntry, 2> specializationEntries{
+            vk::SpecializationMapEntry{ 0, offsetof(decltype(specializationData), sampleCount), sizeof(uint32_t) },
+            vk::SpecializationMapEntry{ 1, offsetof(decltype(specializationData), edgesOnly), sizeof(VkBool32) },
+        };
+        vk::SpecializationInfo specializationInfo{ (uint32_t)specializationEntries.size(), specializationEntries.data(), sizeof(specializationData),
+                                                   &specializationData };
         // With MSAA
         builder.loadShader(getAssetPath() + "shaders/deferredmultisampling/deferred.vert.spv", vk::ShaderStageFlagBits::eVertex);
         builder.loadShader(getAssetPath() + "shaders/deferredmultisampling/deferred.frag.spv", vk::ShaderStageFlagBits::eFragment);
         builder.shaderStages[1].pSpecializationInfo = &specializationInfo;
         pipelines.deferred = builder.create(context.pipelineCache);
+        // With MSAA, per sample along edges only
+        specializationData.edgesOnly = VK_TRUE;
+        pipelines.deferredEdges = builder.create(context.pipelineCache);
         // No MSAA (1 sample)
-        specializationData = 1;
+        specializationData.sampleCount = 1;
+        specializationData.edgesOnly = VK_FALSE;
         pipelines.deferredNoMSAA = builder.create(context.pipelineCache);
         builder.destroyShaderModules();
 
@@ -535,9 +607,25 @@ public:
         // won't see anything rendered to the attachment
         builder.colorBlendState.blendAttachmentStates.resize(3);
         pipelines.offscreen = builder.create(context.pipelineCache);
+        builder.destroyShaderModules();
+        prepareSampleShadingPipeline();
+    }
 
+    // The rate isn't dynamic state, so every change of it takes a new pipeline
+    void prepareSampleShadingPipeline() {
+        if (pipelines.offscreenSampleShading) {
+            context.trash(pipelines.offscreenSampleShading);
+        }
+        vks::pipelines::GraphicsPipelineBuilder builder{ device, pipelineLayouts.offscreen, offscreen.renderPass };
+        builder.rasterizationState.frontFace = vk::FrontFace::eClockwise;
+        builder.vertexInputState.appendVertexLayout(vertexLayout);
+        builder.loadShader(getAssetPath() + "shaders/deferredmultisampling/mrt.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        builder.loadShader(getAssetPath() + "shaders/deferredmultisampling/mrt.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        builder.multisampleState.rasterizationSamples = SAMPLE_COUNT;
+        builder.multisampleState.alphaToCoverageEnable = VK_TRUE;
         builder.multisampleState.sampleShadingEnable = VK_TRUE;
-        builder.multisampleState.minSampleShading = 0.25f;
+        builder.multisampleState.minSampleShading = SAMPLE_SHADING_RATES[sampleShadingRate];
+        builder.colorBlendState.blendAttachmentStates.resize(3);
         pipelines.offscreenSampleShading = builder.create(context.pipelineCache);
     }
 
@@ -549,6 +637,12 @@ public:
         uniformBuffers.vsOffscreen = context.createUniformBuffer(uboOffscreenVS);
         // Deferred fragment shader
         uniformBuffers.fsLights = context.createUniformBuffer(uboFragmentLights);
+        uniformBuffers.lights = context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer,
+                                                     vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                                     sizeof(Light) * MAX_LIGHT_COUNT);
+        uniformBuffers.lights.map();
+        clusters.create(context, getAssetPath() + "shaders/base/clusters.comp.spv", MAX_LIGHT_COUNT);
+        prepareFillLights();
 
         // Init some values
         uboOffscreenVS.instancePos[0] = glm::vec4(0.0f);
@@ -577,54 +671,87 @@ public:
         uboOffscreenVS.view = camera.matrices.view;
         uboOffscreenVS.model = glm::mat4(1.0f);
         memcpy(uniformBuffers.vsOffscreen.mapped, &uboOffscreenVS, sizeof(uboOffscreenVS));
+        updateClusters();
+    }
+
+    // The G-buffer holds world space positions with y flipped, see mrt.vert
+    void updateClusters() {
+        const glm::mat4 flipY = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, -1.0f, 1.0f));
+        clusters.update(camera.matrices.view * flipY, camera.matrices.perspective, camera.getNearClip(), camera.getFarClip(), lightCount);
+    }
+
+    // The attenuation never reaches zero, so lights are bounded by the distance their contribution becomes negligible
+    static float lightRange(const Light& light) {
+        const float intensity = light.radius * std::max(light.color.r, std::max(light.color.g, light.color.b));
+        return sqrt(std::max(intensity / LIGHT_CUTOFF - 1.0f, 0.0f));
+    }
+
+    // Static fill lights around the scene, with a fixed seed so runs with the same light count are comparable
+    void prepareFillLights() {
+        lights.resize(MAX_LIGHT_COUNT);
+        std::default_random_engine rndEngine(0);
+        std::uniform_real_distribution<float> position(-8.0f, 8.0f);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (uint32_t i = SCENE_LIGHT_COUNT; i < MAX_LIGHT_COUNT; ++i) {
+            auto& light = lights[i];
+            light.position = glm::vec4(position(rndEngine), position(rndEngine) * 0.125f, position(rndEngine), 0.0f);
+            light.color = glm::vec3(unit(rndEngine), unit(rndEngine), unit(rndEngine));
+            light.radius = 0.02f + unit(rndEngine) * 0.06f;
+            clusters.lightBounds()[i] = glm::vec4(glm::vec3(light.position), lightRange(light));
+        }
+        uniformBuffers.lights.copy(lights);
     }
 
     // Update fragment shader light position uniform block
     void updateUniformBufferDeferredLights() {
         // White
-        uboFragmentLights.lights[0].position = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
-        uboFragmentLights.lights[0].color = glm::vec3(1.5f);
-        uboFragmentLights.lights[0].radius = 15.0f * 0.25f;
+        lights[0].position = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+        lights[0].color = glm::vec3(1.5f);
+        lights[0].radius = 15.0f * 0.25f;
         // Red
-        uboFragmentLights.lights[1].position = glm::vec4(-2.0f, 0.0f, 0.0f, 0.0f);
-        uboFragmentLights.lights[1].color = glm::vec3(1.0f, 0.0f, 0.0f);
-        uboFragmentLights.lights[1].radius = 15.0f;
+        lights[1].position = glm::vec4(-2.0f, 0.0f, 0.0f, 0.0f);
+        lights[1].color = glm::vec3(1.0f, 0.0f, 0.0f);
+        lights[1].radius = 15.0f;
         // Blue
-        uboFragmentLights.lights[2].position = glm::vec4(2.0f, 1.0f, 0.0f, 0.0f);
-        uboFragmentLights.lights[2].color = glm::vec3(0.0f, 0.0f, 2.5f);
-        uboFragmentLights.lights[2].radius = 5.0f;
+        lights[2].position = glm::vec4(2.0f, 1.0f, 0.0f, 0.0f);
+        lights[2].color = glm::vec3(0.0f, 0.0f, 2.5f);
+        lights[2].radius = 5.0f;
         // Yellow
-        uboFragmentLights.lights[3].position = glm::vec4(0.0f, 0.9f, 0.5f, 0.0f);
-        uboFragmentLights.lights[3].color = glm::vec3(1.0f, 1.0f, 0.0f);
-        uboFragmentLights.lights[3].radius = 2.0f;
+        lights[3].position = glm::vec4(0.0f, 0.9f, 0.5f, 0.0f);
+        lights[3].color = glm::vec3(1.0f, 1.0f, 0.0f);
+        lights[3].radius = 2.0f;
         // Green
-        uboFragmentLights.lights[4].position = glm::vec4(0.0f, 0.5f, 0.0f, 0.0f);
-        uboFragmentLights.lights[4].color = glm::vec3(0.0f, 1.0f, 0.2f);
-        uboFragmentLights.lights[4].radius = 5.0f;
+        lights[4].position = glm::vec4(0.0f, 0.5f, 0.0f, 0.0f);
+        lights[4].color = glm::vec3(0.0f, 1.0f, 0.2f);
+        lights[4].radius = 5.0f;
         // Yellow
-        uboFragmentLights.lights[5].position = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
-        uboFragmentLights.lights[5].color = glm::vec3(1.0f, 0.7f, 0.3f);
-        uboFragmentLights.lights[5].radius = 25.0f;
+        lights[5].position = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+        lights[5].color = glm::vec3(1.0f, 0.7f, 0.3f);
+        lights[5].radius = 25.0f;
 
-        uboFragmentLights.lights[0].position.x = sin(glm::radians(360.0f * timer)) * 5.0f;
-        uboFragmentLights.lights[0].position.z = cos(glm::radians(360.0f * timer)) * 5.0f;
+        lights[0].position.x = sin(glm::radians(360.0f * timer)) * 5.0f;
+        lights[0].position.z = cos(glm::radians(360.0f * timer)) * 5.0f;
 
-        uboFragmentLights.lights[1].position.x = -4.0f + sin(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
-        uboFragmentLights.lights[1].position.z = 0.0f + cos(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
+        lights[1].position.x = -4.0f + sin(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
+        lights[1].position.z = 0.0f + cos(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
 
-        uboFragmentLights.lights[2].position.x = 4.0f + sin(glm::radians(360.0f * timer)) * 2.0f;
-        uboFragmentLights.lights[2].position.z = 0.0f + cos(glm::radians(360.0f * timer)) * 2.0f;
+        lights[2].position.x = 4.0f + sin(glm::radians(360.0f * timer)) * 2.0f;
+        lights[2].position.z = 0.0f + cos(glm::radians(360.0f * timer)) * 2.0f;
 
-        uboFragmentLights.lights[4].position.x = 0.0f + sin(glm::radians(360.0f * timer + 90.0f)) * 5.0f;
-        uboFragmentLights.lights[4].position.z = 0.0f - cos(glm::radians(360.0f * timer + 45.0f)) * 5.0f;
+        lights[4].position.x = 0.0f + sin(glm::radians(360.0f * timer + 90.0f)) * 5.0f;
+        lights[4].position.z = 0.0f - cos(glm::radians(360.0f * timer + 45.0f)) * 5.0f;
 
-        uboFragmentLights.lights[5].position.x = 0.0f + sin(glm::radians(-360.0f * timer + 135.0f)) * 10.0f;
-        uboFragmentLights.lights[5].position.z = 0.0f - cos(glm::radians(-360.0f * timer - 45.0f)) * 10.0f;
+        lights[5].position.x = 0.0f + sin(glm::radians(-360.0f * timer + 135.0f)) * 10.0f;
+        lights[5].position.z = 0.0f - cos(glm::radians(-360.0f * timer - 45.0f)) * 10.0f;
 
         // Current view position
         uboFragmentLights.viewPos = glm::vec4(camera.position, 0.0f) * glm::vec4(-1.0f, 1.0f, -1.0f, 1.0f);
 
         memcpy(uniformBuffers.fsLights.mapped, &uboFragmentLights, sizeof(uboFragmentLights));
+        uniformBuffers.lights.copy(sizeof(Light) * SCENE_LIGHT_COUNT, lights.data());
+        for (uint32_t i = 0; i < SCENE_LIGHT_COUNT; ++i) {
+            clusters.lightBounds()[i] = glm::vec4(glm::vec3(lights[i].position), lightRange(lights[i]));
+        }
     }
 
     void draw() override {
@@ -671,10 +798,21 @@ public:
             if (ui.checkBox("MSAA", &useMSAA)) {
                 buildCommandBuffers();
             }
+            if (useMSAA && ui.checkBox("Light edge samples only", &edgeShading)) {
+                buildCommandBuffers();
+            }
             if (context.deviceFeatures.sampleRateShading) {
                 if (ui.checkBox("Sample rate shading", &useSampleShading)) {
                     buildDeferredCommandBuffer();
                 }
+                if (useSampleShading && ui.comboBox("Shaded samples", &sampleShadingRate, { "25%", "50%", "100%" })) {
+                    device.waitIdle();
+                    prepareSampleShadingPipeline();
+                    buildDeferredCommandBuffer();
+                }
+            }
+            if (ui.sliderInt("Lights", &lightCount, 1, MAX_LIGHT_COUNT)) {
+                updateClusters();
             }
         }
     }
@@ -1,13 +1,25 @@
 /*
 * Vulkan Example - Deferred shading with shadows from multiple light sources using geometry shader instancing
 *
+* The shadow maps share one atlas, with tiles sized by how much of the screen each light affects, and only as many
+* of them as the budget allows are refreshed per frame.  The depth of the static background is cached per light, so
+* a refresh only copies that back and renders the models over it.
+*
+* With VK_KHR_ray_query the shadows can instead be traced against an acceleration structure of the static scene from
+* the composition pass, which needs no pass per light.
+*
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#include <random>
+
 #include <vulkanExampleBase.h>
+#include <vks/clusteredLights.hpp>
 #include <vks/framebuffer2.hpp>
+#include <vks/raytracing.hpp>
+#include <vks/shadowatlas.hpp>
 
 // Shadowmap properties
 #if defined(__ANDROID__)
@@ -15,6 +27,8 @@
 #else
 #define SHADOWMAP_DIM 2048
 #endif
+// The largest tile of the atlas is a whole shadow map, so all of the lights get one while they fit
+#define SHADOW_ATLAS_DIM (2 * SHADOWMAP_DIM)
 // 16 bits of depth is enough for such a small scene
 #define SHADOWMAP_FORMAT vk::Format::eD32SfloatS8Uint
 
@@ -27,11 +41,15 @@
 
 // Must match the LIGHT_COUNT define in the shadow and deferred shaders
 #define LIGHT_COUNT 3
+// Unshadowed point lights on top of the shadow casting spot lights
+#define MAX_POINT_LIGHT_COUNT 4096
 
 class VulkanExample : public vkx::ExampleBase {
 public:
     bool debugDisplay = false;
     bool enableShadows = true;
+    // Trace the shadows with ray queries instead of rendering shadow maps, only with context.rayQueryEnabled
+    bool rayQueryShadows = false;
 
     // Keep depth range as small as possible
     // for better shadow map precision
@@ -88,6 +106,8 @@ public:
         glm::vec4 target;
         glm::vec4 color;
         glm::mat4 viewMatrix;
+        // Where in the atlas the shadow map is, see vks::ShadowAtlas::rect
+        glm::vec4 atlasRect;
     };
 
     struct {
@@ -96,11 +116,20 @@ public:
         uint32_t useShadows = 1;
     } uboFragmentLights;
 
+    // Point lights only go through the clusters, in a storage buffer the composition indexes with their light lists
+    struct PointLight {
+        glm::vec4 position;  // w = radius
+        glm::vec4 color;
+    };
+    int32_t pointLightCount = 0;
+    vks::ClusteredLights clusters;
+
     struct {
         vks::Buffer vsFullScreen;
         vks::Buffer vsOffscreen;
         vks::Buffer fsLights;
         vks::Buffer uboShadowGS;
+        vks::Buffer pointLights;
     } uniformBuffers;
 
     struct {
@@ -131,19 +160,48 @@ public:
         const vks::Context& context;
         // Framebuffer resources for the deferred pass
         vks::Framebuffer deferred{ context };
-        // Framebuffer resources for the shadow pass
+        // Framebuffer resources for the shadow pass, the atlas
         vks::Framebuffer shadow{ context };
+        // The depth of only the static background from each light, in the same tiles as the atlas
+        vks::Framebuffer staticShadow{ context };
     } frameBuffers{ context };
 
+    vks::ShadowAtlas shadowAtlas;
+    // Lights whose shadows are refreshed per frame, at least, and how many were last frame
+    int32_t shadowBudget = 1;
+    uint32_t shadowsRefreshed = 0;
+
     struct {
         vk::CommandBuffer deferred;
     } commandBuffers;
 
+    // The scene is static, so its acceleration structures are built once
+    struct {
+        std::vector<vks::raytracing::AccelerationStructure> bottomLevel;
+        vks::raytracing::AccelerationStructure topLevel;
+        vk::Pipeline deferred;
+    } rayQuery;
+
+    // The shadow updates are in their own command buffer, which the profiler doesn't track, so they're timed here.  Null
+    // if the queue has no timestamps.
+    vk::QueryPool shadowPassTimestamps;
+    // Whether the last frame wrote them, frames that refresh no shadows don't
+    bool shadowTimestampsWritten = false;
+
+    // Smoothed GPU milliseconds of the shadow pass, and of the composition unshadowed, with shadow maps and with ray
+    // queries.  Negative until measured.
+    struct {
+        double shadowPass = -1.0;
+        double composition[3] = { -1.0, -1.0, -1.0 };
+    } shadowTimings;
+
     // Semaphore used to synchronize between offscreen and final scene rendering
     vk::Semaphore offscreenSemaphore;
 
     VulkanExample() {
         title = "Deferred shading with shadows";
+        // Optional, ray traced shadows are only offered if the device supports them
+        context.enableRayQuery = true;
         camera.type = Camera::CameraType::firstperson;
 #if defined(__ANDROID__)
         camera.movementSpeed = 2.5f;
@@ -157,17 +215,31 @@ public:
         timerSpeed *= 0.25f;
         paused = true;
         settings.overlay = true;
+
+        const auto& args = vkx::getCommandLine();
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (args[i] == "--lights" && i + 1 < args.size()) {
+                pointLightCount = std::max(0, std::min(MAX_POINT_LIGHT_COUNT, std::stoi(args[++i])));
+            }
+        }
     }
 
     ~VulkanExample() {
         // Frame buffers
         frameBuffers.deferred.destroy();
         frameBuffers.shadow.destroy();
+        frameBuffers.staticShadow.destroy();
 
         device.destroy(pipelines.deferred);
         device.destroy(pipelines.offscreen);
         device.destroy(pipelines.shadowpass);
         device.destroy(pipelines.debug);
+        device.destroy(rayQuery.deferred);
+        for (auto& structure : rayQuery.bottomLevel) {
+            structure.destroy();
+        }
+        rayQuery.topLevel.destroy();
+        device.destroy(shadowPassTimestamps);
 
         device.destroy(pipelineLayouts.deferred);
         device.destroy(pipelineLayouts.offscreen);
@@ -184,6 +256,8 @@ public:
         uniformBuffers.vsFullScreen.destroy();
         uniformBuffers.fsLights.destroy();
         uniformBuffers.uboShadowGS.destroy();
+        uniformBuffers.pointLights.destroy();
+        clusters.destroy();
 
         device.freeCommandBuffers(cmdPool, commandBuffers.deferred);
 
@@ -204,6 +278,12 @@ public:
         } else {
             throw std::runtime_error("Selected GPU does not support geometry shaders!");
         }
+        // The geometry shader picks the atlas tile of each light through its viewport
+        if (context.deviceFeatures.multiViewport) {
+            context.enabledFeatures.multiViewport = VK_TRUE;
+        } else {
+            throw std::runtime_error("Selected GPU does not support multiple viewports!");
+        }
         // Enable anisotropic filtering if supported
         if (context.deviceFeatures.samplerAnisotropy) {
             context.enabledFeatures.samplerAnisotropy = VK_TRUE;
@@ -218,28 +298,41 @@ public:
         }
     }
 
-    // Prepare a layered shadow map with each layer containing depth from a light's point of view
+    // Prepare a shadow atlas with a tile containing depth from each light's point of view
     // The shadow mapping pass uses geometry shader instancing to output the scene from the different
-    // light sources' point of view to the layers of the depth attachment in one single pass
+    // light sources' point of view to their tiles of the depth attachment in one single pass
     void shadowSetup() {
-        frameBuffers.shadow.size = vk::Extent2D{ SHADOWMAP_DIM, SHADOWMAP_DIM };
+        shadowAtlas.create(LIGHT_COUNT, SHADOW_ATLAS_DIM, SHADOWMAP_DIM / 8, SHADOWMAP_DIM);
+        frameBuffers.shadow.size = frameBuffers.staticShadow.size = vk::Extent2D{ SHADOW_ATLAS_DIM, SHADOW_ATLAS_DIM };
 
-        // Create a layered depth attachment for rendering the depth maps from the lights' point of view
-        // Each layer corresponds to one of the lights
-        // The actual output to the separate layers is done in the geometry shader using shader instancing
-        // We will pass the matrices of the lights to the GS that selects the layer by the current invocation
+        // Create a depth attachment for rendering the depth maps from the lights' point of view
+        // The actual output to the separate tiles is done in the geometry shader using shader instancing
+        // We will pass the matrices of the lights to the GS that selects the viewport by the current invocation
         vks::AttachmentCreateInfo attachmentInfo = {};
         attachmentInfo.format = SHADOWMAP_FORMAT;
-        attachmentInfo.layerCount = LIGHT_COUNT;
-        attachmentInfo.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled;
+        attachmentInfo.layerCount = 1;
+        attachmentInfo.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
         frameBuffers.shadow.addAttachment(attachmentInfo);
+        // Static depth is copied from here into the tiles of the atlas being refreshed
+        attachmentInfo.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransferSrc;
+        frameBuffers.staticShadow.addAttachment(attachmentInfo);
+
+        // Only some of the tiles are rendered at a time, the others have to be kept, and the barriers around the
+        // passes take care of the layouts
+        for (auto framebuffer : { &frameBuffers.shadow, &frameBuffers.staticShadow }) {
+            auto& description = framebuffer->attachments[0].description;
+            description.loadOp = vk::AttachmentLoadOp::eLoad;
+            description.storeOp = vk::AttachmentStoreOp::eStore;
+            description.initialLayout = description.finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+        }
 
         // Create sampler to sample from to depth attachment
         // Used to sample in the fragment shader for shadowed rendering
         frameBuffers.shadow.createSampler(vk::Filter::eLinear, vk::Filter::eLinear, vk::SamplerAddressMode::eClampToEdge);
 
-        // Create default renderpass for the framebuffer
+        // Both render passes are compatible, so the shadow pipeline renders into either
         frameBuffers.shadow.createRenderPass();
+        frameBuffers.staticShadow.createRenderPass();
     }
 
     // Prepare the framebuffer for offscreen rendering with multiple attachments used as render targets inside the fragment shaders
@@ -276,28 +369,98 @@ public:
         frameBuffers.deferred.createRenderPass();
     }
 
-    // Put render commands for the scene into the given command buffer
-    void renderScene(const vk::Extent2D& size, const vk::CommandBuffer& cmdBuffer, bool shadow) {
-        vk::Viewport viewport = { 0, 0, (float)size.width, (float)size.height, 0.0f, 1.0f };
-        commandBuffers.deferred.setViewport(0, viewport);
-        vk::Rect2D scissor = { {}, size };
-        commandBuffers.deferred.setScissor(0, scissor);
-
-        // Background
-        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.offscreen, 0, shadow ? descriptorSets.shadow : descriptorSets.background,
-                                     nullptr);
+    // The static background, once
+    void renderBackground(const vk::CommandBuffer& cmdBuffer, const vk::DescriptorSet& descriptorSet) {
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.offscreen, 0, descriptorSet, nullptr);
         cmdBuffer.bindVertexBuffers(0, models.background.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(models.background.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(models.background.indices.buffer, 0, models.background.indexType);
         cmdBuffer.drawIndexed(models.background.indexCount, 1, 0, 0, 0);
+    }
 
-        // Objects
-        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.offscreen, 0, shadow ? descriptorSets.shadow : descriptorSets.model,
-                                     nullptr);
+    // The models, at each of the instance positions
+    void renderObjects(const vk::CommandBuffer& cmdBuffer, const vk::DescriptorSet& descriptorSet) {
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.offscreen, 0, descriptorSet, nullptr);
         cmdBuffer.bindVertexBuffers(0, models.model.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(models.model.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(models.model.indices.buffer, 0, models.model.indexType);
         cmdBuffer.drawIndexed(models.model.indexCount, 3, 0, 0, 0);
     }
 
+    // The shadow pipeline state for rendering into the tiles of the lights in `lightMask`, the others are skipped by
+    // the geometry shader
+    void bindShadowPass(const vk::CommandBuffer& cmdBuffer, uint32_t lightMask) {
+        std::array<vk::Viewport, LIGHT_COUNT> viewports;
+        std::array<vk::Rect2D, LIGHT_COUNT> scissors;
+        for (uint32_t i = 0; i < LIGHT_COUNT; ++i) {
+            viewports[i] = shadowAtlas.viewport(i);
+            scissors[i] = shadowAtlas.scissor(i);
+        }
+        cmdBuffer.setViewport(0, viewports);
+        cmdBuffer.setScissor(0, scissors);
+        // Set depth bias (aka "Polygon offset")
+        cmdBuffer.setDepthBias(depthBiasConstant, 0.0f, depthBiasSlope);
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.shadowpass);
+        cmdBuffer.pushConstants<uint32_t>(pipelineLayouts.offscreen, vk::ShaderStageFlagBits::eGeometry, 0, lightMask);
+    }
+
+    // Refresh the shadow maps of the `scheduled` lights, rendering their static depth first if it isn't cached, and
+    // leave the atlas ready to be sampled
+    void recordShadowUpdates(const vk::CommandBuffer& cmdBuffer, const std::vector<uint32_t>& scheduled) {
+        auto& atlas = frameBuffers.shadow.attachments[0];
+        auto& cache = frameBuffers.staticShadow.attachments[0];
+        uint32_t refreshMask = 0;
+        uint32_t staticMask = 0;
+        for (auto light : scheduled) {
+            refreshMask |= 1u << light;
+            if (!shadowAtlas.staticCached(light)) {
+                staticMask |= 1u << light;
+            }
+        }
+        const vk::Rect2D renderArea{ {}, frameBuffers.shadow.size };
+
+        if (staticMask) {
+            context.setImageLayout(cmdBuffer, cache, vks::ImageUsage::DepthStencilAttachment);
+            cmdBuffer.beginRenderPass({ frameBuffers.staticShadow.renderPass, frameBuffers.staticShadow.framebuffer, renderArea }, vk::SubpassContents::eInline);
+            // Only the tiles being rendered, the others hold the depth of lights that are still cached
+            std::vector<vk::ClearRect> clearRects;
+            for (auto light : scheduled) {
+                if (staticMask & (1u << light)) {
+                    clearRects.push_back({ shadowAtlas.scissor(light), 0, 1 });
+                }
+            }
+            vk::ClearValue clearValue;
+            clearValue.depthStencil = defaultClearDepth;
+            const vk::ClearAttachment clear{ vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil, 0, clearValue };
+            cmdBuffer.clearAttachments(clear, clearRects);
+            bindShadowPass(cmdBuffer, staticMask);
+            renderBackground(cmdBuffer, descriptorSets.shadow);
+            cmdBuffer.endRenderPass();
+            for (auto light : scheduled) {
+                shadowAtlas.setStaticCached(light);
+            }
+        }
+
+        // Start each refreshed tile from its static depth
+        vks::Barriers barriers;
+        barriers.image(cache, vks::ImageUsage::TransferSrc).image(atlas, vks::ImageUsage::TransferDst);
+        barriers.record(cmdBuffer, context);
+        std::vector<vk::ImageCopy> regions;
+        for (auto light : scheduled) {
+            const auto& tile = shadowAtlas.tile(light);
+            const vk::ImageSubresourceLayers depth{ vk::ImageAspectFlagBits::eDepth, 0, 0, 1 };
+            const vk::Offset3D offset{ (int32_t)tile.x, (int32_t)tile.y, 0 };
+            regions.push_back({ depth, offset, depth, offset, vk::Extent3D{ tile.size, tile.size, 1 } });
+        }
+        cmdBuffer.copyImage(cache.image, vk::ImageLayout::eTransferSrcOptimal, atlas.image, vk::ImageLayout::eTransferDstOptimal, regions);
+
+        // Then the models over it
+        context.setImageLayout(cmdBuffer, atlas, vks::ImageUsage::DepthStencilAttachment);
+        cmdBuffer.beginRenderPass({ frameBuffers.shadow.renderPass, frameBuffers.shadow.framebuffer, renderArea }, vk::SubpassContents::eInline);
+        bindShadowPass(cmdBuffer, refreshMask);
+        renderObjects(cmdBuffer, descriptorSets.shadow);
+        cmdBuffer.endRenderPass();
+        context.setImageLayout(cmdBuffer, atlas, vks::ImageUsage::FragmentSampled);
+    }
+
     // Build a secondary command buffer for rendering the scene values to the offscreen frame buffer attachments
     void buildDeferredCommandBuffer() {
         if (!commandBuffers.deferred) {
@@ -305,32 +468,17 @@ public:
         }
 
         // Create a semaphore used to synchronize offscreen rendering and usage
-        offscreenSemaphore = device.createSemaphore({});
+        if (!offscreenSemaphore) {
+            offscreenSemaphore = device.createSemaphore({});
+        }
 
         vk::RenderPassBeginInfo renderPassBeginInfo;
         std::array<vk::ClearValue, 4> clearValues;
 
-        // First pass: Shadow map generation
-        // -------------------------------------------------------------------------------------------------------
-
-        clearValues[0].depthStencil = defaultClearDepth;
-
-        renderPassBeginInfo.renderPass = frameBuffers.shadow.renderPass;
-        renderPassBeginInfo.framebuffer = frameBuffers.shadow.framebuffer;
-        renderPassBeginInfo.renderArea.extent = frameBuffers.shadow.size;
-        renderPassBeginInfo.clearValueCount = 1;
-        renderPassBeginInfo.pClearValues = clearValues.data();
-
+        // The shadow maps are refreshed in a command buffer of their own, see draw
         commandBuffers.deferred.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
 
-        commandBuffers.deferred.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-        // Set depth bias (aka "Polygon offset")
-        commandBuffers.deferred.setDepthBias(depthBiasConstant, 0.0f, depthBiasSlope);
-        commandBuffers.deferred.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.shadowpass);
-        renderScene(frameBuffers.shadow.size, commandBuffers.deferred, true);
-        commandBuffers.deferred.endRenderPass();
-
-        // Second pass: Deferred calculations
+        // Deferred calculations
         // -------------------------------------------------------------------------------------------------------
 
         // Clear values for all attachments written in the fragment sahder
@@ -351,15 +499,24 @@ public:
         scissor.extent = frameBuffers.deferred.size;
         commandBuffers.deferred.setScissor(0, scissor);
         commandBuffers.deferred.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.offscreen);
-        renderScene(frameBuffers.deferred.size, commandBuffers.deferred, false);
+        renderBackground(commandBuffers.deferred, descriptorSets.background);
+        renderObjects(commandBuffers.deferred, descriptorSets.model);
         commandBuffers.deferred.endRenderPass();
+
+        // Bin the point lights for the composition
+        clusters.record(commandBuffers.deferred);
         commandBuffers.deferred.end();
     }
 
     void loadAssets() override {
-        models.model.loadFromFile(context, getAssetPath() + "models/armor/armor.dae", vertexLayout, 1.0f);
+        // Both models also go into the acceleration structure for ray traced shadows
+        const vk::BufferUsageFlags usage = context.rayQueryEnabled ? vks::raytracing::BUILD_INPUT_USAGE : vk::BufferUsageFlags{};
+        vks::model::ModelCreateInfo armorCreateInfo{ 1.0f, 1.0f, 0.0f };
+        armorCreateInfo.vertexUsage = armorCreateInfo.indexUsage = usage;
+        models.model.loadFromFile(context, getAssetPath() + "models/armor/armor.dae", vertexLayout, armorCreateInfo);
 
         vks::model::ModelCreateInfo modelCreateInfo;
+        modelCreateInfo.vertexUsage = modelCreateInfo.indexUsage = usage;
         modelCreateInfo.scale = glm::vec3(15.0f);
         modelCreateInfo.uvscale = glm::vec2(1.0f, 1.5f);
         modelCreateInfo.center = glm::vec3(0.0f, 2.3f, 0.0f);
@@ -396,10 +553,12 @@ public:
         drawCmdBuffer.setScissor(0, scissor);
 
         drawCmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.deferred, 0, descriptorSet, nullptr);
-        drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.deferred);
+        drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, rayQueryShadows ? rayQuery.deferred : pipelines.deferred);
         drawCmdBuffer.bindVertexBuffers(0, models.quad.vertices.buffer, { 0 });
-        drawCmdBuffer.bindIndexBuffer(models.quad.indices.buffer, 0, vk::IndexType::eUint32);
+        drawCmdBuffer.bindIndexBuffer(models.quad.indices.buffer, 0, models.quad.indexType);
+        vks::debug::marker::beginRegion(drawCmdBuffer, "Composition", glm::vec4(0.5f, 0.8f, 0.5f, 1.0f));
         drawCmdBuffer.drawIndexed(6, 1, 0, 0, 0);
+        vks::debug::marker::endRegion(drawCmdBuffer);
 
         if (debugDisplay) {
             // Visualize depth maps
@@ -444,7 +603,11 @@ public:
         std::vector<vk::DescriptorPoolSize> poolSizes{
             vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 12 },
             vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 16 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 2 },
         };
+        if (context.rayQueryEnabled) {
+            poolSizes.push_back({ vk::DescriptorType::eAccelerationStructureKHR, 1 });
+        }
 
         descriptorPool = device.createDescriptorPool({ {}, 4, static_cast<uint32_t>(poolSizes.size()), poolSizes.data() });
     }
@@ -465,12 +628,23 @@ public:
             vk::DescriptorSetLayoutBinding{ 4, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment },
             // Binding 5: Shadow map
             vk::DescriptorSetLayoutBinding{ 5, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 6: Point lights
+            vk::DescriptorSetLayoutBinding{ 6, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 7: Cluster parameters
+            vk::DescriptorSetLayoutBinding{ 7, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 8: Light lists of the clusters
+            vk::DescriptorSetLayoutBinding{ 8, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment },
         };
+        if (context.rayQueryEnabled) {
+            // Binding 9: Scene acceleration structure for ray traced shadows
+            setLayoutBindings.push_back({ 9, vk::DescriptorType::eAccelerationStructureKHR, 1, vk::ShaderStageFlagBits::eFragment });
+        }
 
         descriptorSetLayout = device.createDescriptorSetLayout({ {}, static_cast<uint32_t>(setLayoutBindings.size()), setLayoutBindings.data() });
         pipelineLayouts.deferred = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
-        // Offscreen (scene) rendering pipeline layout
-        pipelineLayouts.offscreen = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+        // Offscreen (scene) rendering pipeline layout, the shadow pass pushes the mask of the lights to render
+        vk::PushConstantRange lightMaskRange{ vk::ShaderStageFlagBits::eGeometry, 0, sizeof(uint32_t) };
+        pipelineLayouts.offscreen = device.createPipelineLayout({ {}, 1, &descriptorSetLayout, 1, &lightMaskRange });
     }
 
     void setupDescriptorSet() {
@@ -506,6 +680,12 @@ public:
             { descriptorSet, 4, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.fsLights.descriptor },
             // Binding 5: Shadow map
             { descriptorSet, 5, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texDescriptorShadowMap },
+            // Binding 6: Point lights
+            { descriptorSet, 6, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &uniformBuffers.pointLights.descriptor },
+            // Binding 7: Cluster parameters
+            { descriptorSet, 7, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &clusters.uniformDescriptor() },
+            // Binding 8: Light lists of the clusters
+            { descriptorSet, 8, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &clusters.gridDescriptor() },
 
             // Model descriptor set
             // Binding 0: Vertex shader uniform buffer
@@ -527,56 +707,82 @@ public:
             // Binding 0: Vertex shader uniform buffer
             { descriptorSets.shadow, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.uboShadowGS.descriptor },
         };
+        vk::WriteDescriptorSetAccelerationStructureKHR topLevelDescriptor{ 1, &rayQuery.topLevel.handle };
+        if (context.rayQueryEnabled) {
+            // Binding 9: Scene acceleration structure
+            vk::WriteDescriptorSet topLevelWrite{ descriptorSet, 9, 0, 1, vk::DescriptorType::eAccelerationStructureKHR };
+            topLevelWrite.pNext = &topLevelDescriptor;
+            writeDescriptorSets.push_back(topLevelWrite);
+        }
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
     }
 
     void preparePipelines() {
+        // All four pipelines are independent, so describe them up front and compile them in parallel
+        vks::pipelines::GraphicsPipelineBuilder deferredBuilder(device, pipelineLayouts.deferred, renderPass);
+        vks::pipelines::GraphicsPipelineBuilder debugBuilder(device, pipelineLayouts.deferred, renderPass);
+        vks::pipelines::GraphicsPipelineBuilder offscreenBuilder(device, pipelineLayouts.offscreen, frameBuffers.deferred.renderPass);
+        vks::pipelines::GraphicsPipelineBuilder shadowBuilder(device, pipelineLayouts.offscreen, frameBuffers.shadow.renderPass);
+        for (auto builder : { &deferredBuilder, &debugBuilder, &offscreenBuilder, &shadowBuilder }) {
+            builder->rasterizationState.frontFace = vk::FrontFace::eClockwise;
+            builder->vertexInputState.appendVertexLayout(vertexLayout);
+        }
+
         // Final fullscreen pass pipeline
-        vks::pipelines::GraphicsPipelineBuilder builder(device, pipelineLayouts.deferred, renderPass);
-        builder.rasterizationState.frontFace = vk::FrontFace::eClockwise;
-        builder.vertexInputState.appendVertexLayout(vertexLayout);
-        builder.loadShader(getAssetPath() + "shaders/deferredshadows/deferred.vert.spv", vk::ShaderStageFlagBits::eVertex);
-        builder.loadShader(getAssetPath() + "shaders/deferredshadows/deferred.frag.spv", vk::ShaderStageFlagBits::eFragment);
-        pipelines.deferred = builder.create(context.pipelineCache);
-        builder.destroyShaderModules();
+        deferredBuilder.loadShader(getAssetPath() + "shaders/deferredshadows/deferred.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        deferredBuilder.loadShader(getAssetPath() + "shaders/deferredshadows/deferred.frag.spv", vk::ShaderStageFlagBits::eFragment);
 
         // Debug display pipeline
-        builder.loadShader(getAssetPath() + "shaders/deferredshadows/debug.vert.spv", vk::ShaderStageFlagBits::eVertex);
-        builder.loadShader(getAssetPath() + "shaders/deferredshadows/debug.frag.spv", vk::ShaderStageFlagBits::eFragment);
-        pipelines.debug = builder.create(context.pipelineCache);
-        builder.destroyShaderModules();
+        debugBuilder.loadShader(getAssetPath() + "shaders/deferredshadows/debug.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        debugBuilder.loadShader(getAssetPath() + "shaders/deferredshadows/debug.frag.spv", vk::ShaderStageFlagBits::eFragment);
 
         // Offscreen pipeline
-        // Separate render pass
-        builder.renderPass = frameBuffers.deferred.renderPass;
-        // Separate layout
-        builder.layout = pipelineLayouts.offscreen;
-        builder.loadShader(getAssetPath() + "shaders/deferredshadows/mrt.vert.spv", vk::ShaderStageFlagBits::eVertex);
-        builder.loadShader(getAssetPath() + "shaders/deferredshadows/mrt.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        // Separate render pass and layout
+        offscreenBuilder.loadShader(getAssetPath() + "shaders/deferredshadows/mrt.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        offscreenBuilder.loadShader(getAssetPath() + "shaders/deferredshadows/mrt.frag.spv", vk::ShaderStageFlagBits::eFragment);
         // Blend attachment states required for all color attachments
         // This is important, as color write mask will otherwise be 0x0 and you
         // won't see anything rendered to the attachment
-        builder.colorBlendState.blendAttachmentStates.resize(3);
-        pipelines.offscreen = builder.create(context.pipelineCache);
-        builder.destroyShaderModules();
+        offscreenBuilder.colorBlendState.blendAttachmentStates.resize(3);
 
         // Shadow mapping pipeline
         // The shadow mapping pipeline uses geometry shader instancing (invocations layout modifier) to output
-        // shadow maps for multiple lights sources into the different shadow map layers in one single render pass
-        builder.loadShader(getAssetPath() + "shaders/deferredshadows/shadow.vert.spv", vk::ShaderStageFlagBits::eVertex);
-        builder.loadShader(getAssetPath() + "shaders/deferredshadows/shadow.frag.spv", vk::ShaderStageFlagBits::eFragment);
-        builder.loadShader(getAssetPath() + "shaders/deferredshadows/shadow.geom.spv", vk::ShaderStageFlagBits::eGeometry);
+        // shadow maps for multiple lights sources into their tiles of the atlas in one single render pass, through
+        // a viewport per light
+        shadowBuilder.loadShader(getAssetPath() + "shaders/deferredshadows/shadow.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        shadowBuilder.loadShader(getAssetPath() + "shaders/deferredshadows/shadow.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        shadowBuilder.loadShader(getAssetPath() + "shaders/deferredshadows/shadow.geom.spv", vk::ShaderStageFlagBits::eGeometry);
         // Shadow pass doesn't use any color attachments
-        builder.colorBlendState.blendAttachmentStates.clear();
+        shadowBuilder.colorBlendState.blendAttachmentStates.clear();
         // Cull front faces
-        builder.rasterizationState.cullMode = vk::CullModeFlagBits::eFront;
-        builder.depthStencilState.depthCompareOp = vk::CompareOp::eLessOrEqual;
+        shadowBuilder.rasterizationState.cullMode = vk::CullModeFlagBits::eFront;
+        shadowBuilder.depthStencilState.depthCompareOp = vk::CompareOp::eLessOrEqual;
         // Enable depth bias
-        builder.rasterizationState.depthBiasEnable = VK_TRUE;
+        shadowBuilder.rasterizationState.depthBiasEnable = VK_TRUE;
         // Add depth bias to dynamic state, so we can change it at runtime
-        builder.dynamicState.dynamicStateEnables.push_back(vk::DynamicState::eDepthBias);
-        builder.renderPass = frameBuffers.shadow.renderPass;
-        pipelines.shadowpass = builder.create(context.pipelineCache);
+        shadowBuilder.dynamicState.dynamicStateEnables.push_back(vk::DynamicState::eDepthBias);
+        shadowBuilder.viewportState.viewports.resize(LIGHT_COUNT);
+        shadowBuilder.viewportState.scissors.resize(LIGHT_COUNT);
+
+        std::vector<vks::pipelines::GraphicsPipelineBuilder*> builders{ &deferredBuilder, &debugBuilder, &offscreenBuilder, &shadowBuilder };
+        // Composition with ray traced shadows
+        vks::pipelines::GraphicsPipelineBuilder rayQueryBuilder(device, pipelineLayouts.deferred, renderPass);
+        if (context.rayQueryEnabled) {
+            rayQueryBuilder.rasterizationState.frontFace = vk::FrontFace::eClockwise;
+            rayQueryBuilder.vertexInputState.appendVertexLayout(vertexLayout);
+            rayQueryBuilder.loadShader(getAssetPath() + "shaders/deferredshadows/deferred.vert.spv", vk::ShaderStageFlagBits::eVertex);
+            rayQueryBuilder.loadShader(getAssetPath() + "shaders/deferredshadows/deferred_rayquery.frag.spv", vk::ShaderStageFlagBits::eFragment);
+            builders.push_back(&rayQueryBuilder);
+        }
+
+        auto created = vks::pipelines::createGraphicsPipelines(device, builders, context.pipelineCache);
+        pipelines.deferred = created[0];
+        pipelines.debug = created[1];
+        pipelines.offscreen = created[2];
+        pipelines.shadowpass = created[3];
+        if (context.rayQueryEnabled) {
+            rayQuery.deferred = created[4];
+        }
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
@@ -593,6 +799,14 @@ public:
         // Shadow map vertex shader (matrices from shadow's pov)
         uniformBuffers.uboShadowGS = context.createUniformBuffer(uboShadowGS);
 
+        // Clustered point lights
+        uniformBuffers.pointLights = context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer,
+                                                          vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                                          sizeof(PointLight) * MAX_POINT_LIGHT_COUNT);
+        uniformBuffers.pointLights.map();
+        clusters.create(context, getAssetPath() + "shaders/base/clusters.comp.spv", MAX_POINT_LIGHT_COUNT);
+        preparePointLights();
+
         // Init some values
         uboOffscreenVS.instancePos[0] = glm::vec4(0.0f);
         uboOffscreenVS.instancePos[1] = glm::vec4(-4.0f, 0.0, -4.0f, 0.0f);
@@ -618,6 +832,37 @@ public:
         uboOffscreenVS.view = camera.matrices.view;
         uboOffscreenVS.model = glm::mat4(1.0f);
         memcpy(uniformBuffers.vsOffscreen.mapped, &uboOffscreenVS, sizeof(uboOffscreenVS));
+        updateClusters();
+    }
+
+    // The G-buffer holds world space positions
+    void updateClusters() { clusters.update(camera.matrices.view, camera.matrices.perspective, zNear, zFar, pointLightCount); }
+
+    // Static point lights scattered over the floor, with a fixed seed so runs with the same light count are comparable
+    void preparePointLights() {
+        std::vector<PointLight> pointLights(MAX_POINT_LIGHT_COUNT);
+        std::default_random_engine rndEngine(0);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (uint32_t i = 0; i < MAX_POINT_LIGHT_COUNT; ++i) {
+            const glm::vec3 position{ -12.0f + unit(rndEngine) * 24.0f, -0.25f - unit(rndEngine) * 2.5f, -10.0f + unit(rndEngine) * 24.0f };
+            const float radius = 1.5f + unit(rndEngine) * 2.5f;
+            pointLights[i] = { glm::vec4(position, radius), glm::vec4(unit(rndEngine), unit(rndEngine), unit(rndEngine), 0.0f) };
+            clusters.lightBounds()[i] = pointLights[i].position;
+        }
+        uniformBuffers.pointLights.copy(pointLights);
+    }
+
+    // One instance of the background and three of the model, placed like renderBackground and renderObjects place them
+    void prepareAccelerationStructures() {
+        // Both are built in one batch
+        const std::vector<vks::raytracing::BottomLevelInput> inputs{ vks::raytracing::modelInput(context, models.background),
+                                                                     vks::raytracing::modelInput(context, models.model) };
+        rayQuery.bottomLevel = vks::raytracing::buildBottomLevel(context, inputs);
+        std::vector<vk::AccelerationStructureInstanceKHR> instances{ vks::raytracing::instance(rayQuery.bottomLevel[0], glm::mat4(1.0f)) };
+        for (const auto& position : uboOffscreenVS.instancePos) {
+            instances.push_back(vks::raytracing::instance(rayQuery.bottomLevel[1], glm::translate(glm::mat4(1.0f), glm::vec3(position))));
+        }
+        rayQuery.topLevel = vks::raytracing::buildTopLevel(context, instances);
     }
 
     Light initLight(const glm::vec3& pos, const glm::vec3& target, const glm::vec3& color) {
@@ -634,7 +879,8 @@ public:
         uboFragmentLights.lights[2] = initLight(glm::vec3(0.0f, -10.0f, 4.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 1.0f, 1.0f));
     }
 
-    // Update fragment shader light position uniform block
+    // Update fragment shader light position uniform block.  The shadow matrices and atlas tiles the composition
+    // uses are only updated along with the shadow maps they belong to, see draw.
     void updateUniformBufferDeferredLights() {
         // Animate
         //if (!paused)
@@ -649,6 +895,7 @@ public:
             uboFragmentLights.lights[2].position.z = 4.0f + cos(glm::radians(timer * 360.0f)) * 2.0f;
         }
 
+        std::vector<float> importance(LIGHT_COUNT);
         for (uint32_t i = 0; i < LIGHT_COUNT; i++) {
             // mvp from light's pov (for shadows)
             glm::mat4 shadowProj = glm::perspective(glm::radians(lightFOV), 1.0f, zNear, zFar);
@@ -656,9 +903,18 @@ public:
                 glm::lookAt(glm::vec3(uboFragmentLights.lights[i].position), glm::vec3(uboFragmentLights.lights[i].target), glm::vec3(0.0f, 1.0f, 0.0f));
             glm::mat4 shadowModel = glm::mat4(1.0f);
 
-            uboShadowGS.mvp[i] = shadowProj * shadowView * shadowModel;
-            uboFragmentLights.lights[i].viewMatrix = uboShadowGS.mvp[i];
+            const glm::mat4 mvp = shadowProj * shadowView * shadowModel;
+            if (mvp != uboShadowGS.mvp[i]) {
+                shadowAtlas.invalidate(i);
+            }
+            uboShadowGS.mvp[i] = mvp;
+
+            // The spot light's outer cone where it meets its target, on screen
+            const glm::vec3 target{ uboFragmentLights.lights[i].target };
+            const float reach = glm::length(glm::vec3(uboFragmentLights.lights[i].position) - target) * std::tan(glm::radians(25.0f));
+            importance[i] = vks::ShadowAtlas::screenCoverage(camera.matrices.view, camera.matrices.perspective, target, std::max(reach, 1.0f));
         }
+        shadowAtlas.assign(importance);
 
         memcpy(uboShadowGS.instancePos, uboOffscreenVS.instancePos, sizeof(uboOffscreenVS.instancePos));
 
@@ -672,8 +928,51 @@ public:
     void draw() override {
         ExampleBase::prepareFrame();
 
+        // The previous frame's shadow updates are usually done by now.  If they aren't, their timestamps are unavailable.
+        if (shadowPassTimestamps && shadowTimestampsWritten) {
+            std::array<uint64_t, 2> ticks;
+            const vk::Result result = device.getQueryPoolResults(shadowPassTimestamps, 0, 2, sizeof(ticks), ticks.data(), sizeof(uint64_t),
+                                                                 vk::QueryResultFlagBits::e64);
+            if (result == vk::Result::eSuccess) {
+                profiler.report("Shadow maps", (double)(ticks[1] - ticks[0]) * context.deviceProperties.limits.timestampPeriod / 1.0e6);
+            }
+        }
+        updateShadowTimings();
+
+        // Refresh the shadows the atlas picks within the budget, the others keep what was last rendered into their tiles
+        std::vector<vk::CommandBuffer> offscreenCommandBuffers;
+        shadowsRefreshed = 0;
+        shadowTimestampsWritten = false;
+        // Ray traced shadows don't read the shadow maps
+        if (!rayQueryShadows) {
+            const auto scheduled = shadowAtlas.schedule((uint32_t)shadowBudget);
+            if (!scheduled.empty()) {
+                for (auto light : scheduled) {
+                    uboFragmentLights.lights[light].viewMatrix = uboShadowGS.mvp[light];
+                    uboFragmentLights.lights[light].atlasRect = shadowAtlas.rect(light);
+                }
+                memcpy(uniformBuffers.fsLights.mapped, &uboFragmentLights, sizeof(uboFragmentLights));
+
+                const vk::CommandBuffer shadowCmdBuffer = context.frameCommandPools.allocate();
+                shadowCmdBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+                if (shadowPassTimestamps) {
+                    shadowCmdBuffer.resetQueryPool(shadowPassTimestamps, 0, 2);
+                    shadowCmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, shadowPassTimestamps, 0);
+                }
+                recordShadowUpdates(shadowCmdBuffer, scheduled);
+                if (shadowPassTimestamps) {
+                    shadowCmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, shadowPassTimestamps, 1);
+                    shadowTimestampsWritten = true;
+                }
+                shadowCmdBuffer.end();
+                offscreenCommandBuffers.push_back(shadowCmdBuffer);
+                shadowsRefreshed = (uint32_t)scheduled.size();
+            }
+        }
+
         // Offscreen rendering
-        context.submit(commandBuffers.deferred, { { semaphores.acquireComplete, vk::PipelineStageFlagBits::eBottomOfPipe } }, offscreenSemaphore);
+        offscreenCommandBuffers.push_back(commandBuffers.deferred);
+        context.submit(offscreenCommandBuffers, { { semaphores.acquireComplete, vk::PipelineStageFlagBits::eBottomOfPipe } }, offscreenSemaphore);
 
         // Scene rendering
         renderWaitSemaphores = { offscreenSemaphore };
@@ -682,6 +981,21 @@ public:
         ExampleBase::submitFrame();
     }
 
+    // Sorts the latest timings into shadowTimings by the mode they were measured in
+    void updateShadowTimings() {
+        const size_t mode = uboFragmentLights.useShadows ? (rayQueryShadows ? 2 : 1) : 0;
+        for (const auto& scope : profiler.getScopes()) {
+            if (scope.name == "Composition") {
+                shadowTimings.composition[mode] = scope.milliseconds;
+            }
+        }
+        for (const auto& report : profiler.getReports()) {
+            if (report.name == "Shadow maps") {
+                shadowTimings.shadowPass = report.milliseconds;
+            }
+        }
+    }
+
     void prepare() override {
         ExampleBase::prepare();
         generateQuads();
@@ -689,6 +1003,14 @@ public:
         shadowSetup();
         initLights();
         prepareUniformBuffers();
+        if (context.rayQueryEnabled) {
+            prepareAccelerationStructures();
+        }
+        if (context.queueFamilyProperties[context.queueIndices.graphics].timestampValidBits) {
+            shadowPassTimestamps = device.createQueryPool({ {}, vk::QueryType::eTimestamp, 2 });
+            // Reset once up front, so that reading them before the first shadow pass finds them unavailable
+            context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& cmdBuffer) { cmdBuffer.resetQueryPool(shadowPassTimestamps, 0, 2); });
+        }
         setupDescriptorSetLayout();
         preparePipelines();
         setupDescriptorPool();
@@ -718,6 +1040,40 @@ public:
                 uboFragmentLights.useShadows = shadows;
                 updateUniformBufferDeferredLights();
             }
+            if (ui.sliderInt("Point lights", &pointLightCount, 0, MAX_POINT_LIGHT_COUNT)) {
+                updateClusters();
+            }
+            if (!rayQueryShadows) {
+                ui.sliderInt("Shadow updates per frame", &shadowBudget, 1, LIGHT_COUNT);
+                ui.text("Shadows refreshed: %u of %u", shadowsRefreshed, LIGHT_COUNT);
+            }
+            if (context.rayQueryEnabled && ui.checkBox("Ray traced shadows", &rayQueryShadows)) {
+                // The offscreen command buffer may still be executing
+                device.waitIdle();
+                buildCommandBuffers();
+                buildDeferredCommandBuffer();
+            }
+        }
+        if (context.rayQueryEnabled && ui.header("Shadow cost")) {
+            // Both are compared against the composition without shadows, so that only what the shadows add is counted
+            const double unshadowed = shadowTimings.composition[0];
+            const double maps = shadowTimings.shadowPass + shadowTimings.composition[1];
+            const double traced = shadowTimings.composition[2];
+            if (unshadowed < 0.0) {
+                ui.text("Turn shadows off once to measure the composition without them");
+            }
+            if (shadowTimings.shadowPass >= 0.0 && shadowTimings.composition[1] >= 0.0) {
+                ui.text("Shadow maps: %.2f ms pass, %.2f ms composition", shadowTimings.shadowPass, shadowTimings.composition[1]);
+                if (unshadowed >= 0.0) {
+                    ui.text("  %.3f ms per light", (maps - unshadowed) / LIGHT_COUNT);
+                }
+            }
+            if (traced >= 0.0) {
+                ui.text("Ray queries: %.2f ms composition", traced);
+                if (unshadowed >= 0.0) {
+                    ui.text("  %.3f ms per light", (traced - unshadowed) / LIGHT_COUNT);
+                }
+            }
         }
     }
 };
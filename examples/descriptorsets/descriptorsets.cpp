@@ -79,7 +79,7 @@ public:
         drawCmdBuffer.setScissor(0, scissor());
         drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
         drawCmdBuffer.bindVertexBuffers(0, models.cube.vertices.buffer, { 0 });
-        drawCmdBuffer.bindIndexBuffer(models.cube.indices.buffer, 0, vk::IndexType::eUint32);
+        drawCmdBuffer.bindIndexBuffer(models.cube.indices.buffer, 0, models.cube.indexType);
 
         /*
         [POI] Render cubes with separate descriptor sets
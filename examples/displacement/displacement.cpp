@@ -1,12 +1,16 @@
 /*
 * Vulkan Example - Displacement mapping with tessellation shaders
 *
+* The tessellation levels follow the on screen length of the edges, and patches outside the view or facing away are
+* culled in the control shader, see vks::AdaptiveTessellation
+*
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
 #include <vulkanExampleBase.h>
+#include <vks/tessellation.hpp>
 
 // Vertex layout for this example
 vks::model::VertexLayout vertexLayout{ {
@@ -33,9 +37,15 @@ public:
 
     vks::Buffer uniformDataTC, uniformDataTE;
 
-    struct UBOTessControl {
-        float tessLevel = 64.0f;
-    } uboTessControl;
+    // Screen space levels within a triangle budget, or the same level everywhere
+    vks::AdaptiveTessellation tessellation;
+    bool adaptive = true;
+    float tessLevel = 64.0f;
+    float edgePixels = 8.0f;
+    int32_t triangleBudget = 1024;
+    // The tessellated triangles of the most recent profiler collection, 0 without pipeline statistics
+    uint64_t tessellatedTriangles = 0;
+    uint64_t statisticsCollections = 0;
 
     struct UBOTessEval {
         glm::mat4 projection;
@@ -85,11 +95,9 @@ public:
 
         meshes.object.destroy();
 
-        device.destroyBuffer(uniformDataTC.buffer);
-        device.freeMemory(uniformDataTC.memory);
+        uniformDataTC.destroy();
 
-        device.destroyBuffer(uniformDataTE.buffer);
-        device.freeMemory(uniformDataTE.memory);
+        uniformDataTE.destroy();
 
         textures.colorHeightMap.destroy();
     }
@@ -102,6 +110,7 @@ public:
 
     void loadAssets() override {
         meshes.object.loadFromFile(context, getAssetPath() + "models/torus.obj", vertexLayout, 0.25f);
+        tessellation.patchCount = meshes.object.indexCount / 3;
         if (context.deviceFeatures.textureCompressionBC) {
             textures.colorHeightMap.loadFromFile(context, getAssetPath() + "textures/stonefloor03_color_bc3_unorm.ktx", vk::Format::eBc3UnormBlock);
         } else if (context.deviceFeatures.textureCompressionASTC_LDR) {
@@ -120,7 +129,7 @@ public:
         cmdBuffer.setLineWidth(1.0f);
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
         cmdBuffer.bindVertexBuffers(0, meshes.object.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.object.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.object.indices.buffer, 0, meshes.object.indexType);
 
         if (splitScreen) {
             cmdBuffer.setViewport(0, viewport);
@@ -129,9 +138,12 @@ public:
             viewport.x += viewport.width;
         }
 
+        // The region's pipeline statistics count the patches and the triangles they were tessellated into
+        vks::debug::marker::beginRegion(cmdBuffer, "Displacement", glm::vec4(0.5f, 1.0f, 0.5f, 1.0f));
         cmdBuffer.setViewport(0, viewport);
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *pipelineRight);
         cmdBuffer.drawIndexed(meshes.object.indexCount, 1, 0, 0, 0);
+        vks::debug::marker::endRegion(cmdBuffer);
     }
 
     void setupDescriptorPool() {
@@ -147,7 +159,7 @@ public:
             // Binding 0 : Tessellation control shader ubo
             { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eTessellationControl },
             // Binding 1 : Tessellation evaluation shader ubo
-            { 1, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eTessellationEvaluation },
+            { 1, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eTessellationControl | vk::ShaderStageFlagBits::eTessellationEvaluation },
             // Binding 2 : Tessellation evaluation shader displacement map image sampler
             { 2, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eTessellationEvaluation | vk::ShaderStageFlagBits::eFragment },
         };
@@ -197,8 +209,8 @@ public:
 
         // Pass through pipelines
         // Load pass through tessellation shaders (Vert and frag are reused)
-        context.device.destroyShaderModule(pipelineBuilder.shaderStages[2].module);
-        context.device.destroyShaderModule(pipelineBuilder.shaderStages[3].module);
+        vks::shaders::releaseShaderModule(context.device, pipelineBuilder.shaderStages[2].module);
+        vks::shaders::releaseShaderModule(context.device, pipelineBuilder.shaderStages[3].module);
         pipelineBuilder.shaderStages.resize(2);
         pipelineBuilder.loadShader(getAssetPath() + "shaders/displacement/passthrough.tesc.spv", vk::ShaderStageFlagBits::eTessellationControl);
         pipelineBuilder.loadShader(getAssetPath() + "shaders/displacement/passthrough.tese.spv", vk::ShaderStageFlagBits::eTessellationEvaluation);
@@ -217,7 +229,21 @@ public:
         // Tessellation evaluation shader uniform buffer
         uniformDataTE = context.createUniformBuffer(uboTessEval);
         // Tessellation control shader uniform buffer
-        uniformDataTC = context.createUniformBuffer(uboTessControl);
+        uniformDataTC = context.createUniformBuffer(tessellation.params(size));
+        updateTessellation();
+    }
+
+    void updateTessellation() {
+        // Without displacement the patches are drawn as they are
+        const bool screenSpace = adaptive && displacement;
+        tessellation.edgePixels = screenSpace ? edgePixels : 0.0f;
+        if (!displacement) {
+            tessellation.maxLevel = 1.0f;
+        } else {
+            tessellation.maxLevel = adaptive ? std::min(64.0f, (float)context.deviceProperties.limits.maxTessellationGenerationLevel) : tessLevel;
+        }
+        tessellation.maxTriangles = (uint32_t)triangleBudget * 1000;
+        tessellation.reset();
         updateUniformBuffers();
     }
 
@@ -230,16 +256,24 @@ public:
 
 
 
-        // Tessellation control
-        float savedLevel = uboTessControl.tessLevel;
-        if (!displacement) {
-            uboTessControl.tessLevel = 1.0f;
-        }
-
-        uniformDataTC.copy(uboTessControl);
+        // Tessellation control, the displacement map's alpha is at most 1
+        tessellation.displacement = displacement ? uboTessEval.tessStrength : 0.0f;
+        uniformDataTC.copy(tessellation.params({ splitScreen ? size.width / 2 : size.width, size.height }));
+    }
 
-        if (!displacement) {
-            uboTessControl.tessLevel = savedLevel;
+    void update(float deltaTime) override {
+        Parent::update(deltaTime);
+        if (profiler.getCollectionCount() == statisticsCollections) {
+            return;
+        }
+        statisticsCollections = profiler.getCollectionCount();
+        // Every tessellated triangle goes through clipping, culled patches don't make any
+        const auto* scope = profiler.findScope("Displacement");
+        if (scope && !scope->statistics.empty()) {
+            tessellatedTriangles = profiler.getStatistic("Displacement", "clippingInvocations");
+            if (tessellation.update(tessellatedTriangles)) {
+                updateUniformBuffers();
+            }
         }
     }
 
@@ -265,12 +299,26 @@ public:
     void OnUpdateUIOverlay() override {
         if (ui.header("Settings")) {
             if (ui.checkBox("Tessellation displacement", &displacement)) {
-                updateUniformBuffers();
+                updateTessellation();
             }
             if (ui.inputFloat("Strength", &uboTessEval.tessStrength, 0.025f, 3)) {
                 updateUniformBuffers();
             }
-            if (ui.inputFloat("Level", &uboTessControl.tessLevel, 0.5f, 2)) {
+            if (ui.checkBox("Adaptive", &adaptive)) {
+                updateTessellation();
+            }
+            if (adaptive) {
+                if (ui.inputFloat("Edge length (pixels)", &edgePixels, 1.0f, 1)) {
+                    edgePixels = std::max(edgePixels, 1.0f);
+                    updateTessellation();
+                }
+                if (ui.sliderInt("Triangle budget (thousands)", &triangleBudget, 16, 4096)) {
+                    updateTessellation();
+                }
+            } else if (ui.inputFloat("Level", &tessLevel, 0.5f, 2)) {
+                updateTessellation();
+            }
+            if (ui.checkBox("Cull patches", &tessellation.cull)) {
                 updateUniformBuffers();
             }
             if (deviceFeatures.fillModeNonSolid) {
@@ -279,7 +327,14 @@ public:
                     updateUniformBuffers();
                 }
             }
-
+        }
+        if (ui.header("Tessellation")) {
+            if (tessellatedTriangles) {
+                ui.text("Triangles: %llu", (unsigned long long)tessellatedTriangles);
+            } else {
+                ui.text("Triangles need pipeline statistics");
+            }
+            ui.text("Budget scale: %.2f", tessellation.budgetScale());
         }
     }
 };
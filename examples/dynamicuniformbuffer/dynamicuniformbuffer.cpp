@@ -8,15 +8,16 @@
 * Summary:
 * Demonstrates the use of dynamic uniform buffers.
 *
-* Instead of using one uniform buffer per-object, this example allocates one big uniform buffer
-* with respect to the alignment reported by the device via minUniformBufferOffsetAlignment that
-* contains all matrices for the objects in the scene.
+* Instead of using one uniform buffer per-object, the model matrices of all objects are pushed into
+* the per frame linear allocator of the base class, one big buffer split into a region per frame in
+* flight, that takes care of the alignment reported by the device via minUniformBufferOffsetAlignment.
 *
 * The used descriptor type VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC then allows to set a dynamic
 * offset used to pass data from the single uniform buffer to the connected shader binding point.
 */
 
 #include <vulkanExampleBase.h>
+#include <vks/transforms.hpp>
 
 #define OBJECT_INSTANCES 125
 
@@ -26,28 +27,6 @@ struct Vertex {
     float color[3];
 };
 
-// Wrapper functions for aligned memory allocation
-// There is currently no standard for this in C++ that works across all platforms and vendors, so we abstract this
-void* alignedAlloc(size_t size, size_t alignment) {
-    void* data = nullptr;
-#if defined(_MSC_VER) || defined(__MINGW32__)
-    data = _aligned_malloc(size, alignment);
-#else
-    int res = posix_memalign(&data, alignment, size);
-    if (res != 0)
-        data = nullptr;
-#endif
-    return data;
-}
-
-void alignedFree(void* data) {
-#if defined(_MSC_VER) || defined(__MINGW32__)
-    _aligned_free(data);
-#else
-    free(data);
-#endif
-}
-
 class VulkanExample : public vkx::ExampleBase {
 public:
     vks::Buffer vertexBuffer;
@@ -56,7 +35,6 @@ public:
 
     struct {
         vks::Buffer view;
-        vks::Buffer dynamic;
     } uniformBuffers;
 
     struct {
@@ -68,11 +46,11 @@ public:
     glm::vec3 rotations[OBJECT_INSTANCES];
     glm::vec3 rotationSpeeds[OBJECT_INSTANCES];
 
-    // One big uniform buffer that contains all matrices
-    // Note that we need to manually allocate the data to cope for GPU-specific uniform buffer offset alignments
-    struct UboDataDynamic {
-        glm::mat4* model = nullptr;
-    } uboDataDynamic;
+    // Per-object transforms, children of one root for the whole grid.  Their world matrices are written straight
+    // into the frame allocator every frame, at a stride of the dynamic offset alignment
+    vks::TransformHierarchy transforms;
+    uint32_t gridNode{ 0 };
+    std::array<uint32_t, OBJECT_INSTANCES> objectNodes;
 
     vk::Pipeline pipeline;
     vk::PipelineLayout pipelineLayout;
@@ -81,8 +59,6 @@ public:
 
     float animationTimer = 0.0f;
 
-    size_t dynamicAlignment;
-
     VulkanExample() {
         title = "Vulkan Example - Dynamic uniform buffers";
         camera.type = Camera::CameraType::lookat;
@@ -90,13 +66,11 @@ public:
         camera.setRotation(glm::vec3(0.0f));
         camera.setPerspective(60.0f, (float)size.width / (float)size.height, 0.1f, 256.0f);
         settings.overlay = true;
+        // The dynamic offsets change every frame
+        recordPerFrame = true;
     }
 
     ~VulkanExample() {
-        if (uboDataDynamic.model) {
-            alignedFree(uboDataDynamic.model);
-        }
-
         // Clean up used Vulkan resources
         // Note : Inherited destructor cleans up resources stored in base class
         vkDestroyPipeline(device, pipeline, nullptr);
@@ -108,7 +82,6 @@ public:
         indexBuffer.destroy();
 
         uniformBuffers.view.destroy();
-        uniformBuffers.dynamic.destroy();
     }
 
     void updateDrawCommandBuffer(const vk::CommandBuffer& drawCommandBuffer) override {
@@ -129,10 +102,15 @@ public:
         drawCommandBuffer.bindVertexBuffers(0, vertexBuffer.buffer, { 0 });
         drawCommandBuffer.bindIndexBuffer(indexBuffer.buffer, 0, vk::IndexType::eUint32);
 
+        // This frame's copy of the model matrices, only the objects that rotated since the last frame are recomputed
+        const vk::DeviceSize stride = vks::StagingRing::alignUp(sizeof(glm::mat4), frameAllocator.offsetAlignment());
+        const auto allocation = frameAllocator.allocate(stride * transforms.size());
+        transforms.update(&getScheduler(), allocation.mapped, static_cast<size_t>(stride), 32);
+
         // Render multiple objects using different model matrices by dynamically offsetting into one uniform buffer
         for (uint32_t j = 0; j < OBJECT_INSTANCES; j++) {
-            // One dynamic offset per dynamic descriptor to offset into the ubo containing all model matrices
-            uint32_t dynamicOffset = j * static_cast<uint32_t>(dynamicAlignment);
+            // One dynamic offset per dynamic descriptor, pointing at this frame's copy of the model matrix
+            uint32_t dynamicOffset = allocation.offset + static_cast<uint32_t>(objectNodes[j] * stride);
             // Bind the descriptor set for rendering a mesh using the dynamic offset
             drawCommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, dynamicOffset);
             drawCommandBuffer.drawIndexed(indexCount, 1, 0, 0, 0);
@@ -164,16 +142,6 @@ public:
         indexBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indices);
     }
 
-    void setupDescriptorPool() {
-        // Example uses one ubo and one image sampler
-        std::vector<vk::DescriptorPoolSize> poolSizes{
-            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 1 },
-            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBufferDynamic, 1 },
-            vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 1 },
-        };
-        descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 2, static_cast<uint32_t>(poolSizes.size()), poolSizes.data() });
-    }
-
     void setupDescriptorSetLayout() {
         std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
             { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
@@ -186,13 +154,13 @@ public:
     }
 
     void setupDescriptorSet() {
-        descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
-
-        std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
-            { descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.view.descriptor },
-            { descriptorSet, 1, 0, 1, vk::DescriptorType::eUniformBufferDynamic, nullptr, &uniformBuffers.dynamic.descriptor },
+        // The base class' allocator sizes its pools itself.  The dynamic binding covers one matrix, wherever in the
+        // frame allocator's buffer it is
+        std::vector<vks::DescriptorBinding> bindings{
+            { 0, vk::DescriptorType::eUniformBuffer, uniformBuffers.view.descriptor },
+            { 1, vk::DescriptorType::eUniformBufferDynamic, frameAllocator.descriptor(sizeof(glm::mat4)) },
         };
-        device.updateDescriptorSets(writeDescriptorSets, {});
+        descriptorSet = descriptorAllocator.get(descriptorSetLayout, bindings);
     }
 
     void preparePipelines() {
@@ -219,38 +187,26 @@ public:
 
     // Prepare and initialize uniform buffer containing shader uniforms
     void prepareUniformBuffers() {
-        // Allocate data for the dynamic uniform buffer object
-        // We allocate this manually as the alignment of the offset differs between GPUs
-
-        // Calculate required alignment based on minimum device offset alignment
-        size_t minUboAlignment = context.deviceProperties.limits.minUniformBufferOffsetAlignment;
-        dynamicAlignment = sizeof(glm::mat4);
-        if (minUboAlignment > 0) {
-            dynamicAlignment = (dynamicAlignment + minUboAlignment - 1) & ~(minUboAlignment - 1);
-        }
-
-        size_t bufferSize = OBJECT_INSTANCES * dynamicAlignment;
-
-        uboDataDynamic.model = (glm::mat4*)alignedAlloc(bufferSize, dynamicAlignment);
-        assert(uboDataDynamic.model);
+        // Per-object matrices, allocated from a region of the frame allocator's buffer every frame.  The allocator
+        // rounds every allocation up to the minimum uniform buffer offset alignment of the device.  One more for the
+        // matrix of the grid
+        const vk::DeviceSize minUboAlignment = context.deviceProperties.limits.minUniformBufferOffsetAlignment;
+        frameAllocator.create(context, (OBJECT_INSTANCES + 1) * std::max<vk::DeviceSize>(sizeof(glm::mat4), minUboAlignment), (uint32_t)frames.size());
 
         std::cout << "minUniformBufferOffsetAlignment = " << minUboAlignment << std::endl;
-        std::cout << "dynamicAlignment = " << dynamicAlignment << std::endl;
 
         // Vertex shader uniform buffer block
 
         // Static shared uniform buffer object with projection and view matrix
         uniformBuffers.view = context.createUniformBuffer(uboVS);
 
-        // Uniform buffer object with per-object matrices
-        uniformBuffers.dynamic = context.createBuffer(vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible, bufferSize);
-        // Map persistent
-        uniformBuffers.dynamic.map();
-
         // Prepare per-object matrices with offsets and random rotations
         std::mt19937 rndGen(static_cast<uint32_t>(time(0)));
         std::normal_distribution<float> rndDist(-1.0f, 1.0f);
+        transforms.reserve(OBJECT_INSTANCES + 1);
+        gridNode = transforms.add();
         for (uint32_t i = 0; i < OBJECT_INSTANCES; i++) {
+            objectNodes[i] = transforms.add(gridNode);
             rotations[i] = glm::vec3(rndDist(rndGen), rndDist(rndGen), rndDist(rndGen)) * 2.0f * (float)M_PI;
             rotationSpeeds[i] = glm::vec3(rndDist(rndGen), rndDist(rndGen), rndDist(rndGen));
         }
@@ -283,9 +239,6 @@ public:
                 for (uint32_t z = 0; z < dim; z++) {
                     uint32_t index = x * dim * dim + y * dim + z;
 
-                    // Aligned offset
-                    glm::mat4* modelMat = (glm::mat4*)(((uint64_t)uboDataDynamic.model + (index * dynamicAlignment)));
-
                     // Update rotations
                     rotations[index] += animationTimer * rotationSpeeds[index];
 
@@ -293,18 +246,15 @@ public:
                     glm::vec3 pos =
                         glm::vec3(-((dim * offset.x) / 2.0f) + offset.x / 2.0f + x * offset.x, -((dim * offset.y) / 2.0f) + offset.y / 2.0f + y * offset.y,
                                   -((dim * offset.z) / 2.0f) + offset.z / 2.0f + z * offset.z);
-                    *modelMat = glm::translate(glm::mat4(1.0f), pos);
-                    *modelMat = glm::rotate(*modelMat, rotations[index].x, glm::vec3(1.0f, 1.0f, 0.0f));
-                    *modelMat = glm::rotate(*modelMat, rotations[index].y, glm::vec3(0.0f, 1.0f, 0.0f));
-                    *modelMat = glm::rotate(*modelMat, rotations[index].z, glm::vec3(0.0f, 0.0f, 1.0f));
+                    glm::quat rotation = glm::angleAxis(rotations[index].x, glm::normalize(glm::vec3(1.0f, 1.0f, 0.0f))) *
+                                         glm::angleAxis(rotations[index].y, glm::vec3(0.0f, 1.0f, 0.0f)) *
+                                         glm::angleAxis(rotations[index].z, glm::vec3(0.0f, 0.0f, 1.0f));
+                    transforms.setLocal(objectNodes[index], pos, rotation, glm::vec3(1.0f));
                 }
             }
         }
 
         animationTimer = 0.0f;
-        uniformBuffers.dynamic.copy(uniformBuffers.dynamic.size, uboDataDynamic.model);
-        // Flush to make changes visible to the host
-        uniformBuffers.dynamic.flush();
     }
 
     void prepare() override {
@@ -313,7 +263,6 @@ public:
         prepareUniformBuffers();
         setupDescriptorSetLayout();
         preparePipelines();
-        setupDescriptorPool();
         setupDescriptorSet();
         buildCommandBuffers();
         prepared = true;
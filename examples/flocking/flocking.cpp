@@ -0,0 +1,518 @@
+/*
+* Vulkan Example - Compute shader flocking with a uniform grid
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <vulkanExampleBase.h>
+
+// Boid counts selectable in the UI, --boids <count> and --benchmark-sweep take any other
+static const std::vector<uint32_t> BOID_COUNTS{ 10000, 50000, 100000, 250000, 500000, 1000000 };
+
+// Every boid steers by the boids within one cell size of it, which a naive kernel would find by visiting all of them,
+// O(N^2).  Instead the boids are binned into a uniform grid of cells one neighbourhood radius across every frame,
+// with a counting sort on the GPU, and each boid only visits the 27 cells around its own:
+//   count          cell of every boid, and its rank within the cell from an atomic increment of the cell's count
+//   scan           exclusive prefix sum of the counts within workgroup sized blocks of cells, and the block totals
+//   scan_groups    prefix sum of the block totals, in a single workgroup
+//   scatter        every boid to the start of its cell plus its rank, in a sorted copy
+//   flocking       separation, alignment and cohesion over the neighbouring cells, and integration
+// The grid is sized to keep the number of boids per cell about the same whatever their count, so the cost per
+// boid stays flat as the count grows.  Boids are double buffered in the slots of `boids`, and the update writes them
+// in sorted order, so the next frame's sort has little to move.
+class ComputeFlocking : public vkx::Compute {
+    using Parent = vkx::Compute;
+
+public:
+    ComputeFlocking(const vks::Context& context)
+        : Parent(context) {}
+
+    struct Boid {
+        glm::vec4 pos;
+        glm::vec4 vel;
+    };
+
+    // Average number of boids per cell the grid is sized for
+    static constexpr float DENSITY = 4.0f;
+
+    // May be changed before prepare, afterwards through setBoidCount
+    uint32_t boidCount{ 100000 };
+    // Workgroup size of every pass, 0 picks one from the device limits.  Rounded down to a power of two
+    uint32_t groupSize{ 0 };
+    // Cells along each edge of the box
+    uint32_t gridDim{ 0 };
+
+    SlotBuffer boids;
+    vks::Buffer uniformBuffer;
+    vks::Buffer sortedBoids;
+    vks::Buffer cellCounts;
+    vks::Buffer cellStarts;
+    vks::Buffer boidCells;
+    vks::Buffer blockSums;
+    // One per slot written
+    std::array<vk::CommandBuffer, SLOT_COUNT> commandBuffers;
+    vk::DescriptorPool descriptorPool;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    // Per slot written
+    std::array<vk::DescriptorSet, SLOT_COUNT> descriptorSets;
+    vk::PipelineLayout pipelineLayout;
+    struct {
+        vk::Pipeline count;
+        vk::Pipeline scan;
+        vk::Pipeline scanGroups;
+        vk::Pipeline scatter;
+        vk::Pipeline update;
+    } pipelines;
+
+    // Must match flocking.glsl
+    struct UBO {
+        float deltaT{ 0.0f };
+        uint32_t boidCount{ 0 };
+        uint32_t gridDim{ 0 };
+        // Also the radius of the neighbourhood
+        float cellSize{ 1.0f };
+        float separation{ 0.5f };
+        float alignment{ 1.0f };
+        float cohesion{ 1.0f };
+        float minSpeed{ 0.5f };
+        float maxSpeed{ 2.0f };
+    } ubo;
+
+    float worldSize() const { return (float)gridDim * ubo.cellSize; }
+    uint32_t cellCount() const { return gridDim * gridDim * gridDim; }
+
+    void prepare() override {
+        Parent::prepare();
+        chooseGroupSize();
+        uniformBuffer = context.createUniformBuffer(ubo);
+        prepareStorageBuffers();
+        prepareDescriptors();
+        preparePipelines();
+        auto allocated = device.allocateCommandBuffers({ commandPool, vk::CommandBufferLevel::ePrimary, (uint32_t)commandBuffers.size() });
+        std::copy(allocated.begin(), allocated.end(), commandBuffers.begin());
+        buildComputeCommandBuffers();
+    }
+
+    void destroyStorage() {
+        boids.destroy();
+        sortedBoids.destroy();
+        cellCounts.destroy();
+        cellStarts.destroy();
+        boidCells.destroy();
+        blockSums.destroy();
+        device.destroy(descriptorPool);
+    }
+
+    void destroy() override {
+        destroyStorage();
+        uniformBuffer.destroy();
+        device.destroy(pipelines.count);
+        device.destroy(pipelines.scan);
+        device.destroy(pipelines.scanGroups);
+        device.destroy(pipelines.scatter);
+        device.destroy(pipelines.update);
+        device.destroy(pipelineLayout);
+        device.destroy(descriptorSetLayout);
+        Parent::destroy();
+    }
+
+    // Largest power of two not above `value`
+    static uint32_t floorPowerOfTwo(uint32_t value) {
+        uint32_t result = 1;
+        while (result <= value / 2) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    void chooseGroupSize() {
+        const auto& limits = context.deviceProperties.limits;
+        // The scans keep a uint per invocation in shared memory
+        const uint32_t maxSize = std::min({ limits.maxComputeWorkGroupSize[0], limits.maxComputeWorkGroupInvocations,
+                                            (uint32_t)(limits.maxComputeSharedMemorySize / sizeof(uint32_t)) });
+        groupSize = floorPowerOfTwo(std::min(groupSize ? groupSize : 256u, maxSize));
+    }
+
+    uint32_t groupCount(uint32_t invocations) const { return (invocations + groupSize - 1) / groupSize; }
+
+    // Random positions all over the box, heading in random directions
+    void prepareStorageBuffers() {
+        // At least three cells across, so that the 27 cells around any cell are distinct
+        gridDim = std::max(3u, (uint32_t)std::ceil(std::cbrt((float)boidCount / DENSITY)));
+        ubo.boidCount = boidCount;
+        ubo.gridDim = gridDim;
+
+        std::vector<Boid> initialBoids(boidCount);
+        std::mt19937 rndGen(static_cast<uint32_t>(time(0)));
+        std::uniform_real_distribution<float> position(0.0f, worldSize());
+        std::normal_distribution<float> direction(0.0f, 1.0f);
+        for (auto& boid : initialBoids) {
+            const glm::vec3 heading{ direction(rndGen), direction(rndGen), direction(rndGen) };
+            boid.pos = glm::vec4(position(rndGen), position(rndGen), position(rndGen), 0.0f);
+            boid.vel = glm::vec4(glm::normalize(heading + glm::vec3(FLT_EPSILON)) * ubo.minSpeed, 0.0f);
+        }
+        boids = createSlotBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer, initialBoids);
+
+        sortedBoids = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, sizeof(Boid) * boidCount);
+        cellCounts = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                                sizeof(uint32_t) * cellCount());
+        cellStarts = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, sizeof(uint32_t) * cellCount());
+        boidCells = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, sizeof(glm::uvec2) * boidCount);
+        blockSums = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, sizeof(uint32_t) * groupCount(cellCount()));
+    }
+
+    void prepareDescriptors() {
+        std::vector<vk::DescriptorPoolSize> poolSizes = {
+            { vk::DescriptorType::eUniformBuffer, SLOT_COUNT },
+            { vk::DescriptorType::eStorageBuffer, 7 * SLOT_COUNT },
+        };
+        descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, SLOT_COUNT, (uint32_t)poolSizes.size(), poolSizes.data() });
+
+        if (!descriptorSetLayout) {
+            std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+                { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            };
+            // Boids read and written, sorted boids, cell counts, cell starts, boid cells and block sums
+            for (uint32_t binding = 1; binding <= 7; ++binding) {
+                setLayoutBindings.push_back({ binding, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute });
+            }
+            descriptorSetLayout =
+                device.createDescriptorSetLayout(vk::DescriptorSetLayoutCreateInfo{ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+        }
+        const std::array<vk::DescriptorSetLayout, SLOT_COUNT> layouts{ descriptorSetLayout, descriptorSetLayout };
+        auto sets = device.allocateDescriptorSets({ descriptorPool, (uint32_t)layouts.size(), layouts.data() });
+
+        const vk::DescriptorBufferInfo slots[SLOT_COUNT]{ boids.descriptor(0), boids.descriptor(1) };
+        const vk::DescriptorBufferInfo sortedInfo{ sortedBoids.buffer, 0, VK_WHOLE_SIZE };
+        const vk::DescriptorBufferInfo countsInfo{ cellCounts.buffer, 0, VK_WHOLE_SIZE };
+        const vk::DescriptorBufferInfo startsInfo{ cellStarts.buffer, 0, VK_WHOLE_SIZE };
+        const vk::DescriptorBufferInfo cellsInfo{ boidCells.buffer, 0, VK_WHOLE_SIZE };
+        const vk::DescriptorBufferInfo sumsInfo{ blockSums.buffer, 0, VK_WHOLE_SIZE };
+        std::vector<vk::WriteDescriptorSet> writeDescriptorSets;
+        // Set i writes slot i and reads the other one
+        for (uint32_t i = 0; i < SLOT_COUNT; ++i) {
+            descriptorSets[i] = sets[i];
+            writeDescriptorSets.insert(writeDescriptorSets.end(),
+                                       {
+                                           { sets[i], 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffer.descriptor },
+                                           { sets[i], 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &slots[1 - i] },
+                                           { sets[i], 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &slots[i] },
+                                           { sets[i], 3, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &sortedInfo },
+                                           { sets[i], 4, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &countsInfo },
+                                           { sets[i], 5, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &startsInfo },
+                                           { sets[i], 6, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &cellsInfo },
+                                           { sets[i], 7, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &sumsInfo },
+                                       });
+        }
+        device.updateDescriptorSets(writeDescriptorSets, nullptr);
+    }
+
+    vk::Pipeline createPipeline(const std::string& name, const vk::SpecializationInfo& specializationInfo) {
+        vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+        computePipelineCreateInfo.layout = pipelineLayout;
+        computePipelineCreateInfo.stage =
+            vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/flocking/" + name, vk::ShaderStageFlagBits::eCompute);
+        computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+        vk::Pipeline pipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+        return pipeline;
+    }
+
+    void preparePipelines() {
+        pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+        // The workgroup size, which is also the block size of the scans
+        const vk::SpecializationMapEntry groupSizeEntry{ 0, 0, sizeof(uint32_t) };
+        const vk::SpecializationInfo specializationInfo{ 1, &groupSizeEntry, sizeof(groupSize), &groupSize };
+        pipelines.count = createPipeline("count.comp.spv", specializationInfo);
+        pipelines.scan = createPipeline("scan.comp.spv", specializationInfo);
+        pipelines.scanGroups = createPipeline("scan_groups.comp.spv", specializationInfo);
+        pipelines.scatter = createPipeline("scatter.comp.spv", specializationInfo);
+        pipelines.update = createPipeline("flocking.comp.spv", specializationInfo);
+    }
+
+    // Written by one dispatch, read or written by the next
+    static void computeBarrier(const vk::CommandBuffer& commandBuffer, vk::PipelineStageFlags srcStage = vk::PipelineStageFlagBits::eComputeShader) {
+        vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite,
+                                   vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+        commandBuffer.pipelineBarrier(srcStage, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+    }
+
+    void dispatch(const vk::CommandBuffer& commandBuffer, const vk::Pipeline& pipeline, uint32_t invocations) {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        commandBuffer.dispatch(groupCount(invocations), 1, 1);
+    }
+
+    // Must not be called while the command buffers are pending
+    void buildComputeCommandBuffers() {
+        for (uint32_t i = 0; i < SLOT_COUNT; ++i) {
+            const auto& commandBuffer = commandBuffers[i];
+            beginCommandBuffer(commandBuffer, i);
+            vks::debug::marker::beginRegion(commandBuffer, "Flocking", glm::vec4(0.2f, 0.6f, 1.0f, 1.0f));
+            // The previous submission wrote the slot read here, and its update may still be reading the grid
+            vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite,
+                                       vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite };
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                          vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer, {}, barrier, nullptr, nullptr);
+            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSets[i], nullptr);
+
+            profiler.beginScope(commandBuffer, "Grid");
+            commandBuffer.fillBuffer(cellCounts.buffer, 0, VK_WHOLE_SIZE, 0);
+            computeBarrier(commandBuffer, vk::PipelineStageFlagBits::eTransfer);
+            dispatch(commandBuffer, pipelines.count, boidCount);
+            computeBarrier(commandBuffer);
+            dispatch(commandBuffer, pipelines.scan, cellCount());
+            computeBarrier(commandBuffer);
+            commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.scanGroups);
+            commandBuffer.dispatch(1, 1, 1);
+            computeBarrier(commandBuffer);
+            dispatch(commandBuffer, pipelines.scatter, boidCount);
+            computeBarrier(commandBuffer);
+            profiler.endScope(commandBuffer);
+
+            profiler.beginScope(commandBuffer, "Update");
+            dispatch(commandBuffer, pipelines.update, boidCount);
+            profiler.endScope(commandBuffer);
+
+            vks::debug::marker::endRegion(commandBuffer);
+            endCommandBuffer(commandBuffer);
+        }
+    }
+
+    // Starts over with `count` boids.  Waits for both queues, so nothing reads the old buffers any more.
+    void setBoidCount(uint32_t count) {
+        queue.waitIdle();
+        context.queue.waitIdle();
+        destroyStorage();
+        boidCount = std::max(1u, count);
+        prepareStorageBuffers();
+        prepareDescriptors();
+        buildComputeCommandBuffers();
+    }
+
+    void submit() {
+        memcpy(uniformBuffer.mapped, &ubo, sizeof(ubo));
+        // Reading the slot written by the previous submission
+        Parent::submit(commandBuffers[writeSlot()]);
+    }
+};
+
+class VulkanExample : public vkx::ExampleBase {
+    using Parent = vkx::ExampleBase;
+
+public:
+    struct {
+        vks::Buffer uniformBuffer;
+        vk::DescriptorSetLayout descriptorSetLayout;
+        vk::DescriptorSet descriptorSet;
+        vk::PipelineLayout pipelineLayout;
+        vk::Pipeline pipeline;
+        struct {
+            glm::mat4 projection;
+            glm::mat4 view;
+            float worldSize;
+        } ubo;
+    } graphics;
+
+    ComputeFlocking compute{ context };
+    // Draws of the boid slot the last compute pass wrote, per swap chain image
+    vkx::SlotDraws<vk::DrawIndirectCommand> slotDraws;
+    uint64_t passCollections{ 0 };
+
+    VulkanExample() {
+        title = "Compute shader flocking";
+        settings.overlay = true;
+        camera.type = Camera::CameraType::lookat;
+        camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 512.0f);
+        camera.setRotation(glm::vec3(-20.0f, 45.0f, 0.0f));
+        camera.setTranslation(glm::vec3(0.0f, 0.0f, -18.0f));
+        // Synchronize with the compute queue through queue timelines where the device supports them, which the
+        // compute timings also need
+        context.enableTimelineSemaphores = true;
+
+        // --boids <count> and --group-size <size> select what to benchmark
+        const auto& args = vkx::getCommandLine();
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (args[i] == "--boids" && i + 1 < args.size()) {
+                compute.boidCount = std::max(1u, (uint32_t)std::stoul(args[++i]));
+            } else if (args[i] == "--group-size" && i + 1 < args.size()) {
+                compute.groupSize = (uint32_t)std::stoul(args[++i]);
+            }
+        }
+    }
+
+    ~VulkanExample() {
+        compute.destroy();
+        slotDraws.destroy();
+
+        graphics.uniformBuffer.destroy();
+        device.destroyPipeline(graphics.pipeline);
+        device.destroyPipelineLayout(graphics.pipelineLayout);
+        device.destroyDescriptorSetLayout(graphics.descriptorSetLayout);
+    }
+
+    void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        cmdBuffer.setViewport(0, viewport());
+        cmdBuffer.setScissor(0, scissor());
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, graphics.pipeline);
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, graphics.pipelineLayout, 0, graphics.descriptorSet, nullptr);
+        cmdBuffer.bindVertexBuffers(0, compute.boids.buffer.buffer, { 0 });
+        // The first vertex is in the slot the last compute pass wrote
+        cmdBuffer.drawIndirect(slotDraws.buffer.buffer, slotDraws.offset(commandBufferImage(cmdBuffer)), 1, sizeof(vk::DrawIndirectCommand));
+    }
+
+    void setupDescriptorPool() {
+        std::vector<vk::DescriptorPoolSize> poolSizes = {
+            { vk::DescriptorType::eUniformBuffer, 1 },
+        };
+        descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 1, (uint32_t)poolSizes.size(), poolSizes.data() });
+    }
+
+    void setupDescriptorSetLayout() {
+        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+            { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+        };
+        graphics.descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+        graphics.pipelineLayout = device.createPipelineLayout({ {}, 1, &graphics.descriptorSetLayout });
+    }
+
+    void setupDescriptorSet() {
+        graphics.descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &graphics.descriptorSetLayout })[0];
+        std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
+            { graphics.descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &graphics.uniformBuffer.descriptor },
+        };
+        device.updateDescriptorSets(writeDescriptorSets, nullptr);
+    }
+
+    void preparePipelines() {
+        vks::pipelines::GraphicsPipelineBuilder pipelineBuilder{ device, graphics.pipelineLayout, renderPass };
+        pipelineBuilder.inputAssemblyState.topology = vk::PrimitiveTopology::ePointList;
+        pipelineBuilder.rasterizationState.cullMode = vk::CullModeFlagBits::eNone;
+        pipelineBuilder.vertexInputState.bindingDescriptions = {
+            { 0, sizeof(ComputeFlocking::Boid), vk::VertexInputRate::eVertex },
+        };
+        pipelineBuilder.vertexInputState.attributeDescriptions = {
+            // Location 0 : Position
+            { 0, 0, vF::eR32G32B32A32Sfloat, offsetof(ComputeFlocking::Boid, pos) },
+            // Location 1 : Velocity, for the color
+            { 1, 0, vF::eR32G32B32A32Sfloat, offsetof(ComputeFlocking::Boid, vel) },
+        };
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/flocking/flocking.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/flocking/flocking.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        graphics.pipeline = pipelineBuilder.create(context.pipelineCache);
+    }
+
+    void prepareUniformBuffers() {
+        graphics.uniformBuffer = context.createUniformBuffer(graphics.ubo);
+        updateGraphicsUniformBuffers();
+    }
+
+    void updateGraphicsUniformBuffers() {
+        graphics.ubo.projection = camera.matrices.perspective;
+        graphics.ubo.view = camera.matrices.view;
+        graphics.ubo.worldSize = compute.worldSize();
+        memcpy(graphics.uniformBuffer.mapped, &graphics.ubo, sizeof(graphics.ubo));
+    }
+
+    void draw() override {
+        prepareFrame();
+        // The image's previous frame is done with its draw command, point it at the latest boids
+        slotDraws.select(currentBuffer, compute.readSlot());
+        drawCurrentCommandBuffer();
+        submitFrame();
+
+        static std::once_flag once;
+        if (!context.timelineSemaphoresEnabled) {
+            std::call_once(once, [&] { addRenderWaitSemaphore(compute.semaphores.complete, vk::PipelineStageFlagBits::eVertexInput); });
+        }
+        // Simulate the next frame while this one is drawn
+        compute.ubo.deltaT = paused ? 0.0f : std::min(frameTimer, 0.05f);
+        compute.submit();
+        compute.reportTimings(profiler);
+        // The passes too, so that benchmark reports have them
+        if (compute.profiler.getCollectionCount() != passCollections) {
+            passCollections = compute.profiler.getCollectionCount();
+            for (const auto& scope : compute.profiler.getScopes()) {
+                if (scope.depth > 0) {
+                    profiler.report(scope.name, scope.lastMilliseconds);
+                }
+            }
+        }
+    }
+
+    void prepareSlotDraws() {
+        slotDraws.create(context, swapChain.imageCount, { compute.boidCount, 1, 0, 0 }, compute.boidCount);
+    }
+
+    void prepare() override {
+        ExampleBase::prepare();
+        compute.overlap = true;
+        compute.prepare();
+        prepareSlotDraws();
+        if (context.timelineSemaphoresEnabled) {
+            // The draw reads the boids the compute pass wrote
+            addRenderWaitQueue(compute.queue, vk::PipelineStageFlagBits::eVertexInput);
+        } else {
+            renderSignalSemaphores.push_back(compute.semaphores.ready);
+        }
+
+        prepareUniformBuffers();
+        setupDescriptorSetLayout();
+        preparePipelines();
+        setupDescriptorPool();
+        setupDescriptorSet();
+        buildCommandBuffers();
+        prepared = true;
+    }
+
+    void setBoidCount(uint32_t count) {
+        compute.setBoidCount(count);
+        slotDraws.destroy();
+        prepareSlotDraws();
+        updateGraphicsUniformBuffers();
+        // The draws bind the new buffer
+        buildCommandBuffers();
+    }
+
+    bool applyBenchmarkSweep(uint32_t value) override {
+        setBoidCount(value);
+        return true;
+    }
+
+    void viewChanged() override { updateGraphicsUniformBuffers(); }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            std::vector<std::string> counts;
+            int32_t selected = -1;
+            for (size_t i = 0; i < BOID_COUNTS.size(); ++i) {
+                counts.push_back(std::to_string(BOID_COUNTS[i]));
+                if (BOID_COUNTS[i] == compute.boidCount) {
+                    selected = (int32_t)i;
+                }
+            }
+            if (ui.comboBox("Boids", &selected, counts)) {
+                setBoidCount(BOID_COUNTS[selected]);
+            }
+            ui.sliderFloat("Separation", &compute.ubo.separation, 0.0f, 2.0f);
+            ui.sliderFloat("Alignment", &compute.ubo.alignment, 0.0f, 4.0f);
+            ui.sliderFloat("Cohesion", &compute.ubo.cohesion, 0.0f, 4.0f);
+        }
+        if (ui.header("Statistics")) {
+            ui.text("Boids: %u", compute.boidCount);
+            ui.text("Grid: %u^3 cells", compute.gridDim);
+            ui.text("Workgroup size: %u", compute.groupSize);
+            double total = 0.0;
+            for (const auto& scope : compute.profiler.getScopes()) {
+                if (scope.depth > 0) {
+                    ui.text("%s: %.3f ms", scope.name.c_str(), scope.milliseconds);
+                    total += scope.milliseconds;
+                }
+            }
+            if (total > 0.0) {
+                ui.text("Per boid: %.2f ns", total * 1.0e6 / compute.boidCount);
+            }
+        }
+    }
+};
+
+VULKAN_EXAMPLE_MAIN()
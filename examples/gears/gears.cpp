@@ -1,6 +1,9 @@
 /*
 * Vulkan Example - Animated gears using multiple uniform buffers
 *
+* Doubles as a draw call overhead test: the gears can also be drawn from one merged mesh, with one draw per gear
+* that only changes a push constant or with a single multi draw indirect, and copied on a grid to scale the count
+*
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
@@ -15,9 +18,25 @@ class VulkanExample : public vkx::ExampleBase {
 public:
     struct {
         vk::Pipeline solid;
+        vk::Pipeline batch;
     } pipelines;
 
+    enum DrawMode
+    {
+        // Binds and draws every gear's own buffers and descriptor set
+        DRAW_SEPARATE = 0,
+        // One set of binds for all gears, then a draw per gear with the gear in a push constant
+        DRAW_MERGED = 1,
+        // One set of binds and a single multi draw indirect
+        DRAW_MULTI_INDIRECT = 2,
+    };
+    int32_t drawMode{ DRAW_SEPARATE };
+    // The three gears are copied gridSize x gridSize times
+    int32_t gridSize{ 1 };
+
+    std::vector<GearDefinition> definitions;
     std::vector<VulkanGear> gears;
+    GearBatch batch;
     vks::model::VertexLayout vertexLayout{ {
         vks::model::VERTEX_COMPONENT_POSITION,
         vks::model::VERTEX_COMPONENT_NORMAL,
@@ -26,30 +45,54 @@ public:
 
     vk::PipelineLayout pipelineLayout;
     vk::DescriptorSetLayout descriptorSetLayout;
+    vk::PipelineLayout batchPipelineLayout;
+    vk::DescriptorSetLayout batchDescriptorSetLayout;
 
     VulkanExample() {
         timerSpeed *= 0.25f;
         camera.translate(glm::vec3(0.0f, 0.0f, -12.0f * zoomSpeed));
         title = "Vulkan Example - Gears";
+        // The cost of recording the draws is what the draw modes are compared by
+        recordPerFrame = true;
+    }
+
+    void getEnabledFeatures() override {
+        if (deviceFeatures.multiDrawIndirect && deviceFeatures.drawIndirectFirstInstance) {
+            enabledFeatures.multiDrawIndirect = VK_TRUE;
+            enabledFeatures.drawIndirectFirstInstance = VK_TRUE;
+        }
     }
 
+    bool multiDrawIndirectSupported() const { return context.enabledFeatures.multiDrawIndirect && context.enabledFeatures.drawIndirectFirstInstance; }
+
     ~VulkanExample() {
         // Clean up used Vulkan resources
         // Note : Inherited destructor cleans up resources stored in base class
         device.destroyPipeline(pipelines.solid);
+        device.destroyPipeline(pipelines.batch);
         device.destroyPipelineLayout(pipelineLayout);
         device.destroyDescriptorSetLayout(descriptorSetLayout);
+        device.destroyPipelineLayout(batchPipelineLayout);
+        device.destroyDescriptorSetLayout(batchDescriptorSetLayout);
 
         gears.clear();
+        batch.destroy();
     }
 
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
         cmdBuffer.setViewport(0, vks::util::viewport(size));
         cmdBuffer.setScissor(0, vks::util::rect2D(size));
-        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.solid);
-        for (auto& gear : gears) {
-            gear.draw(cmdBuffer, pipelineLayout);
+        vks::debug::marker::beginRegion(cmdBuffer, "Gears", glm::vec4(0.8f, 0.4f, 0.1f, 1.0f));
+        if (drawMode == DRAW_SEPARATE) {
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.solid);
+            for (auto& gear : gears) {
+                gear.draw(cmdBuffer, pipelineLayout);
+            }
+        } else {
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.batch);
+            batch.draw(cmdBuffer, batchPipelineLayout, drawMode == DRAW_MULTI_INDIRECT);
         }
+        vks::debug::marker::endRegion(cmdBuffer);
     }
 
     void prepareVertices() {
@@ -64,19 +107,34 @@ public:
         std::vector<float> rotationSpeeds = { 1.0f, -2.0f, -2.0f };
         std::vector<float> rotationStarts = { 0.0f, -9.0f, -30.0f };
 
-        gears.resize(positions.size());
-        for (int32_t i = 0; i < gears.size(); ++i) {
-            gears[i].generate(context, innerRadiuses[i], outerRadiuses[i], widths[i], toothCount[i], toothDepth[i], colors[i], positions[i], rotationSpeeds[i],
-                              rotationStarts[i]);
+        // Copies of the three gears on a grid centered on the original ones
+        const glm::vec2 spacing{ 16.0f, 16.0f };
+        definitions.clear();
+        for (int32_t y = 0; y < gridSize; ++y) {
+            for (int32_t x = 0; x < gridSize; ++x) {
+                const glm::vec3 offset{ ((float)x - (float)(gridSize - 1) * 0.5f) * spacing.x, ((float)y - (float)(gridSize - 1) * 0.5f) * spacing.y, 0.0f };
+                for (size_t i = 0; i < positions.size(); ++i) {
+                    definitions.push_back({ innerRadiuses[i], outerRadiuses[i], widths[i], toothCount[i], toothDepth[i], colors[i], positions[i] + offset,
+                                            rotationSpeeds[i], rotationStarts[i] });
+                }
+            }
         }
+
+        gears.resize(definitions.size());
+        for (size_t i = 0; i < gears.size(); ++i) {
+            gears[i].generate(context, definitions[i]);
+        }
+        batch.create(context, definitions);
     }
 
     void setupDescriptorPool() {
-        // One UBO for each gears
+        // One UBO for each gear, and the UBO and matrices of the batch
+        const uint32_t gearCount = (uint32_t)gears.size();
         std::vector<vk::DescriptorPoolSize> poolSizes{
-            vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, 3),
+            vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, gearCount + 1),
+            vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, 1),
         };
-        descriptorPool = device.createDescriptorPool({ {}, 3, (uint32_t)poolSizes.size(), poolSizes.data() });
+        descriptorPool = device.createDescriptorPool({ {}, gearCount + 1, (uint32_t)poolSizes.size(), poolSizes.data() });
     }
 
     void setupDescriptorSetLayout() {
@@ -85,12 +143,24 @@ public:
         };
         descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
         pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+
+        std::vector<vk::DescriptorSetLayoutBinding> batchBindings{
+            // Binding 0 : Vertex shader uniform buffer
+            { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+            // Binding 1 : Gear matrices
+            { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+        };
+        batchDescriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)batchBindings.size(), batchBindings.data() });
+        // Index of the gear drawn
+        vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eVertex, 0, sizeof(uint32_t) };
+        batchPipelineLayout = device.createPipelineLayout({ {}, 1, &batchDescriptorSetLayout, 1, &pushConstantRange });
     }
 
     void setupDescriptorSets() {
         for (auto& gear : gears) {
             gear.setupDescriptorSet(descriptorPool, descriptorSetLayout);
         }
+        batch.setupDescriptorSet(descriptorPool, batchDescriptorSetLayout);
     }
 
     void preparePipelines() {
@@ -105,17 +175,45 @@ public:
         pipelineBuilder.loadShader(getAssetPath() + "shaders/gears/gears.frag.spv", vk::ShaderStageFlagBits::eFragment);
         pipelineBuilder.vertexInputState.appendVertexLayout(vertexLayout);
         pipelines.solid = pipelineBuilder.create(context.pipelineCache);
+
+        // Merged gears, same fragment shader
+        pipelineBuilder.destroyShaderModules();
+        pipelineBuilder.layout = batchPipelineLayout;
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/gears/gearsbatch.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/gears/gears.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipelines.batch = pipelineBuilder.create(context.pipelineCache);
+    }
+
+    // Regenerate the gears for a new grid size.  Recording every frame, nothing but the draws refers to them
+    void rebuildGears() {
+        device.waitIdle();
+        gears.clear();
+        batch.destroy();
+        device.destroyDescriptorPool(descriptorPool);
+        prepareVertices();
+        setupDescriptorPool();
+        setupDescriptorSets();
+        updateUniformBuffers();
     }
 
     void updateUniformBuffers() {
         glm::mat4 perspective = glm::perspective(glm::radians(60.0f), (float)size.width / (float)size.height, 0.001f, 256.0f);
-        for (auto& gear : gears) {
-            gear.updateUniformBuffer(perspective, camera.matrices.view, timer * 360.0f);
+        // Only the buffers of the current draw mode are read
+        if (drawMode == DRAW_SEPARATE) {
+            for (auto& gear : gears) {
+                gear.updateUniformBuffer(perspective, camera.matrices.view, timer * 360.0f);
+            }
+        } else {
+            batch.updateUniformBuffer(perspective, camera.matrices.view, timer * 360.0f);
         }
     }
 
     void prepare() override {
         Parent::prepare();
+        // Enough gears for the draw modes to differ measurably, see applyBenchmarkSweep
+        if (benchmark.active) {
+            gridSize = 16;
+        }
         prepareVertices();
         setupDescriptorSetLayout();
         preparePipelines();
@@ -134,6 +232,40 @@ public:
     }
 
     void viewChanged() override { updateUniformBuffers(); }
+
+    // Sweep values are draw modes (0 separate, 1 merged, 2 multi draw indirect), to compare them for the same gears
+    bool applyBenchmarkSweep(uint32_t value) override {
+        if (value > DRAW_MULTI_INDIRECT || (value == DRAW_MULTI_INDIRECT && !multiDrawIndirectSupported())) {
+            return false;
+        }
+        drawMode = (int32_t)value;
+        updateUniformBuffers();
+        return true;
+    }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            std::vector<std::string> modes{ "Separate buffers", "Merged, push constants" };
+            if (multiDrawIndirectSupported()) {
+                modes.push_back("Merged, multi draw indirect");
+            }
+            if (ui.comboBox("Draw mode", &drawMode, modes)) {
+                updateUniformBuffers();
+            }
+            if (ui.sliderInt("Grid size", &gridSize, 1, 32)) {
+                rebuildGears();
+            }
+        }
+        if (ui.header("Statistics")) {
+            const uint32_t gearCount = (uint32_t)gears.size();
+            ui.text("Gears: %u", gearCount);
+            const bool separate = drawMode == DRAW_SEPARATE;
+            const bool indirect = drawMode == DRAW_MULTI_INDIRECT;
+            ui.text("Draw calls: %u", indirect ? 1 : gearCount);
+            ui.text("Descriptor set binds: %u", separate ? gearCount : 1);
+            ui.text("Vertex and index buffer binds: %u", separate ? gearCount : 1);
+        }
+    }
 };
 
 RUN_EXAMPLE(VulkanExample)
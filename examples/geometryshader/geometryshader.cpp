@@ -1,5 +1,8 @@
 /*
-* Vulkan Example - Geometry shader (vertex normal debugging)
+* Vulkan Example - Vertex normal debugging
+*
+* The normals used to be expanded into lines by a geometry shader over every triangle, each frame.  A compute pass
+* now writes a line list once, when the mesh or the line length changes, which is drawn by a plain line pipeline.
 *
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
@@ -7,6 +10,7 @@
 */
 
 #include <vulkanExampleBase.h>
+#include <vks/normallines.hpp>
 
 // Vertex layout for this example
 vks::model::VertexLayout vertexLayout{ {
@@ -26,16 +30,12 @@ public:
         glm::mat4 model;
     } uboVS;
 
-    struct {
-        glm::mat4 projection;
-        glm::mat4 model;
-    } uboGS;
-
     struct {
         vks::Buffer VS;
-        vks::Buffer GS;
     } uniformData;
 
+    vks::model::NormalLines normalLines;
+
     struct {
         vk::Pipeline solid;
         vk::Pipeline normals;
@@ -45,11 +45,12 @@ public:
     vk::DescriptorSet descriptorSet;
     vk::DescriptorSetLayout descriptorSetLayout;
     bool displayNormals = true;
+    float normalLength = 0.02f;
 
     VulkanExample() {
         camera.setRotation({ 0.0f, -25.0f, 0.0f });
         camera.translate({ 0.0f, 0.0f, -9.0f });
-        title = "Vulkan Example - Geometry shader";
+        title = "Vulkan Example - Normal debugging";
     }
 
     ~VulkanExample() {
@@ -61,10 +62,10 @@ public:
         device.destroyPipelineLayout(pipelineLayout);
         device.destroyDescriptorSetLayout(descriptorSetLayout);
 
+        normalLines.destroy();
         meshes.object.destroy();
 
         uniformData.VS.destroy();
-        uniformData.GS.destroy();
     }
 
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
@@ -73,34 +74,53 @@ public:
         cmdBuffer.setLineWidth(1.0f);
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
         cmdBuffer.bindVertexBuffers(0, meshes.object.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.object.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.object.indices.buffer, 0, meshes.object.indexType);
         // Solid shading
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.solid);
         cmdBuffer.drawIndexed(meshes.object.indexCount, 1, 0, 0, 0);
         // Normal debugging
         if (displayNormals) {
             cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.normals);
-            cmdBuffer.drawIndexed(meshes.object.indexCount, 1, 0, 0, 0);
+            cmdBuffer.bindVertexBuffers(0, normalLines.lines.buffer, { 0 });
+            cmdBuffer.draw(normalLines.lineVertexCount(), 1, 0, 0);
         }
     }
 
-    void loadAssets() override { meshes.object.loadFromFile(context, getAssetPath() + "models/suzanne.obj", vertexLayout, 0.25f); }
+    void loadAssets() override {
+        // The normal lines are generated from the vertices as a storage buffer
+        vks::model::ModelCreateInfo modelCreateInfo{ 0.25f, 1.0f, 0.0f };
+        modelCreateInfo.vertexUsage = vk::BufferUsageFlagBits::eStorageBuffer;
+        meshes.object.loadFromFile(context, getAssetPath() + "models/suzanne.obj", vertexLayout, modelCreateInfo);
+    }
+
+    void prepareNormalLines() {
+        vks::model::NormalLines::SourceLayout layout;
+        layout.stride = vertexLayout.stride();
+        layout.position = vertexLayout.offset(0);
+        layout.normal = vertexLayout.offset(1);
+        normalLines.create(context, getAssetPath() + "shaders/base/normallines.comp.spv", meshes.object.vertices.buffer, meshes.object.vertexCount,
+                           layout);
+        generateNormalLines();
+    }
+
+    // Only needed when the mesh or the line length changes
+    void generateNormalLines() {
+        context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) { normalLines.record(commandBuffer, normalLength); });
+    }
 
     void setupDescriptorPool() {
-        // Example uses two ubos
+        // Example uses one ubo
         std::vector<vk::DescriptorPoolSize> poolSizes{
-            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 2 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 1 },
         };
 
-        descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
+        descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 1, (uint32_t)poolSizes.size(), poolSizes.data() });
     }
 
     void setupDescriptorSetLayout() {
         std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
             // Binding 0 : Vertex shader ubo
             vk::DescriptorSetLayoutBinding{ 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
-            // Binding 1 : Geometry shader ubo
-            vk::DescriptorSetLayoutBinding{ 1, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eGeometry },
         };
 
         descriptorSetLayout =
@@ -115,8 +135,6 @@ public:
         std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
             // Binding 0 : Vertex shader shader ubo
             vk::WriteDescriptorSet{ descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.VS.descriptor },
-            // Binding 1 : Geometry shader ubo
-            vk::WriteDescriptorSet{ descriptorSet, 1, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.GS.descriptor },
         };
 
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
@@ -127,26 +145,29 @@ public:
         pipelineBuilder.rasterizationState.frontFace = vk::FrontFace::eClockwise;
         pipelineBuilder.dynamicState.dynamicStateEnables = { vk::DynamicState::eViewport, vk::DynamicState::eScissor, vk::DynamicState::eLineWidth };
 
-        // Normal debugging pipeline
-        pipelineBuilder.loadShader(getAssetPath() + "shaders/geometryshader/base.vert.spv", vk::ShaderStageFlagBits::eVertex);
-        pipelineBuilder.loadShader(getAssetPath() + "shaders/geometryshader/base.frag.spv", vk::ShaderStageFlagBits::eFragment);
-        pipelineBuilder.loadShader(getAssetPath() + "shaders/geometryshader/normaldebug.geom.spv", vk::ShaderStageFlagBits::eGeometry);
-        pipelineBuilder.vertexInputState.appendVertexLayout(vertexLayout);
-        pipelines.normals = pipelineBuilder.create(context.pipelineCache);
-        pipelineBuilder.destroyShaderModules();
-
         // Solid rendering pipeline
         pipelineBuilder.loadShader(getAssetPath() + "shaders/geometryshader/mesh.vert.spv", vk::ShaderStageFlagBits::eVertex);
         pipelineBuilder.loadShader(getAssetPath() + "shaders/geometryshader/mesh.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipelineBuilder.vertexInputState.appendVertexLayout(vertexLayout);
         pipelines.solid = pipelineBuilder.create(context.pipelineCache);
+        pipelineBuilder.destroyShaderModules();
+
+        // Normal debugging pipeline, a line list of the generated positions
+        auto& vertexInputState = pipelineBuilder.vertexInputState;
+        vertexInputState.bindingDescriptions.clear();
+        vertexInputState.attributeDescriptions.clear();
+        vertexInputState.bindingDescriptions.emplace_back(0, vks::model::NormalLines::OUTPUT_STRIDE, vk::VertexInputRate::eVertex);
+        vertexInputState.attributeDescriptions.emplace_back(0, 0, vk::Format::eR32G32B32Sfloat, 0);
+        pipelineBuilder.inputAssemblyState.topology = vk::PrimitiveTopology::eLineList;
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/geometryshader/base.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/geometryshader/base.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipelines.normals = pipelineBuilder.create(context.pipelineCache);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
     void prepareUniformBuffers() {
         // Vertex shader uniform buffer block
         uniformData.VS = context.createUniformBuffer(uboVS);
-        // Geometry shader uniform buffer block
-        uniformData.GS = context.createUniformBuffer(uboGS);
         updateUniformBuffers();
     }
 
@@ -155,15 +176,11 @@ public:
         uboVS.projection = getProjection();
         uboVS.model = camera.matrices.view;
         uniformData.VS.copy(uboVS);
-
-        // Geometry shader
-        uboGS.model = uboVS.model;
-        uboGS.projection = uboVS.projection;
-        uniformData.GS.copy(uboGS);
     }
 
     void prepare() override {
         ExampleBase::prepare();
+        prepareNormalLines();
         prepareUniformBuffers();
         setupDescriptorSetLayout();
         preparePipelines();
@@ -186,6 +203,10 @@ public:
             if (ui.checkBox("Display normals", &displayNormals)) {
                 buildCommandBuffers();
             }
+            if (displayNormals && ui.sliderFloat("Normal length", &normalLength, 0.005f, 0.1f)) {
+                // The command buffers draw the same buffer, only its contents change
+                generateNormalLines();
+            }
         }
     }
 };
@@ -16,13 +16,24 @@ struct ShareHandles {
 };
 
 static const uint32_t SHARED_TEXTURE_DIMENSION = 512;
+// The shared images form a ring, so that GL can draw into one while Vulkan samples another.  Each has its own pair
+// of semaphores, a binary semaphore only ever has one signal pending.
+static const uint32_t SHARED_IMAGE_COUNT = 3;
 
 class TextureGenerator {
 public:
     static const std::string VERTEX_SHADER;
     static const std::string FRAGMENT_SHADER;
 
-    void init(ShareHandles& handles, uint64_t memorySize) {
+    // GPU time GL spent waiting between the end of one frame's draw and the start of the next one, and drawing, of the
+    // most recent frame whose queries were available.  In milliseconds, negative when there are no new results.
+    struct Timings {
+        double idle{ -1.0 };
+        double busy{ -1.0 };
+    } timings;
+
+    // `handles` has one entry per shared image, all of which take `memorySize` bytes
+    void init(const std::vector<ShareHandles>& handles, uint64_t memorySize) {
         glfw::Window::init();
         glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_API);
         glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -43,36 +54,40 @@ public:
 
         glDisable(GL_DEPTH_TEST);
 
-        // Create the texture for the FBO color attachment.
-        // This only reserves the ID, it doesn't allocate memory
-        glCreateTextures(GL_TEXTURE_2D, 1, &color);
-
-        // Import semaphores
-        glGenSemaphoresEXT(1, &glReady);
-        glGenSemaphoresEXT(1, &glComplete);
-
-        // Platform specific import.  On non-Win32 systems use glImportSemaphoreFdEXT instead
-        glImportSemaphoreWin32HandleEXT(glReady, GL_HANDLE_TYPE_OPAQUE_WIN32_EXT, handles.glReady);
-        glImportSemaphoreWin32HandleEXT(glComplete, GL_HANDLE_TYPE_OPAQUE_WIN32_EXT, handles.glComplete);
-
-        // Import memory
-        glCreateMemoryObjectsEXT(1, &mem);
-        // Platform specific import.  On non-Win32 systems use glImportMemoryFdEXT instead
-        glImportMemoryWin32HandleEXT(mem, memorySize, GL_HANDLE_TYPE_OPAQUE_WIN32_EXT, handles.memory);
-
-        // Use the imported memory as backing for the OpenGL texture.  The internalFormat, dimensions
-        // and mip count should match the ones used by Vulkan to create the image and determine it's memory
-        // allocation.
-        glTextureStorageMem2DEXT(color, 1, GL_RGBA8, SHARED_TEXTURE_DIMENSION, SHARED_TEXTURE_DIMENSION, mem, 0);
-
-        // The remaining initialization code is all standard OpenGL
-        glCreateFramebuffers(1, &fbo);
-        glNamedFramebufferTexture(fbo, GL_COLOR_ATTACHMENT0, color, 0);
+        targets.resize(handles.size());
+        for (size_t i = 0; i < handles.size(); ++i) {
+            auto& target = targets[i];
+            // Create the texture for the FBO color attachment.
+            // This only reserves the ID, it doesn't allocate memory
+            glCreateTextures(GL_TEXTURE_2D, 1, &target.color);
+
+            // Import semaphores
+            glGenSemaphoresEXT(1, &target.glReady);
+            glGenSemaphoresEXT(1, &target.glComplete);
+
+            // Platform specific import.  On non-Win32 systems use glImportSemaphoreFdEXT instead
+            glImportSemaphoreWin32HandleEXT(target.glReady, GL_HANDLE_TYPE_OPAQUE_WIN32_EXT, handles[i].glReady);
+            glImportSemaphoreWin32HandleEXT(target.glComplete, GL_HANDLE_TYPE_OPAQUE_WIN32_EXT, handles[i].glComplete);
+
+            // Import memory
+            glCreateMemoryObjectsEXT(1, &target.mem);
+            // Platform specific import.  On non-Win32 systems use glImportMemoryFdEXT instead
+            glImportMemoryWin32HandleEXT(target.mem, memorySize, GL_HANDLE_TYPE_OPAQUE_WIN32_EXT, handles[i].memory);
+
+            // Use the imported memory as backing for the OpenGL texture.  The internalFormat, dimensions
+            // and mip count should match the ones used by Vulkan to create the image and determine it's memory
+            // allocation.
+            glTextureStorageMem2DEXT(target.color, 1, GL_RGBA8, SHARED_TEXTURE_DIMENSION, SHARED_TEXTURE_DIMENSION, target.mem, 0);
+
+            // The remaining initialization code is all standard OpenGL
+            glCreateFramebuffers(1, &target.fbo);
+            glNamedFramebufferTexture(target.fbo, GL_COLOR_ATTACHMENT0, target.color, 0);
+            glGenQueries(2, target.queries);
+        }
         glGenVertexArrays(1, &vao);
         glBindVertexArray(vao);
         glUseProgram(program);
         glProgramUniform3f(program, 0, (float)SHARED_TEXTURE_DIMENSION, (float)SHARED_TEXTURE_DIMENSION, 0.0f);
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
         glViewport(0, 0, SHARED_TEXTURE_DIMENSION, SHARED_TEXTURE_DIMENSION);
     }
 
@@ -80,10 +95,15 @@ public:
         glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
         glBindVertexArray(0);
         glUseProgram(0);
-        glDeleteFramebuffers(1, &fbo);
-        glDeleteTextures(1, &color);
-        glDeleteSemaphoresEXT(1, &glReady);
-        glDeleteSemaphoresEXT(1, &glComplete);
+        for (auto& target : targets) {
+            glDeleteQueries(2, target.queries);
+            glDeleteFramebuffers(1, &target.fbo);
+            glDeleteTextures(1, &target.color);
+            glDeleteMemoryObjectsEXT(1, &target.mem);
+            glDeleteSemaphoresEXT(1, &target.glReady);
+            glDeleteSemaphoresEXT(1, &target.glComplete);
+        }
+        targets.clear();
         glDeleteVertexArrays(1, &vao);
         glDeleteProgram(program);
         glFlush();
@@ -91,21 +111,31 @@ public:
         window.destroyWindow();
     }
 
-    void render() {
+    // Draw into shared image `index` once Vulkan has signaled its glReady semaphore
+    void render(uint32_t index) {
+        auto& target = targets[index];
+        // The queries are reused, so whatever they measured the last time round is read back first
+        collectTimings(target);
+
         // The GL shader animates the image, so provide the time as input
         glProgramUniform1f(program, 1, (float)(glfwGetTime() - startTime));
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.fbo);
 
         // Wait (on the GPU side) for the Vulkan semaphore to be signaled
         GLenum srcLayout = GL_LAYOUT_COLOR_ATTACHMENT_EXT;
-        glWaitSemaphoreEXT(glReady, 0, nullptr, 1, &color, &srcLayout);
+        glWaitSemaphoreEXT(target.glReady, 0, nullptr, 1, &target.color, &srcLayout);
+        // Timestamp queries are written once all previous commands have completed, which includes the wait
+        glQueryCounter(target.queries[0], GL_TIMESTAMP);
 
         // Draw to the framebuffer
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glQueryCounter(target.queries[1], GL_TIMESTAMP);
+        target.queried = true;
 
         // Once drawing is complete, signal the Vulkan semaphore indicating
         // it can continue with it's render
         GLenum dstLayout = GL_LAYOUT_SHADER_READ_ONLY_EXT;
-        glSignalSemaphoreEXT(glComplete, 0, nullptr, 1, &color, &dstLayout);
+        glSignalSemaphoreEXT(target.glComplete, 0, nullptr, 1, &target.color, &dstLayout);
 
         // When using synchronization across multiple GL context, or in this case
         // across OpenGL and another API, it's critical that an operation on a
@@ -120,12 +150,44 @@ public:
     }
 
 private:
-    GLuint glReady{ 0 }, glComplete{ 0 };
-    GLuint color = 0;
-    GLuint fbo = 0;
+    struct Target {
+        GLuint glReady{ 0 }, glComplete{ 0 };
+        GLuint color = 0;
+        GLuint fbo = 0;
+        GLuint mem = 0;
+        // Timestamps after the wait for Vulkan and after the draw
+        GLuint queries[2]{ 0, 0 };
+        bool queried{ false };
+    };
+
+    // Targets are drawn into in order, so they are also collected in order and each frame's idle time is measured
+    // from the end of the previous frame's draw.  Never waits for results, a frame whose results aren't available yet
+    // is skipped.
+    void collectTimings(const Target& target) {
+        if (!target.queried) {
+            return;
+        }
+        GLuint64 available = 0;
+        glGetQueryObjectui64v(target.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            lastDrawEnd = 0;
+            return;
+        }
+        GLuint64 waitEnd = 0, drawEnd = 0;
+        glGetQueryObjectui64v(target.queries[0], GL_QUERY_RESULT, &waitEnd);
+        glGetQueryObjectui64v(target.queries[1], GL_QUERY_RESULT, &drawEnd);
+        if (lastDrawEnd) {
+            timings.idle = (double)(waitEnd > lastDrawEnd ? waitEnd - lastDrawEnd : 0) / 1.0e6;
+        }
+        timings.busy = (double)(drawEnd - waitEnd) / 1.0e6;
+        lastDrawEnd = drawEnd;
+    }
+
+    std::vector<Target> targets;
     GLuint vao = 0;
     GLuint program = 0;
-    GLuint mem = 0;
+    // In nanoseconds, 0 if the previous frame wasn't collected
+    GLuint64 lastDrawEnd{ 0 };
     double startTime;
     glfw::Window window;
 };
@@ -221,6 +283,7 @@ class OpenGLInteropExample : public vkx::ExampleBase {
     using Parent = ExampleBase;
 
 public:
+    // One shared image, along with the semaphores that hand it from Vulkan to GL and back
     struct SharedResources {
         vks::Image texture;
         struct {
@@ -301,7 +364,8 @@ public:
                 texture.view = context.device.createImageView(viewCreateInfo);
             }
 
-            // Setup the command buffers used to transition the image between GL and VK
+            // Setup the command buffers used to transition the image between GL and VK.  GL draws the whole image, so its
+            // previous contents can be discarded.
             transitionCmdBuf = context.createCommandBuffer();
             transitionCmdBuf.begin(vk::CommandBufferBeginInfo{});
             context.setImageLayout(transitionCmdBuf, texture.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined,
@@ -315,21 +379,36 @@ public:
             device.destroy(semaphores.glReady);
         }
 
-        void transitionToGl(const vk::Queue& queue, const vk::Semaphore& waitSemaphore) const {
+        // A semaphore signal waits for everything submitted before it, so this hands the image to GL once the frames
+        // that sampled it are done with it.  GL waits on the signal right after, so it isn't held back in the
+        // context's submit batch either, and whatever the batch holds goes first to keep it ahead of the signal
+        void transitionToGl(const vks::Context& context, const vk::Queue& queue) const {
+            context.flushSubmits();
             vk::SubmitInfo submitInfo;
-            vk::PipelineStageFlags stageFlags = vk::PipelineStageFlagBits::eBottomOfPipe;
-            submitInfo.pWaitDstStageMask = &stageFlags;
-            submitInfo.waitSemaphoreCount = 1;
-            submitInfo.pWaitSemaphores = &waitSemaphore;
             submitInfo.signalSemaphoreCount = 1;
             submitInfo.pSignalSemaphores = &semaphores.glReady;
             submitInfo.commandBufferCount = 1;
             submitInfo.pCommandBuffers = &transitionCmdBuf;
             queue.submit({ submitInfo }, {});
         }
-    } shared;
+    };
+    std::array<SharedResources, SHARED_IMAGE_COUNT> shared;
 
     TextureGenerator texGenerator;
+    // How many frames GL draws ahead of the one Vulkan samples.  With 0 they alternate within every frame: GL waits
+    // for Vulkan to hand over the image and Vulkan waits for GL to finish drawing it.  Must be less than
+    // SHARED_IMAGE_COUNT, GL can't draw into an image a frame still in flight samples.
+    int32_t framesAhead{ 1 };
+    // Frames handed to Vulkan so far, the current one samples shared image sharedFrame % SHARED_IMAGE_COUNT
+    uint64_t sharedFrame{ 0 };
+    // The next frame GL draws, ahead of sharedFrame by up to framesAhead
+    uint64_t nextGlFrame{ 0 };
+
+    // Start and end of the frame command buffer, per frame in flight, to measure how long the queue sits idle between
+    // frames.  The frame starts once the image GL has drawn is ready.
+    vk::QueryPool frameTimestamps;
+    // In timestamp ticks, 0 if the previous frame wasn't collected
+    uint64_t lastFrameEnd{ 0 };
 
     struct Geometry {
         uint32_t count{ 0 };
@@ -351,13 +430,16 @@ public:
     } pipelines;
 
     vk::PipelineLayout pipelineLayout;
-    vk::DescriptorSet descriptorSet;
+    // One per shared image
+    std::array<vk::DescriptorSet, SHARED_IMAGE_COUNT> descriptorSets;
     vk::DescriptorSetLayout descriptorSetLayout;
 
     OpenGLInteropExample() {
         camera.setRotation({ 0.0f, 15.0f, 0.0f });
         camera.dolly(-2.5f);
         title = "Vulkan Example - Texturing";
+        // The image the frame samples changes every frame
+        recordPerFrame = true;
 
         context.requireExtensions({
             VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME,    //
@@ -379,7 +461,10 @@ public:
     }
 
     ~OpenGLInteropExample() {
-        shared.destroy();
+        for (auto& resources : shared) {
+            resources.destroy();
+        }
+        device.destroy(frameTimestamps);
 
         device.destroyPipeline(pipelines.solid);
         device.destroyPipelineLayout(pipelineLayout);
@@ -388,24 +473,49 @@ public:
         geometry.vertices.destroy();
         geometry.indices.destroy();
 
-        device.destroyBuffer(uniformDataVS.buffer);
-        device.freeMemory(uniformDataVS.memory);
+        uniformDataVS.destroy();
     }
 
     void buildExportableImage() {
-        shared.init(context);
-        texGenerator.init(shared.handles, shared.texture.allocSize);
+        std::vector<ShareHandles> handles;
+        for (auto& resources : shared) {
+            resources.init(context);
+            handles.push_back(resources.handles);
+        }
+        texGenerator.init(handles, shared[0].texture.allocSize);
     }
 
+    void prepareTimestamps() {
+        if (!context.queueFamilyProperties[context.queueIndices.graphics].timestampValidBits) {
+            return;
+        }
+        const uint32_t queryCount = (uint32_t)frames.size() * 2;
+        frameTimestamps = device.createQueryPool({ {}, vk::QueryType::eTimestamp, queryCount });
+        // Reset once up front, so that reading them before the first frame finds them unavailable
+        context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& cmdBuffer) { cmdBuffer.resetQueryPool(frameTimestamps, 0, queryCount); });
+    }
+
+    uint32_t sharedIndex() const { return (uint32_t)(sharedFrame % SHARED_IMAGE_COUNT); }
+
     void updateCommandBufferPreDraw(const vk::CommandBuffer& commandBuffer) override {
-        context.setImageLayout(commandBuffer, shared.texture.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eColorAttachmentOptimal,
-                               vk::ImageLayout::eShaderReadOnlyOptimal);
+        if (frameTimestamps) {
+            commandBuffer.resetQueryPool(frameTimestamps, currentFrame * 2, 2);
+            commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, frameTimestamps, currentFrame * 2);
+        }
+        context.setImageLayout(commandBuffer, shared[sharedIndex()].texture.image, vk::ImageAspectFlagBits::eColor,
+                               vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+    }
+
+    void updateCommandBufferPostDraw(const vk::CommandBuffer& commandBuffer) override {
+        if (frameTimestamps) {
+            commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, frameTimestamps, currentFrame * 2 + 1);
+        }
     }
 
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
         cmdBuffer.setViewport(0, vks::util::viewport(size));
         cmdBuffer.setScissor(0, vks::util::rect2D(size));
-        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets[sharedIndex()], nullptr);
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.solid);
         vk::DeviceSize offsets = 0;
         cmdBuffer.bindVertexBuffers(0, geometry.vertices.buffer, offsets);
@@ -433,12 +543,12 @@ public:
     }
 
     void setupDescriptorPool() {
-        // Example uses one ubo and one image sampler
+        // Example uses one ubo and one image sampler, in one set per shared image
         std::vector<vk::DescriptorPoolSize> poolSizes = {
-            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 1 },
-            vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 1 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, SHARED_IMAGE_COUNT },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, SHARED_IMAGE_COUNT },
         };
-        descriptorPool = device.createDescriptorPool({ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
+        descriptorPool = device.createDescriptorPool({ {}, SHARED_IMAGE_COUNT, (uint32_t)poolSizes.size(), poolSizes.data() });
     }
 
     void setupDescriptorSetLayout() {
@@ -453,18 +563,24 @@ public:
         pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
     }
 
-    void setupDescriptorSet() {
-        descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
-        // vk::Image descriptor for the color map texture
-        vk::DescriptorImageInfo texDescriptor{ shared.texture.sampler, shared.texture.view, vk::ImageLayout::eShaderReadOnlyOptimal };
-        device.updateDescriptorSets(
-            {
-                // Binding 0 : Vertex shader uniform buffer
-                vk::WriteDescriptorSet{ descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformDataVS.descriptor },
-                // Binding 1 : Fragment shader texture sampler
-                vk::WriteDescriptorSet{ descriptorSet, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texDescriptor },
-            },
-            {});
+    void setupDescriptorSets() {
+        std::array<vk::DescriptorSetLayout, SHARED_IMAGE_COUNT> layouts;
+        layouts.fill(descriptorSetLayout);
+        auto sets = device.allocateDescriptorSets({ descriptorPool, SHARED_IMAGE_COUNT, layouts.data() });
+        for (uint32_t i = 0; i < SHARED_IMAGE_COUNT; ++i) {
+            descriptorSets[i] = sets[i];
+            // vk::Image descriptor for the color map texture
+            const auto& texture = shared[i].texture;
+            vk::DescriptorImageInfo texDescriptor{ texture.sampler, texture.view, vk::ImageLayout::eShaderReadOnlyOptimal };
+            device.updateDescriptorSets(
+                {
+                    // Binding 0 : Vertex shader uniform buffer
+                    vk::WriteDescriptorSet{ descriptorSets[i], 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformDataVS.descriptor },
+                    // Binding 1 : Fragment shader texture sampler
+                    vk::WriteDescriptorSet{ descriptorSets[i], 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texDescriptor },
+                },
+                {});
+        }
     }
 
     void preparePipelines() {
@@ -500,23 +616,71 @@ public:
         generateQuad();
         prepareUniformBuffers();
         buildExportableImage();
+        prepareTimestamps();
         setupDescriptorSetLayout();
         preparePipelines();
         setupDescriptorPool();
-        setupDescriptorSet();
+        setupDescriptorSets();
         buildCommandBuffers();
         prepared = true;
     }
 
     void viewChanged() override { updateUniformBuffers(); }
 
+    // Report the time the queue sat idle before the frame whose slot was just waited for, and GL's timings
+    void updateIdleTimings() {
+        if (frameTimestamps) {
+            std::array<uint64_t, 2> ticks;
+            const vk::Result result = device.getQueryPoolResults(frameTimestamps, currentFrame * 2, 2, sizeof(ticks), ticks.data(), sizeof(uint64_t),
+                                                                 vk::QueryResultFlagBits::e64);
+            if (result != vk::Result::eSuccess) {
+                lastFrameEnd = 0;
+            } else {
+                if (lastFrameEnd) {
+                    const uint64_t idle = ticks[0] > lastFrameEnd ? ticks[0] - lastFrameEnd : 0;
+                    profiler.report("Vulkan idle", (double)idle * context.deviceProperties.limits.timestampPeriod / 1.0e6);
+                }
+                lastFrameEnd = ticks[1];
+            }
+        }
+        // Each GL result is only reported once
+        auto& glTimings = texGenerator.timings;
+        if (glTimings.idle >= 0.0) {
+            profiler.report("GL idle", glTimings.idle);
+        }
+        if (glTimings.busy >= 0.0) {
+            profiler.report("GL texture generation", glTimings.busy);
+        }
+        glTimings = TextureGenerator::Timings{};
+    }
+
     void draw() override {
         prepareFrame();
-        shared.transitionToGl(queue, semaphores.acquireComplete);
-        texGenerator.render();
-        renderWaitSemaphores = { shared.semaphores.glComplete };
+        updateIdleTimings();
+
+        // Hand GL every image up to framesAhead frames ahead that it hasn't drawn yet.  Lowering framesAhead just
+        // means GL draws nothing until Vulkan catches up.
+        const uint64_t lastGlFrame = sharedFrame + (uint64_t)framesAhead;
+        for (; nextGlFrame <= lastGlFrame; ++nextGlFrame) {
+            const uint32_t index = (uint32_t)(nextGlFrame % SHARED_IMAGE_COUNT);
+            shared[index].transitionToGl(context, queue);
+            texGenerator.render(index);
+        }
+
+        // The frame waits for the image to be drawn before it starts at all, so that its first timestamp marks when
+        // the image was ready
+        renderWaitSemaphores = { semaphores.acquireComplete, shared[sharedIndex()].semaphores.glComplete };
+        renderWaitStages = { vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eAllCommands };
         drawCurrentCommandBuffer();
         submitFrame();
+        ++sharedFrame;
+    }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            ui.sliderInt("GL frames ahead", &framesAhead, 0, SHARED_IMAGE_COUNT - 1);
+            ui.text("Shared images: %u", SHARED_IMAGE_COUNT);
+        }
     }
 };
 #else
@@ -14,6 +14,12 @@ class VulkanExample : public vkx::ExampleBase {
 public:
     bool bloom = true;
     bool displaySkybox = true;
+    // Adapt the exposure to the luminance histogram of the previous frame, see prepareExposure
+    bool autoExposure = false;
+    // Keep the HDR targets in the smallest formats the device supports, see prepareoffscreenfer, rather than 32 bit RGBA
+    bool compactTargets = true;
+    // Show how far the scene in the bright pass target is off from the same scene in the first target, see formats
+    bool formatError = false;
 
     // Vertex layout for the models
 
@@ -35,6 +41,7 @@ public:
     struct {
         vks::Buffer matrices;
         vks::Buffer params;
+        vks::Buffer adaptation;
     } uniformBuffers;
 
     struct UBOVS {
@@ -44,12 +51,58 @@ public:
 
     struct UBOParams {
         float exposure = 1.0f;
+        int32_t autoExposure = 0;
+        // Write the scene into the bright pass target too, to compare its format with the first target's
+        int32_t formatError = 0;
     } uboParams;
 
+    // Of the two offscreen targets and the bloom filter target.  The first holds the linear luminance in alpha for
+    // the exposure histogram, the others need no alpha.
+    struct {
+        vk::Format scene;
+        vk::Format bright;
+        vk::Format filter;
+    } formats;
+
+    // Must match the UBO of histogram.comp and exposure.comp
+    struct UBOAdaptation {
+        // Luminance range of the histogram, in stops
+        float minLogLuminance = -10.0f;
+        float logLuminanceRange = 14.0f;
+        // Seconds since the last frame
+        float timeDelta = 0.0f;
+        // How fast the exposure follows the scene, per second
+        float adaptationRate = 1.5f;
+        // Exposed average luminance
+        float key = 0.5f;
+    } uboAdaptation;
+
+    static const uint32_t HISTOGRAM_BINS = 256;
+    // Must match exposure.glsl
+    struct ExposureState {
+        float exposure;
+        float averageLuminance;
+        uint32_t histogram[HISTOGRAM_BINS];
+    };
+
+    struct {
+        vks::Buffer state;
+        vk::DescriptorSetLayout histogramSetLayout;
+        vk::DescriptorSetLayout exposureSetLayout;
+        vk::PipelineLayout histogramLayout;
+        vk::PipelineLayout exposureLayout;
+        vk::Pipeline histogram;
+        vk::Pipeline exposure;
+        vk::DescriptorSet histogramSet;
+        vk::DescriptorSet exposureSet;
+    } adaptation;
+
     struct {
         vk::Pipeline skybox;
         vk::Pipeline reflect;
         vk::Pipeline composition;
+        // The composition showing the difference between the offscreen targets, amplified
+        vk::Pipeline formatError;
         vk::Pipeline bloom[2];
     } pipelines;
 
@@ -100,15 +153,34 @@ public:
         camera.setRotation(glm::vec3(0.0f, 180.0f, 0.0f));
         camera.setPerspective(60.0f, (float)size.width / (float)size.height, 0.1f, 256.0f);
         settings.overlay = true;
+
+        const auto& args = vkx::getCommandLine();
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (args[i] == "--auto-exposure") {
+                autoExposure = true;
+            } else if (args[i] == "--wide-targets") {
+                compactTargets = false;
+            }
+        }
+        uboParams.autoExposure = autoExposure ? 1 : 0;
     }
 
     ~VulkanExample() {
         device.destroyPipeline(pipelines.skybox);
         device.destroyPipeline(pipelines.reflect);
         device.destroyPipeline(pipelines.composition);
+        device.destroyPipeline(pipelines.formatError);
         device.destroyPipeline(pipelines.bloom[0]);
         device.destroyPipeline(pipelines.bloom[1]);
 
+        device.destroyPipeline(adaptation.histogram);
+        device.destroyPipeline(adaptation.exposure);
+        device.destroyPipelineLayout(adaptation.histogramLayout);
+        device.destroyPipelineLayout(adaptation.exposureLayout);
+        device.destroyDescriptorSetLayout(adaptation.histogramSetLayout);
+        device.destroyDescriptorSetLayout(adaptation.exposureSetLayout);
+        adaptation.state.destroy();
+
         device.destroyPipelineLayout(pipelineLayouts.models);
         device.destroyPipelineLayout(pipelineLayouts.composition);
         device.destroyPipelineLayout(pipelineLayouts.bloomFilter);
@@ -140,6 +212,7 @@ public:
         models.skybox.destroy();
         uniformBuffers.matrices.destroy();
         uniformBuffers.params.destroy();
+        uniformBuffers.adaptation.destroy();
         textures.envmap.destroy();
     }
 
@@ -178,11 +251,11 @@ public:
         commandBuffer.setViewport(0, viewport());
         commandBuffer.setScissor(0, scissor());
         commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.composition, 0, descriptorSets.composition, nullptr);
-        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.composition);
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, formatError ? pipelines.formatError : pipelines.composition);
         commandBuffer.draw(3, 1, 0, 0);
 
         // Bloom
-        if (bloom) {
+        if (bloom && !formatError) {
             commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.bloom[0]);
             commandBuffer.draw(3, 1, 0, 0);
         }
@@ -241,15 +314,26 @@ public:
     }
 
     // Prepare a new framebuffer and attachments for offscreen rendering (G-Buffer)
+    // Every pass of the example reads or writes these targets in full, so their size is what its bandwidth comes down
+    // to.  The compact formats have less precision, which formatError shows.
     void prepareoffscreenfer() {
+        if (compactTargets) {
+            // The bloom filter is blended into by its second pass and linearly filtered when composited
+            const vk::FormatFeatureFlags filtered = vk::FormatFeatureFlagBits::eColorAttachment | vk::FormatFeatureFlagBits::eColorAttachmentBlend |
+                                                    vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+            formats.scene = context.getSupportedHdrColorFormat(true);
+            formats.bright = context.getSupportedHdrColorFormat(false);
+            formats.filter = context.getSupportedHdrColorFormat(false, filtered);
+        } else {
+            formats.scene = formats.bright = formats.filter = vk::Format::eR32G32B32A32Sfloat;
+        }
+
         {
             offscreen.extent = size;
             // Color attachments
             // Two floating point color buffers
-            offscreen.color[0] =
-                createAttachment(vk::Format::eR32G32B32A32Sfloat, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment);
-            offscreen.color[1] =
-                createAttachment(vk::Format::eR32G32B32A32Sfloat, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment);
+            offscreen.color[0] = createAttachment(formats.scene, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment);
+            offscreen.color[1] = createAttachment(formats.bright, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment);
             // Depth attachment
             offscreen.depth = createAttachment(depthFormat, vk::ImageUsageFlagBits::eDepthStencilAttachment);
 
@@ -337,7 +421,7 @@ public:
             // Color attachments
 
             // Two floating point color buffers
-            filterPass.color[0] = createAttachment(vk::Format::eR32G32B32A32Sfloat, vk::ImageUsageFlagBits::eColorAttachment);
+            filterPass.color[0] = createAttachment(formats.filter, vk::ImageUsageFlagBits::eColorAttachment);
 
             // Set up separate renderpass with references to the colorand depth attachments
             std::array<vk::AttachmentDescription, 1> attachmentDescs;
@@ -430,7 +514,7 @@ public:
         if (displaySkybox) {
             offscreen.cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.models, 0, descriptorSets.skybox, nullptr);
             offscreen.cmdBuffer.bindVertexBuffers(0, models.skybox.vertices.buffer, { 0 });
-            offscreen.cmdBuffer.bindIndexBuffer(models.skybox.indices.buffer, 0, vk::IndexType::eUint32);
+            offscreen.cmdBuffer.bindIndexBuffer(models.skybox.indices.buffer, 0, models.skybox.indexType);
             offscreen.cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.skybox);
             offscreen.cmdBuffer.drawIndexed(models.skybox.indexCount, 1, 0, 0, 0);
         }
@@ -439,13 +523,78 @@ public:
         const auto& model = models.objects[models.objectIndex];
         offscreen.cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.models, 0, descriptorSets.object, nullptr);
         offscreen.cmdBuffer.bindVertexBuffers(0, model.vertices.buffer, { 0 });
-        offscreen.cmdBuffer.bindIndexBuffer(model.indices.buffer, 0, vk::IndexType::eUint32);
+        offscreen.cmdBuffer.bindIndexBuffer(model.indices.buffer, 0, model.indexType);
         offscreen.cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.reflect);
         offscreen.cmdBuffer.drawIndexed(model.indexCount, 1, 0, 0, 0);
         offscreen.cmdBuffer.endRenderPass();
+
+        if (autoExposure) {
+            buildExposureCommands(offscreen.cmdBuffer);
+        }
         offscreen.cmdBuffer.end();
     }
 
+    // Bin the luminance of the frame just rendered and adapt the exposure the next frame is tonemapped with
+    void buildExposureCommands(const vk::CommandBuffer& cmdBuffer) {
+        // The HDR target has to be written, and the previous frame done reading the exposure and adapting it
+        vk::MemoryBarrier renderBarrier{ vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eShaderWrite,
+                                         vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eFragmentShader |
+                                      vk::PipelineStageFlagBits::eComputeShader,
+                                  vk::PipelineStageFlagBits::eComputeShader, {}, renderBarrier, nullptr, nullptr);
+
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, adaptation.histogram);
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, adaptation.histogramLayout, 0, adaptation.histogramSet, nullptr);
+        cmdBuffer.dispatch((offscreen.extent.width + 15) / 16, (offscreen.extent.height + 15) / 16, 1);
+
+        vk::MemoryBarrier histogramBarrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, histogramBarrier, nullptr, nullptr);
+
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, adaptation.exposure);
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, adaptation.exposureLayout, 0, adaptation.exposureSet, nullptr);
+        cmdBuffer.dispatch(1, 1, 1);
+
+        // Read by the tonemapping of the next frame
+        vk::MemoryBarrier exposureBarrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead };
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eFragmentShader, {}, exposureBarrier, nullptr, nullptr);
+    }
+
+    // Auto exposure without a CPU round trip: histogram.comp bins the linear luminance the G-buffer pass leaves in the
+    // alpha of the HDR target, and exposure.comp turns the histogram into an exposure that adapts over time, which
+    // the G-buffer pass of the next frame tonemaps with.
+    void prepareExposure() {
+        ExposureState initial{};
+        initial.exposure = uboParams.exposure;
+        adaptation.state = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, initial);
+
+        const auto stage = vk::ShaderStageFlagBits::eCompute;
+        std::vector<vk::DescriptorSetLayoutBinding> bindings{
+            { 0, vk::DescriptorType::eCombinedImageSampler, 1, stage },
+            { 1, vk::DescriptorType::eStorageBuffer, 1, stage },
+            { 2, vk::DescriptorType::eUniformBuffer, 1, stage },
+        };
+        adaptation.histogramSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)bindings.size(), bindings.data() });
+        adaptation.histogramLayout = device.createPipelineLayout({ {}, 1, &adaptation.histogramSetLayout });
+        bindings = {
+            { 0, vk::DescriptorType::eStorageBuffer, 1, stage },
+            { 1, vk::DescriptorType::eUniformBuffer, 1, stage },
+        };
+        adaptation.exposureSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)bindings.size(), bindings.data() });
+        adaptation.exposureLayout = device.createPipelineLayout({ {}, 1, &adaptation.exposureSetLayout });
+
+        adaptation.histogram = createComputePipeline("histogram.comp.spv", adaptation.histogramLayout);
+        adaptation.exposure = createComputePipeline("exposure.comp.spv", adaptation.exposureLayout);
+    }
+
+    vk::Pipeline createComputePipeline(const std::string& shader, const vk::PipelineLayout& layout) {
+        vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+        computePipelineCreateInfo.layout = layout;
+        computePipelineCreateInfo.stage = vks::shaders::loadShader(device, getAssetPath() + "shaders/hdr/" + shader, vk::ShaderStageFlagBits::eCompute);
+        vk::Pipeline pipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+        return pipeline;
+    }
+
     void loadAssets() override {
         // Models
         models.skybox.loadFromFile(context, getAssetPath() + "models/cube.obj", models.vertexLayout, 0.05f);
@@ -464,10 +613,11 @@ public:
 
     void setupDescriptorPool() {
         std::vector<vk::DescriptorPoolSize> poolSizes = {
-            { vk::DescriptorType::eUniformBuffer, 4 },
-            { vk::DescriptorType::eCombinedImageSampler, 6 },
+            { vk::DescriptorType::eUniformBuffer, 6 },
+            { vk::DescriptorType::eCombinedImageSampler, 8 },
+            { vk::DescriptorType::eStorageBuffer, 4 },
         };
-        descriptorPool = device.createDescriptorPool({ {}, 4, (uint32_t)poolSizes.size(), poolSizes.data() });
+        descriptorPool = device.createDescriptorPool({ {}, 6, (uint32_t)poolSizes.size(), poolSizes.data() });
     }
 
     void setupDescriptorSetLayout() {
@@ -475,6 +625,7 @@ public:
             { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
             { 1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
             { 2, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment },
+            { 3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment },
         };
 
         descriptorSetLayouts.models = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
@@ -493,6 +644,7 @@ public:
         setLayoutBindings = {
             { 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
             { 1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
+            { 2, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
         };
 
         descriptorSetLayouts.composition = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
@@ -508,6 +660,9 @@ public:
         descriptorSets.bloomFilter = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.bloomFilter })[0];
         // Composition descriptor set
         descriptorSets.composition = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.composition })[0];
+        // Exposure adaptation
+        adaptation.histogramSet = device.allocateDescriptorSets({ descriptorPool, 1, &adaptation.histogramSetLayout })[0];
+        adaptation.exposureSet = device.allocateDescriptorSets({ descriptorPool, 1, &adaptation.exposureSetLayout })[0];
 
         std::vector<vk::DescriptorImageInfo> colorDescriptors = {
             { offscreen.sampler, offscreen.color[0].view, vk::ImageLayout::eShaderReadOnlyOptimal },
@@ -519,13 +674,21 @@ public:
             vk::WriteDescriptorSet{ descriptorSets.object, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.matrices.descriptor },
             vk::WriteDescriptorSet{ descriptorSets.object, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &textures.envmap.descriptor },
             vk::WriteDescriptorSet{ descriptorSets.object, 2, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.params.descriptor },
+            vk::WriteDescriptorSet{ descriptorSets.object, 3, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &adaptation.state.descriptor },
             vk::WriteDescriptorSet{ descriptorSets.skybox, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.matrices.descriptor },
             vk::WriteDescriptorSet{ descriptorSets.skybox, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &textures.envmap.descriptor },
             vk::WriteDescriptorSet{ descriptorSets.skybox, 2, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.params.descriptor },
+            vk::WriteDescriptorSet{ descriptorSets.skybox, 3, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &adaptation.state.descriptor },
             vk::WriteDescriptorSet{ descriptorSets.bloomFilter, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &colorDescriptors[0] },
             vk::WriteDescriptorSet{ descriptorSets.bloomFilter, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &colorDescriptors[1] },
             vk::WriteDescriptorSet{ descriptorSets.composition, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &colorDescriptors[0] },
             vk::WriteDescriptorSet{ descriptorSets.composition, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &colorDescriptors[2] },
+            vk::WriteDescriptorSet{ descriptorSets.composition, 2, 0, 1, vk::DescriptorType::eCombinedImageSampler, &colorDescriptors[1] },
+            vk::WriteDescriptorSet{ adaptation.histogramSet, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &colorDescriptors[0] },
+            vk::WriteDescriptorSet{ adaptation.histogramSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &adaptation.state.descriptor },
+            vk::WriteDescriptorSet{ adaptation.histogramSet, 2, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.adaptation.descriptor },
+            vk::WriteDescriptorSet{ adaptation.exposureSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &adaptation.state.descriptor },
+            vk::WriteDescriptorSet{ adaptation.exposureSet, 1, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.adaptation.descriptor },
         };
 
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
@@ -540,6 +703,12 @@ public:
         pipelineBuilder.loadShader(getAssetPath() + "shaders/hdr/composition.vert.spv", vk::ShaderStageFlagBits::eVertex);
         pipelineBuilder.loadShader(getAssetPath() + "shaders/hdr/composition.frag.spv", vk::ShaderStageFlagBits::eFragment);
         pipelines.composition = pipelineBuilder.create(context.pipelineCache);
+        // Format error visualization
+        uint32_t showError = 1;
+        vk::SpecializationMapEntry errorMapEntry{ 0, 0, sizeof(uint32_t) };
+        vk::SpecializationInfo errorSpecializationInfo{ 1, &errorMapEntry, sizeof(showError), &showError };
+        pipelineBuilder.shaderStages[1].pSpecializationInfo = &errorSpecializationInfo;
+        pipelines.formatError = pipelineBuilder.create(context.pipelineCache);
         pipelineBuilder.destroyShaderModules();
 
         // Bloom pass
@@ -602,6 +771,8 @@ public:
         uniformBuffers.matrices = context.createUniformBuffer(uboVS);
         // Params
         uniformBuffers.params = context.createUniformBuffer(uboParams);
+        // Exposure adaptation
+        uniformBuffers.adaptation = context.createUniformBuffer(uboAdaptation);
 
         updateUniformBuffers();
         updateParams();
@@ -615,6 +786,8 @@ public:
 
     void updateParams() { memcpy(uniformBuffers.params.mapped, &uboParams, sizeof(uboParams)); }
 
+    void updateAdaptation() { memcpy(uniformBuffers.adaptation.mapped, &uboAdaptation, sizeof(uboAdaptation)); }
+
     void draw() override {
         prepareFrame();
         context.submit(offscreen.cmdBuffer, { { semaphores.acquireComplete, vk::PipelineStageFlagBits::eBottomOfPipe } }, offscreen.semaphore);
@@ -627,6 +800,7 @@ public:
         ExampleBase::prepare();
         prepareUniformBuffers();
         prepareoffscreenfer();
+        prepareExposure();
         setupDescriptorSetLayout();
         preparePipelines();
         setupDescriptorPool();
@@ -636,6 +810,12 @@ public:
         prepared = true;
     }
 
+    void update(float deltaTime) override {
+        ExampleBase::update(deltaTime);
+        uboAdaptation.timeDelta = deltaTime;
+        updateAdaptation();
+    }
+
     void viewChanged() override { updateUniformBuffers(); }
 
     void OnUpdateUIOverlay() override {
@@ -644,7 +824,20 @@ public:
                 updateUniformBuffers();
                 buildDeferredCommandBuffer();
             }
-            if (ui.inputFloat("Exposure", &uboParams.exposure, 0.025f, 3)) {
+            if (ui.checkBox("Auto exposure", &autoExposure)) {
+                uboParams.autoExposure = autoExposure ? 1 : 0;
+                updateParams();
+                device.waitIdle();
+                buildDeferredCommandBuffer();
+            }
+            if (autoExposure) {
+                if (ui.inputFloat("Key", &uboAdaptation.key, 0.05f, 2)) {
+                    updateAdaptation();
+                }
+                if (ui.inputFloat("Adaptation rate", &uboAdaptation.adaptationRate, 0.1f, 2)) {
+                    updateAdaptation();
+                }
+            } else if (ui.inputFloat("Exposure", &uboParams.exposure, 0.025f, 3)) {
                 updateParams();
             }
             if (ui.checkBox("Bloom", &bloom)) {
@@ -654,6 +847,16 @@ public:
                 buildDeferredCommandBuffer();
             }
         }
+        if (ui.header("Target formats")) {
+            ui.text("Scene: %s", vk::to_string(formats.scene).c_str());
+            ui.text("Bright pass: %s", vk::to_string(formats.bright).c_str());
+            ui.text("Bloom filter: %s", vk::to_string(formats.filter).c_str());
+            if (formats.bright != formats.scene && ui.checkBox("Show format error (x64)", &formatError)) {
+                uboParams.formatError = formatError ? 1 : 0;
+                updateParams();
+                buildCommandBuffers();
+            }
+        }
     }
 };
 
@@ -15,13 +15,19 @@
 * The example shows how to setup and fill such a buffer on the CPU side, stages it to the device and
 * shows how to render it using only one draw command.
 *
+* With buffer device addresses the plants are culled on the device instead: a compute shader tests every instance
+* against the frustum and appends the visible ones to the draws of a vks::SceneBuffers, which the vertex shader then
+* reads them back from.  --no-scene-buffers keeps the draws filled on the CPU.
+*
 * See readme.md for details
 *
 */
 
 #include <vulkanExampleBase.h>
+#include <vks/frustum.hpp>
+#include <vks/scenebuffers.hpp>
 
-// Number of instances per object
+// Default number of instances per object, --instances <count> sets the total over all objects
 #if defined(__ANDROID__)
 #define OBJECT_INSTANCE_COUNT 1024
 // Circular range of plant distribution
@@ -61,16 +67,34 @@ public:
         uint32_t texIndex;
     };
 
-    // Contains the instanced data
+    // Contains the instanced data, generated on the device.  The scene's own instances with sceneBuffers
     vks::Buffer instanceBuffer;
     // Contains the indirect drawing commands
     vks::Buffer indirectCommandsBuffer;
     uint32_t indirectDrawCount;
 
+    // Instances requested with --instances, 0 for OBJECT_INSTANCE_COUNT per object.  The instance buffer is sized for
+    // the largest of it and the --benchmark-sweep values, which are instance counts here
+    uint32_t instanceCount = 0;
+    uint32_t instanceCapacity = 0;
+
     struct {
         glm::mat4 projection;
         glm::mat4 view;
+        // For the culling shader
+        glm::vec4 frustumPlanes[6];
     } uboVS;
+    vks::Frustum frustum;
+
+    // The plants as a vks::SceneBuffers, culled by `cull` and drawn with pipelines.scenePlants, unless the device has no
+    // buffer device addresses or --no-scene-buffers was given
+    bool sceneBuffers = false;
+    vks::SceneBuffers scene;
+    // Both the culling and the scene's vertex shader get the table through a push constant
+    vk::PipelineLayout scenePipelineLayout;
+    struct {
+        vk::Pipeline pipeline;
+    } cull;
 
     struct {
         vks::Buffer scene;
@@ -78,6 +102,7 @@ public:
 
     struct {
         vk::Pipeline plants;
+        vk::Pipeline scenePlants;
         vk::Pipeline ground;
         vk::Pipeline skysphere;
     } pipelines;
@@ -88,6 +113,14 @@ public:
 
     vk::Sampler samplerRepeat;
 
+    // Fills the instance buffer, see setInstanceCount
+    struct {
+        vk::DescriptorSetLayout descriptorSetLayout;
+        vk::DescriptorSet descriptorSet;
+        vk::PipelineLayout pipelineLayout;
+        vk::Pipeline pipeline;
+    } generate;
+
     uint32_t objectCount = 0;
 
     // Store the indirect draw commands containing index offsets and instance count per object
@@ -102,14 +135,31 @@ public:
         camera.movementSpeed = 5.0f;
         defaultClearColor = vks::util::clearColor({ 0.18f, 0.27f, 0.5f, 0.0f });
         settings.overlay = true;
+
+        context.enableBufferDeviceAddress = true;
+        const auto& args = vkx::getCommandLine();
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (args[i] == "--instances" && i + 1 < args.size()) {
+                instanceCount = (uint32_t)std::stoul(args[++i]);
+            } else if (args[i] == "--no-scene-buffers") {
+                context.enableBufferDeviceAddress = false;
+            }
+        }
     }
 
     ~VulkanExample() {
         device.destroy(pipelines.plants);
+        device.destroy(pipelines.scenePlants);
+        device.destroy(cull.pipeline);
+        device.destroy(scenePipelineLayout);
+        scene.destroy();
         device.destroy(pipelines.ground);
         device.destroy(pipelines.skysphere);
         device.destroy(pipelineLayout);
         device.destroy(descriptorSetLayout);
+        device.destroy(generate.pipeline);
+        device.destroy(generate.pipelineLayout);
+        device.destroy(generate.descriptorSetLayout);
         models.plants.destroy();
         models.ground.destroy();
         models.skysphere.destroy();
@@ -144,16 +194,61 @@ public:
         drawCmdBuffer.setViewport(0, viewport());
         drawCmdBuffer.setScissor(0, scissor());
 
+        if (sceneBuffers) {
+            vks::debug::marker::beginRegion(drawCmdBuffer, "Draw", glm::vec4(0.5f, 0.76f, 0.34f, 1.0f));
+            drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.scenePlants);
+            // The push constant range makes the layouts incompatible, so the set is bound for each
+            drawCmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, scenePipelineLayout, 0, descriptorSet, nullptr);
+            const vk::DeviceAddress table = scene.table();
+            drawCmdBuffer.pushConstants<vk::DeviceAddress>(scenePipelineLayout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute, 0,
+                                                           table);
+            // Every plant in one multi draw, with as many instances as survived culling
+            scene.draw(drawCmdBuffer);
+            vks::debug::marker::endRegion(drawCmdBuffer);
+        }
+
         drawCmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
+        if (!sceneBuffers) {
+            drawPlants(drawCmdBuffer);
+        }
+
+        // Ground
+        drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.ground);
+        drawCmdBuffer.bindVertexBuffers(0, models.ground.vertices.buffer, { 0 });
+        drawCmdBuffer.bindIndexBuffer(models.ground.indices.buffer, 0, models.ground.indexType);
+        drawCmdBuffer.drawIndexed(models.ground.indexCount, 1, 0, 0, 0);
+        // Skysphere
+        drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.skysphere);
+        drawCmdBuffer.bindVertexBuffers(0, models.skysphere.vertices.buffer, { 0 });
+        drawCmdBuffer.bindIndexBuffer(models.skysphere.indices.buffer, 0, models.skysphere.indexType);
+        drawCmdBuffer.drawIndexed(models.skysphere.indexCount, 1, 0, 0, 0);
+    }
 
-        // Plants
+    // Cull the plants into the scene's draws, before the render pass
+    void updateCommandBufferPreDraw(const vk::CommandBuffer& commandBuffer) override {
+        if (!sceneBuffers) {
+            return;
+        }
+        scene.recordReset(commandBuffer);
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, cull.pipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, scenePipelineLayout, 0, descriptorSet, nullptr);
+        const vk::DeviceAddress table = scene.table();
+        commandBuffer.pushConstants<vk::DeviceAddress>(scenePipelineLayout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute, 0, table);
+        const auto groups = vkx::workGroupCounts(context, objectCount, 64);
+        commandBuffer.dispatch(groups[0], groups[1], 1);
+        scene.recordCulled(commandBuffer);
+    }
+
+    // The instances as vertex attributes, with the draws filled on the CPU
+    void drawPlants(const vk::CommandBuffer& drawCmdBuffer) {
         drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.plants);
         // Binding point 0 : Mesh vertex buffer
         drawCmdBuffer.bindVertexBuffers(0, models.plants.vertices.buffer, { 0 });
         // Binding point 1 : Instance data buffer
         drawCmdBuffer.bindVertexBuffers(1, instanceBuffer.buffer, { 0 });
-        drawCmdBuffer.bindIndexBuffer(models.plants.indices.buffer, 0, vk::IndexType::eUint32);
+        drawCmdBuffer.bindIndexBuffer(models.plants.indices.buffer, 0, models.plants.indexType);
 
+        vks::debug::marker::beginRegion(drawCmdBuffer, "Draw", glm::vec4(0.5f, 0.76f, 0.34f, 1.0f));
         // If the multi draw feature is supported:
         // One draw call for an arbitrary number of ojects
         // Index offsets and instance count are taken from the indirect buffer
@@ -166,21 +261,15 @@ public:
                                                   sizeof(VkDrawIndexedIndirectCommand));
             }
         }
-
-        // Ground
-        drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.ground);
-        drawCmdBuffer.bindVertexBuffers(0, models.ground.vertices.buffer, { 0 });
-        drawCmdBuffer.bindIndexBuffer(models.ground.indices.buffer, 0, vk::IndexType::eUint32);
-        drawCmdBuffer.drawIndexed(models.ground.indexCount, 1, 0, 0, 0);
-        // Skysphere
-        drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.skysphere);
-        drawCmdBuffer.bindVertexBuffers(0, models.skysphere.vertices.buffer, { 0 });
-        drawCmdBuffer.bindIndexBuffer(models.skysphere.indices.buffer, 0, vk::IndexType::eUint32);
-        drawCmdBuffer.drawIndexed(models.skysphere.indexCount, 1, 0, 0, 0);
+        vks::debug::marker::endRegion(drawCmdBuffer);
     }
 
     void loadAssets() override {
-        models.plants.loadFromFile(context, getAssetPath() + "models/plants.dae", vertexLayout, 0.0025f);
+        sceneBuffers = context.bufferDeviceAddressEnabled;
+        // The scene merges the plants from the host copy
+        vks::model::ModelCreateInfo plantsCreateInfo{ 0.0025f, 1.0f, 0.0f };
+        plantsCreateInfo.hostCopy = sceneBuffers;
+        models.plants.loadFromFile(context, getAssetPath() + "models/plants.dae", vertexLayout, plantsCreateInfo);
         models.ground.loadFromFile(context, getAssetPath() + "models/plane_circle.dae", vertexLayout, PLANT_RADIUS + 1.0f);
         models.skysphere.loadFromFile(context, getAssetPath() + "models/skysphere.dae", vertexLayout, 512.0f / 10.0f);
 
@@ -206,10 +295,11 @@ public:
     }
 
     void setupDescriptorPool() {
-        // Example uses one ubo
+        // Example uses one ubo, and instance generation one storage buffer
         std::vector<vk::DescriptorPoolSize> poolSizes = {
             { vk::DescriptorType::eUniformBuffer, 1 },
             { vk::DescriptorType::eCombinedImageSampler, 2 },
+            { vk::DescriptorType::eStorageBuffer, 1 },
         };
 
         descriptorPool = device.createDescriptorPool({ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
@@ -217,13 +307,18 @@ public:
 
     void setupDescriptorSetLayout() {
         std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
-            { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+            { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute },
             { 1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
             { 2, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
         };
 
         descriptorSetLayout = device.createDescriptorSetLayout({ {}, static_cast<uint32_t>(setLayoutBindings.size()), setLayoutBindings.data() });
         pipelineLayout = device.createPipelineLayout(vk::PipelineLayoutCreateInfo{ {}, 1, &descriptorSetLayout });
+        if (sceneBuffers) {
+            // The address of the scene's table
+            vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute, 0, sizeof(vk::DeviceAddress) };
+            scenePipelineLayout = device.createPipelineLayout(vk::PipelineLayoutCreateInfo{ {}, 1, &descriptorSetLayout, 1, &pushConstantRange });
+        }
     }
 
     void setupDescriptorSet() {
@@ -255,8 +350,25 @@ public:
         pipelines.skysphere = builder.create(context.pipelineCache);
         builder.destroyShaderModules();
 
-        // Indirect (and instanced) pipeline for the plants
         builder.rasterizationState.cullMode = vk::CullModeFlagBits::eBack;
+        if (sceneBuffers) {
+            // The plants of the scene, with the instances read from its table
+            builder.layout = scenePipelineLayout;
+            builder.loadShader(getAssetPath() + "shaders/indirectdraw/indirectdraw_scene.vert.spv", vk::ShaderStageFlagBits::eVertex);
+            builder.loadShader(getAssetPath() + "shaders/indirectdraw/indirectdraw.frag.spv", vk::ShaderStageFlagBits::eFragment);
+            pipelines.scenePlants = builder.create(context.pipelineCache);
+            builder.destroyShaderModules();
+
+            vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+            computePipelineCreateInfo.layout = scenePipelineLayout;
+            computePipelineCreateInfo.stage =
+                vks::shaders::loadShader(device, getAssetPath() + "shaders/indirectdraw/cull.comp.spv", vk::ShaderStageFlagBits::eCompute);
+            cull.pipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+            device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+            return;
+        }
+
+        // Indirect (and instanced) pipeline for the plants
         builder.vertexInputState.bindingDescriptions.push_back({ 1, sizeof(InstanceData), vk::VertexInputRate::eInstance });
         builder.vertexInputState.attributeDescriptions.push_back({ 4, 1, vk::Format::eR32G32B32Sfloat, offsetof(InstanceData, pos) });
         builder.vertexInputState.attributeDescriptions.push_back({ 5, 1, vk::Format::eR32G32B32Sfloat, offsetof(InstanceData, rot) });
@@ -268,16 +380,64 @@ public:
         builder.destroyShaderModules();
     }
 
-    // Prepare (and stage) a buffer containing the indirect draw commands
-    void prepareIndirectData() {
-        indirectCommands.clear();
+    // Buffers for instanceCapacity instances, filled by setInstanceCount
+    void prepareInstanceBuffers() {
+        const uint32_t typeCount = static_cast<uint32_t>(models.plants.parts.size());
+        if (instanceCount == 0) {
+            instanceCount = OBJECT_INSTANCE_COUNT * typeCount;
+        }
+        instanceCapacity = instanceCount;
+        for (const auto value : benchmark.sweep) {
+            instanceCapacity = std::max(instanceCapacity, value);
+        }
+        // The generation shader sees the instances as one storage buffer
+        const uint32_t maxInstances = context.deviceProperties.limits.maxStorageBufferRange / sizeof(InstanceData);
+        if (instanceCapacity > maxInstances) {
+            vkx::logMessage(vkx::LogLevel::LOG_WARN, "Limiting the instance count to %u, the device's storage buffer range", maxInstances);
+            instanceCapacity = maxInstances;
+        }
+        indirectDrawCount = typeCount;
+        if (sceneBuffers) {
+            // One mesh per plant, in the order of their parts, so a plant's texture index is its mesh
+            scene.add(models.plants);
+            scene.create(context, sizeof(InstanceData), instanceCapacity);
+            return;
+        }
+        instanceBuffer = context.createDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+                                                    sizeof(InstanceData) * instanceCapacity);
+        indirectCommandsBuffer = context.createDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                                            sizeof(vk::DrawIndexedIndirectCommand) * indirectDrawCount);
+    }
+
+    void prepareGeneratePipeline() {
+        vk::DescriptorSetLayoutBinding binding{ 0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute };
+        generate.descriptorSetLayout = device.createDescriptorSetLayout({ {}, 1, &binding });
+        // instancesPerType, seed and radius
+        vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(uint32_t) * 3 };
+        generate.pipelineLayout = device.createPipelineLayout({ {}, 1, &generate.descriptorSetLayout, 1, &pushConstantRange });
+        generate.descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &generate.descriptorSetLayout })[0];
+
+        vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+        computePipelineCreateInfo.layout = generate.pipelineLayout;
+        computePipelineCreateInfo.stage =
+            vks::shaders::loadShader(device, getAssetPath() + "shaders/indirectdraw/generate.comp.spv", vk::ShaderStageFlagBits::eCompute);
+        generate.pipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+    }
+
+    // Spread `count` instances evenly over the objects, rounded down to a multiple of their number, and generate
+    // them on the device.  Nothing may be in flight
+    void setInstanceCount(uint32_t count) {
+        const uint32_t instancesPerType = std::max(1u, std::min(count, instanceCapacity) / indirectDrawCount);
+        objectCount = instancesPerType * indirectDrawCount;
 
         // Create on indirect command for each mesh in the scene
+        indirectCommands.clear();
         uint32_t m = 0;
         for (auto& modelPart : models.plants.parts) {
             VkDrawIndexedIndirectCommand indirectCmd{};
-            indirectCmd.instanceCount = OBJECT_INSTANCE_COUNT;
-            indirectCmd.firstInstance = m * OBJECT_INSTANCE_COUNT;
+            indirectCmd.instanceCount = instancesPerType;
+            indirectCmd.firstInstance = m * instancesPerType;
             indirectCmd.firstIndex = modelPart.indexBase;
             indirectCmd.indexCount = modelPart.indexCount;
 
@@ -286,32 +446,36 @@ public:
             m++;
         }
 
-        objectCount = 0;
-        for (auto indirectCmd : indirectCommands) {
-            objectCount += indirectCmd.instanceCount;
-        }
-        indirectDrawCount = static_cast<uint32_t>(indirectCommands.size());
-        indirectCommandsBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer, indirectCommands);
-    }
-
-    // Prepare (and stage) a buffer containing instanced data for the mesh draws
-    void prepareInstanceData() {
-        std::vector<InstanceData> instanceData;
-        instanceData.resize(objectCount);
-
-        std::mt19937 rndGenerator((unsigned)time(NULL));
-        std::uniform_real_distribution<float> uniformDist(0.0f, 1.0f);
-
-        for (uint32_t i = 0; i < objectCount; i++) {
-            instanceData[i].rot = glm::vec3(0.0f, float(M_PI) * uniformDist(rndGenerator), 0.0f);
-            float theta = 2 * float(M_PI) * uniformDist(rndGenerator);
-            float phi = acos(1 - 2 * uniformDist(rndGenerator));
-            instanceData[i].pos = glm::vec3(sin(phi) * cos(theta), 0.0f, cos(phi)) * PLANT_RADIUS;
-            instanceData[i].scale = 1.0f + uniformDist(rndGenerator) * 2.0f;
-            instanceData[i].texIndex = i / OBJECT_INSTANCE_COUNT;
+        if (sceneBuffers) {
+            scene.setInstanceCounts(std::vector<uint32_t>(indirectDrawCount, instancesPerType));
         }
-
-        instanceBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, instanceData);
+        const vk::DescriptorBufferInfo instances{ sceneBuffers ? scene.instances().buffer : instanceBuffer.buffer, 0, sizeof(InstanceData) * objectCount };
+        device.updateDescriptorSets(vk::WriteDescriptorSet{ generate.descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &instances },
+                                    nullptr);
+
+        struct {
+            uint32_t instancesPerType;
+            uint32_t seed;
+            float radius;
+        } pushConstants{ instancesPerType, benchmark.active ? 0 : (uint32_t)time(nullptr), PLANT_RADIUS };
+        context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+            if (!sceneBuffers) {
+                commandBuffer.updateBuffer<vk::DrawIndexedIndirectCommand>(indirectCommandsBuffer.buffer, 0, indirectCommands);
+            }
+            commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, generate.pipeline);
+            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, generate.pipelineLayout, 0, generate.descriptorSet, nullptr);
+            commandBuffer.pushConstants(generate.pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(pushConstants), &pushConstants);
+            const auto groups = vkx::workGroupCounts(context, objectCount, 64);
+            commandBuffer.dispatch(groups[0], groups[1], 1);
+            // The scene's culling reads the instances in a compute shader
+            const vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite,
+                                             vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndirectCommandRead |
+                                                 vk::AccessFlagBits::eShaderRead };
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer,
+                                          vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eDrawIndirect |
+                                              vk::PipelineStageFlagBits::eComputeShader,
+                                          {}, barrier, nullptr, nullptr);
+        });
     }
 
     void prepareUniformBuffers() {
@@ -323,6 +487,8 @@ public:
         if (viewChanged) {
             uboVS.projection = camera.matrices.perspective;
             uboVS.view = camera.matrices.view;
+            frustum.update(uboVS.projection * uboVS.view);
+            memcpy(uboVS.frustumPlanes, frustum.planes.data(), sizeof(glm::vec4) * 6);
         }
 
         memcpy(uniformData.scene.mapped, &uboVS, sizeof(uboVS));
@@ -330,17 +496,26 @@ public:
 
     void prepare() {
         ExampleBase::prepare();
-        prepareIndirectData();
-        prepareInstanceData();
+        prepareInstanceBuffers();
         prepareUniformBuffers();
         setupDescriptorSetLayout();
         preparePipelines();
         setupDescriptorPool();
         setupDescriptorSet();
+        prepareGeneratePipeline();
+        setInstanceCount(instanceCount);
         buildCommandBuffers();
         prepared = true;
     }
 
+    // Sweep values are instance counts, and the reports list the time of the draw scope for each
+    bool applyBenchmarkSweep(uint32_t value) override {
+        device.waitIdle();
+        setInstanceCount(value);
+        buildCommandBuffers();
+        return true;
+    }
+
     void viewChanged() override { updateUniformBuffer(true); }
 
     void OnUpdateUIOverlay() override {
@@ -351,6 +526,7 @@ public:
         }
         if (ui.header("Statistics")) {
             ui.text("Objects: %d", objectCount);
+            ui.text(sceneBuffers ? "Culled on the device" : "Drawn without culling");
         }
     }
 };
@@ -1,14 +1,26 @@
 /*
 * Vulkan Example - Instanced mesh rendering, uses a separate vertex buffer for instanced data
 *
+* The instances are generated, animated and culled by a compute shader every frame, which appends the visible ones
+* to the instance buffer and counts them in an indexed indirect draw per level of detail.  Distant rocks are drawn as
+* impostors, billboards of views of the rock baked at load time
+*
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#include <numeric>
+
 #include <vulkanExampleBase.h>
+#include <compute.hpp>
+#include <vks/frustum.hpp>
+#include <vks/impostor.hpp>
 
-#define INSTANCE_COUNT 2048
+// Number of rocks the rings were laid out for, larger counts get smaller rocks
+#define DEFAULT_INSTANCE_COUNT 2048
+#define MAX_INSTANCE_COUNT (4 * 1024 * 1024)
+#define INSTANCE_GROUP_SIZE 64
 
 // Vertex layout for this example
 vks::model::VertexLayout vertexLayout{ {
@@ -25,28 +37,79 @@ public:
         vks::model::Model planet;
     } models;
 
+    // Low detail stand-in for distant rocks, a single quad facing the camera with the baked view of the rock closest
+    // to it.  Its vertices are drawn through an index buffer of 0 to QUAD_VERTEX_COUNT - 1, so that both levels of
+    // detail are indexed indirect draws of the same instance buffer
+    vks::model::Impostor rockImpostor;
+    vks::Buffer impostorIndices;
+
     struct {
         vks::texture::Texture2D planet;
         vks::texture::Texture2DArray rocks;
     } textures;
 
-    // Per-instance data block
-    struct InstanceData {
-        glm::vec3 pos;
-        glm::vec3 rot;
-        float scale;
+    // Per-instance data block, written by instances.comp for the visible instances only
+    struct VisibleInstance {
+        glm::vec4 posScale;
+        // Orientation quaternion
+        int16_t rotation[4];
         uint32_t texIndex;
+        uint32_t _pad0;
+    };
+
+    // Levels of detail, each with an indirect draw
+    enum Lod
+    {
+        LOD_HIGH = 0,
+        LOD_LOW = 1,
+        LOD_COUNT = 2
     };
 
-    // Contains the instanced data
+    // Nothing is stored per rock, every frame regenerates them from their index.  Only the visible ones take memory,
+    // high detail ones from the start of the instance buffer and low detail ones from the end.
+    int32_t instanceCount{ DEFAULT_INSTANCE_COUNT };
+    uint32_t instanceCapacity{ 0 };
+    uint32_t seed{ 0 };
     vks::Buffer instanceBuffer;
+    // The indirect draws, and the state the cull pass starts from
+    vks::Buffer drawsBuffer;
+    vks::Buffer drawsTemplate;
+    // The draws of each swap chain image's last frame, for the statistics
+    vks::Buffer drawsReadback;
+    std::array<uint32_t, LOD_COUNT> visibleCounts{};
+
+    struct {
+        vk::DescriptorSetLayout descriptorSetLayout;
+        vk::DescriptorSet descriptorSet;
+        vk::PipelineLayout pipelineLayout;
+        vk::Pipeline pipeline;
+        vk::Pipeline finalizePipeline;
+    } cull;
+
+    // Must match instances.comp
+    struct CullPushConsts {
+        uint32_t instanceCount;
+        uint32_t capacity;
+        uint32_t seed;
+        uint32_t layerCount;
+        float scale;
+    };
+
+    vks::Frustum frustum;
 
     struct UboVS {
         glm::mat4 projection;
         glm::mat4 view;
         glm::vec4 lightPos = glm::vec4(0.0f, -5.0f, 0.0f, 1.0f);
+        // Culling and level of detail selection, only read by instances.comp
+        glm::vec4 frustumPlanes[6];
+        glm::vec4 cameraPos;
         float locSpeed = 0.0f;
         float globSpeed = 0.0f;
+        float pixelScale = 0.0f;
+        float radius = 1.0f;
+        float lodPixels = 12.0f;
+        float cullPixels = 0.5f;
     } uboVS;
 
     struct {
@@ -56,6 +119,7 @@ public:
     vk::PipelineLayout pipelineLayout;
     struct {
         vk::Pipeline instancedRocks;
+        vk::Pipeline impostors;
         vk::Pipeline planet;
         vk::Pipeline starfield;
     } pipelines;
@@ -63,8 +127,17 @@ public:
     struct {
         vk::DescriptorSet instancedRocks;
         vk::DescriptorSet planet;
+        vk::DescriptorSet impostors;
     } descriptorSets;
     vk::DescriptorSetLayout descriptorSetLayout;
+    vk::DescriptorSetLayout impostorDescriptorSetLayout;
+    vk::PipelineLayout impostorPipelineLayout;
+
+    // Must match impostor.vert
+    struct ImpostorPushConsts {
+        glm::vec4 sphere;
+        uint32_t frames;
+    };
 
     VulkanExample() {
         rotationSpeed = 0.25f;
@@ -73,20 +146,81 @@ public:
         srand((uint32_t)time(NULL));
     }
 
+    void getEnabledFeatures() override {
+        // The low detail draw starts past the first instance, without the feature every rock uses the high detail mesh
+        if (deviceFeatures.drawIndirectFirstInstance) {
+            enabledFeatures.drawIndirectFirstInstance = VK_TRUE;
+        }
+    }
+
     ~VulkanExample() {
         device.destroy(pipelines.instancedRocks);
+        device.destroy(pipelines.impostors);
         device.destroy(pipelines.planet);
         device.destroy(pipelines.starfield);
         device.destroyPipelineLayout(pipelineLayout);
         device.destroyDescriptorSetLayout(descriptorSetLayout);
+        device.destroyPipelineLayout(impostorPipelineLayout);
+        device.destroyDescriptorSetLayout(impostorDescriptorSetLayout);
+        device.destroyPipeline(cull.pipeline);
+        device.destroyPipeline(cull.finalizePipeline);
+        device.destroyPipelineLayout(cull.pipelineLayout);
+        device.destroyDescriptorSetLayout(cull.descriptorSetLayout);
         instanceBuffer.destroy();
+        drawsBuffer.destroy();
+        drawsTemplate.destroy();
+        drawsReadback.destroy();
         models.planet.destroy();
         models.rock.destroy();
+        rockImpostor.destroy();
+        impostorIndices.destroy();
         uniformData.scene.destroy();
         textures.planet.destroy();
         textures.rocks.destroy();
     }
 
+    // Reset the draws and fill them with this frame's visible instances.  The previous frame's draws and copy of the
+    // statistics have to be done with the buffers first.
+    void updateCommandBufferPreDraw(const vk::CommandBuffer& cmdBuffer) override {
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eTransfer,
+                                  vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, nullptr, nullptr);
+        cmdBuffer.copyBuffer(drawsTemplate.buffer, drawsBuffer.buffer, vk::BufferCopy{ 0, 0, drawsBuffer.size });
+        const vk::MemoryBarrier reset{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, reset, nullptr, nullptr);
+
+        CullPushConsts pushConsts;
+        pushConsts.instanceCount = (uint32_t)instanceCount;
+        pushConsts.capacity = instanceCapacity;
+        pushConsts.seed = seed;
+        pushConsts.layerCount = textures.rocks.layerCount;
+        pushConsts.scale = std::min(1.0f, sqrtf((float)DEFAULT_INSTANCE_COUNT / (float)instanceCount));
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, cull.pipelineLayout, 0, cull.descriptorSet, nullptr);
+        cmdBuffer.pushConstants<CullPushConsts>(cull.pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushConsts);
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, cull.pipeline);
+        const auto groups = vkx::workGroupCounts(context, (uint32_t)instanceCount, INSTANCE_GROUP_SIZE);
+        cmdBuffer.dispatch(groups[0], groups[1], 1);
+
+        // The low detail draw starts where the last of its instances was appended
+        const vk::MemoryBarrier counted{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, counted, nullptr, nullptr);
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, cull.finalizePipeline);
+        cmdBuffer.dispatch(1, 1, 1);
+
+        const vk::MemoryBarrier written{ vk::AccessFlagBits::eShaderWrite,
+                                         vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eVertexAttributeRead };
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput,
+                                  {}, written, nullptr, nullptr);
+    }
+
+    // Copy the draws for the statistics, read once the image's frame has completed
+    void updateCommandBufferPostDraw(const vk::CommandBuffer& cmdBuffer) override {
+        const vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eTransferRead };
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer, {}, barrier, nullptr, nullptr);
+        cmdBuffer.copyBuffer(drawsBuffer.buffer, drawsReadback.buffer, vk::BufferCopy{ 0, drawsBuffer.size * commandBufferImage(cmdBuffer), drawsBuffer.size });
+        const vk::MemoryBarrier hostBarrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead };
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, hostBarrier, nullptr, nullptr);
+    }
+
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
         cmdBuffer.setViewport(0, vks::util::viewport(size));
         cmdBuffer.setScissor(0, vks::util::rect2D(size));
@@ -97,19 +231,26 @@ public:
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.planet, nullptr);
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.planet);
         cmdBuffer.bindVertexBuffers(0, models.planet.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(models.planet.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(models.planet.indices.buffer, 0, models.planet.indexType);
         cmdBuffer.drawIndexed(models.planet.indexCount, 1, 0, 0, 0);
 
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.instancedRocks, nullptr);
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.instancedRocks);
 
+        // Binding point 1 : Instance data buffer, each draw starts at its first instance
+        cmdBuffer.bindVertexBuffers(1, instanceBuffer.buffer, { 0 });
         // Binding point 0 : Mesh vertex buffer
         cmdBuffer.bindVertexBuffers(0, models.rock.vertices.buffer, { 0 });
-        // Binding point 1 : Instance data buffer
-        cmdBuffer.bindVertexBuffers(1, instanceBuffer.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(models.rock.indices.buffer, 0, vk::IndexType::eUint32);
-        // Render instances
-        cmdBuffer.drawIndexed(models.rock.indexCount, INSTANCE_COUNT, 0, 0, 0);
+        cmdBuffer.bindIndexBuffer(models.rock.indices.buffer, 0, models.rock.indexType);
+        // Render the visible instances, as counted by the compute shader
+        cmdBuffer.drawIndexedIndirect(drawsBuffer.buffer, sizeof(vk::DrawIndexedIndirectCommand) * LOD_HIGH, 1, sizeof(vk::DrawIndexedIndirectCommand));
+
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, impostorPipelineLayout, 0, descriptorSets.impostors, nullptr);
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.impostors);
+        const ImpostorPushConsts pushConsts{ rockImpostor.sphere(), rockImpostor.frames() };
+        cmdBuffer.pushConstants<ImpostorPushConsts>(impostorPipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, pushConsts);
+        cmdBuffer.bindIndexBuffer(impostorIndices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.drawIndexedIndirect(drawsBuffer.buffer, sizeof(vk::DrawIndexedIndirectCommand) * LOD_LOW, 1, sizeof(vk::DrawIndexedIndirectCommand));
     }
 
     void loadAssets() override {
@@ -117,16 +258,24 @@ public:
         models.rock.loadFromFile(context, getAssetPath() + "models/rock01.dae", vertexLayout, 0.1f);
         textures.rocks.loadFromFile(context, getAssetPath() + "textures/texturearray_rocks_bc3.ktx", vk::Format::eBc3UnormBlock);
         textures.planet.loadFromFile(context, getAssetPath() + "textures/lavaplanet_bc3_unorm.ktx", vk::Format::eBc3UnormBlock);
+        // Distant rocks are only a few pixels, so the views can be small
+        vks::model::Impostor::Config impostorConfig;
+        impostorConfig.frameSize = 32;
+        rockImpostor.bake(context, getAssetPath(), models.rock, impostorConfig);
+        std::vector<uint32_t> indices(vks::model::Impostor::QUAD_VERTEX_COUNT);
+        std::iota(indices.begin(), indices.end(), 0);
+        impostorIndices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indices);
     }
 
     void setupDescriptorPool() {
         // Example uses one ubo
         std::vector<vk::DescriptorPoolSize> poolSizes{
-            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 2 },
-            vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 2 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 4 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 5 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 2 },
         };
 
-        descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
+        descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 4, (uint32_t)poolSizes.size(), poolSizes.data() });
     }
 
     void setupDescriptorSetLayout() {
@@ -139,14 +288,46 @@ public:
 
         descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
         pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+
+        std::vector<vk::DescriptorSetLayoutBinding> impostorBindings{
+            // Binding 0 : Uniform buffer, the fragment shader moves the depth to the baked surface
+            { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment },
+            // Binding 1 : Rock textures, for the color of each rock
+            { 1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 2 : Impostor albedo
+            { 2, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 3 : Impostor normals and depth
+            { 3, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
+        };
+        impostorDescriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)impostorBindings.size(), impostorBindings.data() });
+        const vk::PushConstantRange impostorPushConstantRange{ vk::ShaderStageFlagBits::eVertex, 0, sizeof(ImpostorPushConsts) };
+        impostorPipelineLayout = device.createPipelineLayout({ {}, 1, &impostorDescriptorSetLayout, 1, &impostorPushConstantRange });
+
+        std::vector<vk::DescriptorSetLayoutBinding> cullBindings{
+            // Binding 0 : Uniform buffer, shared with the vertex shaders
+            { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 1 : Visible instances (output)
+            { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 2 : Indirect draws
+            { 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        };
+        cull.descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)cullBindings.size(), cullBindings.data() });
+        vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullPushConsts) };
+        cull.pipelineLayout = device.createPipelineLayout({ {}, 1, &cull.descriptorSetLayout, 1, &pushConstantRange });
     }
 
     void setupDescriptorSet() {
         descriptorSets.instancedRocks = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{ descriptorPool, 1, &descriptorSetLayout })[0];
         descriptorSets.planet = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{ descriptorPool, 1, &descriptorSetLayout })[0];
+        cull.descriptorSet = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{ descriptorPool, 1, &cull.descriptorSetLayout })[0];
+        descriptorSets.impostors = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{ descriptorPool, 1, &impostorDescriptorSetLayout })[0];
+        vk::DescriptorBufferInfo instancesDescriptor{ instanceBuffer.buffer, 0, VK_WHOLE_SIZE };
+        vk::DescriptorBufferInfo drawsDescriptor{ drawsBuffer.buffer, 0, VK_WHOLE_SIZE };
 
         vk::DescriptorImageInfo texRocksDescriptor = vk::DescriptorImageInfo{ textures.rocks.sampler, textures.rocks.view, vk::ImageLayout::eGeneral };
         vk::DescriptorImageInfo texPlanetDescriptor = vk::DescriptorImageInfo{ textures.planet.sampler, textures.planet.view, vk::ImageLayout::eGeneral };
+        vk::DescriptorImageInfo impostorAlbedoDescriptor = rockImpostor.albedoDescriptor();
+        vk::DescriptorImageInfo impostorNormalDepthDescriptor = rockImpostor.normalDepthDescriptor();
 
         device.updateDescriptorSets(
             {
@@ -158,6 +339,20 @@ public:
                 { descriptorSets.planet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.scene.descriptor },
                 // Binding 1 : Color map
                 { descriptorSets.planet, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texPlanetDescriptor },
+                // Binding 0 : Uniform buffer
+                { cull.descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.scene.descriptor },
+                // Binding 1 : Visible instances
+                { cull.descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &instancesDescriptor },
+                // Binding 2 : Indirect draws
+                { cull.descriptorSet, 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &drawsDescriptor },
+                // Binding 0 : Uniform buffer
+                { descriptorSets.impostors, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.scene.descriptor },
+                // Binding 1 : Rock textures
+                { descriptorSets.impostors, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texRocksDescriptor },
+                // Binding 2 : Impostor albedo
+                { descriptorSets.impostors, 2, 0, 1, vk::DescriptorType::eCombinedImageSampler, &impostorAlbedoDescriptor },
+                // Binding 3 : Impostor normals and depth
+                { descriptorSets.impostors, 3, 0, 1, vk::DescriptorType::eCombinedImageSampler, &impostorNormalDepthDescriptor },
             },
             nullptr);
     }
@@ -172,7 +367,7 @@ public:
             // Step for each vertex rendered
             { 0, vertexLayout.stride(), vk::VertexInputRate::eVertex },
             // Step for each instance rendered
-            { 1, sizeof(InstanceData), vk::VertexInputRate::eInstance },
+            { 1, sizeof(VisibleInstance), vk::VertexInputRate::eInstance },
         };
 
         // Attribute descriptions
@@ -189,14 +384,12 @@ public:
             { 3, 0, vk::Format::eR32G32B32Sfloat, vertexLayout.offset(3) },
 
             // Instanced attributes
-            // Location 4 : Instance Position
-            { 4, 1, vk::Format::eR32G32B32Sfloat, offsetof(InstanceData, pos) },
-            // Location 5 : Instance Rotation
-            { 5, 1, vk::Format::eR32G32B32Sfloat, offsetof(InstanceData, rot) },
-            // Location 6 : Instance Scale
-            { 6, 1, vk::Format::eR32Sfloat, offsetof(InstanceData, scale) },
-            // Location 7 : Instance array layer
-            { 7, 1, vk::Format::eR32Sint, offsetof(InstanceData, texIndex) },
+            // Location 4 : Instance position and scale
+            { 4, 1, vk::Format::eR32G32B32A32Sfloat, offsetof(VisibleInstance, posScale) },
+            // Location 5 : Instance rotation
+            { 5, 1, vk::Format::eR16G16B16A16Snorm, offsetof(VisibleInstance, rotation) },
+            // Location 6 : Instance array layer
+            { 6, 1, vk::Format::eR32Uint, offsetof(VisibleInstance, texIndex) },
         };
 
         // Load shaders
@@ -205,7 +398,6 @@ public:
         // Instacing pipeline
         pipelines.instancedRocks = pipelineBuilder.create(context.pipelineCache);
 
-
         pipelineBuilder.destroyShaderModules();
         pipelineBuilder.loadShader(getAssetPath() + "shaders/instancing/planet.vert.spv", vk::ShaderStageFlagBits::eVertex);
         pipelineBuilder.loadShader(getAssetPath() + "shaders/instancing/planet.frag.spv", vk::ShaderStageFlagBits::eFragment);
@@ -220,52 +412,71 @@ public:
         pipelineBuilder.loadShader(getAssetPath() + "shaders/instancing/starfield.vert.spv", vk::ShaderStageFlagBits::eVertex);
         pipelineBuilder.loadShader(getAssetPath() + "shaders/instancing/starfield.frag.spv", vk::ShaderStageFlagBits::eFragment);
         pipelines.starfield = pipelineBuilder.create(context.pipelineCache);
-    }
 
-    float rnd(float range) { return range * (rand() / float(RAND_MAX)); }
-    uint32_t rnd(uint32_t range) { return (uint32_t)rnd((float)range); }
+        // Impostors, which only take the instanced attributes.  The billboards face the view closest to the camera,
+        // not the camera itself, so they are drawn from both sides
+        pipelineBuilder.destroyShaderModules();
+        pipelineBuilder.layout = impostorPipelineLayout;
+        pipelineBuilder.depthStencilState.depthWriteEnable = VK_TRUE;
+        pipelineBuilder.vertexInputState.bindingDescriptions = {
+            { 1, sizeof(VisibleInstance), vk::VertexInputRate::eInstance },
+        };
+        pipelineBuilder.vertexInputState.attributeDescriptions = {
+            { 4, 1, vk::Format::eR32G32B32A32Sfloat, offsetof(VisibleInstance, posScale) },
+            { 5, 1, vk::Format::eR16G16B16A16Snorm, offsetof(VisibleInstance, rotation) },
+            { 6, 1, vk::Format::eR32Uint, offsetof(VisibleInstance, texIndex) },
+        };
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/instancing/impostor.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/instancing/impostor.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipelines.impostors = pipelineBuilder.create(context.pipelineCache);
+
+        // Instance generation and culling, and the pass finalizing the draws, differ in a specialization constant
+        vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+        computePipelineCreateInfo.layout = cull.pipelineLayout;
+        computePipelineCreateInfo.stage =
+            vks::shaders::loadShader(device, getAssetPath() + "shaders/instancing/instances.comp.spv", vk::ShaderStageFlagBits::eCompute);
+        vk::SpecializationMapEntry specializationEntry{ 0, 0, sizeof(VkBool32) };
+        VkBool32 finalize = VK_FALSE;
+        vk::SpecializationInfo specializationInfo{ 1, &specializationEntry, sizeof(finalize), &finalize };
+        computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+        cull.pipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+        finalize = VK_TRUE;
+        cull.finalizePipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+    }
 
     void prepareInstanceData() {
-        std::vector<InstanceData> instanceData;
-        instanceData.resize(INSTANCE_COUNT);
-
-        std::default_random_engine rndGenerator(benchmark.active ? 0 : (unsigned)time(nullptr));
-        std::uniform_real_distribution<float> uniformDist(0.0, 1.0);
-        std::uniform_int_distribution<uint32_t> rndTextureIndex(0, textures.rocks.layerCount);
-
-        // Distribute rocks randomly on two different rings
-        for (auto i = 0; i < INSTANCE_COUNT / 2; i++) {
-            glm::vec2 ring0{ 7.0f, 11.0f };
-            glm::vec2 ring1{ 14.0f, 18.0f };
-
-            float rho, theta;
-
-            // Inner ring
-            rho = sqrt((pow(ring0[1], 2.0f) - pow(ring0[0], 2.0f)) * uniformDist(rndGenerator) + pow(ring0[0], 2.0f));
-            theta = 2.0 * M_PI * uniformDist(rndGenerator);
-            instanceData[i].pos = glm::vec3(rho*cos(theta), uniformDist(rndGenerator) * 0.5f - 0.25f, rho*sin(theta));
-            instanceData[i].rot = glm::vec3(M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator));
-            instanceData[i].scale = 1.5f + uniformDist(rndGenerator) - uniformDist(rndGenerator);
-            instanceData[i].texIndex = rndTextureIndex(rndGenerator);
-            instanceData[i].scale *= 0.75f;
-
-            // Outer ring
-            rho = sqrt((pow(ring1[1], 2.0f) - pow(ring1[0], 2.0f)) * uniformDist(rndGenerator) + pow(ring1[0], 2.0f));
-            theta = 2.0 * M_PI * uniformDist(rndGenerator);
-            instanceData[i + INSTANCE_COUNT / 2].pos = glm::vec3(rho*cos(theta), uniformDist(rndGenerator) * 0.5f - 0.25f, rho*sin(theta));
-            instanceData[i + INSTANCE_COUNT / 2].rot = glm::vec3(M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator));
-            instanceData[i + INSTANCE_COUNT / 2].scale = 1.5f + uniformDist(rndGenerator) - uniformDist(rndGenerator);
-            instanceData[i + INSTANCE_COUNT / 2].texIndex = rndTextureIndex(rndGenerator);
-            instanceData[i + INSTANCE_COUNT / 2].scale *= 0.75f;
-        }
-
-        // Staging
-        // Instanced data is static, copy to device local memory
-        // This results in better performance
-        instanceBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, instanceData);
+        seed = benchmark.active ? 0 : (uint32_t)time(nullptr);
+        const vk::DeviceSize maxRange = context.deviceProperties.limits.maxStorageBufferRange;
+        instanceCapacity = (uint32_t)std::min<vk::DeviceSize>(MAX_INSTANCE_COUNT, maxRange / sizeof(VisibleInstance));
+        instanceCount = std::min(instanceCount, (int32_t)instanceCapacity);
+        // Written by the compute shader and read as vertex input, sized for every instance being visible
+        instanceBuffer = context.createDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+                                                    sizeof(VisibleInstance) * instanceCapacity);
+
+        // The draws start out without instances, the low detail instances are appended downwards from the end
+        std::vector<vk::DrawIndexedIndirectCommand> draws(LOD_COUNT);
+        draws[LOD_HIGH].indexCount = models.rock.indexCount;
+        draws[LOD_LOW].indexCount = vks::model::Impostor::QUAD_VERTEX_COUNT;
+        draws[LOD_LOW].firstInstance = instanceCapacity;
+        drawsTemplate = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eTransferSrc, draws);
+        drawsBuffer = context.createDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer |
+                                                     vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc,
+                                                 sizeof(vk::DrawIndexedIndirectCommand) * LOD_COUNT);
+        drawsReadback = context.createBuffer(vk::BufferUsageFlagBits::eTransferDst,
+                                             vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                             drawsBuffer.size * swapChain.imageCount);
+        drawsReadback.map();
+        memset(drawsReadback.mapped, 0, drawsReadback.size);
     }
 
     void prepareUniformBuffers() {
+        // Instances rotate around their origin, the bounds have to cover every orientation
+        const auto& dim = models.rock.dim;
+        uboVS.radius = glm::length(glm::max(glm::abs(dim.min), glm::abs(dim.max)));
+        if (!context.enabledFeatures.drawIndirectFirstInstance) {
+            uboVS.lodPixels = 0.0f;
+        }
         uniformData.scene = context.createUniformBuffer(uboVS);
         updateUniformBuffer(true);
     }
@@ -274,6 +485,10 @@ public:
         if (viewChanged) {
             uboVS.projection = getProjection();
             uboVS.view = camera.matrices.view;
+            uboVS.cameraPos = glm::inverse(uboVS.view)[3];
+            uboVS.pixelScale = 0.5f * (float)size.height * uboVS.projection[1][1];
+            frustum.update(uboVS.projection * uboVS.view);
+            memcpy(uboVS.frustumPlanes, frustum.planes.data(), sizeof(glm::vec4) * 6);
         }
 
         if (!paused) {
@@ -295,6 +510,17 @@ public:
         prepared = true;
     }
 
+    void draw() override {
+        prepareFrame();
+        // The image's previous frame has completed, the copy of its draws is up to date
+        const auto* draws = static_cast<const vk::DrawIndexedIndirectCommand*>(drawsReadback.mapped) + LOD_COUNT * currentBuffer;
+        for (uint32_t lod = 0; lod < LOD_COUNT; ++lod) {
+            visibleCounts[lod] = draws[lod].instanceCount;
+        }
+        drawCurrentCommandBuffer();
+        submitFrame();
+    }
+
     void render() override {
         if (!prepared) {
             return;
@@ -306,6 +532,28 @@ public:
     }
 
     void viewChanged() override { updateUniformBuffer(true); }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            if (ui.sliderInt("Instances", &instanceCount, 1, (int32_t)instanceCapacity)) {
+                // The dispatch size is recorded into the command buffers
+                buildCommandBuffers();
+            }
+            bool changed = ui.sliderFloat("Cull below (px)", &uboVS.cullPixels, 0.0f, 4.0f);
+            if (context.enabledFeatures.drawIndirectFirstInstance) {
+                changed |= ui.sliderFloat("Low detail below (px)", &uboVS.lodPixels, 0.0f, 64.0f);
+            } else {
+                ui.text("drawIndirectFirstInstance not supported");
+            }
+            if (changed) {
+                updateUniformBuffer(false);
+            }
+        }
+        if (ui.header("Statistics")) {
+            ui.text("High detail: %u", visibleCounts[LOD_HIGH]);
+            ui.text("Low detail: %u", visibleCounts[LOD_LOW]);
+        }
+    }
 };
 
 RUN_EXAMPLE(VulkanExample)
@@ -50,10 +50,9 @@ public:
         glm::vec4 lightPos = glm::vec4(25.0f, 5.0f, 5.0f, 1.0f);
     } uboVS;
 
-    struct {
-        vk::Pipeline solid;
-        vk::Pipeline wireframe;
-    } pipelines;
+    // Solid and wire frame rendering.  Where the device can set the polygon mode dynamically they're one pipeline.
+    vks::pipelines::DynamicStatePipelines pipelines{ device };
+    vks::pipelines::DynamicRasterizationState rasterizationState;
 
     vk::PipelineLayout pipelineLayout;
     vk::DescriptorSet descriptorSet;
@@ -65,13 +64,13 @@ public:
         camera.setRotation({ -0.5f, -112.75f, 0.0f });
         camera.setTranslation({ -0.1f, 1.1f, -5.5f });
         title = "Vulkan Example - Mesh rendering";
+        context.enableExtendedDynamicState = true;
     }
 
     ~VulkanExample() {
         // Clean up used Vulkan resources
         // Note : Inherited destructor cleans up resources stored in base class
-        device.destroyPipeline(pipelines.wireframe);
-        device.destroyPipeline(pipelines.solid);
+        pipelines.destroy();
         device.destroyPipelineLayout(pipelineLayout);
         device.destroyDescriptorSetLayout(descriptorSetLayout);
 
@@ -85,11 +84,12 @@ public:
         cmdBuffer.setViewport(0, vks::util::viewport(size));
         cmdBuffer.setScissor(0, vks::util::rect2D(size));
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
-        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, wireframe ? pipelines.wireframe : pipelines.solid);
+        rasterizationState.polygonMode = wireframe ? vk::PolygonMode::eLine : vk::PolygonMode::eFill;
+        pipelines.bind(cmdBuffer, rasterizationState, context.dynamicDispatch, context.pipelineCache);
         // Bind mesh vertex buffer
         cmdBuffer.bindVertexBuffers(0, meshes.model.vertices.buffer, { 0 });
         // Bind mesh index buffer
-        cmdBuffer.bindIndexBuffer(meshes.model.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.model.indices.buffer, 0, meshes.model.indexType);
         // Render mesh vertex buffer using it's indices
         cmdBuffer.drawIndexed(meshes.model.indexCount, 1, 0, 0, 0);
     }
@@ -137,17 +137,21 @@ public:
     }
 
     void preparePipelines() {
-        // Solid rendering pipeline
-        vks::pipelines::GraphicsPipelineBuilder pipelineBuilder{ device, pipelineLayout, renderPass };
+        auto& pipelineBuilder = pipelines.builder;
+        pipelineBuilder.layout = pipelineLayout;
+        pipelineBuilder.renderPass = renderPass;
+        pipelineBuilder.extendedDynamicState = vks::pipelines::ExtendedDynamicState::enabled(context);
         pipelineBuilder.rasterizationState.frontFace = vk::FrontFace::eClockwise;
         pipelineBuilder.vertexInputState.appendVertexLayout(meshes.vertexLayout);
         pipelineBuilder.loadShader(getAssetPath() + "shaders/mesh/mesh.vert.spv", vk::ShaderStageFlagBits::eVertex);
         pipelineBuilder.loadShader(getAssetPath() + "shaders/mesh/mesh.frag.spv", vk::ShaderStageFlagBits::eFragment);
-        pipelines.solid = pipelineBuilder.create(context.pipelineCache);
+        rasterizationState = pipelineBuilder.dynamicRasterizationState();
 
-        // Wire frame rendering pipeline
-        pipelineBuilder.rasterizationState.polygonMode = vk::PolygonMode::eLine;
-        pipelines.wireframe = pipelineBuilder.create(context.pipelineCache);
+        // Solid and wire frame rendering pipelines, up front rather than when first drawn
+        pipelines.get(rasterizationState, context.pipelineCache);
+        auto wireframeState = rasterizationState;
+        wireframeState.polygonMode = vk::PolygonMode::eLine;
+        pipelines.get(wireframeState, context.pipelineCache);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
@@ -1,6 +1,10 @@
 /*
 * Vulkan Example - Multisampling using resolve attachments
 *
+* The multisampled targets only live in tile memory, they're resolved at the end of the render pass and never stored.
+* With VK_KHR_depth_stencil_resolve the depth is resolved as well, into the single sampled depth buffer.  Pass
+* --min-sample-shading <fraction> to shade that fraction of the samples of every pixel instead of once per pixel.
+*
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
@@ -51,6 +55,8 @@ public:
     vk::DescriptorSet descriptorSet;
     vk::DescriptorSetLayout descriptorSetLayout;
     vk::RenderPass uiRenderPass;
+    // Fraction of the samples shaded per pixel, 0 shades once per pixel
+    float minSampleShading = 0.0f;
 
     VulkanExample() {
         zoomSpeed = 2.5f;
@@ -58,6 +64,20 @@ public:
         camera.setTranslation({ 2.5f, 2.5f, -7.5 });
         title = "Vulkan Example - Multisampling";
         settings.overlay = false;
+        context.enableDepthStencilResolve = true;
+
+        const auto& args = vkx::getCommandLine();
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (args[i] == "--min-sample-shading" && i + 1 < args.size()) {
+                minSampleShading = std::max(0.0f, std::min(1.0f, std::stof(args[++i])));
+            }
+        }
+    }
+
+    void getEnabledFeatures() override {
+        if (minSampleShading > 0.0f && context.deviceFeatures.sampleRateShading) {
+            context.enabledFeatures.sampleRateShading = VK_TRUE;
+        }
     }
 
     // UI overlay configuration needs to be adjusted for this example (renderpass setup, attachment count, etc.)
@@ -84,12 +104,8 @@ public:
         meshes.example.destroy();
 
         // Destroy MSAA target
-        device.destroyImage(multisampleTarget.color.image);
-        device.destroyImageView(multisampleTarget.color.view);
-        device.freeMemory(multisampleTarget.color.memory);
-        device.destroyImage(multisampleTarget.depth.image);
-        device.destroyImageView(multisampleTarget.depth.view);
-        device.freeMemory(multisampleTarget.depth.memory);
+        multisampleTarget.color.destroy();
+        multisampleTarget.depth.destroy();
 
         textures.colorMap.destroy();
 
@@ -105,6 +121,12 @@ public:
         vk::SampleCountFlags requiredSamples = SAMPLE_COUNT;
         assert((uint32_t)colorSampleCount >= (uint32_t)requiredSamples && (uint32_t)depthSampleCount >= (uint32_t)requiredSamples);
 
+        // Frames in flight may still be rendering to the previous ones
+        if (multisampleTarget.color) {
+            context.trash(multisampleTarget.color);
+            context.trash(multisampleTarget.depth);
+        }
+
         // Color target
         vk::ImageCreateInfo info;
         info.imageType = vk::ImageType::e2D;
@@ -117,18 +139,9 @@ public:
         info.sharingMode = vk::SharingMode::eExclusive;
         info.tiling = vk::ImageTiling::eOptimal;
         info.samples = SAMPLE_COUNT;
-        // vk::Image will only be used as a transient target
-        info.usage = vk::ImageUsageFlagBits::eTransientAttachment | vk::ImageUsageFlagBits::eColorAttachment;
+        info.usage = vk::ImageUsageFlagBits::eColorAttachment;
         info.initialLayout = vk::ImageLayout::eUndefined;
-        multisampleTarget.color = context.createImage(info, vk::MemoryPropertyFlagBits::eDeviceLocal);
-
-        //// We prefer a lazily allocated memory type
-        //// This means that the memory get allocated when the implementation sees fit, e.g. when first using the images
-        //vk::Bool32 lazyMemType = getMemoryType(memReqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eLazilyAllocated, &memAlloc.memoryTypeIndex);
-        //if (!lazyMemType) {
-        //    // If this is not available, fall back to device local memory
-        //    getMemoryType(memReqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal, &memAlloc.memoryTypeIndex);
-        //}
+        multisampleTarget.color = context.createTransientImage(info);
 
         // Create image view for the MSAA target
         vk::ImageViewCreateInfo viewInfo;
@@ -146,42 +159,20 @@ public:
         multisampleTarget.color.view = device.createImageView(viewInfo);
 
         // Depth target
-        info.imageType = vk::ImageType::e2D;
         info.format = depthFormat;
-        info.extent.width = size.width;
-        info.extent.height = size.height;
-        info.extent.depth = 1;
-        info.mipLevels = 1;
-        info.arrayLayers = 1;
-        info.sharingMode = vk::SharingMode::eExclusive;
-        info.tiling = vk::ImageTiling::eOptimal;
-        info.samples = SAMPLE_COUNT;
-        // vk::Image will only be used as a transient target
-        info.usage = vk::ImageUsageFlagBits::eTransientAttachment | vk::ImageUsageFlagBits::eDepthStencilAttachment;
-        info.initialLayout = vk::ImageLayout::eUndefined;
-        multisampleTarget.depth = context.createImage(info, vk::MemoryPropertyFlagBits::eDeviceLocal);
+        info.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
+        multisampleTarget.depth = context.createTransientImage(info);
 
         // Create image view for the MSAA target
         viewInfo.image = multisampleTarget.depth.image;
-        viewInfo.viewType = vk::ImageViewType::e2D;
         viewInfo.format = depthFormat;
         viewInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
-        viewInfo.subresourceRange.levelCount = 1;
-        viewInfo.subresourceRange.layerCount = 1;
 
         multisampleTarget.depth.view = device.createImageView(viewInfo);
+    }
 
-        // Initial image layout transitions
-        // We need to transform the MSAA target layouts before using them
-        context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& setupCmdBuffer) {
-            // Tansform MSAA color target
-            context.setImageLayout(setupCmdBuffer, multisampleTarget.color.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined,
-                                   vk::ImageLayout::eColorAttachmentOptimal);
-
-            // Tansform MSAA depth target
-            context.setImageLayout(setupCmdBuffer, multisampleTarget.depth.image, vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil,
-                                   vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal);
-        });
+    static bool hasStencil(vk::Format format) {
+        return format == vk::Format::eD16UnormS8Uint || format == vk::Format::eD24UnormS8Uint || format == vk::Format::eD32SfloatS8Uint;
     }
 
     // Setup a render pass for using a multi sampled attachment
@@ -190,9 +181,9 @@ public:
     void setupRenderPass() override {
         // Overrides the virtual function of the base class
 
-        std::array<vk::AttachmentDescription, 4> attachments = {};
+        std::vector<vk::AttachmentDescription> attachments(3);
 
-        // Multisampled attachment that we render to
+        // Multisampled attachment that we render to.  Cleared on load and never stored, it only ever lives on the tile.
         attachments[0].format = colorformat;
         attachments[0].samples = SAMPLE_COUNT;
         attachments[0].loadOp = vk::AttachmentLoadOp::eClear;
@@ -200,7 +191,7 @@ public:
         attachments[0].storeOp = vk::AttachmentStoreOp::eDontCare;
         attachments[0].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
         attachments[0].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-        attachments[0].initialLayout = vk::ImageLayout::eColorAttachmentOptimal;
+        attachments[0].initialLayout = vk::ImageLayout::eUndefined;
         attachments[0].finalLayout = vk::ImageLayout::eColorAttachmentOptimal;
 
         // This is the frame buffer attachment to where the multisampled image
@@ -221,18 +212,17 @@ public:
         attachments[2].storeOp = vk::AttachmentStoreOp::eDontCare;
         attachments[2].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
         attachments[2].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-        attachments[2].initialLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+        attachments[2].initialLayout = vk::ImageLayout::eUndefined;
         attachments[2].finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
 
-        // Depth resolve attachment
-        attachments[3].format = depthFormat;
-        attachments[3].samples = vk::SampleCountFlagBits::e1;
-        attachments[3].loadOp = vk::AttachmentLoadOp::eDontCare;
-        attachments[3].storeOp = vk::AttachmentStoreOp::eStore;
-        attachments[3].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
-        attachments[3].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-        attachments[3].initialLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
-        attachments[3].finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+        std::vector<vk::SubpassDependency> dependencies{ { 0, VK_SUBPASS_EXTERNAL, vk::PipelineStageFlagBits::eBottomOfPipe,
+                                                           vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlagBits::eColorAttachmentWrite,
+                                                           vk::AccessFlagBits::eColorAttachmentRead } };
+
+        if (context.depthStencilResolveEnabled) {
+            setupDepthResolveRenderPass(attachments, dependencies);
+            return;
+        }
 
         vk::AttachmentReference colorReference;
         colorReference.attachment = 0;
@@ -242,25 +232,19 @@ public:
         depthReference.attachment = 2;
         depthReference.layout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
 
-        // Two resolve attachment references for color and depth
-        std::array<vk::AttachmentReference, 2> resolveReferences = {};
-        resolveReferences[0].attachment = 1;
-        resolveReferences[0].layout = vk::ImageLayout::eColorAttachmentOptimal;
-        resolveReferences[1].attachment = 3;
-        resolveReferences[1].layout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+        // Resolve attachments are per color attachment, depth can only be resolved with VK_KHR_depth_stencil_resolve
+        vk::AttachmentReference resolveReference;
+        resolveReference.attachment = 1;
+        resolveReference.layout = vk::ImageLayout::eColorAttachmentOptimal;
 
         vk::SubpassDescription subpass;
         subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
         subpass.colorAttachmentCount = 1;
         subpass.pColorAttachments = &colorReference;
-        // Pass our resolve attachments to the sub pass
-        subpass.pResolveAttachments = resolveReferences.data();
+        // Pass our resolve attachment to the sub pass
+        subpass.pResolveAttachments = &resolveReference;
         subpass.pDepthStencilAttachment = &depthReference;
 
-        std::vector<vk::SubpassDependency> dependencies{ { 0, VK_SUBPASS_EXTERNAL, vk::PipelineStageFlagBits::eBottomOfPipe,
-                                                           vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlagBits::eColorAttachmentWrite,
-                                                           vk::AccessFlagBits::eColorAttachmentRead } };
-
         vk::RenderPassCreateInfo renderPassInfo;
         renderPassInfo.attachmentCount = (uint32_t)attachments.size();
         renderPassInfo.pAttachments = attachments.data();
@@ -272,19 +256,78 @@ public:
         renderPass = device.createRenderPass(renderPassInfo);
     }
 
+    // The same render pass, with the multisampled depth also resolved into the depth buffer of the base class, where
+    // later passes could test against or sample it
+    void setupDepthResolveRenderPass(const std::vector<vk::AttachmentDescription>& attachments, const std::vector<vk::SubpassDependency>& dependencies) {
+        std::vector<vk::AttachmentDescription2> attachments2;
+        for (const auto& attachment : attachments) {
+            attachments2.push_back({ attachment.flags, attachment.format, attachment.samples, attachment.loadOp, attachment.storeOp,
+                                     attachment.stencilLoadOp, attachment.stencilStoreOp, attachment.initialLayout, attachment.finalLayout });
+        }
+        // Depth resolve attachment
+        const bool stencil = hasStencil(depthFormat);
+        vk::AttachmentDescription2 depthResolve;
+        depthResolve.format = depthFormat;
+        depthResolve.samples = vk::SampleCountFlagBits::e1;
+        depthResolve.loadOp = vk::AttachmentLoadOp::eDontCare;
+        depthResolve.storeOp = vk::AttachmentStoreOp::eStore;
+        depthResolve.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+        depthResolve.stencilStoreOp = stencil ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
+        depthResolve.initialLayout = vk::ImageLayout::eUndefined;
+        depthResolve.finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+        attachments2.push_back(depthResolve);
+
+        const vk::ImageAspectFlags depthAspect = stencil ? vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil
+                                                         : vk::ImageAspectFlags(vk::ImageAspectFlagBits::eDepth);
+        vk::AttachmentReference2 colorReference{ 0, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageAspectFlagBits::eColor };
+        vk::AttachmentReference2 resolveReference{ 1, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageAspectFlagBits::eColor };
+        vk::AttachmentReference2 depthReference{ 2, vk::ImageLayout::eDepthStencilAttachmentOptimal, depthAspect };
+        vk::AttachmentReference2 depthResolveReference{ 3, vk::ImageLayout::eDepthStencilAttachmentOptimal, depthAspect };
+
+        // Sample zero is the one mode every implementation supports for depth and for stencil, and using the same for
+        // both is allowed whatever the independent resolve limits are
+        vk::SubpassDescriptionDepthStencilResolve subpassResolve;
+        subpassResolve.depthResolveMode = vk::ResolveModeFlagBits::eSampleZero;
+        subpassResolve.stencilResolveMode = stencil ? vk::ResolveModeFlagBits::eSampleZero : vk::ResolveModeFlagBits::eNone;
+        subpassResolve.pDepthStencilResolveAttachment = &depthResolveReference;
+
+        vk::SubpassDescription2 subpass;
+        subpass.pNext = &subpassResolve;
+        subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &colorReference;
+        subpass.pResolveAttachments = &resolveReference;
+        subpass.pDepthStencilAttachment = &depthReference;
+
+        std::vector<vk::SubpassDependency2> dependencies2;
+        for (const auto& dependency : dependencies) {
+            dependencies2.push_back({ dependency.srcSubpass, dependency.dstSubpass, dependency.srcStageMask, dependency.dstStageMask,
+                                      dependency.srcAccessMask, dependency.dstAccessMask, dependency.dependencyFlags });
+        }
+
+        vk::RenderPassCreateInfo2 renderPassInfo;
+        renderPassInfo.attachmentCount = (uint32_t)attachments2.size();
+        renderPassInfo.pAttachments = attachments2.data();
+        renderPassInfo.dependencyCount = (uint32_t)dependencies2.size();
+        renderPassInfo.pDependencies = dependencies2.data();
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+
+        renderPass = device.createRenderPass2KHR(renderPassInfo, nullptr, context.dynamicDispatch);
+    }
+
     // Frame buffer attachments must match with render pass setup,
     // so we need to adjust frame buffer creation to cover our
     // multisample target
     void setupFrameBuffer() override {
         // Overrides the virtual function of the base class
-        std::array<vk::ImageView, 4> attachments;
-
         setupMultisampleTarget();
 
-        attachments[0] = multisampleTarget.color.view;
+        std::vector<vk::ImageView> attachments{ multisampleTarget.color.view, nullptr, multisampleTarget.depth.view };
         // attachment[1] = swapchain image
-        attachments[2] = multisampleTarget.depth.view;
-        attachments[3] = depthStencil.view;
+        if (context.depthStencilResolveEnabled) {
+            attachments.push_back(depthStencil.view);
+        }
 
         vk::FramebufferCreateInfo framebufferCreateInfo;
         framebufferCreateInfo.renderPass = renderPass;
@@ -318,7 +361,7 @@ public:
 
         vk::DeviceSize offsets = 0;
         cmdBuffer.bindVertexBuffers(0, meshes.example.vertices.buffer, offsets);
-        cmdBuffer.bindIndexBuffer(meshes.example.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.example.indices.buffer, 0, meshes.example.indexType);
         cmdBuffer.drawIndexed(meshes.example.indexCount, 1, 0, 0, 0);
     }
 
@@ -373,6 +416,10 @@ public:
         vks::pipelines::GraphicsPipelineBuilder pipelineBuilder{ device, pipelineLayout, renderPass };
         pipelineBuilder.rasterizationState.frontFace = vk::FrontFace::eClockwise;
         pipelineBuilder.multisampleState.rasterizationSamples = SAMPLE_COUNT;
+        if (context.enabledFeatures.sampleRateShading) {
+            pipelineBuilder.multisampleState.sampleShadingEnable = VK_TRUE;
+            pipelineBuilder.multisampleState.minSampleShading = minSampleShading;
+        }
         pipelineBuilder.vertexInputState.appendVertexLayout(vertexLayout);
         // Load shaders
         pipelineBuilder.loadShader(getAssetPath() + "shaders/mesh/mesh.vert.spv", vk::ShaderStageFlagBits::eVertex);
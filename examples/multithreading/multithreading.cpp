@@ -0,0 +1,334 @@
+/*
+* Vulkan Example - Multi threaded command buffer generation and rendering
+*
+* Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <vulkanExampleBase.h>
+
+#include <atomic>
+#include <ctime>
+#include <random>
+
+#include <vks/frustum.hpp>
+#include <vks/scheduler.hpp>
+
+// Number of animated objects to be rendered by using threads and secondary command buffers
+#define OBJECT_COUNT 512
+// Objects recorded into each secondary command buffer.  Ranges of this size are what the scheduler hands out,
+// so smaller values balance better across threads at the cost of more secondaries.
+#define OBJECTS_PER_RANGE 16
+
+// Vertex layout for this example
+vks::model::VertexLayout vertexLayout{ {
+    vks::model::Component::VERTEX_COMPONENT_POSITION,
+    vks::model::Component::VERTEX_COMPONENT_NORMAL,
+    vks::model::Component::VERTEX_COMPONENT_COLOR,
+} };
+
+class VulkanExample : public vkx::ExampleBase {
+    using Parent = vkx::ExampleBase;
+
+public:
+    struct {
+        vks::model::Model ufo;
+        vks::model::Model skysphere;
+    } models;
+
+    // Shared matrices used for the push constant blocks
+    struct {
+        glm::mat4 projection;
+        glm::mat4 view;
+    } matrices;
+
+    struct {
+        vk::Pipeline phong;
+        vk::Pipeline starsphere;
+    } pipelines;
+
+    vk::PipelineLayout pipelineLayout;
+
+    // Use push constants to update shader parameters on a per object basis
+    struct PushConstantBlock {
+        glm::mat4 mvp;
+        glm::vec3 color;
+    };
+
+    struct ObjectData {
+        glm::mat4 model;
+        glm::vec3 pos;
+        glm::vec3 rotation;
+        float rotationDir;
+        float rotationSpeed;
+        float scale;
+        float deltaT;
+        PushConstantBlock pushConstants;
+    };
+    std::vector<ObjectData> objects;
+
+    // Secondary command buffers of one thread, reused in order every time the thread records for the image
+    struct WorkerCommandBuffers {
+        std::vector<vk::CommandBuffer> commandBuffers;
+        size_t used{ 0 };
+    };
+
+    // Everything recorded for a single swap chain image.  Only touched once the image's previous frame has completed.
+    struct ImageRecording {
+        vk::CommandBuffer skysphere;
+        // Indexed by TaskScheduler::workerIndex, so each thread allocates from (and records into) its own pool
+        std::vector<WorkerCommandBuffers> workers;
+        // The secondary recorded for each object range, or null if the whole range was culled
+        std::vector<vk::CommandBuffer> ranges;
+    };
+    std::vector<ImageRecording> recordings;
+
+    std::atomic<uint32_t> visibleObjects{ 0 };
+
+    // Max. dimension of the ufo mesh for use as the sphere radius for frustum culling
+    float objectSphereDim{ 0.0f };
+
+    // View frustum for culling invisible objects
+    vks::Frustum frustum;
+    // Bounding spheres of the objects, updated along with their animation and culled a range at a time
+    vks::SphereArray bounds;
+
+    VulkanExample() {
+        camera.dolly(-32.5f);
+        zoomSpeed = 2.5f;
+        rotationSpeed = 0.5f;
+        camera.setRotation({ 0.0f, 37.5f, 0.0f });
+        title = "Vulkan Example - Multi threaded rendering";
+    }
+
+    ~VulkanExample() {
+        // Clean up used Vulkan resources
+        // Note : Inherited destructor cleans up resources stored in base class
+        // Secondary command buffers are released along with the per thread command pools by the context
+        device.destroyPipeline(pipelines.phong);
+        device.destroyPipeline(pipelines.starsphere);
+
+        device.destroyPipelineLayout(pipelineLayout);
+
+        models.ufo.destroy();
+        models.skysphere.destroy();
+    }
+
+    void loadAssets() override {
+        models.ufo.loadFromFile(context, getAssetPath() + "models/retroufo_red_lowpoly.dae", vertexLayout, 0.12f);
+        models.skysphere.loadFromFile(context, getAssetPath() + "models/sphere.obj", vertexLayout, 1.0f);
+        objectSphereDim = std::max(std::max(models.ufo.dim.size.x, models.ufo.dim.size.y), models.ufo.dim.size.z);
+    }
+
+    void prepareObjects() {
+        // Benchmark runs always lay out the same scene
+        std::default_random_engine rndEngine(benchmark.active ? 0 : (unsigned)time(nullptr));
+        std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
+        auto rnd = [&](float range) { return range * rndDist(rndEngine); };
+
+        objects.resize(OBJECT_COUNT);
+        bounds.resize(OBJECT_COUNT);
+        const float maxX = std::floor(std::sqrt((float)OBJECT_COUNT));
+        float posX = 0.0f;
+        float posZ = 0.0f;
+        for (auto& object : objects) {
+            object.pos.x = (posX - maxX / 2.0f) * 3.0f + rnd(1.5f) - rnd(1.5f);
+            object.pos.z = (posZ - maxX / 2.0f) * 3.0f + rnd(1.5f) - rnd(1.5f);
+            posX += 1.0f;
+            if (posX >= maxX) {
+                posX = 0.0f;
+                posZ += 1.0f;
+            }
+            object.rotation = glm::vec3(0.0f, rnd(360.0f), 0.0f);
+            object.deltaT = rnd(1.0f);
+            object.rotationDir = (rnd(100.0f) < 50.0f) ? 1.0f : -1.0f;
+            object.rotationSpeed = (2.0f + rnd(4.0f)) * object.rotationDir;
+            object.scale = 0.75f + rnd(0.5f);
+            object.pushConstants.color = glm::vec3(rnd(1.0f), rnd(1.0f), rnd(1.0f));
+        }
+    }
+
+    void setupPipelineLayout() {
+        // Push constants for model matrices
+        vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eVertex, 0, sizeof(PushConstantBlock) };
+        pipelineLayout = device.createPipelineLayout({ {}, 0, nullptr, 1, &pushConstantRange });
+    }
+
+    void preparePipelines() {
+        vks::pipelines::GraphicsPipelineBuilder pipelineBuilder{ device, pipelineLayout, renderPass };
+        pipelineBuilder.rasterizationState.frontFace = vk::FrontFace::eClockwise;
+        pipelineBuilder.vertexInputState.appendVertexLayout(vertexLayout);
+
+        // Solid rendering pipeline
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/multithreading/phong.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/multithreading/phong.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipelines.phong = pipelineBuilder.create(context.pipelineCache);
+        pipelineBuilder.destroyShaderModules();
+
+        // Star sphere rendering pipeline
+        pipelineBuilder.rasterizationState.cullMode = vk::CullModeFlagBits::eFront;
+        pipelineBuilder.depthStencilState.depthWriteEnable = VK_FALSE;
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/multithreading/starsphere.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/multithreading/starsphere.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipelines.starsphere = pipelineBuilder.create(context.pipelineCache);
+    }
+
+    // Called from whichever thread is running the range, so it only touches that thread's command buffers
+    vk::CommandBuffer acquireSecondary(ImageRecording& recording) {
+        auto& worker = recording.workers[getScheduler().workerIndex()];
+        if (worker.used == worker.commandBuffers.size()) {
+            worker.commandBuffers.push_back(device.allocateCommandBuffers({ context.getCommandPool(), vk::CommandBufferLevel::eSecondary, 1 })[0]);
+        }
+        return worker.commandBuffers[worker.used++];
+    }
+
+    void updateObject(ObjectData& object) {
+        if (!paused) {
+            object.rotation.y += 2.5f * object.rotationSpeed * frameTimer;
+            if (object.rotation.y > 360.0f) {
+                object.rotation.y -= 360.0f;
+            }
+            object.deltaT += 0.15f * frameTimer;
+            if (object.deltaT > 1.0f) {
+                object.deltaT -= 1.0f;
+            }
+            object.pos.y = sin(glm::radians(object.deltaT * 360.0f)) * 2.5f;
+        }
+
+        object.model = glm::translate(glm::mat4(), object.pos);
+        object.model = glm::rotate(object.model, -sinf(glm::radians(object.deltaT * 360.0f)) * 0.25f, glm::vec3(object.rotationDir, 0.0f, 0.0f));
+        object.model = glm::rotate(object.model, glm::radians(object.rotation.y), glm::vec3(0.0f, object.rotationDir, 0.0f));
+        object.model = glm::rotate(object.model, glm::radians(object.deltaT * 360.0f), glm::vec3(0.0f, object.rotationDir, 0.0f));
+        object.model = glm::scale(object.model, glm::vec3(object.scale));
+        object.pushConstants.mvp = matrices.projection * matrices.view * object.model;
+    }
+
+    // Animates and culls the objects in [begin, end) and records the visible ones into a single secondary
+    void recordRange(ImageRecording& recording, const vk::CommandBufferInheritanceInfo& inheritanceInfo, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            updateObject(objects[i]);
+            bounds.set(i, objects[i].pos, objectSphereDim * 0.5f);
+        }
+        std::vector<uint32_t> visible;
+        visible.reserve(end - begin);
+        frustum.cullSpheres(bounds, visible, begin, end);
+
+        vk::CommandBuffer cmdBuffer;
+        for (const auto index : visible) {
+            const auto& object = objects[index];
+            if (!cmdBuffer) {
+                cmdBuffer = acquireSecondary(recording);
+                cmdBuffer.begin({ vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eOneTimeSubmit, &inheritanceInfo });
+                cmdBuffer.setViewport(0, vks::util::viewport(size));
+                cmdBuffer.setScissor(0, vks::util::rect2D(size));
+                cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.phong);
+                cmdBuffer.bindVertexBuffers(0, models.ufo.vertices.buffer, { 0 });
+                cmdBuffer.bindIndexBuffer(models.ufo.indices.buffer, 0, models.ufo.indexType);
+            }
+            cmdBuffer.pushConstants<PushConstantBlock>(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, object.pushConstants);
+            cmdBuffer.drawIndexed(models.ufo.indexCount, 1, 0, 0, 0);
+        }
+        if (cmdBuffer) {
+            cmdBuffer.end();
+        }
+        recording.ranges[begin / OBJECTS_PER_RANGE] = cmdBuffer;
+        visibleObjects += (uint32_t)visible.size();
+    }
+
+    void recordSkysphere(const vk::CommandBuffer& cmdBuffer, const vk::CommandBufferInheritanceInfo& inheritanceInfo) {
+        cmdBuffer.begin({ vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eOneTimeSubmit, &inheritanceInfo });
+        cmdBuffer.setViewport(0, vks::util::viewport(size));
+        cmdBuffer.setScissor(0, vks::util::rect2D(size));
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.starsphere);
+        glm::mat4 mvp = matrices.projection * glm::mat4_cast(camera.orientation);
+        cmdBuffer.pushConstants<glm::mat4>(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, mvp);
+        cmdBuffer.bindVertexBuffers(0, models.skysphere.vertices.buffer, { 0 });
+        cmdBuffer.bindIndexBuffer(models.skysphere.indices.buffer, 0, models.skysphere.indexType);
+        cmdBuffer.drawIndexed(models.skysphere.indexCount, 1, 0, 0, 0);
+        cmdBuffer.end();
+    }
+
+    // The primaries are re-recorded every frame in draw, so only allocate them here
+    void buildCommandBuffers() override {
+        allocateCommandBuffers();
+        recordings.resize(swapChain.imageCount);
+        for (auto& recording : recordings) {
+            if (!recording.skysphere) {
+                recording.skysphere = device.allocateCommandBuffers({ cmdPool, vk::CommandBufferLevel::eSecondary, 1 })[0];
+            }
+            recording.workers.resize(getScheduler().workerCount());
+            recording.ranges.resize((OBJECT_COUNT + OBJECTS_PER_RANGE - 1) / OBJECTS_PER_RANGE);
+        }
+    }
+
+    // Records the frame for the current image.  Object ranges are spread across the scheduler's threads
+    // dynamically, so threads that get mostly culled ranges simply pick up more of them.
+    void updateCommandBuffer() {
+        auto& recording = recordings[currentBuffer];
+        const vk::Framebuffer framebuffer = framebuffers[currentBuffer];
+        const vk::CommandBufferInheritanceInfo inheritanceInfo{ renderPass, 0, framebuffer };
+
+        for (auto& worker : recording.workers) {
+            worker.used = 0;
+        }
+        visibleObjects = 0;
+
+        recordSkysphere(recording.skysphere, inheritanceInfo);
+        getScheduler().parallelFor(0, objects.size(), OBJECTS_PER_RANGE,
+                                   [&](size_t begin, size_t end) { recordRange(recording, inheritanceInfo, begin, end); });
+
+        // Ranges are executed in object order regardless of which thread recorded them
+        std::vector<vk::CommandBuffer> secondaries{ recording.skysphere };
+        for (const auto& range : recording.ranges) {
+            if (range) {
+                secondaries.push_back(range);
+            }
+        }
+
+        const auto& cmdBuffer = commandBuffers[currentBuffer];
+        cmdBuffer.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+        renderPassBeginInfo.framebuffer = framebuffer;
+        // The primary command buffer does not contain any rendering commands
+        // These are stored (and retrieved) from the secondary command buffers
+        cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+        cmdBuffer.executeCommands(secondaries);
+        cmdBuffer.endRenderPass();
+        cmdBuffer.end();
+    }
+
+    void draw() override {
+        prepareFrame();
+        // prepareFrame has waited for the image's previous frame, so its command buffers can be recorded again
+        updateCommandBuffer();
+        drawCurrentCommandBuffer();
+        submitFrame();
+    }
+
+    void updateMatrices() {
+        matrices.projection = camera.matrices.perspective;
+        matrices.view = camera.matrices.view;
+        frustum.update(matrices.projection * matrices.view);
+    }
+
+    void prepare() override {
+        Parent::prepare();
+        prepareObjects();
+        setupPipelineLayout();
+        preparePipelines();
+        updateMatrices();
+        buildCommandBuffers();
+        prepared = true;
+    }
+
+    void viewChanged() override { updateMatrices(); }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Statistics")) {
+            ui.text("Threads: %d", (int)getScheduler().workerCount());
+            ui.text("Visible objects: %d / %d", (int)visibleObjects.load(), (int)objects.size());
+        }
+    }
+};
+
+RUN_EXAMPLE(VulkanExample)
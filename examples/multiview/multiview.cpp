@@ -88,8 +88,7 @@ public:
             throw std::runtime_error("This example requires Vulkan 1.1");
         }
 
-        multiview.features = physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceMultiviewFeatures>(context.dynamicDispatch)
-                                 .get<vk::PhysicalDeviceMultiviewFeatures>();
+        multiview.features = context.supportedFeatures.multiview;
         if (!multiview.features.multiview) {
             throw std::runtime_error("Multiview unsupported");
         }
@@ -243,7 +242,7 @@ public:
         offscreen.cmdBuffer.setScissor(0, scissor);
         offscreen.cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
         offscreen.cmdBuffer.bindVertexBuffers(0, scene.vertices.buffer, { 0 });
-        offscreen.cmdBuffer.bindIndexBuffer(scene.indices.buffer, 0, vk::IndexType::eUint32);
+        offscreen.cmdBuffer.bindIndexBuffer(scene.indices.buffer, 0, scene.indexType);
         offscreen.cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
         offscreen.cmdBuffer.drawIndexed(scene.indexCount, 1, 0, 0, 0);
         offscreen.cmdBuffer.endRenderPass();
@@ -0,0 +1,194 @@
+/*
+* Vulkan Example - Rendering to several windows from one context
+*
+* The main window and every display opened with addDisplay share the device, the model, the pipeline and its layout.
+* Each window only has a swap chain, a depth buffer and a uniform buffer of its own, with the camera orbited around
+* the model by an equal share of a full turn per window.  All of them are drawn in one submit and shown with one
+* present, see ExampleBase::submitFrame.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <vulkanExampleBase.h>
+
+// Vertex layout for this example
+vks::model::VertexLayout vertexLayout{ {
+    vks::model::Component::VERTEX_COMPONENT_POSITION,
+    vks::model::Component::VERTEX_COMPONENT_NORMAL,
+    vks::model::Component::VERTEX_COMPONENT_COLOR,
+} };
+
+// Windows opened in addition to the main one, at most
+#define MAX_DISPLAYS 4
+
+class VulkanExample : public vkx::ExampleBase {
+public:
+    vks::model::Model model;
+
+    // Same uniform buffer layout as shader
+    struct UboVS {
+        glm::mat4 projection;
+        glm::mat4 modelView;
+        glm::vec4 lightPos = glm::vec4(0.0f, 2.0f, 1.0f, 0.0f);
+        glm::vec4 tint = glm::vec4(1.0f);
+    };
+
+    // The main window's view first, then one per display
+    struct View {
+        vks::Buffer uniformBuffer;
+        vk::DescriptorSet descriptorSet;
+    };
+    std::vector<View> views;
+
+    vk::PipelineLayout pipelineLayout;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::Pipeline pipeline;
+
+    uint32_t displayCount{ 2 };
+
+    VulkanExample() {
+        camera.dolly(-10.5f);
+        camera.setRotation({ -25.0f, 15.0f, 0.0f });
+        title = "Vulkan Example - Multiple windows";
+#if defined(__ANDROID__)
+        // A single window there, see addDisplay
+        displayCount = 0;
+#endif
+
+        const auto& args = vkx::getCommandLine();
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (args[i] == "--displays" && i + 1 < args.size()) {
+                displayCount = std::min<uint32_t>(MAX_DISPLAYS, (uint32_t)std::stoul(args[++i]));
+            }
+        }
+    }
+
+    ~VulkanExample() {
+        // Clean up used Vulkan resources
+        // Note : Inherited destructor cleans up resources stored in base class
+        device.destroyPipeline(pipeline);
+        device.destroyPipelineLayout(pipelineLayout);
+        device.destroyDescriptorSetLayout(descriptorSetLayout);
+        model.destroy();
+        for (auto& view : views) {
+            view.uniformBuffer.destroy();
+        }
+    }
+
+    void drawView(const vk::CommandBuffer& cmdBuffer, uint32_t index) {
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, views[index].descriptorSet, nullptr);
+        cmdBuffer.bindVertexBuffers(0, model.vertices.buffer, { 0 });
+        cmdBuffer.bindIndexBuffer(model.indices.buffer, 0, model.indexType);
+        cmdBuffer.drawIndexed(model.indexCount, 1, 0, 0, 0);
+    }
+
+    void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        cmdBuffer.setViewport(0, viewport());
+        cmdBuffer.setScissor(0, scissor());
+        drawView(cmdBuffer, 0);
+    }
+
+    void updateDisplayCommandBuffer(const vk::CommandBuffer& cmdBuffer, uint32_t index) override { drawView(cmdBuffer, index + 1); }
+
+    void loadAssets() override { model.loadFromFile(context, getAssetPath() + "models/treasure_smooth.dae", vertexLayout, 1.0f); }
+
+    void setupDescriptorSetLayout() {
+        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings = {
+            // Binding 0 : Vertex shader uniform buffer
+            { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+        };
+
+        descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+        pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+    }
+
+    void setupDescriptorSets() {
+        const uint32_t setCount = (uint32_t)views.size();
+        std::vector<vk::DescriptorPoolSize> poolSizes = {
+            { vk::DescriptorType::eUniformBuffer, setCount },
+        };
+        descriptorPool = device.createDescriptorPool({ {}, setCount, (uint32_t)poolSizes.size(), poolSizes.data() });
+
+        std::vector<vk::WriteDescriptorSet> writeDescriptorSets;
+        for (auto& view : views) {
+            view.descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+            // Binding 0 : Vertex shader uniform buffer
+            writeDescriptorSets.push_back({ view.descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &view.uniformBuffer.descriptor });
+        }
+        device.updateDescriptorSets(writeDescriptorSets, nullptr);
+    }
+
+    void preparePipelines() {
+        // Drawn in the default render pass, which the displays share with the main window
+        vks::pipelines::GraphicsPipelineBuilder pipelineBuilder{ device, pipelineLayout, renderPass };
+        pipelineBuilder.rasterizationState.frontFace = vk::FrontFace::eClockwise;
+        pipelineBuilder.vertexInputState.appendVertexLayout(vertexLayout);
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/multiwindow/phong.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/multiwindow/phong.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipeline = pipelineBuilder.create(context.pipelineCache);
+    }
+
+    void prepareUniformBuffers() {
+        views.resize(displayCount + 1);
+        for (auto& view : views) {
+            view.uniformBuffer = context.createUniformBuffer(UboVS{});
+        }
+        updateUniformBuffers();
+    }
+
+    void updateUniformBuffers() {
+        const glm::vec3 tints[MAX_DISPLAYS + 1] = {
+            { 1.0f, 1.0f, 1.0f }, { 1.0f, 0.7f, 0.7f }, { 0.7f, 1.0f, 0.7f }, { 0.7f, 0.7f, 1.0f }, { 1.0f, 1.0f, 0.6f },
+        };
+        for (uint32_t i = 0; i < (uint32_t)views.size(); ++i) {
+            // The displays are resized on their own, so each has its own aspect
+            const vk::Extent2D& extent = i ? displays[i - 1]->size : size;
+            UboVS ubo;
+            ubo.projection = glm::perspective(glm::radians(60.0f), (float)extent.width / (float)extent.height, 0.001f, 256.0f);
+            const float orbit = 360.0f * (float)i / (float)views.size();
+            ubo.modelView = camera.matrices.view * glm::rotate(glm::mat4(1.0f), glm::radians(orbit), glm::vec3(0.0f, 1.0f, 0.0f));
+            ubo.tint = glm::vec4(tints[i], 1.0f);
+            views[i].uniformBuffer.copy(ubo);
+        }
+    }
+
+    void prepare() override {
+        ExampleBase::prepare();
+        for (uint32_t i = 0; i < displayCount; ++i) {
+            addDisplay(vk::Extent2D{ size.width / 2, size.height / 2 });
+        }
+        prepareUniformBuffers();
+        setupDescriptorSetLayout();
+        preparePipelines();
+        setupDescriptorSets();
+        buildCommandBuffers();
+        prepared = true;
+    }
+
+    void render() override {
+        if (!prepared) {
+            return;
+        }
+        // For the sizes of the displays, which may have changed since the last frame
+        updateUniformBuffers();
+        draw();
+    }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Displays")) {
+            // The refreshes per present picked by each window's frame pacer, 0 when presenting as soon as possible
+            ui.text("Main window: %ux%u, interval %u", size.width, size.height, presentTiming.interval);
+            for (uint32_t i = 0; i < (uint32_t)displays.size(); ++i) {
+                const auto& display = *displays[i];
+                if (display.active) {
+                    ui.text("Display %u: %ux%u, interval %u", i + 1, display.size.width, display.size.height, display.interval);
+                } else {
+                    ui.text("Display %u: minimized", i + 1);
+                }
+            }
+        }
+    }
+};
+
+RUN_EXAMPLE(VulkanExample)
@@ -53,14 +53,34 @@ public:
     vk::DescriptorSet descriptorSet;
     vk::DescriptorSetLayout descriptorSetLayout;
 
-    // Stores occlusion query results
+    // How the occlusion pass results reach the visible pass
+    enum QueryMode : int32_t
+    {
+        // Read on the host right after the frame, waiting for the GPU to finish it
+        Blocking,
+        // Copied into a ring of host visible slots, one per swap chain image, and read when the image comes around
+        // again, once its previous frame is known to be complete
+        Deferred,
+        // Copied into a buffer the next frame's visible pass reads as the predicate of conditional rendering, so the
+        // host never sees them
+        Conditional,
+    };
+    int32_t queryMode{ Deferred };
+
+    // Query results of every swap chain image, two 64 bit values per image
     vks::Buffer queryResult;
 
-    // Pool that stores all occlusion queries
+    // Predicates of the conditional mode, two 32 bit values
+    vks::Buffer conditionBuffer;
+
+    // Pool that stores all occlusion queries, two per swap chain image
     vk::QueryPool queryPool;
+    uint32_t queryPoolImages{ 0 };
 
     // Passed query samples
     std::array<uint64_t, 2> passedSamples{ 1, 1 };
+    // Frames between rendering the queries and reading their results on the host
+    uint32_t resultLatency{ 0 };
 
     VulkanExample() {
         passedSamples[0] = passedSamples[1] = 1;
@@ -70,6 +90,8 @@ public:
         camera.setRotation({ 0.0, -123.75, 0.0 });
         camera.dolly(-35.0f);
         title = "Vulkan Example - Occlusion queries";
+        settings.overlay = true;
+        context.enableConditionalRendering = true;
     }
 
     ~VulkanExample() {
@@ -84,8 +106,8 @@ public:
 
         device.destroyQueryPool(queryPool);
 
-        device.destroyBuffer(queryResult.buffer);
-        device.freeMemory(queryResult.memory);
+        queryResult.destroy();
+        conditionBuffer.destroy();
 
         uniformData.vsScene.destroy();
         uniformData.sphere.destroy();
@@ -99,18 +121,27 @@ public:
     // Create a buffer for storing the query result
     // Setup a query pool
     void setupQueryResultBuffer() {
-        uint32_t bufSize = 2 * sizeof(uint64_t);
+        const uint32_t images = swapChain.imageCount;
         // Results are saved in a host visible buffer for easy access by the application
-        queryResult = context.createBuffer(vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst,
-                                           vk::MemoryPropertyFlagBits::eHostVisible, bufSize);
+        queryResult = context.createBuffer(vk::BufferUsageFlagBits::eTransferDst,
+                                           vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, 2 * sizeof(uint64_t) * images);
+        // Slots that haven't been written yet count as visible
+        queryResult.map();
+        std::fill_n(static_cast<uint64_t*>(queryResult.mapped), 2 * images, 1);
+        if (context.conditionalRenderingEnabled) {
+            conditionBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eConditionalRenderingEXT | vk::BufferUsageFlagBits::eTransferDst,
+                                                          std::vector<uint32_t>{ 1, 1 });
+        }
         // Query pool will be created for occlusion queries
-        queryPool = device.createQueryPool({ {}, vk::QueryType::eOcclusion, 2 });
+        queryPool = device.createQueryPool({ {}, vk::QueryType::eOcclusion, 2 * images });
+        queryPoolImages = images;
     }
 
+    // First query of the command buffer of a swap chain image
+    uint32_t firstQuery(const vk::CommandBuffer& cmdBuffer) const { return 2 * commandBufferImage(cmdBuffer); }
+
     // Retrieves the results of the occlusion queries submitted to the command buffer
     void getQueryResults() {
-        queue.waitIdle();
-        device.waitIdle();
         // Store results a 64 bit values and wait until the results have been finished
         // If you don't want to wait, you can use VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
         // which also returns the state of the result (ready) in the result
@@ -118,13 +149,57 @@ public:
         // We use vkGetQueryResults to copy the results into a host visible buffer
         // you can use vk::QueryResultFlagBits::eWithAvailability
         // which also returns the state of the result (ready) in the result
-        device.getQueryPoolResults(queryPool, 0, 2, vk::ArrayProxy<uint64_t>{ passedSamples }, sizeof(uint64_t), queryResultFlags);
+        device.getQueryPoolResults(queryPool, 2 * currentBuffer, 2, vk::ArrayProxy<uint64_t>{ passedSamples }, sizeof(uint64_t), queryResultFlags);
+        resultLatency = 0;
+    }
+
+    // Results of the last frame rendered from the current image, copied at the end of its command buffer.  Must be
+    // called after prepareFrame, which guarantees that frame has completed.
+    void getDeferredQueryResults() {
+        const uint64_t* slot = static_cast<const uint64_t*>(queryResult.mapped) + 2 * currentBuffer;
+        passedSamples = { slot[0], slot[1] };
+        resultLatency = swapChain.imageCount;
     }
 
     void updateCommandBufferPreDraw(const vk::CommandBuffer& cmdBuffer) override {
+        if (queryMode == Conditional) {
+            // The previous frame's copy of the predicates has to land before this frame's visible pass reads them
+            vk::MemoryBarrier barrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eConditionalRenderingReadEXT };
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eConditionalRenderingEXT, {}, barrier, nullptr, nullptr);
+        }
         // Reset query pool
         // Must be done outside of render pass
-        cmdBuffer.resetQueryPool(queryPool, 0, 2);
+        cmdBuffer.resetQueryPool(queryPool, firstQuery(cmdBuffer), 2);
+    }
+
+    void updateCommandBufferPostDraw(const vk::CommandBuffer& cmdBuffer) override {
+        const uint32_t query = firstQuery(cmdBuffer);
+        if (queryMode == Deferred) {
+            // The copy waits for the queries on the GPU, the host reads the slot once the image comes around again
+            cmdBuffer.copyQueryPoolResults(queryPool, query, 2, queryResult.buffer, sizeof(uint64_t) * query, sizeof(uint64_t),
+                                           vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+            vk::MemoryBarrier barrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead };
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, barrier, nullptr, nullptr);
+        } else if (queryMode == Conditional) {
+            // The predicates are still being read by this frame's visible pass.  Zero samples passed skips the draw
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eConditionalRenderingEXT, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, nullptr);
+            cmdBuffer.copyQueryPoolResults(queryPool, query, 2, conditionBuffer.buffer, 0, sizeof(uint32_t), vk::QueryResultFlagBits::eWait);
+        }
+    }
+
+    // Draws the visible pass of an occludee, skipped on the GPU if its last query passed no samples in the
+    // conditional mode
+    void drawOccludee(const vk::CommandBuffer& cmdBuffer, const vk::DescriptorSet& descriptorSet, const vks::model::Model& model, uint32_t index) {
+        if (queryMode == Conditional) {
+            cmdBuffer.beginConditionalRenderingEXT({ conditionBuffer.buffer, sizeof(uint32_t) * index }, context.dynamicDispatch);
+        }
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
+        cmdBuffer.bindVertexBuffers(0, model.vertices.buffer, { 0 });
+        cmdBuffer.bindIndexBuffer(model.indices.buffer, 0, model.indexType);
+        cmdBuffer.drawIndexed(model.indexCount, 1, 0, 0, 0);
+        if (queryMode == Conditional) {
+            cmdBuffer.endConditionalRenderingEXT(context.dynamicDispatch);
+        }
     }
 
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
@@ -137,28 +212,30 @@ public:
         // Occluder first
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
         cmdBuffer.bindVertexBuffers(0, meshes.plane.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.plane.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.plane.indices.buffer, 0, meshes.plane.indexType);
         cmdBuffer.drawIndexed(meshes.plane.indexCount, 1, 0, 0, 0);
 
+        const uint32_t query = firstQuery(cmdBuffer);
+
         // Teapot
-        cmdBuffer.beginQuery(queryPool, 0, vk::QueryControlFlags());
+        cmdBuffer.beginQuery(queryPool, query, vk::QueryControlFlags());
 
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.teapot, nullptr);
         cmdBuffer.bindVertexBuffers(0, meshes.teapot.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.teapot.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.teapot.indices.buffer, 0, meshes.teapot.indexType);
         cmdBuffer.drawIndexed(meshes.teapot.indexCount, 1, 0, 0, 0);
 
-        cmdBuffer.endQuery(queryPool, 0);
+        cmdBuffer.endQuery(queryPool, query);
 
         // Sphere
-        cmdBuffer.beginQuery(queryPool, 1, vk::QueryControlFlags());
+        cmdBuffer.beginQuery(queryPool, query + 1, vk::QueryControlFlags());
 
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.sphere, nullptr);
         cmdBuffer.bindVertexBuffers(0, meshes.sphere.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.sphere.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.sphere.indices.buffer, 0, meshes.sphere.indexType);
         cmdBuffer.drawIndexed(meshes.sphere.indexCount, 1, 0, 0, 0);
 
-        cmdBuffer.endQuery(queryPool, 1);
+        cmdBuffer.endQuery(queryPool, query + 1);
 
         // Visible pass
         // Clear color and depth attachments
@@ -179,36 +256,45 @@ public:
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.solid);
 
         // Teapot
-        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.teapot, nullptr);
-        cmdBuffer.bindVertexBuffers(0, meshes.teapot.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.teapot.indices.buffer, 0, vk::IndexType::eUint32);
-        cmdBuffer.drawIndexed(meshes.teapot.indexCount, 1, 0, 0, 0);
+        drawOccludee(cmdBuffer, descriptorSets.teapot, meshes.teapot, 0);
 
         // Sphere
-        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.sphere, nullptr);
-        cmdBuffer.bindVertexBuffers(0, meshes.sphere.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.sphere.indices.buffer, 0, vk::IndexType::eUint32);
-        cmdBuffer.drawIndexed(meshes.sphere.indexCount, 1, 0, 0, 0);
+        drawOccludee(cmdBuffer, descriptorSets.sphere, meshes.sphere, 1);
 
         // Occluder
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.occluder);
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
         cmdBuffer.bindVertexBuffers(0, meshes.plane.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.plane.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.plane.indices.buffer, 0, meshes.plane.indexType);
         cmdBuffer.drawIndexed(meshes.plane.indexCount, 1, 0, 0, 0);
     }
 
     void draw() override {
         prepareFrame();
 
+        if (queryMode == Deferred) {
+            applyQueryResults([this] { getDeferredQueryResults(); });
+        }
+
         drawCurrentCommandBuffer();
 
-        // Read query results for displaying in next frame
-        getQueryResults();
+        if (queryMode == Blocking) {
+            // Read query results for displaying in next frame, stalling until the GPU has finished this one
+            applyQueryResults([this] { getQueryResults(); });
+        }
 
         submitFrame();
     }
 
+    // The colors of the occludees follow their visibility
+    void applyQueryResults(const std::function<void()>& read) {
+        const auto previous = passedSamples;
+        read();
+        if ((previous[0] > 0) != (passedSamples[0] > 0) || (previous[1] > 0) != (passedSamples[1] > 0)) {
+            updateUniformBuffers();
+        }
+    }
+
     void loadMeshes() {
         meshes.plane.loadFromFile(context, getAssetPath() + "models/plane_z.3ds", vertexLayout, 0.4f);
         meshes.teapot.loadFromFile(context, getAssetPath() + "models/teapot.3ds", vertexLayout, 0.3f);
@@ -343,6 +429,42 @@ public:
     }
 
     void viewChanged() override { updateUniformBuffers(); }
+
+    void windowResized() override {
+        // The query pool and the result ring have a slot per swap chain image.  The command buffers are rebuilt after this
+        if (queryPoolImages != swapChain.imageCount) {
+            device.destroyQueryPool(queryPool);
+            queryResult.destroy();
+            conditionBuffer.destroy();
+            setupQueryResultBuffer();
+        }
+    }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            std::vector<std::string> modes{ "Blocking", "Deferred" };
+            if (context.conditionalRenderingEnabled) {
+                modes.push_back("Conditional rendering");
+            }
+            if (ui.comboBox("Query results", &queryMode, modes)) {
+                queue.waitIdle();
+                // Conditional rendering skips occluded draws on the GPU, the colors don't change
+                passedSamples = { 1, 1 };
+                resultLatency = 0;
+                updateUniformBuffers();
+                buildCommandBuffers();
+            }
+        }
+        if (ui.header("Occlusion")) {
+            if (queryMode == Conditional) {
+                ui.text("Results stay on the GPU, one frame behind");
+            } else {
+                ui.text("Teapot: %llu samples", (unsigned long long)passedSamples[0]);
+                ui.text("Sphere: %llu samples", (unsigned long long)passedSamples[1]);
+                ui.text("Results %u frames old", resultLatency);
+            }
+        }
+    }
 };
 
 RUN_EXAMPLE(VulkanExample)
@@ -108,7 +108,7 @@ public:
 
         vk::DeviceSize offsets = 0;
         cmdBuffer.bindVertexBuffers(0, meshes.quad.vertices.buffer, offsets);
-        cmdBuffer.bindIndexBuffer(meshes.quad.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.quad.indices.buffer, 0, meshes.quad.indexType);
 
         // Parallax enabled
         cmdBuffer.setViewport(0, viewport);
@@ -0,0 +1,329 @@
+/*
+* Vulkan Example - Headless benchmark of the scan, compaction and radix sort of vks::parallel
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <common.hpp>
+#include <vks/context.hpp>
+#include <vks/parallel.hpp>
+#include <vks/profiler.hpp>
+#include <utils.hpp>
+
+#include <chrono>
+#include <numeric>
+#include <random>
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+#define LOG(...) ((void)__android_log_print(ANDROID_LOG_INFO, "vulkanExample", __VA_ARGS__))
+#else
+#define LOG(...) printf(__VA_ARGS__)
+#endif
+
+/*
+    Every primitive runs on the same random input a number of times, each run timed on its own, and its result is
+    compared with that of the CPU doing the same.  Everything goes through the graphics queue, which the primitives
+    and the staging uploads of the context share.
+*/
+class VulkanExample {
+public:
+    vks::Context context;
+    vk::Device& device{ context.device };
+    vks::debug::GpuProfiler profiler;
+    vks::parallel::Scan scan;
+    vks::parallel::Compaction compaction;
+    vks::parallel::RadixSort sort;
+    bool sortSupported{ false };
+
+    /*
+        Benchmark settings, from the command line
+            --elements <n,n,...>   element counts to run
+            --iterations <n>       timed runs of each primitive
+            --warmup <n>           untimed runs before them
+    */
+    struct Settings {
+        std::vector<uint32_t> elements{ 1 << 16, 1 << 20, 1 << 24 };
+        uint32_t iterations{ 16 };
+        uint32_t warmup{ 2 };
+    } settings;
+
+    // Inputs, and the CPU results to compare with
+    std::vector<uint32_t> scanInput, flags, keys, values;
+
+    static std::vector<uint32_t> parseList(const std::string& list) {
+        std::vector<uint32_t> result;
+        std::stringstream values(list);
+        std::string value;
+        while (std::getline(values, value, ',')) {
+            result.push_back(std::max(1u, (uint32_t)std::stoul(value)));
+        }
+        return result;
+    }
+
+    void parseCommandLine() {
+        const auto& args = vkx::getCommandLine();
+        for (size_t i = 1; i < args.size(); ++i) {
+            const auto& arg = args[i];
+            const bool hasValue = i + 1 < args.size();
+            if (arg == "--elements" && hasValue) {
+                settings.elements = parseList(args[++i]);
+            } else if (arg == "--iterations" && hasValue) {
+                settings.iterations = std::max(1u, (uint32_t)std::stoul(args[++i]));
+            } else if (arg == "--warmup" && hasValue) {
+                settings.warmup = (uint32_t)std::stoul(args[++i]);
+            }
+        }
+    }
+
+    void prepare() {
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+        LOG("loading vulkan lib");
+        vks::android::loadVulkanLibrary();
+#endif
+        parseCommandLine();
+        context.createInstance();
+        context.createDevice();
+        LOG("GPU: %s\n", context.deviceProperties.deviceName);
+
+        // One scope per timed run
+        profiler.create(context.physicalDevice, device, context.queueIndices.graphics, 1, settings.iterations);
+        if (!profiler.enabled()) {
+            throw std::runtime_error("The graphics queue doesn't support timestamps");
+        }
+
+        const uint32_t maxCount = *std::max_element(settings.elements.begin(), settings.elements.end());
+        const std::string shaderDirectory = vkx::getAssetPath() + "shaders/base/";
+        scan.create(context, shaderDirectory, maxCount);
+        compaction.create(context, shaderDirectory, maxCount);
+        sortSupported = vks::parallel::RadixSort::supported(context);
+        if (sortSupported) {
+            sort.create(context, shaderDirectory, maxCount);
+        } else {
+            LOG("The device has no subgroup ballots in compute shaders, skipping the radix sort\n");
+        }
+        LOG("Scan and compaction %s subgroups\n", scan.subgroups() ? "with" : "without");
+    }
+
+    void generate(uint32_t elements) {
+        std::mt19937 random(elements);
+        scanInput.resize(elements);
+        flags.resize(elements);
+        keys.resize(elements);
+        values.resize(elements);
+        for (uint32_t i = 0; i < elements; ++i) {
+            keys[i] = random();
+            scanInput[i] = keys[i] % 16;
+            flags[i] = (keys[i] >> 8) & 1;
+            values[i] = i;
+        }
+    }
+
+    vks::Buffer upload(const std::vector<uint32_t>& data) {
+        const vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc;
+        return context.stageToDeviceBuffer<uint32_t>(usage, data);
+    }
+
+    std::vector<uint32_t> download(const vks::Buffer& buffer, uint32_t count) {
+        const vk::DeviceSize size = sizeof(uint32_t) * count;
+        vks::Buffer host = context.createBuffer(vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible, size);
+        context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+            commandBuffer.copyBuffer(buffer.buffer, host.buffer, vk::BufferCopy{ 0, 0, size });
+            vk::MemoryBarrier barrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead };
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, barrier, nullptr, nullptr);
+        });
+        std::vector<uint32_t> result(count);
+        host.map();
+        host.invalidate();
+        memcpy(result.data(), host.mapped, size);
+        host.unmap();
+        host.destroy();
+        return result;
+    }
+
+    // Records the warmup and timed runs, with `prepareRun` outside of the timed scopes, and returns the mean time
+    using Recorder = std::function<void(const vk::CommandBuffer&)>;
+    double time(const std::string& name, const Recorder& prepareRun, const Recorder& run) {
+        context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+            profiler.beginCommandBuffer(commandBuffer, 0);
+            for (uint32_t i = 0; i < settings.warmup + settings.iterations; ++i) {
+                const bool timed = i >= settings.warmup;
+                if (prepareRun) {
+                    prepareRun(commandBuffer);
+                }
+                if (timed) {
+                    profiler.beginScope(commandBuffer, name);
+                }
+                run(commandBuffer);
+                if (timed) {
+                    profiler.endScope(commandBuffer);
+                }
+            }
+            profiler.endCommandBuffer(commandBuffer);
+        });
+
+        const uint64_t collections = profiler.getCollectionCount();
+        profiler.collect(0);
+        if (profiler.getCollectionCount() == collections) {
+            return 0.0;
+        }
+        double sum = 0.0;
+        uint32_t count = 0;
+        for (const auto& scope : profiler.getScopes()) {
+            if (scope.name == name) {
+                sum += scope.lastMilliseconds;
+                ++count;
+            }
+        }
+        return count ? sum / count : 0.0;
+    }
+
+    static double millisecondsSince(const std::chrono::high_resolution_clock::time_point& start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    void report(const char* name, uint32_t elements, double gpuMilliseconds, double cpuMilliseconds, bool verified) {
+        const double elementsPerSecond = gpuMilliseconds > 0.0 ? elements / (gpuMilliseconds / 1000.0) : 0.0;
+        LOG("%-10s %10u elements: %9.4f ms GPU, %8.3f Gelements/s, %9.4f ms CPU%s\n", name, elements, gpuMilliseconds, elementsPerSecond / 1.0e9,
+            cpuMilliseconds, verified ? "" : ", WRONG RESULTS");
+    }
+
+    bool runScan(uint32_t elements) {
+        vks::Buffer input = upload(scanInput);
+        vks::Buffer output = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc,
+                                                        sizeof(uint32_t) * elements);
+        const double gpu = time("scan", nullptr, [&](const vk::CommandBuffer& commandBuffer) {
+            scan.record(commandBuffer, input.descriptor, output.descriptor, elements);
+        });
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        std::vector<uint32_t> expected(elements);
+        uint32_t sum = 0;
+        for (uint32_t i = 0; i < elements; ++i) {
+            expected[i] = sum;
+            sum += scanInput[i];
+        }
+        const double cpu = millisecondsSince(start);
+
+        const bool verified = download(output, elements) == expected;
+        report("scan", elements, gpu, cpu, verified);
+        input.destroy();
+        output.destroy();
+        return verified;
+    }
+
+    bool runCompaction(uint32_t elements) {
+        vks::Buffer flagBuffer = upload(flags);
+        vks::Buffer valueBuffer = upload(keys);
+        vks::Buffer output = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc,
+                                                        sizeof(uint32_t) * elements);
+        vks::Buffer count = upload({ 0 });
+        const double gpu = time("compaction", nullptr, [&](const vk::CommandBuffer& commandBuffer) {
+            compaction.record(commandBuffer, flagBuffer.descriptor, valueBuffer.descriptor, output.descriptor, count.descriptor, elements);
+        });
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        std::vector<uint32_t> expected;
+        expected.reserve(elements);
+        for (uint32_t i = 0; i < elements; ++i) {
+            if (flags[i]) {
+                expected.push_back(keys[i]);
+            }
+        }
+        const double cpu = millisecondsSince(start);
+
+        const uint32_t compacted = download(count, 1)[0];
+        bool verified = compacted == (uint32_t)expected.size();
+        if (verified && compacted) {
+            verified = download(output, compacted) == expected;
+        }
+        report("compaction", elements, gpu, cpu, verified);
+        flagBuffer.destroy();
+        valueBuffer.destroy();
+        output.destroy();
+        count.destroy();
+        return verified;
+    }
+
+    bool runSort(uint32_t elements) {
+        // Every run sorts the same keys, copied over the result of the previous one outside of the timed scope
+        vks::Buffer originalKeys = upload(keys);
+        vks::Buffer originalValues = upload(values);
+        const vk::BufferUsageFlags usage =
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst;
+        vks::Buffer keyBuffer = context.createDeviceBuffer(usage, sizeof(uint32_t) * elements);
+        vks::Buffer valueBuffer = context.createDeviceBuffer(usage, sizeof(uint32_t) * elements);
+        const vk::BufferCopy region{ 0, 0, sizeof(uint32_t) * elements };
+        auto restore = [&](const vk::CommandBuffer& commandBuffer) {
+            const vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferRead,
+                                             vk::AccessFlagBits::eTransferWrite };
+            const vk::PipelineStageFlags stages = vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer;
+            commandBuffer.pipelineBarrier(stages, vk::PipelineStageFlagBits::eTransfer, {}, barrier, nullptr, nullptr);
+            commandBuffer.copyBuffer(originalKeys.buffer, keyBuffer.buffer, region);
+            commandBuffer.copyBuffer(originalValues.buffer, valueBuffer.buffer, region);
+        };
+        const double gpu = time("sort", restore, [&](const vk::CommandBuffer& commandBuffer) {
+            sort.record(commandBuffer, keyBuffer.descriptor, valueBuffer.descriptor, elements);
+        });
+
+        // Values are the original positions, so a stable sort of the pairs by key is the only right answer
+        const auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::pair<uint32_t, uint32_t>> pairs(elements);
+        for (uint32_t i = 0; i < elements; ++i) {
+            pairs[i] = { keys[i], values[i] };
+        }
+        std::stable_sort(pairs.begin(), pairs.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        const double cpu = millisecondsSince(start);
+
+        const auto sortedKeys = download(keyBuffer, elements);
+        const auto sortedValues = download(valueBuffer, elements);
+        bool verified = true;
+        for (uint32_t i = 0; i < elements && verified; ++i) {
+            if (sortedKeys[i] != pairs[i].first || sortedValues[i] != pairs[i].second) {
+                LOG("Element %u is %u:%u, expected %u:%u\n", i, sortedKeys[i], sortedValues[i], pairs[i].first, pairs[i].second);
+                verified = false;
+            }
+        }
+        report("sort", elements, gpu, cpu, verified);
+        originalKeys.destroy();
+        originalValues.destroy();
+        keyBuffer.destroy();
+        valueBuffer.destroy();
+        return verified;
+    }
+
+    // Returns false if any primitive produced wrong results
+    bool run() {
+        LOG("Running parallel primitives benchmark\n");
+        prepare();
+
+        LOG("%u timed runs of each primitive\n", settings.iterations);
+        bool verified = true;
+        for (const auto elements : settings.elements) {
+            generate(elements);
+            verified = runScan(elements) && verified;
+            verified = runCompaction(elements) && verified;
+            if (sortSupported) {
+                verified = runSort(elements) && verified;
+            }
+        }
+        return verified;
+    }
+
+    ~VulkanExample() {
+        sort.destroy();
+        compaction.destroy();
+        scan.destroy();
+        profiler.destroy();
+        context.destroy();
+    }
+};
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+VULKAN_EXAMPLE_MAIN()
+#else
+// The exit code tells scripts whether the results were right
+int main(const int argc, const char* argv[]) {
+    vkx::setCommandLine(argc, argv);
+    return VulkanExample().run() ? 0 : 1;
+}
+#endif
@@ -1,5 +1,5 @@
 /*
-* Vulkan Example - CPU based fire particle system
+* Vulkan Example - Fire particle system, simulated on the CPU or in compute shaders
 *
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
@@ -7,7 +7,16 @@
 */
 
 #include <vulkanExampleBase.h>
+#include <vks/oit.hpp>
 
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PARTICLEFIRE_SSE 1
+#endif
+
+// Default particle count, --particles <count> overrides it
 #define PARTICLE_COUNT 512
 #define PARTICLE_SIZE 10.0f
 
@@ -15,7 +24,23 @@
 
 #define PARTICLE_TYPE_FLAME 0
 #define PARTICLE_TYPE_SMOKE 1
+// Free slot of the compute simulation, never drawn
+#define PARTICLE_TYPE_DEAD 2
+
+// How the particles are blended over the scene
+enum Transparency {
+    // In the order they're drawn, which depth sort makes back to front
+    TRANSPARENCY_BLENDED,
+    TRANSPARENCY_WEIGHTED_BLENDED,
+    TRANSPARENCY_LINKED_LIST,
+};
+
+// Particles per task of the CPU simulation
+#define PARTICLE_GRAIN 16384
+// Must match the local size of the simulation kernels
+#define PARTICLE_GROUP_SIZE 256
 
+// Vertex format of the particle draw, and the particle state of the compute simulation (see particle.glsl)
 struct Particle {
     glm::vec3 pos;
     glm::vec3 color;
@@ -28,6 +53,55 @@ struct Particle {
     float rotationSpeed;
 };
 
+// Small xorshift generator.  Every CPU task has its own, so tasks don't contend on rand()
+struct Random {
+    uint32_t state;
+
+    explicit Random(uint32_t seed)
+        : state(seed ? seed : 0x9e3779b9u) {}
+
+    // [0, range]
+    float operator()(float range) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return range * ((float)state / 4294967295.0f);
+    }
+};
+
+// CPU simulation state, one array per attribute so the update handles four particles per instruction.
+// Particle colors are always grey, so a single channel is kept.
+struct ParticleStreams {
+    std::vector<float> posX, posY, posZ;
+    std::vector<float> velX, velY, velZ;
+    std::vector<float> shade;
+    std::vector<float> alpha;
+    std::vector<float> size;
+    std::vector<float> rotation;
+    std::vector<float> rotationSpeed;
+    std::vector<uint32_t> type;
+
+    void resize(size_t count) {
+        for (auto* stream : { &posX, &posY, &posZ, &velX, &velY, &velZ, &shade, &alpha, &size, &rotation, &rotationSpeed }) {
+            stream->resize(count);
+        }
+        type.resize(count);
+    }
+};
+
+// Uniform block of the compute simulation, see particle.glsl
+struct SimulationParams {
+    glm::mat4 modelview;
+    glm::vec4 emitterPos;
+    glm::vec4 minVel;
+    glm::vec4 maxVel;
+    float frameTimer{ 0.0f };
+    uint32_t seed{ 0 };
+    uint32_t particleCount{ 0 };
+    // Free slots the emitter may fill this frame
+    uint32_t emitBudget{ 0 };
+};
+
 // Vertex layout for this example
 class VulkanExample : public vkx::ExampleBase {
 public:
@@ -98,13 +172,61 @@ public:
     struct {
         vk::Pipeline particles;
         vk::Pipeline environment;
+        // Order independent transparency: the environment's depth, and the particles in either mode
+        vk::Pipeline occluder;
+        vk::Pipeline particlesWeightedBlended;
+        vk::Pipeline particlesLinkedList;
     } pipelines;
 
     vk::PipelineLayout pipelineLayout;
+    // With the fragment lists of the order independent transparency in set 1
+    vk::PipelineLayout linkedListPipelineLayout;
     vk::DescriptorSet descriptorSet;
     vk::DescriptorSetLayout descriptorSetLayout;
 
-    std::vector<Particle> particleBuffer;
+    uint32_t particleCount{ PARTICLE_COUNT };
+    // Simulate in compute shaders instead of on the CPU
+    bool computeSimulation{ false };
+    // Draw the compute simulation's particles back to front, for correct blending of the smoke
+    bool depthSort{ false };
+    // See Transparency, the order independent modes need no sorting
+    int32_t transparency{ TRANSPARENCY_BLENDED };
+    vks::OrderIndependentTransparency oit;
+    uint32_t frameSeed{ 0 };
+
+    // CPU simulation
+    ParticleStreams particleStreams;
+    // Milliseconds, smoothed
+    float cpuSimulationTime{ 0.0f };
+
+    // Compute simulation.  Particles live in a pool of slots, and every frame
+    //   simulate   advances the live particles and returns the slots of dead ones to the dead list
+    //   emit       fills free slots with new flame particles
+    //   sortkeys   (sorting only) collects the view depth of every live particle
+    //   bitonic    (sorting only) sorts the keys back to front, one network step per dispatch
+    //   compact    packs the live particles into the render buffer and counts them into the indirect draw
+    struct {
+        vks::Buffer state;
+        vks::Buffer deadList;
+        vks::Buffer sortKeys;
+        vks::Buffer render;
+        vks::Buffer drawCommand;
+        vks::Buffer params;
+        // Number of sort keys, the particle count rounded up to a power of two
+        uint32_t sortCount{ 0 };
+        vk::DescriptorSetLayout descriptorSetLayout;
+        vk::DescriptorSet descriptorSet;
+        vk::PipelineLayout pipelineLayout;
+        struct {
+            vk::Pipeline simulate;
+            vk::Pipeline emit;
+            vk::Pipeline sortKeys;
+            vk::Pipeline bitonic;
+            vk::Pipeline compact;
+            vk::Pipeline compactSorted;
+        } pipelines;
+    } compute;
+    SimulationParams simulationParams;
 
     VulkanExample() {
         camera.setRotation({ -15.0f, 45.0f, 0.0f });
@@ -113,6 +235,21 @@ public:
         zoomSpeed *= 1.5f;
         timerSpeed *= 8.0f;
         srand((uint32_t)time(NULL));
+        frameSeed = (uint32_t)rand();
+
+        // --particles <count>, --compute-particles, --sort-particles and --oit <weighted|list> select what to benchmark
+        const auto& args = vkx::getCommandLine();
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (args[i] == "--particles" && i + 1 < args.size()) {
+                particleCount = std::max(1u, (uint32_t)std::stoul(args[++i]));
+            } else if (args[i] == "--compute-particles") {
+                computeSimulation = true;
+            } else if (args[i] == "--sort-particles") {
+                depthSort = true;
+            } else if (args[i] == "--oit" && i + 1 < args.size()) {
+                transparency = args[++i] == "list" ? TRANSPARENCY_LINKED_LIST : TRANSPARENCY_WEIGHTED_BLENDED;
+            }
+        }
     }
 
     ~VulkanExample() {
@@ -126,10 +263,30 @@ public:
 
         device.destroyPipeline(pipelines.particles);
         device.destroyPipeline(pipelines.environment);
+        device.destroyPipeline(pipelines.occluder);
+        device.destroyPipeline(pipelines.particlesWeightedBlended);
+        device.destroyPipeline(pipelines.particlesLinkedList);
+        oit.destroy();
 
         device.destroyPipelineLayout(pipelineLayout);
+        device.destroyPipelineLayout(linkedListPipelineLayout);
         device.destroyDescriptorSetLayout(descriptorSetLayout);
 
+        device.destroyPipeline(compute.pipelines.simulate);
+        device.destroyPipeline(compute.pipelines.emit);
+        device.destroyPipeline(compute.pipelines.sortKeys);
+        device.destroyPipeline(compute.pipelines.bitonic);
+        device.destroyPipeline(compute.pipelines.compact);
+        device.destroyPipeline(compute.pipelines.compactSorted);
+        device.destroyPipelineLayout(compute.pipelineLayout);
+        device.destroyDescriptorSetLayout(compute.descriptorSetLayout);
+        compute.state.destroy();
+        compute.deadList.destroy();
+        compute.sortKeys.destroy();
+        compute.render.destroy();
+        compute.drawCommand.destroy();
+        compute.params.destroy();
+
         particles.buffer.destroy();
         uniformData.fire.destroy();
         uniformData.environment.destroy();
@@ -138,108 +295,314 @@ public:
         device.destroySampler(textures.particles.sampler);
     }
 
+    // Written by one dispatch, read or written by the next
+    static void computeBarrier(const vk::CommandBuffer& cmdBuffer, vk::PipelineStageFlags srcStage = vk::PipelineStageFlagBits::eComputeShader) {
+        vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite,
+                                   vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+        cmdBuffer.pipelineBarrier(srcStage, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+    }
+
+    void dispatchSort(const vk::CommandBuffer& cmdBuffer, vk::Pipeline pipeline, uint32_t blockSize, uint32_t distance) {
+        const uint32_t pushConstants[3] = { compute.sortCount, blockSize, distance };
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        cmdBuffer.pushConstants(compute.pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(pushConstants), pushConstants);
+        cmdBuffer.dispatch((compute.sortCount + PARTICLE_GROUP_SIZE - 1) / PARTICLE_GROUP_SIZE, 1, 1);
+        computeBarrier(cmdBuffer);
+    }
+
+    void getEnabledFeatures() override {
+        // The linked list transparency appends fragments from the fragment shader
+        if (deviceFeatures.fragmentStoresAndAtomics) {
+            enabledFeatures.fragmentStoresAndAtomics = VK_TRUE;
+        }
+    }
+
+    vks::OrderIndependentTransparency::Mode oitMode() const {
+        return transparency == TRANSPARENCY_LINKED_LIST ? vks::OrderIndependentTransparency::Mode::LinkedList
+                                                        : vks::OrderIndependentTransparency::Mode::WeightedBlended;
+    }
+
+    void drawEnvironment(const vk::CommandBuffer& cmdBuffer) const {
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, meshes.descriptorSet, nullptr);
+        cmdBuffer.bindVertexBuffers(0, meshes.environment.vertices.buffer, vk::DeviceSize());
+        cmdBuffer.bindIndexBuffer(meshes.environment.indices.buffer, 0, meshes.environment.indexType);
+        cmdBuffer.drawIndexed(meshes.environment.indexCount, 1, 0, 0, 0);
+    }
+
+    void drawParticles(const vk::CommandBuffer& cmdBuffer) const {
+        if (computeSimulation) {
+            // The number of live particles is only known on the GPU
+            cmdBuffer.bindVertexBuffers(0, compute.render.buffer, { 0 });
+            cmdBuffer.drawIndirect(compute.drawCommand.buffer, 0, 1, sizeof(vk::DrawIndirectCommand));
+        } else {
+            cmdBuffer.bindVertexBuffers(0, particles.buffer.buffer, { 0 });
+            cmdBuffer.draw(particleCount, 1, 0, 0);
+        }
+    }
+
+    void updateCommandBufferPreDraw(const vk::CommandBuffer& cmdBuffer) override {
+        if (computeSimulation) {
+            recordSimulation(cmdBuffer);
+        }
+        if (transparency == TRANSPARENCY_BLENDED) {
+            return;
+        }
+        // The particles are drawn in whatever order, against the environment's depth, and composited in the
+        // render pass
+        const auto mode = oitMode();
+        vks::debug::marker::beginRegion(cmdBuffer, "Particle transparency", glm::vec4(1.0f, 0.8f, 0.0f, 1.0f));
+        oit.begin(cmdBuffer, mode);
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.occluder);
+        drawEnvironment(cmdBuffer);
+        if (mode == vks::OrderIndependentTransparency::Mode::LinkedList) {
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.particlesLinkedList);
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, linkedListPipelineLayout, 0, { descriptorSet, oit.listDescriptorSet() },
+                                         nullptr);
+        } else {
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.particlesWeightedBlended);
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
+        }
+        drawParticles(cmdBuffer);
+        oit.end(cmdBuffer);
+        vks::debug::marker::endRegion(cmdBuffer);
+    }
+
+    void recordSimulation(const vk::CommandBuffer& cmdBuffer) {
+        vks::debug::marker::beginRegion(cmdBuffer, "Particle simulation", glm::vec4(1.0f, 0.5f, 0.0f, 1.0f));
+        // The previous frame's particle draw has to be done with the render buffer and the draw command
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eDrawIndirect,
+                                  vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, nullptr, nullptr);
+        // vertexCount, compact counts into it
+        cmdBuffer.fillBuffer(compute.drawCommand.buffer, 0, sizeof(uint32_t), 0);
+        computeBarrier(cmdBuffer, vk::PipelineStageFlagBits::eTransfer);
+
+        const uint32_t groups = (particleCount + PARTICLE_GROUP_SIZE - 1) / PARTICLE_GROUP_SIZE;
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, compute.pipelineLayout, 0, compute.descriptorSet, nullptr);
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, compute.pipelines.simulate);
+        cmdBuffer.dispatch(groups, 1, 1);
+        computeBarrier(cmdBuffer);
+        // At most one particle per slot is emitted
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, compute.pipelines.emit);
+        cmdBuffer.dispatch(groups, 1, 1);
+        computeBarrier(cmdBuffer);
+
+        // Order independent transparency doesn't need the particles in order
+        const bool sorted = depthSort && transparency == TRANSPARENCY_BLENDED;
+        if (sorted) {
+            dispatchSort(cmdBuffer, compute.pipelines.sortKeys, 0, 0);
+            for (uint32_t blockSize = 2; blockSize <= compute.sortCount; blockSize <<= 1) {
+                for (uint32_t distance = blockSize >> 1; distance > 0; distance >>= 1) {
+                    dispatchSort(cmdBuffer, compute.pipelines.bitonic, blockSize, distance);
+                }
+            }
+        }
+
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, sorted ? compute.pipelines.compactSorted : compute.pipelines.compact);
+        cmdBuffer.dispatch(groups, 1, 1);
+
+        vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndirectCommandRead };
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eDrawIndirect,
+                                  {}, barrier, nullptr, nullptr);
+        vks::debug::marker::endRegion(cmdBuffer);
+    }
+
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
         cmdBuffer.setViewport(0, vks::util::viewport(size));
         cmdBuffer.setScissor(0, vks::util::rect2D(size));
         // Environment
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.environment);
-        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, meshes.descriptorSet, nullptr);
-        cmdBuffer.bindVertexBuffers(0, meshes.environment.vertices.buffer, vk::DeviceSize());
-        cmdBuffer.bindIndexBuffer(meshes.environment.indices.buffer, 0, vk::IndexType::eUint32);
-        cmdBuffer.drawIndexed(meshes.environment.indexCount, 1, 0, 0, 0);
+        drawEnvironment(cmdBuffer);
 
         // Particle system
+        if (transparency != TRANSPARENCY_BLENDED) {
+            oit.composite(cmdBuffer, oitMode());
+            return;
+        }
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.particles);
-        cmdBuffer.bindVertexBuffers(0, particles.buffer.buffer, { 0 });
-        cmdBuffer.draw(PARTICLE_COUNT, 1, 0, 0);
+        drawParticles(cmdBuffer);
     }
 
-    float rnd(float range) { return range * (rand() / float(RAND_MAX)); }
-
-    void initParticle(Particle* particle, glm::vec3 emitterPos) {
-        particle->vel = glm::vec4(0.0f, minVel.y + rnd(maxVel.y - minVel.y), 0.0f, 0.0f);
-        particle->alpha = rnd(0.75f);
-        particle->size = 1.0f + rnd(0.5f);
-        particle->color = glm::vec4(1.0f);
-        particle->type = PARTICLE_TYPE_FLAME;
-        particle->rotation = rnd(2.0f * (float)M_PI);
-        particle->rotationSpeed = rnd(2.0f) - rnd(2.0f);
+    void initParticle(ParticleStreams& p, size_t i, Random& rnd) const {
+        p.velX[i] = 0.0f;
+        p.velY[i] = minVel.y + rnd(maxVel.y - minVel.y);
+        p.velZ[i] = 0.0f;
+        p.alpha[i] = rnd(0.75f);
+        p.size[i] = 1.0f + rnd(0.5f);
+        p.shade[i] = 1.0f;
+        p.type[i] = PARTICLE_TYPE_FLAME;
+        p.rotation[i] = rnd(2.0f * (float)M_PI);
+        p.rotationSpeed[i] = rnd(2.0f) - rnd(2.0f);
 
         // Get random sphere point
         float theta = rnd(2 * (float)M_PI);
         float phi = rnd((float)M_PI) - (float)M_PI / 2;
         float r = rnd(FLAME_RADIUS);
 
-        particle->pos.x = r * cos(theta) * cos(phi);
-        particle->pos.y = r * sin(phi);
-        particle->pos.z = r * sin(theta) * cos(phi);
-
-        particle->pos += emitterPos;
+        p.posX[i] = r * cos(theta) * cos(phi) + emitterPos.x;
+        p.posY[i] = r * sin(phi) + emitterPos.y;
+        p.posZ[i] = r * sin(theta) * cos(phi) + emitterPos.z;
     }
 
-    void transitionParticle(Particle* particle) {
-        switch (particle->type) {
+    void transitionParticle(ParticleStreams& p, size_t i, Random& rnd) const {
+        switch (p.type[i]) {
             case PARTICLE_TYPE_FLAME:
                 // Flame particles have a chance of turning into smoke
                 if (rnd(1.0f) < 0.05f) {
-                    particle->alpha = 0.0f;
-                    particle->color = glm::vec4(0.25f + rnd(0.25f));
-                    particle->pos.x *= 0.5f;
-                    particle->pos.z *= 0.5f;
-                    particle->vel = glm::vec4(rnd(1.0f) - rnd(1.0f), (minVel.y * 2) + rnd(maxVel.y - minVel.y), rnd(1.0f) - rnd(1.0f), 0.0f);
-                    particle->size = 1.0f + rnd(0.5f);
-                    particle->rotationSpeed = rnd(1.0f) - rnd(1.0f);
-                    particle->type = PARTICLE_TYPE_SMOKE;
+                    p.alpha[i] = 0.0f;
+                    p.shade[i] = 0.25f + rnd(0.25f);
+                    p.posX[i] *= 0.5f;
+                    p.posZ[i] *= 0.5f;
+                    p.velX[i] = rnd(1.0f) - rnd(1.0f);
+                    p.velY[i] = (minVel.y * 2) + rnd(maxVel.y - minVel.y);
+                    p.velZ[i] = rnd(1.0f) - rnd(1.0f);
+                    p.size[i] = 1.0f + rnd(0.5f);
+                    p.rotationSpeed[i] = rnd(1.0f) - rnd(1.0f);
+                    p.type[i] = PARTICLE_TYPE_SMOKE;
                 } else {
-                    initParticle(particle, emitterPos);
+                    initParticle(p, i, rnd);
                 }
                 break;
             case PARTICLE_TYPE_SMOKE:
                 // Respawn at end of life
-                initParticle(particle, emitterPos);
+                initParticle(p, i, rnd);
                 break;
         }
     }
 
     void prepareParticles() {
-        particleBuffer.resize(PARTICLE_COUNT);
-        for (auto& particle : particleBuffer) {
-            initParticle(&particle, emitterPos);
-            particle.alpha = 1.0f - (abs(particle.pos.y) / (FLAME_RADIUS * 2.0f));
+        Random rnd(frameSeed);
+        particleStreams.resize(particleCount);
+        for (size_t i = 0; i < particleCount; ++i) {
+            initParticle(particleStreams, i, rnd);
+            particleStreams.alpha[i] = 1.0f - (abs(particleStreams.posY[i]) / (FLAME_RADIUS * 2.0f));
         }
 
         particles.buffer =
             context.createBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-                                 sizeof(Particle) * particleBuffer.size());
+                                 sizeof(Particle) * particleCount);
         particles.buffer.map();
-        particles.buffer.copy(particleBuffer);
+
+        // Every slot starts out free, the emitter fills them on the first frame
+        std::vector<Particle> slots(particleCount);
+        std::vector<uint32_t> deadList(particleCount + 1);
+        deadList[0] = particleCount;
+        for (uint32_t i = 0; i < particleCount; ++i) {
+            slots[i] = Particle{};
+            slots[i].type = PARTICLE_TYPE_DEAD;
+            deadList[i + 1] = i;
+        }
+        compute.state = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, slots);
+        compute.deadList = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, deadList);
+        compute.sortCount = 1;
+        while (compute.sortCount < particleCount) {
+            compute.sortCount <<= 1;
+        }
+        compute.sortKeys = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, 2 * sizeof(uint32_t) * compute.sortCount);
+        compute.render = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer, sizeof(Particle) * particleCount);
+        vk::DrawIndirectCommand drawCommand{ 0, 1, 0, 0 };
+        compute.drawCommand = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, drawCommand);
+        compute.params = context.createUniformBuffer(simulationParams);
     }
 
-    void updateParticles() {
-        float particleTimer = frameTimer * 0.45f;
-        for (auto& particle : particleBuffer) {
-            switch (particle.type) {
-                case PARTICLE_TYPE_FLAME:
-                    particle.pos.y -= particle.vel.y * particleTimer * 3.5f;
-                    particle.alpha += particleTimer * 2.5f;
-                    particle.size -= particleTimer * 0.5f;
-                    break;
-                case PARTICLE_TYPE_SMOKE:
-                    particle.pos -= particle.vel * frameTimer * 1.0f;
-                    particle.alpha += particleTimer * 1.25f;
-                    particle.size += particleTimer * 0.125f;
-                    particle.color -= particleTimer * 0.05f;
-                    break;
+    // Advance particle `i` by one frame, the scalar version of the SIMD loop in simulateRange
+    void advanceParticle(ParticleStreams& p, size_t i, float particleTimer) const {
+        if (p.type[i] == PARTICLE_TYPE_FLAME) {
+            p.posY[i] -= p.velY[i] * particleTimer * 3.5f;
+            p.alpha[i] += particleTimer * 2.5f;
+            p.size[i] -= particleTimer * 0.5f;
+        } else {
+            p.posX[i] -= p.velX[i] * frameTimer;
+            p.posY[i] -= p.velY[i] * frameTimer;
+            p.posZ[i] -= p.velZ[i] * frameTimer;
+            p.alpha[i] += particleTimer * 1.25f;
+            p.size[i] += particleTimer * 0.125f;
+            p.shade[i] -= particleTimer * 0.05f;
+        }
+        p.rotation[i] += particleTimer * p.rotationSpeed[i];
+    }
+
+    void simulateRange(size_t begin, size_t end, Random& rnd) {
+        auto& p = particleStreams;
+        const float particleTimer = frameTimer * 0.45f;
+        size_t i = begin;
+#if defined(PARTICLEFIRE_SSE)
+        // Both kinds of particle are advanced in every lane and the lane's type selects the result
+        const __m128 flameRise = _mm_set1_ps(particleTimer * 3.5f);
+        const __m128 smokeMove = _mm_set1_ps(frameTimer);
+        const __m128 flameAlpha = _mm_set1_ps(particleTimer * 2.5f);
+        const __m128 smokeAlpha = _mm_set1_ps(particleTimer * 1.25f);
+        const __m128 flameSize = _mm_set1_ps(-particleTimer * 0.5f);
+        const __m128 smokeSize = _mm_set1_ps(particleTimer * 0.125f);
+        const __m128 smokeShade = _mm_set1_ps(-particleTimer * 0.05f);
+        const __m128 rotationStep = _mm_set1_ps(particleTimer);
+        const __m128 maxAlpha = _mm_set1_ps(2.0f);
+        const __m128i smokeType = _mm_set1_epi32(PARTICLE_TYPE_SMOKE);
+        const auto select = [](__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); };
+        for (; i + 4 <= end; i += 4) {
+            const __m128 smoke = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)&p.type[i]), smokeType));
+            const __m128 move = _mm_and_ps(smoke, smokeMove);
+            _mm_storeu_ps(&p.posX[i], _mm_sub_ps(_mm_loadu_ps(&p.posX[i]), _mm_mul_ps(_mm_loadu_ps(&p.velX[i]), move)));
+            _mm_storeu_ps(&p.posY[i], _mm_sub_ps(_mm_loadu_ps(&p.posY[i]), _mm_mul_ps(_mm_loadu_ps(&p.velY[i]), select(smoke, smokeMove, flameRise))));
+            _mm_storeu_ps(&p.posZ[i], _mm_sub_ps(_mm_loadu_ps(&p.posZ[i]), _mm_mul_ps(_mm_loadu_ps(&p.velZ[i]), move)));
+            const __m128 alpha = _mm_add_ps(_mm_loadu_ps(&p.alpha[i]), select(smoke, smokeAlpha, flameAlpha));
+            _mm_storeu_ps(&p.alpha[i], alpha);
+            _mm_storeu_ps(&p.size[i], _mm_add_ps(_mm_loadu_ps(&p.size[i]), select(smoke, smokeSize, flameSize)));
+            _mm_storeu_ps(&p.shade[i], _mm_add_ps(_mm_loadu_ps(&p.shade[i]), _mm_and_ps(smoke, smokeShade)));
+            _mm_storeu_ps(&p.rotation[i], _mm_add_ps(_mm_loadu_ps(&p.rotation[i]), _mm_mul_ps(_mm_loadu_ps(&p.rotationSpeed[i]), rotationStep)));
+            // Transitions are rare, so they stay scalar
+            const int expired = _mm_movemask_ps(_mm_cmpgt_ps(alpha, maxAlpha));
+            for (size_t lane = 0; expired && lane < 4; ++lane) {
+                if (expired & (1 << lane)) {
+                    transitionParticle(p, i + lane, rnd);
+                }
             }
-            particle.rotation += particleTimer * particle.rotationSpeed;
+        }
+#endif
+        for (; i < end; ++i) {
+            advanceParticle(p, i, particleTimer);
             // Transition particle state
-            if (particle.alpha > 2.0f) {
-                transitionParticle(&particle);
+            if (p.alpha[i] > 2.0f) {
+                transitionParticle(p, i, rnd);
             }
         }
 
-        particles.buffer.copy(particleBuffer);
+        // Only the attributes the shader reads
+        Particle* output = static_cast<Particle*>(particles.buffer.mapped);
+        for (i = begin; i < end; ++i) {
+            Particle& particle = output[i];
+            particle.pos = glm::vec3(p.posX[i], p.posY[i], p.posZ[i]);
+            particle.color = glm::vec3(p.shade[i]);
+            particle.alpha = p.alpha[i];
+            particle.size = p.size[i];
+            particle.rotation = p.rotation[i];
+            particle.type = p.type[i];
+        }
+    }
+
+    void updateParticles() {
+        ++frameSeed;
+        if (computeSimulation) {
+            simulationParams.modelview = camera.matrices.view;
+            simulationParams.emitterPos = glm::vec4(emitterPos, 0.0f);
+            simulationParams.minVel = glm::vec4(minVel, 0.0f);
+            simulationParams.maxVel = glm::vec4(maxVel, 0.0f);
+            simulationParams.frameTimer = frameTimer;
+            simulationParams.seed = frameSeed;
+            simulationParams.particleCount = particleCount;
+            // Slots are refilled as soon as they are freed, like the CPU path respawns its particles
+            simulationParams.emitBudget = particleCount;
+            compute.params.copy(simulationParams);
+            return;
+        }
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        getScheduler().parallelFor(0, particleCount, PARTICLE_GRAIN, [&](size_t begin, size_t end) {
+            Random rnd(frameSeed * 2654435761u ^ (uint32_t)begin);
+            simulateRange(begin, end, rnd);
+        });
+        const float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        cpuSimulationTime = cpuSimulationTime * 0.95f + milliseconds * 0.05f;
     }
 
     void loadAssets() override {
@@ -278,10 +641,12 @@ public:
 
     void setupDescriptorPool() {
         // Example uses one ubo and one image sampler
-        std::vector<vk::DescriptorPoolSize> poolSizes = { vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, 2),
-                                                          vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 4) };
+        // and the compute simulation one ubo and five storage buffers
+        std::vector<vk::DescriptorPoolSize> poolSizes = { vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, 3),
+                                                          vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 4),
+                                                          vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, 5) };
 
-        descriptorPool = device.createDescriptorPool({ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
+        descriptorPool = device.createDescriptorPool({ {}, 3, (uint32_t)poolSizes.size(), poolSizes.data() });
     }
 
     void setupDescriptorSetLayout() {
@@ -296,6 +661,24 @@ public:
 
         descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
         pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+        if (vks::OrderIndependentTransparency::linkedListSupported(context)) {
+            const vk::DescriptorSetLayout setLayouts[2]{ descriptorSetLayout, oit.listDescriptorSetLayout() };
+            linkedListPipelineLayout = device.createPipelineLayout({ {}, 2, setLayouts });
+        }
+
+        // Compute simulation, see particle.glsl
+        setLayoutBindings = {
+            { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            { 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            { 3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            { 4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            { 5, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        };
+        compute.descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+        // Sort parameters
+        vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, 3 * sizeof(uint32_t) };
+        compute.pipelineLayout = device.createPipelineLayout({ {}, 1, &compute.descriptorSetLayout, 1, &pushConstantRange });
     }
 
     void setupDescriptorSets() {
@@ -333,6 +716,33 @@ public:
         };
 
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
+
+        // Compute simulation
+        compute.descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &compute.descriptorSetLayout })[0];
+        vk::DescriptorBufferInfo stateInfo{ compute.state.buffer, 0, VK_WHOLE_SIZE };
+        vk::DescriptorBufferInfo deadListInfo{ compute.deadList.buffer, 0, VK_WHOLE_SIZE };
+        vk::DescriptorBufferInfo sortKeysInfo{ compute.sortKeys.buffer, 0, VK_WHOLE_SIZE };
+        vk::DescriptorBufferInfo renderInfo{ compute.render.buffer, 0, VK_WHOLE_SIZE };
+        vk::DescriptorBufferInfo drawCommandInfo{ compute.drawCommand.buffer, 0, VK_WHOLE_SIZE };
+        writeDescriptorSets = {
+            vk::WriteDescriptorSet{ compute.descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &compute.params.descriptor },
+            vk::WriteDescriptorSet{ compute.descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &stateInfo },
+            vk::WriteDescriptorSet{ compute.descriptorSet, 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &deadListInfo },
+            vk::WriteDescriptorSet{ compute.descriptorSet, 3, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &sortKeysInfo },
+            vk::WriteDescriptorSet{ compute.descriptorSet, 4, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &renderInfo },
+            vk::WriteDescriptorSet{ compute.descriptorSet, 5, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &drawCommandInfo },
+        };
+        device.updateDescriptorSets(writeDescriptorSets, nullptr);
+    }
+
+    vk::Pipeline createComputePipeline(const std::string& shader, const vk::SpecializationInfo* specializationInfo = nullptr) {
+        vk::ComputePipelineCreateInfo pipelineCreateInfo;
+        pipelineCreateInfo.layout = compute.pipelineLayout;
+        pipelineCreateInfo.stage = vks::shaders::loadShader(device, getAssetPath() + "shaders/particlefire/" + shader, vk::ShaderStageFlagBits::eCompute);
+        pipelineCreateInfo.stage.pSpecializationInfo = specializationInfo;
+        vk::Pipeline pipeline = device.createComputePipeline(context.pipelineCache, pipelineCreateInfo);
+        device.destroyShaderModule(pipelineCreateInfo.stage.module);
+        return pipeline;
     }
 
     void preparePipelines() {
@@ -364,6 +774,40 @@ public:
         pipelineBuilder.loadShader(getAssetPath() + "shaders/particlefire/particle.vert.spv", vk::ShaderStageFlagBits::eVertex);
         pipelineBuilder.loadShader(getAssetPath() + "shaders/particlefire/particle.frag.spv", vk::ShaderStageFlagBits::eFragment);
         pipelines.particles = pipelineBuilder.create(context.pipelineCache);
+
+        // Order independent transparency, the particles go in its render pass, behind the environment's depth
+        {
+            vks::pipelines::GraphicsPipelineBuilder occluderBuilder{ device, pipelineLayout, renderPass };
+            occluderBuilder.rasterizationState.frontFace = vk::FrontFace::eClockwise;
+            occluderBuilder.vertexInputState.appendVertexLayout(meshes.vertexLayout);
+            oit.setupOccluderPipeline(occluderBuilder);
+            occluderBuilder.loadShader(getAssetPath() + "shaders/particlefire/normalmap.vert.spv", vk::ShaderStageFlagBits::eVertex);
+            pipelines.occluder = occluderBuilder.create(context.pipelineCache);
+        }
+        oit.setupTransparentPipeline(pipelineBuilder, vks::OrderIndependentTransparency::Mode::WeightedBlended);
+        pipelineBuilder.destroyShaderModules();
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/particlefire/particle.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/particlefire/particle_oit.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipelines.particlesWeightedBlended = pipelineBuilder.create(context.pipelineCache);
+        if (linkedListPipelineLayout) {
+            oit.setupTransparentPipeline(pipelineBuilder, vks::OrderIndependentTransparency::Mode::LinkedList);
+            pipelineBuilder.layout = linkedListPipelineLayout;
+            pipelineBuilder.destroyShaderModules();
+            pipelineBuilder.loadShader(getAssetPath() + "shaders/particlefire/particle.vert.spv", vk::ShaderStageFlagBits::eVertex);
+            pipelineBuilder.loadShader(getAssetPath() + "shaders/particlefire/particle_oitlist.frag.spv", vk::ShaderStageFlagBits::eFragment);
+            pipelines.particlesLinkedList = pipelineBuilder.create(context.pipelineCache);
+        }
+
+        // Compute simulation
+        compute.pipelines.simulate = createComputePipeline("simulate.comp.spv");
+        compute.pipelines.emit = createComputePipeline("emit.comp.spv");
+        compute.pipelines.sortKeys = createComputePipeline("sortkeys.comp.spv");
+        compute.pipelines.bitonic = createComputePipeline("bitonic.comp.spv");
+        compute.pipelines.compact = createComputePipeline("compact.comp.spv");
+        const VkBool32 sorted = VK_TRUE;
+        vk::SpecializationMapEntry sortedEntry{ 0, 0, sizeof(sorted) };
+        vk::SpecializationInfo sortedInfo{ 1, &sortedEntry, sizeof(sorted), &sorted };
+        compute.pipelines.compactSorted = createComputePipeline("compact.comp.spv", &sortedInfo);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
@@ -402,6 +846,10 @@ public:
 
     void prepare() override {
         ExampleBase::prepare();
+        oit.create(context, getAssetPath(), size, depthFormat, renderPass);
+        if (transparency == TRANSPARENCY_LINKED_LIST && !vks::OrderIndependentTransparency::linkedListSupported(context)) {
+            transparency = TRANSPARENCY_WEIGHTED_BLENDED;
+        }
         prepareParticles();
         prepareUniformBuffers();
         setupDescriptorSetLayout();
@@ -423,6 +871,35 @@ public:
     }
 
     void viewChanged() override { updateUniformBuffers(); }
+
+    void windowResized() override {
+        // The command buffers recorded with the old targets are recorded again after this
+        oit.resize(size);
+    }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            if (ui.checkBox("Compute simulation", &computeSimulation)) {
+                buildCommandBuffers();
+            }
+            std::vector<std::string> modes{ "Blended", "Weighted blended OIT" };
+            if (vks::OrderIndependentTransparency::linkedListSupported(context)) {
+                modes.push_back("Linked list OIT");
+            }
+            if (ui.comboBox("Transparency", &transparency, modes)) {
+                buildCommandBuffers();
+            }
+            if (computeSimulation && transparency == TRANSPARENCY_BLENDED && ui.checkBox("Depth sort", &depthSort)) {
+                buildCommandBuffers();
+            }
+        }
+        if (ui.header("Statistics")) {
+            ui.text("Particles: %u", particleCount);
+            if (!computeSimulation) {
+                ui.text("CPU simulation: %.3f ms", cpuSimulationTime);
+            }
+        }
+    }
 };
 
 RUN_EXAMPLE(VulkanExample)
@@ -133,7 +133,7 @@ public:
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
         cmdBuffer.bindVertexBuffers(0, models.objects[models.objectIndex].vertices.buffer, offsets);
-        cmdBuffer.bindIndexBuffer(models.objects[models.objectIndex].indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(models.objects[models.objectIndex].indices.buffer, 0, models.objects[models.objectIndex].indexType);
 
         Material mat = materials[materialIndex];
 
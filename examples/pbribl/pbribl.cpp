@@ -15,6 +15,9 @@
 
 #define GRID_DIM 7
 
+// Just in front of the middle of the row of objects, on the camera's side
+static const glm::vec3 PROBE_POSITION{ 0.0f, 0.0f, -1.5f };
+
 struct Material {
     // Parameter block used as push constant block
     struct PushBlock {
@@ -43,12 +46,22 @@ vks::model::VertexLayout vertexLayout{ {
 class VulkanExample : public vkx::ExampleBase {
 public:
     bool displaySkybox = true;
+    // Reflect a probe captured around the objects instead of the static environment, with the objects moving
+    bool probeEnabled = false;
+    bool animate = false;
+    vkx::pbr::ReflectionProbe probe;
+    // The static environment is reflected until the probe's first update completed
+    bool probePublished = false;
 
     struct Textures {
         vks::texture::TextureCubeMap environmentCube;
+        // Keys the generated cubes in the texture cache
+        std::string environmentFile;
         // Generated at runtime
         vks::texture::Texture2D lutBrdf;
         vks::texture::TextureCubeMap irradianceCube;
+        // Order 2 spherical harmonics of the irradiance, the alternative to irradianceCube
+        vks::Buffer irradianceSH;
         vks::texture::TextureCubeMap prefilteredCube;
     } textures;
 
@@ -75,20 +88,33 @@ public:
         glm::vec4 lights[4];
         float exposure = 4.5f;
         float gamma = 2.2f;
+        // Evaluate the irradiance from the spherical harmonics rather than sampling the cube
+        int32_t irradianceFromSH = 0;
     } uboParams;
 
     struct {
         vk::Pipeline skybox;
         vk::Pipeline pbr;
+        // For the probe's render pass, writing linear color
+        vk::Pipeline captureSkybox;
+        vk::Pipeline capturePbr;
     } pipelines;
 
     struct {
         vk::DescriptorSet object;
         vk::DescriptorSet skybox;
+        // The objects reflecting the probe
+        vk::DescriptorSet probeObject;
+        // The scene as the probe sees it, with the matrices of each face in the frame allocator
+        vk::DescriptorSet captureObject;
+        vk::DescriptorSet captureSkybox;
     } descriptorSets;
 
     vk::PipelineLayout pipelineLayout;
     vk::DescriptorSetLayout descriptorSetLayout;
+    // Binding 0 is a dynamic uniform buffer
+    vk::PipelineLayout capturePipelineLayout;
+    vk::DescriptorSetLayout captureDescriptorSetLayout;
 
     // Default materials to select from
     std::vector<Material> materials;
@@ -124,6 +150,8 @@ public:
         materials.push_back(Material("Blue", glm::vec3(0.0f, 0.0f, 1.0f)));
 
         settings.overlay = true;
+        // The probe updates and the moving objects are recorded every frame
+        recordPerFrame = true;
 
         for (auto material : materials) {
             materialNames.push_back(material.name);
@@ -136,9 +164,15 @@ public:
     ~VulkanExample() {
         device.destroyPipeline(pipelines.skybox, nullptr);
         device.destroyPipeline(pipelines.pbr, nullptr);
+        device.destroyPipeline(pipelines.captureSkybox, nullptr);
+        device.destroyPipeline(pipelines.capturePbr, nullptr);
 
         device.destroyPipelineLayout(pipelineLayout, nullptr);
         device.destroyDescriptorSetLayout(descriptorSetLayout, nullptr);
+        device.destroyPipelineLayout(capturePipelineLayout, nullptr);
+        device.destroyDescriptorSetLayout(captureDescriptorSetLayout, nullptr);
+
+        probe.destroy();
 
         for (auto& model : models.objects) {
             model.destroy();
@@ -151,6 +185,7 @@ public:
 
         textures.environmentCube.destroy();
         textures.irradianceCube.destroy();
+        textures.irradianceSH.destroy();
         textures.prefilteredCube.destroy();
         textures.lutBrdf.destroy();
     }
@@ -159,27 +194,38 @@ public:
         if (context.deviceFeatures.samplerAnisotropy) {
             context.enabledFeatures.samplerAnisotropy = VK_TRUE;
         }
+        // Lets the BRDF look-up-table be generated in a two channel format
+        if (context.deviceFeatures.shaderStorageImageExtendedFormats) {
+            context.enabledFeatures.shaderStorageImageExtendedFormats = VK_TRUE;
+        }
     }
 
-    void updateDrawCommandBuffer(const vk::CommandBuffer& commandBuffer) override {
-        commandBuffer.setViewport(0, viewport());
-        commandBuffer.setScissor(0, scissor());
+    // The skybox and objects with `layout` and the sets and pipelines given, with the dynamic offsets of the capture
+    // sets' matrices
+    void drawScene(const vk::CommandBuffer& commandBuffer,
+                   const vk::PipelineLayout& layout,
+                   const vk::DescriptorSet& skyboxSet,
+                   const vk::Pipeline& skyboxPipeline,
+                   const vk::DescriptorSet& objectSet,
+                   const vk::Pipeline& objectPipeline,
+                   const std::vector<uint32_t>& skyboxOffsets = {},
+                   const std::vector<uint32_t>& objectOffsets = {}) {
         vk::DeviceSize offsets[1] = { 0 };
 
         // Skybox
         if (displaySkybox) {
-            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, 1, &descriptorSets.skybox, 0, NULL);
+            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, skyboxSet, skyboxOffsets);
             commandBuffer.bindVertexBuffers(0, 1, &models.skybox.vertices.buffer, offsets);
-            commandBuffer.bindIndexBuffer(models.skybox.indices.buffer, 0, vk::IndexType::eUint32);
-            commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.skybox);
+            commandBuffer.bindIndexBuffer(models.skybox.indices.buffer, 0, models.skybox.indexType);
+            commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, skyboxPipeline);
             commandBuffer.drawIndexed(models.skybox.indexCount, 1, 0, 0, 0);
         }
 
         // Objects
-        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, 1, &descriptorSets.object, 0, NULL);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, objectSet, objectOffsets);
         commandBuffer.bindVertexBuffers(0, 1, &models.objects[models.objectIndex].vertices.buffer, offsets);
-        commandBuffer.bindIndexBuffer(models.objects[models.objectIndex].indices.buffer, 0, vk::IndexType::eUint32);
-        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.pbr);
+        commandBuffer.bindIndexBuffer(models.objects[models.objectIndex].indices.buffer, 0, models.objects[models.objectIndex].indexType);
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, objectPipeline);
 
         Material mat = materials[materialIndex];
 
@@ -187,29 +233,63 @@ public:
 #ifdef SINGLE_ROW
         uint32_t objcount = 10;
         for (uint32_t x = 0; x < objcount; x++) {
-            glm::vec3 pos = glm::vec3(float(x - (objcount / 2.0f)) * 2.15f, 0.0f, 0.0f);
+            glm::vec3 pos = glm::vec3(float(x - (objcount / 2.0f)) * 2.15f, bob((float)x / (float)objcount), 0.0f);
             mat.params.roughness = 1.0f - glm::clamp((float)x / (float)objcount, 0.005f, 1.0f);
             mat.params.metallic = glm::clamp((float)x / (float)objcount, 0.005f, 1.0f);
-            commandBuffer.pushConstants<glm::vec3>(pipelineLayout, vSS::eVertex, 0, pos);
-            commandBuffer.pushConstants<Material::PushBlock>(pipelineLayout, vSS::eFragment, sizeof(glm::vec3), mat.params);
+            commandBuffer.pushConstants<glm::vec3>(layout, vSS::eVertex, 0, pos);
+            commandBuffer.pushConstants<Material::PushBlock>(layout, vSS::eFragment, sizeof(glm::vec3), mat.params);
             commandBuffer.drawIndexed(models.objects[models.objectIndex].indexCount, 1, 0, 0, 0);
         }
 #else
         for (uint32_t y = 0; y < GRID_DIM; y++) {
             mat.params.metallic = (float)y / (float)(GRID_DIM);
             for (uint32_t x = 0; x < GRID_DIM; x++) {
-                glm::vec3 pos = glm::vec3(float(x - (GRID_DIM / 2.0f)) * 2.5f, 0.0f, float(y - (GRID_DIM / 2.0f)) * 2.5f);
+                glm::vec3 pos = glm::vec3(float(x - (GRID_DIM / 2.0f)) * 2.5f, bob((float)(x + y) / (float)GRID_DIM), float(y - (GRID_DIM / 2.0f)) * 2.5f);
                 mat.params.roughness = glm::clamp((float)x / (float)(GRID_DIM), 0.05f, 1.0f);
-                commandBuffer.pushConstants<glm::vec3>(pipelineLayout, vSS::eVertex, 0, pos);
-                commandBuffer.pushConstants<Material::PushBlock>(pipelineLayout, vSS::eFragment, sizeof(glm::vec3), mat.params);
+                commandBuffer.pushConstants<glm::vec3>(layout, vSS::eVertex, 0, pos);
+                commandBuffer.pushConstants<Material::PushBlock>(layout, vSS::eFragment, sizeof(glm::vec3), mat.params);
                 commandBuffer.drawIndexed(models.objects[models.objectIndex].indexCount, 1, 0, 0, 0);
             }
         }
 #endif
     }
 
+    // Height of an object `phase` of the way along the row while animating
+    float bob(float phase) const { return animate ? sin((timer + phase) * 2.0f * float(M_PI)) * 0.75f : 0.0f; }
+
+    glm::mat4 objectModel() const {
+        return glm::rotate(glm::mat4(1.0f), glm::radians(90.0f + (models.objectIndex == 1 ? 45.0f : 0.0f)), glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+
+    // Probe steps within its budget, the objects it sees use the static maps
+    void updateCommandBufferPreDraw(const vk::CommandBuffer& commandBuffer) override {
+        if (!probeEnabled) {
+            return;
+        }
+        probePublished |= probe.update(commandBuffer, currentFrame, [&](const vk::CommandBuffer& faceCommandBuffer, uint32_t face) {
+            UBOMatrices matrices;
+            matrices.projection = probe.projection();
+            matrices.view = probe.faceView(face);
+            matrices.model = objectModel();
+            matrices.camPos = probe.getPosition();
+            const uint32_t objectOffset = frameAllocator.push(matrices);
+            matrices.model = glm::mat4(glm::mat3(matrices.view));
+            const uint32_t skyboxOffset = frameAllocator.push(matrices);
+            drawScene(faceCommandBuffer, capturePipelineLayout, descriptorSets.captureSkybox, pipelines.captureSkybox, descriptorSets.captureObject,
+                      pipelines.capturePbr, { skyboxOffset }, { objectOffset });
+        });
+    }
+
+    void updateDrawCommandBuffer(const vk::CommandBuffer& commandBuffer) override {
+        commandBuffer.setViewport(0, viewport());
+        commandBuffer.setScissor(0, scissor());
+        const auto& objectSet = probeEnabled && probePublished ? descriptorSets.probeObject : descriptorSets.object;
+        drawScene(commandBuffer, pipelineLayout, descriptorSets.skybox, pipelines.skybox, objectSet, pipelines.pbr);
+    }
+
     void loadAssets() override {
-        textures.environmentCube.loadFromFile(context, getAssetPath() + "textures/hdr/pisa_cube.ktx", vF::eR16G16B16A16Sfloat);
+        textures.environmentFile = getAssetPath() + "textures/hdr/pisa_cube.ktx";
+        textures.environmentCube.loadFromFile(context, textures.environmentFile, vF::eR16G16B16A16Sfloat);
         // Skybox
         models.skybox.loadFromFile(context, getAssetPath() + "models/cube.obj", vertexLayout, 1.0f);
         // Objects
@@ -226,19 +306,22 @@ public:
     void setupDescriptors() {
         // Descriptor Pool
         std::vector<vk::DescriptorPoolSize> poolSizes{
-            { vDT::eUniformBuffer, 4 },
-            { vDT::eCombinedImageSampler, 6 },
+            { vDT::eUniformBuffer, 13 },
+            { vDT::eUniformBufferDynamic, 2 },
+            { vDT::eCombinedImageSampler, 15 },
         };
 
-        descriptorPool = device.createDescriptorPool({ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
+        descriptorPool = device.createDescriptorPool({ {}, 5, (uint32_t)poolSizes.size(), poolSizes.data() });
 
         // Descriptor set layout
         std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
             { 0, vDT::eUniformBuffer, 1, vSS::eVertex | vSS::eFragment }, { 1, vDT::eUniformBuffer, 1, vSS::eFragment },
             { 2, vDT::eCombinedImageSampler, 1, vSS::eFragment },         { 3, vDT::eCombinedImageSampler, 1, vSS::eFragment },
-            { 4, vDT::eCombinedImageSampler, 1, vSS::eFragment },
+            { 4, vDT::eCombinedImageSampler, 1, vSS::eFragment },         { 5, vDT::eUniformBuffer, 1, vSS::eFragment },
         };
         descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+        setLayoutBindings[0].descriptorType = vDT::eUniformBufferDynamic;
+        captureDescriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
 
         // Descriptor sets
         vk::DescriptorSetAllocateInfo allocInfo{ descriptorPool, 1, &descriptorSetLayout };
@@ -250,6 +333,7 @@ public:
             { descriptorSets.object, 2, 0, 1, vDT::eCombinedImageSampler, &textures.irradianceCube.descriptor },
             { descriptorSets.object, 3, 0, 1, vDT::eCombinedImageSampler, &textures.lutBrdf.descriptor },
             { descriptorSets.object, 4, 0, 1, vDT::eCombinedImageSampler, &textures.prefilteredCube.descriptor },
+            { descriptorSets.object, 5, 0, 1, vDT::eUniformBuffer, nullptr, &textures.irradianceSH.descriptor },
         };
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
 
@@ -261,6 +345,36 @@ public:
             { descriptorSets.skybox, 2, 0, 1, vDT::eCombinedImageSampler, &textures.environmentCube.descriptor },
         };
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
+
+        // Objects reflecting the probe
+        descriptorSets.probeObject = device.allocateDescriptorSets(allocInfo)[0];
+        writeDescriptorSets = {
+            { descriptorSets.probeObject, 0, 0, 1, vDT::eUniformBuffer, nullptr, &uniformBuffers.object.descriptor },
+            { descriptorSets.probeObject, 1, 0, 1, vDT::eUniformBuffer, nullptr, &uniformBuffers.params.descriptor },
+            { descriptorSets.probeObject, 2, 0, 1, vDT::eCombinedImageSampler, &textures.irradianceCube.descriptor },
+            { descriptorSets.probeObject, 3, 0, 1, vDT::eCombinedImageSampler, &textures.lutBrdf.descriptor },
+            { descriptorSets.probeObject, 4, 0, 1, vDT::eCombinedImageSampler, &probe.cube().descriptor },
+            { descriptorSets.probeObject, 5, 0, 1, vDT::eUniformBuffer, nullptr, &textures.irradianceSH.descriptor },
+        };
+        device.updateDescriptorSets(writeDescriptorSets, nullptr);
+
+        // The probe's faces, which only reflect the static environment so they don't read the probe they're written to
+        vk::DescriptorSetAllocateInfo captureAllocInfo{ descriptorPool, 1, &captureDescriptorSetLayout };
+        const vk::DescriptorBufferInfo faceMatrices = frameAllocator.descriptor(sizeof(UBOMatrices));
+        descriptorSets.captureObject = device.allocateDescriptorSets(captureAllocInfo)[0];
+        descriptorSets.captureSkybox = device.allocateDescriptorSets(captureAllocInfo)[0];
+        writeDescriptorSets = {
+            { descriptorSets.captureObject, 0, 0, 1, vDT::eUniformBufferDynamic, nullptr, &faceMatrices },
+            { descriptorSets.captureObject, 1, 0, 1, vDT::eUniformBuffer, nullptr, &uniformBuffers.params.descriptor },
+            { descriptorSets.captureObject, 2, 0, 1, vDT::eCombinedImageSampler, &textures.irradianceCube.descriptor },
+            { descriptorSets.captureObject, 3, 0, 1, vDT::eCombinedImageSampler, &textures.lutBrdf.descriptor },
+            { descriptorSets.captureObject, 4, 0, 1, vDT::eCombinedImageSampler, &textures.prefilteredCube.descriptor },
+            { descriptorSets.captureObject, 5, 0, 1, vDT::eUniformBuffer, nullptr, &textures.irradianceSH.descriptor },
+            { descriptorSets.captureSkybox, 0, 0, 1, vDT::eUniformBufferDynamic, nullptr, &faceMatrices },
+            { descriptorSets.captureSkybox, 1, 0, 1, vDT::eUniformBuffer, nullptr, &uniformBuffers.params.descriptor },
+            { descriptorSets.captureSkybox, 2, 0, 1, vDT::eCombinedImageSampler, &textures.environmentCube.descriptor },
+        };
+        device.updateDescriptorSets(writeDescriptorSets, nullptr);
     }
 
     void preparePipelines() {
@@ -270,6 +384,8 @@ public:
             { vSS::eFragment, sizeof(glm::vec3), sizeof(Material::PushBlock) },
         };
         pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout, (uint32_t)pushConstantRanges.size(), pushConstantRanges.data() });
+        capturePipelineLayout =
+            device.createPipelineLayout({ {}, 1, &captureDescriptorSetLayout, (uint32_t)pushConstantRanges.size(), pushConstantRanges.data() });
 
         // Pipelines
         vks::pipelines::GraphicsPipelineBuilder pipelineBuilder{ device, pipelineLayout, renderPass };
@@ -290,6 +406,23 @@ public:
         pipelineBuilder.loadShader(getAssetPath() + "shaders/pbribl/pbribl.vert.spv", vSS::eVertex);
         pipelineBuilder.loadShader(getAssetPath() + "shaders/pbribl/pbribl.frag.spv", vSS::eFragment);
         pipelines.pbr = pipelineBuilder.create(context.pipelineCache);
+        pipelineBuilder.destroyShaderModules();
+
+        // The same for the probe, whose faces are pre-filtered and so are rendered without tone mapping
+        const uint32_t linearOutput = VK_TRUE;
+        vk::SpecializationMapEntry specializationEntry{ 0, 0, sizeof(uint32_t) };
+        vk::SpecializationInfo specializationInfo{ 1, &specializationEntry, sizeof(linearOutput), &linearOutput };
+        pipelineBuilder.layout = capturePipelineLayout;
+        pipelineBuilder.renderPass = probe.getRenderPass();
+        pipelineBuilder.depthStencilState = { false };
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/pbribl/skybox.vert.spv", vSS::eVertex);
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/pbribl/skybox.frag.spv", vSS::eFragment).pSpecializationInfo = &specializationInfo;
+        pipelines.captureSkybox = pipelineBuilder.create(context.pipelineCache);
+        pipelineBuilder.destroyShaderModules();
+        pipelineBuilder.depthStencilState = { true };
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/pbribl/pbribl.vert.spv", vSS::eVertex);
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/pbribl/pbribl.frag.spv", vSS::eFragment).pSpecializationInfo = &specializationInfo;
+        pipelines.capturePbr = pipelineBuilder.create(context.pipelineCache);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
@@ -311,7 +444,7 @@ public:
         // 3D object
         uboMatrices.projection = camera.matrices.perspective;
         uboMatrices.view = camera.matrices.view;
-        uboMatrices.model = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f + (models.objectIndex == 1 ? 45.0f : 0.0f)), glm::vec3(0.0f, 1.0f, 0.0f));
+        uboMatrices.model = objectModel();
         uboMatrices.camPos = camera.position * -1.0f;
         memcpy(uniformBuffers.object.mapped, &uboMatrices, sizeof(uboMatrices));
 
@@ -333,8 +466,17 @@ public:
     void prepare() override {
         ExampleBase::prepare();
         vkx::pbr::generateBRDFLUT(context, textures.lutBrdf);
-        vkx::pbr::generateIrradianceCube(context, textures.irradianceCube, models.skybox, vertexLayout, textures.environmentCube.descriptor);
-        vkx::pbr::generatePrefilteredCube(context, textures.prefilteredCube, models.skybox, vertexLayout, textures.environmentCube.descriptor);
+        vkx::pbr::generateIrradianceCube(context, textures.irradianceCube, textures.environmentCube, textures.environmentFile);
+        vkx::pbr::generateIrradianceSH(context, textures.irradianceSH, textures.environmentCube);
+        // --prefilter-compare also times the fixed sample count pre-filtering used to take, see PrefilterSettings
+        vkx::pbr::PrefilterSettings prefilterSettings;
+        const auto& args = vkx::getCommandLine();
+        prefilterSettings.compareFixed = std::find(args.begin(), args.end(), "--prefilter-compare") != args.end();
+        vkx::pbr::generatePrefilteredCube(context, textures.prefilteredCube, textures.environmentCube, textures.environmentFile, prefilterSettings);
+        probe.create(context, PROBE_POSITION, (uint32_t)frames.size());
+        // The matrices of the faces the probe renders in a frame, an object and a skybox set each
+        const vk::DeviceSize faceMatricesSize = vks::StagingRing::alignUp(sizeof(UBOMatrices), context.deviceProperties.limits.minUniformBufferOffsetAlignment);
+        frameAllocator.create(context, 2 * 6 * faceMatricesSize, (uint32_t)frames.size());
         prepareUniformBuffers();
         setupDescriptors();
         preparePipelines();
@@ -359,10 +501,26 @@ public:
             if (ui.inputFloat("Gamma", &uboParams.gamma, 0.1f, 2)) {
                 updateParams();
             }
+            if (ui.checkBox("Spherical harmonics irradiance", &uboParams.irradianceFromSH)) {
+                updateParams();
+            }
             if (ui.checkBox("Skybox", &displaySkybox)) {
+                probe.invalidate();
                 buildCommandBuffers();
             }
         }
+        if (ui.header("Reflection probe")) {
+            if (ui.checkBox("Dynamic reflection probe", &probeEnabled)) {
+                probe.invalidate();
+            }
+            ui.checkBox("Animate objects", &animate);
+            ui.sliderFloat("GPU budget (ms)", &probe.settings.budget, 0.05f, 4.0f);
+            double total = 0.0;
+            for (auto cost : probe.stepCosts()) {
+                total += std::max(cost, 0.0);
+            }
+            ui.text("Step %u of %u, %.2f ms per update cycle", probe.nextStep(), probe.stepCount(), total);
+        }
     }
 };
 
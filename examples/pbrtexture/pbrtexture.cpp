@@ -19,9 +19,13 @@ public:
 
     struct Textures {
         vks::texture::TextureCubeMap environmentCube;
+        // Keys the generated cubes in the texture cache
+        std::string environmentFile;
         // Generated at runtime
         vks::texture::Texture2D lutBrdf;
         vks::texture::TextureCubeMap irradianceCube;
+        // Order 2 spherical harmonics of the irradiance, the alternative to irradianceCube
+        vks::Buffer irradianceSH;
         vks::texture::TextureCubeMap prefilteredCube;
         // Object texture maps
         vks::texture::Texture2D albedoMap;
@@ -29,8 +33,14 @@ public:
         vks::texture::Texture2D aoMap;
         vks::texture::Texture2D metallicMap;
         vks::texture::Texture2D roughnessMap;
+        // Ambient occlusion, roughness and metallic in one texture, replacing the three maps above with packedMaterial
+        vks::texture::Texture2D ormMap;
     } textures;
 
+    // Use the material maps packed by tools/vkmaterial (the assets_materials target) if they're there: the ORM texture
+    // and BC5 normals, which take two fetches and descriptors instead of four
+    bool packedMaterial = false;
+
     // Vertex layout for the models
     vks::model::VertexLayout vertexLayout = vks::model::VertexLayout({
         vks::model::VERTEX_COMPONENT_POSITION,
@@ -60,11 +70,15 @@ public:
         glm::vec4 lights[4];
         float exposure = 4.5f;
         float gamma = 2.2f;
+        // Evaluate the irradiance from the spherical harmonics rather than sampling the cube
+        int32_t irradianceFromSH = 0;
     } uboParams;
 
     struct {
         vk::Pipeline skybox;
         vk::Pipeline pbr;
+        // The fragment shader's _fp16 variant, with shaderFloat16
+        vk::Pipeline pbrHalf;
     } pipelines;
 
     struct {
@@ -92,6 +106,9 @@ public:
     ~VulkanExample() {
         device.destroyPipeline(pipelines.skybox);
         device.destroyPipeline(pipelines.pbr);
+        if (pipelines.pbrHalf) {
+            device.destroyPipeline(pipelines.pbrHalf);
+        }
 
         device.destroyPipelineLayout(pipelineLayout);
         device.destroyDescriptorSetLayout(descriptorSetLayout);
@@ -105,6 +122,7 @@ public:
 
         textures.environmentCube.destroy();
         textures.irradianceCube.destroy();
+        textures.irradianceSH.destroy();
         textures.prefilteredCube.destroy();
         textures.lutBrdf.destroy();
         textures.albedoMap.destroy();
@@ -112,12 +130,17 @@ public:
         textures.aoMap.destroy();
         textures.metallicMap.destroy();
         textures.roughnessMap.destroy();
+        textures.ormMap.destroy();
     }
 
     void getEnabledFeatures() override {
         if (context.deviceFeatures.samplerAnisotropy) {
             context.enabledFeatures.samplerAnisotropy = VK_TRUE;
         }
+        // Lets the BRDF look-up-table be generated in a two channel format
+        if (context.deviceFeatures.shaderStorageImageExtendedFormats) {
+            context.enabledFeatures.shaderStorageImageExtendedFormats = VK_TRUE;
+        }
     }
 
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuf) override {
@@ -130,7 +153,7 @@ public:
         if (displaySkybox) {
             cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.skybox, nullptr);
             cmdBuf.bindVertexBuffers(0, models.skybox.vertices.buffer, offsets);
-            cmdBuf.bindIndexBuffer(models.skybox.indices.buffer, 0, vk::IndexType::eUint32);
+            cmdBuf.bindIndexBuffer(models.skybox.indices.buffer, 0, models.skybox.indexType);
             cmdBuf.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.skybox);
             cmdBuf.drawIndexed(models.skybox.indexCount, 1, 0, 0, 0);
         }
@@ -138,28 +161,60 @@ public:
         // Objects
         cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.object, nullptr);
         cmdBuf.bindVertexBuffers(0, models.object.vertices.buffer, offsets);
-        cmdBuf.bindIndexBuffer(models.object.indices.buffer, 0, vk::IndexType::eUint32);
-        cmdBuf.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.pbr);
-
-        cmdBuf.drawIndexed(models.object.indexCount, 1, 0, 0, 0);
+        cmdBuf.bindIndexBuffer(models.object.indices.buffer, 0, models.object.indexType);
+        recordWithPrecision(cmdBuf, size, [&](bool half) {
+            cmdBuf.bindPipeline(vk::PipelineBindPoint::eGraphics, half ? pipelines.pbrHalf : pipelines.pbr);
+            cmdBuf.drawIndexed(models.object.indexCount, 1, 0, 0, 0);
+        });
     }
 
+    bool supportsHalfPrecision() const override { return true; }
+
     void loadAssets() override {
-        textures.environmentCube.loadFromFile(context, getAssetPath() + "textures/hdr/gcanyon_cube.ktx", vF::eR16G16B16A16Sfloat);
+        const std::string materialPath = getAssetPath() + "models/cerberus/";
+        // BC5 is one of the formats textureCompressionBC guarantees
+        packedMaterial = context.enabledFeatures.textureCompressionBC && vks::storage::Storage::exists(materialPath + "orm.ktx") &&
+                         vks::storage::Storage::exists(materialPath + "normal_bc5.ktx");
+        const std::string fragmentShader = packedMaterial ? "pbrtexture_packed.frag.spv" : "pbrtexture.frag.spv";
+        using Files = std::vector<std::string>;
+        const Files materialFiles = packedMaterial ? Files{ "albedo.ktx", "orm.ktx", "normal_bc5.ktx" }
+                                                   : Files{ "albedo.ktx", "normal.ktx", "ao.ktx", "metallic.ktx", "roughness.ktx" };
+
+        // Queue up all the reads so the disk is busy while earlier files are being decoded
+        std::vector<std::string> files{
+            getAssetPath() + "textures/hdr/gcanyon_cube.ktx",
+            getAssetPath() + "models/cube.obj",
+            materialPath + "cerberus.fbx",
+            getAssetPath() + "shaders/pbrtexture/skybox.vert.spv",
+            getAssetPath() + "shaders/pbrtexture/skybox.frag.spv",
+            getAssetPath() + "shaders/pbrtexture/pbrtexture.vert.spv",
+            getAssetPath() + "shaders/pbrtexture/" + fragmentShader,
+        };
+        for (const auto& file : materialFiles) {
+            files.push_back(materialPath + file);
+        }
+        vks::file::prefetch(files);
+        textures.environmentFile = getAssetPath() + "textures/hdr/gcanyon_cube.ktx";
+        textures.environmentCube.loadFromFile(context, textures.environmentFile, vF::eR16G16B16A16Sfloat);
         models.skybox.loadFromFile(context, getAssetPath() + "models/cube.obj", vertexLayout, 1.0f);
         // PBR model
-        models.object.loadFromFile(context, getAssetPath() + "models/cerberus/cerberus.fbx", vertexLayout, 0.05f);
-        textures.albedoMap.loadFromFile(context, getAssetPath() + "models/cerberus/albedo.ktx", vF::eR8G8B8A8Unorm);
-        textures.normalMap.loadFromFile(context, getAssetPath() + "models/cerberus/normal.ktx", vF::eR8G8B8A8Unorm);
-        textures.aoMap.loadFromFile(context, getAssetPath() + "models/cerberus/ao.ktx", vF::eR8Unorm);
-        textures.metallicMap.loadFromFile(context, getAssetPath() + "models/cerberus/metallic.ktx", vF::eR8Unorm);
-        textures.roughnessMap.loadFromFile(context, getAssetPath() + "models/cerberus/roughness.ktx", vF::eR8Unorm);
+        models.object.loadFromFile(context, materialPath + "cerberus.fbx", vertexLayout, 0.05f);
+        textures.albedoMap.loadFromFile(context, materialPath + "albedo.ktx", vF::eR8G8B8A8Unorm);
+        if (packedMaterial) {
+            textures.normalMap.loadFromFile(context, materialPath + "normal_bc5.ktx", vF::eBc5UnormBlock);
+            textures.ormMap.loadFromFile(context, materialPath + "orm.ktx", vF::eR8G8B8A8Unorm);
+        } else {
+            textures.normalMap.loadFromFile(context, materialPath + "normal.ktx", vF::eR8G8B8A8Unorm);
+            textures.aoMap.loadFromFile(context, materialPath + "ao.ktx", vF::eR8Unorm);
+            textures.metallicMap.loadFromFile(context, materialPath + "metallic.ktx", vF::eR8Unorm);
+            textures.roughnessMap.loadFromFile(context, materialPath + "roughness.ktx", vF::eR8Unorm);
+        }
     }
 
     void setupDescriptors() {
         // Descriptor Pool
         std::vector<vk::DescriptorPoolSize> poolSizes{
-            { vDT::eUniformBuffer, 4 },
+            { vDT::eUniformBuffer, 6 },
             { vDT::eCombinedImageSampler, 16 },
         };
         descriptorPool = device.createDescriptorPool({ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
@@ -170,8 +225,13 @@ public:
             { 2, vDT::eCombinedImageSampler, 1, vSS::eFragment },         { 3, vDT::eCombinedImageSampler, 1, vSS::eFragment },
             { 4, vDT::eCombinedImageSampler, 1, vSS::eFragment },         { 5, vDT::eCombinedImageSampler, 1, vSS::eFragment },
             { 6, vDT::eCombinedImageSampler, 1, vSS::eFragment },         { 7, vDT::eCombinedImageSampler, 1, vSS::eFragment },
-            { 8, vDT::eCombinedImageSampler, 1, vSS::eFragment },         { 9, vDT::eCombinedImageSampler, 1, vSS::eFragment },
+            { 10, vDT::eUniformBuffer, 1, vSS::eFragment },
         };
+        // The packed material has no separate metallic and roughness maps
+        if (!packedMaterial) {
+            setLayoutBindings.push_back({ 8, vDT::eCombinedImageSampler, 1, vSS::eFragment });
+            setLayoutBindings.push_back({ 9, vDT::eCombinedImageSampler, 1, vSS::eFragment });
+        }
         descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
 
         // Descriptor sets
@@ -187,10 +247,15 @@ public:
             { descriptorSets.object, 4, 0, 1, vDT::eCombinedImageSampler, &textures.prefilteredCube.descriptor },
             { descriptorSets.object, 5, 0, 1, vDT::eCombinedImageSampler, &textures.albedoMap.descriptor },
             { descriptorSets.object, 6, 0, 1, vDT::eCombinedImageSampler, &textures.normalMap.descriptor },
-            { descriptorSets.object, 7, 0, 1, vDT::eCombinedImageSampler, &textures.aoMap.descriptor },
-            { descriptorSets.object, 8, 0, 1, vDT::eCombinedImageSampler, &textures.metallicMap.descriptor },
-            { descriptorSets.object, 9, 0, 1, vDT::eCombinedImageSampler, &textures.roughnessMap.descriptor },
+            { descriptorSets.object, 10, 0, 1, vDT::eUniformBuffer, nullptr, &textures.irradianceSH.descriptor },
         };
+        if (packedMaterial) {
+            writeDescriptorSets.push_back({ descriptorSets.object, 7, 0, 1, vDT::eCombinedImageSampler, &textures.ormMap.descriptor });
+        } else {
+            writeDescriptorSets.push_back({ descriptorSets.object, 7, 0, 1, vDT::eCombinedImageSampler, &textures.aoMap.descriptor });
+            writeDescriptorSets.push_back({ descriptorSets.object, 8, 0, 1, vDT::eCombinedImageSampler, &textures.metallicMap.descriptor });
+            writeDescriptorSets.push_back({ descriptorSets.object, 9, 0, 1, vDT::eCombinedImageSampler, &textures.roughnessMap.descriptor });
+        }
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
 
         // Sky box
@@ -220,10 +285,20 @@ public:
         // PBR pipeline
         pipelineBuilder.rasterizationState.cullMode = vk::CullModeFlagBits::eFront;
         pipelineBuilder.loadShader(getAssetPath() + "shaders/pbrtexture/pbrtexture.vert.spv", vSS::eVertex);
-        pipelineBuilder.loadShader(getAssetPath() + "shaders/pbrtexture/pbrtexture.frag.spv", vSS::eFragment);
+        const std::string fragmentShader = packedMaterial ? "pbrtexture_packed.frag.spv" : "pbrtexture.frag.spv";
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/pbrtexture/" + fragmentShader, vSS::eFragment);
         // Enable depth test and write
         pipelineBuilder.depthStencilState = { true };
         pipelines.pbr = pipelineBuilder.create(context.pipelineCache);
+
+        // The same with the shading in 16 bit arithmetic
+        if (context.shaderFloat16Enabled) {
+            pipelineBuilder.destroyShaderModules();
+            const std::string halfShader = packedMaterial ? "pbrtexture_packed_fp16.frag.spv" : "pbrtexture_fp16.frag.spv";
+            pipelineBuilder.loadShader(getAssetPath() + "shaders/pbrtexture/pbrtexture.vert.spv", vSS::eVertex);
+            pipelineBuilder.loadShader(getAssetPath() + "shaders/pbrtexture/" + halfShader, vSS::eFragment);
+            pipelines.pbrHalf = pipelineBuilder.create(context.pipelineCache);
+        }
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
@@ -264,8 +339,13 @@ public:
     void prepare() override {
         ExampleBase::prepare();
         vkx::pbr::generateBRDFLUT(context, textures.lutBrdf);
-        vkx::pbr::generateIrradianceCube(context, textures.irradianceCube, models.skybox, vertexLayout, textures.environmentCube.descriptor);
-        vkx::pbr::generatePrefilteredCube(context, textures.prefilteredCube, models.skybox, vertexLayout, textures.environmentCube.descriptor);
+        vkx::pbr::generateIrradianceCube(context, textures.irradianceCube, textures.environmentCube, textures.environmentFile);
+        vkx::pbr::generateIrradianceSH(context, textures.irradianceSH, textures.environmentCube);
+        // --prefilter-compare also times the fixed sample count pre-filtering used to take, see PrefilterSettings
+        vkx::pbr::PrefilterSettings prefilterSettings;
+        const auto& args = vkx::getCommandLine();
+        prefilterSettings.compareFixed = std::find(args.begin(), args.end(), "--prefilter-compare") != args.end();
+        vkx::pbr::generatePrefilteredCube(context, textures.prefilteredCube, textures.environmentCube, textures.environmentFile, prefilterSettings);
         prepareUniformBuffers();
         setupDescriptors();
         preparePipelines();
@@ -283,9 +363,13 @@ public:
             if (ui.inputFloat("Gamma", &uboParams.gamma, 0.1f, 2)) {
                 updateParams();
             }
+            if (ui.checkBox("Spherical harmonics irradiance", &uboParams.irradianceFromSH)) {
+                updateParams();
+            }
             if (ui.checkBox("Skybox", &displaySkybox)) {
                 buildCommandBuffers();
             }
+            ui.text(packedMaterial ? "Material: ORM and BC5 normal maps" : "Material: separate maps");
         }
     }
 };
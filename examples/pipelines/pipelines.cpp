@@ -51,6 +51,12 @@ public:
         camera.dolly(-10.5f);
         camera.setRotation({ -25.0f, 15.0f, 0.0f });
         title = "Vulkan Example - vk::Pipeline state objects";
+
+        // --draw-slices records each panel as a secondary command buffer on a worker thread, see drawSliceCount
+        const auto& args = vkx::getCommandLine();
+        if (std::find(args.begin(), args.end(), "--draw-slices") != args.end()) {
+            drawSliceCount = PANEL_COUNT;
+        }
     }
 
     ~VulkanExample() {
@@ -67,39 +73,54 @@ public:
 
         meshes.cube.destroy();
 
-        device.destroyBuffer(uniformDataVS.buffer);
-        device.freeMemory(uniformDataVS.memory);
+        uniformDataVS.destroy();
     }
 
-    void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
-        cmdBuffer.setScissor(0, vks::util::rect2D(size));
-        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
-        cmdBuffer.bindVertexBuffers(0, meshes.cube.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.cube.indices.buffer, 0, vk::IndexType::eUint32);
-
-        // Left : Solid colored
-        vk::Viewport viewport = vks::util::viewport((float)size.width / 3, (float)size.height, 0.0f, 1.0f);
-        cmdBuffer.setViewport(0, viewport);
-        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.phong);
-
-        cmdBuffer.drawIndexed(meshes.cube.indexCount, 1, 0, 0, 0);
+    // The panels, phong, toon and wireframe from left to right, each drawn with the whole of its own dynamic state,
+    // so that they can also be recorded as secondary command buffers of their own
+    static const uint32_t PANEL_COUNT = 3;
 
-        // Center : Toon
-        viewport.x += viewport.width;
+    void drawPanel(const vk::CommandBuffer& cmdBuffer, uint32_t panel) {
+        // Without fillModeNonSolid there is no wireframe pipeline, and its panel stays empty
+        if (panel == 2 && !context.deviceFeatures.fillModeNonSolid) {
+            return;
+        }
+        vk::Viewport viewport = vks::util::viewport((float)size.width / PANEL_COUNT, (float)size.height, 0.0f, 1.0f);
+        viewport.x = viewport.width * panel;
         cmdBuffer.setViewport(0, viewport);
-        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.toon);
+        cmdBuffer.setScissor(0, vks::util::rect2D(size));
+        // Dynamic in all three pipelines, the wireframe's lines used to inherit it from the toon panel
         cmdBuffer.setLineWidth(2.0f);
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
+        cmdBuffer.bindVertexBuffers(0, meshes.cube.vertices.buffer, { 0 });
+        cmdBuffer.bindIndexBuffer(meshes.cube.indices.buffer, 0, meshes.cube.indexType);
+        switch (panel) {
+            case 0:
+                // Left : Solid colored
+                cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.phong);
+                break;
+            case 1:
+                // Center : Toon
+                cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.toon);
+                break;
+            default:
+                // Right : Wireframe
+                cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.wireframe);
+                break;
+        }
         cmdBuffer.drawIndexed(meshes.cube.indexCount, 1, 0, 0, 0);
+    }
 
-        auto lineWidthGranularity = context.deviceProperties.limits.lineWidthGranularity;
-        auto lineWidthRange = context.deviceProperties.limits.lineWidthRange;
+    void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        for (uint32_t panel = 0; panel < PANEL_COUNT; ++panel) {
+            drawPanel(cmdBuffer, panel);
+        }
+    }
 
-        if (context.deviceFeatures.fillModeNonSolid) {
-            // Right : Wireframe
-            viewport.x += viewport.width;
-            cmdBuffer.setViewport(0, viewport);
-            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.wireframe);
-            cmdBuffer.drawIndexed(meshes.cube.indexCount, 1, 0, 0, 0);
+    // With drawSliceCount set, the panels are spread over the slices, recorded on worker threads
+    void updateDrawCommandBufferSlice(const vk::CommandBuffer& cmdBuffer, uint32_t slice, uint32_t sliceCount) override {
+        for (uint32_t panel = slice; panel < PANEL_COUNT; panel += sliceCount) {
+            drawPanel(cmdBuffer, panel);
         }
     }
 
@@ -136,6 +157,8 @@ public:
 
     void preparePipelines() {
         vks::pipelines::GraphicsPipelineBuilder pipelineCreator{ device, pipelineLayout, renderPass };
+        // Used instead of the render pass with --dynamic-rendering
+        pipelineCreator.renderingState = renderingFormats;
 
         pipelineCreator.rasterizationState.frontFace = vk::FrontFace::eClockwise;
         pipelineCreator.dynamicState.dynamicStateEnables = {
@@ -210,6 +233,18 @@ public:
     }
 
     void viewChanged() override { updateUniformBuffers(); }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            bool slices = drawSliceCount != 0;
+            if (ui.checkBox("Record panels on worker threads", &slices)) {
+                drawSliceCount = slices ? PANEL_COUNT : 0;
+                buildCommandBuffers();
+            }
+        }
+    }
+
+    bool supportsDynamicRendering() const override { return true; }
 };
 
 RUN_EXAMPLE(VulkanExample)
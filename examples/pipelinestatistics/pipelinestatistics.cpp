@@ -47,12 +47,6 @@ public:
     vk::DescriptorSet descriptorSet;
     vk::DescriptorSetLayout descriptorSetLayout;
 
-    vk::QueryPool queryPool;
-
-    // Vector for storing pipeline statistics results
-    std::vector<uint64_t> pipelineStats;
-    std::vector<std::string> pipelineStatNames;
-
     int32_t gridSize = 3;
 
     VulkanExample() {
@@ -64,13 +58,14 @@ public:
         camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 256.0f);
         camera.rotationSpeed = 0.25f;
         settings.overlay = true;
+        // The counters are collected by the GPU profiler, for the "Scene" region
+        settings.gpuTimings = true;
     }
 
     ~VulkanExample() {
         device.destroy(pipeline);
         device.destroy(pipelineLayout);
         device.destroy(descriptorSetLayout);
-        device.destroy(queryPool);
         uniformBuffers.VS.destroy();
         for (auto& model : models.objects) {
             model.destroy();
@@ -92,59 +87,19 @@ public:
         }
     }
 
-    // Setup a query pool for storing pipeline statistics
-    void setupQueryPool() {
-        pipelineStatNames = {
-            "Input assembly vertex count        ", "Input assembly primitives count    ", "Vertex shader invocations          ",
-            "Clipping stage primitives processed", "Clipping stage primtives output    ", "Fragment shader invocations        ",
-        };
-        if (deviceFeatures.tessellationShader) {
-            pipelineStatNames.push_back("Tess. control shader patches       ");
-            pipelineStatNames.push_back("Tess. eval. shader invocations     ");
-        }
-        pipelineStats.resize(pipelineStatNames.size());
-
-        vk::QueryPoolCreateInfo queryPoolInfo = {};
-        // This query pool will store pipeline statistics
-        queryPoolInfo.queryType = vk::QueryType::ePipelineStatistics;
-
-        // Pipeline counters to be returned for this pool
-        queryPoolInfo.pipelineStatistics =
-            vk::QueryPipelineStatisticFlagBits::eInputAssemblyVertices | vk::QueryPipelineStatisticFlagBits::eInputAssemblyPrimitives |
-            vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations | vk::QueryPipelineStatisticFlagBits::eClippingInvocations |
-            vk::QueryPipelineStatisticFlagBits::eClippingPrimitives | vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations;
-        if (deviceFeatures.tessellationShader) {
-            queryPoolInfo.pipelineStatistics |= vk::QueryPipelineStatisticFlagBits::eTessellationControlShaderPatches |
-                                                vk::QueryPipelineStatisticFlagBits::eTessellationEvaluationShaderInvocations;
-        }
-        queryPoolInfo.queryCount = deviceFeatures.tessellationShader ? 8 : 6;
-        queryPool = device.createQueryPool(queryPoolInfo);
-    }
-
-    // Retrieves the results of the pipeline statistics query submitted to the command buffer
-    void getQueryResults() {
-        uint32_t count = static_cast<uint32_t>(pipelineStats.size());
-        device.getQueryPoolResults<uint64_t>(queryPool, 0, 1, pipelineStats, sizeof(uint64_t), vk::QueryResultFlagBits::e64);
-    }
-
-    void updateCommandBufferPreDraw(const vk::CommandBuffer& drawCmdBuffer) {
-        // Reset timestamp query pool
-        drawCmdBuffer.resetQueryPool(queryPool, 0, static_cast<uint32_t>(pipelineStats.size()));
-    }
-
     void updateDrawCommandBuffer(const vk::CommandBuffer& drawCmdBuffer) {
         drawCmdBuffer.setViewport(0, viewport());
         drawCmdBuffer.setScissor(0, scissor());
 
         VkDeviceSize offsets[1] = { 0 };
 
-        // Start capture of pipeline statistics
-        drawCmdBuffer.beginQuery(queryPool, 0, vk::QueryControlFlagBits::ePrecise);
+        // Regions directly inside the frame capture pipeline statistics
+        vks::debug::marker::beginRegion(drawCmdBuffer, "Scene", glm::vec4(1.0f));
 
         drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
         drawCmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
         drawCmdBuffer.bindVertexBuffers(0, 1, &models.objects[models.objectIndex].vertices.buffer, offsets);
-        drawCmdBuffer.bindIndexBuffer(models.objects[models.objectIndex].indices.buffer, 0, vk::IndexType::eUint32);
+        drawCmdBuffer.bindIndexBuffer(models.objects[models.objectIndex].indices.buffer, 0, models.objects[models.objectIndex].indexType);
 
         for (int32_t y = 0; y < gridSize; y++) {
             for (int32_t x = 0; x < gridSize; x++) {
@@ -154,19 +109,7 @@ public:
             }
         }
 
-        // End capture of pipeline statistics
-        drawCmdBuffer.endQuery(queryPool, 0);
-    }
-
-    void draw() {
-        ExampleBase::prepareFrame();
-
-        drawCurrentCommandBuffer();
-
-        // Read query results for displaying in next frame
-        getQueryResults();
-
-        ExampleBase::submitFrame();
+        vks::debug::marker::endRegion(drawCmdBuffer);
     }
 
     void loadAssets() override {
@@ -268,7 +211,6 @@ public:
 
     void prepare() override {
         ExampleBase::prepare();
-        setupQueryPool();
         prepareUniformBuffers();
         setupDescriptorSetLayout();
         preparePipelines();
@@ -278,12 +220,6 @@ public:
         prepared = true;
     }
 
-    void render() override {
-        if (!prepared)
-            return;
-        draw();
-    }
-
     void viewChanged() override { updateUniformBuffers(); }
 
     void OnUpdateUIOverlay() override {
@@ -321,14 +257,6 @@ public:
                 buildCommandBuffers();
             }
         }
-        if (!pipelineStats.empty()) {
-            if (ui.header("Pipeline statistics")) {
-                for (auto i = 0; i < pipelineStats.size(); i++) {
-                    std::string caption = pipelineStatNames[i] + ": %d";
-                    ui.text(caption.c_str(), pipelineStats[i]);
-                }
-            }
-        }
     }
 };
 
@@ -111,7 +111,7 @@ public:
 
         vk::DeviceSize offsets = 0;
         cmdBuffer.bindVertexBuffers(0, meshes.scene.vertices.buffer, offsets);
-        cmdBuffer.bindIndexBuffer(meshes.scene.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.scene.indices.buffer, 0, meshes.scene.indexType);
 
         cmdBuffer.drawIndexed(meshes.scene.indexCount, 1, 0, 0, 0);
     }
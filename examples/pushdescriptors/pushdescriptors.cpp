@@ -8,12 +8,16 @@
 * this example uses push descriptors to pass descriptor sets for per-model textures and matrices 
 * at command buffer creation time.
 *
+* On Vulkan 1.1 devices the pushes go through a descriptor update template compiled once from a
+* vku::DescriptorSetUpdater, otherwise through write descriptor structures built for every draw.
+*
 * Copyright (C) 2018 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
 #include <vulkanExampleBase.h>
+#include <vks/vku.hpp>
 
 class VulkanExample : public vkx::ExampleBase
 {
@@ -55,6 +59,11 @@ public:
     vk::PipelineLayout pipelineLayout;
     vk::DescriptorSetLayout descriptorSetLayout;
 
+    // The pushed bindings compiled into a descriptor update template (Vulkan 1.1).  Per cube only the model matrix
+    // buffer and the texture of the updater are replaced before pushing, no write structures are built
+    vku::DescriptorSetUpdater pushUpdater{ 2, 1 };
+    vk::DescriptorUpdateTemplate pushTemplate;
+
     VulkanExample()  {
         title = "Push descriptors";
         settings.overlay = true;
@@ -77,6 +86,9 @@ public:
 
     ~VulkanExample()
     {
+        if (pushTemplate) {
+            device.destroyDescriptorUpdateTemplate(pushTemplate, nullptr, dispatcher);
+        }
         device.destroy(pipeline);
         device.destroy(pipelineLayout);
         device.destroy(descriptorSetLayout);
@@ -100,10 +112,17 @@ public:
         drawCmdBuffer.setScissor(0, scissor());
         drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
         drawCmdBuffer.bindVertexBuffers(0, models.cube.vertices.buffer, { 0 });
-        drawCmdBuffer.bindIndexBuffer(models.cube.indices.buffer, 0, vk::IndexType::eUint32);
+        drawCmdBuffer.bindIndexBuffer(models.cube.indices.buffer, 0, models.cube.indexType);
 
         // Render two cubes using different descriptor sets using push descriptors
         for (const auto& cube : cubes) {
+            if (pushTemplate) {
+                pushUpdater.setBuffer(1, cube.uniformBuffer.descriptor);
+                pushUpdater.setImage(0, cube.texture.descriptor);
+                pushUpdater.push(drawCmdBuffer, pushTemplate, pipelineLayout, 0, dispatcher);
+                drawCmdBuffer.drawIndexed(models.cube.indexCount, 1, 0, 0, 0);
+                continue;
+            }
 
             // Instead of preparing the descriptor sets up-front, using push descriptors we can set (push) them inside of a command buffer
             // This allows a more dynamic approach without the need to create descriptor sets for each model
@@ -143,6 +162,20 @@ public:
         descriptorSetLayout = device.createDescriptorSetLayout({ vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptorKHR, static_cast<uint32_t>(setLayoutBindings.size()), setLayoutBindings.data() });
 
         pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+
+        // Same bindings as the writes in updateDrawCommandBuffer, with the first cube's resources as placeholders
+        if (context.deviceProperties.apiVersion >= VK_MAKE_VERSION(1, 1, 0)) {
+            pushUpdater.beginBuffers(0, 0, vk::DescriptorType::eUniformBuffer);
+            const auto& scene = uniformBuffers.scene.descriptor;
+            pushUpdater.buffer(scene.buffer, scene.offset, scene.range);
+            pushUpdater.beginBuffers(1, 0, vk::DescriptorType::eUniformBuffer);
+            const auto& model = cubes[0].uniformBuffer.descriptor;
+            pushUpdater.buffer(model.buffer, model.offset, model.range);
+            pushUpdater.beginImages(2, 0, vk::DescriptorType::eCombinedImageSampler);
+            const auto& texture = cubes[0].texture.descriptor;
+            pushUpdater.image(texture.sampler, texture.imageView, texture.imageLayout);
+            pushTemplate = pushUpdater.createPushTemplate(device, vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, dispatcher);
+        }
     }
 
     void preparePipelines()
@@ -1,5 +1,5 @@
 /*
-* Vulkan Example - Fullscreen radial blur (Single pass offscreen effect)
+* Vulkan Example - Fullscreen radial blur (Single pass offscreen effect, or reduced resolution compute passes)
 *
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
@@ -10,6 +10,9 @@
 
 // Texture properties
 #define TEX_DIM 128
+// Compute path, see radial below
+#define RADIAL_PASSES 3
+#define RADIAL_TAPS 4
 
 // Vertex layout for this example
 vks::model::VertexLayout vertexLayout{ {
@@ -23,6 +26,9 @@ class VulkanExample : public vkx::OffscreenExampleBase {
 public:
     bool blur = true;
     bool displayTexture = false;
+    bool computeBlur = true;
+    // The compute path's resolution, at 1 / (2 << computeResolution) of the window's in either direction
+    int32_t computeResolution = 0;
 
     struct {
         vks::model::Model example;
@@ -58,6 +64,8 @@ public:
         vk::Pipeline colorPass;
         vk::Pipeline phongPass;
         vk::Pipeline fullScreenOnly;
+        vk::Pipeline composite;
+        vk::Pipeline compositeOnly;
     } pipelines;
 
     struct {
@@ -68,8 +76,29 @@ public:
     struct {
         vk::DescriptorSet scene;
         vk::DescriptorSet quad;
+        vk::DescriptorSet composite;
     } descriptorSets;
 
+    // The compute path.  The glow source is blurred at a fraction of the window's resolution in RADIAL_PASSES
+    // passes, back and forth between two targets, and the last one is added to the scene by a bilinear upsample.
+    // Each pass takes RADIAL_TAPS samples along the ray with steps RADIAL_TAPS times longer than the pass before, so
+    // the passes average RADIAL_TAPS ^ RADIAL_PASSES positions for RADIAL_TAPS * RADIAL_PASSES taps per reduced
+    // texel, where radialblur.frag takes 16 for every pixel of the window.
+    struct RadialPass {
+        glm::vec2 origin;
+        float step;
+    };
+
+    struct {
+        std::array<vks::Image, 2> targets;
+        vk::Extent2D extent;
+        vk::DescriptorSetLayout setLayout;
+        vk::PipelineLayout layout;
+        vk::Pipeline pipeline;
+        // Set i is read and written by pass i
+        std::array<vk::DescriptorSet, RADIAL_PASSES> sets;
+    } radial;
+
     // Descriptor set layout is shared amongst
     // all descriptor sets
     vk::DescriptorSetLayout descriptorSetLayout;
@@ -89,11 +118,14 @@ public:
         device.destroyPipeline(pipelines.phongPass);
         device.destroyPipeline(pipelines.colorPass);
         device.destroyPipeline(pipelines.fullScreenOnly);
+        device.destroyPipeline(pipelines.composite);
+        device.destroyPipeline(pipelines.compositeOnly);
+        device.destroyPipeline(radial.pipeline);
+        for (auto& target : radial.targets) {
+            target.destroy();
+        }
 
-        device.destroyPipelineLayout(pipelineLayouts.radialBlur);
-        device.destroyPipelineLayout(pipelineLayouts.scene);
-
-        device.destroyDescriptorSetLayout(descriptorSetLayout);
+        // The layouts belong to the context's layout cache
 
         // Meshes
         meshes.example.destroy();
@@ -125,6 +157,7 @@ public:
         renderPassBeginInfo.clearValueCount = 2;
         renderPassBeginInfo.pClearValues = clearValues;
 
+        offscreen.cmdBuffer.reset(vk::CommandBufferResetFlagBits::eReleaseResources);
         offscreen.cmdBuffer.begin(cmdBufInfo);
         offscreen.cmdBuffer.setViewport(0, vks::util::viewport(offscreen.size));
         offscreen.cmdBuffer.setScissor(0, vks::util::rect2D(offscreen.size));
@@ -134,13 +167,40 @@ public:
 
         vk::DeviceSize offsets = 0;
         offscreen.cmdBuffer.bindVertexBuffers(0, meshes.example.vertices.buffer, offsets);
-        offscreen.cmdBuffer.bindIndexBuffer(meshes.example.indices.buffer, 0, vk::IndexType::eUint32);
+        offscreen.cmdBuffer.bindIndexBuffer(meshes.example.indices.buffer, 0, meshes.example.indexType);
         offscreen.cmdBuffer.drawIndexed(meshes.example.indexCount, 1, 0, 0, 0);
         offscreen.cmdBuffer.endRenderPass();
 
+        if (computeBlur) {
+            buildRadialCommands(offscreen.cmdBuffer);
+        }
+
         offscreen.cmdBuffer.end();
     }
 
+    void buildRadialCommands(const vk::CommandBuffer& cmdBuffer) {
+        // The glow source has to be written, and the previous frame's composition done reading the last target
+        vk::MemoryBarrier sourceBarrier{ vk::AccessFlagBits::eColorAttachmentWrite, vk::AccessFlagBits::eShaderRead };
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eFragmentShader,
+                                  vk::PipelineStageFlagBits::eComputeShader, {}, sourceBarrier, nullptr, nullptr);
+
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, radial.pipeline);
+        // The steps of all passes add up to the span of radialblur.frag's samples
+        RadialPass pass{ uboQuadFS.radialOrigin, uboQuadFS.radialBlurScale / (std::pow((float)RADIAL_TAPS, (float)RADIAL_PASSES) - 1.0f) };
+        for (uint32_t i = 0; i < RADIAL_PASSES; ++i) {
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, radial.layout, 0, radial.sets[i], nullptr);
+            cmdBuffer.pushConstants<RadialPass>(radial.layout, vk::ShaderStageFlagBits::eCompute, 0, pass);
+            cmdBuffer.dispatch((radial.extent.width + 7) / 8, (radial.extent.height + 7) / 8, 1);
+            // The next pass reads this one's target and writes the one this pass read, the main pass samples the last
+            const bool last = i == RADIAL_PASSES - 1;
+            vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead };
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                      last ? vk::PipelineStageFlagBits::eFragmentShader : vk::PipelineStageFlagBits::eComputeShader, {}, barrier,
+                                      nullptr, nullptr);
+            pass.step *= RADIAL_TAPS;
+        }
+    }
+
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
         cmdBuffer.setViewport(0, vks::util::viewport(size));
         cmdBuffer.setScissor(0, vks::util::rect2D(size));
@@ -149,15 +209,20 @@ public:
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.phongPass);
 
         cmdBuffer.bindVertexBuffers(0, meshes.example.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.example.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.example.indices.buffer, 0, meshes.example.indexType);
         cmdBuffer.drawIndexed(meshes.example.indexCount, 1, 0, 0, 0);
 
         // Fullscreen quad with radial blur
         if (blur) {
-            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.radialBlur, 0, descriptorSets.quad, nullptr);
-            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, (displayTexture) ? pipelines.fullScreenOnly : pipelines.radialBlur);
+            if (computeBlur) {
+                cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.radialBlur, 0, descriptorSets.composite, nullptr);
+                cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, (displayTexture) ? pipelines.compositeOnly : pipelines.composite);
+            } else {
+                cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.radialBlur, 0, descriptorSets.quad, nullptr);
+                cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, (displayTexture) ? pipelines.fullScreenOnly : pipelines.radialBlur);
+            }
             cmdBuffer.bindVertexBuffers(0, meshes.quad.vertices.buffer, { 0 });
-            cmdBuffer.bindIndexBuffer(meshes.quad.indices.buffer, 0, vk::IndexType::eUint32);
+            cmdBuffer.bindIndexBuffer(meshes.quad.indices.buffer, 0, meshes.quad.indexType);
             cmdBuffer.drawIndexed(meshes.quad.indexCount, 1, 0, 0, 0);
         }
     }
@@ -188,30 +253,99 @@ public:
     }
 
     void setupDescriptorPool() {
-        // Example uses three ubos and one image sampler
+        // Example uses three ubos and one image sampler, and the compute path a sampler and a storage image per pass
         std::vector<vk::DescriptorPoolSize> poolSizes = {
-            { vk::DescriptorType::eUniformBuffer, 4 },
-            { vk::DescriptorType::eCombinedImageSampler, 2 },
+            { vk::DescriptorType::eUniformBuffer, 6 },
+            { vk::DescriptorType::eCombinedImageSampler, 3 + RADIAL_PASSES },
+            { vk::DescriptorType::eStorageImage, RADIAL_PASSES },
         };
 
-        descriptorPool = device.createDescriptorPool({ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
+        descriptorPool = device.createDescriptorPool({ {}, 3 + RADIAL_PASSES, (uint32_t)poolSizes.size(), poolSizes.data() });
     }
 
     void setupDescriptorSetLayout() {
-        // Textured quad pipeline layout
-        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings = {
-            // Binding 0 : Vertex shader uniform buffer
-            { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
-            // Binding 1 : Fragment shader image sampler
-            { 1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
-            // Binding 2 : Fragment shader uniform buffer
-            { 2, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment },
-        };
-
-        descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
-        pipelineLayouts.radialBlur = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+        // Every pass binds a set of the same layout, which is the union of what all of their shaders declare: a vertex
+        // shader uniform buffer at binding 0, and a fragment shader image sampler and uniform buffer at 1 and 2 for
+        // the radial blur.  Reflected together, the passes get the same pipeline layout, so the set bound for the
+        // scene stays bound across the pipeline switches.
+        vks::shaders::ShaderLayout layout;
+        for (const auto& pass : { "radialblur", "phongpass", "colorpass" }) {
+            const auto path = getAssetPath() + "shaders/radialblur/" + pass;
+            layout.merge(vks::shaders::reflectShader(device, path + ".vert.spv", vk::ShaderStageFlagBits::eVertex));
+            layout.merge(vks::shaders::reflectShader(device, path + ".frag.spv", vk::ShaderStageFlagBits::eFragment));
+        }
+        // The compute path's composition draws the same quad
+        layout.merge(vks::shaders::reflectShader(device, getAssetPath() + "shaders/radialblur/radialcomposite.frag.spv", vk::ShaderStageFlagBits::eFragment));
+        descriptorSetLayout = context.layoutCache->getDescriptorSetLayout(layout, 0);
+        pipelineLayouts.radialBlur = context.layoutCache->getPipelineLayout(layout);
         // Offscreen pipeline layout
-        pipelineLayouts.scene = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+        pipelineLayouts.scene = pipelineLayouts.radialBlur;
+
+        const auto radialLayout =
+            vks::shaders::reflectShader(device, getAssetPath() + "shaders/radialblur/radialblur.comp.spv", vk::ShaderStageFlagBits::eCompute);
+        radial.setLayout = context.layoutCache->getDescriptorSetLayout(radialLayout, 0);
+        radial.layout = context.layoutCache->getPipelineLayout(radialLayout);
+    }
+
+    // The targets of the compute path, at the current computeResolution of the window
+    void prepareRadialTargets() {
+        const uint32_t divisor = 2u << computeResolution;
+        radial.extent = vk::Extent2D{ std::max(1u, size.width / divisor), std::max(1u, size.height / divisor) };
+        const vk::Format format = vk::Format::eR16G16B16A16Sfloat;
+        vk::ImageCreateInfo imageCreateInfo;
+        imageCreateInfo.imageType = vk::ImageType::e2D;
+        imageCreateInfo.format = format;
+        imageCreateInfo.extent = vk::Extent3D{ radial.extent.width, radial.extent.height, 1 };
+        imageCreateInfo.mipLevels = 1;
+        imageCreateInfo.arrayLayers = 1;
+        imageCreateInfo.usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled;
+
+        vk::SamplerCreateInfo samplerInfo;
+        samplerInfo.magFilter = vk::Filter::eLinear;
+        samplerInfo.minFilter = vk::Filter::eLinear;
+        samplerInfo.addressModeU = samplerInfo.addressModeV = samplerInfo.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+        samplerInfo.maxAnisotropy = 1.0f;
+        samplerInfo.borderColor = vk::BorderColor::eFloatOpaqueWhite;
+
+        const vk::ImageSubresourceRange range{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
+        for (auto& target : radial.targets) {
+            target = context.createImage(imageCreateInfo);
+            // Written as storage and sampled by the next pass, so the targets stay in the general layout
+            context.setImageLayout(target.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, range);
+            target.view = device.createImageView({ {}, target.image, vk::ImageViewType::e2D, format, {}, range });
+            target.sampler = vks::acquireSampler(device, samplerInfo);
+        }
+    }
+
+    // Pass 0 reads the glow source, every later pass the target the pass before it wrote
+    void updateRadialDescriptorSets() {
+        vk::DescriptorImageInfo sourceDescriptor{ offscreen.framebuffers[0].colors[0].sampler, offscreen.framebuffers[0].colors[0].view,
+                                                  vk::ImageLayout::eShaderReadOnlyOptimal };
+        std::array<vk::DescriptorImageInfo, 2> targetDescriptors;
+        for (uint32_t i = 0; i < 2; ++i) {
+            targetDescriptors[i] = vk::DescriptorImageInfo{ radial.targets[i].sampler, radial.targets[i].view, vk::ImageLayout::eGeneral };
+        }
+        std::vector<vk::WriteDescriptorSet> writeDescriptorSets;
+        for (uint32_t i = 0; i < RADIAL_PASSES; ++i) {
+            const vk::DescriptorImageInfo* input = i ? &targetDescriptors[(i - 1) % 2] : &sourceDescriptor;
+            writeDescriptorSets.push_back({ radial.sets[i], 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, input });
+            writeDescriptorSets.push_back({ radial.sets[i], 1, 0, 1, vk::DescriptorType::eStorageImage, &targetDescriptors[i % 2] });
+        }
+        writeDescriptorSets.push_back(
+            { descriptorSets.composite, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &targetDescriptors[(RADIAL_PASSES - 1) % 2] });
+        device.updateDescriptorSets(writeDescriptorSets, nullptr);
+    }
+
+    // Recreate the compute path's targets for the window's size or a new computeResolution
+    void resizeRadialTargets() {
+        // The offscreen command buffer may still be executing
+        device.waitIdle();
+        for (auto& target : radial.targets) {
+            target.destroy();
+        }
+        prepareRadialTargets();
+        updateRadialDescriptorSets();
+        buildOffscreenCommandBuffer();
     }
 
     void setupDescriptorSet() {
@@ -241,6 +375,19 @@ public:
             { descriptorSets.scene, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.vsQuad.descriptor },
         };
         device.updateDescriptorSets(offscreenWriteDescriptorSets, nullptr);
+
+        // Compute path, the composition draws the same quad as the fragment shader blur
+        descriptorSets.composite = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+        device.updateDescriptorSets(
+            {
+                { descriptorSets.composite, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.vsScene.descriptor },
+                { descriptorSets.composite, 2, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.fsQuad.descriptor },
+            },
+            nullptr);
+        for (auto& set : radial.sets) {
+            set = device.allocateDescriptorSets({ descriptorPool, 1, &radial.setLayout })[0];
+        }
+        updateRadialDescriptorSets();
     }
 
     void preparePipelines() {
@@ -268,6 +415,26 @@ public:
         blendAttachmentState.blendEnable = VK_FALSE;
         pipelines.fullScreenOnly = pipelineBuilder.create(context.pipelineCache);
 
+        // Composition of the compute path, blended the same way
+        pipelineBuilder.destroyShaderModules();
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/radialblur/radialblur.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/radialblur/radialcomposite.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipelines.compositeOnly = pipelineBuilder.create(context.pipelineCache);
+        blendAttachmentState.blendEnable = VK_TRUE;
+        pipelines.composite = pipelineBuilder.create(context.pipelineCache);
+
+        // Radial blur passes of the compute path
+        vk::SpecializationMapEntry specializationEntry{ 0, 0, sizeof(int32_t) };
+        const int32_t taps = RADIAL_TAPS;
+        vk::SpecializationInfo specializationInfo{ 1, &specializationEntry, sizeof(int32_t), &taps };
+        vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+        computePipelineCreateInfo.layout = radial.layout;
+        computePipelineCreateInfo.stage =
+            vks::shaders::loadShader(device, getAssetPath() + "shaders/radialblur/radialblur.comp.spv", vk::ShaderStageFlagBits::eCompute);
+        computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+        radial.pipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+
         // Phong pass
         pipelineBuilder.destroyShaderModules();
         pipelineBuilder.loadShader(getAssetPath() + "shaders/radialblur/phongpass.vert.spv", vk::ShaderStageFlagBits::eVertex);
@@ -328,6 +495,7 @@ public:
         loadMeshes();
         prepareUniformBuffers();
         setupDescriptorSetLayout();
+        prepareRadialTargets();
         preparePipelines();
         setupDescriptorPool();
         setupDescriptorSet();
@@ -350,6 +518,8 @@ public:
         updateUniformBuffersScreen();
     }
 
+    void windowResized() override { resizeRadialTargets(); }
+
     void keyPressed(uint32_t keyCode) override {
         switch (keyCode) {
             case KEY_B:
@@ -382,6 +552,17 @@ public:
             if (ui.checkBox("Dsiplay render target", &displayTexture)) {
                 buildCommandBuffers();
             }
+            if (ui.checkBox("Compute, reduced resolution", &computeBlur)) {
+                device.waitIdle();
+                buildCommandBuffers();
+                buildOffscreenCommandBuffer();
+            }
+            if (computeBlur) {
+                if (ui.comboBox("Resolution", &computeResolution, { "Half", "Quarter" })) {
+                    resizeRadialTargets();
+                }
+                ui.text("%u x %u, %u passes of %u taps", radial.extent.width, radial.extent.height, RADIAL_PASSES, RADIAL_TAPS);
+            }
         }
     }
 };
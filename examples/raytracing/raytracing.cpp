@@ -1,14 +1,24 @@
 /*
 * Vulkan Example - Compute shader ray tracing
 *
+* Triangle meshes are traced through a bounding volume hierarchy built on the CPU, see vks::bvh.  The rays traced
+* per frame are counted on the GPU, which together with the GPU time of the dispatch gives the rays per second.
+*
+* Where VK_KHR_ray_tracing_pipeline is supported the same scene can also be traced through hardware acceleration
+* structures, see vks::raytracing, to compare the rays per second of both.
+*
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
 #include <vulkanExampleBase.h>
+#include <vks/bvh.hpp>
+#include <vks/raytracing.hpp>
 
 #define TEX_DIM 2048
+// Must match STACK_SIZE of raytracing.comp
+#define MAX_BVH_DEPTH 64
 
 // Vertex layout for this example
 struct Vertex {
@@ -21,6 +31,31 @@ vks::model::VertexLayout vertexLayout{ {
     vks::model::VERTEX_COMPONENT_UV,
 } };
 
+// The traced meshes only need positions and normals, and are kept on the host to build the BVH from
+vks::model::VertexLayout sceneLayout{ {
+    vks::model::VERTEX_COMPONENT_POSITION,
+    vks::model::VERTEX_COMPONENT_NORMAL,
+} };
+
+struct Scene {
+    std::string name;
+    std::string file;
+    glm::vec3 color;
+};
+
+const std::vector<Scene> SCENES{
+    { "Chinese dragon", "chinesedragon.dae", { 0.8f, 0.3f, 0.2f } },
+    { "Venus", "venus.fbx", { 0.9f, 0.9f, 0.85f } },
+    { "Vulkan scene", "vulkanscenemodels.dae", { 0.4f, 0.6f, 0.9f } },
+};
+
+enum Tracer : int32_t {
+    TRACER_COMPUTE = 0,
+    TRACER_HARDWARE = 1,
+};
+
+const std::vector<std::string> TRACER_NAMES{ "Compute BVH", "Hardware" };
+
 class VulkanExample : public vkx::ExampleBase {
 private:
     vks::Image textureComputeTarget;
@@ -28,20 +63,76 @@ private:
 public:
     struct {
         vks::model::Model quad;
+        // The compute tracer only uses the host copy of the vertices, the hardware one builds its acceleration
+        // structure from the GPU buffers.  These are kept until the next scene is loaded, since their upload may still
+        // be in flight.
+        vks::model::Model scene;
     } meshes;
 
+    // Must match the Triangle and TriangleNormals structs of raytracing.comp
+    struct Triangle {
+        glm::vec4 v0;
+        glm::vec4 e1;
+        glm::vec4 e2;
+    };
+
+    struct TriangleNormals {
+        glm::vec4 n0;
+        glm::vec4 n1;
+        glm::vec4 n2;
+    };
+
+    int32_t sceneIndex{ 0 };
+    struct {
+        vks::Buffer nodes;
+        vks::Buffer triangles;
+        vks::Buffer normals;
+        uint32_t triangleCount{ 0 };
+        uint32_t nodeCount{ 0 };
+        uint32_t depth{ 0 };
+        double buildMilliseconds{ 0.0 };
+    } bvh;
+
+    int32_t tracer{ TRACER_COMPUTE };
+    // Only with context.rayTracingEnabled
+    struct {
+        vks::raytracing::AccelerationStructure bottomLevel;
+        vks::raytracing::AccelerationStructure topLevel;
+        // Vertex normals of the triangles in the order of the model's indices, rather than of the BVH leaves
+        vks::Buffer normals;
+        // The first triangle of each model part
+        vks::Buffer parts;
+        vk::Pipeline pipeline;
+        vk::PipelineLayout pipelineLayout;
+        vk::DescriptorSetLayout descriptorSetLayout;
+        vk::DescriptorSet descriptorSet;
+        vks::raytracing::ShaderBindingTable shaderBindingTable;
+        double buildMilliseconds{ 0.0 };
+    } hardware;
+
+    // Rays traced by each swap chain image's last frame, written by the compute or ray generation shader
+    vks::Buffer rayCounts;
+
+    struct {
+        uint32_t rays{ 0 };
+        double milliseconds{ 0.0 };
+        // Smoothed rays per second
+        double raysPerSecond{ 0.0 };
+        // For the benchmark report of the current scene
+        double raysPerSecondSum{ 0.0 };
+        uint32_t samples{ 0 };
+    } stats;
+
     vks::Buffer uniformDataCompute;
 
     struct UboCompute {
-        glm::vec3 lightPos;
-        // Aspect ratio of the viewport
-        float aspectRatio;
+        glm::mat4 invView;
+        glm::mat4 invProjection;
+        glm::vec4 lightPos;
         glm::vec4 fogColor = glm::vec4(0.0f);
-        struct Camera {
-            glm::vec3 pos = glm::vec3(0.0f, 1.5f, 4.0f);
-            glm::vec3 lookat = glm::vec3(0.0f, 0.5f, 0.0f);
-            float fov = 10.0f;
-        } camera;
+        glm::vec4 meshColor;
+        float planeHeight{ 0.0f };
+        uint32_t bounces{ 2 };
     } uboCompute;
 
     struct {
@@ -49,10 +140,6 @@ public:
         vk::Pipeline compute;
     } pipelines;
 
-    int vertexBufferSize;
-
-    vk::Queue computeQueue;
-    vk::CommandBuffer computeCmdBuffer;
     vk::PipelineLayout computePipelineLayout;
     vk::DescriptorSet computeDescriptorSet;
     vk::DescriptorSetLayout computeDescriptorSetLayout;
@@ -62,16 +149,21 @@ public:
     vk::DescriptorSetLayout descriptorSetLayout;
 
     VulkanExample() {
-        camera.dolly(-2.0f);
         title = "Vulkan Example - Compute shader ray tracing";
-        uboCompute.aspectRatio = (float)size.width / (float)size.height;
+        camera.type = Camera::CameraType::lookat;
+        camera.setPerspective(60.0f, size, 0.1f, 256.0f);
+        camera.setRotation(glm::vec3(-15.0f, 30.0f, 0.0f));
+        camera.setTranslation(glm::vec3(0.0f, 0.0f, -3.5f));
         paused = true;
         timerSpeed *= 0.5f;
+        // Optional, the hardware tracer is only offered if the device supports it
+        context.enableRayTracing = true;
     }
 
     ~VulkanExample() {
         // Clean up used Vulkan resources
         // Note : Inherited destructor cleans up resources stored in base class
+        reportThroughput();
 
         device.destroyPipeline(pipelines.display);
         device.destroyPipeline(pipelines.compute);
@@ -81,11 +173,18 @@ public:
         device.destroyPipelineLayout(computePipelineLayout);
         device.destroyDescriptorSetLayout(computeDescriptorSetLayout);
 
+        if (context.rayTracingEnabled) {
+            device.destroyPipeline(hardware.pipeline);
+            device.destroyPipelineLayout(hardware.pipelineLayout);
+            device.destroyDescriptorSetLayout(hardware.descriptorSetLayout);
+            hardware.shaderBindingTable.destroy();
+        }
+
         meshes.quad.destroy();
+        destroyScene();
+        rayCounts.destroy();
         uniformDataCompute.destroy();
 
-        device.freeCommandBuffers(cmdPool, computeCmdBuffer);
-
         textureComputeTarget.destroy();
     }
 
@@ -93,8 +192,7 @@ public:
     void prepareTextureTarget(vks::Image& tex, uint32_t width, uint32_t height, vk::Format format) {
         context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& setupCmdBuffer) {
             // Get device properties for the requested texture format
-            vk::FormatProperties formatProperties;
-            formatProperties = physicalDevice.getFormatProperties(format);
+            const vk::FormatProperties& formatProperties = context.getFormatProperties(format);
             // Check if requested image format supports image storage operations
             assert(formatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eStorageImage);
 
@@ -142,47 +240,60 @@ public:
         });
     }
 
-    void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) {
-        // vk::Image memory barrier to make sure that compute
-        // shader writes are finished before sampling
-        // from the texture
+    // Trace the image before the render pass samples it.  The previous frame has to be done sampling it first.
+    void updateCommandBufferPreDraw(const vk::CommandBuffer& cmdBuffer) override {
+        const vk::PipelineStageFlags traceStage =
+            tracer == TRACER_HARDWARE ? vk::PipelineStageFlagBits::eRayTracingShaderKHR : vk::PipelineStageFlagBits::eComputeShader;
+
         vk::ImageMemoryBarrier imageMemoryBarrier;
         imageMemoryBarrier.oldLayout = vk::ImageLayout::eGeneral;
         imageMemoryBarrier.newLayout = vk::ImageLayout::eGeneral;
         imageMemoryBarrier.image = textureComputeTarget.image;
         imageMemoryBarrier.subresourceRange = { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
+        imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eShaderRead;
+        imageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eShaderWrite;
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader, traceStage, {}, nullptr, nullptr, imageMemoryBarrier);
+
+        const uint32_t image = commandBufferImage(cmdBuffer);
+        cmdBuffer.fillBuffer(rayCounts.buffer, sizeof(uint32_t) * image, sizeof(uint32_t), 0);
+        const vk::MemoryBarrier reset{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, traceStage, {}, reset, nullptr, nullptr);
+
+        // Both tracers are timed by the same region, so that the rays per second compare
+        vks::debug::marker::beginRegion(cmdBuffer, "Ray tracing", glm::vec4(1.0f, 0.5f, 0.5f, 1.0f));
+        if (tracer == TRACER_HARDWARE) {
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, hardware.pipeline);
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingKHR, hardware.pipelineLayout, 0, hardware.descriptorSet, nullptr);
+            cmdBuffer.pushConstants<uint32_t>(hardware.pipelineLayout, vk::ShaderStageFlagBits::eRaygenKHR, 0, image);
+            hardware.shaderBindingTable.traceRays(cmdBuffer, textureComputeTarget.extent.width, textureComputeTarget.extent.height);
+        } else {
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.compute);
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, computePipelineLayout, 0, computeDescriptorSet, nullptr);
+            cmdBuffer.pushConstants<uint32_t>(computePipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, image);
+            cmdBuffer.dispatch(textureComputeTarget.extent.width / 16, textureComputeTarget.extent.height / 16, 1);
+        }
+        vks::debug::marker::endRegion(cmdBuffer);
+
+        // Make sure that the tracing shader writes are finished before sampling from the texture, and that the ray
+        // count is visible to the host once the frame has completed
         imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
-        imageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eInputAttachmentRead;
-        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTopOfPipe, vk::DependencyFlags(), nullptr, nullptr,
-                                  imageMemoryBarrier);
+        imageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+        cmdBuffer.pipelineBarrier(traceStage, vk::PipelineStageFlagBits::eFragmentShader, {}, nullptr, nullptr, imageMemoryBarrier);
+        const vk::MemoryBarrier counted{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead };
+        cmdBuffer.pipelineBarrier(traceStage, vk::PipelineStageFlagBits::eHost, {}, counted, nullptr, nullptr);
+    }
+
+    void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
         cmdBuffer.setViewport(0, vks::util::viewport(size));
         cmdBuffer.setScissor(0, vks::util::rect2D(size));
         cmdBuffer.bindVertexBuffers(0, meshes.quad.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.quad.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.quad.indices.buffer, 0, meshes.quad.indexType);
         // Display ray traced image generated by compute shader as a full screen quad
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSetPostCompute, nullptr);
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.display);
         cmdBuffer.drawIndexed(meshes.quad.indexCount, 1, 0, 0, 0);
     }
 
-    void buildComputeCommandBuffer() {
-        vk::CommandBufferBeginInfo cmdBufInfo;
-        computeCmdBuffer.begin(cmdBufInfo);
-        computeCmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.compute);
-        computeCmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, computePipelineLayout, 0, computeDescriptorSet, nullptr);
-        computeCmdBuffer.dispatch(textureComputeTarget.extent.width / 16, textureComputeTarget.extent.height / 16, 1);
-        computeCmdBuffer.end();
-    }
-
-    void compute() {
-        // Compute
-        vk::SubmitInfo computeSubmitInfo;
-        computeSubmitInfo.commandBufferCount = 1;
-        computeSubmitInfo.pCommandBuffers = &computeCmdBuffer;
-        computeQueue.submit(computeSubmitInfo, nullptr);
-        computeQueue.waitIdle();
-    }
-
     // Setup vertices for a single uv-mapped quad
     void generateQuad() {
 #define dim 1.0f
@@ -198,16 +309,145 @@ public:
         meshes.quad.indices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indexBuffer);
     }
 
+    void destroyScene() {
+        meshes.scene.destroy();
+        bvh.nodes.destroy();
+        bvh.triangles.destroy();
+        bvh.normals.destroy();
+        hardware.bottomLevel.destroy();
+        hardware.topLevel.destroy();
+        hardware.normals.destroy();
+        hardware.parts.destroy();
+    }
+
+    // Load the mesh of SCENES[sceneIndex], fitted into a box of size 2 around the origin, and build its BVH.  The ground
+    // plane is placed at the bottom of the box.
+    void loadScene() {
+        const auto& scene = SCENES[sceneIndex];
+        vks::model::ModelCreateInfo createInfo;
+        createInfo.hostCopy = true;
+        if (context.rayTracingEnabled) {
+            createInfo.vertexUsage = vks::raytracing::BUILD_INPUT_USAGE;
+            createInfo.indexUsage = vks::raytracing::BUILD_INPUT_USAGE;
+        }
+        meshes.scene.loadFromFile(context, getAssetPath() + "models/" + scene.file, sceneLayout, createInfo);
+
+        auto& model = meshes.scene;
+        const size_t stride = sceneLayout.stride();
+        const size_t normalOffset = sceneLayout.offset(1);
+        const glm::vec3 center = (model.dim.min + model.dim.max) * 0.5f;
+        const float scale = 2.0f / std::max(std::max(model.dim.size.x, model.dim.size.y), std::max(model.dim.size.z, FLT_MIN));
+        for (size_t offset = 0; offset < model.hostVertices.size(); offset += stride) {
+            glm::vec3 position;
+            memcpy(&position, model.hostVertices.data() + offset, sizeof(position));
+            position = (position - center) * scale;
+            memcpy(model.hostVertices.data() + offset, &position, sizeof(position));
+        }
+        // -y is up
+        uboCompute.planeHeight = (model.dim.max.y - center.y) * scale;
+        uboCompute.meshColor = glm::vec4(scene.color, 1.0f);
+
+        auto& scheduler = getScheduler();
+        vks::bvh::Bvh hierarchy;
+        auto tStart = std::chrono::high_resolution_clock::now();
+        hierarchy.build(model.hostVertices.data(), stride, model.hostIndices.data(), model.hostIndices.size(), vks::bvh::BuildSettings{}, &scheduler);
+        bvh.buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+        if (hierarchy.depth > MAX_BVH_DEPTH) {
+            throw std::runtime_error("The BVH of " + scene.file + " is too deep for the traversal stack");
+        }
+
+        // The triangles in the order of the leaves, so that each leaf reads a contiguous range
+        const uint32_t triangleCount = (uint32_t)hierarchy.triangles.size();
+        std::vector<Triangle> triangles(triangleCount);
+        std::vector<TriangleNormals> normals(triangleCount);
+        scheduler.parallelFor(0, triangleCount, 4096, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                glm::vec3 positions[3];
+                glm::vec3 vertexNormals[3];
+                for (uint32_t corner = 0; corner < 3; ++corner) {
+                    const uint8_t* vertex = model.hostVertices.data() + model.hostIndices[hierarchy.triangles[i] * 3 + corner] * stride;
+                    memcpy(&positions[corner], vertex, sizeof(glm::vec3));
+                    memcpy(&vertexNormals[corner], vertex + normalOffset, sizeof(glm::vec3));
+                }
+                triangles[i] = { glm::vec4(positions[0], 0.0f), glm::vec4(positions[1] - positions[0], 0.0f), glm::vec4(positions[2] - positions[0], 0.0f) };
+                normals[i] = { glm::vec4(vertexNormals[0], 0.0f), glm::vec4(vertexNormals[1], 0.0f), glm::vec4(vertexNormals[2], 0.0f) };
+            }
+        });
+
+        bvh.nodes = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, hierarchy.nodes);
+        bvh.triangles = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, triangles);
+        bvh.normals = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, normals);
+        bvh.triangleCount = triangleCount;
+        bvh.nodeCount = (uint32_t)hierarchy.nodes.size();
+        bvh.depth = hierarchy.depth;
+        stats = {};
+
+        if (context.rayTracingEnabled) {
+            std::vector<TriangleNormals> modelOrderNormals(triangleCount);
+            for (uint32_t i = 0; i < triangleCount; ++i) {
+                modelOrderNormals[hierarchy.triangles[i]] = normals[i];
+            }
+            loadHardwareScene(center, scale, modelOrderNormals);
+        }
+    }
+
+    // The normalization of the host vertices is applied to the GPU ones by the instance transform
+    void loadHardwareScene(const glm::vec3& center, float scale, const std::vector<TriangleNormals>& normals) {
+        const auto& model = meshes.scene;
+        std::vector<uint32_t> firstTriangles;
+        for (const auto& part : model.parts) {
+            firstTriangles.push_back(part.indexBase / 3);
+        }
+        hardware.normals = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, normals);
+        hardware.parts = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, firstTriangles);
+
+        auto tStart = std::chrono::high_resolution_clock::now();
+        hardware.bottomLevel = vks::raytracing::buildBottomLevel(context, { vks::raytracing::modelInput(context, model) })[0];
+        const glm::mat4 transform = glm::translate(glm::scale(glm::mat4(1.0f), glm::vec3(scale)), -center);
+        hardware.topLevel = vks::raytracing::buildTopLevel(context, { vks::raytracing::instance(hardware.bottomLevel, transform) });
+        hardware.buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+    }
+
+    // Replace the scene, which the descriptor set and with it the command buffers refer to
+    void changeScene(int32_t index) {
+        reportThroughput();
+        device.waitIdle();
+        destroyScene();
+        sceneIndex = index;
+        loadScene();
+        updateSceneDescriptors();
+        updateUniformBuffers();
+        buildCommandBuffers();
+    }
+
+    void changeTracer(int32_t index) {
+        reportThroughput();
+        device.waitIdle();
+        tracer = index;
+        stats = {};
+        buildCommandBuffers();
+    }
+
     void setupDescriptorPool() {
         std::vector<vk::DescriptorPoolSize> poolSizes = {
-            { vk::DescriptorType::eUniformBuffer, 2 },
+            { vk::DescriptorType::eUniformBuffer, 1 },
             // Graphics pipeline uses image samplers for display
-            { vk::DescriptorType::eCombinedImageSampler, 4 },
+            { vk::DescriptorType::eCombinedImageSampler, 1 },
             // Compute pipeline uses storage images image loads and stores
             { vk::DescriptorType::eStorageImage, 1 },
+            // The BVH, its triangles and normals, and the ray counts
+            { vk::DescriptorType::eStorageBuffer, 4 },
         };
+        if (context.rayTracingEnabled) {
+            // The ray tracing pipeline's output image and uniform buffer, its normals, parts and ray counts
+            poolSizes.push_back({ vk::DescriptorType::eStorageImage, 1 });
+            poolSizes.push_back({ vk::DescriptorType::eUniformBuffer, 1 });
+            poolSizes.push_back({ vk::DescriptorType::eStorageBuffer, 3 });
+            poolSizes.push_back({ vk::DescriptorType::eAccelerationStructureKHR, 1 });
+        }
 
-        descriptorPool = device.createDescriptorPool({ {}, 3, (uint32_t)poolSizes.size(), poolSizes.data() });
+        const uint32_t maxSets = context.rayTracingEnabled ? 3 : 2;
+        descriptorPool = device.createDescriptorPool({ {}, maxSets, (uint32_t)poolSizes.size(), poolSizes.data() });
     }
 
     void setupDescriptorSetLayout() {
@@ -234,9 +474,6 @@ public:
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
     }
 
-    // Create a separate command buffer for compute commands
-    void createComputeCommandBuffer() { computeCmdBuffer = device.allocateCommandBuffers({ cmdPool, vk::CommandBufferLevel::ePrimary, 1 })[0]; }
-
     void preparePipelines() {
         // Display pipeline
         vks::pipelines::GraphicsPipelineBuilder pipelineCreator{ device, pipelineLayout, renderPass };
@@ -247,6 +484,33 @@ public:
         pipelines.display = pipelineCreator.create(context.pipelineCache);
     }
 
+    void updateSceneDescriptors() {
+        std::vector<vk::WriteDescriptorSet> computeWriteDescriptorSets{
+            // Binding 2 : BVH nodes
+            { computeDescriptorSet, 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &bvh.nodes.descriptor },
+            // Binding 3 : Triangles, in the order of the BVH leaves
+            { computeDescriptorSet, 3, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &bvh.triangles.descriptor },
+            // Binding 4 : Vertex normals of the triangles
+            { computeDescriptorSet, 4, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &bvh.normals.descriptor },
+        };
+        device.updateDescriptorSets(computeWriteDescriptorSets, nullptr);
+
+        if (context.rayTracingEnabled) {
+            vk::WriteDescriptorSetAccelerationStructureKHR topLevelDescriptor{ 1, &hardware.topLevel.handle };
+            vk::WriteDescriptorSet topLevelWrite{ hardware.descriptorSet, 2, 0, 1, vk::DescriptorType::eAccelerationStructureKHR };
+            topLevelWrite.pNext = &topLevelDescriptor;
+            std::vector<vk::WriteDescriptorSet> hardwareWriteDescriptorSets{
+                // Binding 2 : Top level acceleration structure
+                topLevelWrite,
+                // Binding 4 : Vertex normals of the triangles
+                { hardware.descriptorSet, 4, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &hardware.normals.descriptor },
+                // Binding 6 : First triangle of each part
+                { hardware.descriptorSet, 6, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &hardware.parts.descriptor },
+            };
+            device.updateDescriptorSets(hardwareWriteDescriptorSets, nullptr);
+        }
+    }
+
     // Prepare the compute pipeline that generates the ray traced image
     void prepareCompute() {
         std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
@@ -254,23 +518,37 @@ public:
             { 0, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute },
             // Binding 1 : Uniform buffer block
             { 1, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 2 : BVH nodes
+            { 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 3 : Triangles
+            { 3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 4 : Triangle normals
+            { 4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 5 : Ray counts
+            { 5, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
         };
 
         computeDescriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
-        computePipelineLayout = device.createPipelineLayout({ {}, 1, &computeDescriptorSetLayout });
+        // The index of the ray counter to add to
+        vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(uint32_t) };
+        computePipelineLayout = device.createPipelineLayout({ {}, 1, &computeDescriptorSetLayout, 1, &pushConstantRange });
 
         computeDescriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &computeDescriptorSetLayout })[0];
 
         std::vector<vk::DescriptorImageInfo> computeTexDescriptors{
             { nullptr, textureComputeTarget.view, vk::ImageLayout::eGeneral },
         };
+        vk::DescriptorBufferInfo rayCountsDescriptor{ rayCounts.buffer, 0, VK_WHOLE_SIZE };
         std::vector<vk::WriteDescriptorSet> computeWriteDescriptorSets{
             // Binding 0 : Output storage image
             { computeDescriptorSet, 0, 0, 1, vk::DescriptorType::eStorageImage, &computeTexDescriptors[0] },
             // Binding 1 : Uniform buffer block
             { computeDescriptorSet, 1, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformDataCompute.descriptor },
+            // Binding 5 : Ray counts
+            { computeDescriptorSet, 5, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &rayCountsDescriptor },
         };
         device.updateDescriptorSets(computeWriteDescriptorSets, nullptr);
+        updateSceneDescriptors();
 
         // Create compute shader pipelines
         vk::ComputePipelineCreateInfo computePipelineCreateInfo;
@@ -278,6 +556,62 @@ public:
         computePipelineCreateInfo.stage =
             vks::shaders::loadShader(device, getAssetPath() + "shaders/raytracing/raytracing.comp.spv", vk::ShaderStageFlagBits::eCompute);
         pipelines.compute = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+    }
+
+    // Prepare the ray tracing pipeline that generates the same image as the compute one
+    void prepareHardware() {
+        const vk::ShaderStageFlags raygen = vk::ShaderStageFlagBits::eRaygenKHR;
+        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+            // Binding 0 : Output storage image
+            { 0, vk::DescriptorType::eStorageImage, 1, raygen },
+            // Binding 1 : Uniform buffer block
+            { 1, vk::DescriptorType::eUniformBuffer, 1, raygen },
+            // Binding 2 : Top level acceleration structure
+            { 2, vk::DescriptorType::eAccelerationStructureKHR, 1, raygen },
+            // Binding 4 : Triangle normals
+            { 4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eClosestHitKHR },
+            // Binding 5 : Ray counts
+            { 5, vk::DescriptorType::eStorageBuffer, 1, raygen },
+            // Binding 6 : First triangle of each part
+            { 6, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eClosestHitKHR },
+        };
+
+        hardware.descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+        // The index of the ray counter to add to
+        vk::PushConstantRange pushConstantRange{ raygen, 0, sizeof(uint32_t) };
+        hardware.pipelineLayout = device.createPipelineLayout({ {}, 1, &hardware.descriptorSetLayout, 1, &pushConstantRange });
+
+        hardware.descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &hardware.descriptorSetLayout })[0];
+        vk::DescriptorImageInfo targetDescriptor{ nullptr, textureComputeTarget.view, vk::ImageLayout::eGeneral };
+        vk::DescriptorBufferInfo rayCountsDescriptor{ rayCounts.buffer, 0, VK_WHOLE_SIZE };
+        std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
+            // Binding 0 : Output storage image
+            { hardware.descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageImage, &targetDescriptor },
+            // Binding 1 : Uniform buffer block
+            { hardware.descriptorSet, 1, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformDataCompute.descriptor },
+            // Binding 5 : Ray counts
+            { hardware.descriptorSet, 5, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &rayCountsDescriptor },
+        };
+        device.updateDescriptorSets(writeDescriptorSets, nullptr);
+
+        // Miss shader 0 is for the primary and reflection rays, 1 for shadow rays
+        vks::raytracing::RayTracingPipelineBuilder pipelineBuilder{ context, hardware.pipelineLayout };
+        pipelineBuilder.addShader(getAssetPath() + "shaders/raytracing/raytracing.rgen.spv", vk::ShaderStageFlagBits::eRaygenKHR);
+        pipelineBuilder.addShader(getAssetPath() + "shaders/raytracing/raytracing.rmiss.spv", vk::ShaderStageFlagBits::eMissKHR);
+        pipelineBuilder.addShader(getAssetPath() + "shaders/raytracing/shadow.rmiss.spv", vk::ShaderStageFlagBits::eMissKHR);
+        pipelineBuilder.addHitGroup(getAssetPath() + "shaders/raytracing/raytracing.rchit.spv");
+        hardware.pipeline = pipelineBuilder.create(context.pipelineCache);
+        hardware.shaderBindingTable.create(context, hardware.pipeline, pipelineBuilder);
+    }
+
+    void prepareRayCounts() {
+        // Cleared and written on the device, and read once the swap chain image's frame has completed
+        rayCounts = context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                         vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                         sizeof(uint32_t) * swapChain.imageCount);
+        rayCounts.map();
+        memset(rayCounts.mapped, 0, rayCounts.size);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
@@ -288,60 +622,120 @@ public:
     }
 
     void updateUniformBuffers() {
+        uboCompute.invView = glm::inverse(camera.matrices.view);
+        uboCompute.invProjection = glm::inverse(getProjection());
         uboCompute.lightPos.x = 0.0f + sin(glm::radians(timer * 360.0f)) * 2.0f;
-        uboCompute.lightPos.y = 5.0f;
-        uboCompute.lightPos.z = 1.0f;
+        uboCompute.lightPos.y = -5.0f;
         uboCompute.lightPos.z = 0.0f + cos(glm::radians(timer * 360.0f)) * 2.0f;
         uniformDataCompute.copy(uboCompute);
     }
 
-    // Find and create a compute capable device queue
-    void getComputeQueue() {
-        uint32_t queueIndex = 0;
-
-        std::vector<vk::QueueFamilyProperties> queueProps = physicalDevice.getQueueFamilyProperties();
-        uint32_t queueCount = (uint32_t)queueProps.size();
-
-        for (queueIndex = 0; queueIndex < queueCount; queueIndex++) {
-            if (queueProps[queueIndex].queueFlags & vk::QueueFlagBits::eCompute)
-                break;
-        }
-        assert(queueIndex < queueCount);
-
-        vk::DeviceQueueCreateInfo queueCreateInfo;
-        queueCreateInfo.queueFamilyIndex = queueIndex;
-        queueCreateInfo.queueCount = 1;
-        computeQueue = device.getQueue(queueIndex, 0);
-    }
-
-    void prepare() {
+    void prepare() override {
         ExampleBase::prepare();
         generateQuad();
-        getComputeQueue();
-        createComputeCommandBuffer();
+        loadScene();
+        prepareRayCounts();
         prepareUniformBuffers();
         prepareTextureTarget(textureComputeTarget, TEX_DIM, TEX_DIM, vk::Format::eR8G8B8A8Unorm);
         setupDescriptorSetLayout();
         preparePipelines();
         setupDescriptorPool();
         setupDescriptorSet();
+        if (context.rayTracingEnabled) {
+            prepareHardware();
+        }
         prepareCompute();
         buildCommandBuffers();
-        buildComputeCommandBuffer();
         prepared = true;
     }
 
-    virtual void render() {
+    void draw() override {
+        prepareFrame();
+        // The image's previous frame has completed, so has its ray count.  The GPU time of the dispatch is from the
+        // most recent collection, close enough for a smoothed figure.
+        stats.rays = static_cast<const uint32_t*>(rayCounts.mapped)[currentBuffer];
+        const auto& scopes = profiler.getScopes();
+        auto scope = std::find_if(scopes.begin(), scopes.end(), [](const vks::debug::GpuProfiler::Scope& s) { return s.name == "Ray tracing"; });
+        if (scope != scopes.end() && scope->lastMilliseconds > 0.0 && stats.rays) {
+            stats.milliseconds = scope->milliseconds;
+            const double raysPerSecond = (double)stats.rays / (scope->lastMilliseconds * 0.001);
+            stats.raysPerSecond = stats.samples ? stats.raysPerSecond * 0.9 + raysPerSecond * 0.1 : raysPerSecond;
+            stats.raysPerSecondSum += raysPerSecond;
+            ++stats.samples;
+        }
+        drawCurrentCommandBuffer();
+        submitFrame();
+    }
+
+    // The benchmark report has the GPU time of the tracing, but not the number of rays it traced
+    void reportThroughput() {
+        if (benchmark.active && stats.samples) {
+            vkx::logMessage(vkx::LogLevel::LOG_INFO, "%s, %s: %u triangles, %.2f Mrays/s", SCENES[sceneIndex].name.c_str(), TRACER_NAMES[tracer].c_str(),
+                            bvh.triangleCount, stats.raysPerSecondSum / stats.samples * 1e-6);
+        }
+    }
+
+    void render() override {
         if (!prepared)
             return;
         draw();
-        compute();
         if (!paused) {
             updateUniformBuffers();
         }
     }
 
-    virtual void viewChanged() { updateUniformBuffers(); }
+    void viewChanged() override { updateUniformBuffers(); }
+
+    // Sweeps over the scenes, and with hardware ray tracing over the scenes again with the hardware tracer
+    bool applyBenchmarkSweep(uint32_t value) override {
+        const uint32_t tracers = context.rayTracingEnabled ? 2 : 1;
+        if (value >= SCENES.size() * tracers) {
+            return false;
+        }
+        const int32_t sweepTracer = (int32_t)(value / SCENES.size());
+        if (sweepTracer != tracer) {
+            changeTracer(sweepTracer);
+        }
+        changeScene((int32_t)(value % SCENES.size()));
+        return true;
+    }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            std::vector<std::string> names;
+            for (const auto& scene : SCENES) {
+                names.push_back(scene.name);
+            }
+            int32_t index = sceneIndex;
+            if (ui.comboBox("Scene", &index, names)) {
+                changeScene(index);
+            }
+            if (context.rayTracingEnabled) {
+                int32_t tracerIndex = tracer;
+                if (ui.comboBox("Tracer", &tracerIndex, TRACER_NAMES)) {
+                    changeTracer(tracerIndex);
+                }
+            }
+            int32_t bounces = (int32_t)uboCompute.bounces;
+            if (ui.sliderInt("Bounces", &bounces, 0, 4)) {
+                uboCompute.bounces = (uint32_t)bounces;
+                updateUniformBuffers();
+            }
+        }
+        if (ui.header("Statistics")) {
+            ui.text("%u triangles, %u nodes, depth %u", bvh.triangleCount, bvh.nodeCount, bvh.depth);
+            ui.text("BVH built in %.1f ms", bvh.buildMilliseconds);
+            if (context.rayTracingEnabled) {
+                ui.text("Acceleration structures built in %.1f ms", hardware.buildMilliseconds);
+            }
+            ui.text("%u rays per frame", stats.rays);
+            if (stats.samples) {
+                ui.text("Ray tracing: %.2f ms, %.1f Mrays/s", stats.milliseconds, stats.raysPerSecond * 1e-6);
+            } else {
+                ui.text("Rays per second need GPU timings");
+            }
+        }
+    }
 };
 
 RUN_EXAMPLE(VulkanExample)
@@ -1,19 +1,26 @@
 /*
-* Vulkan Example - Minimal headless rendering example
+* Vulkan Example - Headless batch rendering
 *
 * Copyright (C) 2017 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#include <atomic>
+#include <exception>
+#include <map>
+#include <memory>
+#include <thread>
+
 #include <common.hpp>
 #include <utils.hpp>
 #include <vks/debug.hpp>
 #include <vks/context.hpp>
+#include <vks/framebuffer.hpp>
 #include <vks/pipelines.hpp>
 #include <vks/helpers.hpp>
-
-#define BUFFER_ELEMENTS 32
+#include <vks/readback.hpp>
+#include <vks/threadpool.hpp>
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 #define LOG(...) ((void)__android_log_print(ANDROID_LOG_INFO, "vulkanExample", __VA_ARGS__))
@@ -21,8 +28,101 @@
 #define LOG(...) printf(__VA_ARGS__)
 #endif
 
+// A camera view of one of the scenes, rendered into `output`, a .ppm or a run length encoded .tga file
+struct Job {
+    std::string scene;
+    glm::vec3 eye;
+    glm::vec3 target;
+    // Vertical field of view in degrees
+    float fov{ 60.0f };
+    std::string output;
+};
+
+// One job per line, blank lines and lines starting with # are skipped:
+//   <scene> <eye x> <eye y> <eye z> <target x> <target y> <target z> <fov> <output>
+std::vector<Job> loadJobs(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file) {
+        throw std::runtime_error("Unable to open job list " + filename);
+    }
+    std::vector<Job> jobs;
+    std::string line;
+    for (uint32_t lineNumber = 1; std::getline(file, line); ++lineNumber) {
+        std::istringstream fields(line);
+        Job job;
+        if (!(fields >> job.scene) || job.scene[0] == '#') {
+            continue;
+        }
+        if (!(fields >> job.eye.x >> job.eye.y >> job.eye.z >> job.target.x >> job.target.y >> job.target.z >> job.fov >> job.output)) {
+            throw std::runtime_error(filename + ":" + std::to_string(lineNumber) + ": malformed job");
+        }
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+// The view of the original example
+Job defaultJob() {
+    Job job;
+    job.scene = "triangles";
+    job.eye = glm::vec3(0.0f);
+    job.target = glm::vec3(0.0f, 0.0f, -1.0f);
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+    job.output = std::string(getenv("EXTERNAL_STORAGE")) + "/headless.ppm";
+#else
+    job.output = "headless.ppm";
+#endif
+    return job;
+}
+
+// `count` views circling every scene
+std::vector<Job> orbitJobs(const std::vector<std::string>& scenes, uint32_t count) {
+    std::vector<Job> jobs;
+    jobs.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        const float angle = glm::two_pi<float>() * (float)i / (float)count;
+        Job job;
+        job.scene = scenes[i % scenes.size()];
+        job.target = glm::vec3(0.0f, 0.0f, -4.0f);
+        job.eye = job.target + glm::vec3(sin(angle) * 6.0f, 1.5f, cos(angle) * 6.0f);
+        job.fov = 60.0f;
+        job.output = "orbit_" + std::to_string(i) + ".tga";
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+// The jobs shared by the renderers of every device, each taking the next one whenever it has a target free, so that
+// faster devices render more of them
+class JobQueue {
+public:
+    JobQueue(const std::vector<Job>& jobs) : jobs(jobs) {}
+
+    const std::vector<Job>& all() const { return jobs; }
+
+    // Nullptr once every job is taken
+    const Job* take() {
+        const size_t index = next++;
+        return index < jobs.size() ? &jobs[index] : nullptr;
+    }
+
+private:
+    const std::vector<Job>& jobs;
+    std::atomic<size_t> next{ 0 };
+};
+
 class VulkanExample {
 public:
+    // Offscreen targets in flight.  While the GPU renders into one, the copy of another is being written to disk
+    static const uint32_t TARGET_COUNT = 3;
+
+    struct Target {
+        vks::Framebuffer framebuffer;
+        vk::CommandBuffer commandBuffer;
+        // Signalled once the job last rendered into the target and its readback copy are done
+        vk::Fence fence;
+    };
+
     vks::Context context;
     vk::Instance instance;
     vk::Device& device{ context.device };
@@ -34,24 +134,21 @@ public:
     vk::Extent2D size;
     uint32_t& width{ size.width };
     uint32_t& height{ size.height };
+    vk::Format colorFormat{ vk::Format::eR8G8B8A8Unorm };
     vk::RenderPass renderPass;
-    vk::Framebuffer framebuffer;
-    vks::Image colorAttachment, depthAttachment;
+    std::array<Target, TARGET_COUNT> targets;
 
-    /*
-        Submit command buffer to a queue and wait for fence until queue operations have been finished
-    */
-    void submitWork(const vk::CommandBuffer& cmdBuffer, const vk::Queue queue) {
-        vk::SubmitInfo submitInfo;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &cmdBuffer;
-        vk::Fence fence = device.createFence({});
-        queue.submit(submitInfo, fence);
-        device.waitForFences(fence, true, UINT64_MAX);
-        device.destroy(fence);
-    }
+    // Positions of the triangles of each scene
+    std::map<std::string, std::vector<glm::vec3>> scenes;
+
+    // Copies of the targets, written to disk by its workers
+    vks::Readback readback;
+    // Images the workers have written so far
+    std::atomic<uint64_t> written{ 0 };
 
-    VulkanExample() {
+    // Renders on the physical device `deviceIndex`, or the context's choice for a negative index, in an instance of
+    // its own, with its share of the readback workers of `deviceCount` renderers
+    VulkanExample(int32_t deviceIndex = -1, uint32_t deviceCount = 1) {
         LOG("Running headless rendering example\n");
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
@@ -74,7 +171,13 @@ public:
         context.setValidationEnabled(true);
 #endif
         context.createInstance();
+        if (deviceIndex >= 0) {
+            context.setDevicePicker([=](const std::vector<vk::PhysicalDevice>& devices) { return devices.at(deviceIndex); });
+        }
         context.createDevice();
+        if (deviceIndex >= 0) {
+            LOG("Device %d: %s\n", deviceIndex, context.deviceProperties.deviceName);
+        }
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
         vks::android::loadVulkanFunctions(instance);
@@ -99,49 +202,34 @@ public:
 
             // Indices
             indexBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indices);
+            // The copies are only recorded into the context's upload batch, and the jobs are submitted to the queue
+            // directly, so send them now
+            context.flushUploads(true);
         }
 
         /*
-            Create framebuffer attachments
+            Scenes
         */
+        scenes["triangles"] = {
+            glm::vec3(-1.5f, 0.0f, -4.0f),
+            glm::vec3(0.0f, 0.0f, -2.5f),
+            glm::vec3(1.5f, 0.0f, -4.0f),
+        };
+        auto& ring = scenes["ring"];
+        for (uint32_t i = 0; i < 12; ++i) {
+            const float angle = glm::two_pi<float>() * (float)i / 12.0f;
+            ring.emplace_back(sin(angle) * 3.0f, 0.0f, cos(angle) * 3.0f - 4.0f);
+        }
+        auto& grid = scenes["grid"];
+        for (int32_t z = -3; z <= 3; ++z) {
+            for (int32_t x = -3; x <= 3; ++x) {
+                grid.emplace_back((float)x * 2.5f, (float)((x + z) & 1), (float)z * 2.5f - 4.0f);
+            }
+        }
+
         width = 1024;
         height = 1024;
-        static const vk::Format colorFormat = vk::Format::eR8G8B8A8Unorm;
-        static const vk::Format depthFormat = context.getSupportedDepthFormat();
-        {
-            // Color attachment
-            vk::ImageCreateInfo image;
-            image.imageType = vk::ImageType::e2D;
-            image.format = colorFormat;
-            image.extent.width = width;
-            image.extent.height = height;
-            image.extent.depth = 1;
-            image.mipLevels = 1;
-            image.arrayLayers = 1;
-            image.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc;
-            colorAttachment = context.createImage(image);
-
-            vk::ImageViewCreateInfo imageView;
-            imageView.viewType = vk::ImageViewType::e2D;
-            imageView.format = colorFormat;
-            imageView.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-            imageView.subresourceRange.baseMipLevel = 0;
-            imageView.subresourceRange.levelCount = 1;
-            imageView.subresourceRange.baseArrayLayer = 0;
-            imageView.subresourceRange.layerCount = 1;
-            imageView.image = colorAttachment.image;
-            colorAttachment.view = device.createImageView(imageView);
-
-            // Depth stencil attachment
-            image.format = depthFormat;
-            image.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
-            depthAttachment = context.createImage(image);
-
-            imageView.format = depthFormat;
-            imageView.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
-            imageView.image = depthAttachment.image;
-            depthAttachment.view = device.createImageView(imageView);
-        }
+        const vk::Format depthFormat = context.getSupportedDepthFormat();
 
         /*
             Create renderpass
@@ -155,7 +243,8 @@ public:
             attchmentDescriptions[0].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
             attchmentDescriptions[0].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
             attchmentDescriptions[0].initialLayout = vk::ImageLayout::eUndefined;
-            attchmentDescriptions[0].finalLayout = vk::ImageLayout::eTransferSrcOptimal;
+            // The readback takes the image from here to the transfer source layout and back
+            attchmentDescriptions[0].finalLayout = vk::ImageLayout::eColorAttachmentOptimal;
             // Depth attachment
             attchmentDescriptions[1].format = depthFormat;
             attchmentDescriptions[1].loadOp = vk::AttachmentLoadOp::eClear;
@@ -202,21 +291,23 @@ public:
             renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
             renderPassInfo.pDependencies = dependencies.data();
             renderPass = device.createRenderPass(renderPassInfo);
+        }
 
-            vk::ImageView attachments[2];
-            attachments[0] = colorAttachment.view;
-            attachments[1] = depthAttachment.view;
-
-            vk::FramebufferCreateInfo framebufferCreateInfo;
-            framebufferCreateInfo.renderPass = renderPass;
-            framebufferCreateInfo.attachmentCount = 2;
-            framebufferCreateInfo.pAttachments = attachments;
-            framebufferCreateInfo.width = width;
-            framebufferCreateInfo.height = height;
-            framebufferCreateInfo.layers = 1;
-            framebuffer = device.createFramebuffer(framebufferCreateInfo);
+        /*
+            Create the offscreen targets
+        */
+        const auto commandBuffers = context.allocateCommandBuffers(TARGET_COUNT);
+        for (uint32_t i = 0; i < TARGET_COUNT; ++i) {
+            auto& target = targets[i];
+            target.framebuffer.create(context, glm::uvec2(width, height), { colorFormat }, depthFormat, renderPass, vk::ImageUsageFlagBits::eTransferSrc);
+            target.commandBuffer = commandBuffers[i];
+            target.fence = device.createFence({ vk::FenceCreateFlagBits::eSignaled });
         }
 
+        // Every target can have a copy pending while the workers write out one more per thread
+        const size_t threadCount = std::max<size_t>(1, vks::ThreadPool::defaultThreadCount() / deviceCount);
+        readback.create(context, TARGET_COUNT + (uint32_t)threadCount, threadCount);
+
         /* 
             Prepare graphics pipeline
         */
@@ -233,6 +324,8 @@ public:
             // Create pipeline
             vks::pipelines::GraphicsPipelineBuilder builder{ device, pipelineLayout, renderPass };
             builder.rasterizationState.frontFace = vk::FrontFace::eClockwise;
+            // Cameras may look at the triangles from behind
+            builder.rasterizationState.cullMode = vk::CullModeFlagBits::eNone;
 
             // Vertex bindings an attributes
             // Binding description
@@ -250,157 +343,206 @@ public:
             builder.loadShader(vkx::getAssetPath() + "shaders/renderheadless/triangle.frag.spv", vk::ShaderStageFlagBits::eFragment);
             pipeline = builder.create(context.pipelineCache);
         }
+    }
 
-        /* 
-            Command buffer creation (for compute work submission)
-        */
-        {
-            vk::CommandBuffer commandBuffer = context.allocateCommandBuffers(1)[0];
-            commandBuffer.begin(vk::CommandBufferBeginInfo{});
-
-            vk::ClearValue clearValues[2];
-            clearValues[0].color = vks::util::clearColor({ 0.0f, 0.0f, 0.2f, 1.0f });
-            clearValues[1].depthStencil = vk::ClearDepthStencilValue{ 1.0f, 0 };
-
-            vk::RenderPassBeginInfo renderPassBeginInfo{ renderPass, framebuffer, vk::Rect2D{ vk::Offset2D{}, size }, 2, clearValues };
-            commandBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-
-            vk::Viewport viewport = {};
-            viewport.height = (float)height;
-            viewport.width = (float)width;
-            viewport.minDepth = (float)0.0f;
-            viewport.maxDepth = (float)1.0f;
-            commandBuffer.setViewport(0, viewport);
-
-            // Update dynamic scissor state
-            vk::Rect2D scissor;
-            scissor.extent = size;
-            commandBuffer.setScissor(0, scissor);
-            commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
-
-            // Render scene
-            vk::DeviceSize offset = 0;
-            commandBuffer.bindVertexBuffers(0, vertexBuffer.buffer, offset);
-            commandBuffer.bindIndexBuffer(indexBuffer.buffer, offset, vk::IndexType::eUint32);
-
-            std::vector<glm::vec3> pos = {
-                glm::vec3(-1.5f, 0.0f, -4.0f),
-                glm::vec3(0.0f, 0.0f, -2.5f),
-                glm::vec3(1.5f, 0.0f, -4.0f),
-            };
-
-            for (auto v : pos) {
-                glm::mat4 mvpMatrix = glm::perspective(glm::radians(60.0f), (float)width / (float)height, 0.1f, 256.0f) * glm::translate(glm::mat4(1.0f), v);
-                commandBuffer.pushConstants<glm::mat4>(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, mvpMatrix);
-                commandBuffer.drawIndexed(3, 1, 0, 0, 0);
-            }
+    ~VulkanExample() {
+        for (auto& target : targets) {
+            device.waitForFences(target.fence, VK_TRUE, UINT64_MAX);
+        }
+        readback.destroy();
+        for (auto& target : targets) {
+            target.framebuffer.destroy();
+            device.destroy(target.fence);
+        }
+        vertexBuffer.destroy();
+        indexBuffer.destroy();
+        device.destroy(renderPass);
+        device.destroy(pipelineLayout);
+        device.destroy(descriptorSetLayout);
+        device.destroy(pipeline);
 
-            commandBuffer.endRenderPass();
-            commandBuffer.end();
+        context.destroy();
+    }
 
-            submitWork(commandBuffer, context.queue);
-            device.waitIdle();
+    void recordJob(const Target& target, const Job& job) {
+        const vk::CommandBuffer& commandBuffer = target.commandBuffer;
+        commandBuffer.reset({});
+        commandBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+
+        vk::ClearValue clearValues[2];
+        clearValues[0].color = vks::util::clearColor({ 0.0f, 0.0f, 0.2f, 1.0f });
+        clearValues[1].depthStencil = vk::ClearDepthStencilValue{ 1.0f, 0 };
+
+        vk::RenderPassBeginInfo renderPassBeginInfo{ renderPass, target.framebuffer.framebuffer, vk::Rect2D{ vk::Offset2D{}, size }, 2, clearValues };
+        commandBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+
+        vk::Viewport viewport = {};
+        viewport.height = (float)height;
+        viewport.width = (float)width;
+        viewport.minDepth = (float)0.0f;
+        viewport.maxDepth = (float)1.0f;
+        commandBuffer.setViewport(0, viewport);
+
+        // Update dynamic scissor state
+        vk::Rect2D scissor;
+        scissor.extent = size;
+        commandBuffer.setScissor(0, scissor);
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+
+        // Render scene
+        vk::DeviceSize offset = 0;
+        commandBuffer.bindVertexBuffers(0, vertexBuffer.buffer, offset);
+        commandBuffer.bindIndexBuffer(indexBuffer.buffer, offset, vk::IndexType::eUint32);
+
+        const glm::mat4 viewProjection = glm::perspective(glm::radians(job.fov), (float)width / (float)height, 0.1f, 256.0f) *
+                                         glm::lookAt(job.eye, job.target, glm::vec3(0.0f, 1.0f, 0.0f));
+        for (const auto& position : scenes.at(job.scene)) {
+            glm::mat4 mvpMatrix = viewProjection * glm::translate(glm::mat4(1.0f), position);
+            commandBuffer.pushConstants<glm::mat4>(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, mvpMatrix);
+            commandBuffer.drawIndexed(3, 1, 0, 0, 0);
         }
 
-        /*
-            Copy framebuffer image to host visible image
-        */
-        const char* imagedata;
-        {
-            // Create the linear tiled destination image to copy to and to read the memory from
-            vk::ImageCreateInfo imgCreateInfo;
-            imgCreateInfo.imageType = vk::ImageType::e2D;
-            imgCreateInfo.format = vk::Format::eR8G8B8A8Unorm;
-            imgCreateInfo.extent.width = width;
-            imgCreateInfo.extent.height = height;
-            imgCreateInfo.extent.depth = 1;
-            imgCreateInfo.arrayLayers = 1;
-            imgCreateInfo.mipLevels = 1;
-            imgCreateInfo.initialLayout = vk::ImageLayout::eUndefined;
-            imgCreateInfo.tiling = vk::ImageTiling::eLinear;
-            imgCreateInfo.usage = vk::ImageUsageFlagBits::eTransferDst;
-
-            // Create the image
-            auto dstImage = context.createImage(imgCreateInfo, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-
-            // Do the actual blit from the swapchain image to our host visible destination image
-            context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& copyCmd) {
-                // Transition destination image to transfer destination layout
-                context.setImageLayout(copyCmd, dstImage.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined,
-                                       vk::ImageLayout::eTransferDstOptimal);
-                // The source image is already in vk::ImageLayout::eTransferSrcOptimal due to the renderpass setup
-                vk::ImageCopy imageCopyRegion;
-                imageCopyRegion.srcSubresource = { vk::ImageAspectFlagBits::eColor, 0, 0, 1 };
-                imageCopyRegion.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-                imageCopyRegion.dstSubresource = { vk::ImageAspectFlagBits::eColor, 0, 0, 1 };
-                imageCopyRegion.extent.width = width;
-                imageCopyRegion.extent.height = height;
-                imageCopyRegion.extent.depth = 1;
-                copyCmd.copyImage(colorAttachment.image, vk::ImageLayout::eTransferSrcOptimal, dstImage.image, vk::ImageLayout::eTransferDstOptimal,
-                                  imageCopyRegion);
-                // Transition destination image to general layout, which is the required layout for mapping the image memory later on
-                context.setImageLayout(copyCmd, dstImage.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eTransferDstOptimal,
-                                       vk::ImageLayout::eGeneral);
-                // The source image needs no transition because we're no longer using it for anything
-            });
+        commandBuffer.endRenderPass();
+        commandBuffer.end();
+    }
 
-            // Get layout of the image (including row pitch)
-            vk::SubresourceLayout subResourceLayout = device.getImageSubresourceLayout(dstImage.image, { vk::ImageAspectFlagBits::eColor });
+    /*
+        Render the jobs round robin into the targets, until the queue runs out.  Nothing waits for the GPU other than
+        a target about to be reused, the copies of finished targets are handed to the readback workers, which encode
+        and write them while the next jobs render.  Returns the number of jobs rendered, progress is logged when
+        `reportProgress` is set.
+    */
+    size_t run(JobQueue& queue, bool reportProgress = true) {
+        const auto& jobs = queue.all();
+        for (const auto& job : jobs) {
+            if (!scenes.count(job.scene)) {
+                throw std::runtime_error("Unknown scene " + job.scene);
+            }
+        }
 
-            // Map image memory so we can start copying from it
-            imagedata = (const char*)dstImage.map(subResourceLayout.offset, VK_WHOLE_SIZE);
+        using Clock = std::chrono::high_resolution_clock;
+        const auto start = Clock::now();
+        auto reported = start;
+        size_t i = 0;
+        for (const Job* next = queue.take(); next; next = queue.take(), ++i) {
+            const Job& job = *next;
+            Target& target = targets[i % TARGET_COUNT];
+            device.waitForFences(target.fence, VK_TRUE, UINT64_MAX);
+            // The fence of every finished job is still signalled at this point, which poll() needs
+            readback.poll();
+            // No image is dropped, when all the slots are taken wait for the workers
+            while (!readback.available()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                readback.poll();
+            }
+            device.resetFences(target.fence);
+
+            recordJob(target, job);
+            const std::string output = job.output;
+            const vk::CommandBuffer copy = readback.record(target.framebuffer.colors[0].image, vk::ImageLayout::eColorAttachmentOptimal, size, colorFormat,
+                                                           [this, output](const vks::Readback::Capture& capture) {
+                                                               if (output.size() > 4 && output.compare(output.size() - 4, 4, ".ppm") == 0) {
+                                                                   vks::writePpm(output, capture);
+                                                               } else {
+                                                                   vks::writeTga(output, capture);
+                                                               }
+                                                               ++written;
+                                                           });
+            const std::array<vk::CommandBuffer, 2> commandBuffers{ target.commandBuffer, copy };
+            vk::SubmitInfo submitInfo;
+            submitInfo.commandBufferCount = (uint32_t)commandBuffers.size();
+            submitInfo.pCommandBuffers = commandBuffers.data();
+            context.queue.submit(submitInfo, target.fence);
+            readback.submitted(target.fence);
+
+            const auto now = Clock::now();
+            if (reportProgress && now - reported > std::chrono::seconds(1)) {
+                reported = now;
+                const double seconds = std::chrono::duration<double>(now - start).count();
+                LOG("%llu / %llu images, %.1f images per second\n", (unsigned long long)written.load(), (unsigned long long)jobs.size(),
+                    written.load() / seconds);
+            }
+        }
 
-            /*
-            Save host visible framebuffer image to disk (ppm format)
-            */
+        // Wait for the last jobs and for the workers to write them
+        for (auto& target : targets) {
+            device.waitForFences(target.fence, VK_TRUE, UINT64_MAX);
+        }
+        readback.poll();
+        readback.destroy();
+        if (reportProgress) {
+            const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            LOG("Rendered %llu images in %.2f seconds, %.1f images per second\n", (unsigned long long)i, seconds, i / seconds);
+        }
+        return i;
+    }
+};
 
-#if defined(VK_USE_PLATFORM_ANDROID_KHR)
-            const char* filename = strcat(getenv("EXTERNAL_STORAGE"), "/headless.ppm");
-#else
-            const char* filename = "headless.ppm";
-#endif
-            std::ofstream file(filename, std::ios::out | std::ios::binary);
+// Without a surface every device can render
+uint32_t physicalDeviceCount() {
+    vk::ApplicationInfo appInfo;
+    appInfo.pApplicationName = "Vulkan headless example";
+    const vk::Instance instance = vk::createInstance({ {}, &appInfo });
+    const auto count = (uint32_t)instance.enumeratePhysicalDevices().size();
+    instance.destroy();
+    return count;
+}
 
-            // ppm header
-            file << "P6\n" << width << "\n" << height << "\n" << 255 << "\n";
+// Shards the jobs across the first `deviceCount` devices, with a renderer and thread each, and returns the seconds
+// spent rendering, not counting the creation of the renderers.  A single renderer takes the context's choice of
+// device unless `byIndex` is set.
+double renderOnDevices(const std::vector<Job>& jobs, uint32_t deviceCount, bool byIndex) {
+    std::vector<std::unique_ptr<VulkanExample>> renderers;
+    for (uint32_t i = 0; i < deviceCount; ++i) {
+        renderers.emplace_back(new VulkanExample(byIndex || deviceCount > 1 ? (int32_t)i : -1, deviceCount));
+    }
 
-            // ppm binary pixel data
-            for (uint32_t y = 0; y < height; y++) {
-                unsigned int* row = (unsigned int*)imagedata;
-                for (uint32_t x = 0; x < width; x++) {
-                    file.write((char*)row, 3);
-                    row++;
+    JobQueue queue{ jobs };
+    std::vector<size_t> rendered(deviceCount, 0);
+    std::vector<std::exception_ptr> errors(deviceCount);
+    using Clock = std::chrono::high_resolution_clock;
+    const auto start = Clock::now();
+    if (deviceCount == 1) {
+        rendered[0] = renderers[0]->run(queue);
+    } else {
+        std::vector<std::thread> threads;
+        for (uint32_t i = 0; i < deviceCount; ++i) {
+            threads.emplace_back([&, i] {
+                try {
+                    rendered[i] = renderers[i]->run(queue, false);
+                } catch (...) {
+                    errors[i] = std::current_exception();
                 }
-                imagedata += subResourceLayout.rowPitch;
-            }
-            file.close();
-            LOG("Framebuffer image saved to %s\n", filename);
-
-            // Clean up resources
-            dstImage.unmap();
-            dstImage.destroy();
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
         }
     }
-
-    ~VulkanExample() {
-        vertexBuffer.destroy();
-        indexBuffer.destroy();
-        colorAttachment.destroy();
-        depthAttachment.destroy();
-        device.destroy(renderPass);
-        device.destroy(framebuffer);
-        device.destroy(pipelineLayout);
-        device.destroy(descriptorSetLayout);
-        device.destroy(pipeline);
-
-        context.destroy();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
     }
-};
+    if (deviceCount > 1) {
+        for (uint32_t i = 0; i < deviceCount; ++i) {
+            LOG("Device %u rendered %llu images\n", i, (unsigned long long)rendered[i]);
+        }
+        LOG("Rendered %llu images on %u devices in %.2f seconds, %.1f images per second\n", (unsigned long long)jobs.size(), deviceCount, seconds,
+            jobs.size() / seconds);
+    }
+    renderers.clear();
+    return seconds;
+}
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 void handleAppCommand(android_app* app, int32_t cmd) {
     if (cmd == APP_CMD_INIT_WINDOW) {
         VulkanExample* vulkanExample = new VulkanExample();
+        const std::vector<Job> jobs{ defaultJob() };
+        JobQueue queue{ jobs };
+        vulkanExample->run(queue);
         delete (vulkanExample);
         ANativeActivity_finish(app->activity);
     }
@@ -421,11 +563,64 @@ void android_main(android_app* state) {
     }
 }
 #else
-int main() {
-    VulkanExample* vulkanExample = new VulkanExample();
-    std::cout << "Finished. Press enter to terminate...";
-    getchar();
-    delete (vulkanExample);
+// renderheadless                  renders the single view of the original example into headless.ppm
+// renderheadless <job list>       renders the jobs of the list, see loadJobs
+// renderheadless --orbit <count>  renders `count` views circling the scenes into orbit_<n>.tga
+// Followed by any of
+//   --devices <count>             shards the jobs across the first `count` devices, or every device for 0
+//   --scaling                     renders the jobs on one device, then two and so on up to the device count, every
+//                                 device unless --devices says otherwise, and reports the speedup over one device
+int main(int argc, char** argv) {
+    std::vector<Job> jobs;
+    uint32_t deviceCount = 1;
+    bool devicesGiven = false;
+    bool scaling = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--orbit" && hasValue) {
+            jobs = orbitJobs({ "triangles", "ring", "grid" }, (uint32_t)std::stoul(argv[++i]));
+        } else if (arg == "--devices" && hasValue) {
+            deviceCount = (uint32_t)std::stoul(argv[++i]);
+            devicesGiven = true;
+        } else if (arg == "--scaling") {
+            scaling = true;
+        } else {
+            jobs = loadJobs(arg);
+        }
+    }
+    const bool interactive = jobs.empty();
+    if (interactive) {
+        jobs = { defaultJob() };
+    }
+    if (scaling && !devicesGiven) {
+        deviceCount = 0;
+    }
+    if (deviceCount != 1) {
+        const uint32_t available = physicalDeviceCount();
+        if (available == 0) {
+            throw std::runtime_error("No Vulkan devices found");
+        }
+        deviceCount = deviceCount == 0 ? available : std::min(deviceCount, available);
+    }
+
+    if (scaling) {
+        std::vector<double> seconds;
+        for (uint32_t count = 1; count <= deviceCount; ++count) {
+            seconds.push_back(renderOnDevices(jobs, count, true));
+        }
+        LOG("Devices  Images/s  Speedup  Efficiency\n");
+        for (uint32_t count = 1; count <= deviceCount; ++count) {
+            const double speedup = seconds[0] / seconds[count - 1];
+            LOG("%7u  %8.1f  %6.2fx  %9.0f%%\n", count, jobs.size() / seconds[count - 1], speedup, 100.0 * speedup / count);
+        }
+    } else {
+        renderOnDevices(jobs, deviceCount, false);
+    }
+    if (interactive) {
+        std::cout << "Finished. Press enter to terminate...";
+        getchar();
+    }
     return 0;
 }
 #endif
@@ -1,12 +1,21 @@
 /*
 * Vulkan Example -  Rendering a scene with multiple meshes and materials
 *
+* The material textures are streamed in by the example's AssetManager, so the scene is drawn with placeholder
+* textures until they are resident
+*
+* With the depth pre-pass enabled, the opaque meshes are first drawn front to back with their positions alone, and
+* then shaded with an eEqual depth test, so each pixel is shaded once
+*
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
 #include <vulkanExampleBase.h>
+#include <vks/drawlist.hpp>
+#include <vks/occlusion.hpp>
+#include <vks/simplify.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <assimp/Importer.hpp>
@@ -26,6 +35,11 @@ vks::model::VertexLayout vertexLayout{ {
     vks::model::VERTEX_COMPONENT_COLOR,
 } };
 
+// The position stream of the meshes, drawn by the depth pre-pass
+vks::model::VertexLayout positionLayout{ {
+    vks::model::VERTEX_COMPONENT_POSITION,
+} };
+
 // Scene related structs
 
 // Shader properites for a material
@@ -42,8 +56,8 @@ struct SceneMaterial {
     std::string name;
     // Material properties
     SceneMaterialProperites properties;
-    // The example only uses a diffuse channel
-    vks::texture::Texture2D diffuse;
+    // The example only uses a diffuse channel, which is owned by the asset manager
+    vks::TextureAsset diffuse;
     // The material's descriptor contains the material descriptors
     vk::DescriptorSet descriptorSet;
     // Pointer to the pipeline used by this material
@@ -54,7 +68,15 @@ struct SceneMaterial {
 struct SceneMesh {
     vks::Buffer vertices;
     vks::Buffer indices;
+    // Just the positions of `vertices`, for the depth pre-pass
+    vks::Buffer positions;
     uint32_t indexCount;
+    // Center of the bounds of the mesh, for sorting by depth
+    glm::vec3 center;
+
+    // Simplified copy of an opaque mesh, rendered into the occlusion buffer
+    std::vector<glm::vec3> occluderVertices;
+    std::vector<uint32_t> occluderIndices;
 
     // Pointer to the material used by this mesh
     SceneMaterial* material;
@@ -64,6 +86,7 @@ struct SceneMesh {
 class Scene {
 private:
     const vks::Context& context;
+    vks::AssetManager& assets;
     const vk::Device& device{ context.device };
     const vk::Queue& queue{ context.queue };
 
@@ -114,11 +137,11 @@ private:
                 std::cout << "  Diffuse: \"" << texturefile.C_Str() << "\"" << std::endl;
                 std::string fileName = std::string(texturefile.C_Str());
                 std::replace(fileName.begin(), fileName.end(), '\\', '/');
-                materials[i].diffuse.loadFromFile(context, assetPath + fileName, vk::Format::eBc3UnormBlock);
+                materials[i].diffuse = assets.loadTexture2D(assetPath + fileName, vk::Format::eBc3UnormBlock);
             } else {
                 std::cout << "  Material has no diffuse, using dummy texture!" << std::endl;
                 // todo : separate pipeline and layout
-                materials[i].diffuse.loadFromFile(context, assetPath + "dummy.ktx", vk::Format::eBc2UnormBlock);
+                materials[i].diffuse = assets.loadTexture2D(assetPath + "dummy.ktx", vk::Format::eBc2UnormBlock);
             }
 
             // For scenes with multiple textures per material we would need to check for additional texture types, e.g.:
@@ -164,17 +187,9 @@ private:
 
         // Material descriptor sets
         for (size_t i = 0; i < materials.size(); i++) {
-            // Descriptor set
             materials[i].descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.material })[0];
-
-            vk::DescriptorImageInfo texDescriptor{ materials[i].diffuse.sampler, materials[i].diffuse.view, vk::ImageLayout::eGeneral };
-            std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
-                // Binding 0: Diffuse texture
-                { materials[i].descriptorSet, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texDescriptor },
-            };
-
-            device.updateDescriptorSets(writeDescriptorSets, nullptr);
         }
+        updateMaterialDescriptors();
 
         // Scene descriptor set
         descriptorSetScene = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.scene })[0];
@@ -189,6 +204,7 @@ private:
     // for rendering them
     void loadMeshes(vk::CommandBuffer copyCmd) {
         meshes.resize(aScene->mNumMeshes);
+        bounds.resize(meshes.size());
         for (uint32_t i = 0; i < meshes.size(); i++) {
             aiMesh* aMesh = aScene->mMeshes[i];
 
@@ -206,6 +222,8 @@ private:
             bool hasColor = aMesh->HasVertexColors(0);
             bool hasNormals = aMesh->HasNormals();
 
+            glm::vec3 boundsMin{ std::numeric_limits<float>::max() };
+            glm::vec3 boundsMax{ -std::numeric_limits<float>::max() };
             for (uint32_t v = 0; v < aMesh->mNumVertices; v++) {
                 vertices[v].pos = glm::make_vec3(&aMesh->mVertices[v].x);
                 vertices[v].pos.y = -vertices[v].pos.y;
@@ -213,8 +231,18 @@ private:
                 vertices[v].normal = hasNormals ? glm::make_vec3(&aMesh->mNormals[v].x) : glm::vec3(0.0f);
                 vertices[v].normal.y = -vertices[v].normal.y;
                 vertices[v].color = hasColor ? glm::make_vec3(&aMesh->mColors[0][v].r) : glm::vec3(1.0f);
+                boundsMin = glm::min(boundsMin, vertices[v].pos);
+                boundsMax = glm::max(boundsMax, vertices[v].pos);
+            }
+            if (!aMesh->mNumVertices) {
+                boundsMin = boundsMax = glm::vec3(0.0f);
             }
+            meshes[i].center = (boundsMin + boundsMax) * 0.5f;
+            bounds.set(i, boundsMin, boundsMax);
             meshes[i].vertices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertices);
+            std::vector<glm::vec3> positions(vertices.size());
+            std::transform(vertices.begin(), vertices.end(), positions.begin(), [](const Vertex& vertex) { return vertex.pos; });
+            meshes[i].positions = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, positions);
 
             // Indices
             std::vector<uint32_t> indices;
@@ -224,12 +252,47 @@ private:
                 memcpy(&indices[f * 3], &aMesh->mFaces[f].mIndices[0], sizeof(uint32_t) * 3);
             }
             meshes[i].indices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indices);
+
+            if (meshes[i].material->pipeline == &pipelines.solid) {
+                loadOccluder(meshes[i], vertices, indices);
+            }
+        }
+    }
+
+    // Simplify an opaque mesh to an eighth of its triangles, keeping only the positions of the vertices still used
+    void loadOccluder(SceneMesh& mesh, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) {
+        std::vector<uint32_t> simplified(indices.size());
+        float error = 0.0f;
+        const size_t targetIndexCount = indices.size() / 8 / 3 * 3;
+        simplified.resize(vks::model::simplify(simplified.data(), indices.data(), indices.size(), reinterpret_cast<const uint8_t*>(vertices.data()),
+                                               vertices.size(), sizeof(Vertex), offsetof(Vertex, pos), {}, targetIndexCount, 0.01f, error));
+
+        std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+        mesh.occluderIndices.reserve(simplified.size());
+        for (uint32_t index : simplified) {
+            if (remap[index] == UINT32_MAX) {
+                remap[index] = static_cast<uint32_t>(mesh.occluderVertices.size());
+                mesh.occluderVertices.push_back(vertices[index].pos);
+            }
+            mesh.occluderIndices.push_back(remap[index]);
         }
     }
 
 public:
     std::string assetPath = "";
 
+    // Point the material descriptor sets at the diffuse textures, or their placeholders while they're loading
+    void updateMaterialDescriptors() {
+        for (const auto& material : materials) {
+            const vk::DescriptorImageInfo& texDescriptor = material.diffuse->descriptor;
+            std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
+                // Binding 0: Diffuse texture
+                { material.descriptorSet, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texDescriptor },
+            };
+            device.updateDescriptorSets(writeDescriptorSets, nullptr);
+        }
+    }
+
     std::vector<SceneMaterial> materials;
     std::vector<SceneMesh> meshes;
 
@@ -248,6 +311,7 @@ public:
         vk::Pipeline solid;
         vk::Pipeline blending;
         vk::Pipeline wireframe;
+        vk::Pipeline depthPrepass;
     } pipelines;
 
     // Shared pipeline layout
@@ -257,18 +321,32 @@ public:
     bool renderSingleScenePart = false;
     uint32_t scenePartIndex = 0;
 
-    Scene(const vks::Context& context)
-        : context(context) {
+    // Draws of the current frame, sorted by pipeline and material so that meshes sharing them are drawn together
+    vks::DrawList drawList;
+    vks::DrawList::Stats drawStats;
+    // Draws of the depth pre-pass, front to back
+    vks::DrawList depthDrawList;
+
+    // Bounds of the meshes, tested against the frustum and then against the occluders rendered on the CPU
+    vks::BoxArray bounds;
+    vks::Frustum frustum;
+    vks::OcclusionBuffer occlusion;
+    bool occlusionCulling = true;
+    // The meshes passing the tests of the last cull, in ascending order
+    std::vector<uint32_t> visibleMeshes;
+
+    Scene(const vks::Context& context, vks::AssetManager& assets)
+        : context(context)
+        , assets(assets) {
         uniformBuffer = context.createUniformBuffer(uniformData);
+        occlusion.resize(320, 192);
     }
 
     ~Scene() {
         for (auto mesh : meshes) {
             mesh.vertices.destroy();
             mesh.indices.destroy();
-        }
-        for (auto material : materials) {
-            material.diffuse.destroy();
+            mesh.positions.destroy();
         }
         vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
         vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.material, nullptr);
@@ -277,9 +355,29 @@ public:
         vkDestroyPipeline(device, pipelines.solid, nullptr);
         vkDestroyPipeline(device, pipelines.blending, nullptr);
         vkDestroyPipeline(device, pipelines.wireframe, nullptr);
+        device.destroyPipeline(pipelines.depthPrepass);
         uniformBuffer.destroy();
     }
 
+    // Find the meshes visible with `viewProjection`, rasterizing the occluders on the threads of `scheduler`
+    void cull(const glm::mat4& viewProjection, vks::TaskScheduler* scheduler) {
+        visibleMeshes.clear();
+        frustum.update(viewProjection);
+        if (!occlusionCulling) {
+            frustum.cullBoxes(bounds, visibleMeshes);
+            return;
+        }
+        occlusion.begin(viewProjection);
+        for (const auto& mesh : meshes) {
+            if (!mesh.occluderIndices.empty()) {
+                occlusion.addOccluder(glm::mat4(), mesh.occluderVertices.data(), mesh.occluderVertices.size(), mesh.occluderIndices.data(),
+                                      mesh.occluderIndices.size());
+            }
+        }
+        occlusion.render(scheduler);
+        occlusion.cullBoxes(frustum, bounds, visibleMeshes);
+    }
+
     void load(const std::string& filename, vk::CommandBuffer copyCmd) {
         Assimp::Importer Importer;
         vks::file::withBinaryFileContents(filename, [&](size_t size, const void* data) {
@@ -295,43 +393,82 @@ public:
         }
     }
 
-    // Renders the scene into an active command buffer
-    // In a real world application we would do some visibility culling in here
-    void render(vk::CommandBuffer cmdBuffer, bool wireframe) {
-        vk::DeviceSize offsets[1] = { 0 };
-        for (size_t i = 0; i < meshes.size(); i++) {
+    // Renders the depth of the opaque meshes found visible by the last cull, nearest first, so that the meshes behind
+    // them are rejected before rasterizing as much as possible
+    void renderDepth(vk::CommandBuffer cmdBuffer, const glm::vec3& eye, float farDistance) {
+        depthDrawList.clear();
+        for (uint32_t i : visibleMeshes) {
             if ((renderSingleScenePart) && (i != scenePartIndex))
                 continue;
 
-            //if (meshes[i].material->opacity == 0.0f)
-            //    continue;
+            const auto& mesh = meshes[i];
+            if (mesh.material->pipeline != &pipelines.solid) {
+                continue;
+            }
+            vks::DrawList::Draw draw;
+            draw.key = vks::DrawList::depthOnlyKey(0, vks::DrawList::depthBucket(glm::length(mesh.center - eye), farDistance));
+            draw.pipeline = pipelines.depthPrepass;
+            draw.layout = pipelineLayout;
+            draw.setCount = 1;
+            draw.sets[0] = descriptorSetScene;
+            draw.vertexBuffer = mesh.positions.buffer;
+            draw.indexBuffer = mesh.indices.buffer;
+            draw.indexType = vk::IndexType::eUint32;
+            draw.indexCount = mesh.indexCount;
+            depthDrawList.add(draw);
+        }
+
+        depthDrawList.sort();
+        depthDrawList.record(cmdBuffer);
+    }
+
+    // Renders the meshes found visible by the last cull into an active command buffer, seen from `eye` out to
+    // `farDistance`
+    void render(vk::CommandBuffer cmdBuffer, bool wireframe, const glm::vec3& eye, float farDistance) {
+        // Pipeline ids, in the order opaque draws sort by
+        enum : uint32_t { SOLID, WIREFRAME, BLENDING };
+
+        drawList.clear();
+        for (uint32_t i : visibleMeshes) {
+            if ((renderSingleScenePart) && (i != scenePartIndex))
+                continue;
+
+            const auto& mesh = meshes[i];
+            const auto& material = *mesh.material;
+            const uint32_t materialIndex = static_cast<uint32_t>(&material - materials.data());
+            const uint32_t depth = vks::DrawList::depthBucket(glm::length(mesh.center - eye), farDistance);
+            const bool blending = !wireframe && material.pipeline == &pipelines.blending;
 
-            // todo : per material pipelines
-            //            vkCmdBindPipeline(cmdBuffer, vk::PipelineBindPoint::eGraphics, *mesh.material->pipeline);
+            vks::DrawList::Draw draw;
+            // Render transparent objects last, back to front
+            draw.key = blending ? vks::DrawList::transparentKey(BLENDING, materialIndex, depth)
+                                : vks::DrawList::opaqueKey(wireframe ? WIREFRAME : SOLID, materialIndex, depth);
+            draw.pipeline = wireframe ? pipelines.wireframe : *material.pipeline;
+            draw.layout = pipelineLayout;
 
             // We will be using multiple descriptor sets for rendering
             // In GLSL the selection is done via the set and binding keywords
             // VS: layout (set = 0, binding = 0) uniform UBO;
             // FS: layout (set = 1, binding = 0) uniform sampler2D samplerColorMap;
-
-            std::array<vk::DescriptorSet, 2> descriptorSets;
+            draw.setCount = 2;
             // Set 0: Scene descriptor set containing global matrices
-            descriptorSets[0] = descriptorSetScene;
+            draw.sets[0] = descriptorSetScene;
             // Set 1: Per-Material descriptor set containing bound images
-            descriptorSets[1] = meshes[i].material->descriptorSet;
-
-            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, wireframe ? pipelines.wireframe : *meshes[i].material->pipeline);
-            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets, {});
+            draw.sets[1] = material.descriptorSet;
 
             // Pass material properies via push constants
-            vkCmdPushConstants(cmdBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(SceneMaterialProperites), &meshes[i].material->properties);
-
-            cmdBuffer.bindVertexBuffers(0, meshes[i].vertices.buffer, { 0 });
-            cmdBuffer.bindIndexBuffer(meshes[i].indices.buffer, 0, vk::IndexType::eUint32);
-            cmdBuffer.drawIndexed(meshes[i].indexCount, 1, 0, 0, 0);
+            draw.pushConstantStages = vk::ShaderStageFlagBits::eFragment;
+            draw.pushConstantSize = sizeof(SceneMaterialProperites);
+
+            draw.vertexBuffer = mesh.vertices.buffer;
+            draw.indexBuffer = mesh.indices.buffer;
+            draw.indexType = vk::IndexType::eUint32;
+            draw.indexCount = mesh.indexCount;
+            drawList.add(draw, &material.properties);
         }
 
-        // Render transparent objects last
+        drawList.sort();
+        drawStats = drawList.record(cmdBuffer);
     }
 };
 
@@ -352,23 +489,63 @@ public:
         camera.setRotation(glm::vec3(5.0f, 90.0f, 0.0f));
         camera.setPerspective(60.0f, size, 0.1f, 256.0f);
         title = "Vulkan Example - Scene rendering";
+        // The draws are sorted by their distance from the camera every frame
+        recordPerFrame = true;
     }
 
     ~VulkanExample() { delete (scene); }
 
+    // Culled ahead of both passes
+    void updateCommandBufferPreDraw(const vk::CommandBuffer& cmdBuffer) override {
+        scene->cull(camera.matrices.perspective * camera.matrices.view, &getScheduler());
+    }
+
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
         cmdBuffer.setViewport(0, vks::util::viewport(size));
         cmdBuffer.setScissor(0, vks::util::rect2D(size));
-        scene->render(cmdBuffer, wireframe);
+        scene->render(cmdBuffer, wireframe, -camera.position, camera.getFarClip());
+    }
+
+    bool supportsDepthPrepass() const override { return true; }
+
+    void updateDepthPrepassCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        // The wire frame keeps testing against the depth it writes itself
+        if (wireframe) {
+            return;
+        }
+        cmdBuffer.setViewport(0, vks::util::viewport(size));
+        cmdBuffer.setScissor(0, vks::util::rect2D(size));
+        scene->renderDepth(cmdBuffer, -camera.position, camera.getFarClip());
+    }
+
+    void depthPrepassChanged() override {
+        context.trash(scene->pipelines.solid);
+        context.trash(scene->pipelines.wireframe);
+        context.trash(scene->pipelines.blending);
+        context.trash(scene->pipelines.depthPrepass);
+        preparePipelines();
     }
 
     void preparePipelines() {
+        // Position only, no fragment shader and no color writes
+        vks::pipelines::GraphicsPipelineBuilder depthBuilder{ device, scene->pipelineLayout, renderPass };
+        depthBuilder.vertexInputState.appendVertexLayout(positionLayout);
+        depthBuilder.colorBlendState.blendAttachmentStates[0].colorWriteMask = vk::ColorComponentFlags();
+        depthBuilder.loadShader(getAssetPath() + "shaders/scenerendering/depthprepass.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        scene->pipelines.depthPrepass = depthBuilder.create(context.pipelineCache);
+
         vks::pipelines::GraphicsPipelineBuilder pipelineBuilder{ device, scene->pipelineLayout, renderPass };
         pipelineBuilder.vertexInputState.appendVertexLayout(vertexLayout);
         pipelineBuilder.loadShader(getAssetPath() + "shaders/scenerendering/scene.vert.spv", vk::ShaderStageFlagBits::eVertex);
         pipelineBuilder.loadShader(getAssetPath() + "shaders/scenerendering/scene.frag.spv", vk::ShaderStageFlagBits::eFragment);
-        // Solid frame rendering pipeline
+        // Solid frame rendering pipeline, only shading the fragments that made it into the pre-pass's depth
+        if (depthPrepass) {
+            pipelineBuilder.depthStencilState.depthCompareOp = vk::CompareOp::eEqual;
+            pipelineBuilder.depthStencilState.depthWriteEnable = VK_FALSE;
+        }
         scene->pipelines.solid = pipelineBuilder.create(context.pipelineCache);
+        pipelineBuilder.depthStencilState.depthCompareOp = vk::CompareOp::eLessOrEqual;
+        pipelineBuilder.depthStencilState.depthWriteEnable = VK_TRUE;
 
         // Wire frame rendering pipeline
         pipelineBuilder.rasterizationState.polygonMode = vk::PolygonMode::eLine;
@@ -399,7 +576,7 @@ public:
 
     void loadScene() {
         context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& cmdBuffer) {
-            scene = new Scene(context);
+            scene = new Scene(context, assets);
             scene->assetPath = getAssetPath() + "models/sibenik/";
             scene->load(getAssetPath() + "models/sibenik/sibenik.dae", cmdBuffer);
         });
@@ -421,8 +598,28 @@ public:
         draw();
     }
 
+    void assetsLoaded() override { scene->updateMaterialDescriptors(); }
+
     void viewChanged() override { updateUniformBuffers(); }
 
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Statistics")) {
+            const auto& stats = scene->drawStats;
+            ui.text("Draws: %u", stats.draws);
+            ui.text("Binds: %u of %u, %u saved", stats.binds, stats.naiveBinds, stats.saved());
+            ui.text("Meshes: %u visible of %u", (uint32_t)scene->visibleMeshes.size(), (uint32_t)scene->meshes.size());
+            if (assets.pendingCount()) {
+                ui.text("Textures: %u of %u loaded", (uint32_t)assets.loadedCount(), (uint32_t)(assets.loadedCount() + assets.pendingCount()));
+            }
+            if (scene->occlusionCulling) {
+                ui.text("Occluder triangles: %u", scene->occlusion.stats().triangles);
+            }
+        }
+        if (ui.header("Settings")) {
+            ui.checkBox("Occlusion culling", &scene->occlusionCulling);
+        }
+    }
+
     void keyPressed(uint32_t keyCode) override {
         Parent::keyPressed(keyCode);
         switch (keyCode) {
@@ -35,7 +35,10 @@ public:
     vk::DescriptorSetLayout descriptorSetLayout;
     vk::DescriptorSet descriptorSet;
 
-    bool screenshotSaved = false;
+    // Written by the readback workers
+    std::atomic<bool> screenshotSaved{ false };
+    // Capture every frame, as capture_<n>.ppm
+    bool captureFrames = false;
 
     VulkanExample() {
         title = "Saving framebuffer to screenshot";
@@ -69,7 +72,7 @@ public:
 
         static const vk::DeviceSize offset = 0;
         drawCmdBuffer.bindVertexBuffers(0, models.object.vertices.buffer, offset);
-        drawCmdBuffer.bindIndexBuffer(models.object.indices.buffer, 0, vk::IndexType::eUint32);
+        drawCmdBuffer.bindIndexBuffer(models.object.indices.buffer, 0, models.object.indexType);
         drawCmdBuffer.drawIndexed(models.object.indexCount, 1, 0, 0, 0);
     }
 
@@ -128,149 +131,22 @@ public:
         uniformBuffer.copyTo(&uboVS, sizeof(uboVS));
     }
 
-    // Take a screenshot for the curretn swapchain image
-    // This is done using a blit from the swapchain image to a linear image whose memory content is then saved as a ppm image
-    // Getting the image date directly from a swapchain image wouldn't work as they're usually stored in an implementation dependant optimal tiling format
-    // Note: This requires the swapchain images to be created with the VK_IMAGE_USAGE_TRANSFER_SRC_BIT flag (see VulkanSwapChain::create)
-    void saveScreenshot(const char* filename) {
-        screenshotSaved = false;
-
-
-        bool supportsBlit = true;
-
-        // Check blit support for source and destination
-
-        // Get format properties for the swapchain color format
-        // Check if the device supports blitting from optimal images (the swapchain images are in optimal format)
-        vk::FormatProperties formatProps;
-        formatProps = context.physicalDevice.getFormatProperties(swapChain.colorFormat);
-        if (!(formatProps.optimalTilingFeatures & vk::FormatFeatureFlagBits::eBlitSrc)) {
-            std::cerr << "Device does not support blitting from optimal tiled images, using copy instead of blit!" << std::endl;
-            supportsBlit = false;
-        }
-
-        // Check if the device supports blitting to linear images
-        formatProps = context.physicalDevice.getFormatProperties(vk::Format::eR8G8B8A8Unorm);
-        if (!(formatProps.linearTilingFeatures & vk::FormatFeatureFlagBits::eBlitDst)) {
-            std::cerr << "Device does not support blitting to linear tiled images, using copy instead of blit!" << std::endl;
-            supportsBlit = false;
-        }
-
-        // Source for the copy is the last rendered swapchain image
-        auto& srcImage = swapChain.images[currentBuffer];
-
-        // Create the linear tiled destination image to copy to and to read the memory from
-        vk::ImageCreateInfo imgCreateInfo;
-        imgCreateInfo.imageType = vk::ImageType::e2D;
-        // Note that vkCmdBlitImage (if supported) will also do format conversions if the swapchain color format would differ
-        imgCreateInfo.format = vk::Format::eR8G8B8A8Unorm;
-        imgCreateInfo.extent.width = size.width;
-        imgCreateInfo.extent.height = size.height;
-        imgCreateInfo.extent.depth = 1;
-        imgCreateInfo.arrayLayers = 1;
-        imgCreateInfo.mipLevels = 1;
-        imgCreateInfo.initialLayout = vk::ImageLayout::eUndefined;
-        imgCreateInfo.tiling = vk::ImageTiling::eLinear;
-        imgCreateInfo.usage = vk::ImageUsageFlagBits::eTransferDst;
-        // Create the image
-        // Memory must be host visible to copy from
-        auto dstImage = context.createImage(imgCreateInfo, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-
-        // Do the actual blit from the swapchain image to our host visible destination image
-        context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
-            // Transition destination image to transfer destination layout
-            context.setImageLayout(commandBuffer, dstImage.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
-            // Transition swapchain image from present to transfer source layout
-            context.setImageLayout(commandBuffer, srcImage.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::ePresentSrcKHR, vk::ImageLayout::eTransferSrcOptimal);
-
-            // If source and destination support blit we'll blit as this also does automatic format conversion (e.g. from BGR to RGB)
-            if (supportsBlit) {
-                // Define the region to blit (we will blit the whole swapchain image)
-                vk::Offset3D blitSize;
-                blitSize.x = size.width;
-                blitSize.y = size.height;
-                blitSize.z = 1;
-                vk::ImageBlit imageBlitRegion;
-                imageBlitRegion.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-                imageBlitRegion.srcSubresource.layerCount = 1;
-                imageBlitRegion.srcOffsets[1] = blitSize;
-                imageBlitRegion.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-                imageBlitRegion.dstSubresource.layerCount = 1;
-                imageBlitRegion.dstOffsets[1] = blitSize;
-
-                // Issue the blit command
-                commandBuffer.blitImage(srcImage.image, vk::ImageLayout::eTransferSrcOptimal, dstImage.image, vk::ImageLayout::eTransferDstOptimal, imageBlitRegion, vk::Filter::eNearest);
-            } else {
-                // Otherwise use image copy (requires us to manually flip components)
-                vk::ImageCopy imageCopyRegion{};
-                imageCopyRegion.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-                imageCopyRegion.srcSubresource.layerCount = 1;
-                imageCopyRegion.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-                imageCopyRegion.dstSubresource.layerCount = 1;
-                imageCopyRegion.extent.width = size.width;
-                imageCopyRegion.extent.height = size.height;
-                imageCopyRegion.extent.depth = 1;
-
-                // Issue the copy command
-                commandBuffer.copyImage(srcImage.image, vk::ImageLayout::eTransferSrcOptimal, dstImage.image, vk::ImageLayout::eTransferDstOptimal, imageCopyRegion);
-            }
-
-            // Transition destination image to general layout, which is the required layout for mapping the image memory later on
-            context.setImageLayout(commandBuffer, dstImage.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eGeneral);
-            // Transition back the swap chain image after the blit is done
-            context.setImageLayout(commandBuffer, srcImage.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::ePresentSrcKHR);
+    // Screenshots are copied out of the swap chain image after the frame that rendered it, into a ring of host visible
+    // buffers, and written on a worker thread once the frame's fence has signalled (see vks::Readback), so neither
+    // taking one nor capturing every frame stalls rendering.
+    // Note: This requires the swapchain images to support VK_IMAGE_USAGE_TRANSFER_SRC_BIT (see SwapChain::create)
+    void saveScreenshot(const std::string& filename) {
+        requestCapture([this, filename](const vks::Readback::Capture& capture) {
+            vks::writePpm(filename, capture);
+            screenshotSaved = true;
         });
+    }
 
-
-        // Get layout of the image (including row pitch)
-        vk::ImageSubresource subResource;
-        subResource.aspectMask = vk::ImageAspectFlagBits::eColor;
-        vk::SubresourceLayout subResourceLayout;
-        subResourceLayout = device.getImageSubresourceLayout(dstImage.image, { vk::ImageAspectFlagBits::eColor });
-
-        
-
-        // Map image memory so we can start copying from it
-        const char* data = (const char*)dstImage.map();
-        data += subResourceLayout.offset;
-
-        std::ofstream file(filename, std::ios::out | std::ios::binary);
-
-        // ppm header
-        file << "P6\n" << size.width << "\n" << size.height << "\n" << 255 << "\n";
-
-        // If source is BGR (destination is always RGB) and we can't use blit (which does automatic conversion), we'll have to manually swizzle color components
-        bool colorSwizzle = false;
-        // Check if source is BGR
-        // Note: Not complete, only contains most common and basic BGR surface formats for demonstation purposes
-        if (!supportsBlit) {
-            std::vector<vk::Format> formatsBGR = { vk::Format::eB8G8R8A8Srgb, vk::Format::eB8G8R8A8Unorm, vk::Format::eB8G8R8A8Snorm };
-            colorSwizzle = (std::find(formatsBGR.begin(), formatsBGR.end(), swapChain.colorFormat) != formatsBGR.end());
-        }
-
-        // ppm binary pixel data
-        for (uint32_t y = 0; y < size.height; y++) {
-            unsigned int* row = (unsigned int*)data;
-            for (uint32_t x = 0; x < size.width; x++) {
-                if (colorSwizzle) {
-                    file.write((char*)row + 2, 1);
-                    file.write((char*)row + 1, 1);
-                    file.write((char*)row, 1);
-                } else {
-                    file.write((char*)row, 3);
-                }
-                row++;
-            }
-            data += subResourceLayout.rowPitch;
+    void draw() override {
+        if (captureFrames) {
+            saveScreenshot("capture_" + std::to_string(readback.getCaptureCount()) + ".ppm");
         }
-        file.close();
-
-        std::cout << "Screenshot saved to disk" << std::endl;
-
-        // Clean up resources
-        dstImage.unmap();
-        dstImage.destroy();
-        screenshotSaved = true;
+        ExampleBase::draw();
     }
 
     void prepare() override {
@@ -289,11 +165,16 @@ public:
     void OnUpdateUIOverlay() override {
         if (ui.header("Functions")) {
             if (ui.button("Take screenshot")) {
+                screenshotSaved = false;
                 saveScreenshot("screenshot.ppm");
             }
             if (screenshotSaved) {
                 ui.text("Screenshot saved as screenshot.ppm");
             }
+            ui.checkBox("Capture every frame", &captureFrames);
+            if (readback) {
+                ui.text("%llu requested, %llu dropped", (unsigned long long)readback.getCaptureCount(), (unsigned long long)readback.getDroppedCount());
+            }
         }
     }
 };
@@ -153,7 +153,7 @@ public:
         offscreen.cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.offscreen);
         offscreen.cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.offscreen, 0, descriptorSets.offscreen, nullptr);
         offscreen.cmdBuffer.bindVertexBuffers(0, meshes.scene.vertices.buffer, { 0 });
-        offscreen.cmdBuffer.bindIndexBuffer(meshes.scene.indices.buffer, 0, vk::IndexType::eUint32);
+        offscreen.cmdBuffer.bindIndexBuffer(meshes.scene.indices.buffer, 0, meshes.scene.indexType);
         offscreen.cmdBuffer.drawIndexed(meshes.scene.indexCount, 1, 0, 0, 0);
         offscreen.cmdBuffer.endRenderPass();
         offscreen.cmdBuffer.end();
@@ -168,7 +168,7 @@ public:
         // Visualize shadow map
         if (displayShadowMap) {
             cmdBuffer.bindVertexBuffers(0, meshes.quad.vertices.buffer, { 0 });
-            cmdBuffer.bindIndexBuffer(meshes.quad.indices.buffer, 0, vk::IndexType::eUint32);
+            cmdBuffer.bindIndexBuffer(meshes.quad.indices.buffer, 0, meshes.quad.indexType);
             cmdBuffer.drawIndexed(meshes.quad.indexCount, 1, 0, 0, 0);
         }
 
@@ -177,7 +177,7 @@ public:
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.scene);
 
         cmdBuffer.bindVertexBuffers(0, meshes.scene.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.scene.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.scene.indices.buffer, 0, meshes.scene.indexType);
         cmdBuffer.drawIndexed(meshes.scene.indexCount, 1, 0, 0, 0);
     }
 
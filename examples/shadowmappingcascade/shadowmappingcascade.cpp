@@ -15,10 +15,22 @@
 
     A further optimization could be done using a geometry shader to do a single-pass render for the depth map
     cascades instead of multiple passes (geometry shaders are not supported on all target devices).
+
+    Cascades are only re-rendered when their texel snapped light matrix changes, and the far ones at most every few
+    frames, sampled with the matrix they were last rendered with in between.  The cascades rendered in a frame are
+    culled and recorded into their own secondary command buffers in parallel.
+
+    With VK_KHR_multiview, all cascades can be rendered in a single pass instead, the vertex shader picking the
+    cascade's matrix by view index.  Every draw is then recorded once for all cascades, and the cascades a tree is
+    culled from are moved outside of the clip volume.  All views of a multiview pass are rendered together, so that mode renders
+    every cascade whenever one of them is due.
 */
 
 #include <vulkanExampleBase.h>
 
+#include <vks/frustum.hpp>
+#include <vks/scheduler.hpp>
+
 #if defined(__ANDROID__)
 #define SHADOWMAP_DIM 2048
 #else
@@ -35,6 +47,13 @@ public:
     bool filterPCF = false;
 
     float cascadeSplitLambda = 0.95f;
+    // Skip rendering cascades whose light matrix hasn't changed, and render the far ones less often
+    bool cacheCascades = true;
+    // Cascades rendered in the last frame
+    uint32_t renderedCascades = 0;
+    // Render all cascades in one multiview pass, if the device supports it
+    bool multiviewDepthPass = false;
+    bool multiviewSupported = false;
 
     float zNear = 0.5f;
     float zFar = 48.0f;
@@ -51,6 +70,16 @@ public:
 
     std::vector<vks::model::Model> models;
 
+    const std::vector<glm::vec3> treePositions = {
+        glm::vec3(0.0f, 0.0f, 0.0f),    glm::vec3(1.25f, 0.25f, 1.25f),    glm::vec3(-1.25f, -0.2f, 1.25f),
+        glm::vec3(1.25f, 0.1f, -1.25f), glm::vec3(-1.25f, -0.25f, -1.25f),
+    };
+    // Bounding sphere of the trunk and leaves, relative to the tree position
+    glm::vec3 treeCenter;
+    float treeRadius{ 0.0f };
+    // The bounding spheres at every tree position
+    vks::SphereArray treeBounds;
+
     struct Material {
         vks::texture::Texture2D texture;
         vk::DescriptorSet descriptorSet;
@@ -95,17 +124,25 @@ public:
     struct PushConstBlock {
         glm::vec4 position;
         uint32_t cascadeIndex;
+        // The cascades the draw is visible in, for the multiview depth pass
+        uint32_t cascadeMask;
     };
 
     // Resources of the depth map generation pass
     struct DepthPass {
         vk::RenderPass renderPass;
-        vk::CommandBuffer commandBuffer;
         vk::Semaphore semaphore;
         vk::PipelineLayout pipelineLayout;
         vk::Pipeline pipeline;
         vks::Buffer uniformBuffer;
 
+        // Every cascade in one pass, one view per layer
+        struct {
+            vk::RenderPass renderPass;
+            vk::Framebuffer framebuffer;
+            vk::Pipeline pipeline;
+        } multiview;
+
         struct UniformBlock {
             std::array<glm::mat4, SHADOW_MAP_CASCADE_COUNT> cascadeViewProjMat;
         } ubo;
@@ -115,6 +152,9 @@ public:
             device.destroy(semaphore);
             device.destroy(pipelineLayout);
             device.destroy(pipeline);
+            device.destroy(multiview.renderPass);
+            device.destroy(multiview.framebuffer);
+            device.destroy(multiview.pipeline);
             uniformBuffer.destroy();
         }
     } depthPass;
@@ -131,6 +171,11 @@ public:
 
         float splitDepth;
         glm::mat4 viewProjMatrix;
+        // The matrix of the depth currently in the cascade's layer
+        glm::mat4 renderedViewProjMatrix;
+        // Frames since the layer was last rendered, UINT32_MAX before the first time
+        uint32_t age{ UINT32_MAX };
+        bool render{ false };
 
         void destroy(const vk::Device& device) {
             device.destroy(view);
@@ -139,6 +184,34 @@ public:
     };
     std::array<Cascade, SHADOW_MAP_CASCADE_COUNT> cascades;
 
+    // Inputs of the last updateCascades, which has nothing to do if they are unchanged
+    struct CascadeInputs {
+        glm::mat4 viewProj;
+        glm::vec3 lightPos;
+        float splitLambda{ -1.0f };
+
+        bool operator==(const CascadeInputs& other) const {
+            return viewProj == other.viewProj && lightPos == other.lightPos && splitLambda == other.splitLambda;
+        }
+    } cascadeInputs;
+
+    // Secondary command buffers of one thread, reused in order every time the thread records for the image
+    struct WorkerCommandBuffers {
+        std::vector<vk::CommandBuffer> commandBuffers;
+        size_t used{ 0 };
+    };
+
+    // The depth pass recorded for a single swap chain image.  Only touched once the image's previous frame has
+    // completed, which the depth pass of that frame has as well, since the frame waited for it.
+    struct DepthRecording {
+        vk::CommandBuffer commandBuffer;
+        // Indexed by TaskScheduler::workerIndex, so each thread allocates from (and records into) its own pool
+        std::vector<WorkerCommandBuffers> workers;
+        // Null for the cascades that are not rendered this frame
+        std::array<vk::CommandBuffer, SHADOW_MAP_CASCADE_COUNT> cascades;
+    };
+    std::vector<DepthRecording> depthRecordings;
+
     VulkanExample() {
         title = "Cascaded shadow mapping";
         timerSpeed *= 0.025f;
@@ -149,6 +222,10 @@ public:
         camera.setRotation(glm::vec3(-17.0f, 7.0f, 0.0f));
         settings.overlay = true;
         timer = 0.2f;
+        // Render all cascades in one pass where available
+        context.enableMultiview = true;
+        // The display and filtering options are picked up by the next frame's command buffer
+        recordPerFrame = true;
     }
 
     ~VulkanExample() {
@@ -176,7 +253,10 @@ public:
         uniformBuffers.VS.destroy();
         uniformBuffers.FS.destroy();
 
-        device.freeCommandBuffers(cmdPool, depthPass.commandBuffer);
+        // Secondary command buffers are released along with the per thread command pools by the context
+        for (const auto& recording : depthRecordings) {
+            device.freeCommandBuffers(cmdPool, recording.commandBuffer);
+        }
         depthPass.destroy(device);
     }
 
@@ -186,16 +266,27 @@ public:
         context.enabledFeatures.depthClamp = context.deviceFeatures.depthClamp;
     }
 
+    // The indices of the trees inside the light volume of a cascade.  Casters between the light and the volume
+    // still cast shadows into it, so the near plane is left out.
+    void castersInto(const vks::Frustum& volume, std::vector<uint32_t>& casters) const {
+        casters.clear();
+        volume.cullSpheres(treeBounds, casters, 0, SIZE_MAX, vks::Frustum::ALL_PLANES & ~(1u << vks::Frustum::BACK));
+    }
+
     /*
         Render the example scene with given command buffer, pipeline layout and dscriptor set
         Used by the scene rendering and depth pass generation command buffer
+        With `volumes`, trees are culled against the light volumes of the cascades in `cascadeMask`, and skipped if
+        they are outside of all of them
     */
     void renderScene(const vk::CommandBuffer& commandBuffer,
                      const vk::PipelineLayout& pipelineLayout,
                      const vk::DescriptorSet& descriptorSet,
-                     uint32_t cascadeIndex = 0) {
+                     uint32_t cascadeIndex = 0,
+                     const std::array<vks::Frustum, SHADOW_MAP_CASCADE_COUNT>* volumes = nullptr,
+                     uint32_t cascadeMask = 0) {
         const vk::DeviceSize offsets[1] = { 0 };
-        PushConstBlock pushConstBlock = { glm::vec4(0.0f), cascadeIndex };
+        PushConstBlock pushConstBlock = { glm::vec4(0.0f), cascadeIndex, cascadeMask };
 
         std::array<vk::DescriptorSet, 2> sets;
         sets[0] = descriptorSet;
@@ -205,29 +296,42 @@ public:
         commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, sets, nullptr);
         commandBuffer.pushConstants<PushConstBlock>(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, pushConstBlock);
         commandBuffer.bindVertexBuffers(0, models[0].vertices.buffer, { 0 });
-        commandBuffer.bindIndexBuffer(models[0].indices.buffer, 0, vk::IndexType::eUint32);
+        commandBuffer.bindIndexBuffer(models[0].indices.buffer, 0, models[0].indexType);
         commandBuffer.drawIndexed(models[0].indexCount, 1, 0, 0, 0);
 
-        // Trees
-        const std::vector<glm::vec3> positions = {
-            glm::vec3(0.0f, 0.0f, 0.0f),    glm::vec3(1.25f, 0.25f, 1.25f),    glm::vec3(-1.25f, -0.2f, 1.25f),
-            glm::vec3(1.25f, 0.1f, -1.25f), glm::vec3(-1.25f, -0.25f, -1.25f),
-        };
-
-        for (auto position : positions) {
-            pushConstBlock.position = glm::vec4(position, 0.0f);
+        // Trees, with the cascades each one casts into
+        std::vector<uint32_t> treeMasks(treePositions.size(), 0);
+        if (volumes) {
+            std::vector<uint32_t> casters;
+            for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
+                if (cascadeMask & (1u << i)) {
+                    castersInto((*volumes)[i], casters);
+                    for (const auto tree : casters) {
+                        treeMasks[tree] |= 1u << i;
+                    }
+                }
+            }
+        }
+        for (size_t tree = 0; tree < treePositions.size(); ++tree) {
+            if (volumes) {
+                pushConstBlock.cascadeMask = treeMasks[tree];
+                if (!pushConstBlock.cascadeMask) {
+                    continue;
+                }
+            }
+            pushConstBlock.position = glm::vec4(treePositions[tree], 0.0f);
             commandBuffer.pushConstants<PushConstBlock>(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, pushConstBlock);
 
             sets[1] = materials[1].descriptorSet;
             commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, sets, nullptr);
             commandBuffer.bindVertexBuffers(0, models[1].vertices.buffer, { 0 });
-            commandBuffer.bindIndexBuffer(models[1].indices.buffer, 0, vk::IndexType::eUint32);
+            commandBuffer.bindIndexBuffer(models[1].indices.buffer, 0, models[1].indexType);
             commandBuffer.drawIndexed(models[1].indexCount, 1, 0, 0, 0);
 
             sets[1] = materials[2].descriptorSet;
             commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, sets, nullptr);
             commandBuffer.bindVertexBuffers(0, models[2].vertices.buffer, { 0 });
-            commandBuffer.bindIndexBuffer(models[2].indices.buffer, 0, vk::IndexType::eUint32);
+            commandBuffer.bindIndexBuffer(models[2].indices.buffer, 0, models[2].indexType);
             commandBuffer.drawIndexed(models[2].indexCount, 1, 0, 0, 0);
         }
     }
@@ -238,8 +342,6 @@ public:
     */
     void prepareDepthPass() {
         auto depthFormat = context.getSupportedDepthFormat();
-        vk::CommandBufferAllocateInfo allocInfo;
-        depthPass.commandBuffer = context.allocateCommandBuffers(1)[0];
         depthPass.semaphore = device.createSemaphore(vk::SemaphoreCreateInfo{});
         // Create a semaphore used to synchronize depth map generation and use
 
@@ -335,6 +437,22 @@ public:
             cascades[i].frameBuffer = device.createFramebuffer(framebufferInfo);
         }
 
+        // Multiview pass rendering view i to layer i of the full depth map view
+        multiviewSupported =
+            context.multiviewEnabled && context.multiviewProperties.maxMultiviewViewCount >= SHADOW_MAP_CASCADE_COUNT;
+        if (multiviewSupported) {
+            const uint32_t viewMask = (1u << SHADOW_MAP_CASCADE_COUNT) - 1;
+            vk::RenderPassMultiviewCreateInfo multiviewInfo;
+            multiviewInfo.subpassCount = 1;
+            multiviewInfo.pViewMasks = &viewMask;
+            renderPassCreateInfo.pNext = &multiviewInfo;
+            depthPass.multiview.renderPass = device.createRenderPass(renderPassCreateInfo);
+
+            framebufferInfo.renderPass = depthPass.multiview.renderPass;
+            framebufferInfo.pAttachments = &depth.view;
+            depthPass.multiview.framebuffer = device.createFramebuffer(framebufferInfo);
+        }
+
         // Shared sampler for cascade deoth reads
         vk::SamplerCreateInfo sampler;
         sampler.magFilter = vk::Filter::eLinear;
@@ -351,23 +469,116 @@ public:
         depth.sampler = device.createSampler(sampler);
     }
 
+    // Frames cascade `index` may keep its depth before it has to follow the light matrix: the near cascades cover
+    // little and move the most on screen, the far ones are coarse enough for lag to go unnoticed
+    static uint32_t refreshInterval(uint32_t index) { return index < 2 ? 1 : 1u << (index - 1); }
+
+    // Pick the cascades rendered this frame and the matrices the scene samples all of them with
+    void selectCascades() {
+        renderedCascades = 0;
+        for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
+            auto& cascade = cascades[i];
+            if (cascade.age != UINT32_MAX) {
+                ++cascade.age;
+            }
+            const bool stale = cascade.age == UINT32_MAX || cascade.viewProjMatrix != cascade.renderedViewProjMatrix;
+            cascade.render = cacheCascades ? stale && cascade.age >= refreshInterval(i) : true;
+        }
+        // The multiview pass writes every layer, so a cascade that is due takes the others along
+        if (multiviewDepthPass) {
+            const bool any = std::any_of(cascades.begin(), cascades.end(), [](const Cascade& cascade) { return cascade.render; });
+            for (auto& cascade : cascades) {
+                cascade.render = any;
+            }
+        }
+        for (auto& cascade : cascades) {
+            if (cascade.render) {
+                cascade.renderedViewProjMatrix = cascade.viewProjMatrix;
+                cascade.age = 0;
+                ++renderedCascades;
+            }
+        }
+    }
+
+    // Called from whichever thread is recording the cascade, so it only touches that thread's command buffers
+    vk::CommandBuffer acquireSecondary(DepthRecording& recording) {
+        auto& worker = recording.workers[getScheduler().workerIndex()];
+        if (worker.used == worker.commandBuffers.size()) {
+            worker.commandBuffers.push_back(device.allocateCommandBuffers({ context.getCommandPool(), vk::CommandBufferLevel::eSecondary, 1 })[0]);
+        }
+        return worker.commandBuffers[worker.used++];
+    }
+
+    // The casters of one cascade, into a secondary of the cascade's render pass
+    void recordCascade(DepthRecording& recording, uint32_t index) {
+        const vk::CommandBufferInheritanceInfo inheritanceInfo{ depthPass.renderPass, 0, cascades[index].frameBuffer };
+        const auto cmdBuffer = acquireSecondary(recording);
+        cmdBuffer.begin({ vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eOneTimeSubmit, &inheritanceInfo });
+        cmdBuffer.setViewport(0, vk::Viewport{ 0, 0, (float)SHADOWMAP_DIM, (float)SHADOWMAP_DIM, 0, 1 });
+        cmdBuffer.setScissor(0, vk::Rect2D{ {}, vk::Extent2D{ SHADOWMAP_DIM, SHADOWMAP_DIM } });
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, depthPass.pipeline);
+        const auto volumes = cascadeVolumes();
+        renderScene(cmdBuffer, depthPass.pipelineLayout, cascades[index].descriptorSet, index, &volumes, 1u << index);
+        cmdBuffer.end();
+        recording.cascades[index] = cmdBuffer;
+    }
+
+    // The light volumes of all cascades, as last rendered
+    std::array<vks::Frustum, SHADOW_MAP_CASCADE_COUNT> cascadeVolumes() const {
+        std::array<vks::Frustum, SHADOW_MAP_CASCADE_COUNT> volumes;
+        for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
+            volumes[i].update(cascades[i].renderedViewProjMatrix);
+        }
+        return volumes;
+    }
+
+    // Every cascade in a single multiview pass: each tree is drawn once, with the cascades it is visible in
+    void recordMultiviewDepthPass(const vk::CommandBuffer& cmdBuffer) {
+        vk::ClearValue clearValue;
+        clearValue.depthStencil = defaultClearDepth;
+        vk::RenderPassBeginInfo renderPassBeginInfo{ depthPass.multiview.renderPass, depthPass.multiview.framebuffer,
+                                                     vk::Rect2D{ {}, vk::Extent2D{ SHADOWMAP_DIM, SHADOWMAP_DIM } }, 1, &clearValue };
+        cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+        cmdBuffer.setViewport(0, vk::Viewport{ 0, 0, (float)SHADOWMAP_DIM, (float)SHADOWMAP_DIM, 0, 1 });
+        cmdBuffer.setScissor(0, vk::Rect2D{ {}, vk::Extent2D{ SHADOWMAP_DIM, SHADOWMAP_DIM } });
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, depthPass.multiview.pipeline);
+        const auto volumes = cascadeVolumes();
+        renderScene(cmdBuffer, depthPass.pipelineLayout, cascades[0].descriptorSet, 0, &volumes, (1u << SHADOW_MAP_CASCADE_COUNT) - 1);
+        cmdBuffer.endRenderPass();
+    }
+
     /*
-        Build the command buffer for rendering the depth map cascades
-        Uses multiple passes with each pass rendering the scene to the cascade's depth image layer
-        Could be optimized using a geometry shader (and layered frame buffer) on devices that support geometry shaders
+        Record the depth pass of the current image, one pass per cascade rendered this frame
+        The secondaries of the cascades are recorded in parallel, the primary executes them in cascade order
+        With the multiview depth pass, all cascades are rendered in one pass instead
     */
-    void buildDepthPassCommandBuffer() {
-        depthPass.commandBuffer.begin({ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
-        vk::Viewport viewport;
-        viewport.width = (float)SHADOWMAP_DIM;
-        viewport.height = (float)SHADOWMAP_DIM;
-        viewport.minDepth = 0;
-        viewport.maxDepth = 1;
-        depthPass.commandBuffer.setViewport(0, viewport);
-
-        vk::Rect2D scissor;
-        scissor.extent = vk::Extent2D{ SHADOWMAP_DIM, SHADOWMAP_DIM };
-        depthPass.commandBuffer.setScissor(0, scissor);
+    void updateDepthPassCommandBuffer() {
+        auto& recording = depthRecordings[currentBuffer];
+        for (auto& worker : recording.workers) {
+            worker.used = 0;
+        }
+        recording.cascades = {};
+
+        if (multiviewDepthPass) {
+            recording.commandBuffer.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+            if (renderedCascades) {
+                recordMultiviewDepthPass(recording.commandBuffer);
+            }
+            recording.commandBuffer.end();
+            return;
+        }
+
+        std::vector<uint32_t> rendered;
+        for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
+            if (cascades[i].render) {
+                rendered.push_back(i);
+            }
+        }
+        getScheduler().parallelFor(0, rendered.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                recordCascade(recording, rendered[i]);
+            }
+        });
 
         vk::ClearValue clearValue;
         clearValue.depthStencil = defaultClearDepth;
@@ -379,17 +590,26 @@ public:
         renderPassBeginInfo.clearValueCount = 1;
         renderPassBeginInfo.pClearValues = &clearValue;
 
-        // One pass per cascade
-        // The layer that this pass renders too is defined by the cascade's image view (selected via the cascade's decsriptor set)
-        for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
+        // The layer that each pass renders to is defined by the cascade's framebuffer.  Layers of cascades that are
+        // skipped keep their depth from an earlier frame.
+        const auto& cmdBuffer = recording.commandBuffer;
+        cmdBuffer.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+        for (auto i : rendered) {
             renderPassBeginInfo.framebuffer = cascades[i].frameBuffer;
-            depthPass.commandBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-            depthPass.commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, depthPass.pipeline);
-            renderScene(depthPass.commandBuffer, depthPass.pipelineLayout, cascades[i].descriptorSet, i);
-            depthPass.commandBuffer.endRenderPass();
+            cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+            cmdBuffer.executeCommands(recording.cascades[i]);
+            cmdBuffer.endRenderPass();
         }
+        cmdBuffer.end();
+    }
 
-        depthPass.commandBuffer.end();
+    // The depth pass primaries are re-recorded every frame in draw, so only allocate them here
+    void prepareDepthRecordings() {
+        depthRecordings.resize(swapChain.imageCount);
+        for (auto& recording : depthRecordings) {
+            recording.commandBuffer = device.allocateCommandBuffers({ cmdPool, vk::CommandBufferLevel::ePrimary, 1 })[0];
+            recording.workers.resize(getScheduler().workerCount());
+        }
     }
 
     void updateDrawCommandBuffer(const vk::CommandBuffer& drawCommandBuffer) override {
@@ -422,6 +642,15 @@ public:
         models[0].loadFromFile(context, getAssetPath() + "models/terrain_simple.dae", vertexLayout, 1.0f);
         models[1].loadFromFile(context, getAssetPath() + "models/oak_trunk.dae", vertexLayout, 2.0f);
         models[2].loadFromFile(context, getAssetPath() + "models/oak_leafs.dae", vertexLayout, 2.0f);
+
+        const glm::vec3 treeMin = glm::min(models[1].dim.min, models[2].dim.min);
+        const glm::vec3 treeMax = glm::max(models[1].dim.max, models[2].dim.max);
+        treeCenter = (treeMin + treeMax) * 0.5f;
+        treeRadius = glm::length(treeMax - treeMin) * 0.5f;
+        treeBounds.clear();
+        for (const auto& position : treePositions) {
+            treeBounds.push_back(position + treeCenter, treeRadius);
+        }
     }
 
     void setupLayoutsAndDescriptors() {
@@ -537,6 +766,14 @@ public:
         builder.layout = depthPass.pipelineLayout;
         builder.renderPass = depthPass.renderPass;
         depthPass.pipeline = builder.create(context.pipelineCache);
+
+        if (multiviewSupported) {
+            builder.destroyShaderModules();
+            builder.loadShader(getAssetPath() + "shaders/shadowmappingcascade/depthpass_multiview.vert.spv", vk::ShaderStageFlagBits::eVertex);
+            builder.loadShader(getAssetPath() + "shaders/shadowmappingcascade/depthpass.frag.spv", vk::ShaderStageFlagBits::eFragment);
+            builder.renderPass = depthPass.multiview.renderPass;
+            depthPass.multiview.pipeline = builder.create(context.pipelineCache);
+        }
     }
 
     void prepareUniformBuffers() {
@@ -555,6 +792,12 @@ public:
         Based on https://johanmedestrom.wordpress.com/2016/03/18/opengl-cascaded-shadow-maps/
     */
     void updateCascades() {
+        const CascadeInputs inputs{ camera.matrices.perspective * camera.matrices.view, lightPos, cascadeSplitLambda };
+        if (inputs == cascadeInputs) {
+            return;
+        }
+        cascadeInputs = inputs;
+
         float cascadeSplits[SHADOW_MAP_CASCADE_COUNT];
 
         float nearClip = camera.getNearClip();
@@ -618,6 +861,15 @@ public:
             glm::vec3 minExtents = -maxExtents;
 
             glm::vec3 lightDir = normalize(-lightPos);
+
+            // Move the center in whole texels across the light and in depth, so the matrix stays the same while the
+            // camera moves less than a texel, and the cascade can be cached
+            const float texelSize = 2.0f * radius / SHADOWMAP_DIM;
+            const glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), lightDir, glm::vec3(0.0f, 1.0f, 0.0f));
+            glm::vec3 lightSpaceCenter = glm::vec3(lightRotation * glm::vec4(frustumCenter, 1.0f));
+            lightSpaceCenter = glm::floor(lightSpaceCenter / texelSize) * texelSize;
+            frustumCenter = glm::vec3(glm::inverse(lightRotation) * glm::vec4(lightSpaceCenter, 1.0f));
+
             glm::mat4 lightViewMatrix = glm::lookAt(frustumCenter - lightDir * -minExtents.z, frustumCenter, glm::vec3(0.0f, 1.0f, 0.0f));
             glm::mat4 lightOrthoMatrix = glm::ortho(minExtents.x, maxExtents.x, minExtents.y, maxExtents.y, 0.0f, maxExtents.z - minExtents.z);
 
@@ -640,7 +892,7 @@ public:
             Depth rendering
         */
         for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
-            depthPass.ubo.cascadeViewProjMat[i] = cascades[i].viewProjMatrix;
+            depthPass.ubo.cascadeViewProjMat[i] = cascades[i].renderedViewProjMatrix;
         }
         memcpy(depthPass.uniformBuffer.mapped, &depthPass.ubo, sizeof(depthPass.ubo));
 
@@ -655,7 +907,8 @@ public:
 
         for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
             uboFS.cascadeSplits[i] = cascades[i].splitDepth;
-            uboFS.cascadeViewProjMat[i] = cascades[i].viewProjMatrix;
+            // Cached layers are looked up the way they were rendered
+            uboFS.cascadeViewProjMat[i] = cascades[i].renderedViewProjMatrix;
         }
         uboFS.inverseViewMat = glm::inverse(camera.matrices.view);
         uboFS.lightDir = normalize(-lightPos);
@@ -665,6 +918,10 @@ public:
 
     void draw() override {
         prepareFrame();
+        // prepareFrame has waited for the image's previous frame, so its depth pass can be recorded again
+        selectCascades();
+        updateUniformBuffers();
+        updateDepthPassCommandBuffer();
 
         // Depth map generation
         {
@@ -676,8 +933,9 @@ public:
             submitInfo.signalSemaphoreCount = 1;
             submitInfo.pSignalSemaphores = &depthPass.semaphore;
             submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = &depthPass.commandBuffer;
-            queue.submit(submitInfo, nullptr);
+            submitInfo.pCommandBuffers = &depthRecordings[currentBuffer].commandBuffer;
+            // Goes out with the scene's submission
+            context.submitBatched(queue, submitInfo);
         }
 
         // Scene rendering
@@ -695,7 +953,7 @@ public:
         setupLayoutsAndDescriptors();
         preparePipelines();
         buildCommandBuffers();
-        buildDepthPassCommandBuffer();
+        prepareDepthRecordings();
         prepared = true;
     }
 
@@ -724,18 +982,20 @@ public:
             if (ui.checkBox("Color cascades", &colorCascades)) {
                 updateUniformBuffers();
             }
-            if (ui.checkBox("Display depth map", &displayDepthMap)) {
-                buildCommandBuffers();
-            }
+            ui.checkBox("Display depth map", &displayDepthMap);
             if (displayDepthMap) {
-                if (ui.sliderInt("Cascade", &displayDepthMapCascadeIndex, 0, SHADOW_MAP_CASCADE_COUNT - 1)) {
-                    buildCommandBuffers();
-                }
+                ui.sliderInt("Cascade", &displayDepthMapCascadeIndex, 0, SHADOW_MAP_CASCADE_COUNT - 1);
             }
-            if (ui.checkBox("PCF filtering", &filterPCF)) {
-                buildCommandBuffers();
+            ui.checkBox("PCF filtering", &filterPCF);
+            ui.checkBox("Cache cascades", &cacheCascades);
+            if (multiviewSupported) {
+                ui.checkBox("Single pass (multiview)", &multiviewDepthPass);
             }
         }
+        if (ui.header("Statistics")) {
+            ui.text("Cascades rendered: %u / %u", renderedCascades, SHADOW_MAP_CASCADE_COUNT);
+            ui.text("Threads: %d", (int)getScheduler().workerCount());
+        }
     }
 };
 
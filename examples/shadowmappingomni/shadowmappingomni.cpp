@@ -7,6 +7,7 @@
 */
 
 #include <vulkanOffscreenExampleBase.hpp>
+#include <vks/frustum.hpp>
 
 // Texture properties
 #define TEX_DIM 1024
@@ -16,6 +17,9 @@
 #define FB_DIM TEX_DIM
 #define FB_COLOR_FORMAT
 
+// Point lights sharing the cube map array, six layers each.  Must match LIGHT_COUNT of the shaders
+#define LIGHT_COUNT 2
+
 // Vertex layout for this example
 vks::model::VertexLayout vertexLayout{ {
     vks::model::Component::VERTEX_COMPONENT_POSITION,
@@ -27,6 +31,11 @@ vks::model::VertexLayout vertexLayout{ {
 class VulkanExample : public vkx::OffscreenExampleBase {
 public:
     bool displayCubeMap = false;
+    // Render all six faces of the moving light in one multiview pass, instead of one pass per face
+    bool multiviewPass = false;
+    bool multiviewSupported = false;
+    // The faces of static lights are only rendered again when one of them changed
+    bool staticShadowsDirty = true;
 
     float zNear = 0.1f;
     float zFar = 1024.0f;
@@ -52,22 +61,57 @@ public:
         glm::mat4 model;
     } uboVSquad;
 
-    glm::vec4 lightPos = glm::vec4(0.0f, -25.0f, 0.0f, 1.0);
+    struct Light {
+        glm::vec3 center;
+        // Radius of the light's orbit around its center, 0 for a static light
+        float orbit;
+        float intensity;
+        glm::vec3 position;
+    };
+    // The first light moves, and is the one the multiview pass and the cube map display show
+    std::array<Light, LIGHT_COUNT> lights{ { { glm::vec3(0.0f, -25.0f, 0.0f), 1.0f, 1.0f, glm::vec3() },
+                                             { glm::vec3(-30.0f, -20.0f, 15.0f), 0.0f, 0.5f, glm::vec3() } } };
 
     struct {
         glm::mat4 projection;
         glm::mat4 view;
         glm::mat4 model;
-        glm::vec4 lightPos;
+        // xyz position, w intensity
+        glm::vec4 lights[LIGHT_COUNT];
     } uboVSscene;
 
     struct {
         glm::mat4 projection;
-        glm::mat4 view;
-        glm::mat4 model;
-        glm::vec4 lightPos;
+        glm::vec4 lights[LIGHT_COUNT];
+        // View matrix of every cube face, indexed by gl_ViewIndex in the multiview pass
+        glm::mat4 faceViews[6];
     } uboOffscreenVS;
 
+    // Which face of which light a pass renders
+    struct FacePushConstants {
+        glm::mat4 view;
+        uint32_t light;
+    };
+
+    // Each face of each light rendered straight into its layer of the cube map array.  The faces are rendered one
+    // after the other, so they share a depth buffer.
+    struct {
+        std::array<vk::ImageView, LIGHT_COUNT * 6> views;
+        std::array<vk::Framebuffer, LIGHT_COUNT * 6> framebuffers;
+        vks::Image depth;
+    } faces;
+
+    // Bounding sphere of every part of the scene, for culling it against the faces
+    std::vector<glm::vec4> partSpheres;
+
+    // Every face of the moving light in one pass, one view per layer
+    struct {
+        vk::ImageView view;
+        vk::RenderPass renderPass;
+        vk::Framebuffer framebuffer;
+        vk::Pipeline pipeline;
+    } multiview;
+
     struct {
         vk::Pipeline scene;
         vk::Pipeline offscreen;
@@ -86,7 +130,9 @@ public:
 
     vk::DescriptorSetLayout descriptorSetLayout;
 
+    // The faces of the first light, and those of all lights
     const vk::ImageSubresourceRange CUBEMAP_RANGE{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 6 };
+    const vk::ImageSubresourceRange ATLAS_RANGE{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 6 * LIGHT_COUNT };
 
     vks::Image shadowCubeMap;
 
@@ -106,6 +152,7 @@ public:
         timerSpeed *= 0.25f;
         camera.setRotation({ -20.5f, -673.0f, 0.0f });
         title = "Vulkan Example - Point light shadows";
+        context.enableMultiview = true;
     }
 
     ~VulkanExample() {
@@ -114,12 +161,22 @@ public:
 
         // Cube map
         shadowCubeMap.destroy();
+        for (uint32_t i = 0; i < faces.views.size(); ++i) {
+            device.destroyFramebuffer(faces.framebuffers[i]);
+            device.destroyImageView(faces.views[i]);
+        }
+        faces.depth.destroy();
 
         // Pipelibes
         device.destroyPipeline(pipelines.scene);
         device.destroyPipeline(pipelines.offscreen);
         device.destroyPipeline(pipelines.cubeMap);
 
+        device.destroyPipeline(multiview.pipeline);
+        device.destroyFramebuffer(multiview.framebuffer);
+        device.destroyRenderPass(multiview.renderPass);
+        device.destroyImageView(multiview.view);
+
         device.destroyPipelineLayout(pipelineLayouts.scene);
         device.destroyPipelineLayout(pipelineLayouts.offscreen);
 
@@ -145,22 +202,17 @@ public:
         imageCreateInfo.extent.height = TEX_DIM;
         imageCreateInfo.extent.depth = 1;
         imageCreateInfo.mipLevels = 1;
-        imageCreateInfo.arrayLayers = 6;
+        imageCreateInfo.arrayLayers = 6 * LIGHT_COUNT;
         imageCreateInfo.samples = vk::SampleCountFlagBits::e1;
         imageCreateInfo.tiling = vk::ImageTiling::eOptimal;
-        imageCreateInfo.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
+        // Rendered to directly, a face per layer
+        imageCreateInfo.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled;
         imageCreateInfo.sharingMode = vk::SharingMode::eExclusive;
         imageCreateInfo.initialLayout = vk::ImageLayout::eUndefined;
         imageCreateInfo.flags = vk::ImageCreateFlagBits::eCubeCompatible;
 
         shadowCubeMap = context.createImage(imageCreateInfo, vk::MemoryPropertyFlagBits::eDeviceLocal);
-        context.setImageLayout(shadowCubeMap.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal, CUBEMAP_RANGE);
-
-        vk::ImageSubresourceRange subresourceRange;
-        subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-        subresourceRange.baseMipLevel = 0;
-        subresourceRange.levelCount = 1;
-        subresourceRange.layerCount = 6;
+        context.setImageLayout(shadowCubeMap.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal, ATLAS_RANGE);
 
         // Create sampler
         vk::SamplerCreateInfo sampler;
@@ -178,37 +230,110 @@ public:
         sampler.borderColor = vk::BorderColor::eFloatOpaqueWhite;
         shadowCubeMap.sampler = device.createSampler(sampler);
 
-        // Create image view
+        // Create image view, one cube per light
         vk::ImageViewCreateInfo view;
-        view.viewType = vk::ImageViewType::eCube;
+        view.viewType = vk::ImageViewType::eCubeArray;
         view.format = format;
-        view.subresourceRange = { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
-        view.subresourceRange.layerCount = 6;
+        view.subresourceRange = ATLAS_RANGE;
         view.image = shadowCubeMap.image;
         shadowCubeMap.view = device.createImageView(view);
+
+        prepareFaces(format);
+        if (multiviewSupported) {
+            prepareMultiview(format);
+        }
     }
 
-    // Updates a single cube map face
-    // Renders the scene with face's view and does
-    // a copy from framebuffer to cube face
-    // Uses push constants for quick update of
-    // view matrix for the current cube map face
-    void updateCubeFace(uint32_t faceIndex) {
-        vk::ClearValue clearValues[2];
-        clearValues[0].color = vks::util::clearColor({ 0.0f, 0.0f, 0.0f, 1.0f });
-        clearValues[1].depthStencil = defaultClearDepth;
+    // A view and framebuffer for every layer of the cube map array, for the offscreen render pass
+    void prepareFaces(vk::Format format) {
+        vk::ImageCreateInfo depthInfo;
+        depthInfo.imageType = vk::ImageType::e2D;
+        depthInfo.format = offscreen.depthFormat;
+        depthInfo.extent = vk::Extent3D{ TEX_DIM, TEX_DIM, 1 };
+        depthInfo.mipLevels = 1;
+        depthInfo.arrayLayers = 1;
+        depthInfo.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
+        faces.depth = context.createImage(depthInfo, vk::MemoryPropertyFlagBits::eDeviceLocal);
+        vk::ImageViewCreateInfo depthView;
+        depthView.viewType = vk::ImageViewType::e2D;
+        depthView.format = offscreen.depthFormat;
+        depthView.subresourceRange = { vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1 };
+        depthView.image = faces.depth.image;
+        faces.depth.view = device.createImageView(depthView);
 
-        vk::RenderPassBeginInfo renderPassBeginInfo;
-        // Reuse render pass from example pass
-        renderPassBeginInfo.renderPass = offscreen.renderPass;
-        renderPassBeginInfo.framebuffer = offscreen.framebuffers[0].framebuffer;
-        renderPassBeginInfo.renderArea.extent.width = offscreen.size.x;
-        renderPassBeginInfo.renderArea.extent.height = offscreen.size.y;
-        renderPassBeginInfo.clearValueCount = 2;
-        renderPassBeginInfo.pClearValues = clearValues;
+        vk::ImageViewCreateInfo view;
+        view.viewType = vk::ImageViewType::e2D;
+        view.format = format;
+        view.image = shadowCubeMap.image;
+        for (uint32_t layer = 0; layer < faces.views.size(); ++layer) {
+            view.subresourceRange = { vk::ImageAspectFlagBits::eColor, 0, 1, layer, 1 };
+            faces.views[layer] = device.createImageView(view);
+            const std::array<vk::ImageView, 2> attachments{ faces.views[layer], faces.depth.view };
+            faces.framebuffers[layer] = device.createFramebuffer({ {}, offscreen.renderPass, 2, attachments.data(), TEX_DIM, TEX_DIM, 1 });
+        }
+    }
 
-        // Update view matrix via push constant
+    // Render pass and framebuffer writing view i to face i of the cube map
+    void prepareMultiview(vk::Format format) {
+        vk::ImageViewCreateInfo view;
+        view.viewType = vk::ImageViewType::e2DArray;
+        view.format = format;
+        view.subresourceRange = CUBEMAP_RANGE;
+        view.image = shadowCubeMap.image;
+        multiview.view = device.createImageView(view);
+
+        // Every face is cleared and rendered, so the previous contents can be discarded
+        vk::AttachmentDescription attachment;
+        attachment.format = format;
+        attachment.loadOp = vk::AttachmentLoadOp::eClear;
+        attachment.storeOp = vk::AttachmentStoreOp::eStore;
+        attachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+        attachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+        attachment.initialLayout = vk::ImageLayout::eUndefined;
+        attachment.finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+
+        vk::AttachmentReference colorReference{ 0, vk::ImageLayout::eColorAttachmentOptimal };
+        vk::SubpassDescription subpass;
+        subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &colorReference;
+
+        // The scene pass of the previous frame samples the cube map
+        std::array<vk::SubpassDependency, 2> dependencies;
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass = 0;
+        dependencies[0].srcStageMask = vk::PipelineStageFlagBits::eFragmentShader;
+        dependencies[0].dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+        dependencies[0].srcAccessMask = vk::AccessFlagBits::eShaderRead;
+        dependencies[0].dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
+        dependencies[1].srcSubpass = 0;
+        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+        dependencies[1].dstStageMask = vk::PipelineStageFlagBits::eFragmentShader;
+        dependencies[1].srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
+        dependencies[1].dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+        const uint32_t viewMask = 0x3F;
+        vk::RenderPassMultiviewCreateInfo multiviewInfo;
+        multiviewInfo.subpassCount = 1;
+        multiviewInfo.pViewMasks = &viewMask;
+
+        vk::RenderPassCreateInfo renderPassInfo;
+        renderPassInfo.pNext = &multiviewInfo;
+        renderPassInfo.attachmentCount = 1;
+        renderPassInfo.pAttachments = &attachment;
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = (uint32_t)dependencies.size();
+        renderPassInfo.pDependencies = dependencies.data();
+        multiview.renderPass = device.createRenderPass(renderPassInfo);
+
+        // Multiview framebuffers have a single layer, the views pick the layers of the attachment
+        multiview.framebuffer = device.createFramebuffer({ {}, multiview.renderPass, 1, &multiview.view, TEX_DIM, TEX_DIM, 1 });
+    }
 
+    // View matrix for rendering the scene from the light into cube map face `faceIndex`
+    static glm::mat4 faceView(uint32_t faceIndex) {
         glm::mat4 viewMatrix = glm::mat4();
         switch (faceIndex) {
             case 0:  // POSITIVE_X
@@ -232,35 +357,79 @@ public:
                 viewMatrix = glm::rotate(viewMatrix, glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
                 break;
         }
+        return viewMatrix;
+    }
+
+    static glm::mat4 lightProjection(float zNear, float zFar) { return glm::perspective((float)(M_PI / 2.0), 1.0f, zNear, zFar); }
+
+    // The parts of the scene in face `faceIndex` of `light`, wherever on its orbit the light is, so command buffers
+    // recorded with them stay valid while it moves
+    std::vector<uint32_t> partsInFace(uint32_t light, uint32_t faceIndex) const {
+        vks::Frustum frustum;
+        frustum.update(lightProjection(zNear, zFar) * faceView(faceIndex) * glm::translate(glm::mat4(), -lights[light].center));
+        std::vector<uint32_t> parts;
+        for (uint32_t i = 0; i < partSpheres.size(); ++i) {
+            if (frustum.checkSphere(glm::vec3(partSpheres[i]), partSpheres[i].w + lights[light].orbit)) {
+                parts.push_back(i);
+            }
+        }
+        return parts;
+    }
+
+    // Renders the scene with the face's view straight into the face's layer of the cube map array
+    // Uses push constants for quick update of
+    // view matrix for the current cube map face
+    void renderCubeFace(const vk::CommandBuffer& cmdBuffer, uint32_t light, uint32_t faceIndex) {
+        vk::ClearValue clearValues[2];
+        clearValues[0].color = vks::util::clearColor({ 0.0f, 0.0f, 0.0f, 1.0f });
+        clearValues[1].depthStencil = defaultClearDepth;
 
-        // Change image layout for all cubemap faces to transfer destination
-        context.setImageLayout(offscreen.cmdBuffer, offscreen.framebuffers[0].colors[0].image, vk::ImageLayout::eUndefined,
-                               vk::ImageLayout::eColorAttachmentOptimal, vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
+        vk::RenderPassBeginInfo renderPassBeginInfo;
+        renderPassBeginInfo.renderPass = offscreen.renderPass;
+        renderPassBeginInfo.framebuffer = faces.framebuffers[light * 6 + faceIndex];
+        renderPassBeginInfo.renderArea.extent.width = offscreen.size.x;
+        renderPassBeginInfo.renderArea.extent.height = offscreen.size.y;
+        renderPassBeginInfo.clearValueCount = 2;
+        renderPassBeginInfo.pClearValues = clearValues;
 
         // Render scene from cube face's point of view
-        offscreen.cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+        cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
         // Update shader push constant block
-        // Contains current face view matrix
-        offscreen.cmdBuffer.pushConstants(pipelineLayouts.offscreen, vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::mat4), &viewMatrix);
-        offscreen.cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.offscreen);
-        offscreen.cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.offscreen, 0, descriptorSets.offscreen, nullptr);
-        offscreen.cmdBuffer.bindVertexBuffers(0, meshes.scene.vertices.buffer, { 0 });
-        offscreen.cmdBuffer.bindIndexBuffer(meshes.scene.indices.buffer, 0, vk::IndexType::eUint32);
-        offscreen.cmdBuffer.drawIndexed(meshes.scene.indexCount, 1, 0, 0, 0);
-        offscreen.cmdBuffer.endRenderPass();
-
-        // Copy region for transfer from framebuffer to cube face
-        vk::ImageCopy copyRegion;
-        copyRegion.srcSubresource = vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, 0, 0, 1 };
-        copyRegion.dstSubresource = vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, 0, faceIndex, 1 };
-        copyRegion.extent = shadowCubeMap.extent;
-
-        // Put image copy into command buffer
-        offscreen.cmdBuffer.copyImage(offscreen.framebuffers[0].colors[0].image, vk::ImageLayout::eTransferSrcOptimal, shadowCubeMap.image,
-                                      vk::ImageLayout::eTransferDstOptimal, copyRegion);
+        // Contains current face view matrix and the light
+        const FacePushConstants pushConstants{ faceView(faceIndex), light };
+        cmdBuffer.pushConstants(pipelineLayouts.offscreen, vk::ShaderStageFlagBits::eVertex, 0, sizeof(pushConstants), &pushConstants);
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.offscreen);
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.offscreen, 0, descriptorSets.offscreen, nullptr);
+        cmdBuffer.bindVertexBuffers(0, meshes.scene.vertices.buffer, { 0 });
+        cmdBuffer.bindIndexBuffer(meshes.scene.indices.buffer, 0, meshes.scene.indexType);
+        for (auto part : partsInFace(light, faceIndex)) {
+            cmdBuffer.drawIndexed(meshes.scene.parts[part].indexCount, 1, meshes.scene.parts[part].indexBase, 0, 0);
+        }
+        cmdBuffer.endRenderPass();
+    }
+
+    void renderLight(const vk::CommandBuffer& cmdBuffer, uint32_t light) {
+        for (uint32_t face = 0; face < 6; ++face) {
+            renderCubeFace(cmdBuffer, light, face);
+        }
     }
 
-    // Command buffer for rendering and copying all cube map faces
+    // Renders the faces of the static lights once, rather than every frame.  Nothing may be reading them.
+    void updateStaticShadows() {
+        updateUniformBufferOffscreen();
+        context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& cmdBuffer) {
+            cmdBuffer.setViewport(0, vks::util::viewport(offscreen.size));
+            cmdBuffer.setScissor(0, vks::util::rect2D(offscreen.size));
+            for (uint32_t light = 0; light < LIGHT_COUNT; ++light) {
+                if (lights[light].orbit == 0.0f) {
+                    renderLight(cmdBuffer, light);
+                }
+            }
+        });
+        staticShadowsDirty = false;
+    }
+
+    // Command buffer for rendering the cube map faces of the moving light
     void buildOffscreenCommandBuffer() override {
         auto& cmdBuffer = offscreen.cmdBuffer;
         // Create separate command buffer for offscreen
@@ -271,14 +440,26 @@ public:
         cmdBuffer.begin({ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
         cmdBuffer.setViewport(0, vks::util::viewport(offscreen.size));
         cmdBuffer.setScissor(0, vks::util::rect2D(offscreen.size));
-        // Change image layout for all cubemap faces to transfer destination
-        context.setImageLayout(cmdBuffer, shadowCubeMap.image, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eTransferDstOptimal, CUBEMAP_RANGE);
-        for (uint32_t face = 0; face < 6; ++face) {
-            updateCubeFace(face);
+        if (multiviewPass) {
+            // The scene is only drawn once, the views replicate it to the faces
+            vk::ClearValue clearValue;
+            clearValue.color = vks::util::clearColor({ 0.0f, 0.0f, 0.0f, 1.0f });
+            cmdBuffer.beginRenderPass({ multiview.renderPass, multiview.framebuffer, vks::util::rect2D(offscreen.size), 1, &clearValue },
+                                      vk::SubpassContents::eInline);
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, multiview.pipeline);
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.offscreen, 0, descriptorSets.offscreen, nullptr);
+            cmdBuffer.bindVertexBuffers(0, meshes.scene.vertices.buffer, { 0 });
+            cmdBuffer.bindIndexBuffer(meshes.scene.indices.buffer, 0, meshes.scene.indexType);
+            cmdBuffer.drawIndexed(meshes.scene.indexCount, 1, 0, 0, 0);
+            cmdBuffer.endRenderPass();
+        } else {
+            for (uint32_t light = 0; light < LIGHT_COUNT; ++light) {
+                if (lights[light].orbit != 0.0f) {
+                    renderLight(cmdBuffer, light);
+                }
+            }
         }
-        // Change image layout for all cubemap faces to shader read after they have been copied
-        context.setImageLayout(cmdBuffer, shadowCubeMap.image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, CUBEMAP_RANGE);
-        offscreen.cmdBuffer.end();
+        cmdBuffer.end();
     }
 
     //void updateCommandBufferPreDraw(const vk::CommandBuffer& cmdBuffer) override {
@@ -294,19 +475,55 @@ public:
         if (displayCubeMap) {
             cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.cubeMap);
             cmdBuffer.bindVertexBuffers(0, meshes.skybox.vertices.buffer, { 0 });
-            cmdBuffer.bindIndexBuffer(meshes.skybox.indices.buffer, 0, vk::IndexType::eUint32);
+            cmdBuffer.bindIndexBuffer(meshes.skybox.indices.buffer, 0, meshes.skybox.indexType);
             cmdBuffer.drawIndexed(meshes.skybox.indexCount, 1, 0, 0, 0);
         } else {
             cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.scene);
             cmdBuffer.bindVertexBuffers(0, meshes.scene.vertices.buffer, { 0 });
-            cmdBuffer.bindIndexBuffer(meshes.scene.indices.buffer, 0, vk::IndexType::eUint32);
+            cmdBuffer.bindIndexBuffer(meshes.scene.indices.buffer, 0, meshes.scene.indexType);
             cmdBuffer.drawIndexed(meshes.scene.indexCount, 1, 0, 0, 0);
         }
     }
 
+    void getEnabledFeatures() override {
+        // All lights' cube maps are in one cube map array
+        if (context.deviceFeatures.imageCubeArray) {
+            context.enabledFeatures.imageCubeArray = VK_TRUE;
+        } else {
+            throw std::runtime_error("Selected GPU does not support cube map arrays!");
+        }
+    }
+
     void loadAssets() override {
         meshes.skybox.loadFromFile(context, getAssetPath() + "models/cube.obj", vertexLayout, 2.0f);
-        meshes.scene.loadFromFile(context, getAssetPath() + "models/shadowscene_fire.dae", vertexLayout, 2.0f);
+        // The vertices are kept for the bounds of the parts
+        vks::model::ModelCreateInfo sceneCreateInfo{ glm::vec3(0.0f), glm::vec3(2.0f), glm::vec2(1.0f) };
+        sceneCreateInfo.hostCopy = true;
+        meshes.scene.loadFromFile(context, getAssetPath() + "models/shadowscene_fire.dae", vertexLayout, sceneCreateInfo);
+
+        // Bounded by the sphere around the center of each part's box
+        const uint32_t stride = vertexLayout.stride();
+        partSpheres.clear();
+        for (const auto& part : meshes.scene.parts) {
+            glm::vec3 min{ FLT_MAX };
+            glm::vec3 max{ -FLT_MAX };
+            for (uint32_t v = part.vertexBase; v < part.vertexBase + part.vertexCount; ++v) {
+                glm::vec3 pos;
+                memcpy(&pos, meshes.scene.hostVertices.data() + v * stride, sizeof(pos));
+                min = glm::min(min, pos);
+                max = glm::max(max, pos);
+            }
+            const glm::vec3 center = part.vertexCount ? (min + max) * 0.5f : glm::vec3(0.0f);
+            float radius = 0.0f;
+            for (uint32_t v = part.vertexBase; v < part.vertexBase + part.vertexCount; ++v) {
+                glm::vec3 pos;
+                memcpy(&pos, meshes.scene.hostVertices.data() + v * stride, sizeof(pos));
+                radius = std::max(radius, glm::length(pos - center));
+            }
+            partSpheres.push_back(glm::vec4(center, radius));
+        }
+        meshes.scene.hostVertices = {};
+        meshes.scene.hostIndices = {};
     }
 
     void setupDescriptorPool() {
@@ -319,9 +536,9 @@ public:
     void setupDescriptorSetLayout() {
         // Shared pipeline layout
         std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings = {
-            // Binding 0 : Vertex shader uniform buffer
-            { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
-            // Binding 1 : Fragment shader image sampler (cube map)
+            // Binding 0 : Vertex and fragment shader uniform buffer
+            { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment },
+            // Binding 1 : Fragment shader image sampler (cube map array)
             { 1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
         };
 
@@ -332,8 +549,8 @@ public:
         pipelineLayouts.scene = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
 
         // Offscreen pipeline layout
-        // Push constants for cube map face view matrices
-        vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::mat4) };
+        // Push constants for cube map face view matrices and the light
+        vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eVertex, 0, sizeof(FacePushConstants) };
         // Push constant ranges are part of the pipeline layout
         pipelineLayouts.offscreen = device.createPipelineLayout({ {}, 1, &descriptorSetLayout, 1, &pushConstantRange });
     }
@@ -379,6 +596,14 @@ public:
         builder.layout = pipelineLayouts.offscreen;
         builder.renderPass = offscreen.renderPass;
         pipelines.offscreen = builder.create(context.pipelineCache);
+
+        if (multiviewSupported) {
+            builder.destroyShaderModules();
+            builder.loadShader(getAssetPath() + "shaders/shadowmappingomni/offscreen_multiview.vert.spv", vk::ShaderStageFlagBits::eVertex);
+            builder.loadShader(getAssetPath() + "shaders/shadowmappingomni/offscreen.frag.spv", vk::ShaderStageFlagBits::eFragment);
+            builder.renderPass = multiview.renderPass;
+            multiview.pipeline = builder.create(context.pipelineCache);
+        }
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
@@ -402,33 +627,40 @@ public:
         rotM = glm::rotate(rotM, glm::radians(camera.rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
         rotM = glm::rotate(rotM, glm::radians(camera.rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
         uboVSscene.model = rotM;
-        uboVSscene.lightPos = lightPos;
+        for (uint32_t i = 0; i < LIGHT_COUNT; ++i) {
+            uboVSscene.lights[i] = glm::vec4(lights[i].position, lights[i].intensity);
+        }
         uniformData.scene.copy(uboVSscene);
     }
 
     void updateUniformBufferOffscreen() {
-        lightPos.x = sin(glm::radians(timer * 360.0f)) * 1.0f;
-        lightPos.z = cos(glm::radians(timer * 360.0f)) * 1.0f;
-        uboOffscreenVS.projection = glm::perspective((float)(M_PI / 2.0), 1.0f, zNear, zFar);
-        uboOffscreenVS.view = glm::mat4();
-        uboOffscreenVS.model = glm::translate(glm::mat4(), glm::vec3(-lightPos.x, -lightPos.y, -lightPos.z));
-        uboOffscreenVS.lightPos = lightPos;
+        for (uint32_t i = 0; i < LIGHT_COUNT; ++i) {
+            auto& light = lights[i];
+            light.position = light.center + glm::vec3(sin(glm::radians(timer * 360.0f)), 0.0f, cos(glm::radians(timer * 360.0f))) * light.orbit;
+            uboOffscreenVS.lights[i] = glm::vec4(light.position, light.intensity);
+        }
+        uboOffscreenVS.projection = lightProjection(zNear, zFar);
+        for (uint32_t face = 0; face < 6; ++face) {
+            uboOffscreenVS.faceViews[face] = faceView(face);
+        }
         uniformData.offscreen.copy(uboOffscreenVS);
     }
 
     void prepare() override {
         offscreen.size = glm::uvec2(TEX_DIM);
         offscreen.colorFormats = { vk::Format::eR32Sfloat };
-        offscreen.depthFormat = vk::Format::eUndefined;
-        offscreen.attachmentUsage = vk::ImageUsageFlagBits::eTransferSrc;
-        offscreen.colorFinalLayout = vk::ImageLayout::eTransferSrcOptimal;
+        // Each face renders into the cube map array, with the framebuffers of prepareFaces
+        offscreen.framebuffers.clear();
+        offscreen.colorFinalLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
         OffscreenExampleBase::prepare();
+        multiviewSupported = context.multiviewEnabled && context.multiviewProperties.maxMultiviewViewCount >= 6;
         prepareUniformBuffers();
         prepareCubeMap();
         setupDescriptorSetLayout();
         preparePipelines();
         setupDescriptorPool();
         setupDescriptorSets();
+        updateStaticShadows();
         buildCommandBuffers();
         buildOffscreenCommandBuffer();
         prepared = true;
@@ -437,6 +669,11 @@ public:
     void render() override {
         if (!prepared)
             return;
+        if (staticShadowsDirty) {
+            // The scene pass of the frames in flight samples them
+            device.waitIdle();
+            updateStaticShadows();
+        }
         draw();
         if (!paused) {
             updateUniformBufferOffscreen();
@@ -454,6 +691,15 @@ public:
             if (ui.checkBox("Display shadow cube render target", &displayCubeMap)) {
                 buildCommandBuffers();
             }
+            if (multiviewSupported && ui.checkBox("Single pass (multiview)", &multiviewPass)) {
+                // The offscreen command buffer may still be executing
+                device.waitIdle();
+                buildOffscreenCommandBuffer();
+            }
+            if (ui.sliderFloat("Static light height", &lights[1].center.y, -40.0f, -5.0f)) {
+                staticShadowsDirty = true;
+                viewChanged();
+            }
         }
     }
 };
@@ -7,10 +7,10 @@
 */
 
 #include <vulkanExampleBase.h>
+#include <vks/animation.hpp>
+#include <vks/skinning.hpp>
 
 #include <map>
-#include <assimp/matrix4x4.h>
-#include <assimp/anim.h>
 #include <assimp/mesh.h>
 #include <assimp/scene.h>
 #include <glm/gtc/type_ptr.hpp>
@@ -38,9 +38,8 @@ vks::model::VertexLayout vertexLayout{ {
     vks::model::Component::VERTEX_COMPONENT_DUMMY_UINT4,
 } };
 
-// Maximum number of bones per mesh
-// Must not be higher than same const in skinning shader
-#define MAX_BONES 64
+// Number of characters drawn, in a square grid
+#define CHARACTER_GRID 4
 // Maximum number of bones per vertex
 #define MAX_BONES_PER_VERTEX 4
 
@@ -63,54 +62,44 @@ struct VertexBoneData {
     }
 };
 
-// Stores information on a single bone
-struct BoneInfo {
-    aiMatrix4x4 offset;
-    aiMatrix4x4 finalTransformation;
-
-    BoneInfo() {
-        offset = aiMatrix4x4();
-        finalTransformation = aiMatrix4x4();
-    };
-};
-
 class SkinnedMesh : public vks::model::Model {
 public:
     // Bone related stuff
     // Maps bone name with index
     std::map<std::string, uint32_t> boneMapping;
-    // Bone details
-    std::vector<BoneInfo> boneInfo;
+    // Bone names by index, resolved to skeleton joints once the bones are loaded
+    std::vector<std::string> boneNames;
     // Number of bones present
     uint32_t numBones = 0;
-    // Root inverese transform matrix
-    aiMatrix4x4 globalInverseTransform;
     // Per-vertex bone info
     std::vector<VertexBoneData> bones;
-    // Bone transformations
-    std::vector<aiMatrix4x4> boneTransforms;
 
     // Modifier for the animation
     float animationSpeed = 0.75f;
+    // Node hierarchy, animations and bone bindings baked out of the scene at load time
+    vks::model::Skeleton skeleton;
+    std::vector<vks::model::AnimationClip> clips;
+    vks::model::Skin skin;
     // Currently active animation
-    const aiScene* pScene{ nullptr };
-    aiAnimation* pAnimation{ nullptr };
-    uint32_t numAnimations{ 0 };
+    uint32_t currentClip{ 0 };
 
     // Vulkan buffers
     vks::model::Model meshBuffer;
-    // Reference to assimp mesh
-    // Required for animation
+
+    // The bones and animations come from the Assimp scene, which a cached load doesn't have
+    bool cacheable() const override { return false; }
 
     void onLoad(const vks::Context& context, Assimp::Importer& importer, const aiScene* pScene) override {
-        this->pScene = importer.GetOrphanedScene();
         // Setup bones
         // One vertex bone info structure per vertex
         bones.resize(vertexCount);
-        numAnimations = pScene->mNumAnimations;
+        skeleton = vks::model::buildSkeleton(pScene->mRootNode);
+        clips.clear();
+        for (uint32_t i = 0; i < pScene->mNumAnimations; i++) {
+            clips.push_back(vks::model::bakeAnimation(pScene->mAnimations[i], skeleton));
+        }
         // Store global inverse transform matrix of root node
-        globalInverseTransform = pScene->mRootNode->mTransformation;
-        globalInverseTransform.Inverse();
+        skin.rootInverse = glm::inverse(glm::transpose(glm::make_mat4(&pScene->mRootNode->mTransformation.a1)));
         // Load bones (weights and IDs)
         for (uint32_t m = 0; m < pScene->mNumMeshes; m++) {
             aiMesh* paiMesh = pScene->mMeshes[m];
@@ -118,47 +107,56 @@ public:
                 loadBones(m, paiMesh, bones);
             }
         }
+        skin.joints.resize(numBones);
+        for (uint32_t i = 0; i < numBones; i++) {
+            const int32_t joint = skeleton.find(boneNames[i]);
+            if (joint < 0) {
+                throw std::runtime_error("Bone " + boneNames[i] + " has no node in the scene");
+            }
+            skin.joints[i] = static_cast<uint32_t>(joint);
+        }
     }
 
-    void appendVertex(std::vector<uint8_t>& outputBuffer, const aiScene* pScene, uint32_t meshIndex, uint32_t vertexIndex) override {
+    void packMesh(uint8_t* output, const aiScene* pScene, uint32_t meshIndex, Dimension& bounds) const override {
         const auto& part = parts[meshIndex];
-        const auto& bone = bones[part.vertexBase + vertexIndex];
         const aiVector3D Zero3D(0.0f, 0.0f, 0.0f);
         const aiMesh* paiMesh = pScene->mMeshes[meshIndex];
-        const aiVector3D* pPos = &(paiMesh->mVertices[vertexIndex]);
-        const aiVector3D* pNormal = &(paiMesh->mNormals[vertexIndex]);
-        const aiVector3D* pTexCoord = (paiMesh->HasTextureCoords(0)) ? &(paiMesh->mTextureCoords[0][vertexIndex]) : &Zero3D;
-        const aiVector3D* pTangent = (paiMesh->HasTangentsAndBitangents()) ? &(paiMesh->mTangents[vertexIndex]) : &Zero3D;
-        const aiVector3D* pBiTangent = (paiMesh->HasTangentsAndBitangents()) ? &(paiMesh->mBitangents[vertexIndex]) : &Zero3D;
 
         aiColor3D pColor(0.f, 0.f, 0.f);
         pScene->mMaterials[paiMesh->mMaterialIndex]->Get(AI_MATKEY_COLOR_DIFFUSE, pColor);
 
-        Vertex vertex;
-        vertex.pos = { pPos->x, -pPos->y, pPos->z };
-        vertex.pos *= scale;
-        vertex.pos += center;
-        vertex.normal = { pNormal->x, -pNormal->y, pNormal->z };
-        vertex.uv = { pTexCoord->x, pTexCoord->y };
-        vertex.uv *= uvscale;
-        vertex.color = { pColor.r, pColor.g, pColor.b };
-
-        // Fetch bone weights and IDs
-        for (uint32_t boneIndex = 0; boneIndex < MAX_BONES_PER_VERTEX; boneIndex++) {
-            vertex.boneWeights[boneIndex] = bone.weights[boneIndex];
-            vertex.boneIDs[boneIndex] = bone.IDs[boneIndex];
-        }
+        for (uint32_t vertexIndex = 0; vertexIndex < paiMesh->mNumVertices; ++vertexIndex) {
+            const auto& bone = bones[part.vertexBase + vertexIndex];
+            const aiVector3D* pPos = &(paiMesh->mVertices[vertexIndex]);
+            const aiVector3D* pNormal = &(paiMesh->mNormals[vertexIndex]);
+            const aiVector3D* pTexCoord = (paiMesh->HasTextureCoords(0)) ? &(paiMesh->mTextureCoords[0][vertexIndex]) : &Zero3D;
+
+            Vertex vertex;
+            vertex.pos = { pPos->x, -pPos->y, pPos->z };
+            vertex.pos *= scale;
+            vertex.pos += center;
+            vertex.normal = { pNormal->x, -pNormal->y, pNormal->z };
+            vertex.uv = { pTexCoord->x, pTexCoord->y };
+            vertex.uv *= uvscale;
+            vertex.color = { pColor.r, pColor.g, pColor.b };
+
+            // Fetch bone weights and IDs
+            for (uint32_t boneIndex = 0; boneIndex < MAX_BONES_PER_VERTEX; boneIndex++) {
+                vertex.boneWeights[boneIndex] = bone.weights[boneIndex];
+                vertex.boneIDs[boneIndex] = bone.IDs[boneIndex];
+            }
 
-        dim.max = glm::max(vertex.pos, dim.max);
-        dim.min = glm::min(vertex.pos, dim.min);
+            bounds.max = glm::max(vertex.pos, bounds.max);
+            bounds.min = glm::min(vertex.pos, bounds.min);
 
-        appendOutput(outputBuffer, vertex);
+            memcpy(output + vertexIndex * sizeof(Vertex), &vertex, sizeof(Vertex));
+        }
     }
 
     // Set active animation by index
     void setAnimation(uint32_t animationIndex) {
-        assert(animationIndex < numAnimations);
-        pAnimation = pScene->mAnimations[animationIndex];
+        assert(animationIndex < clips.size());
+        currentClip = animationIndex;
     }
 
     // Load bone information from ASSIMP mesh
@@ -166,17 +164,14 @@ public:
         for (uint32_t i = 0; i < pMesh->mNumBones; i++) {
             uint32_t index = 0;
 
-            assert(pMesh->mNumBones <= MAX_BONES);
-
             std::string name(pMesh->mBones[i]->mName.data);
 
             if (boneMapping.find(name) == boneMapping.end()) {
                 // Bone not present, add new one
                 index = numBones;
                 numBones++;
-                BoneInfo bone;
-                boneInfo.push_back(bone);
-                boneInfo[index].offset = pMesh->mBones[i]->mOffsetMatrix;
+                boneNames.push_back(name);
+                skin.inverseBindMatrices.push_back(glm::transpose(glm::make_mat4(&pMesh->mBones[i]->mOffsetMatrix.a1)));
                 boneMapping[name] = index;
             } else {
                 index = boneMapping[name];
@@ -187,156 +182,17 @@ public:
                 Bones[vertexID].add(index, pMesh->mBones[i]->mWeights[j].mWeight);
             }
         }
-        boneTransforms.resize(numBones);
-    }
-
-    // Recursive bone transformation for given animation time
-    void update(float time) {
-        float TicksPerSecond = (float)(pScene->mAnimations[0]->mTicksPerSecond != 0 ? pScene->mAnimations[0]->mTicksPerSecond : 25.0f);
-        float TimeInTicks = time * TicksPerSecond;
-        float AnimationTime = fmod(TimeInTicks, (float)pScene->mAnimations[0]->mDuration);
-
-        aiMatrix4x4 identity = aiMatrix4x4();
-        readNodeHierarchy(AnimationTime, pScene->mRootNode, identity);
-
-        for (uint32_t i = 0; i < boneTransforms.size(); i++) {
-            boneTransforms[i] = boneInfo[i].finalTransformation;
-        }
-    }
-
-private:
-    // Find animation for a given node
-    const aiNodeAnim* findNodeAnim(const aiAnimation* animation, const std::string nodeName) {
-        for (uint32_t i = 0; i < animation->mNumChannels; i++) {
-            const aiNodeAnim* nodeAnim = animation->mChannels[i];
-            if (std::string(nodeAnim->mNodeName.data) == nodeName) {
-                return nodeAnim;
-            }
-        }
-        return nullptr;
     }
 
-    // Returns a 4x4 matrix with interpolated translation between current and next frame
-    aiMatrix4x4 interpolateTranslation(float time, const aiNodeAnim* pNodeAnim) {
-        aiVector3D translation;
-
-        if (pNodeAnim->mNumPositionKeys == 1) {
-            translation = pNodeAnim->mPositionKeys[0].mValue;
-        } else {
-            uint32_t frameIndex = 0;
-            for (uint32_t i = 0; i < pNodeAnim->mNumPositionKeys - 1; i++) {
-                if (time < (float)pNodeAnim->mPositionKeys[i + 1].mTime) {
-                    frameIndex = i;
-                    break;
-                }
-            }
-
-            aiVectorKey currentFrame = pNodeAnim->mPositionKeys[frameIndex];
-            aiVectorKey nextFrame = pNodeAnim->mPositionKeys[(frameIndex + 1) % pNodeAnim->mNumPositionKeys];
-
-            float delta = (time - (float)currentFrame.mTime) / (float)(nextFrame.mTime - currentFrame.mTime);
-
-            const aiVector3D& start = currentFrame.mValue;
-            const aiVector3D& end = nextFrame.mValue;
-
-            translation = (start + delta * (end - start));
-        }
-
-        aiMatrix4x4 mat;
-        aiMatrix4x4::Translation(translation, mat);
-        return mat;
-    }
-
-    // Returns a 4x4 matrix with interpolated rotation between current and next frame
-    aiMatrix4x4 interpolateRotation(float time, const aiNodeAnim* pNodeAnim) {
-        aiQuaternion rotation;
-
-        if (pNodeAnim->mNumRotationKeys == 1) {
-            rotation = pNodeAnim->mRotationKeys[0].mValue;
-        } else {
-            uint32_t frameIndex = 0;
-            for (uint32_t i = 0; i < pNodeAnim->mNumRotationKeys - 1; i++) {
-                if (time < (float)pNodeAnim->mRotationKeys[i + 1].mTime) {
-                    frameIndex = i;
-                    break;
-                }
-            }
-
-            aiQuatKey currentFrame = pNodeAnim->mRotationKeys[frameIndex];
-            aiQuatKey nextFrame = pNodeAnim->mRotationKeys[(frameIndex + 1) % pNodeAnim->mNumRotationKeys];
-
-            float delta = (time - (float)currentFrame.mTime) / (float)(nextFrame.mTime - currentFrame.mTime);
-
-            const aiQuaternion& start = currentFrame.mValue;
-            const aiQuaternion& end = nextFrame.mValue;
-
-            aiQuaternion::Interpolate(rotation, start, end, delta);
-            rotation.Normalize();
-        }
-
-        aiMatrix4x4 mat(rotation.GetMatrix());
-        return mat;
-    }
-
-    // Returns a 4x4 matrix with interpolated scaling between current and next frame
-    aiMatrix4x4 interpolateScale(float time, const aiNodeAnim* pNodeAnim) {
-        aiVector3D scale;
-
-        if (pNodeAnim->mNumScalingKeys == 1) {
-            scale = pNodeAnim->mScalingKeys[0].mValue;
-        } else {
-            uint32_t frameIndex = 0;
-            for (uint32_t i = 0; i < pNodeAnim->mNumScalingKeys - 1; i++) {
-                if (time < (float)pNodeAnim->mScalingKeys[i + 1].mTime) {
-                    frameIndex = i;
-                    break;
-                }
-            }
-
-            aiVectorKey currentFrame = pNodeAnim->mScalingKeys[frameIndex];
-            aiVectorKey nextFrame = pNodeAnim->mScalingKeys[(frameIndex + 1) % pNodeAnim->mNumScalingKeys];
-
-            float delta = (time - (float)currentFrame.mTime) / (float)(nextFrame.mTime - currentFrame.mTime);
-
-            const aiVector3D& start = currentFrame.mValue;
-            const aiVector3D& end = nextFrame.mValue;
-
-            scale = (start + delta * (end - start));
+    // Animate every instance with the current animation, the bone transformations land in the instances' palettes
+    void update(vks::TaskScheduler& scheduler, const std::vector<vks::model::AnimationInstance>& instances) const {
+        if (clips.empty()) {
+            return;
         }
-
-        aiMatrix4x4 mat;
-        aiMatrix4x4::Scaling(scale, mat);
-        return mat;
+        vks::model::evaluateBatch(scheduler, skeleton, skin, instances.data(), instances.size());
     }
 
-    // Get node hierarchy for current animation time
-    void readNodeHierarchy(float AnimationTime, const aiNode* pNode, const aiMatrix4x4& ParentTransform) {
-        std::string NodeName(pNode->mName.data);
-
-        aiMatrix4x4 NodeTransformation(pNode->mTransformation);
-
-        const aiNodeAnim* pNodeAnim = findNodeAnim(pAnimation, NodeName);
-
-        if (pNodeAnim) {
-            // Get interpolated matrices between current and next frame
-            aiMatrix4x4 matScale = interpolateScale(AnimationTime, pNodeAnim);
-            aiMatrix4x4 matRotation = interpolateRotation(AnimationTime, pNodeAnim);
-            aiMatrix4x4 matTranslation = interpolateTranslation(AnimationTime, pNodeAnim);
-
-            NodeTransformation = matTranslation * matRotation * matScale;
-        }
-
-        aiMatrix4x4 GlobalTransformation = ParentTransform * NodeTransformation;
-
-        if (boneMapping.find(NodeName) != boneMapping.end()) {
-            uint32_t BoneIndex = boneMapping[NodeName];
-            boneInfo[BoneIndex].finalTransformation = globalInverseTransform * GlobalTransformation * boneInfo[BoneIndex].offset;
-        }
-
-        for (uint32_t i = 0; i < pNode->mNumChildren; i++) {
-            readNodeHierarchy(AnimationTime, pNode->mChildren[i], GlobalTransformation);
-        }
-    }
+    const vks::model::AnimationClip* currentAnimation() const { return clips.empty() ? nullptr : &clips[currentClip]; }
 };
 
 class VulkanExample : public vkx::ExampleBase {
@@ -347,6 +203,17 @@ public:
     } textures;
 
     SkinnedMesh skinnedMesh;
+    // Skins every character once per frame, the draws read the skinned vertices
+    vks::model::ComputeSkinning skinning;
+
+    struct Character {
+        glm::mat4 transform;
+        // So the characters don't all move in lockstep
+        float timeOffset;
+        vks::model::AnimationState animationState;
+    };
+    std::vector<Character> characters;
+    std::vector<vks::model::AnimationInstance> animationInstances;
 
     struct {
         vks::Buffer vsScene;
@@ -356,7 +223,6 @@ public:
     struct UboVS {
         glm::mat4 projection;
         glm::mat4 model;
-        glm::mat4 bones[MAX_BONES];
         glm::vec4 lightPos = glm::vec4(0.0f, -250.0f, 250.0f, 1.0);
         glm::vec4 viewPos;
     } uboVS;
@@ -411,25 +277,31 @@ public:
         uniformData.vsScene.destroy();
 
         // Destroy and free mesh resources
+        skinning.destroy();
         skinnedMesh.destroy();
     }
 
+    void updateCommandBufferPreDraw(const vk::CommandBuffer& cmdBuffer) override { skinning.record(cmdBuffer, (uint32_t)characters.size()); }
+
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
         cmdBuffer.setViewport(0, vks::util::viewport(size));
         cmdBuffer.setScissor(0, vks::util::rect2D(size));
 
-        // Skinned mesh
+        // Skinned characters, already skinned by the compute pass.  Binding 0 is the character's skinned positions
+        // and normals, binding 1 the shared bind pose vertices for the remaining attributes
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.skinning);
-        cmdBuffer.bindVertexBuffers(0, skinnedMesh.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(skinnedMesh.indices.buffer, 0, vk::IndexType::eUint32);
-        cmdBuffer.drawIndexed(skinnedMesh.indexCount, 1, 0, 0, 0);
+        cmdBuffer.bindIndexBuffer(skinnedMesh.indices.buffer, 0, skinnedMesh.indexType);
+        for (uint32_t i = 0; i < (uint32_t)characters.size(); ++i) {
+            cmdBuffer.bindVertexBuffers(0, { skinning.output.buffer, skinnedMesh.vertices.buffer }, { skinning.outputOffset(i), 0 });
+            cmdBuffer.drawIndexed(skinnedMesh.indexCount, 1, 0, 0, 0);
+        }
 
         // Floor
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.floor, nullptr);
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.texture);
         cmdBuffer.bindVertexBuffers(0, meshes.floor.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.floor.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.floor.indices.buffer, 0, meshes.floor.indexType);
         cmdBuffer.drawIndexed(meshes.floor.indexCount, 1, 0, 0, 0);
     }
 
@@ -438,11 +310,51 @@ public:
         textures.floor.loadFromFile(context, getAssetPath() + "textures/pattern_35_bc3.ktx", vk::Format::eBc3UnormBlock);
         meshes.floor.loadFromFile(context, getAssetPath() + "models/plane_z.obj", vertexLayout, 512.0f);
         // Load a mesh based on data read via assimp
-        skinnedMesh.loadFromFile(context, getAssetPath() + "models/goblin.dae", vertexLayout, 1.0f,
+        // The compute pass reads the bind pose vertices as a storage buffer
+        vks::model::ModelCreateInfo modelCreateInfo{ 1.0f, 1.0f, 0.0f };
+        modelCreateInfo.vertexUsage = vk::BufferUsageFlagBits::eStorageBuffer;
+        skinnedMesh.loadFromFile(context, getAssetPath() + "models/goblin.dae", vertexLayout, modelCreateInfo,
                                  aiProcess_FlipWindingOrder | aiProcess_Triangulate | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals);
         skinnedMesh.setAnimation(0);
     }
 
+    void prepareSkinning() {
+        vks::model::ComputeSkinning::SourceLayout layout;
+        layout.stride = vertexLayout.stride();
+        layout.position = vertexLayout.offset(0);
+        layout.normal = vertexLayout.offset(1);
+        layout.weights = vertexLayout.offset(4);
+        layout.joints = vertexLayout.offset(5);
+        skinning.create(context, getAssetPath() + "shaders/base/skinning.comp.spv", skinnedMesh.vertices.buffer, skinnedMesh.vertexCount, layout,
+                        skinnedMesh.numBones, CHARACTER_GRID * CHARACTER_GRID);
+
+        // Spread the characters out on the floor, which is the model space xy plane
+        const float spacing = 1.5f * std::max(skinnedMesh.dim.size.x, skinnedMesh.dim.size.y);
+        characters.resize(CHARACTER_GRID * CHARACTER_GRID);
+        for (uint32_t i = 0; i < (uint32_t)characters.size(); ++i) {
+            const float x = ((float)(i % CHARACTER_GRID) - (CHARACTER_GRID - 1) * 0.5f) * spacing;
+            const float y = ((float)(i / CHARACTER_GRID) - (CHARACTER_GRID - 1) * 0.5f) * spacing;
+            characters[i].transform = glm::translate(glm::mat4(1.0f), glm::vec3(x, y, 0.0f));
+            characters[i].timeOffset = 0.37f * (float)i;
+        }
+    }
+
+    void updateCharacters() {
+        // The characters are evaluated in parallel, each straight into its slice of the palette buffer.  Placing the
+        // character is folded into its palette, so the skinned vertices are already in place
+        animationInstances.resize(characters.size());
+        for (uint32_t i = 0; i < (uint32_t)characters.size(); ++i) {
+            auto& character = characters[i];
+            auto& instance = animationInstances[i];
+            instance.clip = skinnedMesh.currentAnimation();
+            instance.time = runningTime + character.timeOffset;
+            instance.state = &character.animationState;
+            instance.transform = character.transform;
+            instance.palette = skinning.palette(i);
+        }
+        skinnedMesh.update(getScheduler(), animationInstances);
+    }
+
     void setupDescriptorPool() {
         // Example uses one ubo and one combined image sampler
         std::vector<vk::DescriptorPoolSize> poolSizes = {
@@ -496,12 +408,23 @@ public:
     void preparePipelines() {
         // Skinned rendering pipeline
         vks::pipelines::GraphicsPipelineBuilder pipelineCreator{ device, pipelineLayout, renderPass };
-        pipelineCreator.vertexInputState.appendVertexLayout(vertexLayout);
+        auto& vertexInputState = pipelineCreator.vertexInputState;
+        // Skinned position and normal
+        vertexInputState.bindingDescriptions.emplace_back(0, vks::model::ComputeSkinning::OUTPUT_STRIDE, vk::VertexInputRate::eVertex);
+        vertexInputState.attributeDescriptions.emplace_back(0, 0, vk::Format::eR32G32B32Sfloat, 0);
+        vertexInputState.attributeDescriptions.emplace_back(1, 0, vk::Format::eR32G32B32Sfloat, (uint32_t)(3 * sizeof(float)));
+        // UV and color from the bind pose vertices
+        vertexInputState.bindingDescriptions.emplace_back(1, vertexLayout.stride(), vk::VertexInputRate::eVertex);
+        vertexInputState.attributeDescriptions.emplace_back(2, 1, vk::Format::eR32G32Sfloat, vertexLayout.offset(2));
+        vertexInputState.attributeDescriptions.emplace_back(3, 1, vk::Format::eR32G32B32Sfloat, vertexLayout.offset(3));
         pipelineCreator.rasterizationState.frontFace = vk::FrontFace::eClockwise;
         pipelineCreator.loadShader(getAssetPath() + "shaders/skeletalanimation/mesh.vert.spv", vk::ShaderStageFlagBits::eVertex);
         pipelineCreator.loadShader(getAssetPath() + "shaders/skeletalanimation/mesh.frag.spv", vk::ShaderStageFlagBits::eFragment);
         pipelines.skinning = pipelineCreator.create(context.pipelineCache);
         pipelineCreator.destroyShaderModules();
+        vertexInputState.bindingDescriptions.clear();
+        vertexInputState.attributeDescriptions.clear();
+        vertexInputState.appendVertexLayout(vertexLayout);
         pipelineCreator.loadShader(getAssetPath() + "shaders/skeletalanimation/texture.vert.spv", vk::ShaderStageFlagBits::eVertex);
         pipelineCreator.loadShader(getAssetPath() + "shaders/skeletalanimation/texture.frag.spv", vk::ShaderStageFlagBits::eFragment);
         pipelines.texture = pipelineCreator.create(context.pipelineCache);
@@ -527,10 +450,7 @@ public:
         }
 
         // Update bones
-        skinnedMesh.update(runningTime);
-        for (uint32_t i = 0; i < skinnedMesh.boneTransforms.size(); i++) {
-            uboVS.bones[i] = glm::transpose(glm::make_mat4(&skinnedMesh.boneTransforms[i].a1));
-        }
+        updateCharacters();
 
         uniformData.vsScene.copy(uboVS);
 
@@ -541,6 +461,7 @@ public:
 
     void prepare() override {
         ExampleBase::prepare();
+        prepareSkinning();
         prepareUniformBuffers();
         setupDescriptorSetLayout();
         preparePipelines();
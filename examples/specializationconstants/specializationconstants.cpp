@@ -11,6 +11,8 @@
 #include <vulkanExampleBase.h>
 
 class VulkanExample : public vkx::ExampleBase {
+    using Parent = vkx::ExampleBase;
+
 public:
     // Vertex layout for the models
     const vks::model::VertexLayout vertexLayout{ {
@@ -41,11 +43,18 @@ public:
     vk::DescriptorSet descriptorSet;
     vk::DescriptorSetLayout descriptorSetLayout;
 
-    struct {
-        vk::Pipeline phong;
-        vk::Pipeline toon;
-        vk::Pipeline textured;
-    } pipelines;
+    // All pipelines use the same "uber" shader, with specialization constants selecting the branches and parameters
+    // of it.  Shader bindings based on specialization constants are marked by the "constant_id" layout qualifier:
+    //	layout (constant_id = 0) const int LIGHTING_MODEL = 0;
+    //	layout (constant_id = 1) const float PARAM_TOON_DESATURATION = 0.0f;
+    static const uint32_t LIGHTING_MODEL = 0;
+    static const uint32_t TOON_DESATURATION = 1;
+    static const int32_t LIGHTING_MODEL_COUNT = 3;
+    static const int32_t DESATURATION_STEPS = 10;
+
+    // Each new desaturation step is compiled in the background, drawing with the fallback until it's done
+    vks::pipelines::GraphicsPipelineVariants pipelines{ device };
+    int32_t desaturation{ DESATURATION_STEPS / 2 };
 
     VulkanExample() {
         title = "Specialization constants";
@@ -57,9 +66,7 @@ public:
     }
 
     ~VulkanExample() {
-        device.destroy(pipelines.phong);
-        device.destroy(pipelines.textured);
-        device.destroy(pipelines.toon);
+        pipelines.destroy();
 
         device.destroy(pipelineLayout);
         device.destroy(descriptorSetLayout);
@@ -82,25 +89,25 @@ public:
 
         drawCmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, { descriptorSet }, {});
         drawCmdBuffer.bindVertexBuffers(0, models.cube.vertices.buffer, { 0 });
-        drawCmdBuffer.bindIndexBuffer(models.cube.indices.buffer, 0, vk::IndexType::eUint32);
-
-        // Left
-        viewport.x = 0;
-        drawCmdBuffer.setViewport(0, viewport);
-        drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.phong);
-        drawCmdBuffer.drawIndexed(models.cube.indexCount, 1, 0, 0, 0);
-
-        // Center
-        viewport.x = (float)size.width / 3.0f;
-        drawCmdBuffer.setViewport(0, viewport);
-        drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.toon);
-        drawCmdBuffer.drawIndexed(models.cube.indexCount, 1, 0, 0, 0);
-
-        // Right
-        viewport.x += (float)size.width / 3.0f;
-        drawCmdBuffer.setViewport(0, viewport);
-        drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.textured);
-        drawCmdBuffer.drawIndexed(models.cube.indexCount, 1, 0, 0, 0);
+        drawCmdBuffer.bindIndexBuffer(models.cube.indices.buffer, 0, models.cube.indexType);
+
+        // Phong, toon and textured from left to right
+        for (int32_t lightingModel = 0; lightingModel < LIGHTING_MODEL_COUNT; ++lightingModel) {
+            viewport.x = (float)lightingModel * (float)size.width / 3.0f;
+            drawCmdBuffer.setViewport(0, viewport);
+            drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.get(constants(lightingModel, desaturation)));
+            drawCmdBuffer.drawIndexed(models.cube.indexCount, 1, 0, 0, 0);
+        }
+    }
+
+    // Only toon shading reads the desaturation, leaving it out of the others keeps them from being compiled again
+    static vks::pipelines::SpecializationConstants constants(int32_t lightingModel, int32_t desaturationStep) {
+        vks::pipelines::SpecializationConstants result;
+        result.set(LIGHTING_MODEL, lightingModel);
+        if (lightingModel == 1) {
+            result.set(TOON_DESATURATION, (float)desaturationStep / (float)DESATURATION_STEPS);
+        }
+        return result;
     }
 
     void loadAssets() override {
@@ -136,63 +143,23 @@ public:
     }
 
     void preparePipelines() {
-        vks::pipelines::GraphicsPipelineBuilder builder{ device, pipelineLayout, renderPass };
+        auto& builder = pipelines.builder;
+        builder.layout = pipelineLayout;
+        builder.renderPass = renderPass;
         builder.rasterizationState.frontFace = vk::FrontFace::eClockwise;
         builder.dynamicState.dynamicStateEnables.push_back(vk::DynamicState::eLineWidth);
         builder.vertexInputState.appendVertexLayout(vertexLayout);
-
-        // Prepare specialization data
-
-        // Host data to take specialization constants from
-        struct SpecializationData {
-            // Sets the lighting model used in the fragment "uber" shader
-            uint32_t lightingModel;
-            // Parameter for the toon shading part of the fragment shader
-            float toonDesaturationFactor = 0.5f;
-        } specializationData;
-
-        // Each shader constant of a shader stage corresponds to one map entry
-        std::array<vk::SpecializationMapEntry, 2> specializationMapEntries;
-        // Shader bindings based on specialization constants are marked by the new "constant_id" layout qualifier:
-        //	layout (constant_id = 0) const int LIGHTING_MODEL = 0;
-        //	layout (constant_id = 1) const float PARAM_TOON_DESATURATION = 0.0f;
-
-        // Map entry for the lighting model to be used by the fragment shader
-        specializationMapEntries[0].constantID = 0;
-        specializationMapEntries[0].size = sizeof(specializationData.lightingModel);
-        specializationMapEntries[0].offset = 0;
-
-        // Map entry for the toon shader parameter
-        specializationMapEntries[1].constantID = 1;
-        specializationMapEntries[1].size = sizeof(specializationData.toonDesaturationFactor);
-        specializationMapEntries[1].offset = offsetof(SpecializationData, toonDesaturationFactor);
-
-        // Prepare specialization info block for the shader stage
-        vk::SpecializationInfo specializationInfo{};
-        specializationInfo.dataSize = sizeof(specializationData);
-        specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationMapEntries.size());
-        specializationInfo.pMapEntries = specializationMapEntries.data();
-        specializationInfo.pData = &specializationData;
-
-        // Create pipelines
-        // All pipelines will use the same "uber" shader and specialization constants to change branching and parameters of that shader
         builder.loadShader(getAssetPath() + "shaders/specializationconstants/uber.vert.spv", vk::ShaderStageFlagBits::eVertex);
         builder.loadShader(getAssetPath() + "shaders/specializationconstants/uber.frag.spv", vk::ShaderStageFlagBits::eFragment);
 
-        // Specialization info is assigned is part of the shader stage (modul) and must be set after creating the module and before creating the pipeline
-        builder.shaderStages[1].pSpecializationInfo = &specializationInfo;
-
-        // Solid phong shading
-        specializationData.lightingModel = 0;
-        pipelines.phong = builder.create(context.pipelineCache);
-
-        // Phong and textured
-        specializationData.lightingModel = 1;
-        pipelines.toon = builder.create(context.pipelineCache);
-
-        // Textured discard
-        specializationData.lightingModel = 2;
-        pipelines.textured = builder.create(context.pipelineCache);
+        // Phong is built right away and stands in for the others, which derive from it, until they're compiled
+        std::vector<vks::pipelines::SpecializationConstants> variants;
+        for (int32_t lightingModel = 1; lightingModel < LIGHTING_MODEL_COUNT; ++lightingModel) {
+            variants.push_back(constants(lightingModel, desaturation));
+        }
+        // Hot reloaded pipelines may still be in use by the frames in flight
+        pipelines.retire = [this](const vk::Pipeline& pipeline) { context.trash(pipeline); };
+        pipelines.create(constants(0, desaturation), variants, context.pipelineCache);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
@@ -219,7 +186,30 @@ public:
         prepared = true;
     }
 
+    void update(float deltaTime) override {
+        Parent::update(deltaTime);
+        // Swap in the variants that finished compiling
+        if (pipelines.poll()) {
+            buildCommandBuffers();
+        }
+    }
+
+    // With --hot-reload, edits to the uber shader recompile every variant, update swaps them in as they're done
+    void shadersChanged(const std::vector<std::string>& files) override { pipelines.reload(files); }
+
     void viewChanged() override { updateUniformBuffers(); }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            if (ui.sliderInt("Toon desaturation", &desaturation, 0, DESATURATION_STEPS)) {
+                buildCommandBuffers();
+            }
+        }
+        if (ui.header("Pipeline variants")) {
+            ui.text("Compiled: %d", (int32_t)pipelines.readyCount());
+            ui.text("Compiling: %d", (int32_t)pipelines.pendingCount());
+        }
+    }
 };
 
 VULKAN_EXAMPLE_MAIN()
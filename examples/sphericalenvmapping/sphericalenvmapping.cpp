@@ -86,7 +86,7 @@ public:
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.sem);
         cmdBuffer.bindVertexBuffers(0, meshes.object.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.object.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.object.indices.buffer, 0, meshes.object.indexType);
         cmdBuffer.drawIndexed(meshes.object.indexCount, 1, 0, 0, 0);
     }
 
@@ -1,12 +1,17 @@
 /*
 * Vulkan Example - Screen space ambient occlusion example
 *
+* With VK_KHR_ray_query the occlusion can instead be traced against an acceleration structure of the scene, from the
+* same pass and with the same kernel.
+*
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
 #include <vulkanExampleBase.h>
+#include <vks/raytracing.hpp>
+#include <vks/rendergraph.hpp>
 
 #define SSAO_KERNEL_SIZE 32
 #define SSAO_RADIUS 0.5f
@@ -18,6 +23,26 @@
 #endif
 #define SSAO_NOISE_COUNT (SSAO_NOISE_DIM * SSAO_NOISE_DIM)
 
+// Must match the local sizes of the compute shaders
+#define SSAO_COMPUTE_GROUP_SIZE 8
+#define SSAO_COMPUTE_TILE_SIZE 16
+#define SSAO_BLUR_GROUP_SIZE 64
+#define SSAO_BLUR_MAX_RADIUS 8
+
+// Kernel samples and blur radius of the compute path
+struct SSAOPreset {
+    const char* name;
+    int32_t sampleCount;
+    int32_t blurRadius;
+};
+
+// Sample counts must divide SSAO_KERNEL_SIZE
+static const std::array<SSAOPreset, 3> ssaoPresets{ {
+    { "Performance", 8, 2 },
+    { "Balanced", 16, 4 },
+    { "Quality", 32, 6 },
+} };
+
 // Vertex layout for the models
 static const vks::model::VertexLayout vertexLayout{ {
     vks::model::VERTEX_COMPONENT_POSITION,
@@ -28,6 +53,12 @@ static const vks::model::VertexLayout vertexLayout{ {
 
 class VulkanExample : public vkx::ExampleBase {
 public:
+    // Run SSAO, its blur and an upsample in compute at half resolution instead of full resolution fragment passes
+    bool computeSSAO = false;
+    int32_t ssaoPreset = 1;
+    // Trace the kernel samples with ray queries in the fragment pass, only with context.rayQueryEnabled
+    bool rayQueryAO = false;
+
     struct {
         vks::texture::Texture2D ssaoNoise;
     } textures;
@@ -47,15 +78,57 @@ public:
         int32_t ssao = true;
         int32_t ssaoOnly = false;
         int32_t ssaoBlur = true;
+        // Pads invView to the alignment std140 gives it
+        int32_t _padding = 0;
+        // For the ray traced occlusion, the G-buffer is in view space
+        glm::mat4 invView;
     } uboSSAOParams;
 
+    // The scene is static, so its acceleration structures are built once
+    struct {
+        vks::raytracing::AccelerationStructure bottomLevel;
+        vks::raytracing::AccelerationStructure topLevel;
+        vk::Pipeline ssao;
+    } rayQuery;
+
+    // Bracket the occlusion passes in the offscreen command buffer, which the profiler doesn't track.  Null if the
+    // queue has no timestamps.
+    vk::QueryPool ssaoTimestamps;
+
     struct {
         vk::Pipeline offscreen;
         vk::Pipeline composition;
         vk::Pipeline ssao;
+        // ssao.frag's _fp16 variant, with shaderFloat16
+        vk::Pipeline ssaoHalf;
         vk::Pipeline ssaoBlur;
     } pipelines;
 
+    // The compute path.  The G-buffer is downsampled to half resolution, SSAO is computed and blurred there, and
+    // the result upsampled to full resolution with weights that respect depth edges.
+    struct ComputeStage {
+        vk::DescriptorSetLayout descriptorSetLayout;
+        vk::PipelineLayout pipelineLayout;
+        vk::Pipeline pipeline;
+    };
+
+    struct {
+        ComputeStage downsample, ssao, blur, upsample;
+        vk::DescriptorSet downsampleSet;
+        vk::DescriptorSet ssaoSet;
+        // Rows of the raw SSAO into blurTemp, then columns of blurTemp into blurred
+        vk::DescriptorSet blurSets[2];
+        vk::DescriptorSet upsampleSet;
+        // The composition set with the upsampled result in place of the fragment pass targets
+        vk::DescriptorSet compositionSet;
+        // The passes and their targets, which the graph places the barriers between and lets share memory where their
+        // passes don't overlap.  The G-buffer is imported, the upsampled result is the graph's output.
+        vks::rendergraph::RenderGraph graph;
+        vks::rendergraph::Resource positionDepth, normal;
+        vks::rendergraph::Resource halfPositionDepth, halfNormal, ssao, blurTemp, blurred, upsampled;
+        vk::Extent2D halfSize;
+    } compute;
+
     struct {
         vk::PipelineLayout gBuffer;
         vk::PipelineLayout ssao;
@@ -64,7 +137,7 @@ public:
     } pipelineLayouts;
 
     struct {
-        const uint32_t count = 5;
+        const uint32_t count = 11;
         vk::DescriptorSet model;
         vk::DescriptorSet floor;
         vk::DescriptorSet ssao;
@@ -139,6 +212,8 @@ public:
         camera.position = { 7.5f, -6.75f, 0.0f };
         camera.setRotation(glm::vec3(5.0f, 90.0f, 0.0f));
         camera.setPerspective(60.0f, (float)size.width / (float)size.height, 0.1f, 64.0f);
+        // Optional, ray traced occlusion is only offered if the device supports it
+        context.enableRayQuery = true;
     }
 
     ~VulkanExample() {
@@ -152,7 +227,12 @@ public:
         device.destroy(pipelines.offscreen);
         device.destroy(pipelines.composition);
         device.destroy(pipelines.ssao);
+        device.destroy(pipelines.ssaoHalf);
         device.destroy(pipelines.ssaoBlur);
+        device.destroy(rayQuery.ssao);
+        rayQuery.bottomLevel.destroy();
+        rayQuery.topLevel.destroy();
+        device.destroy(ssaoTimestamps);
 
         device.destroy(pipelineLayouts.gBuffer);
         device.destroy(pipelineLayouts.ssao);
@@ -177,6 +257,13 @@ public:
         device.destroy(offscreenSemaphore);
 
         textures.ssaoNoise.destroy();
+
+        for (auto stage : { &compute.downsample, &compute.ssao, &compute.blur, &compute.upsample }) {
+            device.destroy(stage->pipeline);
+            device.destroy(stage->pipelineLayout);
+            device.destroy(stage->descriptorSetLayout);
+        }
+        compute.graph.destroy();
     }
 
     // Create a frame buffer attachment
@@ -332,6 +419,8 @@ public:
             fb.frameBuffer = device.createFramebuffer({ {}, fb.renderPass, 1, &fb.color.view, fb.size.width, fb.size.height, 1 });
         }
 
+        prepareComputeGraph();
+
         vk::SamplerCreateInfo sampler;
         sampler.mipmapMode = vk::SamplerMipmapMode::eLinear;
         sampler.addressModeU = sampler.addressModeV = sampler.addressModeW = vk::SamplerAddressMode::eClampToEdge;
@@ -350,7 +439,9 @@ public:
         }
 
         // Create a semaphore used to synchronize offscreen rendering and usage
-        offscreenSemaphore = device.createSemaphore({});
+        if (!offscreenSemaphore) {
+            offscreenSemaphore = device.createSemaphore({});
+        }
 
         offScreenCmdBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
 
@@ -374,10 +465,24 @@ public:
         offScreenCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.offscreen);
         offScreenCmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.gBuffer, 0, descriptorSets.floor, {});
         offScreenCmdBuffer.bindVertexBuffers(0, models.scene.vertices.buffer, { 0 });
-        offScreenCmdBuffer.bindIndexBuffer(models.scene.indices.buffer, 0, vk::IndexType::eUint32);
+        offScreenCmdBuffer.bindIndexBuffer(models.scene.indices.buffer, 0, models.scene.indexType);
         offScreenCmdBuffer.drawIndexed(models.scene.indexCount, 1, 0, 0, 0);
         offScreenCmdBuffer.endRenderPass();
 
+        if (ssaoTimestamps) {
+            offScreenCmdBuffer.resetQueryPool(ssaoTimestamps, 0, 2);
+            offScreenCmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, ssaoTimestamps, 0);
+        }
+
+        if (computeSSAO) {
+            compute.graph.record(offScreenCmdBuffer);
+            if (ssaoTimestamps) {
+                offScreenCmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, ssaoTimestamps, 1);
+            }
+            offScreenCmdBuffer.end();
+            return;
+        }
+
         // Second pass: SSAO generation
         // -------------------------------------------------------------------------------------------------------
         clearValues[1].depthStencil = defaultClearDepth;
@@ -394,8 +499,15 @@ public:
         offScreenCmdBuffer.setViewport(0, viewport);
         offScreenCmdBuffer.setScissor(0, scissor);
         offScreenCmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.ssao, 0, descriptorSets.ssao, {});
-        offScreenCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.ssao);
-        offScreenCmdBuffer.draw(3, 1, 0, 0);
+        if (rayQueryAO) {
+            offScreenCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, rayQuery.ssao);
+            offScreenCmdBuffer.draw(3, 1, 0, 0);
+        } else {
+            recordWithPrecision(offScreenCmdBuffer, frameBuffers.ssao.size, [&](bool half) {
+                offScreenCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, half ? pipelines.ssaoHalf : pipelines.ssao);
+                offScreenCmdBuffer.draw(3, 1, 0, 0);
+            });
+        }
         offScreenCmdBuffer.endRenderPass();
 
         // Third pass: SSAO blur
@@ -415,14 +527,114 @@ public:
         offScreenCmdBuffer.draw(3, 1, 0, 0);
         offScreenCmdBuffer.endRenderPass();
 
+        if (ssaoTimestamps) {
+            offScreenCmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, ssaoTimestamps, 1);
+        }
         offScreenCmdBuffer.end();
     }
 
+    static uint32_t groupCount(uint32_t count, uint32_t groupSize) { return (count + groupSize - 1) / groupSize; }
+
+    // The formats are among those every device supports for storage images
+    void prepareComputeGraph() {
+        using namespace vks::rendergraph;
+        auto& graph = compute.graph;
+        compute.halfSize = vk::Extent2D{ (size.width + 1) / 2, (size.height + 1) / 2 };
+
+        // The G-buffer render pass leaves them in ShaderReadOnlyOptimal, for the compute passes here and the
+        // composition, and writes them again the next frame
+        const vk::PipelineStageFlags gBufferStages = vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eFragmentShader;
+        const vk::ImageLayout gBufferLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+        compute.positionDepth =
+            graph.importImage("Position and depth", frameBuffers.offscreen.position, gBufferLayout, gBufferStages, vk::AccessFlagBits::eColorAttachmentWrite);
+        compute.normal = graph.importImage("Normal", frameBuffers.offscreen.normal, gBufferLayout, gBufferStages, vk::AccessFlagBits::eColorAttachmentWrite);
+
+        AttachmentDescription target;
+        target.extent = compute.halfSize;
+        target.format = vk::Format::eR16G16B16A16Sfloat;
+        compute.halfPositionDepth = graph.addAttachment("Half resolution position and depth", target);
+        target.format = vk::Format::eR8G8B8A8Unorm;
+        compute.halfNormal = graph.addAttachment("Half resolution normal", target);
+        target.format = vk::Format::eR32Sfloat;
+        compute.ssao = graph.addAttachment("SSAO", target);
+        compute.blurTemp = graph.addAttachment("SSAO blurred rows", target);
+        compute.blurred = graph.addAttachment("SSAO blurred", target);
+        target.extent = size;
+        compute.upsampled = graph.addAttachment("SSAO upsampled", target);
+        graph.addOutput(compute.upsampled);
+
+        PassDescription downsample;
+        downsample.name = "Downsample";
+        downsample.compute = true;
+        downsample.sampledAttachments = { compute.positionDepth, compute.normal };
+        downsample.storageWrites = { compute.halfPositionDepth, compute.halfNormal };
+        downsample.record = [this](const vk::CommandBuffer& cmdBuffer) {
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, compute.downsample.pipeline);
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, compute.downsample.pipelineLayout, 0, compute.downsampleSet, nullptr);
+            cmdBuffer.dispatch(groupCount(compute.halfSize.width, SSAO_COMPUTE_GROUP_SIZE), groupCount(compute.halfSize.height, SSAO_COMPUTE_GROUP_SIZE), 1);
+        };
+        graph.addPass(downsample);
+
+        PassDescription ssao;
+        ssao.name = "SSAO";
+        ssao.compute = true;
+        ssao.sampledAttachments = { compute.halfPositionDepth, compute.halfNormal };
+        ssao.storageWrites = { compute.ssao };
+        ssao.record = [this](const vk::CommandBuffer& cmdBuffer) {
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, compute.ssao.pipeline);
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, compute.ssao.pipelineLayout, 0, compute.ssaoSet, nullptr);
+            cmdBuffer.pushConstants<int32_t>(compute.ssao.pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, ssaoPresets[ssaoPreset].sampleCount);
+            cmdBuffer.dispatch(groupCount(compute.halfSize.width, SSAO_COMPUTE_TILE_SIZE), groupCount(compute.halfSize.height, SSAO_COMPUTE_TILE_SIZE), 1);
+        };
+        graph.addPass(ssao);
+
+        // Rows, then columns
+        const Resource blurInputs[2] = { compute.ssao, compute.blurTemp };
+        const Resource blurOutputs[2] = { compute.blurTemp, compute.blurred };
+        for (uint32_t pass = 0; pass < 2; ++pass) {
+            PassDescription blur;
+            blur.name = pass == 0 ? "Blur rows" : "Blur columns";
+            blur.compute = true;
+            blur.sampledAttachments = { blurInputs[pass], compute.halfPositionDepth };
+            blur.storageWrites = { blurOutputs[pass] };
+            blur.record = [this, pass](const vk::CommandBuffer& cmdBuffer) {
+                const auto& preset = ssaoPresets[ssaoPreset];
+                assert(preset.blurRadius <= SSAO_BLUR_MAX_RADIUS);
+                const glm::ivec3 blurConstants{ pass == 0 ? 1 : 0, pass == 0 ? 0 : 1, preset.blurRadius };
+                const uint32_t lineLength = pass == 0 ? compute.halfSize.width : compute.halfSize.height;
+                const uint32_t lineCount = pass == 0 ? compute.halfSize.height : compute.halfSize.width;
+                cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, compute.blur.pipeline);
+                cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, compute.blur.pipelineLayout, 0, compute.blurSets[pass], nullptr);
+                cmdBuffer.pushConstants<glm::ivec3>(compute.blur.pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, blurConstants);
+                cmdBuffer.dispatch(groupCount(lineLength, SSAO_BLUR_GROUP_SIZE), lineCount, 1);
+            };
+            graph.addPass(blur);
+        }
+
+        PassDescription upsample;
+        upsample.name = "Upsample";
+        upsample.compute = true;
+        upsample.sampledAttachments = { compute.ssao, compute.blurred, compute.halfPositionDepth, compute.positionDepth };
+        upsample.storageWrites = { compute.upsampled };
+        upsample.record = [this](const vk::CommandBuffer& cmdBuffer) {
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, compute.upsample.pipeline);
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, compute.upsample.pipelineLayout, 0, compute.upsampleSet, nullptr);
+            cmdBuffer.dispatch(groupCount(size.width, SSAO_COMPUTE_GROUP_SIZE), groupCount(size.height, SSAO_COMPUTE_GROUP_SIZE), 1);
+        };
+        graph.addPass(upsample);
+
+        graph.compile(context);
+    }
+
     void loadAssets() override {
         vks::model::ModelCreateInfo modelCreateInfo;
         modelCreateInfo.scale = glm::vec3(0.5f);
         modelCreateInfo.uvscale = glm::vec2(1.0f);
         modelCreateInfo.center = glm::vec3(0.0f, 0.0f, 0.0f);
+        if (context.rayQueryEnabled) {
+            modelCreateInfo.vertexUsage = vks::raytracing::BUILD_INPUT_USAGE;
+            modelCreateInfo.indexUsage = vks::raytracing::BUILD_INPUT_USAGE;
+        }
         models.scene.loadFromFile(context, getAssetPath() + "models/sibenik/sibenik.dae", vertexLayout, modelCreateInfo);
     }
 
@@ -438,16 +650,21 @@ public:
         scissor.extent = size;
         drawCommandBuffer.setScissor(0, scissor);
         // Final composition pass
-        drawCommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.composition, 0, descriptorSets.composition, {});
+        drawCommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.composition, 0,
+                                             computeSSAO ? compute.compositionSet : descriptorSets.composition, {});
         drawCommandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.composition);
         drawCommandBuffer.draw(3, 1, 0, 0);
     }
 
     void setupDescriptorPool() {
         std::vector<vk::DescriptorPoolSize> poolSizes{
-            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 10 },
-            vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 12 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 14 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 31 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eStorageImage, 6 },
         };
+        if (context.rayQueryEnabled) {
+            poolSizes.push_back({ vk::DescriptorType::eAccelerationStructureKHR, 1 });
+        }
         descriptorPool =
             device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, descriptorSets.count, static_cast<uint32_t>(poolSizes.size()), poolSizes.data() });
     }
@@ -478,6 +695,9 @@ public:
             { 3, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment },         // FS SSAO Kernel UBO
             { 4, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment },         // FS Params UBO
         };
+        if (context.rayQueryEnabled) {
+            setLayoutBindings.push_back({ 5, vk::DescriptorType::eAccelerationStructureKHR, 1, vk::ShaderStageFlagBits::eFragment });  // FS Scene
+        }
 
         descriptorSetLayouts.ssao = device.createDescriptorSetLayout({ {}, static_cast<uint32_t>(setLayoutBindings.size()), setLayoutBindings.data() });
         pipelineLayouts.ssao = device.createPipelineLayout({ {}, 1, &descriptorSetLayouts.ssao });
@@ -494,6 +714,12 @@ public:
             { descriptorSets.ssao, 3, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.ssaoKernel.descriptor },  // FS SSAO Kernel UBO
             { descriptorSets.ssao, 4, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.ssaoParams.descriptor },  // FS SSAO Params UBO
         };
+        vk::WriteDescriptorSetAccelerationStructureKHR topLevelDescriptor{ 1, &rayQuery.topLevel.handle };
+        if (context.rayQueryEnabled) {
+            vk::WriteDescriptorSet topLevelWrite{ descriptorSets.ssao, 5, 0, 1, vk::DescriptorType::eAccelerationStructureKHR };
+            topLevelWrite.pNext = &topLevelDescriptor;
+            writeDescriptorSets.push_back(topLevelWrite);  // FS Scene
+        }
         device.updateDescriptorSets(writeDescriptorSets, {});
 
         // SSAO Blur
@@ -543,6 +769,126 @@ public:
             { descriptorSets.composition, 5, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.ssaoParams.descriptor },  // FS SSAO Params UBO
         };
         device.updateDescriptorSets(writeDescriptorSets, {});
+
+        // Composition of the compute path, the upsampled result is already blurred or not as the params ask for
+        compute.compositionSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.composition })[0];
+        imageDescriptors[3] = imageDescriptors[4] = { colorSampler, compute.graph.image(compute.upsampled).view, vk::ImageLayout::eShaderReadOnlyOptimal };
+        for (auto& write : writeDescriptorSets) {
+            write.dstSet = compute.compositionSet;
+        }
+        device.updateDescriptorSets(writeDescriptorSets, {});
+
+        setupComputeLayoutsAndDescriptors();
+    }
+
+    void createComputeStage(ComputeStage& stage, const std::vector<vk::DescriptorSetLayoutBinding>& bindings, uint32_t pushConstantSize) {
+        stage.descriptorSetLayout = device.createDescriptorSetLayout({ {}, static_cast<uint32_t>(bindings.size()), bindings.data() });
+        vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, pushConstantSize };
+        stage.pipelineLayout = device.createPipelineLayout({ {}, 1, &stage.descriptorSetLayout, pushConstantSize ? 1u : 0u, &pushConstantRange });
+    }
+
+    void setupComputeLayoutsAndDescriptors() {
+        const auto sampled = vk::DescriptorType::eCombinedImageSampler;
+        const auto storage = vk::DescriptorType::eStorageImage;
+        const auto uniform = vk::DescriptorType::eUniformBuffer;
+        const auto stage = vk::ShaderStageFlagBits::eCompute;
+        // The graph has the targets in the general layout for the passes writing them, and in the read only layout for
+        // the ones sampling them
+        const auto read = [&](vks::rendergraph::Resource resource) {
+            return vk::DescriptorImageInfo{ colorSampler, compute.graph.image(resource).view, vk::ImageLayout::eShaderReadOnlyOptimal };
+        };
+        const auto write = [&](vks::rendergraph::Resource resource) {
+            return vk::DescriptorImageInfo{ colorSampler, compute.graph.image(resource).view, vk::ImageLayout::eGeneral };
+        };
+        const vk::DescriptorImageInfo positionDepth = read(compute.positionDepth);
+        const vk::DescriptorImageInfo normal = read(compute.normal);
+        const vk::DescriptorImageInfo halfPositionDepth = read(compute.halfPositionDepth);
+        const vk::DescriptorImageInfo halfNormal = read(compute.halfNormal);
+        const vk::DescriptorImageInfo ssao = read(compute.ssao);
+        const vk::DescriptorImageInfo blurTemp = read(compute.blurTemp);
+        const vk::DescriptorImageInfo blurred = read(compute.blurred);
+        const vk::DescriptorImageInfo halfPositionDepthTarget = write(compute.halfPositionDepth);
+        const vk::DescriptorImageInfo halfNormalTarget = write(compute.halfNormal);
+        const vk::DescriptorImageInfo ssaoTarget = write(compute.ssao);
+        const vk::DescriptorImageInfo blurTempTarget = write(compute.blurTemp);
+        const vk::DescriptorImageInfo blurredTarget = write(compute.blurred);
+        const vk::DescriptorImageInfo upsampledTarget = write(compute.upsampled);
+        std::vector<vk::WriteDescriptorSet> writeDescriptorSets;
+
+        // Downsample
+        createComputeStage(compute.downsample, { { 0, sampled, 1, stage }, { 1, sampled, 1, stage }, { 2, storage, 1, stage }, { 3, storage, 1, stage } }, 0);
+        compute.downsampleSet = device.allocateDescriptorSets({ descriptorPool, 1, &compute.downsample.descriptorSetLayout })[0];
+        writeDescriptorSets = {
+            { compute.downsampleSet, 0, 0, 1, sampled, &positionDepth },
+            { compute.downsampleSet, 1, 0, 1, sampled, &normal },
+            { compute.downsampleSet, 2, 0, 1, storage, &halfPositionDepthTarget },
+            { compute.downsampleSet, 3, 0, 1, storage, &halfNormalTarget },
+        };
+        device.updateDescriptorSets(writeDescriptorSets, {});
+
+        // SSAO
+        createComputeStage(compute.ssao,
+                           { { 0, sampled, 1, stage },
+                             { 1, sampled, 1, stage },
+                             { 2, sampled, 1, stage },
+                             { 3, uniform, 1, stage },
+                             { 4, uniform, 1, stage },
+                             { 5, storage, 1, stage } },
+                           sizeof(int32_t));
+        compute.ssaoSet = device.allocateDescriptorSets({ descriptorPool, 1, &compute.ssao.descriptorSetLayout })[0];
+        writeDescriptorSets = {
+            { compute.ssaoSet, 0, 0, 1, sampled, &halfPositionDepth },
+            { compute.ssaoSet, 1, 0, 1, sampled, &halfNormal },
+            { compute.ssaoSet, 2, 0, 1, sampled, &textures.ssaoNoise.descriptor },
+            { compute.ssaoSet, 3, 0, 1, uniform, nullptr, &uniformBuffers.ssaoKernel.descriptor },
+            { compute.ssaoSet, 4, 0, 1, uniform, nullptr, &uniformBuffers.ssaoParams.descriptor },
+            { compute.ssaoSet, 5, 0, 1, storage, &ssaoTarget },
+        };
+        device.updateDescriptorSets(writeDescriptorSets, {});
+
+        // Blur
+        createComputeStage(compute.blur, { { 0, sampled, 1, stage }, { 1, sampled, 1, stage }, { 2, storage, 1, stage } }, sizeof(glm::ivec3));
+        const vk::DescriptorImageInfo* blurInputs[2] = { &ssao, &blurTemp };
+        const vk::DescriptorImageInfo* blurOutputs[2] = { &blurTempTarget, &blurredTarget };
+        for (uint32_t pass = 0; pass < 2; ++pass) {
+            compute.blurSets[pass] = device.allocateDescriptorSets({ descriptorPool, 1, &compute.blur.descriptorSetLayout })[0];
+            writeDescriptorSets = {
+                { compute.blurSets[pass], 0, 0, 1, sampled, blurInputs[pass] },
+                { compute.blurSets[pass], 1, 0, 1, sampled, &halfPositionDepth },
+                { compute.blurSets[pass], 2, 0, 1, storage, blurOutputs[pass] },
+            };
+            device.updateDescriptorSets(writeDescriptorSets, {});
+        }
+
+        // Upsample
+        createComputeStage(compute.upsample,
+                           { { 0, sampled, 1, stage },
+                             { 1, sampled, 1, stage },
+                             { 2, sampled, 1, stage },
+                             { 3, sampled, 1, stage },
+                             { 4, uniform, 1, stage },
+                             { 5, storage, 1, stage } },
+                           0);
+        compute.upsampleSet = device.allocateDescriptorSets({ descriptorPool, 1, &compute.upsample.descriptorSetLayout })[0];
+        writeDescriptorSets = {
+            { compute.upsampleSet, 0, 0, 1, sampled, &ssao },
+            { compute.upsampleSet, 1, 0, 1, sampled, &blurred },
+            { compute.upsampleSet, 2, 0, 1, sampled, &halfPositionDepth },
+            { compute.upsampleSet, 3, 0, 1, sampled, &positionDepth },
+            { compute.upsampleSet, 4, 0, 1, uniform, nullptr, &uniformBuffers.ssaoParams.descriptor },
+            { compute.upsampleSet, 5, 0, 1, storage, &upsampledTarget },
+        };
+        device.updateDescriptorSets(writeDescriptorSets, {});
+    }
+
+    vk::Pipeline createComputePipeline(const ComputeStage& stage, const std::string& shader, const vk::SpecializationInfo* specializationInfo = nullptr) {
+        vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+        computePipelineCreateInfo.layout = stage.pipelineLayout;
+        computePipelineCreateInfo.stage = vks::shaders::loadShader(device, getAssetPath() + "shaders/ssao/" + shader, vk::ShaderStageFlagBits::eCompute);
+        computePipelineCreateInfo.stage.pSpecializationInfo = specializationInfo;
+        vk::Pipeline pipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+        return pipeline;
     }
 
     void preparePipelines() {
@@ -560,7 +906,7 @@ public:
             builder.renderPass = frameBuffers.ssao.renderPass;
             builder.layout = pipelineLayouts.ssao;
             // Destroy the fragment shader, but not the vertex shader
-            device.destroy(builder.shaderStages[1].module);
+            vks::shaders::releaseShaderModule(device, builder.shaderStages[1].module);
             builder.shaderStages.resize(1);
             builder.loadShader(getAssetPath() + "shaders/ssao/ssao.frag.spv", vk::ShaderStageFlagBits::eFragment);
 
@@ -578,6 +924,30 @@ public:
             vk::SpecializationInfo specializationInfo{ 2, specializationMapEntries.data(), sizeof(SpecializationData), &specializationData };
             builder.shaderStages[1].pSpecializationInfo = &specializationInfo;
             pipelines.ssao = builder.create(context.pipelineCache);
+
+            // The kernel in 16 bit arithmetic
+            if (context.shaderFloat16Enabled) {
+                vks::shaders::releaseShaderModule(device, builder.shaderStages[1].module);
+                builder.shaderStages.resize(1);
+                builder.loadShader(getAssetPath() + "shaders/ssao/ssao_fp16.frag.spv", vk::ShaderStageFlagBits::eFragment);
+                builder.shaderStages[1].pSpecializationInfo = &specializationInfo;
+                pipelines.ssaoHalf = builder.create(context.pipelineCache);
+            }
+
+            // Ray traced, with the same kernel
+            if (context.rayQueryEnabled) {
+                vks::shaders::releaseShaderModule(device, builder.shaderStages[1].module);
+                builder.shaderStages.resize(1);
+                builder.loadShader(getAssetPath() + "shaders/ssao/ssao_rayquery.frag.spv", vk::ShaderStageFlagBits::eFragment);
+                builder.shaderStages[1].pSpecializationInfo = &specializationInfo;
+                rayQuery.ssao = builder.create(context.pipelineCache);
+            }
+
+            // Compute path, with the same kernel
+            compute.downsample.pipeline = createComputePipeline(compute.downsample, "downsample.comp.spv");
+            compute.ssao.pipeline = createComputePipeline(compute.ssao, "ssao.comp.spv", &specializationInfo);
+            compute.blur.pipeline = createComputePipeline(compute.blur, "blur.comp.spv");
+            compute.upsample.pipeline = createComputePipeline(compute.upsample, "upsample.comp.spv");
         }
 
         // SSAO blur pass
@@ -585,7 +955,7 @@ public:
             builder.renderPass = frameBuffers.ssaoBlur.renderPass;
             builder.layout = pipelineLayouts.ssaoBlur;
             // Destroy the fragment shader, but not the vertex shader
-            device.destroy(builder.shaderStages[1].module);
+            vks::shaders::releaseShaderModule(device, builder.shaderStages[1].module);
             builder.shaderStages.resize(1);
             builder.loadShader(getAssetPath() + "shaders/ssao/blur.frag.spv", vk::ShaderStageFlagBits::eFragment);
             pipelines.ssaoBlur = builder.create(context.pipelineCache);
@@ -658,11 +1028,28 @@ public:
 
     void updateUniformBufferSSAOParams() {
         uboSSAOParams.projection = camera.matrices.perspective;
+        uboSSAOParams.invView = glm::inverse(camera.matrices.view);
         uniformBuffers.ssaoParams.copyTo(&uboSSAOParams, sizeof(uboSSAOParams));
     }
 
+    // The scene model is already in world space
+    void prepareAccelerationStructures() {
+        rayQuery.bottomLevel = vks::raytracing::buildBottomLevel(context, { vks::raytracing::modelInput(context, models.scene) })[0];
+        rayQuery.topLevel = vks::raytracing::buildTopLevel(context, { vks::raytracing::instance(rayQuery.bottomLevel, glm::mat4(1.0f)) });
+    }
+
     void draw() override {
         prepareFrame();
+        // The previous submission of the offscreen command buffer is usually done by now, its timestamps are
+        // unavailable if it isn't
+        if (ssaoTimestamps) {
+            std::array<uint64_t, 2> ticks;
+            const vk::Result result =
+                device.getQueryPoolResults(ssaoTimestamps, 0, 2, sizeof(ticks), ticks.data(), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+            if (result == vk::Result::eSuccess) {
+                profiler.report("Ambient occlusion", (double)(ticks[1] - ticks[0]) * context.deviceProperties.limits.timestampPeriod / 1.0e6);
+            }
+        }
         context.submit(offScreenCmdBuffer, { { semaphores.acquireComplete, vk::PipelineStageFlagBits::eBottomOfPipe } }, offscreenSemaphore);
         renderWaitSemaphores = { offscreenSemaphore };
         drawCurrentCommandBuffer();
@@ -672,6 +1059,14 @@ public:
     void prepare() override {
         ExampleBase::prepare();
         loadAssets();
+        if (context.rayQueryEnabled) {
+            prepareAccelerationStructures();
+        }
+        if (context.queueFamilyProperties[context.queueIndices.graphics].timestampValidBits) {
+            ssaoTimestamps = device.createQueryPool({ {}, vk::QueryType::eTimestamp, 2 });
+            // Reset once up front, so that reading them before the first submission finds them unavailable
+            context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& cmdBuffer) { cmdBuffer.resetQueryPool(ssaoTimestamps, 0, 2); });
+        }
         prepareOffscreenFramebuffers();
         prepareUniformBuffers();
         setupDescriptorPool();
@@ -687,6 +1082,15 @@ public:
         updateUniformBufferSSAOParams();
     }
 
+    bool supportsHalfPrecision() const override { return true; }
+
+    void shaderPrecisionChanged() override {
+        // The offscreen command buffer may still be executing
+        device.waitIdle();
+        buildCommandBuffers();
+        buildDeferredCommandBuffer();
+    }
+
     void OnUpdateUIOverlay() override {
         if (ui.header("Settings")) {
             if (ui.checkBox("Enable SSAO", &uboSSAOParams.ssao)) {
@@ -698,6 +1102,29 @@ public:
             if (ui.checkBox("SSAO pass only", &uboSSAOParams.ssaoOnly)) {
                 updateUniformBufferSSAOParams();
             }
+            bool rebuild = ui.checkBox("Compute (half resolution)", &computeSSAO);
+            if (computeSSAO) {
+                rayQueryAO = false;
+                std::vector<std::string> presetNames;
+                for (const auto& preset : ssaoPresets) {
+                    presetNames.push_back(preset.name);
+                }
+                rebuild |= ui.comboBox("Preset", &ssaoPreset, presetNames);
+                ui.text("Targets: %.1f MB, %.1f MB unaliased", compute.graph.memorySize() / (1024.0f * 1024.0f),
+                        compute.graph.unaliasedMemorySize() / (1024.0f * 1024.0f));
+                ui.text("Barriers: %u", (uint32_t)compute.graph.barrierCount());
+            }
+            // Full resolution fragment pass only
+            if (context.rayQueryEnabled && ui.checkBox("Ray traced", &rayQueryAO)) {
+                computeSSAO = computeSSAO && !rayQueryAO;
+                rebuild = true;
+            }
+            if (rebuild) {
+                // The offscreen command buffer may still be executing
+                device.waitIdle();
+                buildCommandBuffers();
+                buildDeferredCommandBuffer();
+            }
         }
     }
 };
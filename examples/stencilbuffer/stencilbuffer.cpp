@@ -66,7 +66,7 @@ public:
         drawCmdBuffer.setScissor(0, scissor);
 
         drawCmdBuffer.bindVertexBuffers(0, model.vertices.buffer, { 0 });
-        drawCmdBuffer.bindIndexBuffer(model.indices.buffer, 0, vk::IndexType::eUint32);
+        drawCmdBuffer.bindIndexBuffer(model.indices.buffer, 0, model.indexType);
 
         drawCmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
 
@@ -396,7 +396,7 @@ public:
             drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.offscreen);
             drawCmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.offscreen, 0, descriptorSets.scene, nullptr);
             drawCmdBuffer.bindVertexBuffers(0, models.scene.vertices.buffer, { 0 });
-            drawCmdBuffer.bindIndexBuffer(models.scene.indices.buffer, 0, vk::IndexType::eUint32);
+            drawCmdBuffer.bindIndexBuffer(models.scene.indices.buffer, 0, models.scene.indexType);
             drawCmdBuffer.drawIndexed(models.scene.indexCount, 1, 0, 0, 0);
             vks::debug::marker::endRegion(drawCmdBuffer);
         }
@@ -404,8 +404,9 @@ public:
         // Second sub pass
         // This subpass will use the G-Buffer components that have been filled in the first subpass as input attachment for the final compositing
         {
-            vks::debug::marker::beginRegion(drawCmdBuffer, "Subpass 1: Deferred composition", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+            // Regions stay within a subpass, as the pipeline statistics queries of the GPU timings have to
             drawCmdBuffer.nextSubpass(vk::SubpassContents::eInline);
+            vks::debug::marker::beginRegion(drawCmdBuffer, "Subpass 1: Deferred composition", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
             drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.composition);
             drawCmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.composition, 0, descriptorSets.composition, nullptr);
             drawCmdBuffer.draw(3, 1, 0, 0);
@@ -415,12 +416,12 @@ public:
         // Third subpass
         // Render transparent geometry using a forward pass that compares against depth generted during G-Buffer fill
         {
-            vks::debug::marker::beginRegion(drawCmdBuffer, "Subpass 2: Forward transparency", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
             drawCmdBuffer.nextSubpass(vk::SubpassContents::eInline);
+            vks::debug::marker::beginRegion(drawCmdBuffer, "Subpass 2: Forward transparency", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
             drawCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.transparent);
             drawCmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.transparent, 0, descriptorSets.transparent, nullptr);
             drawCmdBuffer.bindVertexBuffers(0, models.transparent.vertices.buffer, { 0 });
-            drawCmdBuffer.bindIndexBuffer(models.transparent.indices.buffer, 0, vk::IndexType::eUint32);
+            drawCmdBuffer.bindIndexBuffer(models.transparent.indices.buffer, 0, models.transparent.indexType);
             drawCmdBuffer.drawIndexed(models.transparent.indexCount, 1, 0, 0, 0);
             vks::debug::marker::endRegion(drawCmdBuffer);
         }
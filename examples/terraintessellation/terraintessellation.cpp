@@ -7,7 +7,9 @@
 */
 
 #include <vulkanExampleBase.h>
-#include <frustum.hpp>
+#include <vks/frustum.hpp>
+#include <heightmap.hpp>
+#include <vks/terrain.hpp>
 
 // Vertex layout for this example
 vks::model::VertexLayout vertexLayout{ {
@@ -19,7 +21,8 @@ vks::model::VertexLayout vertexLayout{ {
 class VulkanExample : public vkx::ExampleBase {
 private:
     struct {
-        vks::texture::Texture2D heightMap;
+        // Streamed in coarsest level first, both terrain paths sample the finest resident level
+        vks::texture::StreamingTexture2D heightMap;
         vks::texture::Texture2D skySphere;
         vks::texture::Texture2DArray terrainArray;
     } textures;
@@ -27,6 +30,11 @@ private:
 public:
     bool wireframe = false;
     bool tessellation = true;
+    // Draw the nodes a compute shader selects from a quadtree over the height map instead of tessellating patches
+    bool quadtree = false;
+    float lodDistance = 6.0f;
+
+    vks::terrain::Quadtree terrainQuadtree;
 
     struct {
         vks::model::Model object;
@@ -60,28 +68,28 @@ public:
         vk::Pipeline terrain;
         vk::Pipeline wireframe;
         vk::Pipeline skysphere;
+        vk::Pipeline quadtree;
+        vk::Pipeline quadtreeWireframe;
     } pipelines;
 
     struct {
         vk::DescriptorSetLayout terrain;
         vk::DescriptorSetLayout skysphere;
+        vk::DescriptorSetLayout quadtree;
     } descriptorSetLayouts;
 
     struct {
         vk::PipelineLayout terrain;
         vk::PipelineLayout skysphere;
+        vk::PipelineLayout quadtree;
     } pipelineLayouts;
 
     struct {
         vk::DescriptorSet terrain;
         vk::DescriptorSet skysphere;
+        vk::DescriptorSet quadtree;
     } descriptorSets;
 
-    // Pipeline statistics
-    vks::Buffer queryResult;
-    vk::QueryPool queryPool;
-    std::array<uint64_t, 2> pipelineStats{ 0, 0 };
-
     // View frustum passed to tessellation control shader for culling
     vks::Frustum frustum;
 
@@ -101,10 +109,6 @@ public:
             throw std::runtime_error("Selected GPU does not support tessellation shaders!");
         }
 
-        if (deviceFeatures.pipelineStatisticsQuery) {
-            enabledFeatures.pipelineStatisticsQuery = VK_TRUE;
-        }
-
         if (deviceFeatures.fillModeNonSolid) {
             enabledFeatures.fillModeNonSolid = VK_TRUE;
         }
@@ -115,12 +119,18 @@ public:
         // Note : Inherited destructor cleans up resources stored in base class
         device.destroy(pipelines.terrain);
         device.destroy(pipelines.wireframe);
+        device.destroy(pipelines.quadtree);
+        device.destroy(pipelines.quadtreeWireframe);
 
         device.destroy(pipelineLayouts.skysphere);
         device.destroy(pipelineLayouts.terrain);
+        device.destroy(pipelineLayouts.quadtree);
 
         device.destroy(descriptorSetLayouts.terrain);
         device.destroy(descriptorSetLayouts.skysphere);
+        device.destroy(descriptorSetLayouts.quadtree);
+
+        terrainQuadtree.destroy();
 
         meshes.object.destroy();
 
@@ -129,27 +139,6 @@ public:
         textures.heightMap.destroy();
         textures.skySphere.destroy();
         textures.terrainArray.destroy();
-        device.destroy(queryPool);
-        queryResult.destroy();
-    }
-
-    // Setup pool and buffer for storing pipeline statistics results
-    void setupQueryResultBuffer() {
-        uint32_t bufSize = 2 * sizeof(uint64_t);
-        // Results are saved in a host visible buffer for easy access by the application
-        queryResult = context.createBuffer(vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst,
-                                           vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, bufSize);
-
-        // Create query pool
-        auto pipelineStatistics =
-            vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations | vk::QueryPipelineStatisticFlagBits::eTessellationEvaluationShaderInvocations;
-        queryPool = device.createQueryPool({ {}, vk::QueryType::ePipelineStatistics, 2, pipelineStatistics });
-    }
-
-    // Retrieves the results of the pipeline statistics query submitted to the command buffer
-    void getQueryResults() {
-        // We use vkGetQueryResults to copy the results into a host visible buffer
-        device.getQueryPoolResults<uint64_t>(queryPool, 0, 1, pipelineStats, sizeof(uint64_t), vk::QueryResultFlagBits::e64);
     }
 
     void loadAssets() override {
@@ -161,29 +150,32 @@ public:
         textures.terrainArray.loadFromFile(context, getAssetPath() + "textures/terrain_texturearray_bc3.ktx", vk::Format::eBc3UnormBlock);
 
         // Setup a mirroring sampler for the height map
-        device.destroySampler(textures.heightMap.sampler);
+        vks::releaseSampler(device, textures.heightMap.sampler);
         vk::SamplerCreateInfo samplerInfo;
         samplerInfo.minFilter = samplerInfo.magFilter = vk::Filter::eLinear;
         samplerInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
         samplerInfo.maxLod = (float)textures.heightMap.mipLevels;
         samplerInfo.borderColor = vk::BorderColor::eFloatOpaqueWhite;
-        textures.heightMap.sampler = device.createSampler(samplerInfo);
+        textures.heightMap.sampler = vks::acquireSampler(device, samplerInfo);
         textures.heightMap.updateDescriptor();
 
         // Setup a repeating sampler for the terrain texture layers
-        device.destroySampler(textures.terrainArray.sampler);
+        vks::releaseSampler(device, textures.terrainArray.sampler);
         samplerInfo.maxLod = (float)textures.terrainArray.mipLevels;
         if (context.deviceFeatures.samplerAnisotropy) {
             samplerInfo.maxAnisotropy = 4.0f;
             samplerInfo.anisotropyEnable = VK_TRUE;
         }
-        textures.terrainArray.sampler = device.createSampler(samplerInfo);
+        textures.terrainArray.sampler = vks::acquireSampler(device, samplerInfo);
         textures.terrainArray.updateDescriptor();
     }
 
     void updateCommandBufferPreDraw(const vk::CommandBuffer& cmdBuffer) override {
-        if (deviceFeatures.pipelineStatisticsQuery) {
-            cmdBuffer.resetQueryPool(queryPool, 0, 2);
+        if (quadtree) {
+            // Selected for the camera of every frame on the GPU, so the recorded commands stay valid as it moves
+            vks::debug::marker::beginRegion(cmdBuffer, "Quadtree selection", glm::vec4(0.5f, 0.5f, 1.0f, 1.0f));
+            terrainQuadtree.record(cmdBuffer);
+            vks::debug::marker::endRegion(cmdBuffer);
         }
     }
 
@@ -192,27 +184,28 @@ public:
         cmdBuffer.setScissor(0, vks::util::rect2D(size));
         cmdBuffer.setLineWidth(1.0f);
         // Skysphere
+        vks::debug::marker::beginRegion(cmdBuffer, "Skysphere", glm::vec4(0.5f, 0.5f, 1.0f, 1.0f));
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.skysphere);
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.skysphere, 0, descriptorSets.skysphere, {});
         cmdBuffer.bindVertexBuffers(0, meshes.skysphere.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.skysphere.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.skysphere.indices.buffer, 0, meshes.skysphere.indexType);
         cmdBuffer.drawIndexed(meshes.skysphere.indexCount, 1, 0, 0, 0);
-
-        // Terrrain
-        // Begin pipeline statistics query
-        if (deviceFeatures.pipelineStatisticsQuery) {
-            cmdBuffer.beginQuery(queryPool, 0, vk::QueryControlFlagBits::ePrecise);
-        }
-        // Render
-        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, wireframe ? pipelines.wireframe : pipelines.terrain);
-        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.terrain, 0, descriptorSets.terrain, {});
-        cmdBuffer.bindVertexBuffers(0, meshes.object.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.object.indices.buffer, 0, vk::IndexType::eUint32);
-        cmdBuffer.drawIndexed(meshes.object.indexCount, 1, 0, 0, 0);
-        // End pipeline statistics query
-        if (deviceFeatures.pipelineStatisticsQuery) {
-            cmdBuffer.endQuery(queryPool, 0);
+        vks::debug::marker::endRegion(cmdBuffer);
+
+        // Terrrain, the GPU timings count the vertex and tessellation shader invocations of each region
+        vks::debug::marker::beginRegion(cmdBuffer, "Terrain", glm::vec4(0.5f, 1.0f, 0.5f, 1.0f));
+        if (quadtree) {
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, wireframe ? pipelines.quadtreeWireframe : pipelines.quadtree);
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.quadtree, 0, descriptorSets.quadtree, {});
+            terrainQuadtree.draw(cmdBuffer);
+        } else {
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, wireframe ? pipelines.wireframe : pipelines.terrain);
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.terrain, 0, descriptorSets.terrain, {});
+            cmdBuffer.bindVertexBuffers(0, meshes.object.vertices.buffer, { 0 });
+            cmdBuffer.bindIndexBuffer(meshes.object.indices.buffer, 0, meshes.object.indexType);
+            cmdBuffer.drawIndexed(meshes.object.indexCount, 1, 0, 0, 0);
         }
+        vks::debug::marker::endRegion(cmdBuffer);
     }
 
     // Generate a terrain quad patch for feeding to the tessellation control shader
@@ -261,13 +254,34 @@ public:
         meshes.object.indexCount = indices.size();
     }
 
+    // The quadtree covers the same area as the patches, with nodes of the deepest level about as large as
+    // `gridSize` height map texels
+    void prepareQuadtree() {
+        vkx::HeightMap heightMap;
+        heightMap.loadHeights(getAssetPath() + "textures/terrain_heightmap_r16.ktx");
+        vks::terrain::Quadtree::Settings settings;
+        settings.size = PATCH_SIZE * 2.0f;
+        settings.origin = glm::vec2(-settings.size / 2.0f);
+        // Heights are subtracted from y, as in the tessellation evaluation shader
+        settings.heightScale = -uboTess.displacementFactor;
+        settings.levels = 1;
+        while (settings.levels < vks::terrain::Quadtree::MAX_LEVELS && (settings.gridSize << settings.levels) <= heightMap.dimension()) {
+            ++settings.levels;
+        }
+        terrainQuadtree.create(context, getAssetPath() + "shaders/base/quadtree.comp.spv", settings, heightMap.heightBounds(settings.levels));
+    }
+
     void setupDescriptorPool() {
+        // The terrain sets are replaced whenever more of the height map has streamed in, and the old ones are only
+        // freed once the frames using them have completed
+        const uint32_t terrainSets = framesInFlight + 2;
         std::vector<vk::DescriptorPoolSize> poolSizes = {
-            vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, 3),
-            vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 3),
+            vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, 1 + terrainSets * 3),
+            vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 1 + terrainSets * 4),
         };
 
-        descriptorPool = device.createDescriptorPool({ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
+        descriptorPool = device.createDescriptorPool(
+            { vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet, 1 + terrainSets * 2, (uint32_t)poolSizes.size(), poolSizes.data() });
     }
 
     void setupDescriptorSetLayouts() {
@@ -289,6 +303,21 @@ public:
         descriptorSetLayouts.terrain = device.createDescriptorSetLayout({ {}, static_cast<uint32_t>(setLayoutBindings.size()), setLayoutBindings.data() });
         pipelineLayouts.terrain = device.createPipelineLayout(vk::PipelineLayoutCreateInfo{ {}, 1, &descriptorSetLayouts.terrain });
 
+        // Quadtree terrain, the height map is sampled in the vertex shader
+        setLayoutBindings = {
+            // Binding 0 : Shared terrain ubo
+            { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+            // Binding 1 : Height map
+            { 1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment },
+            // Binding 2 : Terrain texture array layers
+            { 2, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 3 : Quadtree uniforms
+            { 3, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+        };
+
+        descriptorSetLayouts.quadtree = device.createDescriptorSetLayout({ {}, static_cast<uint32_t>(setLayoutBindings.size()), setLayoutBindings.data() });
+        pipelineLayouts.quadtree = device.createPipelineLayout(vk::PipelineLayoutCreateInfo{ {}, 1, &descriptorSetLayouts.quadtree });
+
         // Skysphere
         setLayoutBindings = {
             { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
@@ -299,11 +328,20 @@ public:
         pipelineLayouts.skysphere = device.createPipelineLayout(vk::PipelineLayoutCreateInfo{ {}, 1, &descriptorSetLayouts.skysphere });
     }
 
-    void setupDescriptorSets() {
-        // Terrain
+    // The sets sampling the height map, replaced whenever its image changes
+    void setupTerrainDescriptorSets() {
+        for (auto set : { &descriptorSets.terrain, &descriptorSets.quadtree }) {
+            if (*set) {
+                // Frames in flight may still use the old set
+                context.trash<vk::DescriptorSet>(*set, [this](vk::DescriptorSet set) {
+                    if (descriptorPool) {
+                        device.freeDescriptorSets(descriptorPool, set);
+                    }
+                });
+            }
+        }
         descriptorSets.terrain = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.terrain })[0];
-        // Skysphere
-        descriptorSets.skysphere = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.skysphere })[0];
+        descriptorSets.quadtree = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.quadtree })[0];
 
         std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
             // Terrain
@@ -314,6 +352,21 @@ public:
             // Binding 2 : Color map (alpha channel)
             { descriptorSets.terrain, 2, 0, 1, vk::DescriptorType::eCombinedImageSampler, &textures.terrainArray.descriptor },
 
+            // Quadtree terrain
+            { descriptorSets.quadtree, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.terrainTessellation.descriptor },
+            { descriptorSets.quadtree, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &textures.heightMap.descriptor },
+            { descriptorSets.quadtree, 2, 0, 1, vk::DescriptorType::eCombinedImageSampler, &textures.terrainArray.descriptor },
+            { descriptorSets.quadtree, 3, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &terrainQuadtree.uniforms.descriptor },
+        };
+        device.updateDescriptorSets(writeDescriptorSets, nullptr);
+    }
+
+    void setupDescriptorSets() {
+        setupTerrainDescriptorSets();
+        // Skysphere
+        descriptorSets.skysphere = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.skysphere })[0];
+
+        std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
             // Skysphere
             // Binding 0 : Vertex shader ubo
             { descriptorSets.skysphere, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.skysphereVertex.descriptor },
@@ -344,12 +397,25 @@ public:
 
         builder.destroyShaderModules();
 
-        // Skysphere pipeline
-        builder.rasterizationState.polygonMode = vk::PolygonMode::eFill;
-        // Revert to triangle list topology
+        // Quadtree terrain pipelines, indexed triangles displaced in the vertex shader
+        builder.layout = pipelineLayouts.quadtree;
         builder.inputAssemblyState.topology = vk::PrimitiveTopology::eTriangleList;
-        // Reset tessellation state
         builder.pipelineCreateInfo.pTessellationState = nullptr;
+        builder.vertexInputState.bindingDescriptions.clear();
+        builder.vertexInputState.attributeDescriptions.clear();
+        vks::terrain::Quadtree::appendVertexInput(builder.vertexInputState);
+        builder.loadShader(getAssetPath() + "shaders/terraintessellation/quadtree.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        builder.loadShader(getAssetPath() + "shaders/terraintessellation/terrain.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipelines.quadtreeWireframe = builder.create(context.pipelineCache);
+        builder.rasterizationState.polygonMode = vk::PolygonMode::eFill;
+        pipelines.quadtree = builder.create(context.pipelineCache);
+
+        builder.destroyShaderModules();
+        builder.vertexInputState.bindingDescriptions.clear();
+        builder.vertexInputState.attributeDescriptions.clear();
+        builder.vertexInputState.appendVertexLayout(vertexLayout);
+
+        // Skysphere pipeline
         // Don't write to depth buffer
         builder.depthStencilState.depthWriteEnable = VK_FALSE;
         builder.layout = pipelineLayouts.skysphere;
@@ -375,6 +441,7 @@ public:
         uboTess.viewportDim = glm::vec2((float)size.width, (float)size.height);
         frustum.update(uboTess.projection * uboTess.modelview);
         memcpy(uboTess.frustumPlanes, frustum.planes.data(), sizeof(glm::vec4) * 6);
+        terrainQuadtree.update(glm::vec3(glm::inverse(camera.matrices.view)[3]), frustum.planes, lodDistance);
 
         float savedFactor = uboTess.tessellationFactor;
         if (!tessellation) {
@@ -391,23 +458,10 @@ public:
         uniformData.skysphereVertex.copy(uboVS);
     }
 
-    void draw() {
-        ExampleBase::prepareFrame();
-
-        drawCurrentCommandBuffer();
-        if (deviceFeatures.pipelineStatisticsQuery) {
-            getQueryResults();
-        }
-
-        ExampleBase::submitFrame();
-    }
-
     void prepare() override {
         ExampleBase::prepare();
         generateTerrain();
-        if (deviceFeatures.pipelineStatisticsQuery) {
-            setupQueryResultBuffer();
-        }
+        prepareQuadtree();
         prepareUniformBuffers();
         setupDescriptorSetLayouts();
         preparePipelines();
@@ -417,15 +471,33 @@ public:
         prepared = true;
     }
 
+    void render() override {
+        if (prepared && textures.heightMap.update()) {
+            // The pre-recorded command buffers reference the terrain descriptor sets, so both are replaced
+            setupTerrainDescriptorSets();
+            buildCommandBuffers();
+        }
+        ExampleBase::render();
+    }
+
     void viewChanged() override { updateUniformBuffers(); }
 
     void OnUpdateUIOverlay() override {
         if (ui.header("Settings")) {
-            if (ui.checkBox("Tessellation", &tessellation)) {
-                updateUniformBuffers();
+            if (ui.checkBox("GPU quadtree", &quadtree)) {
+                buildCommandBuffers();
             }
-            if (ui.inputFloat("Factor", &uboTess.tessellationFactor, 0.05f, 2)) {
-                updateUniformBuffers();
+            if (quadtree) {
+                if (ui.sliderFloat("LOD distance", &lodDistance, 2.0f, 16.0f)) {
+                    updateUniformBuffers();
+                }
+            } else {
+                if (ui.checkBox("Tessellation", &tessellation)) {
+                    updateUniformBuffers();
+                }
+                if (ui.inputFloat("Factor", &uboTess.tessellationFactor, 0.05f, 2)) {
+                    updateUniformBuffers();
+                }
             }
             if (deviceFeatures.fillModeNonSolid) {
                 if (ui.checkBox("Wireframe", &wireframe)) {
@@ -433,11 +505,8 @@ public:
                 }
             }
         }
-        if (deviceFeatures.pipelineStatisticsQuery) {
-            if (ui.header("Pipeline statistics")) {
-                ui.text("VS invocations: %d", pipelineStats[0]);
-                ui.text("TE invocations: %d", pipelineStats[1]);
-            }
+        if (quadtree && ui.header("Height map")) {
+            ui.text("Resident level: %d of %d", textures.heightMap.residentLevel(), textures.heightMap.mipLevels);
         }
     }
 };
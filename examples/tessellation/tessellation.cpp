@@ -4,12 +4,16 @@
 * Based on http://alex.vlachos.com/graphics/CurvedPNTriangles.pdf
 * Shaders based on http://onrendering.blogspot.de/2011/12/tessellation-on-gpu-curved-pn-triangles.html
 *
+* The tessellation levels follow the on screen length of the edges, and patches outside the view or facing away are
+* culled in the control shader, see vks::AdaptiveTessellation
+*
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
 #include "vulkanExampleBase.h"
+#include <vks/tessellation.hpp>
 
 // Vertex layout for this example
 vks::model::VertexLayout vertexLayout{ { vks::model::VERTEX_COMPONENT_POSITION, vks::model::VERTEX_COMPONENT_NORMAL, vks::model::VERTEX_COMPONENT_UV } };
@@ -31,9 +35,15 @@ public:
 
     vks::Buffer uniformDataTC, uniformDataTE;
 
-    struct UboTC {
-        float tessLevel = 3.0f;
-    } uboTC;
+    // Screen space levels within a triangle budget, or the same level everywhere
+    vks::AdaptiveTessellation tessellation;
+    bool adaptive = true;
+    float tessLevel = 3.0f;
+    float edgePixels = 12.0f;
+    int32_t triangleBudget = 256;
+    // The tessellated triangles of the most recent profiler collection, 0 without pipeline statistics
+    uint64_t tessellatedTriangles = 0;
+    uint64_t statisticsCollections = 0;
 
     struct UboTE {
         glm::mat4 projection;
@@ -86,11 +96,9 @@ public:
 
         meshes.object.destroy();
 
-        device.destroyBuffer(uniformDataTC.buffer);
-        device.freeMemory(uniformDataTC.memory);
+        uniformDataTC.destroy();
 
-        device.destroyBuffer(uniformDataTE.buffer);
-        device.freeMemory(uniformDataTE.memory);
+        uniformDataTE.destroy();
 
         textures.colorMap.destroy();
     }
@@ -105,7 +113,7 @@ public:
 
         vk::DeviceSize offsets = 0;
         cmdBuffer.bindVertexBuffers(0, meshes.object.vertices.buffer, offsets);
-        cmdBuffer.bindIndexBuffer(meshes.object.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.object.indices.buffer, 0, meshes.object.indexType);
 
         if (splitScreen) {
             cmdBuffer.setViewport(0, viewport);
@@ -114,13 +122,17 @@ public:
             viewport.x = float(size.width) / 2;
         }
 
+        // The region's pipeline statistics count the patches and the triangles they were tessellated into
+        vks::debug::marker::beginRegion(cmdBuffer, "PN triangles", glm::vec4(0.5f, 1.0f, 0.5f, 1.0f));
         cmdBuffer.setViewport(0, viewport);
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, wireframe ? pipelines.wire : pipelines.solid);
         cmdBuffer.drawIndexed(meshes.object.indexCount, 1, 0, 0, 0);
+        vks::debug::marker::endRegion(cmdBuffer);
     }
 
     void loadAssets() override {
         meshes.object.loadFromFile(context, getAssetPath() + "models/lowpoly/deer.dae", vertexLayout, 1.0f);
+        tessellation.patchCount = meshes.object.indexCount / 3;
         textures.colorMap.loadFromFile(context, getAssetPath() + "textures/deer.ktx", vk::Format::eBc3UnormBlock);
     }
 
@@ -136,7 +148,7 @@ public:
     void setupDescriptorSetLayout() {
         std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
             { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eTessellationControl },
-            { 1, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eTessellationEvaluation },
+            { 1, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eTessellationControl | vk::ShaderStageFlagBits::eTessellationEvaluation },
             { 2, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
         };
 
@@ -183,8 +195,8 @@ public:
 
         // Pass through pipelines
         // Load pass through tessellation shaders (Vert and frag are reused)
-        device.destroyShaderModule(builder.shaderStages[2].module);
-        device.destroyShaderModule(builder.shaderStages[3].module);
+        vks::shaders::releaseShaderModule(device, builder.shaderStages[2].module);
+        vks::shaders::releaseShaderModule(device, builder.shaderStages[3].module);
         builder.shaderStages.resize(2);
         builder.loadShader(getAssetPath() + "shaders/tessellation/passthrough.tesc.spv", vk::ShaderStageFlagBits::eTessellationControl);
         builder.loadShader(getAssetPath() + "shaders/tessellation/passthrough.tese.spv", vk::ShaderStageFlagBits::eTessellationEvaluation);
@@ -203,7 +215,15 @@ public:
         // Tessellation evaluation shader uniform buffer
         uniformDataTE = context.createUniformBuffer(uboTE);
         // Tessellation control shader uniform buffer
-        uniformDataTC = context.createUniformBuffer(uboTC);
+        uniformDataTC = context.createUniformBuffer(tessellation.params(size));
+        updateTessellation();
+    }
+
+    void updateTessellation() {
+        tessellation.edgePixels = adaptive ? edgePixels : 0.0f;
+        tessellation.maxLevel = adaptive ? std::min(64.0f, (float)context.deviceProperties.limits.maxTessellationGenerationLevel) : tessLevel;
+        tessellation.maxTriangles = (uint32_t)triangleBudget * 1000;
+        tessellation.reset();
         updateUniformBuffers();
     }
 
@@ -214,7 +234,23 @@ public:
         uniformDataTE.copy(uboTE);
 
         // Tessellation control uniform block
-        uniformDataTC.copy(uboTC);
+        uniformDataTC.copy(tessellation.params({ splitScreen ? size.width / 2 : size.width, size.height }));
+    }
+
+    void update(float deltaTime) override {
+        Parent::update(deltaTime);
+        if (profiler.getCollectionCount() == statisticsCollections) {
+            return;
+        }
+        statisticsCollections = profiler.getCollectionCount();
+        // Every tessellated triangle goes through clipping, culled patches don't make any
+        const auto* scope = profiler.findScope("PN triangles");
+        if (scope && !scope->statistics.empty()) {
+            tessellatedTriangles = profiler.getStatistic("PN triangles", "clippingInvocations");
+            if (tessellation.update(tessellatedTriangles)) {
+                updateUniformBuffers();
+            }
+        }
     }
 
     void prepare() override {
@@ -232,7 +268,21 @@ public:
 
     virtual void OnUpdateUIOverlay() {
         if (ui.header("Settings")) {
-            if (ui.inputFloat("Tessellation level", &uboTC.tessLevel, 0.25f, 2)) {
+            if (ui.checkBox("Adaptive", &adaptive)) {
+                updateTessellation();
+            }
+            if (adaptive) {
+                if (ui.inputFloat("Edge length (pixels)", &edgePixels, 1.0f, 1)) {
+                    edgePixels = std::max(edgePixels, 1.0f);
+                    updateTessellation();
+                }
+                if (ui.sliderInt("Triangle budget (thousands)", &triangleBudget, 16, 4096)) {
+                    updateTessellation();
+                }
+            } else if (ui.inputFloat("Tessellation level", &tessLevel, 0.25f, 2)) {
+                updateTessellation();
+            }
+            if (ui.checkBox("Cull patches", &tessellation.cull)) {
                 updateUniformBuffers();
             }
             if (deviceFeatures.fillModeNonSolid) {
@@ -246,6 +296,14 @@ public:
                 }
             }
         }
+        if (ui.header("Tessellation")) {
+            if (tessellatedTriangles) {
+                ui.text("Triangles: %llu", (unsigned long long)tessellatedTriangles);
+            } else {
+                ui.text("Triangles need pipeline statistics");
+            }
+            ui.text("Budget scale: %.2f", tessellation.budgetScale());
+        }
     }
 };
 
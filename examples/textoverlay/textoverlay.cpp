@@ -0,0 +1,273 @@
+/*
+* Vulkan Example - Text overlay rendering on-top of an existing scene
+*
+* All of the text is re-laid out every frame by vks::TextRenderer and drawn with a single instanced draw at the end
+* of the scene's render pass
+*
+* Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "vulkanExampleBase.h"
+#include <vks/text.hpp>
+
+// Vertex layout for this example
+vks::model::VertexLayout vertexLayout{ {
+    vks::model::VERTEX_COMPONENT_POSITION,
+    vks::model::VERTEX_COMPONENT_NORMAL,
+    vks::model::VERTEX_COMPONENT_UV,
+    vks::model::VERTEX_COMPONENT_COLOR,
+} };
+
+class VulkanExample : public vkx::ExampleBase {
+public:
+    // Height of a line of text, in pixels
+    static constexpr float LINE_SIZE = 20.0f;
+
+    vks::TextRenderer text;
+    bool textVisible = true;
+
+    struct {
+        vks::texture::Texture2D background;
+        vks::texture::Texture2D cube;
+    } textures;
+
+    struct {
+        vks::model::Model cube;
+    } meshes;
+
+    vks::Buffer uniformDataVS;
+
+    struct {
+        glm::mat4 projection;
+        glm::mat4 model;
+        glm::vec4 lightPos = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    } uboVS;
+
+    struct {
+        vk::Pipeline solid;
+        vk::Pipeline background;
+    } pipelines;
+
+    vk::PipelineLayout pipelineLayout;
+    vk::DescriptorSetLayout descriptorSetLayout;
+
+    struct {
+        vk::DescriptorSet background;
+        vk::DescriptorSet cube;
+    } descriptorSets;
+
+    VulkanExample() {
+        camera.dolly(-4.5f);
+        camera.setRotation({ -25.0f, 0.0f, 0.0f });
+        title = "Vulkan Example - Text overlay";
+        // The text follows the camera and the frame times, so it is laid out again for every frame
+        recordPerFrame = true;
+    }
+
+    ~VulkanExample() {
+        text.destroy();
+        device.destroy(pipelines.solid);
+        device.destroy(pipelines.background);
+        device.destroy(pipelineLayout);
+        device.destroy(descriptorSetLayout);
+        meshes.cube.destroy();
+        textures.background.destroy();
+        textures.cube.destroy();
+        uniformDataVS.destroy();
+    }
+
+    // Window coordinates of a point of the cube
+    glm::vec2 project(const glm::vec3& point) const {
+        const glm::vec4 clip = uboVS.projection * uboVS.model * glm::vec4(point, 1.0f);
+        const glm::vec2 ndc = glm::vec2(clip) / clip.w;
+        return (ndc * 0.5f + 0.5f) * glm::vec2((float)size.width, (float)size.height);
+    }
+
+    // Lay out all of the text for the frame being recorded
+    void addText() {
+        using Align = vks::TextRenderer::Align;
+        text.begin(currentFrame);
+        if (!textVisible) {
+            return;
+        }
+        const float width = (float)size.width;
+        const float height = (float)size.height;
+        char line[128];
+
+        text.add(title, { 5.0f, 5.0f }, LINE_SIZE);
+        snprintf(line, sizeof(line), "%.2fms (%u fps)", frameTimer * 1000.0f, lastFPS);
+        text.add(line, { 5.0f, 5.0f + LINE_SIZE }, LINE_SIZE);
+        text.add(context.deviceProperties.deviceName, { 5.0f, 5.0f + LINE_SIZE * 2.0f }, LINE_SIZE);
+
+        // Projected cube vertices
+        for (int32_t x = -1; x <= 1; x += 2) {
+            for (int32_t y = -1; y <= 1; y += 2) {
+                for (int32_t z = -1; z <= 1; z += 2) {
+                    snprintf(line, sizeof(line), "%+d/%+d/%+d", x, y, z);
+                    const glm::vec2 projected = project(glm::vec3((float)x, (float)y, (float)z));
+                    text.add(line, { projected.x, projected.y + (y > -1 ? 5.0f : -LINE_SIZE - 5.0f) }, LINE_SIZE, glm::vec4(1.0f, 1.0f, 0.5f, 1.0f),
+                             Align::Center);
+                }
+            }
+        }
+
+        // Current model view matrix
+        text.add("model view matrix", { width - 5.0f, 5.0f }, LINE_SIZE, glm::vec4(1.0f), Align::Right);
+        for (uint32_t i = 0; i < 4; i++) {
+            const glm::mat4& m = uboVS.model;
+            snprintf(line, sizeof(line), "%+.2f %+.2f %+.2f %+.2f", m[0][i], m[1][i], m[2][i], m[3][i]);
+            text.add(line, { width - 5.0f, 5.0f + LINE_SIZE * (float)(i + 1) }, LINE_SIZE, glm::vec4(1.0f), Align::Right);
+        }
+
+        const glm::vec2 center = project(glm::vec3(0.0f));
+        text.add("Uniform cube", { center.x, center.y - LINE_SIZE * 0.5f }, LINE_SIZE, glm::vec4(1.0f), Align::Center);
+
+        text.add("Press \"space\" to toggle text overlay", { 5.0f, height - 5.0f - LINE_SIZE }, LINE_SIZE);
+#if !defined(__ANDROID__)
+        text.add("Hold middle mouse button and drag to move", { 5.0f, height - 5.0f - LINE_SIZE * 2.0f }, LINE_SIZE);
+#endif
+    }
+
+    void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        cmdBuffer.setViewport(0, vks::util::viewport(size));
+        cmdBuffer.setScissor(0, vks::util::rect2D(size));
+
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.background, nullptr);
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.background);
+        cmdBuffer.draw(3, 1, 0, 0);
+
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.solid);
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.cube, nullptr);
+        cmdBuffer.bindVertexBuffers(0, meshes.cube.vertices.buffer, { 0 });
+        cmdBuffer.bindIndexBuffer(meshes.cube.indices.buffer, 0, meshes.cube.indexType);
+        cmdBuffer.drawIndexed(meshes.cube.indexCount, 1, 0, 0, 0);
+
+        // Drawn last, over the scene, in window coordinates
+        addText();
+        text.draw(cmdBuffer, glm::ortho(0.0f, (float)size.width, 0.0f, (float)size.height));
+    }
+
+    void loadAssets() override {
+        // Get supported compressed texture format
+        std::string texFormatSuffix;
+        vk::Format texFormat;
+        if (context.deviceFeatures.textureCompressionBC) {
+            texFormatSuffix = "_bc3_unorm";
+            texFormat = vk::Format::eBc3UnormBlock;
+        } else if (context.deviceFeatures.textureCompressionASTC_LDR) {
+            texFormatSuffix = "_astc_8x8_unorm";
+            texFormat = vk::Format::eAstc8x8UnormBlock;
+        } else if (context.deviceFeatures.textureCompressionETC2) {
+            texFormatSuffix = "_etc2_unorm";
+            texFormat = vk::Format::eEtc2R8G8B8A8UnormBlock;
+        } else {
+            throw std::runtime_error("Device does not support any compressed texture format!");
+        }
+        textures.background.loadFromFile(context, getAssetPath() + "textures/skysphere" + texFormatSuffix + ".ktx", texFormat);
+        textures.cube.loadFromFile(context, getAssetPath() + "textures/round_window" + texFormatSuffix + ".ktx", texFormat);
+        meshes.cube.loadFromFile(context, getAssetPath() + "models/cube.dae", vertexLayout, 1.0f);
+    }
+
+    void setupDescriptorPool() {
+        std::vector<vk::DescriptorPoolSize> poolSizes{
+            { vk::DescriptorType::eUniformBuffer, 2 },
+            { vk::DescriptorType::eCombinedImageSampler, 2 },
+        };
+        descriptorPool = device.createDescriptorPool({ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
+    }
+
+    void setupDescriptorSetLayout() {
+        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+            // Binding 0 : Vertex shader uniform buffer
+            { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+            // Binding 1 : Fragment shader combined sampler
+            { 1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
+        };
+        descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+        pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+    }
+
+    void setupDescriptorSet() {
+        vk::DescriptorSetAllocateInfo allocInfo{ descriptorPool, 1, &descriptorSetLayout };
+        descriptorSets.background = device.allocateDescriptorSets(allocInfo)[0];
+        descriptorSets.cube = device.allocateDescriptorSets(allocInfo)[0];
+
+        std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
+            // Background
+            { descriptorSets.background, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformDataVS.descriptor },
+            { descriptorSets.background, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &textures.background.descriptor },
+            // Cube
+            { descriptorSets.cube, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformDataVS.descriptor },
+            { descriptorSets.cube, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &textures.cube.descriptor },
+        };
+        device.updateDescriptorSets(writeDescriptorSets, nullptr);
+    }
+
+    void preparePipelines() {
+        vks::pipelines::GraphicsPipelineBuilder builder{ device, pipelineLayout, renderPass };
+        builder.rasterizationState.frontFace = vk::FrontFace::eClockwise;
+        builder.vertexInputState.appendVertexLayout(vertexLayout);
+        builder.loadShader(getAssetPath() + "shaders/textoverlay/mesh.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        builder.loadShader(getAssetPath() + "shaders/textoverlay/mesh.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipelines.solid = builder.create(context.pipelineCache);
+        builder.destroyShaderModules();
+
+        // Full screen triangle behind the cube, generated in the vertex shader
+        builder.vertexInputState.bindingDescriptions.clear();
+        builder.vertexInputState.attributeDescriptions.clear();
+        builder.depthStencilState = false;
+        builder.rasterizationState.cullMode = vk::CullModeFlagBits::eNone;
+        builder.loadShader(getAssetPath() + "shaders/textoverlay/background.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        builder.loadShader(getAssetPath() + "shaders/textoverlay/background.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipelines.background = builder.create(context.pipelineCache);
+    }
+
+    // Prepare and initialize uniform buffer containing shader uniforms
+    void prepareUniformBuffers() {
+        uniformDataVS = context.createUniformBuffer(uboVS);
+        updateUniformBuffers();
+    }
+
+    void updateUniformBuffers() {
+        uboVS.projection = camera.matrices.perspective;
+        uboVS.model = camera.matrices.view;
+        uniformDataVS.copy(uboVS);
+    }
+
+    void prepare() override {
+        ExampleBase::prepare();
+        text.create(context, getAssetPath(), renderPass, (uint32_t)frames.size());
+        prepareUniformBuffers();
+        setupDescriptorSetLayout();
+        preparePipelines();
+        setupDescriptorPool();
+        setupDescriptorSet();
+        buildCommandBuffers();
+        prepared = true;
+    }
+
+    void viewChanged() override { updateUniformBuffers(); }
+
+    void keyPressed(uint32_t keyCode) override {
+        switch (keyCode) {
+            case KEY_KPADD:
+            case KEY_SPACE:
+                textVisible = !textVisible;
+                break;
+            default:
+                ExampleBase::keyPressed(keyCode);
+                break;
+        }
+    }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            ui.checkBox("Text overlay", &textVisible);
+            ui.text("%u glyphs in one draw", text.glyphCount());
+        }
+    }
+};
+
+RUN_EXAMPLE(VulkanExample)
@@ -8,6 +8,7 @@
 
 #include <vulkanExampleBase.h>
 #include <vks/texture.hpp>
+#include <limits>
 
 // Vertex layout for this example
 struct Vertex {
@@ -23,7 +24,11 @@ public:
     // Note that this repository contains a texture loader (TextureLoader.h)
     // that encapsulates texture loading functionality in a class that is used
     // in subsequent demos
-    vks::texture::Texture2D texture;
+    // The mip levels are streamed in coarsest first, see StreamingTexture2D
+    vks::texture::StreamingTexture2D texture;
+    // Finest mip level to stream in, from the UI, or from the quad's size on screen
+    int32_t requestedLevel = 0;
+    bool automaticLevel = true;
 
     struct {
         uint32_t count;
@@ -118,6 +123,8 @@ public:
     }
 
     void loadTexture(const std::string& fileName, vk::Format format) {
+        // A small budget, so the levels visibly arrive one after the other
+        texture.budgetMB = 0.25f;
         texture.loadFromFile(context, fileName, format);
     }
 
@@ -155,13 +162,17 @@ public:
     }
 
     void setupDescriptorPool() {
-        // Example uses one ubo and one image sampler
+        // Example uses one ubo and one image sampler.  Every time the texture's view changes a new set replaces the
+        // current one, and the old one is only freed once the frames using it have completed, which can leave one
+        // set per frame in flight waiting while the next one is allocated.
+        const uint32_t maxSets = framesInFlight + 2;
         std::vector<vk::DescriptorPoolSize> poolSizes =
         {
-            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 1 },
-            vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 1 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, maxSets },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, maxSets },
         };
-        descriptorPool = device.createDescriptorPool({ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
+        descriptorPool = device.createDescriptorPool(
+            { vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet, maxSets, (uint32_t)poolSizes.size(), poolSizes.data() });
     }
 
     void setupDescriptorSetLayout() {
@@ -177,9 +188,17 @@ public:
     }
 
     void setupDescriptorSet() {
+        if (descriptorSet) {
+            // Frames in flight may still use the old set
+            context.trash<vk::DescriptorSet>(descriptorSet, [this](vk::DescriptorSet set) {
+                if (descriptorPool) {
+                    device.freeDescriptorSets(descriptorPool, set);
+                }
+            });
+        }
         descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
         // vk::Image descriptor for the color map texture
-        vk::DescriptorImageInfo texDescriptor{ texture.sampler, texture.view, vk::ImageLayout::eGeneral };
+        const vk::DescriptorImageInfo& texDescriptor = texture.descriptor;
         device.updateDescriptorSets({
             // Binding 0 : Vertex shader uniform buffer
             vk::WriteDescriptorSet{ descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformDataVS.descriptor },
@@ -235,10 +254,52 @@ public:
         prepared = true;
     }
 
+    // The quad spans [-1, 1] in x and y, its bounding box in pixels stands for the size the texture is drawn at
+    void requestScreenSizeLevel() {
+        glm::vec2 lower{ std::numeric_limits<float>::max() };
+        glm::vec2 upper{ -std::numeric_limits<float>::max() };
+        for (const glm::vec2 corner : { glm::vec2{ -1.0f, -1.0f }, glm::vec2{ 1.0f, -1.0f }, glm::vec2{ -1.0f, 1.0f }, glm::vec2{ 1.0f, 1.0f } }) {
+            const glm::vec4 clip = uboVS.projection * uboVS.model * glm::vec4(corner, 0.0f, 1.0f);
+            if (clip.w <= 0.0f) {
+                // Partly behind the camera, so the part in front may be arbitrarily close
+                texture.request(0);
+                return;
+            }
+            const glm::vec2 pixel = (glm::vec2(clip) / clip.w * 0.5f + 0.5f) * glm::vec2(size.width, size.height);
+            lower = glm::min(lower, pixel);
+            upper = glm::max(upper, pixel);
+        }
+        texture.requestForScreenSize(upper.x - lower.x, upper.y - lower.y, uboVS.lodBias);
+    }
+
+    void render() override {
+        if (prepared && automaticLevel) {
+            requestScreenSizeLevel();
+        }
+        if (prepared && texture.update()) {
+            // The pre-recorded command buffers reference the descriptor set, so both are replaced
+            setupDescriptorSet();
+            buildCommandBuffers();
+        }
+        Parent::render();
+    }
+
     void viewChanged() override {
         updateUniformBuffers();
     }
 
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Streaming")) {
+            if (ui.checkBox("From screen size", &automaticLevel) && !automaticLevel) {
+                texture.request((uint32_t)requestedLevel);
+            }
+            if (!automaticLevel && ui.sliderInt("Requested level", &requestedLevel, 0, (int32_t)texture.mipLevels - 1)) {
+                texture.request((uint32_t)requestedLevel);
+            }
+            ui.text("Resident level: %d", texture.residentLevel());
+        }
+    }
+
     void changeLodBias(float delta) {
         uboVS.lodBias += delta;
         if (uboVS.lodBias < 0.0f) {
@@ -1,6 +1,9 @@
 /*
 * Vulkan Example - 3D texture loading (and generation using perlin noise) example
 *
+* The noise is generated either on the CPU and uploaded through a staging buffer, or by a compute shader writing
+* straight into the texture
+*
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
@@ -77,6 +80,9 @@ public:
                           lerp(u, grad(permutations[AB + 1], x, y - 1, z - 1), grad(permutations[BB + 1], x - 1, y - 1, z - 1))));
         return res;
     }
+
+    // The lookup, 0..255 shuffled and repeated once, for the compute shader to hash with
+    const uint32_t* table() const { return permutations; }
 };
 
 // Fractal noise generator based on perlin noise above
@@ -118,9 +124,39 @@ public:
     // Contains all Vulkan objects that are required to store and use a 3D texture
     vks::Image texture;
     vk::Extent3D textureSize;
+    // Kept so the mip chain can be regenerated along with the noise
+    vk::ImageCreateInfo textureCreateInfo;
     vk::DescriptorImageInfo textureDescriptor;
 
     bool regenerateNoise = true;
+    bool generateOnGpu = false;
+
+    // Same parameters as FractalNoise
+    struct NoisePushConsts {
+        float scale;
+        uint32_t octaves = 6;
+        float persistence = 0.5f;
+    };
+
+    // Compute generator writing level 0 of the texture
+    struct {
+        bool supported = false;
+        vk::ImageView view;
+        vk::DescriptorSetLayout descriptorSetLayout;
+        vk::PipelineLayout pipelineLayout;
+        vk::Pipeline pipeline;
+        vk::DescriptorSet descriptorSet;
+        vks::Buffer permutations;
+        // Brackets the dispatch, if the queue has timestamps
+        vk::QueryPool timestamps;
+    } noiseCompute;
+
+    // Milliseconds taken by the last generation with each path, including upload and mip chain.  Negative until used
+    struct {
+        double cpu = -1.0;
+        double gpu = -1.0;
+        double gpuDispatch = -1.0;
+    } noiseTimings;
 
     struct {
         vks::model::Model cube;
@@ -159,6 +195,14 @@ public:
         // Clean up used Vulkan resources
         // Note : Inherited destructor cleans up resources stored in base class
 
+        if (noiseCompute.supported) {
+            device.destroy(noiseCompute.timestamps);
+            noiseCompute.permutations.destroy();
+            device.destroy(noiseCompute.pipeline);
+            device.destroy(noiseCompute.pipelineLayout);
+            device.destroy(noiseCompute.descriptorSetLayout);
+            device.destroy(noiseCompute.view);
+        }
         texture.destroy();
         device.destroy(pipelines.solid);
         device.destroy(pipelineLayout);
@@ -180,7 +224,7 @@ public:
 
         // Format support check
         // 3D texture support in Vulkan is mandatory (in contrast to OpenGL) so no need to check if it's supported
-        auto formatProperties = context.physicalDevice.getFormatProperties(texture.format);
+        auto formatProperties = context.getFormatProperties(texture.format);
         // Check if format supports transfer
         if (!formatProperties.optimalTilingFeatures && VK_IMAGE_USAGE_TRANSFER_DST_BIT) {
             std::cout << "Error: Device does not support flag TRANSFER_DST for selected texture format!" << std::endl;
@@ -192,15 +236,26 @@ public:
             std::cout << "Error: Requested texture dimensions is greater than supported 3D texture dimension!" << std::endl;
             return;
         }
-
-        // Create optimal tiled target image
-        vk::ImageCreateInfo imageCreateInfo;
+        // The compute generator writes the format without declaring it in the shader
+        noiseCompute.supported = (formatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eStorageImage) &&
+                                 context.enabledFeatures.shaderStorageImageWriteWithoutFormat;
+        generateOnGpu = noiseCompute.supported;
+
+        // Create optimal tiled target image, with a full mip chain generated on the GPU from the noise to avoid
+        // aliasing in slices viewed from afar
+        vk::ImageCreateInfo& imageCreateInfo = textureCreateInfo;
         imageCreateInfo.imageType = vk::ImageType::e3D;
         imageCreateInfo.format = texture.format;
-        imageCreateInfo.mipLevels = 1;
+        imageCreateInfo.mipLevels = vks::util::mipLevelCount(textureSize);
         imageCreateInfo.arrayLayers = 1;
-        imageCreateInfo.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
+        imageCreateInfo.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc;
+        if (noiseCompute.supported) {
+            imageCreateInfo.usage |= vk::ImageUsageFlagBits::eStorage;
+        }
         imageCreateInfo.extent = textureSize;
+        if (context.getMipmapMethod(imageCreateInfo) == vks::Context::MipmapMethod::None) {
+            imageCreateInfo.mipLevels = 1;
+        }
         // Create image and allocate memory
         texture = context.createImage(imageCreateInfo);
 
@@ -210,6 +265,7 @@ public:
         sampler.mipmapMode = vk::SamplerMipmapMode::eLinear;
         sampler.addressModeU = sampler.addressModeV = sampler.addressModeW = vk::SamplerAddressMode::eClampToEdge;
         sampler.borderColor = vk::BorderColor::eFloatOpaqueWhite;
+        sampler.maxLod = (float)imageCreateInfo.mipLevels;
         texture.sampler = device.createSampler(sampler);
 
         // Create image view
@@ -219,33 +275,97 @@ public:
         view.format = texture.format;
         view.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
         view.subresourceRange.layerCount = 1;
-        view.subresourceRange.levelCount = 1;
+        view.subresourceRange.levelCount = imageCreateInfo.mipLevels;
         texture.view = device.createImageView(view);
 
         // Fill image descriptor image info to be used descriptor set setup
         textureDescriptor.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
         textureDescriptor.imageView = texture.view;
         textureDescriptor.sampler = texture.sampler;
+
+        if (noiseCompute.supported) {
+            // Storage image views can only cover a single level
+            view.subresourceRange.levelCount = 1;
+            noiseCompute.view = device.createImageView(view);
+        }
     }
 
-    // Generate randomized noise and upload it to the 3D texture using staging
-    void updateNoiseTexture() {
-        const uint32_t texMemSize = textureSize.width * textureSize.height * textureSize.depth;
+    void prepareNoiseCompute() {
+        if (!noiseCompute.supported) {
+            return;
+        }
+        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+            { 0, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute },
+            { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        };
+        noiseCompute.descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+        vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(NoisePushConsts) };
+        noiseCompute.pipelineLayout = device.createPipelineLayout({ {}, 1, &noiseCompute.descriptorSetLayout, 1, &pushConstantRange });
+
+        vk::ComputePipelineCreateInfo computePipelineCreateInfo{ {}, {}, noiseCompute.pipelineLayout };
+        computePipelineCreateInfo.stage =
+            vks::shaders::loadShader(device, getAssetPath() + "shaders/texture3d/noise.comp.spv", vk::ShaderStageFlagBits::eCompute);
+        noiseCompute.pipeline = device.createComputePipelines(context.pipelineCache, computePipelineCreateInfo, nullptr)[0];
+        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+
+        // Rewritten for every generation, which waits for the previous one to complete
+        noiseCompute.permutations = context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer,
+                                                         vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                                         512 * sizeof(uint32_t));
+        noiseCompute.permutations.map();
+
+        if (context.queueFamilyProperties[context.queueIndices.graphics].timestampValidBits) {
+            noiseCompute.timestamps = device.createQueryPool({ {}, vk::QueryType::eTimestamp, 2 });
+        }
+    }
 
-        std::vector<uint8_t> data;
-        data.assign(texMemSize, 0);
+    void setupNoiseComputeDescriptorSet() {
+        if (!noiseCompute.supported) {
+            return;
+        }
+        noiseCompute.descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &noiseCompute.descriptorSetLayout })[0];
+        vk::DescriptorImageInfo imageDescriptor{ nullptr, noiseCompute.view, vk::ImageLayout::eGeneral };
+        std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
+            { noiseCompute.descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageImage, &imageDescriptor },
+            { noiseCompute.descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &noiseCompute.permutations.descriptor },
+        };
+        device.updateDescriptorSets(writeDescriptorSets, {});
+    }
+
+    // Generate randomized noise into the 3D texture, with the compute shader or on the CPU
+    void updateNoiseTexture() {
+        std::cout << "Generating " << textureSize.width << " x " << textureSize.height << " x " << textureSize.depth << " noise texture on the "
+                  << (generateOnGpu ? "GPU" : "CPU") << "..." << std::endl;
 
-        // Generate perlin based noise
-        std::cout << "Generating " << textureSize.width << " x " << textureSize.height << " x " << textureSize.depth << " noise texture..." << std::endl;
+        // Frames still in flight sample the texture about to be overwritten
+        context.queue.waitIdle();
 
         auto tStart = std::chrono::high_resolution_clock::now();
 
         PerlinNoise<float> perlinNoise;
-        FractalNoise<float> fractalNoise(perlinNoise);
-
-        std::default_random_engine rndEngine(std::random_device{}());
-        const int32_t noiseType = rand() % 2;
         const float noiseScale = static_cast<float>(rand() % 10) + 4.0f;
+        if (generateOnGpu) {
+            generateNoiseGpu(perlinNoise, noiseScale);
+        } else {
+            generateNoiseCpu(perlinNoise, noiseScale);
+        }
+
+        auto tEnd = std::chrono::high_resolution_clock::now();
+        auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+        (generateOnGpu ? noiseTimings.gpu : noiseTimings.cpu) = tDiff;
+
+        std::cout << "Done in " << tDiff << "ms" << std::endl;
+        regenerateNoise = false;
+    }
+
+    // Generate the noise on the CPU and upload it using staging
+    void generateNoiseCpu(const PerlinNoise<float>& perlinNoise, float noiseScale) {
+        const uint32_t texMemSize = textureSize.width * textureSize.height * textureSize.depth;
+
+        std::vector<uint8_t> data;
+        data.assign(texMemSize, 0);
+
+        FractalNoise<float> fractalNoise(perlinNoise);
 
 #pragma omp parallel for
         for (int32_t z = 0; z < textureSize.depth; z++) {
@@ -269,11 +389,6 @@ public:
             }
         }
 
-        auto tEnd = std::chrono::high_resolution_clock::now();
-        auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-
-        std::cout << "Done in " << tDiff << "ms" << std::endl;
-
         // Create a host-visible staging buffer that contains the raw image data
         // Copy texture data into staging buffer
         vks::Buffer stagingBuffer = context.createStagingBuffer(data);
@@ -294,14 +409,61 @@ public:
             bufferCopyRegion.imageExtent = textureSize;
             copyCmd.copyBufferToImage(stagingBuffer.buffer, texture.image, vk::ImageLayout::eTransferDstOptimal, bufferCopyRegion);
 
-            // Change texture image layout to shader read after all mip levels have been copied
-            context.setImageLayout(copyCmd, texture.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eTransferDstOptimal,
-                                   vk::ImageLayout::eShaderReadOnlyOptimal);
+            // Downsample the noise into the remaining levels, leaving all of them ready for the shader
+            context.generateMipmaps(copyCmd, texture.image, textureCreateInfo);
         });
 
         // Clean up staging resources
         stagingBuffer.destroy();
-        regenerateNoise = false;
+    }
+
+    // Generate the noise with the compute shader, directly into level 0 of the texture
+    void generateNoiseGpu(const PerlinNoise<float>& perlinNoise, float noiseScale) {
+        memcpy(noiseCompute.permutations.mapped, perlinNoise.table(), 512 * sizeof(uint32_t));
+        NoisePushConsts pushConsts;
+        pushConsts.scale = noiseScale;
+
+        context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& cmdBuffer) {
+            vk::ImageMemoryBarrier barrier;
+            barrier.image = texture.image;
+            barrier.subresourceRange = { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
+            barrier.oldLayout = vk::ImageLayout::eUndefined;
+            barrier.newLayout = vk::ImageLayout::eGeneral;
+            barrier.dstAccessMask = vk::AccessFlagBits::eShaderWrite;
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, nullptr, barrier);
+
+            if (noiseCompute.timestamps) {
+                cmdBuffer.resetQueryPool(noiseCompute.timestamps, 0, 2);
+                cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, noiseCompute.timestamps, 0);
+            }
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, noiseCompute.pipeline);
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, noiseCompute.pipelineLayout, 0, noiseCompute.descriptorSet, nullptr);
+            cmdBuffer.pushConstants<NoisePushConsts>(noiseCompute.pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushConsts);
+            // 4 x 4 x 4 local size
+            cmdBuffer.dispatch((textureSize.width + 3) / 4, (textureSize.height + 3) / 4, (textureSize.depth + 3) / 4);
+            if (noiseCompute.timestamps) {
+                cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, noiseCompute.timestamps, 1);
+            }
+
+            // Level 0 is where generateMipmaps expects it, the same as after the CPU path's copy
+            barrier.oldLayout = vk::ImageLayout::eGeneral;
+            barrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
+            barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+            barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite;
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, barrier);
+
+            context.generateMipmaps(cmdBuffer, texture.image, textureCreateInfo);
+        });
+
+        if (noiseCompute.timestamps) {
+            // The command buffer has completed, so the results are available
+            std::array<uint64_t, 2> ticks;
+            const vk::Result result = device.getQueryPoolResults(noiseCompute.timestamps, 0, 2, sizeof(ticks), ticks.data(), sizeof(uint64_t),
+                                                                 vk::QueryResultFlagBits::e64);
+            if (result == vk::Result::eSuccess) {
+                noiseTimings.gpuDispatch = (double)(ticks[1] - ticks[0]) * context.deviceProperties.limits.timestampPeriod / 1.0e6;
+            }
+        }
     }
 
     void updateDrawCommandBuffer(const vk::CommandBuffer& drawCmdBuffer) override {
@@ -344,10 +506,13 @@ public:
     }
 
     void setupDescriptorPool() {
-        // Example uses one ubo and one image sampler
+        // Example uses one ubo and one image sampler, and the noise generator a storage image and buffer
         std::vector<vk::DescriptorPoolSize> poolSizes{
             vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 1 },
             vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 1 },
+            // Noise compute shader
+            vk::DescriptorPoolSize{ vk::DescriptorType::eStorageImage, 1 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 1 },
         };
         descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 2, static_cast<uint32_t>(poolSizes.size()), poolSizes.data() });
     }
@@ -426,8 +591,10 @@ public:
         prepareNoiseTexture(256, 256, 256);
         setupDescriptorSetLayout();
         preparePipelines();
+        prepareNoiseCompute();
         setupDescriptorPool();
         setupDescriptorSet();
+        setupNoiseComputeDescriptorSet();
         buildCommandBuffers();
         prepared = true;
     }
@@ -451,10 +618,22 @@ public:
             if (regenerateNoise) {
                 ui.text("Generating new noise texture...");
             } else {
+                if (noiseCompute.supported) {
+                    ui.checkBox("Generate on GPU", &generateOnGpu);
+                }
                 if (ui.button("Generate new texture")) {
                     regenerateNoise = true;
                 }
             }
+            if (noiseTimings.cpu >= 0.0) {
+                ui.text("CPU: %.1f ms", noiseTimings.cpu);
+            }
+            if (noiseTimings.gpu >= 0.0) {
+                ui.text("GPU: %.1f ms", noiseTimings.gpu);
+                if (noiseTimings.gpuDispatch >= 0.0) {
+                    ui.text("GPU dispatch: %.2f ms", noiseTimings.gpuDispatch);
+                }
+            }
         }
     }
 };
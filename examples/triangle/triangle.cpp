@@ -119,7 +119,7 @@ public:
 
         cmdPool = context.getCommandPool();
 
-        swapChain.setup(context.physicalDevice, context.device, context.queue, context.queueIndices.graphics);
+        swapChain.setup(context.physicalDevice, context.device, context.queue, context.queueIndices.graphics, context.fencePool);
         swapChain.setSurface(surface);
         swapChain.create(size);
 
@@ -160,11 +160,7 @@ public:
         for (const auto& framebuffer : framebuffers) {
             device.destroyFramebuffer(framebuffer);
         }
-        for (const auto& image : swapChain.images) {
-            if (image.fence) {
-                device.destroyFence(image.fence);
-            }
-        }
+        swapChain.releaseSubmitFences();
         swapChain.destroy();
         context.destroy();
     }
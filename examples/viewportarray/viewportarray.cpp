@@ -1,5 +1,8 @@
 /*
-* Vulkan Example - Viewport array with single pass rendering using geometry shaders
+* Vulkan Example - Viewport array with single pass rendering of several views
+*
+* Every view culls the rooms of the scene on its own, and with VK_EXT_shader_viewport_index_layer the vertex shader
+* routes each instance to the viewport of its view, so that all views are drawn by one draw without a geometry shader.
 *
 * Copyright (C) 2017 by Sascha Willems - www.saschawillems.de
 *
@@ -7,6 +10,7 @@
 */
 
 #include <vulkanExampleBase.h>
+#include <vks/viewportarray.hpp>
 
 // Vertex layout for the models
 static const vks::model::VertexLayout VERTEX_LAYOUT{ {
@@ -15,22 +19,28 @@ static const vks::model::VertexLayout VERTEX_LAYOUT{ {
     vks::model::VERTEX_COMPONENT_COLOR,
 } };
 
+// Copies of the room along each horizontal axis
+static const uint32_t GRID_SIZE = 4;
+
 class VulkanExample : public vkx::ExampleBase {
 public:
     vks::model::Model scene;
-
-    struct UBOGS {
-        glm::mat4 projection[2];
-        glm::mat4 modelview[2];
-        glm::vec4 lightPos = glm::vec4(-2.5f, -3.5f, 0.0f, 1.0f);
-    } uboGS;
-
-    vks::Buffer uniformBufferGS;
+    vks::ViewportArray viewportArray;
 
     vk::Pipeline pipeline;
     vk::PipelineLayout pipelineLayout;
-    vk::DescriptorSet descriptorSet;
-    vk::DescriptorSetLayout descriptorSetLayout;
+
+    enum class Layout : int32_t {
+        // The left and right eye side by side
+        Stereo,
+        // The camera, and orthographic top, front and side views of the whole scene
+        Quad,
+    };
+    Layout viewLayout{ Layout::Stereo };
+    bool layered{ false };
+
+    // The extent of the grid of rooms
+    glm::vec3 sceneMin, sceneMax;
 
     // Camera and view properties
     float eyeSeparation = 0.08f;
@@ -46,159 +56,190 @@ public:
         camera.setTranslation(glm::vec3(7.0f, 3.2f, 0.0f));
         camera.movementSpeed = 5.0f;
         settings.overlay = true;
+        context.enableShaderViewportIndexLayer = true;
     }
 
     ~VulkanExample() {
         device.destroy(pipeline);
         device.destroy(pipelineLayout);
-        device.destroy(descriptorSetLayout);
+        viewportArray.destroy();
         scene.destroy();
-        uniformBufferGS.destroy();
     }
 
     // Enable physical device features required for this example
     void getEnabledFeatures() override {
-        // Geometry shader support is required for this example
-        if (!context.deviceFeatures.geometryShader) {
-            throw std::runtime_error("Selected GPU does not support geometry shaders!");
-        }
-        // Multiple viewports must be supported
-        if (!context.deviceFeatures.multiViewport) {
-            throw std::runtime_error("Selected GPU does not support multi viewports!");
+        // Layered draws set several viewports, without them every view is drawn on its own
+        if (context.deviceFeatures.multiViewport) {
+            context.enabledFeatures.multiViewport = VK_TRUE;
         }
     }
 
     void updateDrawCommandBuffer(const vk::CommandBuffer& commandBuffer) override {
-        std::vector<vk::Viewport> viewports{
-            // Left
-            vk::Viewport{ 0.0f, 0.0f, (float)size.width / 2.0f, (float)size.height, 0.0f, 1.0f },
-            // Right
-            vk::Viewport{ (float)size.width / 2.0f, 0.0f, (float)size.width / 2.0f, (float)size.height, 0.0f, 1.0f },
-        };
-        commandBuffer.setViewport(0, viewports);
-
-        std::vector<vk::Rect2D> scissorRects{
-            vk::Rect2D{ vk::Offset2D{
-                            0,
-                            0,
-                        },
-                        vk::Extent2D{ size.width / 2, size.height } },
-            vk::Rect2D{ vk::Offset2D{ (int32_t)size.width / 2, 0 }, vk::Extent2D{ size.width / 2, size.height } },
-        };
-        commandBuffer.setScissor(0, scissorRects);
         commandBuffer.setLineWidth(1.0f);
-        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
         commandBuffer.bindVertexBuffers(0, scene.vertices.buffer, { 0 });
-        commandBuffer.bindIndexBuffer(scene.indices.buffer, 0, vk::IndexType::eUint32);
+        commandBuffer.bindIndexBuffer(scene.indices.buffer, 0, scene.indexType);
         commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
-        commandBuffer.drawIndexed(scene.indexCount, 1, 0, 0, 0);
+        viewportArray.draw(commandBuffer, pipelineLayout);
     }
 
     void loadAssets() override { scene.loadFromFile(context, getAssetPath() + "models/sampleroom.dae", VERTEX_LAYOUT, 0.25f); }
 
-    void setupDescriptorPool() {
-        // Example uses two ubos
-        std::vector<vk::DescriptorPoolSize> poolSizes{
-            { vk::DescriptorType::eUniformBuffer, 1 },
-        };
-        descriptorPool = device.createDescriptorPool({ {}, 1, static_cast<uint32_t>(poolSizes.size()), poolSizes.data() });
-    }
-
-    void setupDescriptorSetLayout() {
-        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
-            { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eGeometry },
-        };
-
-        descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
-        pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
-    }
-
-    void setupDescriptorSet() {
-        descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
-        std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
-            { descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBufferGS.descriptor },
-        };
-
-        device.updateDescriptorSets(writeDescriptorSets, nullptr);
+    void prepareInstances() {
+        layered = vks::ViewportArray::layeredSupported(context);
+        viewportArray.create(context, GRID_SIZE * GRID_SIZE, scene.indexCount, 0, 0, layered);
+
+        const glm::vec3 roomSize = scene.dim.max - scene.dim.min;
+        const glm::vec3 roomCenter = (scene.dim.min + scene.dim.max) * 0.5f;
+        const float radius = glm::length(roomSize) * 0.5f;
+        sceneMin = scene.dim.min;
+        sceneMax = scene.dim.max + glm::vec3(roomSize.x, 0.0f, roomSize.z) * (float)(GRID_SIZE - 1);
+        for (uint32_t z = 0; z < GRID_SIZE; ++z) {
+            for (uint32_t x = 0; x < GRID_SIZE; ++x) {
+                const glm::vec3 offset{ roomSize.x * x, 0.0f, roomSize.z * z };
+                viewportArray.models.push_back(glm::translate(glm::mat4(1.0f), offset));
+                viewportArray.bounds.push_back(roomCenter + offset, radius);
+            }
+        }
     }
 
     void preparePipelines() {
+        if (!pipelineLayout) {
+            const auto pushConstantRange = viewportArray.pushConstantRange();
+            pipelineLayout = device.createPipelineLayout({ {}, 1, &viewportArray.descriptorSetLayout(), 1, &pushConstantRange });
+        }
         vks::pipelines::GraphicsPipelineBuilder pipelineBuilder{ device, pipelineLayout, renderPass };
         pipelineBuilder.rasterizationState.frontFace = vk::FrontFace::eClockwise;
         pipelineBuilder.vertexInputState.appendVertexLayout(VERTEX_LAYOUT);
-        pipelineBuilder.loadShader(getAssetPath() + "shaders/viewportarray/scene.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        viewportArray.setupPipeline(pipelineBuilder);
+        const std::string vertexShader = layered ? "scene_layered.vert.spv" : "scene.vert.spv";
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/viewportarray/" + vertexShader, vk::ShaderStageFlagBits::eVertex);
         pipelineBuilder.loadShader(getAssetPath() + "shaders/viewportarray/scene.frag.spv", vk::ShaderStageFlagBits::eFragment);
-        pipelineBuilder.loadShader(getAssetPath() + "shaders/viewportarray/multiview.geom.spv", vk::ShaderStageFlagBits::eGeometry);
         pipeline = pipelineBuilder.create(context.pipelineCache);
     }
 
-    // Prepare and initialize uniform buffer containing shader uniforms
-    void prepareUniformBuffers() {
-        // Geometry shader uniform buffer block
-        uniformBufferGS = context.createUniformBuffer(uboGS);
-        updateUniformBuffers();
+    // The viewport, and its scissor, of `width` by `height` at `x`, `y`
+    static vks::ViewportArray::View viewAt(float x, float y, float width, float height) {
+        vks::ViewportArray::View view;
+        view.viewport = vk::Viewport{ x, y, width, height, 0.0f, 1.0f };
+        view.scissor = vk::Rect2D{ vk::Offset2D{ (int32_t)x, (int32_t)y }, vk::Extent2D{ (uint32_t)width, (uint32_t)height } };
+        return view;
     }
 
-    void updateUniformBuffers() {
-        // Geometry shader matrices for the two viewports
-        // See http://paulbourke.net/stereographics/stereorender/
+    glm::mat4 cameraRotation() const {
+        glm::mat4 rotM = glm::mat4(1.0f);
+        rotM = glm::rotate(rotM, glm::radians(camera.rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+        rotM = glm::rotate(rotM, glm::radians(camera.rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+        rotM = glm::rotate(rotM, glm::radians(camera.rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+        return rotM;
+    }
 
-        // Calculate some variables
-        float aspectRatio = (float)(size.width * 0.5f) / (float)size.height;
+    void setupStereoViews() {
+        // See http://paulbourke.net/stereographics/stereorender/
+        const float width = (float)size.width * 0.5f;
+        const float height = (float)size.height;
+        float aspectRatio = width / height;
         float wd2 = zNear * tan(glm::radians(fov / 2.0f));
         float ndfl = zNear / focalLength;
-        float left, right;
         float top = wd2;
         float bottom = -wd2;
 
         glm::vec3 camFront = camera.getFront();
         glm::vec3 camRight = glm::normalize(glm::cross(camFront, glm::vec3(0.0f, 1.0f, 0.0f)));
-        glm::mat4 rotM = glm::mat4(1.0f);
-        glm::mat4 transM;
-
-        rotM = glm::rotate(rotM, glm::radians(camera.rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-        rotM = glm::rotate(rotM, glm::radians(camera.rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-        rotM = glm::rotate(rotM, glm::radians(camera.rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
-
-        // Left eye
-        left = -aspectRatio * wd2 + 0.5f * eyeSeparation * ndfl;
-        right = aspectRatio * wd2 + 0.5f * eyeSeparation * ndfl;
-
-        transM = glm::translate(glm::mat4(1.0f), camera.position - camRight * (eyeSeparation / 2.0f));
-
-        uboGS.projection[0] = glm::frustum(left, right, bottom, top, zNear, zFar);
-        uboGS.modelview[0] = rotM * transM;
-
-        // Right eye
-        left = -aspectRatio * wd2 - 0.5f * eyeSeparation * ndfl;
-        right = aspectRatio * wd2 - 0.5f * eyeSeparation * ndfl;
+        const glm::mat4 rotM = cameraRotation();
+
+        for (uint32_t eye = 0; eye < 2; ++eye) {
+            // The left eye is shifted left and its frustum right, the right eye the other way around
+            const float side = eye ? 1.0f : -1.0f;
+            const float shift = 0.5f * eyeSeparation * ndfl * side;
+            auto view = viewAt(width * eye, 0.0f, width, height);
+            view.projection = glm::frustum(-aspectRatio * wd2 - shift, aspectRatio * wd2 - shift, bottom, top, zNear, zFar);
+            view.view = rotM * glm::translate(glm::mat4(1.0f), camera.position + camRight * (side * eyeSeparation / 2.0f));
+            viewportArray.views.push_back(view);
+        }
+    }
 
-        transM = glm::translate(glm::mat4(1.0f), camera.position + camRight * (eyeSeparation / 2.0f));
+    void setupQuadViews() {
+        const float width = (float)size.width * 0.5f;
+        const float height = (float)size.height * 0.5f;
+        const float aspectRatio = width / height;
+
+        auto perspective = viewAt(0.0f, 0.0f, width, height);
+        perspective.projection = glm::perspective(glm::radians(fov), aspectRatio, zNear, zFar);
+        perspective.view = cameraRotation() * glm::translate(glm::mat4(1.0f), camera.position);
+        viewportArray.views.push_back(perspective);
+
+        // Orthographic views fitting the whole grid, from above, the front and the side
+        const glm::vec3 center = (sceneMin + sceneMax) * 0.5f;
+        const float radius = glm::length(sceneMax - sceneMin) * 0.5f;
+        const glm::mat4 projection = glm::ortho(-radius * aspectRatio, radius * aspectRatio, -radius, radius, 0.0f, radius * 4.0f);
+        const std::array<std::pair<glm::vec3, glm::vec3>, 3> directions{ {
+            { glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f) },
+            { glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f) },
+            { glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f) },
+        } };
+        for (uint32_t i = 0; i < directions.size(); ++i) {
+            const uint32_t quadrant = i + 1;
+            auto view = viewAt(width * (quadrant % 2), height * (quadrant / 2), width, height);
+            view.projection = projection;
+            view.view = glm::lookAt(center - directions[i].first * radius * 2.0f, center, directions[i].second);
+            viewportArray.views.push_back(view);
+        }
+    }
 
-        uboGS.projection[1] = glm::frustum(left, right, bottom, top, zNear, zFar);
-        uboGS.modelview[1] = rotM * transM;
+    void updateViews() {
+        viewportArray.views.clear();
+        switch (viewLayout) {
+            case Layout::Stereo:
+                setupStereoViews();
+                break;
+            case Layout::Quad:
+                setupQuadViews();
+                break;
+        }
+        viewportArray.update();
+    }
 
-        memcpy(uniformBufferGS.mapped, &uboGS, sizeof(uboGS));
+    // The number of views, and so the viewports of the pipeline and command buffers, changed
+    void layoutChanged() {
+        updateViews();
+        context.queue.waitIdle();
+        device.destroy(pipeline);
+        preparePipelines();
+        buildCommandBuffers();
     }
 
     void prepare() override {
         ExampleBase::prepare();
         loadAssets();
-        prepareUniformBuffers();
-        setupDescriptorSetLayout();
+        prepareInstances();
+        updateViews();
         preparePipelines();
-        setupDescriptorPool();
-        setupDescriptorSet();
         buildCommandBuffers();
         prepared = true;
     }
 
-    void viewChanged() override { updateUniformBuffers(); }
+    // The views have projections and viewports of their own, which a pre-rotated swap chain would need rotated too
+    bool supportsPreRotation() const override { return false; }
+
+    void viewChanged() override { updateViews(); }
+
+    void windowResized() override { updateViews(); }
 
     void OnUpdateUIOverlay() override {
         if (ui.header("Settings")) {
-            if (ui.sliderFloat("Eye separation", &eyeSeparation, -1.0f, 1.0f)) {
-                updateUniformBuffers();
+            int32_t layoutIndex = (int32_t)viewLayout;
+            if (ui.comboBox("Views", &layoutIndex, { "Stereo", "Quad" })) {
+                viewLayout = (Layout)layoutIndex;
+                layoutChanged();
+            }
+            if (viewLayout == Layout::Stereo && ui.sliderFloat("Eye separation", &eyeSeparation, -1.0f, 1.0f)) {
+                updateViews();
+            }
+        }
+        if (ui.header("Statistics")) {
+            ui.text(layered ? "One layered draw" : "One draw per view");
+            for (uint32_t v = 0; v < viewportArray.views.size(); ++v) {
+                ui.text("View %u: %u of %u rooms", v, viewportArray.visibleCount(v), GRID_SIZE * GRID_SIZE);
             }
         }
     }
@@ -123,6 +123,11 @@ public:
     vk::Semaphore blitComplete;
     std::vector<vk::CommandBuffer> oculusBlitCommands;
     std::vector<vk::CommandBuffer> mirrorBlitCommands;
+    // Signalled by the Oculus blit of every frame, a frame's latch slot is only written once the frame that used it
+    // last has completed
+    std::array<vk::Fence, vkx::ShapesRenderer::LATCH_SLOTS> latchFences;
+    // When update() sampled the poses the frame would have been drawn with, without late latching
+    double updateTime{ 0.0 };
 
     ~OculusExample() {
         // Shut down Oculus
@@ -156,6 +161,8 @@ public:
             _viewScaleDesc.HmdToEyePose[eye] = erd.HmdToEyePose;
 
             ovrFovPort& fov = _sceneLayer.Fov[eye] = erd.Fov;
+            // Foveate around the center of the lens, where the asymmetric frustum is centered
+            shapesRenderer->foveation.centers[eye] = glm::vec2{ fov.LeftTan / (fov.LeftTan + fov.RightTan), fov.UpTan / (fov.UpTan + fov.DownTan) };
             auto eyeSize = ovr_GetFovTextureSize(_session, eye, fov, 1.0f);
             _sceneLayer.Viewport[eye].Size = eyeSize;
             _sceneLayer.Viewport[eye].Pos = { (int)renderTargetSize.x, 0 };
@@ -200,10 +207,9 @@ public:
             oculusBlitCommands = context.device.allocateCommandBuffers(cmdBufAllocateInfo);
         }
 
-        vk::ImageBlit sceneBlit;
-        sceneBlit.dstSubresource.aspectMask = sceneBlit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-        sceneBlit.dstSubresource.layerCount = sceneBlit.srcSubresource.layerCount = 1;
-        sceneBlit.dstOffsets[1] = sceneBlit.srcOffsets[1] = vk::Offset3D{ (int32_t)renderTargetSize.x, (int32_t)renderTargetSize.y, 1 };
+        // The eye viewports of the scene layer are side by side, multiview eye layers are copied into them.  Filtered, as
+        // the eyes may have been rendered at a lower resolution than the layer's
+        const auto sceneBlits = eyeBlits(renderTargetSize);
         for (int i = 0; i < oculusSwapchainLength; ++i) {
             vk::CommandBuffer& cmdBuffer = oculusBlitCommands[i];
             VkImage oculusImage;
@@ -214,7 +220,7 @@ public:
             cmdBuffer.begin(vk::CommandBufferBeginInfo{});
             context.setImageLayout(cmdBuffer, oculusImage, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
             cmdBuffer.blitImage(shapesRenderer->framebuffer.colors[0].image, vk::ImageLayout::eTransferSrcOptimal, oculusImage,
-                                vk::ImageLayout::eTransferDstOptimal, sceneBlit, vk::Filter::eNearest);
+                                vk::ImageLayout::eTransferDstOptimal, sceneBlits, vk::Filter::eLinear);
             context.setImageLayout(cmdBuffer, oculusImage, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eTransferDstOptimal,
                                    vk::ImageLayout::eTransferSrcOptimal);
             cmdBuffer.end();
@@ -266,6 +272,9 @@ public:
         prepareOculusSwapchain();
         prepareOculusMirror();
         blitComplete = context.device.createSemaphore({});
+        for (auto& fence : latchFences) {
+            fence = context.device.createFence({ vk::FenceCreateFlagBits::eSignaled });
+        }
     }
 
     void prepare() {
@@ -293,14 +302,19 @@ public:
         }
 
         ovr_WaitToBeginFrame(_session, frameCounter);
+        sampleEyeViews();
+        updateTime = _sceneLayer.SensorSampleTime;
+        Parent::update(delta);
+    }
+
+    // Sample the eye views predicted for the display of this frame, which the compositor's time warp corrects from
+    // the render poses of the layer, and return how far ahead of it they were sampled
+    float sampleEyeViews() {
         ovr::EyePoses eyePoses;
         ovr_GetEyePoses(_session, frameCounter, true, _viewScaleDesc.HmdToEyePose, eyePoses.data(), &_sceneLayer.SensorSampleTime);
         eyeViews = std::array<glm::mat4, 2>{ glm::inverse(ovr::toGlm(eyePoses[0])), glm::inverse(ovr::toGlm(eyePoses[1])) };
-        ovr::for_each_eye([&](ovrEyeType eye) {
-            const auto& vp = _sceneLayer.Viewport[eye];
-            _sceneLayer.RenderPose[eye] = eyePoses[eye];
-        });
-        Parent::update(delta);
+        ovr::for_each_eye([&](ovrEyeType eye) { _sceneLayer.RenderPose[eye] = eyePoses[eye]; });
+        return (float)(ovr_GetPredictedDisplayTime(_session, frameCounter) - _sceneLayer.SensorSampleTime);
     }
 
     void render() {
@@ -311,6 +325,12 @@ public:
         ovrResult result;
         result = ovr_BeginFrame(_session, frameCounter);
 
+        const vk::Fence& latchFence = latchFences[frameCounter % latchFences.size()];
+        context.device.waitForFences(latchFence, VK_TRUE, UINT64_MAX);
+        context.device.resetFences(latchFence);
+        const double sampleTime = updateTime;
+        const auto secondsToPhotons = sampleEyeViews();
+        latchPoses(secondsToPhotons, (float)(_sceneLayer.SensorSampleTime - sampleTime));
         shapesRenderer->render();
 
         int oculusIndex;
@@ -320,7 +340,8 @@ public:
         }
 
         // Blit from our framebuffer to the Oculus output image (pre-recorded command buffer)
-        context.submit(oculusBlitCommands[oculusIndex], { { shapesRenderer->semaphores.renderComplete, vk::PipelineStageFlagBits::eColorAttachmentOutput } });
+        context.submit(oculusBlitCommands[oculusIndex], { { shapesRenderer->semaphores.renderComplete, vk::PipelineStageFlagBits::eColorAttachmentOutput } },
+                       {}, latchFence);
 
         // The lack of explicit synchronization here is baffling.  One of these calls must be blocking,
         // meaning there would have to be some backend use of waitIdle or fences, meaning less optimal
@@ -345,7 +366,7 @@ public:
 
     std::string getWindowTitle() {
         std::string device(context.deviceProperties.deviceName);
-        return "Oculus SDK Example " + device + " - " + std::to_string((int)lastFPS) + " fps";
+        return "Oculus SDK Example " + device + " - " + std::to_string((int)lastFPS) + " fps, " + getLatencyText();
     }
 };
 
@@ -101,13 +101,15 @@ public:
 
     size_t frameIndex{ 0 };
 
-    using EyeImages = std::array<vks::Image, 2>;
-    using StagingImages = std::array<EyeImages, FRAME_LAG>;
-    StagingImages stagingImages;
-    std::array<std::vector<vk::CommandBuffer>, FRAME_LAG> stagingBlitCommands;
-    std::array<vk::Semaphore, FRAME_LAG> stagingBlitCompletes;
     std::array<vk::Fence, FRAME_LAG> frameFences;
-
+    static_assert(FRAME_LAG <= vkx::ShapesRenderer::LATCH_SLOTS, "Latched poses would overwrite those of frames in flight");
+    // When update() sampled the poses the frame would have been drawn with, without late latching
+    std::chrono::high_resolution_clock::time_point updateTime;
+
+    // Both eyes are submitted straight from the side by side render target, each with the bounds of its half,
+    // which the compositor copies from on the graphics queue.  The window only shows a filtered, downsampled copy
+    // of it when `mirror` is set, toggled with M.
+    bool mirror{ true };
     vk::Semaphore mirrorBlitComplete;
     std::vector<vk::CommandBuffer> mirrorBlitCommands;
 
@@ -119,6 +121,13 @@ public:
 
     void recenter() override { vrSystem->ResetSeatedZeroPose(); }
 
+    void onKeyEvent(int key, int scancode, int action, int mods) override {
+        if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+            mirror = !mirror;
+        }
+        Parent::onKeyEvent(key, scancode, action, mods);
+    }
+
     void prepareOpenVr() {
         vr::EVRInitError eError;
         vrSystem = vr::VR_Init(&eError, vr::VRApplication_Scene);
@@ -134,6 +143,10 @@ public:
         openvr::for_each_eye([&](vr::Hmd_Eye eye) {
             eyeOffsets[eye] = openvr::toGlm(vrSystem->GetEyeToHeadTransform(eye));
             eyeProjections[eye] = openvr::toGlm(vrSystem->GetProjectionMatrix(eye, 0.1f, 256.0f));
+            // Foveate around the center of the lens, where the asymmetric frustum is centered
+            float left, right, top, bottom;
+            vrSystem->GetProjectionRaw(eye, &left, &right, &top, &bottom);
+            shapesRenderer->foveation.centers[eye] = glm::vec2{ -left / (right - left), -top / (bottom - top) };
             // FIXME Strange distortion and inverted Z view when doing this, but correct head tracking
             //eyeProjections[eye][1][1] *= -1.0f;
         });
@@ -153,11 +166,7 @@ public:
             mirrorBlitCommands = context.device.allocateCommandBuffers(cmdBufAllocateInfo);
         }
 
-        vk::ImageBlit mirrorBlit;
-        mirrorBlit.dstSubresource.aspectMask = mirrorBlit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-        mirrorBlit.dstSubresource.layerCount = mirrorBlit.srcSubresource.layerCount = 1;
-        mirrorBlit.srcOffsets[1] = vk::Offset3D{ (int32_t)renderTargetSize.x, (int32_t)renderTargetSize.y, 1 };
-        mirrorBlit.dstOffsets[1] = vk::Offset3D{ (int32_t)size.x, (int32_t)size.y, 1 };
+        const auto mirrorBlits = eyeBlits(size);
 
         for (size_t i = 0; i < swapchain.imageCount; ++i) {
             vk::CommandBuffer& cmdBuffer = mirrorBlitCommands[i];
@@ -166,70 +175,14 @@ public:
             context.setImageLayout(cmdBuffer, swapchain.images[i].image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined,
                                    vk::ImageLayout::eTransferDstOptimal);
             cmdBuffer.blitImage(shapesRenderer->framebuffer.colors[0].image, vk::ImageLayout::eTransferSrcOptimal, swapchain.images[i].image,
-                                vk::ImageLayout::eTransferDstOptimal, mirrorBlit, vk::Filter::eNearest);
+                                vk::ImageLayout::eTransferDstOptimal, mirrorBlits, vk::Filter::eLinear);
             context.setImageLayout(cmdBuffer, swapchain.images[i].image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eTransferDstOptimal,
                                    vk::ImageLayout::ePresentSrcKHR);
             cmdBuffer.end();
         }
     }
 
-    void prepareStagingImages() {
-        vk::ImageCreateInfo imageCreate;
-        imageCreate.imageType = vk::ImageType::e2D;
-        imageCreate.extent = vk::Extent3D{ renderTargetSize.x / 2, renderTargetSize.y, 1 };
-        imageCreate.format = vk::Format::eR8G8B8A8Srgb;
-        imageCreate.mipLevels = 1;
-        imageCreate.arrayLayers = 1;
-        imageCreate.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eSampled;
-
-        for (size_t frame = 0; frame < FRAME_LAG; ++frame) {
-            for (size_t eye = 0; eye < 2; ++eye) {
-                stagingImages[frame][eye] = context.createImage(imageCreate);
-            }
-        }
-    }
-
-    void prepareStagingBlit() {
-        for (size_t frame = 0; frame < FRAME_LAG; ++frame) {
-            stagingBlitCompletes[frame] = context.device.createSemaphore({});
-
-            auto& blitCommands = stagingBlitCommands[frame];
-            if (blitCommands.empty()) {
-                vk::CommandBufferAllocateInfo cmdBufAllocateInfo;
-                cmdBufAllocateInfo.commandPool = context.getCommandPool();
-                cmdBufAllocateInfo.commandBufferCount = 2;
-                blitCommands = context.device.allocateCommandBuffers(cmdBufAllocateInfo);
-            }
-
-            for (size_t eye = 0; eye < 2; ++eye) {
-                vk::ImageBlit blit;
-                blit.dstSubresource.aspectMask = blit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-                blit.dstSubresource.layerCount = blit.srcSubresource.layerCount = 1;
-                blit.srcOffsets[1] = vk::Offset3D{ (int32_t)renderTargetSize.x / 2, (int32_t)renderTargetSize.y, 1 };
-                blit.dstOffsets[1] = vk::Offset3D{ (int32_t)renderTargetSize.x / 2, (int32_t)renderTargetSize.y, 1 };
-                // Offset the source image for the right eye
-                if (eye == vr::Eye_Right) {
-                    blit.srcOffsets[0].x = (int32_t)renderTargetSize.x / 2;
-                    blit.srcOffsets[1].x += (int32_t)renderTargetSize.x / 2;
-                }
-                vk::CommandBuffer& cmdBuffer = blitCommands[eye];
-                cmdBuffer.reset(vk::CommandBufferResetFlagBits::eReleaseResources);
-                cmdBuffer.begin(vk::CommandBufferBeginInfo{});
-                const auto& stagingImage = stagingImages[frame][eye];
-                context.setImageLayout(cmdBuffer, stagingImage.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined,
-                                       vk::ImageLayout::eTransferDstOptimal);
-                cmdBuffer.blitImage(shapesRenderer->framebuffer.colors[0].image, vk::ImageLayout::eTransferSrcOptimal, stagingImage.image,
-                                    vk::ImageLayout::eTransferDstOptimal, blit, vk::Filter::eNearest);
-                context.setImageLayout(cmdBuffer, stagingImage.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eTransferDstOptimal,
-                                       vk::ImageLayout::eGeneral);
-                cmdBuffer.end();
-            }
-        }
-    }
-
     void prepareOpenVrVk() {
-        prepareStagingImages();
-        prepareStagingBlit();
         prepareMirrorBlit();
         for (size_t frame = 0; frame < FRAME_LAG; ++frame) {
             frameFences[frame] = context.device.createFence({ vk::FenceCreateFlagBits::eSignaled });
@@ -242,14 +195,16 @@ public:
         prepareOpenVrVk();
     }
 
-    void update(float delta) {
-        vr::TrackedDevicePose_t currentTrackedDevicePose[vr::k_unMaxTrackedDeviceCount];
-        vrCompositor->WaitGetPoses(currentTrackedDevicePose, vr::k_unMaxTrackedDeviceCount, nullptr, 0);
+    // Sample the eye views predicted for the display of the frame WaitGetPoses last waited for, and return how far
+    // ahead of it they were sampled
+    float sampleEyeViews() {
         vr::TrackedDevicePose_t _trackedDevicePose[vr::k_unMaxTrackedDeviceCount];
         float displayFrequency = vrSystem->GetFloatTrackedDeviceProperty(vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_DisplayFrequency_Float);
         float frameDuration = 1.f / displayFrequency;
         float vsyncToPhotons = vrSystem->GetFloatTrackedDeviceProperty(vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_SecondsFromVsyncToPhotons_Float);
-        float predictedDisplayTime = frameDuration + vsyncToPhotons;
+        float secondsSinceLastVsync{ 0.0f };
+        vrSystem->GetTimeSinceLastVsync(&secondsSinceLastVsync, nullptr);
+        float predictedDisplayTime = std::max(frameDuration - secondsSinceLastVsync, 0.0f) + vsyncToPhotons;
         vrSystem->GetDeviceToAbsoluteTrackingPose(vr::TrackingUniverseStanding, (float)predictedDisplayTime, _trackedDevicePose, vr::k_unMaxTrackedDeviceCount);
         auto basePose = openvr::toGlm(_trackedDevicePose[vr::k_unTrackedDeviceIndex_Hmd].mDeviceToAbsoluteTracking);
         auto baseRotation = glm::quat_cast(glm::mat3(basePose));
@@ -257,6 +212,14 @@ public:
         basePose = glm::mat4_cast(baseRotation);
 
         eyeViews = std::array<glm::mat4, 2>{ glm::inverse(basePose * eyeOffsets[0]), glm::inverse(basePose * eyeOffsets[1]) };
+        return predictedDisplayTime;
+    }
+
+    void update(float delta) {
+        vr::TrackedDevicePose_t currentTrackedDevicePose[vr::k_unMaxTrackedDeviceCount];
+        vrCompositor->WaitGetPoses(currentTrackedDevicePose, vr::k_unMaxTrackedDeviceCount, nullptr, 0);
+        sampleEyeViews();
+        updateTime = std::chrono::high_resolution_clock::now();
         Parent::update(delta);
     }
 
@@ -264,52 +227,67 @@ public:
         context.device.waitForFences(frameFences[frameIndex], VK_TRUE, UINT64_MAX);
         context.device.resetFences(frameFences[frameIndex]);
 
-        auto currentImageResult = swapchain.acquireNextImage(shapesRenderer->semaphores.renderStart, frameFences[frameIndex]);
-        auto currentImage = currentImageResult.value;
-
-        shapesRenderer->render();
-
-        // Perform both eye blits and the mirror blit concurrently
-        context.submit({ stagingBlitCommands[frameIndex][vr::Eye_Left], stagingBlitCommands[frameIndex][vr::Eye_Right], mirrorBlitCommands[currentImage] },
-                       { { shapesRenderer->semaphores.renderComplete, vk::PipelineStageFlagBits::eColorAttachmentOutput } },
-                       { stagingBlitCompletes[frameIndex] });
+        const bool mirrored = mirror;
+        uint32_t currentImage = 0;
+        if (mirrored) {
+            currentImage = swapchain.acquireNextImage(shapesRenderer->semaphores.renderStart).value;
+        }
+        // The frame FRAME_LAG renders ago is complete, so its latch slot is free for the poses sampled now
+        const auto secondsToPhotons = sampleEyeViews();
+        latchPoses(secondsToPhotons, std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - updateTime).count());
+        if (mirrored) {
+            shapesRenderer->render();
+            context.submit(mirrorBlitCommands[currentImage], { { shapesRenderer->semaphores.renderComplete, vk::PipelineStageFlagBits::eTransfer } },
+                           { mirrorBlitComplete }, frameFences[frameIndex]);
+        } else {
+            shapesRenderer->render({}, {}, frameFences[frameIndex]);
+        }
 
         //-----------------------------------------------------------------------------------------
-        // OpenVR BEGIN: Submit eyes to compositor, left eye just rendered
+        // OpenVR BEGIN: Submit eyes to compositor
         //-----------------------------------------------------------------------------------------
-        vr::VRTextureBounds_t textureBounds;
-        textureBounds.uMin = 0.0f;
-        textureBounds.uMax = 1.0f;
-        textureBounds.vMin = 0.0f;
-        textureBounds.vMax = 1.0f;
-
-        vr::VRVulkanTextureData_t vulkanData;
+        // The render target is left in the transfer source layout the compositor expects.  Its copies go into the
+        // queue after the rendering, and the next frame's render pass waits for transfers before clearing it.
+        const auto& renderTarget = shapesRenderer->framebuffer.colors[0];
+        // A multiview target holds an eye per layer, which the compositor takes as a texture array
+        vr::VRVulkanTextureArrayData_t vulkanData;
+        vulkanData.m_nImage = (uint64_t)(VkImage)renderTarget.image;
         vulkanData.m_pDevice = (VkDevice_T*)context.device;
         vulkanData.m_pPhysicalDevice = (VkPhysicalDevice_T*)context.physicalDevice;
         vulkanData.m_pInstance = (VkInstance_T*)context.instance;
         vulkanData.m_pQueue = (VkQueue_T*)context.queue;
         vulkanData.m_nQueueFamilyIndex = context.queueIndices.graphics;
-        vulkanData.m_nWidth = renderTargetSize.x / 2;
-        vulkanData.m_nHeight = renderTargetSize.y;
-        vulkanData.m_nFormat = (uint32_t)stagingImages[frameIndex][vr::Eye_Left].format;
+        vulkanData.m_nWidth = shapesRenderer->framebufferSize.x;
+        vulkanData.m_nHeight = shapesRenderer->framebufferSize.y;
+        vulkanData.m_nFormat = (uint32_t)renderTarget.format;
         vulkanData.m_nSampleCount = 1;
+        vulkanData.m_unArraySize = shapesRenderer->viewCount;
         vr::Texture_t texture = { &vulkanData, vr::TextureType_Vulkan, vr::ColorSpace_Auto };
 
-        // Submit left eye
-        vulkanData.m_nImage = (uint64_t)(VkImage)stagingImages[frameIndex][vr::Eye_Left].image;
-        vr::VRCompositor()->Submit(vr::Eye_Left, &texture, &textureBounds);
-
-        // Submit right eye
-        vulkanData.m_nImage = (uint64_t)(VkImage)stagingImages[frameIndex][vr::Eye_Right].image;
-        vr::VRCompositor()->Submit(vr::Eye_Right, &texture, &textureBounds);
+        const bool multiview = shapesRenderer->multiview;
+        openvr::for_each_eye([&](vr::Hmd_Eye eye) {
+            vr::VRTextureBounds_t textureBounds;
+            textureBounds.uMin = eye == vr::Eye_Left || multiview ? 0.0f : 0.5f;
+            textureBounds.uMax = textureBounds.uMin + (multiview ? 1.0f : 0.5f);
+            textureBounds.vMin = 0.0f;
+            textureBounds.vMax = 1.0f;
+            if (multiview) {
+                vulkanData.m_unArrayIndex = eye == vr::Eye_Left ? 0 : 1;
+                vrCompositor->Submit(eye, &texture, &textureBounds, vr::Submit_VulkanTextureWithArrayData);
+            } else {
+                vrCompositor->Submit(eye, &texture, &textureBounds);
+            }
+        });
 
-        swapchain.queuePresent(stagingBlitCompletes[frameIndex]);
+        if (mirrored) {
+            swapchain.queuePresent(mirrorBlitComplete);
+        }
         frameIndex = (frameIndex + 1) % FRAME_LAG;
     }
 
     std::string getWindowTitle() {
         std::string device(context.deviceProperties.deviceName);
-        return "OpenVR SDK Example " + device + " - " + std::to_string((int)lastFPS) + " fps";
+        return "OpenVR SDK Example " + device + " - " + std::to_string((int)lastFPS) + " fps, " + getLatencyText();
     }
 };
 
@@ -11,6 +11,7 @@
 */
 
 #include <vulkanExampleBase.h>
+#include <vks/drawlist.hpp>
 
 static std::vector<std::string> names{ "logos", "background", "models", "skybox" };
 
@@ -53,6 +54,10 @@ public:
 
     glm::vec4 lightPos = glm::vec4(1.0f, 2.0f, 0.0f, 0.0f);
 
+    // Background and models share a pipeline, which sorting puts next to each other
+    vks::DrawList drawList;
+    vks::DrawList::Stats drawStats;
+
     VulkanExample() {
         size.width = 1280;
         size.height = 720;
@@ -86,21 +91,30 @@ public:
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
         cmdBuffer.setViewport(0, vks::util::viewport(size));
         cmdBuffer.setScissor(0, vks::util::rect2D(size));
-        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
-        std::array<DemoMesh*, 4> meshes{ {
-            &demoMeshes.skybox,
-            &demoMeshes.background,
-            &demoMeshes.logos,
-            &demoMeshes.models,
+        // Pipeline ids in drawing order, the skybox first
+        std::array<std::pair<DemoMesh*, uint32_t>, 4> meshes{ {
+            { &demoMeshes.skybox, 0 },
+            { &demoMeshes.background, 1 },
+            { &demoMeshes.logos, 2 },
+            { &demoMeshes.models, 1 },
         } };
-        for (auto& meshPtr : meshes) {
-            const auto& pipeline = meshPtr->second;
-            const auto& mesh = meshPtr->first;
-            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
-            cmdBuffer.bindVertexBuffers(0, mesh.vertices.buffer, { 0 });
-            cmdBuffer.bindIndexBuffer(mesh.indices.buffer, 0, vk::IndexType::eUint32);
-            cmdBuffer.drawIndexed(mesh.indexCount, 1, 0, 0, 0);
+        drawList.clear();
+        for (const auto& entry : meshes) {
+            const auto& mesh = entry.first->first;
+            vks::DrawList::Draw draw;
+            draw.key = vks::DrawList::opaqueKey(entry.second, 0, 0);
+            draw.pipeline = entry.first->second;
+            draw.layout = pipelineLayout;
+            draw.setCount = 1;
+            draw.sets[0] = descriptorSet;
+            draw.vertexBuffer = mesh.vertices.buffer;
+            draw.indexBuffer = mesh.indices.buffer;
+            draw.indexType = mesh.indexType;
+            draw.indexCount = mesh.indexCount;
+            drawList.add(draw);
         }
+        drawList.sort();
+        drawStats = drawList.record(cmdBuffer);
     }
 
     vks::model::VertexLayout vertexLayout{ {
@@ -226,6 +240,20 @@ public:
 
     void prepare() override {
         ExampleBase::prepare();
+        // Queue up all the reads so the disk is busy while earlier files are being decoded
+        vks::file::prefetch({
+            getAssetPath() + "textures/cubemap_vulkan.ktx",
+            getAssetPath() + "models/vulkanscenelogos.dae",
+            getAssetPath() + "models/vulkanscenebackground.dae",
+            getAssetPath() + "models/vulkanscenemodels.dae",
+            getAssetPath() + "models/cube.obj",
+            getAssetPath() + "shaders/vulkanscene/mesh.vert.spv",
+            getAssetPath() + "shaders/vulkanscene/mesh.frag.spv",
+            getAssetPath() + "shaders/vulkanscene/logo.vert.spv",
+            getAssetPath() + "shaders/vulkanscene/logo.frag.spv",
+            getAssetPath() + "shaders/vulkanscene/skybox.vert.spv",
+            getAssetPath() + "shaders/vulkanscene/skybox.frag.spv",
+        });
         loadTextures();
         prepareVertices();
         prepareUniformBuffers();
@@ -238,6 +266,13 @@ public:
     }
 
     void viewChanged() override { updateUniformBuffers(); }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Statistics")) {
+            ui.text("Draws: %u", drawStats.draws);
+            ui.text("Binds: %u of %u, %u saved", drawStats.binds, drawStats.naiveBinds, drawStats.saved());
+        }
+    }
 };
 
 RUN_EXAMPLE(VulkanExample)
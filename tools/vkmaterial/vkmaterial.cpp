@@ -0,0 +1,163 @@
+/*
+* Material texture packer
+*
+* Packs the separate maps of a metal/roughness material into the layout examples/pbrtexture samples with two fetches
+* instead of four:
+*
+*   vkmaterial <ao> <roughness> <metallic> <normal> <orm> <normal bc5>
+*
+* Ambient occlusion, roughness and metallic go into the red, green and blue channels of one RGBA8 texture, in the
+* order glTF uses.  The tangent space normals are renormalized and compressed to BC5, which keeps x and y at twice
+* the precision of BC1/BC3 color, and the shader rebuilds z.  The maps have to have the same size and number of mip
+* levels, which are packed level by level, and 8 bit channels, of which the first is used for the single channel maps.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <gli/gli.hpp>
+
+namespace {
+
+struct Map {
+    gli::texture2d texture;
+    std::string filename;
+    size_t components{ 0 };
+
+    uint8_t texel(size_t level, uint32_t x, uint32_t y, size_t component) const {
+        const auto image = texture[level];
+        const uint32_t width = static_cast<uint32_t>(image.extent().x);
+        return static_cast<const uint8_t*>(image.data())[(y * width + x) * components + component];
+    }
+};
+
+Map loadMap(const std::string& filename, size_t minComponents) {
+    Map result;
+    result.filename = filename;
+    result.texture = gli::texture2d(gli::load(filename));
+    if (result.texture.empty()) {
+        throw std::runtime_error("Failed to load " + filename);
+    }
+    const gli::format format = result.texture.format();
+    result.components = gli::component_count(format);
+    if (gli::is_compressed(format) || gli::block_size(format) != result.components || result.components < minComponents) {
+        throw std::runtime_error(filename + " needs at least " + std::to_string(minComponents) + " uncompressed 8 bit channels");
+    }
+    return result;
+}
+
+void checkShape(const Map& map, const Map& reference) {
+    if (map.texture.extent() != reference.texture.extent() || map.texture.levels() != reference.texture.levels()) {
+        throw std::runtime_error(map.filename + " doesn't have the size and mip levels of " + reference.filename);
+    }
+}
+
+// One BC4 block of the 16 values of a 4x4 texel block, in the mode with six interpolated values between the endpoints
+void encodeBC4(const uint8_t values[16], uint8_t* block) {
+    const uint8_t high = *std::max_element(values, values + 16);
+    const uint8_t low = *std::min_element(values, values + 16);
+    block[0] = high;
+    block[1] = low;
+    uint64_t indices = 0;
+    if (high != low) {
+        // Index 0 is the high endpoint, 1 the low one, and 2 to 7 step from high to low
+        const uint32_t steps[8] = { 0, 7, 1, 2, 3, 4, 5, 6 };
+        for (uint32_t i = 0; i < 16; ++i) {
+            const uint32_t step = (uint32_t)std::lround(7.0 * (high - values[i]) / (high - low));
+            const uint32_t index = static_cast<uint32_t>(std::find(steps, steps + 8, step) - steps);
+            indices |= (uint64_t)index << (3 * i);
+        }
+    }
+    for (uint32_t i = 0; i < 6; ++i) {
+        block[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+    }
+}
+
+gli::texture2d packORM(const Map& ao, const Map& roughness, const Map& metallic) {
+    gli::texture2d result(gli::FORMAT_RGBA8_UNORM_PACK8, ao.texture.extent(), ao.texture.levels());
+    for (size_t level = 0; level < result.levels(); ++level) {
+        const auto extent = result[level].extent();
+        uint8_t* texel = static_cast<uint8_t*>(result[level].data());
+        for (uint32_t y = 0; y < (uint32_t)extent.y; ++y) {
+            for (uint32_t x = 0; x < (uint32_t)extent.x; ++x) {
+                *texel++ = ao.texel(level, x, y, 0);
+                *texel++ = roughness.texel(level, x, y, 0);
+                *texel++ = metallic.texel(level, x, y, 0);
+                *texel++ = 255;
+            }
+        }
+    }
+    return result;
+}
+
+gli::texture2d compressNormals(const Map& normal) {
+    gli::texture2d result(gli::FORMAT_RG_ATI2N_UNORM_BLOCK16, normal.texture.extent(), normal.texture.levels());
+    for (size_t level = 0; level < result.levels(); ++level) {
+        const auto extent = normal.texture[level].extent();
+        const uint32_t width = static_cast<uint32_t>(extent.x);
+        const uint32_t height = static_cast<uint32_t>(extent.y);
+        uint8_t* block = static_cast<uint8_t*>(result[level].data());
+        for (uint32_t blockY = 0; blockY < height; blockY += 4) {
+            for (uint32_t blockX = 0; blockX < width; blockX += 4) {
+                uint8_t xs[16];
+                uint8_t ys[16];
+                for (uint32_t i = 0; i < 16; ++i) {
+                    // Levels smaller than a block repeat their last row and column
+                    const uint32_t x = std::min(blockX + i % 4, width - 1);
+                    const uint32_t y = std::min(blockY + i / 4, height - 1);
+                    const float nx = normal.texel(level, x, y, 0) / 127.5f - 1.0f;
+                    const float ny = normal.texel(level, x, y, 1) / 127.5f - 1.0f;
+                    const float nz = normal.components > 2 ? normal.texel(level, x, y, 2) / 127.5f - 1.0f : 1.0f;
+                    // Filtered mip levels are shorter than unit length, which would bend the rebuilt z
+                    const float scale = 127.5f / std::max(std::sqrt(nx * nx + ny * ny + nz * nz), 1e-6f);
+                    xs[i] = static_cast<uint8_t>(std::lround(std::min(std::max(nx * scale + 127.5f, 0.0f), 255.0f)));
+                    ys[i] = static_cast<uint8_t>(std::lround(std::min(std::max(ny * scale + 127.5f, 0.0f), 255.0f)));
+                }
+                encodeBC4(xs, block);
+                encodeBC4(ys, block + 8);
+                block += 16;
+            }
+        }
+    }
+    return result;
+}
+
+void save(const gli::texture2d& texture, const std::string& filename) {
+    if (!gli::save_ktx(texture, filename)) {
+        throw std::runtime_error("Failed to write " + filename);
+    }
+}
+
+void usage() {
+    std::cerr << "usage: vkmaterial <ao> <roughness> <metallic> <normal> <orm> <normal bc5>" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 7) {
+        usage();
+        return 1;
+    }
+    try {
+        const Map ao = loadMap(argv[1], 1);
+        const Map roughness = loadMap(argv[2], 1);
+        const Map metallic = loadMap(argv[3], 1);
+        const Map normal = loadMap(argv[4], 2);
+        checkShape(roughness, ao);
+        checkShape(metallic, ao);
+        save(packORM(ao, roughness, metallic), argv[5]);
+        save(compressNormals(normal), argv[6]);
+        std::cout << "Packed " << argv[5] << " and " << argv[6] << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+* Asset packer
+*
+* Packs a directory tree into one file for vks::storage::Storage::mountPack, see base/vks/pack.hpp.
+*
+*   vkpack [--lz4] [--exclude <suffix>]... <directory> <pack>
+*
+* Files ending in .pack are never packed.  With --lz4, entries that compress by at least an eighth are stored
+* compressed, which costs a copy on every read of them, so directories of already compressed assets pack as well
+* without it.  The pack is read back and compared with the files once written.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(WIN32)
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "pack.hpp"
+
+using namespace vks::storage;
+
+namespace {
+
+bool endsWith(const std::string& value, const std::string& suffix) {
+    return value.size() >= suffix.size() && 0 == value.compare(value.size() - suffix.size(), suffix.size(), suffix);
+}
+
+// Paths of the files under `directory`, relative to it, with '/' separators
+void listFiles(const std::string& directory, const std::string& prefix, std::vector<std::string>& outPaths) {
+#if defined(WIN32)
+    WIN32_FIND_DATAA found;
+    HANDLE handle = FindFirstFileA((directory + "/*").c_str(), &found);
+    if (handle == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Failed to list " + directory);
+    }
+    do {
+        const std::string name = found.cFileName;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            listFiles(directory + "/" + name, prefix + name + "/", outPaths);
+        } else {
+            outPaths.push_back(prefix + name);
+        }
+    } while (FindNextFileA(handle, &found));
+    FindClose(handle);
+#else
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        throw std::runtime_error("Failed to list " + directory);
+    }
+    while (dirent* item = readdir(dir)) {
+        const std::string name = item->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        const std::string path = directory + "/" + name;
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) {
+            continue;
+        }
+        if (S_ISDIR(info.st_mode)) {
+            listFiles(path, prefix + name + "/", outPaths);
+        } else if (S_ISREG(info.st_mode)) {
+            outPaths.push_back(prefix + name);
+        }
+    }
+    closedir(dir);
+#endif
+}
+
+void usage() {
+    std::cerr << "usage: vkpack [--lz4] [--exclude <suffix>]... <directory> <pack>" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    bool compress = false;
+    std::vector<std::string> excluded{ ".pack" };
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--lz4") {
+            compress = true;
+        } else if (arg == "--exclude" && i + 1 < argc) {
+            excluded.push_back(argv[++i]);
+        } else if (arg.compare(0, 2, "--") == 0) {
+            usage();
+            return 1;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.size() != 2) {
+        usage();
+        return 1;
+    }
+    std::string directory = positional[0];
+    std::replace(directory.begin(), directory.end(), '\\', '/');
+    while (directory.size() > 1 && directory.back() == '/') {
+        directory.pop_back();
+    }
+    const std::string packFile = positional[1];
+
+    try {
+        std::vector<std::string> paths;
+        listFiles(directory, "", paths);
+        paths.erase(std::remove_if(paths.begin(), paths.end(),
+                                   [&](const std::string& path) {
+                                       return std::any_of(excluded.begin(), excluded.end(),
+                                                          [&](const std::string& suffix) { return endsWith(path, suffix); });
+                                   }),
+                    paths.end());
+        std::sort(paths.begin(), paths.end());
+
+        PackWriter writer(packFile, paths);
+        for (const auto& path : paths) {
+            auto contents = Storage::readFile(directory + "/" + path);
+            writer.add(path, contents->data(), contents->size(), compress);
+        }
+        const auto stats = writer.finish();
+
+        Pack pack(Storage::readFile(packFile));
+        for (const auto& path : paths) {
+            auto packed = pack.find(path);
+            auto contents = Storage::readFile(directory + "/" + path);
+            if (!packed || packed->size() != contents->size() || 0 != memcmp(packed->data(), contents->data(), contents->size())) {
+                throw std::runtime_error("Packed " + path + " doesn't match the file");
+            }
+        }
+
+        std::cout << "Packed " << stats.entries << " files, " << stats.compressed << " compressed, " << stats.inputBytes << " bytes into "
+                  << stats.storedBytes << " bytes: " << packFile << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}